@@ -15,12 +15,12 @@
 */
 
 #include "geometry_output.hpp"
-#include <fstream>
 #include <string>
+#include <vector>
 #include "pugixml.hpp"
 #include "util/error.hpp"
+#include "util/xdmf.hpp"
 
-using std::ofstream;
 using std::string;
 
 namespace mocc {
@@ -32,12 +32,14 @@ void output_geometry(const pugi::xml_node &input, const CoreMesh &mesh)
         throw EXCEPT("No input for geometry output.");
     }
 
-    string file;
-    if (input.attribute("file").empty()) {
-        file = "geom.py";
-    }
-    else {
-        file = input.attribute("file").value();
+    // Strip any extension from the file name, since both an .h5 and an
+    // .xdmf file are written
+    string stem  = input.attribute("file").as_string("geom");
+    size_t slash = stem.find_last_of('/');
+    size_t dot   = stem.find_last_of('.');
+    if ((dot != string::npos) &&
+        ((slash == string::npos) || (dot > slash + 1))) {
+        stem.erase(dot);
     }
 
     int plane = input.attribute("plane").as_int(0);
@@ -45,76 +47,61 @@ void output_geometry(const pugi::xml_node &input, const CoreMesh &mesh)
         throw EXCEPT("Invalid plane specified.");
     }
 
-    ofstream out(file);
-
-    // boilerplate
-    out << "import cairo as cr" << std::endl;
-    out << "import math" << std::endl;
-    out << "import rays" << std::endl;
-    out << std::endl;
-    out << "twopi = math.pi*2" << std::endl;
-    out << std::endl;
-    out << "# set this to whichever angle of ray you want to show."
-           " Negative value to disable."
-        << std::endl;
-    out << "angle = -1" << std::endl;
-    out << std::endl;
-    out << "mesh_lines = []" << std::endl;
-    out << std::endl;
-    out << "core_dims = [" << mesh.hx_core() << ", " << mesh.hy_core() << "]"
-        << std::endl;
-    out << "" << std::endl;
-    out << "surface = cr.PDFSurface(\"geometry.pdf\", 720, 720)" << std::endl;
-    out << "ctx = cr.Context(surface)" << std::endl;
-    out << "ctx.scale(720/core_dims[0], -720/core_dims[1])" << std::endl;
-    out << "ctx.translate(0, -core_dims[1])" << std::endl;
-    out << "" << std::endl;
-
-    // do all of the mesh stuff
-    out << "ctx.set_line_width(0.001)" << std::endl;
-    out << "" << std::endl;
-    out << "ctx.set_source_rgb(0, 0, 0)" << std::endl;
-    out << "" << std::endl;
-
-    for (auto l : mesh.lines()) {
-        out << "mesh_lines.append(" << l << ")" << std::endl;
+    int n_arc = input.attribute("arc_segments").as_int(32);
+    if (n_arc < 4) {
+        throw EXCEPT("Too few arc segments specified.");
     }
 
-    // Draw the core lines
-    out << "" << std::endl;
-    out << "for l in mesh_lines:" << std::endl;
-    out << "    p1 = l[0]" << std::endl;
-    out << "    p2 = l[1]" << std::endl;
-    out << "    ctx.move_to(p1[0], p1[1])" << std::endl;
-    out << "    ctx.line_to(p2[0], p2[1])" << std::endl;
-
-    out << std::endl;
-
-    // Draw the pin meshes
-    int ipin = 0;
-    for (auto pin = mesh.begin(plane); pin != mesh.end(plane); ++pin) {
-        out << "print \"drawing pin \" + str(" << ipin << ")" << std::endl;
-        const PinMesh &pm = (*pin)->mesh();
-        Point2 origin     = mesh.pin_origin(ipin);
-
-        out << "ctx.translate(" << origin.x << ", " << origin.y << ")" << std::endl;
-
-        out << pm.draw() << std::endl;
-        out << "ctx.translate(" << -origin.x << ", " << -origin.y << ")" << std::endl
-            << std::endl;
-        ipin++;
+    // Mesh lines
+    XDMFGrid lines("mesh_lines");
+    for (const auto &l : mesh.lines()) {
+        lines.add_cell(std::vector<Point2>{l.p1, l.p2}, false);
     }
 
-    out << std::endl;
-
-    // Do ray output
-    out << "if angle >= 0:" << std::endl;
-    out << "    ctx.set_source_rgb(0, 0, 1)" << std::endl;
-    out << "    rays.draw_rays(ctx, angle)" << std::endl;
-    out << "" << std::endl;
+    // Flat source regions, walking the lattices of the plane and the pins of
+    // each. Regions are visited in the same order as their indices.
+    XDMFGrid regions("regions");
+    VecI reg_ids;
+    VecI mat_ids;
+    int iplane       = mesh.unique_plane_id(plane);
+    const Core &core = mesh.core();
+    for (int iy = 0; iy < core.ny(); iy++) {
+        for (int ix = 0; ix < core.nx(); ix++) {
+            const auto &instance   = mesh.lattice_instance(iplane, ix, iy);
+            const Lattice &lattice = core.at(ix, iy)[plane];
+            int ireg               = instance.reg_offset;
+            real_t y               = instance.origin.y;
+            for (unsigned iy_pin = 0; iy_pin < lattice.ny(); iy_pin++) {
+                real_t x  = instance.origin.x;
+                real_t hy = lattice.hy_vec()[iy_pin];
+                for (unsigned ix_pin = 0; ix_pin < lattice.nx(); ix_pin++) {
+                    real_t hx      = lattice.hx_vec()[ix_pin];
+                    const Pin &pin = lattice.at(ix_pin, iy_pin);
+                    const auto &pm = pin.mesh();
+                    Point2 center(x + 0.5 * hx, y + 0.5 * hy);
+                    auto polygons = pm.polygons(n_arc);
+                    for (auto &polygon : polygons) {
+                        for (auto &p : polygon) {
+                            p.x += center.x;
+                            p.y += center.y;
+                        }
+                        regions.add_cell(polygon, true);
+                        reg_ids.push_back(ireg++);
+                    }
+                    for (int ixs = 0; ixs < pm.n_xsreg(); ixs++) {
+                        mat_ids.insert(mat_ids.end(), pm.n_fsrs(ixs),
+                                       pin.mat_ids()[ixs]);
+                    }
+                    x += hx;
+                }
+                y += hy;
+            }
+        }
+    }
+    regions.attributes.emplace_back("region", reg_ids);
+    regions.attributes.emplace_back("material", mat_ids);
 
-    out << "surface.finish()" << std::endl;
-    out << "" << std::endl;
+    write_xdmf(stem, {lines, regions});
 
     return;
 }
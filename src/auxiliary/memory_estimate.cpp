@@ -0,0 +1,213 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "memory_estimate.hpp"
+
+#include <string>
+#include "pugixml.hpp"
+#include "util/error.hpp"
+#include "util/files.hpp"
+#include "core/angular_quadrature.hpp"
+#include "core/xs_mesh.hpp"
+#include "core/xs_mesh_homogenized.hpp"
+#include "mc/particle.hpp"
+#include "moc/ray_data.hpp"
+
+namespace {
+using namespace mocc;
+
+// Find the <ang_quad> that a sweeper would use, searching up the tree from
+// the sweeper input
+AngularQuadrature find_ang_quad(const pugi::xml_node &input)
+{
+    for (auto node = input; !node.empty(); node = node.parent()) {
+        if (!node.child("ang_quad").empty()) {
+            return AngularQuadrature(node.child("ang_quad"));
+        }
+    }
+    throw EXCEPT("Reached document root without finding an angular "
+                 "quadrature specification.");
+}
+
+// Scalar flux, old flux and volumes, plus the group source
+void estimate_flux(MemoryReport &report, size_t n_reg, size_t n_group)
+{
+    report.add("flux", (2 * n_reg * n_group + n_reg) * sizeof(real_t));
+    return;
+}
+
+void estimate_moc(MemoryReport &report, const pugi::xml_node &input,
+                  const CoreMesh &mesh)
+{
+    XSMesh xs_mesh(mesh, MeshTreatment::PLANE);
+    size_t n_reg   = mesh.n_reg(MeshTreatment::PLANE);
+    size_t n_group = xs_mesh.n_group();
+
+    estimate_flux(report, n_reg, n_group);
+    report.add("xs_mesh", xs_mesh.memory());
+
+    AngularQuadrature ang_quad = find_ang_quad(input);
+    moc::RayData rays(input.child("rays"), ang_quad, mesh);
+    report.add("rays", rays.memory());
+
+    // Each ray has a boundary value at both ends, for all groups on the
+    // incoming side and one group on the outgoing side, for every plane
+    size_t n_bc = 0;
+    for (int iang = 0; iang < (int)rays.begin()->size(); iang++) {
+        n_bc += 2 * (rays.nx(iang) + rays.ny(iang));
+    }
+    report.add("boundary", n_bc * (n_group + 1) * mesh.nz() * sizeof(real_t));
+
+    report.add("work_arrays", 2 * n_reg * sizeof(real_t));
+    return;
+}
+
+void estimate_sn(MemoryReport &report, const pugi::xml_node &input,
+                 const CoreMesh &mesh)
+{
+    XSMeshHomogenized xs_mesh(mesh);
+    size_t n_reg   = mesh.n_pin();
+    size_t n_group = xs_mesh.n_group();
+
+    estimate_flux(report, n_reg, n_group);
+    report.add("xs_mesh", xs_mesh.memory());
+
+    AngularQuadrature ang_quad = find_ang_quad(input);
+    size_t nx   = mesh.nx();
+    size_t ny   = mesh.ny();
+    size_t nz   = mesh.nz();
+    size_t n_bc = ang_quad.ndir() * (ny * nz + nx * nz + nx * ny);
+    report.add("boundary", n_bc * (n_group + 1) * sizeof(real_t));
+
+    report.add("work_arrays", n_reg * sizeof(real_t));
+    return;
+}
+
+void estimate_sweeper(MemoryReport &report, const pugi::xml_node &input,
+                      const CoreMesh &mesh)
+{
+    std::string type = input.attribute("type").value();
+    if ((type == "moc") || (type == "moc_2d3d")) {
+        estimate_moc(report, input, mesh);
+    } else if (type == "sn") {
+        estimate_sn(report, input, mesh);
+    } else if (type == "2d3d") {
+        estimate_sn(report.child("sn"), input.child("sn_sweeper"), mesh);
+        estimate_moc(report.child("moc"), input.child("moc_sweeper"), mesh);
+
+        // The correction factors use the MoC quadrature, with two alphas and
+        // one beta per coarse cell, half-space angle and group
+        AngularQuadrature ang_quad =
+            find_ang_quad(input.child("moc_sweeper"));
+        size_t n_group = mesh.mat_lib().n_group();
+        size_t n_cell  = mesh.nx() * mesh.ny() * mesh.macroplanes().size();
+        report.add("corrections", 3 * n_cell * (ang_quad.ndir() / 2) *
+                                      n_group * sizeof(real_t));
+        report.add("projection", 3 * mesh.n_pin() * n_group * sizeof(real_t));
+    } else {
+        throw EXCEPT("Failed to detect a valid sweeper type.");
+    }
+    return;
+}
+
+void estimate_cmfd(MemoryReport &report, const CoreMesh &mesh)
+{
+    size_t n_group = mesh.mat_lib().n_group();
+    size_t n_cell  = mesh.n_pin();
+    size_t n_surf  = mesh.n_surf();
+
+    // A seven-point stencil in 3-D, five-point in 2-D. Each non-zero stores
+    // a value and a column index, and there is a row index per cell.
+    size_t stencil = (mesh.nz() > 1) ? 7 : 5;
+    size_t nnz     = stencil * n_cell;
+    report.add("matrices",
+               n_group * (nnz * (sizeof(real_t) + sizeof(int)) +
+                          (n_cell + 1) * sizeof(int)));
+
+    // Net and partial currents and surface flux on each surface, and the
+    // current and old flux in each cell
+    report.add("coarse_data",
+               n_group * (6 * n_surf + 2 * n_cell) * sizeof(real_t));
+    report.add("surface_coefficients", 4 * n_surf * n_group * sizeof(real_t));
+    report.add("vectors", 5 * n_cell * sizeof(real_t));
+    return;
+}
+
+void estimate_mc(MemoryReport &report, const pugi::xml_node &input,
+                 const CoreMesh &mesh)
+{
+    XSMesh xs_mesh(mesh, MeshTreatment::TRUE);
+    size_t n_group = xs_mesh.n_group();
+    report.add("xs_mesh", xs_mesh.memory());
+
+    int n_particles = input.attribute("particles_per_cycle").as_int(0);
+    if (n_particles <= 0) {
+        throw EXCEPT("Invalid number of particles per cycle.");
+    }
+    report.add("source_bank", n_particles * sizeof(Particle));
+
+    // The pusher's fission bank is usually a little larger than the source
+    // bank, since it is the product of the source and k
+    auto &pusher = report.child("pusher");
+    pusher.add("fission_bank", n_particles * sizeof(Particle));
+
+    // Mean and second moment for the coarse and fine flux in every group,
+    // and the pin powers
+    size_t n_reg = mesh.n_reg(MeshTreatment::TRUE);
+    pusher.add("tallies", (n_group * (mesh.n_pin() + 2 * n_reg) +
+                           mesh.n_pin()) *
+                              2 * sizeof(real_t));
+    return;
+}
+}
+
+namespace mocc {
+namespace aux {
+MemoryReport estimate_memory(const pugi::xml_node &input, const CoreMesh &mesh)
+{
+    if (input.empty()) {
+        throw EXCEPT("No <solver> input to estimate memory for.");
+    }
+
+    LogScreen << "Estimating memory requirements (dry run)" << std::endl;
+
+    MemoryReport report("Estimated memory");
+
+    std::string type = input.attribute("type").value();
+    if ((type == "eigenvalue") || (type == "fixed_source")) {
+        // Sn sweepers work on the pin mesh, all others on the FSRs
+        std::string sweeper = input.child("sweeper").attribute("type").value();
+        size_t n_reg = (sweeper == "sn") ? mesh.n_pin()
+                                         : mesh.n_reg(MeshTreatment::PLANE);
+        if (type == "eigenvalue") {
+            report.add("fission_source", 2 * n_reg * sizeof(real_t));
+        }
+        report.add("source", 2 * n_reg * sizeof(real_t));
+        estimate_sweeper(report.child("sweeper"), input.child("sweeper"),
+                         mesh);
+        if (input.attribute("cmfd").as_bool(false)) {
+            estimate_cmfd(report.child("cmfd"), mesh);
+        }
+    } else if (type == "eigenvalue_mc") {
+        estimate_mc(report, input, mesh);
+    } else {
+        throw EXCEPT("Unrecognized solver type.");
+    }
+
+    return report;
+}
+}
+}
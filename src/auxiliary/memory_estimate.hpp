@@ -0,0 +1,44 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include "util/memory.hpp"
+#include "util/pugifwd.hpp"
+#include "core/core_mesh.hpp"
+
+namespace mocc {
+namespace aux {
+/**
+ * \brief Estimate the memory that the solver described by \p input would
+ * need, without constructing it
+ *
+ * This is used for dry runs, to check whether a case will fit on a machine
+ * before committing to it. The cross-section mesh and, for MoC sweepers, the
+ * ray data are actually built, since their sizes depend on the geometry in
+ * ways that are hard to predict; they are also generally cheap compared to
+ * the flux and boundary condition arrays, which are estimated from the mesh
+ * and quadrature dimensions and not allocated. The estimate is laid out the
+ * same as the report produced by \ref Solver::memory(), so the two may be
+ * compared.
+ *
+ * \param input the \<solver\> tag of the input document
+ * \param mesh the \ref CoreMesh
+ */
+MemoryReport estimate_memory(const pugi::xml_node &input,
+                             const CoreMesh &mesh);
+}
+}
@@ -0,0 +1,264 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "bench.hpp"
+
+#include <omp.h>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "util/error.hpp"
+#include "util/files.hpp"
+#include "util/global_config.hpp"
+#include "util/tee_stream.hpp"
+
+using namespace mocc;
+using namespace mocc::bench;
+
+namespace {
+struct Options {
+    std::string filter;
+    std::string output = "mocc_bench.json";
+    double min_time    = 1.0;
+    std::vector<int> threads;
+    bool list = false;
+};
+
+void print_usage()
+{
+    std::cout << "Usage: mocc_bench [options]\n"
+              << "  --list            list the available benchmarks\n"
+              << "  --filter <str>    only run benchmarks containing <str>\n"
+              << "  --min-time <s>    minimum time per measurement [1.0]\n"
+              << "  --threads <list>  comma-separated thread counts\n"
+              << "                    [1, 2, 4, ... max]\n"
+              << "  --output <file>   JSON results file [mocc_bench.json]\n";
+}
+
+std::vector<int> default_threads()
+{
+    std::vector<int> threads;
+    int max_threads = omp_get_max_threads();
+    for (int n = 1; n < max_threads; n *= 2) {
+        threads.push_back(n);
+    }
+    threads.push_back(max_threads);
+    return threads;
+}
+
+Options parse_args(int argc, char *argv[])
+{
+    Options opts;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--list") {
+            opts.list = true;
+            continue;
+        }
+        if (arg == "--help" || arg == "-h") {
+            print_usage();
+            std::exit(EXIT_SUCCESS);
+        }
+        if (i + 1 >= argc) {
+            throw EXCEPT("Missing value for option " + arg);
+        }
+        std::string value = argv[++i];
+        if (arg == "--filter") {
+            opts.filter = value;
+        } else if (arg == "--output") {
+            opts.output = value;
+        } else if (arg == "--min-time") {
+            opts.min_time = std::atof(value.c_str());
+            if (opts.min_time <= 0.0) {
+                throw EXCEPT("Invalid --min-time");
+            }
+        } else if (arg == "--threads") {
+            std::stringstream ss(value);
+            std::string token;
+            while (std::getline(ss, token, ',')) {
+                int n = std::atoi(token.c_str());
+                if (n < 1) {
+                    throw EXCEPT("Invalid thread count: " + token);
+                }
+                opts.threads.push_back(n);
+            }
+        } else {
+            throw EXCEPT("Unrecognized option: " + arg);
+        }
+    }
+
+    if (opts.threads.empty()) {
+        opts.threads = default_threads();
+    }
+
+    return opts;
+}
+
+/**
+ * Run one benchmark on the current number of threads. The kernel is called
+ * once untimed to warm caches and first-touch any lazily-allocated storage,
+ * then repeatedly until the minimum time has elapsed.
+ */
+Result measure(const Benchmark &bench, int threads, double min_time)
+{
+    Kernel_t kernel = bench.setup();
+    kernel();
+
+    double work    = 0.0;
+    int reps       = 0;
+    double t0      = omp_get_wtime();
+    double elapsed = 0.0;
+    do {
+        work += kernel();
+        reps++;
+        elapsed = omp_get_wtime() - t0;
+    } while (elapsed < min_time);
+
+    return {bench.name, bench.unit, threads, reps, elapsed, work};
+}
+
+void write_json(const std::string &fname, const Options &opts,
+                const std::vector<Result> &results)
+{
+    std::ofstream out(fname);
+    if (!out.good()) {
+        throw EXCEPT("Failed to open benchmark output: " + fname);
+    }
+
+    out << std::setprecision(8);
+    out << "{\n";
+    out << "  \"max_threads\": " << omp_get_max_threads() << ",\n";
+    out << "  \"min_time\": " << opts.min_time << ",\n";
+    out << "  \"results\": [";
+    for (unsigned i = 0; i < results.size(); i++) {
+        const auto &r = results[i];
+
+        // Scaling relative to the single-thread result for the same
+        // benchmark, if there is one
+        double speedup = 0.0;
+        for (const auto &base : results) {
+            if (base.name == r.name && base.threads == 1) {
+                speedup = r.rate() / base.rate();
+            }
+        }
+
+        out << (i == 0 ? "\n" : ",\n");
+        out << "    {\"name\": \"" << r.name << "\", "
+            << "\"threads\": " << r.threads << ", "
+            << "\"reps\": " << r.reps << ", "
+            << "\"seconds\": " << r.seconds << ", "
+            << "\"work\": " << r.work << ", "
+            << "\"unit\": \"" << r.unit << "\", "
+            << "\"rate\": " << r.rate() << ", "
+            << "\"ns_per_unit\": " << r.ns_per_unit();
+        if (speedup > 0.0) {
+            out << ", \"speedup\": " << speedup
+                << ", \"efficiency\": " << speedup / r.threads;
+        }
+        out << "}";
+    }
+    out << "\n  ]\n}\n";
+}
+} // namespace
+
+namespace mocc {
+namespace bench {
+std::vector<Benchmark> &registry()
+{
+    static std::vector<Benchmark> benchmarks;
+    return benchmarks;
+}
+
+std::unique_ptr<pugi::xml_document> load_case(const std::string &fname,
+                                              const std::string &extra)
+{
+    std::unique_ptr<pugi::xml_document> doc(new pugi::xml_document);
+    pugi::xml_parse_result result = doc->load_file(fname.c_str());
+    if (!result) {
+        throw EXCEPT("Failed to load benchmark input " + fname + ": " +
+                     result.description());
+    }
+    if (!extra.empty()) {
+        result = doc->append_buffer(extra.c_str(), extra.size());
+        if (!result) {
+            throw EXCEPT(std::string("Malformed benchmark options: ") +
+                         result.description());
+        }
+    }
+    return doc;
+}
+}
+}
+
+int main(int argc, char *argv[])
+{
+    try {
+        Options opts = parse_args(argc, argv);
+
+        if (opts.list) {
+            for (const auto &b : registry()) {
+                std::cout << b.name << std::endl;
+            }
+            return EXIT_SUCCESS;
+        }
+
+        // Keep the chatter from sweeper construction out of the results
+        StartLogFile("mocc_bench");
+        static onullstream null_stream;
+        LogScreen.reset(LogFile, null_stream);
+
+        std::vector<Result> results;
+        std::cout << std::left << std::setw(32) << "benchmark" << std::right
+                  << std::setw(8) << "threads" << std::setw(14) << "rate"
+                  << std::setw(14) << "ns/unit"
+                  << "  unit" << std::endl;
+        for (const auto &b : registry()) {
+            if (b.name.find(opts.filter) == std::string::npos) {
+                continue;
+            }
+            std::vector<int> threads = opts.threads;
+            if (!b.threaded) {
+                threads = {1};
+            }
+            for (int n : threads) {
+                omp_set_num_threads(n);
+                LogFile << "Benchmark: " << b.name << " threads: " << n
+                        << std::endl;
+                Result r = measure(b, n, opts.min_time);
+                std::cout << std::left << std::setw(32) << r.name
+                          << std::right << std::setw(8) << r.threads
+                          << std::setw(14) << std::setprecision(5)
+                          << r.rate() << std::setw(14) << r.ns_per_unit()
+                          << "  " << r.unit << "/s" << std::endl;
+                results.push_back(r);
+            }
+        }
+
+        write_json(opts.output, opts, results);
+        std::cout << "Results written to " << opts.output << std::endl;
+    }
+    catch (Exception e) {
+        std::cerr << "Error:" << std::endl;
+        std::cerr << e.what();
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
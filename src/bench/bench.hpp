@@ -0,0 +1,109 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "pugixml.hpp"
+
+/**
+ * \file bench.hpp
+ * \brief A minimal benchmark harness for the \c mocc_bench target.
+ *
+ * Each benchmark registers itself through a static \ref
+ * mocc::bench::Register object. The harness calls the benchmark's setup
+ * function once for each thread count under test, and then times repeated
+ * calls to the returned kernel until a minimum wall time has elapsed. Each
+ * kernel call returns the amount of work it did, in the units of the
+ * benchmark (segments, particles, etc.), from which the rates are computed.
+ */
+
+namespace mocc {
+namespace bench {
+/**
+ * \brief A single repetition of a benchmark, returning the amount of work
+ * done.
+ */
+typedef std::function<double()> Kernel_t;
+
+/**
+ * \brief Prepare a benchmark for the current number of OpenMP threads,
+ * returning the kernel to be timed.
+ *
+ * All expensive setup (ray tracing, cross-section expansion, etc.) should be
+ * done here, so that it is not included in the timings.
+ */
+typedef std::function<Kernel_t()> Setup_t;
+
+struct Benchmark {
+    std::string name;
+    // Unit of the work returned by the kernel, e.g. "segment"
+    std::string unit;
+    // Whether the benchmark should be run across the thread sweep. Serial
+    // benchmarks are only run once, on a single thread.
+    bool threaded;
+    Setup_t setup;
+};
+
+struct Result {
+    std::string name;
+    std::string unit;
+    int threads;
+    int reps;
+    double seconds;
+    double work;
+
+    double rate() const
+    {
+        return work / seconds;
+    }
+
+    double ns_per_unit() const
+    {
+        return 1.0e9 * seconds / work;
+    }
+};
+
+/**
+ * \brief Return the global list of registered benchmarks
+ */
+std::vector<Benchmark> &registry();
+
+/**
+ * \brief Load a geometry input file, appending extra XML to it.
+ *
+ * The geometry inputs shared with the unit tests only describe the mesh and
+ * materials, so the sweeper/solver options for each benchmark are appended
+ * here.
+ */
+std::unique_ptr<pugi::xml_document> load_case(const std::string &fname,
+                                              const std::string &extra);
+
+/**
+ * \brief Register a benchmark at static-initialization time
+ */
+struct Register {
+    Register(const std::string &name, const std::string &unit, bool threaded,
+             Setup_t setup)
+    {
+        registry().push_back({name, unit, threaded, setup});
+    }
+};
+}
+}
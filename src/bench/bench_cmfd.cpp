@@ -0,0 +1,69 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "bench.hpp"
+
+#include <memory>
+#include <string>
+#include "util/global_config.hpp"
+#include "core/cmfd.hpp"
+#include "core/core_mesh.hpp"
+#include "core/xs_mesh_homogenized.hpp"
+
+using namespace mocc;
+using namespace mocc::bench;
+
+// A full CMFD eigenvalue solve on the C5G7 pin mesh, starting each time from
+// a flat flux guess, as on the first outer iteration of a transport solve.
+namespace {
+const std::string cmfd_options = "<cmfd k_tol=\"1e-10\" "
+                                 "psi_tol=\"1e-8\" "
+                                 "max_iter=\"500\" "
+                                 "enabled=\"t\" "
+                                 "negative_fixup=\"f\" />";
+
+struct CMFDCase {
+    CMFDCase(const std::string &fname)
+        : doc(load_case(fname, cmfd_options)),
+          mesh(*doc),
+          xsmesh(std::make_shared<XSMeshHomogenized>(mesh)),
+          cmfd(doc->child("cmfd"), &mesh, xsmesh)
+    {
+        return;
+    }
+
+    std::unique_ptr<pugi::xml_document> doc;
+    CoreMesh mesh;
+    std::shared_ptr<XSMeshHomogenized> xsmesh;
+    CMFD cmfd;
+};
+
+Setup_t cmfd_solve(const std::string &fname)
+{
+    return [fname]() -> Kernel_t {
+        auto c = std::make_shared<CMFDCase>(fname);
+        return [c]() {
+            c->cmfd.coarse_data().flux = 1.0;
+            real_t k = 1.0;
+            c->cmfd.solve(k);
+            return 1.0;
+        };
+    };
+}
+
+Register solve_c5g7("cmfd_solve/c5g7_2d", "solve", true,
+                    cmfd_solve("c5g7_2d.xml"));
+}
@@ -0,0 +1,73 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "bench.hpp"
+
+#include <omp.h>
+#include <memory>
+#include <string>
+#include "util/global_config.hpp"
+#include "util/rng_lcg.hpp"
+#include "core/exponential.hpp"
+
+using namespace mocc;
+using namespace mocc::bench;
+
+// Throughput of the batched exponential evaluators. Each thread evaluates
+// its own batches, so this measures the raw evaluation rate and how well it
+// scales with memory bandwidth, independent of the sweep.
+namespace {
+const int batch_size = 4096;
+const int n_batch    = 256;
+
+Setup_t exponential(const std::string &type)
+{
+    return [type]() -> Kernel_t {
+        std::shared_ptr<Exponential> exp(ExponentialFactory(type));
+
+        // Arguments spread over the domain of the tables, as seen for optical
+        // thicknesses in a typical sweep
+        auto args = std::make_shared<VecF>(batch_size);
+        RNG_LCG rng(11112854149);
+        for (auto &v : *args) {
+            v = -rng.random(10.0);
+        }
+
+        return [exp, args]() {
+            int n_thread = 1;
+#pragma omp parallel
+            {
+#pragma omp single
+                n_thread = omp_get_num_threads();
+
+                VecF out(batch_size);
+                for (int i = 0; i < n_batch; i++) {
+                    exp->exp_n(args->data(), out.data(), batch_size);
+                }
+            }
+            return (double)n_thread * n_batch * batch_size;
+        };
+    };
+}
+
+Register exact("exponential/exact", "exp", true, exponential("exact"));
+Register linear("exponential/linear", "exp", true, exponential("linear"));
+Register clamped("exponential/clamped", "exp", true, exponential("clamped"));
+Register quadratic("exponential/quadratic", "exp", true,
+                   exponential("quadratic"));
+Register polynomial("exponential/polynomial", "exp", true,
+                    exponential("polynomial"));
+}
@@ -0,0 +1,81 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "bench.hpp"
+
+#include <memory>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include "util/global_config.hpp"
+#include "util/rng_lcg.hpp"
+#include "core/core_mesh.hpp"
+#include "core/xs_mesh.hpp"
+#include "mc/fission_bank.hpp"
+#include "mc/particle_pusher.hpp"
+
+using namespace mocc;
+using namespace mocc::bench;
+
+// One Monte Carlo cycle on the C5G7 geometry, simulating a fixed source bank
+// sampled over the fissile regions of the whole core.
+namespace {
+const int n_particle = 10000;
+
+struct MCCase {
+    MCCase(const std::string &fname)
+        : doc(load_case(fname, "")),
+          mesh(*doc),
+          xs_mesh(mesh, MeshTreatment::TRUE),
+          pusher(mesh, xs_mesh)
+    {
+        const VecF &dz = mesh.pin_dz();
+        std::stringstream box;
+        box << "<fission_box x_min=\"0.0\" x_max=\"" << mesh.hx_core()
+            << "\" y_min=\"0.0\" y_max=\"" << mesh.hy_core()
+            << "\" z_min=\"0.0\" z_max=\""
+            << std::accumulate(dz.begin(), dz.end(), 0.0) << "\" />";
+        box_xml.load_string(box.str().c_str());
+
+        RNG_LCG rng(11112854149);
+        bank.reset(new FissionBank(box_xml.child("fission_box"), n_particle,
+                                   mesh, xs_mesh, rng));
+        return;
+    }
+
+    std::unique_ptr<pugi::xml_document> doc;
+    CoreMesh mesh;
+    XSMesh xs_mesh;
+    ParticlePusher pusher;
+    pugi::xml_document box_xml;
+    std::unique_ptr<FissionBank> bank;
+};
+
+Setup_t mc_cycle(const std::string &fname)
+{
+    return [fname]() -> Kernel_t {
+        auto c = std::make_shared<MCCase>(fname);
+        return [c]() {
+            c->pusher.simulate(*c->bank, 1.0);
+            c->pusher.reset_tallies();
+            return (double)c->bank->size();
+        };
+    };
+}
+
+Register cycle_c5g7("mc_cycle/c5g7_2d", "particle", true,
+                    mc_cycle("c5g7_2d.xml"));
+}
@@ -0,0 +1,119 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "bench.hpp"
+
+#include <memory>
+#include <string>
+#include "util/global_config.hpp"
+#include "core/angular_quadrature.hpp"
+#include "core/core_mesh.hpp"
+#include "moc/ray_data.hpp"
+#include "sweep_case.hpp"
+
+using namespace mocc;
+using namespace mocc::bench;
+
+// MoC benchmarks: single-group sweeps on the C5G7 and large geometries, MoC
+// source construction, and ray tracing. Sweep and tracing rates are reported
+// per segment, counting both directions of each ray.
+namespace {
+const std::string moc_options = "<source scattering=\"P0\" />"
+                                "<sweeper type=\"moc\" n_inner=\"1\">"
+                                "    <ang_quad type=\"ls\" order=\"4\" />"
+                                "    <rays spacing=\"0.05\" />"
+                                "</sweeper>";
+
+/**
+ * The number of segments swept in a single inner iteration over every
+ * macroplane, counting each ray in both directions.
+ */
+double count_segments(const moc::RayData &rays, const CoreMesh &mesh)
+{
+    double n_seg = 0.0;
+    for (const auto &mplane : mesh.macroplanes()) {
+        n_seg += rays.n_segments(mesh.unique_plane_ids()[mplane.iz_min]);
+    }
+    return n_seg;
+}
+
+/**
+ * Trace a stand-alone copy of the rays, using the same options as the
+ * sweeper, to count segments.
+ */
+double count_segments(const SweepCase &c)
+{
+    const auto sweeper_xml = c.doc->child("sweeper");
+    AngularQuadrature ang_quad(sweeper_xml.child("ang_quad"));
+    moc::RayData rays(sweeper_xml.child("rays"), ang_quad, c.mesh);
+    return count_segments(rays, c.mesh);
+}
+
+Setup_t moc_sweep(const std::string &fname, int group)
+{
+    return [fname, group]() -> Kernel_t {
+        auto c       = std::make_shared<SweepCase>(fname, moc_options);
+        double n_seg = count_segments(*c);
+        c->update_source(group);
+        return [c, group, n_seg]() {
+            c->sweeper->sweep(group);
+            return n_seg;
+        };
+    };
+}
+
+Setup_t moc_source(const std::string &fname)
+{
+    return [fname]() -> Kernel_t {
+        auto c = std::make_shared<SweepCase>(fname, moc_options);
+        return [c]() {
+            for (int ig = 0; ig < c->sweeper->n_group(); ig++) {
+                c->update_source(ig);
+            }
+            return (double)c->sweeper->n_reg() * c->sweeper->n_group();
+        };
+    };
+}
+
+Setup_t ray_trace(const std::string &fname)
+{
+    return [fname]() -> Kernel_t {
+        auto doc      = std::shared_ptr<pugi::xml_document>(
+            load_case(fname, moc_options));
+        auto mesh     = std::make_shared<CoreMesh>(*doc);
+        auto ang_quad = std::make_shared<AngularQuadrature>(
+            doc->child("sweeper").child("ang_quad"));
+        return [doc, mesh, ang_quad]() {
+            moc::RayData rays(doc->child("sweeper").child("rays"), *ang_quad,
+                              *mesh);
+            return count_segments(rays, *mesh);
+        };
+    };
+}
+
+// Sweep both the fast and the most thermal group, since the distribution of
+// optical thicknesses, and therefore the exponential cost, differs between them
+Register sweep_c5g7("moc_sweep/c5g7_2d", "segment", true,
+                    moc_sweep("c5g7_2d.xml", 0));
+Register sweep_c5g7_thermal("moc_sweep/c5g7_2d/thermal", "segment", true,
+                            moc_sweep("c5g7_2d.xml", 6));
+Register sweep_large("moc_sweep/large", "segment", true,
+                     moc_sweep("large.xml", 0));
+Register source_c5g7("moc_source/c5g7_2d", "region-group", true,
+                     moc_source("c5g7_2d.xml"));
+Register trace_c5g7("ray_trace/c5g7_2d", "segment", true,
+                    ray_trace("c5g7_2d.xml"));
+}
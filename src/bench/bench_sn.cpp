@@ -0,0 +1,60 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "bench.hpp"
+
+#include <memory>
+#include <string>
+#include "util/global_config.hpp"
+#include "sweep_case.hpp"
+
+using namespace mocc;
+using namespace mocc::bench;
+
+// Single-group Sn sweeps on the C5G7 pin mesh, for each of the ways of
+// distributing the sweep among threads. Rates are per cell-angle, the unit of
+// work for one application of the diamond-difference equations.
+namespace {
+std::string sn_options(const std::string &mode)
+{
+    return "<source scattering=\"P0\" />"
+           "<sweeper type=\"sn\" n_inner=\"1\" sweep=\"" +
+           mode + "\">"
+                  "    <ang_quad type=\"ls\" order=\"4\" />"
+                  "</sweeper>";
+}
+
+Setup_t sn_sweep(const std::string &fname, const std::string &mode)
+{
+    return [fname, mode]() -> Kernel_t {
+        auto c = std::make_shared<SweepCase>(fname, sn_options(mode));
+        c->update_source(0);
+        double work = (double)c->sweeper->n_reg() *
+                      c->sweeper->ang_quad().ndir();
+        return [c, work]() {
+            c->sweeper->sweep(0);
+            return work;
+        };
+    };
+}
+
+Register angle("sn_sweep/c5g7_2d/angle", "cell-angle", true,
+               sn_sweep("c5g7_2d.xml", "angle"));
+Register wavefront("sn_sweep/c5g7_2d/wavefront", "cell-angle", true,
+                   sn_sweep("c5g7_2d.xml", "wavefront"));
+Register octant("sn_sweep/c5g7_2d/octant", "cell-angle", true,
+                sn_sweep("c5g7_2d.xml", "octant"));
+}
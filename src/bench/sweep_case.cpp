@@ -0,0 +1,49 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "sweep_case.hpp"
+
+#include "bench.hpp"
+#include "transport_sweeper_factory.hpp"
+
+namespace mocc {
+namespace bench {
+SweepCase::SweepCase(const std::string &fname, const std::string &options)
+    : doc(load_case(fname, options)),
+      mesh(*doc),
+      sweeper(TransportSweeperFactory(*doc, mesh)),
+      source(sweeper->create_source(doc->child("source"))),
+      fission_source(sweeper->n_reg())
+{
+    sweeper->assign_source(source.get());
+    sweeper->initialize();
+
+    fission_source = 0.0;
+    sweeper->calc_fission_source(1.0, fission_source);
+
+    return;
+}
+
+void SweepCase::update_source(int group)
+{
+    source->initialize_group(group);
+    source->fission(fission_source, group);
+    source->in_scatter(group);
+
+    return;
+}
+}
+}
@@ -0,0 +1,53 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include "pugixml.hpp"
+#include "util/blitz_typedefs.hpp"
+#include "core/core_mesh.hpp"
+#include "core/source.hpp"
+#include "core/transport_sweeper.hpp"
+
+namespace mocc {
+namespace bench {
+/**
+ * \brief A transport sweeper on a benchmark input, with its source assigned
+ * and ready to sweep.
+ *
+ * The sweeper is produced by the \ref TransportSweeperFactory() from the
+ * \<sweeper\> tag of the input, and a fission source is computed from the
+ * initial flux, so that every sweep sees a realistic, non-trivial source.
+ */
+struct SweepCase {
+    SweepCase(const std::string &fname, const std::string &options);
+
+    /**
+     * \brief Construct the group source, as the \ref FixedSourceSolver
+     * would before sweeping group \p group.
+     */
+    void update_source(int group);
+
+    std::unique_ptr<pugi::xml_document> doc;
+    CoreMesh mesh;
+    UP_Sweeper_t sweeper;
+    UP_Source_t source;
+    ArrayB1 fission_source;
+};
+}
+}
@@ -16,6 +16,7 @@
 
 #include "angular_quadrature.hpp"
 
+#include <cmath>
 #include <iomanip>
 #include <iostream>
 #include <sstream>
@@ -35,8 +36,28 @@
 namespace {
 const std::vector<std::string> recognized_attributes_ls   = {"type", "order"};
 const std::vector<std::string> recognized_attributes_prod = {
-    "type", "n_azimuthal", "n_polar"};
+    "type", "n_azimuthal", "n_polar", "polar_tolerance"};
 const std::vector<std::string> recognized_attributes_user = {"type"};
+
+// Return the fewest polar angles, up to n_max, for which the polar quadrature
+// made by gen integrates Ki3 to within tol. The error of each option is
+// logged, so that the cost of tightening the tolerance is apparent.
+template <class Generator>
+int select_n_polar(Generator gen, int n_max, mocc::real_t tol)
+{
+    LogScreen << "Selecting polar angles for a Ki3 tolerance of " << tol
+              << std::endl;
+    for (int n = 1; n <= n_max; n++) {
+        mocc::real_t err = PolarError(gen(n));
+        LogScreen << "    " << n << " polar angles: error " << err
+                  << std::endl;
+        if (err <= tol) {
+            return n;
+        }
+    }
+    mocc::Warn("No polar quadrature meets the tolerance. Using the largest.");
+    return n_max;
+}
 }
 
 namespace mocc {
@@ -55,9 +76,17 @@ AngularQuadrature::AngularQuadrature(const pugi::xml_node &input)
         throw EXCEPT("Input is not an <ang_quad/> tag");
     }
 
-    // extract the quadrature order, if present
+    // extract the quadrature order, if present. The number of polar angles
+    // may be chosen automatically for the product quadratures, as the fewest
+    // that meet a tolerance on the polar integration error.
     n_azimuthal_ = input.attribute("n_azimuthal").as_int(-1);
     n_polar_     = input.attribute("n_polar").as_int(-1);
+    bool auto_polar =
+        std::string(input.attribute("n_polar").value()) == "auto";
+    real_t polar_tol = input.attribute("polar_tolerance").as_double(1.0e-3);
+    if (auto_polar && (polar_tol <= 0.0)) {
+        throw EXCEPT("Invalid polar tolerance (polar_tolerance).");
+    }
 
     // Extract the quadrature type
     std::string type_str = input.attribute("type").value();
@@ -73,6 +102,9 @@ AngularQuadrature::AngularQuadrature(const pugi::xml_node &input)
         angles_ = GenSn(order);
     } else if ((type_str == "cg") || (type_str == "chebyshev-gauss")) {
         validate_input(input, recognized_attributes_prod);
+        if (auto_polar) {
+            n_polar_ = select_n_polar(GenGauss, 8, polar_tol);
+        }
         if ((n_azimuthal_ < 1) || (n_polar_ < 1)) {
             throw EXCEPT("Number of polar or azimuthal angles is invalid");
         }
@@ -82,6 +114,9 @@ AngularQuadrature::AngularQuadrature(const pugi::xml_node &input)
         angles_ = GenProduct(GenChebyshev(n_azimuthal_), GenGauss(n_polar_));
     } else if ((type_str == "cy") || (type_str == "chebyshev-yamamoto")) {
         validate_input(input, recognized_attributes_prod);
+        if (auto_polar) {
+            n_polar_ = select_n_polar(GenYamamoto, 3, polar_tol);
+        }
         if ((n_azimuthal_ < 1) || (n_polar_ < 1)) {
             throw EXCEPT("Number of polar or azimuthal angles is invalid");
         }
@@ -198,6 +233,25 @@ void AngularQuadrature::modify_angle(int iang, Angle ang)
     }
 }
 
+int AngularQuadrature::rotate(unsigned int iang, bool clockwise) const
+{
+    const Angle &ang = angles_[iang];
+    real_t ox        = clockwise ? ang.oy : -ang.oy;
+    real_t oy        = clockwise ? -ang.ox : ang.ox;
+
+    // The direction cosines of modularized angles carry some round-off, so
+    // match them loosely
+    const real_t tol = 1.0e-10;
+    for (int i = 0; i < (int)angles_.size(); i++) {
+        const Angle &a = angles_[i];
+        if ((std::abs(a.ox - ox) < tol) && (std::abs(a.oy - oy) < tol) &&
+            (std::abs(a.oz - ang.oz) < tol)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
 std::ostream &operator<<(std::ostream &os, const AngularQuadrature &angquad)
 {
     const int w = 12;
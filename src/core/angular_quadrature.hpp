@@ -166,6 +166,19 @@ public:
         return 0;
     }
 
+    /**
+     * \brief Return the index of the angle rotated a quarter turn about the
+     * z axis, or -1 if the quadrature doesn't contain it.
+     *
+     * \param iang the index of the angle to rotate
+     * \param clockwise whether to rotate clockwise, taking (ox, oy) to (oy,
+     * -ox), or counter-clockwise, taking (ox, oy) to (-oy, ox)
+     *
+     * This is a search over the angles, so callers should tabulate the
+     * results rather than calling it in a sweep.
+     */
+    int rotate(unsigned int iang, bool clockwise) const;
+
     void output(H5Node &node) const;
 
     bool operator==(const AngularQuadrature &other) const
@@ -16,7 +16,10 @@
 
 #include "core/boundary_condition.hpp"
 
+#include <algorithm>
+
 #include "util/error.hpp"
+#include "util/first_touch.hpp"
 
 namespace mocc {
 
@@ -38,7 +41,10 @@ BoundaryCondition::BoundaryCondition(int n_group,
       n_angle_(n_bc.size()),
       bc_(bc),
       size_(n_bc),
-      ang_quad_(angquad)
+      ang_quad_(angquad),
+      group_slot_(n_group),
+      n_resident_(0),
+      spare_slot_(-1)
 {
     assert((angquad.ndir() == (int)n_bc.size()) ||
            (angquad.ndir() / 2 == (int)n_bc.size()));
@@ -63,6 +69,10 @@ BoundaryCondition::BoundaryCondition(int n_group,
     offset_.resize(n_angle, 3);
     assert(offset_(0, blitz::Range::all()).isStorageContiguous());
 
+    for (int ig = 0; ig < n_group; ig++) {
+        group_slot_[ig] = ig;
+    }
+
     int offset = 0;
     int iang   = 0;
     for (auto n_ang : n_bc) {
@@ -74,6 +84,27 @@ BoundaryCondition::BoundaryCondition(int n_group,
         }
         iang++;
     }
+
+    // Tabulate the rotated angles, and make sure that the faces they map
+    // onto are compatible
+    if (bc_[(int)Surface::WEST] == Boundary::ROTATE) {
+        rotate_cw_.resize(n_angle);
+        rotate_ccw_.resize(n_angle);
+        for (int iang = 0; iang < n_angle; iang++) {
+            rotate_cw_[iang]  = ang_quad_.rotate(iang, true);
+            rotate_ccw_[iang] = ang_quad_.rotate(iang, false);
+            if ((rotate_cw_[iang] < 0) || (rotate_cw_[iang] >= n_angle) ||
+                (rotate_ccw_[iang] < 0) || (rotate_ccw_[iang] >= n_angle)) {
+                throw EXCEPT("Angular quadrature is not symmetric under a "
+                             "quarter-turn rotation.");
+            }
+            if (size_[iang][(int)Normal::X_NORM] !=
+                size_[rotate_cw_[iang]][(int)Normal::Y_NORM]) {
+                throw EXCEPT("Boundary faces are not compatible with "
+                             "rotational symmetry.");
+            }
+        }
+    }
     return;
 }
 
@@ -81,14 +112,23 @@ BoundaryCondition::BoundaryCondition(const BoundaryCondition &rhs)
     : BoundaryCondition(rhs.n_group_, rhs.ang_quad_, rhs.bc_, rhs.size_,
             (rhs.factor_==2.0?2:3))
 {
+    if (rhs.double_buffered()) {
+        this->enable_double_buffer();
+    }
+    if (rhs.packed()) {
+        this->enable_packed_storage(rhs.n_resident_);
+    }
     return;
 }
 
 void BoundaryCondition::initialize_scalar(real_t val)
 {
-    // Start with all zeros
-    data_ = 0.0;
+    // Start with all zeros. The first call places the storage, so this is
+    // done in parallel.
+    first_touch(data_.data(), data_.size(), (real_t)0.0);
+    std::fill(packed_.begin(), packed_.end(), 0.0f);
     for (int group = 0; group < n_group_; group++) {
+        this->load(group);
         // This is not a range-based loop, because n_angle_ is different
         // depending on the type of sweeper that made this
         // BoundaryCondition.
@@ -117,6 +157,7 @@ void BoundaryCondition::initialize_scalar(real_t val)
                 case Boundary::PARALLEL:
                 case Boundary::REFLECT:
                 case Boundary::PERIODIC:
+                case Boundary::ROTATE:
                     // initialize with the prescribed scalar
                     for (int i = 0; i < face_pair.first; i++) {
                         face[i] = val;
@@ -133,29 +174,60 @@ void BoundaryCondition::initialize_scalar(real_t val)
 void BoundaryCondition::initialize_spectrum(const ArrayB1 &spectrum)
 {
     assert((int)spectrum.size() == n_group_);
-    int it = 0;
     for (int ig = 0; ig < n_group_; ig++) {
         real_t val = spectrum(ig);
+        if (group_slot_[ig] < 0) {
+            auto first = packed_.begin() + (size_t)bc_per_group_ * ig;
+            std::fill(first, first + bc_per_group_, (float)val);
+            continue;
+        }
+        int it = this->group_offset(ig);
         data_(blitz::Range(it, it + bc_per_group_ - 1)) = val;
-        it += bc_per_group_;
     }
     return;
 }
 
-void BoundaryCondition::update(int group, const BoundaryCondition &out)
+void BoundaryCondition::write(H5Node &node, const std::string &path) const
+{
+    // Write the groups in order, regardless of which slots they are in
+    ArrayB1 data(this->size());
+    for (int ig = 0; ig < n_group_; ig++) {
+        this->copy_group(ig, &data(bc_per_group_ * ig));
+    }
+    node.write(path, data);
+    return;
+}
+
+void BoundaryCondition::read(H5Node &node, const std::string &path)
+{
+    ArrayB1 data;
+    node.read_1d(path, data);
+    if ((int)data.size() != this->size()) {
+        throw EXCEPT("Boundary condition size does not match: " + path);
+    }
+    for (int ig = 0; ig < n_group_; ig++) {
+        this->set_group(ig, &data(bc_per_group_ * ig));
+    }
+    return;
+}
+
+void BoundaryCondition::update(int group, const BoundaryCondition &out,
+                               int out_group)
 {
-    assert(out.n_group_ == 1);
+    assert(out_group < out.n_group_);
 
     for (int iang = 0; iang < n_angle_; iang++) {
-        this->update(group, iang, out);
+        this->update(group, iang, out, out_group);
     }
     return;
 }
 
 void BoundaryCondition::update(int group, int angle,
-                               const BoundaryCondition &out)
+                               const BoundaryCondition &out, int out_group)
 {
-    int group_offset = bc_per_group_ * group;
+    assert(out_group < out.n_group_);
+    int group_offset     = this->group_offset(group);
+    int out_group_offset = out.group_offset(out_group);
 
     for (Normal n : AllNormals) {
         int size    = size_[angle][(int)n];
@@ -167,8 +239,7 @@ void BoundaryCondition::update(int group, int angle,
         assert(iang_in < n_angle_);
         const auto &angle_in = ang_quad_[iang_in];
         int offset_in        = group_offset + offset_(iang_in, (int)n);
-        int offset_out       = out.offset_(angle, (int)n);
-        ;
+        int offset_out = out_group_offset + out.offset_(angle, (int)n);
 
         switch (bc_[(int)(angle_in.upwind_surface(n))]) {
         case Boundary::VACUUM:
@@ -183,10 +254,188 @@ void BoundaryCondition::update(int group, int angle,
         case Boundary::PRESCRIBED:
             break;
 
+        case Boundary::ROTATE: {
+            // The outgoing angle leaves through the west or south face, and
+            // re-enters through the other one, rotated a quarter turn
+            bool west      = n == Normal::X_NORM;
+            int iang_rot   = west ? rotate_cw_[angle] : rotate_ccw_[angle];
+            Normal n_rot   = west ? Normal::Y_NORM : Normal::X_NORM;
+            int offset_rot = group_offset + offset_(iang_rot, (int)n_rot);
+            assert(size == size_[iang_rot][(int)n_rot]);
+            data_(blitz::Range(offset_rot, offset_rot + size - 1)) =
+                out.data_(blitz::Range(offset_out, offset_out + size - 1));
+        } break;
+
+        default:
+            throw EXCEPT("Unsupported boundary condition type");
+        }
+    }
+    return;
+}
+
+VecI BoundaryCondition::update_targets(int angle) const
+{
+    VecI targets;
+    for (Normal n : AllNormals) {
+        if (size_[angle][(int)n] == 0) {
+            break;
+        }
+        int iang_in          = ang_quad_.reflect(angle, n);
+        const auto &angle_in = ang_quad_[iang_in];
+
+        switch (bc_[(int)(angle_in.upwind_surface(n))]) {
+        case Boundary::VACUUM:
+        case Boundary::REFLECT:
+            targets.push_back(iang_in);
+            break;
+
+        case Boundary::PRESCRIBED:
+            break;
+
+        case Boundary::ROTATE:
+            targets.push_back(n == Normal::X_NORM ? rotate_cw_[angle]
+                                                  : rotate_ccw_[angle]);
+            break;
+
         default:
             throw EXCEPT("Unsupported boundary condition type");
         }
     }
+    return targets;
+}
+
+void BoundaryCondition::enable_double_buffer()
+{
+    if (this->double_buffered()) {
+        return;
+    }
+
+    // Tabulate where the flux leaving through each face goes, following
+    // the same logic as update()
+    next_offset_.resize(n_angle_, 3);
+    next_offset_ = -1;
+    for (int angle = 0; angle < n_angle_; angle++) {
+        for (Normal n : AllNormals) {
+            int size    = size_[angle][(int)n];
+            int iang_in = ang_quad_.reflect(angle, n);
+            if (size == 0) {
+                break;
+            }
+            assert(iang_in < n_angle_);
+            const auto &angle_in = ang_quad_[iang_in];
+            int offset_in        = offset_(iang_in, (int)n);
+
+            switch (bc_[(int)(angle_in.upwind_surface(n))]) {
+            case Boundary::VACUUM:
+                vacuum_faces_.emplace_back(offset_in, size);
+                break;
+
+            case Boundary::REFLECT:
+                next_offset_(angle, (int)n) = offset_in;
+                break;
+
+            case Boundary::PRESCRIBED:
+                prescribed_faces_.emplace_back(offset_in, size);
+                break;
+
+            case Boundary::ROTATE: {
+                bool west    = n == Normal::X_NORM;
+                int iang_rot = west ? rotate_cw_[angle] : rotate_ccw_[angle];
+                Normal n_rot = west ? Normal::Y_NORM : Normal::X_NORM;
+                next_offset_(angle, (int)n) = offset_(iang_rot, (int)n_rot);
+            } break;
+
+            default:
+                throw EXCEPT("Unsupported boundary condition type");
+            }
+        }
+    }
+
+    spare_slot_ = this->packed() ? n_resident_ : n_group_;
+    data_.resizeAndPreserve(bc_per_group_ * (spare_slot_ + 1));
+    data_(blitz::Range(bc_per_group_ * spare_slot_, blitz::toEnd)) = 0.0;
+    return;
+}
+
+void BoundaryCondition::swap_next(int group)
+{
+    assert(this->double_buffered());
+    assert(group < n_group_);
+    real_t *next       = &data_(bc_per_group_ * spare_slot_);
+    const real_t *prev = &data_(this->group_offset(group));
+
+    for (const auto &face : vacuum_faces_) {
+        std::fill(next + face.first, next + face.first + face.second, 0.0);
+    }
+    for (const auto &face : prescribed_faces_) {
+        std::copy(prev + face.first, prev + face.first + face.second,
+                  next + face.first);
+    }
+
+    std::swap(group_slot_[group], spare_slot_);
+    return;
+}
+
+void BoundaryCondition::enable_packed_storage(int n_resident)
+{
+    assert(n_resident > 0);
+    if (this->packed() || (n_resident >= n_group_)) {
+        return;
+    }
+
+    const size_t n = bc_per_group_;
+    packed_.resize(n * n_group_);
+    for (int ig = 0; ig < n_group_; ig++) {
+        const real_t *first = &data_(this->group_offset(ig));
+        std::copy(first, first + n, &packed_[n * ig]);
+    }
+
+    // The first groups stay resident, in the first slots, followed by the
+    // spare slot for double buffering
+    int n_slot = n_resident + (this->double_buffered() ? 1 : 0);
+    ArrayB1 data(n * n_slot);
+    data = 0.0;
+    resident_.clear();
+    for (int ig = 0; ig < n_resident; ig++) {
+        this->copy_group(ig, &data(n * ig));
+        resident_.push_back(ig);
+    }
+    for (int ig = 0; ig < n_group_; ig++) {
+        group_slot_[ig] = (ig < n_resident) ? ig : -1;
+    }
+    if (this->double_buffered()) {
+        spare_slot_ = n_resident;
+    }
+    data_.reference(data);
+    n_resident_ = n_resident;
+
+    return;
+}
+
+void BoundaryCondition::load_packed(int group)
+{
+    auto it = std::find(resident_.begin(), resident_.end(), group);
+    if (it != resident_.end()) {
+        resident_.erase(it);
+        resident_.push_back(group);
+        return;
+    }
+
+    // Round the least recently loaded group into packed storage, and expand
+    // this one into its slot
+    int evict = resident_.front();
+    resident_.erase(resident_.begin());
+    const size_t n = bc_per_group_;
+    int slot       = group_slot_[evict];
+    real_t *values = &data_(n * slot);
+    std::copy(values, values + n, &packed_[n * evict]);
+    group_slot_[evict] = -1;
+
+    const float *first = &packed_[n * group];
+    std::copy(first, first + n, values);
+    group_slot_[group] = slot;
+    resident_.push_back(group);
+
     return;
 }
 
@@ -198,8 +447,10 @@ std::ostream &operator<<(std::ostream &os, const BoundaryCondition &bc)
     }
     os << std::endl;
 
+    VecF values(bc.bc_per_group_);
     for (int igroup = 0; igroup < bc.n_group_; igroup++) {
         os << "Group: " << igroup << std::endl;
+        bc.copy_group(igroup, values.data());
 
         for (int iang = 0; iang < bc.n_angle_; iang++) {
             os << "Angle: " << iang << std::endl;
@@ -208,9 +459,9 @@ std::ostream &operator<<(std::ostream &os, const BoundaryCondition &bc)
             for (auto norm : AllNormals) {
                 if (ang_size[(int)norm] > 0) {
                     os << norm << std::endl;
-                    auto bvals = bc.get_face(igroup, iang, norm);
-                    for (int i = 0; i < bvals.first; i++) {
-                        os << bvals.second[i] << " ";
+                    int off = bc.offset_(iang, (int)norm);
+                    for (int i = 0; i < ang_size[(int)norm]; i++) {
+                        os << values[off + i] << " ";
                     }
                     os << std::endl << std::endl;
                 }
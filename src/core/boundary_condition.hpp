@@ -17,9 +17,12 @@
 #pragma once
 
 #include <array>
+#include <string>
 
 #include "util/blitz_typedefs.hpp"
 #include "util/global_config.hpp"
+#include "util/h5file.hpp"
+#include "util/memory.hpp"
 #include "angular_quadrature.hpp"
 #include "constants.hpp"
 
@@ -91,7 +94,69 @@ public:
      */
     int size() const
     {
-        return data_.size();
+        return bc_per_group_ * n_group_;
+    }
+
+    /**
+     * \brief Return the number of boundary condition points in each group.
+     *
+     * The points of each group are stored consecutively, starting at the
+     * first face of the first angle.
+     */
+    int size_per_group() const
+    {
+        return bc_per_group_;
+    }
+
+    /**
+     * \brief Return the number of bytes used to store the boundary values
+     * and their offsets
+     */
+    size_t memory() const
+    {
+        return bytes(data_) + bytes(offset_) + bytes(group_slot_) +
+               bytes(next_offset_) + bytes(packed_) + bytes(resident_);
+    }
+
+    /**
+     * \brief Keep only some of the groups in full precision, storing the
+     * rest in single precision
+     *
+     * \param n_resident the number of groups to keep in full precision at a
+     * time
+     *
+     * The boundary values are only iteration state, so single precision is
+     * plenty for the groups that aren't being swept. Once this is enabled, a
+     * group must be made resident with \ref load() before its values are
+     * accessed through \ref get_face(), \ref get_boundary(), \ref
+     * copy_face(), \ref update(), \ref next_face() or \ref swap_next().
+     * The other methods work on any group. Nothing changes if \p
+     * n_resident is at least the number of groups.
+     */
+    void enable_packed_storage(int n_resident);
+
+    /**
+     * \brief Return whether \ref enable_packed_storage() has taken effect
+     */
+    bool packed() const
+    {
+        return n_resident_ > 0;
+    }
+
+    /**
+     * \brief Make a group resident in full precision
+     *
+     * If all of the resident slots are taken, the least recently loaded
+     * group is rounded to single precision to make room. This does nothing
+     * without packed storage. It must not be called while other threads are
+     * accessing the boundary values.
+     */
+    void load(int group)
+    {
+        assert(group < n_group_);
+        if ((n_resident_ > 0) && (resident_.back() != group)) {
+            this->load_packed(group);
+        }
     }
 
     /**
@@ -112,7 +177,7 @@ public:
     {
         assert(angle < n_angle_);
         assert(group < n_group_);
-        int off = bc_per_group_ * group + offset_(angle, (int)norm);
+        int off = this->group_offset(group) + offset_(angle, (int)norm);
         return BVal_const_t(size_[angle][(int)norm], &data_(off));
     }
 
@@ -123,7 +188,7 @@ public:
     {
         assert(angle < n_angle_);
         assert(group < n_group_);
-        int off = bc_per_group_ * group + offset_(angle, (int)norm);
+        int off = this->group_offset(group) + offset_(angle, (int)norm);
         return BVal_t(size_[angle][(int)norm], &data_(off));
     }
 
@@ -137,6 +202,40 @@ public:
         std::copy(face, face + n, out);
     }
 
+    /**
+     * \brief Copy all of the boundary values of a group to an external
+     * array of \ref size_per_group() values
+     */
+    void copy_group(int group, real_t *out) const
+    {
+        assert(group < n_group_);
+        if (group_slot_[group] < 0) {
+            const float *first = &packed_[(size_t)bc_per_group_ * group];
+            std::copy(first, first + bc_per_group_, out);
+            return;
+        }
+        const real_t *first = &data_(this->group_offset(group));
+        std::copy(first, first + bc_per_group_, out);
+    }
+
+    /**
+     * \brief Set all of the boundary values of a group from an external
+     * array of \ref size_per_group() values
+     *
+     * This allows a sweeper to restore the incoming condition of a group
+     * that it copied with \ref copy_group().
+     */
+    void set_group(int group, const real_t *in)
+    {
+        assert(group < n_group_);
+        if (group_slot_[group] < 0) {
+            std::copy(in, in + bc_per_group_,
+                      &packed_[(size_t)bc_per_group_ * group]);
+            return;
+        }
+        std::copy(in, in + bc_per_group_, &data_(this->group_offset(group)));
+    }
+
     /**
      * \brief Return a const pointer to the beginning of the boundary values
      * for the given group and angle. Includes all faces
@@ -146,7 +245,7 @@ public:
         assert(angle < n_angle_);
         assert(group < n_group_);
         int size = size_[angle][0] + size_[angle][1] + size_[angle][2];
-        int off  = bc_per_group_ * group + offset_(angle, 0);
+        int off  = this->group_offset(group) + offset_(angle, 0);
         return BVal_const_t(size, &data_(off));
     }
 
@@ -159,7 +258,7 @@ public:
         assert(angle < n_angle_);
         assert(group < n_group_);
         int size = size_[angle][0] + size_[angle][1] + size_[angle][2];
-        int off  = bc_per_group_ * group + offset_(angle, 0);
+        int off  = this->group_offset(group) + offset_(angle, 0);
         return BVal_t(size, &data_(off));
     }
 
@@ -169,12 +268,14 @@ public:
      *
      * \param group the energy group to update
      * \param out the "outgoing" angular flux boundary condition to use in
-     * the update. It should only have one group of storage
+     * the update. It usually only has one group of storage
+     * \param out_group the group of \p out to read from. Defaults to zero,
+     * which is the only group in a single-group outgoing condition.
      *
      * This would be used for a Jacobi-style iteration on the boundary
      * source.
      */
-    void update(int group, const BoundaryCondition &out);
+    void update(int group, const BoundaryCondition &out, int out_group = 0);
 
     /**
      * \brief Update the boundary condition from a single outgoing angle for
@@ -182,22 +283,111 @@ public:
      *
      * \param group the energy group to treat
      * \param angle the angle index of the outgoing angle. See below.
-     * \param out a single-group \ref BoundaryCondition object storing the
-     * outgoing boundary values to use.
+     * \param out a \ref BoundaryCondition object storing the outgoing
+     * boundary values to use. Usually single-group.
+     * \param out_group the group of \p out to read from
      *
      * This would be used for a Gauss-Seidel-style iteration on the boundary
      * source.
      *
      * The passed angle indicates the angle of the outgoing angle. Depending
      * on the various domain boundary conditions, corresponding boundary
-     * values may be updated on \c this
+     * values may be updated on \c this. For \ref Boundary::ROTATE, the
+     * updated values belong to the outgoing angle rotated a quarter turn,
+     * on the other symmetry face.
+     */
+    void update(int group, int angle, const BoundaryCondition &out,
+                int out_group = 0);
+
+    /**
+     * \brief Return the angles whose incoming values are written by \ref
+     * update() for the outgoing angle \p angle
+     *
+     * This is what a Gauss-Seidel sweep needs to know to order the update
+     * against the sweeps of other angles. Prescribed faces are never written,
+     * so they don't appear.
+     */
+    VecI update_targets(int angle) const;
+
+    /**
+     * \brief Add a spare group of storage, into which the next incoming
+     * values of a group may be written directly
+     *
+     * This is an alternative to the Jacobi-style \ref update(), which needs
+     * the outgoing values to be stored in a separate \ref BoundaryCondition
+     * before copying them over. Instead, a sweeper may sweep each outgoing
+     * face in place in the spare storage given by \ref next_face(), then
+     * make it the incoming condition with \ref swap_next(), which is a swap
+     * of group storage rather than a copy.
+     */
+    void enable_double_buffer();
+
+    /**
+     * \brief Return whether \ref enable_double_buffer() has been called
      */
-    void update(int group, int angle, const BoundaryCondition &out);
+    bool double_buffered() const
+    {
+        return spare_slot_ >= 0;
+    }
+
+    /**
+     * \brief Return a pointer to the spare storage that receives the flux
+     * leaving the domain in \p angle, through the face normal to \p norm
+     *
+     * This is the face of the angle that the flux re-enters the domain in,
+     * as it would be updated by \ref update(). Returns a null pointer if the
+     * outgoing flux does not come back, through a vacuum or prescribed
+     * boundary. The face has the same number of values as the outgoing face.
+     */
+    real_t *next_face(int angle, Normal norm)
+    {
+        assert(spare_slot_ >= 0);
+        assert(angle < n_angle_);
+        int off = next_offset_(angle, (int)norm);
+        return (off < 0) ? nullptr : &data_(bc_per_group_ * spare_slot_ + off);
+    }
+
+    /**
+     * \brief Make the spare storage the incoming condition of a group
+     *
+     * \param group the group that the spare storage has been filled for
+     *
+     * Every non-null \ref next_face() of every angle must have been written
+     * since the last swap. The vacuum faces are zeroed and the prescribed
+     * faces are carried over from the old values, which then become the
+     * spare storage.
+     */
+    void swap_next(int group);
+
+    /**
+     * \brief Write all of the boundary values to a dataset, for
+     * checkpointing
+     */
+    void write(H5Node &node, const std::string &path) const;
+
+    /**
+     * \brief Read the boundary values back from a dataset written by \ref
+     * write()
+     *
+     * The dataset must have the same number of values as the boundary
+     * condition.
+     */
+    void read(H5Node &node, const std::string &path);
 
     friend std::ostream &operator<<(std::ostream &os,
                                     const BoundaryCondition &bc);
 
 private:
+    // Index of the first value of a group in data_
+    int group_offset(int group) const
+    {
+        assert(group_slot_[group] >= 0);
+        return bc_per_group_ * group_slot_[group];
+    }
+
+    // The part of load() that swaps a group in from packed storage
+    void load_packed(int group);
+
     // Number of energy groups
     int n_group_;
 
@@ -221,6 +411,33 @@ private:
     // angles, groups and faces
     ArrayB1 data_;
 
+    // Slot of data_, in units of bc_per_group_, holding each group. This is
+    // the identity, unless double buffering has swapped groups in and out
+    // of the spare slot, or packed storage is enabled, in which case groups
+    // that aren't resident have a slot of -1.
+    VecI group_slot_;
+
+    // With packed storage, the number of groups with a slot in data_, the
+    // single precision values of every group, and the resident groups, from
+    // least to most recently loaded. The packed values of a resident group
+    // are stale until it is swapped out. n_resident_ is zero without packed
+    // storage.
+    int n_resident_;
+    std::vector<float> packed_;
+    VecI resident_;
+
+    // Slot of data_ holding the spare group storage for double buffering,
+    // or -1 if double buffering is disabled
+    int spare_slot_;
+
+    // For double buffering, the index offset of the face receiving the flux
+    // leaving through each angle/face, or -1 if it doesn't come back. The
+    // vacuum and prescribed faces, which nothing is written to, are stored
+    // as (offset, size) pairs.
+    blitz::Array<int, 2> next_offset_;
+    std::vector<std::pair<int, int>> vacuum_faces_;
+    std::vector<std::pair<int, int>> prescribed_faces_;
+
     // An array of index offsets to get to an angle/face. Needs to be
     // incremented by bc_per_group_*group to yield final starting index of a
     // face of BCs
@@ -228,5 +445,14 @@ private:
 
     // A factor to scale the incoming boundary flux based on 2D or 3D
     real_t factor_;
+
+    // Index of each angle rotated a quarter turn clockwise and
+    // counter-clockwise. Only populated for rotational symmetry, where
+    // flux leaving the west face re-enters through the south face rotated
+    // clockwise, and vice versa. The west/south face values are stored in
+    // the same order as each other along their faces, so that a rotated
+    // face is a straight copy.
+    VecI rotate_cw_;
+    VecI rotate_ccw_;
 };
 }
@@ -16,24 +16,64 @@
 
 #include "cmfd.hpp"
 
+#include <algorithm>
+#include <array>
 #include <cmath>
+#include <exception>
 #include <iomanip>
+#include <numeric>
 #include <string>
 #include <vector>
 #include "pugixml.hpp"
 #include "util/error.hpp"
 #include "util/files.hpp"
 #include "util/global_config.hpp"
+#include "util/string_utils.hpp"
 #include "util/validate_input.hpp"
+#include "parallel_environment.hpp"
 
 typedef Eigen::Triplet<mocc::real_t> T;
-typedef Eigen::SparseMatrix<mocc::real_t> M;
+typedef Eigen::SparseMatrix<mocc::real_t, Eigen::RowMajor> M;
 
 namespace {
 using namespace mocc;
 const std::vector<std::string> recognized_attributes = {
-    "enabled",  "k_tol",          "psi_tol",     "residual_reduction",
-    "max_iter", "negative_fixup", "dump_current"};
+    "enabled",  "k_tol",          "psi_tol",      "residual_reduction",
+    "max_iter", "negative_fixup", "dump_current", "refactor_tol",
+    "eigen_solver", "wielandt_shift", "preconditioner", "multilevel",
+    "energy_groups", "assembly_cells", "operator", "stencil_solver",
+    "sor_omega", "pcmfd", "odcmfd", "recycle", "inexact", "inexact_factor",
+    "inexact_max", "backend", "ksp_type", "pc_type", "petsc_options",
+    "offload", "direct_cells", "energy_sweep"};
+
+/**
+ * \brief Return the odCMFD diffusion coefficient correction factor for a
+ * cell of the given optical thickness
+ *
+ * The cell diffusion coefficient is increased by theta*h, which makes the
+ * CMFD-accelerated transport iteration stable on optically thick cells. This
+ * is the polynomial fit for MoC from Zhu et al., "An optimally diffusive
+ * Coarse Mesh Finite Difference method to accelerate neutron transport
+ * calculations," Ann. Nucl. Energy (2016).
+ */
+real_t od_theta(real_t tau)
+{
+    if (tau < 1.0) {
+        return 0.0;
+    }
+    if (tau >= 14.0) {
+        return 0.127;
+    }
+    const std::array<real_t, 7> c = {{-5.542780e-02, 8.740501e-02,
+                                      -2.152599e-02, 3.145553e-03,
+                                      -2.683648e-04, 1.222516e-05,
+                                      -2.284879e-07}};
+    real_t theta = 0.0;
+    for (int i = (int)c.size() - 1; i >= 0; i--) {
+        theta = theta * tau + c[i];
+    }
+    return theta;
+}
 
 /**
  * \brief Helper function for making the CMFD mesh
@@ -56,6 +96,25 @@ Mesh make_cmfd_mesh(const CoreMesh *mesh)
     return Mesh(n_reg, n_reg, mesh->x_divisions(), mesh->y_divisions(),
                 mplane_z, mesh->boundary());
 }
+
+// Cell boundaries of a coarse CMFD mesh along one dimension, splitting each
+// assembly's pins into n nearly-equal cells. n_pin is the number of pins
+// across each assembly along the dimension.
+VecI split_assemblies(const VecI &n_pin, int n)
+{
+    VecI index(1, 0);
+    for (int np : n_pin) {
+        if (n > np) {
+            throw EXCEPT("More CMFD cells than pins across an assembly");
+        }
+        int start = index.back();
+        for (int i = 1; i <= n; i++) {
+            // Round to the nearest pin boundary, larger cells first
+            index.push_back(start + (i * np + n - 1) / n);
+        }
+    }
+    return index;
+}
 }
 
 namespace mocc {
@@ -78,23 +137,59 @@ CMFD::CMFD(const pugi::xml_node &input, const CoreMesh *mesh,
       fs_old_(n_cell_),
       x_(n_cell_),
       source_(n_cell_, &xsmesh_, coarse_data_.flux),
-      m_(n_group_, Eigen::SparseMatrix<real_t>(n_cell_, n_cell_)),
+      m_(n_group_, M(n_cell_, n_cell_)),
       solvers_(n_group_),
+      direct_cells_(20000),
+      use_stencil_(false),
+      stencil_sor_(false),
+      sor_omega_(1.5),
+      stencil_tol_(0.001),
+      energy_sweep_(EnergySweep::GAUSS_SEIDEL),
+      pcmfd_(false),
+      odcmfd_(false),
+      factored_values_(n_group_),
+      refactor_tol_(0.1),
+      wielandt_(false),
+      wielandt_shift_(0.05),
       d_hat_(n_surf_, n_group_),
       d_tilde_(n_surf_, n_group_),
       s_hat_(n_surf_, n_group_),
       s_tilde_(n_surf_, n_group_),
       n_solve_(0),
+      n_iter_(0),
+      n_linear_iter_(0),
       k_tol_(1.0e-6),
       psi_tol_(1.0e-5),
       resid_reduction_(0.001),
       max_iter_(100),
+      inexact_(false),
+      inexact_factor_(0.1),
+      inexact_max_(0.1),
+      outer_error_k_(0.0),
+      outer_error_psi_(0.0),
       zero_fixup_(false),
       dump_current_(false)
 {
     // Check input attributes
     validate_input(input, recognized_attributes);
 
+    timer_solve_.enable_counters();
+
+    // With rotational symmetry, the cells along the west boundary couple to
+    // the cells along the south boundary that they are rotated onto, and
+    // vice versa.
+    rotate_cell_.assign(n_surf_, -1);
+    if (mesh_.boundary()[(int)Surface::WEST] == Boundary::ROTATE) {
+        for (int iz = 0; iz < (int)mesh_.nz(); iz++) {
+            for (int k = 0; k < (int)mesh_.nx(); k++) {
+                int west  = mesh_.coarse_cell(Position(0, k, iz));
+                int south = mesh_.coarse_cell(Position(k, 0, iz));
+                rotate_cell_[mesh_.coarse_surf(west, Surface::WEST)]   = south;
+                rotate_cell_[mesh_.coarse_surf(south, Surface::SOUTH)] = west;
+            }
+        }
+    }
+
     // Set up the structure of the matrix
     std::vector<T> structure;
     for (int i = 0; i < n_cell_; i++) {
@@ -108,12 +203,80 @@ CMFD::CMFD(const pugi::xml_node &input, const CoreMesh *mesh,
                 structure.push_back(T(n, i, 1.0));
             }
         }
+        for (auto d : {Surface::WEST, Surface::SOUTH}) {
+            int n = rotate_cell_[mesh_.coarse_surf(i, d)];
+            if ((n >= 0) && (n != i)) {
+                structure.push_back(T(i, n, 1.0));
+            }
+        }
     }
     for (auto &m : m_) {
         m.setFromTriplets(structure.begin(), structure.end());
         m.makeCompressed();
     }
 
+    // Map the surface quantities to the non-zeros of the matrix. All groups
+    // share the same pattern, so just use the first. The matrices are
+    // row-major, so the outer index is the row.
+    diagonal_.resize(n_cell_);
+    if (n_group_ > 0) {
+        const M &m = m_.front();
+        coeff_offset_.reserve(m.nonZeros() + 1);
+        for (int i = 0; i < m.outerSize(); i++) {
+            for (int nz = m.outerIndexPtr()[i]; nz < m.outerIndexPtr()[i + 1];
+                 nz++) {
+                coeff_offset_.push_back(coeffs_.size());
+                int j = m.innerIndexPtr()[nz];
+                if (i == j) {
+                    diagonal_[i] = nz;
+                    for (auto is : AllSurfaces) {
+                        real_t sign_hat = ((is == Surface::WEST) ||
+                                           (is == Surface::SOUTH) ||
+                                           (is == Surface::BOTTOM))
+                                              ? -1.0
+                                              : 1.0;
+                        coeffs_.push_back({nz, mesh_.coarse_surf(i, is),
+                                           mesh_.coarse_area(i, is), 1.0,
+                                           sign_hat});
+                    }
+                    // The corner cell is rotated onto itself
+                    for (auto is : {Surface::WEST, Surface::SOUTH}) {
+                        int surf = mesh_.coarse_surf(i, is);
+                        if (rotate_cell_[surf] == i) {
+                            coeffs_.push_back({nz, surf,
+                                               mesh_.coarse_area(i, is), -1.0,
+                                               -1.0});
+                        }
+                    }
+                    continue;
+                }
+
+                int surf_w = mesh_.coarse_surf(i, Surface::WEST);
+                int surf_s = mesh_.coarse_surf(i, Surface::SOUTH);
+                if (rotate_cell_[surf_w] == j) {
+                    coeffs_.push_back({nz, surf_w,
+                                       mesh_.coarse_area(i, Surface::WEST),
+                                       -1.0, -1.0});
+                } else if (rotate_cell_[surf_s] == j) {
+                    coeffs_.push_back({nz, surf_s,
+                                       mesh_.coarse_area(i, Surface::SOUTH),
+                                       -1.0, -1.0});
+                } else {
+                    auto pair       = mesh_.coarse_interface(i, j);
+                    real_t sign_hat = ((pair.second == Surface::WEST) ||
+                                       (pair.second == Surface::SOUTH) ||
+                                       (pair.second == Surface::BOTTOM))
+                                          ? -1.0
+                                          : 1.0;
+                    coeffs_.push_back({nz, pair.first,
+                                       mesh_.coarse_area(i, pair.second), -1.0,
+                                       sign_hat});
+                }
+            }
+        }
+        coeff_offset_.push_back(coeffs_.size());
+    }
+
     // Parse options from the XML, if present
     if (!input.empty()) {
         // Eigenvalue tolerance
@@ -149,6 +312,22 @@ CMFD::CMFD(const pugi::xml_node &input, const CoreMesh *mesh,
             }
         }
 
+        // Inexact solves
+        inexact_ = input.attribute("inexact").as_bool(false);
+        if (!input.attribute("inexact_factor").empty()) {
+            inexact_factor_ = input.attribute("inexact_factor").as_float(-1.0);
+            if (inexact_factor_ <= 0.0) {
+                throw EXCEPT("Inexact CMFD factor is invalid.");
+            }
+        }
+        if (!input.attribute("inexact_max").empty()) {
+            inexact_max_ = input.attribute("inexact_max").as_float(-1.0);
+            if ((inexact_max_ <= 0.0) || (inexact_max_ >= 1.0)) {
+                throw EXCEPT("Inexact CMFD maximum residual reduction is "
+                             "invalid.");
+            }
+        }
+
         if (!input.attribute("negative_fixup").empty()) {
             zero_fixup_ = input.attribute("negative_fixup").as_bool(false);
         }
@@ -161,6 +340,296 @@ CMFD::CMFD(const pugi::xml_node &input, const CoreMesh *mesh,
         if (!input.attribute("dump_current").empty()) {
             dump_current_ = input.attribute("dump_current").as_bool(false);
         }
+
+        // Preconditioner refactorization tolerance
+        if (!input.attribute("refactor_tol").empty()) {
+            refactor_tol_ = input.attribute("refactor_tol").as_float(-1.0);
+            if (refactor_tol_ < 0.0) {
+                throw EXCEPT("Preconditioner refactor tolerance is invalid.");
+            }
+        }
+
+        // Largest system to factorize directly, rather than iterate on
+        if (!input.attribute("direct_cells").empty()) {
+            direct_cells_ = input.attribute("direct_cells").as_int(-1);
+            if (direct_cells_ < 0) {
+                throw EXCEPT("Invalid number of cells for direct CMFD "
+                             "solves.");
+            }
+        }
+
+        // Recycled solutions for the initial guesses
+        if (!input.attribute("recycle").empty()) {
+            int n_recycle = input.attribute("recycle").as_int(-1);
+            if (n_recycle < 0) {
+                throw EXCEPT("Invalid number of recycled CMFD solutions.");
+            }
+            if (n_recycle > 0) {
+                recycle_.assign(n_group_, RecycledSubspace(n_recycle));
+            }
+        }
+
+        // Eigenvalue solution method
+        if (!input.attribute("eigen_solver").empty()) {
+            std::string in_string = input.attribute("eigen_solver").value();
+            sanitize(in_string);
+            if (in_string == "power") {
+                wielandt_ = false;
+            } else if (in_string == "wielandt") {
+                wielandt_ = true;
+            } else {
+                throw EXCEPT("Unrecognized CMFD eigenvalue solver.");
+            }
+        }
+
+        // Energy iteration of the power iteration inners
+        if (!input.attribute("energy_sweep").empty()) {
+            std::string in_string = input.attribute("energy_sweep").value();
+            sanitize(in_string);
+            if ((in_string == "gauss-seidel") || (in_string == "gs")) {
+                energy_sweep_ = EnergySweep::GAUSS_SEIDEL;
+            } else if (in_string == "jacobi") {
+                energy_sweep_ = EnergySweep::JACOBI;
+            } else if (in_string == "red-black") {
+                energy_sweep_ = EnergySweep::RED_BLACK;
+            } else {
+                throw EXCEPT("Unrecognized CMFD energy sweep.");
+            }
+        }
+
+        if (!input.attribute("wielandt_shift").empty()) {
+            wielandt_shift_ = input.attribute("wielandt_shift").as_float(-1.0);
+            if (wielandt_shift_ <= 0.0) {
+                throw EXCEPT("Wielandt shift is invalid.");
+            }
+        }
+
+        // Preconditioner for the one-group solves
+        if (!input.attribute("preconditioner").empty()) {
+            std::string in_string = input.attribute("preconditioner").value();
+            sanitize(in_string);
+            CMFDPreconditioner::Type type;
+            if (in_string == "ilut") {
+                type = CMFDPreconditioner::Type::ILUT;
+            } else if (in_string == "multigrid") {
+                type = CMFDPreconditioner::Type::MULTIGRID;
+            } else {
+                throw EXCEPT("Unrecognized CMFD preconditioner.");
+            }
+            for (auto &solver : solvers_) {
+                solver.preconditioner().configure(type, mesh_.nx(), mesh_.ny(),
+                                                  mesh_.nz());
+            }
+        }
+
+        // Assembly-level acceleration of the power iteration
+        if (input.attribute("multilevel").as_bool(false)) {
+            if (wielandt_) {
+                Warn("Multilevel CMFD is only used with power iteration");
+            }
+            const Core &core = mesh->core();
+            VecI x_index(1, 0);
+            for (int ix = 0; ix < core.nx(); ix++) {
+                x_index.push_back(x_index.back() + core.at(ix, 0).nx());
+            }
+            VecI y_index(1, 0);
+            for (int iy = 0; iy < core.ny(); iy++) {
+                y_index.push_back(y_index.back() + core.at(0, iy).ny());
+            }
+            VecI group_map(n_group_);
+            std::iota(group_map.begin(), group_map.end(), 0);
+            coarse_level_.reset(new CMFDCoarseLevel(mesh_, x_index, y_index,
+                                                    group_map, xsmesh_));
+            LogFile << "Multilevel CMFD with " << coarse_level_->n_cell()
+                    << " coarse cells" << std::endl;
+        }
+
+        // Few-group and/or radially-coarsened CMFD. The energy groups are
+        // given as the number of fine groups in each coarse group, and the
+        // radial mesh as the number of CMFD cells across each assembly.
+        bool condense = !input.attribute("energy_groups").empty();
+        bool coarsen  = !input.attribute("assembly_cells").empty();
+        if (condense || coarsen) {
+            VecI group_map;
+            if (condense) {
+                VecI n_fine = explode_string<int>(
+                    input.attribute("energy_groups").value());
+                for (int cg = 0; cg < (int)n_fine.size(); cg++) {
+                    if (n_fine[cg] < 1) {
+                        throw EXCEPT("Invalid CMFD energy group structure");
+                    }
+                    group_map.insert(group_map.end(), n_fine[cg], cg);
+                }
+                if ((int)group_map.size() != n_group_) {
+                    throw EXCEPT("CMFD energy groups do not add up to the "
+                                 "number of groups");
+                }
+            } else {
+                group_map.resize(n_group_);
+                std::iota(group_map.begin(), group_map.end(), 0);
+            }
+            if (wielandt_ || coarse_level_) {
+                Warn("Condensed CMFD replaces the multigroup eigenvalue "
+                     "solver, ignoring any other CMFD solver options");
+            }
+
+            // Keep the pin-level mesh, unless coarsening
+            VecI x_index(mesh_.nx() + 1);
+            std::iota(x_index.begin(), x_index.end(), 0);
+            VecI y_index(mesh_.ny() + 1);
+            std::iota(y_index.begin(), y_index.end(), 0);
+            if (coarsen) {
+                VecI n_cells = explode_string<int>(
+                    input.attribute("assembly_cells").value());
+                if ((n_cells.size() != 2) || (n_cells[0] < 1) ||
+                    (n_cells[1] < 1)) {
+                    throw EXCEPT("Invalid number of CMFD cells per assembly");
+                }
+                const Core &core = mesh->core();
+                VecI nx_asy;
+                for (int ix = 0; ix < core.nx(); ix++) {
+                    nx_asy.push_back(core.at(ix, 0).nx());
+                }
+                VecI ny_asy;
+                for (int iy = 0; iy < core.ny(); iy++) {
+                    ny_asy.push_back(core.at(0, iy).ny());
+                }
+                x_index = split_assemblies(nx_asy, n_cells[0]);
+                y_index = split_assemblies(ny_asy, n_cells[1]);
+            }
+            few_group_.reset(new CMFDCoarseLevel(mesh_, x_index, y_index,
+                                                 group_map, xsmesh_));
+            LogFile << "Condensed CMFD with " << few_group_->n_group()
+                    << " groups and " << few_group_->n_cell() << " cells"
+                    << std::endl;
+
+            // The multigroup systems are never solved
+            decltype(m_)().swap(m_);
+            decltype(solvers_)().swap(solvers_);
+            decltype(factored_values_)().swap(factored_values_);
+        }
+
+        // Partial-current and optimally-diffusive CMFD
+        if (!input.attribute("pcmfd").empty()) {
+            pcmfd_ = input.attribute("pcmfd").as_bool(false);
+        }
+        if (!input.attribute("odcmfd").empty()) {
+            odcmfd_ = input.attribute("odcmfd").as_bool(false);
+        }
+
+        // Matrix storage for the one-group systems
+        if (!input.attribute("operator").empty()) {
+            std::string in_string = input.attribute("operator").value();
+            sanitize(in_string);
+            if (in_string == "sparse") {
+                use_stencil_ = false;
+            } else if (in_string == "stencil") {
+                use_stencil_ = true;
+            } else {
+                throw EXCEPT("Unrecognized CMFD operator.");
+            }
+        }
+
+        if (!input.attribute("stencil_solver").empty()) {
+            std::string in_string = input.attribute("stencil_solver").value();
+            sanitize(in_string);
+            if (in_string == "bicgstab") {
+                stencil_sor_ = false;
+            } else if (in_string == "sor") {
+                stencil_sor_ = true;
+            } else {
+                throw EXCEPT("Unrecognized CMFD stencil solver.");
+            }
+        }
+
+        if (!input.attribute("sor_omega").empty()) {
+            sor_omega_ = input.attribute("sor_omega").as_float(-1.0);
+            if ((sor_omega_ <= 0.0) || (sor_omega_ >= 2.0)) {
+                throw EXCEPT("SOR over-relaxation factor is invalid.");
+            }
+        }
+
+        // External linear solver backend
+        backend_ = make_cmfd_linear_solver(input, n_group_);
+        if (backend_ && (use_stencil_ || wielandt_)) {
+            throw EXCEPT("External CMFD linear solvers are only supported "
+                         "with the sparse operator and power iteration");
+        }
+
+        if (input.attribute("offload").as_bool(false) &&
+            (!use_stencil_ || few_group_)) {
+            throw EXCEPT("Offloaded CMFD solves need the stencil operator");
+        }
+
+        if (use_stencil_ && !few_group_) {
+            if (mesh_.boundary()[(int)Surface::WEST] == Boundary::ROTATE) {
+                throw EXCEPT("The stencil CMFD operator does not support "
+                             "rotational symmetry");
+            }
+            if (wielandt_) {
+                throw EXCEPT("The stencil CMFD operator is only supported "
+                             "with power iteration");
+            }
+            stencil_.assign(n_group_,
+                            StencilMatrix(mesh_.nx(), mesh_.ny(), mesh_.nz()));
+
+            // Device-resident stencil solves
+            if (input.attribute("offload").as_bool(false)) {
+                if (stencil_sor_) {
+                    throw EXCEPT("Offloaded CMFD solves use BiCGSTAB, not "
+                                 "SOR");
+                }
+#ifndef MOCC_USE_OFFLOAD
+                Warn("Built without offload support. Offloaded CMFD solves "
+                     "will run on the host.");
+#endif
+                LogFile << "Offloading CMFD solves" << std::endl;
+                device_.reset(new DeviceStencil(mesh_.nx(), mesh_.ny(),
+                                                mesh_.nz(), n_group_));
+            }
+
+            // The sparse systems are never solved
+            decltype(m_)().swap(m_);
+            decltype(solvers_)().swap(solvers_);
+            decltype(factored_values_)().swap(factored_values_);
+            decltype(coeffs_)().swap(coeffs_);
+            decltype(coeff_offset_)().swap(coeff_offset_);
+            decltype(diagonal_)().swap(diagonal_);
+        }
+
+        // The groups of a color are solved concurrently, which the external
+        // and offloaded solvers don't support
+        if (energy_sweep_ != EnergySweep::GAUSS_SEIDEL) {
+            if (backend_ || device_) {
+                throw EXCEPT("Concurrent CMFD group solves are not supported "
+                             "with external linear solvers or offload");
+            }
+            if (wielandt_ || few_group_) {
+                Warn("The CMFD energy sweep only applies to the multigroup "
+                     "power iteration");
+            }
+            group_rhs_.assign(n_group_, VectorX(n_cell_));
+            group_x_.assign(n_group_, VectorX(n_cell_));
+        }
+    }
+
+    // Small enough sparse systems are cheaper to factorize once per CMFD
+    // solve than to iterate on. The sparsity pattern never changes, so its
+    // ordering and symbolic analysis are done here, once.
+    if (!m_.empty() && !backend_ && !wielandt_ && (n_cell_ <= direct_cells_)) {
+        if (!recycle_.empty()) {
+            Warn("Recycled solutions are not used by direct CMFD solves");
+            decltype(recycle_)().swap(recycle_);
+        }
+        decltype(lu_)(n_group_).swap(lu_);
+        Eigen::SparseMatrix<real_t> pattern = m_.front();
+        for (auto &lu : lu_) {
+            lu.analyzePattern(pattern);
+        }
+        decltype(solvers_)().swap(solvers_);
+        decltype(factored_values_)().swap(factored_values_);
+        LogFile << "Factorizing the " << n_cell_
+                << "-cell CMFD systems directly" << std::endl;
     }
 
     timer_.toc();
@@ -168,13 +637,14 @@ CMFD::CMFD(const pugi::xml_node &input, const CoreMesh *mesh,
     return;
 }
 
-void CMFD::solve(real_t &k)
+void CMFD::solve(real_t &k, bool update_xs)
 {
+    ThreadTeam team(Phase::CMFD);
     timer_.tic();
 
     // Make sure no negative flux
     if (zero_fixup_) {
-        for (int ig = 0; ig < (int)m_.size(); ig++) {
+        for (int ig = 0; ig < n_group_; ig++) {
             ArrayB1 flux_1g = coarse_data_.flux(blitz::Range::all(), ig);
             // assert( flux_1g.isStorageContiguous() );
             for (int i = 0; i < (int)flux_1g.size(); i++) {
@@ -184,13 +654,159 @@ void CMFD::solve(real_t &k)
     }
 
     // Update homogenized cross sections
-    xsmesh_.update();
+    if (update_xs) {
+        xsmesh_.update();
+    }
 
     // Set up the linear systems
     this->setup_solve();
 
+    // Loosen the tolerances for this solve to follow the outer iteration
+    real_t k_tol     = k_tol_;
+    real_t psi_tol   = psi_tol_;
+    real_t reduction = resid_reduction_;
+    if (inexact_) {
+        k_tol_   = std::max(k_tol, inexact_factor_ * outer_error_k_);
+        psi_tol_ = std::max(psi_tol, inexact_factor_ * outer_error_psi_);
+        real_t loose     = inexact_factor_ * outer_error_psi_;
+        resid_reduction_ = std::max(reduction, std::min(inexact_max_, loose));
+    }
+    solve_k_tol_.push_back(k_tol_);
+    solve_psi_tol_.push_back(psi_tol_);
+    solve_reduction_.push_back(resid_reduction_);
+    int iter_start        = n_iter_;
+    int linear_iter_start = n_linear_iter_;
+    real_t time_start     = timer_solve_.time();
+
     timer_solve_.tic();
 
+    if (few_group_) {
+        this->solve_few_group(k);
+    } else if (wielandt_) {
+        this->solve_wielandt(k);
+    } else {
+        this->solve_power(k);
+    }
+
+    k_tol_           = k_tol;
+    psi_tol_         = psi_tol;
+    resid_reduction_ = reduction;
+
+    // Clean up any negative values. These shouldnt be present at convergence,
+    // but sometimes things are nasty on the way there.
+    int n_neg = 0;
+    for (auto &v : coarse_data_.flux) {
+        if (v < 0.0) {
+            n_neg++;
+            v = -v;
+        }
+    }
+    if (n_neg > 0) {
+        LogFile << "Had to fix " << n_neg
+                << "negative fluxes coming from CMFD\n";
+    }
+
+    // Calculate the resultant currents and store back onto the coarse data
+    this->store_currents();
+
+    n_solve_++;
+
+    timer_solve_.toc();
+    timer_.toc();
+
+    solve_iter_.push_back(n_iter_ - iter_start);
+    solve_linear_iter_.push_back(n_linear_iter_ - linear_iter_start);
+    solve_time_.push_back(timer_solve_.time() - time_start);
+    return;
+} // solve()
+
+void CMFD::solve_fixed_source(const ArrayB2 &q, int g_first)
+{
+    assert(q.extent(0) == n_cell_);
+    assert(q.extent(1) == n_group_);
+    assert((g_first >= 0) && (g_first < n_group_));
+
+    ThreadTeam team(Phase::CMFD);
+    timer_.tic();
+
+    if (zero_fixup_) {
+        for (auto &v : coarse_data_.flux) {
+            v = std::max(v, 0.0);
+        }
+    }
+
+    xsmesh_.update();
+    this->setup_solve();
+
+    timer_solve_.tic();
+
+    // The right-hand side of each group changes from one energy iteration to
+    // the next, so converge the linear systems relative to it
+    for (auto &solver : solvers_) {
+        solver.setTolerance(resid_reduction_);
+    }
+    stencil_tol_ = resid_reduction_;
+
+    ArrayB2 flux_old(coarse_data_.flux.shape());
+    int iter   = 0;
+    real_t err = 0.0;
+    while (iter < max_iter_) {
+        iter++;
+        flux_old = coarse_data_.flux;
+        for (int group = g_first; group < n_group_; group++) {
+            source_.initialize_group(group);
+            source_.auxiliary(q(blitz::Range::all(), group));
+            source_.in_scatter(group);
+            source_.scale(mesh_.coarse_volume());
+
+            this->solve_1g(group);
+        }
+
+        real_t e    = 0.0;
+        real_t norm = 0.0;
+        for (int group = g_first; group < n_group_; group++) {
+            for (int i = 0; i < n_cell_; i++) {
+                real_t v = coarse_data_.flux(i, group);
+                real_t d = v - flux_old(i, group);
+                e += d * d;
+                norm += v * v;
+            }
+        }
+        err = (norm > 0.0) ? std::sqrt(e / norm) : 0.0;
+        if (err < psi_tol_) {
+            break;
+        }
+    }
+    n_iter_ += iter;
+
+    auto flags = LogScreen.flags();
+    LogScreen << "CMFD (fixed source) " << iter << " iterations, "
+              << std::scientific << err << std::endl;
+    LogScreen.flags(flags);
+
+    int n_neg = 0;
+    for (auto &v : coarse_data_.flux) {
+        if (v < 0.0) {
+            n_neg++;
+            v = -v;
+        }
+    }
+    if (n_neg > 0) {
+        LogFile << "Had to fix " << n_neg
+                << "negative fluxes coming from CMFD\n";
+    }
+
+    this->store_currents();
+
+    n_solve_++;
+
+    timer_solve_.toc();
+    timer_.toc();
+    return;
+} // solve_fixed_source()
+
+void CMFD::solve_power(real_t &k)
+{
     real_t k_old = k;
     this->fission_source(k);
     real_t tfis = this->total_fission();
@@ -202,6 +818,7 @@ void CMFD::solve(real_t &k)
     for (auto &solver : solvers_) {
         solver.setTolerance(resid_reduction_ * r0);
     }
+    stencil_tol_ = resid_reduction_ * r0;
 
     auto flags = LogScreen.flags();
     LogScreen << "CMFD Converging to " << std::scientific << k_tol_ << " "
@@ -214,19 +831,32 @@ void CMFD::solve(real_t &k)
     real_t ri      = 0.0; // Iteration residual
     while (true) {
         iter++;
-        // Compute fission source
         fs_old_ = fs_;
+
+        // Settle the long-wavelength error on the coarse level, then pick up
+        // the total fission rate of the rescaled flux
+        if (coarse_level_) {
+            coarse_level_->accelerate(k, coarse_data_.flux, d_tilde_, d_hat_,
+                                      k_tol_, psi_tol_, max_iter_);
+            tfis = this->total_fission();
+        }
+
+        // Compute fission source
         this->fission_source(k);
         real_t tfis_old = tfis;
 
         ri = 0.0;
-        for (int group = 0; group < n_group_; group++) {
-            source_.initialize_group(group);
-            source_.fission(fs_, group);
-            source_.in_scatter(group);
-            source_.scale(mesh_.coarse_volume());
-
-            ri += this->solve_1g(group);
+        if (energy_sweep_ == EnergySweep::GAUSS_SEIDEL) {
+            for (int group = 0; group < n_group_; group++) {
+                source_.initialize_group(group);
+                source_.fission(fs_, group);
+                source_.in_scatter(group);
+                source_.scale(mesh_.coarse_volume());
+
+                ri += this->solve_1g(group);
+            }
+        } else {
+            ri = this->solve_groups_parallel();
         }
         ri = std::sqrt(ri) / (n_cell_ * n_group_);
 
@@ -253,30 +883,159 @@ void CMFD::solve(real_t &k)
         }
     }
     this->print(iter, k, std::abs(k - k_old), psi_err, ri / r0);
+    n_iter_ += iter;
 
-    // Clean up any negative values. These shouldnt be present at convergence,
-    // but sometimes things are nasty on the way there.
-    int n_neg = 0;
-    for (auto &v : coarse_data_.flux) {
-        if (v < 0.0) {
-            n_neg++;
-            v = -v;
+    return;
+} // solve_power()
+
+void CMFD::solve_few_group(real_t &k)
+{
+    real_t k_old = k;
+    int iter = few_group_->accelerate(k, coarse_data_.flux, d_tilde_, d_hat_,
+                                      k_tol_, psi_tol_, max_iter_);
+    n_iter_ += iter;
+
+    auto flags = LogScreen.flags();
+    LogScreen << "CMFD (" << few_group_->n_group() << "-group) "
+              << std::setprecision(10) << k << " " << iter << " iterations, "
+              << std::scientific << std::abs(k - k_old) << std::endl;
+    LogScreen.flags(flags);
+
+    return;
+} // solve_few_group()
+
+void CMFD::solve_wielandt(real_t &k)
+{
+    const int n = n_cell_ * n_group_;
+
+    // Assemble the multigroup loss operator, A, and production operator, F,
+    // ordered by group, then cell. The diagonal blocks of A are the one-group
+    // matrices, which already account for self-scatter.
+    std::vector<T> loss;
+    std::vector<T> production;
+    for (int group = 0; group < n_group_; group++) {
+        const M &m = m_[group];
+        int off    = group * n_cell_;
+        for (int j = 0; j < m.outerSize(); j++) {
+            for (M::InnerIterator it(m, j); it; ++it) {
+                loss.push_back(T(off + it.row(), off + it.col(), it.value()));
+            }
         }
     }
-    if (n_neg > 0) {
-        LogFile << "Had to fix " << n_neg
-                << "negative fluxes coming from CMFD\n";
+    for (const auto &xsr : xsmesh_) {
+        for (const int i : xsr.reg()) {
+            real_t vol = mesh_.coarse_volume(i);
+            for (int group = 0; group < n_group_; group++) {
+                const ScatteringRow &scat_row = xsr.xsmacsc(group);
+                int gg                        = scat_row.min_g;
+                for (auto sc : scat_row) {
+                    if ((gg != group) && (sc != 0.0)) {
+                        loss.push_back(T(group * n_cell_ + i, gg * n_cell_ + i,
+                                         -vol * sc));
+                    }
+                    gg++;
+                }
+
+                real_t chi = xsr.xsmacch(group);
+                if (chi == 0.0) {
+                    continue;
+                }
+                for (int gg = 0; gg < n_group_; gg++) {
+                    real_t nf = xsr.xsmacnf(gg);
+                    if (nf != 0.0) {
+                        production.push_back(T(group * n_cell_ + i,
+                                               gg * n_cell_ + i,
+                                               vol * chi * nf));
+                    }
+                }
+            }
+        }
     }
+    M a(n, n);
+    M f(n, n);
+    a.setFromTriplets(loss.begin(), loss.end());
+    f.setFromTriplets(production.begin(), production.end());
 
-    // Calculate the resultant currents and store back onto the coarse data
-    this->store_currents();
+    VectorX phi(n);
+    for (int group = 0; group < n_group_; group++) {
+        for (int i = 0; i < n_cell_; i++) {
+            phi[group * n_cell_ + i] = coarse_data_.flux(i, group);
+        }
+    }
+    VectorX fphi = f * phi;
 
-    n_solve_++;
+    this->fission_source(k);
+    real_t r0 = (a * phi - fphi / k).norm() / n;
+
+    auto flags = LogScreen.flags();
+    LogScreen << "CMFD (Wielandt) Converging to " << std::scientific << k_tol_
+              << " " << std::scientific << psi_tol_ << " " << std::scientific
+              << r0 << std::endl;
+    LogScreen.flags(flags);
+
+    Eigen::BiCGSTAB<M> solver;
+    solver.setTolerance(resid_reduction_);
+    solver.setMaxIterations(150);
+
+    int iter       = 0;
+    real_t k_old   = k;
+    real_t psi_err = 1.0;
+    real_t ri      = 0.0;
+    while (true) {
+        iter++;
+
+        // Inverse iteration on the shifted operator:
+        // (A - F/k_s) phi' = (1/k - 1/k_s) F phi
+        real_t k_s      = k + wielandt_shift_;
+        real_t lambda   = 1.0 / k;
+        real_t lambda_s = 1.0 / k_s;
+        M shifted       = a - lambda_s * f;
+        solver.compute(shifted);
+        VectorX rhs      = (lambda - lambda_s) * fphi;
+        VectorX phi_new  = solver.solveWithGuess(rhs, phi);
+        n_linear_iter_ += solver.iterations();
+        VectorX fphi_new = f * phi_new;
+
+        // At convergence, phi' = phi, so the ratio of fission rates gives the
+        // correction to the eigenvalue
+        k_old = k;
+        k = 1.0 /
+            (lambda_s + (lambda - lambda_s) * fphi.sum() / fphi_new.sum());
+        phi  = phi_new;
+        fphi = fphi_new;
+
+        for (int group = 0; group < n_group_; group++) {
+            for (int i = 0; i < n_cell_; i++) {
+                coarse_data_.flux(i, group) = phi[group * n_cell_ + i];
+            }
+        }
+
+        fs_old_ = fs_;
+        this->fission_source(k);
+        psi_err = 0.0;
+        for (int i = 0; i < (int)fs_.size(); i++) {
+            real_t e = fs_(i) - fs_old_(i);
+            psi_err += e * e;
+        }
+        psi_err = std::sqrt(psi_err);
+
+        ri = (a * phi - fphi / k).norm() / n;
+
+        if (((std::abs(k - k_old) < k_tol_) && (psi_err < psi_tol_) &&
+             (ri / r0 < resid_reduction_)) ||
+            (iter > max_iter_)) {
+            break;
+        }
+
+        if ((iter % 10) == 0) {
+            this->print(iter, k, std::abs(k - k_old), psi_err, ri / r0);
+        }
+    }
+    this->print(iter, k, std::abs(k - k_old), psi_err, ri / r0);
+    n_iter_ += iter;
 
-    timer_solve_.toc();
-    timer_.toc();
     return;
-} // solve()
+} // solve_wielandt()
 
 real_t CMFD::solve_1g(int group)
 {
@@ -286,9 +1045,7 @@ real_t CMFD::solve_1g(int group)
         x_[i] = flux_1g(i);
     }
 
-    real_t resid = this->residual(group);
-
-    x_ = solvers_[group].solveWithGuess(source_.get(), x_);
+    real_t resid = this->solve_1g(group, source_.get(), x_);
 
     // Store the result of the LS solution onto the CoarseData
     for (int i = 0; i < n_cell_; i++) {
@@ -298,28 +1055,136 @@ real_t CMFD::solve_1g(int group)
     return resid;
 }
 
+real_t CMFD::solve_1g(int group, const VectorX &b, VectorX &x)
+{
+    real_t resid = this->residual(group, b, x);
+
+    if (!recycle_.empty()) {
+        LinearOperator op = [&](const VectorX &u, VectorX &y) {
+            if (use_stencil_) {
+                stencil_[group].multiply(u, y);
+            } else {
+                y = m_[group] * u;
+            }
+        };
+        recycle_[group].guess(op, b, x);
+    }
+
+    int n_linear = 0;
+    if (backend_) {
+        n_linear = backend_->solve(group, b, x, stencil_tol_, 150);
+    } else if (!lu_.empty()) {
+        x = lu_[group].solve(b);
+    } else if (!use_stencil_) {
+        x        = solvers_[group].solveWithGuess(b, x);
+        n_linear = solvers_[group].iterations();
+    } else if (device_) {
+        n_linear = device_->solve(group, b, x, stencil_tol_, 150);
+    } else if (stencil_sor_) {
+        n_linear =
+            stencil_[group].solve_sor(b, x, sor_omega_, stencil_tol_, 150);
+    } else {
+        n_linear = stencil_[group].solve_bicgstab(b, x, stencil_tol_, 150);
+    }
+#pragma omp atomic
+    n_linear_iter_ += n_linear;
+
+    if (!recycle_.empty()) {
+        recycle_[group].add(x);
+    }
+
+    return resid;
+}
+
+real_t CMFD::solve_groups_parallel()
+{
+    int n_color = (energy_sweep_ == EnergySweep::RED_BLACK) ? 2 : 1;
+    int n_thread = omp_get_max_threads();
+
+    // Each group of a color gets its own team of threads, for the
+    // parallelism within its solve
+    int max_levels = omp_get_max_active_levels();
+    omp_set_max_active_levels(std::max(max_levels, 2));
+
+    real_t resid = 0.0;
+    for (int color = 0; color < n_color; color++) {
+        VecI groups;
+        for (int group = color; group < n_group_; group += n_color) {
+            groups.push_back(group);
+        }
+        int n_team    = std::min((int)groups.size(), n_thread);
+        int team_size = std::max(1, n_thread / n_team);
+
+        for (int group : groups) {
+            source_.initialize_group(group);
+            source_.fission(fs_, group);
+            source_.in_scatter(group);
+            source_.scale(mesh_.coarse_volume());
+            group_rhs_[group] = source_.get();
+            for (int i = 0; i < n_cell_; i++) {
+                group_x_[group][i] = coarse_data_.flux(i, group);
+            }
+        }
+
+        std::exception_ptr error;
+#pragma omp parallel for num_threads(n_team) schedule(dynamic, 1) \
+    reduction(+ : resid)
+        for (int ig = 0; ig < (int)groups.size(); ig++) {
+            omp_set_num_threads(team_size);
+            int group = groups[ig];
+            try {
+                resid +=
+                    this->solve_1g(group, group_rhs_[group], group_x_[group]);
+            } catch (...) {
+#pragma omp critical
+                error = std::current_exception();
+            }
+        }
+        if (error) {
+            omp_set_max_active_levels(max_levels);
+            std::rethrow_exception(error);
+        }
+
+        for (int group : groups) {
+            for (int i = 0; i < n_cell_; i++) {
+                coarse_data_.flux(i, group) = group_x_[group][i];
+            }
+        }
+    }
+
+    omp_set_max_active_levels(max_levels);
+    return resid;
+}
+
 void CMFD::fission_source(real_t k)
 {
-    fs_ = 0.0;
-    for (const auto &xsr : xsmesh_) {
+    real_t r_keff = 1.0 / k;
+    int n_xsreg   = xsmesh_.size();
+    fs_           = 0.0;
+    // Each cell belongs to a single XS mesh region, so the regions may be
+    // treated independently
+#pragma omp parallel for
+    for (int ixs = 0; ixs < n_xsreg; ixs++) {
+        const auto &xsr = xsmesh_[ixs];
         for (const int i : xsr.reg()) {
+            real_t f = 0.0;
             for (int ig = 0; ig < n_group_; ig++) {
-                fs_(i) += xsr.xsmacnf(ig) * coarse_data_.flux(i, ig);
+                f += xsr.xsmacnf(ig) * coarse_data_.flux(i, ig);
             }
+            fs_(i) = f * r_keff;
         }
     }
 
-    real_t r_keff = 1.0 / k;
-    for (auto &v : fs_) {
-        v *= r_keff;
-    }
     return;
 }
 
 real_t CMFD::total_fission()
 {
-    real_t f = 0.0;
-    for (const auto &xsr : xsmesh_) {
+    real_t f    = 0.0;
+    int n_xsreg = xsmesh_.size();
+#pragma omp parallel for reduction(+ : f)
+    for (int ixs = 0; ixs < n_xsreg; ixs++) {
+        const auto &xsr = xsmesh_[ixs];
         for (const int i : xsr.reg()) {
             for (int ig = 0; ig < n_group_; ig++) {
                 f += xsr.xsmacnf(ig) * coarse_data_.flux(i, ig);
@@ -335,24 +1200,63 @@ void CMFD::setup_solve()
     timer_setup_.tic();
 
     const Mesh::BCArray_t bc = mesh_.boundary_array();
+
+    // Diffusivity to use at the domain boundary for each normal and side.
+    // Resolving these up front keeps exceptions out of the threaded surface
+    // loop below.
+    std::array<std::array<real_t, 2>, 3> bc_diffusivity;
+    for (int inorm = 0; inorm < 3; inorm++) {
+        for (int side = 0; side < 2; side++) {
+            switch (bc[inorm][side]) {
+            case Boundary::REFLECT:
+                bc_diffusivity[inorm][side] = 0.0 / 2.0;
+                break;
+            case Boundary::VACUUM:
+                bc_diffusivity[inorm][side] = 0.5 / 2.0;
+                break;
+            case Boundary::ROTATE:
+                // Handled through rotate_cell_
+                bc_diffusivity[inorm][side] = 0.0;
+                break;
+            default:
+                throw EXCEPT("Unsupported boundary type");
+            }
+        }
+    }
+
     // Construct the system matrix
 
     int nz        = fine_mesh_->nz();
     int n_mplanes = fine_mesh_->n_macroplanes();
-    int group     = 0;
-    for (auto &m : m_) {
+    int n_xsreg   = xsmesh_.size();
+    for (int group = 0; group < n_group_; group++) {
         // Diffusion coefficients
         VecF d_coeff(n_cell_);
+        VecF xstr(n_cell_);
         VecF xsrm(n_cell_);
-        for (const auto &xsr : xsmesh_) {
-            real_t d  = 1.0 / (3.0 * xsr.xsmactr(group));
-            real_t rm = xsr.xsmacrm(group);
+#pragma omp parallel for
+        for (int ixs = 0; ixs < n_xsreg; ixs++) {
+            const auto &xsr = xsmesh_[ixs];
+            real_t tr       = xsr.xsmactr(group);
+            real_t rm       = xsr.xsmacrm(group);
             for (const int i : xsr.reg()) {
-                d_coeff[i] = d;
+                d_coeff[i] = 1.0 / (3.0 * tr);
+                xstr[i]    = tr;
                 xsrm[i]    = rm;
             }
         }
 
+        // Diffusivity (D/h) of a cell across the given normal. odCMFD adds
+        // theta*h to the diffusion coefficient.
+        auto cell_diffusivity = [&](int cell, Normal n) {
+            real_t h = mesh_.cell_thickness(cell, n);
+            real_t d = d_coeff[cell];
+            if (odcmfd_) {
+                d += od_theta(xstr[cell] * h) * h;
+            }
+            return d / h;
+        };
+
         // Surface diffusivity (d_tilde) and non-linear correction coefficient
         // (d_hat) There are lots of options to optimize this, mostly algebraic
         // simplifications, but this is very conformal to the canonical
@@ -416,42 +1320,30 @@ void CMFD::setup_solve()
 
         // Loop over the surfaces in the mesh, and calculate the inter-cell
         // coupling coefficients
+#pragma omp parallel for
         for (int is = 0; is < n_surf_; is++) {
             auto cells  = mesh_.coarse_neigh_cells(is);
             Normal norm = mesh_.surface_normal(is);
 
             real_t diffusivity_1 = 0.0;
             real_t diffusivity_2 = 0.0;
-            if (cells.first > -1) {
-                diffusivity_1 = d_coeff[cells.first] /
-                                mesh_.cell_thickness(cells.first, norm);
+            if (rotate_cell_[is] >= 0) {
+                // The rotated cell stands in for the missing left cell. Its
+                // thickness is along the other radial direction.
+                Normal rot_norm =
+                    norm == Normal::X_NORM ? Normal::Y_NORM : Normal::X_NORM;
+                cells.first   = rotate_cell_[is];
+                diffusivity_1 = cell_diffusivity(cells.first, rot_norm);
+            } else if (cells.first > -1) {
+                diffusivity_1 = cell_diffusivity(cells.first, norm);
             } else {
-                switch (bc[(int)(norm)][0]) {
-                case Boundary::REFLECT:
-                    diffusivity_1 = 0.0 / 2.0;
-                    break;
-                case Boundary::VACUUM:
-                    diffusivity_1 = 0.5 / 2.0;
-                    break;
-                default:
-                    throw EXCEPT("Unsupported boundary type");
-                }
+                diffusivity_1 = bc_diffusivity[(int)(norm)][0];
             }
 
             if (cells.second > -1) {
-                diffusivity_2 = d_coeff[cells.second] /
-                                mesh_.cell_thickness(cells.second, norm);
+                diffusivity_2 = cell_diffusivity(cells.second, norm);
             } else {
-                switch (bc[(int)(norm)][1]) {
-                case Boundary::REFLECT:
-                    diffusivity_2 = 0.0 / 2.0;
-                    break;
-                case Boundary::VACUUM:
-                    diffusivity_2 = 0.5 / 2.0;
-                    break;
-                default:
-                    throw EXCEPT("Unsupported boundary type");
-                }
+                diffusivity_2 = bc_diffusivity[(int)(norm)][1];
             }
 
             d_tilde(is) = 2.0 * diffusivity_1 * diffusivity_2 /
@@ -488,6 +1380,29 @@ void CMFD::setup_solve()
                 if (!std::isfinite(d_hat(is))) {
                     d_hat(is) = 0.0;
                 }
+
+                // pCMFD corrects each partial current separately:
+                //   J+ = -D~/2 (flux_r - flux_l) + D^+ flux_l
+                //   J- =  D~/2 (flux_r - flux_l) + D^- flux_r
+                // The resulting net current is the same as that of the
+                // usual form, with D~ + (D^+ + D^-)/2 in place of D~ and
+                // (D^+ - D^-)/2 in place of D^, so store it that way. The
+                // partial currents are reconstructed from the net current
+                // and surface flux, as in store_currents(). On the domain
+                // boundary there is only one cell, so keep the usual form.
+                if (pcmfd_ && (flux_l > 0.0) && (flux_r > 0.0)) {
+                    real_t j_p     = 0.25 * sfc_flux + 0.5 * j;
+                    real_t j_m     = 0.25 * sfc_flux - 0.5 * j;
+                    real_t dt_half = 0.5 * d_tilde(is) * (flux_r - flux_l);
+                    real_t dh_p    = (j_p + dt_half) / flux_l;
+                    real_t dh_m    = (j_m - dt_half) / flux_r;
+                    real_t dt_p    = d_tilde(is) + 0.5 * (dh_p + dh_m);
+                    // Only use it if the effective diffusivity is positive
+                    if (dt_p > 0.0) {
+                        d_tilde(is) = dt_p;
+                        d_hat(is)   = 0.5 * (dh_p - dh_m);
+                    }
+                }
                 s_hat(is) = (cells.first >= 0)
                                 ? (sfc_flux - s_tilde(is) * flux_l -
                                    (1.0 - s_tilde(is)) * flux_r) /
@@ -499,54 +1414,85 @@ void CMFD::setup_solve()
             }
         } // surfaces
 
-        // put values into the matrix. Optimal access patterns in sparse
-        // matrix representations are not obvious, so the best way is to
-        // iterate through the matrix linearly and act according to the
-        // indices (i.e.  row/col) that we get for each coefficient.
-        for (int k = 0; k < m.outerSize(); k++) {
-            for (M::InnerIterator it(m, k); it; ++it) {
-                auto i = it.row();
-                auto j = it.col();
-                if (i == j) {
-                    // Diagonal element
-                    real_t v = mesh_.coarse_volume(i) * xsrm[i];
-                    for (auto is : AllSurfaces) {
-                        int surf = mesh_.coarse_surf(i, is);
-                        real_t a = mesh_.coarse_area(i, is);
+        // The few-group solve only needs the coupling coefficients
+        if (few_group_) {
+            continue;
+        }
 
-                        // Switch sign of D-hat if necessary
-                        real_t d_hat_ij = d_hat(surf);
-                        if ((is == Surface::WEST) || (is == Surface::SOUTH) ||
-                            (is == Surface::BOTTOM)) {
-                            d_hat_ij = -d_hat_ij;
-                        }
+        if (use_stencil_) {
+            StencilMatrix &m = stencil_[group];
+#pragma omp parallel for
+            for (int i = 0; i < n_cell_; i++) {
+                real_t diag = mesh_.coarse_volume(i) * xsrm[i];
+                for (auto is : AllSurfaces) {
+                    real_t sign_hat = ((is == Surface::WEST) ||
+                                       (is == Surface::SOUTH) ||
+                                       (is == Surface::BOTTOM))
+                                          ? -1.0
+                                          : 1.0;
+                    int surf    = mesh_.coarse_surf(i, is);
+                    real_t area = mesh_.coarse_area(i, is);
+                    diag += area * (d_tilde(surf) + sign_hat * d_hat(surf));
+                    m.coeff(i, is) =
+                        (mesh_.coarse_neighbor(i, is) >= 0)
+                            ? area * (-d_tilde(surf) + sign_hat * d_hat(surf))
+                            : 0.0;
+                }
+                m.diagonal(i) = diag;
+            }
+            if (device_) {
+                device_->update(group, m);
+            }
+            continue;
+        }
 
-                        v += a * (d_tilde(surf) + d_hat_ij);
-                    }
-                    it.valueRef() = v;
-                } else {
-                    // off-diagonal element
-                    auto pair       = mesh_.coarse_interface(i, j);
-                    real_t a        = mesh_.coarse_area(i, pair.second);
-                    int surf        = pair.first;
-                    real_t d_hat_ij = d_hat(surf);
-                    // Switch sign of D-hat if necessary
-                    if ((pair.second == Surface::WEST) ||
-                        (pair.second == Surface::SOUTH) ||
-                        (pair.second == Surface::BOTTOM)) {
-                        d_hat_ij = -d_hat_ij;
-                    }
+        // Put values into the matrix, using the precomputed mapping from the
+        // surface quantities to the non-zeros
+        M &m           = m_[group];
+        real_t *values = m.valuePtr();
+        int nnz        = m.nonZeros();
+#pragma omp parallel for
+        for (int inz = 0; inz < nnz; inz++) {
+            real_t v = 0.0;
+            for (int ic = coeff_offset_[inz]; ic < coeff_offset_[inz + 1];
+                 ic++) {
+                const auto &c = coeffs_[ic];
+                v += c.area * (c.sign_tilde * d_tilde(c.surf) +
+                               c.sign_hat * d_hat(c.surf));
+            }
+            values[inz] = v;
+        }
+#pragma omp parallel for
+        for (int i = 0; i < n_cell_; i++) {
+            values[diagonal_[i]] += mesh_.coarse_volume(i) * xsrm[i];
+        }
 
-                    real_t v      = a * (d_hat_ij - d_tilde(surf));
-                    it.valueRef() = v;
-                }
+        if (!lu_.empty()) {
+            lu_[group].factorize(Eigen::SparseMatrix<real_t>(m));
+            if (lu_[group].info() != Eigen::Success) {
+                throw EXCEPT("Failed to factorize a CMFD matrix.");
             }
-        } // matrix element loop
+            continue;
+        }
 
-        solvers_[group].compute(m);
+        // Only recompute the preconditioner if the matrix has drifted far
+        // enough from the one it was computed for. Otherwise, the solver
+        // keeps using the old preconditioner with the updated matrix, which
+        // it refers to rather than copies.
+        Eigen::Map<const VectorX> v(values, m.nonZeros());
+        VectorX &v0   = factored_values_[group];
+        bool refactor = (v0.size() != v.size()) ||
+                        ((v - v0).lpNorm<Eigen::Infinity>() >
+                         refactor_tol_ * v0.lpNorm<Eigen::Infinity>());
+        if (backend_) {
+            backend_->update(group, m, refactor);
+        } else if (refactor) {
+            solvers_[group].compute(m);
+        }
+        if (refactor) {
+            v0 = v;
+        }
         solvers_[group].setMaxIterations(150);
-
-        group++;
     } // group loop
     timer_setup_.toc();
     return;
@@ -573,6 +1519,9 @@ void CMFD::store_currents()
          */
         for (int is = 0; is < n_surf_; is++) {
             auto cells = mesh_.coarse_neigh_cells(is);
+            if (rotate_cell_[is] >= 0) {
+                cells.first = rotate_cell_[is];
+            }
             real_t flux_r =
                 cells.second >= 0 ? coarse_data_.flux(cells.second, ig) : 0.0;
             real_t flux_l =
@@ -660,11 +1609,104 @@ real_t CMFD::residual()
 
 real_t CMFD::residual(int group) const
 {
-    VectorX resid = m_[group] * x_ - source_.get();
+    return this->residual(group, source_.get(), x_);
+}
+
+real_t CMFD::residual(int group, const VectorX &b, const VectorX &x) const
+{
+    VectorX resid(n_cell_);
+    if (use_stencil_) {
+        stencil_[group].multiply(x, resid);
+        resid -= b;
+    } else {
+        resid = m_[group] * x - b;
+    }
 
     return resid.squaredNorm();
 }
 
+void CMFD::output_performance(H5Node &node) const
+{
+    node.write("solves", n_solve_);
+    node.write("iterations", n_iter_);
+    node.write("linear_iterations", n_linear_iter_);
+    node.write("time", timer_.time());
+    node.write("solve_time", timer_solve_.time());
+    node.write("setup_time", timer_setup_.time());
+    if (timer_solve_.has_counts()) {
+        auto g = node.create_group("solve_counters");
+        timer_solve_.output_counters(g);
+    }
+    if (coarse_level_) {
+        node.write("coarse_iterations", coarse_level_->n_iter());
+    }
+    if (few_group_) {
+        node.write("few_group_iterations", few_group_->n_iter());
+    }
+    if (!solve_iter_.empty()) {
+        auto g = node.create_group("solve_work");
+        g.write("iterations", VecF(solve_iter_.begin(), solve_iter_.end()));
+        g.write("linear_iterations",
+                VecF(solve_linear_iter_.begin(), solve_linear_iter_.end()));
+        g.write("time", solve_time_);
+        g.write("k_tol", solve_k_tol_);
+        g.write("psi_tol", solve_psi_tol_);
+        g.write("residual_reduction", solve_reduction_);
+    }
+
+    return;
+}
+
+void CMFD::memory(MemoryReport &report) const
+{
+    size_t matrices = 0;
+    for (const auto &m : m_) {
+        matrices += m.nonZeros() * (sizeof(real_t) + sizeof(int)) +
+                    (m.outerSize() + 1) * sizeof(int);
+    }
+    for (const auto &v : factored_values_) {
+        matrices += bytes(v);
+    }
+    for (const auto &m : stencil_) {
+        matrices += m.memory();
+    }
+    for (const auto &lu : lu_) {
+        matrices += (lu.nnzL() + lu.nnzU()) * (sizeof(real_t) + sizeof(int));
+    }
+    matrices += coeffs_.size() * sizeof(MatrixCoeff) + bytes(coeff_offset_) +
+                bytes(diagonal_);
+    report.add("matrices", matrices);
+
+    report.add("coarse_data", coarse_data_.memory());
+    report.add("cross_sections", xsmesh_.memory());
+    report.add("surface_coefficients", bytes(d_hat_) + bytes(d_tilde_) +
+                                           bytes(s_hat_) + bytes(s_tilde_));
+    report.add("vectors", bytes(fs_) + bytes(fs_old_) + bytes(x_) +
+                              bytes(current_1g_) + bytes(source_.get()));
+    if (!group_rhs_.empty()) {
+        report.add("group_vectors", (group_rhs_.size() + group_x_.size()) *
+                                        n_cell_ * sizeof(real_t));
+    }
+    if (!recycle_.empty()) {
+        size_t recycled = 0;
+        for (const auto &r : recycle_) {
+            recycled += r.memory();
+        }
+        report.add("recycled_solutions", recycled);
+    }
+    if (coarse_level_) {
+        report.add("coarse_level", coarse_level_->memory());
+    }
+    if (few_group_) {
+        report.add("few_group", few_group_->memory());
+    }
+    if (device_) {
+        report.add("device_stencil", device_->memory());
+    }
+
+    return;
+}
+
 void CMFD::output(H5Node &node) const
 {
     if (!dump_current_) {
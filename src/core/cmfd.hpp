@@ -21,11 +21,18 @@
 #include <Eigen/Sparse>
 
 #include "util/global_config.hpp"
+#include "util/memory.hpp"
 #include "util/timers.hpp"
+#include "cmfd_coarse_level.hpp"
+#include "cmfd_linear_solver.hpp"
+#include "cmfd_preconditioner.hpp"
 #include "coarse_data.hpp"
+#include "device_stencil.hpp"
 #include "eigen_interface.hpp"
 #include "mesh.hpp"
+#include "recycled_subspace.hpp"
 #include "source_isotropic.hpp"
+#include "stencil_matrix.hpp"
 #include "xs_mesh_homogenized.hpp"
 
 namespace mocc {
@@ -39,8 +46,36 @@ public:
      *
      * \param [in,out] k the initial guess to use for the system eigenvalue.
      * Updated byt the solve.
+     * \param update_xs whether to re-homogenize the cross sections with the
+     * transport flux first. A solve that runs alongside the transport sweep
+     * must not read its flux, so its caller updates them beforehand with
+     * \ref update_xs() and passes \c false.
      */
-    void solve(real_t &k);
+    void solve(real_t &k, bool update_xs = true);
+
+    /**
+     * \brief Re-homogenize the cross sections with the transport flux
+     */
+    void update_xs()
+    {
+        xsmesh_.update();
+    }
+
+    /**
+     * \brief Solve the CMFD system as a fixed-source problem
+     *
+     * \param [in] q the external source on the CMFD mesh, indexed by cell
+     * and group, per unit volume.
+     * \param [in] g_first the first group to solve for. The flux of the
+     * groups below it is held fixed, and only contributes to the in-scatter
+     * source.
+     *
+     * There is no fission source. The groups are solved in turn, with the
+     * in-scatter source from the latest flux of the other groups, until the
+     * relative change in the flux between energy iterations drops below the
+     * \c psi_tol, or \c max_iter iterations have been performed.
+     */
+    void solve_fixed_source(const ArrayB2 &q, int g_first = 0);
 
     /**
      * \brief Return a pointer to the coarse data.
@@ -104,8 +139,54 @@ public:
         return;
     }
 
+    /**
+     * \brief Return whether the tolerances of each solve follow the
+     * convergence of the outer iteration
+     */
+    bool is_inexact() const
+    {
+        return inexact_;
+    }
+
+    /**
+     * \brief Set the errors of the outer iteration that the next \ref solve()
+     * accelerates
+     *
+     * With inexact solves, the eigenvalue and fission source tolerances of
+     * the solve are loosened to \c inexact_factor times these errors, and
+     * the residual reduction of the linear solves to \c inexact_factor times
+     * the fission source error (but no more than \c inexact_max). None are
+     * ever tighter than the configured tolerances, which are reached as the
+     * outer iteration converges. This does nothing otherwise.
+     */
+    void set_outer_error(real_t error_k, real_t error_psi)
+    {
+        outer_error_k_   = error_k;
+        outer_error_psi_ = error_psi;
+        return;
+    }
+
     void output(H5Node &node) const;
 
+    /**
+     * \brief Write the number of solves and iterations performed so far, and
+     * the time spent on them.
+     *
+     * The work done by each eigenvalue solve (power or inverse iterations,
+     * linear solver iterations and time) is written to the \c solve_work
+     * group, along with the tolerances that it was converged to.
+     */
+    void output_performance(H5Node &node) const;
+
+    /**
+     * \brief Add the memory used by the CMFD matrices, coarse mesh data and
+     * work arrays to a \ref MemoryReport
+     *
+     * The storage internal to the linear solvers (e.g. the preconditioner
+     * factors) is not counted.
+     */
+    void memory(MemoryReport &report) const;
+
 private:
     // Private methods
     /**
@@ -161,7 +242,67 @@ norm = std::sqrt(norm)/(n_cell_*n_group_);
      * \sa CMFD::residual()
      */
     real_t residual(int group) const;
+
+    /**
+     * \brief Return the squared L-2 norm of the residual of a group, for the
+     * given right-hand side and flux
+     */
+    real_t residual(int group, const VectorX &b, const VectorX &x) const;
+
+    /**
+     * \brief Converge the CMFD system with power iteration, solving each
+     * group in turn.
+     */
+    void solve_power(real_t &k);
+
+    /**
+     * \brief Converge the CMFD system with Wielandt-shifted inverse
+     * iteration on the full multigroup system.
+     *
+     * The multigroup loss and production operators are assembled once per
+     * solve, with all scattering (including upscatter) in the loss operator.
+     * Each iteration solves the shifted system with BiCGSTAB, using a shift
+     * of \c wielandt_shift_ above the current eigenvalue estimate.
+     *
+     * \pre \ref setup_solve() has been called.
+     */
+    void solve_wielandt(real_t &k);
+
+    /**
+     * \brief Converge the CMFD system in a condensed group structure and/or
+     * on a coarser radial mesh, and prolong the result back onto the
+     * multigroup pin-level flux
+     *
+     * \pre \ref setup_solve() has been called, which computes the
+     * multigroup coupling coefficients.
+     */
+    void solve_few_group(real_t &k);
+
     real_t solve_1g(int group);
+
+    /**
+     * \brief Solve the one-group system of a group for the right-hand side
+     * \p b, using and overwriting the initial guess \p x
+     *
+     * This neither reads nor writes the \ref CoarseData flux, so the systems
+     * of several groups may be solved at once, as long as each has its own
+     * \p b and \p x. Returns the squared residual of the initial guess.
+     */
+    real_t solve_1g(int group, const VectorX &b, VectorX &x);
+
+    /**
+     * \brief Do one inner iteration over all groups, solving the groups of
+     * each color of the \ref energy_sweep_ concurrently
+     *
+     * The sources of a color are all built before any of its groups are
+     * solved, so that the in-scatter between groups of the same color is
+     * that of the previous iterate. Returns the sum of the squared residuals
+     * of the groups.
+     *
+     * \pre The fission source is stored in \c fs_
+     */
+    real_t solve_groups_parallel();
+
     void fission_source(real_t k);
     void print(int iter, real_t k, real_t k_err, real_t psi_err,
                real_t resid_ratio);
@@ -214,11 +355,118 @@ norm = std::sqrt(norm)/(n_cell_*n_group_);
 
     SourceIsotropic source_;
 
-    // Vector of one-group sparse matrix
-    std::vector<Eigen::SparseMatrix<real_t>> m_;
+    // Vector of one-group sparse matrix. These are row-major, so that Eigen
+    // can thread the matrix-vector products in the solvers.
+    std::vector<Eigen::SparseMatrix<real_t, Eigen::RowMajor>> m_;
+
+    // Vector of BiCGSTAB objects
+    std::vector<Eigen::BiCGSTAB<Eigen::SparseMatrix<real_t, Eigen::RowMajor>,
+                                CMFDPreconditioner>>
+        solvers_;
+
+    // Sparse LU factorizations of the one-group matrices, used in place of
+    // the BiCGSTAB objects above for systems of at most direct_cells_ cells.
+    // They are refactorized for every CMFD solve, and empty if unused.
+    std::vector<Eigen::SparseLU<Eigen::SparseMatrix<real_t>,
+                                Eigen::COLAMDOrdering<int>>>
+        lu_;
+    int direct_cells_;
+
+    // Seven-point stencil form of the one-group matrices, used in place of
+    // the sparse matrices and BiCGSTAB objects above if requested
+    bool use_stencil_;
+    std::vector<StencilMatrix> stencil_;
+
+    // Device copies of the stencil matrices, used for the stencil solves if
+    // present
+    std::unique_ptr<DeviceStencil> device_;
+
+    // Use red-black SOR, rather than BiCGSTAB, for the stencil solves
+    bool stencil_sor_;
+    real_t sor_omega_;
+
+    // Relative residual to converge the stencil and external backend solves
+    // to
+    real_t stencil_tol_;
+
+    // External solver for the one-group sparse systems, used in place of the
+    // BiCGSTAB objects above if present
+    std::unique_ptr<CMFDLinearSolver> backend_;
+
+    // Previous solutions of each group's one-group system, used to improve
+    // the initial guesses of its later solves. Empty unless enabled.
+    std::vector<RecycledSubspace> recycle_;
+
+    // How the groups are iterated in energy. GAUSS_SEIDEL solves them one
+    // after another, using the latest flux of all other groups. JACOBI
+    // solves all groups at once, with the in-scatter source from the
+    // previous iterate, and RED_BLACK does the same for the even groups,
+    // then for the odd groups.
+    enum class EnergySweep { GAUSS_SEIDEL, JACOBI, RED_BLACK };
+    EnergySweep energy_sweep_;
+
+    // Right-hand side and solution of each group, for the concurrent group
+    // solves. Empty for Gauss-Seidel.
+    std::vector<VectorX> group_rhs_;
+    std::vector<VectorX> group_x_;
+
+    // Use the partial-current (pCMFD) form of the coupling coefficients
+    bool pcmfd_;
+
+    // Use optimally-diffusive (odCMFD) diffusion coefficients
+    bool odcmfd_;
 
-    // Vector of BiCGSTAB objects.
-    std::vector<Eigen::BiCGSTAB<Eigen::SparseMatrix<real_t>>> solvers_;
+    /**
+     * \brief Contribution of a surface to a non-zero of the CMFD matrix
+     *
+     * Each non-zero value is the sum of its contributions, of the form
+     * area * (sign_tilde * d_tilde + sign_hat * d_hat), plus the removal
+     * term for diagonal entries.
+     */
+    struct MatrixCoeff {
+        // Index of the non-zero in the matrix value array
+        int nz;
+        int surf;
+        real_t area;
+        real_t sign_tilde;
+        real_t sign_hat;
+    };
+
+    // Surface contributions to the matrix non-zeros. The sparsity pattern is
+    // the same for all groups and never changes, so these are built once
+    // and used to update the matrix values in place. The contributions to
+    // non-zero nz are in [coeff_offset_[nz], coeff_offset_[nz+1]).
+    std::vector<MatrixCoeff> coeffs_;
+    VecI coeff_offset_;
+
+    // Index of the diagonal non-zero for each cell
+    VecI diagonal_;
+
+    // For each surface on a rotationally-symmetric boundary, the cell that
+    // maps onto the missing "left" side of the surface when rotated into
+    // the domain. -1 for all other surfaces.
+    VecI rotate_cell_;
+
+    // Matrix values for each group at the time its preconditioner was last
+    // computed
+    std::vector<VectorX> factored_values_;
+
+    // Relative change in the matrix values beyond which the preconditioner
+    // is recomputed
+    real_t refactor_tol_;
+
+    // Use Wielandt-shifted inverse iteration, rather than power iteration
+    bool wielandt_;
+    // Shift (in k) of the Wielandt operator above the eigenvalue estimate
+    real_t wielandt_shift_;
+
+    // Assembly-level CMFD used to accelerate the power iteration. Null if
+    // multilevel acceleration is disabled.
+    std::unique_ptr<CMFDCoarseLevel> coarse_level_;
+
+    // Energy-condensed and/or radially-coarsened CMFD, which replaces the
+    // multigroup pin-level solve if present
+    std::unique_ptr<CMFDCoarseLevel> few_group_;
 
     // Surface quantities. We need to keep these around to do the current
     // update without having to recalculate. Based on profiling, might be
@@ -232,12 +480,34 @@ norm = std::sqrt(norm)/(n_cell_*n_group_);
     // Number of times solve() has been called
     int n_solve_;
 
+    // Total number of power/inverse iterations over all solves, and of
+    // linear solver iterations
+    int n_iter_;
+    int n_linear_iter_;
+
+    // Iterations, linear solver iterations, time and tolerances of each
+    // eigenvalue solve
+    VecI solve_iter_;
+    VecI solve_linear_iter_;
+    VecF solve_time_;
+    VecF solve_k_tol_;
+    VecF solve_psi_tol_;
+    VecF solve_reduction_;
+
     // Convergence options
     real_t k_tol_;
     real_t psi_tol_;
     real_t resid_reduction_;
     int max_iter_;
 
+    // Inexact solves, with tolerances following the errors of the outer
+    // iteration. See set_outer_error().
+    bool inexact_;
+    real_t inexact_factor_;
+    real_t inexact_max_;
+    real_t outer_error_k_;
+    real_t outer_error_psi_;
+
     // Other options
     bool zero_fixup_;
     bool dump_current_;
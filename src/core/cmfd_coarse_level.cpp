@@ -0,0 +1,459 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "cmfd_coarse_level.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include "util/error.hpp"
+#include "util/memory.hpp"
+
+typedef Eigen::Triplet<mocc::real_t> T;
+
+namespace {
+using namespace mocc;
+Mesh make_coarse_mesh(const Mesh &fine, const VecI &x_index,
+                      const VecI &y_index)
+{
+    if ((x_index.size() < 2) || (x_index.front() != 0) ||
+        (x_index.back() != (int)fine.nx()) || (y_index.size() < 2) ||
+        (y_index.front() != 0) || (y_index.back() != (int)fine.ny())) {
+        throw EXCEPT("Coarse CMFD boundaries do not span the mesh");
+    }
+    if (!std::is_sorted(x_index.begin(), x_index.end()) ||
+        !std::is_sorted(y_index.begin(), y_index.end())) {
+        throw EXCEPT("Coarse CMFD boundaries are out of order");
+    }
+
+    VecF hx;
+    for (int i : x_index) {
+        hx.push_back(fine.x_divisions()[i]);
+    }
+    VecF hy;
+    for (int i : y_index) {
+        hy.push_back(fine.y_divisions()[i]);
+    }
+    size_t n_reg = (hx.size() - 1) * (hy.size() - 1) * fine.nz();
+
+    return Mesh(n_reg, n_reg, hx, hy, fine.z_divisions(), fine.boundary());
+}
+}
+
+namespace mocc {
+CMFDCoarseLevel::CMFDCoarseLevel(const Mesh &fine, const VecI &x_index,
+                                 const VecI &y_index, const VecI &group_map,
+                                 const XSMeshHomogenized &xsmesh)
+    : fine_mesh_(fine),
+      xsmesh_(xsmesh),
+      mesh_(make_coarse_mesh(fine, x_index, y_index)),
+      n_cell_(mesh_.n_pin()),
+      n_surf_(mesh_.n_surf()),
+      n_fine_group_(xsmesh.n_group()),
+      n_group_(group_map.empty() ? 0 : group_map.back() + 1),
+      group_map_(group_map),
+      flux_(n_cell_, n_group_),
+      xsrm_(n_cell_, n_group_),
+      xsnf_(n_cell_, n_group_),
+      xsch_(n_cell_, n_group_),
+      diffusion_(n_cell_, n_group_),
+      current_(n_surf_, n_group_),
+      m_(n_group_, Matrix_t(n_cell_, n_cell_)),
+      solvers_(n_group_),
+      n_iter_(0)
+{
+    if (group_map_.empty() || ((int)group_map_.size() != n_fine_group_) ||
+        (group_map_[0] != 0)) {
+        throw EXCEPT("Coarse CMFD group structure does not match the fine "
+                     "groups");
+    }
+    for (int g = 1; g < n_fine_group_; g++) {
+        if ((group_map_[g] != group_map_[g - 1]) &&
+            (group_map_[g] != group_map_[g - 1] + 1)) {
+            throw EXCEPT("Coarse CMFD groups must be contiguous");
+        }
+    }
+
+    for (auto b : mesh_.boundary()) {
+        if (b == Boundary::ROTATE) {
+            throw EXCEPT("Multilevel CMFD does not support rotational "
+                         "symmetry");
+        }
+    }
+
+    const Mesh::BCArray_t bc = mesh_.boundary_array();
+    for (int inorm = 0; inorm < 3; inorm++) {
+        for (int side = 0; side < 2; side++) {
+            bc_diffusivity_[inorm][side] =
+                (bc[inorm][side] == Boundary::VACUUM) ? 0.5 / 2.0 : 0.0;
+        }
+    }
+
+    // Map the pin-level cells onto the coarse cells
+    int n_fine = fine_mesh_.n_pin();
+    VecI x_map(fine_mesh_.nx());
+    for (int ix = 0; ix < (int)x_index.size() - 1; ix++) {
+        std::fill(x_map.begin() + x_index[ix], x_map.begin() + x_index[ix + 1],
+                  ix);
+    }
+    VecI y_map(fine_mesh_.ny());
+    for (int iy = 0; iy < (int)y_index.size() - 1; iy++) {
+        std::fill(y_map.begin() + y_index[iy], y_map.begin() + y_index[iy + 1],
+                  iy);
+    }
+    cell_map_.resize(n_fine);
+    for (int i = 0; i < n_fine; i++) {
+        Position pos = fine_mesh_.coarse_position(i);
+        cell_map_[i] =
+            mesh_.coarse_cell(Position(x_map[pos.x], y_map[pos.y], pos.z));
+    }
+
+    fine_offset_.assign(n_cell_ + 1, 0);
+    for (int i = 0; i < n_fine; i++) {
+        fine_offset_[cell_map_[i] + 1]++;
+    }
+    for (int ic = 0; ic < n_cell_; ic++) {
+        fine_offset_[ic + 1] += fine_offset_[ic];
+    }
+    fine_cells_.resize(n_fine);
+    VecI fill(fine_offset_.begin(), fine_offset_.end() - 1);
+    for (int i = 0; i < n_fine; i++) {
+        fine_cells_[fill[cell_map_[i]]++] = i;
+    }
+
+    fine_xsreg_.assign(n_fine, -1);
+    for (int ixs = 0; ixs < (int)xsmesh_.size(); ixs++) {
+        for (const int i : xsmesh_[ixs].reg()) {
+            fine_xsreg_[i] = ixs;
+        }
+    }
+
+    // A pin-level surface lies on a coarse surface if the cells on either
+    // side of it belong to different coarse cells
+    surf_map_.assign(fine_mesh_.n_surf(), -1);
+    for (int i = 0; i < n_fine; i++) {
+        for (auto d : AllSurfaces) {
+            int n = fine_mesh_.coarse_neighbor(i, d);
+            if ((n < 0) || (cell_map_[n] != cell_map_[i])) {
+                surf_map_[fine_mesh_.coarse_surf(i, d)] =
+                    mesh_.coarse_surf(cell_map_[i], d);
+            }
+        }
+    }
+
+    return;
+}
+
+void CMFDCoarseLevel::homogenize(const ArrayB2 &flux, const ArrayB2 &d_tilde,
+                                 const ArrayB2 &d_hat)
+{
+    // Size the in-scatter bands, which may change with the cross sections
+    scat_min_.assign(n_cell_ * n_group_, n_group_);
+    VecI scat_max(n_cell_ * n_group_, -1);
+    for (int ic = 0; ic < n_cell_; ic++) {
+        for (int j = fine_offset_[ic]; j < fine_offset_[ic + 1]; j++) {
+            const auto &xsr = xsmesh_[fine_xsreg_[fine_cells_[j]]];
+            for (int g = 0; g < n_fine_group_; g++) {
+                const auto &row = xsr.xsmacsc(g);
+                int ig          = ic * n_group_ + group_map_[g];
+                scat_min_[ig] = std::min(scat_min_[ig], group_map_[row.min_g]);
+                scat_max[ig]  = std::max(scat_max[ig], group_map_[row.max_g]);
+            }
+        }
+    }
+    scat_offset_.assign(n_cell_ * n_group_ + 1, 0);
+    for (int ig = 0; ig < n_cell_ * n_group_; ig++) {
+        scat_offset_[ig + 1] =
+            scat_offset_[ig] + std::max(0, scat_max[ig] - scat_min_[ig] + 1);
+    }
+    scat_.assign(scat_offset_.back(), 0.0);
+
+    // Flux-volume weighted cross sections. The fission spectrum is weighted
+    // by the fission source instead. Scattering between fine groups that
+    // share a coarse group stays within the coarse group, so it comes off of
+    // the removal cross section.
+#pragma omp parallel for
+    for (int ic = 0; ic < n_cell_; ic++) {
+        VecF weight(n_group_, 0.0);
+        real_t fission = 0.0;
+        for (int g = 0; g < n_group_; g++) {
+            xsrm_(ic, g)      = 0.0;
+            xsnf_(ic, g)      = 0.0;
+            xsch_(ic, g)      = 0.0;
+            diffusion_(ic, g) = 0.0;
+        }
+        for (int j = fine_offset_[ic]; j < fine_offset_[ic + 1]; j++) {
+            int i           = fine_cells_[j];
+            const auto &xsr = xsmesh_[fine_xsreg_[i]];
+            real_t vol      = fine_mesh_.coarse_volume(i);
+            real_t fs       = 0.0;
+            for (int g = 0; g < n_fine_group_; g++) {
+                int cg   = group_map_[g];
+                real_t w = flux(i, g) * vol;
+                weight[cg] += w;
+                xsrm_(ic, cg) += xsr.xsmacrm(g) * w;
+                xsnf_(ic, cg) += xsr.xsmacnf(g) * w;
+                diffusion_(ic, cg) += w / (3.0 * xsr.xsmactr(g));
+                fs += xsr.xsmacnf(g) * w;
+            }
+            fission += fs;
+            for (int g = 0; g < n_fine_group_; g++) {
+                int cg = group_map_[g];
+                xsch_(ic, cg) += xsr.xsmacch(g) * fs;
+
+                const auto &row = xsr.xsmacsc(g);
+                int ig          = ic * n_group_ + cg;
+                real_t *scat    = scat_.data() + scat_offset_[ig];
+                int cg_min      = scat_min_[ig];
+                for (int gg = row.min_g; gg <= row.max_g; gg++) {
+                    real_t rate = row[gg] * flux(i, gg) * vol;
+                    if (group_map_[gg] == cg) {
+                        if (gg != g) {
+                            xsrm_(ic, cg) -= rate;
+                        }
+                    } else {
+                        scat[group_map_[gg] - cg_min] += rate;
+                    }
+                }
+            }
+        }
+
+        real_t vol = mesh_.coarse_volume(ic);
+        for (int g = 0; g < n_group_; g++) {
+            if (weight[g] > 0.0) {
+                xsrm_(ic, g) /= weight[g];
+                xsnf_(ic, g) /= weight[g];
+                diffusion_(ic, g) /= weight[g];
+            }
+            if (fission > 0.0) {
+                xsch_(ic, g) /= fission;
+            }
+            flux_(ic, g) = weight[g] / vol;
+
+            int ig       = ic * n_group_ + g;
+            real_t *scat = scat_.data() + scat_offset_[ig];
+            int n_scat   = scat_offset_[ig + 1] - scat_offset_[ig];
+            for (int k = 0; k < n_scat; k++) {
+                int gg = scat_min_[ig] + k;
+                if (weight[gg] > 0.0) {
+                    scat[k] /= weight[gg];
+                }
+            }
+        }
+    }
+
+    // Sum the pin-level currents, as implied by the pin-level D-tildes and
+    // D-hats, over each coarse surface
+    int n_fine_surf = fine_mesh_.n_surf();
+#pragma omp parallel for
+    for (int cg = 0; cg < n_group_; cg++) {
+        for (int is = 0; is < n_surf_; is++) {
+            current_(is, cg) = 0.0;
+        }
+        for (int g = 0; g < n_fine_group_; g++) {
+            if (group_map_[g] != cg) {
+                continue;
+            }
+            for (int is = 0; is < n_fine_surf; is++) {
+                int cs = surf_map_[is];
+                if (cs < 0) {
+                    continue;
+                }
+                auto cells    = fine_mesh_.coarse_neigh_cells(is);
+                real_t flux_l = cells.first >= 0 ? flux(cells.first, g) : 0.0;
+                real_t flux_r =
+                    cells.second >= 0 ? flux(cells.second, g) : 0.0;
+                real_t j = -d_tilde(is, g) * (flux_r - flux_l) +
+                           d_hat(is, g) * (flux_r + flux_l);
+                current_(cs, cg) += j * fine_mesh_.coarse_area(is);
+            }
+        }
+        for (int is = 0; is < n_surf_; is++) {
+            current_(is, cg) /= mesh_.coarse_area(is);
+        }
+    }
+
+    return;
+}
+
+void CMFDCoarseLevel::setup()
+{
+#pragma omp parallel for
+    for (int g = 0; g < n_group_; g++) {
+        // Coupling coefficients, with the D-hats chosen to reproduce the
+        // homogenized currents
+        VecF d_tilde(n_surf_);
+        VecF d_hat(n_surf_);
+        for (int is = 0; is < n_surf_; is++) {
+            auto cells  = mesh_.coarse_neigh_cells(is);
+            Normal norm = mesh_.surface_normal(is);
+
+            real_t diffusivity_1 =
+                cells.first >= 0 ? diffusion_(cells.first, g) /
+                                       mesh_.cell_thickness(cells.first, norm)
+                                 : bc_diffusivity_[(int)norm][0];
+            real_t diffusivity_2 =
+                cells.second >= 0 ? diffusion_(cells.second, g) /
+                                        mesh_.cell_thickness(cells.second, norm)
+                                  : bc_diffusivity_[(int)norm][1];
+            real_t sum  = diffusivity_1 + diffusivity_2;
+            d_tilde[is] = sum > 0.0
+                              ? 2.0 * diffusivity_1 * diffusivity_2 / sum
+                              : 0.0;
+
+            real_t flux_l = cells.first >= 0 ? flux_(cells.first, g) : 0.0;
+            real_t flux_r = cells.second >= 0 ? flux_(cells.second, g) : 0.0;
+            d_hat[is] = (current_(is, g) + d_tilde[is] * (flux_r - flux_l)) /
+                        (flux_l + flux_r);
+            if (!std::isfinite(d_hat[is])) {
+                d_hat[is] = 0.0;
+            }
+        }
+
+        std::vector<T> entries;
+        entries.reserve(7 * n_cell_);
+        for (int ic = 0; ic < n_cell_; ic++) {
+            real_t diag = mesh_.coarse_volume(ic) * xsrm_(ic, g);
+            for (auto d : AllSurfaces) {
+                int is      = mesh_.coarse_surf(ic, d);
+                real_t area = mesh_.coarse_area(ic, d);
+                real_t sign = ((d == Surface::WEST) || (d == Surface::SOUTH) ||
+                               (d == Surface::BOTTOM))
+                                  ? -1.0
+                                  : 1.0;
+                diag += area * (d_tilde[is] + sign * d_hat[is]);
+                int n = mesh_.coarse_neighbor(ic, d);
+                if (n >= 0) {
+                    entries.push_back(
+                        T(ic, n, area * (-d_tilde[is] + sign * d_hat[is])));
+                }
+            }
+            entries.push_back(T(ic, ic, diag));
+        }
+        m_[g].setFromTriplets(entries.begin(), entries.end());
+        solvers_[g].compute(m_[g]);
+    }
+
+    for (const auto &solver : solvers_) {
+        if (solver.info() != Eigen::Success) {
+            throw EXCEPT("Failed to factorize coarse CMFD system");
+        }
+    }
+
+    return;
+}
+
+int CMFDCoarseLevel::accelerate(real_t &k, ArrayB2 &flux,
+                                const ArrayB2 &d_tilde, const ArrayB2 &d_hat,
+                                real_t k_tol, real_t psi_tol, int max_iter)
+{
+    this->homogenize(flux, d_tilde, d_hat);
+    this->setup();
+
+    ArrayB2 flux_0(flux_.copy());
+
+    auto fission_source = [&](VecF &fs) {
+        real_t r_keff = 1.0 / k;
+        real_t total  = 0.0;
+        for (int ic = 0; ic < n_cell_; ic++) {
+            real_t f = 0.0;
+            for (int g = 0; g < n_group_; g++) {
+                f += xsnf_(ic, g) * flux_(ic, g);
+            }
+            fs[ic] = f * r_keff;
+            total += f * mesh_.coarse_volume(ic);
+        }
+        return total;
+    };
+
+    VecF fs(n_cell_);
+    VecF fs_old(n_cell_);
+    VectorX b(n_cell_);
+    real_t tfis = fission_source(fs);
+    int iter    = 0;
+    while (iter < max_iter) {
+        iter++;
+        n_iter_++;
+        fs_old = fs;
+
+        for (int g = 0; g < n_group_; g++) {
+            for (int ic = 0; ic < n_cell_; ic++) {
+                int ig             = ic * n_group_ + g;
+                const real_t *scat = scat_.data() + scat_offset_[ig];
+                int n_scat         = scat_offset_[ig + 1] - scat_offset_[ig];
+                real_t s           = xsch_(ic, g) * fs[ic];
+                for (int j = 0; j < n_scat; j++) {
+                    int gg = scat_min_[ig] + j;
+                    if (gg != g) {
+                        s += scat[j] * flux_(ic, gg);
+                    }
+                }
+                b[ic] = s * mesh_.coarse_volume(ic);
+            }
+            VectorX x = solvers_[g].solve(b);
+            for (int ic = 0; ic < n_cell_; ic++) {
+                flux_(ic, g) = x[ic];
+            }
+        }
+
+        real_t tfis_old = tfis;
+        real_t k_old    = k;
+        tfis            = fission_source(fs);
+        k               = k * tfis / tfis_old;
+
+        real_t psi_err = 0.0;
+        for (int ic = 0; ic < n_cell_; ic++) {
+            real_t e = fs[ic] - fs_old[ic];
+            psi_err += e * e;
+        }
+        psi_err = std::sqrt(psi_err);
+
+        if ((std::abs(k - k_old) < k_tol) && (psi_err < psi_tol)) {
+            break;
+        }
+    }
+
+    // Prolong the change in the coarse flux back onto the pin-level flux
+#pragma omp parallel for
+    for (int ic = 0; ic < n_cell_; ic++) {
+        for (int g = 0; g < n_fine_group_; g++) {
+            int cg = group_map_[g];
+            if (flux_0(ic, cg) <= 0.0) {
+                continue;
+            }
+            real_t ratio = flux_(ic, cg) / flux_0(ic, cg);
+            for (int j = fine_offset_[ic]; j < fine_offset_[ic + 1]; j++) {
+                flux(fine_cells_[j], g) *= ratio;
+            }
+        }
+    }
+
+    return iter;
+}
+
+size_t CMFDCoarseLevel::memory() const
+{
+    size_t n = bytes(group_map_) + bytes(cell_map_) + bytes(fine_cells_) +
+               bytes(fine_offset_) + bytes(fine_xsreg_) + bytes(surf_map_) +
+               bytes(flux_) + bytes(xsrm_) + bytes(xsnf_) + bytes(xsch_) +
+               bytes(diffusion_) + bytes(current_) + bytes(scat_min_) +
+               bytes(scat_offset_) + bytes(scat_);
+    for (const auto &m : m_) {
+        n += m.nonZeros() * (sizeof(real_t) + sizeof(int)) +
+             (m.outerSize() + 1) * sizeof(int);
+    }
+    return n;
+}
+}
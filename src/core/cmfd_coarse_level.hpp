@@ -0,0 +1,183 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include <Eigen/Sparse>
+
+#include "util/global_config.hpp"
+#include "eigen_interface.hpp"
+#include "mesh.hpp"
+#include "xs_mesh_homogenized.hpp"
+
+namespace mocc {
+/**
+ * \brief Coarse (e.g. assembly-sized and/or few-group) CMFD level, used to
+ * accelerate or stand in for the pin-level CMFD system
+ *
+ * The coarse mesh is formed by merging blocks of the radial cells of the
+ * pin-level CMFD mesh, keeping its axial mesh, and the coarse groups by
+ * merging contiguous blocks of the fine groups. The pin-level flux, cross
+ * sections and currents are homogenized and condensed onto the coarse level,
+ * with coarse D-hats chosen to reproduce the currents through the coarse
+ * cell faces. The coarse eigenvalue problem is then converged, and the
+ * pin-level flux of each fine group in each coarse cell is scaled by the
+ * change in the coarse flux of that cell and coarse group.
+ *
+ * Since the coarse system conserves the balance of the pin-level system
+ * over each coarse cell, its solution does not change a converged pin-level
+ * solution. It does, however, settle the long-wavelength error modes, which
+ * single-level power iteration is slowest to converge, at the cost of a few
+ * small direct solves.
+ */
+class CMFDCoarseLevel {
+public:
+    typedef Eigen::SparseMatrix<real_t> Matrix_t;
+
+    /**
+     * \brief Build the coarse level over a pin-level CMFD mesh
+     *
+     * \param fine the pin-level CMFD mesh
+     * \param x_index the indices of the cell boundaries of \p fine along
+     * the x dimension that are kept on the coarse mesh. Should start at zero
+     * and end at fine.nx().
+     * \param y_index as \p x_index, for the y dimension
+     * \param group_map the coarse group of each fine group. Coarse groups
+     * should be numbered from zero, in increasing order of the fine groups.
+     * \param xsmesh the cross sections of the pin-level CMFD mesh
+     *
+     * Rotational symmetry is not supported.
+     */
+    CMFDCoarseLevel(const Mesh &fine, const VecI &x_index, const VecI &y_index,
+                    const VecI &group_map, const XSMeshHomogenized &xsmesh);
+
+    /**
+     * \brief Accelerate the pin-level solution
+     *
+     * \param [in,out] k the eigenvalue estimate, updated to the coarse-level
+     * eigenvalue
+     * \param [in,out] flux the pin-level scalar flux, which is scaled
+     * coarse cell-by-coarse cell
+     * \param d_tilde the pin-level surface diffusivities
+     * \param d_hat the pin-level nonlinear correction coefficients
+     * \param k_tol the eigenvalue convergence tolerance
+     * \param psi_tol the fission source convergence tolerance
+     * \param max_iter the maximum number of coarse power iterations
+     *
+     * Returns the number of coarse power iterations performed.
+     */
+    int accelerate(real_t &k, ArrayB2 &flux, const ArrayB2 &d_tilde,
+                   const ArrayB2 &d_hat, real_t k_tol, real_t psi_tol,
+                   int max_iter);
+
+    /**
+     * \brief Return the number of coarse groups
+     */
+    int n_group() const
+    {
+        return n_group_;
+    }
+
+    /**
+     * \brief Return the number of coarse cells
+     */
+    int n_cell() const
+    {
+        return n_cell_;
+    }
+
+    /**
+     * \brief Return the total number of coarse power iterations performed
+     */
+    int n_iter() const
+    {
+        return n_iter_;
+    }
+
+    /**
+     * \brief Return the number of bytes used for the coarse-level data,
+     * not counting the matrix factorizations
+     */
+    size_t memory() const;
+
+private:
+    /**
+     * \brief Homogenize the pin-level flux, cross sections and currents onto
+     * the coarse mesh
+     */
+    void homogenize(const ArrayB2 &flux, const ArrayB2 &d_tilde,
+                    const ArrayB2 &d_hat);
+
+    /**
+     * \brief Build and factorize the coarse-level matrix for each group
+     */
+    void setup();
+
+    const Mesh &fine_mesh_;
+    const XSMeshHomogenized &xsmesh_;
+    Mesh mesh_;
+    int n_cell_;
+    int n_surf_;
+    int n_fine_group_;
+    int n_group_;
+
+    // Coarse group containing each fine group
+    VecI group_map_;
+
+    // Coarse cell containing each pin-level cell
+    VecI cell_map_;
+
+    // Pin-level cells within each coarse cell. Those of coarse cell i are
+    // in [fine_offset_[i], fine_offset_[i+1]).
+    VecI fine_cells_;
+    VecI fine_offset_;
+
+    // XS mesh region of each pin-level cell
+    VecI fine_xsreg_;
+
+    // Coarse surface that each pin-level surface lies on, or -1 for
+    // surfaces inside of a coarse cell
+    VecI surf_map_;
+
+    // Diffusivity to use at the domain boundary for each normal and side
+    std::array<std::array<real_t, 2>, 3> bc_diffusivity_;
+
+    // Homogenized quantities, indexed by coarse cell and coarse group
+    ArrayB2 flux_;
+    ArrayB2 xsrm_;
+    ArrayB2 xsnf_;
+    ArrayB2 xsch_;
+    ArrayB2 diffusion_;
+
+    // Net current through each coarse surface, by coarse group
+    ArrayB2 current_;
+
+    // Homogenized in-scatter cross sections. For coarse cell i and group g,
+    // the cross sections from groups scat_min_[i*n_group_+g] and up are
+    // stored in [scat_offset_[i*n_group_+g], scat_offset_[i*n_group_+g+1]).
+    VecI scat_min_;
+    VecI scat_offset_;
+    VecF scat_;
+
+    std::vector<Matrix_t> m_;
+    std::vector<Eigen::SparseLU<Matrix_t>> solvers_;
+
+    int n_iter_;
+};
+}
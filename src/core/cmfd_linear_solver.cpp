@@ -0,0 +1,46 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "cmfd_linear_solver.hpp"
+
+#include <string>
+#include "util/error.hpp"
+
+#ifdef MOCC_USE_PETSC
+#include "petsc_linear_solver.hpp"
+#endif
+
+namespace mocc {
+std::unique_ptr<CMFDLinearSolver> make_cmfd_linear_solver(
+    const pugi::xml_node &input, int n_group)
+{
+    std::string backend = input.attribute("backend").empty()
+                              ? "eigen"
+                              : input.attribute("backend").value();
+    if (backend == "eigen") {
+        return std::unique_ptr<CMFDLinearSolver>();
+    }
+    if (backend == "petsc") {
+#ifdef MOCC_USE_PETSC
+        return std::unique_ptr<CMFDLinearSolver>(
+            new PETScLinearSolver(input, n_group));
+#else
+        throw EXCEPT("MOCC was not built with PETSc support (USE_PETSC)");
+#endif
+    }
+    throw EXCEPT("Unrecognized CMFD linear solver backend: " + backend);
+}
+}
@@ -0,0 +1,78 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <memory>
+
+#include <Eigen/Sparse>
+
+#include "pugixml.hpp"
+#include "util/global_config.hpp"
+#include "eigen_interface.hpp"
+
+namespace mocc {
+/**
+ * \brief Interface to an external solver for the one-group CMFD linear
+ * systems
+ *
+ * By default, the one-group systems are solved with Eigen's BiCGSTAB, which
+ * is built into \ref CMFD. A backend takes over the solves from it, keeping
+ * its own copy of each group's matrix. The matrices keep the same sparsity
+ * pattern for the life of the solver, and only their values change.
+ */
+class CMFDLinearSolver {
+public:
+    typedef Eigen::SparseMatrix<real_t, Eigen::RowMajor> Matrix_t;
+
+    virtual ~CMFDLinearSolver()
+    {
+        return;
+    }
+
+    /**
+     * \brief Update the matrix of a group
+     *
+     * \param group the group
+     * \param m the new matrix
+     * \param refactor whether the preconditioner should be recomputed for
+     * the new matrix, rather than kept from the last time that it was
+     */
+    virtual void update(int group, const Matrix_t &m, bool refactor) = 0;
+
+    /**
+     * \brief Solve the system of a group
+     *
+     * \param group the group
+     * \param b the right-hand side
+     * \param [in,out] x the initial guess, replaced by the solution
+     * \param tol the relative residual to converge to
+     * \param max_iter the maximum number of iterations
+     *
+     * Returns the number of iterations performed.
+     */
+    virtual int solve(int group, const VectorX &b, VectorX &x, real_t tol,
+                      int max_iter) = 0;
+};
+
+/**
+ * \brief Make the CMFD linear solver backend requested by a \<cmfd\> tag
+ *
+ * Returns null for the built-in Eigen solvers, which is the default.
+ */
+std::unique_ptr<CMFDLinearSolver> make_cmfd_linear_solver(
+    const pugi::xml_node &input, int n_group);
+}
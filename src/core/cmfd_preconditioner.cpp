@@ -0,0 +1,125 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "cmfd_preconditioner.hpp"
+
+#include <cassert>
+#include "util/error.hpp"
+
+namespace {
+// Stop coarsening once a level has no more than this many cells
+const int coarse_size = 64;
+
+// Number of smoothing sweeps before and after each coarse-grid correction
+const int n_smooth = 2;
+
+// Damping factor for the Jacobi smoother
+const mocc::real_t omega = 0.7;
+}
+
+namespace mocc {
+void CMFDPreconditioner::setup_multigrid(const Matrix_t &m)
+{
+    if (nx_ * ny_ * nz_ != m.rows()) {
+        throw EXCEPT("Mesh dimensions do not match the CMFD matrix");
+    }
+
+    levels_.clear();
+    levels_.push_back(Level());
+    levels_.back().a  = m;
+    levels_.back().nx = nx_;
+    levels_.back().ny = ny_;
+    levels_.back().nz = nz_;
+
+    while (true) {
+        Level &fine = levels_.back();
+        if ((fine.a.rows() <= coarse_size) ||
+            (fine.nx == 1 && fine.ny == 1 && fine.nz == 1)) {
+            break;
+        }
+
+        int cnx = (fine.nx + 1) / 2;
+        int cny = (fine.ny + 1) / 2;
+        int cnz = (fine.nz + 1) / 2;
+
+        // Piecewise-constant prolongation from each aggregate to its cells
+        typedef Eigen::Triplet<real_t> T;
+        std::vector<T> entries;
+        entries.reserve(fine.a.rows());
+        for (int iz = 0; iz < fine.nz; iz++) {
+            for (int iy = 0; iy < fine.ny; iy++) {
+                for (int ix = 0; ix < fine.nx; ix++) {
+                    int i = ix + fine.nx * (iy + fine.ny * iz);
+                    int c = ix / 2 + cnx * (iy / 2 + cny * (iz / 2));
+                    entries.push_back(T(i, c, 1.0));
+                }
+            }
+        }
+        fine.p = Matrix_t(fine.a.rows(), cnx * cny * cnz);
+        fine.p.setFromTriplets(entries.begin(), entries.end());
+
+        Matrix_t r = fine.p.transpose();
+        Level coarse;
+        coarse.a  = r * fine.a * fine.p;
+        coarse.nx = cnx;
+        coarse.ny = cny;
+        coarse.nz = cnz;
+        levels_.push_back(coarse);
+    }
+
+    for (auto &level : levels_) {
+        level.inv_diag = level.a.diagonal().cwiseInverse();
+    }
+
+    coarse_lu_.compute(MatrixX(levels_.back().a));
+
+    return;
+}
+
+void CMFDPreconditioner::smooth(const Level &level, const VectorX &b,
+                                VectorX &x) const
+{
+    for (int i = 0; i < n_smooth; i++) {
+        VectorX r = b - level.a * x;
+        x += omega * level.inv_diag.cwiseProduct(r);
+    }
+    return;
+}
+
+void CMFDPreconditioner::vcycle(int ilevel, const VectorX &b,
+                                VectorX &x) const
+{
+    assert(ilevel < (int)levels_.size());
+    const Level &level = levels_[ilevel];
+
+    if (ilevel == (int)levels_.size() - 1) {
+        x = coarse_lu_.solve(b);
+        return;
+    }
+
+    this->smooth(level, b, x);
+
+    VectorX r  = b - level.a * x;
+    VectorX rc = level.p.transpose() * r;
+    VectorX xc = VectorX::Zero(rc.size());
+    this->vcycle(ilevel + 1, rc, xc);
+    x += level.p * xc;
+
+    this->smooth(level, b, x);
+
+    return;
+}
+}
@@ -0,0 +1,149 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+
+#include "util/global_config.hpp"
+#include "eigen_interface.hpp"
+
+namespace mocc {
+/**
+ * \brief Preconditioner for the one-group CMFD linear systems
+ *
+ * This satisfies the interface that Eigen expects of preconditioners for its
+ * iterative solvers, and provides either an incomplete LU factorization or a
+ * geometric multigrid V-cycle.
+ *
+ * The multigrid hierarchy is built by aggregating 2x2x2 blocks of cells of
+ * the structured CMFD mesh (axes that are a single cell wide are left
+ * alone), using piecewise-constant prolongation and Galerkin coarse-grid
+ * operators. Damped Jacobi is used as the smoother, and the coarsest level is
+ * solved directly.
+ *
+ * The CMFD cells are expected to be ordered x-fastest, then y, then z, as in
+ * \ref Mesh::coarse_cell().
+ */
+class CMFDPreconditioner {
+public:
+    typedef Eigen::SparseMatrix<real_t> Matrix_t;
+
+    enum class Type { ILUT, MULTIGRID };
+
+    CMFDPreconditioner() : type_(Type::ILUT), nx_(0), ny_(0), nz_(0)
+    {
+        return;
+    }
+
+    template <typename MatType>
+    explicit CMFDPreconditioner(const MatType &m)
+        : type_(Type::ILUT), nx_(0), ny_(0), nz_(0)
+    {
+        this->compute(m);
+        return;
+    }
+
+    /**
+     * \brief Select the type of preconditioner, and provide the dimensions of
+     * the mesh, which are needed for the multigrid hierarchy.
+     */
+    void configure(Type type, int nx, int ny, int nz)
+    {
+        type_ = type;
+        nx_   = nx;
+        ny_   = ny;
+        nz_   = nz;
+        return;
+    }
+
+    template <typename MatType>
+    CMFDPreconditioner &analyzePattern(const MatType &m)
+    {
+        return *this;
+    }
+
+    template <typename MatType> CMFDPreconditioner &factorize(const MatType &m)
+    {
+        return this->compute(m);
+    }
+
+    template <typename MatType> CMFDPreconditioner &compute(const MatType &m)
+    {
+        if (type_ == Type::ILUT) {
+            ilut_.compute(m);
+        } else {
+            this->setup_multigrid(Matrix_t(m));
+        }
+        return *this;
+    }
+
+    template <typename Rhs> VectorX solve(const Rhs &b) const
+    {
+        if (type_ == Type::ILUT) {
+            return ilut_.solve(b);
+        }
+        VectorX x = VectorX::Zero(b.size());
+        this->vcycle(0, b, x);
+        return x;
+    }
+
+    Eigen::ComputationInfo info() const
+    {
+        return Eigen::Success;
+    }
+
+    /**
+     * \brief Return the number of levels in the multigrid hierarchy
+     */
+    int n_level() const
+    {
+        return levels_.size();
+    }
+
+private:
+    struct Level {
+        // Operator on this level
+        Matrix_t a;
+        // Prolongation from the next-coarser level to this one
+        Matrix_t p;
+        // Inverse of the operator diagonal, for the smoother
+        VectorX inv_diag;
+        int nx;
+        int ny;
+        int nz;
+    };
+
+    void setup_multigrid(const Matrix_t &m);
+
+    void vcycle(int level, const VectorX &b, VectorX &x) const;
+
+    void smooth(const Level &level, const VectorX &b, VectorX &x) const;
+
+    Type type_;
+    int nx_;
+    int ny_;
+    int nz_;
+
+    Eigen::IncompleteLUT<real_t> ilut_;
+
+    std::vector<Level> levels_;
+    Eigen::PartialPivLU<MatrixX> coarse_lu_;
+};
+}
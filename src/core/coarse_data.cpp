@@ -16,6 +16,9 @@
 
 #include "coarse_data.hpp"
 
+#include <algorithm>
+#include "util/error.hpp"
+
 namespace mocc {
 CoarseData::CoarseData(const Mesh &mesh, size_t ngroup)
     : current((int)mesh.n_surf(), ngroup),
@@ -84,4 +87,80 @@ void CoarseData::zero_data_radial(int group, bool zero_partial)
     }
     return;
 }
+
+void CoarseData::write_checkpoint(H5Node &node) const
+{
+    node.write("current", current);
+    node.write("surface_flux", surface_flux);
+    node.write("flux", flux);
+
+    VecI dims = {partial_current.extent(0), partial_current.extent(1), 2};
+    const real_t *partial = partial_current.data()->data();
+    node.write("partial_current", partial, partial + 2 * partial_current.size(),
+               dims);
+
+    node.write("has_radial", (int)has_data_radial_);
+    node.write("has_axial", (int)has_data_axial_);
+
+    return;
+}
+
+void CoarseData::read_checkpoint(H5Node &node)
+{
+    ArrayB2 current_in;
+    ArrayB2 surface_flux_in;
+    ArrayB2 flux_in;
+    node.read("current", current_in);
+    node.read("surface_flux", surface_flux_in);
+    node.read("flux", flux_in);
+    if ((current_in.shape() != current.shape()) ||
+        (surface_flux_in.shape() != surface_flux.shape()) ||
+        (flux_in.shape() != flux.shape())) {
+        throw EXCEPT("Checkpoint coarse data do not match the mesh");
+    }
+
+    ArrayB1 partial;
+    node.read_1d("partial_current", partial);
+    if ((int)partial.size() != 2 * (int)partial_current.size()) {
+        throw EXCEPT("Checkpoint partial currents do not match the mesh");
+    }
+
+    current      = current_in;
+    surface_flux = surface_flux_in;
+    flux         = flux_in;
+    old_flux     = flux_in;
+    std::copy(partial.begin(), partial.end(),
+              partial_current.data()->data());
+
+    int has = 0;
+    node.read("has_radial", has);
+    has_data_radial_ = has;
+    node.read("has_axial", has);
+    has_data_axial_ = has;
+    source_         = "Checkpoint";
+
+    return;
+}
+
+void CoarseData::assign(const CoarseData &other)
+{
+    if ((other.current.shape() != current.shape()) ||
+        (other.surface_flux.shape() != surface_flux.shape()) ||
+        (other.flux.shape() != flux.shape())) {
+        throw EXCEPT("Coarse data do not match the mesh");
+    }
+
+    current         = other.current;
+    surface_flux    = other.surface_flux;
+    partial_current = other.partial_current;
+    flux            = other.flux;
+    old_flux        = other.flux;
+
+    has_data_radial_ = other.has_data_radial_;
+    has_data_axial_  = other.has_data_axial_;
+    has_old_partial_ = false;
+    source_          = other.source_;
+
+    return;
+}
 }
@@ -21,6 +21,8 @@
 #include <vector>
 #include "util/blitz_typedefs.hpp"
 #include "util/global_config.hpp"
+#include "util/h5file.hpp"
+#include "util/memory.hpp"
 #include "core/eigen_interface.hpp"
 #include "core/mesh.hpp"
 
@@ -148,6 +150,35 @@ public:
      */
     void zero_data_radial(int group, bool zero_partial = false);
 
+    /**
+     * \brief Write the coarse mesh data to an HDF5 group, for checkpointing
+     */
+    void write_checkpoint(H5Node &node) const;
+
+    /**
+     * \brief Restore the coarse mesh data from a group written by \ref
+     * write_checkpoint()
+     */
+    void read_checkpoint(H5Node &node);
+
+    /**
+     * \brief Copy the coarse mesh data from another \ref CoarseData on the
+     * same mesh
+     *
+     * The previous-iteration partial currents are not copied, so the next
+     * incoming flux update starts afresh.
+     */
+    void assign(const CoarseData &other);
+
+    /**
+     * \brief Return the number of bytes used by the coarse mesh data
+     */
+    size_t memory() const
+    {
+        return bytes(current) + bytes(surface_flux) + bytes(partial_current) +
+               bytes(partial_current_old) + bytes(flux) + bytes(old_flux);
+    }
+
     ArrayB2 current;
     ArrayB2 surface_flux;
     blitz::Array<std::array<real_t, 2>, 2> partial_current;
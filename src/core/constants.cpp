@@ -130,6 +130,9 @@ std::ostream &operator<<(std::ostream &os, const Boundary b)
     case Boundary::PRESCRIBED:
         os << "PRESCRIBED";
         break;
+    case Boundary::ROTATE:
+        os << "ROTATE";
+        break;
     default:
         os << "Unknown: " << (int)b;
     }
@@ -88,6 +88,12 @@ enum class Boundary {
      * Dirichelet boundary.
      */
     PRESCRIBED,
+    /**
+     * Rotational (90 degree) symmetry about the corner shared by the west
+     * and south faces. Flux exiting one of those faces enters through the
+     * other, rotated a quarter turn. Must be applied to both faces.
+     */
+    ROTATE,
 
     INVALID
 };
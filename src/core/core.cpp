@@ -17,6 +17,7 @@
 #include "core.hpp"
 
 #include <iostream>
+#include <limits>
 #include <string>
 #include "pugixml.hpp"
 #include "util/error.hpp"
@@ -32,6 +33,8 @@ Boundary bc_parse(const pugi::xml_node &input, const char *surf)
         return Boundary::REFLECT;
     } else if (in == "prescribed") {
         return Boundary::PRESCRIBED;
+    } else if (in == "rotate") {
+        return Boundary::ROTATE;
     } else {
         return Boundary::INVALID;
     }
@@ -39,8 +42,10 @@ Boundary bc_parse(const pugi::xml_node &input, const char *surf)
 
 Core::Core()
 {
-    nx_ = 0;
-    ny_ = 0;
+    nx_                    = 0;
+    ny_                    = 0;
+    merge_planes_          = false;
+    max_macroplane_height_ = std::numeric_limits<real_t>::max();
 }
 
 Core::Core(const pugi::xml_node &input,
@@ -66,6 +71,33 @@ Core::Core(const pugi::xml_node &input,
         }
     }
 
+    // Rotational symmetry maps the west and south faces onto each other, so
+    // it has to be applied to both of them, and nowhere else
+    bool rotate_west  = bc_[(int)Surface::WEST] == Boundary::ROTATE;
+    bool rotate_south = bc_[(int)Surface::SOUTH] == Boundary::ROTATE;
+    if (rotate_west != rotate_south) {
+        throw EXCEPT("Rotational symmetry must be applied to both the west "
+                     "and south boundaries.");
+    }
+    for (auto s : {Surface::NORTH, Surface::EAST, Surface::TOP,
+                   Surface::BOTTOM}) {
+        if (bc_[(int)s] == Boundary::ROTATE) {
+            throw EXCEPT("Rotational symmetry is only supported on the west "
+                         "and south boundaries.");
+        }
+    }
+
+    // Automatic merging of axial planes into macroplanes
+    merge_planes_ = input.attribute("merge_planes").as_bool(false);
+    max_macroplane_height_ = std::numeric_limits<real_t>::max();
+    if (!input.attribute("max_macroplane_height").empty()) {
+        max_macroplane_height_ =
+            input.attribute("max_macroplane_height").as_double(0.0);
+        if (max_macroplane_height_ <= 0.0) {
+            throw EXCEPT("Invalid maximum macroplane height.");
+        }
+    }
+
     // Read in the assembly IDs
     std::string asy_str = input.child_value();
 
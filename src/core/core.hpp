@@ -127,6 +127,24 @@ public:
         return bc_;
     }
 
+    /**
+     * \brief Return whether axially-adjacent, identical planes should be
+     * merged into macroplanes automatically
+     */
+    bool merge_planes() const
+    {
+        return merge_planes_;
+    }
+
+    /**
+     * \brief Return the maximum height of an automatically-merged
+     * macroplane
+     */
+    real_t max_macroplane_height() const
+    {
+        return max_macroplane_height_;
+    }
+
 private:
     // Core dimensions (in assemblies)
     unsigned int nx_;
@@ -145,6 +163,10 @@ private:
 
     // boundary conditions
     std::array<Boundary, 6> bc_;
+
+    // Automatic macroplane merging
+    bool merge_planes_;
+    real_t max_macroplane_height_;
 };
 
 Core ParseCore(const pugi::xml_node &input,
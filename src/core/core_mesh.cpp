@@ -17,11 +17,14 @@
 #include "core_mesh.hpp"
 
 #include <algorithm>
+#include <exception>
 #include <iostream>
+#include <memory>
 #include <string>
 #include "pugixml.hpp"
 #include "util/error.hpp"
 #include "util/files.hpp"
+#include "util/fp_utils.hpp"
 #include "util/string_utils.hpp"
 
 namespace mocc {
@@ -32,7 +35,8 @@ CoreMesh::CoreMesh(const pugi::xml_node &input)
       lattices_(ParseLattices(input, pins_)),
       assemblies_(ParseAssemblies(input, lattices_)),
       core_(ParseCore(input, assemblies_)),
-      subplane_(core_.front().subplane())
+      subplane_(core_.front().subplane()),
+      snapshot_key_(0)
 {
     LogScreen << "Building core mesh... " << std::endl;
 
@@ -55,17 +59,14 @@ CoreMesh::CoreMesh(const pugi::xml_node &input)
 
     // Determine the set of geometrically-unique axial planes and plane region
     // offsets
-    std::vector<const Lattice *> plane_lattices;
-    plane_lattices.reserve(core_.nx() * core_.ny());
+    std::vector<std::vector<const Lattice *>> plane_lattices(nz_);
     int plane_reg = 0;
-    n_fuel_2d_    = 0;
     for (int iz = 0; iz < nz_; iz++) {
         first_reg_plane_.push_back(plane_reg);
-        // Construct a temporary Plane object to test against the list of known
-        // unique planes, or to insert if its new
+        plane_lattices[iz].reserve(core_.nx() * core_.ny());
         for (const auto &assembly : core_) {
             const Lattice &lattice = (*assembly)[iz];
-            plane_lattices.push_back(&lattice);
+            plane_lattices[iz].push_back(&lattice);
             plane_reg += (*assembly)[iz].n_reg();
             // add the contained pins to the overall list of pins in the
             // CoreMesh
@@ -73,8 +74,32 @@ CoreMesh::CoreMesh(const pugi::xml_node &input)
                 core_pins_.push_back(pin);
             }
         }
-        Plane temp_plane(plane_lattices, core_.nx(), core_.ny());
-        n_fuel_2d_ = std::max(n_fuel_2d_, temp_plane.n_fuel());
+    }
+
+    // Construct a temporary Plane object for each axial plane, in parallel,
+    // to test against the list of known unique planes
+    std::vector<std::unique_ptr<Plane>> temp_planes(nz_);
+    std::exception_ptr error;
+#pragma omp parallel for schedule(dynamic)
+    for (int iz = 0; iz < nz_; iz++) {
+        try {
+            temp_planes[iz].reset(
+                new Plane(plane_lattices[iz], core_.nx(), core_.ny()));
+        } catch (...) {
+#pragma omp critical
+            error = std::current_exception();
+        }
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+
+    // The search itself goes in axial order, so that the unique planes and
+    // their IDs don't depend on the threading
+    n_fuel_2d_ = 0;
+    for (int iz = 0; iz < nz_; iz++) {
+        const Plane &temp_plane = *temp_planes[iz];
+        n_fuel_2d_              = std::max(n_fuel_2d_, temp_plane.n_fuel());
 
         // Check against current list of unique planes
         auto match_plane =
@@ -91,7 +116,6 @@ CoreMesh::CoreMesh(const pugi::xml_node &input)
             // already visited. do nothing
         }
         unique_plane_ids_.push_back(unique_id);
-        plane_lattices.clear();
     } // Unique plane search
     LogFile << "Unique plane search done" << std::endl;
 
@@ -120,6 +144,19 @@ CoreMesh::CoreMesh(const pugi::xml_node &input)
         }
     }
 
+    // Rotational symmetry swaps the x and y axes at the west and south
+    // faces, so the pin boundaries need to be the same along both
+    if (bc_[(int)Surface::WEST] == Boundary::ROTATE) {
+        bool square = x_vec_.size() == y_vec_.size();
+        for (size_t i = 0; square && (i < x_vec_.size()); i++) {
+            square = fp_equiv_ulp(x_vec_[i], y_vec_[i]);
+        }
+        if (!square) {
+            throw EXCEPT("Rotational symmetry requires the same pin "
+                         "boundaries along x and y.");
+        }
+    }
+
     // Form lines for internal pin boundaries and domain bounding box
     for (auto xi = x_vec_.cbegin() + 1; xi != x_vec_.cend() - 1; ++xi) {
         lines_.push_back(Line(Point2(*xi, 0.0), Point2(*xi, hx_)));
@@ -147,6 +184,7 @@ CoreMesh::CoreMesh(const pugi::xml_node &input)
      * core first. Going to have to come up with something.
      */
     coarse_vol_ = VecF(this->n_pin());
+#pragma omp parallel for schedule(static)
     for (int i = 0; i < this->n_pin(); i++) {
         auto pos       = this->coarse_position(i);
         coarse_vol_[i] = dx_vec_[pos.x] * dy_vec_[pos.y] * dz_vec_[pos.z];
@@ -161,6 +199,55 @@ CoreMesh::CoreMesh(const pugi::xml_node &input)
         n_xsreg_ += a->n_xsreg();
     }
 
+    // Merge axially-adjacent blocks of planes into larger macroplanes when
+    // they share the same plane geometry and the same pins, up to the
+    // requested height. The blocks from the input are never split, so the
+    // result is at least as coarse as what was asked for.
+    if (core_.merge_planes()) {
+        const int n_pin_plane = nx_ * ny_;
+        const real_t h_max    = core_.max_macroplane_height();
+        auto same_pins = [&](int iz1, int iz2) {
+            if (unique_plane_ids_[iz1] != unique_plane_ids_[iz2]) {
+                return false;
+            }
+            for (int ipin = 0; ipin < n_pin_plane; ipin++) {
+                const Pin *p1 = core_pins_[iz1 * n_pin_plane + ipin];
+                const Pin *p2 = core_pins_[iz2 * n_pin_plane + ipin];
+                if ((p1 != p2) && (p1->mat_ids() != p2->mat_ids())) {
+                    return false;
+                }
+            }
+            return true;
+        };
+
+        VecI merged;
+        merged.reserve(subplane_.size());
+        int iz_merged   = 0;
+        real_t h_merged = 0.0;
+        int iz          = 0;
+        for (const int np : subplane_) {
+            bool same = !merged.empty();
+            real_t h  = 0.0;
+            for (int i = 0; i < np; i++) {
+                h += dz_vec_[iz + i];
+                same = same && same_pins(iz_merged, iz + i);
+            }
+            if (same && (h_merged + h <= h_max * (1.0 + REAL_FUZZ))) {
+                merged.back() += np;
+                h_merged += h;
+            } else {
+                merged.push_back(np);
+                iz_merged = iz;
+                h_merged  = h;
+            }
+            iz += np;
+        }
+
+        LogScreen << "Merged " << subplane_.size() << " axial blocks into "
+                  << merged.size() << " macroplanes" << std::endl;
+        subplane_ = merged;
+    }
+
     // Figure out the height of the macroplanes
     macroplane_heights_ = VecF(subplane_.size(), 0.0);
     int iz              = 0;
@@ -200,6 +287,61 @@ CoreMesh::CoreMesh(const pugi::xml_node &input)
     // calculate surface indices
     this->prepare_surfaces();
 
+    // Tabulate the pin lookup for each geometrically-unique lattice, and
+    // the placement of those lattices in each unique plane, so that neighbor
+    // lookups don't have to descend through the core
+    for (int ilat = 0; ilat < core_.nx(); ilat++) {
+        const Lattice &lat = core_.at(ilat, 0)[0];
+        for (int ix = 0; ix < (int)lat.nx(); ix++) {
+            lattice_x_.push_back(ilat);
+            local_x_.push_back(ix);
+        }
+    }
+    for (int ilat = 0; ilat < core_.ny(); ilat++) {
+        const Lattice &lat = core_.at(0, ilat)[0];
+        for (int iy = 0; iy < (int)lat.ny(); iy++) {
+            lattice_y_.push_back(ilat);
+            local_y_.push_back(iy);
+        }
+    }
+
+    lattice_instances_.reserve(planes_.size() * core_.nx() * core_.ny());
+    for (const auto &plane : planes_) {
+        int reg_offset = 0;
+        real_t y0      = 0.0;
+        for (int iy = 0; iy < core_.ny(); iy++) {
+            real_t x0 = 0.0;
+            for (int ix = 0; ix < core_.nx(); ix++) {
+                const Lattice &lat = plane.at(ix, iy);
+                auto match         = std::find_if(
+                    unique_lattices_.begin(), unique_lattices_.end(),
+                    [&](const Lattice *l) {
+                        return l->geometrically_equivalent(lat);
+                    });
+                int id = std::distance(unique_lattices_.begin(), match);
+                if (match == unique_lattices_.end()) {
+                    unique_lattices_.push_back(&lat);
+                    std::vector<PinLocation> pins;
+                    pins.reserve(lat.n_pin());
+                    int pin_reg = 0;
+                    for (const auto &pin : lat) {
+                        pins.push_back({&pin->mesh(), pin_reg});
+                        pin_reg += pin->n_reg();
+                    }
+                    lattice_pins_.push_back(pins);
+                }
+                lattice_instances_.push_back(
+                    {id, reg_offset, Point2(x0, y0)});
+                reg_offset += lat.n_reg();
+                x0 += lat.hx();
+            }
+            y0 += plane.at(0, iy).hy();
+        }
+    }
+    LogFile << "Geometrically-unique lattices: " << unique_lattices_.size()
+            << " of " << lattice_instances_.size() << " lattice instances"
+            << std::endl;
+
     LogScreen << "Done building Core Mesh." << std::endl;
 
     return;
@@ -216,14 +358,25 @@ const PinMeshTuple CoreMesh::get_pinmesh(Point2 &p, size_t iplane,
     assert((iplane >= 0) & (iplane < planes_.size()));
 
     // Locate the Position of the pin
-    unsigned int ix = std::lower_bound(x_vec_.begin(), x_vec_.end(), p.x) -
-                      x_vec_.begin() - 1;
-    unsigned int iy = std::lower_bound(y_vec_.begin(), y_vec_.end(), p.y) -
-                      y_vec_.begin() - 1;
+    int ix = std::lower_bound(x_vec_.begin(), x_vec_.end(), p.x) -
+             x_vec_.begin() - 1;
+    int iy = std::lower_bound(y_vec_.begin(), y_vec_.end(), p.y) -
+             y_vec_.begin() - 1;
+
+    ix = std::min(nx_ - 1, std::max(0, ix));
+    iy = std::min(ny_ - 1, std::max(0, iy));
 
     Position pos(ix, iy, 0);
 
-    return PinMeshTuple(pos, planes_[iplane].get_pinmesh(p, first_reg));
+    // Move the point to the pin origin, and take the PinMesh from the
+    // lattice instance tables rather than descending through the plane
+    p.x = (x_vec_[ix] + x_vec_[ix + 1]) * 0.5;
+    p.y = (y_vec_[iy] + y_vec_[iy + 1]) * 0.5;
+
+    PinLocation pin = this->pin_location(ix, iy, iplane);
+    first_reg += pin.reg_offset;
+
+    return PinMeshTuple(pos, pin.pm);
 }
 
 Position CoreMesh::pin_position(size_t ipin) const
@@ -278,6 +431,39 @@ CoreMesh::LocationInfo CoreMesh::get_location_info(Point3 p,
     return info;
 }
 
+CoreMesh::LocationInfo CoreMesh::get_location_info(
+    Point3 p, Direction dir, const LocationInfo &prev) const
+{
+    // Step across whichever faces of the previous pin the point has passed.
+    // The comparisons mirror the lower_bound search in the full lookup, so
+    // that a point on a pin boundary lands in the same pin either way.
+    const auto &bounds = prev.pin_boundary;
+    int ix = prev.pos.x + (p.x > bounds[1].x) - (p.x <= bounds[0].x);
+    int iy = prev.pos.y + (p.y > bounds[1].y) - (p.y <= bounds[0].y);
+
+    if ((ix < 0) || (ix >= nx_) || (iy < 0) || (iy >= ny_)) {
+        return this->get_location_info(p, dir);
+    }
+
+    LocationInfo info;
+    info.pos = Position(ix, iy, this->plane_index(p.z, dir.oz));
+
+    PinLocation pin =
+        this->pin_location(ix, iy, unique_plane_ids_[info.pos.z]);
+    info.pm          = pin.pm;
+    info.reg_offset  = first_reg_plane(info.pos.z) + pin.reg_offset;
+    info.local_point = p.to_2d();
+    info.local_point -= Point2((x_vec_[ix] + x_vec_[ix + 1]) * 0.5,
+                               (y_vec_[iy] + y_vec_[iy + 1]) * 0.5);
+
+    info.pin_boundary = {
+        {Point3(x_vec_[info.pos.x], y_vec_[info.pos.y], z_vec_[info.pos.z]),
+         Point3(x_vec_[info.pos.x + 1], y_vec_[info.pos.y + 1],
+                z_vec_[info.pos.z + 1])}};
+
+    return info;
+}
+
 std::ostream &operator<<(std::ostream &os, const CoreMesh &mesh)
 {
     os << "Boundary conditions: " << std::endl;
@@ -19,6 +19,7 @@
 #include <algorithm>
 #include <map>
 #include <memory>
+#include <string>
 #include "util/pugifwd.hpp"
 #include "core/assembly.hpp"
 #include "core/core.hpp"
@@ -42,7 +43,9 @@ namespace mocc {
 * Once the sturctures that are used to define the system in the input file
 * are parsed in, the \ref CoreMesh determines the set of
 * geometrically-unique planes, which reduces the memory cost to perform ray
-* tracing considerably.
+* tracing considerably. Within those planes, lattices that share the same
+* pin mesh layout are likewise stored once, along with a table of their
+* instances, which is used for fast pin lookups.
 */
 class CoreMesh : public Mesh {
 public:
@@ -147,6 +150,19 @@ public:
 
     LocationInfo get_location_info(Point3 p, Direction dir) const;
 
+    /**
+     * \brief Return the \ref LocationInfo for a point that has just crossed
+     * out of the pin described by \p prev.
+     *
+     * Rather than searching the plane/lattice/pin hierarchy, the new pin is
+     * found by stepping the previous pin \ref Position across each face that
+     * \p p has passed, and the \ref PinMesh and region offset are taken from
+     * a table built with the mesh. Falls back to the full lookup if the step
+     * leaves the domain.
+     */
+    LocationInfo get_location_info(Point3 p, Direction dir,
+                                   const LocationInfo &prev) const;
+
     /**
     * \brief Return a const reference to the \ref Plane located at the indicated
     * axial position.
@@ -249,6 +265,35 @@ public:
         return mat_lib_;
     }
 
+    /**
+    * \brief Replace the cross sections of the material mapped to ID \p id
+    *
+    * \copydetails MaterialLib::update_material()
+    */
+    void update_material(int id, const Material &mat)
+    {
+        mat_lib_.update_material(id, mat);
+    }
+
+    /**
+    * \brief Release the unused materials of the material library
+    *
+    * \copydetails MaterialLib::compact()
+    */
+    int compact_mat_lib()
+    {
+        return mat_lib_.compact();
+    }
+
+    /**
+    * \brief Return a const reference to the map of \ref PinMesh objects,
+    * indexed by their user-specified IDs.
+    */
+    const std::map<int, UP_PinMesh_t> &pin_meshes() const
+    {
+        return pin_meshes_;
+    }
+
     /**
     * \brief Return the index of the first FSR within the given plane.
     */
@@ -419,6 +464,81 @@ public:
         return n_fuel_2d_;
     }
 
+    /**
+     * \brief Placement of a geometrically-unique \ref Lattice within a
+     * geometrically-unique \ref Plane
+     */
+    struct LatticeInstance {
+        // Index of the unique lattice
+        int id;
+        // Index of the first region of the lattice, relative to the plane
+        int reg_offset;
+        // Lower-left corner of the lattice, in core-local coordinates
+        Point2 origin;
+    };
+
+    /**
+     * \brief Return the number of geometrically-unique lattices
+     */
+    size_t n_unique_lattices() const
+    {
+        return unique_lattices_.size();
+    }
+
+    /**
+     * \brief Return the representative \ref Lattice for a unique lattice
+     * index.
+     *
+     * Only the geometry of the returned \ref Lattice should be used; the
+     * lattices sharing its index may be filled with different materials.
+     */
+    const Lattice &unique_lattice(int id) const
+    {
+        return *unique_lattices_[id];
+    }
+
+    /**
+     * \brief Return the \ref LatticeInstance at lattice position (\p ix,
+     * \p iy) of unique plane \p iplane
+     */
+    const LatticeInstance &lattice_instance(int iplane, int ix, int iy) const
+    {
+        return lattice_instances_[(iplane * core_.ny() + iy) * core_.nx() +
+                                  ix];
+    }
+
+    /**
+     * \brief Set the snapshot file in which to keep data derived from the
+     * mesh, such as the homogenized cross sections of \ref
+     * XSMeshHomogenized, between runs
+     *
+     * \param file the path to the snapshot file
+     * \param key a hash of the input that produced the mesh. Snapshots made
+     * with a different key are ignored.
+     */
+    void set_snapshot(const std::string &file, uint64_t key)
+    {
+        snapshot_file_ = file;
+        snapshot_key_  = key;
+    }
+
+    /**
+     * \brief Return the path to the snapshot file, empty if there is none
+     */
+    const std::string &snapshot_file() const
+    {
+        return snapshot_file_;
+    }
+
+    /**
+     * \brief Return the hash of the input that produced the mesh, as passed
+     * to \ref set_snapshot()
+     */
+    uint64_t snapshot_key() const
+    {
+        return snapshot_key_;
+    }
+
 private:
     // Map for storing pin mesh objects indexed by user-specified IDs
     std::map<int, UP_PinMesh_t> pin_meshes_;
@@ -472,6 +592,52 @@ private:
 
     // Index of the first flat source region on each plane
     VecI first_reg_plane_;
+
+    // Geometrically-unique lattices. Lattices that only differ in their
+    // materials share an entry, since the pin lookup only needs the pin
+    // meshes.
+    std::vector<const Lattice *> unique_lattices_;
+
+    // The PinMesh and lattice-local region offset of each pin in each of the
+    // unique lattices, indexed [id][iy * nx + ix]
+    struct PinLocation {
+        const PinMesh *pm;
+        int reg_offset;
+    };
+    std::vector<std::vector<PinLocation>> lattice_pins_;
+
+    // Unique lattice stored at each lattice position of each unique plane,
+    // indexed [iplane * core_.nx() * core_.ny() + iy * core_.nx() + ix]
+    std::vector<LatticeInstance> lattice_instances_;
+
+    // Lattice column/row containing each pin column/row, and the index of
+    // the pin column/row within that lattice
+    VecI lattice_x_;
+    VecI lattice_y_;
+    VecI local_x_;
+    VecI local_y_;
+
+    // Snapshot file for derived data, and the hash of the mesh input
+    std::string snapshot_file_;
+    uint64_t snapshot_key_;
+
+    /**
+     * \brief Return the \ref PinMesh and plane-local region offset of the
+     * pin at the given column and row of a unique plane, from the lattice
+     * instance tables.
+     */
+    PinLocation pin_location(int ix, int iy, int iplane) const
+    {
+        int nlat            = core_.nx() * core_.ny();
+        const auto &lattice = lattice_instances_[iplane * nlat +
+                                                 lattice_y_[iy] * core_.nx() +
+                                                 lattice_x_[ix]];
+        int nx_lat = unique_lattices_[lattice.id]->nx();
+        PinLocation pin =
+            lattice_pins_[lattice.id][local_y_[iy] * nx_lat + local_x_[ix]];
+        pin.reg_offset += lattice.reg_offset;
+        return pin;
+    }
 };
 
 typedef std::shared_ptr<CoreMesh> SP_CoreMesh_t;
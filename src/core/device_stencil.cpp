@@ -0,0 +1,272 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "device_stencil.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include "util/memory.hpp"
+#include "constants.hpp"
+
+namespace mocc {
+DeviceStencil::DeviceStencil(int nx, int ny, int nz, int n_group)
+    : nx_(nx),
+      ny_(ny),
+      nz_(nz),
+      n_(nx * ny * nz),
+      n_group_(n_group),
+      mat_(7 * n_group * n_, 0.0),
+      b_(n_, 0.0),
+      x_(n_, 0.0),
+      inv_diag_(n_, 0.0),
+      r_(n_, 0.0),
+      r0_(n_, 0.0),
+      p_(n_, 0.0),
+      v_(n_, 0.0),
+      y_(n_, 0.0),
+      z_(n_, 0.0),
+      s_(n_, 0.0),
+      t_(n_, 0.0)
+{
+    real_t *mat = mat_.data();
+    real_t *b   = b_.data();
+    real_t *x   = x_.data();
+    real_t *d   = inv_diag_.data();
+    real_t *r   = r_.data();
+    real_t *r0  = r0_.data();
+    real_t *p   = p_.data();
+    real_t *v   = v_.data();
+    real_t *y   = y_.data();
+    real_t *z   = z_.data();
+    real_t *s   = s_.data();
+    real_t *t   = t_.data();
+    int n_mat   = mat_.size();
+    int n       = n_;
+#pragma omp target enter data map(to: mat[0:n_mat]) map(alloc: b[0:n],   \
+    x[0:n], d[0:n], r[0:n], r0[0:n], p[0:n], v[0:n], y[0:n], z[0:n],      \
+    s[0:n], t[0:n])
+
+    return;
+}
+
+DeviceStencil::~DeviceStencil()
+{
+    real_t *mat = mat_.data();
+    real_t *b   = b_.data();
+    real_t *x   = x_.data();
+    real_t *d   = inv_diag_.data();
+    real_t *r   = r_.data();
+    real_t *r0  = r0_.data();
+    real_t *p   = p_.data();
+    real_t *v   = v_.data();
+    real_t *y   = y_.data();
+    real_t *z   = z_.data();
+    real_t *s   = s_.data();
+    real_t *t   = t_.data();
+    int n_mat   = mat_.size();
+    int n       = n_;
+#pragma omp target exit data map(delete: mat[0:n_mat], b[0:n], x[0:n],   \
+    d[0:n], r[0:n], r0[0:n], p[0:n], v[0:n], y[0:n], z[0:n], s[0:n],      \
+    t[0:n])
+
+    return;
+}
+
+void DeviceStencil::update(int group, const StencilMatrix &m)
+{
+    assert(m.size() == n_);
+    real_t *mat = mat_.data() + 7 * group * n_;
+    for (int i = 0; i < n_; i++) {
+        mat[i] = m.diagonal(i);
+    }
+    for (auto surf : AllSurfaces) {
+        real_t *c = mat + (1 + (int)surf) * n_;
+        for (int i = 0; i < n_; i++) {
+            c[i] = m.coeff(i, surf);
+        }
+    }
+
+    int n_g = 7 * n_;
+#pragma omp target update to(mat[0:n_g])
+
+    return;
+}
+
+void DeviceStencil::multiply(int a, const real_t *x, real_t *y) const
+{
+    const real_t *mat = mat_.data();
+    const int nx      = nx_;
+    const int ny      = ny_;
+    const int nz      = nz_;
+    const int nxy     = nx_ * ny_;
+    const int n       = n_;
+    const int i_d     = a;
+    const int i_e     = a + (1 + (int)Surface::EAST) * n_;
+    const int i_w     = a + (1 + (int)Surface::WEST) * n_;
+    const int i_n     = a + (1 + (int)Surface::NORTH) * n_;
+    const int i_s     = a + (1 + (int)Surface::SOUTH) * n_;
+    const int i_t     = a + (1 + (int)Surface::TOP) * n_;
+    const int i_b     = a + (1 + (int)Surface::BOTTOM) * n_;
+
+    // The coefficients across the domain boundary are zero, but the
+    // neighbors there do not exist, so they are skipped
+#pragma omp target teams distribute parallel for
+    for (int i = 0; i < n; i++) {
+        int ix   = i % nx;
+        int iy   = (i / nx) % ny;
+        int iz   = i / nxy;
+        real_t v = mat[i_d + i] * x[i];
+        if (ix > 0) {
+            v += mat[i_w + i] * x[i - 1];
+        }
+        if (ix < nx - 1) {
+            v += mat[i_e + i] * x[i + 1];
+        }
+        if (iy > 0) {
+            v += mat[i_s + i] * x[i - nx];
+        }
+        if (iy < ny - 1) {
+            v += mat[i_n + i] * x[i + nx];
+        }
+        if (iz > 0) {
+            v += mat[i_b + i] * x[i - nxy];
+        }
+        if (iz < nz - 1) {
+            v += mat[i_t + i] * x[i + nxy];
+        }
+        y[i] = v;
+    }
+
+    return;
+}
+
+real_t DeviceStencil::dot(const real_t *x, const real_t *y) const
+{
+    const int n  = n_;
+    real_t total = 0.0;
+#pragma omp target teams distribute parallel for reduction(+: total) \
+    map(tofrom: total)
+    for (int i = 0; i < n; i++) {
+        total += x[i] * y[i];
+    }
+    return total;
+}
+
+int DeviceStencil::solve(int group, const VectorX &b_in, VectorX &x_in,
+                         real_t tol, int max_iter)
+{
+    assert(b_in.size() == n_);
+    assert(x_in.size() == n_);
+
+    const int n       = n_;
+    const int a       = 7 * group * n_;
+    const real_t *mat = mat_.data();
+    real_t *b         = b_.data();
+    real_t *x         = x_.data();
+    real_t *d         = inv_diag_.data();
+    real_t *r         = r_.data();
+    real_t *r0        = r0_.data();
+    real_t *p         = p_.data();
+    real_t *v         = v_.data();
+    real_t *y         = y_.data();
+    real_t *z         = z_.data();
+    real_t *s         = s_.data();
+    real_t *t         = t_.data();
+
+    std::copy(b_in.data(), b_in.data() + n, b_.begin());
+    std::copy(x_in.data(), x_in.data() + n, x_.begin());
+#pragma omp target update to(b[0:n], x[0:n])
+
+    real_t b_norm = std::sqrt(this->dot(b, b));
+    if (b_norm == 0.0) {
+        x_in.setZero();
+        return 0;
+    }
+
+    this->multiply(a, x, r);
+#pragma omp target teams distribute parallel for
+    for (int i = 0; i < n; i++) {
+        d[i]  = 1.0 / mat[a + i];
+        r[i]  = b[i] - r[i];
+        r0[i] = r[i];
+        p[i]  = 0.0;
+        v[i]  = 0.0;
+    }
+
+    real_t rho   = 1.0;
+    real_t alpha = 1.0;
+    real_t omega = 1.0;
+    int iter     = 0;
+    while ((std::sqrt(this->dot(r, r)) > tol * b_norm) && (iter < max_iter)) {
+        iter++;
+        real_t rho_new = this->dot(r0, r);
+        if (rho_new == 0.0) {
+            // Breakdown. Restart with the current residual.
+#pragma omp target teams distribute parallel for
+            for (int i = 0; i < n; i++) {
+                r0[i] = r[i];
+                p[i]  = 0.0;
+                v[i]  = 0.0;
+            }
+            rho_new = this->dot(r0, r);
+            rho     = 1.0;
+            alpha   = 1.0;
+            omega   = 1.0;
+        }
+        real_t beta = (rho_new / rho) * (alpha / omega);
+        real_t w    = omega;
+#pragma omp target teams distribute parallel for
+        for (int i = 0; i < n; i++) {
+            p[i] = r[i] + beta * (p[i] - w * v[i]);
+            y[i] = d[i] * p[i];
+        }
+        this->multiply(a, y, v);
+        alpha      = rho_new / this->dot(r0, v);
+        real_t alp = alpha;
+#pragma omp target teams distribute parallel for
+        for (int i = 0; i < n; i++) {
+            s[i] = r[i] - alp * v[i];
+            z[i] = d[i] * s[i];
+        }
+        this->multiply(a, z, t);
+        real_t tt = this->dot(t, t);
+        omega     = tt > 0.0 ? this->dot(t, s) / tt : 0.0;
+        w         = omega;
+#pragma omp target teams distribute parallel for
+        for (int i = 0; i < n; i++) {
+            x[i] += alp * y[i] + w * z[i];
+            r[i] = s[i] - w * t[i];
+        }
+        rho = rho_new;
+        if (omega == 0.0) {
+            break;
+        }
+    }
+
+#pragma omp target update from(x[0:n])
+    std::copy(x_.begin(), x_.end(), x_in.data());
+
+    return iter;
+}
+
+size_t DeviceStencil::memory() const
+{
+    return bytes(mat_) + bytes(b_) + bytes(x_) + bytes(inv_diag_) + bytes(r_) +
+           bytes(r0_) + bytes(p_) + bytes(v_) + bytes(y_) + bytes(z_) +
+           bytes(s_) + bytes(t_);
+}
+}
@@ -0,0 +1,106 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <vector>
+#include "util/global_config.hpp"
+#include "eigen_interface.hpp"
+#include "stencil_matrix.hpp"
+
+namespace mocc {
+/**
+ * \brief Device-resident seven-point stencil matrices and a
+ * Jacobi-preconditioned BiCGSTAB solver, using OpenMP target offload
+ *
+ * The diagonals of every group's \ref StencilMatrix, and the work vectors of
+ * the solver, are mapped to the device once, on construction, and stay there
+ * until the \ref DeviceStencil is destroyed. An update only moves the
+ * diagonals of one group, and a solve only the right-hand side and the
+ * solution, so that all of the iterations run on the device. The iteration
+ * is the same as \ref StencilMatrix::solve_bicgstab().
+ */
+class DeviceStencil {
+public:
+    DeviceStencil(int nx, int ny, int nz, int n_group);
+
+    ~DeviceStencil();
+
+    DeviceStencil(const DeviceStencil &) = delete;
+    DeviceStencil &operator=(const DeviceStencil &) = delete;
+
+    /**
+     * \brief Copy the matrix of a group to the device
+     */
+    void update(int group, const StencilMatrix &m);
+
+    /**
+     * \brief Solve the system of a group on the device
+     *
+     * \param group the group
+     * \param b the right-hand side
+     * \param [in,out] x the initial guess, replaced by the solution
+     * \param tol the relative residual to converge to
+     * \param max_iter the maximum number of iterations
+     *
+     * Returns the number of iterations performed.
+     */
+    int solve(int group, const VectorX &b, VectorX &x, real_t tol,
+              int max_iter);
+
+    /**
+     * \brief Return the number of bytes used on the device (and mirrored on
+     * the host)
+     */
+    size_t memory() const;
+
+private:
+    /**
+     * \brief Compute y = A x on the device, for the matrix starting at
+     * \p a in \ref mat_
+     */
+    void multiply(int a, const real_t *x, real_t *y) const;
+
+    /**
+     * \brief Return the dot product of two device vectors
+     */
+    real_t dot(const real_t *x, const real_t *y) const;
+
+    int nx_;
+    int ny_;
+    int nz_;
+    int n_;
+    int n_group_;
+
+    // Diagonal and coefficients of each group, indexed [(group * 7 + k) *
+    // n_ + i], with k = 0 for the diagonal and 1 + (int)Surface for the
+    // coefficients across each surface
+    std::vector<real_t> mat_;
+
+    // Right-hand side, solution and BiCGSTAB work vectors
+    std::vector<real_t> b_;
+    std::vector<real_t> x_;
+    std::vector<real_t> inv_diag_;
+    std::vector<real_t> r_;
+    std::vector<real_t> r0_;
+    std::vector<real_t> p_;
+    std::vector<real_t> v_;
+    std::vector<real_t> y_;
+    std::vector<real_t> z_;
+    std::vector<real_t> s_;
+    std::vector<real_t> t_;
+};
+}
@@ -0,0 +1,40 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include "exponential.hpp"
+
+#include "util/error.hpp"
+
+namespace mocc {
+UP_Exponential_t ExponentialFactory(const std::string &type)
+{
+    if (type == "exact") {
+        return UP_Exponential_t(new Exponential());
+    } else if (type == "linear") {
+        return UP_Exponential_t(new Exponential_Linear<10000>());
+    } else if (type == "clamped") {
+        return UP_Exponential_t(
+            new Exponential_ClampedLinear<20000>(-20.0, 0.0));
+    } else if (type == "quadratic") {
+        return UP_Exponential_t(new Exponential_Quadratic<2000>(-20.0, 0.0));
+    } else if (type == "polynomial") {
+        return UP_Exponential_t(new Exponential_Polynomial());
+    }
+
+    throw EXCEPT("Unrecognized exponential type: " + type);
+}
+}
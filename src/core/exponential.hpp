@@ -20,8 +20,13 @@
 #include <array>
 #include <cassert>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
 
 #include "util/global_config.hpp"
+#include "constants.hpp"
 
 namespace mocc {
 /**
@@ -36,18 +41,41 @@ public:
     {
     }
 
+    virtual ~Exponential()
+    {
+    }
+
     inline real_t exp(real_t v) const
     {
         return std::exp(v);
     }
 
+    /**
+     * \brief Evaluate the exponential of a batch of values
+     *
+     * \param in the arguments
+     * \param out the results. This may be the same as \p in.
+     * \param n the number of values
+     *
+     * This is virtual, so that the evaluator may be chosen at run time while
+     * only paying for one virtual call per batch. Each derived class
+     * implements it as a simple loop over its own \c exp(), which is written
+     * to be vectorizable where possible.
+     */
+    virtual void exp_n(const real_t *in, real_t *out, int n) const
+    {
+        for (int i = 0; i < n; i++) {
+            out[i] = std::exp(in[i]);
+        }
+    }
+
     virtual real_t max_error()
     {
         return 0.0;
     }
 };
 
-/*
+/**
  * This version of \ref Exponential uses a linear lookup table to speed up
  * the evaluations of \ref exp(). If the argument to \ref exp() is beyond
  * the domain of the table, it will fall back to the result of the standard
@@ -68,9 +96,7 @@ public:
 
     inline real_t exp(real_t v) const
     {
-        if (v < min_ || v > max_) {
-            std::cout << "Out-of-bounds exponential argument: " << v
-                      << std::endl;
+        if (v < min_ || v >= max_) {
             return std::exp(v);
         }
         int i = (v - min_) * rspace_;
@@ -78,6 +104,13 @@ public:
         return d_[i] + (d_[i + 1] - d_[i]) * v * rspace_;
     }
 
+    void exp_n(const real_t *in, real_t *out, int n) const override
+    {
+        for (int i = 0; i < n; i++) {
+            out[i] = this->exp(in[i]);
+        }
+    }
+
     real_t max_error()
     {
         real_t max_error = 0.0;
@@ -120,6 +153,7 @@ protected:
  * Exponential_Linear.
  */
 template <int N> class Exponential_UnsafeLinear : public Exponential_Linear<N> {
+public:
     Exponential_UnsafeLinear(real_t min = -10.0, real_t max = 0.0)
         : Exponential_Linear<N>(min, max)
     {
@@ -133,5 +167,262 @@ template <int N> class Exponential_UnsafeLinear : public Exponential_Linear<N> {
         return this->d_[i] +
                (this->d_[i + 1] - this->d_[i]) * v * this->rspace_;
     }
+
+    void exp_n(const real_t *in, real_t *out, int n) const override
+    {
+        for (int i = 0; i < n; i++) {
+            out[i] = this->exp(in[i]);
+        }
+    }
+};
+
+/**
+ * Same as \ref Exponential_Linear, but arguments are clamped to the domain of
+ * the table rather than checked. Arguments below the table return zero, and
+ * arguments above it return the value at the top of the table. With no
+ * branches in \ref exp(), the loop in \ref exp_n() can be vectorized (using
+ * gathers for the table lookups). This is intended for MoC, where arguments
+ * are non-positive and the table should be wide enough that exp(min) is
+ * negligible.
+ */
+template <int N> class Exponential_ClampedLinear : public Exponential_Linear<N> {
+public:
+    Exponential_ClampedLinear(real_t min = -10.0, real_t max = 0.0)
+        : Exponential_Linear<N>(min, max)
+    {
+        return;
+    }
+
+    inline real_t exp(real_t v) const
+    {
+        real_t vc = std::min(std::max(v, this->min_), this->max_);
+        int i     = std::min((int)((vc - this->min_) * this->rspace_), N - 1);
+        real_t x  = vc - (this->space_ * i + this->min_);
+        real_t e  = this->d_[i] +
+                   (this->d_[i + 1] - this->d_[i]) * x * this->rspace_;
+        return (v >= this->min_) ? e : 0.0;
+    }
+
+    void exp_n(const real_t *in, real_t *out, int n) const override
+    {
+#pragma omp simd
+        for (int i = 0; i < n; i++) {
+            out[i] = this->exp(in[i]);
+        }
+    }
+
+    real_t max_error()
+    {
+        real_t max_error = 0.0;
+        for (int i = 0; i < N; i++) {
+            real_t x   = this->min_ + this->space_ * (0.5 + i);
+            real_t e   = std::exp(x);
+            real_t err = std::abs((this->exp(x) - e) / e);
+            max_error  = std::max(max_error, err);
+        }
+        return max_error;
+    }
+};
+
+/**
+ * This is a table of the normalized Bickley-Naylor function of order three,
+ * \f$Ki_3(x)/Ki_3(0)\f$, with
+ * \f[
+ * Ki_3(x) = \int_0^{\pi/2} \sin^2\theta \, e^{-x/\sin\theta} d\theta,
+ * \f]
+ * where \f$\theta\f$ is the polar angle. This plays the role of the
+ * exponential when the attenuation along a 2-D MoC segment of in-plane optical
+ * thickness \f$x\f$ is integrated over the polar angle, so \ref exp()
+ * returns \f$Ki_3(-v)/Ki_3(0)\f$ to stand in for \f$e^v\f$. The table is
+ * interpolated and clamped in the same way as \ref Exponential_ClampedLinear.
+ */
+template <int N>
+class BickleyNaylor_Ki3 : public Exponential_ClampedLinear<N> {
+public:
+    BickleyNaylor_Ki3(real_t min = -20.0)
+        : Exponential_ClampedLinear<N>(min, 0.0)
+    {
+        real_t ki3_0 = ki3(0.0);
+        for (int i = 0; i <= N; i++) {
+            this->d_[i] = ki3(-(this->min_ + i * this->space_)) / ki3_0;
+        }
+        return;
+    }
+
+    /**
+     * \brief Evaluate \f$Ki_3(x)\f$ directly, with Simpson's rule
+     *
+     * This is only meant for setting up and checking the table.
+     */
+    static real_t ki3(real_t x)
+    {
+        const int n    = 1000;
+        const real_t h = HPI / n;
+        real_t sum     = 0.0;
+        // The integrand vanishes at theta = 0, so start from the first
+        // interior point
+        for (int i = 1; i <= n; i++) {
+            real_t s = std::sin(i * h);
+            real_t f = s * s * std::exp(-x / s);
+            sum += f * ((i == n) ? 1.0 : ((i % 2 == 1) ? 4.0 : 2.0));
+        }
+        return sum * h / 3.0;
+    }
+
+    real_t max_error()
+    {
+        real_t max_error = 0.0;
+        real_t ki3_0     = ki3(0.0);
+        for (int i = 0; i < N; i++) {
+            real_t x   = this->min_ + this->space_ * (0.5 + i);
+            real_t err = std::abs(this->exp(x) - ki3(-x) / ki3_0);
+            max_error  = std::max(max_error, err);
+        }
+        return max_error;
+    }
 };
+
+/**
+ * This version of \ref Exponential uses a table of exponentials at evenly
+ * spaced nodes, and a second-order expansion about the nearest node:
+ * exp(x) = exp(x_i) * (1 + h + h^2/2), with h = x - x_i. Since |h| is at most
+ * half a table spacing, this is much more accurate than linear interpolation
+ * for the same table size, so a smaller table can be used, which is easier on
+ * cache. Arguments are clamped in the same way as \ref
+ * Exponential_ClampedLinear.
+ */
+template <int N> class Exponential_Quadratic : public Exponential {
+public:
+    Exponential_Quadratic(real_t min = -10.0, real_t max = 0.0)
+        : min_(min),
+          max_(max),
+          space_((max - min_) / (real_t)(N)),
+          rspace_(1.0 / space_)
+    {
+        for (int i = 0; i <= N; i++) {
+            d_[i] = std::exp(min_ + i * space_);
+        }
+    }
+
+    inline real_t exp(real_t v) const
+    {
+        real_t vc = std::min(std::max(v, min_), max_);
+        int i     = (vc - min_) * rspace_ + 0.5;
+        real_t h  = vc - (space_ * i + min_);
+        real_t e  = d_[i] * (1.0 + h * (1.0 + 0.5 * h));
+        return (v >= min_) ? e : 0.0;
+    }
+
+    void exp_n(const real_t *in, real_t *out, int n) const override
+    {
+#pragma omp simd
+        for (int i = 0; i < n; i++) {
+            out[i] = this->exp(in[i]);
+        }
+    }
+
+    real_t max_error()
+    {
+        real_t max_error = 0.0;
+        for (int i = 0; i < N; i++) {
+            real_t x   = min_ + space_ * (0.5 + i);
+            real_t e   = std::exp(x);
+            real_t err = std::abs((this->exp(x) - e) / e);
+            max_error  = std::max(max_error, err);
+        }
+        return max_error;
+    }
+
+protected:
+    real_t min_;
+    real_t max_;
+    real_t space_;
+    real_t rspace_;
+    std::array<real_t, N + 1> d_;
+};
+
+/**
+ * This version of \ref Exponential needs no table at all. The argument is
+ * reduced to x = k*ln(2) + r, with |r| <= ln(2)/2, exp(r) is evaluated with a
+ * degree-11 polynomial, and the result is scaled by 2^k by building the
+ * exponent bits directly. Everything is straight-line arithmetic, so \ref
+ * exp_n() vectorizes cleanly on AVX2/AVX-512 without gathers, and the result
+ * is accurate to a few ULP for all arguments. Arguments below -708 return
+ * zero.
+ */
+class Exponential_Polynomial : public Exponential {
+public:
+    Exponential_Polynomial()
+    {
+    }
+
+    inline real_t exp(real_t v) const
+    {
+        const double log2e  = 1.4426950408889634;
+        const double ln2_hi = 6.93147180369123816490e-01;
+        const double ln2_lo = 1.90821492927058770002e-10;
+        const double x_min  = -708.0;
+        const double x_max  = 709.0;
+
+        double x = std::min(std::max((double)v, x_min), x_max);
+        double k = std::floor(x * log2e + 0.5);
+        double r = (x - k * ln2_hi) - k * ln2_lo;
+
+        // Taylor coefficients through 1/11!. Over |r| <= ln(2)/2 the
+        // truncation error is below 1e-15.
+        double p = 2.505210838544172e-08;
+        p        = p * r + 2.755731922398589e-07;
+        p        = p * r + 2.755731922398589e-06;
+        p        = p * r + 2.480158730158730e-05;
+        p        = p * r + 1.984126984126984e-04;
+        p        = p * r + 1.388888888888889e-03;
+        p        = p * r + 8.333333333333333e-03;
+        p        = p * r + 4.166666666666666e-02;
+        p        = p * r + 1.666666666666667e-01;
+        p        = p * r + 0.5;
+        p        = p * r + 1.0;
+        p        = p * r + 1.0;
+
+        // Build 2^k from its exponent bits
+        uint64_t bits = (uint64_t)((int64_t)k + 1023) << 52;
+        double scale;
+        std::memcpy(&scale, &bits, sizeof(scale));
+
+        return ((double)v >= x_min) ? p * scale : 0.0;
+    }
+
+    void exp_n(const real_t *in, real_t *out, int n) const override
+    {
+#pragma omp simd
+        for (int i = 0; i < n; i++) {
+            out[i] = this->exp(in[i]);
+        }
+    }
+
+    real_t max_error()
+    {
+        real_t max_error = 0.0;
+        for (real_t x = -20.0; x < 0.0; x += 0.001) {
+            real_t e   = std::exp(x);
+            real_t err = std::abs((this->exp(x) - e) / e);
+            max_error  = std::max(max_error, err);
+        }
+        return max_error;
+    }
+};
+
+typedef std::unique_ptr<Exponential> UP_Exponential_t;
+
+/**
+ * \brief Return a new exponential evaluator of the named type
+ *
+ * Recognized types are:
+ *  - \c "exact": the standard library \c exp()
+ *  - \c "linear": \ref Exponential_Linear with 10000 points on [-10, 0]
+ *  - \c "clamped": \ref Exponential_ClampedLinear with 20000 points on
+ *  [-20, 0]
+ *  - \c "quadratic": \ref Exponential_Quadratic with 2000 points on [-20, 0]
+ *  - \c "polynomial": \ref Exponential_Polynomial
+ */
+UP_Exponential_t ExponentialFactory(const std::string &type);
 }
@@ -17,7 +17,9 @@
 #pragma once
 
 #include <cassert>
+#include <cmath>
 #include <iosfwd>
+#include "util/fast_math.hpp"
 #include "util/fp_utils.hpp"
 #include "util/global_config.hpp"
 #include "core/constants.hpp"
@@ -79,6 +81,25 @@ public:
         return;
     }
 
+    /**
+     * \brief Construct from all of the components, which must already be
+     * consistent with each other
+     *
+     * This does no trigonometry, for callers that already have the cosines
+     * and angles in hand.
+     */
+    Direction(real_t ox, real_t oy, real_t oz, real_t alpha, real_t theta,
+              real_t rsintheta)
+        : ox(ox),
+          oy(oy),
+          oz(oz),
+          alpha(alpha),
+          theta(theta),
+          rsintheta(rsintheta)
+    {
+        return;
+    }
+
     /**
      * \brief Change the azimuthal angle of this Direction, and update all
      * other values accordingly.
@@ -113,22 +134,56 @@ public:
      */
     void reflect(Surface surf)
     {
+        // Flipping a cosine maps the angles directly, keeping alpha in
+        // [0, 2*pi)
         if ((surf == Surface::EAST) || (surf == Surface::WEST)) {
-            *this = Direction(-ox, oy, oz);
+            ox    = -ox;
+            alpha = PI - alpha;
+            alpha = (alpha < 0.0) ? alpha + TWOPI : alpha;
         }
         if ((surf == Surface::NORTH) || (surf == Surface::SOUTH)) {
-            *this = Direction(ox, -oy, oz);
+            oy    = -oy;
+            alpha = (alpha > 0.0) ? TWOPI - alpha : 0.0;
         }
         if ((surf == Surface::TOP) || (surf == Surface::BOTTOM)) {
-            *this = Direction(ox, oy, -oz);
+            oz    = -oz;
+            theta = PI - theta;
         }
     }
 
+    /**
+     * \brief Return a Direction sampled uniformly over the unit sphere
+     *
+     * The polar cosine is sampled directly from \p r2, so only the sine and
+     * cosine of the azimuthal angle are needed for the direction cosines.
+     * The polar angle itself is still stored, since other code (e.g. the
+     * \ref FissionBank) keeps a Direction by its angles.
+     */
     static Direction Isotropic(real_t r1, real_t r2)
     {
         assert((r1 >= 0.0) && (r1 < 1.0));
         assert((r2 >= 0.0) && (r2 < 1.0));
-        return Direction(r1 * TWOPI, std::acos(r2 * 2.0 - 1.0));
+        double sin_alpha, cos_alpha;
+        fast_sincos_2pi(r1, sin_alpha, cos_alpha);
+        return Isotropic(r2, sin_alpha, cos_alpha, r1 * TWOPI);
+    }
+
+    /**
+     * \brief Return an isotropic Direction from a random number for the polar
+     * cosine, and the already-computed sine and cosine of the azimuthal angle
+     *
+     * This lets batches of directions get their sines and cosines from the
+     * vectorized fast_sincos_2pi(). As long as those come from the same
+     * random number, the result is identical to Isotropic(r1, r2).
+     */
+    static Direction Isotropic(real_t r2, real_t sin_alpha, real_t cos_alpha,
+                               real_t alpha)
+    {
+        real_t mu = r2 * 2.0 - 1.0;
+        // (1 - mu) * (1 + mu) keeps its precision near the poles
+        real_t sin_theta = std::sqrt((1.0 - mu) * (1.0 + mu));
+        return Direction(sin_theta * cos_alpha, sin_theta * sin_alpha, mu,
+                         alpha, std::acos(mu), 1.0 / sin_theta);
     }
 
     /**
@@ -19,11 +19,15 @@
 #include <iostream>
 #include "pugixml.hpp"
 #include "util/error.hpp"
+#include "util/rng_lcg.hpp"
 #include "angle.hpp"
 #include "constants.hpp"
 
 using mocc::Angle;
+using mocc::Direction;
 using mocc::Exception;
+using mocc::real_t;
+using mocc::Surface;
 
 TEST(testAngle)
 {
@@ -169,6 +173,36 @@ TEST(testXMLAngle)
     }
 }
 
+// Isotropic directions are built from their cosines, but should agree with
+// the same angles built the long way, and reflect to the same place
+TEST(testIsotropic)
+{
+    mocc::RNG_LCG rng;
+    for (int i = 0; i < 1000; i++) {
+        real_t r1     = rng.random();
+        real_t r2     = rng.random();
+        Direction dir = Direction::Isotropic(r1, r2);
+        CHECK_CLOSE(1.0, dir.ox * dir.ox + dir.oy * dir.oy + dir.oz * dir.oz,
+                    1.0e-14);
+
+        Direction ref(dir.alpha, dir.theta);
+        CHECK_CLOSE(ref.ox, dir.ox, 1.0e-14);
+        CHECK_CLOSE(ref.oy, dir.oy, 1.0e-14);
+        CHECK_CLOSE(ref.oz, dir.oz, 1.0e-14);
+        CHECK_CLOSE(1.0, ref.rsintheta / dir.rsintheta, 1.0e-12);
+
+        for (Surface surf : {Surface::EAST, Surface::NORTH, Surface::TOP}) {
+            Direction refl = dir;
+            refl.reflect(surf);
+            Direction ref_refl(refl.ox, refl.oy, refl.oz);
+            CHECK_CLOSE(ref_refl.alpha, refl.alpha, 1.0e-10);
+            CHECK_CLOSE(ref_refl.theta, refl.theta, 1.0e-10);
+            CHECK(refl.alpha >= 0.0);
+            CHECK(refl.alpha < TWOPI);
+        }
+    }
+}
+
 int main()
 {
     return UnitTest::RunAllTests();
@@ -0,0 +1,130 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "gmres.hpp"
+
+#include <cassert>
+#include <cmath>
+#include <vector>
+
+namespace mocc {
+int gmres(const LinearOperator &op, const VectorX &b, VectorX &x, real_t tol,
+          int max_iter, int restart)
+{
+    assert(restart > 0);
+    assert(x.size() == b.size());
+
+    const int n   = b.size();
+    real_t b_norm = b.norm();
+    if (b_norm == 0.0) {
+        x.setZero();
+        return 0;
+    }
+
+    std::vector<VectorX> v(restart + 1, VectorX(n));
+    MatrixX h = MatrixX::Zero(restart + 1, restart);
+    VectorX cs(restart);
+    VectorX sn(restart);
+    VectorX g(restart + 1);
+    VectorX r(n);
+    VectorX w(n);
+
+    int n_op = 0;
+    if (x.squaredNorm() == 0.0) {
+        r = b;
+    } else {
+        op(x, r);
+        n_op++;
+        r = b - r;
+    }
+
+    while (true) {
+        real_t beta = r.norm();
+        if ((beta <= tol * b_norm) || (n_op >= max_iter)) {
+            break;
+        }
+
+        v[0] = r / beta;
+        g.setZero();
+        g[0] = beta;
+
+        // Build up the Krylov space until it is full, the residual is small
+        // enough, or we run out of applications
+        int k          = 0;
+        bool converged = false;
+        while ((k < restart) && (n_op < max_iter) && !converged) {
+            op(v[k], w);
+            n_op++;
+            for (int j = 0; j <= k; j++) {
+                h(j, k) = w.dot(v[j]);
+                w -= h(j, k) * v[j];
+            }
+            h(k + 1, k) = w.norm();
+            if (h(k + 1, k) > 0.0) {
+                v[k + 1] = w / h(k + 1, k);
+            }
+
+            // Apply the previous rotations to the new column, then find the
+            // rotation that zeros its sub-diagonal
+            for (int j = 0; j < k; j++) {
+                real_t t    = cs[j] * h(j, k) + sn[j] * h(j + 1, k);
+                h(j + 1, k) = -sn[j] * h(j, k) + cs[j] * h(j + 1, k);
+                h(j, k)     = t;
+            }
+            real_t d = std::hypot(h(k, k), h(k + 1, k));
+            if (d == 0.0) {
+                break;
+            }
+            cs[k]       = h(k, k) / d;
+            sn[k]       = h(k + 1, k) / d;
+            h(k, k)     = d;
+            h(k + 1, k) = 0.0;
+            g[k + 1]    = -sn[k] * g[k];
+            g[k]        = cs[k] * g[k];
+
+            // A zero sub-diagonal means that the Krylov space is invariant,
+            // and the solution is exact
+            converged = (std::abs(g[k + 1]) <= tol * b_norm) ||
+                        (sn[k] == 0.0);
+            k++;
+        }
+
+        if (k == 0) {
+            break;
+        }
+
+        // Update the solution from the least-squares solution in the
+        // Krylov space
+        VectorX y = h.topLeftCorner(k, k)
+                        .triangularView<Eigen::Upper>()
+                        .solve(g.head(k));
+        for (int j = 0; j < k; j++) {
+            x += y[j] * v[j];
+        }
+
+        if (converged || (n_op >= max_iter)) {
+            break;
+        }
+
+        // Restart from the true residual
+        op(x, r);
+        n_op++;
+        r = b - r;
+    }
+
+    return n_op;
+}
+}
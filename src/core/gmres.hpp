@@ -0,0 +1,50 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <functional>
+
+#include "util/global_config.hpp"
+#include "eigen_interface.hpp"
+
+namespace mocc {
+/**
+ * \brief The action of a linear operator, y = A*x, called as op(x, y)
+ */
+typedef std::function<void(const VectorX &, VectorX &)> LinearOperator;
+
+/**
+ * \brief Solve A*x = b with restarted GMRES, given only the action of A
+ *
+ * \param [in] op the action of the operator
+ * \param [in] b the right-hand side
+ * \param [in,out] x the initial guess, replaced by the solution
+ * \param [in] tol the relative residual to converge to
+ * \param [in] max_iter the maximum number of operator applications
+ * \param [in] restart the number of Krylov vectors to keep before
+ * restarting
+ *
+ * \returns the number of operator applications performed. No application is
+ * needed to find the initial residual of a zero initial guess.
+ *
+ * The Arnoldi vectors are orthogonalized with modified Gram-Schmidt, and the
+ * least-squares problem is updated with Givens rotations, so the residual
+ * norm is known after every application without forming the solution.
+ */
+int gmres(const LinearOperator &op, const VectorX &b, VectorX &x, real_t tol,
+          int max_iter, int restart);
+}
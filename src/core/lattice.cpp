@@ -222,7 +222,8 @@ bool Lattice::geometrically_equivalent(const Lattice &other) const
     }
 
     for(unsigned ip=0; ip<pins_.size(); ip++) {
-        if(pins_[ip]->mesh().id() != other.pins_[ip]->mesh().id()) {
+        if (!pins_[ip]->mesh().geometrically_equivalent(
+                other.pins_[ip]->mesh())) {
             return false;
         }
     }
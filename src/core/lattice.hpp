@@ -170,8 +170,9 @@ public:
      * \brief Return whether another Lattice is geometrically equivalent to this
      * one.
      *
-     * This compares \ref PinMesh IDs only; identical pin meshes with different
-     * IDs will not be considered equivalent here.
+     * Pins are compared by their \ref PinMesh only, with \ref
+     * PinMesh::geometrically_equivalent(), so lattices that only differ in
+     * their materials, or in the IDs of identical pin meshes, are equivalent.
      */
     bool geometrically_equivalent(const Lattice &other) const;
 
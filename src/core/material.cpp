@@ -20,7 +20,8 @@
 
 namespace mocc {
 Material::Material(VecF xsab, VecF xsnf, VecF xsf, VecF xsch,
-                   std::vector<VecF> scat)
+                   std::vector<VecF> scat,
+                   std::vector<std::vector<VecF>> scat_pn)
     : xsab_(xsab.size()),
       xstr_(xsab.size()),
       xsnf_(xsab.size()),
@@ -32,6 +33,12 @@ Material::Material(VecF xsab, VecF xsnf, VecF xsf, VecF xsch,
     assert(xsab.size() == xsf.size());
     assert(xsab.size() == xsch.size());
 
+    xssc_pn_.reserve(scat_pn.size());
+    for (const auto &table : scat_pn) {
+        assert(table.size() == xsab.size());
+        xssc_pn_.emplace_back(table);
+    }
+
     for (unsigned ig = 0; ig < xsab.size(); ig++) {
         xsab_(ig) = xsab[ig];
         xsnf_(ig) = xsnf[ig];
@@ -60,4 +67,38 @@ Material::Material(VecF xsab, VecF xsnf, VecF xsf, VecF xsch,
         xstr_(ig) = xsab[ig] + xssc_.out(ig);
     }
 }
+
+Material Material::scaled(real_t factor) const
+{
+    int ng = xsab_.size();
+    VecF xsab(ng);
+    VecF xsnf(ng);
+    VecF xsf(ng);
+    VecF xsch(ng);
+
+    auto scale_table = [&](const ScatteringMatrix &matrix) {
+        std::vector<VecF> table(ng, VecF(ng, 0.0));
+        VecF sc = matrix.as_vector();
+        for (int ig = 0; ig < ng; ig++) {
+            for (int igg = 0; igg < ng; igg++) {
+                table[ig][igg] = factor * sc[ng * ig + igg];
+            }
+        }
+        return table;
+    };
+
+    for (int ig = 0; ig < ng; ig++) {
+        xsab[ig] = factor * xsab_(ig);
+        xsnf[ig] = factor * xsnf_(ig);
+        xsf[ig]  = factor * xsf_(ig);
+        xsch[ig] = xsch_(ig);
+    }
+
+    std::vector<std::vector<VecF>> scat_pn;
+    for (const auto &matrix : xssc_pn_) {
+        scat_pn.push_back(scale_table(matrix));
+    }
+
+    return Material(xsab, xsnf, xsf, xsch, scale_table(xssc_), scat_pn);
+}
 };
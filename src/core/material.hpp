@@ -24,7 +24,41 @@
 namespace mocc {
 class Material {
 public:
-    Material(VecF xsab, VecF xsnf, VecF xsf, VecF xsch, std::vector<VecF> scat);
+    /**
+     * \brief Construct a material
+     *
+     * \p scat is the isotropic (P0) scattering table, indexed by destination
+     * group, then source group. \p scat_pn optionally holds the tables of the
+     * higher Legendre moments of the scattering kernel, starting with P1, in
+     * the same layout. The transport cross section is always formed from the
+     * P0 table.
+     */
+    Material(VecF xsab, VecF xsnf, VecF xsf, VecF xsch, std::vector<VecF> scat,
+             std::vector<std::vector<VecF>> scat_pn = {});
+
+    /**
+     * \brief Assignment shares a reference to the cross sections of the
+     * other material, as copy construction does
+     *
+     * The cross sections of a \ref Material are never modified in place, so
+     * this allows a material to be replaced without disturbing copies of the
+     * old one.
+     */
+    Material &operator=(const Material &other)
+    {
+        if (this == &other) {
+            return *this;
+        }
+        xsab_.reference(other.xsab_);
+        xstr_.reference(other.xstr_);
+        xsnf_.reference(other.xsnf_);
+        xsf_.reference(other.xsf_);
+        xsch_.reference(other.xsch_);
+        xssc_       = other.xssc_;
+        xssc_pn_    = other.xssc_pn_;
+        is_fissile_ = other.is_fissile_;
+        return *this;
+    }
     // Accessors for absorption
     const auto xsab() const
     {
@@ -80,9 +114,40 @@ public:
         return xssc_;
     }
 
+    /**
+     * \brief Return the highest Legendre order of the scattering kernel that
+     * the material provides
+     */
+    int scat_order() const
+    {
+        return xssc_pn_.size();
+    }
+
+    /**
+     * \brief Return the scattering matrix for Legendre moment \p l of the
+     * scattering kernel
+     *
+     * \p l ranges from 1 to \ref scat_order(); the P0 matrix is \ref xssc().
+     */
+    const ScatteringMatrix &xssc_pn(int l) const
+    {
+        assert((l > 0) && (l <= this->scat_order()));
+        return xssc_pn_[l - 1];
+    }
+
     /**
      * Return whether the material is fissile.
      */
+    /**
+     * \brief Return a copy of the material with all of its cross sections
+     * scaled by \p factor
+     *
+     * This is the material that results from changing the number densities
+     * of all of its constituents by the same factor, as for a change in
+     * coolant density. The fission spectrum is unchanged.
+     */
+    Material scaled(real_t factor) const;
+
     bool is_fissile() const
     {
         bool is_fissile = std::any_of(xsnf_.begin(), xsnf_.end(),
@@ -97,6 +162,8 @@ private:
     ArrayB1 xsf_;
     ArrayB1 xsch_;
     ScatteringMatrix xssc_;
+    // Scattering matrices of the P1 and higher moments
+    std::vector<ScatteringMatrix> xssc_pn_;
     bool is_fissile_;
 };
 }
@@ -36,19 +36,57 @@ using std::regex_match;
 
 namespace mocc {
 
-MaterialLib::MaterialLib()
+MaterialLib::MaterialLib() : state_(0)
 {
     // do nothing
     return;
 }
 
-MaterialLib::MaterialLib(const pugi::xml_node &input) : n_material_(0)
+MaterialLib::MaterialLib(const pugi::xml_node &input)
+    : n_material_(0), state_(0)
 {
     if (input.empty()) {
         throw EXCEPT("No material library specified.");
     }
     std::string matLibName = input.attribute("path").value();
     LogFile << "Using material library at: " << matLibName << std::endl;
+
+    // Binary libraries only need their header up front. The materials are
+    // read as they are assigned IDs below.
+    const std::string h5_ext = ".h5";
+    if ((matLibName.size() > h5_ext.size()) &&
+        (matLibName.compare(matLibName.size() - h5_ext.size(), h5_ext.size(),
+                            h5_ext) == 0)) {
+        try {
+            H5Node h5(matLibName, H5Access::READ);
+            this->read_header(h5);
+        } catch (...) {
+            std::stringstream msg;
+            msg << "Failed to open the cross-section library at: "
+                << matLibName;
+            throw EXCEPT(msg.str());
+        }
+        h5_path_ = matLibName;
+
+        for (auto mat = input.child("material"); mat;
+             mat      = mat.next_sibling("material")) {
+            this->assignID(mat.attribute("id").as_int(),
+                           mat.attribute("name").value());
+        }
+        return;
+    }
+
+    // A batch of cases only parses each text library once
+    if (cache_enabled_ && (cache_.count(matLibName) > 0)) {
+        *this = *cache_.at(matLibName);
+        for (auto mat = input.child("material"); mat;
+             mat      = mat.next_sibling("material")) {
+            this->assignID(mat.attribute("id").as_int(),
+                           mat.attribute("name").value());
+        }
+        return;
+    }
+
     FileScrubber matLibFile;
 
     try {
@@ -65,8 +103,8 @@ MaterialLib::MaterialLib(const pugi::xml_node &input) : n_material_(0)
     // Description
     // Number of groups and number of materials
     {
-        // skip the first line
-        matLibFile.getline();
+        // The first line is a description of the library
+        m_description = matLibFile.getline();
         stringstream inBuf(matLibFile.getline());
         inBuf >> n_grp_;
         if (inBuf.fail()) {
@@ -98,8 +136,12 @@ MaterialLib::MaterialLib(const pugi::xml_node &input) : n_material_(0)
 
         regex headExp("^\\s*XSMACRO\\s+([^\\s]+)\\s+([0-9]+)\\s*$");
         smatch results;
-        regex_match(line, results, headExp);
+        if (!regex_match(line, results, headExp)) {
+            throw EXCEPT("Malformed material header: " + line);
+        }
         string materialName = results[1].str();
+        // Legendre order of the scattering data that follows
+        int n_order = std::stoi(results[2].str());
 
         // Read in the non-scattering stuff
         VecF abs(n_grp_, 0.0);
@@ -129,8 +171,21 @@ MaterialLib::MaterialLib(const pugi::xml_node &input) : n_material_(0)
             scatTable.push_back(scatRow);
         }
 
+        // Read in the tables of the higher scattering moments, P1 first
+        std::vector<std::vector<VecF>> scatPn(n_order);
+        for (auto &table : scatPn) {
+            for (size_t ig = 0; ig < n_grp_; ig++) {
+                VecF scatRow = explode_string<real_t>(matLibFile.getline());
+                if (scatRow.size() != n_grp_) {
+                    throw EXCEPT("Trouble reading Pn scattering row");
+                }
+                table.push_back(scatRow);
+            }
+        }
+
         // produce a Material object and add it to the library
-        lib_materials_.push_back(Material(abs, nuFiss, fiss, chi, scatTable));
+        lib_materials_.push_back(
+            Material(abs, nuFiss, fiss, chi, scatTable, scatPn));
         try {
             material_names_[materialName] = imat;
         } catch (...) {
@@ -139,6 +194,10 @@ MaterialLib::MaterialLib(const pugi::xml_node &input) : n_material_(0)
         }
     }
 
+    if (cache_enabled_) {
+        cache_[matLibName] = std::make_shared<const MaterialLib>(*this);
+    }
+
     // Parse material IDs
     for (auto mat = input.child("material"); mat;
          mat      = mat.next_sibling("material")) {
@@ -148,15 +207,16 @@ MaterialLib::MaterialLib(const pugi::xml_node &input) : n_material_(0)
     return;
 }
 
-MaterialLib::MaterialLib(FileScrubber &input) : n_material_(0)
+MaterialLib::MaterialLib(FileScrubber &input)
+    : n_material_(0), state_(0)
 {
     string line;
     // Read the first three lines to extract the library header
     // Description
     // Number of groups and number of materials
     {
-        // skip the first line
-        input.getline();
+        // The first line is a description of the library
+        m_description = input.getline();
         stringstream inBuf(input.getline());
         inBuf >> n_grp_;
         if (inBuf.fail()) {
@@ -188,8 +248,12 @@ MaterialLib::MaterialLib(FileScrubber &input) : n_material_(0)
 
         regex headExp("^\\s*XSMACRO\\s+([^\\s]+)\\s+([0-9]+)\\s*$");
         smatch results;
-        regex_match(line, results, headExp);
+        if (!regex_match(line, results, headExp)) {
+            throw EXCEPT("Malformed material header: " + line);
+        }
         string materialName = results[1].str();
+        // Legendre order of the scattering data that follows
+        int n_order = std::stoi(results[2].str());
 
         // Read in the non-scattering stuff
         VecF abs;
@@ -226,8 +290,27 @@ MaterialLib::MaterialLib(FileScrubber &input) : n_material_(0)
             scatTable.push_back(scatRow);
         }
 
+        // Read in the tables of the higher scattering moments, P1 first
+        std::vector<std::vector<VecF>> scatPn(n_order);
+        for (auto &table : scatPn) {
+            for (size_t ig = 0; ig < n_grp_; ig++) {
+                stringstream inBuf(input.getline());
+                VecF scatRow;
+                for (size_t igg = 0; igg < n_grp_; igg++) {
+                    double val;
+                    inBuf >> val;
+                    scatRow.push_back(val);
+                }
+                if (inBuf.fail()) {
+                    throw EXCEPT("Trouble reading Pn scattering row");
+                }
+                table.push_back(scatRow);
+            }
+        }
+
         // produce a Material object and add it to the library
-        lib_materials_.push_back(Material(abs, nuFiss, fiss, chi, scatTable));
+        lib_materials_.push_back(
+            Material(abs, nuFiss, fiss, chi, scatTable, scatPn));
         try {
             material_names_[materialName] = imat;
         } catch (...) {
@@ -237,8 +320,24 @@ MaterialLib::MaterialLib(FileScrubber &input) : n_material_(0)
     }
 }
 
+bool MaterialLib::cache_enabled_ = false;
+std::map<std::string, std::shared_ptr<const MaterialLib>> MaterialLib::cache_;
+
+void MaterialLib::enable_cache(bool enable)
+{
+    cache_enabled_ = enable;
+    if (!enable) {
+        cache_.clear();
+    }
+    return;
+}
+
 void MaterialLib::assignID(int id, std::string name)
 {
+    if (!h5_path_.empty() && (material_names_.count(name) == 0)) {
+        this->read_material(name);
+    }
+
     try {
         LogFile << "Mapping material '" << name << "' to ID " << id
                 << std::endl;
@@ -253,4 +352,170 @@ void MaterialLib::assignID(int id, std::string name)
     }
     return;
 }
+
+void MaterialLib::update_material(int id, const Material &mat)
+{
+    if (material_ids_.count(id) == 0) {
+        throw EXCEPT("Unknown material ID: " + std::to_string(id));
+    }
+    if ((unsigned)mat.xsab().size() != n_grp_) {
+        throw EXCEPT("Updated material has the wrong number of groups.");
+    }
+
+    // Only replace the library material in place if no other ID refers to it
+    int mat_index = material_ids_[id];
+    bool shared   = false;
+    for (const auto &id_pair : material_ids_) {
+        if ((id_pair.first != id) && (id_pair.second == mat_index)) {
+            shared = true;
+            break;
+        }
+    }
+    if (shared) {
+        lib_materials_.push_back(mat);
+        material_ids_[id] = lib_materials_.size() - 1;
+    } else {
+        lib_materials_[mat_index] = mat;
+    }
+    assigned_materials_[material_dense_index_[id]] = mat;
+
+    state_++;
+    material_state_[id] = state_;
+    return;
+}
+
+int MaterialLib::compact()
+{
+    // Keep the mapped materials in their current order
+    std::map<int, int> new_index;
+    MaterialVec kept;
+    for (auto &id_index : material_ids_) {
+        auto inserted = new_index.emplace(id_index.second, (int)kept.size());
+        if (inserted.second) {
+            kept.push_back(lib_materials_[id_index.second]);
+        }
+        id_index.second = inserted.first->second;
+    }
+
+    std::map<std::string, int> names;
+    for (const auto &name_index : material_names_) {
+        auto index = new_index.find(name_index.second);
+        if (index != new_index.end()) {
+            names[name_index.first] = index->second;
+        }
+    }
+
+    int n_released = lib_materials_.size() - kept.size();
+    lib_materials_.swap(kept);
+    material_names_.swap(names);
+    return n_released;
+}
+
+void MaterialLib::write(H5Node &node) const
+{
+    node.write("n_group", (int)n_grp_);
+    node.write("n_material", (int)lib_materials_.size());
+    node.write("g_bounds", g_bounds_);
+    node.write("description", m_description);
+
+    auto materials = node.create_group("materials");
+    VecI dims      = {(int)n_grp_, (int)n_grp_};
+    for (const auto &name_index : material_names_) {
+        if (name_index.first.find('/') != std::string::npos) {
+            throw EXCEPT("Material names may not contain '/' in a binary "
+                         "library: " +
+                         name_index.first);
+        }
+        const Material &mat = lib_materials_[name_index.second];
+        auto g              = materials.create_group(name_index.first);
+        g.write("xsab", mat.xsab());
+        g.write("xsnf", mat.xsnf());
+        g.write("xsf", mat.xsf());
+        g.write("xsch", mat.xsch());
+        g.write("xssc", mat.xssc().as_vector(), dims);
+        for (int l = 1; l <= mat.scat_order(); l++) {
+            g.write("xssc_p" + std::to_string(l), mat.xssc_pn(l).as_vector(),
+                    dims);
+        }
+    }
+
+    return;
+}
+
+void MaterialLib::read_header(const H5Node &h5)
+{
+    int n_grp = 0;
+    int n_mat = 0;
+    h5.read("n_group", n_grp);
+    h5.read("n_material", n_mat);
+    h5.read("g_bounds", g_bounds_);
+    if ((n_grp <= 0) || ((int)g_bounds_.size() != n_grp)) {
+        throw EXCEPT("Bad group structure in binary cross-section library");
+    }
+    n_grp_          = n_grp;
+    n_material_lib_ = n_mat;
+
+    // Materials are added as they are read. Make room for all of them now, so
+    // that references to the materials read so far stay valid.
+    lib_materials_.reserve(n_material_lib_);
+
+    return;
+}
+
+void MaterialLib::read_material(const std::string &name)
+{
+    H5Node h5(h5_path_, H5Access::READ);
+
+    std::string path = "materials/" + name;
+    if ((name.find('/') != std::string::npos) || !h5.exists(path)) {
+        throw EXCEPT("Material '" + name +
+                     "' not found in the cross-section library");
+    }
+
+    VecF abs;
+    VecF nuFiss;
+    VecF fiss;
+    VecF chi;
+    VecF scat;
+    h5.read(path + "/xsab", abs);
+    h5.read(path + "/xsnf", nuFiss);
+    h5.read(path + "/xsf", fiss);
+    h5.read(path + "/xsch", chi);
+    h5.read(path + "/xssc", scat);
+
+    if ((abs.size() != n_grp_) || (nuFiss.size() != n_grp_) ||
+        (fiss.size() != n_grp_) || (chi.size() != n_grp_) ||
+        (scat.size() != n_grp_ * n_grp_)) {
+        throw EXCEPT("Trouble reading XS data for material '" + name +
+                     "' from library!");
+    }
+
+    auto unpack = [this](const VecF &dense) {
+        std::vector<VecF> table;
+        for (size_t ig = 0; ig < n_grp_; ig++) {
+            table.emplace_back(dense.begin() + ig * n_grp_,
+                               dense.begin() + (ig + 1) * n_grp_);
+        }
+        return table;
+    };
+
+    // The higher scattering moments, if any, are stored as xssc_p1,
+    // xssc_p2, and so on
+    std::vector<std::vector<VecF>> scatPn;
+    for (int l = 1; h5.exists(path + "/xssc_p" + std::to_string(l)); l++) {
+        VecF scat_l;
+        h5.read(path + "/xssc_p" + std::to_string(l), scat_l);
+        if (scat_l.size() != n_grp_ * n_grp_) {
+            throw EXCEPT("Trouble reading Pn scattering data for material '" +
+                         name + "' from library!");
+        }
+        scatPn.push_back(unpack(scat_l));
+    }
+
+    material_names_[name] = lib_materials_.size();
+    lib_materials_.push_back(
+        Material(abs, nuFiss, fiss, chi, unpack(scat), scatPn));
+
+    return;
+}
 }
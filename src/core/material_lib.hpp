@@ -16,10 +16,12 @@
 
 #pragma once
 #include <map>
+#include <memory>
 #include <string>
 
 #include "util/file_scrubber.hpp"
 #include "util/global_config.hpp"
+#include "util/h5file.hpp"
 #include "util/pugifwd.hpp"
 #include "core/material.hpp"
 
@@ -43,13 +45,42 @@ public:
      */
     MaterialLib(FileScrubber &input);
 
+    /**
+     * Construct a \ref MaterialLib from a \c \<material_lib\> tag. The
+     * library at \c path may either be a text "MPACT user cross-section
+     * library," or a binary library written by \ref write(), identified by an
+     * \c .h5 extension. Materials in a binary library are only read once they
+     * are assigned an ID.
+     */
     MaterialLib(const pugi::xml_node &input);
 
+    /**
+     * \brief Enable or disable the cache of parsed text libraries
+     *
+     * While enabled, each text library is parsed once, the first time it
+     * is used, and later libraries with the same path start from a copy of
+     * it. This is meant for batch runs, where many cases use the same
+     * library; a library parsed before worker processes are forked is
+     * shared by all of them. Disabling the cache frees it.
+     */
+    static void enable_cache(bool enable);
+
     /**
      * Assign an ID to a material in the library.
      */
     void assignID(int id, std::string name);
 
+    /**
+     * \brief Write the whole library to an HDF5 file, which may be used in
+     * place of the text library that it came from.
+     *
+     * The file stores the number of groups and materials, the group bounds,
+     * and a group under \c /materials for each material, named after the
+     * material, containing its absorption, nu-fission, fission and chi
+     * vectors, and its dense scattering matrix.
+     */
+    void write(H5Node &node) const;
+
     /**
      * Return the number of materials in the library
      */
@@ -116,6 +147,45 @@ public:
         return assigned_materials_.cend();
     }
 
+    /**
+     * \brief Replace the cross sections of the material mapped to ID \p id
+     *
+     * Other IDs mapped to the same library material keep the old cross
+     * sections. The XS meshes built from the library pick the new cross
+     * sections up on their next update.
+     */
+    void update_material(int id, const Material &mat);
+
+    /**
+     * \brief Release the library materials that aren't mapped to an ID
+     *
+     * Text libraries are read in full, though most problems only use a few
+     * of their materials. Afterwards, only the mapped materials can be
+     * assigned to further IDs, unless the library is binary, in which case
+     * the others are read again as needed. Returns the number of materials
+     * released.
+     */
+    int compact();
+
+    /**
+     * \brief Return the number of updates made to the library with \ref
+     * update_material()
+     */
+    int state() const
+    {
+        return state_;
+    }
+
+    /**
+     * \brief Return the value of \ref state() just after the material
+     * mapped to ID \p id was last updated, or zero if it never has been
+     */
+    int material_state(int id) const
+    {
+        auto it = material_state_.find(id);
+        return it == material_state_.end() ? 0 : it->second;
+    }
+
     /**
      * \brief Return whether the passed material ID is defined
      */
@@ -125,6 +195,18 @@ public:
     }
 
 private:
+    /**
+     * \brief Read the header of a binary library, without reading any
+     * materials
+     */
+    void read_header(const H5Node &h5);
+
+    /**
+     * \brief Read a material from the binary library, adding it to the
+     * library under its name
+     */
+    void read_material(const std::string &name);
+
     // Vector storing all of the materials in the library.
     MaterialVec lib_materials_;
 
@@ -158,5 +240,18 @@ private:
 
     // Descriptive string for the material library
     std::string m_description;
+
+    // Path to the binary library that materials are read from as they are
+    // needed. Empty for text libraries, which are read up front.
+    std::string h5_path_;
+
+    // Number of material updates, and the state just after each updated
+    // material ID was last updated
+    int state_;
+    std::map<int, int> material_state_;
+
+    // Parsed text libraries by path, before any IDs are assigned
+    static bool cache_enabled_;
+    static std::map<std::string, std::shared_ptr<const MaterialLib>> cache_;
 };
 }
@@ -92,11 +92,13 @@ void Mesh::prepare_surfaces()
     // number of y-normal surfaces in each x column
     int nysurf = ny_ + 1;
     // number of x- and y-normal surfaces in each plane
-    int nxysurf     = (nx_ + 1) * ny_ + (ny_ + 1) * nx_;
-    int i           = 0;
-    coarse_surf_    = VecI(6 * nx_ * ny_ * nz_, 0);
-    int surf_offset = 0;
+    int nxysurf  = (nx_ + 1) * ny_ + (ny_ + 1) * nx_;
+    coarse_surf_ = VecI(6 * nx_ * ny_ * nz_, 0);
+    // Each plane of cells is independent of the others
+#pragma omp parallel for schedule(static)
     for (int iz = 0; iz < nz_; iz++) {
+        int i           = iz * nx_ * ny_;
+        int surf_offset = iz * (nxysurf + nx_ * ny_);
         for (int iy = 0; iy < ny_; iy++) {
             for (int ix = 0; ix < nx_; ix++) {
                 Surface surf;
@@ -130,7 +132,6 @@ void Mesh::prepare_surfaces()
                 i++;
             }
         }
-        surf_offset += nxysurf + nx_ * ny_;
     }
     return;
 }
@@ -15,35 +15,277 @@
 */
 
 #include "parallel_environment.hpp"
+#include <algorithm>
+#include <cassert>
+#include <fstream>
 #include <omp.h>
+#include <tuple>
+#include <vector>
+#ifdef __linux__
+#include <sched.h>
+#endif
+#ifdef MOCC_USE_MPI
+#include <mpi.h>
+#endif
 #include "pugixml.hpp"
+#include "util/aligned_allocator.hpp"
 #include "util/error.hpp"
+#include "util/perf_counters.hpp"
+#include "util/string_utils.hpp"
+
+namespace {
+struct CPU {
+    int id;
+    int package;
+    int core;
+    // Index of this CPU among the hardware threads of its core
+    int smt;
+    // Index of this CPU among those of its package with the same smt
+    int slot;
+};
+
+#ifdef __linux__
+int read_topology(int cpu, const char *what)
+{
+    std::ifstream f("/sys/devices/system/cpu/cpu" + std::to_string(cpu) +
+                    "/topology/" + what);
+    int val = 0;
+    if (!(f >> val)) {
+        return 0;
+    }
+    return val;
+}
+
+/**
+ * Return the CPUs that the process is allowed to run on, with their
+ * topology. This is the mask at the time of the first call, before any of
+ * the threads are bound.
+ */
+std::vector<CPU> allowed_cpus()
+{
+    std::vector<CPU> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+        return cpus;
+    }
+    for (int i = 0; i < CPU_SETSIZE; i++) {
+        if (CPU_ISSET(i, &set)) {
+            CPU cpu = {i, read_topology(i, "physical_package_id"),
+                       read_topology(i, "core_id"), 0, 0};
+            for (const auto &other : cpus) {
+                if ((other.package == cpu.package) &&
+                    (other.core == cpu.core)) {
+                    cpu.smt++;
+                }
+            }
+            for (const auto &other : cpus) {
+                if ((other.package == cpu.package) && (other.smt == cpu.smt)) {
+                    cpu.slot++;
+                }
+            }
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+#endif
+}
 
 namespace mocc {
 ParallelEnvironment::ParallelEnvironment(const pugi::xml_node &input)
-    : num_threads_(1)
+    : num_threads_(1), rank_(0), n_rank_(1), affinity_("none")
 {
+    phase_threads_.fill(0);
+
+#ifdef MOCC_USE_MPI
+    int initialized = 0;
+    MPI_Initialized(&initialized);
+    if (initialized) {
+        MPI_Comm_rank(MPI_COMM_WORLD, &rank_);
+        MPI_Comm_size(MPI_COMM_WORLD, &n_rank_);
+    }
+#endif
+
     if (!input.empty()) {
-        num_threads_ =
-            input.attribute("num_threads").as_int(0);
+        if (!input.attribute("num_threads").empty()) {
+            num_threads_ = input.attribute("num_threads").as_int(0);
+
+            if (num_threads_ < 1) {
+                throw EXCEPT(
+                    "Less than one thread specified in <parallel> "
+                    "tag");
+            }
+
+            if (num_threads_ > omp_get_num_procs()) {
+                Warn(
+                    "More threads specified than physical "
+                    "threads on this machine in <parallel> tag");
+            }
+
+            // Okay. Looking good. Tell OpenMP whats up
+            omp_set_num_threads(num_threads_);
+        } else {
+            num_threads_ = omp_get_max_threads();
+        }
+
+        // A process sharing the machine with other jobs keeps to its share
+        if ((max_threads_ > 0) && (num_threads_ > max_threads_)) {
+            num_threads_ = max_threads_;
+            omp_set_num_threads(num_threads_);
+        }
+
+        // Per-phase thread counts
+        const char *phase_attr[] = {"sweep_threads", "source_threads",
+                                    "cmfd_threads", "projection_threads"};
+        for (int i = 0; i < (int)Phase::N_PHASE; i++) {
+            if (input.attribute(phase_attr[i]).empty()) {
+                continue;
+            }
+            int n = input.attribute(phase_attr[i]).as_int(0);
+            if (max_threads_ > 0) {
+                n = std::min(n, num_threads_);
+            }
+            if ((n < 1) || (n > num_threads_)) {
+                throw EXCEPT(std::string("Invalid ") + phase_attr[i] +
+                             " in <parallel> tag. Must be from 1 to "
+                             "num_threads.");
+            }
+            phase_threads_[i] = n;
+        }
+
+        // Back the large sweeper arrays with transparent huge pages
+        set_huge_pages(input.attribute("huge_pages").as_bool(false));
+
+        if (!input.attribute("affinity").empty()) {
+            affinity_ = input.attribute("affinity").value();
+            sanitize(affinity_);
+            if ((affinity_ != "none") && (affinity_ != "compact") &&
+                (affinity_ != "scatter")) {
+                throw EXCEPT("Unrecognized thread affinity: " + affinity_);
+            }
+        }
+        this->bind_threads();
+
+        // Count hardware events on the threads, once they are where they
+        // are going to stay
+        if (input.attribute("perf_counters").as_bool(false) &&
+            !perf::enable()) {
+            Warn("Hardware performance counters are not available");
+        }
+    }
+    return;
+}
+
+void ParallelEnvironment::bind_threads() const
+{
+    if (affinity_ == "none") {
+        return;
+    }
 
-        if (num_threads_ < 1) {
-            throw EXCEPT(
-                "Less than one thread specified in <parallel> "
-                "tag");
+#ifdef __linux__
+    static const std::vector<CPU> allowed = allowed_cpus();
+    if (allowed.empty()) {
+        Warn("Failed to determine the available CPUs. Threads not bound.");
+        return;
+    }
+
+    // Order the CPUs in which to place the threads. Either way, each core
+    // gets a thread before any core gets a second one.
+    std::vector<CPU> cpus = allowed;
+    bool scatter          = affinity_ == "scatter";
+    std::sort(cpus.begin(), cpus.end(), [scatter](const CPU &a, const CPU &b) {
+        if (scatter) {
+            return std::tie(a.smt, a.slot, a.package, a.id) <
+                   std::tie(b.smt, b.slot, b.package, b.id);
         }
+        return std::tie(a.smt, a.package, a.slot, a.id) <
+               std::tie(b.smt, b.package, b.slot, b.id);
+    });
+
+    bool ok = true;
+#pragma omp parallel reduction(&& : ok)
+    {
+        int cpu = cpus[omp_get_thread_num() % cpus.size()].id;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        ok = sched_setaffinity(0, sizeof(set), &set) == 0;
+    }
+    if (!ok) {
+        Warn("Failed to bind threads to CPUs");
+    }
+#else
+    Warn("Thread affinity is only supported on Linux. Threads not bound.");
+#endif
+    return;
+}
 
-        if (num_threads_ > omp_get_num_procs()) {
-            Warn(
-                "More threads specified than physical "
-                "threads on this machine in <parallel> tag");
+void ParallelEnvironment::partition(int n_jobs, int job)
+{
+    assert((job >= 0) && (job < n_jobs));
+
+    int n_threads = std::max(1, omp_get_num_procs() / n_jobs);
+#ifdef __linux__
+    // Keep the hardware threads of each core next to each other, and the
+    // cores of each package together
+    std::vector<CPU> cpus = allowed_cpus();
+    std::sort(cpus.begin(), cpus.end(), [](const CPU &a, const CPU &b) {
+        return std::tie(a.package, a.slot, a.smt, a.id) <
+               std::tie(b.package, b.slot, b.smt, b.id);
+    });
+    std::vector<std::vector<int>> cores;
+    for (unsigned i = 0; i < cpus.size(); i++) {
+        if ((i == 0) || (cpus[i].package != cpus[i - 1].package) ||
+            (cpus[i].slot != cpus[i - 1].slot)) {
+            cores.emplace_back();
         }
+        cores.back().push_back(cpus[i].id);
+    }
+
+    if ((int)cores.size() >= n_jobs) {
+        // Spread the remainder over the first few jobs
+        int n_core = cores.size() / n_jobs;
+        int extra  = cores.size() % n_jobs;
+        int first  = job * n_core + std::min(job, extra);
+        int last   = first + n_core + (job < extra ? 1 : 0);
 
-        // Okay. Looking good. Tell OpenMP whats up
-        omp_set_num_threads(num_threads_);
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        n_threads = 0;
+        for (int icore = first; icore < last; icore++) {
+            for (int cpu : cores[icore]) {
+                CPU_SET(cpu, &set);
+                n_threads++;
+            }
+        }
+        if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+            Warn("Failed to confine the job to its CPUs");
+        }
+    } else if (!cores.empty()) {
+        Warn("More jobs than cores. The jobs share the CPUs.");
     }
+#endif
+
+    max_threads_ = n_threads;
+    omp_set_num_threads(n_threads);
+    ParEnv.set_num_threads(n_threads);
     return;
 }
 
+void ParallelEnvironment::sum(real_t *data, int n) const
+{
+#ifdef MOCC_USE_MPI
+    if (n_rank_ > 1) {
+        MPI_Datatype type =
+            (sizeof(real_t) == sizeof(float)) ? MPI_FLOAT : MPI_DOUBLE;
+        MPI_Allreduce(MPI_IN_PLACE, data, n, type, MPI_SUM, MPI_COMM_WORLD);
+    }
+#endif
+    return;
+}
+
+int ParallelEnvironment::max_threads_ = 0;
+
 ParallelEnvironment ParEnv;
 }
@@ -16,18 +16,45 @@
 
 #pragma once
 
+#include <array>
+#include <string>
+#include "util/global_config.hpp"
+#include "util/omp_guard.h"
 #include "util/pugifwd.hpp"
 
 namespace mocc {
+/**
+ * \brief Phases of the calculation that may run with their own number of
+ * threads
+ */
+enum class Phase {
+    // Transport sweeps
+    SWEEP,
+    // Construction of the fission and scattering sources
+    SOURCE,
+    // CMFD solves
+    CMFD,
+    // Projection of the flux and cross sections between the transport and
+    // coarse meshes
+    PROJECTION,
+    N_PHASE
+};
+
 /**
  * \brief Small class for storing information about the parallel environment
  * in which the code is running.
  *
  * There should be a global instance of this class, initialized somewhere
- * like \ref InputProc or similar. For now, since we only do threading this
- * class is not much more useful than a global integer storing the number of
- * threads available. As we get more complicated or add MPI, this will
- * become more useful.
+ * like \ref InputProc or similar. It stores the number of threads available,
+ * and, when built with MPI support (\c MOCC_USE_MPI), the rank of this
+ * process and the number of processes in \c MPI_COMM_WORLD. Without MPI these
+ * are always 0 and 1, respectively.
+ *
+ * Each \ref Phase may be given its own number of threads, up to the total,
+ * for parts of the calculation that don't scale to the whole machine.
+ *
+ * It may also pin the OpenMP threads to CPUs, which keeps the memory that
+ * each thread first touches on its own NUMA node for the rest of the run.
  *
  * Really, this should be a singleton class, but I have better things to do
  * than make sure I handle all the nasty corner cases that that would
@@ -36,10 +63,21 @@ namespace mocc {
 class ParallelEnvironment {
 private:
     int num_threads_;
+    int rank_;
+    int n_rank_;
+    // Thread affinity policy: "none", "compact" or "scatter"
+    std::string affinity_;
+    // Number of threads for each phase. Zero to use num_threads_.
+    std::array<int, (int)Phase::N_PHASE> phase_threads_;
+    // Most threads that this process may use. Zero for no limit. See \ref
+    // partition().
+    static int max_threads_;
 
 public:
-    ParallelEnvironment() : num_threads_(1)
+    ParallelEnvironment()
+        : num_threads_(1), rank_(0), n_rank_(1), affinity_("none")
     {
+        phase_threads_.fill(0);
         return;
     }
 
@@ -54,8 +92,123 @@ public:
     {
         num_threads_ = num_threads;
     }
+
+    /**
+     * \brief Return whether the given phase has its own number of threads
+     */
+    bool has_threads(Phase phase) const
+    {
+        return phase_threads_[(int)phase] > 0;
+    }
+
+    /**
+     * \brief Return the number of threads to use for the given phase
+     */
+    int num_threads(Phase phase) const
+    {
+        return this->has_threads(phase) ? phase_threads_[(int)phase]
+                                        : num_threads_;
+    }
+
+    /**
+     * \brief Return the thread affinity policy
+     */
+    const std::string &affinity() const
+    {
+        return affinity_;
+    }
+
+    /**
+     * \brief Pin the threads of a parallel region of the current size to
+     * CPUs, according to the affinity policy
+     *
+     * With the "compact" policy, threads are placed on consecutive physical
+     * cores, filling one socket before moving on to the next. With
+     * "scatter", consecutive threads alternate between sockets. Hardware
+     * threads sharing a core are only used once every core has a thread.
+     * This does nothing for the "none" policy, or on platforms other than
+     * Linux.
+     *
+     * This is called on construction. Threads created later by the OpenMP
+     * runtime inherit the binding of the master thread, so this must be
+     * called again if a larger team is used.
+     */
+    void bind_threads() const;
+
+    /**
+     * \brief Confine this process to its share of the CPUs, so that \p
+     * n_jobs processes may run cases side by side
+     *
+     * The physical cores available to the process are split into \p n_jobs
+     * contiguous blocks, keeping the cores of a socket together, and the
+     * process is restricted to the hardware threads of block \p job. It
+     * then runs with one thread for each of them, and any \ref
+     * ParallelEnvironment made later, as from a \c \<parallel\> tag, is
+     * limited to that many threads.
+     */
+    static void partition(int n_jobs, int job);
+
+    int rank() const
+    {
+        return rank_;
+    }
+
+    int n_rank() const
+    {
+        return n_rank_;
+    }
+
+    bool is_root() const
+    {
+        return rank_ == 0;
+    }
+
+    /**
+     * \brief Sum an array over all of the processes, leaving the result on
+     * every one of them
+     *
+     * This is collective over \c MPI_COMM_WORLD, and does nothing with a
+     * single process.
+     */
+    void sum(real_t *data, int n) const;
 };
 
 // Declare the global instance of ParallelEnvironment
 extern ParallelEnvironment ParEnv;
+
+/**
+ * \brief Scope guard that sets the OpenMP thread count for a \ref Phase
+ *
+ * Parallel regions started in the scope of a \ref ThreadTeam use the
+ * number of threads given for the phase in \ref ParEnv, if it has one. The
+ * previous count is restored when the guard is destroyed, so phases may be
+ * nested.
+ */
+class ThreadTeam {
+public:
+    ThreadTeam(Phase phase) : prev_(omp_get_max_threads())
+    {
+        if (ParEnv.has_threads(phase)) {
+            int n = ParEnv.num_threads(phase);
+            if (n != prev_) {
+                omp_set_num_threads(n);
+            }
+        }
+        return;
+    }
+
+    ~ThreadTeam()
+    {
+        if (omp_get_max_threads() != prev_) {
+            omp_set_num_threads(prev_);
+        }
+        return;
+    }
+
+    ThreadTeam(const ThreadTeam &) = delete;
+    ThreadTeam &operator=(const ThreadTeam &) = delete;
+
+private:
+    int prev_;
+};
 }
@@ -0,0 +1,165 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifdef MOCC_USE_PETSC
+
+#include "petsc_linear_solver.hpp"
+
+#include <algorithm>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "util/error.hpp"
+
+namespace {
+static_assert(std::is_same<PetscScalar, mocc::real_t>::value,
+              "PETSc must be built with real scalars of the same precision as "
+              "MOCC");
+
+void check(PetscErrorCode ierr)
+{
+    if (ierr) {
+        const char *message = nullptr;
+        PetscErrorMessage(ierr, &message, nullptr);
+        throw EXCEPT(std::string("PETSc error: ") +
+                     (message ? message : "unknown"));
+    }
+}
+}
+
+namespace mocc {
+PETScLinearSolver::PETScLinearSolver(const pugi::xml_node &input, int n_group)
+    : n_(0), m_(n_group, nullptr), ksp_(n_group, nullptr), b_(nullptr),
+      x_(nullptr)
+{
+    // PETSc is left initialized until the end of the run, since other
+    // solvers may come and go in the meantime
+    PetscBool initialized = PETSC_FALSE;
+    check(PetscInitialized(&initialized));
+    if (!initialized) {
+        check(PetscInitializeNoArguments());
+    }
+
+    if (!input.attribute("petsc_options").empty()) {
+        check(PetscOptionsInsertString(
+            nullptr, input.attribute("petsc_options").value()));
+    }
+
+    std::string ksp_type = input.attribute("ksp_type").empty()
+                               ? "bcgs"
+                               : input.attribute("ksp_type").value();
+#ifdef PETSC_HAVE_HYPRE
+    std::string pc_type = "hypre";
+#else
+    std::string pc_type = "ilu";
+#endif
+    if (!input.attribute("pc_type").empty()) {
+        pc_type = input.attribute("pc_type").value();
+    }
+
+    for (auto &ksp : ksp_) {
+        check(KSPCreate(PETSC_COMM_SELF, &ksp));
+        check(KSPSetType(ksp, ksp_type.c_str()));
+        check(KSPSetInitialGuessNonzero(ksp, PETSC_TRUE));
+        PC pc;
+        check(KSPGetPC(ksp, &pc));
+        check(PCSetType(pc, pc_type.c_str()));
+#ifdef PETSC_HAVE_HYPRE
+        if (pc_type == "hypre") {
+            check(PCHYPRESetType(pc, "boomeramg"));
+        }
+#endif
+        check(KSPSetOptionsPrefix(ksp, "cmfd_"));
+        check(KSPSetFromOptions(ksp));
+    }
+
+    return;
+}
+
+PETScLinearSolver::~PETScLinearSolver()
+{
+    for (auto &ksp : ksp_) {
+        KSPDestroy(&ksp);
+    }
+    for (auto &m : m_) {
+        MatDestroy(&m);
+    }
+    VecDestroy(&b_);
+    VecDestroy(&x_);
+    return;
+}
+
+void PETScLinearSolver::update(int group, const Matrix_t &m, bool refactor)
+{
+    Mat &mat = m_[group];
+    if (!mat) {
+        n_ = m.rows();
+        std::vector<PetscInt> nnz(n_);
+        for (int i = 0; i < n_; i++) {
+            nnz[i] = m.outerIndexPtr()[i + 1] - m.outerIndexPtr()[i];
+        }
+        check(MatCreateSeqAIJ(PETSC_COMM_SELF, n_, n_, 0, nnz.data(), &mat));
+        check(KSPSetOperators(ksp_[group], mat, mat));
+        if (!b_) {
+            check(VecCreateSeq(PETSC_COMM_SELF, n_, &b_));
+            check(VecDuplicate(b_, &x_));
+        }
+        refactor = true;
+    }
+
+    std::vector<PetscInt> cols;
+    for (PetscInt i = 0; i < n_; i++) {
+        int start = m.outerIndexPtr()[i];
+        int n_col = m.outerIndexPtr()[i + 1] - start;
+        cols.assign(m.innerIndexPtr() + start,
+                    m.innerIndexPtr() + start + n_col);
+        check(MatSetValues(mat, 1, &i, n_col, cols.data(),
+                           m.valuePtr() + start, INSERT_VALUES));
+    }
+    check(MatAssemblyBegin(mat, MAT_FINAL_ASSEMBLY));
+    check(MatAssemblyEnd(mat, MAT_FINAL_ASSEMBLY));
+
+    check(KSPSetReusePreconditioner(ksp_[group],
+                                    refactor ? PETSC_FALSE : PETSC_TRUE));
+    return;
+}
+
+int PETScLinearSolver::solve(int group, const VectorX &b, VectorX &x,
+                             real_t tol, int max_iter)
+{
+    PetscScalar *v;
+    check(VecGetArray(b_, &v));
+    std::copy(b.data(), b.data() + n_, v);
+    check(VecRestoreArray(b_, &v));
+    check(VecGetArray(x_, &v));
+    std::copy(x.data(), x.data() + n_, v);
+    check(VecRestoreArray(x_, &v));
+
+    KSP ksp = ksp_[group];
+    check(KSPSetTolerances(ksp, tol, PETSC_DEFAULT, PETSC_DEFAULT, max_iter));
+    check(KSPSolve(ksp, b_, x_));
+
+    check(VecGetArray(x_, &v));
+    std::copy(v, v + n_, x.data());
+    check(VecRestoreArray(x_, &v));
+
+    PetscInt iter = 0;
+    check(KSPGetIterationNumber(ksp, &iter));
+    return iter;
+}
+}
+
+#endif
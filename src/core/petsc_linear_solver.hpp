@@ -0,0 +1,62 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#ifdef MOCC_USE_PETSC
+
+#include <vector>
+
+#include <petscksp.h>
+
+#include "pugixml.hpp"
+#include "util/global_config.hpp"
+#include "cmfd_linear_solver.hpp"
+
+namespace mocc {
+/**
+ * \brief CMFD linear solver backend using a PETSc KSP for each group
+ *
+ * The Krylov method and preconditioner are set by the \c ksp_type (default
+ * \c "bcgs") and \c pc_type (default \c "hypre", with BoomerAMG, if PETSc was
+ * built with Hypre, otherwise \c "ilu") attributes of the \<cmfd\> tag. Any
+ * other PETSc options may be given in the \c petsc_options attribute, as on
+ * the PETSc command line, with the \c cmfd_ prefix (e.g.
+ * <tt>-cmfd_pc_hypre_boomeramg_strong_threshold 0.5</tt>).
+ *
+ * The systems are solved serially on each process, like the rest of CMFD.
+ */
+class PETScLinearSolver : public CMFDLinearSolver {
+public:
+    PETScLinearSolver(const pugi::xml_node &input, int n_group);
+
+    ~PETScLinearSolver();
+
+    void update(int group, const Matrix_t &m, bool refactor) override;
+
+    int solve(int group, const VectorX &b, VectorX &x, real_t tol,
+              int max_iter) override;
+
+private:
+    int n_;
+    std::vector<Mat> m_;
+    std::vector<KSP> ksp_;
+    Vec b_;
+    Vec x_;
+};
+}
+
+#endif
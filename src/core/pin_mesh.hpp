@@ -49,4 +49,31 @@ PinMesh *PinMeshFactory(const pugi::xml_node &input);
  * within.
  */
 PinMesh_Map_t ParsePinMeshes(const pugi::xml_node &input);
+
+/**
+ * \brief Call \p f with \p pm cast to its concrete type
+ *
+ * \param pm the \ref PinMesh to dispatch on
+ * \param f a callable, typically a generic lambda, accepting any of the
+ * concrete \ref PinMesh types, or the \ref PinMesh itself
+ *
+ * This provides a closed, switch-based dispatch over the \ref PinMesh types
+ * listed in \ref PinMeshType. Calls made through the concrete type inside of
+ * \p f are resolved statically, so that the hot geometry loops in the ray
+ * tracing and Monte Carlo code don't pay for a virtual call at every pin
+ * mesh lookup. Types tagged \c OTHER are passed to \p f as a plain \ref
+ * PinMesh, falling back to the virtual interface.
+ */
+template <class Function>
+auto visit(const PinMesh &pm, Function &&f) -> decltype(f(pm))
+{
+    switch (pm.type()) {
+    case PinMeshType::RECT:
+        return f(static_cast<const PinMesh_Rect &>(pm));
+    case PinMeshType::CYL:
+        return f(static_cast<const PinMesh_Cyl &>(pm));
+    default:
+        return f(pm);
+    }
+}
 }
@@ -18,10 +18,14 @@
 
 #include "pugixml.hpp"
 #include "util/error.hpp"
+#include "util/fp_utils.hpp"
 
 namespace mocc {
 PinMesh::PinMesh(const pugi::xml_node &input)
 {
+    // Derived types that support static dispatch overwrite this
+    type_ = PinMeshType::OTHER;
+
     // Extract pin id
     id_ = input.attribute("id").as_int(-1);
 
@@ -55,4 +59,20 @@ void PinMesh::print(std::ostream &os) const
     os << "# of XS Regions: " << n_xsreg_;
     return;
 }
+
+bool PinMesh::geometrically_equivalent(const PinMesh &other) const
+{
+    if ((this == &other) || (id_ == other.id_)) {
+        return true;
+    }
+    if ((type_ != other.type_) || (n_reg_ != other.n_reg_) ||
+        (n_xsreg_ != other.n_xsreg_)) {
+        return false;
+    }
+    if (!fp_equiv_ulp(pitch_x_, other.pitch_x_) ||
+        !fp_equiv_ulp(pitch_y_, other.pitch_y_)) {
+        return false;
+    }
+    return this->same_geometry(other);
+}
 }
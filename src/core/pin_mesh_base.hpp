@@ -17,6 +17,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 #include "util/global_config.hpp"
 #include "util/pugifwd.hpp"
@@ -24,6 +25,15 @@
 #include "position.hpp"
 
 namespace mocc {
+/**
+ * \brief Concrete type of a \ref PinMesh, used by \ref visit() to dispatch
+ * to the concrete type without a virtual call.
+ *
+ * Types that are not listed here are tagged as \c OTHER, and are only
+ * reachable through the virtual interface.
+ */
+enum class PinMeshType { RECT, CYL, OTHER };
+
 /**
  * \ref PinMesh is a virtual class, which provides methods for performing
  * ray tracing and accessing data in common between all types of pin mesh,
@@ -42,6 +52,14 @@ public:
         return id_;
     }
 
+    /**
+     * \brief Return the concrete type of the \ref PinMesh
+     */
+    PinMeshType type() const
+    {
+        return type_;
+    }
+
     int n_reg() const
     {
         return n_reg_;
@@ -125,6 +143,26 @@ public:
      */
     virtual int find_reg(Point2 p, Direction dir) const = 0;
 
+    /**
+     * \brief Find the pin-local region indices of a batch of points
+     *
+     * \param[in] n the number of points
+     * \param[in] p the \ref Point2 s to look up, in pin-local coordinates
+     * \param[out] reg the region index of each point
+     *
+     * This is equivalent to calling find_reg(Point2) for each point, but
+     * only makes one virtual call for the whole batch. The derived types
+     * override it with a loop over their own lookup, which the compiler is
+     * then free to inline.
+     */
+    virtual void find_reg(int n, const Point2 *p, int *reg) const
+    {
+        for (int i = 0; i < n; i++) {
+            reg[i] = this->find_reg(p[i]);
+        }
+        return;
+    }
+
     /**
      * Return the number of flat source regions corresponding to an XS
      * region (indexed pin-locally).
@@ -163,10 +201,14 @@ public:
     }
 
     /**
-     * \brief Return a string containing PyCairo commands to draw the \ref
-     * PinMesh.
+     * \brief Return the outline of each region of the mesh as a polygon
+     *
+     * The vertices are in pin-local coordinates, in counter-clockwise order,
+     * and the regions are in the same order as \ref find_reg(). Curved
+     * boundaries are approximated by \p n_arc straight segments per full
+     * circle.
      */
-    virtual std::string draw() const = 0;
+    virtual std::vector<std::vector<Point2>> polygons(int n_arc) const = 0;
 
     /**
      * \brief Provide stream insertion support.
@@ -176,8 +218,31 @@ public:
      */
     friend std::ostream &operator<<(std::ostream &os, const PinMesh &pm);
 
+    /**
+     * \brief Return whether another \ref PinMesh divides the pin into the
+     * same regions
+     *
+     * This is true for the same mesh, and for meshes of the same type and
+     * dimensions that only differ in their IDs.
+     */
+    bool geometrically_equivalent(const PinMesh &other) const;
+
 protected:
+    /**
+     * \brief Compare the parts of the geometry that are specific to the
+     * concrete type
+     *
+     * This is only called once the type, pitch and number of regions are
+     * known to match. Types that don't override it are only ever equivalent
+     * to themselves.
+     */
+    virtual bool same_geometry(const PinMesh &other) const
+    {
+        return false;
+    }
+
     int id_;
+    PinMeshType type_;
     int n_reg_;
     int n_xsreg_;
     real_t pitch_x_;
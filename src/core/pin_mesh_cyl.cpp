@@ -24,6 +24,7 @@
 #include <string>
 #include "pugixml.hpp"
 #include "util/error.hpp"
+#include "util/fp_utils.hpp"
 #include "util/files.hpp"
 #include "util/global_config.hpp"
 #include "util/string_utils.hpp"
@@ -35,6 +36,8 @@ using std::stringstream;
 namespace mocc {
 PinMesh_Cyl::PinMesh_Cyl(const pugi::xml_node &input) : PinMesh(input)
 {
+    type_ = PinMeshType::CYL;
+
     // Extract the radii and check for sanity
     {
         stringstream radiiIn(input.child("radii").child_value());
@@ -131,6 +134,7 @@ PinMesh_Cyl::PinMesh_Cyl(const pugi::xml_node &input) : PinMesh(input)
     Point2 origin(0.0, 0.0);
     for (auto ri = radii_.begin(); ri != radii_.end(); ++ri) {
         circles_.push_back(Circle(origin, *ri));
+        radii_sq_.push_back((*ri) * (*ri));
     }
 
     // Construct Line objects corresponding to each azimuthal subdivision
@@ -139,6 +143,7 @@ PinMesh_Cyl::PinMesh_Cyl(const pugi::xml_node &input) : PinMesh(input)
     int n_azi        = sub_azi_[0];
     Box pin_box(Point2(-h_pitch_x, -h_pitch_y), Point2(h_pitch_x, h_pitch_y));
     real_t ang_sep = TWOPI / n_azi;
+    oct_per_azi_   = (8 % n_azi == 0) ? 8 / n_azi : 0;
     for (int iazi = 0; iazi < n_azi; iazi++) {
         Angle ang(iazi * ang_sep, HPI, 0.0);
         // Point at which the azimuthal subdivision intersects the bounding
@@ -210,12 +215,49 @@ int PinMesh_Cyl::trace(Point2 p1, Point2 p2, int first_reg, VecF &s,
     ps.erase(std::unique(ps.begin(), ps.end()), ps.end());
 
     // Determine segment lengths and region indices
-    for (unsigned int ip = 1; ip < ps.size(); ip++) {
+    int nseg = ps.size() - 1;
+    std::vector<Point2> mid;
+    mid.reserve(nseg);
+    for (int ip = 1; ip <= nseg; ip++) {
         s.push_back(ps[ip].distance(ps[ip - 1]));
-        unsigned int local_reg = this->find_reg(Midpoint(ps[ip], ps[ip - 1]));
-        reg.push_back(local_reg + first_reg);
+        mid.push_back(Midpoint(ps[ip], ps[ip - 1]));
+    }
+    int stt = reg.size();
+    reg.resize(stt + nseg);
+    this->find_reg(nseg, mid.data(), &reg[stt]);
+    for (int ip = 0; ip < nseg; ip++) {
+        reg[stt + ip] += first_reg;
     }
-    return ps.size() - 1;
+    return nseg;
+}
+
+/**
+ * When the azimuthal subdivisions line up with the octants (2, 4 or 8 of
+ * them), the subdivision is found by comparing the coordinates against each
+ * other, rather than by computing the angle of the point.
+ */
+int PinMesh_Cyl::find_azi(Point2 p) const
+{
+    if (oct_per_azi_ == 0) {
+        return p.alpha() / (TWOPI / sub_azi_[0]);
+    }
+
+    // Octant of the point, counting counter-clockwise from the positive x
+    // axis. Each octant includes its clockwise-most edge.
+    real_t x = p.x;
+    real_t y = p.y;
+    int oct  = 0;
+    if ((x > 0.0) && (y >= 0.0)) {
+        oct = (y < x) ? 0 : 1;
+    } else if ((x <= 0.0) && (y > 0.0)) {
+        oct = (-x < y) ? 2 : 3;
+    } else if ((x < 0.0) && (y <= 0.0)) {
+        oct = (-y < -x) ? 4 : 5;
+    } else if ((x >= 0.0) && (y < 0.0)) {
+        oct = (x < -y) ? 6 : 7;
+    }
+
+    return oct / oct_per_azi_;
 }
 
 /**
@@ -231,30 +273,27 @@ int PinMesh_Cyl::find_reg(Point2 p) const
         return -1;
     }
 
-    // Find the radial division of the point
-    real_t r        = sqrt(p.x * p.x + p.y * p.y);
-    unsigned int ir = 0;
-    for (ir = 0; ir < radii_.size(); ir++) {
-        if (r < radii_[ir]) {
-            break;
-        }
-    }
-
-    // This is only a little tricky; if the loop above runs through it means
-    // that the point is outside the largest ring, and therefore in the
-    // annular region outside the pin. Conveniently, ir will be the proper
-    // index corresponding to that region, so we can go ahead and use it.
+    // Find the radial division of the point. If the point is outside the
+    // largest ring, this is the index of the annular region outside the pin.
+    int ir = this->find_ring(p);
 
     // Find the azimuthal subdivision that the point is in.
-    real_t azi = p.alpha();
-    int ia     = azi / (TWOPI / sub_azi_[0]);
-    int ireg   = ir * sub_azi_[0] + ia;
+    int ia   = this->find_azi(p);
+    int ireg = ir * sub_azi_[0] + ia;
 
     assert((0 <= ireg) && (ireg < n_reg_));
 
     return ireg;
 }
 
+void PinMesh_Cyl::find_reg(int n, const Point2 *p, int *reg) const
+{
+    for (int i = 0; i < n; i++) {
+        reg[i] = PinMesh_Cyl::find_reg(p[i]);
+    }
+    return;
+}
+
 int PinMesh_Cyl::find_reg(Point2 p, Direction dir) const
 {
     // Test that the point is inside the pin mesh
@@ -327,7 +366,15 @@ PinMesh_Cyl::distance_to_surface(Point2 p, Direction dir, int &coincident) const
 
     ret.second = false;
 
-    for (const auto &c : circles_) {
+    // Only the rings and azimuthal lines bounding the region containing the
+    // point can be hit first. The search window is widened by one on either
+    // side, in case a point lying on a surface was located in the region on
+    // its other side.
+    int n_ring = circles_.size();
+    int ir     = this->find_ring(p);
+    for (int ic = std::max(0, ir - 2); ic <= std::min(n_ring - 1, ir + 1);
+         ic++) {
+        const auto &c = circles_[ic];
         real_t d = c.distance_to_surface(p, dir, (coincident == c.surf_id));
         if ((d < dist)) {
             coinc = c.surf_id;
@@ -335,7 +382,11 @@ PinMesh_Cyl::distance_to_surface(Point2 p, Direction dir, int &coincident) const
         }
     }
 
-    for (const auto &l : lines_) {
+    int n_azi  = sub_azi_[0];
+    int ia     = this->find_azi(p);
+    int n_line = std::min(4, n_azi);
+    for (int i = 0; i < n_line; i++) {
+        const auto &l = lines_[(ia - 1 + i + n_azi) % n_azi];
         real_t d = l.distance_to_surface(p, dir, (coincident == l.surf_id));
         if ((d < dist)) {
             coinc = l.surf_id;
@@ -362,23 +413,79 @@ void PinMesh_Cyl::print(std::ostream &os) const
     return;
 }
 
-std::string PinMesh_Cyl::draw() const
+std::vector<std::vector<Point2>> PinMesh_Cyl::polygons(int n_arc) const
 {
-    std::stringstream buf;
-
-    buf << "ctx.move_to(0, 0)" << std::endl;
-    for (auto c : circles_) {
-        buf << "ctx.arc(" << c.c.x << ", " << c.c.y << ", " << c.r
-            << ", 0, twopi)" << std::endl;
-        ;
+    const int n_azi   = sub_azi_[0];
+    const real_t sep  = TWOPI / n_azi;
+    const int n_seg   = std::max(1, (n_arc + n_azi - 1) / n_azi);
+    const real_t h_px = 0.5 * pitch_x_;
+    const real_t h_py = 0.5 * pitch_y_;
+
+    // Append the arc of radius r spanning azimuthal sector ia, optionally in
+    // the clockwise direction
+    auto arc = [&](real_t r, int ia, bool reverse, std::vector<Point2> &poly) {
+        for (int i = 0; i <= n_seg; i++) {
+            int j    = reverse ? n_seg - i : i;
+            real_t a = (ia + (real_t)j / n_seg) * sep;
+            poly.emplace_back(r * std::cos(a), r * std::sin(a));
+        }
+    };
+
+    std::vector<std::vector<Point2>> polys;
+    polys.reserve(n_reg_);
+    real_t r_in = 0.0;
+    for (const real_t r : radii_) {
+        for (int ia = 0; ia < n_azi; ia++) {
+            std::vector<Point2> poly;
+            arc(r, ia, false, poly);
+            if (r_in > 0.0) {
+                arc(r_in, ia, true, poly);
+            } else {
+                poly.emplace_back(0.0, 0.0);
+            }
+            polys.push_back(poly);
+        }
+        r_in = r;
     }
 
-    for (auto l : lines_) {
-        buf << "ctx.move_to(" << l.p1.x << ", " << l.p1.y << ")" << std::endl;
-        buf << "ctx.line_to(" << l.p2.x << ", " << l.p2.y << ")" << std::endl;
-        buf << "ctx.close_path()" << std::endl;
+    // Outside of the largest ring, the sectors run out to the edges of the
+    // pin, and pick up the corners that they contain
+    Point2 origin(0.0, 0.0);
+    Box pin_box(Point2(-h_px, -h_py), Point2(h_px, h_py));
+    const real_t corner = std::atan2(h_py, h_px);
+    const real_t corner_ang[4] = {corner, PI - corner, PI + corner,
+                                  TWOPI - corner};
+    const Point2 corners[4] = {Point2(h_px, h_py), Point2(-h_px, h_py),
+                               Point2(-h_px, -h_py), Point2(h_px, -h_py)};
+    for (int ia = 0; ia < n_azi; ia++) {
+        real_t a0 = ia * sep;
+        real_t a1 = (ia + 1) * sep;
+        std::vector<Point2> poly;
+        poly.push_back(pin_box.intersect(origin, Angle(a0, HPI, 0.0)));
+        for (int ic = 0; ic < 4; ic++) {
+            if ((corner_ang[ic] > a0) && (corner_ang[ic] < a1)) {
+                poly.push_back(corners[ic]);
+            }
+        }
+        poly.push_back(pin_box.intersect(origin, Angle(a1, HPI, 0.0)));
+        arc(r_in, ia, true, poly);
+        polys.push_back(poly);
     }
-    buf << "ctx.stroke()";
-    return buf.str();
+
+    assert((int)polys.size() == n_reg_);
+    return polys;
+}
+
+bool PinMesh_Cyl::same_geometry(const PinMesh &other) const
+{
+    // The base class has already checked that the types match
+    const auto &o = static_cast<const PinMesh_Cyl &>(other);
+    return (sub_azi_ == o.sub_azi_) && (sub_rad_ == o.sub_rad_) &&
+           (xs_radii_.size() == o.xs_radii_.size()) &&
+           (radii_.size() == o.radii_.size()) &&
+           std::equal(xs_radii_.begin(), xs_radii_.end(),
+                      o.xs_radii_.begin(), fp_equiv_ulp) &&
+           std::equal(radii_.begin(), radii_.end(), o.radii_.begin(),
+                      fp_equiv_ulp);
 }
 }
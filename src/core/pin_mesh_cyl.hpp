@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include <algorithm>
 #include <string>
 #include <vector>
 #include "util/global_config.hpp"
@@ -33,6 +34,7 @@ public:
 
     int find_reg(Point2 p) const final override;
     int find_reg(Point2 p, Direction dir) const final override;
+    void find_reg(int n, const Point2 *p, int *reg) const final override;
 
     // If i ever get more general with the azimuthal subdivision, i will
     // have to generalize this as well.
@@ -48,18 +50,50 @@ public:
         return n;
     }
 
-    std::pair<real_t, bool> distance_to_surface(Point2 p, Direction dir,
-                                                int &coincident) const override;
+    std::pair<real_t, bool>
+    distance_to_surface(Point2 p, Direction dir,
+                        int &coincident) const final override;
 
     void print(std::ostream &os) const override;
 
-    std::string draw() const override;
+    std::vector<std::vector<Point2>> polygons(int n_arc) const override;
+
+    /**
+     * \brief Return the radii of the mesh rings
+     */
+    const std::vector<real_t> &radii() const
+    {
+        return radii_;
+    }
+
+    /**
+     * \brief Return the number of azimuthal subdivisions
+     */
+    int n_azi() const
+    {
+        return sub_azi_[0];
+    }
+
+    const std::vector<Circle> &circles() const
+    {
+        return circles_;
+    }
+
+    const std::vector<Line> &lines() const
+    {
+        return lines_;
+    }
+
+protected:
+    bool same_geometry(const PinMesh &other) const override;
 
 private:
     // Radii of material rings
     std::vector<real_t> xs_radii_;
     // Radii of actual mesh rings
     std::vector<real_t> radii_;
+    // Squared radii of the mesh rings, for locating points without a sqrt
+    std::vector<real_t> radii_sq_;
     // Vector of circle objects.
     std::vector<Circle> circles_;
     // Vector of line objects
@@ -68,5 +102,25 @@ private:
     VecI sub_azi_;
     // Number of radial subdivisions for each material ring
     VecI sub_rad_;
+    // Number of octants spanned by each azimuthal subdivision, or zero if
+    // the subdivisions don't line up with the octants
+    int oct_per_azi_;
+
+    /**
+     * \brief Return the index of the azimuthal subdivision containing \p p
+     */
+    int find_azi(Point2 p) const;
+
+    /**
+     * \brief Return the index of the mesh ring containing \p p, where the
+     * index of the region outside of the largest ring is radii_.size()
+     */
+    int find_ring(Point2 p) const
+    {
+        real_t r2 = p.x * p.x + p.y * p.y;
+        return std::distance(
+            radii_sq_.begin(),
+            std::upper_bound(radii_sq_.begin(), radii_sq_.end(), r2));
+    }
 };
 }
@@ -24,10 +24,13 @@
 #include <string>
 #include "pugixml.hpp"
 #include "util/error.hpp"
+#include "util/fp_utils.hpp"
 
 namespace mocc {
 PinMesh_Rect::PinMesh_Rect(const pugi::xml_node &input) : PinMesh(input)
 {
+    type_ = PinMeshType::RECT;
+
     // Parse the number of x and y divisions
     int ndiv_x = input.child("sub_x").text().as_int(0);
     if (ndiv_x < 1) {
@@ -48,6 +51,8 @@ PinMesh_Rect::PinMesh_Rect(const pugi::xml_node &input) : PinMesh(input)
 
     real_t dx = pitch_x_ / ndiv_x;
     real_t dy = pitch_y_ / ndiv_y;
+    rdx_      = ndiv_x / pitch_x_;
+    rdy_      = ndiv_y / pitch_y_;
 
     real_t h_pitch_x = 0.5 * pitch_x_;
     real_t h_pitch_y = 0.5 * pitch_y_;
@@ -90,12 +95,27 @@ std::pair<real_t, bool> PinMesh_Rect::distance_to_surface(Point2 p,
 
     ret.second = false;
     ret.first  = std::numeric_limits<real_t>::max();
-    for (const auto &l : lines_) {
-        real_t d  = l.distance_to_surface(p, dir, (coincident == l.surf_id));
-        if((d < ret.first)) {
+
+    // Only the divisions bounding the cell containing the point can be hit
+    // first. Test one more on either side, in case a point lying on a
+    // division was located in the cell on its other side. lines_ holds the
+    // internal x divisions, followed by the internal y divisions.
+    auto cell  = this->find_cell(p);
+    auto check = [&](int il) {
+        const auto &l = lines_[il];
+        real_t d = l.distance_to_surface(p, dir, (coincident == l.surf_id));
+        if ((d < ret.first)) {
             ret.first = d;
-            coinc = l.surf_id;
+            coinc     = l.surf_id;
         }
+    };
+    for (int ix = std::max(1, cell.first - 1);
+         ix <= std::min((int)nx_ - 1, cell.first + 2); ix++) {
+        check(ix - 1);
+    }
+    for (int iy = std::max(1, cell.second - 1);
+         iy <= std::min((int)ny_ - 1, cell.second + 2); iy++) {
+        check((int)nx_ + iy - 2);
     }
     coincident = coinc;
 
@@ -128,12 +148,21 @@ int PinMesh_Rect::trace(Point2 p1, Point2 p2, int first_reg, VecF &s,
     ps.erase(std::unique(ps.begin(), ps.end()), ps.end());
 
     // Determine segment lengths and region indices
-    for (unsigned int ip = 1; ip < ps.size(); ip++) {
+    int nseg = ps.size() - 1;
+    std::vector<Point2> mid;
+    mid.reserve(nseg);
+    for (int ip = 1; ip <= nseg; ip++) {
         s.push_back(ps[ip].distance(ps[ip - 1]));
-        reg.push_back(this->find_reg(Midpoint(ps[ip], ps[ip - 1])) + first_reg);
+        mid.push_back(Midpoint(ps[ip], ps[ip - 1]));
+    }
+    int stt = reg.size();
+    reg.resize(stt + nseg);
+    this->find_reg(nseg, mid.data(), &reg[stt]);
+    for (int ip = 0; ip < nseg; ip++) {
+        reg[stt + ip] += first_reg;
     }
 
-    return ps.size() - 1;
+    return nseg;
 }
 
 /**
@@ -150,20 +179,22 @@ int PinMesh_Rect::find_reg(Point2 p) const
     if (fabs(p.y) > 0.5 * pitch_y_) {
         return -1;
     }
-    
-    int ix = std::distance(
-        hx_.begin(), std::lower_bound(hx_.cbegin(), hx_.cend(), p.x));
-    int iy = std::distance(
-        hy_.begin(), std::lower_bound(hy_.cbegin(), hy_.cend(), p.y));
-    ix--;
-    iy--;
-    
-    int ireg = nx_ * iy + ix ;
+
+    auto cell = this->find_cell(p);
+    int ireg  = nx_ * cell.second + cell.first;
 
     assert( (ireg >= 0) && (ireg < n_reg_));
     return ireg;
 }
 
+void PinMesh_Rect::find_reg(int n, const Point2 *p, int *reg) const
+{
+    for (int i = 0; i < n; i++) {
+        reg[i] = PinMesh_Rect::find_reg(p[i]);
+    }
+    return;
+}
+
 int PinMesh_Rect::find_reg(Point2 p, Direction dir) const
 {
     // Make sure the point is inside the pin
@@ -208,17 +239,27 @@ void PinMesh_Rect::print(std::ostream &os) const
     return;
 }
 
-std::string PinMesh_Rect::draw() const
+std::vector<std::vector<Point2>> PinMesh_Rect::polygons(int n_arc) const
 {
-    std::stringstream buf;
-
-    for (auto l : lines_) {
-        buf << "ctx.move_to(" << l.p1.x << ", " << l.p1.y << ")" << std::endl;
-        buf << "ctx.line_to(" << l.p2.x << ", " << l.p2.y << ")" << std::endl;
-        buf << "ctx.close_path()" << std::endl;
+    std::vector<std::vector<Point2>> polys;
+    polys.reserve(n_reg_);
+    for (unsigned iy = 0; iy < ny_; iy++) {
+        for (unsigned ix = 0; ix < nx_; ix++) {
+            polys.push_back({Point2(hx_[ix], hy_[iy]),
+                             Point2(hx_[ix + 1], hy_[iy]),
+                             Point2(hx_[ix + 1], hy_[iy + 1]),
+                             Point2(hx_[ix], hy_[iy + 1])});
+        }
     }
-    buf << "ctx.stroke()";
+    return polys;
+}
 
-    return buf.str();
+bool PinMesh_Rect::same_geometry(const PinMesh &other) const
+{
+    // The base class has already checked that the types match
+    const auto &o = static_cast<const PinMesh_Rect &>(other);
+    return (nx_ == o.nx_) && (ny_ == o.ny_) &&
+           std::equal(hx_.begin(), hx_.end(), o.hx_.begin(), fp_equiv_ulp) &&
+           std::equal(hy_.begin(), hy_.end(), o.hy_.begin(), fp_equiv_ulp);
 }
 }
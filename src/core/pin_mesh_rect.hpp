@@ -15,7 +15,9 @@
 */
 
 #pragma once
+#include <algorithm>
 #include <string>
+#include <utility>
 #include <vector>
 #include "util/error.hpp"
 #include "util/pugifwd.hpp"
@@ -32,19 +34,46 @@ public:
 
     int find_reg(Point2 p) const override final;
     int find_reg(Point2 p, Direction dir) const override final;
+    void find_reg(int n, const Point2 *p, int *reg) const override final;
 
     size_t n_fsrs(unsigned int xsreg) const override
     {
         return 1;
     }
 
-    virtual std::pair<real_t, bool>
+    std::pair<real_t, bool>
     distance_to_surface(Point2 p, Direction dir,
-                        int &coincident) const override;
+                        int &coincident) const override final;
 
     void print(std::ostream &os) const override;
 
-    std::string draw() const override;
+    std::vector<std::vector<Point2>> polygons(int n_arc) const override;
+
+    /**
+     * \brief Return the locations of the x divisions, including the pin
+     * boundaries
+     */
+    const VecF &hx() const
+    {
+        return hx_;
+    }
+
+    /**
+     * \brief Return the locations of the y divisions, including the pin
+     * boundaries
+     */
+    const VecF &hy() const
+    {
+        return hy_;
+    }
+
+    const std::vector<Line> &lines() const
+    {
+        return lines_;
+    }
+
+protected:
+    bool same_geometry(const PinMesh &other) const override;
 
 private:
     unsigned nx_;
@@ -55,6 +84,38 @@ private:
     // Vector containing the locations of the y divisions, including pin
     // boundaries
     VecF hy_;
+    // Reciprocals of the x and y division widths
+    real_t rdx_;
+    real_t rdy_;
     std::vector<Line> lines_;
+
+    /**
+     * \brief Return the x and y division indices of the cell containing a
+     * point, which is assumed to be inside the pin.
+     *
+     * The divisions are uniform, so the index is computed directly and then
+     * nudged to agree with a search of \ref hx_ and \ref hy_ for points
+     * that round onto the wrong side of a division.
+     */
+    std::pair<int, int> find_cell(Point2 p) const
+    {
+        int ix = (p.x - hx_.front()) * rdx_;
+        ix     = std::max(0, std::min((int)nx_ - 1, ix));
+        if ((ix > 0) && (p.x <= hx_[ix])) {
+            ix--;
+        } else if ((ix < (int)nx_ - 1) && (p.x > hx_[ix + 1])) {
+            ix++;
+        }
+
+        int iy = (p.y - hy_.front()) * rdy_;
+        iy     = std::max(0, std::min((int)ny_ - 1, iy));
+        if ((iy > 0) && (p.y <= hy_[iy])) {
+            iy--;
+        } else if ((iy < (int)ny_ - 1) && (p.y > hy_[iy + 1])) {
+            iy++;
+        }
+
+        return std::make_pair(ix, iy);
+    }
 };
 }
@@ -151,9 +151,9 @@ public:
      * \brief Return whether or not another \ref Plane is geometrically
      * identical to this \ref Plane
      *
-     * This only checks PinMesh IDs; if there are multiple pin meshes with
-     * different IDs but the same actual mesh structure, this method will
-     * consider them to be different.
+     * Materials are ignored, and pin meshes are compared with \ref
+     * PinMesh::geometrically_equivalent(), so pin meshes with different IDs
+     * but the same actual mesh structure are considered the same.
      */
     bool geometrically_equivalent(const Plane &other) const;
 
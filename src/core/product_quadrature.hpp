@@ -17,6 +17,8 @@
 #pragma once
 
 #include <math.h>
+#include <algorithm>
+#include <cmath>
 #include <vector>
 
 #include "util/blitz_typedefs.hpp"
@@ -26,24 +28,72 @@
 
 using namespace mocc;
 
-// Produce a vector of <theta,weight> pairs of size n_polar with Yamamoto
-// quadrature within (0, PI/2). All weights sum to 1. Currently, only npol=3
-// is supported.
+// Produce a vector of <theta,weight> pairs of size n_polar with the
+// Tabuchi-Yamamoto optimal quadrature within (0, PI/2). All weights sum to 1.
+// Only 1 to 3 polar angles are supported.
 std::vector<std::pair<real_t, real_t>> GenYamamoto(int n_polar)
 {
 
     std::vector<std::pair<real_t, real_t>> thetaWeightPairVec;
 
-    if (n_polar != 3) {
-        throw EXCEPT("Only support Yamamoto quadrature when npol=3");
+    switch (n_polar) {
+    case 1:
+        thetaWeightPairVec.emplace_back(0.924274629374141, 1.0);
+        break;
+    case 2:
+        thetaWeightPairVec.emplace_back(0.372451560619977, 0.212854000000000);
+        thetaWeightPairVec.emplace_back(1.11954015357234, 0.787146000000000);
+        break;
+    case 3:
+        thetaWeightPairVec.emplace_back(0.167429147795000,
+                                        4.623300000000000E-002);
+        thetaWeightPairVec.emplace_back(0.567715121084000, 0.283619000000000);
+        thetaWeightPairVec.emplace_back(1.20253314678900, 0.670148000000000);
+        break;
+    default:
+        throw EXCEPT("Only support Yamamoto quadrature when npol=1, 2 or 3");
     }
-    thetaWeightPairVec.emplace_back(0.167429147795000, 4.623300000000000E-002);
-    thetaWeightPairVec.emplace_back(0.567715121084000, 0.283619000000000);
-    thetaWeightPairVec.emplace_back(1.20253314678900, 0.670148000000000);
 
     return thetaWeightPairVec;
 }
 
+// Return the largest absolute error of a vector of <theta,weight> polar
+// pairs in integrating the Bickley-Naylor function Ki3(tau) for optical
+// thicknesses in [0, 10]. This is the polar integral of the attenuation along
+// a 2-D characteristic, so it is a good proxy for the polar discretization
+// error of MoC.
+real_t PolarError(const std::vector<std::pair<real_t, real_t>> &pol)
+{
+    // Reference values come from a fine composite Simpson rule. The
+    // integrand vanishes smoothly at theta = 0.
+    const int n_theta    = 2000;
+    const int n_tau      = 101;
+    const real_t tau_max = 10.0;
+    const real_t h       = 0.5 * PI / n_theta;
+
+    real_t err = 0.0;
+    for (int it = 0; it < n_tau; it++) {
+        real_t tau = tau_max * it / (n_tau - 1);
+
+        real_t ki3 = 0.0;
+        for (int i = 1; i <= n_theta; i++) {
+            real_t s = sin(i * h);
+            real_t c = (i == n_theta) ? 1.0 : ((i % 2) ? 4.0 : 2.0);
+            ki3 += c * s * s * exp(-tau / s);
+        }
+        ki3 *= h / 3.0;
+
+        real_t q = 0.0;
+        for (const auto &p : pol) {
+            real_t s = sin(p.first);
+            q += p.second * s * exp(-tau / s);
+        }
+        err = std::max(err, std::abs(q - ki3));
+    }
+
+    return err;
+}
+
 // Produce a vector of <alpha,weight> pairs of size n_azimuthal with Chebyshev
 // quadrature within (0, PI/2). All weights sum to 1.
 std::vector<std::pair<real_t, real_t>> GenChebyshev(int n_azimuthal)
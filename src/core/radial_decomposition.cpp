@@ -0,0 +1,198 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include "radial_decomposition.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include "util/error.hpp"
+
+namespace {
+mocc::VecI assembly_cost(const mocc::CoreMesh &mesh)
+{
+    mocc::VecI cost;
+    cost.reserve(mesh.core().nasy());
+    for (int iy = 0; iy < mesh.core().ny(); iy++) {
+        for (int ix = 0; ix < mesh.core().nx(); ix++) {
+            cost.push_back(mesh.core().at(ix, iy).n_reg());
+        }
+    }
+    return cost;
+}
+}
+
+namespace mocc {
+VecI contiguous_partition(const VecI &cost, int n_part)
+{
+    int n_item = cost.size();
+    if ((n_part < 1) || (n_part > n_item)) {
+        throw EXCEPT("Invalid number of partitions");
+    }
+
+    // Accumulated cost at each item boundary
+    std::vector<long> prefix(n_item + 1, 0);
+    for (int i = 0; i < n_item; i++) {
+        prefix[i + 1] = prefix[i] + cost[i];
+    }
+    real_t target = (real_t)prefix.back() / n_part;
+
+    // Place each interior boundary at the item boundary nearest its even
+    // share of the cost, leaving at least one item for this part and each of
+    // the ones that remain.
+    VecI bounds;
+    bounds.reserve(n_part + 1);
+    bounds.push_back(0);
+    for (int ip = 1; ip < n_part; ip++) {
+        int lo       = bounds.back() + 1;
+        int hi       = n_item - (n_part - ip);
+        real_t ideal = target * ip;
+        int best     = lo;
+        for (int i = lo; i <= hi; i++) {
+            if (std::abs(prefix[i] - ideal) < std::abs(prefix[best] - ideal)) {
+                best = i;
+            }
+        }
+        bounds.push_back(best);
+    }
+    bounds.push_back(n_item);
+
+    return bounds;
+}
+
+RadialDecomposition::RadialDecomposition(const VecI &cost, int nx, int ny,
+                                         int n_domain)
+{
+    assert((int)cost.size() == nx * ny);
+    if ((n_domain < 1) || (n_domain > nx * ny)) {
+        throw EXCEPT("Invalid number of radial domains");
+    }
+
+    VecI col_cost(nx, 0);
+    VecI row_cost(ny, 0);
+    for (int iy = 0; iy < ny; iy++) {
+        for (int ix = 0; ix < nx; ix++) {
+            col_cost[ix] += cost[iy * nx + ix];
+            row_cost[iy] += cost[iy * nx + ix];
+        }
+    }
+
+    int best_max = -1;
+    for (int px = 1; px <= n_domain; px++) {
+        if ((n_domain % px != 0) || (px > nx) || (n_domain / px > ny)) {
+            continue;
+        }
+        int py      = n_domain / px;
+        VecI x_cuts = contiguous_partition(col_cost, px);
+        VecI y_cuts = contiguous_partition(row_cost, py);
+
+        VecI domain_cost(n_domain, 0);
+        for (int jy = 0; jy < py; jy++) {
+            for (int jx = 0; jx < px; jx++) {
+                int c = 0;
+                for (int iy = y_cuts[jy]; iy < y_cuts[jy + 1]; iy++) {
+                    for (int ix = x_cuts[jx]; ix < x_cuts[jx + 1]; ix++) {
+                        c += cost[iy * nx + ix];
+                    }
+                }
+                domain_cost[jy * px + jx] = c;
+            }
+        }
+
+        int max_cost =
+            *std::max_element(domain_cost.begin(), domain_cost.end());
+        if ((best_max < 0) || (max_cost < best_max)) {
+            best_max  = max_cost;
+            x_bounds_ = x_cuts;
+            y_bounds_ = y_cuts;
+            cost_     = domain_cost;
+        }
+    }
+
+    if (best_max < 0) {
+        throw EXCEPT("Number of radial domains does not fit the core");
+    }
+
+    return;
+}
+
+RadialDecomposition::RadialDecomposition(const CoreMesh &mesh, int n_domain)
+    : RadialDecomposition(assembly_cost(mesh), mesh.core().nx(),
+                          mesh.core().ny(), n_domain)
+{
+    return;
+}
+
+int RadialDecomposition::owner(int ix, int iy) const
+{
+    assert((ix >= 0) && (ix < x_bounds_.back()));
+    assert((iy >= 0) && (iy < y_bounds_.back()));
+    int jx = std::distance(x_bounds_.begin(),
+                           std::upper_bound(x_bounds_.begin(),
+                                            x_bounds_.end(), ix)) -
+             1;
+    int jy = std::distance(y_bounds_.begin(),
+                           std::upper_bound(y_bounds_.begin(),
+                                            y_bounds_.end(), iy)) -
+             1;
+    return jy * px() + jx;
+}
+
+int RadialDecomposition::neighbor(int domain, Surface surf) const
+{
+    int jx = domain % px();
+    int jy = domain / px();
+    switch (surf) {
+    case Surface::EAST:
+        jx++;
+        break;
+    case Surface::WEST:
+        jx--;
+        break;
+    case Surface::NORTH:
+        jy++;
+        break;
+    case Surface::SOUTH:
+        jy--;
+        break;
+    default:
+        return -1;
+    }
+    if ((jx < 0) || (jx >= px()) || (jy < 0) || (jy >= py())) {
+        return -1;
+    }
+    return jy * px() + jx;
+}
+
+std::ostream &operator<<(std::ostream &os, const RadialDecomposition &decomp)
+{
+    os << "Radial decomposition: " << decomp.px() << " x " << decomp.py()
+       << std::endl;
+    for (int jy = 0; jy < decomp.py(); jy++) {
+        for (int jx = 0; jx < decomp.px(); jx++) {
+            int id = jy * decomp.px() + jx;
+            os << "    Domain " << id << ": assemblies x "
+               << decomp.x_bounds_[jx] << " - " << decomp.x_bounds_[jx + 1] - 1
+               << ", y " << decomp.y_bounds_[jy] << " - "
+               << decomp.y_bounds_[jy + 1] - 1 << ", cost " << decomp.cost(id)
+               << std::endl;
+        }
+    }
+    return os;
+}
+}
@@ -0,0 +1,136 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#pragma once
+
+#include <iosfwd>
+#include "util/global_config.hpp"
+#include "core/constants.hpp"
+#include "core/core_mesh.hpp"
+
+namespace mocc {
+/**
+ * \brief Split a sequence of items into contiguous, cost-balanced parts
+ *
+ * \param cost the relative cost of each item
+ * \param n_part the number of parts to make. Must be between one and the
+ * number of items.
+ *
+ * \returns the index of the first item in each part, with an extra entry at
+ * the end for the number of items. Each part gets at least one item.
+ */
+VecI contiguous_partition(const VecI &cost, int n_part);
+
+/**
+ * \brief Partitioning of the assemblies of a \ref CoreMesh into rectangular,
+ * cost-balanced radial domains.
+ *
+ * The assembly grid is cut into \c px columns and \c py rows of domains, with
+ * \c px * \c py equal to the requested number of domains. Of all such
+ * factorizations, the one with the smallest maximum domain cost is chosen.
+ * Along each direction, the cuts are placed with \ref contiguous_partition()
+ * using the cost of each assembly column/row. A rectangular layout gives
+ * each domain at most four neighbors, which is what the KBA Sn sweep (\ref
+ * sn::KBADomain) pipelines across.
+ */
+class RadialDecomposition {
+public:
+    /**
+     * \brief Partition a grid of assemblies, given the cost of each
+     *
+     * \param cost the relative cost of each assembly, with x varying fastest
+     * \param nx the number of assemblies along x
+     * \param ny the number of assemblies along y
+     * \param n_domain the number of domains to make
+     */
+    RadialDecomposition(const VecI &cost, int nx, int ny, int n_domain);
+
+    /**
+     * \brief Partition the assemblies of a \ref CoreMesh.
+     *
+     * The cost of each assembly is taken as its number of flat source
+     * regions.
+     */
+    RadialDecomposition(const CoreMesh &mesh, int n_domain);
+
+    int n_domain() const
+    {
+        return px() * py();
+    }
+
+    int px() const
+    {
+        return x_bounds_.size() - 1;
+    }
+
+    int py() const
+    {
+        return y_bounds_.size() - 1;
+    }
+
+    /**
+     * \brief Return the first assembly column of a column of domains
+     *
+     * For \p jx equal to \ref px(), this is the number of assembly columns.
+     */
+    int x_bound(int jx) const
+    {
+        return x_bounds_[jx];
+    }
+
+    /**
+     * \brief Return the first assembly row of a row of domains
+     *
+     * For \p jy equal to \ref py(), this is the number of assembly rows.
+     */
+    int y_bound(int jy) const
+    {
+        return y_bounds_[jy];
+    }
+
+    /**
+     * \brief Return the domain owning the assembly at (\p ix, \p iy)
+     */
+    int owner(int ix, int iy) const;
+
+    /**
+     * \brief Return the domain adjacent to \p domain across the passed
+     * \ref Surface, or -1 if that surface is on the domain boundary.
+     */
+    int neighbor(int domain, Surface surf) const;
+
+    /**
+     * \brief Return the total cost of the assemblies in a domain
+     */
+    int cost(int domain) const
+    {
+        return cost_[domain];
+    }
+
+    friend std::ostream &operator<<(std::ostream &os,
+                                    const RadialDecomposition &decomp);
+
+private:
+    // First assembly column/row of each domain column/row, with an extra
+    // entry at the end
+    VecI x_bounds_;
+    VecI y_bounds_;
+
+    // Cost of each domain, x varying fastest
+    VecI cost_;
+};
+}
@@ -0,0 +1,86 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "recycled_subspace.hpp"
+
+#include <cassert>
+#include "util/memory.hpp"
+
+namespace mocc {
+void RecycledSubspace::guess(const LinearOperator &op, const VectorX &b,
+                             VectorX &x) const
+{
+    assert(x.size() == b.size());
+    const int k = basis_.size();
+    if (k == 0) {
+        return;
+    }
+
+    // Minimize |b - A*(x + U*c)| over c, using the images of the basis
+    // under the current operator
+    MatrixX w(b.size(), k);
+    VectorX y(b.size());
+    for (int i = 0; i < k; i++) {
+        op(basis_[i], y);
+        w.col(i) = y;
+    }
+    op(x, y);
+    VectorX r = b - y;
+    VectorX c = w.colPivHouseholderQr().solve(r);
+
+    for (int i = 0; i < k; i++) {
+        x += c(i) * basis_[i];
+    }
+    return;
+}
+
+void RecycledSubspace::add(const VectorX &x)
+{
+    if (max_size_ == 0) {
+        return;
+    }
+    real_t norm = x.norm();
+    if (norm == 0.0) {
+        return;
+    }
+
+    if ((int)basis_.size() == max_size_) {
+        basis_.erase(basis_.begin());
+    }
+
+    // Classical Gram-Schmidt, twice, is enough to keep the basis orthonormal
+    VectorX v = x;
+    for (int pass = 0; pass < 2; pass++) {
+        for (const auto &u : basis_) {
+            v -= u.dot(v) * u;
+        }
+    }
+    real_t rest = v.norm();
+    if (rest > 1.0e-10 * norm) {
+        basis_.push_back(v / rest);
+    }
+    return;
+}
+
+size_t RecycledSubspace::memory() const
+{
+    size_t n = 0;
+    for (const auto &u : basis_) {
+        n += bytes(u);
+    }
+    return n;
+}
+}
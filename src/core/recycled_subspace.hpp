@@ -0,0 +1,104 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "util/global_config.hpp"
+#include "eigen_interface.hpp"
+#include "gmres.hpp"
+
+namespace mocc {
+/**
+ * \brief A small basis of previous solutions to a slowly-changing linear
+ * system, used to improve the initial guess of the next solve
+ *
+ * The one-group CMFD systems are solved many times over, both within a CMFD
+ * solve and from one outer iteration to the next, with operators and
+ * right-hand sides that change only a little in between. The solutions
+ * therefore stay close to the span of the last few, and searching that span
+ * first removes most of the initial residual that the Krylov solver would
+ * otherwise have to.
+ *
+ * The basis is kept orthonormal, and holds at most \ref max_size() vectors,
+ * dropping the oldest as new ones are added.
+ */
+class RecycledSubspace {
+public:
+    RecycledSubspace(int max_size = 0) : max_size_(max_size)
+    {
+        return;
+    }
+
+    /**
+     * \brief Return the largest number of vectors kept in the basis
+     */
+    int max_size() const
+    {
+        return max_size_;
+    }
+
+    /**
+     * \brief Return the number of vectors in the basis
+     */
+    int size() const
+    {
+        return basis_.size();
+    }
+
+    /**
+     * \brief Improve the initial guess for A*x = b
+     *
+     * \param [in] op the action of the current operator
+     * \param [in] b the right-hand side
+     * \param [in,out] x the initial guess, replaced by the improved guess
+     *
+     * Adds the correction from the span of the basis that minimizes the
+     * residual with the current operator, so the residual never grows. This
+     * costs one application of the operator per basis vector, plus one for
+     * the residual of \p x.
+     */
+    void guess(const LinearOperator &op, const VectorX &b, VectorX &x) const;
+
+    /**
+     * \brief Add a solution to the basis
+     *
+     * If the basis is full, its oldest vector is dropped first. The part of
+     * \p x already in the span of the basis is removed, and the rest is
+     * normalized and added, unless there is effectively nothing left.
+     */
+    void add(const VectorX &x);
+
+    /**
+     * \brief Remove all vectors from the basis
+     */
+    void clear()
+    {
+        basis_.clear();
+    }
+
+    /**
+     * \brief Return the number of bytes used to store the basis
+     */
+    size_t memory() const;
+
+private:
+    int max_size_;
+    // Orthonormal basis vectors, oldest first
+    std::vector<VectorX> basis_;
+};
+}
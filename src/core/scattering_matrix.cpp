@@ -16,6 +16,7 @@
 
 #include "scattering_matrix.hpp"
 
+#include <cstdint>
 #include <iomanip>
 #include <iostream>
 #include "util/error.hpp"
@@ -73,13 +74,13 @@ ScatteringMatrix::ScatteringMatrix(const ArrayB2 &scat)
         std::pair<int, int> these_bounds;
         for (int from = 0; from < ng_; from++) {
             these_bounds.first = from;
-            if (scat(to, from) > 0.0) {
+            if (scat(to, from) != 0.0) {
                 break;
             }
         }
         for (int from = ng_ - 1; from >= 0; from--) {
             these_bounds.second = from;
-            if (scat(to, from) > 0.0) {
+            if (scat(to, from) != 0.0) {
                 break;
             }
         }
@@ -120,6 +121,68 @@ ScatteringMatrix::ScatteringMatrix(const ArrayB2 &scat)
         to++;
         pos += these_bounds.second - these_bounds.first + 1;
     }
+
+    this->transpose();
+}
+
+size_t ScatteringMatrix::hash() const
+{
+    // FNV-1a hash of the row bounds and cross sections
+    uint64_t key = 14695981039346656037ull;
+    auto hash    = [&key](const void *data, size_t size) {
+        const unsigned char *bytes = static_cast<const unsigned char *>(data);
+        for (size_t i = 0; i < size; i++) {
+            key ^= bytes[i];
+            key *= 1099511628211ull;
+        }
+    };
+
+    hash(&ng_, sizeof(ng_));
+    for (const auto &row : rows_) {
+        hash(&row.min_g, sizeof(row.min_g));
+        hash(&row.max_g, sizeof(row.max_g));
+    }
+    hash(scat_.data(), scat_.size() * sizeof(real_t));
+    return key;
+}
+
+void ScatteringMatrix::transpose()
+{
+    out_scat_.clear();
+    out_rows_.clear();
+
+    // Find the band of destination groups for each source group, including
+    // its self-scatter entry
+    std::vector<std::pair<int, int>> bounds(ng_);
+    int size = 0;
+    for (int from = 0; from < ng_; from++) {
+        bounds[from] = {from, from};
+        for (int to = 0; to < ng_; to++) {
+            const ScatteringRow &row = rows_[to];
+            if ((from >= row.min_g) && (from <= row.max_g) &&
+                (row[from] != 0.0)) {
+                bounds[from].first  = std::min(bounds[from].first, to);
+                bounds[from].second = std::max(bounds[from].second, to);
+            }
+        }
+        size += bounds[from].second - bounds[from].first + 1;
+    }
+
+    out_scat_.reserve(size);
+    out_rows_.reserve(ng_);
+    for (int from = 0; from < ng_; from++) {
+        int pos = out_scat_.size();
+        for (int to = bounds[from].first; to <= bounds[from].second; to++) {
+            const ScatteringRow &row = rows_[to];
+            bool in_row = (from >= row.min_g) && (from <= row.max_g);
+            out_scat_.push_back(in_row ? row[from] : 0.0);
+        }
+        out_rows_.push_back(ScatteringRow(bounds[from].first,
+                                          bounds[from].second,
+                                          &out_scat_[pos]));
+    }
+
+    return;
 }
 
 std::ostream &operator<<(std::ostream &os, const ScatteringMatrix &scat_mat)
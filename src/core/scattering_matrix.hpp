@@ -16,9 +16,11 @@
 
 #pragma once
 
+#include <algorithm>
 #include <iosfwd>
 #include "util/blitz_typedefs.hpp"
 #include "util/global_config.hpp"
+#include "util/memory.hpp"
 
 namespace mocc {
 // Scattering matrix row
@@ -80,6 +82,11 @@ public:
  * transfer is physically limited by the ratio of masses. Therefore we use a
  * compressed representation, where each "row" of outscatter cross sections
  * are stored contiguously, along with their group boundaries.
+ *
+ * A transposed copy is also kept, whose rows hold the cross sections for
+ * scattering out of each group into a band of destination groups. This is
+ * what is needed to sample, or scatter into, the groups that a given group
+ * feeds.
  */
 class ScatteringMatrix {
 public:
@@ -122,6 +129,7 @@ public:
             rows_.push_back(ScatteringRow(row.min_g, row.max_g, &scat_[pos]));
             pos += row.max_g - row.min_g + 1;
         }
+        this->transpose();
 
         return;
     }
@@ -140,6 +148,7 @@ public:
                     ScatteringRow(row.min_g, row.max_g, &scat_[pos]));
                 pos += row.max_g - row.min_g + 1;
             }
+            this->transpose();
         }
         return *this;
     }
@@ -150,6 +159,20 @@ public:
         return rows_[ig];
     }
 
+    /**
+     * \brief Return the out-scattering row of group \p ig
+     *
+     * This is a row of the transposed matrix, holding the cross sections for
+     * scattering from group \p ig into the groups in [min_g, max_g]. Like
+     * the rows returned by \ref to(), it always includes the self-scatter
+     * entry.
+     */
+    const ScatteringRow &from(int ig) const
+    {
+        assert((ig >= 0) && (ig < int(out_rows_.size())));
+        return out_rows_[ig];
+    }
+
     /**
      * \brief Return the self-scattering cross section for the indicated
      * group.
@@ -168,6 +191,16 @@ public:
         return ng_;
     }
 
+    /**
+     * Return the number of bytes used to store the scattering cross
+     * sections.
+     */
+    size_t memory() const
+    {
+        return bytes(scat_) + bytes(out_) + bytes(out_scat_) +
+               (rows_.size() + out_rows_.size()) * sizeof(ScatteringRow);
+    }
+
     /**
      * Return the total out-scattering cross section for group ig
      *
@@ -186,19 +219,16 @@ public:
      */
     VecF out_cdf(int ig) const
     {
-        VecF cdf;
-        cdf.reserve(ng_);
+        const ScatteringRow &row = this->from(ig);
+        VecF cdf(ng_, 0.0);
 
         real_t scale = 1.0 / this->out(ig);
         real_t prev  = 0.0;
-        for (int igg = 0; igg < ng_; igg++) {
-            real_t xssc =
-                ((ig >= this->to(igg).min_g) && (ig <= this->to(igg).max_g))
-                    ? this->to(igg)[ig]
-                    : 0.0;
-            cdf.push_back(prev + xssc * scale);
-            prev = cdf.back();
+        for (int igg = row.min_g; igg <= row.max_g; igg++) {
+            prev += row[igg] * scale;
+            cdf[igg] = prev;
         }
+        std::fill(cdf.begin() + row.max_g + 1, cdf.end(), prev);
         return cdf;
     }
 
@@ -251,6 +281,11 @@ public:
         if (out_ != other.out_) {
             return false;
         }
+        for (int ig = 0; ig < ng_; ig++) {
+            if (rows_[ig] != other.rows_[ig]) {
+                return false;
+            }
+        }
         return true;
     }
 
@@ -259,16 +294,32 @@ public:
         return !(*this == other);
     }
 
+    /**
+     * \brief Return a hash of the row bounds and cross sections
+     *
+     * Equal matrices have equal hashes, which is used to find identical
+     * matrices to share storage.
+     */
+    size_t hash() const;
+
     // Provide stream insertion support
     friend std::ostream &operator<<(std::ostream &os,
                                     const ScatteringMatrix &scat_mat);
 
 private:
+    /**
+     * \brief Build the transposed rows from the scattering rows
+     */
+    void transpose();
+
     int ng_;
     // Densified scattering cross sections
     VecF scat_;
     // Group-wise outscatter cross sections
     VecF out_;
     std::vector<ScatteringRow> rows_;
+    // Densified cross sections and rows of the transposed matrix
+    VecF out_scat_;
+    std::vector<ScatteringRow> out_rows_;
 };
 }
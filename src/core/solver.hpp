@@ -55,6 +55,36 @@ public:
         return nullptr;
     }
 
+    /**
+    * Write throughput metrics (work done, time spent, rates) for the solver
+    * and anything it owns to an HDF5 node. These are gathered over the
+    * lifetime of the solver and written to the \c /performance group of the
+    * output file. The default writes nothing.
+    */
+    virtual void output_performance(H5Node &node) const
+    {
+        return;
+    }
+
+    /**
+    * Add the memory used by the solver and anything it owns to a \ref
+    * MemoryReport. The default adds nothing.
+    */
+    virtual void memory(MemoryReport &report) const
+    {
+        return;
+    }
+
+    /**
+    * Release data that was only needed to set up the solver and anything it
+    * owns. This is called once, before \ref solve(). The default does
+    * nothing.
+    */
+    virtual void compact()
+    {
+        return;
+    }
+
 private:
 };
 
@@ -20,6 +20,7 @@
 #include <iostream>
 #include "pugixml.hpp"
 #include "util/error.hpp"
+#include "util/first_touch.hpp"
 #include "core/constants.hpp"
 
 namespace mocc {
@@ -28,28 +29,72 @@ Source::Source(int nreg, const XSMesh *xs_mesh, const ArrayB2 &flux)
       n_group_(xs_mesh->n_group()),
       n_reg_(flux.size() / n_group_),
       has_external_(false),
+      external_group_(-1),
       source_1g_(nreg),
-      flux_(flux)
+      flux_(flux),
+      xsreg_(xs_mesh->xsreg_index()),
+      xsreg_runs_(xs_mesh->xsreg_runs())
 {
     assert(nreg * n_group_ == (int)flux_.size());
     assert(xs_mesh_->n_reg_expanded() == nreg);
-    source_1g_.fill(0.0);
+    assert((int)xsreg_.size() == nreg);
+    first_touch(source_1g_.data(), source_1g_.size(), (real_t)0.0);
+
     state_.reset();
     return;
 }
 
 void Source::initialize_group(int ig)
+{
+    this->load_external(ig);
+
+#pragma omp parallel
+    this->initialize_group_loop(ig, source_1g_);
+
+    state_.reset();
+    return;
+}
+
+void Source::initialize_group_loop(int ig, VectorX &q)
 {
     if (has_external_) {
-        for (int ireg = 0; ireg < (int)n_reg_; ireg++) {
-            source_1g_[ireg] = external_source_(ireg, ig);
+        assert(external_group_ == ig);
+#pragma omp for nowait
+        for (int ireg = 0; ireg < n_reg_; ireg++) {
+            q[ireg] = external_1g_(ireg);
         }
     }
     else {
-        source_1g_.fill(0.0);
+#pragma omp for nowait
+        for (int ireg = 0; ireg < n_reg_; ireg++) {
+            q[ireg] = 0.0;
+        }
     }
 
-    state_.reset();
+    return;
+}
+
+void Source::load_external(int ig)
+{
+    if (!has_external_ || (ig == external_group_)) {
+        return;
+    }
+
+    if (external_file_) {
+        external_file_->read_slab("/source", external_1g_.data(), ig, 1);
+    } else {
+        // Only the listed regions are non-zero. Zero them all first, so that
+        // a region listed more than once gets the sum of its strengths.
+        for (int reg : external_reg_) {
+            external_1g_(reg) = 0.0;
+        }
+        for (int i = 0; i < (int)external_reg_.size(); i++) {
+            external_1g_(external_reg_[i]) +=
+                external_strength_[i] * external_spectrum_[ig];
+        }
+    }
+    external_group_ = ig;
+
     return;
 }
 
@@ -63,18 +108,30 @@ std::ostream &operator<<(std::ostream &os, const Source &src)
 // start with that.
 void Source::fission(const ArrayB1 &fs, int ig)
 {
-    assert((int)fs.size() == n_reg_);
     assert(!state_.has_fission);
     assert(!state_.is_scaled);
 
-    for (auto &xsr : *xs_mesh_) {
-        real_t xsch = xsr.xsmacch(ig);
-        for (const int &ireg : xsr.reg()) {
-            source_1g_[ireg] += xsch * fs(ireg);
+#pragma omp parallel
+    this->fission_loop(fs, ig, source_1g_);
+
+    state_.has_fission = true;
+    return;
+}
+
+void Source::fission_loop(const ArrayB1 &fs, int ig, VectorX &q)
+{
+    assert((int)fs.size() == n_reg_);
+
+    const real_t *xsch = xs_mesh_->xsch(ig);
+#pragma omp for nowait
+    for (int ireg = 0; ireg < n_reg_; ireg++) {
+        int ixs = xsreg_[ireg];
+        if (ixs < 0) {
+            continue;
         }
+        q[ireg] += xsch[ixs] * fs(ireg);
     }
 
-    state_.has_fission = true;
     return;
 }
 
@@ -83,28 +140,115 @@ void Source::fission(const ArrayB1 &fs, int ig)
  * other groups.
  */
 void Source::in_scatter(size_t ig)
+{
+    this->in_scatter(ig, flux_);
+    return;
+}
+
+void Source::in_scatter(size_t ig, const ArrayB2 &flux)
 {
     assert(!state_.has_inscatter);
     assert(!state_.is_scaled);
-    for (auto &xsr : *xs_mesh_) {
-        if (xsr.reg().size() == 0) {
+
+#pragma omp parallel
+    this->in_scatter_loop(ig, flux, source_1g_);
+
+    return;
+}
+
+void Source::in_scatter_loop(size_t ig, const ArrayB2 &flux, VectorX &q,
+                             int skip)
+{
+    assert(flux.extent(0) == n_reg_);
+    assert(flux.extent(1) == n_group_);
+
+    // One pass over the runs of regions that share an XS mesh region, so
+    // that each scattering row is only looked up once per run. The flux is
+    // stored with the group index running fastest, so the band of each
+    // scattering row is contiguous. Self-scatter and the skipped group are
+    // left out by splitting the band around them.
+    int g           = ig;
+    const int cut_1 = (skip < 0) ? g : std::min(g, skip);
+    const int cut_2 = (skip < 0) ? g : std::max(g, skip);
+    const int n_run = xsreg_runs_.size() - 1;
+#pragma omp for nowait
+    for (int irun = 0; irun < n_run; irun++) {
+        int ixs = xsreg_[xsreg_runs_[irun]];
+        if (ixs < 0) {
             continue;
         }
-        const ScatteringRow &scat_row = xsr.xsmacsc().to(ig);
-        size_t min_g                  = scat_row.min_g;
-        int igg                       = min_g;
-        for (auto sc : scat_row) {
-            // Dont add a contribution for self-scatter. It might be a
-            // good idea to remove self-scatter from the scattering matrix
-            // and store it separately. May also benefit the self-scatter
-            // routine to have less indirection.
-            if (igg != (int)ig) {
-                for (auto &ireg : xsr.reg()) {
-                    real_t scat_src = sc * flux_((int)ireg, igg);
-                    source_1g_[ireg] += scat_src;
-                }
+        const ScatteringRow scat_row = xs_mesh_->scat_row(g, ixs);
+        const real_t *sc             = scat_row.from;
+        const int min_g              = scat_row.min_g;
+        const int max_g              = scat_row.max_g;
+        const int down_end           = std::min(cut_1, max_g + 1);
+        const int mid_begin          = std::max(min_g, cut_1 + 1);
+        const int mid_end            = std::min(cut_2, max_g + 1);
+        const int up_begin           = std::max(min_g, cut_2 + 1);
+        for (int ireg = xsreg_runs_[irun]; ireg < xsreg_runs_[irun + 1];
+             ireg++) {
+            real_t scat_src = 0.0;
+            for (int igg = min_g; igg < down_end; igg++) {
+                scat_src += sc[igg - min_g] * flux(ireg, igg);
+            }
+            for (int igg = mid_begin; igg < mid_end; igg++) {
+                scat_src += sc[igg - min_g] * flux(ireg, igg);
             }
-            igg++;
+            for (int igg = up_begin; igg <= max_g; igg++) {
+                scat_src += sc[igg - min_g] * flux(ireg, igg);
+            }
+            q[ireg] += scat_src;
+        }
+    }
+
+    return;
+}
+
+void Source::prepare_next(int ig, const ArrayB1 *fs, int skip)
+{
+    assert(skip != ig);
+    if (next_1g_.size() != source_1g_.size()) {
+        next_1g_.resize(source_1g_.size());
+    }
+    this->load_external(ig);
+
+#pragma omp parallel
+    {
+        // The loops share their partitioning of the regions, so no barriers
+        // are needed between them
+        this->initialize_group_loop(ig, next_1g_);
+        if (fs) {
+            this->fission_loop(*fs, ig, next_1g_);
+        }
+        this->in_scatter_loop(ig, flux_, next_1g_, skip);
+    }
+
+    return;
+}
+
+void Source::use_next(int ig, const ArrayB1 *fs, int skip)
+{
+    assert(next_1g_.size() == source_1g_.size());
+    source_1g_.swap(next_1g_);
+    state_.reset();
+    state_.has_fission = fs != nullptr;
+
+    // Add the in-scatter from the skipped group, now that it has been swept
+    const int n_run = xsreg_runs_.size() - 1;
+#pragma omp parallel for
+    for (int irun = 0; irun < n_run; irun++) {
+        int ixs = xsreg_[xsreg_runs_[irun]];
+        if (ixs < 0) {
+            continue;
+        }
+        const ScatteringRow scat_row = xs_mesh_->scat_row(ig, ixs);
+        if ((skip < scat_row.min_g) || (skip > scat_row.max_g)) {
+            continue;
+        }
+        real_t sc = scat_row[skip];
+        for (int ireg = xsreg_runs_[irun]; ireg < xsreg_runs_[irun + 1];
+             ireg++) {
+            source_1g_[ireg] += sc * flux_(ireg, skip);
         }
     }
 
@@ -128,18 +272,49 @@ void Source::add_external(const pugi::xml_node &input)
     }
 
     std::string srcfname = input.attribute("file").value();
-    H5Node srcfile(srcfname, H5Access::READ);
-    srcfile.read("/source", external_source_);
+    std::unique_ptr<H5Node> srcfile(new H5Node(srcfname, H5Access::READ));
 
-    // I converted this from the old HDF5 routines, and the order of these
-    // could be wrong. make sure to test or change as necessary
-    if (external_source_.extent(0) != (int)n_group_) {
-        throw EXCEPT("Wrong group dimensions for source");
-    }
-    if (external_source_.extent(1) != (int)n_reg_) {
-        throw EXCEPT("Wrong regions dimensions for source");
+    external_reg_.clear();
+    external_strength_.clear();
+    external_spectrum_.clear();
+    external_file_.reset();
+
+    if (srcfile->exists("/source_regions")) {
+        srcfile->read("/source_regions", external_reg_);
+        srcfile->read("/source_spectrum", external_spectrum_);
+        if (srcfile->exists("/source_strength")) {
+            srcfile->read("/source_strength", external_strength_);
+        } else {
+            external_strength_.assign(external_reg_.size(), 1.0);
+        }
+
+        if ((int)external_spectrum_.size() != n_group_) {
+            throw EXCEPT("Wrong group dimensions for source spectrum");
+        }
+        if (external_strength_.size() != external_reg_.size()) {
+            throw EXCEPT("Wrong number of source strengths");
+        }
+        for (int reg : external_reg_) {
+            if ((reg < 0) || (reg >= n_reg_)) {
+                throw EXCEPT("Source region out of bounds");
+            }
+        }
+    } else {
+        // The dense source is stored group-major, so that each group is a
+        // contiguous slab that load_external() can read on its own
+        std::vector<hsize_t> dims = srcfile->dimensions("/source");
+        if ((dims.size() != 2) || ((int)dims[0] != n_group_)) {
+            throw EXCEPT("Wrong group dimensions for source");
+        }
+        if ((int)dims[1] != n_reg_) {
+            throw EXCEPT("Wrong regions dimensions for source");
+        }
+        external_file_ = std::move(srcfile);
     }
 
-    has_external_ = true;
+    external_1g_.resize(n_reg_);
+    external_1g_    = 0.0;
+    external_group_ = -1;
+    has_external_   = true;
 }
 }
@@ -18,8 +18,11 @@
 
 #include <blitz/array.h>
 #include <iosfwd>
+#include <memory>
 #include "util/blitz_typedefs.hpp"
 #include "util/global_config.hpp"
+#include "util/h5file.hpp"
+#include "util/memory.hpp"
 #include "core/eigen_interface.hpp"
 #include "xs_mesh.hpp"
 
@@ -75,6 +78,15 @@ public:
      */
     virtual void in_scatter(size_t ig);
 
+    /**
+     * \brief Add the contribution from in-scattering from other groups,
+     * using the passed multi-group flux rather than the current sweeper flux.
+     *
+     * This allows Jacobi-style energy iterations, where the in-scatter source
+     * for several groups is built from a previous iterate.
+     */
+    virtual void in_scatter(size_t ig, const ArrayB2 &flux);
+
     /**
      * \brief Add a one-group auxiliary source
      *
@@ -84,6 +96,40 @@ public:
      */
     void auxiliary(const ArrayB1 &aux);
 
+    /**
+     * \brief Return whether \ref prepare_next() and \ref use_next() may be
+     * used to build a group's source ahead of time
+     *
+     * Sources that keep more than the flat one-group source (e.g. the linear
+     * source moments) return \c false.
+     */
+    virtual bool can_prepare_next() const
+    {
+        return true;
+    }
+
+    /**
+     * \brief Build the source of a group ahead of time, into storage of its
+     * own, leaving out the in-scatter from one other group
+     *
+     * \param ig the group to build the source for
+     * \param fs the group-independent fission source, or \c nullptr
+     * \param skip the group whose in-scatter source is left out
+     *
+     * This adds the external, fission and in-scatter sources, like \ref
+     * initialize_group(), \ref fission() and \ref in_scatter(), without
+     * touching the current group source and without reading the flux of \p
+     * skip. It may then run alongside a sweep of \p skip that uses the
+     * current source. \ref use_next() makes it the current source.
+     */
+    void prepare_next(int ig, const ArrayB1 *fs, int skip);
+
+    /**
+     * \brief Make the source built by \ref prepare_next() the current group
+     * source, adding the in-scatter from the group that it left out
+     */
+    void use_next(int ig, const ArrayB1 *fs, int skip);
+
     /**
      * \brief Add self-scatter source
      *
@@ -106,6 +152,14 @@ public:
 
     /**
      * \brief Add an external source from an XML node.
+     *
+     * The \c file attribute names an HDF5 file holding either a dense
+     * source, as a \c /source dataset of dimensions [n_group][n_reg], or a
+     * sparse one, as a list of \c /source_regions with a common \c
+     * /source_spectrum and an optional \c /source_strength for each listed
+     * region. A dense source is read from the file one group at a time, as
+     * each group is initialized, rather than being held in memory for the
+     * whole run.
      */
     void add_external(const pugi::xml_node &input);
 
@@ -161,6 +215,16 @@ public:
      */
     virtual const VectorX &get_transport(int iang) const = 0;
 
+    /**
+     * \brief Return the number of bytes used to store the source
+     */
+    virtual size_t memory() const
+    {
+        return bytes(external_1g_) + bytes(external_reg_) +
+               bytes(external_strength_) + bytes(external_spectrum_) +
+               bytes(source_1g_) + bytes(next_1g_);
+    }
+
     friend std::ostream &operator<<(std::ostream &os, const Source &src);
 
 protected:
@@ -182,6 +246,22 @@ protected:
 
     State state_;
 
+    // The loops of initialize_group(), fission() and in_scatter(), without
+    // their parallel regions or changes to the State, adding to the source q.
+    // Each must be called by all threads of an enclosing parallel region,
+    // and returns without a barrier, so that several sources may be built in
+    // the same region. in_scatter_loop() also leaves out the in-scatter from
+    // group skip, if it is not negative.
+    void initialize_group_loop(int ig, VectorX &q);
+    void fission_loop(const ArrayB1 &fs, int ig, VectorX &q);
+    void in_scatter_loop(size_t ig, const ArrayB2 &flux, VectorX &q,
+                         int skip = -1);
+
+    // Make external_1g_ hold the external source of group ig, reading it
+    // from the file if it is dense. This must be called before
+    // initialize_group_loop(), outside of any parallel region.
+    void load_external(int ig);
+
     /**
      * Reference to a compatible \ref TransportSweeper \ref XSMesh.
      */
@@ -194,16 +274,38 @@ protected:
     // initialized false.
     bool has_external_;
 
-    // The external source, if set
-    ArrayB2 external_source_;
+    // File holding a dense external source, kept open to read one group at
+    // a time. Null if the source is sparse.
+    std::unique_ptr<H5Node> external_file_;
+
+    // Regions of a sparse external source, their strengths, and the
+    // spectrum that they share
+    VecI external_reg_;
+    VecF external_strength_;
+    VecF external_spectrum_;
+
+    // External source of a single group, and the group it currently holds
+    ArrayB1 external_1g_;
+    int external_group_;
 
     // Single-group source. We use the Eigen storage class so that it can be
     // used directly as a source vector in a linear system.
     VectorX source_1g_;
 
+    // Source of the next group, built ahead of time by prepare_next()
+    VectorX next_1g_;
+
     // Reference to the MG flux variable. Need this to do scattering
     // contributions, etc.
     const ArrayB2 &flux_;
+
+    // Index of the XS mesh region that each region belongs to, or -1 if it
+    // is not covered by the XS mesh. Owned by the XS mesh.
+    const VecI &xsreg_;
+
+    // Runs of consecutive regions in the same XS mesh region. Owned by the
+    // XS mesh.
+    const VecI &xsreg_runs_;
 };
 
 typedef std::shared_ptr<Source> SP_Source_t;
@@ -56,7 +56,10 @@ UP_Source_t SourceFactory(const pugi::xml_node &input, int n_reg,
         source.reset(new SourceIsotropic(n_reg, xs_mesh, flux));
         break;
     case ScatteringTreatment::PN:
-        throw EXCEPT("Pn scattering not supported yet.");
+        // The flux moments belong to the sweeper, so only a sweeper that
+        // tracks them can make a Pn source
+        throw EXCEPT("Pn scattering is only supported by the MoC sweeper, "
+                     "with a scattering order on the <sweeper>.");
         break;
     default:
         throw EXCEPT("Unrecognized scattering treatment in <source />");
@@ -22,35 +22,18 @@ void SourceIsotropic::self_scatter(size_t ig, const ArrayB1 &xstr)
 {
     // Take a slice reference for this group's flux
     const ArrayB1 flux_1g = flux_(blitz::Range::all(), ig);
-    if (xstr.size() > 0) {
-        for (auto &xsr : *xs_mesh_) {
-            const ScatteringRow &scat_row = xsr.xsmacsc().to(ig);
-            real_t xssc                   = scat_row[ig];
-            real_t r_fpi_tr               = 1.0 / (xsr.xsmactr(ig) * FPI);
-            for (const int ireg : xsr.reg()) {
-                q_[ireg] = (source_1g_[ireg] + flux_1g(ireg) * xssc) * r_fpi_tr;
-            }
+    bool use_xstr    = xstr.size() > 0;
+    int g            = ig;
+    const real_t *tr = xs_mesh_->xstr(g);
+#pragma omp parallel for
+    for (int ireg = 0; ireg < n_reg_; ireg++) {
+        int ixs = xsreg_[ireg];
+        if (ixs < 0) {
+            continue;
         }
-    } else {
-        real_t r_fpi = 1.0 / (FPI);
-        for (auto &xsr : *xs_mesh_) {
-            const ScatteringRow &scat_row = xsr.xsmacsc().to(ig);
-            real_t xssc                   = scat_row[ig];
-            for (const int ireg : xsr.reg()) {
-                q_[ireg] = (source_1g_[ireg] + flux_1g(ireg) * xssc) * r_fpi;
-            }
-        }
-    }
-
-    // Check to make sure that the source is positive
-    bool any = false;
-    for (int i = 0; i < q_.size(); i++) {
-        if (q_[i] < 0.0) {
-            any = true;
-        }
-    }
-    if (any) {
-        //  throw EXCEPT("Negative source!");
+        real_t xssc  = xs_mesh_->self_scat(g, ixs);
+        real_t r_fpi = use_xstr ? 1.0 / (tr[ixs] * FPI) : 1.0 / FPI;
+        q_[ireg]     = (source_1g_[ireg] + flux_1g(ireg) * xssc) * r_fpi;
     }
 
     return;
@@ -39,6 +39,11 @@ public:
         return q_;
     }
 
+    size_t memory() const override
+    {
+        return Source::memory() + bytes(q_);
+    }
+
 protected:
     // The source, including self-scatter. This is stored separately from
     // source_1g_ so that the self_scatter method may be called multiple
@@ -0,0 +1,136 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include "core/source_linear.hpp"
+
+#include <algorithm>
+#include "core/constants.hpp"
+
+namespace mocc {
+SourceLinear::SourceLinear(int nreg, const XSMesh *xs_mesh,
+                           const ArrayB2 &flux, const ArrayB2 &flux_x,
+                           const ArrayB2 &flux_y)
+    : SourceIsotropic(nreg, xs_mesh, flux),
+      flux_x_(flux_x),
+      flux_y_(flux_y),
+      source_x_(nreg),
+      source_y_(nreg),
+      q_x_(nreg),
+      q_y_(nreg)
+{
+    assert(flux_x_.size() == flux_.size());
+    assert(flux_y_.size() == flux_.size());
+    source_x_.fill(0.0);
+    source_y_.fill(0.0);
+    q_x_.fill(0.0);
+    q_y_.fill(0.0);
+    return;
+}
+
+void SourceLinear::initialize_group(int ig)
+{
+    SourceIsotropic::initialize_group(ig);
+    source_x_.fill(0.0);
+    source_y_.fill(0.0);
+    return;
+}
+
+void SourceLinear::fission(const ArrayB1 &fs, int ig)
+{
+    SourceIsotropic::fission(fs, ig);
+
+#pragma omp parallel for
+    for (int ireg = 0; ireg < n_reg_; ireg++) {
+        int ixs = xsreg_[ireg];
+        if (ixs < 0) {
+            continue;
+        }
+        const XSMeshRegion &xsr = (*xs_mesh_)[ixs];
+        real_t rate             = 0.0;
+        real_t rate_x           = 0.0;
+        real_t rate_y           = 0.0;
+        for (int igg = 0; igg < n_group_; igg++) {
+            real_t nf = xsr.xsmacnf(igg);
+            rate += nf * flux_(ireg, igg);
+            rate_x += nf * flux_x_(ireg, igg);
+            rate_y += nf * flux_y_(ireg, igg);
+        }
+        if (rate <= 0.0) {
+            continue;
+        }
+        real_t f = xsr.xsmacch(ig) * fs(ireg) / rate;
+        source_x_[ireg] += f * rate_x;
+        source_y_[ireg] += f * rate_y;
+    }
+
+    return;
+}
+
+void SourceLinear::in_scatter(size_t ig, const ArrayB2 &flux)
+{
+    SourceIsotropic::in_scatter(ig, flux);
+
+    // Same as the scalar in-scatter, but applied to the flux moments
+    int g = ig;
+#pragma omp parallel for
+    for (int ireg = 0; ireg < n_reg_; ireg++) {
+        int ixs = xsreg_[ireg];
+        if (ixs < 0) {
+            continue;
+        }
+        const ScatteringRow scat_row = xs_mesh_->scat_row(g, ixs);
+        const real_t *sc             = scat_row.from;
+        int min_g                    = scat_row.min_g;
+        int max_g                    = scat_row.max_g;
+        real_t scat_x                = 0.0;
+        real_t scat_y                = 0.0;
+        for (int igg = min_g; igg <= max_g; igg++) {
+            if (igg == g) {
+                continue;
+            }
+            scat_x += sc[igg - min_g] * flux_x_(ireg, igg);
+            scat_y += sc[igg - min_g] * flux_y_(ireg, igg);
+        }
+        source_x_[ireg] += scat_x;
+        source_y_[ireg] += scat_y;
+    }
+
+    return;
+}
+
+void SourceLinear::self_scatter(size_t ig, const ArrayB1 &xstr)
+{
+    SourceIsotropic::self_scatter(ig, xstr);
+
+    bool use_xstr    = xstr.size() > 0;
+    int g            = ig;
+    const real_t *tr = xs_mesh_->xstr(g);
+#pragma omp parallel for
+    for (int ireg = 0; ireg < n_reg_; ireg++) {
+        int ixs = xsreg_[ireg];
+        if (ixs < 0) {
+            continue;
+        }
+        real_t xssc  = xs_mesh_->self_scat(g, ixs);
+        real_t r_fpi = use_xstr ? 1.0 / (tr[ixs] * FPI) : 1.0 / FPI;
+        q_x_[ireg]   = (source_x_[ireg] + flux_x_(ireg, g) * xssc) * r_fpi;
+        q_y_[ireg]   = (source_y_[ireg] + flux_y_(ireg, g) * xssc) * r_fpi;
+    }
+
+    return;
+}
+}
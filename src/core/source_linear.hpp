@@ -0,0 +1,92 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#pragma once
+
+#include "core/source_isotropic.hpp"
+
+namespace mocc {
+/**
+ * This extends the \ref SourceIsotropic to carry the first spatial moments
+ * of the source in each region, for use by sweepers with a linear source
+ * expansion.
+ *
+ * The moments are \f$\frac{1}{V}\int_V (\vec{r} - \vec{r}_c) Q(\vec{r})
+ * dV\f$, about the centroid of each region, and are built from the
+ * corresponding moments of the scalar flux, which are owned by the sweeper.
+ * Only the fission and scattering sources have moments; external and
+ * auxiliary sources are treated as flat.
+ *
+ * Since the fission source is handed down already scaled by the eigenvalue,
+ * the fission moments are scaled the same way, as the ratio of the passed
+ * fission source to the fission rate of the current flux.
+ */
+class SourceLinear : public SourceIsotropic {
+public:
+    SourceLinear(int nreg, const XSMesh *xs_mesh, const ArrayB2 &flux,
+                 const ArrayB2 &flux_x, const ArrayB2 &flux_y);
+
+    void initialize_group(int ig) override;
+
+    void fission(const ArrayB1 &fs, int ig) override;
+
+    void in_scatter(size_t ig, const ArrayB2 &flux) override;
+
+    void self_scatter(size_t ig, const ArrayB1 &xstr = ArrayB1(0)) override;
+
+    /**
+     * The source moments are only built along with the flat source, so the
+     * source can't be built ahead of time.
+     */
+    bool can_prepare_next() const override
+    {
+        return false;
+    }
+
+    /**
+     * \brief Return the x or y moment of the source, as it should be used in
+     * a transport sweeper.
+     *
+     * These are scaled the same way as \ref get_transport(), and include
+     * self-scatter.
+     */
+    const VectorX &get_transport_moment(int dir) const
+    {
+        assert((dir == 0) || (dir == 1));
+        return dir == 0 ? q_x_ : q_y_;
+    }
+
+    size_t memory() const override
+    {
+        return SourceIsotropic::memory() + bytes(source_x_) +
+               bytes(source_y_) + bytes(q_x_) + bytes(q_y_);
+    }
+
+protected:
+    // Spatial moments of the MG scalar flux, in the same layout as flux_
+    const ArrayB2 &flux_x_;
+    const ArrayB2 &flux_y_;
+
+    // Single-group source moments, without self-scatter
+    VectorX source_x_;
+    VectorX source_y_;
+
+    // Single-group source moments, with self-scatter
+    VectorX q_x_;
+    VectorX q_y_;
+};
+}
@@ -0,0 +1,108 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "core/source_pn.hpp"
+
+#include <algorithm>
+#include "core/constants.hpp"
+
+namespace mocc {
+SourcePn::SourcePn(int nreg, const XSMesh *xs_mesh, const ArrayB2 &flux,
+                   const SphericalHarmonics &harmonics,
+                   const std::vector<ArrayB2> &flux_pn)
+    : SourceIsotropic(nreg, xs_mesh, flux),
+      flux_pn_(flux_pn),
+      n_mom_(harmonics.size() - 1),
+      source_pn_(nreg * n_mom_, 0.0),
+      q_pn_(nreg * n_mom_, 0.0)
+{
+    assert((int)flux_pn_.size() == n_mom_);
+    for (int k = 1; k < harmonics.size(); k++) {
+        l_.push_back(harmonics.l(k));
+    }
+    return;
+}
+
+void SourcePn::initialize_group(int ig)
+{
+    SourceIsotropic::initialize_group(ig);
+    std::fill(source_pn_.begin(), source_pn_.end(), 0.0);
+    return;
+}
+
+void SourcePn::in_scatter(size_t ig, const ArrayB2 &flux)
+{
+    SourceIsotropic::in_scatter(ig, flux);
+
+    // Same as the scalar in-scatter, but with the matrix of each moment's
+    // degree, applied to the flux moments
+    int g = ig;
+#pragma omp parallel for
+    for (int ireg = 0; ireg < n_reg_; ireg++) {
+        int ixs = xsreg_[ireg];
+        if (ixs < 0) {
+            continue;
+        }
+        const XSMeshRegion &xsr = (*xs_mesh_)[ixs];
+        for (int k = 0; k < n_mom_; k++) {
+            int l = l_[k];
+            if (l > xsr.scat_order()) {
+                continue;
+            }
+            const ScatteringRow &row = xsr.xsmacsc_pn(l).to(g);
+            const ArrayB2 &flux_k    = flux_pn_[k];
+            real_t scat              = 0.0;
+            for (int igg = row.min_g; igg <= row.max_g; igg++) {
+                if (igg == g) {
+                    continue;
+                }
+                scat += row[igg] * flux_k(ireg, igg);
+            }
+            source_pn_[ireg * n_mom_ + k] += scat;
+        }
+    }
+
+    return;
+}
+
+void SourcePn::self_scatter(size_t ig, const ArrayB1 &xstr)
+{
+    SourceIsotropic::self_scatter(ig, xstr);
+
+    bool use_xstr    = xstr.size() > 0;
+    int g            = ig;
+    const real_t *tr = xs_mesh_->xstr(g);
+#pragma omp parallel for
+    for (int ireg = 0; ireg < n_reg_; ireg++) {
+        int ixs = xsreg_[ireg];
+        if (ixs < 0) {
+            continue;
+        }
+        const XSMeshRegion &xsr = (*xs_mesh_)[ixs];
+        real_t r_fpi = use_xstr ? 1.0 / (tr[ixs] * FPI) : 1.0 / FPI;
+        for (int k = 0; k < n_mom_; k++) {
+            int l       = l_[k];
+            real_t xssc = l > xsr.scat_order() ? 0.0
+                                               : xsr.xsmacsc_pn(l).to(g)[g];
+            int i   = ireg * n_mom_ + k;
+            q_pn_[i] = (source_pn_[i] + flux_pn_[k](ireg, g) * xssc) *
+                       (2 * l + 1) * r_fpi;
+        }
+    }
+
+    return;
+}
+}
@@ -0,0 +1,117 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <vector>
+#include "core/source_isotropic.hpp"
+#include "core/spherical_harmonics.hpp"
+
+namespace mocc {
+/**
+ * This extends the \ref SourceIsotropic to carry the anisotropic scattering
+ * source, as moments in the real spherical harmonics, for use by sweepers
+ * with Pn scattering.
+ *
+ * The angular flux moments \f$\phi_{lm} = \int R_{lm}(\Omega)\psi(\Omega)
+ * d\Omega\f$ are owned by the sweeper, one array for each harmonic above
+ * \f$R_{00}\f$, in the same layout as the scalar flux. The scattering source
+ * in direction \f$\Omega\f$ is then
+ * \f[
+ *      q(\Omega) = \sum_{lm} \frac{2l+1}{4\pi} R_{lm}(\Omega)
+ *      \sum_{g'} \Sigma_{s,l}^{g' \rightarrow g} \phi_{lm}^{g'},
+ * \f]
+ * where \f$\Sigma_{s,l}\f$ is the Legendre moment of order \f$l\f$ of the
+ * scattering kernel, as provided by \ref XSMeshRegion::xsmacsc_pn(). The
+ * \f$l = 0\f$ term is the usual isotropic source. Only the moments of the
+ * source are stored; the sweeper forms the source in each direction from
+ * them as needed.
+ *
+ * The fission, external and auxiliary sources are isotropic.
+ */
+class SourcePn : public SourceIsotropic {
+public:
+    /**
+     * \param nreg the number of regions
+     * \param xs_mesh the cross-section mesh
+     * \param flux the multi-group scalar flux
+     * \param harmonics the harmonics of the expansion
+     * \param flux_pn the multi-group flux moments for each harmonic, after
+     * \f$R_{00}\f$
+     */
+    SourcePn(int nreg, const XSMesh *xs_mesh, const ArrayB2 &flux,
+             const SphericalHarmonics &harmonics,
+             const std::vector<ArrayB2> &flux_pn);
+
+    void initialize_group(int ig) override;
+
+    void in_scatter(size_t ig, const ArrayB2 &flux) override;
+
+    void self_scatter(size_t ig, const ArrayB1 &xstr = ArrayB1(0)) override;
+
+    /**
+     * The source moments are only built along with the isotropic source, so
+     * the source can't be built ahead of time.
+     */
+    bool can_prepare_next() const override
+    {
+        return false;
+    }
+
+    /**
+     * \brief Return the number of anisotropic moments per region
+     */
+    int n_moments() const
+    {
+        return n_mom_;
+    }
+
+    /**
+     * \brief Return the anisotropic moments of the source, as they should be
+     * used in a transport sweeper
+     *
+     * These are the coefficients of the harmonics after \f$R_{00}\f$, stored
+     * with the moment index running fastest. They are scaled the same way as
+     * \ref get_transport(), including the \f$\frac{2l+1}{4\pi}\f$ factors,
+     * and include self-scatter, so that the source in direction
+     * \f$\Omega\f$ is simply \f$\bar{q} + \sum_k q_k R_k(\Omega)\f$.
+     */
+    const VecF &get_transport_moments() const
+    {
+        return q_pn_;
+    }
+
+    size_t memory() const override
+    {
+        return SourceIsotropic::memory() + bytes(source_pn_) + bytes(q_pn_);
+    }
+
+protected:
+    // Flux moments of each anisotropic harmonic, in the same layout as flux_
+    const std::vector<ArrayB2> &flux_pn_;
+
+    // Number of anisotropic moments, and the degree of each
+    int n_mom_;
+    VecI l_;
+
+    // Single-group source moments, [ireg * n_mom_ + k], without
+    // self-scatter
+    VecF source_pn_;
+
+    // Single-group source moments, with self-scatter and scaling
+    VecF q_pn_;
+};
+}
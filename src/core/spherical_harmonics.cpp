@@ -0,0 +1,92 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "core/spherical_harmonics.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include "util/error.hpp"
+
+namespace mocc {
+SphericalHarmonics::SphericalHarmonics(int order, bool z_symmetric)
+    : order_(order)
+{
+    if (order < 0) {
+        throw EXCEPT("Invalid order for the spherical harmonics");
+    }
+    for (int l = 0; l <= order; l++) {
+        for (int m = -l; m <= l; m++) {
+            if (z_symmetric && ((l + std::abs(m)) % 2 != 0)) {
+                continue;
+            }
+            l_.push_back(l);
+            m_.push_back(m);
+        }
+    }
+    return;
+}
+
+void SphericalHarmonics::evaluate(const Direction &dir, real_t *y) const
+{
+    const int n = order_ + 1;
+    const real_t mu = dir.oz;
+    const real_t st = std::sqrt(std::max(0.0, (1.0 - mu) * (1.0 + mu)));
+
+    // cos(m alpha) and sin(m alpha), by the angle-sum recurrence from the
+    // direction cosines
+    std::vector<real_t> cos_m(n, 1.0);
+    std::vector<real_t> sin_m(n, 0.0);
+    real_t ca = st > 0.0 ? dir.ox / st : 1.0;
+    real_t sa = st > 0.0 ? dir.oy / st : 0.0;
+    for (int m = 1; m < n; m++) {
+        cos_m[m] = cos_m[m - 1] * ca - sin_m[m - 1] * sa;
+        sin_m[m] = sin_m[m - 1] * ca + cos_m[m - 1] * sa;
+    }
+
+    // Associated Legendre functions, without the Condon-Shortley phase,
+    // P[l * n + m], by the usual recurrences in l
+    std::vector<real_t> p(n * n, 0.0);
+    real_t pmm = 1.0;
+    for (int m = 0; m < n; m++) {
+        p[m * n + m] = pmm;
+        if (m + 1 < n) {
+            p[(m + 1) * n + m] = mu * (2 * m + 1) * pmm;
+        }
+        for (int l = m + 2; l < n; l++) {
+            p[l * n + m] = ((2 * l - 1) * mu * p[(l - 1) * n + m] -
+                            (l + m - 1) * p[(l - 2) * n + m]) /
+                           (l - m);
+        }
+        pmm *= (2 * m + 1) * st;
+    }
+
+    for (int k = 0; k < this->size(); k++) {
+        int l  = l_[k];
+        int am = std::abs(m_[k]);
+
+        // (l - |m|)! / (l + |m|)!
+        real_t ratio = 1.0;
+        for (int i = l - am + 1; i <= l + am; i++) {
+            ratio /= i;
+        }
+        real_t norm = std::sqrt((am == 0 ? 1.0 : 2.0) * ratio);
+        real_t azi  = m_[k] >= 0 ? cos_m[am] : sin_m[am];
+        y[k]        = norm * p[l * n + am] * azi;
+    }
+
+    return;
+}
+} // namespace mocc
@@ -0,0 +1,95 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <vector>
+#include "util/global_config.hpp"
+#include "core/geometry/direction.hpp"
+
+namespace mocc {
+/**
+ * \brief Real spherical harmonics, for expanding angular quantities in
+ * Legendre moments
+ *
+ * The harmonic of degree \f$l\f$ and order \f$m\f$, for \f$-l \le m \le l\f$,
+ * is
+ * \f[
+ *      R_{lm}(\Omega) = \sqrt{(2 - \delta_{m0})\frac{(l-|m|)!}{(l+|m|)!}}
+ *      P_l^{|m|}(\mu) \begin{cases} \cos(m\alpha) & m \ge 0 \\
+ *      \sin(|m|\alpha) & m < 0 \end{cases},
+ * \f]
+ * with \f$\mu = \Omega_z\f$ and \f$\alpha\f$ the azimuthal angle. These are
+ * normalized so that \f$\sum_m R_{lm}(\Omega)R_{lm}(\Omega') =
+ * P_l(\Omega\cdot\Omega')\f$, and so \f$\frac{1}{4\pi}\int R_{lm}R_{l'm'}
+ * d\Omega = \frac{\delta_{ll'}\delta_{mm'}}{2l+1}\f$. \f$R_{00} = 1\f$, and
+ * the \f$l = 1\f$ harmonics are the direction cosines.
+ *
+ * When the problem is symmetric in z, as it is for the 2-D sweepers, the
+ * harmonics that are odd in \f$\mu\f$ (those with \f$l + m\f$ odd) have no
+ * moments, and may be left out.
+ */
+class SphericalHarmonics {
+public:
+    /**
+     * \brief Set up the harmonics up to degree \p order
+     *
+     * By default, this is just \f$R_{00}\f$.
+     *
+     * \param order the highest degree, \f$l\f$
+     * \param z_symmetric whether to leave out the harmonics that are odd in
+     * \f$\mu\f$
+     */
+    SphericalHarmonics(int order = 0, bool z_symmetric = true);
+
+    /**
+     * \brief Return the number of harmonics, including \f$R_{00}\f$
+     */
+    int size() const
+    {
+        return l_.size();
+    }
+
+    /**
+     * \brief Return the degree of harmonic \p k
+     */
+    int l(int k) const
+    {
+        return l_[k];
+    }
+
+    /**
+     * \brief Return the order of harmonic \p k
+     */
+    int m(int k) const
+    {
+        return m_[k];
+    }
+
+    /**
+     * \brief Evaluate all of the harmonics in direction \p dir, into \p y
+     *
+     * \p y must have room for \ref size() values. The harmonics are ordered by
+     * degree, then by order, from \f$-l\f$ to \f$l\f$.
+     */
+    void evaluate(const Direction &dir, real_t *y) const;
+
+private:
+    int order_;
+    std::vector<int> l_;
+    std::vector<int> m_;
+};
+} // namespace mocc
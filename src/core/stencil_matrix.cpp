@@ -0,0 +1,222 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "stencil_matrix.hpp"
+
+#include <cmath>
+#include "util/memory.hpp"
+
+namespace mocc {
+StencilMatrix::StencilMatrix(int nx, int ny, int nz)
+    : nx_(nx),
+      ny_(ny),
+      nz_(nz),
+      n_(nx * ny * nz),
+      diagonal_(n_, 0.0),
+      zero_(nx, 0.0)
+{
+    for (auto &c : coeff_) {
+        c.assign(n_, 0.0);
+    }
+    return;
+}
+
+void StencilMatrix::multiply(const VectorX &x, VectorX &y) const
+{
+    assert(x.size() == n_);
+    assert(y.size() == n_);
+
+    const int nxy     = nx_ * ny_;
+    const real_t *px  = x.data();
+    real_t *py        = y.data();
+    const real_t *d   = diagonal_.data();
+    const real_t *c_e = coeff_[(int)Surface::EAST].data();
+    const real_t *c_w = coeff_[(int)Surface::WEST].data();
+    const real_t *c_n = coeff_[(int)Surface::NORTH].data();
+    const real_t *c_s = coeff_[(int)Surface::SOUTH].data();
+    const real_t *c_t = coeff_[(int)Surface::TOP].data();
+    const real_t *c_b = coeff_[(int)Surface::BOTTOM].data();
+
+    // Work a row at a time. The rows of the neighbors in y and z are
+    // contiguous too, and are replaced by zeros past the domain boundary,
+    // where the coefficients are zero anyway.
+#pragma omp parallel for schedule(static)
+    for (int izy = 0; izy < nz_ * ny_; izy++) {
+        int iz           = izy / ny_;
+        int iy           = izy % ny_;
+        int row          = izy * nx_;
+        const real_t *x0 = px + row;
+        const real_t *xs = iy > 0 ? x0 - nx_ : zero_.data();
+        const real_t *xn = iy < ny_ - 1 ? x0 + nx_ : zero_.data();
+        const real_t *xb = iz > 0 ? x0 - nxy : zero_.data();
+        const real_t *xt = iz < nz_ - 1 ? x0 + nxy : zero_.data();
+        real_t *y0       = py + row;
+
+#pragma omp simd
+        for (int ix = 0; ix < nx_; ix++) {
+            int i  = row + ix;
+            y0[ix] = d[i] * x0[ix] + c_s[i] * xs[ix] + c_n[i] * xn[ix] +
+                     c_b[i] * xb[ix] + c_t[i] * xt[ix];
+        }
+#pragma omp simd
+        for (int ix = 0; ix < nx_ - 1; ix++) {
+            y0[ix] += c_e[row + ix] * x0[ix + 1];
+        }
+#pragma omp simd
+        for (int ix = 1; ix < nx_; ix++) {
+            y0[ix] += c_w[row + ix] * x0[ix - 1];
+        }
+    }
+
+    return;
+}
+
+int StencilMatrix::solve_bicgstab(const VectorX &b, VectorX &x, real_t tol,
+                                  int max_iter) const
+{
+    real_t b_norm = b.norm();
+    if (b_norm == 0.0) {
+        x.setZero();
+        return 0;
+    }
+
+    VectorX inv_diag(n_);
+    for (int i = 0; i < n_; i++) {
+        inv_diag[i] = 1.0 / diagonal_[i];
+    }
+
+    VectorX r(n_);
+    this->multiply(x, r);
+    r = b - r;
+    VectorX r0 = r;
+    VectorX p  = VectorX::Zero(n_);
+    VectorX v  = VectorX::Zero(n_);
+    VectorX y(n_);
+    VectorX z(n_);
+    VectorX s(n_);
+    VectorX t(n_);
+
+    real_t rho   = 1.0;
+    real_t alpha = 1.0;
+    real_t omega = 1.0;
+    int iter     = 0;
+    while ((r.norm() > tol * b_norm) && (iter < max_iter)) {
+        iter++;
+        real_t rho_new = r0.dot(r);
+        if (rho_new == 0.0) {
+            // Breakdown. Restart with the current residual.
+            r0      = r;
+            rho_new = r0.dot(r);
+            p.setZero();
+            v.setZero();
+            rho   = 1.0;
+            alpha = 1.0;
+            omega = 1.0;
+        }
+        real_t beta = (rho_new / rho) * (alpha / omega);
+        p           = r + beta * (p - omega * v);
+        y           = inv_diag.cwiseProduct(p);
+        this->multiply(y, v);
+        alpha = rho_new / r0.dot(v);
+        s     = r - alpha * v;
+        z     = inv_diag.cwiseProduct(s);
+        this->multiply(z, t);
+        real_t tt = t.dot(t);
+        omega     = tt > 0.0 ? t.dot(s) / tt : 0.0;
+        x += alpha * y + omega * z;
+        r   = s - omega * t;
+        rho = rho_new;
+        if (omega == 0.0) {
+            break;
+        }
+    }
+
+    return iter;
+}
+
+int StencilMatrix::solve_sor(const VectorX &b, VectorX &x, real_t omega,
+                             real_t tol, int max_iter) const
+{
+    assert((omega > 0.0) && (omega < 2.0));
+
+    real_t b_norm = b.norm();
+    if (b_norm == 0.0) {
+        x.setZero();
+        return 0;
+    }
+
+    const int nxy = nx_ * ny_;
+    VectorX r(n_);
+    int iter = 0;
+    while (iter < max_iter) {
+        iter++;
+
+        // Cells of one color only couple to cells of the other, so each half
+        // sweep may be done in parallel
+        for (int color = 0; color < 2; color++) {
+#pragma omp parallel for schedule(static)
+            for (int izy = 0; izy < nz_ * ny_; izy++) {
+                int iz  = izy / ny_;
+                int iy  = izy % ny_;
+                int row = izy * nx_;
+                for (int ix = (iy + iz + color) % 2; ix < nx_; ix += 2) {
+                    int i    = row + ix;
+                    real_t s = b[i];
+                    if (ix < nx_ - 1) {
+                        s -= coeff_[(int)Surface::EAST][i] * x[i + 1];
+                    }
+                    if (ix > 0) {
+                        s -= coeff_[(int)Surface::WEST][i] * x[i - 1];
+                    }
+                    if (iy < ny_ - 1) {
+                        s -= coeff_[(int)Surface::NORTH][i] * x[i + nx_];
+                    }
+                    if (iy > 0) {
+                        s -= coeff_[(int)Surface::SOUTH][i] * x[i - nx_];
+                    }
+                    if (iz < nz_ - 1) {
+                        s -= coeff_[(int)Surface::TOP][i] * x[i + nxy];
+                    }
+                    if (iz > 0) {
+                        s -= coeff_[(int)Surface::BOTTOM][i] * x[i - nxy];
+                    }
+                    x[i] = (1.0 - omega) * x[i] + omega * s / diagonal_[i];
+                }
+            }
+        }
+
+        // Checking the residual costs about as much as a sweep, so only do
+        // it every few iterations
+        if ((iter % 5 == 0) || (iter == max_iter)) {
+            this->multiply(x, r);
+            if ((b - r).norm() < tol * b_norm) {
+                break;
+            }
+        }
+    }
+
+    return iter;
+}
+
+size_t StencilMatrix::memory() const
+{
+    size_t n = bytes(diagonal_) + bytes(zero_);
+    for (const auto &c : coeff_) {
+        n += bytes(c);
+    }
+    return n;
+}
+}
@@ -0,0 +1,138 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <array>
+#include <cassert>
+
+#include "util/global_config.hpp"
+#include "constants.hpp"
+#include "eigen_interface.hpp"
+
+namespace mocc {
+/**
+ * \brief A seven-point stencil matrix on a structured nx x ny x nz mesh
+ *
+ * The matrix is stored as its diagonal, plus one array of coefficients for
+ * each \ref Surface, coupling each cell to its neighbor across that surface.
+ * Coefficients across the domain boundary must be zero. The cells are
+ * ordered x-fastest, then y, then z, as in \ref Mesh::coarse_cell().
+ *
+ * Compared to a general sparse matrix, no index storage is needed, and the
+ * matrix-vector product streams through contiguous arrays, so it vectorizes
+ * and is limited only by memory bandwidth. Since the mesh is structured,
+ * red-black ordering makes SOR parallel as well.
+ */
+class StencilMatrix {
+public:
+    StencilMatrix() : nx_(0), ny_(0), nz_(0), n_(0)
+    {
+        return;
+    }
+
+    StencilMatrix(int nx, int ny, int nz);
+
+    /**
+     * \brief Return the number of rows (cells)
+     */
+    int size() const
+    {
+        return n_;
+    }
+
+    real_t &diagonal(int i)
+    {
+        assert(i < n_);
+        return diagonal_[i];
+    }
+
+    real_t diagonal(int i) const
+    {
+        assert(i < n_);
+        return diagonal_[i];
+    }
+
+    /**
+     * \brief Return the coefficient coupling cell \p i to its neighbor
+     * across \p surf
+     */
+    real_t &coeff(int i, Surface surf)
+    {
+        assert(i < n_);
+        assert((int)surf < 6);
+        return coeff_[(int)surf][i];
+    }
+
+    real_t coeff(int i, Surface surf) const
+    {
+        assert(i < n_);
+        assert((int)surf < 6);
+        return coeff_[(int)surf][i];
+    }
+
+    /**
+     * \brief Compute \p y = A * \p x
+     */
+    void multiply(const VectorX &x, VectorX &y) const;
+
+    /**
+     * \brief Solve A x = b with Jacobi-preconditioned BiCGSTAB
+     *
+     * \param b the right-hand side
+     * \param [in,out] x the initial guess, replaced by the solution
+     * \param tol the relative residual to converge to
+     * \param max_iter the maximum number of iterations
+     *
+     * Returns the number of iterations performed.
+     */
+    int solve_bicgstab(const VectorX &b, VectorX &x, real_t tol,
+                       int max_iter) const;
+
+    /**
+     * \brief Solve A x = b with red-black successive over-relaxation
+     *
+     * \param b the right-hand side
+     * \param [in,out] x the initial guess, replaced by the solution
+     * \param omega the over-relaxation factor, in (0, 2)
+     * \param tol the relative residual to converge to
+     * \param max_iter the maximum number of iterations
+     *
+     * Returns the number of iterations performed.
+     */
+    int solve_sor(const VectorX &b, VectorX &x, real_t omega, real_t tol,
+                  int max_iter) const;
+
+    /**
+     * \brief Return the number of bytes used to store the matrix
+     */
+    size_t memory() const;
+
+private:
+    int nx_;
+    int ny_;
+    int nz_;
+    int n_;
+
+    VecF diagonal_;
+
+    // Coefficients, indexed by Surface, then cell
+    std::array<VecF, 6> coeff_;
+
+    // A row of zeros to stand in for the neighbors of boundary rows
+    VecF zero_;
+};
+}
@@ -0,0 +1,121 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+#include "util/aligned_allocator.hpp"
+#include "util/global_config.hpp"
+#include "util/omp_guard.h"
+
+namespace mocc {
+/**
+ * \brief Persistent, per-thread scratch storage for sweeper kernels
+ *
+ * Sweeper kernels need a handful of scratch arrays for each thread (e.g.
+ * exponentials and angular flux along a ray). Rather than allocating these
+ * every time a kernel is entered, a \ref SweepWorkspace is sized once,
+ * usually from the sweeper's \c initialize() method, and the kernel asks for
+ * the calling thread's buffers with \ref get().
+ *
+ * Each thread's storage is allocated and zeroed from within a parallel
+ * region by the thread that will use it, so that on first-touch NUMA systems
+ * it lands in that thread's local memory. The buffer size is padded to a
+ * whole number of cache lines, so that every buffer returned by \ref get()
+ * is cache-line aligned.
+ */
+class SweepWorkspace {
+public:
+    SweepWorkspace() : n_buffer_(0), size_(0)
+    {
+        return;
+    }
+
+    /**
+     * \brief Make sure that each thread has \p n_buffer buffers of at least
+     * \p size elements. This must be called outside of any parallel region.
+     *
+     * Storage is only reallocated if the number of threads grows or the
+     * existing buffers are too small, so that alternating between phases
+     * with different thread counts (see \ref ThreadTeam) doesn't reallocate.
+     */
+    void resize(int n_buffer, int size)
+    {
+        int n_thread = omp_get_max_threads();
+        if (((int)data_.size() >= n_thread) && (n_buffer <= n_buffer_) &&
+            (size <= size_)) {
+            return;
+        }
+        n_thread = std::max(n_thread, (int)data_.size());
+
+        const int line = CACHE_LINE / sizeof(real_t);
+        n_buffer_      = std::max(n_buffer, n_buffer_);
+        size_          = std::max(size, size_);
+        size_          = ((size_ + line - 1) / line) * line;
+        data_.clear();
+        data_.resize(n_thread);
+
+#pragma omp parallel default(shared) num_threads(n_thread)
+        {
+            // Zero-filling the storage does the first touch from the
+            // owning thread.
+            data_[omp_get_thread_num()] =
+                AlignedVecF(n_buffer_ * size_, 0.0);
+        }
+        return;
+    }
+
+    /**
+     * \brief Return the number of elements in each buffer
+     */
+    int size() const
+    {
+        return size_;
+    }
+
+    /**
+     * \brief Return the number of bytes allocated over all threads
+     */
+    size_t memory() const
+    {
+        size_t mem = 0;
+        for (const auto &d : data_) {
+            mem += d.size() * sizeof(real_t);
+        }
+        return mem;
+    }
+
+    /**
+     * \brief Return a pointer to the \p ibuf-th buffer of the calling thread
+     *
+     * The buffer is aligned to \ref CACHE_LINE bytes.
+     */
+    real_t *get(int ibuf)
+    {
+        assert(omp_get_thread_num() < (int)data_.size());
+        assert(ibuf < n_buffer_);
+        return data_[omp_get_thread_num()].data() + ibuf * size_;
+    }
+
+private:
+    int n_buffer_;
+    int size_;
+    std::vector<AlignedVecF> data_;
+};
+}
@@ -24,6 +24,7 @@
 #include "pugixml.hpp"
 
 #include "angular_quadrature.hpp"
+#include "spherical_harmonics.hpp"
 
 using namespace mocc;
 
@@ -76,6 +77,28 @@ public:
         }
     }
 
+    void test_rotate()
+    {
+        for (int iang = 0; iang < ang_quad.ndir(); iang++) {
+            const auto &angle = ang_quad[iang];
+            int cw            = ang_quad.rotate(iang, true);
+            int ccw           = ang_quad.rotate(iang, false);
+            CHECK(cw >= 0);
+            CHECK(ccw >= 0);
+            if ((cw < 0) || (ccw < 0)) {
+                continue;
+            }
+
+            CHECK_CLOSE(angle.oy, ang_quad[cw].ox, 0.0000000000001);
+            CHECK_CLOSE(-angle.ox, ang_quad[cw].oy, 0.0000000000001);
+            CHECK_CLOSE(angle.oz, ang_quad[cw].oz, 0.0000000000001);
+
+            // Rotating back should recover the original angle
+            CHECK_EQUAL(iang, ang_quad.rotate(cw, false));
+            CHECK_EQUAL(iang, ang_quad.rotate(ccw, true));
+        }
+    }
+
     real_t total_weight()
     {
         real_t wsum = 0.0;
@@ -130,6 +153,15 @@ public:
     }
 };
 
+class ChebyshevYamamoto_16_auto : public AngQuadFixture {
+public:
+    ChebyshevYamamoto_16_auto()
+    {
+        this->make_angquad("<ang_quad type=\"cy\" n_azimuthal=\"16\" "
+                           "n_polar=\"auto\" polar_tolerance=\"1e-3\" />");
+    }
+};
+
 class ChebyshevGauss_3_1 : public AngQuadFixture {
 public:
     ChebyshevGauss_3_1()
@@ -184,6 +216,9 @@ TEST_FIXTURE(LevelSymmetric_6, higher_order)
     // Test the angle reflection capabilities
     test_reflect();
 
+    // Level-symmetric quadratures are invariant under a quarter turn
+    test_rotate();
+
     // Other tests
     CHECK_EQUAL(6, ang_quad.ndir_oct());
     // Test the weight sum is 8.0
@@ -213,6 +248,15 @@ TEST_FIXTURE(ChebyshevYamamoto_16_3, cy_general)
     CHECK_CLOSE(6.000672075260800, ang_quad[0].rsintheta, 0.0000000000001);
 }
 
+TEST_FIXTURE(ChebyshevYamamoto_16_auto, cy_auto_polar)
+{
+    // One polar angle misses the tolerance, two meet it
+    CHECK_EQUAL(32, ang_quad.ndir_oct());
+    CHECK_CLOSE(8.0, total_weight(), 0.00000000000001);
+    CHECK_CLOSE(0.372451560619977, ang_quad[0].theta, 0.0000000000001);
+    CHECK(isValidOutput());
+}
+
 TEST_FIXTURE(ChebyshevGauss_16_3, cg_general)
 {
     // Test the angle reflection capabilities
@@ -256,6 +300,45 @@ TEST_FIXTURE(ChebyshevGauss_3_1, gc_update_wgt)
     CHECK_CLOSE(0.3125, ang_quad[2].weight, 0.00000000000001);
 }
 
+// The harmonics should be orthogonal under a quadrature that integrates their
+// products exactly
+TEST_FIXTURE(ChebyshevGauss_16_3, harmonics)
+{
+    for (bool z_symmetric : {false, true}) {
+        SphericalHarmonics harmonics(2, z_symmetric);
+        int n = harmonics.size();
+        CHECK_EQUAL(z_symmetric ? 6 : 9, n);
+
+        VecF y(n);
+        VecF product(n * n, 0.0);
+        for (const auto &angle : ang_quad) {
+            harmonics.evaluate(angle, y.data());
+            for (int k = 0; k < n; k++) {
+                for (int q = 0; q < n; q++) {
+                    product[k * n + q] += angle.weight * y[k] * y[q] / 8.0;
+                }
+            }
+        }
+
+        for (int k = 0; k < n; k++) {
+            for (int q = 0; q < n; q++) {
+                real_t expected =
+                    k == q ? 1.0 / (2 * harmonics.l(k) + 1) : 0.0;
+                CHECK_CLOSE(expected, product[k * n + q], 1.0e-12);
+            }
+        }
+    }
+
+    // The first-degree harmonics are the direction cosines
+    SphericalHarmonics harmonics(1, false);
+    VecF y(harmonics.size());
+    harmonics.evaluate(ang_quad[0], y.data());
+    CHECK_CLOSE(1.0, y[0], 1.0e-14);
+    CHECK_CLOSE(ang_quad[0].oy, y[1], 1.0e-14);
+    CHECK_CLOSE(ang_quad[0].oz, y[2], 1.0e-14);
+    CHECK_CLOSE(ang_quad[0].ox, y[3], 1.0e-14);
+}
+
 int main()
 {
     return UnitTest::RunAllTests();
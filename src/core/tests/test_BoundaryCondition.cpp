@@ -132,6 +132,133 @@ TEST_FIXTURE(BCIrregularFixture, test_bc)
     std::cout << in << std::endl;
 }
 
+TEST_FIXTURE(BCIrregularFixture, test_checkpoint)
+{
+    ArrayB1 spectrum(2);
+    spectrum(0) = 1.1111;
+    spectrum(1) = 5.5555;
+    in.initialize_spectrum(spectrum);
+
+    H5Node h5f("test_bc_checkpoint.h5", H5Access::MEMORY);
+    in.write(h5f, "bc");
+
+    BoundaryCondition restored(in);
+    restored.initialize_scalar(0.0);
+    restored.read(h5f, "bc");
+    for (int ig = 0; ig < ngroup; ig++) {
+        for (int ia = 0; ia < nang; ia++) {
+            auto face = restored.get_face(ig, ia, Normal::Y_NORM);
+            for (int ibc = 0; ibc < face.first; ibc++) {
+                CHECK_EQUAL(spectrum(ig), face.second[ibc]);
+            }
+        }
+    }
+
+    // A boundary condition of the wrong size should refuse the data
+    CHECK_THROW(out.read(h5f, "bc"), Exception);
+}
+
+TEST_FIXTURE(BCIrregularFixture, test_double_buffer)
+{
+    BoundaryCondition ref(in);
+    in.enable_double_buffer();
+    CHECK(in.double_buffered());
+    CHECK(!ref.double_buffered());
+    CHECK_EQUAL(192, in.size());
+
+    in.initialize_scalar(1.0);
+    ref.initialize_scalar(1.0);
+    out.initialize_scalar(0.0);
+
+    // Sweeping into the spare storage and swapping it in should give the
+    // same result as a Jacobi update
+    for (int ia = 0; ia < nang; ia++) {
+        for (auto norm : {Normal::X_NORM, Normal::Y_NORM}) {
+            auto face    = out.get_face(0, ia, norm);
+            real_t *next = in.next_face(ia, norm);
+            CHECK(next != nullptr);
+            for (int i = 0; i < face.first; i++) {
+                face.second[i] = 100.0 * ia + 10.0 * (int)norm + i;
+                next[i]        = face.second[i];
+            }
+        }
+    }
+    ref.update(1, out);
+    in.swap_next(1);
+
+    H5Node h5f("test_bc_double_buffer.h5", H5Access::MEMORY);
+    in.write(h5f, "bc");
+    BoundaryCondition restored(ref);
+    restored.read(h5f, "bc");
+
+    for (int ig = 0; ig < ngroup; ig++) {
+        for (int ia = 0; ia < nang; ia++) {
+            for (auto norm : {Normal::X_NORM, Normal::Y_NORM}) {
+                auto face     = in.get_face(ig, ia, norm);
+                auto ref_face = ref.get_face(ig, ia, norm);
+                auto r_face   = restored.get_face(ig, ia, norm);
+                for (int i = 0; i < face.first; i++) {
+                    CHECK_EQUAL(ref_face.second[i], face.second[i]);
+                    CHECK_EQUAL(ref_face.second[i], r_face.second[i]);
+                }
+            }
+        }
+    }
+}
+
+TEST_FIXTURE(BCIrregularFixture, test_packed)
+{
+    BoundaryCondition ref(in);
+    in.enable_packed_storage(1);
+    CHECK(in.packed());
+    CHECK(!ref.packed());
+
+    ArrayB1 spectrum(2);
+    spectrum(0) = 0.25;
+    spectrum(1) = 1.0 / 3.0;
+    in.initialize_spectrum(spectrum);
+    ref.initialize_spectrum(spectrum);
+    out.initialize_scalar(0.0);
+
+    // Update group 1, which starts out packed
+    for (int ia = 0; ia < nang; ia++) {
+        auto face = out.get_face(0, ia, Normal::X_NORM);
+        for (int i = 0; i < face.first; i++) {
+            face.second[i] = 0.1 * (ia + 1) + i;
+        }
+    }
+    in.load(1);
+    in.update(1, out);
+    ref.update(1, out);
+
+    // Swapping group 1 out rounds it to single precision, but the resident
+    // group keeps its full precision
+    in.load(0);
+    for (int ia = 0; ia < nang; ia++) {
+        auto face     = in.get_face(0, ia, Normal::Y_NORM);
+        auto ref_face = ref.get_face(0, ia, Normal::Y_NORM);
+        for (int i = 0; i < face.first; i++) {
+            CHECK_EQUAL(ref_face.second[i], face.second[i]);
+        }
+    }
+    VecF values(in.size_per_group());
+    VecF ref_values(ref.size_per_group());
+    in.copy_group(1, values.data());
+    ref.copy_group(1, ref_values.data());
+    for (int i = 0; i < in.size_per_group(); i++) {
+        CHECK_CLOSE(ref_values[i], values[i], 1.0e-6 * ref_values[i]);
+    }
+
+    // Checkpoints carry the groups in order, wherever they are stored
+    H5Node h5f("test_bc_packed.h5", H5Access::MEMORY);
+    in.write(h5f, "bc");
+    ref.read(h5f, "bc");
+    ref.copy_group(1, ref_values.data());
+    for (int i = 0; i < in.size_per_group(); i++) {
+        CHECK_EQUAL(values[i], ref_values[i]);
+    }
+}
+
 int main()
 {
     return UnitTest::RunAllTests();
@@ -16,13 +16,20 @@
 
 #include "UnitTest++/UnitTest++.h"
 
+#include <cmath>
 #include <memory>
+#include <string>
+#include <vector>
 
 #include "pugixml.hpp"
 
 #include "core/tests/pugi_utils.hpp"
 
 #include "core/cmfd.hpp"
+#include "core/cmfd_preconditioner.hpp"
+#include "core/gmres.hpp"
+#include "core/recycled_subspace.hpp"
+#include "core/stencil_matrix.hpp"
 #include "core/xs_mesh_homogenized.hpp"
 
 using namespace mocc;
@@ -50,6 +57,338 @@ TEST(testCMFD)
     std::cout << k << std::endl;
 }
 
+// The different eigenvalue solvers and preconditioners should all converge to
+// the same eigenvalue
+TEST(CMFD_solvers)
+{
+    auto mesh_xml = inline_xml_file("3x5.xml");
+    CoreMesh mesh(*mesh_xml);
+
+    std::shared_ptr<XSMeshHomogenized> xsmesh(
+        std::make_shared<XSMeshHomogenized>(mesh));
+
+    std::vector<std::string> options = {
+        "", "preconditioner=\"multigrid\"", "eigen_solver=\"wielandt\"",
+        "multilevel=\"t\"", "energy_groups=\"1 1 1 1 1 1 1\"",
+        "operator=\"stencil\"",
+        "operator=\"stencil\" stencil_solver=\"sor\"", "pcmfd=\"t\"",
+        "operator=\"stencil\" offload=\"t\"", "direct_cells=\"0\"",
+        "energy_sweep=\"jacobi\"",
+        "operator=\"stencil\" energy_sweep=\"red-black\""};
+    VecF k_result;
+    for (const auto &option : options) {
+        std::string input = "<cmfd k_tol=\"1e-10\" "
+                            "psi_tol=\"1e-8\" "
+                            "max_iter=\"500\" " +
+                            option + " />";
+        auto cmfd_xml = inline_xml(input.c_str());
+        CMFD cmfd(*cmfd_xml, &mesh, xsmesh);
+
+        real_t k = 1.0;
+        cmfd.solve(k);
+        k_result.push_back(k);
+    }
+
+    CHECK_CLOSE(k_result[0], k_result[1], 1.0e-6);
+    CHECK_CLOSE(k_result[0], k_result[2], 1.0e-6);
+    CHECK_CLOSE(k_result[0], k_result[3], 1.0e-6);
+    CHECK_CLOSE(k_result[0], k_result[4], 1.0e-6);
+    CHECK_CLOSE(k_result[0], k_result[5], 1.0e-6);
+    CHECK_CLOSE(k_result[0], k_result[6], 1.0e-6);
+    CHECK_CLOSE(k_result[0], k_result[7], 1.0e-6);
+    CHECK_CLOSE(k_result[0], k_result[8], 1.0e-6);
+    CHECK_CLOSE(k_result[0], k_result[9], 1.0e-6);
+    CHECK_CLOSE(k_result[0], k_result[10], 1.0e-6);
+    CHECK_CLOSE(k_result[0], k_result[11], 1.0e-6);
+}
+
+// Condensing to fewer groups should still give a sensible eigenvalue, and the
+// coarse groups have to add up to the fine groups
+TEST(CMFD_few_group)
+{
+    auto mesh_xml = inline_xml_file("3x5.xml");
+    CoreMesh mesh(*mesh_xml);
+
+    std::shared_ptr<XSMeshHomogenized> xsmesh(
+        std::make_shared<XSMeshHomogenized>(mesh));
+
+    auto cmfd_xml = inline_xml("<cmfd k_tol=\"1e-10\" psi_tol=\"1e-8\" "
+                               "max_iter=\"500\" energy_groups=\"3 4\" />");
+    CMFD cmfd(*cmfd_xml, &mesh, xsmesh);
+    real_t k = 1.0;
+    cmfd.solve(k);
+    CHECK(k > 0.0);
+    CHECK(std::isfinite(k));
+
+    auto bad_xml = inline_xml("<cmfd energy_groups=\"3 3\" />");
+    CHECK_THROW(CMFD(*bad_xml, &mesh, xsmesh), Exception);
+}
+
+// CMFD on cells coarser than the pins should still give a sensible
+// eigenvalue, with no more cells across an assembly than it has pins
+TEST(CMFD_coarse_mesh)
+{
+    auto mesh_xml = inline_xml_file("3x5.xml");
+    CoreMesh mesh(*mesh_xml);
+
+    std::shared_ptr<XSMeshHomogenized> xsmesh(
+        std::make_shared<XSMeshHomogenized>(mesh));
+
+    for (const char *option :
+         {"assembly_cells=\"1 1\"",
+          "assembly_cells=\"1 1\" energy_groups=\"3 4\""}) {
+        std::string input = "<cmfd k_tol=\"1e-10\" psi_tol=\"1e-8\" "
+                            "max_iter=\"500\" " +
+                            std::string(option) + " />";
+        auto cmfd_xml = inline_xml(input.c_str());
+        CMFD cmfd(*cmfd_xml, &mesh, xsmesh);
+        real_t k = 1.0;
+        cmfd.solve(k);
+        CHECK(k > 0.0);
+        CHECK(std::isfinite(k));
+    }
+
+    auto bad_xml = inline_xml("<cmfd assembly_cells=\"0 1\" />");
+    CHECK_THROW(CMFD(*bad_xml, &mesh, xsmesh), Exception);
+    bad_xml = inline_xml("<cmfd assembly_cells=\"1000 1\" />");
+    CHECK_THROW(CMFD(*bad_xml, &mesh, xsmesh), Exception);
+}
+
+// Unknown linear solver backends, and those not built in, should be rejected
+TEST(CMFD_backend)
+{
+    auto mesh_xml = inline_xml_file("3x5.xml");
+    CoreMesh mesh(*mesh_xml);
+
+    std::shared_ptr<XSMeshHomogenized> xsmesh(
+        std::make_shared<XSMeshHomogenized>(mesh));
+
+    auto bad_xml = inline_xml("<cmfd backend=\"magic\" />");
+    CHECK_THROW(CMFD(*bad_xml, &mesh, xsmesh), Exception);
+#ifndef MOCC_USE_PETSC
+    bad_xml = inline_xml("<cmfd backend=\"petsc\" />");
+    CHECK_THROW(CMFD(*bad_xml, &mesh, xsmesh), Exception);
+#endif
+}
+
+// The fixed-source solution should be positive and scale with the source
+TEST(CMFD_fixed_source)
+{
+    auto mesh_xml = inline_xml_file("3x5.xml");
+    CoreMesh mesh(*mesh_xml);
+
+    std::shared_ptr<XSMeshHomogenized> xsmesh(
+        std::make_shared<XSMeshHomogenized>(mesh));
+
+    auto cmfd_xml = inline_xml("<cmfd psi_tol=\"1e-10\" max_iter=\"500\" "
+                               "residual_reduction=\"1e-10\" />");
+    CMFD cmfd(*cmfd_xml, &mesh, xsmesh);
+
+    ArrayB2 q(cmfd.flux().shape());
+    q                         = 0.0;
+    q(blitz::Range::all(), 0) = 1.0;
+
+    cmfd.solve_fixed_source(q);
+    ArrayB2 flux(cmfd.flux().shape());
+    flux = cmfd.flux();
+    CHECK(blitz::min(flux) >= 0.0);
+    CHECK(blitz::max(flux) > 0.0);
+
+    q *= 2.0;
+    cmfd.solve_fixed_source(q);
+    for (int i = 0; i < (int)flux.size(); i++) {
+        CHECK_CLOSE(2.0 * flux.data()[i], cmfd.flux().data()[i],
+                    1.0e-6 * blitz::max(flux));
+    }
+}
+
+// A multigrid-preconditioned solve of a simple diffusion problem
+TEST(CMFD_multigrid)
+{
+    int nx = 13;
+    int ny = 10;
+    int nz = 5;
+    int n  = nx * ny * nz;
+
+    typedef Eigen::Triplet<real_t> T;
+    std::vector<T> entries;
+    for (int iz = 0; iz < nz; iz++) {
+        for (int iy = 0; iy < ny; iy++) {
+            for (int ix = 0; ix < nx; ix++) {
+                int i = ix + nx * (iy + ny * iz);
+                entries.push_back(T(i, i, 6.1));
+                if (ix > 0) {
+                    entries.push_back(T(i, i - 1, -1.0));
+                }
+                if (ix < nx - 1) {
+                    entries.push_back(T(i, i + 1, -1.0));
+                }
+                if (iy > 0) {
+                    entries.push_back(T(i, i - nx, -1.0));
+                }
+                if (iy < ny - 1) {
+                    entries.push_back(T(i, i + nx, -1.0));
+                }
+                if (iz > 0) {
+                    entries.push_back(T(i, i - nx * ny, -1.0));
+                }
+                if (iz < nz - 1) {
+                    entries.push_back(T(i, i + nx * ny, -1.0));
+                }
+            }
+        }
+    }
+    Eigen::SparseMatrix<real_t> m(n, n);
+    m.setFromTriplets(entries.begin(), entries.end());
+
+    Eigen::BiCGSTAB<Eigen::SparseMatrix<real_t>, CMFDPreconditioner> solver;
+    solver.preconditioner().configure(CMFDPreconditioner::Type::MULTIGRID, nx,
+                                      ny, nz);
+    solver.setTolerance(1.0e-10);
+    solver.compute(m);
+    CHECK(solver.preconditioner().n_level() > 1);
+
+    VectorX b = VectorX::Ones(n);
+    VectorX x = solver.solve(b);
+    CHECK(solver.info() == Eigen::Success);
+    CHECK((m * x - b).norm() / b.norm() < 1.0e-8);
+
+    // Mesh dimensions must match the matrix
+    solver.preconditioner().configure(CMFDPreconditioner::Type::MULTIGRID, nx,
+                                      ny, nz + 1);
+    CHECK_THROW(solver.compute(m), Exception);
+}
+
+// The stencil matrix should behave just like the equivalent sparse matrix
+TEST(CMFD_stencil)
+{
+    int nx = 13;
+    int ny = 10;
+    int nz = 5;
+    int n  = nx * ny * nz;
+
+    StencilMatrix stencil(nx, ny, nz);
+    typedef Eigen::Triplet<real_t> T;
+    std::vector<T> entries;
+    for (int iz = 0; iz < nz; iz++) {
+        for (int iy = 0; iy < ny; iy++) {
+            for (int ix = 0; ix < nx; ix++) {
+                int i = ix + nx * (iy + ny * iz);
+                std::vector<std::pair<Surface, int>> neighbors;
+                if (ix > 0) {
+                    neighbors.push_back({Surface::WEST, i - 1});
+                }
+                if (ix < nx - 1) {
+                    neighbors.push_back({Surface::EAST, i + 1});
+                }
+                if (iy > 0) {
+                    neighbors.push_back({Surface::SOUTH, i - nx});
+                }
+                if (iy < ny - 1) {
+                    neighbors.push_back({Surface::NORTH, i + nx});
+                }
+                if (iz > 0) {
+                    neighbors.push_back({Surface::BOTTOM, i - nx * ny});
+                }
+                if (iz < nz - 1) {
+                    neighbors.push_back({Surface::TOP, i + nx * ny});
+                }
+
+                // Make it non-symmetric
+                real_t diag         = 6.1 + 0.01 * i;
+                stencil.diagonal(i) = diag;
+                entries.push_back(T(i, i, diag));
+                for (const auto &nb : neighbors) {
+                    real_t v                   = -1.0 - 0.1 * (int)nb.first;
+                    stencil.coeff(i, nb.first) = v;
+                    entries.push_back(T(i, nb.second, v));
+                }
+            }
+        }
+    }
+    Eigen::SparseMatrix<real_t> m(n, n);
+    m.setFromTriplets(entries.begin(), entries.end());
+
+    VectorX x = VectorX::Random(n);
+    VectorX y(n);
+    stencil.multiply(x, y);
+    CHECK((y - m * x).norm() / y.norm() < 1.0e-12);
+
+    VectorX b = VectorX::Ones(n);
+    x         = VectorX::Zero(n);
+    stencil.solve_bicgstab(b, x, 1.0e-10, 500);
+    CHECK((m * x - b).norm() / b.norm() < 1.0e-8);
+
+    x = VectorX::Zero(n);
+    stencil.solve_sor(b, x, 1.5, 1.0e-10, 5000);
+    CHECK((m * x - b).norm() / b.norm() < 1.0e-8);
+
+    // Matrix-free GMRES, with and without restarts
+    auto op = [&](const VectorX &v, VectorX &w) { stencil.multiply(v, w); };
+    for (int restart : {5, 50}) {
+        x = VectorX::Zero(n);
+        int n_op = gmres(op, b, x, 1.0e-10, 500, restart);
+        CHECK(n_op < 500);
+        CHECK((m * x - b).norm() / b.norm() < 1.0e-8);
+    }
+}
+
+// The recycled guess should never make the residual worse, and should solve
+// a system exactly if its solution is in the span of the basis
+TEST(CMFD_recycle)
+{
+    int n = 50;
+    typedef Eigen::Triplet<real_t> T;
+    auto make_matrix = [n](real_t diag) {
+        std::vector<T> entries;
+        for (int i = 0; i < n; i++) {
+            entries.push_back(T(i, i, diag + 0.01 * i));
+            if (i > 0) {
+                entries.push_back(T(i, i - 1, -1.0));
+            }
+            if (i < n - 1) {
+                entries.push_back(T(i, i + 1, -1.1));
+            }
+        }
+        Eigen::SparseMatrix<real_t> m(n, n);
+        m.setFromTriplets(entries.begin(), entries.end());
+        return m;
+    };
+    Eigen::SparseMatrix<real_t> m1 = make_matrix(3.0);
+    Eigen::SparseMatrix<real_t> m2 = make_matrix(3.05);
+
+    RecycledSubspace recycle(2);
+    CHECK_EQUAL(0, recycle.size());
+
+    VectorX b = VectorX::Random(n);
+    VectorX x1 = Eigen::SparseLU<Eigen::SparseMatrix<real_t>>(m1).solve(b);
+    recycle.add(x1);
+    recycle.add(2.0 * x1);
+    CHECK_EQUAL(1, recycle.size());
+
+    LinearOperator op1 = [&](const VectorX &u, VectorX &y) { y = m1 * u; };
+    VectorX x = VectorX::Zero(n);
+    recycle.guess(op1, b, x);
+    CHECK((b - m1 * x).norm() / b.norm() < 1.0e-10);
+
+    // A slightly different operator and source
+    LinearOperator op2 = [&](const VectorX &u, VectorX &y) { y = m2 * u; };
+    VectorX b2 = b + 0.01 * VectorX::Random(n);
+    x          = VectorX::Zero(n);
+    recycle.guess(op2, b2, x);
+    CHECK((b2 - m2 * x).norm() / b2.norm() < 0.1);
+    VectorX x0 = VectorX::Random(n);
+    x          = x0;
+    recycle.guess(op2, b2, x);
+    CHECK((b2 - m2 * x).norm() <= (b2 - m2 * x0).norm());
+
+    // The oldest vector is dropped once the basis is full
+    recycle.add(VectorX::Random(n));
+    recycle.add(VectorX::Random(n));
+    CHECK_EQUAL(2, recycle.size());
+    CHECK(recycle.memory() >= 2 * n * sizeof(real_t));
+}
+
 int main()
 {
     return UnitTest::RunAllTests();
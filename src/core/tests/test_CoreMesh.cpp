@@ -19,6 +19,7 @@
 #include <iostream>
 #include "pugixml.hpp"
 #include "core/core_mesh.hpp"
+#include "core/radial_decomposition.hpp"
 
 #include "inputs.hpp"
 
@@ -67,6 +68,203 @@ TEST(assembly)
 
 }
 
+TEST(neighbor_location)
+{
+    pugi::xml_document xml_doc;
+    pugi::xml_parse_result result = xml_doc.load_string(complex_xml.c_str());
+
+    REQUIRE CHECK(result);
+
+    CoreMesh mesh(xml_doc);
+
+    // Step from the center of each pin just across its east and north faces
+    // and make sure the neighbor lookup agrees with the full search
+    Direction dir(0.3, 0.4, 0.2);
+    for (int i = 0; i < (int)mesh.n_pin(); i++) {
+        auto pos = mesh.coarse_position(i);
+        if ((pos.x == (int)mesh.nx() - 1) || (pos.y == (int)mesh.ny() - 1)) {
+            continue;
+        }
+        const VecF &xv = mesh.x_divisions();
+        const VecF &yv = mesh.y_divisions();
+        const VecF &zv = mesh.z_divisions();
+        Point3 c(0.5 * (xv[pos.x] + xv[pos.x + 1]),
+                 0.5 * (yv[pos.y] + yv[pos.y + 1]),
+                 0.5 * (zv[pos.z] + zv[pos.z + 1]));
+        auto prev = mesh.get_location_info(c, dir);
+
+        for (int dim = 0; dim < 2; dim++) {
+            Point3 p = c;
+            if (dim == 0) {
+                p.x = xv[pos.x + 1] + 1.0e-9;
+            } else {
+                p.y = yv[pos.y + 1] + 1.0e-9;
+            }
+            auto ref  = mesh.get_location_info(p, dir);
+            auto fast = mesh.get_location_info(p, dir, prev);
+            CHECK_EQUAL(ref.pos.x, fast.pos.x);
+            CHECK_EQUAL(ref.pos.y, fast.pos.y);
+            CHECK_EQUAL(ref.pos.z, fast.pos.z);
+            CHECK(ref.pm == fast.pm);
+            CHECK_EQUAL(ref.reg_offset, fast.reg_offset);
+            CHECK_CLOSE(ref.local_point.x, fast.local_point.x, 1.0e-12);
+            CHECK_CLOSE(ref.local_point.y, fast.local_point.y, 1.0e-12);
+        }
+    }
+}
+
+TEST(unique_lattices)
+{
+    pugi::xml_document xml_doc;
+    pugi::xml_parse_result result = xml_doc.load_string(complex_xml.c_str());
+
+    REQUIRE CHECK(result);
+
+    CoreMesh mesh(xml_doc);
+
+    CHECK(mesh.n_unique_lattices() > 0);
+    CHECK(mesh.n_unique_lattices() <=
+          mesh.n_unique_planes() * mesh.core().nx() * mesh.core().ny());
+
+    // The lattice instance tables should give the same pin mesh and region
+    // offset as descending through each unique plane
+    const VecF &xv = mesh.x_divisions();
+    const VecF &yv = mesh.y_divisions();
+    for (int iplane = 0; iplane < (int)mesh.n_unique_planes(); iplane++) {
+        for (int iy = 0; iy < (int)mesh.ny(); iy++) {
+            for (int ix = 0; ix < (int)mesh.nx(); ix++) {
+                Point2 p(0.5 * (xv[ix] + xv[ix + 1]),
+                         0.5 * (yv[iy] + yv[iy + 1]));
+                Point2 p_ref  = p;
+                int first_reg = 0;
+                int ref_reg   = 0;
+                const PinMesh *ref =
+                    mesh.unique_plane(iplane).get_pinmesh(p_ref, ref_reg);
+                auto pmt = mesh.get_pinmesh(p, iplane, first_reg);
+                CHECK(ref == pmt.pm);
+                CHECK_EQUAL(ref_reg, first_reg);
+                CHECK_EQUAL(ix, pmt.position.x);
+                CHECK_EQUAL(iy, pmt.position.y);
+                CHECK_CLOSE(p_ref.x, p.x, 1.0e-12);
+                CHECK_CLOSE(p_ref.y, p.y, 1.0e-12);
+            }
+        }
+    }
+}
+
+// Automatic merging of identical planes into macroplanes. Assembly 1 of
+// 2x3_stack has 8 planes of lattice 2 under 4 planes of lattice 1, all 0.5 cm
+// tall, and no macroplanes of its own
+TEST(merge_planes)
+{
+    std::string core_xml = "    north  = \"reflect\""
+                           "    south  = \"reflect\""
+                           "    east   = \"reflect\""
+                           "    west   = \"reflect\""
+                           "    top    = \"vacuum\""
+                           "    bottom = \"vacuum\" > "
+                           "    1"
+                           "</core>";
+    auto make_mesh = [&](std::string limit, pugi::xml_document &doc) {
+        pugi::xml_parse_result result = doc.load_file("2x3_stack.xml");
+        REQUIRE CHECK(result);
+        std::string xml =
+            "<core nx=\"1\" ny=\"1\" merge_planes=\"t\" " + limit + core_xml;
+        result = doc.append_buffer(xml.c_str(), xml.size());
+        REQUIRE CHECK(result);
+    };
+
+    {
+        pugi::xml_document doc;
+        make_mesh("", doc);
+        CoreMesh mesh(doc);
+        CHECK_EQUAL(2, mesh.macroplanes().size());
+        CHECK_EQUAL(8, mesh.subplane()[0]);
+        CHECK_EQUAL(4, mesh.subplane()[1]);
+        CHECK_CLOSE(4.0, mesh.macroplane_heights()[0], 1.0e-12);
+        CHECK_CLOSE(2.0, mesh.macroplane_heights()[1], 1.0e-12);
+    }
+    {
+        pugi::xml_document doc;
+        make_mesh("max_macroplane_height=\"1.5\"", doc);
+        CoreMesh mesh(doc);
+        int ref_subplane[] = {3, 3, 2, 3, 1};
+        CHECK_EQUAL(5, mesh.subplane().size());
+        CHECK_ARRAY_EQUAL(ref_subplane, mesh.subplane(), 5);
+        for (const auto h : mesh.macroplane_heights()) {
+            CHECK(h <= 1.5);
+        }
+    }
+    {
+        pugi::xml_document doc;
+        make_mesh("max_macroplane_height=\"0.0\"", doc);
+        CHECK_THROW(CoreMesh mesh(doc), Exception);
+    }
+}
+
+TEST(contiguous_partition)
+{
+    {
+        // Uniform items split evenly
+        VecI bounds = contiguous_partition(VecI(8, 10), 4);
+        CHECK_EQUAL(5, (int)bounds.size());
+        for (int ip = 0; ip <= 4; ip++) {
+            CHECK_EQUAL(2 * ip, bounds[ip]);
+        }
+    }
+
+    {
+        // One expensive item gets a part to itself
+        VecI bounds = contiguous_partition({1, 1, 10, 1, 1}, 3);
+        VecI ref    = {0, 2, 3, 5};
+        CHECK_ARRAY_EQUAL(ref, bounds, 4);
+    }
+
+    {
+        // Every part gets at least one item
+        VecI bounds = contiguous_partition({100, 1, 1}, 3);
+        VecI ref    = {0, 1, 2, 3};
+        CHECK_ARRAY_EQUAL(ref, bounds, 4);
+    }
+
+    CHECK_THROW(contiguous_partition(VecI(2, 1), 3), Exception);
+}
+
+TEST(radial_decomposition)
+{
+    {
+        // A uniform 4x2 grid into 4 domains should be cut 2x2
+        VecI cost(8, 1);
+        RadialDecomposition decomp(cost, 4, 2, 4);
+        CHECK_EQUAL(2, decomp.px());
+        CHECK_EQUAL(2, decomp.py());
+        for (int id = 0; id < 4; id++) {
+            CHECK_EQUAL(2, decomp.cost(id));
+        }
+        CHECK_EQUAL(0, decomp.owner(1, 0));
+        CHECK_EQUAL(1, decomp.owner(2, 0));
+        CHECK_EQUAL(3, decomp.owner(3, 1));
+
+        CHECK_EQUAL(1, decomp.neighbor(0, Surface::EAST));
+        CHECK_EQUAL(2, decomp.neighbor(0, Surface::NORTH));
+        CHECK_EQUAL(-1, decomp.neighbor(0, Surface::WEST));
+        CHECK_EQUAL(-1, decomp.neighbor(0, Surface::SOUTH));
+        CHECK_EQUAL(-1, decomp.neighbor(0, Surface::TOP));
+        CHECK_EQUAL(0, decomp.neighbor(2, Surface::SOUTH));
+    }
+
+    {
+        // A strip can only be cut one way
+        VecI cost(3, 1);
+        RadialDecomposition decomp(cost, 3, 1, 3);
+        CHECK_EQUAL(3, decomp.px());
+        CHECK_EQUAL(1, decomp.py());
+    }
+
+    // 3 domains cannot tile a 2x2 grid
+    CHECK_THROW(RadialDecomposition(VecI(4, 1), 2, 2, 3), Exception);
+}
+
 int main()
 {
     UnitTest::RunAllTests();
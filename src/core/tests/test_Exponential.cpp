@@ -19,7 +19,10 @@
 #include <cmath>
 #include <iostream>
 #include <stdlib.h>
+#include <string>
+#include "util/error.hpp"
 #include "util/fp_utils.hpp"
+#include "core/constants.hpp"
 #include "core/exponential.hpp"
 
 using namespace mocc;
@@ -91,6 +94,81 @@ TEST(exp_coarse)
 
 }
 
+TEST(exp_variants)
+{
+    Exponential_ClampedLinear<20000> clamped(-20.0, 0.0);
+    Exponential_Quadratic<2000> quadratic(-20.0, 0.0);
+    Exponential_Polynomial polynomial;
+
+    std::cout << "Max error, clamped: " << clamped.max_error() << std::endl;
+    std::cout << "Max error, quadratic: " << quadratic.max_error()
+              << std::endl;
+    std::cout << "Max error, polynomial: " << polynomial.max_error()
+              << std::endl;
+
+    // Use a step that doesn't line up with the table points
+    for (real_t x = -20.0; x <= 0.0; x += 0.0137) {
+        real_t exp_r = std::exp(x);
+        CHECK(std::abs(exp_r - clamped.exp(x)) < 2e-7);
+        CHECK(std::abs(exp_r - quadratic.exp(x)) < 3e-8);
+        CHECK(std::abs(exp_r - polynomial.exp(x)) / exp_r < 1e-14);
+    }
+
+    // Arguments below the domain should go to zero
+    CHECK_EQUAL(0.0, clamped.exp(-30.0));
+    CHECK_EQUAL(0.0, quadratic.exp(-30.0));
+    CHECK_EQUAL(0.0, polynomial.exp(-1000.0));
+}
+
+TEST(bickley_naylor)
+{
+    BickleyNaylor_Ki3<4000> ki3(-20.0);
+
+    std::cout << "Max error, Ki3: " << ki3.max_error() << std::endl;
+
+    // Ki3(0) is pi/4, and a reference value from a fine quadrature
+    CHECK_CLOSE(0.25 * PI, BickleyNaylor_Ki3<4000>::ki3(0.0), 1e-12);
+    CHECK_CLOSE(0.2378450822, BickleyNaylor_Ki3<4000>::ki3(1.0), 1e-9);
+
+    for (real_t x = -20.0; x <= 0.0; x += 0.0137) {
+        real_t ref = BickleyNaylor_Ki3<4000>::ki3(-x) / (0.25 * PI);
+        CHECK(std::abs(ref - ki3.exp(x)) < 1e-5);
+    }
+
+    // Ki3 falls off faster than the exponential of the in-plane optical
+    // thickness, since the paths out of the plane are longer
+    CHECK_CLOSE(1.0, ki3.exp(0.0), 1e-12);
+    CHECK(ki3.exp(-1.0) < std::exp(-1.0));
+    CHECK_EQUAL(0.0, ki3.exp(-30.0));
+}
+
+TEST(exp_n)
+{
+    const int n = 100;
+    real_t in[n];
+    real_t out[n];
+    for (int i = 0; i < n; i++) {
+        in[i] = -0.1 * i;
+    }
+
+    for (std::string type :
+         {"exact", "linear", "clamped", "quadratic", "polynomial"}) {
+        auto exp = ExponentialFactory(type);
+        exp->exp_n(in, out, n);
+        for (int i = 0; i < n; i++) {
+            CHECK(std::abs(std::exp(in[i]) - out[i]) < 2e-7);
+        }
+
+        // Make sure that it works in place
+        real_t inout[n];
+        std::copy(in, in + n, inout);
+        exp->exp_n(inout, inout, n);
+        CHECK_ARRAY_EQUAL(out, inout, n);
+    }
+
+    CHECK_THROW(ExponentialFactory("bogus"), Exception);
+}
+
 int main(int, const char *[])
 {
     return UnitTest::RunAllTests();
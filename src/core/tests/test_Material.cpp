@@ -17,11 +17,14 @@
 #include "UnitTest++/UnitTest++.h"
 
 #include <cassert>
+#include <fstream>
 #include <iostream>
 #include <string>
+#include "pugixml.hpp"
 #include "util/file_scrubber.hpp"
 #include "util/fp_utils.hpp"
 #include "util/global_config.hpp"
+#include "util/h5file.hpp"
 #include "material.hpp"
 #include "material_lib.hpp"
 
@@ -54,6 +57,161 @@ TEST(material)
     CHECK_CLOSE(5.04050E-09, mat.xssc().to(3).from[0], 0.000000000001);
 }
 
+// Round-trip the library through the binary format
+TEST(binary_library)
+{
+    {
+        FileScrubber c5g7_file("c5g7.xsl", "!");
+        MaterialLib matlib(c5g7_file);
+        H5Node h5("c5g7_test.h5", H5Access::WRITE);
+        matlib.write(h5);
+    }
+
+    FileScrubber c5g7_file("c5g7.xsl", "!");
+    MaterialLib text_lib(c5g7_file);
+    text_lib.assignID(1, "MOX-4.3");
+
+    pugi::xml_document doc;
+    auto lib_node                     = doc.append_child("material_lib");
+    lib_node.append_attribute("path") = "c5g7_test.h5";
+    auto mat_node                     = lib_node.append_child("material");
+    mat_node.append_attribute("id")   = 1;
+    mat_node.append_attribute("name") = "MOX-4.3";
+    MaterialLib bin_lib(lib_node);
+
+    CHECK_EQUAL(text_lib.n_group(), bin_lib.n_group());
+    CHECK_EQUAL(1, bin_lib.n_materials());
+    CHECK(bin_lib.has(1));
+
+    const Material &text_mat = text_lib.get_material_by_id(1);
+    const Material &bin_mat  = bin_lib.get_material_by_id(1);
+    for (int ig = 0; ig < text_lib.n_group(); ig++) {
+        CHECK_EQUAL(text_lib.g_bounds()[ig], bin_lib.g_bounds()[ig]);
+        CHECK_EQUAL(text_mat.xstr(ig), bin_mat.xstr(ig));
+        CHECK_EQUAL(text_mat.xsnf(ig), bin_mat.xsnf(ig));
+        CHECK_EQUAL(text_mat.xsch(ig), bin_mat.xsch(ig));
+    }
+    CHECK(text_mat.xssc() == bin_mat.xssc());
+
+    // Unknown materials should fail to map
+    CHECK_THROW(bin_lib.assignID(2, "Unobtainium"), Exception);
+}
+
+// A material with P1 scattering data should carry its higher-order matrix,
+// including negative entries, through both library formats
+TEST(pn_scattering)
+{
+    {
+        std::ofstream lib("p1_test.xsl");
+        lib << "P1 test library\n"
+            << "2 1\n"
+            << "1.0e6 0.625\n"
+            << "XSMACRO Water 1\n"
+            << "0.01 0.0 0.0 0.0\n"
+            << "0.02 0.0 0.0 0.0\n"
+            << "0.5 0.0\n"
+            << "0.1 1.2\n"
+            << "0.3 0.0\n"
+            << "-0.02 0.4\n";
+    }
+
+    FileScrubber lib_file("p1_test.xsl", "!");
+    MaterialLib matlib(lib_file);
+    matlib.assignID(1, "Water");
+    const Material &mat = matlib.get_material_by_id(1);
+
+    CHECK_EQUAL(1, mat.scat_order());
+    const ScatteringMatrix &p1 = mat.xssc_pn(1);
+    CHECK_CLOSE(0.3, p1.to(0)[0], 1.0e-14);
+    CHECK_CLOSE(-0.02, p1.to(1)[0], 1.0e-14);
+    CHECK_CLOSE(0.4, p1.to(1)[1], 1.0e-14);
+    CHECK_EQUAL(0, p1.to(1).min_g);
+
+    // The transport cross section still comes from P0
+    CHECK_CLOSE(0.01 + 0.6, mat.xstr(0), 1.0e-14);
+
+    // Scaling applies to the higher moments as well
+    Material scaled = mat.scaled(2.0);
+    CHECK_EQUAL(1, scaled.scat_order());
+    CHECK_CLOSE(-0.04, scaled.xssc_pn(1).to(1)[0], 1.0e-14);
+
+    {
+        H5Node h5("p1_test.h5", H5Access::WRITE);
+        matlib.write(h5);
+    }
+    pugi::xml_document doc;
+    auto lib_node                     = doc.append_child("material_lib");
+    lib_node.append_attribute("path") = "p1_test.h5";
+    auto mat_node                     = lib_node.append_child("material");
+    mat_node.append_attribute("id")   = 1;
+    mat_node.append_attribute("name") = "Water";
+    MaterialLib bin_lib(lib_node);
+
+    const Material &bin_mat = bin_lib.get_material_by_id(1);
+    CHECK_EQUAL(1, bin_mat.scat_order());
+    CHECK(bin_mat.xssc_pn(1) == p1);
+}
+
+// Replacing a material should only affect its own ID, and be tracked by the
+// library state
+TEST(update_material)
+{
+    FileScrubber c5g7_file("c5g7.xsl", "!");
+    MaterialLib matlib(c5g7_file);
+    matlib.assignID(1, "UO2-3.3");
+    matlib.assignID(2, "UO2-3.3");
+    CHECK_EQUAL(0, matlib.state());
+
+    Material orig = matlib.get_material_by_id(1);
+    Material mat  = orig.scaled(0.5);
+    for (int ig = 0; ig < matlib.n_group(); ig++) {
+        CHECK_CLOSE(0.5 * orig.xstr(ig), mat.xstr(ig), 1.0e-12);
+        CHECK_CLOSE(0.5 * orig.xsnf(ig), mat.xsnf(ig), 1.0e-12);
+        CHECK_CLOSE(orig.xsch(ig), mat.xsch(ig), 1.0e-12);
+    }
+
+    matlib.update_material(1, mat);
+    CHECK_EQUAL(1, matlib.state());
+    CHECK_EQUAL(1, matlib.material_state(1));
+    CHECK_EQUAL(0, matlib.material_state(2));
+    for (int ig = 0; ig < matlib.n_group(); ig++) {
+        CHECK_EQUAL(mat.xstr(ig), matlib[1].xstr(ig));
+        CHECK_EQUAL(orig.xstr(ig), matlib[2].xstr(ig));
+        CHECK_EQUAL(orig.xstr(ig), orig.scaled(1.0).xstr(ig));
+    }
+
+    CHECK_THROW(matlib.update_material(3, mat), Exception);
+}
+
+// Compacting should only keep the mapped materials, without changing them
+TEST(compact)
+{
+    FileScrubber c5g7_file("c5g7.xsl", "!");
+    MaterialLib matlib(c5g7_file);
+    matlib.assignID(1, "MOX-4.3");
+    matlib.assignID(2, "UO2-3.3");
+    matlib.assignID(3, "UO2-3.3");
+    Material mox = matlib[1];
+    Material uo2 = matlib[2];
+    int n_lib    = matlib.materials().size();
+
+    CHECK_EQUAL(n_lib - 2, matlib.compact());
+    CHECK_EQUAL(2, matlib.materials().size());
+    CHECK_EQUAL(3, matlib.n_materials());
+    for (int ig = 0; ig < matlib.n_group(); ig++) {
+        CHECK_EQUAL(mox.xstr(ig), matlib[1].xstr(ig));
+        CHECK_EQUAL(uo2.xstr(ig), matlib[2].xstr(ig));
+        CHECK_EQUAL(uo2.xstr(ig), matlib[3].xstr(ig));
+    }
+    CHECK(mox.xssc() == matlib[1].xssc());
+
+    // Only the kept materials may be mapped again
+    matlib.assignID(4, "MOX-4.3");
+    CHECK_EQUAL(mox.xsnf(0), matlib[4].xsnf(0));
+    CHECK_THROW(matlib.assignID(5, "Moderator"), Exception);
+    CHECK_EQUAL(0, matlib.compact());
+}
+
 int main(int, const char *[])
 {
     return UnitTest::RunAllTests();
@@ -16,7 +16,13 @@
 
 #include "UnitTest++/UnitTest++.h"
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
 
 #include "pugixml.hpp"
 
@@ -55,6 +61,90 @@ TEST(test_cyl)
         55, pm->find_reg(Point2(0.62, 0.0), Direction(7.0 * PI / 4.0, HPI)));
 }
 
+TEST(test_cyl_lookup)
+{
+    // The accelerated region and surface lookups should agree with a search
+    // over all of the rings and lines
+    for (int n_azi : {2, 4, 6, 8}) {
+        std::string xml_input =
+            "<mesh type=\"cyl\" id=\"1\"  pitch=\"1.26\"><radii>0.3 0.54 "
+            "0.62</radii><sub_radii>3 4 2</sub_radii><sub_azi>" +
+            std::to_string(n_azi) + "</sub_azi></mesh>";
+
+        pugi::xml_document xml;
+        xml.load_string(xml_input.c_str());
+
+        std::unique_ptr<PinMesh> pm(PinMeshFactory(xml.child("mesh")));
+        const auto *cyl = dynamic_cast<const PinMesh_Cyl *>(pm.get());
+        REQUIRE CHECK(cyl);
+
+        std::vector<Point2> points;
+        for (int i = 0; i < 37; i++) {
+            for (int j = 0; j < 37; j++) {
+                points.push_back(
+                    Point2(-0.62 + 0.0343 * i, -0.615 + 0.0341 * j));
+            }
+        }
+        VecI batch(points.size());
+        pm->find_reg(points.size(), points.data(), batch.data());
+
+        for (unsigned ip = 0; ip < points.size(); ip++) {
+            const Point2 &p = points[ip];
+            real_t r        = std::sqrt(p.x * p.x + p.y * p.y);
+            int ir          = 0;
+            while ((ir < (int)cyl->radii().size()) && (r >= cyl->radii()[ir])) {
+                ir++;
+            }
+            int ia = p.alpha() / (TWOPI / n_azi);
+            CHECK_EQUAL(ir * n_azi + ia, pm->find_reg(p));
+            CHECK_EQUAL(ir * n_azi + ia, batch[ip]);
+
+            Direction dir(std::fmod(0.1 + 0.37 * ip, TWOPI), HPI);
+            real_t dist = std::numeric_limits<real_t>::max();
+            for (const auto &c : cyl->circles()) {
+                dist = std::min(dist, c.distance_to_surface(p, dir, false));
+            }
+            for (const auto &l : cyl->lines()) {
+                dist = std::min(dist, l.distance_to_surface(p, dir, false));
+            }
+            int coincident = -1;
+            auto d         = pm->distance_to_surface(p, dir, coincident);
+            CHECK_EQUAL(dist, d.first);
+        }
+    }
+}
+
+// The region outlines should enclose the volume of each region, to within the
+// error of approximating the arcs. The outer regions only have equal volumes
+// when the sectors divide the octants evenly, so six sectors are left out.
+TEST(test_cyl_polygons)
+{
+    for (int n_azi : {2, 4, 8}) {
+        std::string xml_input =
+            "<mesh type=\"cyl\" id=\"1\"  pitch=\"1.26\"><radii>0.3 0.54 "
+            "0.62</radii><sub_radii>3 4 2</sub_radii><sub_azi>" +
+            std::to_string(n_azi) + "</sub_azi></mesh>";
+
+        pugi::xml_document xml;
+        xml.load_string(xml_input.c_str());
+
+        std::unique_ptr<PinMesh> pm(PinMeshFactory(xml.child("mesh")));
+        auto polys = pm->polygons(4096);
+        REQUIRE CHECK_EQUAL(pm->n_reg(), (int)polys.size());
+
+        for (int ireg = 0; ireg < pm->n_reg(); ireg++) {
+            const auto &poly = polys[ireg];
+            real_t area      = 0.0;
+            for (int i = 0; i < (int)poly.size(); i++) {
+                const Point2 &p1 = poly[i];
+                const Point2 &p2 = poly[(i + 1) % poly.size()];
+                area += 0.5 * (p1.x * p2.y - p2.x * p1.y);
+            }
+            CHECK_CLOSE(pm->areas()[ireg], area, 1.0e-6);
+        }
+    }
+}
+
 int main()
 {
     return UnitTest::RunAllTests();
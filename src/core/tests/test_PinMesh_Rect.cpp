@@ -17,6 +17,7 @@
 #include "UnitTest++/UnitTest++.h"
 
 #include <iostream>
+#include <type_traits>
 
 #include "pugixml.hpp"
 
@@ -103,6 +104,61 @@ TEST(test_fine_mesh)
     CHECK_EQUAL(6319,pm->find_reg(Point2(4.9375,4.8456249999999992)));
 }
 
+TEST(test_visit)
+{
+    std::string xml_input =
+        "<mesh id=\"1\" type=\"rect\" pitch=\"1.26\">"
+        "        <sub_x>5</sub_x>"
+        "        <sub_y>5</sub_y>"
+        "</mesh>";
+    pugi::xml_document xml;
+    xml.load_string(xml_input.c_str());
+
+    auto pm = PinMeshFactory(xml.child("mesh"));
+
+    CHECK(pm->type() == PinMeshType::RECT);
+
+    // Static dispatch should land on the concrete type, and agree with the
+    // virtual interface
+    bool is_rect = visit(*pm, [](const auto &m) {
+        return std::is_same<std::decay_t<decltype(m)>, PinMesh_Rect>::value;
+    });
+    CHECK(is_rect);
+
+    Point2 p(0.378, 0.4);
+    Direction dir(3.0 * PI / 4.0, HPI);
+    int ireg =
+        visit(*pm, [&](const auto &m) { return m.find_reg(p, dir); });
+    CHECK_EQUAL(pm->find_reg(p, dir), ireg);
+}
+
+// Meshes that only differ in their ID have the same geometry
+TEST(test_equivalent)
+{
+    std::string xml_input =
+        "<mesh type=\"rect\" id=\"1\" pitch=\"1.26\"><sub_x>3</sub_x>"
+        "<sub_y>3</sub_y></mesh>"
+        "<mesh type=\"rect\" id=\"2\" pitch=\"1.26\"><sub_x>3</sub_x>"
+        "<sub_y>3</sub_y></mesh>"
+        "<mesh type=\"rect\" id=\"3\" pitch=\"1.26\"><sub_x>3</sub_x>"
+        "<sub_y>2</sub_y></mesh>"
+        "<mesh type=\"cyl\" id=\"4\" pitch=\"1.26\"><radii>0.54</radii>"
+        "<sub_radii>1</sub_radii><sub_azi>8</sub_azi></mesh>";
+
+    pugi::xml_document xml;
+    xml.load_string(xml_input.c_str());
+
+    std::vector<std::unique_ptr<PinMesh>> pms;
+    for (auto mesh = xml.child("mesh"); mesh; mesh = mesh.next_sibling()) {
+        pms.emplace_back(PinMeshFactory(mesh));
+    }
+
+    CHECK(pms[0]->geometrically_equivalent(*pms[0]));
+    CHECK(pms[0]->geometrically_equivalent(*pms[1]));
+    CHECK(pms[1]->geometrically_equivalent(*pms[0]));
+    CHECK(!pms[0]->geometrically_equivalent(*pms[2]));
+    CHECK(!pms[0]->geometrically_equivalent(*pms[3]));
+}
 
 int main()
 {
@@ -129,6 +129,28 @@ TEST(scat_matrix_vecorVecF)
     CHECK_CLOSE(0.0, scat_matrix.to(1)[1], 0.0000000000001);
     CHECK_CLOSE(0.4, scat_matrix.to(3)[3], 0.0000000000001);
 
+    // test the transposed, out-scattering rows
+    CHECK_EQUAL(2, scat_matrix.from(3).min_g);
+    CHECK_EQUAL(5, scat_matrix.from(3).max_g);
+    CHECK_CLOSE(0.3, scat_matrix.from(3)[2], 0.0000000000001);
+    CHECK_CLOSE(0.2, scat_matrix.from(3)[5], 0.0000000000001);
+    CHECK_EQUAL(1, scat_matrix.from(1).min_g);
+    CHECK_EQUAL(4, scat_matrix.from(1).max_g);
+    CHECK_CLOSE(0.0, scat_matrix.from(1)[1], 0.0000000000001);
+    CHECK_CLOSE(0.1, scat_matrix.from(1)[4], 0.0000000000001);
+    CHECK_EQUAL(5, scat_matrix.from(6).min_g);
+    CHECK_EQUAL(6, scat_matrix.from(6).max_g);
+    for (int ig = 0; ig < NG; ig++) {
+        real_t out = 0.0;
+        for (auto xs : scat_matrix.from(ig)) {
+            out += xs;
+        }
+        CHECK_CLOSE(scat_matrix.out(ig), out, 0.0000000000001);
+        CHECK(scat_matrix_copy.from(ig) == scat_matrix.from(ig));
+        CHECK(scat_matrix_copy.from(ig).begin() !=
+              scat_matrix.from(ig).begin());
+    }
+
     // Check the outscatter CDF
     VecF out_cdf = scat_matrix.out_cdf(3);
     std::cout << scat_matrix.out(3) << std::endl;
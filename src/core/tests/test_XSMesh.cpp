@@ -52,6 +52,91 @@ TEST(test)
     }
 }
 
+// Make sure that the flattened representation agrees with the regions
+TEST(flat)
+{
+    pugi::xml_document geom_xml;
+    pugi::xml_parse_result result = geom_xml.load_file("2x3_1.xml");
+    CHECK(result);
+
+    CoreMesh mesh(geom_xml);
+
+    XSMesh xs_mesh(mesh, MeshTreatment::PLANE);
+
+    const VecI &index = xs_mesh.xsreg_index();
+    CHECK_EQUAL(xs_mesh.n_reg_expanded(), (int)index.size());
+
+    int ixs = 0;
+    for (const auto &xsr : xs_mesh) {
+        for (const int ireg : xsr.reg()) {
+            CHECK_EQUAL(ixs, index[ireg]);
+        }
+        for (int ig = 0; ig < (int)xs_mesh.n_group(); ig++) {
+            CHECK_EQUAL(xsr.xsmactr(ig), xs_mesh.xstr(ig)[ixs]);
+            CHECK_EQUAL(xsr.xsmacnf(ig), xs_mesh.xsnf(ig)[ixs]);
+            CHECK_EQUAL(xsr.xsmacch(ig), xs_mesh.xsch(ig)[ixs]);
+            CHECK_EQUAL(xsr.xsmacf(ig), xs_mesh.xsf(ig)[ixs]);
+            CHECK_EQUAL(xsr.xsmacrm(ig), xs_mesh.xsrm(ig)[ixs]);
+            CHECK_EQUAL(xsr.xsmacsc().self_scat(ig),
+                        xs_mesh.self_scat(ig, ixs));
+
+            const ScatteringRow &row = xsr.xsmacsc().to(ig);
+            ScatteringRow flat_row   = xs_mesh.scat_row(ig, ixs);
+            CHECK_EQUAL(row.min_g, flat_row.min_g);
+            CHECK_EQUAL(row.max_g, flat_row.max_g);
+            for (int igg = row.min_g; igg <= row.max_g; igg++) {
+                CHECK_EQUAL(row[igg], flat_row[igg]);
+            }
+        }
+        ixs++;
+    }
+
+    // The runs must cover all regions, each run in a single XS mesh region,
+    // with neighbouring runs in different ones
+    const VecI &runs = xs_mesh.xsreg_runs();
+    CHECK_EQUAL(0, runs.front());
+    CHECK_EQUAL(xs_mesh.n_reg_expanded(), runs.back());
+    for (int irun = 0; irun < (int)runs.size() - 1; irun++) {
+        CHECK(runs[irun] < runs[irun + 1]);
+        for (int ireg = runs[irun]; ireg < runs[irun + 1]; ireg++) {
+            CHECK_EQUAL(index[runs[irun]], index[ireg]);
+        }
+        if (irun > 0) {
+            CHECK(index[runs[irun]] != index[runs[irun] - 1]);
+        }
+    }
+}
+
+// The all-group cache should produce the same cross sections as a plain
+// expansion, in any order of groups
+TEST(expanded)
+{
+    pugi::xml_document geom_xml;
+    pugi::xml_parse_result result = geom_xml.load_file("2x3_1.xml");
+    CHECK(result);
+
+    CoreMesh mesh(geom_xml);
+
+    XSMesh xs_mesh(mesh, MeshTreatment::PLANE);
+
+    ExpandedXS plain(&xs_mesh);
+    ExpandedXS cached(&xs_mesh);
+    cached.cache_all_groups();
+    CHECK(cached.memory() > plain.memory());
+
+    int ng = xs_mesh.n_group();
+    for (int ig : {0, ng - 1, ng - 1, 0}) {
+        plain.expand(ig);
+        cached.expand(ig);
+        for (const auto &xsr : xs_mesh) {
+            for (const int ireg : xsr.reg()) {
+                CHECK_EQUAL(xsr.xsmactr(ig), plain[ireg]);
+                CHECK_EQUAL(xsr.xsmactr(ig), cached[ireg]);
+            }
+        }
+    }
+}
+
 int main()
 {
     return UnitTest::RunAllTests();
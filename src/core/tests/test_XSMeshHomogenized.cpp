@@ -16,6 +16,8 @@
 
 #include "UnitTest++/UnitTest++.h"
 
+#include <cstdio>
+
 #include "pugixml.hpp"
 
 #include "xs_mesh_homogenized.hpp"
@@ -64,6 +66,53 @@ TEST(xsmeshhom)
     }
 }
 
+// Every pin in 2x3_1 is the same, so the volume-weighted homogenized regions
+// should all share one scattering matrix, and one set of flattened rows
+TEST(shared_scattering)
+{
+    pugi::xml_document geom_xml;
+    pugi::xml_parse_result result = geom_xml.load_file("2x3_1.xml");
+    CHECK(result);
+
+    CoreMesh mesh(geom_xml);
+
+    XSMeshHomogenized xs_mesh(mesh);
+
+    CHECK(xs_mesh.size() > 1);
+    for (int ixs = 1; ixs < (int)xs_mesh.size(); ixs++) {
+        CHECK(&xs_mesh[ixs].xsmacsc() == &xs_mesh[0].xsmacsc());
+        for (int ig = 0; ig < (int)xs_mesh.n_group(); ig++) {
+            CHECK(xs_mesh.scat_row(ig, ixs).from ==
+                  xs_mesh.scat_row(ig, 0).from);
+        }
+    }
+}
+
+// The first mesh made with a snapshot file writes it, and later ones with the
+// same key should read back the same cross sections
+TEST(snapshot)
+{
+    pugi::xml_document geom_xml;
+    pugi::xml_parse_result result = geom_xml.load_file("2x3_1.xml");
+    CHECK(result);
+
+    CoreMesh mesh(geom_xml);
+    std::remove("xsmesh_snapshot.h5");
+    mesh.set_snapshot("xsmesh_snapshot.h5", 1);
+
+    XSMeshHomogenized written(mesh);
+    XSMeshHomogenized read(mesh);
+    CHECK(written == read);
+    for (int ixs = 1; ixs < (int)read.size(); ixs++) {
+        CHECK(&read[ixs].xsmacsc() == &read[0].xsmacsc());
+    }
+
+    // A snapshot made for another input is ignored
+    mesh.set_snapshot("xsmesh_snapshot.h5", 2);
+    XSMeshHomogenized rebuilt(mesh);
+    CHECK(written == rebuilt);
+}
+
 // Tests some of the error checking involved in constructing an XSMeshHom from
 // data files.
 TEST(fromdata_fail)
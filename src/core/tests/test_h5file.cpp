@@ -18,6 +18,7 @@
 
 #include "util/blitz_typedefs.hpp"
 #include "util/error.hpp"
+#include "util/global_config.hpp"
 #include "util/h5file.hpp"
 
 using namespace mocc;
@@ -33,6 +34,7 @@ TEST(test_write)
     data(2, 4, 8) = 7.3;
 
     h5test.write("test_array", data);
+    h5test.write("scalar", 2.5);
 
     H5Node g = h5test.create_group("group_a");
 
@@ -60,17 +62,147 @@ TEST(test_read)
     CHECK_EQUAL(data(0, 0, 0), 1.0);
     CHECK_EQUAL(data(2, 4, 8), 7.3);
 
+    VecF scalar;
+    h5test.read("scalar", scalar);
+    CHECK_EQUAL(1u, scalar.size());
+    CHECK_EQUAL(2.5, scalar[0]);
+
     ArrayB1 d1(11);
     CHECK_THROW(h5test.read("/group_a/one_d", d1), Exception);
     d1.resize(10);
     h5test.read("/group_a/one_d", d1);
     CHECK_EQUAL(5.32, d1(3));
 
+    // A slab along the leading dimension holds just that part of the array
+    VecF slab(7 * 14, -1.0);
+    h5test.read_slab("test_array", slab.data(), 2, 1);
+    CHECK_EQUAL(7.3, slab[4 * 14 + 8]);
+    CHECK_EQUAL(0.0, slab[0]);
+    CHECK_THROW(h5test.read_slab("test_array", slab.data(), 3, 1), Exception);
+
     // make sure we arent allowing write-like operations
     CHECK_THROW(h5test.create_group("falala"), Exception);
     // CHECK_THROW(h5test.write, Exception);
 }
 
+TEST(test_slab)
+{
+    // Without other processes the file isn't shared, so the one slab has to
+    // cover the whole dataset
+    {
+        H5Node h5test("test_slab.h5", H5Access::PARALLEL);
+        CHECK_EQUAL(1, h5test.n_process());
+        CHECK_EQUAL(0, h5test.process());
+
+        VecF data(3 * 4);
+        for (int i = 0; i < (int)data.size(); i++) {
+            data[i] = i;
+        }
+        h5test.write_slab("slab", data.data(), {3, 4}, 0, 3);
+        CHECK_THROW(h5test.write_slab("part", data.data(), {3, 4}, 1, 2),
+                    Exception);
+        CHECK_THROW(h5test.write_slab("over", data.data(), {3, 4}, 2, 2),
+                    Exception);
+    }
+
+    H5Node h5test("test_slab.h5", H5Access::READ);
+    std::vector<hsize_t> dims = h5test.dimensions("slab");
+    CHECK_EQUAL(2u, dims.size());
+    CHECK_EQUAL(3u, dims[0]);
+    CHECK_EQUAL(4u, dims[1]);
+
+    ArrayB2 data;
+    h5test.read("slab", data);
+    CHECK_EQUAL(0.0, data(0, 0));
+    CHECK_EQUAL(6.0, data(1, 2));
+    CHECK_EQUAL(11.0, data(2, 3));
+}
+
+TEST(test_compact)
+{
+    {
+        H5Node h5test("test_compact.h5", H5Access::WRITE);
+        h5test.set_single_precision(true);
+        h5test.set_compression(H5Filter::GZIP, 4);
+        h5test.set_selection({}, {"skip", "group/skip"});
+        CHECK(h5test.selected("keep"));
+        CHECK(!h5test.selected("/skip/a"));
+        CHECK(h5test.selected("skipped"));
+
+        ArrayB1 d(100);
+        for (int i = 0; i < 100; i++) {
+            d(i) = 1.0 / (i + 1);
+        }
+        h5test.write("keep", d);
+        h5test.write("pi", 3.14159265358979);
+        h5test.create_group("skip");
+        h5test.write("skip/d", d);
+        auto g = h5test.create_group("group");
+        CHECK(!g.selected("skip"));
+        g.write("skip", d);
+        g.write("keep", d);
+
+        CHECK_THROW(h5test.set_compression(H5Filter::GZIP, 10), Exception);
+    }
+
+    H5Node h5test("test_compact.h5", H5Access::READ);
+    CHECK(h5test.exists("keep"));
+    CHECK(h5test.exists("group/keep"));
+    CHECK(h5test.exists("skip"));
+    CHECK(!h5test.exists("skip/d"));
+    CHECK(!h5test.exists("group/skip"));
+
+    // Arrays lose precision, scalars don't
+    ArrayB1 d;
+    h5test.read("keep", d);
+    CHECK_EQUAL(100, (int)d.size());
+    CHECK_CLOSE(1.0 / 3.0, d(2), 1.0e-7);
+    CHECK((float)d(2) == d(2));
+    VecF pi;
+    h5test.read("pi", pi);
+    CHECK_EQUAL(3.14159265358979, pi[0]);
+}
+
+TEST(test_slab_serial)
+{
+    // A slab covering the whole dataset should store the same thing as a
+    // serial write, also when it spans several chunks
+    ArrayB3 data(3, 7, 14);
+    for (int i = 0; i < (int)data.size(); i++) {
+        data.data()[i] = 0.5 * i;
+    }
+    VecF long_data(100000);
+    for (int i = 0; i < (int)long_data.size(); i++) {
+        long_data[i] = i % 977;
+    }
+
+    {
+        H5Node h5test("test_slab_serial.h5", H5Access::PARALLEL);
+        h5test.write("serial", data);
+        h5test.write_slab("slab", data.data(), {3, 7, 14}, 0, 3);
+        h5test.write("serial_1d", long_data);
+        h5test.write_slab("slab_1d", long_data.data(), {long_data.size()}, 0,
+                          long_data.size());
+    }
+
+    H5Node h5test("test_slab_serial.h5", H5Access::READ);
+    CHECK(h5test.dimensions("serial") == h5test.dimensions("slab"));
+    ArrayB3 serial;
+    ArrayB3 slab;
+    h5test.read("serial", serial);
+    h5test.read("slab", slab);
+    REQUIRE CHECK_EQUAL(serial.size(), slab.size());
+    CHECK_ARRAY_EQUAL(serial.data(), slab.data(), (int)serial.size());
+
+    CHECK(h5test.dimensions("serial_1d") == h5test.dimensions("slab_1d"));
+    VecF serial_1d;
+    VecF slab_1d;
+    h5test.read("serial_1d", serial_1d);
+    h5test.read("slab_1d", slab_1d);
+    REQUIRE CHECK_EQUAL(long_data.size(), slab_1d.size());
+    CHECK_ARRAY_EQUAL(serial_1d, slab_1d, (int)slab_1d.size());
+}
+
 int main(int, const char *[])
 {
     return UnitTest::RunAllTests();
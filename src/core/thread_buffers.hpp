@@ -0,0 +1,151 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include "util/aligned_allocator.hpp"
+#include "util/global_config.hpp"
+#include "util/omp_guard.h"
+
+namespace mocc {
+/**
+ * \brief A set of per-thread accumulation buffers, with a parallel reduction
+ *
+ * Sweepers accumulate scalar flux into a private buffer for each thread, which
+ * must then be summed. Doing this in an \c omp \c critical section serializes
+ * n_thread * n additions. Instead, the \ref reduce() method splits the
+ * elements among the threads, with each thread summing its own slice across
+ * all of the thread buffers.
+ *
+ * The buffers persist between sweeps, and are only reallocated if the number
+ * of threads or buffer size changes. Since the storage is not touched on
+ * allocation, the first \ref zero() by each thread places its buffer in that
+ * thread's local memory on first-touch NUMA systems. Each buffer starts on a
+ * cache line, so that threads never write to the same line.
+ */
+class ThreadBuffers {
+public:
+    ThreadBuffers() : n_thread_(0), size_(0), stride_(0)
+    {
+        return;
+    }
+
+    /**
+     * \brief Make sure that there are buffers of the given size for the
+     * maximum number of threads. This should be called outside of any
+     * parallel region.
+     *
+     * Storage is only reallocated if the number of threads or the buffers
+     * need to grow.
+     */
+    void resize(int size)
+    {
+        int n_thread = omp_get_max_threads();
+        if ((n_thread > n_thread_) || (size > stride_)) {
+            const int line = CACHE_LINE / sizeof(real_t);
+            n_thread_      = std::max(n_thread, n_thread_);
+            stride_        = std::max(size, stride_);
+            stride_        = ((stride_ + line - 1) / line) * line;
+            data_.clear();
+            data_.resize(n_thread_ * stride_);
+        }
+        size_ = size;
+        return;
+    }
+
+    int size() const
+    {
+        return size_;
+    }
+
+    /**
+     * \brief Return the number of bytes allocated over all threads
+     */
+    size_t memory() const
+    {
+        return data_.size() * sizeof(real_t);
+    }
+
+    /**
+     * \brief Return a pointer to the calling thread's buffer, aligned to
+     * \ref CACHE_LINE bytes
+     */
+    real_t *get()
+    {
+        assert(omp_get_thread_num() < n_thread_);
+        return data_.data() + omp_get_thread_num() * stride_;
+    }
+
+    /**
+     * \brief Zero the calling thread's buffer
+     */
+    void zero()
+    {
+        real_t *buf = this->get();
+        std::fill(buf, buf + size_, 0.0);
+    }
+
+    /**
+     * \brief Sum the buffers of all threads, passing each sum to \p f
+     *
+     * This must be called by all threads of the enclosing parallel region,
+     * after they are done accumulating into their buffers (i.e. after a
+     * barrier). \p f is called once for each element, as \c f(i, sum), from
+     * whichever thread reduced it. There is an implied barrier at the end.
+     */
+    template <class Function> void reduce(Function f) const
+    {
+        this->reduce(0, size_, f);
+        return;
+    }
+
+    /**
+     * \brief Sum the buffers of all threads over the elements [\p first, \p
+     * last) only, passing each sum to \p f
+     *
+     * The same rules apply as for \ref reduce(Function).
+     */
+    template <class Function>
+    void reduce(int first, int last, Function f) const
+    {
+        assert((first >= 0) && (last <= size_));
+        int n_active = omp_get_num_threads();
+        assert(n_active <= n_thread_);
+        const real_t *data = data_.data();
+        const int stride   = stride_;
+#pragma omp for schedule(static)
+        for (int i = first; i < last; i++) {
+            real_t sum = 0.0;
+            for (int it = 0; it < n_active; it++) {
+                sum += data[it * stride + i];
+            }
+            f(i, sum);
+        }
+        return;
+    }
+
+private:
+    int n_thread_;
+    // Size of the buffers in use
+    int size_;
+    // Allocated size of each buffer
+    int stride_;
+    AlignedVecF data_;
+};
+}
@@ -17,6 +17,8 @@
 #include "transport_sweeper.hpp"
 
 #include "pugixml.hpp"
+#include "util/reduction.hpp"
+#include "core/parallel_environment.hpp"
 
 #include <cmath>
 #include <iostream>
@@ -85,8 +87,27 @@ TransportSweeper::TransportSweeper(const pugi::xml_node &input,
       coarse_data_(nullptr),
       n_sweep_(0),
       n_sweep_inner_(0),
-      do_incoming_update_(input.attribute("update_incoming").as_bool(true))
+      do_incoming_update_(input.attribute("update_incoming").as_bool(true)),
+      gmres_inner_(false),
+      gmres_tol_(input.attribute("gmres_tol").as_float(1.0e-6)),
+      gmres_max_iter_(input.attribute("gmres_max_iter").as_int(20)),
+      gmres_restart_(input.attribute("gmres_restart").as_int(10))
 {
+    if (!input.attribute("inner_solver").empty()) {
+        std::string solver = input.attribute("inner_solver").value();
+        sanitize(solver);
+        if (solver == "gmres") {
+            gmres_inner_ = true;
+        } else if (solver != "source_iteration") {
+            throw EXCEPT("Unrecognized inner solver: " + solver);
+        }
+    }
+    if (gmres_tol_ <= 0.0) {
+        throw EXCEPT("Invalid GMRES tolerance");
+    }
+    if ((gmres_max_iter_ < 1) || (gmres_restart_ < 1)) {
+        throw EXCEPT("Invalid GMRES iteration limits");
+    }
     return;
 }
 
@@ -96,43 +117,130 @@ TransportSweeper::TransportSweeper(const pugi::xml_node &input)
       coarse_data_(nullptr),
       n_sweep_(0),
       n_sweep_inner_(0),
-      do_incoming_update_(input.attribute("update_incoming").as_bool(true))
+      do_incoming_update_(input.attribute("update_incoming").as_bool(true)),
+      gmres_inner_(false),
+      gmres_tol_(1.0e-6),
+      gmres_max_iter_(20),
+      gmres_restart_(10)
 {
     return;
 }
 
+int TransportSweeper::gmres_inner(ArrayB1 &flux_1g,
+                                  const std::function<void()> &sweep)
+{
+    const int n = flux_1g.size();
+
+    // Apply one sweep to x
+    auto apply = [&](const VectorX &x, VectorX &y) {
+        for (int i = 0; i < n; i++) {
+            flux_1g(i) = x[i];
+        }
+        sweep();
+        for (int i = 0; i < n; i++) {
+            y[i] = flux_1g(i);
+        }
+    };
+
+    VectorX x0(n);
+    for (int i = 0; i < n; i++) {
+        x0[i] = flux_1g(i);
+    }
+
+    // Solve for the correction to the initial guess, d, from
+    // (I - M)*d = S(x0) - x0, where M*d = S(x0 + d) - S(x0)
+    VectorX s0(n);
+    apply(x0, s0);
+    VectorX r0 = s0 - x0;
+
+    VectorX xd(n);
+    auto op = [&](const VectorX &d, VectorX &y) {
+        xd = x0 + d;
+        apply(xd, y);
+        y = d - (y - s0);
+    };
+
+    VectorX d = VectorX::Zero(n);
+    int n_op  = gmres(op, r0, d, gmres_tol_ * s0.norm() / r0.norm(),
+                     gmres_max_iter_ - 1, gmres_restart_);
+
+    xd = x0 + d;
+    for (int i = 0; i < n; i++) {
+        flux_1g(i) = xd[i];
+    }
+
+    return n_op + 1;
+}
+
 real_t TransportSweeper::total_fission(bool old) const
 {
-    real_t tfis      = 0.0;
-    const auto &flux = old ? flux_old_ : flux_;
-    for (auto &xsr : *xs_mesh_) {
+    const auto &flux  = old ? flux_old_ : flux_;
+    const VecI &xsreg = xs_mesh_->xsreg_index();
+    return parallel_sum(xsreg.size(), [&](int ireg) -> real_t {
+        int ixs = xsreg[ireg];
+        if (ixs < 0) {
+            return 0.0;
+        }
+        real_t fs = 0.0;
         for (int ig = 0; ig < n_group_; ig++) {
-            real_t xsnf = xsr.xsmacnf(ig);
-            for (auto &ireg : xsr.reg()) {
-                tfis += flux((int)ireg, (int)ig) * vol_[ireg] * xsnf;
-            }
+            fs += xs_mesh_->xsnf(ig)[ixs] * flux(ireg, ig);
         }
-    }
-    return tfis;
+        return fs * vol_[ireg];
+    });
 }
 
 void TransportSweeper::calc_fission_source(real_t k,
                                            ArrayB1 &fission_source) const
 {
+    ThreadTeam team(Phase::SOURCE);
     real_t rkeff   = 1.0 / k;
     fission_source = 0.0;
-    for (auto &xsr : *xs_mesh_) {
-        const auto &xsnf = xsr.xsmacnf();
+
+    const VecI &xsreg = xs_mesh_->xsreg_index();
+#pragma omp parallel for schedule(static)
+    for (int ireg = 0; ireg < (int)xsreg.size(); ireg++) {
+        int ixs = xsreg[ireg];
+        if (ixs < 0) {
+            continue;
+        }
+        real_t fs = 0.0;
         for (int ig = 0; ig < (int)n_group_; ig++) {
-            for (auto &ireg : xsr.reg()) {
-                fission_source(ireg) += rkeff * xsnf[ig] * flux_(ireg, ig);
-            }
+            fs += xs_mesh_->xsnf(ig)[ixs] * flux_(ireg, ig);
         }
+        fission_source(ireg) = rkeff * fs;
     }
 
     return;
 }
 
+TransportSweeper::FissionTotals
+TransportSweeper::fission_update(real_t k, ArrayB1 &fission_source) const
+{
+    ThreadTeam team(Phase::SOURCE);
+    const real_t rkeff = 1.0 / k;
+    fission_source     = 0.0;
+
+    const VecI &xsreg = xs_mesh_->xsreg_index();
+    auto tfis = parallel_sums<2>(xsreg.size(), [&](int ireg, real_t *s) {
+        int ixs = xsreg[ireg];
+        if (ixs < 0) {
+            return;
+        }
+        real_t fs     = 0.0;
+        real_t fs_old = 0.0;
+        for (int ig = 0; ig < n_group_; ig++) {
+            real_t nf = xs_mesh_->xsnf(ig)[ixs];
+            fs += nf * flux_(ireg, ig);
+            fs_old += nf * flux_old_(ireg, ig);
+        }
+        fission_source(ireg) = rkeff * fs;
+        s[0] += fs * vol_[ireg];
+        s[1] += fs_old * vol_[ireg];
+    });
+
+    return {tfis[0], tfis[1]};
+}
+
 /**
  * \todo make this general for all mesh treatments. For now, since this is only
  * used for MoC, we wil just hard-code it to use PLANE treatment.
@@ -209,16 +317,45 @@ ArrayB2 TransportSweeper::get_pin_flux(MeshTreatment treatment) const
 
 real_t TransportSweeper::flux_residual() const
 {
-    real_t r    = 0.0;
-    auto it     = flux_.begin();
-    auto it_old = flux_old_.begin();
-    auto end    = flux_.end();
-    while (it != end) {
-        real_t e = *it - *it_old;
-        r += e * e;
-        ++it;
-        ++it_old;
+    assert(flux_.isStorageContiguous());
+    assert(flux_old_.isStorageContiguous());
+    return std::sqrt(
+        squared_distance(flux_.data(), flux_old_.data(), flux_.size()));
+}
+
+void TransportSweeper::write_checkpoint(H5Node &node) const
+{
+    node.write("flux", flux_);
+    return;
+}
+
+void TransportSweeper::read_checkpoint(H5Node &node)
+{
+    ArrayB2 flux;
+    node.read("flux", flux);
+    if ((flux.extent(0) != flux_.extent(0)) ||
+        (flux.extent(1) != flux_.extent(1))) {
+        throw EXCEPT("Checkpoint flux does not match the sweeper shape");
+    }
+    flux_     = flux;
+    flux_old_ = flux;
+    return;
+}
+
+void TransportSweeper::output_performance(H5Node &node) const
+{
+    node.write("sweeps", n_sweep_);
+    node.write("inner_sweeps", n_sweep_inner_);
+    return;
+}
+
+void TransportSweeper::memory(MemoryReport &report) const
+{
+    report.add("flux", bytes(flux_) + bytes(flux_old_) + bytes(vol_));
+    report.add("thread_buffers", thread_flux_.memory() + workspace_.memory());
+    if (xs_mesh_) {
+        report.add("xs_mesh", xs_mesh_->memory());
     }
-    return std::sqrt(r);
+    return;
 }
 }
@@ -16,12 +16,14 @@
 
 #pragma once
 
+#include <functional>
 #include <iosfwd>
 #include <memory>
 #include <vector>
 #include "util/blitz_typedefs.hpp"
 #include "util/error.hpp"
 #include "util/global_config.hpp"
+#include "util/memory.hpp"
 #include "util/range.hpp"
 #include "core/angular_quadrature.hpp"
 #include "core/coarse_data.hpp"
@@ -30,6 +32,8 @@
 #include "core/source.hpp"
 #include "core/source_factory.hpp"
 #include "core/source_isotropic.hpp"
+#include "core/sweep_workspace.hpp"
+#include "core/thread_buffers.hpp"
 #include "core/xs_mesh.hpp"
 #include "core/xs_mesh_homogenized.hpp"
 
@@ -68,6 +72,23 @@ public:
      */
     virtual void update_incoming_flux() = 0;
 
+    /**
+     * \brief Set the incoming boundary flux of each group to an isotropic
+     * value
+     *
+     * \param spectrum the scalar flux of each group; the angular flux on the
+     * boundary is set to \f$ \phi_g / 4\pi \f$.
+     *
+     * This is used to start the boundary conditions consistently with a
+     * scalar flux that was projected onto the sweeper from elsewhere, since
+     * the angular flux itself can't be carried between discretizations.
+     * Sweepers without boundary conditions ignore it.
+     */
+    virtual void initialize_boundary(const ArrayB1 &spectrum)
+    {
+        return;
+    }
+
     /**
      * \brief Return a const reference to the Sweeper's \ref
      * AngularQuadrature
@@ -274,6 +295,19 @@ public:
         return;
     }
 
+    /**
+     * \brief Return the number of consecutive groups that the sweeper treats
+     * together.
+     *
+     * Some sweepers defer the actual sweep of a group until \ref sweep() has
+     * been called for every group in its block. Callers that want to skip
+     * the sweeps for some groups should only do so for whole blocks.
+     */
+    virtual int group_block() const
+    {
+        return 1;
+    }
+
     /**
      * \brief Compute a flux residual between the current state of the flux
      * and the old flux. Defaults to L-2 norm.
@@ -288,6 +322,25 @@ public:
      */
     virtual real_t total_fission(bool old = false) const;
 
+    /**
+     * \brief Total fission source of the current and previous flux, as
+     * returned by \ref fission_update()
+     */
+    struct FissionTotals {
+        real_t current;
+        real_t old;
+    };
+
+    /**
+     * \brief Calculate the fission source for eigenvalue \p k, and the total
+     * fission source of the current and previous flux, in one pass
+     *
+     * This is the same as \ref calc_fission_source() followed by \ref
+     * total_fission() for both fluxes, but only reads each flux once.
+     */
+    virtual FissionTotals fission_update(real_t k,
+                                         ArrayB1 &fission_source) const;
+
     /**
      * \brief Return a 3-D array containing normalized pin powers
      *
@@ -305,6 +358,54 @@ public:
      */
     virtual ArrayB3 pin_powers() const;
 
+    /**
+     * \brief Write the state needed to resume a calculation to an HDF5 node
+     *
+     * The default implementation only stores the scalar flux. Sweepers
+     * holding additional iterative state (e.g. boundary conditions) should
+     * extend this, calling the base version.
+     */
+    virtual void write_checkpoint(H5Node &node) const;
+
+    /**
+     * \brief Restore state written by \ref write_checkpoint()
+     *
+     * Both the current and old flux are set from the stored flux.
+     */
+    virtual void read_checkpoint(H5Node &node);
+
+    /**
+     * \brief Write throughput metrics gathered over the lifetime of the
+     * sweeper to an HDF5 node
+     *
+     * The default implementation writes the number of sweeps and inner
+     * sweeps. Derived sweepers should extend this with their own measures of
+     * work done and its rate, calling the base version.
+     */
+    virtual void output_performance(H5Node &node) const;
+
+    /**
+     * \brief Add the memory used by the sweeper to a \ref MemoryReport
+     *
+     * The default implementation reports the scalar flux, volumes,
+     * thread-private buffers and the cross-section mesh. Derived sweepers
+     * should add their own storage (ray data, boundary conditions, etc.),
+     * calling the base version.
+     */
+    virtual void memory(MemoryReport &report) const;
+
+    /**
+     * \brief Release data that was only needed to set up the sweeper
+     *
+     * This is called once the solver is set up, before the first sweep. The
+     * default does nothing. Derived sweepers should release or shrink to fit
+     * whatever their sweeps don't use, calling the base version.
+     */
+    virtual void compact()
+    {
+        return;
+    }
+
     /**
      * \brief Return a const reference to the region volumes
      */
@@ -314,6 +415,27 @@ public:
     }
 
 protected:
+    /**
+     * \brief Converge the within-group problem of a group with restarted
+     * GMRES
+     *
+     * \param [in,out] flux_1g the scalar flux of the group. The initial
+     * guess, replaced by the solution.
+     * \param [in] sweep performs one transport sweep of the group, from the
+     * self-scatter source of the flux in \p flux_1g, storing the resulting
+     * flux back in \p flux_1g.
+     *
+     * \returns the number of sweeps performed
+     *
+     * One sweep is an affine map of the flux, S(x) = M*x + b, as long as the
+     * fixed source and the incoming boundary flux are held constant, which
+     * \p sweep must ensure. GMRES then solves (I - M)*x = b for a correction
+     * to the initial guess, with one sweep per operator application. The
+     * caller should follow this with a regular sweep, to update the boundary
+     * conditions and currents.
+     */
+    int gmres_inner(ArrayB1 &flux_1g, const std::function<void()> &sweep);
+
     const CoreMesh *core_mesh_;
 
     SP_XSMesh_t xs_mesh_;
@@ -333,6 +455,13 @@ protected:
     // Region volumes
     VecF vol_;
 
+    // Thread-private scalar flux accumulators, reused by each sweep
+    ThreadBuffers thread_flux_;
+
+    // Per-thread scratch storage for the sweep kernels. Sized by the
+    // derived sweepers in initialize()
+    SweepWorkspace workspace_;
+
     AngularQuadrature ang_quad_;
 
     // Reference to the CoarseData object that should be used to store
@@ -348,6 +477,14 @@ protected:
 
     // Do incoming flux updates?
     bool do_incoming_update_;
+
+    // Use GMRES, rather than source iteration, for the within-group
+    // problem. The relative residual to converge to, the maximum number of
+    // sweeps and the number of Krylov vectors before a restart.
+    bool gmres_inner_;
+    real_t gmres_tol_;
+    int gmres_max_iter_;
+    int gmres_restart_;
 };
 
 typedef std::unique_ptr<TransportSweeper> UP_Sweeper_t;
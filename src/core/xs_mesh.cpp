@@ -19,12 +19,18 @@
 #include <iostream>
 #include <map>
 #include <memory>
+#include <unordered_map>
+#include <unordered_set>
 #include "util/blitz_typedefs.hpp"
 #include "util/files.hpp"
 #include "util/global_config.hpp"
+#include "util/partition.hpp"
 
 namespace mocc {
-XSMesh::XSMesh(const CoreMesh &mesh, MeshTreatment treatment) : state_(0)
+XSMesh::XSMesh(const CoreMesh &mesh, MeshTreatment treatment)
+    : state_(0),
+      mat_lib_(&mesh.mat_lib()),
+      lib_state_(mesh.mat_lib().state())
 {
 
     LogFile << "Initializing XS Mesh... ";
@@ -41,36 +47,16 @@ XSMesh::XSMesh(const CoreMesh &mesh, MeshTreatment treatment) : state_(0)
     // map from material index to the flat source region indices that are filled
     // by the indexed material. After that, everything else should be quite
     // similar.
-    std::map<int, VecI> fsr_map;
-
+    //
+    // The material of every region is found in parallel over the pins, and
+    // the regions are then bucketed by material. The buckets come out in
+    // ascending region order, so the result is the same as a serial loop.
+    std::vector<const Pin *> pins;
     if (treatment == MeshTreatment::TRUE) {
-        int ireg = 0;
-        for (const auto &pini : mesh) {
-            const PinMesh &pm   = pini->mesh();
-            const VecI &mat_ids = pini->mat_ids();
-            int ixsreg          = 0;
-            for (auto &mat_id : mat_ids) {
-                for (size_t reg = 0; reg < pm.n_fsrs(ixsreg); reg++) {
-                    fsr_map[mat_id].push_back(ireg);
-                    ireg++;
-                }
-                ixsreg++;
-            }
-        }
+        pins.assign(mesh.begin(), mesh.end());
     } else if (treatment == MeshTreatment::PLANE) {
-        int ireg = 0;
         for (const auto &mplane : mesh.macroplanes()) {
-            for (const auto &pin : mplane) {
-                int ixsreg = 0;
-                for (const auto mat_id : pin->mat_ids()) {
-                    for (unsigned reg = 0; reg < pin->mesh().n_fsrs(ixsreg);
-                         reg++) {
-                        fsr_map[mat_id].push_back(ireg);
-                        ireg++;
-                    }
-                    ixsreg++;
-                }
-            }
+            pins.insert(pins.end(), mplane.begin(), mplane.end());
         }
     } else {
         // Should be using the homogenized class. This would be nice to merge at
@@ -78,42 +64,199 @@ XSMesh::XSMesh(const CoreMesh &mesh, MeshTreatment treatment) : state_(0)
         return;
     }
 
-    int n_xsreg = fsr_map.size();
-    this->allocate_xs(n_xsreg, ng_);
-
-    // The ids/keys in fsr_map correspond to the user-specified IDs in the
+    // The ids/keys in mat_index correspond to the user-specified IDs in the
     // material library. We want to cast this into a contiguous, zero-based
-    // index space for internal storage and saner indexing, hence the imat
-    // counter.
-    n_reg_expanded_ = 0;
+    // index space for internal storage and saner indexing, in ascending order
+    // of the IDs.
+    std::map<int, int> mat_index;
+    VecI first_reg(pins.size() + 1, 0);
+    for (int ipin = 0; ipin < (int)pins.size(); ipin++) {
+        for (const auto mat_id : pins[ipin]->mat_ids()) {
+            mat_index[mat_id] = 0;
+        }
+        first_reg[ipin + 1] = first_reg[ipin] + pins[ipin]->n_reg();
+    }
+    int n_xsreg = mat_index.size();
     VecI mat_ids(n_xsreg);
-    int imat = 0;
-    for (const auto &mat_pair : fsr_map) {
-        mat_ids[imat]   = mat_pair.first;
-        const auto &mat = mat_lib[mat_pair.first];
+    {
+        int imat = 0;
+        for (auto &mat_pair : mat_index) {
+            mat_ids[imat]   = mat_pair.first;
+            mat_pair.second = imat++;
+        }
+    }
+
+    n_reg_expanded_ = first_reg.back();
+    VecI reg_mat(n_reg_expanded_);
+#pragma omp parallel for schedule(static)
+    for (int ipin = 0; ipin < (int)pins.size(); ipin++) {
+        const PinMesh &pm = pins[ipin]->mesh();
+        int ireg          = first_reg[ipin];
+        int ixsreg        = 0;
+        for (const auto mat_id : pins[ipin]->mat_ids()) {
+            int imat = mat_index.at(mat_id);
+            for (size_t reg = 0; reg < pm.n_fsrs(ixsreg); reg++) {
+                reg_mat[ireg++] = imat;
+            }
+            ixsreg++;
+        }
+    }
+    std::vector<VecI> fsrs = parallel_buckets(reg_mat, n_xsreg);
+
+    this->allocate_xs(n_xsreg, ng_);
+    for (int imat = 0; imat < n_xsreg; imat++) {
+        const auto &mat = mat_lib[mat_ids[imat]];
         xstr_(imat, blitz::Range::all()) = mat.xstr();
         xsnf_(imat, blitz::Range::all()) = mat.xsnf();
         xsch_(imat, blitz::Range::all()) = mat.xsch();
         xsf_(imat, blitz::Range::all())  = mat.xsf();
-        n_reg_expanded_ += mat_pair.second.size();
-
-        imat++;
     }
 
     // Preallocate space for the regions. Saves on lots of copies for large
     // xsmeshes.
-    regions_.reserve(fsr_map.size());
-    imat = 0;
-    for (auto &reg_pair : fsr_map) {
+    regions_.reserve(n_xsreg);
+    for (int imat = 0; imat < n_xsreg; imat++) {
         const auto &mat = mat_lib[mat_ids[imat]];
-        regions_.emplace_back(reg_pair.second, &xstr_(imat, 0), &xsnf_(imat, 0),
+        regions_.emplace_back(fsrs[imat], &xstr_(imat, 0), &xsnf_(imat, 0),
                               &xsch_(imat, 0), &xsf_(imat, 0), &xsrm_(imat, 0),
-                              mat.xssc());
-        imat++;
+                              n_xsreg, mat.xssc());
+        this->set_scattering_pn(regions_.back(), mat);
     }
+    mat_ids_ = mat_ids;
+
+    this->flatten();
 
     LogFile << "done." << std::endl;
 
     return;
 }
+
+void XSMesh::update()
+{
+    // Pick up materials that have been replaced in the library
+    if (!this->materials_changed()) {
+        return;
+    }
+
+    auto vec = [](const ArrayB1 &xs) { return VecF(xs.begin(), xs.end()); };
+
+    int n_updated = 0;
+    for (int ixs = 0; ixs < (int)regions_.size(); ixs++) {
+        int mat_id = mat_ids_[ixs];
+        if (mat_lib_->material_state(mat_id) <= lib_state_) {
+            continue;
+        }
+        const Material &mat = mat_lib_->get_material_by_id(mat_id);
+        auto &xsr           = regions_[ixs];
+        xsr.update(vec(mat.xstr()), vec(mat.xsnf()), vec(mat.xsch()),
+                   vec(mat.xsf()), mat.xssc());
+        this->set_scattering_pn(xsr, mat);
+        xsr.is_fissile_    = mat.is_fissile();
+        region_state_[ixs] = state_ + 1;
+        n_updated++;
+    }
+    lib_state_ = mat_lib_->state();
+
+    if (n_updated > 0) {
+        LogFile << "Updated cross sections of " << n_updated
+                << " materials" << std::endl;
+        this->flatten();
+        state_++;
+    }
+    return;
+}
+
+void XSMesh::flatten()
+{
+    int n_xsreg = regions_.size();
+
+    xsreg_.assign(n_reg_expanded_, -1);
+    int ixs = 0;
+    for (const auto &xsr : regions_) {
+        for (const int ireg : xsr.reg()) {
+            assert(ireg < n_reg_expanded_);
+            xsreg_[ireg] = ixs;
+        }
+        ixs++;
+    }
+
+    xsreg_runs_.clear();
+    for (int ireg = 0; ireg < n_reg_expanded_; ireg++) {
+        if ((ireg == 0) || (xsreg_[ireg] != xsreg_[ireg - 1])) {
+            xsreg_runs_.push_back(ireg);
+        }
+    }
+    xsreg_runs_.push_back(n_reg_expanded_);
+
+    // New regions are as old as the current state
+    if (region_state_.size() != regions_.size()) {
+        region_state_.assign(n_xsreg, state_);
+    }
+
+    // Regions with identical scattering matrices (e.g. the same pin type in
+    // the same flux, for a homogenized mesh) share a single copy, and a
+    // single set of rows in the flattened table. shared[ixs] is the first
+    // region with the same matrix as region ixs.
+    VecI shared(n_xsreg);
+    std::unordered_map<size_t, VecI> by_hash;
+    for (int ixs = 0; ixs < n_xsreg; ixs++) {
+        auto &xsr     = regions_[ixs];
+        shared[ixs]   = ixs;
+        auto &matches = by_hash[xsr.xsmacsc_->hash()];
+        for (int jxs : matches) {
+            const auto &first = regions_[jxs].xsmacsc_;
+            if ((first == xsr.xsmacsc_) || (*first == *xsr.xsmacsc_)) {
+                xsr.xsmacsc_ = first;
+                shared[ixs]  = jxs;
+                break;
+            }
+        }
+        if (shared[ixs] == ixs) {
+            matches.push_back(ixs);
+        }
+    }
+
+    scat_min_.resize(ng_ * n_xsreg);
+    scat_max_.resize(ng_ * n_xsreg);
+    scat_offset_.resize(ng_ * n_xsreg);
+    scat_.clear();
+    int i = 0;
+    for (int ig = 0; ig < (int)ng_; ig++) {
+        for (int ixs = 0; ixs < n_xsreg; ixs++) {
+            const ScatteringRow &row = regions_[ixs].xsmacsc().to(ig);
+            scat_min_[i]             = row.min_g;
+            scat_max_[i]             = row.max_g;
+            if (shared[ixs] == ixs) {
+                scat_offset_[i] = scat_.size();
+                scat_.insert(scat_.end(), row.begin(), row.end());
+            } else {
+                scat_offset_[i] = scat_offset_[ig * n_xsreg + shared[ixs]];
+            }
+            i++;
+        }
+    }
+
+    return;
+}
+
+size_t XSMesh::memory() const
+{
+    size_t mem = bytes(xstr_) + bytes(xsnf_) + bytes(xsch_) + bytes(xsf_) +
+                 bytes(xsrm_) + bytes(xsreg_) + bytes(xsreg_runs_) +
+                 bytes(scat_min_) +
+                 bytes(scat_max_) + bytes(scat_offset_) + bytes(scat_) +
+                 bytes(region_state_) + bytes(mat_ids_);
+    // Count each shared scattering matrix once
+    std::unordered_set<const ScatteringMatrix *> counted;
+    for (const auto &xsr : regions_) {
+        mem += sizeof(XSMeshRegion) + bytes(xsr.reg());
+        if (counted.insert(xsr.xsmacsc_.get()).second) {
+            mem += xsr.xsmacsc().memory();
+        }
+        for (int l = 1; l <= xsr.scat_order(); l++) {
+            mem += xsr.xsmacsc_pn(l).memory();
+        }
+    }
+    return mem;
+}
 }
@@ -16,10 +16,13 @@
 
 #pragma once
 
+#include <algorithm>
+#include <memory>
 #include <vector>
 #include "util/blitz_typedefs.hpp"
 #include "util/fp_utils.hpp"
 #include "util/global_config.hpp"
+#include "util/memory.hpp"
 #include "core_mesh.hpp"
 #include "output_interface.hpp"
 #include "xs_mesh_region.hpp"
@@ -68,18 +71,24 @@ public:
     /**
      * \brief Update macroscopic cross sections if needed
      *
-     * Since the stock XSMesh only deals in un-homogenized, macroscopic
-     * cross sections, this does nothing. When support for microscopic cross
-     * sections is added, this will need to start doing some work.
+     * The stock XSMesh only deals in un-homogenized, macroscopic cross
+     * sections, so this only picks up the materials that have been replaced
+     * in the \ref MaterialLib since the last update. When support for
+     * microscopic cross sections is added, this will need to start doing
+     * more work.
      *
-     * For right now, this is overridden in the \ref XSMeshHomogenized class
-     * to calculate new homoginzed cross sections given a new state of the
-     * FM scalar flux.
+     * This is overridden in the \ref XSMeshHomogenized class to calculate
+     * new homoginzed cross sections given a new state of the FM scalar flux.
      */
-    virtual void update()
+    virtual void update();
+
+    /**
+     * \brief Return whether any material has been replaced in the \ref
+     * MaterialLib since the last update
+     */
+    bool materials_changed() const
     {
-        // Do nothing for the regular XS Mesh... for now
-        return;
+        return mat_lib_ && (mat_lib_->state() != lib_state_);
     }
 
     virtual void output(H5Node &file) const
@@ -88,6 +97,22 @@ public:
         assert(false);
     }
 
+    /**
+     * \brief Return the highest Legendre order of the scattering kernel
+     * available in any region
+     *
+     * Regions with a lower order have no scattering in the higher moments.
+     * This is always zero for homogenized meshes.
+     */
+    int scat_order() const
+    {
+        int order = 0;
+        for (const auto &xsr : regions_) {
+            order = std::max(order, xsr.scat_order());
+        }
+        return order;
+    }
+
     bool operator==(const XSMesh &other) const
     {
         if (regions_ != other.regions_) {
@@ -112,6 +137,101 @@ public:
         return n_reg_expanded_;
     }
 
+    /**
+     * \brief Return the index of the XS mesh region that each region of the
+     * expanded mesh belongs to, or -1 if it is not covered by the XS mesh
+     */
+    const VecI &xsreg_index() const
+    {
+        return xsreg_;
+    }
+
+    /**
+     * \brief Return the first region of each run of consecutive regions of
+     * the expanded mesh that belong to the same XS mesh region, followed by
+     * the number of regions
+     *
+     * Loops over the regions can look up the cross sections once per run,
+     * rather than once per region.
+     */
+    const VecI &xsreg_runs() const
+    {
+        return xsreg_runs_;
+    }
+
+    /**
+     * \brief Return the transport cross sections of all XS mesh regions for
+     * group \p ig
+     *
+     * The cross sections are stored group-major, so the returned array is
+     * contiguous and indexed by XS mesh region.
+     */
+    const real_t *xstr(int ig) const
+    {
+        return &xstr_(0, ig);
+    }
+
+    /**
+     * \brief Return the nu-fission cross sections of all XS mesh regions for
+     * group \p ig
+     */
+    const real_t *xsnf(int ig) const
+    {
+        return &xsnf_(0, ig);
+    }
+
+    /**
+     * \brief Return the fission spectrum of all XS mesh regions for group
+     * \p ig
+     */
+    const real_t *xsch(int ig) const
+    {
+        return &xsch_(0, ig);
+    }
+
+    /**
+     * \brief Return the fission cross sections of all XS mesh regions for
+     * group \p ig
+     */
+    const real_t *xsf(int ig) const
+    {
+        return &xsf_(0, ig);
+    }
+
+    /**
+     * \brief Return the removal cross sections of all XS mesh regions for
+     * group \p ig
+     */
+    const real_t *xsrm(int ig) const
+    {
+        return &xsrm_(0, ig);
+    }
+
+    /**
+     * \brief Return the row of the flattened scattering table for scattering
+     * into group \p ig in XS mesh region \p ixs
+     *
+     * This is equivalent to <tt>(*this)[ixs].xsmacsc().to(ig)</tt>, but the
+     * rows for all regions live in a single array, ordered by group and then
+     * by XS mesh region.
+     */
+    ScatteringRow scat_row(int ig, int ixs) const
+    {
+        int i = ig * regions_.size() + ixs;
+        return ScatteringRow(scat_min_[i], scat_max_[i],
+                             &scat_[scat_offset_[i]]);
+    }
+
+    /**
+     * \brief Return the self-scattering cross section of XS mesh region
+     * \p ixs in group \p ig from the flattened scattering table
+     */
+    real_t self_scat(int ig, int ixs) const
+    {
+        int i = ig * regions_.size() + ixs;
+        return scat_[scat_offset_[i] + ig - scat_min_[i]];
+    }
+
     /**
      * \brief Return the encoded state
      */
@@ -120,6 +240,24 @@ public:
         return state_;
     }
 
+    /**
+     * \brief Return the state of the XS mesh at which the cross sections of
+     * region \p ixs last changed
+     *
+     * A region whose value is not greater than some earlier value of \ref
+     * state() has not changed since then.
+     */
+    int region_state(int ixs) const
+    {
+        return region_state_[ixs];
+    }
+
+    /**
+     * \brief Return the number of bytes used to store the macroscopic cross
+     * sections, region lists, scattering matrices and flattened tables
+     */
+    size_t memory() const;
+
 protected:
     /**
      * \brief Allocate space to store the actual cross sections.
@@ -132,16 +270,43 @@ protected:
      */
     void allocate_xs(int nxs, int ng)
     {
+        // Store group-major, so that the cross sections for all regions in a
+        // given group are contiguous
         auto shape = blitz::shape(nxs, ng);
-        xstr_.resize(shape);
-        xsnf_.resize(shape);
-        xsch_.resize(shape);
-        xsf_.resize(shape);
-        xsrm_.resize(shape);
-        auto test_slice(xstr_(0, blitz::Range::all()));
+        xstr_.reference(ArrayB2(shape, blitz::ColumnMajorArray<2>()));
+        xsnf_.reference(ArrayB2(shape, blitz::ColumnMajorArray<2>()));
+        xsch_.reference(ArrayB2(shape, blitz::ColumnMajorArray<2>()));
+        xsf_.reference(ArrayB2(shape, blitz::ColumnMajorArray<2>()));
+        xsrm_.reference(ArrayB2(shape, blitz::ColumnMajorArray<2>()));
+        auto test_slice(xstr_(blitz::Range::all(), 0));
         assert(test_slice.isStorageContiguous());
     }
 
+    /**
+     * \brief Rebuild the region index and the flattened scattering table from
+     * the \ref XSMeshRegion objects
+     *
+     * This must be called whenever the regions are constructed, their region
+     * lists change, or their scattering matrices are replaced. Regions whose
+     * scattering matrices are identical are made to share one copy, and one
+     * set of rows in the flattened table.
+     */
+    void flatten();
+
+    /**
+     * \brief Give a region the higher-order scattering matrices of a
+     * material
+     */
+    void set_scattering_pn(XSMeshRegion &xsr, const Material &mat)
+    {
+        xsr.xsmacsc_pn_.clear();
+        for (int l = 1; l <= mat.scat_order(); l++) {
+            xsr.xsmacsc_pn_.push_back(
+                std::make_shared<ScatteringMatrix>(mat.xssc_pn(l)));
+        }
+        return;
+    }
+
     size_t ng_;
 
     // Vector of xs mesh regions
@@ -154,6 +319,19 @@ protected:
     ArrayB2 xsf_;
     ArrayB2 xsrm_;
 
+    // Index of the XS mesh region that each expanded region belongs to
+    VecI xsreg_;
+
+    // Bounds of the runs of regions in the same XS mesh region
+    VecI xsreg_runs_;
+
+    // Flattened, banded scattering table. The rows for all regions are packed
+    // into scat_, indexed by [to group * n_xsreg + xsreg] in the others.
+    VecI scat_min_;
+    VecI scat_max_;
+    VecI scat_offset_;
+    VecF scat_;
+
     // Energy group upper bounds
     VecF eubounds_;
 
@@ -164,6 +342,18 @@ protected:
     // the cross sections change, this shall assume a new value, unique to the
     // history of the XSMesh object
     int state_;
+
+    // The value of state_ at which each region last changed
+    VecI region_state_;
+
+    // Material library that the cross sections come from, null if they do
+    // not, and its state as of the last update
+    const MaterialLib *mat_lib_;
+    int lib_state_;
+
+    // Material ID of each region. Only used by the stock XSMesh, where each
+    // region is a material.
+    VecI mat_ids_;
 };
 
 typedef std::shared_ptr<XSMesh> SP_XSMesh_t;
@@ -215,7 +405,7 @@ public:
     ExpandedXS(const XSMesh *xs_mesh)
         : xstr_(xs_mesh->n_reg_expanded()),
           xs_mesh_(xs_mesh),
-          state_(std::make_shared<std::pair<int, int>>(-1, -1))
+          state_(std::make_shared<State>())
     {
         return;
     }
@@ -258,20 +448,40 @@ public:
         return xstr_.size();
     }
 
+    /**
+     * \brief Expand the cross sections of a group
+     *
+     * Nothing is done if the group and the cross sections are the same as
+     * for the last expansion. If only the cross sections have changed, just
+     * the regions whose \ref XSMeshRegion has changed are rewritten. If the
+     * all-group cache is enabled, a change of group copies the group from
+     * the cache, which is itself kept up to date region by region.
+     */
     void expand(int group)
     {
-        // only update if the group has canged or the cross sections have been
-        // updated
-        if ((group != state_->first) || (xs_mesh_->state() != state_->second)) {
-            state_->first  = group;
-            state_->second = xs_mesh_->state();
-            for (const auto &xsr : *xs_mesh_) {
-                real_t xs = xsr.xsmactr(group);
-                for (const int ireg : xsr.reg()) {
-                    xstr_(ireg) = xs;
+        int xs_state = xs_mesh_->state();
+        if ((group == state_->group) && (xs_state == state_->xs_state)) {
+            return;
+        }
+
+        if (state_->all.size() > 0) {
+            this->update_cache();
+            xstr_ = state_->all(blitz::Range::all(), group);
+        } else if (group == state_->group) {
+            this->expand_changed(xs_mesh_->xstr(group), state_->xs_state,
+                                 xstr_.data());
+        } else {
+            const VecI &index = xs_mesh_->xsreg_index();
+            const real_t *xs  = xs_mesh_->xstr(group);
+            for (int ireg = 0; ireg < (int)index.size(); ireg++) {
+                if (index[ireg] >= 0) {
+                    xstr_(ireg) = xs[index[ireg]];
                 }
             }
         }
+
+        state_->group    = group;
+        state_->xs_state = xs_state;
         return;
     }
 
@@ -285,23 +495,51 @@ public:
             // If we are doing splitting, skip the checks on group, etc. and
             // always expand
             assert((int)split.size() == xs_mesh_->n_reg_expanded());
-            for (const auto &xsr : *xs_mesh_) {
-                real_t xs = xsr.xsmactr(group);
-                for (const int ireg : xsr.reg()) {
-                    xstr_(ireg) = xs + split(ireg);
+            const VecI &index = xs_mesh_->xsreg_index();
+            const real_t *xs  = xs_mesh_->xstr(group);
+            for (int ireg = 0; ireg < (int)index.size(); ireg++) {
+                if (index[ireg] >= 0) {
+                    xstr_(ireg) = xs[index[ireg]] + split(ireg);
                 }
             }
+            // Make sure the split cross sections are not mistaken for the
+            // plain ones by the next expansion
+            state_->group = -1;
         } else {
             this->expand(group);
         }
         return;
     }
 
+    /**
+     * \brief Keep the expanded cross sections of all groups, so that
+     * changing groups does not need a full expansion
+     *
+     * This costs the storage of the cross sections of all groups on the
+     * expanded mesh, and is shared by all instances referring to the same
+     * data.
+     */
+    void cache_all_groups()
+    {
+        int n_reg = xs_mesh_->n_reg_expanded();
+        int ng    = xs_mesh_->n_group();
+        state_->all.reference(
+            ArrayB2(n_reg, ng, blitz::ColumnMajorArray<2>()));
+        state_->all       = 0.0;
+        state_->all_state = -1;
+        return;
+    }
+
     const ArrayB1 &xs() const
     {
         return xstr_;
     }
 
+    size_t memory() const
+    {
+        return bytes(xstr_) + (state_ ? bytes(state_->all) : 0);
+    }
+
     auto begin() const
     {
         return xstr_.begin();
@@ -313,13 +551,59 @@ public:
     }
 
 private:
+    /**
+     * \brief State of the expanded cross sections, shared by all instances
+     * referring to the same data
+     */
+    struct State {
+        // Energy group in the one-group array, and the state of the XS mesh
+        // it was expanded from. -1 if it has not been expanded.
+        int group    = -1;
+        int xs_state = -1;
+
+        // All-group cache, indexed by expanded region and group, and the
+        // state of the XS mesh it was expanded from. Empty if not enabled.
+        ArrayB2 all;
+        int all_state = -1;
+    };
+
     ArrayB1 xstr_;
     const XSMesh *xs_mesh_;
+    std::shared_ptr<State> state_;
+
+    /**
+     * \brief Rewrite the expanded regions of the XS mesh regions that have
+     * changed since XS mesh state \p since
+     */
+    void expand_changed(const real_t *xs, int since, real_t *out) const
+    {
+        for (int ixs = 0; ixs < (int)xs_mesh_->size(); ixs++) {
+            if (xs_mesh_->region_state(ixs) > since) {
+                for (const int ireg : (*xs_mesh_)[ixs].reg()) {
+                    out[ireg] = xs[ixs];
+                }
+            }
+        }
+        return;
+    }
 
-    // State of the cross sections. First is the energy group, second is the
-    // state of the XS mesh from which the cross sections were extracted. This
-    // is stored in a shared pointer so that multiple instances of ExpandedXS
-    // can share state.
-    std::shared_ptr<std::pair<int, int>> state_;
+    /**
+     * \brief Bring the all-group cache up to date with the XS mesh
+     */
+    void update_cache()
+    {
+        int xs_state = xs_mesh_->state();
+        if (state_->all_state == xs_state) {
+            return;
+        }
+
+        // A new cache has a state of -1, which precedes that of every region
+        for (int ig = 0; ig < (int)xs_mesh_->n_group(); ig++) {
+            this->expand_changed(xs_mesh_->xstr(ig), state_->all_state,
+                                 &state_->all(0, ig));
+        }
+        state_->all_state = xs_state;
+        return;
+    }
 };
 }
@@ -16,18 +16,28 @@
 
 #include "xs_mesh_homogenized.hpp"
 
+#include <cmath>
+#include <cstdio>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <numeric>
 #include <sstream>
+#include <unordered_map>
+#include <unistd.h>
 #include "pugixml.hpp"
 #include "util/files.hpp"
 #include "util/h5file.hpp"
 #include "util/string_utils.hpp"
+#include "core/parallel_environment.hpp"
 
 namespace mocc {
 XSMeshHomogenized::XSMeshHomogenized(const CoreMesh &mesh)
-    : XSMesh(mesh, MeshTreatment::PIN), mesh_(mesh), flux_(nullptr)
+    : XSMesh(mesh, MeshTreatment::PIN),
+      mesh_(mesh),
+      flux_(nullptr),
+      update_tol_(0.0),
+      n_skipped_(0)
 {
     // Set up the non-xs part of the xs mesh
     eubounds_ = mesh_.mat_lib().g_bounds();
@@ -48,35 +58,61 @@ XSMeshHomogenized::XSMeshHomogenized(const CoreMesh &mesh)
     // sweeper. The mapping from XS mesh region to sweeper region will therefore
     // be from a homogenized pin at the macroplane level to all of the regions
     // in a MeshTreatment::PIN-type mesh within the corresponding macroplane.
-    regions_.reserve(n_xsreg);
-    n_reg_expanded_ = 0;
-    int ixsreg      = 0;
+    pins_.reserve(n_xsreg);
+    first_reg_.reserve(n_xsreg);
+    VecI first_xsreg;
+    int first_reg = 0;
     for (const auto &mplane : mesh_.macroplanes()) {
-        VecI ireg;
-        ireg.reserve(mplane.iz_max - mplane.iz_min + 1);
+        first_xsreg.push_back(pins_.size());
+        for (const auto &mpin : mplane) {
+            pins_.push_back(mpin);
+            first_reg_.push_back(first_reg);
+            first_reg += mpin->n_reg();
+        }
+    }
+
+    // The coarse cells of each region are looked up in parallel over the
+    // pins of every macroplane; the regions themselves are made in order
+    // afterwards
+    std::vector<VecI> ireg(n_xsreg);
+    const int n_mplane = mesh_.macroplanes().size();
+#pragma omp parallel for schedule(dynamic)
+    for (int iplane = 0; iplane < n_mplane; iplane++) {
+        const auto &mplane = mesh_.macroplanes()[iplane];
         for (unsigned ipin = 0; ipin < mplane.size(); ++ipin) {
+            VecI &reg    = ireg[first_xsreg[iplane] + ipin];
             Position pos = mesh_.pin_position(ipin);
+            reg.reserve(mplane.iz_max - mplane.iz_min + 1);
             for (int iz = mplane.iz_min; iz <= mplane.iz_max; ++iz) {
                 pos.z = iz;
-                ireg.push_back(mesh_.coarse_cell(pos));
+                reg.push_back(mesh_.coarse_cell(pos));
             }
-            regions_.emplace_back(ireg, &xstr_(ixsreg, 0), &xsnf_(ixsreg, 0),
-                                  &xsch_(ixsreg, 0), &xsf_(ixsreg, 0),
-                                  &xsrm_(ixsreg, 0), ScatteringMatrix());
-
-            n_reg_expanded_ += ireg.size();
-            ireg.clear();
-            ixsreg++;
         }
     }
 
-    // Homogenize initial cross sections
-    ixsreg = 0;
-    for (const auto &mplane : mesh_.macroplanes()) {
-        for (const auto &mpin : mplane) {
-            this->homogenize_region(ixsreg, *mpin, regions_[ixsreg]);
-            ixsreg++;
+    regions_.reserve(n_xsreg);
+    n_reg_expanded_ = 0;
+    for (int ixsreg = 0; ixsreg < n_xsreg; ixsreg++) {
+        regions_.emplace_back(ireg[ixsreg], &xstr_(ixsreg, 0),
+                              &xsnf_(ixsreg, 0), &xsch_(ixsreg, 0),
+                              &xsf_(ixsreg, 0), &xsrm_(ixsreg, 0), n_xsreg,
+                              ScatteringMatrix());
+        n_reg_expanded_ += ireg[ixsreg].size();
+    }
+
+    // Homogenize initial cross sections, unless a snapshot of them from a
+    // previous run is available
+    if (mesh_.snapshot_file().empty() || !this->read_snapshot()) {
+#pragma omp parallel for schedule(dynamic)
+        for (int ixsreg = 0; ixsreg < n_xsreg; ixsreg++) {
+            this->homogenize_region(ixsreg, *pins_[ixsreg], regions_[ixsreg]);
         }
+        this->flatten();
+        if (!mesh_.snapshot_file().empty()) {
+            this->write_snapshot();
+        }
+    } else {
+        this->flatten();
     }
 }
 
@@ -133,6 +169,11 @@ XSMeshHomogenized::XSMeshHomogenized(const CoreMesh &mesh,
         this->read_data_multi(input);
     }
 
+    // The cross sections no longer come from the material library
+    mat_lib_ = nullptr;
+
+    this->flatten();
+
     return;
 } // HDF5 constructor
 
@@ -167,6 +208,8 @@ XSMeshHomogenized::XSMeshHomogenized(XSMeshHomogenized &other,
 
     n_reg_expanded_ = regions_.size();
 
+    this->flatten();
+
     return;
 }
 
@@ -175,24 +218,95 @@ XSMeshHomogenized::XSMeshHomogenized(XSMeshHomogenized &other,
  */
 void XSMeshHomogenized::update()
 {
+    ThreadTeam team(Phase::PROJECTION);
+    int n_xsreg = regions_.size();
+
+    // Regions containing materials that have been replaced in the library
+    // need to be re-homogenized, whatever the flux is doing
+    std::vector<bool> changed(n_xsreg, false);
+    if (mat_lib_ && (mat_lib_->state() != lib_state_)) {
+        for (int ixsreg = 0; ixsreg < n_xsreg; ixsreg++) {
+            for (const int mat_id : pins_[ixsreg]->mat_ids()) {
+                if (mat_lib_->material_state(mat_id) > lib_state_) {
+                    changed[ixsreg] = true;
+                    break;
+                }
+            }
+        }
+        lib_state_ = mat_lib_->state();
+    }
+
     if (!flux_) {
-        // no update needed if doing volume-weighted cross sections
+        // Volume-weighted cross sections only change with the materials
+        int n_updated = 0;
+        for (int ixsreg = 0; ixsreg < n_xsreg; ixsreg++) {
+            if (changed[ixsreg]) {
+                this->homogenize_region(ixsreg, *pins_[ixsreg],
+                                        regions_[ixsreg]);
+                region_state_[ixsreg] = state_ + 1;
+                n_updated++;
+            }
+        }
+        if (n_updated > 0) {
+            this->flatten();
+            state_++;
+        }
         return;
     } else {
         // For now assume that the flux is coming from a PLANE-type sweeper
         assert(flux_->extent(0) == (int)mesh_.n_reg(MeshTreatment::PLANE));
     }
-    int first_reg = 0;
-    int ixsreg    = 0;
-    for (const auto &mplane : mesh_.macroplanes()) {
-        for (const auto &pin : mplane) {
-            this->homogenize_region_flux(ixsreg, first_reg, *pin,
-                                         regions_[ixsreg]);
-            first_reg += pin->n_reg();
-            ixsreg++;
+
+    const ArrayB2 &flux = *flux_;
+
+    // Only skip regions once they have been homogenized with a flux
+    bool check = (update_tol_ > 0.0) && (pin_flux_.size() > 0);
+    if ((update_tol_ > 0.0) && (pin_flux_.size() == 0)) {
+        pin_flux_.resize(n_xsreg, ng_);
+        pin_flux_ = 0.0;
+    }
+
+    int n_updated = 0;
+#pragma omp parallel for schedule(dynamic) reduction(+ : n_updated)
+    for (int ixsreg = 0; ixsreg < n_xsreg; ixsreg++) {
+        const Pin &pin = *pins_[ixsreg];
+        int first_reg  = first_reg_[ixsreg];
+
+        if (update_tol_ > 0.0) {
+            const VecF &areas = pin.mesh().areas();
+            bool dirty        = !check || changed[ixsreg];
+            VecF pin_flux(ng_, 0.0);
+            for (int ig = 0; ig < (int)ng_; ig++) {
+                for (int i = 0; i < pin.n_reg(); i++) {
+                    pin_flux[ig] += flux(first_reg + i, ig) * areas[i];
+                }
+                real_t prev = pin_flux_(ixsreg, ig);
+                if (std::abs(pin_flux[ig] - prev) >
+                    update_tol_ * std::abs(prev)) {
+                    dirty = true;
+                }
+            }
+            if (!dirty) {
+                continue;
+            }
+            for (int ig = 0; ig < (int)ng_; ig++) {
+                pin_flux_(ixsreg, ig) = pin_flux[ig];
+            }
         }
+
+        this->homogenize_region_flux(ixsreg, first_reg, pin, regions_[ixsreg]);
+        region_state_[ixsreg] = state_ + 1;
+        n_updated++;
+    }
+
+    n_skipped_ += n_xsreg - n_updated;
+
+    // Leave the state alone if nothing changed, so that expanded cross
+    // sections do not need to be refreshed
+    if (n_updated > 0) {
+        this->flatten();
+        state_++;
     }
-    state_++;
     return;
 }
 
@@ -207,16 +321,16 @@ void XSMeshHomogenized::homogenize_region(int i, const Pin &pin,
 
     std::vector<VecF> scat(ng_, VecF(ng_, 0.0));
 
-    auto mat_lib   = mesh_.mat_lib();
-    auto &pin_mesh = pin.mesh();
-    auto areas     = pin_mesh.areas();
+    const auto &mat_lib  = mesh_.mat_lib();
+    const auto &pin_mesh = pin.mesh();
+    const auto &areas    = pin_mesh.areas();
 
     for (size_t ig = 0; ig < ng_; ig++) {
         int ireg     = 0;
         int ixsreg   = 0;
         real_t farea = 0.0;
         for (auto &mat_id : pin.mat_ids()) {
-            auto mat                      = mat_lib.get_material_by_id(mat_id);
+            const auto &mat               = mat_lib.get_material_by_id(mat_id);
             const ScatteringRow &scat_row = mat.xssc().to(ig);
             int gmin                      = scat_row.min_g;
             int gmax                      = scat_row.max_g;
@@ -264,8 +378,9 @@ void XSMeshHomogenized::homogenize_region_flux(int i, int first_reg,
 {
     assert(flux_);
 
-    // Extract a reference to the flux array.
-    const ArrayB2 flux = *flux_;
+    // Extract a reference to the flux array. Take a plain C++ reference,
+    // since this may be called concurrently for different regions.
+    const ArrayB2 &flux = *flux_;
 
     // Set the FSRs to be one element, representing the coarse mesh index to
     // which this \ref XSMeshRegion belongs.
@@ -277,9 +392,9 @@ void XSMeshHomogenized::homogenize_region_flux(int i, int first_reg,
 
     std::vector<VecF> scat(ng_, VecF(ng_, 0.0));
 
-    auto mat_lib   = mesh_.mat_lib();
-    auto &pin_mesh = pin.mesh();
-    auto areas     = pin_mesh.areas();
+    const auto &mat_lib  = mesh_.mat_lib();
+    const auto &pin_mesh = pin.mesh();
+    const auto &areas    = pin_mesh.areas();
 
     // Precompute the fission source in each region, since it is the
     // wieghting factor for chi
@@ -290,7 +405,7 @@ void XSMeshHomogenized::homogenize_region_flux(int i, int first_reg,
             int ireg_local = 0;
             int ixsreg     = 0;
             for (auto &mat_id : pin.mat_ids()) {
-                auto mat = mat_lib.get_material_by_id(mat_id);
+                const auto &mat = mat_lib.get_material_by_id(mat_id);
                 for (int i = 0; i < (int)pin_mesh.n_fsrs(ixsreg); i++) {
                     fs[ireg_local] +=
                         mat.xsnf(ig) * flux(ireg, ig) * areas[ireg_local];
@@ -314,7 +429,7 @@ void XSMeshHomogenized::homogenize_region_flux(int i, int first_reg,
         int ireg_local = 0;         // pin-local refion index
         int ixsreg     = 0;
         for (auto &mat_id : pin.mat_ids()) {
-            auto mat                      = mat_lib.get_material_by_id(mat_id);
+            const auto &mat               = mat_lib.get_material_by_id(mat_id);
             const ScatteringRow &scat_row = mat.xssc().to(ig);
             size_t gmin                   = scat_row.min_g;
             size_t gmax                   = scat_row.max_g;
@@ -461,9 +576,8 @@ void XSMeshHomogenized::read_data_single(const pugi::xml_node &data)
     }
 
     for (int ixsreg = 0; ixsreg < (int)regions_.size(); ixsreg++) {
-        ScatteringMatrix xssc(
+        regions_[ixsreg].xsmacsc_ = std::make_shared<ScatteringMatrix>(
             scat(ixsreg, blitz::Range::all(), blitz::Range::all()));
-        regions_[ixsreg].xsmacsc_ = xssc;
         regions_[ixsreg].update_removal();
     }
 
@@ -604,7 +718,8 @@ void XSMeshHomogenized::read_data_multi(const pugi::xml_node &input)
         // matrices. Go through and store the scattering matrices on the xsmesh
         // regions too
         for (int ipin = 0; ipin < nreg_plane; ipin++) {
-            ScatteringMatrix xssc(
+            // The planes of the stack share one copy of the matrix
+            auto xssc = std::make_shared<const ScatteringMatrix>(
                 scat(ipin, blitz::Range::all(), blitz::Range::all()));
             for (int ip = bot_plane; ip <= top_plane; ip++) {
                 int ixsreg                = ipin + nreg_plane * ip;
@@ -617,6 +732,188 @@ void XSMeshHomogenized::read_data_multi(const pugi::xml_node &input)
     return;
 }
 
+uint64_t XSMeshHomogenized::snapshot_key() const
+{
+    // FNV-1a hash of the mesh input and of the material cross sections,
+    // which may have changed in the library file, or been updated since
+    const uint64_t version = 1;
+    uint64_t key           = 14695981039346656037ull;
+    auto hash              = [&key](const void *data, size_t size) {
+        const unsigned char *bytes = static_cast<const unsigned char *>(data);
+        for (size_t i = 0; i < size; i++) {
+            key ^= bytes[i];
+            key *= 1099511628211ull;
+        }
+    };
+
+    uint64_t input_key = mesh_.snapshot_key();
+    uint64_t n_xsreg   = regions_.size();
+    hash(&version, sizeof(version));
+    hash(&input_key, sizeof(input_key));
+    hash(&ng_, sizeof(ng_));
+    hash(&n_xsreg, sizeof(n_xsreg));
+    for (const auto &mat : mesh_.mat_lib().materials()) {
+        for (size_t ig = 0; ig < ng_; ig++) {
+            real_t xs[4] = {mat.xstr(ig), mat.xsnf(ig), mat.xsf(ig),
+                            mat.xsch(ig)};
+            hash(xs, sizeof(xs));
+        }
+        VecF scat = mat.xssc().as_vector();
+        hash(scat.data(), scat.size() * sizeof(real_t));
+    }
+
+    return key;
+}
+
+bool XSMeshHomogenized::read_snapshot()
+{
+    const std::string &path = mesh_.snapshot_file();
+    if (!std::ifstream(path).good()) {
+        LogScreen << "Snapshot " << path
+                  << " not found. Homogenizing cross sections." << std::endl;
+        return false;
+    }
+
+    const int n_xsreg = regions_.size();
+    VecF xstr;
+    VecF xsnf;
+    VecF xsf;
+    VecF xsch;
+    VecF scat_index;
+    VecF scat;
+    try {
+        H5Node h5(path, H5Access::READ);
+        uint64_t key = 0;
+        if (h5.exists("xsmesh_homogenized/key")) {
+            h5.read("xsmesh_homogenized/key", key);
+        }
+        if (key != this->snapshot_key()) {
+            LogScreen << "Snapshot " << path
+                      << " does not match this problem. Homogenizing cross "
+                         "sections."
+                      << std::endl;
+            return false;
+        }
+        auto g = h5["xsmesh_homogenized"];
+        g.read("xstr", xstr);
+        g.read("xsnf", xsnf);
+        g.read("xsf", xsf);
+        g.read("xsch", xsch);
+        g.read("scat_index", scat_index);
+        g.read("scat", scat);
+    } catch (Exception e) {
+        Warn("Unable to read snapshot " + path +
+             ". Homogenizing cross sections.");
+        return false;
+    }
+
+    const size_t n_xs = n_xsreg * ng_;
+    const int n_scat  = scat.size() / (ng_ * ng_);
+    bool valid = (xstr.size() == n_xs) && (xsnf.size() == n_xs) &&
+                 (xsf.size() == n_xs) && (xsch.size() == n_xs) &&
+                 ((int)scat_index.size() == n_xsreg) &&
+                 (scat.size() == n_scat * ng_ * ng_);
+    for (int i = 0; valid && (i < n_xsreg); i++) {
+        valid = (scat_index[i] >= 0) && (scat_index[i] < n_scat);
+    }
+    if (!valid) {
+        Warn("Malformed snapshot " + path + ". Homogenizing cross sections.");
+        return false;
+    }
+
+    LogScreen << "Reading homogenized cross sections from snapshot " << path
+              << std::endl;
+
+    // Identical scattering matrices were only stored once, and are shared
+    // again here
+    std::vector<std::shared_ptr<const ScatteringMatrix>> matrices;
+    matrices.reserve(n_scat);
+    for (int is = 0; is < n_scat; is++) {
+        std::vector<VecF> m;
+        for (size_t ig = 0; ig < ng_; ig++) {
+            auto row = scat.begin() + (is * ng_ + ig) * ng_;
+            m.emplace_back(row, row + ng_);
+        }
+        matrices.push_back(std::make_shared<const ScatteringMatrix>(m));
+    }
+
+    for (int i = 0; i < n_xsreg; i++) {
+        for (size_t ig = 0; ig < ng_; ig++) {
+            xstr_(i, ig) = xstr[i * ng_ + ig];
+            xsnf_(i, ig) = xsnf[i * ng_ + ig];
+            xsf_(i, ig)  = xsf[i * ng_ + ig];
+            xsch_(i, ig) = xsch[i * ng_ + ig];
+        }
+        regions_[i].xsmacsc_ = matrices[(int)scat_index[i]];
+        regions_[i].update_removal();
+    }
+
+    return true;
+}
+
+void XSMeshHomogenized::write_snapshot() const
+{
+    // Only one process needs to write the file. As for ray files, write to a
+    // temporary file and move it into place, so that concurrent runs never
+    // see a partial snapshot.
+    if (!ParEnv.is_root()) {
+        return;
+    }
+
+    const std::string &path = mesh_.snapshot_file();
+    const int n_xsreg       = regions_.size();
+    VecF xstr(n_xsreg * ng_);
+    VecF xsnf(n_xsreg * ng_);
+    VecF xsf(n_xsreg * ng_);
+    VecF xsch(n_xsreg * ng_);
+    VecF scat_index(n_xsreg);
+    VecF scat;
+    std::unordered_map<const ScatteringMatrix *, int> unique;
+    for (int i = 0; i < n_xsreg; i++) {
+        const auto &xsr = regions_[i];
+        for (size_t ig = 0; ig < ng_; ig++) {
+            xstr[i * ng_ + ig] = xsr.xsmactr(ig);
+            xsnf[i * ng_ + ig] = xsr.xsmacnf(ig);
+            xsf[i * ng_ + ig]  = xsr.xsmacf(ig);
+            xsch[i * ng_ + ig] = xsr.xsmacch(ig);
+        }
+        const ScatteringMatrix *m = &xsr.xsmacsc();
+        auto it                   = unique.find(m);
+        if (it == unique.end()) {
+            it = unique.emplace(m, unique.size()).first;
+            VecF dense = m->as_vector();
+            scat.insert(scat.end(), dense.begin(), dense.end());
+        }
+        scat_index[i] = it->second;
+    }
+
+    std::string tmp_path = path + ".tmp" + std::to_string(getpid());
+    try {
+        H5Node h5(tmp_path, H5Access::WRITE);
+        auto g = h5.create_group("xsmesh_homogenized");
+        g.write("key", this->snapshot_key());
+        g.write("xstr", xstr);
+        g.write("xsnf", xsnf);
+        g.write("xsf", xsf);
+        g.write("xsch", xsch);
+        g.write("scat_index", scat_index);
+        g.write("scat", scat);
+    } catch (Exception e) {
+        Warn("Unable to write snapshot " + path);
+        std::remove(tmp_path.c_str());
+        return;
+    }
+    if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        Warn("Unable to write snapshot " + path);
+        std::remove(tmp_path.c_str());
+        return;
+    }
+    LogScreen << "Wrote homogenized cross sections to snapshot " << path
+              << std::endl;
+
+    return;
+}
+
 void XSMeshHomogenized::output(H5Node &file) const
 {
     auto xsm_g = file.create_group("xsmesh");
@@ -638,16 +935,18 @@ void XSMeshHomogenized::output(H5Node &file) const
         VecF xsnf(this->size(), 0.0);
         VecF xsf(this->size(), 0.0);
         VecF xsch(this->size(), 0.0);
-        int i = 0;
-        for (auto xsr : regions_) {
+        const real_t *tr = this->xstr(ig);
+        const real_t *nf = this->xsnf(ig);
+        const real_t *kf = this->xsf(ig);
+        const real_t *ch = this->xsch(ig);
+        for (int i = 0; i < (int)regions_.size(); i++) {
             Position pos = mesh_.pin_position(i);
             pos.z        = i / per_plane;
             int icell    = mesh_.coarse_cell(pos);
-            xstr[icell]  = xsr.xsmactr(ig);
-            xsnf[icell]  = xsr.xsmacnf(ig);
-            xsf[icell]   = xsr.xsmacf(ig);
-            xsch[icell]  = xsr.xsmacch(ig);
-            i++;
+            xstr[icell]  = tr[i];
+            xsnf[icell]  = nf[i];
+            xsf[icell]   = kf[i];
+            xsch[icell]  = ch[i];
         }
         {
             std::stringstream setname;
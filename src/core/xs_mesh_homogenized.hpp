@@ -38,6 +38,12 @@ public:
      * Construct a homogenized \ref XSMesh from only a \ref CoreMesh object.
      * Following construction, the cross sections in the mesh will be
      * volume-weighted.
+     *
+     * If the \ref CoreMesh has a snapshot file (see \ref
+     * CoreMesh::set_snapshot()), the volume-weighted cross sections are read
+     * from it when it was made from the same input and materials, instead of
+     * homogenizing every pin. Otherwise they are homogenized and written to
+     * the snapshot for next time.
      */
     XSMeshHomogenized(const CoreMesh &mesh);
 
@@ -86,6 +92,30 @@ public:
         // Make the assumption that the provided flux is using a PLANE treatment
         assert(flux.extent(0) == (int)mesh_.n_reg(MeshTreatment::PLANE));
         flux_ = &flux;
+        pin_flux_.free();
+    }
+
+    /**
+     * \brief Set the tolerance below which regions are not re-homogenized
+     *
+     * When positive, update() only re-homogenizes the regions whose
+     * pin-integrated flux in any group has changed by more than \p tol,
+     * relative to the flux that they were last homogenized with. Zero (the
+     * default) re-homogenizes every region on every update.
+     */
+    void set_update_tolerance(real_t tol)
+    {
+        assert(tol >= 0.0);
+        update_tol_ = tol;
+    }
+
+    /**
+     * \brief Return the number of region homogenizations skipped by update()
+     * so far
+     */
+    int n_skipped() const
+    {
+        return n_skipped_;
     }
 
     /**
@@ -99,6 +129,20 @@ private:
     // Possibly-associated flux for homogenization.
     const ArrayB2 *flux_;
 
+    // Pin and offset into the PLANE-type flux of each region, so that the
+    // regions can be homogenized independently
+    std::vector<const Pin *> pins_;
+    VecI first_reg_;
+
+    // Relative change in pin flux that triggers re-homogenization
+    real_t update_tol_;
+
+    // Pin-integrated flux that each region was last homogenized with,
+    // indexed by [region, group]. Only maintained with a positive tolerance
+    ArrayB2 pin_flux_;
+
+    int n_skipped_;
+
     /**
     * \brief Populate the passed XSMeshRegion with homogenized cross sections
     * from a pin cell. No flux wieghting is performed, only volume weighting.
@@ -131,6 +175,23 @@ private:
     void homogenize_region_flux(int i, int first_reg, const Pin &pin,
                                 XSMeshRegion &xsr) const;
 
+    /**
+     * \brief Return a hash of everything that goes into the volume-weighted
+     * cross sections, to check the snapshot against
+     */
+    uint64_t snapshot_key() const;
+
+    /**
+     * \brief Read the volume-weighted cross sections from the snapshot
+     * file, returning whether it was there and matched this mesh
+     */
+    bool read_snapshot();
+
+    /**
+     * \brief Write the volume-weighted cross sections to the snapshot file
+     */
+    void write_snapshot() const;
+
     void read_data_single(const pugi::xml_node &data);
 
     void read_data_multi(const pugi::xml_node &input);
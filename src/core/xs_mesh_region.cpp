@@ -21,19 +21,20 @@
 namespace mocc {
 XSMeshRegion::XSMeshRegion(const VecI &fsrs, real_t *xstr, real_t *xsnf,
                            real_t *xsch, real_t *xsf, real_t *xsrm,
-                           const ScatteringMatrix &xssc)
+                           int stride, const ScatteringMatrix &xssc)
     : reg_(fsrs),
       xsmactr_(xstr),
       xsmacnf_(xsnf),
       xsmacf_(xsf),
       xsmacch_(xsch),
       xsmacrm_(xsrm),
-      xsmacsc_(xssc)
+      stride_(stride),
+      xsmacsc_(std::make_shared<ScatteringMatrix>(xssc))
 {
     is_fissile_ = false;
     for (int ig = 0; ig < this->n_group(); ig++) {
-        xsmacrm_[ig] = xsmactr_[ig] - xsmacsc_.self_scat(ig);
-        if (xsmacnf_[ig] > 0.0) {
+        xsmacrm_[ig * stride_] = this->xsmactr(ig) - xsmacsc_->self_scat(ig);
+        if (this->xsmacnf(ig) > 0.0) {
             is_fissile_ = true;
         }
     }
@@ -42,39 +43,39 @@ XSMeshRegion::XSMeshRegion(const VecI &fsrs, real_t *xstr, real_t *xsnf,
 
 std::ostream &operator<<(std::ostream &os, const XSMeshRegion &xsr)
 {
-    int ng = xsr.xsmacsc_.n_group();
+    int ng = xsr.xsmacsc_->n_group();
     os << "Transport: " << std::endl;
     for (int ig = 0; ig < ng; ig++) {
-        os << xsr.xsmactr_[ig] << " ";
+        os << xsr.xsmactr(ig) << " ";
     }
     os << std::endl;
 
     os << "nu-fission: " << std::endl;
     for (int ig = 0; ig < ng; ig++) {
-        os << xsr.xsmacnf_[ig] << " ";
+        os << xsr.xsmacnf(ig) << " ";
     }
     os << std::endl;
 
     os << "fission: " << std::endl;
     for (int ig = 0; ig < ng; ig++) {
-        os << xsr.xsmacf_[ig] << " ";
+        os << xsr.xsmacf(ig) << " ";
     }
     os << std::endl;
 
     os << "chi: " << std::endl;
     for (int ig = 0; ig < ng; ig++) {
-        os << xsr.xsmacch_[ig] << " ";
+        os << xsr.xsmacch(ig) << " ";
     }
     os << std::endl;
 
     os << "removal: " << std::endl;
     for (int ig = 0; ig < ng; ig++) {
-        os << xsr.xsmacrm_[ig] << " ";
+        os << xsr.xsmacrm(ig) << " ";
     }
     os << std::endl;
 
     os << "Scattering matrix:" << std::endl;
-    os << xsr.xsmacsc_ << std::endl;
+    os << *xsr.xsmacsc_ << std::endl;
 
     return os;
 }
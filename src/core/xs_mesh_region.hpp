@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include <memory>
 #include "util/fp_utils.hpp"
 #include "util/global_config.hpp"
 #include "constants.hpp"
@@ -27,17 +28,28 @@ class XSMeshRegion {
     friend class XSMeshHomogenized;
 
 public:
-    XSMeshRegion() : is_fissile_(false)
+    XSMeshRegion()
+        : is_fissile_(false),
+          stride_(1),
+          xsmacsc_(std::make_shared<ScatteringMatrix>())
     {
         return;
     }
 
+    /**
+     * \brief Construct a region referring to cross sections stored elsewhere
+     *
+     * The cross sections for group \c ig are found at \c ig*stride past each
+     * of the passed pointers. This allows the owning \ref XSMesh to store the
+     * cross sections for all regions in a single group contiguously.
+     */
     XSMeshRegion(const VecI &fsrs, real_t *xstr, real_t *xsnf, real_t *xsch,
-                 real_t *xsf, real_t *xsrm, const ScatteringMatrix &xssc);
+                 real_t *xsf, real_t *xsrm, int stride,
+                 const ScatteringMatrix &xssc);
 
     int n_group() const
     {
-        return xsmacsc_.n_group();
+        return xsmacsc_->n_group();
     }
 
     bool is_fissile() const
@@ -47,68 +59,67 @@ public:
 
     const real_t &xsmactr(int ig) const
     {
-        return xsmactr_[ig];
-    }
-    const real_t *xsmactr() const
-    {
-        return xsmactr_;
+        return xsmactr_[ig * stride_];
     }
 
     const real_t &xsmacnf(int ig) const
     {
-        return xsmacnf_[ig];
-    }
-    const real_t *xsmacnf() const
-    {
-        return xsmacnf_;
+        return xsmacnf_[ig * stride_];
     }
 
     const real_t &xsmacf(int ig) const
     {
-        return xsmacf_[ig];
-    }
-    const real_t *xsmacf() const
-    {
-        return xsmacf_;
+        return xsmacf_[ig * stride_];
     }
 
     const real_t &xsmacch(int ig) const
     {
-        return xsmacch_[ig];
+        return xsmacch_[ig * stride_];
     }
-    const real_t *xsmacch() const
+
+    const real_t &xsmacrm(int ig) const
     {
-        return xsmacch_;
+        return xsmacrm_[ig * stride_];
     }
 
-    const real_t &xsmacrm(int ig) const
+    const ScatteringMatrix &xsmacsc() const
     {
-        return xsmacrm_[ig];
+        return *xsmacsc_;
     }
-    const real_t *xsmacrm() const
+
+    const ScatteringRow &xsmacsc(int ig) const
     {
-        return xsmacrm_;
+        return xsmacsc_->to(ig);
     }
 
-    const ScatteringMatrix &xsmacsc() const
+    /**
+     * \brief Return the highest Legendre order of the scattering kernel
+     * available for the region
+     */
+    int scat_order() const
     {
-        return xsmacsc_;
+        return xsmacsc_pn_.size();
     }
 
-    const ScatteringRow &xsmacsc(int ig) const
+    /**
+     * \brief Return the scattering matrix for Legendre moment \p l, from 1 to
+     * \ref scat_order()
+     */
+    const ScatteringMatrix &xsmacsc_pn(int l) const
     {
-        return xsmacsc_.to(ig);
+        assert((l > 0) && (l <= this->scat_order()));
+        return *xsmacsc_pn_[l - 1];
     }
 
     VecF reaction_cdf(int ig) const
     {
         VecF cdf(3, 0.0);
 
-        real_t scale = 1.0 / xsmactr_[ig];
+        real_t scale = 1.0 / this->xsmactr(ig);
 
-        cdf[(int)Reaction::SCATTER] = xsmacsc_.out(ig) * scale;
+        cdf[(int)Reaction::SCATTER] = xsmacsc_->out(ig) * scale;
         cdf[(int)Reaction::FISSION] =
-            cdf[(int)Reaction::SCATTER] + xsmacf_[ig] * scale;
+            cdf[(int)Reaction::SCATTER] + this->xsmacf(ig) * scale;
         cdf[(int)Reaction::CAPTURE] = 1.0;
 
         return cdf;
@@ -118,9 +129,9 @@ public:
      * \brief Return a vector containing the Chi distribution as a
      * cumulative distribution function.
      *
-     * For now we are calculating this on the fly, since that is easier,. In
-     * the future, to speed up the MC stuff, it might be nice to have this
-     * precomputed.
+     * This is calculated on the fly, so it should be kept out of hot loops.
+     * The Monte Carlo \ref mc::ParticlePusher samples from precomputed alias
+     * tables instead.
      */
     std::vector<real_t> chi_cdf() const
     {
@@ -128,7 +139,7 @@ public:
         cdf.reserve(this->n_group());
         real_t sum = 0.0;
         for (int ig = 0; ig < this->n_group(); ig++) {
-            sum += xsmacch_[ig];
+            sum += this->xsmacch(ig);
             cdf.push_back(sum);
         }
 
@@ -154,13 +165,15 @@ public:
                 const VecF &xsf, const ScatteringMatrix &xssc)
     {
         for (int ig = 0; ig < xssc.n_group(); ig++) {
-            xsmactr_[ig] = xstr[ig];
-            xsmacnf_[ig] = xsnf[ig];
-            xsmacch_[ig] = xsch[ig];
-            xsmacf_[ig]  = xsf[ig];
-            xsmacrm_[ig] = xstr[ig] - xssc.self_scat(ig);
+            int i = ig * stride_;
+
+            xsmactr_[i] = xstr[ig];
+            xsmacnf_[i] = xsnf[ig];
+            xsmacch_[i] = xsch[ig];
+            xsmacf_[i]  = xsf[ig];
+            xsmacrm_[i] = xstr[ig] - xssc.self_scat(ig);
         }
-        xsmacsc_ = xssc;
+        xsmacsc_ = std::make_shared<ScatteringMatrix>(xssc);
         return;
     }
 
@@ -174,8 +187,9 @@ public:
      */
     void update_removal()
     {
-        for(int ig = 0; ig<xsmacsc_.n_group(); ig++) {
-            xsmacrm_[ig] = xsmactr_[ig] - xsmacsc_.self_scat(ig);
+        for(int ig = 0; ig<xsmacsc_->n_group(); ig++) {
+            xsmacrm_[ig * stride_] =
+                xsmactr_[ig * stride_] - xsmacsc_->self_scat(ig);
         }
         return;
     }
@@ -205,7 +219,15 @@ public:
             if (!fp_equiv_ulp(this->xsmacrm(ig), other.xsmacrm(ig))) {
                 return false;
             }
-            if (xsmacsc_ != other.xsmacsc_) {
+            if (*xsmacsc_ != *other.xsmacsc_) {
+                return false;
+            }
+        }
+        if (this->scat_order() != other.scat_order()) {
+            return false;
+        }
+        for (int l = 1; l <= this->scat_order(); l++) {
+            if (this->xsmacsc_pn(l) != other.xsmacsc_pn(l)) {
                 return false;
             }
         }
@@ -227,14 +249,24 @@ private:
     // Whether or not the region is fissile
     bool is_fissile_;
 
-    // Actual group constants for this XS mesh region
+    // Actual group constants for this XS mesh region. These point into the
+    // group-major storage of the owning XSMesh
     real_t *xsmactr_;
     real_t *xsmacnf_;
     real_t *xsmacf_;
     real_t *xsmacch_;
     real_t *xsmacrm_;
 
-    // Scattering matrix
-    ScatteringMatrix xsmacsc_;
+    // Distance between consecutive groups in the above arrays
+    int stride_;
+
+    // Scattering matrix. Regions with identical scattering matrices may share
+    // one; see XSMesh::flatten(). It is never modified in place, only
+    // replaced.
+    std::shared_ptr<const ScatteringMatrix> xsmacsc_;
+
+    // Scattering matrices of the P1 and higher moments of the scattering
+    // kernel. Empty for isotropic scattering.
+    std::vector<std::shared_ptr<const ScatteringMatrix>> xsmacsc_pn_;
 };
 }
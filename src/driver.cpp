@@ -16,23 +16,40 @@
 
 #include "driver.hpp"
 
+#include <algorithm>
+#include <atomic>
 #include <csignal>
+#include <cstdio>
 #include <cstdlib>
 #include <ctime>
 #include <exception>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <new>
 #include <sstream>
+#ifdef __unix__
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 #include "pugixml.hpp"
+#include "util/async_output.hpp"
 #include "util/error.hpp"
+#include "util/file_scrubber.hpp"
 #include "util/files.hpp"
 #include "util/global_config.hpp"
 #include "util/h5file.hpp"
+#include "util/memory.hpp"
 #include "util/omp_guard.h"
+#include "util/profile.hpp"
 #include "util/timers.hpp"
 #include "core/core_mesh.hpp"
+#include "core/material_lib.hpp"
+#include "core/parallel_environment.hpp"
 #include "core/solver.hpp"
 #include "core/transport_sweeper.hpp"
+#include "sweepers/moc/ray_data.hpp"
 #include "git_SHA1.hpp"
 #include "input_proc.hpp"
 
@@ -47,21 +64,57 @@ SP_CoreMesh_t mesh;
 // Input processor
 std::unique_ptr<InputProcessor> input_proc;
 
+// State carried from one case of a batch run to the next
+struct BatchState {
+    // Core mesh of the previous case, and the input that it was built from
+    std::string mesh_key;
+    SP_CoreMesh_t mesh;
+};
+
 // Generate output from the solver
 void generate_output()
 {
+    // Finish writing any intermediate output first
+    OutputQueue.flush();
+
     std::string out_name = input_proc->case_name();
     out_name.append(".h5");
-    H5Node outfile(out_name, H5Access::WRITE);
+    // All of the processes take part in writing the output file
+    H5Node outfile(out_name, H5Access::PARALLEL);
+    outfile.configure(input_proc->document().child("output"));
     solver->output(outfile);
 
+    // Run-level throughput metrics, for comparing configurations and
+    // machines across runs
+    {
+        auto perf = outfile.create_group("performance");
+        perf.write("threads", omp_get_max_threads());
+        perf.write("wall_time", RootTimer.time());
+        perf.write("peak_rss", (uint64_t)peak_rss());
+        solver->output_performance(perf);
+        auto timers = perf.create_group("timers");
+        RootTimer.output(timers);
+    }
+
+    // Memory footprint of each subsystem
+    {
+        MemoryReport report("Memory");
+        solver->memory(report);
+        auto g = outfile.create_group("memory");
+        report.output(g);
+    }
+
+    if (!profile::Profile.empty()) {
+        profile::Profile.output(outfile);
+        profile::Profile.print(LogFile);
+        std::ofstream trace(input_proc->case_name() + "_trace.json");
+        profile::Profile.write_trace(trace);
+    }
+
     LogFile << std::endl;
     LogFile << "Full input:" << std::endl;
 
-    std::stringstream filestream;
-
-    input_proc->document().save(filestream);
-    outfile.write("input_file", filestream.str());
+    outfile.write("input_file", input_proc->input_text());
 
     outfile.write("git_sha1", std::string(g_GIT_SHA1));
 
@@ -89,6 +142,25 @@ void generate_output()
 // Print the MOCC banner. Pretty!
 void print_banner();
 
+// Convert a text cross-section library to the binary format, which can be
+// loaded without parsing
+int convert_xsl(const std::string &in_name, const std::string &out_name)
+{
+    try {
+        FileScrubber in(in_name.c_str(), "!");
+        MaterialLib lib(in);
+        H5Node out(out_name, H5Access::WRITE);
+        lib.write(out);
+    } catch (Exception e) {
+        std::cerr << "Error:" << std::endl;
+        std::cerr << e.what();
+        return 1;
+    }
+    std::cout << "Wrote cross-section library '" << out_name << "'"
+              << std::endl;
+    return 0;
+}
+
 // Signal handler for SIGINT. Calls output() and quits
 void int_handler(int p)
 {
@@ -113,7 +185,254 @@ int run(int argc, char *argv[])
     return run(args);
 }
 
+/**
+ * Read the list of cases for a batch run. Each line that is not blank and does
+ * not start with '#' names a case, followed by any number of amendments, in
+ * the form accepted by \c -a, which distinguish it from the base input.
+ */
+std::vector<std::vector<std::string>> read_batch(const std::string &fname)
+{
+    std::ifstream file(fname);
+    if (!file.good()) {
+        throw EXCEPT("Failed to open batch file: " + fname);
+    }
+
+    std::vector<std::vector<std::string>> cases;
+    std::string line;
+    while (std::getline(file, line)) {
+        std::stringstream ss(line);
+        std::vector<std::string> fields;
+        std::string field;
+        while (ss >> field) {
+            fields.push_back(field);
+        }
+        if (fields.empty() || (fields.front()[0] == '#')) {
+            continue;
+        }
+        cases.push_back(fields);
+    }
+    return cases;
+}
+
+int run_case(const std::vector<std::string> &args, BatchState *batch);
+
+/**
+ * Run a case of a batch, given the command line shared by all of the cases,
+ * \p base, and the case's line of the batch file. Returns whether it
+ * succeeded.
+ */
+bool run_batch_case(const std::vector<std::string> &base,
+                    const std::vector<std::string> &c, BatchState &state)
+{
+    std::vector<std::string> case_args = base;
+    for (auto amendment = c.begin() + 1; amendment != c.end(); ++amendment) {
+        case_args.push_back("-a");
+        case_args.push_back(*amendment);
+    }
+    case_args.push_back("--case-name");
+    case_args.push_back(c.front());
+
+    // Start each case from a clean slate, apart from the shared state
+    solver.reset();
+    mesh.reset();
+    input_proc.reset();
+    RootTimer.reset();
+    ClearWarnings();
+
+    if (run_case(case_args, &state) != 0) {
+        // The log file is left open when a case bails
+        StopLogFile();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Run the cases of a batch in \p n_jobs worker processes, side by side. Each
+ * job is confined to its share of the CPUs (see \ref
+ * mocc::ParallelEnvironment::partition()) and takes the next case that
+ * hasn't been started whenever it finishes one, so that many small cases
+ * keep the whole machine busy. Returns the number of cases that failed,
+ * including those of a job that died.
+ */
+int run_jobs(const std::vector<std::string> &base,
+             const std::vector<std::vector<std::string>> &cases, int n_jobs,
+             const std::string &batch_name)
+{
+#ifdef __unix__
+    // Parse the cross-section libraries up front, so that the jobs share
+    // them, rather than each parsing its own copy. Cases that fail here
+    // will fail again, and be reported, in their job.
+    for (const auto &c : cases) {
+        try {
+            std::vector<std::string> case_args = base;
+            for (auto amendment = c.begin() + 1; amendment != c.end();
+                 ++amendment) {
+                case_args.push_back("-a");
+                case_args.push_back(*amendment);
+            }
+            InputProcessor input(case_args);
+            MaterialLib lib(input.document().child("material_lib"));
+        } catch (Exception e) {
+            continue;
+        }
+    }
+    RootTimer.reset();
+    ClearWarnings();
+
+    // Case counters shared by the jobs: the next case to start, and the
+    // number that succeeded
+    void *shared = mmap(nullptr, 2 * sizeof(std::atomic<int>),
+                        PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+                        -1, 0);
+    if (shared == MAP_FAILED) {
+        std::cerr << "Failed to set up the jobs" << std::endl;
+        return cases.size();
+    }
+    auto *next      = new (shared) std::atomic<int>(0);
+    auto *succeeded = new (next + 1) std::atomic<int>(0);
+
+    // Nothing may have started an OpenMP thread team yet; the forked jobs
+    // would inherit a broken one
+    std::cout.flush();
+    std::vector<pid_t> jobs;
+    for (int job = 0; job < n_jobs; job++) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            std::cerr << "Failed to start job " << job << std::endl;
+            break;
+        }
+        if (pid == 0) {
+            // Keep the screen output of each job apart
+            std::string out = batch_name + "_job" + std::to_string(job) +
+                              ".out";
+            if (!std::freopen(out.c_str(), "w", stdout)) {
+                std::cerr << "Failed to open " << out << std::endl;
+            }
+            ParallelEnvironment::partition(n_jobs, job);
+
+            BatchState state;
+            int icase;
+            while ((icase = (*next)++) < (int)cases.size()) {
+                if (run_batch_case(base, cases[icase], state)) {
+                    (*succeeded)++;
+                }
+            }
+            std::fflush(stdout);
+            std::_Exit(EXIT_SUCCESS);
+        }
+        jobs.push_back(pid);
+    }
+
+    for (pid_t pid : jobs) {
+        int status;
+        waitpid(pid, &status, 0);
+        if (!WIFEXITED(status)) {
+            std::cerr << "A job died before finishing its cases" << std::endl;
+        }
+    }
+
+    int n_failed = cases.size() - *succeeded;
+    munmap(shared, 2 * sizeof(std::atomic<int>));
+    return n_failed;
+#else
+    std::cerr << "Batch jobs are only supported on POSIX systems"
+              << std::endl;
+    return cases.size();
+#endif
+}
+
+/**
+ * Run each case listed in a batch file, one after another, or with \c --jobs,
+ * in several processes at once (see \ref run_jobs()). The cases run by a
+ * process share a \ref mocc::CoreMesh whenever their inputs only differ in
+ * the solver, and share ray data whenever they have the same geometry,
+ * quadrature and ray options. Text cross-section libraries are only parsed
+ * once.
+ */
+int run_batch(const std::vector<std::string> &args)
+{
+    // Pull out the number of jobs. The rest of the options are forwarded to
+    // each of the cases.
+    std::vector<std::string> base(1, args[0]);
+    int n_jobs = 1;
+    for (size_t iarg = 3; iarg < args.size(); iarg++) {
+        if (args[iarg] == "--jobs") {
+            n_jobs = (iarg + 1 < args.size()) ? std::atoi(args[++iarg].c_str())
+                                              : 0;
+            if (n_jobs < 1) {
+                std::cerr << "--jobs needs a positive number of jobs"
+                          << std::endl;
+                return 1;
+            }
+        } else {
+            base.push_back(args[iarg]);
+        }
+    }
+
+    std::vector<std::vector<std::string>> cases;
+    try {
+        cases = read_batch(args[2]);
+    } catch (Exception e) {
+        std::cerr << "Error:" << std::endl;
+        std::cerr << e.what();
+        return 1;
+    }
+
+    moc::RayData::enable_cache(true);
+    MaterialLib::enable_cache(true);
+
+    int n_failed = 0;
+    if (n_jobs > 1) {
+        std::string batch_name = args[2].substr(0, args[2].rfind('.'));
+        n_failed = run_jobs(base, cases, std::min<int>(n_jobs, cases.size()),
+                            batch_name);
+    } else {
+        BatchState state;
+        for (const auto &c : cases) {
+            if (!run_batch_case(base, c, state)) {
+                n_failed++;
+            }
+        }
+    }
+
+    MaterialLib::enable_cache(false);
+    moc::RayData::enable_cache(false);
+
+    std::cout << "Ran " << cases.size() << " cases, " << n_failed
+              << " failed" << std::endl;
+    return n_failed > 0 ? 1 : 0;
+}
+
 int run(const std::vector<std::string> &args)
+{
+    if ((args.size() > 1) && (args[1] == "--convert-xsl")) {
+        if (args.size() != 4) {
+            std::cerr << "Usage: mocc --convert-xsl library.xsl library.h5"
+                      << std::endl;
+            return 1;
+        }
+        return convert_xsl(args[2], args[3]);
+    }
+
+    if ((args.size() > 1) && (args[1] == "--batch")) {
+        if (args.size() < 4) {
+            std::cerr << "Usage: mocc --batch cases.txt [--jobs n] "
+                         "[options] infile"
+                      << std::endl;
+            return 1;
+        }
+        return run_batch(args);
+    }
+
+    return run_case(args, nullptr);
+}
+
+/**
+ * Run a single case. For a batch run, \p batch carries the mesh shared with
+ * the previous case, otherwise it is \c nullptr.
+ */
+int run_case(const std::vector<std::string> &args, BatchState *batch)
 {
     std::signal(SIGINT, int_handler);
 
@@ -142,7 +461,24 @@ int run(const std::vector<std::string> &args)
         // Actually process the XML input. We waited until now to do this,
         // because we want to be able to log the progress to a file, but needed
         // a case_name from the input file to be processed.
-        input_proc->process();
+        if (batch) {
+            std::string key = input_proc->mesh_key();
+            if (batch->mesh && (key == batch->mesh_key)) {
+                input_proc->process(batch->mesh);
+            } else {
+                input_proc->process();
+            }
+            batch->mesh_key = key;
+            batch->mesh     = input_proc->core_mesh();
+        } else {
+            input_proc->process();
+        }
+
+        // Check the output options now, rather than after the solve
+        {
+            H5Node check("output_check.h5", H5Access::MEMORY);
+            check.configure(input_proc->document().child("output"));
+        }
 
 #pragma omp parallel
         {
@@ -157,8 +493,27 @@ int run(const std::vector<std::string> &args)
         mesh = input_proc->core_mesh();
         LogFile << *mesh << std::endl;
 
+        // For a dry run, all we wanted was the memory estimate
+        if (input_proc->dry_run()) {
+            input_proc->memory_estimate().print(LogScreen);
+            LogScreen << "Peak resident set size: " << format_bytes(peak_rss())
+                      << std::endl;
+            StopLogFile();
+            return 0;
+        }
+
+        // Free everything that was only needed to set up the solver before
+        // it starts sweeping
+        input_proc->compact();
+
         // Pull a shared pointer to the top-level solver and make it go
         solver = input_proc->solver();
+        {
+            MemoryReport report("Memory");
+            solver->memory(report);
+            report.print(LogScreen);
+            LogScreen << std::endl;
+        }
         solver->solve();
 
         // Output stuff
@@ -172,6 +527,7 @@ int run(const std::vector<std::string> &args)
     }
 
     catch (Exception e) {
+        FlushLogs();
         std::cerr << "Error:" << std::endl;
         std::cerr << e.what();
         LogFile << "Error:" << std::endl;
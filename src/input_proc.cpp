@@ -16,9 +16,11 @@
 
 #include "input_proc.hpp"
 
+#include <cstdint>
 #include <cstdlib>
 #include <iostream>
 #include <memory>
+#include <sstream>
 #include <string>
 #include "pugixml.hpp"
 #include "util/error.hpp"
@@ -32,6 +34,7 @@
 #include "core/parallel_environment.hpp"
 #include "core/pin_mesh.hpp"
 #include "auxiliary/geometry_output.hpp"
+#include "auxiliary/memory_estimate.hpp"
 
 using std::shared_ptr;
 
@@ -45,6 +48,17 @@ std::string strip_extension(std::string input)
 
 void apply_amendment(pugi::xml_node &node, std::string path,
                      const std::string &value);
+
+// FNV-1a hash of a string
+uint64_t hash_string(const std::string &str)
+{
+    uint64_t key = 14695981039346656037ull;
+    for (const unsigned char c : str) {
+        key ^= c;
+        key *= 1099511628211ull;
+    }
+    return key;
+}
 }
 
 namespace mocc {
@@ -52,9 +66,13 @@ InputProcessor::InputProcessor(std::vector<std::string> args)
     : timer_(RootTimer.new_timer("Input Processor", true)),
       core_mesh_(nullptr),
       solver_(nullptr),
-      args_(args)
+      compacted_(false),
+      args_(args),
+      dry_run_(false),
+      memory_estimate_("Estimated memory")
 {
     std::vector<std::string> replacements;
+    std::string case_name_override;
     std::string filename      = "";
     bool good_cmd             = true;
     std::string command_error = "";
@@ -78,6 +96,15 @@ InputProcessor::InputProcessor(std::vector<std::string> args)
 
             // Read the replacement string. Pre-increment is intended
             replacements.push_back(args_[++iarg]);
+        } else if ((arg == "-n") || (arg == "--dry-run")) {
+            dry_run_ = true;
+        } else if (arg == "--case-name") {
+            if ((iarg == args_.size() - 1) || (args_[iarg + 1][0] == '-')) {
+                good_cmd      = false;
+                command_error = "--case-name specified without argument";
+                break;
+            }
+            case_name_override = args_[++iarg];
         } else {
             // This should be the filename
             if (filename == "") {
@@ -102,9 +129,14 @@ InputProcessor::InputProcessor(std::vector<std::string> args)
     if (!good_cmd) {
         std::cerr << command_error << std::endl;
 
-        std::cout << "Usage: mocc [-a substitution/path/attribute=value] "
+        std::cout << "Usage: mocc [-n] [-a substitution/path/attribute=value] "
+                     "[--case-name name] infile"
+                  << std::endl;
+        std::cout << "       mocc --batch cases.txt [--jobs n] [options] "
                      "infile"
                   << std::endl;
+        std::cout << "       mocc --convert-xsl library.xsl library.h5"
+                  << std::endl;
 
         exit(EXIT_FAILURE);
     }
@@ -151,6 +183,9 @@ InputProcessor::InputProcessor(std::vector<std::string> args)
             throw EXCEPT("<case_name> was provided, yet empty");
         }
     }
+    if (!case_name_override.empty()) {
+        case_name_ = case_name_override;
+    }
 
     global::case_name = case_name_;
 
@@ -161,7 +196,64 @@ InputProcessor::InputProcessor(std::vector<std::string> args)
     return;
 }
 
-void InputProcessor::process()
+std::string InputProcessor::mesh_key() const
+{
+    std::stringstream key;
+    for (const auto &node : doc_.children()) {
+        std::string name = node.name();
+        if ((name == "solver") || (name == "case_name") ||
+            (name == "parallel") || (name == "geometry_output") ||
+            (name == "output") || (name == "snapshot")) {
+            continue;
+        }
+        node.print(key, "", pugi::format_raw);
+    }
+    return key.str();
+}
+
+void InputProcessor::compact()
+{
+    size_t before = 0;
+    size_t after  = 0;
+    if (solver_) {
+        MemoryReport report("Memory");
+        solver_->memory(report);
+        before = report.total();
+        solver_->compact();
+        MemoryReport compacted("Memory");
+        solver_->memory(compacted);
+        after = compacted.total();
+    }
+
+    int n_mat = core_mesh_->compact_mat_lib();
+
+    input_text_ = this->input_text();
+    pugi::xml_document output;
+    output.append_copy(doc_.child("output"));
+    doc_.reset(output);
+    compacted_ = true;
+
+    release_free_memory();
+
+    LogScreen << "Released "
+              << format_bytes(before > after ? before - after : 0)
+              << " of solver setup data, " << n_mat
+              << " unused library materials and the parsed input"
+              << std::endl;
+    return;
+}
+
+std::string InputProcessor::input_text() const
+{
+    if (compacted_) {
+        return input_text_;
+    }
+    std::stringstream text;
+    doc_.save(text);
+    return text.str();
+}
+
+void InputProcessor::process(SP_CoreMesh_t mesh)
 {
     timer_.tic();
     Timer &mesh_timer = timer_.new_timer("Core Mesh");
@@ -188,16 +280,37 @@ void InputProcessor::process()
         ParEnv = ParallelEnvironment(doc_.child("parallel"));
     }
 
-    // Generate the core mesh
-    core_mesh_ = std::make_shared<CoreMesh>(doc_);
+    // Generate the core mesh, unless we were handed one to share
+    if (mesh) {
+        LogScreen << "Reusing the core mesh from a previous case" << std::endl;
+        core_mesh_ = mesh;
+    } else {
+        core_mesh_ = std::make_shared<CoreMesh>(doc_);
+    }
+
+    // Keep the data derived from the mesh in a snapshot file, keyed on the
+    // input that made the mesh, so that later runs can skip rebuilding it
+    if (!doc_.child("snapshot").empty()) {
+        std::string file = doc_.child("snapshot").attribute("file").value();
+        if (file.empty()) {
+            throw EXCEPT("No file specified for <snapshot>");
+        }
+        core_mesh_->set_snapshot(file, hash_string(this->mesh_key()));
+    }
 
     mesh_timer.toc();
 
     Timer &solver_timer = timer_.new_timer("Solver");
     solver_timer.tic();
 
-    // Generate a top-level solver
-    solver_ = SolverFactory(doc_.child("solver"), *core_mesh_.get());
+    // Generate a top-level solver, or for a dry run, just figure out how big
+    // it would be
+    if (dry_run_) {
+        memory_estimate_ =
+            aux::estimate_memory(doc_.child("solver"), *core_mesh_.get());
+    } else {
+        solver_ = SolverFactory(doc_.child("solver"), *core_mesh_.get());
+    }
 
     // Perform geometry output if necessary
     if (!doc_.child("geometry_output").empty()) {
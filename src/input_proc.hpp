@@ -20,6 +20,7 @@
 #include <memory>
 #include <string>
 #include "pugixml.hpp"
+#include "util/memory.hpp"
 #include "util/timers.hpp"
 #include "core/core_mesh.hpp"
 #include "solvers/solver_factory.hpp"
@@ -41,8 +42,44 @@ public:
     /**
      * \brief Actually process the contents of the file and construct
      * associated objects.
+     *
+     * If \p mesh is passed, it is used in place of constructing a new \ref
+     * CoreMesh. It should have been made from an input with the same \ref
+     * mesh_key().
+     */
+    void process(SP_CoreMesh_t mesh = nullptr);
+
+    /**
+     * \brief Release what was only needed to set up the \ref CoreMesh and
+     * solver, and report how much was released
+     *
+     * This compacts the solver (see \ref Solver::compact()) and the material
+     * library, and replaces the parsed input with its text and a copy of the
+     * \c \<output\> tag, which are all that is needed after the solve. Freed
+     * heap memory is then returned to the operating system where possible.
+     * The peak memory of a run tends to be set by the first sweep, so this
+     * should be called after \ref process() and before \ref
+     * Solver::solve().
+     */
+    void compact();
+
+    /**
+     * \brief Return the text of the input, including command-line
+     * amendments
      */
-    void process();
+    std::string input_text() const;
+
+    /**
+     * \brief Return a string identifying everything in the input that goes
+     * into the \ref CoreMesh
+     *
+     * This is the input with the \c \<solver\>, \c \<case_name\>, \c
+     * \<parallel\>, \c \<geometry_output\>, \c \<output\> and \c
+     * \<snapshot\> tags removed. Inputs with the same key may share a \ref
+     * CoreMesh, and its snapshot. This is only available before \ref
+     * compact().
+     */
+    std::string mesh_key() const;
 
     /**
     * Return a shared pointer to the CoreMesh.
@@ -72,11 +109,36 @@ public:
         return case_name_;
     }
 
+    /**
+     * \brief Return the parsed input
+     *
+     * After \ref compact(), this only holds the \c \<output\> tag.
+     */
     const pugi::xml_document &document() const
     {
         return doc_;
     }
 
+    /**
+     * \brief Return whether a dry run was requested (\c -n or \c --dry-run)
+     *
+     * For a dry run, \ref process() builds the \ref CoreMesh, but not the
+     * solver. Instead it estimates how much memory the solver would need,
+     * which may be had from \ref memory_estimate().
+     */
+    bool dry_run() const
+    {
+        return dry_run_;
+    }
+
+    /**
+     * \brief Return the memory estimate made by \ref process() for a dry run
+     */
+    const MemoryReport &memory_estimate() const
+    {
+        return memory_estimate_;
+    }
+
 private:
     // Timer for all input processing activities
     Timer &timer_;
@@ -90,8 +152,16 @@ private:
     // XML document
     pugi::xml_document doc_;
 
+    // Text of the input, once the document has been compacted
+    std::string input_text_;
+    bool compacted_;
+
     std::vector<std::string> args_;
 
     std::string case_name_;
+
+    bool dry_run_;
+
+    MemoryReport memory_estimate_;
 };
 }
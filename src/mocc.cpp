@@ -15,9 +15,23 @@
 */
 
 #include "driver.hpp"
+#ifdef MOCC_USE_MPI
+#include <mpi.h>
+#include "pugixml.hpp"
+#include "core/parallel_environment.hpp"
+#endif
 #include "util/error.hpp"
 
 int main(int argc, char *argv[])
 {
+#ifdef MOCC_USE_MPI
+    MPI_Init(&argc, &argv);
+    // Pick up the rank and size now that MPI is up
+    mocc::ParEnv = mocc::ParallelEnvironment(pugi::xml_node());
+    int result = run(argc, argv);
+    MPI_Finalize();
+    return result;
+#else
     return run(argc, argv);
+#endif
 }
@@ -0,0 +1,128 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "mocc_api.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "util/error.hpp"
+#include "session.hpp"
+
+using namespace mocc;
+
+struct mocc_session {
+    std::unique_ptr<Session> session;
+};
+
+namespace {
+std::string last_error;
+
+// Run f, translating any exception into an error code and message
+template <typename F> int guard(F f)
+{
+    try {
+        f();
+    } catch (Exception e) {
+        last_error = e.what();
+        return 1;
+    } catch (std::exception &e) {
+        last_error = e.what();
+        return 1;
+    }
+    last_error.clear();
+    return 0;
+}
+}
+
+mocc_session *mocc_create(const char *input_file)
+{
+    mocc_session *session = new mocc_session;
+    int err               = guard([&]() {
+        std::vector<std::string> args = {"mocc", input_file};
+        session->session.reset(new Session(args));
+    });
+    if (err) {
+        delete session;
+        return nullptr;
+    }
+    return session;
+}
+
+void mocc_destroy(mocc_session *session)
+{
+    delete session;
+}
+
+int mocc_solve(mocc_session *session)
+{
+    return guard([&]() { session->session->solve(); });
+}
+
+int mocc_scale_material(mocc_session *session, int mat_id, double factor)
+{
+    return guard(
+        [&]() { session->session->scale_material(mat_id, factor); });
+}
+
+int mocc_set_material_xs(mocc_session *session, int mat_id, int n_group,
+                         const double *xsab, const double *xsnf,
+                         const double *xsf, const double *xsch,
+                         const double *scat)
+{
+    return guard([&]() {
+        VecF ab(xsab, xsab + n_group);
+        VecF nf(xsnf, xsnf + n_group);
+        VecF f(xsf, xsf + n_group);
+        VecF ch(xsch, xsch + n_group);
+        std::vector<VecF> sc;
+        for (int ig = 0; ig < n_group; ig++) {
+            sc.emplace_back(scat + ig * n_group, scat + (ig + 1) * n_group);
+        }
+        session->session->update_material(mat_id,
+                                          Material(ab, nf, f, ch, sc));
+    });
+}
+
+int mocc_keff(const mocc_session *session, double *keff)
+{
+    return guard([&]() { *keff = session->session->keff(); });
+}
+
+int mocc_pin_shape(const mocc_session *session, int *nx, int *ny, int *nz)
+{
+    return guard([&]() {
+        ArrayB3 powers = session->session->pin_powers();
+        *nz            = powers.extent(0);
+        *ny            = powers.extent(1);
+        *nx            = powers.extent(2);
+    });
+}
+
+int mocc_pin_powers(const mocc_session *session, double *powers)
+{
+    return guard([&]() {
+        ArrayB3 p = session->session->pin_powers();
+        for (const auto v : p) {
+            *(powers++) = v;
+        }
+    });
+}
+
+const char *mocc_last_error(void)
+{
+    return last_error.c_str();
+}
@@ -0,0 +1,83 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+/**
+ * \file mocc_api.h
+ *
+ * \brief C interface to \ref mocc::Session
+ *
+ * All functions that return an int return zero on success and non-zero on
+ * failure, in which case \ref mocc_last_error() describes what went wrong.
+ * Cross sections and results are passed as doubles, regardless of the
+ * precision that MOCC was built with.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct mocc_session mocc_session;
+
+/**
+ * \brief Process the input file and construct its solver. Returns NULL on
+ * failure.
+ */
+mocc_session *mocc_create(const char *input_file);
+
+void mocc_destroy(mocc_session *session);
+
+int mocc_solve(mocc_session *session);
+
+/**
+ * \brief Scale the cross sections of a material, relative to those given in
+ * the input, as for a change in its density
+ */
+int mocc_scale_material(mocc_session *session, int mat_id, double factor);
+
+/**
+ * \brief Replace the cross sections of a material
+ *
+ * Each of the one-dimensional arrays holds \p n_group values. The scattering
+ * matrix is dense and row-major, indexed by [to group][from group].
+ */
+int mocc_set_material_xs(mocc_session *session, int mat_id, int n_group,
+                         const double *xsab, const double *xsnf,
+                         const double *xsf, const double *xsch,
+                         const double *scat);
+
+int mocc_keff(const mocc_session *session, double *keff);
+
+/**
+ * \brief Return the dimensions of the pin power array
+ */
+int mocc_pin_shape(const mocc_session *session, int *nx, int *ny, int *nz);
+
+/**
+ * \brief Copy the normalized pin powers to \p powers, which must hold
+ * nx*ny*nz values, with x varying fastest
+ */
+int mocc_pin_powers(const mocc_session *session, double *powers);
+
+/**
+ * \brief Return a description of the last error, or an empty string
+ */
+const char *mocc_last_error(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,128 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "session.hpp"
+
+#include "util/error.hpp"
+#include "util/files.hpp"
+#include "util/h5file.hpp"
+#include "util/timers.hpp"
+#include "solvers/eigen_solver.hpp"
+#include "solvers/jfnk_eigen_solver.hpp"
+
+namespace mocc {
+Session::Session(const std::vector<std::string> &args) : n_solve_(0)
+{
+    RootTimer.tic();
+
+    input_proc_.reset(new InputProcessor(args));
+    if (input_proc_->dry_run()) {
+        throw EXCEPT("Dry runs are not supported by a Session.");
+    }
+
+    StartLogFile(input_proc_->case_name());
+    LogScreen << "Starting session for case: " << input_proc_->case_name()
+              << std::endl;
+
+    input_proc_->process();
+    mesh_   = input_proc_->core_mesh();
+    solver_ = input_proc_->solver();
+
+    // Carry the solution over from one solve to the next
+    if (auto eigen = dynamic_cast<EigenSolver *>(solver_.get())) {
+        eigen->set_continue(true);
+    }
+
+    return;
+}
+
+Session::~Session()
+{
+    solver_.reset();
+    mesh_.reset();
+    input_proc_.reset();
+    RootTimer.toc();
+    StopLogFile();
+}
+
+void Session::solve()
+{
+    LogScreen << "Session solve " << n_solve_ << std::endl;
+    solver_->solve();
+    n_solve_++;
+    return;
+}
+
+void Session::update_material(int id, const Material &mat)
+{
+    mesh_->update_material(id, mat);
+    return;
+}
+
+void Session::scale_material(int id, real_t factor)
+{
+    if (factor <= 0.0) {
+        throw EXCEPT("Invalid material scaling factor.");
+    }
+    if (!mesh_->mat_lib().has(id)) {
+        throw EXCEPT("Unknown material ID: " + std::to_string(id));
+    }
+
+    auto it = original_.find(id);
+    if (it == original_.end()) {
+        it = original_.emplace(id, mesh_->mat_lib()[id]).first;
+    }
+    this->update_material(id, it->second.scaled(factor));
+    return;
+}
+
+real_t Session::keff() const
+{
+    if (auto eigen = dynamic_cast<const EigenSolver *>(solver_.get())) {
+        return eigen->keff();
+    }
+    if (auto jfnk = dynamic_cast<const JFNKEigenSolver *>(solver_.get())) {
+        return jfnk->keff();
+    }
+    throw EXCEPT("The solver does not provide an eigenvalue.");
+}
+
+ArrayB3 Session::pin_powers() const
+{
+    return this->sweeper()->pin_powers();
+}
+
+ArrayB2 Session::pin_flux() const
+{
+    return this->sweeper()->get_pin_flux();
+}
+
+void Session::output(const std::string &file_name) const
+{
+    H5Node file(file_name, H5Access::WRITE);
+    solver_->output(file);
+    return;
+}
+
+const TransportSweeper *Session::sweeper() const
+{
+    const TransportSweeper *sweeper = solver_->sweeper();
+    if (!sweeper) {
+        throw EXCEPT("The solver does not have a sweeper.");
+    }
+    return sweeper;
+}
+}
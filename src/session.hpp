@@ -0,0 +1,123 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "util/blitz_typedefs.hpp"
+#include "util/global_config.hpp"
+#include "core/core_mesh.hpp"
+#include "core/material.hpp"
+#include "core/solver.hpp"
+#include "input_proc.hpp"
+
+namespace mocc {
+/**
+ * \brief In-process interface to a MOCC case, for coupling with other codes
+ *
+ * A Session processes an input once, building the \ref CoreMesh and top-level
+ * \ref Solver, and may then be solved any number of times. Between solves,
+ * the cross sections of the materials may be replaced in memory, and the pin
+ * powers, pin flux and eigenvalue fetched directly, without going through
+ * input and output files.
+ *
+ * Eigenvalue solves after the first start from the flux and eigenvalue of the
+ * previous solve. Other solvers start over.
+ *
+ * The log file, timers and a few other bits of state are global, so only
+ * one Session may exist at a time.
+ */
+class Session {
+public:
+    /**
+     * \brief Process an input and construct the solver
+     *
+     * \param args command line arguments, as accepted by the \c mocc
+     * executable (including the executable name), naming the input file and
+     * any amendments to it. Dry runs are not supported.
+     */
+    Session(const std::vector<std::string> &args);
+
+    ~Session();
+
+    /**
+     * \brief Solve the problem with the current cross sections
+     */
+    void solve();
+
+    /**
+     * \brief Replace the cross sections of the material mapped to ID \p id
+     */
+    void update_material(int id, const Material &mat);
+
+    /**
+     * \brief Scale the cross sections of the material mapped to ID \p id,
+     * relative to those given in the input
+     *
+     * This models a change of the number densities of all constituents of
+     * the material by \p factor, e.g. the density of the coolant. Only
+     * macroscopic cross sections are supported, so the relative composition
+     * of a material can not be changed this way; use \ref update_material()
+     * for that.
+     */
+    void scale_material(int id, real_t factor);
+
+    /**
+     * \brief Return the eigenvalue of the last solve
+     *
+     * Throws if the top-level solver is not an eigenvalue solver.
+     */
+    real_t keff() const;
+
+    /**
+     * \brief Return the normalized pin powers, indexed by (plane, y, x)
+     *
+     * \copydetails TransportSweeper::pin_powers()
+     */
+    ArrayB3 pin_powers() const;
+
+    /**
+     * \brief Return the pin-homogenized multi-group scalar flux, indexed by
+     * pin and group
+     */
+    ArrayB2 pin_flux() const;
+
+    /**
+     * \brief Write the output of the solver to an HDF5 file
+     */
+    void output(const std::string &file_name) const;
+
+    const CoreMesh &mesh() const
+    {
+        return *mesh_;
+    }
+
+private:
+    std::unique_ptr<InputProcessor> input_proc_;
+    SP_CoreMesh_t mesh_;
+    SP_Solver_t solver_;
+
+    // Materials as they were given in the input, before any scaling
+    std::map<int, Material> original_;
+
+    int n_solve_;
+
+    const TransportSweeper *sweeper() const;
+};
+}
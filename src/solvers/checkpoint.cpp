@@ -0,0 +1,58 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "checkpoint.hpp"
+
+#include "pugixml.hpp"
+#include "util/error.hpp"
+#include "util/files.hpp"
+#include "core/globals.hpp"
+
+namespace mocc {
+Checkpoint::Checkpoint(const pugi::xml_node &input)
+    : interval_(0), file_(global::case_name + "_checkpoint.h5")
+{
+    auto node = input.child("checkpoint");
+    if (node.empty()) {
+        return;
+    }
+
+    interval_ = node.attribute("interval").as_int(0);
+    if (interval_ < 0) {
+        throw EXCEPT("Invalid checkpoint interval.");
+    }
+
+    if (!node.attribute("file").empty()) {
+        file_ = node.attribute("file").value();
+        if (file_.empty()) {
+            throw EXCEPT("Empty checkpoint file name.");
+        }
+    }
+
+    restart_file_ = node.attribute("restart").value();
+
+    if (interval_ > 0) {
+        LogFile << "Writing checkpoints to " << file_ << " every "
+                << interval_ << " iterations" << std::endl;
+    }
+    if (!restart_file_.empty()) {
+        LogFile << "Restarting from checkpoint " << restart_file_
+                << std::endl;
+    }
+
+    return;
+}
+} // namespace mocc
@@ -0,0 +1,93 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <string>
+#include "util/async_output.hpp"
+#include "util/h5file.hpp"
+#include "util/pugifwd.hpp"
+
+namespace mocc {
+/**
+ * \brief Periodic checkpointing of a solver, and restart from a checkpoint
+ *
+ * This is configured by a \<checkpoint\> tag inside of the \<solver\> tag:
+ *  - \c interval: write a checkpoint every this many iterations (cycles, for
+ *    the Monte Carlo solver). Zero (the default) disables checkpointing.
+ *  - \c file: the checkpoint file to write. Defaults to
+ *    \c \<case_name\>_checkpoint.h5.
+ *  - \c restart: a checkpoint file to resume the calculation from.
+ *
+ * Checkpoints are snapshotted in memory and written by the global \ref
+ * OutputQueue, so that they do not stall the solver. The file is replaced
+ * atomically, so a run that dies while writing a checkpoint leaves the
+ * previous one intact.
+ */
+class Checkpoint {
+public:
+    /**
+     * \brief Construct from the \<solver\> tag. The \<checkpoint\> tag is
+     * optional.
+     */
+    Checkpoint(const pugi::xml_node &input);
+
+    bool enabled() const
+    {
+        return interval_ > 0;
+    }
+
+    /**
+     * \brief Return whether a checkpoint should be written after the passed
+     * iteration (counting from 1)
+     */
+    bool due(int iteration) const
+    {
+        return (interval_ > 0) && (iteration % interval_ == 0);
+    }
+
+    bool restart() const
+    {
+        return !restart_file_.empty();
+    }
+
+    const std::string &restart_file() const
+    {
+        return restart_file_;
+    }
+
+    /**
+     * \brief Write a checkpoint for the passed iteration
+     *
+     * \param iteration the number of completed iterations
+     * \param f a function object taking an \ref H5Node, to which it should
+     * write the solver state
+     */
+    template <class Function> void write(int iteration, Function f) const
+    {
+        H5Node h5f(file_, H5Access::MEMORY);
+        h5f.write("iteration", iteration);
+        f(h5f);
+        OutputQueue.submit(file_, h5f.image());
+        return;
+    }
+
+private:
+    int interval_;
+    std::string file_;
+    std::string restart_file_;
+};
+} // namespace mocc
@@ -16,20 +16,38 @@
 
 #include "eigen_solver.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <exception>
 #include <iomanip>
 #include "pugixml.hpp"
+#include "util/async_output.hpp"
 #include "util/error.hpp"
 #include "util/files.hpp"
+#include "util/memory.hpp"
+#include "util/profile.hpp"
+#include "util/reduction.hpp"
 #include "util/string_utils.hpp"
 #include "util/utils.hpp"
 #include "util/validate_input.hpp"
 #include "core/globals.hpp"
+#include "core/parallel_environment.hpp"
 
 const static int out_w = 14;
 
 namespace {
 const std::vector<std::string> recognized_attributes = {
-    "type", "cmfd", "k_tol", "psi_tol", "max_iter", "min_iter"};
+    "type",           "cmfd",
+    "k_tol",          "psi_tol",
+    "max_iter",       "min_iter",
+    "acceleration",   "anderson_depth",
+    "energy_iteration", "energy_block",
+    "pipeline_source",  "predict_convergence",
+    "predict_window",   "cmfd_lag"};
+
+// Largest difference between the ratios of successive fission source
+// residuals for them to count as decaying consistently
+const mocc::real_t ratio_spread = 0.05;
 }
 
 namespace mocc {
@@ -37,7 +55,21 @@ EigenSolver::EigenSolver(const pugi::xml_node &input, const CoreMesh &mesh)
     : fss_(input, mesh),
       fission_source_(fss_.sweeper()->n_reg_fission()),
       fission_source_prev_(fss_.sweeper()->n_reg_fission()),
-      min_iterations_(0)
+      min_iterations_(0),
+      predict_(false),
+      predict_window_(4),
+      have_extrapolation_(false),
+      keff_ext_(1.0),
+      cmfd_lag_(false),
+      lag_pending_(false),
+      lag_k_(1.0),
+      fs_accel_(input, fss_.sweeper()->n_reg_fission()),
+      dump_async_(true),
+      dump_compression_(0),
+      checkpoint_(input),
+      continue_(false),
+      solved_(false),
+      n_coarse_iterations_(0)
 {
     LogFile << "Initializing Eigenvalue solver..." << std::endl;
 
@@ -81,6 +113,18 @@ EigenSolver::EigenSolver(const pugi::xml_node &input, const CoreMesh &mesh)
         min_iterations_ = in_int;
     }
 
+    // Early termination on the extrapolated solution
+    predict_ = input.attribute("predict_convergence").as_bool(false);
+    if (!input.attribute("predict_window").empty()) {
+        predict_window_ = input.attribute("predict_window").as_int(-1);
+        if (predict_window_ < 2) {
+            throw EXCEPT("Invalid convergence prediction window.");
+        }
+    }
+    if (predict_) {
+        fission_source_ext_.resize(fission_source_.shape());
+    }
+
     // Read in dump iterations if present
     if (!input.child("dump_iterations").empty()) {
         dump_iterations_ =
@@ -91,6 +135,42 @@ EigenSolver::EigenSolver(const pugi::xml_node &input, const CoreMesh &mesh)
             LogFile << i << " ";
         }
         LogFile << std::endl;
+
+        const auto &dump  = input.child("dump_iterations");
+        dump_async_       = dump.attribute("async").as_bool(true);
+        dump_compression_ = dump.attribute("compression").as_int(0);
+        if ((dump_compression_ < 0) || (dump_compression_ > 9)) {
+            throw EXCEPT("Invalid dump compression level.");
+        }
+    }
+
+    // Warm start from a previous solution
+    if (!input.child("warm_start").empty()) {
+        warm_start_file_ = input.child("warm_start").attribute("file").value();
+        if (warm_start_file_.empty()) {
+            throw EXCEPT("No file specified for warm start.");
+        }
+        if (checkpoint_.restart()) {
+            throw EXCEPT("Warm start and checkpoint restart are exclusive.");
+        }
+    }
+
+    // Coarse discretization to converge on first. Its tag is a complete
+    // eigenvalue solver specification of its own.
+    if (!input.child("continuation").empty()) {
+        const auto &cont = input.child("continuation");
+        if (cont.child("sweeper").empty()) {
+            throw EXCEPT("The continuation solver needs its own <sweeper>.");
+        }
+        if (!warm_start_file_.empty()) {
+            throw EXCEPT("Warm start and continuation are exclusive.");
+        }
+        LogFile << "Initializing the continuation solver..." << std::endl;
+        coarse_.reset(new EigenSolver(cont, mesh));
+        if (coarse_->sweeper()->n_group() != fss_.sweeper()->n_group()) {
+            throw EXCEPT("The continuation solver does not match the energy "
+                         "groups of the solver.");
+        }
     }
 
     // Count the number of fissile mesh regions
@@ -115,9 +195,25 @@ EigenSolver::EigenSolver(const pugi::xml_node &input, const CoreMesh &mesh)
         // sweeper
         cmfd_.reset(new CMFD(input.child("cmfd"), &mesh,
                              fss_.sweeper()->get_homogenized_xsmesh()));
-        // Associate the sweeper with the coarse data from the CMFD solver
-        CoarseData *const cd = cmfd_->get_data();
-        fss_.sweeper()->set_coarse_data(cd);
+        // Associate the sweeper with the coarse data from the CMFD solver.
+        // A lagged solve works on its own coarse data while the sweeper
+        // tallies into a copy.
+        cmfd_lag_ = input.attribute("cmfd_lag").as_bool(false);
+        if (cmfd_lag_) {
+            std::string type = input.child("sweeper").attribute("type").value();
+            if (type == "2d3d") {
+                throw EXCEPT("Lagged CMFD is not supported by the 2D3D "
+                             "sweeper, which shares its homogenized cross "
+                             "sections with the CMFD solver.");
+            }
+            sweep_data_.reset(
+                new CoarseData(mesh, fss_.sweeper()->n_group()));
+            fss_.sweeper()->set_coarse_data(sweep_data_.get());
+            LogFile << "Lagging CMFD by one outer iteration" << std::endl;
+        } else {
+            CoarseData *const cd = cmfd_->get_data();
+            fss_.sweeper()->set_coarse_data(cd);
+        }
     }
 
     LogFile << "Done initializing Eigenvalue solver." << std::endl;
@@ -138,12 +234,19 @@ void EigenSolver::solve()
               << "\t Min/Max Iterations: " << min_iterations_ << " / "
               << max_iterations_ << "\n\n";
 
-    keff_      = 1.0;
-    keff_prev_ = 1.0;
-
-    // initialize the fixed source solver and calculation the initial
-    // fission source
-    fss_.initialize();
+    bool resume = continue_ && solved_;
+    fs_accel_.reset();
+    have_extrapolation_ = false;
+    if (resume) {
+        keff_prev_ = keff_;
+    } else {
+        keff_      = 1.0;
+        keff_prev_ = 1.0;
+
+        // initialize the fixed source solver and calculation the initial
+        // fission source
+        fss_.initialize();
+    }
 
     // Hand a reference to the fission source to the fixed source solver
     fss_.set_fission_source(&fission_source_);
@@ -151,36 +254,53 @@ void EigenSolver::solve()
     error_k_   = tolerance_k_;   // K residual
     error_psi_ = tolerance_psi_; // L-2 norm of the fission source residual
 
+    if (!resume && !warm_start_file_.empty()) {
+        this->warm_start();
+    }
+
+    // A restart already has the fine solution to go on from
+    if (!resume && coarse_ && !checkpoint_.restart()) {
+        this->continuation();
+    }
+
     fss_.sweeper()->calc_fission_source(keff_, fission_source_);
 
+    unsigned start_iteration = 0;
+    if (!resume && checkpoint_.restart()) {
+        start_iteration = this->read_checkpoint();
+        LogScreen << "Resuming from iteration " << start_iteration << " of "
+                  << checkpoint_.restart_file() << std::endl;
+    }
+
+    // The warm start, continuation or restart may have initialized the CMFD
+    // data, which a lagged solve's sweeper works on a copy of
+    if (!resume && sweep_data_) {
+        sweep_data_->assign(cmfd_->coarse_data());
+        lag_pending_ = false;
+    }
+
     LogScreen << std::setw(out_w) << "Time" << std::setw(out_w) << "Iter."
               << std::setw(out_w) << "k" << std::setw(out_w) << "k error"
               << std::setw(out_w) << "psi error" << std::endl;
 
-    auto dump_it       = dump_iterations_.begin();
+    // Skip any dumps for iterations that were completed before a restart
+    auto dump_it = std::upper_bound(dump_iterations_.begin(),
+                                    dump_iterations_.end(),
+                                    (int)start_iteration);
     unsigned next_dump = std::numeric_limits<unsigned>::max();
     if (dump_it != dump_iterations_.end()) {
         next_dump = *dump_it;
     }
 
-    for (size_t n_iterations = 0; n_iterations < max_iterations_;
-         n_iterations++) {
+    for (size_t n_iterations = start_iteration;
+         n_iterations < max_iterations_; n_iterations++) {
         this->step();
 
         // Check for convergence
         error_k_ = fabs(keff_ - keff_prev_);
 
-        const auto &vol = fss_.sweeper()->volumes();
-        //assert(vol.size() == fission_source_.size());
-        Normalize(fission_source_.begin(), fission_source_.end());
-        Normalize(fission_source_prev_.begin(),
-                        fission_source_prev_.end());
-
-        real_t efis = 0.0;
-        for (int i = 0; i < (int)fss_.sweeper()->n_reg(); i++) {
-            real_t e = (fission_source_(i) - fission_source_prev_(i));
-            efis += e * e;
-        }
+        real_t efis =
+            this->normalize_fission_sources((int)fss_.sweeper()->n_reg());
         error_psi_ = std::sqrt(efis / n_fissile_regions_);
 
         convergence_.push_back(
@@ -190,11 +310,25 @@ void EigenSolver::solve()
 
         this->print(n_iterations + 1, convergence_.back());
 
+        real_t rho = this->dominance_ratio();
+        dominance_ratio_.push_back(rho);
+        bool predicted = predict_ && this->extrapolate(rho);
+
         if (n_iterations + 1 == next_dump) {
             std::stringstream fname;
             fname << global::case_name << "_iter_" << n_iterations + 1 << ".h5";
-            H5Node h5f(fname.str(), H5Access::WRITE);
-            this->output(h5f);
+            if (dump_async_) {
+                // Snapshot the output in memory and let the background
+                // thread write it out
+                H5Node h5f(fname.str(), H5Access::MEMORY);
+                h5f.set_compression(dump_compression_);
+                this->output(h5f);
+                OutputQueue.submit(fname.str(), h5f.image());
+            } else {
+                H5Node h5f(fname.str(), H5Access::WRITE);
+                h5f.set_compression(dump_compression_);
+                this->output(h5f);
+            }
 
             next_dump = std::numeric_limits<int>::max();
             if (++dump_it != dump_iterations_.end()) {
@@ -202,6 +336,12 @@ void EigenSolver::solve()
             }
         }
 
+        if (checkpoint_.due(n_iterations + 1)) {
+            checkpoint_.write(n_iterations + 1, [this](H5Node &node) {
+                this->write_checkpoint(node);
+            });
+        }
+
         // Check for NaN
         if (keff_ != keff_) {
             throw EXCEPT("Eigenvalue is not a number. Giving up.");
@@ -215,18 +355,100 @@ void EigenSolver::solve()
             LogScreen << "Convergence criteria satisfied!" << std::endl;
             break;
         }
+        if (predicted && (n_iterations >= min_iterations_)) {
+            keff_           = keff_ext_;
+            fission_source_  = fission_source_ext_;
+            LogScreen << "Extrapolated solution converged, with dominance "
+                         "ratio "
+                      << rho << ". k = " << std::fixed
+                      << std::setprecision(10) << keff_ << std::endl;
+            break;
+        }
 
         if (n_iterations == (max_iterations_ - 1)) {
             LogScreen << "Maximum number of iterations reached!" << std::endl;
         }
     }
+
+    solved_ = true;
 } // solve()
 
+real_t EigenSolver::dominance_ratio() const
+{
+    int n = convergence_.size();
+    if (n <= predict_window_) {
+        return 0.0;
+    }
+
+    real_t min_ratio = 1.0;
+    real_t max_ratio = 0.0;
+    for (int i = n - predict_window_; i < n; i++) {
+        real_t e_prev = convergence_[i - 1].error_psi;
+        if (!(e_prev > 0.0)) {
+            return 0.0;
+        }
+        real_t ratio = convergence_[i].error_psi / e_prev;
+        min_ratio    = std::min(min_ratio, ratio);
+        max_ratio    = std::max(max_ratio, ratio);
+    }
+    if ((max_ratio >= 1.0) || (min_ratio <= 0.0) ||
+        (max_ratio - min_ratio > ratio_spread)) {
+        return 0.0;
+    }
+
+    return std::pow(convergence_[n - 1].error_psi /
+                        convergence_[n - 1 - predict_window_].error_psi,
+                    1.0 / predict_window_);
+}
+
+bool EigenSolver::extrapolate(real_t rho)
+{
+    if (rho <= 0.0) {
+        have_extrapolation_ = false;
+        return false;
+    }
+
+    real_t c     = rho / (1.0 - rho);
+    real_t k_ext = keff_ + c * (keff_ - keff_prev_);
+
+    // The fission sources have both been normalized, and the source handed
+    // to the sweep is the previous iterate
+    int n = fission_source_.size();
+    ArrayB1 fs_ext(n);
+    for (int i = 0; i < n; i++) {
+        fs_ext(i) = fission_source_(i) +
+                    c * (fission_source_(i) - fission_source_prev_(i));
+    }
+
+    bool converged = false;
+    if (have_extrapolation_) {
+        real_t error_k   = std::abs(k_ext - keff_ext_);
+        real_t error_psi = std::sqrt(
+            squared_distance(fs_ext.data(), fission_source_ext_.data(), n) /
+            n_fissile_regions_);
+        LogFile << "Dominance ratio " << rho << ", extrapolated k " << k_ext
+                << ", k error " << error_k << ", psi error " << error_psi
+                << std::endl;
+        converged = (error_k < tolerance_k_) && (error_psi < tolerance_psi_);
+    }
+
+    keff_ext_           = k_ext;
+    fission_source_ext_ = fs_ext;
+    have_extrapolation_ = true;
+    return converged;
+}
+
 void EigenSolver::step()
 {
+    MOCC_PROFILE_ZONE("Outer");
 
     if (cmfd_ && cmfd_->is_enabled()) {
-        this->do_cmfd();
+        if (cmfd_lag_) {
+            this->apply_lagged_cmfd();
+            this->start_lagged_cmfd();
+        } else {
+            this->do_cmfd();
+        }
     }
 
     // Perform a group sweep with the FSS
@@ -235,23 +457,88 @@ void EigenSolver::step()
     // jive with the normalization that is being done for the convergence
     // criterion.
     fss_.sweeper()->calc_fission_source(keff_, fission_source_);
+
+    // Extrapolate the fission source from the previous iterations. This
+    // only applies to the source handed to the sweeper; the convergence
+    // checks still see the fission source that the sweep produces.
+    if (fs_accel_.is_enabled()) {
+        fs_accel_.accelerate(fission_source_, keff_);
+    }
+
     fission_source_prev_ = fission_source_;
-    fss_.step();
+    if (lag_pending_) {
+        // Sweep alongside the lagged CMFD solve. Both start parallel regions
+        // of their own, and the sweep may nest more.
+        int max_levels = omp_get_max_active_levels();
+        omp_set_max_active_levels(std::max(max_levels, 3));
+        std::exception_ptr error;
+#pragma omp parallel sections num_threads(2)
+        {
+#pragma omp section
+            {
+                try {
+                    fss_.step();
+                } catch (...) {
+#pragma omp critical
+                    error = std::current_exception();
+                }
+            }
+#pragma omp section
+            {
+                try {
+                    MOCC_PROFILE_ZONE("CMFD");
+                    cmfd_->solve(lag_k_, false);
+                } catch (...) {
+#pragma omp critical
+                    error = std::current_exception();
+                }
+            }
+        }
+        omp_set_max_active_levels(max_levels);
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    } else {
+        fss_.step();
+    }
 
-    // Get the total fission sources
-    real_t tfis1 = fss_.sweeper()->total_fission(false);
-    real_t tfis2 = fss_.sweeper()->total_fission(true);
+    // Get the total fission sources, along with the new fission source for
+    // the old estimate of k, which is then rescaled for the new one
+    auto tfis = fss_.sweeper()->fission_update(keff_, fission_source_);
 
     // update estimate for k
     keff_prev_ = keff_;
-    keff_      = keff_ * tfis1 / tfis2;
+    keff_      = keff_ * tfis.current / tfis.old;
 
-    // update the fission source
-    fss_.sweeper()->calc_fission_source(keff_, fission_source_);
+    fission_source_ *= keff_prev_ / keff_;
 
     return;
 }
 
+real_t EigenSolver::normalize_fission_sources(int n_dist)
+{
+    const int n     = fission_source_.size();
+    real_t *fs      = fission_source_.data();
+    real_t *fs_prev = fission_source_prev_.data();
+
+    // Number of positive values and sum of each source
+    auto sums = parallel_sums<4>(n, [fs, fs_prev](int i, real_t *s) {
+        s[0] += (fs[i] > 0.0) ? 1.0 : 0.0;
+        s[1] += fs[i];
+        s[2] += (fs_prev[i] > 0.0) ? 1.0 : 0.0;
+        s[3] += fs_prev[i];
+    });
+    const real_t f      = sums[0] / sums[1];
+    const real_t f_prev = sums[2] / sums[3];
+
+    return parallel_sum(n, [=](int i) {
+        fs[i] *= f;
+        fs_prev[i] *= f_prev;
+        real_t e = fs[i] - fs_prev[i];
+        return (i < n_dist) ? e * e : 0.0;
+    });
+}
+
 void EigenSolver::print(int iter, ConvergenceCriteria conv)
 {
     LogScreen << std::setw(out_w) << std::fixed << std::setprecision(5)
@@ -262,34 +549,301 @@ void EigenSolver::print(int iter, ConvergenceCriteria conv)
 
 void EigenSolver::do_cmfd()
 {
+    MOCC_PROFILE_ZONE("CMFD");
     assert(cmfd_);
     assert(cmfd_->is_enabled());
     // push homogenized flux onto the coarse mesh, solve, and pull it
     // back.
-    cmfd_->coarse_data().flux =
-        fss_.sweeper()->get_pin_flux(MeshTreatment::PIN_PLANE);
-
-    // Set the convergence criteria for this solve, there are a few ways we
-    // can do this. This needs some work. Should probably be converging the
-    // CMFD-transport sweeper residual, rather than the actual CMFD solution.
-    CMFDConvergence conv = CMFDConvergence::FIXED;
-    switch (conv) {
-    case CMFDConvergence::FIXED:
-        break;
-    case CMFDConvergence::FLOAT:
-        real_t k_tol = std::max(error_k_ / 1000.0, tolerance_k_ / 10.0);
-        cmfd_->set_k_tolerance(k_tol);
-
-        real_t psi_tol = std::max(error_psi_ / 1000.0, tolerance_psi_ / 10.0);
-        cmfd_->set_psi_tolerance(psi_tol);
-        break;
+    {
+        ThreadTeam team(Phase::PROJECTION);
+        cmfd_->coarse_data().flux =
+            fss_.sweeper()->get_pin_flux(MeshTreatment::PIN_PLANE);
+    }
+
+    // Let inexact CMFD loosen its tolerances to follow the outer iteration.
+    // Nothing is known about its convergence before the first outer, so
+    // solve loosely.
+    if (cmfd_->is_inexact()) {
+        if (convergence_.empty()) {
+            cmfd_->set_outer_error(1.0, 1.0);
+        } else {
+            cmfd_->set_outer_error(error_k_, error_psi_);
+        }
     }
     cmfd_->solve(keff_);
+    ThreadTeam team(Phase::PROJECTION);
     fss_.sweeper()->set_pin_flux(cmfd_->flux(), MeshTreatment::PIN_PLANE);
     //fss_.sweeper()->update_incoming_flux();
     return;
 }
 
+void EigenSolver::apply_lagged_cmfd()
+{
+    if (!lag_pending_) {
+        return;
+    }
+    MOCC_PROFILE_ZONE("CMFD");
+    lag_pending_ = false;
+
+    ThreadTeam team(Phase::PROJECTION);
+    TransportSweeper *sweeper = fss_.sweeper();
+    ArrayB2 pin_flux          = sweeper->get_pin_flux(MeshTreatment::PIN_PLANE);
+    const ArrayB2 &cmfd_flux  = cmfd_->flux();
+    for (int i = 0; i < pin_flux.extent(0); i++) {
+        for (int ig = 0; ig < pin_flux.extent(1); ig++) {
+            if (lag_flux_(i, ig) > 0.0) {
+                pin_flux(i, ig) *= cmfd_flux(i, ig) / lag_flux_(i, ig);
+            }
+        }
+    }
+    sweeper->set_pin_flux(pin_flux, MeshTreatment::PIN_PLANE);
+    keff_ = lag_k_;
+    return;
+}
+
+void EigenSolver::start_lagged_cmfd()
+{
+    MOCC_PROFILE_ZONE("CMFD");
+    // Currents from the last sweep, and the flux that it left behind
+    cmfd_->coarse_data().assign(*sweep_data_);
+    {
+        ThreadTeam team(Phase::PROJECTION);
+        lag_flux_.reference(
+            fss_.sweeper()->get_pin_flux(MeshTreatment::PIN_PLANE));
+        cmfd_->coarse_data().flux = lag_flux_;
+        cmfd_->update_xs();
+    }
+
+    if (cmfd_->is_inexact()) {
+        if (convergence_.empty()) {
+            cmfd_->set_outer_error(1.0, 1.0);
+        } else {
+            cmfd_->set_outer_error(error_k_, error_psi_);
+        }
+    }
+    lag_k_       = keff_;
+    lag_pending_ = true;
+    return;
+}
+
+void EigenSolver::write_checkpoint(H5Node &node) const
+{
+    VecF keff = {keff_, keff_prev_};
+    node.write("k", keff);
+    node.write("fission_source", fission_source_);
+
+    {
+        VecF k;
+        VecF error_k;
+        VecF error_psi;
+        for (auto &c : convergence_) {
+            k.push_back(c.k);
+            error_k.push_back(c.error_k);
+            error_psi.push_back(c.error_psi);
+        }
+        auto g = node.create_group("convergence");
+        g.write("k", k);
+        g.write("error_k", error_k);
+        g.write("error_psi", error_psi);
+        g.write("iteration_time", iteration_times_);
+    }
+
+    {
+        auto g = node.create_group("sweeper");
+        fss_.sweeper()->write_checkpoint(g);
+    }
+
+    if (cmfd_) {
+        auto g = node.create_group("cmfd");
+        cmfd_->coarse_data().write_checkpoint(g);
+    }
+    return;
+}
+
+int EigenSolver::read_checkpoint()
+{
+    H5Node h5f(checkpoint_.restart_file(), H5Access::READ);
+
+    int iteration = 0;
+    h5f.read("iteration", iteration);
+    if ((iteration < 0) || (iteration > (int)max_iterations_)) {
+        throw EXCEPT("Invalid iteration in checkpoint file.");
+    }
+
+    VecF keff;
+    h5f.read("k", keff);
+    if (keff.size() != 2) {
+        throw EXCEPT("Malformed eigenvalue in checkpoint file.");
+    }
+    keff_      = keff[0];
+    keff_prev_ = keff[1];
+
+    h5f.read_1d("fission_source", fission_source_);
+
+    {
+        VecF k;
+        VecF error_k;
+        VecF error_psi;
+        auto g = h5f["convergence"];
+        g.read("k", k);
+        g.read("error_k", error_k);
+        g.read("error_psi", error_psi);
+        g.read("iteration_time", iteration_times_);
+        if ((error_k.size() != k.size()) || (error_psi.size() != k.size())) {
+            throw EXCEPT("Malformed convergence history in checkpoint file.");
+        }
+        convergence_.clear();
+        for (unsigned i = 0; i < k.size(); i++) {
+            convergence_.push_back(
+                ConvergenceCriteria(k[i], error_k[i], error_psi[i]));
+        }
+        dominance_ratio_.assign(k.size(), 0.0);
+    }
+
+    {
+        auto g = h5f["sweeper"];
+        fss_.sweeper()->read_checkpoint(g);
+    }
+
+    if (cmfd_) {
+        auto g = h5f["cmfd"];
+        cmfd_->coarse_data().read_checkpoint(g);
+    }
+
+    return iteration;
+}
+
+void EigenSolver::warm_start()
+{
+    LogScreen << "Warm-starting from " << warm_start_file_ << std::endl;
+
+    H5Node h5f(warm_start_file_, H5Access::READ);
+    TransportSweeper *sweeper = fss_.sweeper();
+
+    // Checkpoints store the current eigenvalue first, while regular output
+    // stores the whole convergence history.
+    VecF k;
+    if (h5f.exists("k")) {
+        h5f.read("k", k);
+    } else if (h5f.exists("convergence/k")) {
+        h5f.read("convergence/k", k);
+        std::reverse(k.begin(), k.end());
+    }
+    if (!k.empty()) {
+        keff_      = k.front();
+        keff_prev_ = keff_;
+    } else {
+        Warn("No eigenvalue in warm-start file. Starting from k = 1.");
+    }
+
+    // Try the fine-mesh state first. This only works if the regions, and
+    // for some sweepers the boundary conditions, match exactly.
+    bool fine = false;
+    if (h5f.exists("sweeper")) {
+        try {
+            auto g = h5f["sweeper"];
+            sweeper->read_checkpoint(g);
+            fine = true;
+            LogFile << "Warm start using the fine-mesh flux" << std::endl;
+        } catch (Exception e) {
+            LogFile << "Warm-start fine-mesh state does not match: "
+                    << e.what() << std::endl;
+        }
+    }
+
+    if (!fine) {
+        // 2-D/3-D output puts the MoC flux in its own group
+        std::string path = h5f.exists("flux") ? "flux" : "MoC/flux";
+        if (!h5f.exists(path)) {
+            throw EXCEPT("No flux found in warm-start file.");
+        }
+        auto g = h5f[path];
+
+        ArrayB2 pin_flux(sweeper->mesh().n_pin(), sweeper->n_group());
+        for (int ig = 0; ig < sweeper->n_group(); ig++) {
+            std::stringstream setname;
+            setname << std::setfill('0') << std::setw(3) << ig + 1;
+            if (!g.exists(setname.str())) {
+                throw EXCEPT("Warm-start flux has too few groups.");
+            }
+            ArrayB1 flux_1g(pin_flux.extent(0));
+            try {
+                g.read_1d(setname.str(), flux_1g);
+            } catch (Exception e) {
+                throw EXCEPT_E("Warm-start flux does not match the pin mesh",
+                               e);
+            }
+            pin_flux(blitz::Range::all(), ig) = flux_1g;
+        }
+        this->project_pin_flux(pin_flux);
+        LogFile << "Warm start using the pin-homogenized flux" << std::endl;
+    }
+
+    if (cmfd_ && h5f.exists("cmfd")) {
+        try {
+            auto g = h5f["cmfd"];
+            cmfd_->coarse_data().read_checkpoint(g);
+        } catch (Exception e) {
+            Warn("Warm-start CMFD data does not match. Ignoring it.");
+        }
+    }
+
+    return;
+}
+
+void EigenSolver::continuation()
+{
+    LogScreen << "Converging the continuation solver" << std::endl;
+    coarse_->solve();
+    n_coarse_iterations_ = coarse_->convergence_.size();
+
+    keff_      = coarse_->keff_;
+    keff_prev_ = keff_;
+
+    this->project_pin_flux(
+        coarse_->sweeper()->get_pin_flux(MeshTreatment::PIN));
+
+    // The coarse mesh currents only depend on the pin mesh, so they carry
+    // over directly
+    if (cmfd_ && coarse_->cmfd_) {
+        cmfd_->coarse_data().assign(coarse_->cmfd_->coarse_data());
+    }
+
+    LogScreen << "Continuing on the full discretization, after "
+              << n_coarse_iterations_ << " coarse outer iterations"
+              << std::endl;
+
+    coarse_.reset();
+    release_free_memory();
+
+    return;
+}
+
+void EigenSolver::project_pin_flux(const ArrayB2 &pin_flux)
+{
+    TransportSweeper *sweeper = fss_.sweeper();
+
+    ArrayB2 guess = sweeper->get_pin_flux(MeshTreatment::PIN);
+    if ((pin_flux.extent(0) != guess.extent(0)) ||
+        (pin_flux.extent(1) != guess.extent(1))) {
+        throw EXCEPT("Projected flux does not match the pin mesh");
+    }
+    real_t total = blitz::sum(pin_flux);
+    real_t scale = (total > 0.0) ? blitz::sum(guess) / total : 1.0;
+    ArrayB2 scaled(guess.shape());
+    scaled = pin_flux * scale;
+
+    ArrayB1 spectrum(sweeper->n_group());
+    for (int ig = 0; ig < sweeper->n_group(); ig++) {
+        ArrayB1 flux_1g = scaled(blitz::Range::all(), ig);
+        sweeper->set_pin_flux_1g(ig, flux_1g, MeshTreatment::PIN);
+        spectrum(ig) = blitz::mean(flux_1g);
+    }
+    sweeper->initialize_boundary(spectrum);
+
+    return;
+}
+
 void EigenSolver::output(H5Node &file) const
 {
     VecF k;
@@ -312,6 +866,7 @@ void EigenSolver::output(H5Node &file) const
         g.write("error_psi", error_psi, dims);
         g.write("iteration_time", iteration_times_);
         g.write("abscissae", iteration_times_);
+        g.write("dominance_ratio", dominance_ratio_);
     }
 
     fss_.output(file);
@@ -321,6 +876,50 @@ void EigenSolver::output(H5Node &file) const
     return;
 }
 
+void EigenSolver::output_performance(H5Node &node) const
+{
+    node.write("outer_iterations", (int)convergence_.size());
+    if (n_coarse_iterations_ > 0) {
+        node.write("continuation_outer_iterations", n_coarse_iterations_);
+    }
+
+    fss_.output_performance(node);
+    if (cmfd_) {
+        auto g = node.create_group("cmfd");
+        cmfd_->output_performance(g);
+    }
+    return;
+}
+
+void EigenSolver::compact()
+{
+    fss_.compact();
+    if (coarse_) {
+        coarse_->compact();
+    }
+    return;
+}
+
+void EigenSolver::memory(MemoryReport &report) const
+{
+    report.add("fission_source", bytes(fission_source_) +
+                                     bytes(fission_source_prev_) +
+                                     bytes(fission_source_ext_));
+
+    fss_.memory(report);
+    if (cmfd_) {
+        cmfd_->memory(report.child("cmfd"));
+    }
+    if (sweep_data_) {
+        report.add("lagged_coarse_data",
+                   sweep_data_->memory() + bytes(lag_flux_));
+    }
+    if (coarse_) {
+        coarse_->memory(report.child("continuation"));
+    }
+    return;
+}
+
 std::ostream &operator<<(std::ostream &os, ConvergenceCriteria conv)
 {
     std::ios::fmtflags flags = os.flags();
@@ -17,21 +17,19 @@
 #pragma once
 
 #include <iosfwd>
+#include <memory>
 #include "util/h5file.hpp"
 #include "util/pugifwd.hpp"
 #include "core/cmfd.hpp"
 #include "core/core_mesh.hpp"
 #include "core/eigen_interface.hpp"
 #include "core/transport_sweeper.hpp"
+#include "checkpoint.hpp"
+#include "fission_source_accelerator.hpp"
 #include "fixed_source_solver.hpp"
 #include "solver.hpp"
 
 namespace mocc {
-enum class CMFDConvergence {
-    FIXED, // Converge the cmfd to a fixed set of convergence criteria
-    FLOAT
-};
-
 struct ConvergenceCriteria {
     ConvergenceCriteria(real_t k, real_t error_k, real_t error_psi)
         : k(k), error_k(error_k), error_psi(error_psi)
@@ -49,6 +47,18 @@ class EigenSolver : public Solver {
 public:
     EigenSolver(const pugi::xml_node &input, const CoreMesh &mesh);
     void solve();
+
+    /**
+     * \brief Perform a single outer iteration: a CMFD solve, if enabled,
+     * followed by a transport step of the \ref FixedSourceSolver
+     *
+     * Normally the sweeps wait for the CMFD solve, since every group's
+     * source depends on its result through the fission source and the
+     * scaled flux. With \c cmfd_lag, the solve instead runs alongside the
+     * sweep, on the coarse data of the previous outer iteration, and its
+     * result is applied at the start of the next one. See \ref
+     * start_lagged_cmfd() and \ref apply_lagged_cmfd().
+     */
     void step();
 
     const TransportSweeper *sweeper() const
@@ -56,9 +66,52 @@ public:
         return fss_.sweeper();
     }
 
+    /**
+     * \brief Return the current estimate of the system eigenvalue
+     */
+    real_t keff() const
+    {
+        return keff_;
+    }
+
+    /**
+     * \brief Set whether subsequent calls to \ref solve() start from the
+     * current flux and eigenvalue, rather than re-initializing them
+     *
+     * This is useful when the solver is driven repeatedly with small changes
+     * to the cross sections, as in coupled calculations. The first solve
+     * always starts from the initial guess (or warm start).
+     */
+    void set_continue(bool c)
+    {
+        continue_ = c;
+    }
+
     // Implement the output interface
     void output(H5Node &file) const;
 
+    /**
+     * \copybrief Solver::output_performance()
+     *
+     * Writes the number of outer iterations, followed by the metrics of the
+     * fixed-source solver and, if present, the CMFD solver in the \c cmfd
+     * group.
+     */
+    void output_performance(H5Node &node) const override;
+
+    /**
+     * \copybrief Solver::memory()
+     *
+     * Adds the fission source, then the fixed-source solver and, if present,
+     * the CMFD solver in the \c cmfd child.
+     */
+    void memory(MemoryReport &report) const override;
+
+    /**
+     * \copybrief Solver::compact()
+     */
+    void compact() override;
+
 private:
     // Data
     FixedSourceSolver fss_;
@@ -94,12 +147,65 @@ private:
     // file at the end of the run for posterity
     std::vector<ConvergenceCriteria> convergence_;
 
+    // Estimate of the dominance ratio after each iteration, or zero where
+    // the fission source residuals weren't decaying consistently
+    VecF dominance_ratio_;
+
+    // Whether to stop once the extrapolated solution has converged, and the
+    // number of iterations over which to estimate the dominance ratio
+    bool predict_;
+    int predict_window_;
+
+    // Extrapolated eigenvalue and fission source of the last iteration, if
+    // it had a dominance ratio estimate
+    bool have_extrapolation_;
+    real_t keff_ext_;
+    ArrayB1 fission_source_ext_;
+
     // CMFD accelerator
     UP_CMFD_t cmfd_;
 
+    // Whether the CMFD solve is lagged by an outer iteration, to run
+    // alongside the sweep. The sweeper then tallies into sweep_data_, rather
+    // than the CMFD solver's own coarse data.
+    bool cmfd_lag_;
+    std::unique_ptr<CoarseData> sweep_data_;
+
+    // Whether a lagged CMFD solve has a result to apply, the coarse flux that
+    // it started from and its eigenvalue
+    bool lag_pending_;
+    ArrayB2 lag_flux_;
+    real_t lag_k_;
+
+    // Extrapolation of the fission source between outer iterations
+    FissionSourceAccelerator fs_accel_;
+
     // Vector in indices after which to dump the state of the solver
     VecI dump_iterations_;
 
+    // Whether to write the dumps on a background thread, and their HDF5
+    // compression level
+    bool dump_async_;
+    int dump_compression_;
+
+    // Periodic checkpoints of the solver state, and restart
+    Checkpoint checkpoint_;
+
+    // Previous solution to initialize the flux, k and CMFD data from. Empty
+    // to start from the sweeper's flat guess.
+    std::string warm_start_file_;
+
+    // Whether to start solve() from the current state, and whether there
+    // has been a solve to continue from
+    bool continue_;
+    bool solved_;
+
+    // Solver on a coarser discretization, converged before the first solve
+    // to provide its initial guess, and the number of outer iterations that
+    // it took. It is released once its solution has been projected.
+    std::unique_ptr<EigenSolver> coarse_;
+    int n_coarse_iterations_;
+
     // Vector containing the time that each eigenvalue iteration completed
     // at. Make useful absiccae for convergence plots and the like
     VecF iteration_times_;
@@ -108,9 +214,104 @@ private:
     // Print the current state of the eigenvalue solver
     void print(int iter, ConvergenceCriteria conv);
 
+    /**
+     * \brief Estimate the dominance ratio from the last \c predict_window_
+     * fission source residuals
+     *
+     * Once the higher modes have died out, the residual shrinks by the
+     * dominance ratio each iteration. The estimate is the geometric mean of
+     * the ratios of successive residuals, as long as they are all below one
+     * and agree with each other; otherwise it is zero.
+     */
+    real_t dominance_ratio() const;
+
+    /**
+     * \brief Normalize the current and previous fission sources in place,
+     * as \ref Normalize() does, and return the squared distance between the
+     * first \p n_dist values of the normalized sources
+     *
+     * The sums and the distance take one pass over the sources each.
+     */
+    real_t normalize_fission_sources(int n_dist);
+
+    /**
+     * \brief Richardson-extrapolate the eigenvalue and fission source of
+     * the last iteration with dominance ratio \p rho, and return whether
+     * the extrapolation has converged
+     *
+     * The error of the power iteration is dominated by the first higher
+     * mode, which is removed by adding \f$ \rho / (1 - \rho) \f$ times the
+     * last change of the iterate. The extrapolated solution has converged
+     * when it has changed from that of the previous iteration by less than
+     * the tolerances.
+     */
+    bool extrapolate(real_t rho);
+
     /**
      * \brief Perform a CMFD accelerator solve
      */
     void do_cmfd();
+
+    /**
+     * \brief Rebalance the flux with the result of the last lagged CMFD
+     * solve
+     *
+     * The sweep that ran alongside the solve has since moved the flux on, so
+     * rather than replacing the pin flux, it is scaled by the ratio of the
+     * CMFD flux to the flux that the solve started from. The eigenvalue is
+     * taken from the solve, as in \ref do_cmfd().
+     */
+    void apply_lagged_cmfd();
+
+    /**
+     * \brief Hand the coarse data of the last sweep to the CMFD solver, for
+     * a solve that runs alongside the next one
+     *
+     * The cross sections are homogenized here, since the solve must not read
+     * the sweeper flux while the sweep writes it.
+     */
+    void start_lagged_cmfd();
+
+    /**
+     * \brief Write the state needed to resume the solve to a checkpoint
+     */
+    void write_checkpoint(H5Node &node) const;
+
+    /**
+     * \brief Restore the state of the solver from the restart file, returning
+     * the number of iterations that had been completed
+     */
+    int read_checkpoint();
+
+    /**
+     * \brief Initialize the flux, eigenvalue and CMFD data from a previous
+     * solution
+     *
+     * The file may be a checkpoint or a regular output file. If it contains
+     * the fine-mesh state of a sweeper with the same regions (i.e. a
+     * checkpoint), it is used directly. Otherwise the pin-homogenized flux is
+     * projected onto the sweeper with \ref TransportSweeper::set_pin_flux_1g().
+     */
+    void warm_start();
+
+    /**
+     * \brief Converge the coarse solver and initialize the flux, eigenvalue
+     * and CMFD data from its solution
+     *
+     * The sweepers of the two solvers generally have different angular
+     * quadratures and rays, or are of different types altogether, so their
+     * solutions are only carried over on the pin mesh.
+     */
+    void continuation();
+
+    /**
+     * \brief Project a pin-homogenized flux onto the sweeper, and start its
+     * boundary conditions from the flux spectrum
+     *
+     * The flux is first scaled to the total of the current guess, so that it
+     * stays consistent with any other state (e.g. the CMFD data) that was
+     * initialized with it.
+     */
+    void project_pin_flux(const ArrayB2 &pin_flux);
 };
 }
@@ -0,0 +1,196 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "fission_source_accelerator.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include "pugixml.hpp"
+#include "util/error.hpp"
+#include "util/files.hpp"
+#include "util/string_utils.hpp"
+
+namespace {
+// Number of unaccelerated iterations used to estimate the dominance ratio
+// before applying Chebyshev extrapolation
+const int n_chebyshev_estimate = 3;
+
+// Largest dominance ratio estimate to trust for Chebyshev extrapolation
+const mocc::real_t max_sigma = 0.995;
+}
+
+namespace mocc {
+FissionSourceAccelerator::FissionSourceAccelerator(const pugi::xml_node &input,
+                                                   int n_reg)
+    : type_(Type::NONE),
+      n_reg_(n_reg),
+      depth_(3),
+      sigma_(-1.0),
+      r_norm_prev_(-1.0),
+      n_estimate_(0),
+      n_fallback_(0)
+{
+    if (!input.attribute("acceleration").empty()) {
+        std::string accel = input.attribute("acceleration").value();
+        sanitize(accel);
+        if (accel == "none") {
+            type_ = Type::NONE;
+        } else if (accel == "anderson") {
+            type_ = Type::ANDERSON;
+        } else if (accel == "chebyshev") {
+            type_ = Type::CHEBYSHEV;
+        } else {
+            throw EXCEPT("Unrecognized fission source acceleration: " + accel);
+        }
+    }
+
+    if (!input.attribute("anderson_depth").empty()) {
+        depth_ = input.attribute("anderson_depth").as_int(-1);
+        if (depth_ < 1) {
+            throw EXCEPT("Invalid Anderson depth.");
+        }
+    }
+
+    return;
+}
+
+void FissionSourceAccelerator::reset()
+{
+    x_.clear();
+    g_.clear();
+    r_.clear();
+    k_.clear();
+    sigma_       = -1.0;
+    r_norm_prev_ = -1.0;
+    n_estimate_  = 0;
+    return;
+}
+
+void FissionSourceAccelerator::accelerate(ArrayB1 &fs, real_t k)
+{
+    if (type_ == Type::NONE) {
+        return;
+    }
+
+    assert((int)fs.size() == n_reg_);
+
+    // Watch for the eigenvalue changing direction on consecutive iterations.
+    // The extrapolation is only meaningful while the error is dominated by a
+    // single, slowly-decaying mode; if that stops being the case, start over.
+    k_.push_back(k);
+    if (k_.size() > 3) {
+        k_.pop_front();
+    }
+    if ((k_.size() == 3) && !x_.empty() &&
+        ((k_[2] - k_[1]) * (k_[1] - k_[0]) < 0.0)) {
+        n_fallback_++;
+        LogFile << "Eigenvalue estimate oscillating. Restarting fission "
+                   "source acceleration ("
+                << n_fallback_ << ")" << std::endl;
+        this->reset();
+    }
+
+    VectorX g(n_reg_);
+    for (int i = 0; i < n_reg_; i++) {
+        g[i] = fs(i);
+    }
+
+    if (x_.empty()) {
+        // Nothing to extrapolate from. Use the source as is.
+        x_.push_back(g);
+        return;
+    }
+
+    VectorX r = g - x_.back();
+    VectorX x_new;
+
+    switch (type_) {
+    case Type::ANDERSON: {
+        g_.push_back(g);
+        r_.push_back(r);
+        if ((int)r_.size() > depth_ + 1) {
+            g_.pop_front();
+            r_.pop_front();
+        }
+
+        int m = r_.size() - 1;
+        if (m == 0) {
+            x_new = g;
+            break;
+        }
+
+        MatrixX dr(n_reg_, m);
+        MatrixX dg(n_reg_, m);
+        for (int j = 0; j < m; j++) {
+            dr.col(j) = r_[j + 1] - r_[j];
+            dg.col(j) = g_[j + 1] - g_[j];
+        }
+        VectorX gamma = dr.colPivHouseholderQr().solve(r);
+        x_new         = g - dg * gamma;
+    } break;
+
+    case Type::CHEBYSHEV: {
+        real_t r_norm = r.norm();
+        if (sigma_ < 0.0) {
+            // Still estimating the dominance ratio from the decay of the
+            // unaccelerated residual
+            x_new = g;
+            if (r_norm_prev_ > 0.0) {
+                n_estimate_++;
+                if (n_estimate_ >= n_chebyshev_estimate) {
+                    sigma_ = std::min(r_norm / r_norm_prev_, max_sigma);
+                    LogFile << "Estimated dominance ratio for Chebyshev "
+                               "extrapolation: "
+                            << sigma_ << std::endl;
+                }
+            }
+            r_norm_prev_ = r_norm;
+            break;
+        }
+
+        // The power iteration error modes have eigenvalues in [0, sigma].
+        // Shift them onto [-rho, rho] and apply the asymptotic Chebyshev
+        // parameters.
+        real_t gamma = 2.0 / (2.0 - sigma_);
+        real_t rho   = sigma_ / (2.0 - sigma_);
+        real_t omega = 2.0 / (1.0 + std::sqrt(1.0 - rho * rho));
+
+        const VectorX &x      = x_.back();
+        const VectorX &x_prev = (x_.size() > 1) ? x_.front() : x;
+        x_new = x_prev + omega * (x + gamma * r - x_prev);
+    } break;
+
+    default:
+        x_new = g;
+    }
+
+    // The extrapolation can take the source slightly negative in places with
+    // little fission. Don't let that through to the sweeper.
+    x_new = x_new.cwiseMax(0.0);
+
+    x_.push_back(x_new);
+    if (x_.size() > 2) {
+        x_.pop_front();
+    }
+
+    for (int i = 0; i < n_reg_; i++) {
+        fs(i) = x_new[i];
+    }
+
+    return;
+}
+}
@@ -0,0 +1,95 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <deque>
+#include "util/blitz_typedefs.hpp"
+#include "util/global_config.hpp"
+#include "util/pugifwd.hpp"
+#include "core/eigen_interface.hpp"
+
+namespace mocc {
+/**
+ * \brief Extrapolation of the fission source between eigenvalue iterations
+ *
+ * The power iteration performed by the \ref EigenSolver can be viewed as a
+ * fixed-point iteration \f$ \psi_{n+1} = G(\psi_n) \f$ on the fission source.
+ * This class takes the fission source produced by each outer iteration,
+ * \f$ G(\psi_n) \f$, and replaces it with an extrapolated guess to use as the
+ * source for the next one. Two methods are supported:
+ *  - Anderson mixing, which uses the last few fission source residuals to
+ *    form the combination of previous iterates with the smallest residual.
+ *  - Chebyshev extrapolation, which estimates the dominance ratio from the
+ *    first few unaccelerated iterations and then applies the stationary
+ *    two-term Chebyshev update.
+ *
+ * If the eigenvalue estimate starts to oscillate between iterations, the
+ * history is discarded and the iteration falls back to plain power iteration,
+ * until enough new history is gathered to resume.
+ */
+class FissionSourceAccelerator {
+public:
+    enum class Type { NONE, ANDERSON, CHEBYSHEV };
+
+    /**
+     * \brief Construct from the \<solver\> tag of an \ref EigenSolver
+     */
+    FissionSourceAccelerator(const pugi::xml_node &input, int n_reg);
+
+    /**
+     * \brief Replace the fission source \p fs, which was produced by the last
+     * outer iteration using eigenvalue estimate \p k, with the source to use
+     * for the next outer iteration.
+     */
+    void accelerate(ArrayB1 &fs, real_t k);
+
+    /**
+     * \brief Discard all of the iteration history
+     */
+    void reset();
+
+    bool is_enabled() const
+    {
+        return type_ != Type::NONE;
+    }
+
+private:
+    Type type_;
+    int n_reg_;
+
+    // Number of previous residuals to use for Anderson mixing
+    int depth_;
+
+    // Fission sources handed to the last two outer iterations
+    std::deque<VectorX> x_;
+
+    // Anderson history of fission sources produced by the outer iterations,
+    // and their residuals
+    std::deque<VectorX> g_;
+    std::deque<VectorX> r_;
+
+    // Chebyshev estimate of the dominance ratio. Negative until it has been
+    // estimated.
+    real_t sigma_;
+    real_t r_norm_prev_;
+    int n_estimate_;
+
+    // Recent eigenvalue estimates, used to detect oscillation
+    std::deque<real_t> k_;
+    int n_fallback_;
+};
+}
@@ -16,21 +16,51 @@
 
 #include "fixed_source_solver.hpp"
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <limits>
 #include "pugixml.hpp"
 #include "util/error.hpp"
 #include "util/files.hpp"
 #include "util/h5file.hpp"
+#include "util/profile.hpp"
+#include "util/string_utils.hpp"
+#include "util/validate_input.hpp"
+#include "core/parallel_environment.hpp"
 #include "transport_sweeper_factory.hpp"
 
+namespace {
+const std::vector<std::string> recognized_attributes_adaptive = {
+    "enabled", "tol", "max_skip", "max_extra"};
+const std::vector<std::string> recognized_attributes_thermal = {
+    "first_group", "n_iter", "method"};
+}
+
 namespace mocc {
 FixedSourceSolver::FixedSourceSolver(const pugi::xml_node &input,
                                      const CoreMesh &mesh) try
-    : sweeper_(UP_Sweeper_t(TransportSweeperFactory(input, mesh))),
+    : timer_source_(RootTimer.new_timer("Source Construction")),
+      sweeper_(UP_Sweeper_t(TransportSweeperFactory(input, mesh))),
       source_(sweeper_->create_source(input.child("source"))),
       fs_(nullptr),
       ng_(sweeper_->n_group()),
-      fixed_source_(false) {
+      fixed_source_(false),
+      adaptive_(false),
+      group_tol_(1.0e-4),
+      max_skip_(2),
+      max_extra_(2),
+      first_upscatter_(ng_),
+      group_resid_(ng_, std::numeric_limits<real_t>::max()),
+      n_skipped_(ng_, 0),
+      n_sweeps_(ng_, 0),
+      thermal_first_(ng_),
+      thermal_iter_(1),
+      thermal_cmfd_(false),
+      energy_iteration_(EnergyIteration::GAUSS_SEIDEL),
+      energy_block_(0),
+      scatter_block_(-1),
+      pipeline_(false) {
     LogFile << "Initializing Fixed-Source solver..." << std::endl;
 
     std::string type = input.attribute("type").value();
@@ -64,6 +94,139 @@ FixedSourceSolver::FixedSourceSolver(const pugi::xml_node &input,
                          "source!");
         }
         source_->add_external(input.child("source"));
+
+        // CMFD acceleration
+        if (input.attribute("cmfd").as_bool(false)) {
+            cmfd_.reset(new CMFD(input.child("cmfd"), &mesh,
+                                 sweeper_->get_homogenized_xsmesh()));
+            sweeper_->set_coarse_data(cmfd_->get_data());
+            cmfd_source_.reference(this->coarse_source());
+            LogFile << "Using CMFD acceleration" << std::endl;
+        }
+    }
+
+    // Find the first group that receives upscatter from any region
+    for (const auto &xsr : sweeper_->xs_mesh()) {
+        for (int ig = 0; ig < first_upscatter_; ig++) {
+            if (xsr.xsmacsc(ig).max_g > ig) {
+                first_upscatter_ = ig;
+                break;
+            }
+        }
+    }
+
+    // Adaptive inner iterations
+    if (!input.child("adaptive_inner").empty()) {
+        auto adapt_in = input.child("adaptive_inner");
+        validate_input(adapt_in, recognized_attributes_adaptive);
+        adaptive_ = adapt_in.attribute("enabled").as_bool(true);
+
+        group_tol_ = adapt_in.attribute("tol").as_float(group_tol_);
+        if (group_tol_ <= 0.0) {
+            throw EXCEPT("Invalid adaptive inner tolerance.");
+        }
+        max_skip_ = adapt_in.attribute("max_skip").as_int(max_skip_);
+        if (max_skip_ < 0) {
+            throw EXCEPT("Invalid maximum number of skipped sweeps.");
+        }
+        max_extra_ = adapt_in.attribute("max_extra").as_int(max_extra_);
+        if (max_extra_ < 0) {
+            throw EXCEPT("Invalid maximum number of extra sweeps.");
+        }
+
+        if (adaptive_) {
+            LogFile << "Using adaptive inner iterations. Tolerance: "
+                    << group_tol_ << ", max skipped: " << max_skip_
+                    << ", max extra: " << max_extra_
+                    << ", first upscatter group: " << first_upscatter_
+                    << std::endl;
+        }
+    }
+
+    // Thermal block iteration
+    if (!input.child("thermal_block").empty()) {
+        auto thermal_in = input.child("thermal_block");
+        validate_input(thermal_in, recognized_attributes_thermal);
+        if (adaptive_) {
+            throw EXCEPT("Thermal block iteration and adaptive inner "
+                         "iterations are exclusive.");
+        }
+
+        int first = thermal_in.attribute("first_group").as_int(
+            first_upscatter_);
+        if ((first < 0) || (first > (int)ng_)) {
+            throw EXCEPT("Invalid first group of the thermal block.");
+        }
+        // Some sweepers only sweep whole blocks of groups
+        int block      = sweeper_->group_block();
+        thermal_first_ = (first / block) * block;
+
+        thermal_iter_ = thermal_in.attribute("n_iter").as_int(3);
+        if (thermal_iter_ < 1) {
+            throw EXCEPT("Invalid number of thermal block iterations.");
+        }
+
+        std::string method = thermal_in.attribute("method").value();
+        sanitize(method);
+        if (method == "cmfd") {
+            if (!cmfd_) {
+                throw EXCEPT("CMFD thermal block iteration needs a "
+                             "stand-alone fixed-source solver with CMFD.");
+            }
+            thermal_cmfd_ = true;
+        } else if (!(method.empty() || (method == "sweep"))) {
+            throw EXCEPT("Unrecognized thermal block iteration method.");
+        }
+
+        if (thermal_first_ < (int)ng_) {
+            LogFile << "Iterating groups " << thermal_first_ << " to "
+                    << ng_ - 1 << " " << thermal_iter_ << " times per outer"
+                    << (thermal_cmfd_ ? ", with CMFD" : "") << std::endl;
+        }
+    }
+
+    // Energy iteration
+    if (!input.attribute("energy_iteration").empty()) {
+        std::string in_str = input.attribute("energy_iteration").value();
+        sanitize(in_str);
+        if (in_str == "gauss_seidel") {
+            energy_iteration_ = EnergyIteration::GAUSS_SEIDEL;
+        } else if (in_str == "jacobi") {
+            energy_iteration_ = EnergyIteration::JACOBI;
+            energy_block_     = ng_;
+        } else if (in_str == "hybrid") {
+            energy_iteration_ = EnergyIteration::HYBRID;
+            energy_block_     = input.attribute("energy_block")
+                                .as_int(sweeper_->group_block());
+            if ((energy_block_ < 1) || (energy_block_ > (int)ng_)) {
+                throw EXCEPT("Invalid energy block size.");
+            }
+        } else {
+            throw EXCEPT("Unrecognized energy iteration option.");
+        }
+    }
+    if (energy_iteration_ != EnergyIteration::GAUSS_SEIDEL) {
+        scatter_flux_.resize(sweeper_->flux().shape());
+        LogFile << "Using Jacobi in-scatter over blocks of " << energy_block_
+                << " groups" << std::endl;
+    }
+
+    // Source pipelining
+    pipeline_ = input.attribute("pipeline_source").as_bool(false);
+    if (pipeline_) {
+        if (energy_iteration_ != EnergyIteration::GAUSS_SEIDEL) {
+            throw EXCEPT("Source pipelining needs Gauss-Seidel energy "
+                         "iterations.");
+        }
+        if (!source_->can_prepare_next() || (sweeper_->group_block() > 1)) {
+            Warn("This sweeper does not support source pipelining");
+            pipeline_ = false;
+        } else if (adaptive_) {
+            Warn("Sources are not pipelined with adaptive inner iterations");
+            pipeline_ = false;
+        } else {
+            LogFile << "Building group sources while sweeping" << std::endl;
+        }
     }
 
     sweeper_->assign_source(source_.get());
@@ -82,6 +245,9 @@ void FixedSourceSolver::solve()
     real_t resid = 0.0;
     for (size_t iouter = 0; iouter < max_iter_; iouter++) {
         this->step();
+        if (cmfd_ && cmfd_->is_enabled()) {
+            this->do_cmfd();
+        }
 
         resid = sweeper_->flux_residual();
         LogScreen << iouter << " " << std::setprecision(15) << resid << std::endl;
@@ -101,19 +267,267 @@ void FixedSourceSolver::solve()
 // Perform a single group sweep
 void FixedSourceSolver::step()
 {
+    // Pick up any materials that have been replaced since the last step
+    if (sweeper_->xs_mesh().materials_changed()) {
+        ThreadTeam team(Phase::PROJECTION);
+        sweeper_->get_xs_mesh()->update();
+    }
+
     // Tell the sweeper to stash its old flux
     sweeper_->store_old_flux();
-    for (size_t ig = 0; ig < ng_; ig++) {
-        // Set up the source
-        source_->initialize_group(ig);
-        if (fs_) {
-            source_->fission(*fs_, ig);
+    scatter_block_ = -1;
+
+    if (!adaptive_) {
+        if (pipeline_) {
+            this->sweep_pipelined(0, thermal_first_ - 1);
+        } else {
+            for (int ig = 0; ig < thermal_first_; ig++) {
+                this->sweep_group(ig);
+            }
+        }
+        for (int iter = 0; iter < thermal_iter_; iter++) {
+            if (iter > 0) {
+                scatter_block_ = -1;
+            }
+            if (pipeline_) {
+                this->sweep_pipelined(thermal_first_, ng_ - 1);
+            } else {
+                for (int ig = thermal_first_; ig < (int)ng_; ig++) {
+                    this->sweep_group(ig);
+                }
+            }
+            if (thermal_cmfd_ && (thermal_first_ < (int)ng_)) {
+                this->do_cmfd(thermal_first_);
+            }
+        }
+        return;
+    }
+
+    // Some sweepers only sweep whole blocks of groups, so make the skipping
+    // decisions a block at a time
+    int ng    = ng_;
+    int block = sweeper_->group_block();
+    for (int g_first = 0; g_first < ng; g_first += block) {
+        int g_last = std::min(g_first + block, ng) - 1;
+
+        bool skip = true;
+        for (int ig = g_first; ig <= g_last; ig++) {
+            skip = skip && (group_resid_[ig] < group_tol_) &&
+                   (n_skipped_[ig] < max_skip_);
+        }
+
+        if (skip) {
+            for (int ig = g_first; ig <= g_last; ig++) {
+                n_skipped_[ig]++;
+            }
+        } else {
+            this->sweep_groups(g_first, g_last);
+        }
+    }
+
+    // Keep sweeping the upscatter groups while their flux is still changing
+    if (first_upscatter_ < ng) {
+        int g_stt = (first_upscatter_ / block) * block;
+        for (int extra = 0; extra < max_extra_; extra++) {
+            real_t resid = *std::max_element(group_resid_.begin() + g_stt,
+                                             group_resid_.end());
+            if (resid < group_tol_) {
+                break;
+            }
+            scatter_block_ = -1;
+            for (int g_first = g_stt; g_first < ng; g_first += block) {
+                this->sweep_groups(g_first, std::min(g_first + block, ng) - 1);
+            }
+        }
+    }
+
+    LogFile << "Group sweeps:";
+    for (const auto n : n_sweeps_) {
+        LogFile << " " << n;
+    }
+    LogFile << std::endl;
+
+    return;
+}
+
+void FixedSourceSolver::build_source(int group)
+{
+    MOCC_PROFILE_ZONE("Source");
+    ThreadTeam team(Phase::SOURCE);
+    timer_source_.tic();
+    source_->initialize_group(group);
+    if (fs_) {
+        source_->fission(*fs_, group);
+    }
+
+    if (energy_block_ > 0) {
+        // Jacobi-style in-scatter: all groups in a block see the flux as it
+        // was before the first of them was swept
+        int iblock = group / energy_block_;
+        if (iblock != scatter_block_) {
+            scatter_flux_  = sweeper_->flux();
+            scatter_block_ = iblock;
+        }
+        source_->in_scatter(group, scatter_flux_);
+    } else {
+        source_->in_scatter(group);
+    }
+    timer_source_.toc();
+
+    return;
+}
+
+void FixedSourceSolver::sweep_group(int group)
+{
+    MOCC_PROFILE_ZONE("Group");
+
+    this->build_source(group);
+
+    {
+        ThreadTeam team(Phase::SWEEP);
+        sweeper_->sweep(group);
+    }
+    n_sweeps_[group]++;
+
+    return;
+}
+
+void FixedSourceSolver::sweep_pipelined(int g_first, int g_last)
+{
+    if (g_first > g_last) {
+        return;
+    }
+
+    this->build_source(g_first);
+
+    // The sweep and the source each start a parallel region of their own
+    int max_levels = omp_get_max_active_levels();
+    omp_set_max_active_levels(std::max(max_levels, 2));
+
+    for (int ig = g_first; ig <= g_last; ig++) {
+        MOCC_PROFILE_ZONE("Group");
+        bool next = ig < g_last;
+
+#pragma omp parallel sections num_threads(2) if (next)
+        {
+#pragma omp section
+            {
+                ThreadTeam team(Phase::SWEEP);
+                sweeper_->sweep(ig);
+            }
+#pragma omp section
+            {
+                if (next) {
+                    MOCC_PROFILE_ZONE("Source");
+                    ThreadTeam team(Phase::SOURCE);
+                    if (!ParEnv.has_threads(Phase::SOURCE)) {
+                        omp_set_num_threads(1);
+                    }
+                    timer_source_.tic();
+                    source_->prepare_next(ig + 1, fs_, ig);
+                    timer_source_.toc();
+                }
+            }
+        }
+        n_sweeps_[ig]++;
+
+        if (next) {
+            MOCC_PROFILE_ZONE("Source");
+            ThreadTeam team(Phase::SOURCE);
+            timer_source_.tic();
+            source_->use_next(ig + 1, fs_, ig);
+            timer_source_.toc();
         }
+    }
+
+    omp_set_max_active_levels(max_levels);
+    return;
+}
 
-        source_->in_scatter(ig);
+void FixedSourceSolver::sweep_groups(int g_first, int g_last)
+{
+    const ArrayB2 &flux = sweeper_->flux();
+    ArrayB2 flux_prev(flux.extent(0), g_last - g_first + 1);
+    flux_prev = flux(blitz::Range::all(), blitz::Range(g_first, g_last));
+
+    for (int ig = g_first; ig <= g_last; ig++) {
+        this->sweep_group(ig);
+    }
 
-        sweeper_->sweep(ig);
+    for (int ig = g_first; ig <= g_last; ig++) {
+        real_t e    = 0.0;
+        real_t norm = 0.0;
+        for (int i = 0; i < (int)flux.extent(0); i++) {
+            real_t d = flux(i, ig) - flux_prev(i, ig - g_first);
+            e += d * d;
+            norm += flux(i, ig) * flux(i, ig);
+        }
+        group_resid_[ig] = (norm > 0.0) ? std::sqrt(e / norm) : 0.0;
+        n_skipped_[ig]   = 0;
     }
+
+    return;
+}
+
+void FixedSourceSolver::do_cmfd(int g_first)
+{
+    MOCC_PROFILE_ZONE("CMFD");
+    {
+        ThreadTeam team(Phase::PROJECTION);
+        cmfd_->coarse_data().flux =
+            sweeper_->get_pin_flux(MeshTreatment::PIN_PLANE);
+    }
+    cmfd_->solve_fixed_source(cmfd_source_, g_first);
+    ThreadTeam team(Phase::PROJECTION);
+    sweeper_->set_pin_flux(cmfd_->flux(), MeshTreatment::PIN_PLANE);
+    return;
+}
+
+ArrayB2 FixedSourceSolver::coarse_source()
+{
+    const CoreMesh &mesh = sweeper_->mesh();
+    const VecF &vol      = sweeper_->volumes();
+    const VecF cell_vol  = mesh.volumes(MeshTreatment::PIN_PLANE);
+    const int nxy        = mesh.nx() * mesh.ny();
+    const int n_reg      = sweeper_->n_reg();
+
+    bool plane = n_reg == (int)mesh.n_reg(MeshTreatment::PLANE);
+    if (!plane && (n_reg != (int)mesh.n_reg(MeshTreatment::PIN))) {
+        throw EXCEPT("Unsupported sweeper mesh for CMFD fixed source");
+    }
+
+    ArrayB2 q(cell_vol.size(), ng_);
+    q = 0.0;
+    for (int ig = 0; ig < (int)ng_; ig++) {
+        source_->initialize_group(ig);
+        const VectorX &q_fine = source_->get();
+        int ireg              = 0;
+        int icell             = 0;
+        for (const auto &mplane : mesh.macroplanes()) {
+            if (plane) {
+                for (auto pin = mplane.begin(); pin != mplane.end(); ++pin) {
+                    for (int i = 0; i < (*pin)->n_reg(); i++) {
+                        q(icell, ig) += q_fine[ireg] * vol[ireg];
+                        ireg++;
+                    }
+                    icell++;
+                }
+            } else {
+                for (int iz = mplane.iz_min; iz <= mplane.iz_max; iz++) {
+                    for (int ixy = 0; ixy < nxy; ixy++) {
+                        ireg = iz * nxy + ixy;
+                        q(icell + ixy, ig) += q_fine[ireg] * vol[ireg];
+                    }
+                }
+                icell += nxy;
+            }
+        }
+        for (int i = 0; i < (int)cell_vol.size(); i++) {
+            q(i, ig) /= cell_vol[i];
+        }
+    }
+
+    return q;
 }
 
 void FixedSourceSolver::output(H5Node &node) const
@@ -123,8 +537,45 @@ void FixedSourceSolver::output(H5Node &node) const
     // sweepers colliding.
     node.write("ng", (int)sweeper_->n_group());
     node.write("eubounds", sweeper_->xs_mesh().eubounds(), VecI(1, ng_));
+    if (adaptive_) {
+        node.write("group_sweeps", VecF(n_sweeps_.begin(), n_sweeps_.end()));
+    }
     
     sweeper_->output(node);                  
+    if (cmfd_) {
+        cmfd_->output(node);
+    }
+    return;
+}
+
+void FixedSourceSolver::output_performance(H5Node &node) const
+{
+    node.write("sweeps_per_group", VecF(n_sweeps_.begin(), n_sweeps_.end()));
+    node.write("source_time", timer_source_.time());
+    if (cmfd_) {
+        auto g = node.create_group("cmfd");
+        cmfd_->output_performance(g);
+    }
+
+    auto g = node.create_group("sweeper");
+    sweeper_->output_performance(g);
+    return;
+}
+
+void FixedSourceSolver::compact()
+{
+    sweeper_->compact();
+    return;
+}
+
+void FixedSourceSolver::memory(MemoryReport &report) const
+{
+    report.add("source", source_->memory() + bytes(scatter_flux_));
+    if (cmfd_) {
+        report.add("cmfd_source", bytes(cmfd_source_));
+        cmfd_->memory(report.child("cmfd"));
+    }
+    sweeper_->memory(report.child("sweeper"));
     return;
 }
 }
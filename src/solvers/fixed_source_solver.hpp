@@ -16,9 +16,11 @@
 
 #pragma once
 
+#include "core/cmfd.hpp"
 #include "core/core_mesh.hpp"
 #include "util/h5file.hpp"
 #include "util/pugifwd.hpp"
+#include "util/timers.hpp"
 #include "core/source.hpp"
 #include "core/transport_sweeper.hpp"
 #include "solver.hpp"
@@ -52,6 +54,30 @@ public:
     /**
     * Instructs the sweeper to store the old value of the flux, then performs a
     * group sweep.
+    *
+    * By default, the in-scatter source for each group uses the latest flux
+    * of every other group (Gauss-Seidel in energy). With Jacobi energy
+    * iterations, the in-scatter source for all groups is built from the flux
+    * of the previous iteration, and with the hybrid scheme, blocks of groups
+    * are treated this way while the blocks themselves are Gauss-Seidel.
+    * Decoupling the groups of a block lets sweepers that sweep several groups
+    * at once (e.g. the multigroup MoC kernel) do so consistently.
+    *
+    * If adaptive inner iterations are enabled, groups whose flux has stopped
+    * changing between sweeps are skipped for up to \c max_skip consecutive
+    * outer iterations, and the groups that receive upscatter are swept up to
+    * \c max_extra additional times until their flux stops changing.
+    *
+    * If a thermal block is specified, the groups below it are swept once,
+    * and the groups of the block are iterated \c n_iter times, each
+    * iteration being either a sweep of the block or a sweep followed by a
+    * CMFD fixed-source solve of just those groups.
+    *
+    * With \c pipeline_source, the source of each group is built while the
+    * group before it is swept (see \ref sweep_pipelined()).
+    *
+    * CMFD acceleration, if enabled, is applied by \ref solve() after each
+    * step.
     */
     void step();
 
@@ -108,7 +134,30 @@ public:
 
     void output(H5Node &node) const;
 
+    /**
+     * \copybrief Solver::output_performance()
+     *
+     * Writes the number of sweeps of each group and the time spent building
+     * group sources, followed by the sweeper's metrics in the \c sweeper
+     * group.
+     */
+    void output_performance(H5Node &node) const override;
+
+    /**
+     * \copybrief Solver::memory()
+     *
+     * Adds the source and the scattering work array, followed by the
+     * sweeper in the \c sweeper child.
+     */
+    void memory(MemoryReport &report) const override;
+
+    /**
+     * \copybrief Solver::compact()
+     */
+    void compact() override;
+
 private:
+    Timer &timer_source_;
     UP_Sweeper_t sweeper_;
     UP_Source_t source_;
     // Pointer to the group-independent fission source. Usually comes from an
@@ -120,5 +169,100 @@ private:
     bool fixed_source_;
     size_t max_iter_;
     real_t flux_tol_;
+
+    // CMFD acceleration of a standalone FS solve, and the external source
+    // homogenized onto the CMFD mesh
+    UP_CMFD_t cmfd_;
+    ArrayB2 cmfd_source_;
+
+    // Adaptive inner iteration control
+    bool adaptive_;
+    // Relative change in a group's flux over a sweep, below which the group
+    // is considered converged
+    real_t group_tol_;
+    // Maximum number of consecutive outer iterations for which a converged
+    // group may be skipped
+    int max_skip_;
+    // Maximum number of additional sweeps of the upscatter groups per outer
+    // iteration
+    int max_extra_;
+    // First group that receives upscatter. ng_ if there is no upscatter.
+    int first_upscatter_;
+    // Relative flux change of each group over its last sweep
+    VecF group_resid_;
+    // Number of consecutive outer iterations each group has been skipped
+    VecI n_skipped_;
+    // Total number of sweeps performed for each group
+    VecI n_sweeps_;
+
+    // Thermal block iteration. The first group of the block (ng_ if there is
+    // no block), the number of times the block is iterated per outer
+    // iteration and whether each iteration is followed by a CMFD solve of
+    // the block.
+    int thermal_first_;
+    int thermal_iter_;
+    bool thermal_cmfd_;
+
+    // Energy iteration scheme
+    enum class EnergyIteration { GAUSS_SEIDEL, JACOBI, HYBRID };
+    EnergyIteration energy_iteration_;
+    // Number of groups whose in-scatter source is built from the same flux.
+    // Zero for Gauss-Seidel.
+    int energy_block_;
+    // Copy of the flux from which the in-scatter source of the current block
+    // is built, and the index of that block. -1 forces a new copy.
+    ArrayB2 scatter_flux_;
+    int scatter_block_;
+
+    // Whether to build the source of the next group while sweeping the
+    // current one
+    bool pipeline_;
+
+    /**
+     * \brief Set up the source for a single group
+     */
+    void build_source(int group);
+
+    /**
+     * \brief Set up the source for a single group and sweep it
+     */
+    void sweep_group(int group);
+
+    /**
+     * \brief Sweep the groups in [g_first, g_last], building the source of
+     * each group while the one before it is swept
+     *
+     * With Gauss-Seidel energy iterations, the only part of the source of
+     * group g+1 that depends on the sweep of group g is the in-scatter from
+     * g. The rest is built by \ref Source::prepare_next() on the \ref
+     * Phase::SOURCE threads (one thread, unless the phase has its own
+     * count), in a nested parallel region alongside the sweep of g. The
+     * in-scatter from g is added once the sweep is done.
+     */
+    void sweep_pipelined(int g_first, int g_last);
+
+    /**
+     * \brief Sweep the groups in [g_first, g_last], updating their residuals
+     * and sweep counts
+     */
+    void sweep_groups(int g_first, int g_last);
+
+    /**
+     * \brief Solve the CMFD fixed-source problem from the current transport
+     * solution and project the result back onto the sweeper flux
+     *
+     * \param g_first the first group to solve for. The CMFD flux of the
+     * groups below it is left as homogenized from the transport solution.
+     */
+    void do_cmfd(int g_first = 0);
+
+    /**
+     * \brief Return the external source, homogenized onto the
+     * \ref MeshTreatment::PIN_PLANE mesh
+     *
+     * This supports sweepers on the \ref MeshTreatment::PLANE and
+     * \ref MeshTreatment::PIN meshes.
+     */
+    ArrayB2 coarse_source();
 };
 }
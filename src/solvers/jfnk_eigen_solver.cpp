@@ -0,0 +1,374 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "jfnk_eigen_solver.hpp"
+
+#include <cmath>
+#include <iomanip>
+#include <limits>
+#include "pugixml.hpp"
+#include "util/error.hpp"
+#include "util/files.hpp"
+#include "util/profile.hpp"
+#include "util/reduction.hpp"
+#include "util/utils.hpp"
+#include "util/validate_input.hpp"
+#include "core/gmres.hpp"
+
+const static int out_w = 14;
+
+namespace {
+const std::vector<std::string> recognized_attributes = {
+    "type",            "cmfd",
+    "k_tol",           "psi_tol",
+    "max_iter",        "power_iter",
+    "krylov_tol",      "krylov_max_iter",
+    "krylov_restart",  "energy_iteration",
+    "energy_block",    "pipeline_source"};
+}
+
+namespace mocc {
+JFNKEigenSolver::JFNKEigenSolver(const pugi::xml_node &input,
+                                 const CoreMesh &mesh)
+    : fss_(input, mesh),
+      fission_source_(fss_.sweeper()->n_reg_fission()),
+      fission_source_prev_(fss_.sweeper()->n_reg_fission()),
+      keff_(1.0),
+      keff_prev_(1.0),
+      power_iterations_(input.attribute("power_iter").as_int(2)),
+      krylov_tol_(input.attribute("krylov_tol").as_float(1.0e-2)),
+      krylov_max_iter_(input.attribute("krylov_max_iter").as_int(10)),
+      krylov_restart_(input.attribute("krylov_restart").as_int(10)),
+      n_iterations_(0),
+      n_evaluations_(0)
+{
+    LogFile << "Initializing JFNK eigenvalue solver..." << std::endl;
+
+    if (input.empty()) {
+        throw EXCEPT("No input specified for the eigenvalue solver.");
+    }
+
+    validate_input(input, recognized_attributes);
+
+    tolerance_k_ = input.attribute("k_tol").as_float(-1.0);
+    if (tolerance_k_ <= 0.0) {
+        throw EXCEPT("Invalid k tolerance.");
+    }
+
+    tolerance_psi_ = input.attribute("psi_tol").as_float(-1.0);
+    if (tolerance_psi_ <= 0.0) {
+        throw EXCEPT("Invalid psi tolerance.");
+    }
+
+    int in_int = input.attribute("max_iter").as_int(-1);
+    if (in_int < 0) {
+        throw EXCEPT("Invalid number of maximum iterations.");
+    }
+    max_iterations_ = in_int;
+
+    if (power_iterations_ < 0) {
+        throw EXCEPT("Invalid number of power iterations.");
+    }
+    if ((krylov_tol_ <= 0.0) || (krylov_tol_ >= 1.0)) {
+        throw EXCEPT("Invalid Krylov tolerance.");
+    }
+    if ((krylov_max_iter_ < 1) || (krylov_restart_ < 1)) {
+        throw EXCEPT("Invalid Krylov iteration limits.");
+    }
+
+    // Count the number of fissile mesh regions
+    n_fissile_regions_ = 0;
+    for (const auto &xsr : fss_.sweeper()->xs_mesh()) {
+        for (int ig = 0; ig < xsr.n_group(); ig++) {
+            if (xsr.xsmacnf(ig) > 0.0) {
+                n_fissile_regions_ += xsr.reg().size();
+                break;
+            }
+        }
+    }
+
+    // CMFD preconditioning
+    if (input.attribute("cmfd").as_bool(false)) {
+        cmfd_.reset(new CMFD(input.child("cmfd"), &mesh,
+                             fss_.sweeper()->get_homogenized_xsmesh()));
+        fss_.sweeper()->set_coarse_data(cmfd_->get_data());
+    }
+
+    // The flux must be contiguous to be treated as a single vector
+    if (!fss_.sweeper()->flux().isStorageContiguous()) {
+        throw EXCEPT("The JFNK solver needs a contiguous sweeper flux.");
+    }
+
+    LogFile << "Done initializing JFNK eigenvalue solver." << std::endl;
+
+    return;
+}
+
+void JFNKEigenSolver::solve()
+{
+    LogScreen << "Converging to: \n"
+                 "\t Eigenvalue: "
+              << tolerance_k_ << "\n"
+              << "\t Fission Source (L-2 norm): " << tolerance_psi_ << "\n"
+              << "\t Max Newton Iterations: " << max_iterations_ << "\n\n";
+
+    keff_      = 1.0;
+    keff_prev_ = 1.0;
+
+    fss_.initialize();
+    fss_.set_fission_source(&fission_source_);
+    lagged_.reset();
+
+    // Start from the initial flux, normalized to unit total fission
+    const ArrayB2 &flux = fss_.sweeper()->flux();
+    phi_                = Eigen::Map<const VectorX>(flux.data(), flux.size());
+    phi_ /= fss_.sweeper()->total_fission(false);
+    g_phi_.resize(phi_.size());
+
+    LogScreen << std::setw(out_w) << "Time" << std::setw(out_w) << "Iter."
+              << std::setw(out_w) << "k" << std::setw(out_w) << "k error"
+              << std::setw(out_w) << "psi error" << std::setw(out_w)
+              << "evaluations" << std::endl;
+
+    for (unsigned iter = 0; iter < max_iterations_; iter++) {
+        this->step();
+
+        convergence_.push_back(
+            ConvergenceCriteria(keff_, error_k_, error_psi_));
+        iteration_times_.push_back(RootTimer.time());
+
+        LogScreen << std::setw(out_w) << std::fixed << std::setprecision(5)
+                  << RootTimer.time() << std::setw(out_w) << iter + 1
+                  << convergence_.back() << std::setw(out_w)
+                  << n_evaluations_ << std::endl;
+
+        if (keff_ != keff_) {
+            throw EXCEPT("Eigenvalue is not a number. Giving up.");
+        }
+
+        if ((error_k_ < tolerance_k_) && (error_psi_ < tolerance_psi_)) {
+            LogScreen << "Convergence criteria satisfied!" << std::endl;
+            break;
+        }
+
+        if (iter == max_iterations_ - 1) {
+            LogScreen << "Maximum number of iterations reached!" << std::endl;
+        }
+    }
+
+    return;
+}
+
+void JFNKEigenSolver::step()
+{
+    MOCC_PROFILE_ZONE("Newton");
+
+    bool newton = n_iterations_ >= power_iterations_;
+    n_iterations_++;
+
+    // Hold the boundary flux and CMFD data fixed for this iteration
+    if (newton) {
+        this->save_lagged();
+    } else {
+        lagged_.reset();
+    }
+
+    keff_prev_ = keff_;
+    keff_      = this->evaluate(phi_, g_phi_);
+    error_k_   = std::abs(keff_ - keff_prev_);
+
+    // Compare the fission source distributions of the iterate and its
+    // image, as the power iteration does. This leaves G(phi) in the sweeper,
+    // which is the best estimate of the solution if we stop here.
+    TransportSweeper *sweeper = fss_.sweeper();
+    this->set_flux(phi_);
+    sweeper->calc_fission_source(keff_, fission_source_prev_);
+    this->set_flux(g_phi_);
+    sweeper->calc_fission_source(keff_, fission_source_);
+    Normalize(fission_source_prev_.begin(), fission_source_prev_.end());
+    Normalize(fission_source_.begin(), fission_source_.end());
+    real_t efis = squared_distance(fission_source_.data(),
+                                   fission_source_prev_.data(),
+                                   (int)fission_source_.size());
+    error_psi_  = std::sqrt(efis / n_fissile_regions_);
+
+    if ((error_k_ < tolerance_k_) && (error_psi_ < tolerance_psi_)) {
+        return;
+    }
+
+    if (!newton) {
+        phi_ = g_phi_;
+        return;
+    }
+
+    // Solve (I - G')*d = G(phi) - phi, approximating the action of G' by
+    // finite differences
+    const VectorX r  = g_phi_ - phi_;
+    const VectorX &g0 = g_phi_;
+    const real_t eps_base =
+        std::sqrt(std::numeric_limits<real_t>::epsilon()) *
+        (1.0 + phi_.norm());
+    VectorX phi_eps(phi_.size());
+    auto op = [&](const VectorX &v, VectorX &y) {
+        real_t v_norm = v.norm();
+        if (v_norm == 0.0) {
+            y.setZero();
+            return;
+        }
+        real_t eps = eps_base / v_norm;
+        phi_eps    = phi_ + eps * v;
+        this->evaluate(phi_eps, y);
+        y = v - (y - g0) / eps;
+    };
+
+    VectorX d = VectorX::Zero(phi_.size());
+    int n_op  = gmres(op, r, d, krylov_tol_, krylov_max_iter_,
+                     krylov_restart_);
+    LogFile << "Newton step took " << n_op << " Krylov iterations"
+            << std::endl;
+
+    phi_ += d;
+
+    // The Krylov iterations leave the sweeper flux on a perturbed iterate
+    this->set_flux(phi_);
+
+    return;
+}
+
+real_t JFNKEigenSolver::evaluate(const VectorX &phi, VectorX &g)
+{
+    TransportSweeper *sweeper = fss_.sweeper();
+
+    if (lagged_) {
+        auto sweeper_node = (*lagged_)["sweeper"];
+        sweeper->read_checkpoint(sweeper_node);
+        if (cmfd_) {
+            auto cmfd_node = (*lagged_)["cmfd"];
+            cmfd_->coarse_data().read_checkpoint(cmfd_node);
+        }
+    }
+    this->set_flux(phi);
+
+    real_t k = keff_;
+    if (cmfd_ && cmfd_->is_enabled()) {
+        cmfd_->coarse_data().flux =
+            sweeper->get_pin_flux(MeshTreatment::PIN_PLANE);
+        cmfd_->solve(k);
+        sweeper->set_pin_flux(cmfd_->flux(), MeshTreatment::PIN_PLANE);
+    }
+
+    sweeper->calc_fission_source(k, fission_source_);
+    fss_.step();
+
+    real_t tfis = sweeper->total_fission(false);
+    k           = k * tfis / sweeper->total_fission(true);
+
+    const ArrayB2 &flux = sweeper->flux();
+    g = Eigen::Map<const VectorX>(flux.data(), flux.size()) / tfis;
+
+    n_evaluations_++;
+    return k;
+}
+
+void JFNKEigenSolver::save_lagged()
+{
+    // Close the previous copy first, since both would have the same name
+    lagged_.reset();
+    lagged_.reset(new H5Node("jfnk_lagged.h5", H5Access::MEMORY));
+
+    auto sweeper_node = lagged_->create_group("sweeper");
+    fss_.sweeper()->write_checkpoint(sweeper_node);
+    if (cmfd_) {
+        auto cmfd_node = lagged_->create_group("cmfd");
+        cmfd_->coarse_data().write_checkpoint(cmfd_node);
+    }
+    return;
+}
+
+void JFNKEigenSolver::set_flux(const VectorX &phi)
+{
+    ArrayB2 &flux = fss_.sweeper()->flux();
+    assert((int)flux.size() == phi.size());
+    Eigen::Map<VectorX>(flux.data(), flux.size()) = phi;
+    return;
+}
+
+void JFNKEigenSolver::output(H5Node &file) const
+{
+    VecF k;
+    VecF error_k;
+    VecF error_psi;
+    for (auto &c : convergence_) {
+        k.push_back(c.k);
+        error_k.push_back(c.error_k);
+        error_psi.push_back(c.error_psi);
+    }
+
+    // Newton iterations are numbered from 1, as on the screen
+    VecI iterations;
+    for (int i = 0; i < (int)convergence_.size(); i++) {
+        iterations.push_back(i + 1);
+    }
+
+    VecI dims(1, convergence_.size());
+    {
+        auto g = file.create_group("convergence");
+        g.write("k", k, dims);
+        g.write("error_k", error_k, dims);
+        g.write("error_psi", error_psi, dims);
+        g.write("iteration_time", iteration_times_);
+        g.write("abscissae", iterations, dims);
+    }
+
+    fss_.output(file);
+    if (cmfd_) {
+        cmfd_->output(file);
+    }
+    return;
+}
+
+void JFNKEigenSolver::output_performance(H5Node &node) const
+{
+    node.write("newton_iterations", n_iterations_);
+    node.write("evaluations", n_evaluations_);
+
+    fss_.output_performance(node);
+    if (cmfd_) {
+        auto g = node.create_group("cmfd");
+        cmfd_->output_performance(g);
+    }
+    return;
+}
+
+void JFNKEigenSolver::compact()
+{
+    fss_.compact();
+    return;
+}
+
+void JFNKEigenSolver::memory(MemoryReport &report) const
+{
+    report.add("fission_source",
+               bytes(fission_source_) + bytes(fission_source_prev_));
+    report.add("newton", (phi_.size() + g_phi_.size()) * sizeof(real_t));
+
+    fss_.memory(report);
+    if (cmfd_) {
+        cmfd_->memory(report.child("cmfd"));
+    }
+    return;
+}
+}
@@ -0,0 +1,168 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "util/h5file.hpp"
+#include "util/pugifwd.hpp"
+#include "core/cmfd.hpp"
+#include "core/core_mesh.hpp"
+#include "core/eigen_interface.hpp"
+#include "core/transport_sweeper.hpp"
+#include "eigen_solver.hpp"
+#include "fixed_source_solver.hpp"
+#include "solver.hpp"
+
+namespace mocc {
+/**
+ * \brief Jacobian-free Newton-Krylov eigenvalue solver
+ *
+ * The unknown is the fine-mesh multi-group scalar flux, and the nonlinear
+ * residual is \f$ F(\phi) = G(\phi) - \phi \f$, where \f$ G \f$ is one
+ * power iteration: a CMFD eigenvalue solve projected onto the flux (if CMFD
+ * is enabled), followed by a transport sweep of all groups, with the result
+ * normalized to unit total fission. CMFD therefore acts as a nonlinear
+ * preconditioner, and the eigenvalue is a by-product of \f$ G \f$. Each
+ * Newton step is solved with restarted GMRES, using finite differences of
+ * \f$ G \f$ for the Jacobian-vector products, so that every Krylov
+ * iteration costs one CMFD solve and one transport sweep.
+ *
+ * The incoming boundary flux and the CMFD currents are not part of the
+ * unknown. They are saved before each Newton iteration and restored before
+ * every evaluation of \f$ G \f$ within it, so that the finite differences
+ * are taken of a single map, and refreshed from the latest evaluation for
+ * the next Newton iteration.
+ */
+class JFNKEigenSolver : public Solver {
+public:
+    JFNKEigenSolver(const pugi::xml_node &input, const CoreMesh &mesh);
+
+    void solve() override;
+
+    /**
+     * \brief Perform a single Newton iteration
+     *
+     * The first \c power_iter iterations are plain power iterations, to get
+     * the Newton iteration going from a reasonable flux.
+     */
+    void step() override;
+
+    const TransportSweeper *sweeper() const override
+    {
+        return fss_.sweeper();
+    }
+
+    /**
+     * \brief Return the current estimate of the system eigenvalue
+     */
+    real_t keff() const
+    {
+        return keff_;
+    }
+
+    void output(H5Node &file) const override;
+
+    /**
+     * \copybrief Solver::output_performance()
+     *
+     * Writes the number of Newton iterations and evaluations of the power
+     * iteration map, followed by the metrics of the fixed-source solver and,
+     * if present, the CMFD solver in the \c cmfd group.
+     */
+    void output_performance(H5Node &node) const override;
+
+    /**
+     * \copybrief Solver::memory()
+     *
+     * Adds the Newton iterate and work vectors, then the fixed-source solver
+     * and, if present, the CMFD solver in the \c cmfd child.
+     */
+    void memory(MemoryReport &report) const override;
+
+    /**
+     * \copybrief Solver::compact()
+     */
+    void compact() override;
+
+private:
+    FixedSourceSolver fss_;
+    UP_CMFD_t cmfd_;
+
+    // Fission source handed to the fixed-source solver, and the fission
+    // source of the previous iterate for the convergence check
+    ArrayB1 fission_source_;
+    ArrayB1 fission_source_prev_;
+
+    real_t keff_;
+    real_t keff_prev_;
+
+    real_t tolerance_k_;
+    real_t tolerance_psi_;
+    real_t error_k_;
+    real_t error_psi_;
+    unsigned int max_iterations_;
+    int n_fissile_regions_;
+
+    // Number of power iterations before starting the Newton iterations
+    int power_iterations_;
+
+    // Relative residual to converge each Newton step to, the maximum number
+    // of Krylov iterations per Newton step and the number of Krylov vectors
+    // before a restart
+    real_t krylov_tol_;
+    int krylov_max_iter_;
+    int krylov_restart_;
+
+    // Newton iterate, and the power iteration map of it
+    VectorX phi_;
+    VectorX g_phi_;
+
+    // In-memory copy of the boundary flux and CMFD data that are held fixed
+    // over a Newton iteration
+    std::unique_ptr<H5Node> lagged_;
+
+    // Number of Newton iterations and evaluations of the power iteration map
+    int n_iterations_;
+    int n_evaluations_;
+
+    std::vector<ConvergenceCriteria> convergence_;
+    VecF iteration_times_;
+
+    /**
+     * \brief Evaluate the power iteration map, returning its estimate of the
+     * eigenvalue
+     *
+     * \param [in] phi the flux to start from
+     * \param [out] g the resulting flux, normalized to unit total fission
+     *
+     * The lagged state is restored first, if it has been saved.
+     */
+    real_t evaluate(const VectorX &phi, VectorX &g);
+
+    /**
+     * \brief Save the boundary flux and CMFD data held fixed over a Newton
+     * iteration
+     */
+    void save_lagged();
+
+    /**
+     * \brief Copy a flux vector into the sweeper flux
+     */
+    void set_flux(const VectorX &phi);
+};
+}
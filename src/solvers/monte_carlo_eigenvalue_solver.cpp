@@ -16,12 +16,19 @@
 
 #include "monte_carlo_eigenvalue_solver.hpp"
 
+#include <algorithm>
+#include <cmath>
 #include <iomanip>
+#include <limits>
+#include <sstream>
 #include "pugixml.hpp"
 #include "util/error.hpp"
 #include "util/files.hpp"
+#include "util/string_utils.hpp"
 #include "util/utils.hpp"
+#include "core/parallel_environment.hpp"
 #include "mc/fission_bank.hpp"
+#include "eigen_solver.hpp"
 
 namespace {
 const int WIDTH = 15;
@@ -33,23 +40,34 @@ MonteCarloEigenvalueSolver::MonteCarloEigenvalueSolver(
     const pugi::xml_node &input, const CoreMesh &mesh)
     : mesh_(mesh),
       xs_mesh_(mesh, MeshTreatment::TRUE),
-      pusher_(mesh_, xs_mesh_),
+      pusher_(mesh_, xs_mesh_,
+              input.attribute("sparse_tallies").as_bool(false)),
       n_cycles_(input.attribute("cycles").as_int(-1)),
       n_inactive_cycles_(input.attribute("inactive_cycles").as_int(-1)),
       particles_per_cycle_(input.attribute("particles_per_cycle").as_int(-1)),
       seed_(input.attribute("seed").as_int(1)),
       rng_(seed_),
-      source_bank_(input.child("fission_box"), particles_per_cycle_, mesh,
-                   xs_mesh_, rng_),
+      source_bank_(mesh),
       k_history_tl_(),
       k_history_col_(),
       k_history_analog_(),
       h_history_(),
+      k_eff_(1.0, 0.0),
       k_tally_tl_(),
       k_tally_col_(),
       k_tally_analog_(),
       cycle_(0),
-      dump_sites_(false)
+      dump_sites_(false),
+      comb_(false),
+      sort_sites_(input.attribute("sort_sites").as_bool(false)),
+      entropy_window_(input.attribute("entropy_window").as_int(0)),
+      target_rel_err_(input.attribute("target_rel_err").as_double(0.0)),
+      checkpoint_(input),
+      cmfd_begin_(input.attribute("cmfd_begin").as_int(1)),
+      cmfd_k_(1.0),
+      timer_simulate_(RootTimer.new_timer("Monte Carlo Simulation")),
+      n_particles_(0),
+      n_cycles_run_(0)
 {
     // Check for valid input
     if (input.empty()) {
@@ -57,6 +75,8 @@ MonteCarloEigenvalueSolver::MonteCarloEigenvalueSolver(
                      "be empty.");
     }
 
+    timer_simulate_.enable_counters();
+
     if (seed_ % 2 == 0) {
         throw EXCEPT("The RNG seed should be odd.");
     }
@@ -81,9 +101,146 @@ MonteCarloEigenvalueSolver::MonteCarloEigenvalueSolver(
         Warn("Zero particles per cycle requested. You sure?");
     }
 
+    if (entropy_window_ < 0) {
+        throw EXCEPT("Invalid Shannon entropy window");
+    }
+    if (target_rel_err_ < 0.0) {
+        throw EXCEPT("Invalid target relative error");
+    }
+
+    // Sample the initial fission source, either uniformly in a box or from a
+    // deterministic solution
+    if (!input.child("initial_source").empty()) {
+        this->seed_source(input.child("initial_source"));
+    } else {
+        FissionBank bank(input.child("fission_box"), particles_per_cycle_,
+                         mesh_, xs_mesh_, rng_);
+        source_bank_.swap(bank);
+    }
+
     // Propagate the seed to the pusher
     pusher_.set_seed(seed_);
 
+    // Spatial tallies to score. The eigenvalue tallies are always scored.
+    if (!input.attribute("tallies").empty()) {
+        std::string names = input.attribute("tallies").value();
+        sanitize(names);
+        std::stringstream stream(names);
+        std::string name;
+        unsigned tallies = 0;
+        while (stream >> name) {
+            if (name == "pin_power") {
+                tallies |= TALLY_PIN_POWER;
+            } else if (name == "flux") {
+                tallies |= TALLY_FLUX;
+            } else if (name == "fine_flux") {
+                tallies |= TALLY_FINE_FLUX;
+            } else if (name == "fine_flux_col") {
+                tallies |= TALLY_FINE_FLUX_COL;
+            } else if (name == "all") {
+                tallies |= TALLY_ALL;
+            } else if (name != "k") {
+                throw EXCEPT("Unrecognized Monte Carlo tally: " + name);
+            }
+        }
+        pusher_.set_tallies(tallies);
+    }
+    if ((target_rel_err_ > 0.0) && !(pusher_.tallies() & TALLY_PIN_POWER)) {
+        throw EXCEPT("A target relative error needs the pin power tally");
+    }
+
+    // History- or event-based particle tracking
+    if (!input.attribute("mode").empty()) {
+        std::string mode = input.attribute("mode").value();
+        sanitize(mode);
+        if (mode == "history") {
+            pusher_.set_event_based(false);
+        } else if (mode == "event") {
+            pusher_.set_event_based(true);
+        } else if (mode == "device") {
+#ifndef MOCC_USE_OFFLOAD
+            Warn("Built without offload support. Device events will run on "
+                 "the host.");
+#endif
+            pusher_.set_device_events(true);
+        } else {
+            throw EXCEPT("Unrecognized Monte Carlo tracking mode: " + mode);
+        }
+    }
+
+    // Surface or delta tracking
+    if (!input.attribute("tracking").empty()) {
+        std::string tracking = input.attribute("tracking").value();
+        sanitize(tracking);
+        if (tracking == "delta") {
+            pusher_.set_delta_tracking(true);
+        } else if (tracking != "surface") {
+            throw EXCEPT("Unrecognized Monte Carlo tracking: " + tracking);
+        }
+    }
+
+    // Survival biasing
+    if (input.attribute("implicit_capture").as_bool(false)) {
+        pusher_.set_implicit_capture(
+            true, input.attribute("weight_cutoff").as_double(0.25),
+            input.attribute("weight_survival").as_double(0.5),
+            input.attribute("weight_split").as_double(2.0));
+    }
+
+    // Fission bank resampling between cycles. A bank that is distributed
+    // over several processes can only be combed, so that is the default
+    // there.
+    const bool distributed = ParEnv.n_rank() > 1;
+    comb_                  = distributed;
+    if (!input.attribute("resample").empty()) {
+        std::string resample = input.attribute("resample").value();
+        sanitize(resample);
+        if (resample == "comb") {
+            comb_ = true;
+        } else if (resample == "random") {
+            if (distributed) {
+                throw EXCEPT("Random fission bank resampling is not "
+                             "supported on multiple processes");
+            }
+            comb_ = false;
+        } else {
+            throw EXCEPT("Unrecognized fission bank resampling: " + resample);
+        }
+    }
+
+    // Share the histories of each cycle over the processes. Every process
+    // has sampled the same initial source, and keeps its own share of it.
+    if (distributed) {
+        if (checkpoint_.enabled() || checkpoint_.restart()) {
+            throw EXCEPT("Monte Carlo checkpoints are not supported on "
+                         "multiple processes");
+        }
+        source_bank_.distribute();
+        pusher_.set_distributed(true);
+    }
+
+    // CMFD acceleration of the fission source. The homogenized cross
+    // sections must be associated with the fine flux before the CMFD object
+    // makes its own copy of them.
+    if (input.attribute("cmfd").as_bool(false)) {
+        if (cmfd_begin_ < 1) {
+            throw EXCEPT("CMFD must begin after at least one inactive cycle");
+        }
+        unsigned needed = TALLY_FLUX | TALLY_FINE_FLUX;
+        if ((pusher_.tallies() & needed) != needed) {
+            throw EXCEPT("CMFD needs the flux and fine_flux tallies");
+        }
+        cmfd_fine_flux_.resize(mesh_.n_reg(MeshTreatment::PLANE),
+                               xs_mesh_.n_group());
+        cmfd_fine_flux_ = 1.0;
+        cmfd_xsmesh_    = std::make_shared<XSMeshHomogenized>(mesh_);
+        cmfd_xsmesh_->set_flux(cmfd_fine_flux_);
+        cmfd_.reset(new CMFD(input.child("cmfd"), &mesh_, cmfd_xsmesh_));
+        cmfd_->coarse_data().set_has_radial_data(true);
+        cmfd_->coarse_data().set_has_axial_data(true);
+        pusher_.set_current_tallies(true);
+    }
+
     return;
 }
 /**
@@ -104,12 +261,34 @@ void MonteCarloEigenvalueSolver::solve()
     LogScreen << std::setw(15) << "Mean (analog)";
     LogScreen << std::endl;
     active_cycle_ = false;
-    for (int i = 0; i < n_inactive_cycles_; i++) {
+    // The inactive cycles don't need the spatial tallies, unless CMFD is
+    // rebalancing the source with them
+    pusher_.set_active(cmfd_ != nullptr);
+    int start_cycle = 0;
+    if (checkpoint_.restart()) {
+        start_cycle = this->read_checkpoint();
+        cycle_ += start_cycle;
+        LogScreen << "Resuming from inactive cycle " << start_cycle << " of "
+                  << checkpoint_.restart_file() << std::endl;
+    }
+    for (int i = start_cycle; i < n_inactive_cycles_; i++) {
         this->step();
+        if (this->source_converged()) {
+            LogScreen << "Fission source converged after " << i + 1
+                      << " inactive cycles" << std::endl;
+            break;
+        }
+        if (checkpoint_.due(i + 1)) {
+            checkpoint_.write(i + 1, [this](H5Node &node) {
+                this->write_checkpoint(node);
+            });
+        }
     }
+    cycle_ = 0;
 
     // Reset the tallies following inactive cycles, here we want to reset ALL
     // tallies on the pusher_, scalar and spatial
+    pusher_.set_active(true);
     pusher_.reset_tallies(true);
 
     LogScreen << "Starting active cycles:" << std::endl;
@@ -118,11 +297,48 @@ void MonteCarloEigenvalueSolver::solve()
     int n_active = n_cycles_ - n_inactive_cycles_ + 1;
     for (int i = 0; i < n_active; i++) {
         this->step();
+        if (target_rel_err_ > 0.0) {
+            real_t err = pusher_.pin_power_tally().max_relative_error();
+            if (err < target_rel_err_) {
+                LogScreen << "Pin power tallies reached target relative "
+                             "error ("
+                          << err << ") after " << i + 1 << " active cycles"
+                          << std::endl;
+                break;
+            }
+        }
     }
 
     return;
 } // MonteCarloEigenvalueSolver::solve()
 
+bool MonteCarloEigenvalueSolver::source_converged() const
+{
+    int n = h_history_.size();
+    if ((entropy_window_ == 0) || (n < 2 * entropy_window_)) {
+        return false;
+    }
+
+    real_t mean_prev = 0.0;
+    real_t mean_last = 0.0;
+    for (int i = n - 2 * entropy_window_; i < n - entropy_window_; i++) {
+        mean_prev += h_history_[i];
+    }
+    for (int i = n - entropy_window_; i < n; i++) {
+        mean_last += h_history_[i];
+    }
+    mean_prev /= entropy_window_;
+    mean_last /= entropy_window_;
+
+    real_t var_last = 0.0;
+    for (int i = n - entropy_window_; i < n; i++) {
+        var_last += (h_history_[i] - mean_last) * (h_history_[i] - mean_last);
+    }
+    var_last /= std::max(entropy_window_ - 1, 1);
+
+    return std::abs(mean_last - mean_prev) <= std::sqrt(var_last);
+}
+
 /**
  * Simulate all of the particles in the source bank using pusher_. After
  * simulating the batch of particles, extract eigenvalue estimates, and if in
@@ -135,7 +351,11 @@ void MonteCarloEigenvalueSolver::step()
     cycle_++;
 
     // Simulate all of the particles in the current fission bank
-    pusher_.simulate(source_bank_, 1.0);
+    timer_simulate_.tic();
+    pusher_.simulate(source_bank_, k_eff_.first);
+    timer_simulate_.toc();
+    n_particles_ += source_bank_.global_size();
+    n_cycles_run_++;
 
     // Log data
     k_eff_        = pusher_.k_tally_tl().get();
@@ -177,14 +397,25 @@ void MonteCarloEigenvalueSolver::step()
     // Grab the new fission sites from the pusher, and resize
     source_bank_.swap(pusher_.fission_bank());
 
-    // Sort and re-index the source bank. This gives reproduceable IDs for
-    // all particles, and therefore reproduceable parallel results. The
-    // stable_sort is important.
-    std::stable_sort(source_bank_.begin(), source_bank_.end());
-    source_bank_.resize(particles_per_cycle_, rng_);
-    unsigned i = 0;
-    for (auto &p : source_bank_) {
-        p.id = i++;
+    // Re-index the source bank. The pusher leaves the sites ordered by their
+    // parents' IDs, and neither resampling nor sorting depends on the number
+    // of threads, so this gives reproduceable IDs for all particles, and
+    // therefore reproduceable parallel results. A distributed bank is
+    // rebalanced over the processes after combing, keeping the global order
+    // of the sites.
+    if (comb_) {
+        source_bank_.comb(particles_per_cycle_, rng_);
+        source_bank_.balance();
+    } else {
+        source_bank_.resize(particles_per_cycle_, rng_);
+    }
+    if (sort_sites_) {
+        source_bank_.sort_sites();
+    }
+    source_bank_.renumber();
+
+    if (cmfd_ && !active_cycle_ && (n_cycles_run_ >= cmfd_begin_)) {
+        this->cmfd_rebalance();
     }
 
     if (dump_sites_) {
@@ -201,6 +432,243 @@ void MonteCarloEigenvalueSolver::step()
     return;
 } // MonteCarloEigenvalueSolver::step()
 
+void MonteCarloEigenvalueSolver::seed_source(const pugi::xml_node &input)
+{
+    ArrayB3 pin_source(mesh_.n_macroplanes(), mesh_.ny(), mesh_.nx());
+    real_t k = 1.0;
+
+    if (!input.attribute("file").empty()) {
+        // Pin powers and eigenvalue from the output of a previous run. 2-D/3-D
+        // output puts the MoC results in their own group.
+        std::string file = input.attribute("file").value();
+        LogScreen << "Sampling the initial fission source from " << file
+                  << std::endl;
+        H5Node h5f(file, H5Access::READ);
+        std::string path =
+            h5f.exists("pin_powers") ? "pin_powers" : "MoC/pin_powers";
+        if (!h5f.exists(path)) {
+            throw EXCEPT("No pin powers found in initial source file.");
+        }
+        try {
+            h5f.read(path, pin_source);
+        } catch (Exception e) {
+            throw EXCEPT_E("Initial source does not match the mesh", e);
+        }
+
+        VecF k_history;
+        if (h5f.exists("convergence/k")) {
+            h5f.read("convergence/k", k_history);
+        }
+        if (!k_history.empty()) {
+            k = k_history.back();
+        } else {
+            Warn("No eigenvalue in initial source file. Starting from "
+                 "k = 1.");
+        }
+    } else {
+        // Converge a deterministic eigenvalue problem, described by the
+        // input node, on the same mesh. This is only needed for the initial
+        // source, so it is thrown away afterwards.
+        LogScreen << "Converging a deterministic initial fission source"
+                  << std::endl;
+        EigenSolver solver(input, mesh_);
+        solver.solve();
+        pin_source = solver.sweeper()->pin_powers();
+        k          = solver.keff();
+    }
+
+    FissionBank bank(pin_source, particles_per_cycle_, mesh_, xs_mesh_, rng_);
+    source_bank_.swap(bank);
+    k_eff_ = {k, 0.0};
+    LogScreen << "Initial k-eff: " << k << std::endl;
+
+    return;
+}
+
+void MonteCarloEigenvalueSolver::cmfd_rebalance()
+{
+    const int n_group = xs_mesh_.n_group();
+    const int nxy     = mesh_.nx() * mesh_.ny();
+    const int n_cell  = mesh_.n_reg(MeshTreatment::PIN_PLANE);
+    CoarseData &cd    = cmfd_->coarse_data();
+
+    for (int ig = 0; ig < n_group; ig++) {
+        // Coarse flux, averaged over the planes of each macroplane, and the
+        // net surface currents
+        auto flux = pusher_.flux_tallies()[ig].get();
+        int icell = 0;
+        for (const auto &mplane : mesh_.macroplanes()) {
+            for (int ixy = 0; ixy < nxy; ixy++) {
+                real_t phi = 0.0;
+                for (int iz = mplane.iz_min; iz <= mplane.iz_max; iz++) {
+                    phi += flux[iz * nxy + ixy].first * mesh_.dz(iz);
+                }
+                cd.flux(icell++, ig) = phi / mplane.height;
+            }
+        }
+
+        auto current = pusher_.current_tallies()[ig].get();
+        for (int is = 0; is < (int)current.size(); is++) {
+            cd.current(is, ig) = current[is].first;
+        }
+
+        // Fine flux for the homogenization, in the same way. A vanishing
+        // floor leaves the pins that no particle has reached yet
+        // volume-weighted, rather than dividing by zero.
+        auto fine_flux = pusher_.fine_flux_tallies()[ig].get();
+        int ireg_plane = 0;
+        for (const auto &mplane : mesh_.macroplanes()) {
+            int n_reg = mplane.plane->n_reg();
+            for (int ir = 0; ir < n_reg; ir++) {
+                real_t phi = std::numeric_limits<real_t>::min();
+                for (int iz = mplane.iz_min; iz <= mplane.iz_max; iz++) {
+                    int ireg = mesh_.first_reg_plane(iz) + ir;
+                    phi += fine_flux[ireg].first * mesh_.dz(iz) /
+                           mplane.height;
+                }
+                cmfd_fine_flux_(ireg_plane++, ig) = phi;
+            }
+        }
+    }
+
+    cmfd_->solve(cmfd_k_);
+    k_history_cmfd_.push_back(cmfd_k_);
+
+    // Fission source of the CMFD solution and of the source bank in each
+    // coarse cell. The homogenized cross-section regions are ordered the
+    // same way as the cells.
+    const VecF volumes = mesh_.volumes(MeshTreatment::PIN_PLANE);
+    VecF fs_cmfd(n_cell, 0.0);
+    VecF fs_mc(n_cell, 0.0);
+    real_t total_cmfd = 0.0;
+    for (int icell = 0; icell < n_cell; icell++) {
+        const auto &xsr = (*cmfd_xsmesh_)[icell];
+        for (int ig = 0; ig < n_group; ig++) {
+            fs_cmfd[icell] += xsr.xsmacnf(ig) * cmfd_->flux()(icell, ig);
+        }
+        fs_cmfd[icell] *= volumes[icell];
+        total_cmfd += fs_cmfd[icell];
+    }
+
+    VecI cell(source_bank_.size());
+    real_t total_mc = 0.0;
+    for (int i = 0; i < source_bank_.size(); i++) {
+        int ipin = mesh_.coarse_cell_point(source_bank_.location(i));
+        cell[i]  = mesh_.macroplane_index(ipin / nxy) * nxy + ipin % nxy;
+        fs_mc[cell[i]] += source_bank_.weight(i);
+        total_mc += source_bank_.weight(i);
+    }
+    if (source_bank_.distributed()) {
+        fs_mc.push_back(total_mc);
+        ParEnv.sum(fs_mc.data(), fs_mc.size());
+        total_mc = fs_mc.back();
+        fs_mc.pop_back();
+    }
+
+    if (!(total_cmfd > 0.0)) {
+        Warn("CMFD fission source is not positive. Skipping the fission "
+             "source rebalance.");
+        return;
+    }
+
+    // Scale the sites in each cell to the CMFD fission source, then
+    // restore the total weight of the bank
+    real_t total = 0.0;
+    for (int i = 0; i < source_bank_.size(); i++) {
+        real_t f = fs_cmfd[cell[i]] * total_mc / (fs_mc[cell[i]] * total_cmfd);
+        if (std::isfinite(f) && (f > 0.0)) {
+            source_bank_.weight(i) *= f;
+        }
+        total += source_bank_.weight(i);
+    }
+    if (source_bank_.distributed()) {
+        ParEnv.sum(&total, 1);
+    }
+    real_t norm = total_mc / total;
+    for (int i = 0; i < source_bank_.size(); i++) {
+        source_bank_.weight(i) *= norm;
+    }
+
+    return;
+}
+
+void MonteCarloEigenvalueSolver::write_checkpoint(H5Node &node) const
+{
+    node.write("rng_state", rng_.state());
+    node.write("id_offset", (uint64_t)pusher_.id_offset());
+
+    node.write("k_history_tl", k_history_tl_);
+    node.write("k_history_col", k_history_col_);
+    node.write("k_history_analog", k_history_analog_);
+    node.write("h_history", h_history_);
+
+    auto g = node.create_group("source_bank");
+    source_bank_.write_checkpoint(g);
+
+    return;
+}
+
+int MonteCarloEigenvalueSolver::read_checkpoint()
+{
+    H5Node h5f(checkpoint_.restart_file(), H5Access::READ);
+
+    int cycle = 0;
+    h5f.read("iteration", cycle);
+    if ((cycle < 0) || (cycle > n_inactive_cycles_)) {
+        throw EXCEPT("Invalid cycle in checkpoint file.");
+    }
+
+    uint64_t rng_state = 0;
+    h5f.read("rng_state", rng_state);
+    rng_.set_seed(rng_state);
+
+    uint64_t id_offset = 0;
+    h5f.read("id_offset", id_offset);
+    pusher_.set_id_offset(id_offset);
+
+    h5f.read("k_history_tl", k_history_tl_);
+    h5f.read("k_history_col", k_history_col_);
+    h5f.read("k_history_analog", k_history_analog_);
+    h5f.read("h_history", h_history_);
+
+    auto g = h5f["source_bank"];
+    source_bank_.read_checkpoint(g);
+
+    return cycle;
+}
+
+void MonteCarloEigenvalueSolver::output_performance(H5Node &node) const
+{
+    real_t time = timer_simulate_.time();
+    node.write("cycles", n_cycles_run_);
+    node.write("particles", n_particles_);
+    node.write("simulate_time", time);
+    node.write("particles_per_second",
+               time > 0.0 ? (real_t)n_particles_ / time : 0.0);
+    if (timer_simulate_.has_counts()) {
+        auto g = node.create_group("simulate_counters");
+        timer_simulate_.output_counters(g);
+    }
+    if (cmfd_) {
+        auto g = node.create_group("cmfd");
+        cmfd_->output_performance(g);
+    }
+    return;
+}
+
+void MonteCarloEigenvalueSolver::memory(MemoryReport &report) const
+{
+    report.add("xs_mesh", xs_mesh_.memory());
+    report.add("source_bank", source_bank_.memory());
+    pusher_.memory(report.child("pusher"));
+    if (cmfd_) {
+        report.add("cmfd_xs_mesh",
+                   cmfd_xsmesh_->memory() + bytes(cmfd_fine_flux_));
+        cmfd_->memory(report.child("cmfd"));
+    }
+    return;
+}
+
 void MonteCarloEigenvalueSolver::output(H5Node &node) const
 {
     auto dims = mesh_.dimensions();
@@ -222,8 +690,17 @@ void MonteCarloEigenvalueSolver::output(H5Node &node) const
 
     node.write("seed", seed_);
 
+    if (cmfd_) {
+        node.write("k_history_cmfd", k_history_cmfd_);
+    }
+
     pusher_.output(node);
 
+    // The final fission source, which each process writes its own part of
+    // when the bank is distributed
+    auto g = node.create_group("fission_bank");
+    source_bank_.output(g);
+
     return;
 }
 } // namespace mc
@@ -19,10 +19,13 @@
 #include <cstdint>
 #include <utility>
 #include "util/pugifwd.hpp"
+#include "util/timers.hpp"
+#include "core/cmfd.hpp"
 #include "core/core_mesh.hpp"
 #include "core/solver.hpp"
 #include "mc/fission_bank.hpp"
 #include "mc/particle_pusher.hpp"
+#include "checkpoint.hpp"
 
 namespace mocc {
 namespace mc {
@@ -35,6 +38,32 @@ namespace mc {
  * such as scalar flux and pin power are maintained within the \ref
  * mc::ParticlePusher. These tallies maintain batch statistics for each cycle,
  * which get reset at the end of the inactive cycles.
+ *
+ * The numbers of inactive and total cycles in the input are upper limits.
+ * If an \c entropy_window is given, the inactive cycles end as soon as the
+ * mean Shannon entropy of the fission source over the last \c entropy_window
+ * cycles is within one standard deviation of its mean over the window before
+ * that. If a \c target_rel_err is given, the active cycles end as soon as
+ * the relative standard error of every non-zero pin power is below it.
+ *
+ * Checkpoints (see \ref Checkpoint) count cycles, and are only written
+ * during the inactive cycles, since the active-cycle tallies are not stored.
+ *
+ * With \c cmfd enabled, the fission source is rebalanced with \ref CMFD
+ * after each inactive cycle from \c cmfd_begin on. The coarse mesh flux and
+ * currents come from the pusher tallies accumulated over the inactive
+ * cycles so far, and the fine flux tallies are used to homogenize the cross
+ * sections. The weight of each source site is then scaled by the ratio of
+ * the CMFD fission source to the Monte Carlo fission source in its coarse
+ * cell. The active cycles are left alone, so that the rebalancing does not
+ * bias the results.
+ *
+ * On several processes, the source bank is distributed (see \ref
+ * FissionBank), and each process simulates its own share of the histories of
+ * every cycle. The bank is combed over all of the processes and then
+ * rebalanced, and the tallies are summed at the end of each cycle. Particles
+ * draw their random numbers by global ID, so a run is reproducible for a
+ * given number of processes.
  */
 class MonteCarloEigenvalueSolver : public Solver {
 public:
@@ -54,6 +83,22 @@ public:
 
     void output(H5Node &node) const override;
 
+    /**
+     * \copybrief Solver::output_performance()
+     *
+     * Writes the number of cycles and particles simulated, the time spent
+     * simulating them, and the particle rate.
+     */
+    void output_performance(H5Node &node) const override;
+
+    /**
+     * \copybrief Solver::memory()
+     *
+     * Adds the cross-section mesh and source bank, and the particle pusher
+     * in the \c pusher child.
+     */
+    void memory(MemoryReport &report) const override;
+
 private:
     // Data
     const CoreMesh &mesh_;
@@ -95,6 +140,74 @@ private:
 
     int cycle_;
     bool dump_sites_;
+
+    // Whether to resample the fission bank between cycles by systematic
+    // combing, rather than randomly, and whether to sort the sites by pin
+    bool comb_;
+    bool sort_sites_;
+
+    // Number of cycles over which to average the Shannon entropy when
+    // checking for source convergence. Zero to always run all of the
+    // inactive cycles.
+    int entropy_window_;
+
+    // Target relative error of the pin power tallies for ending the active
+    // cycles. Zero to always run all of the active cycles.
+    real_t target_rel_err_;
+
+    // Periodic checkpoints of the inactive cycles, and restart
+    Checkpoint checkpoint_;
+
+    // CMFD acceleration of the fission source, if enabled, the homogenized
+    // cross sections that it uses, and the fine mesh flux, with a PLANE
+    // treatment, that they are homogenized with. CMFD starts after
+    // cmfd_begin_ inactive cycles.
+    UP_CMFD_t cmfd_;
+    SP_XSMeshHomogenized_t cmfd_xsmesh_;
+    ArrayB2 cmfd_fine_flux_;
+    int cmfd_begin_;
+    real_t cmfd_k_;
+    VecF k_history_cmfd_;
+
+    // Time spent simulating particles, and the number of particles and
+    // cycles simulated
+    Timer &timer_simulate_;
+    uint64_t n_particles_;
+    int n_cycles_run_;
+
+    /**
+     * \brief Return whether the Shannon entropy history indicates that the
+     * fission source has converged
+     */
+    bool source_converged() const;
+
+    /**
+     * \brief Sample the source bank from a deterministic fission source, and
+     * take the initial eigenvalue from the same solution
+     *
+     * The source is read from the pin powers in the output file given by the
+     * \c file attribute of \p input if present. Otherwise, \p input is used
+     * to construct an \ref EigenSolver on the same mesh, which is solved to
+     * provide the source.
+     */
+    void seed_source(const pugi::xml_node &input);
+
+    /**
+     * \brief Solve the CMFD system with the tallies so far and rebalance the
+     * weights of the sites in the source bank
+     */
+    void cmfd_rebalance();
+
+    /**
+     * \brief Write the state needed to resume the inactive cycles
+     */
+    void write_checkpoint(H5Node &node) const;
+
+    /**
+     * \brief Restore the state of the solver from the restart file, returning
+     * the number of inactive cycles that had been completed
+     */
+    int read_checkpoint();
 };
 } // namespace mc
 } // namespace mocc
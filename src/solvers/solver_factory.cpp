@@ -22,6 +22,7 @@
 #include "util/files.hpp"
 #include "eigen_solver.hpp"
 #include "fixed_source_solver.hpp"
+#include "jfnk_eigen_solver.hpp"
 #include "monte_carlo_eigenvalue_solver.hpp"
 
 namespace mocc {
@@ -38,6 +39,9 @@ SP_Solver_t SolverFactory(const pugi::xml_node &input, const CoreMesh &mesh)
     if (type == "eigenvalue") {
         solver = std::make_shared<EigenSolver>(input, mesh);
     }
+    else if (type == "eigenvalue_jfnk") {
+        solver = std::make_shared<JFNKEigenSolver>(input, mesh);
+    }
     else if (type == "fixed_source") {
         solver = std::make_shared<FixedSourceSolver>(input, mesh);
     }
@@ -0,0 +1,128 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "UnitTest++/UnitTest++.h"
+
+#include <iostream>
+#include <string>
+#include "pugixml.hpp"
+#include "util/blitz_typedefs.hpp"
+#include "util/global_config.hpp"
+#include "core/core_mesh.hpp"
+#include "solvers/eigen_solver.hpp"
+
+using namespace mocc;
+
+// This test makes sure that lagging the CMFD solve by one outer iteration
+// converges to the same eigenvalue and flux as the regular CMFD-accelerated
+// power iteration, on the standalone MoC sweeper. The problem is an infinite
+// homogeneous medium, made out of a 3x2 array of UO2 pins with reflective
+// boundaries, so that the mesh and rays are not trivial.
+
+std::string ihm_xml = "<mesh id=\"1\" type=\"rect\" pitch=\"1.26\">"
+                      "<sub_x>3</sub_x>"
+                      "<sub_y>3</sub_y>"
+                      "</mesh>"
+                      "<pin id=\"1\" mesh=\"1\">"
+                      "1 1 1 1 1 1 1 1 1"
+                      "</pin>"
+                      "<lattice id=\"1\" nx=\"3\" ny=\"2\">"
+                      "1 1 1 1 1 1"
+                      "</lattice>"
+                      "<assembly id=\"1\" np=\"1\" hz=\"0.5\">"
+                      "<lattices>"
+                      "1"
+                      "</lattices>"
+                      "</assembly>"
+                      "<core nx=\"1\" ny=\"1\""
+                      " north=\"reflect\""
+                      " south=\"reflect\""
+                      " east=\"reflect\""
+                      " west=\"reflect\""
+                      " top=\"reflect\""
+                      " bottom=\"reflect\" >"
+                      "1"
+                      "</core>"
+                      ""
+                      "<material_lib path=\"c5g7.xsl\">"
+                      "<material id=\"1\" name=\"UO2-3.3\" />"
+                      "</material_lib>";
+
+std::string sweeper_xml = "<source scattering=\"P0\" />"
+                          "<sweeper type=\"moc\" n_inner=\"5\">"
+                          "    <ang_quad type=\"ls\" order=\"2\" />"
+                          "    <rays spacing=\"0.05\" />"
+                          "</sweeper>";
+
+// Return the solver input of the passed type and extra attributes
+std::string solver_xml(const std::string &type, const std::string &options)
+{
+    return "<solver type=\"" + type + "\" k_tol=\"1.0e-9\" psi_tol=\"1.0e-8\"" +
+           " max_iter=\"500\" " + options + ">" + sweeper_xml + "</solver>";
+}
+
+// Copy the flux of a sweeper, normalized to unit sum
+ArrayB2 normalized_flux(const TransportSweeper &sweeper)
+{
+    ArrayB2 flux(sweeper.flux().shape());
+    flux = sweeper.flux();
+    real_t sum = 0.0;
+    for (auto v : flux) {
+        sum += v;
+    }
+    flux /= sum;
+    return flux;
+}
+
+// Solve the problem with and without lagging the CMFD solve, and compare the
+// results
+TEST(cmfd_lag_ihm)
+{
+    pugi::xml_document doc;
+    pugi::xml_document lag_doc;
+    std::string input     = ihm_xml + solver_xml("eigenvalue", "cmfd=\"t\"");
+    std::string lag_input = ihm_xml + solver_xml("eigenvalue",
+                                                 "cmfd=\"t\" cmfd_lag=\"t\"");
+    REQUIRE CHECK(doc.load_string(input.c_str()));
+    REQUIRE CHECK(lag_doc.load_string(lag_input.c_str()));
+
+    CoreMesh mesh(doc);
+
+    EigenSolver solver(doc.child("solver"), mesh);
+    solver.solve();
+
+    EigenSolver lag_solver(lag_doc.child("solver"), mesh);
+    lag_solver.solve();
+
+    std::cout << "CMFD k: " << solver.keff() << std::endl;
+    std::cout << "lagged CMFD k: " << lag_solver.keff() << std::endl;
+    CHECK_CLOSE(solver.keff(), lag_solver.keff(), 1.0e-6);
+
+    ArrayB2 flux     = normalized_flux(*solver.sweeper());
+    ArrayB2 flux_lag = normalized_flux(*lag_solver.sweeper());
+    REQUIRE CHECK_EQUAL(flux.size(), flux_lag.size());
+    for (int ireg = 0; ireg < (int)flux.extent(0); ireg++) {
+        for (int ig = 0; ig < (int)flux.extent(1); ig++) {
+            CHECK_CLOSE(flux(ireg, ig), flux_lag(ireg, ig),
+                        1.0e-5 * flux(ireg, ig));
+        }
+    }
+}
+
+int main()
+{
+    return UnitTest::RunAllTests();
+}
@@ -17,11 +17,60 @@
 #include "correction_data.hpp"
 
 #include <iomanip>
+#include <string>
 #include "pugixml.hpp"
+#include "util/error.hpp"
 #include "util/files.hpp"
 #include "util/string_utils.hpp"
 
+namespace {
+bool parse_single_precision(const pugi::xml_node &input)
+{
+    std::string precision = "double";
+    if (!input.attribute("precision").empty()) {
+        precision = input.attribute("precision").value();
+        sanitize(precision);
+    }
+    if (precision == "double") {
+        return false;
+    } else if (precision == "single") {
+        return true;
+    }
+    throw EXCEPT("Unrecognized correction factor precision: " + precision);
+}
+
+bool parse_group_only(const pugi::xml_node &input)
+{
+    std::string storage = "full";
+    if (!input.attribute("storage").empty()) {
+        storage = input.attribute("storage").value();
+        sanitize(storage);
+    }
+    if (storage == "full") {
+        return false;
+    } else if (storage == "group") {
+        return true;
+    }
+    throw EXCEPT("Unrecognized correction factor storage: " + storage);
+}
+}
+
 namespace mocc {
+CorrectionData::CorrectionData(const CoreMesh &mesh, size_t nang,
+                               size_t ngroup, const pugi::xml_node &input)
+    : CorrectionData(mesh, nang, ngroup, parse_single_precision(input),
+                     parse_group_only(input))
+{
+    if (single_precision_ || group_only_) {
+        LogFile << "Storing correction factors in "
+                << (single_precision_ ? "single" : "double") << " precision, "
+                << (group_only_ ? "for the current group only" :
+                                  "for all groups")
+                << " (" << this->memory() << " bytes)" << std::endl;
+    }
+    return;
+}
+
 void CorrectionData::from_data(const pugi::xml_node &input)
 {
     if (input.child("data").empty()) {
@@ -31,6 +80,11 @@ void CorrectionData::from_data(const pugi::xml_node &input)
         return;
     }
 
+    if (group_only_) {
+        throw EXCEPT("Correction factors can't be read from file when only "
+                     "the current group is stored.");
+    }
+
     LogFile << "Loading CDD data from file(s)." << std::endl;
 
     int np = mesh_->macroplanes().size();
@@ -103,9 +157,10 @@ void CorrectionData::read_data_single(const pugi::xml_node &data,
                 }
                 for (int ip = bottom_plane; ip <= top_plane; ip++) {
                     int stt = mesh_->plane_cell_begin(ip);
-                    int stp = mesh_->plane_cell_end(ip) - 1;
-                    alpha_(ig, iang, blitz::Range(stt, stp),
-                           (int)Normal::X_NORM) = inbuf;
+                    for (int i = 0; i < (int)inbuf.size(); i++) {
+                        this->set_alpha(stt + i, iang, ig, Normal::X_NORM,
+                                        inbuf(i));
+                    }
                 }
             }
             // alpha y
@@ -120,9 +175,10 @@ void CorrectionData::read_data_single(const pugi::xml_node &data,
                 }
                 for (int ip = bottom_plane; ip <= top_plane; ip++) {
                     int stt = mesh_->plane_cell_begin(ip);
-                    int stp = mesh_->plane_cell_end(ip) - 1;
-                    alpha_(ig, iang, blitz::Range(stt, stp),
-                           (int)Normal::Y_NORM) = inbuf;
+                    for (int i = 0; i < (int)inbuf.size(); i++) {
+                        this->set_alpha(stt + i, iang, ig, Normal::Y_NORM,
+                                        inbuf(i));
+                    }
                 }
             }
             // beta
@@ -137,8 +193,9 @@ void CorrectionData::read_data_single(const pugi::xml_node &data,
                 }
                 for (int ip = bottom_plane; ip <= top_plane; ip++) {
                     int stt = mesh_->plane_cell_begin(ip);
-                    int stp = mesh_->plane_cell_end(ip) - 1;
-                    beta_(ig, iang, blitz::Range(stt, stp)) = inbuf;
+                    for (int i = 0; i < (int)inbuf.size(); i++) {
+                        this->set_beta(stt + i, iang, ig, inbuf(i));
+                    }
                 }
             }
         }
@@ -224,7 +281,11 @@ void CorrectionData::output(H5Node &file) const
     // Declare slice storage
     ArrayB1 slice(n);
 
-    for (int g = 0; g < ngroup_; g++) {
+    // If only the current group is stored, that's all there is to write
+    int g_begin = group_only_ ? current_group_ : 0;
+    int g_end   = group_only_ ? current_group_ + 1 : ngroup_;
+
+    for (int g = g_begin; g < g_end; g++) {
         std::stringstream path;
         path << "alpha_x/" << std::setfill('0') << std::setw(3) << g;
         auto ax_g = file.create_group(path.str());
@@ -239,21 +300,27 @@ void CorrectionData::output(H5Node &file) const
 
         for (int a = 0; a < nang_; a++) {
             {
-                slice = beta_(g, a, blitz::Range::all());
+                for (int i = 0; i < n; i++) {
+                    slice(i) = this->beta(i, a, g);
+                }
                 std::stringstream setname;
                 setname << std::setfill('0') << std::setw(3) << a;
                 beta_g.write(setname.str(), slice, dims);
             }
 
             {
-                slice = alpha_(g, a, blitz::Range::all(), (int)Normal::X_NORM);
+                for (int i = 0; i < n; i++) {
+                    slice(i) = this->alpha(i, a, g, Normal::X_NORM);
+                }
                 std::stringstream setname;
                 setname << std::setfill('0') << std::setw(3) << a;
                 ax_g.write(setname.str(), slice, dims);
             }
 
             {
-                slice = alpha_(g, a, blitz::Range::all(), (int)Normal::Y_NORM);
+                for (int i = 0; i < n; i++) {
+                    slice(i) = this->alpha(i, a, g, Normal::Y_NORM);
+                }
                 std::stringstream setname;
                 setname << std::setfill('0') << std::setw(3) << a;
                 ay_g.write(setname.str(), slice, dims);
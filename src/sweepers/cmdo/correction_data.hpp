@@ -20,6 +20,7 @@
 #include <memory>
 #include "util/blitz_typedefs.hpp"
 #include "util/global_config.hpp"
+#include "util/memory.hpp"
 #include "util/pugifwd.hpp"
 #include "core/constants.hpp"
 #include "core/core_mesh.hpp"
@@ -37,12 +38,44 @@ namespace mocc {
  */
 class CorrectionData : public HasOutput {
 public:
-    CorrectionData() : mesh_(nullptr), nreg_(0), nang_(0), ngroup_(0)
+    CorrectionData()
+        : mesh_(nullptr),
+          nreg_(0),
+          nang_(0),
+          ngroup_(0),
+          single_precision_(false),
+          group_only_(false),
+          current_group_(0)
     {
         return;
     }
 
     CorrectionData(const CoreMesh &mesh, size_t nang, size_t ngroup)
+        : CorrectionData(mesh, nang, ngroup, false, false)
+    {
+        return;
+    }
+
+    /**
+     * \brief Construct to the storage options specified in a
+     * \<corrections\> tag
+     *
+     * The tag may be empty, in which case the defaults (full, double
+     * precision storage) are used. The supported attributes are:
+     *  - \c precision: \c "double" (default) or \c "single". Single
+     *  precision halves the storage, at the cost of rounding the correction
+     *  factors to about seven significant digits.
+     *  - \c storage: \c "full" (default) to store the factors for all
+     *  groups, or \c "group" to store only those of the group being swept.
+     *  The latter reduces the storage by a factor of the number of groups,
+     *  but is only valid if the factors are always generated in the same
+     *  group sweep that consumes them.
+     */
+    CorrectionData(const CoreMesh &mesh, size_t nang, size_t ngroup,
+                   const pugi::xml_node &input);
+
+    CorrectionData(const CoreMesh &mesh, size_t nang, size_t ngroup,
+                   bool single_precision, bool group_only)
         : mesh_(&mesh),
           nx_(mesh.nx()),
           ny_(mesh.ny()),
@@ -50,17 +83,23 @@ public:
           nreg_(nx_ * ny_ * nz_),
           nang_(nang),
           ngroup_(ngroup),
-          alpha_(ngroup_, nang_, nreg_, 2),
-          beta_(ngroup_, nang_, nreg_)
+          single_precision_(single_precision),
+          group_only_(group_only),
+          current_group_(0)
     {
-        assert(alpha_.size() > 0);
-        assert(beta_.size() > 0);
         assert(nx_ * ny_ * nz_ == nreg_);
-        auto slice = alpha_(0, 0, blitz::Range::all(), blitz::Range::all());
-        assert(slice.isStorageContiguous());
-
-        alpha_ = 0.5;
-        beta_  = 1.0;
+        int ng_stored = group_only_ ? 1 : ngroup_;
+        if (single_precision_) {
+            alpha_sp_.resize(ng_stored, nang_, nreg_, 2);
+            beta_sp_.resize(ng_stored, nang_, nreg_);
+            alpha_sp_ = 0.5f;
+            beta_sp_  = 1.0f;
+        } else {
+            alpha_.resize(ng_stored, nang_, nreg_, 2);
+            beta_.resize(ng_stored, nang_, nreg_);
+            alpha_ = 0.5;
+            beta_  = 1.0;
+        }
 
         return;
     }
@@ -71,7 +110,7 @@ public:
 
     size_t size() const
     {
-        return alpha_.size();
+        return single_precision_ ? alpha_sp_.size() : alpha_.size();
     }
 
     int n_cell() const
@@ -79,24 +118,71 @@ public:
         return nreg_;
     }
 
-    inline real_t &alpha(int reg, int ang, int group, Normal norm)
+    int n_ang() const
+    {
+        return nang_;
+    }
+
+    /**
+     * \brief Return whether only the factors for the current group are
+     * stored
+     */
+    bool group_only() const
+    {
+        return group_only_;
+    }
+
+    inline real_t alpha(int reg, int ang, int group, Normal norm) const
+    {
+        assert(!group_only_ || (group == current_group_));
+        int ig = group_only_ ? 0 : group;
+        return single_precision_ ? alpha_sp_(ig, ang, reg, (int)norm)
+                                 : alpha_(ig, ang, reg, (int)norm);
+    }
+
+    inline real_t beta(int reg, int ang, int group) const
     {
-        return alpha_(group, ang, reg, (int)norm);
+        assert(!group_only_ || (group == current_group_));
+        int ig = group_only_ ? 0 : group;
+        return single_precision_ ? beta_sp_(ig, ang, reg)
+                                 : beta_(ig, ang, reg);
     }
 
-    inline const real_t alpha(int reg, int ang, int group, Normal norm) const
+    inline void set_alpha(int reg, int ang, int group, Normal norm,
+                          real_t value)
     {
-        return alpha_(group, ang, reg, (int)norm);
+        int ig = group_only_ ? 0 : group;
+        if (single_precision_) {
+            alpha_sp_(ig, ang, reg, (int)norm) = value;
+        } else {
+            alpha_(ig, ang, reg, (int)norm) = value;
+        }
+        return;
     }
 
-    inline real_t &beta(int reg, int ang, int group)
+    inline void set_beta(int reg, int ang, int group, real_t value)
     {
-        return beta_(group, ang, reg);
+        int ig = group_only_ ? 0 : group;
+        if (single_precision_) {
+            beta_sp_(ig, ang, reg) = value;
+        } else {
+            beta_(ig, ang, reg) = value;
+        }
+        return;
     }
 
-    inline const real_t beta(int reg, int ang, int group) const
+    /**
+     * \brief Signal that the factors for a new group are about to be
+     * generated
+     *
+     * This is only meaningful for \ref group_only() storage, where the
+     * factors of the previous group are overwritten by those of the new one.
+     * In debug builds, reading the factors of any other group is caught.
+     */
+    void begin_group(int group)
     {
-        return beta_(group, ang, reg);
+        current_group_ = group;
+        return;
     }
 
     /**
@@ -107,6 +193,15 @@ public:
 
     void output(H5Node &file) const;
 
+    /**
+     * \brief Return the number of bytes used to store the correction factors
+     */
+    size_t memory() const
+    {
+        return bytes(alpha_) + bytes(beta_) + bytes(alpha_sp_) +
+               bytes(beta_sp_);
+    }
+
 private:
     // Private methods to facilitate reading data from HDF5 files
     /**
@@ -155,8 +250,16 @@ private:
     int nang_;
     int ngroup_;
 
+    // Only one of the double- or single-precision arrays is allocated. If
+    // only the current group is stored, their group extent is one.
+    bool single_precision_;
+    bool group_only_;
+    int current_group_;
+
     ArrayB4 alpha_;
     ArrayB3 beta_;
+    blitz::Array<float, 4> alpha_sp_;
+    blitz::Array<float, 3> beta_sp_;
 };
 
 typedef std::unique_ptr<CorrectionData> UP_CorrectionData_t;
@@ -29,7 +29,8 @@ namespace cmdo {
  * an offset to store data into the mesh-global correction factor
  * storage, but none to access the single-plane buffers.
  */
-void CurrentCorrections::calculate_corrections(size_t ang, size_t group)
+void CurrentCorrections::calculate_corrections(size_t ang, size_t group,
+                                               const AngleSums &sums)
 {
     const int FW = 0;
     const int BW = 1;
@@ -63,8 +64,12 @@ void CurrentCorrections::calculate_corrections(size_t ang, size_t group)
     }
 
     // Make sure we have the right cross sections
+#pragma omp single
     xstr_sn_.expand(group);
 
+    // Doing area-based normalization
+    // sums.surf_sum /= sums.surf_norm;
+
     // See the Surface Normalization page
     // Note that the sin and cos are flipped from what we have in \ref
     // RayData::RayData(). This is because "x spacing" applies to the y-normal
@@ -72,7 +77,15 @@ void CurrentCorrections::calculate_corrections(size_t ang, size_t group)
     // normalization. so the above doesnt really apply
     real_t area[2] = {std::abs(rays_.spacing(ang) / cos(ang_quad_[ang].alpha)),
                       std::abs(rays_.spacing(ang) / sin(ang_quad_[ang].alpha))};
-    for (unsigned ic = 0; ic < mesh_->n_cell_plane(); ic++) {
+    // When only the current group is stored, the previous values belong to
+    // another group, so there is no meaningful change to measure
+    const bool track_residual = !corrections_->group_only();
+
+    // Each thread sums the residuals of its own cells
+    std::array<real_t, 3> residual = {{0.0, 0.0, 0.0}};
+
+#pragma omp for
+    for (int ic = 0; ic < n_cell_; ic++) {
         int icc  = ic + cell_offset_;    // index into the correction data
         int icxs = ic + cell_offset_xs_; // index into expanded XS
         assert(icxs < xstr_sn_.size());
@@ -88,72 +101,87 @@ void CurrentCorrections::calculate_corrections(size_t ang, size_t group)
         // FW direction
         {
             real_t psi_xl =
-                surf_sum_(mesh_->coarse_surf(ic, surfs[FW][XL]) * 2 + 0) *
+                sums.surf_sum(mesh_->coarse_surf(ic, surfs[FW][XL]) * 2 + 0) *
                 area_x;
             real_t psi_xr =
-                surf_sum_(mesh_->coarse_surf(ic, surfs[FW][XR]) * 2 + 0) *
+                sums.surf_sum(mesh_->coarse_surf(ic, surfs[FW][XR]) * 2 + 0) *
                 area_x;
             real_t psi_yl =
-                surf_sum_(mesh_->coarse_surf(ic, surfs[FW][YL]) * 2 + 0) *
+                sums.surf_sum(mesh_->coarse_surf(ic, surfs[FW][YL]) * 2 + 0) *
                 area_y;
             real_t psi_yr =
-                surf_sum_(mesh_->coarse_surf(ic, surfs[FW][YR]) * 2 + 0) *
+                sums.surf_sum(mesh_->coarse_surf(ic, surfs[FW][YR]) * 2 + 0) *
                 area_y;
-            real_t ax = vol_sum_(ic * 2 + 0) / (psi_xl + psi_xr);
-            real_t ay = vol_sum_(ic * 2 + 0) / (psi_yl + psi_yr);
+            // Normalize the flux and sigt values
+            real_t vol  = sums.vol_sum(ic * 2 + 0) / sums.vol_norm(ic);
+            real_t sigt = sums.sigt_sum(ic * 2 + 0) / sums.vol_sum(ic * 2 + 0);
 
-            real_t b = sigt_sum_(ic * 2 + 0) / xstr;
+            real_t ax = vol / (psi_xl + psi_xr);
+            real_t ay = vol / (psi_yl + psi_yr);
+
+            real_t b = sigt / xstr;
             assert(b == b);
 
-            real_t e =
-                ax - corrections_->alpha(icc, iang1, group, Normal::X_NORM);
-            residual_[0] += e * e;
-            e = ay - corrections_->alpha(icc, iang1, group, Normal::Y_NORM);
-            residual_[1] += e * e;
-            e = b - corrections_->beta(icc, iang1, group);
-            residual_[2] += e * e;
-
-            corrections_->alpha(icc, iang1, group, Normal::X_NORM) = ax;
-            corrections_->alpha(icc, iang1, group, Normal::Y_NORM) = ay;
-            corrections_->beta(icc, iang1, group) = b;
+            if (track_residual) {
+                real_t e = ax - corrections_->alpha(icc, iang1, group,
+                                                    Normal::X_NORM);
+                residual[0] += e * e;
+                e = ay - corrections_->alpha(icc, iang1, group, Normal::Y_NORM);
+                residual[1] += e * e;
+                e = b - corrections_->beta(icc, iang1, group);
+                residual[2] += e * e;
+            }
+
+            corrections_->set_alpha(icc, iang1, group, Normal::X_NORM, ax);
+            corrections_->set_alpha(icc, iang1, group, Normal::Y_NORM, ay);
+            corrections_->set_beta(icc, iang1, group, b);
         }
 
         // BW direction
         {
             real_t psi_xl =
-                surf_sum_(mesh_->coarse_surf(ic, surfs[BW][XL]) * 2 + 1) *
+                sums.surf_sum(mesh_->coarse_surf(ic, surfs[BW][XL]) * 2 + 1) *
                 area_x;
             real_t psi_xr =
-                surf_sum_(mesh_->coarse_surf(ic, surfs[BW][XR]) * 2 + 1) *
+                sums.surf_sum(mesh_->coarse_surf(ic, surfs[BW][XR]) * 2 + 1) *
                 area_x;
             real_t psi_yl =
-                surf_sum_(mesh_->coarse_surf(ic, surfs[BW][YL]) * 2 + 1) *
+                sums.surf_sum(mesh_->coarse_surf(ic, surfs[BW][YL]) * 2 + 1) *
                 area_y;
             real_t psi_yr =
-                surf_sum_(mesh_->coarse_surf(ic, surfs[BW][YR]) * 2 + 1) *
+                sums.surf_sum(mesh_->coarse_surf(ic, surfs[BW][YR]) * 2 + 1) *
                 area_y;
 
-            real_t ax = vol_sum_(ic * 2 + 1) / (psi_xl + psi_xr);
-            real_t ay = vol_sum_(ic * 2 + 1) / (psi_yl + psi_yr);
+            real_t vol  = sums.vol_sum(ic * 2 + 1) / sums.vol_norm(ic);
+            real_t sigt = sums.sigt_sum(ic * 2 + 1) / sums.vol_sum(ic * 2 + 1);
 
-            real_t b = sigt_sum_(ic * 2 + 1) / xstr;
-            assert(b == b);
+            real_t ax = vol / (psi_xl + psi_xr);
+            real_t ay = vol / (psi_yl + psi_yr);
 
-            real_t e =
-                ax - corrections_->alpha(icc, iang2, group, Normal::X_NORM);
-            residual_[0] += e * e;
-            e = ay - corrections_->alpha(icc, iang2, group, Normal::Y_NORM);
-            residual_[1] += e * e;
-            e = b - corrections_->beta(icc, iang2, group);
-            residual_[2] += e * e;
-
-            corrections_->alpha(icc, iang2, group, Normal::X_NORM) = ax;
-            corrections_->alpha(icc, iang2, group, Normal::Y_NORM) = ay;
+            real_t b = sigt / xstr;
+            assert(b == b);
 
-            corrections_->beta(icc, iang2, group) = b;
+            if (track_residual) {
+                real_t e = ax - corrections_->alpha(icc, iang2, group,
+                                                    Normal::X_NORM);
+                residual[0] += e * e;
+                e = ay - corrections_->alpha(icc, iang2, group, Normal::Y_NORM);
+                residual[1] += e * e;
+                e = b - corrections_->beta(icc, iang2, group);
+                residual[2] += e * e;
+            }
+
+            corrections_->set_alpha(icc, iang2, group, Normal::X_NORM, ax);
+            corrections_->set_alpha(icc, iang2, group, Normal::Y_NORM, ay);
+            corrections_->set_beta(icc, iang2, group, b);
         }
     }
 
+#pragma omp critical
+    for (int i = 0; i < 3; i++) {
+        residual_[i] += residual[i];
+    }
+
     return;
 }
 }
@@ -21,6 +21,7 @@
 #include "core/angular_quadrature.hpp"
 #include "core/coarse_data.hpp"
 #include "core/mesh.hpp"
+#include "core/thread_buffers.hpp"
 #include "core/xs_mesh_homogenized.hpp"
 #include "sweepers/moc/moc_current_worker.hpp"
 #include "sweepers/moc/ray.hpp"
@@ -32,9 +33,19 @@ namespace cmdo {
 /**
  * See documentation for \ref moc::NoCurrent for canonical documentation
  * for each of the methods.
+ *
+ * Each thread accumulates the flux and cross-section sums for an angle into
+ * its own buffer, along with the currents, which are tallied by the \ref
+ * moc::Current base. When the rays of an angle are done, \ref post_angle()
+ * sums the buffers of all threads and calculates the correction factors for
+ * that angle, with the coarse cells of the plane split among the threads.
  */
 class CurrentCorrections : public moc::Current {
 public:
+    /**
+     * The thread-private sums are allocated here, so this must be called
+     * outside of any parallel region.
+     */
     CurrentCorrections(CoarseData *coarse_data, const Mesh *mesh,
                        CorrectionData *corrections, const VectorX &qbar,
                        ExpandedXS &xstr_true, ExpandedXS &xstr_split,
@@ -47,13 +58,12 @@ public:
           xstr_split_(xstr_split),
           xstr_sn_(xstr_sn),
           ang_quad_(ang_quad),
-          surf_sum_(mesh_->n_surf_plane() * 2),
-          vol_sum_(mesh_->n_cell_plane() * 2),
-          vol_norm_(mesh_->n_cell_plane()),
-          sigt_sum_(mesh_->n_cell_plane() * 2),
-          surf_norm_(mesh_->n_surf_plane() * 2),
+          n_cell_(mesh_->n_cell_plane()),
+          sums_(n_surf_, n_cell_),
           rays_(rays)
     {
+        thread_sums_.resize(sums_.data.size());
+
         assert(xstr_true_.size() == (int)mesh->n_reg(MeshTreatment::PLANE));
         assert(xstr_split_.size() == (int)mesh->n_reg(MeshTreatment::PLANE));
         assert(xstr_sn.size() == (int)mesh->n_reg(MeshTreatment::PIN));
@@ -77,6 +87,9 @@ public:
         return;
     }
 
+    // Copies would share the sums with the original
+    CurrentCorrections(const CurrentCorrections &other) = delete;
+
     inline void set_group(int group)
     {
         group_    = group;
@@ -101,6 +114,7 @@ public:
     {
         assert(plane < (int)mplane_offset_.size());
         Current::set_plane(plane);
+#pragma omp single
         cell_offset_xs_ = mplane_offset_[plane];
 
         return;
@@ -110,138 +124,116 @@ public:
                          const ArrayB1 &e_tau, const moc::Ray &ray,
                          int first_reg)
     {
-#pragma omp critical
-        {
-            auto all          = blitz::Range::all();
-            auto current      = coarse_data_->current(all, group_);
-            auto surface_flux = coarse_data_->surface_flux(all, group_);
-
-            int cell_fw = ray.cm_cell_fw();
-            int cell_bw = ray.cm_cell_bw();
-            int surf_fw = ray.cm_surf_fw();
-            int surf_bw = ray.cm_surf_bw();
-            int iseg_fw = 0;
-            int iseg_bw = ray.nseg();
-
-            // Use an offset for the current contributions, but NOT for the
-            // correction factors, which use plane-by-plane indexing
-            int norm_fw = (int)mesh_->surface_normal(surf_fw);
-            int norm_bw = (int)mesh_->surface_normal(surf_bw);
-            current(surf_fw + surf_offset_) +=
-                psi1[iseg_fw] * current_weights_[norm_fw];
-            current(surf_bw + surf_offset_) -=
-                psi2[iseg_bw] * current_weights_[norm_bw];
-            surface_flux(surf_fw + surf_offset_) +=
-                psi1[iseg_fw] * flux_weights_[norm_fw];
-            surface_flux(surf_bw + surf_offset_) -=
-                psi2[iseg_bw] * flux_weights_[norm_bw];
-
-            surf_sum_(surf_fw * 2 + 0) += psi1[iseg_fw];
-            surf_sum_(surf_bw * 2 + 1) += psi2[iseg_bw];
-            surf_norm_(surf_fw * 2 + 0) += 1.0;
-            surf_norm_(surf_bw * 2 + 1) += 1.0;
-
-            auto begin = ray.cm_data().cbegin();
-            auto end   = ray.cm_data().cend();
-            for (auto crd = begin; crd != end; ++crd) {
-                // Hopefully branch prediction saves me here.
-                if (crd->fw != Surface::INVALID) {
-                    // Store forward volumetric stuff
-                    for (unsigned i = 0; i < crd->nseg_fw; i++) {
-                        int ireg         = ray.seg_index(iseg_fw) + first_reg;
-                        real_t xstr      = xstr_split_[ireg];
-                        real_t xstr_true = xstr_true_[ireg];
-                        real_t t = ang_.rsintheta * ray.seg_len(iseg_fw);
-                        real_t fluxvol =
-                            t * qbar_(ireg) +
-                            (psi1[iseg_fw] - psi1[iseg_fw + 1]) / xstr;
-                        vol_sum_(cell_fw * 2 + 0) += fluxvol;
-                        vol_norm_(cell_fw) += t;
-                        sigt_sum_(cell_fw * 2 + 0) += xstr_true * fluxvol;
-                        iseg_fw++;
-                    }
-                    // Store FW surface stuff
-                    norm_fw = (int)surface_to_normal(crd->fw);
-                    surf_fw = mesh_->coarse_surf(cell_fw, crd->fw);
-                    current(surf_fw + surf_offset_) +=
-                        psi1[iseg_fw] * current_weights_[norm_fw];
-                    surface_flux(surf_fw + surf_offset_) +=
-                        psi1[iseg_fw] * flux_weights_[norm_fw];
-                    surf_sum_(surf_fw * 2 + 0) += psi1[iseg_fw];
-                    surf_norm_(surf_fw * 2 + 0) += 1.0;
+        real_t *current      = tally_.get();
+        real_t *surface_flux = current + n_surf_;
+        real_t *surf_sum     = thread_sums_.get();
+        real_t *surf_norm    = surf_sum + 2 * n_surf_;
+        real_t *vol_sum      = surf_norm + 2 * n_surf_;
+        real_t *vol_norm     = vol_sum + 2 * n_cell_;
+        real_t *sigt_sum     = vol_norm + n_cell_;
+
+        int cell_fw = ray.cm_cell_fw();
+        int cell_bw = ray.cm_cell_bw();
+        int surf_fw = ray.cm_surf_fw();
+        int surf_bw = ray.cm_surf_bw();
+        int iseg_fw = 0;
+        int iseg_bw = ray.nseg();
+
+        // Everything is indexed within the plane. The currents are moved to
+        // their place in the whole mesh when they are reduced.
+        int norm_fw = (int)mesh_->surface_normal(surf_fw);
+        int norm_bw = (int)mesh_->surface_normal(surf_bw);
+        current[surf_fw] += psi1[iseg_fw] * current_weights_[norm_fw];
+        current[surf_bw] -= psi2[iseg_bw] * current_weights_[norm_bw];
+        surface_flux[surf_fw] += psi1[iseg_fw] * flux_weights_[norm_fw];
+        surface_flux[surf_bw] -= psi2[iseg_bw] * flux_weights_[norm_bw];
+
+        surf_sum[surf_fw * 2 + 0] += psi1[iseg_fw];
+        surf_sum[surf_bw * 2 + 1] += psi2[iseg_bw];
+        surf_norm[surf_fw * 2 + 0] += 1.0;
+        surf_norm[surf_bw * 2 + 1] += 1.0;
+
+        auto begin = ray.cm_data().cbegin();
+        auto end   = ray.cm_data().cend();
+        for (auto crd = begin; crd != end; ++crd) {
+            // Hopefully branch prediction saves me here.
+            if (crd->fw != Surface::INVALID) {
+                // Store forward volumetric stuff
+                for (unsigned i = 0; i < crd->nseg_fw; i++) {
+                    int ireg         = ray.seg_index(iseg_fw) + first_reg;
+                    real_t xstr      = xstr_split_[ireg];
+                    real_t xstr_true = xstr_true_[ireg];
+                    real_t t         = ang_.rsintheta * ray.seg_len(iseg_fw);
+                    real_t fluxvol =
+                        t * qbar_(ireg) +
+                        (psi1[iseg_fw] - psi1[iseg_fw + 1]) / xstr;
+                    vol_sum[cell_fw * 2 + 0] += fluxvol;
+                    vol_norm[cell_fw] += t;
+                    sigt_sum[cell_fw * 2 + 0] += xstr_true * fluxvol;
+                    iseg_fw++;
                 }
+                // Store FW surface stuff
+                norm_fw = (int)surface_to_normal(crd->fw);
+                surf_fw = mesh_->coarse_surf(cell_fw, crd->fw);
+                current[surf_fw] += psi1[iseg_fw] * current_weights_[norm_fw];
+                surface_flux[surf_fw] += psi1[iseg_fw] * flux_weights_[norm_fw];
+                surf_sum[surf_fw * 2 + 0] += psi1[iseg_fw];
+                surf_norm[surf_fw * 2 + 0] += 1.0;
+            }
 
-                if (crd->bw != Surface::INVALID) {
-                    // Store backward volumetric stuff
-                    for (unsigned i = 0; i < crd->nseg_bw; i++) {
-                        iseg_bw--;
-                        int ireg         = ray.seg_index(iseg_bw) + first_reg;
-                        real_t xstr      = xstr_split_[ireg];
-                        real_t xstr_true = xstr_true_[ireg];
-                        real_t t       = ang_.rsintheta * ray.seg_len(iseg_bw);
-                        real_t fluxvol = t * qbar_(ireg) +
-                                         e_tau(iseg_bw) *
-                                             (psi2[iseg_bw + 1] - qbar_(ireg)) /
-                                             xstr;
-                        vol_sum_(cell_bw * 2 + 1) += fluxvol;
-                        sigt_sum_(cell_bw * 2 + 1) += xstr_true * fluxvol;
-                    }
-                    // Store BW surface stuff
-                    norm_bw = (int)surface_to_normal(crd->bw);
-                    surf_bw = mesh_->coarse_surf(cell_bw, crd->bw);
-                    current(surf_bw + surf_offset_) -=
-                        psi2[iseg_bw] * current_weights_[norm_bw];
-                    surface_flux(surf_bw + surf_offset_) -=
-                        psi2[iseg_bw] * flux_weights_[norm_bw];
-                    surf_sum_(surf_bw * 2 + 1) += psi2[iseg_bw];
-                    surf_norm_(surf_bw * 2 + 1) += 1.0;
+            if (crd->bw != Surface::INVALID) {
+                // Store backward volumetric stuff
+                for (unsigned i = 0; i < crd->nseg_bw; i++) {
+                    iseg_bw--;
+                    int ireg         = ray.seg_index(iseg_bw) + first_reg;
+                    real_t xstr      = xstr_split_[ireg];
+                    real_t xstr_true = xstr_true_[ireg];
+                    real_t t         = ang_.rsintheta * ray.seg_len(iseg_bw);
+                    real_t fluxvol =
+                        t * qbar_(ireg) +
+                        e_tau(iseg_bw) * (psi2[iseg_bw + 1] - qbar_(ireg)) /
+                            xstr;
+                    vol_sum[cell_bw * 2 + 1] += fluxvol;
+                    sigt_sum[cell_bw * 2 + 1] += xstr_true * fluxvol;
                 }
-
-                cell_fw = mesh_->coarse_neighbor(cell_fw, (crd)->fw);
-                cell_bw = mesh_->coarse_neighbor(cell_bw, (crd)->bw);
+                // Store BW surface stuff
+                norm_bw = (int)surface_to_normal(crd->bw);
+                surf_bw = mesh_->coarse_surf(cell_bw, crd->bw);
+                current[surf_bw] -= psi2[iseg_bw] * current_weights_[norm_bw];
+                surface_flux[surf_bw] -= psi2[iseg_bw] * flux_weights_[norm_bw];
+                surf_sum[surf_bw * 2 + 1] += psi2[iseg_bw];
+                surf_norm[surf_bw * 2 + 1] += 1.0;
             }
+
+            cell_fw = mesh_->coarse_neighbor(cell_fw, (crd)->fw);
+            cell_bw = mesh_->coarse_neighbor(cell_bw, (crd)->bw);
         }
         return;
     }
 
     inline void set_angle(Angle ang, real_t spacing)
     {
-        moc::Current::set_angle(ang, spacing);
+#pragma omp single nowait
         ang_ = ang;
 
-        // Zero out all of the flux sum arrays
-        surf_sum_  = 0.0;
-        surf_norm_ = 0.0;
-        vol_sum_   = 0.0;
-        vol_norm_  = 0.0;
-        sigt_sum_  = 0.0;
-
-#pragma omp barrier
+        // Start the angle with empty sums. The barrier at the end of the base
+        // set_angle() keeps the rays from starting before this is done.
+        thread_sums_.zero();
+        moc::Current::set_angle(ang, spacing);
         return;
     }
 
+    /**
+     * \brief Sum the thread-private sums of the angle and calculate its
+     * correction factors. This must be called by all threads, once the rays
+     * of the angle are done.
+     */
     void post_angle(int iang)
     {
-#pragma omp single
-        {
-            // Do the stock area normailzation
-            moc::Current::post_angle(iang);
-
-            // Normalize the flux and sigt values and calculate
-            // correction factors for the current angle/energy
-            for (size_t i = 0; i < vol_norm_.size(); i++) {
-                sigt_sum_(2 * i + 0) /= vol_sum_(2 * i + 0);
-                sigt_sum_(2 * i + 1) /= vol_sum_(2 * i + 1);
-                vol_sum_(2 * i + 0) /= vol_norm_(i);
-                vol_sum_(2 * i + 1) /= vol_norm_(i);
-            }
-
-            // Doing area-based normalization
-            // surf_sum_ /= surf_norm_;
-
-            calculate_corrections(iang, group_);
-        }
-#pragma omp barrier
+        moc::Current::post_angle(iang);
+        real_t *data = sums_.data.data();
+        thread_sums_.reduce([&](int i, real_t v) { data[i] = v; });
+        this->calculate_corrections(iang, group_, sums_);
         return;
     }
 
@@ -268,11 +260,48 @@ private:
 
     const AngularQuadrature &ang_quad_;
 
-    ArrayB1 surf_sum_;
-    ArrayB1 vol_sum_;
-    ArrayB1 vol_norm_;
-    ArrayB1 sigt_sum_;
-    ArrayB1 surf_norm_;
+    // Number of coarse cells in a plane
+    int n_cell_;
+
+    /**
+     * \brief Sums of the angular flux over the coarse surfaces and cells of
+     * a plane, for a single angle
+     *
+     * The sums are views into one contiguous array, laid out in the same way
+     * as the thread-private buffers that they are reduced from.
+     */
+    struct AngleSums {
+        AngleSums(int n_surf, int n_cell) : data(4 * n_surf + 5 * n_cell)
+        {
+            int off   = 0;
+            auto view = [&](ArrayB1 &a, int n) {
+                a.reference(data(blitz::Range(off, off + n - 1)));
+                off += n;
+            };
+            view(surf_sum, 2 * n_surf);
+            view(surf_norm, 2 * n_surf);
+            view(vol_sum, 2 * n_cell);
+            view(vol_norm, n_cell);
+            view(sigt_sum, 2 * n_cell);
+            return;
+        }
+
+        // Copies would alias the views
+        AngleSums(const AngleSums &other) = delete;
+
+        ArrayB1 data;
+        ArrayB1 surf_sum;
+        ArrayB1 surf_norm;
+        ArrayB1 vol_sum;
+        ArrayB1 vol_norm;
+        ArrayB1 sigt_sum;
+    };
+
+    AngleSums sums_;
+
+    // Thread-private sums for the angle being swept, laid out like
+    // AngleSums::data
+    ThreadBuffers thread_sums_;
 
     Angle ang_;
 
@@ -286,7 +315,13 @@ private:
     /** \page surface_norm Surface Normalization
      * Surface normalization \todo discuss surface normalization
      */
-    void calculate_corrections(size_t ang, size_t group);
+    /**
+     * \brief Calculate the correction factors of an angle from its sums.
+     * This must be called by all threads, which split the coarse cells
+     * among themselves.
+     */
+    void calculate_corrections(size_t ang, size_t group,
+                               const AngleSums &sums);
 };
 }
 }
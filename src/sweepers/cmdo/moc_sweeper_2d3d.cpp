@@ -33,8 +33,32 @@ MoCSweeper_2D3D::MoCSweeper_2D3D(const pugi::xml_node &input,
       xstr_true_(),
       sn_xs_mesh_(nullptr),
       internal_coupling_(false),
+      correction_pipeline_(nullptr),
       correction_residuals_(n_group_)
 {
+    // The correction factors are tallied from the segments of the rays
+    // themselves
+    if (!rays_.ray_segments()) {
+        throw EXCEPT("The 2D3D MoC sweeper does not support rays traced on "
+                     "the fly.");
+    }
+
+    // The correction factors are stored for a single angular quadrature
+    if (!group_sets_.empty()) {
+        throw EXCEPT("The 2D3D MoC sweeper does not support group sets.");
+    }
+
+    // The correction worker tallies each ray at the nominal spacing
+    if (rays_.adaptive()) {
+        throw EXCEPT("The 2D3D MoC sweeper does not support adaptive ray "
+                     "spacing.");
+    }
+
+    // The correction factors are tallied by region, segment by segment
+    if (rays_.macro_segments()) {
+        throw EXCEPT("The 2D3D MoC sweeper does not support macro-segments.");
+    }
+
     if (allow_splitting_) {
         xstr_true_ = ExpandedXS(xs_mesh_.get());
     } else {
@@ -74,6 +98,8 @@ void MoCSweeper_2D3D::sweep(int group)
 
     flux_1g_.reference(flux_(all, group));
 
+    this->set_plane_mask(group);
+
     // Perform inner iterations
     for (unsigned int inner = 0; inner < n_inner_; inner++) {
         n_sweep_inner_++;
@@ -83,9 +109,23 @@ void MoCSweeper_2D3D::sweep(int group)
         // Perform the stock sweep unless we are on the last outer and have
         // a CoarseData object.
         if (inner == n_inner_ - 1 && coarse_data_) {
+            this->stash_plane_currents(group);
             coarse_data_->zero_data_radial(group);
             sn_xs_mesh_->update();
-            this->sweep1g(group, ccw);
+            corrections_->begin_group(group);
+            if (correction_pipeline_) {
+                // The Sn sweep shares the expanded cross sections. Expanding
+                // them now leaves nothing for either sweep to write once the
+                // Sn sweep begins.
+                xstr_sn_.expand(group);
+                angle_pipeline_ = correction_pipeline_;
+                correction_pipeline_->begin();
+                this->sweep1g(group, ccw);
+                angle_pipeline_ = nullptr;
+            } else {
+                this->sweep1g(group, ccw);
+            }
+            this->restore_plane_currents(group);
             coarse_data_->set_has_radial_data(true);
             correction_residuals_[group].push_back(ccw.residual());
         } else {
@@ -93,11 +133,34 @@ void MoCSweeper_2D3D::sweep(int group)
         }
     }
 
+    this->finish_plane_mask(group);
+
     timer_.toc();
     timer_sweep_.toc();
     return;
 }
 
+real_t MoCSweeper_2D3D::correction_change(int group) const
+{
+    // The first sweep of a group compares against the initial guess
+    const auto &resid = correction_residuals_[group];
+    if (resid.size() < 2 || corrections_->group_only()) {
+        return -1.0;
+    }
+
+    real_t n = corrections_->n_cell() * corrections_->n_ang();
+    real_t change =
+        std::max(resid.back()[0], std::max(resid.back()[1], resid.back()[2]));
+    return change / std::sqrt(n);
+}
+
+void MoCSweeper_2D3D::compact()
+{
+    TransportSweeper::compact();
+    rays_.compact(false);
+    return;
+}
+
 void MoCSweeper_2D3D::output(H5Node &node) const
 {
     LogFile << "MoC Sweeper 2D3D output:" << std::endl;
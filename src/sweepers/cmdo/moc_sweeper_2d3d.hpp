@@ -47,6 +47,28 @@ public:
         xstr_sn_     = xstr;
     }
 
+    /**
+     * \brief Hand the correction factors of each angle to \p pipeline as
+     * soon as they are done
+     *
+     * The sweep that calculates the correction factors then begins the
+     * pipeline once the homogenized cross sections are updated, and marks
+     * each angle done once it has been swept in all planes. The caller is
+     * responsible for finishing the pipeline after \ref sweep(). Pass null
+     * to go back to regular sweeps.
+     */
+    void set_pipeline(AnglePipeline *pipeline)
+    {
+        if (pipeline && rays_.out_of_core()) {
+            throw EXCEPT("Pipelined 2D3D MoC sweeps need in-core rays");
+        }
+        if (pipeline && pipeline->n_ang() != ang_quad_.ndir() / 2) {
+            throw EXCEPT("Pipeline does not match the angular quadrature");
+        }
+        correction_pipeline_ = pipeline;
+        return;
+    }
+
     /**
      * \brief Allocate space internally to store coupling coefficients and
      * cross sections. Mainly useful for one-way coupling.
@@ -68,6 +90,24 @@ public:
      */
     void output(H5Node &node) const;
 
+    /**
+     * \brief \copybrief moc::MoCSweeper::compact()
+     *
+     * The correction factors are tallied from the segments of the rays
+     * themselves, so only their spare capacity is released.
+     */
+    void compact() override;
+
+    /**
+     * \brief Return the RMS change in the correction factors of a group
+     * during its most recent MoC sweep.
+     *
+     * The largest of the changes in the x- and y-normal \f$\alpha\f$ and in
+     * \f$\beta\f$ is returned. If the group has not been swept twice, there
+     * is nothing to compare against, and a negative value is returned.
+     */
+    real_t correction_change(int group) const;
+
 private:
     void sweep1g_final(int group);
 
@@ -84,6 +124,10 @@ private:
 
     bool internal_coupling_;
 
+    // Consumer of the correction factors, as they are done. See
+    // set_pipeline().
+    AnglePipeline *correction_pipeline_;
+
     std::vector<std::vector<std::array<real_t, 3>>> correction_residuals_;
 };
 }
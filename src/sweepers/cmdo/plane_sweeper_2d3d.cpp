@@ -16,16 +16,23 @@
 
 #include "plane_sweeper_2d3d.hpp"
 
+#include <algorithm>
 #include <cmath>
+#include <exception>
 #include <iomanip>
 #include <iostream>
 #include <numeric>
+#include <string>
 #include "util/error.hpp"
+#include "util/omp_guard.h"
 #include "util/range.hpp"
+#include "util/string_utils.hpp"
 #include "util/validate_input.hpp"
 #include "sn_sweeper_factory_cdd.hpp"
 
 namespace {
+using namespace mocc;
+
 const std::vector<std::string> recognized_attributes = {
     "type",
     "expose_sn",
@@ -34,12 +41,34 @@ const std::vector<std::string> recognized_attributes = {
     "tl",
     "inactive_moc",
     "moc_modulo",
+    "moc_tolerance",
+    "moc_max_skip",
     "preserve_sn_quadrature",
     "relax",
     "discrepant_flux_update",
     "dump_corrections",
     "update_incoming",
-    "cycle"};
+    "cycle",
+    "angular_levels",
+    "angular_smoothing",
+    "sn_pipeline"};
+
+// Set a source to the self-scatter residual of a source iteration, which
+// took the scalar flux of a group from flux_old to flux
+void set_residual(const XSMesh &xs_mesh, int group, const ArrayB1 &flux,
+                  const ArrayB1 &flux_old, Source &source)
+{
+    for (int i = 0; i < source.n_reg(); i++) {
+        source[i] = 0.0;
+    }
+    for (int ixs = 0; ixs < (int)xs_mesh.size(); ixs++) {
+        real_t xssc = xs_mesh.self_scat(group, ixs);
+        for (int reg : xs_mesh[ixs].reg()) {
+            source[reg] = xssc * (flux(reg) - flux_old(reg));
+        }
+    }
+    return;
+}
 }
 
 namespace mocc {
@@ -69,12 +98,27 @@ PlaneSweeper_2D3D::PlaneSweeper_2D3D(const pugi::xml_node &input,
       sn_resid_(sn_sweeper_->n_group(), mesh_.n_pin()),
       prev_moc_flux_(sn_sweeper_->n_group(),
                      mesh_.n_reg(MeshTreatment::PIN_PLANE)),
+      moc_sn_discrepancy_(sn_sweeper_->n_group(), -1.0),
+      moc_skipped_(sn_sweeper_->n_group(), 0),
+      n_moc_skipped_(0),
+      n_angular_sweep_(0),
       i_outer_(-1)
 {
     validate_input(input, recognized_attributes);
     this->parse_options(input);
     core_mesh_ = &mesh;
 
+    // Storing the corrections for the current group only requires that the
+    // Sn sweep of every group consumes the factors from the MoC sweep of the
+    // same group
+    if (corrections_->group_only() &&
+        ((n_inactive_moc_ > 0) || (moc_modulo_ != 1) || v_cycle_ ||
+         (moc_tolerance_ > 0.0) || moc_sweeper_.plane_masking())) {
+        throw EXCEPT("Correction factors for only the current group may not "
+                     "be used with inactive_moc, moc_modulo, moc_tolerance, "
+                     "MoC plane masking or the V cycle.");
+    }
+
     xs_mesh_ = moc_sweeper_.get_xs_mesh();
     flux_.reference(moc_sweeper_.flux());
     vol_ = moc_sweeper_.volumes();
@@ -94,8 +138,42 @@ PlaneSweeper_2D3D::PlaneSweeper_2D3D(const pugi::xml_node &input,
 
     sn_sweeper_->get_homogenized_xsmesh()->set_flux(moc_sweeper_.flux());
 
+    if (!angular_orders_.empty()) {
+        this->setup_angular_levels(input);
+    }
+
     tl_ = 0.0;
 
+    // Tabulate the cells and axial surfaces of each pin of the macroplanes,
+    // so that the transverse leakage doesn't need to walk the mesh
+    {
+        int iplane   = 0;
+        int ireg_pin = 0;
+        int ipin     = 0;
+        for (const auto &mplane : mesh_.macroplanes()) {
+            for (const auto &mpin : mplane) {
+                TLPin pin;
+                Position pos  = mesh_.pin_position(ipin);
+                pos.z         = mplane.iz_min;
+                pin.surf_down = mesh_.coarse_surf(mesh_.coarse_cell(pos),
+                                                  Surface::BOTTOM);
+                pos.z         = mplane.iz_max;
+                pin.surf_up   = mesh_.coarse_surf(mesh_.coarse_cell(pos),
+                                                  Surface::TOP);
+                pos.z         = iplane;
+                pin.cell      = mesh_.coarse_cell(pos);
+                pin.first_reg = ireg_pin;
+                pin.n_reg     = mpin->n_reg();
+                pin.dz        = mplane.height;
+                tl_pins_.push_back(pin);
+
+                ireg_pin += mpin->n_reg();
+                ipin++;
+            }
+            iplane++;
+        }
+    }
+
     coarse_data_ = nullptr;
 
     return;
@@ -108,20 +186,27 @@ void PlaneSweeper_2D3D::sweep(int group)
         throw EXCEPT("CMFD must be enabled to do 2D3D.");
     }
 
-    /// \todo do something less brittle
-    if (group == 0) {
-        i_outer_++;
-    }
-
     // Calculate transverse leakage source
     if (do_tl_) {
         this->add_tl(group);
     }
 
-    // Do an early Sn sweep if V-cycle is enabled
+    // Do an early Sn sweep if V-cycle is enabled, corrected by the angular
+    // multigrid if there is one
     if (v_cycle_) {
+        ArrayB1 sn_flux_old;
+        if (!angular_levels_.empty()) {
+            sn_flux_old.resize(sn_sweeper_->n_reg());
+            sn_sweeper_->get_pin_flux_1g(group, sn_flux_old,
+                                         MeshTreatment::PIN);
+        }
+
         sn_sweeper_->sweep(group);
 
+        if (!angular_levels_.empty()) {
+            this->angular_correction(group, sn_flux_old);
+        }
+
         ArrayB1 sn_flux(mesh_.n_reg(MeshTreatment::PIN_PLANE));
         sn_sweeper_->get_pin_flux_1g(group, sn_flux, MeshTreatment::PIN_PLANE);
 
@@ -134,9 +219,9 @@ void PlaneSweeper_2D3D::sweep(int group)
             }
         }
         if (n_neg > 0) {
-            LogScreen << "Corrected " << n_neg
-                      << " negative fluxes in Sn projection"
-                      << "\n";
+            LogLimited("negative Sn projection",
+                       "Corrected " + std::to_string(n_neg) +
+                           " negative fluxes in Sn projection");
         }
         moc_sweeper_.set_pin_flux_1g(group, sn_flux, MeshTreatment::PIN_PLANE);
     }
@@ -145,25 +230,35 @@ void PlaneSweeper_2D3D::sweep(int group)
     bool do_moc =
         ((i_outer_ + 1) > n_inactive_moc_) && ((i_outer_ % moc_modulo_) == 0);
     if (do_moc) {
-        moc_sweeper_.sweep(group);
-
-        int n_negative  = 0;
-        int n_NaN       = 0;
-        const auto flux = moc_sweeper_.flux()(blitz::Range::all(), group);
-        for (const auto &v : flux) {
-            if (v < 0.0) {
-                n_negative++;
-            }
-            if (v != v) {
-                n_NaN++;
-            }
+        if (this->moc_needed(group)) {
+            moc_skipped_[group] = 0;
+        } else {
+            do_moc = false;
+            moc_skipped_[group]++;
+            n_moc_skipped_++;
+            LogScreen << "Skipping MoC sweep for group " << group << "\n";
         }
+    }
+    bool pipelined = do_moc && (sn_pipeline_threads_ > 0);
+    if (pipelined) {
+        this->sweep_pipelined(group);
+    } else if (do_moc) {
+        moc_sweeper_.sweep(group);
+    }
+    if (do_moc) {
+        // These are counted by the sweep itself
+        int n_negative = moc_sweeper_.n_negative_flux(group);
+        int n_NaN      = moc_sweeper_.n_nan_flux(group);
         if (n_negative > 0) {
-            LogScreen << n_negative << " negative MoC fluxes in group " << group
-                      << "\n";
+            LogLimited("negative MoC flux",
+                       std::to_string(n_negative) +
+                           " negative MoC fluxes in group " +
+                           std::to_string(group));
         }
         if (n_NaN > 0) {
-            LogScreen << n_NaN << " NaN MoC fluxes in group " << group << "\n";
+            LogLimited("NaN MoC flux", std::to_string(n_NaN) +
+                                           " NaN MoC fluxes in group " +
+                                           std::to_string(group));
         }
     }
 
@@ -175,8 +270,10 @@ void PlaneSweeper_2D3D::sweep(int group)
         sn_sweeper_->set_pin_flux_1g(group, prev_moc_flux);
     }
 
-    // Sn sweeper
-    sn_sweeper_->sweep(group);
+    // Sn sweeper, unless it already ran alongside the MoC sweeper
+    if (!pipelined) {
+        sn_sweeper_->sweep(group);
+    }
 
     ArrayB1 sn_flux(mesh_.n_reg(MeshTreatment::PIN_PLANE));
     sn_sweeper_->get_pin_flux_1g(group, sn_flux, MeshTreatment::PIN_PLANE);
@@ -191,20 +288,24 @@ void PlaneSweeper_2D3D::sweep(int group)
             }
         }
         if (n_neg > 0) {
-            LogScreen << "Corrected " << n_neg
-                      << " negative fluxes in Sn projection"
-                      << "\n";
+            LogLimited("negative Sn projection",
+                       "Corrected " + std::to_string(n_neg) +
+                           " negative fluxes in Sn projection");
         }
         moc_sweeper_.set_pin_flux_1g(group, sn_flux, MeshTreatment::PIN_PLANE);
     }
 
     // Compute Sn-MoC residual
     real_t residual = 0.0;
+    real_t sn_norm  = 0.0;
     for (int i = 0; i < (int)prev_moc_flux.size(); i++) {
         real_t diff = prev_moc_flux(i) - sn_flux(i);
         residual += diff * diff;
+        sn_norm += sn_flux(i) * sn_flux(i);
         sn_resid_(group, i) = diff;
     }
+    moc_sn_discrepancy_[group] =
+        (sn_norm > 0.0) ? std::sqrt(residual / sn_norm) : 0.0;
     residual = sqrt(residual) / mesh_.n_pin();
 
     LogScreen << "MoC/Sn residual: " << residual;
@@ -216,11 +317,285 @@ void PlaneSweeper_2D3D::sweep(int group)
     sn_resid_norm_[group].push_back(residual);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+void PlaneSweeper_2D3D::sweep_pipelined(int group)
+{
+    int n_threads = omp_get_max_threads();
+    int n_sn      = std::min(sn_pipeline_threads_, std::max(n_threads - 1, 1));
+    int n_moc     = std::max(n_threads - n_sn, 1);
+
+    pipeline_.reset(ang_quad_.ndir() / 2);
+    moc_sweeper_.set_pipeline(&pipeline_);
+    sn_sweeper_->set_pipeline(&pipeline_);
+
+    // Each sweep starts parallel regions of its own, which may nest more
+    int max_levels = omp_get_max_active_levels();
+    omp_set_max_active_levels(std::max(max_levels, 3));
+    std::exception_ptr error;
+#pragma omp parallel sections num_threads(2)
+    {
+        // The MoC sweep comes first, so that a single thread still gets
+        // through both sections
+#pragma omp section
+        {
+            omp_set_num_threads(n_moc);
+            try {
+                moc_sweeper_.sweep(group);
+            } catch (...) {
+#pragma omp critical
+                error = std::current_exception();
+            }
+            // Release the Sn sweep, even if the MoC sweep failed
+            pipeline_.finish();
+        }
+#pragma omp section
+        {
+            omp_set_num_threads(n_sn);
+            try {
+                sn_sweeper_->sweep(group);
+            } catch (...) {
+#pragma omp critical
+                error = std::current_exception();
+            }
+        }
+    }
+    omp_set_max_active_levels(max_levels);
+
+    moc_sweeper_.set_pipeline(nullptr);
+    sn_sweeper_->set_pipeline(nullptr);
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool PlaneSweeper_2D3D::moc_needed(int group) const
+{
+    if (moc_tolerance_ <= 0.0) {
+        return true;
+    }
+
+    // Keep sweeping until there is a MoC-Sn discrepancy and a change in the
+    // correction factors to go on
+    real_t correction_change = moc_sweeper_.correction_change(group);
+    if ((moc_sn_discrepancy_[group] < 0.0) || (correction_change < 0.0)) {
+        return true;
+    }
+
+    // Don't let the corrections go stale forever
+    if (moc_skipped_[group] >= moc_max_skip_) {
+        return true;
+    }
+
+    // The discrepancy keeps being measured while MoC is skipped, so a group
+    // whose Sn solution starts to move again will be picked back up. The
+    // correction change is only updated when MoC runs.
+    return (moc_sn_discrepancy_[group] > moc_tolerance_) ||
+           (correction_change > moc_tolerance_);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void PlaneSweeper_2D3D::setup_angular_levels(const pugi::xml_node &input)
+{
+    const pugi::xml_node sn_input = input.child("sn_sweeper");
+
+    // The residual handed to the coarse levels is that of a single source
+    // iteration, and the corrections that they solve for may be negative
+    if (!sn_input.child("data").empty()) {
+        throw EXCEPT("Angular multigrid levels may not be used with Sn "
+                     "<data>.");
+    }
+    if (sn_input.attribute("n_inner").as_int(-1) != 1) {
+        throw EXCEPT("Angular multigrid levels require n_inner=\"1\" on "
+                     "the Sn sweeper.");
+    }
+    std::string axial = sn_input.attribute("axial").value();
+    sanitize(axial);
+    if (axial == "dd_ff") {
+        throw EXCEPT("Angular multigrid levels may not be used with the "
+                     "negative flux fixup.");
+    }
+    if (sn_sweeper_->group_block() > 1) {
+        throw EXCEPT("Angular multigrid levels may not be used with the "
+                     "multi-group Sn kernel.");
+    }
+
+    // Each level is made from a copy of the Sn sweeper input, with a
+    // level-symmetric quadrature of its own. A level only ever needs the
+    // correction factors of the group being swept, and is swept one source
+    // iteration at a time.
+    pugi::xml_document level_doc;
+    pugi::xml_node level_input = level_doc.append_copy(sn_input);
+    level_input.remove_child("ang_quad");
+    level_input.remove_attribute("dump_corrections");
+    level_input.attribute("n_inner") = 1;
+    pugi::xml_node corrections = level_input.child("corrections");
+    if (corrections.empty()) {
+        corrections = level_input.append_child("corrections");
+    }
+    corrections.remove_attribute("storage");
+    corrections.append_attribute("storage") = "group";
+    pugi::xml_node quad_input = level_input.append_child("ang_quad");
+    quad_input.append_attribute("type") = "ls";
+    pugi::xml_attribute order   = quad_input.append_attribute("order");
+
+    const AngularQuadrature *fine_quad = &sn_sweeper_->ang_quad();
+    for (int level_order : angular_orders_) {
+        order = level_order;
+        LogScreen << "Angular multigrid level with S" << level_order
+                  << " quadrature\n";
+
+        CDDPair_t cdd_pair = SnSweeperFactory_CDD(level_input, mesh_);
+        AngularLevel level;
+        level.sweeper     = std::move(cdd_pair.first);
+        level.corrections = cdd_pair.second;
+
+        const AngularQuadrature &quad = level.sweeper->ang_quad();
+        if (quad.ndir() >= fine_quad->ndir()) {
+            throw EXCEPT("Each angular multigrid level must have fewer "
+                         "angles than the next finer one.");
+        }
+
+        // Restrict the correction factors of each angle from the closest
+        // angle of the finer level
+        int n_ang      = quad.ndir() / 2;
+        int n_ang_fine = fine_quad->ndir() / 2;
+        for (int iang = 0; iang < n_ang; iang++) {
+            const Angle &angle = quad[iang];
+            int closest        = 0;
+            real_t max_cos     = -2.0;
+            for (int ifine = 0; ifine < n_ang_fine; ifine++) {
+                const Angle &fine = (*fine_quad)[ifine];
+                real_t cos = angle.ox * fine.ox + angle.oy * fine.oy +
+                             angle.oz * fine.oz;
+                if (cos > max_cos) {
+                    max_cos = cos;
+                    closest = ifine;
+                }
+            }
+            level.fine_angle.push_back(closest);
+        }
+
+        level.sweeper->get_homogenized_xsmesh()->set_flux(
+            moc_sweeper_.flux());
+        level.sweeper->set_negative_fixup(false);
+        level.source = std::make_unique<SourceIsotropic>(
+            level.sweeper->n_reg(), &level.sweeper->xs_mesh(),
+            level.sweeper->flux());
+        level.sweeper->assign_source(level.source.get());
+
+        angular_levels_.push_back(std::move(level));
+        fine_quad = &angular_levels_.back().sweeper->ang_quad();
+    }
+
+    return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void PlaneSweeper_2D3D::angular_correction(int group, const ArrayB1 &flux_old)
+{
+    assert(!angular_levels_.empty());
+    int n_reg = sn_sweeper_->n_reg();
+    ArrayB1 flux(n_reg);
+    sn_sweeper_->get_pin_flux_1g(group, flux, MeshTreatment::PIN);
+
+    set_residual(sn_sweeper_->xs_mesh(), group, flux, flux_old,
+                 *angular_levels_.front().source);
+    this->angular_cycle(0, group);
+
+    // The levels share the spatial mesh, so the correction is prolonged by
+    // adding it to the scalar flux
+    ArrayB1 correction(n_reg);
+    angular_levels_.front().sweeper->get_pin_flux_1g(group, correction,
+                                                     MeshTreatment::PIN);
+    int n_neg = 0;
+    for (int i = 0; i < n_reg; i++) {
+        flux(i) += correction(i);
+        if (flux(i) < 0.0) {
+            n_neg++;
+            flux(i) = 0.0;
+        }
+    }
+    if (n_neg > 0) {
+        LogLimited("negative angular multigrid flux",
+                   "Corrected " + std::to_string(n_neg) +
+                       " negative fluxes after angular multigrid");
+    }
+    sn_sweeper_->set_pin_flux_1g(group, flux);
+
+    return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void PlaneSweeper_2D3D::angular_cycle(int ilevel, int group)
+{
+    AngularLevel &level = angular_levels_[ilevel];
+    const CorrectionData &fine_corrections =
+        (ilevel == 0) ? *corrections_
+                      : *angular_levels_[ilevel - 1].corrections;
+
+    // Restrict the correction factors from the finer level
+    CorrectionData &corrections = *level.corrections;
+    corrections.begin_group(group);
+    int n_ang  = corrections.n_ang();
+    int n_cell = corrections.n_cell();
+#pragma omp parallel for
+    for (int reg = 0; reg < n_cell; reg++) {
+        for (int iang = 0; iang < n_ang; iang++) {
+            int ifine = level.fine_angle[iang];
+            corrections.set_alpha(
+                reg, iang, group, Normal::X_NORM,
+                fine_corrections.alpha(reg, ifine, group, Normal::X_NORM));
+            corrections.set_alpha(
+                reg, iang, group, Normal::Y_NORM,
+                fine_corrections.alpha(reg, ifine, group, Normal::Y_NORM));
+            corrections.set_beta(reg, iang, group,
+                                 fine_corrections.beta(reg, ifine, group));
+        }
+    }
+
+    // The correction starts from zero, with no incoming flux, and is
+    // smoothed by a few source iterations
+    int n_reg = level.sweeper->n_reg();
+    ArrayB1 flux(n_reg);
+    ArrayB1 flux_old(n_reg);
+    flux = 0.0;
+    level.sweeper->set_pin_flux_1g(group, flux);
+    level.sweeper->zero_boundary(group);
+    for (int i = 0; i < angular_smooth_; i++) {
+        flux_old = flux;
+        level.sweeper->sweep(group);
+        level.sweeper->get_pin_flux_1g(group, flux, MeshTreatment::PIN);
+    }
+    n_angular_sweep_ += angular_smooth_;
+
+    // Hand the residual of the last source iteration to the next coarser
+    // level, and add its correction
+    if (ilevel + 1 < (int)angular_levels_.size()) {
+        AngularLevel &coarse = angular_levels_[ilevel + 1];
+        set_residual(level.sweeper->xs_mesh(), group, flux, flux_old,
+                     *coarse.source);
+        this->angular_cycle(ilevel + 1, group);
+
+        ArrayB1 correction(n_reg);
+        coarse.sweeper->get_pin_flux_1g(group, correction,
+                                        MeshTreatment::PIN);
+        flux += correction;
+        level.sweeper->set_pin_flux_1g(group, flux);
+    }
+
+    return;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 void PlaneSweeper_2D3D::initialize()
 {
     sn_sweeper_->initialize();
     moc_sweeper_.initialize();
+    for (auto &level : angular_levels_) {
+        level.sweeper->initialize();
+    }
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -245,40 +620,104 @@ void PlaneSweeper_2D3D::add_tl(int group)
 
     blitz::Array<real_t, 1> tl_g = tl_(group, blitz::Range::all());
 
-    int iplane   = 0;
-    int ireg_pin = 0;
-    int ipin     = 0;
-    for (const auto &mplane : mesh_.macroplanes()) {
-        real_t dz = mplane.height;
-        for (const auto &mpin : mplane) {
-            Position pos  = mesh_.pin_position(ipin);
-            pos.z         = mplane.iz_min;
-            size_t icell  = mesh_.coarse_cell(pos);
-            int surf_down = mesh_.coarse_surf(icell, Surface::BOTTOM);
-            pos.z         = mplane.iz_max;
-            icell         = mesh_.coarse_cell(pos);
-            int surf_up   = mesh_.coarse_surf(icell, Surface::TOP);
-            // Get index for storing in tl_ array
-            pos.z       = iplane;
-            int icoarse = mesh_.coarse_cell(pos);
-
-            real_t j_up   = coarse_data_->current(surf_up, group);
-            real_t j_down = coarse_data_->current(surf_down, group);
-            tl_g(icoarse) =
-                tl_g(icoarse) * (1.0 - relax_) + relax_ * (j_down - j_up) / dz;
-            for (int ir = 0; ir < mpin->n_reg(); ir++) {
-                tl_fsr(ireg_pin) = tl_g(icoarse);
-                ireg_pin++;
-            }
-            ipin++;
+    const int n_pin = tl_pins_.size();
+#pragma omp parallel for schedule(static)
+    for (int ip = 0; ip < n_pin; ip++) {
+        const auto &pin = tl_pins_[ip];
+        real_t j_up     = coarse_data_->current(pin.surf_up, group);
+        real_t j_down   = coarse_data_->current(pin.surf_down, group);
+        real_t tl_new   = (j_down - j_up) / pin.dz;
+        real_t tl       = tl_g(pin.cell) * (1.0 - relax_) + relax_ * tl_new;
+        tl_g(pin.cell)  = tl;
+        for (int ir = 0; ir < pin.n_reg; ir++) {
+            tl_fsr(pin.first_reg + ir) = tl;
         }
-        iplane++;
     }
 
     // Hand the transverse leakage to the MoC sweeper.
     moc_sweeper_.apply_transverse_leakage(group, tl_fsr);
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void PlaneSweeper_2D3D::write_checkpoint(H5Node &node) const
+{
+    {
+        auto g = node.create_group("sn");
+        sn_sweeper_->write_checkpoint(g);
+    }
+    {
+        auto g = node.create_group("moc");
+        moc_sweeper_.write_checkpoint(g);
+    }
+    node.write("sn_resid", sn_resid_);
+    node.write("prev_moc_flux", prev_moc_flux_);
+    node.write("i_outer", i_outer_);
+    return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void PlaneSweeper_2D3D::read_checkpoint(H5Node &node)
+{
+    {
+        auto g = node["sn"];
+        sn_sweeper_->read_checkpoint(g);
+    }
+    {
+        auto g = node["moc"];
+        moc_sweeper_.read_checkpoint(g);
+    }
+    node.read("sn_resid", sn_resid_);
+    node.read("prev_moc_flux", prev_moc_flux_);
+    node.read("i_outer", i_outer_);
+    return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void PlaneSweeper_2D3D::output_performance(H5Node &node) const
+{
+    {
+        auto g = node.create_group("sn");
+        sn_sweeper_->output_performance(g);
+    }
+    {
+        auto g = node.create_group("moc");
+        moc_sweeper_.output_performance(g);
+    }
+    node.write("moc_skipped_sweeps", n_moc_skipped_);
+    if (!angular_levels_.empty()) {
+        node.write("angular_multigrid_sweeps", n_angular_sweep_);
+    }
+    return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void PlaneSweeper_2D3D::compact()
+{
+    TransportSweeper::compact();
+    sn_sweeper_->compact();
+    moc_sweeper_.compact();
+    return;
+}
+
+void PlaneSweeper_2D3D::memory(MemoryReport &report) const
+{
+    TransportSweeper::memory(report);
+    sn_sweeper_->memory(report.child("sn"));
+    moc_sweeper_.memory(report.child("moc"));
+    report.add("corrections", corrections_->memory());
+    for (int i = 0; i < (int)angular_levels_.size(); i++) {
+        const auto &level = angular_levels_[i];
+        auto &level_report =
+            report.child("angular_level_" + std::to_string(i + 1));
+        level.sweeper->memory(level_report);
+        level_report.add("corrections", level.corrections->memory());
+        level_report.add("source", level.source->memory());
+    }
+    report.add("projection", bytes(tl_) + bytes(sn_resid_) +
+                                 bytes(prev_moc_flux_) + bytes(tl_pins_));
+    return;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 void PlaneSweeper_2D3D::output(H5Node &file) const
 {
@@ -368,10 +807,14 @@ void PlaneSweeper_2D3D::parse_options(const pugi::xml_node &input)
     do_tl_                  = true;
     n_inactive_moc_         = 0;
     moc_modulo_             = 1;
+    moc_tolerance_          = 0.0;
+    moc_max_skip_           = 5;
     relax_                  = 1.0;
     discrepant_flux_update_ = false;
     dump_corrections_       = false;
     v_cycle_                = false;
+    sn_pipeline_threads_    = 0;
+    angular_smooth_         = 2;
 
     // Override with entries in the input node
     if (!input.attribute("expose_sn").empty()) {
@@ -392,6 +835,14 @@ void PlaneSweeper_2D3D::parse_options(const pugi::xml_node &input)
     if (!input.attribute("moc_modulo").empty()) {
         moc_modulo_ = input.attribute("moc_modulo").as_int();
     }
+    moc_tolerance_ = input.attribute("moc_tolerance").as_double(0.0);
+    if (moc_tolerance_ < 0.0) {
+        throw EXCEPT("moc_tolerance must be non-negative");
+    }
+    moc_max_skip_ = input.attribute("moc_max_skip").as_int(5);
+    if (moc_max_skip_ < 0) {
+        throw EXCEPT("moc_max_skip must be non-negative");
+    }
     if (!input.attribute("preserve_sn_quadrature").empty()) {
         keep_sn_quad_ = input.attribute("preserve_sn_quadrature").as_bool();
     }
@@ -414,6 +865,27 @@ void PlaneSweeper_2D3D::parse_options(const pugi::xml_node &input)
             throw EXCEPT("Unrecognized cycle attribute");
         }
     }
+    if (!input.attribute("angular_levels").empty()) {
+        angular_orders_ =
+            explode_string<int>(input.attribute("angular_levels").value());
+        if (!v_cycle_) {
+            throw EXCEPT("Angular multigrid levels require the V cycle.");
+        }
+    }
+    angular_smooth_ = input.attribute("angular_smoothing").as_int(2);
+    if (angular_smooth_ < 1) {
+        throw EXCEPT("angular_smoothing must be positive");
+    }
+    sn_pipeline_threads_ = input.attribute("sn_pipeline").as_int(0);
+    if (sn_pipeline_threads_ < 0) {
+        throw EXCEPT("sn_pipeline must be non-negative");
+    }
+    // The Sn sweep starts before the MoC flux is done, and must use the same
+    // angles as the correction factors
+    if ((sn_pipeline_threads_ > 0) && (do_mocproject_ || keep_sn_quad_)) {
+        throw EXCEPT("sn_pipeline may not be used with moc_project or "
+                     "preserve_sn_quadrature.");
+    }
 
     // Make sure that sn project is on if we are exposing sn
     if (expose_sn_ && !do_snproject_) {
@@ -439,8 +911,11 @@ void PlaneSweeper_2D3D::parse_options(const pugi::xml_node &input)
     LogFile << "    Relaxation factor: " << relax_ << "\n";
     LogFile << "    Inactive MoC Outer Iterations: " << n_inactive_moc_ << "\n";
     LogFile << "    MoC sweep modulo: " << moc_modulo_ << "\n";
+    LogFile << "    Adaptive MoC tolerance: " << moc_tolerance_ << "\n";
+    LogFile << "    Adaptive MoC maximum skips: " << moc_max_skip_ << "\n";
     LogFile << "    Apply Sn-MoC flux residual to CMFD updates: "
             << discrepant_flux_update_ << "\n";
+    LogFile << "    Sn pipeline threads: " << sn_pipeline_threads_ << "\n";
     LogFile << "    Sweep cycle: ";
     if (v_cycle_) {
         LogFile << "V"
@@ -449,6 +924,15 @@ void PlaneSweeper_2D3D::parse_options(const pugi::xml_node &input)
         LogFile << "Sawtooth"
                 << "\n";
     }
+    if (!angular_orders_.empty()) {
+        LogFile << "    Angular multigrid orders:";
+        for (int order : angular_orders_) {
+            LogFile << " S" << order;
+        }
+        LogFile << "\n";
+        LogFile << "    Angular multigrid sweeps per level: "
+                << angular_smooth_ << "\n";
+    }
 }
 }
 } // Namespace mocc::cmdo
@@ -17,10 +17,12 @@
 #pragma once
 
 #include <blitz/array.h>
+#include "util/angle_pipeline.hpp"
 #include "util/global_config.hpp"
 #include "util/pugifwd.hpp"
 #include "core/angular_quadrature.hpp"
 #include "core/output_interface.hpp"
+#include "core/source_isotropic.hpp"
 #include "sn/sn_sweeper_variant.hpp"
 #include "correction_data.hpp"
 #include "moc_sweeper_2d3d.hpp"
@@ -43,6 +45,18 @@ public:
 
     void initialize() override final;
 
+    /**
+     * \brief \copybrief mocc::TransportSweeper::initialize_boundary()
+     *
+     * This delegates to both contained sweepers.
+     */
+    void initialize_boundary(const ArrayB1 &spectrum) override final
+    {
+        sn_sweeper_->initialize_boundary(spectrum);
+        moc_sweeper_.initialize_boundary(spectrum);
+        return;
+    }
+
     /**
      * \brief \copybrief mocc::TransportSweeper::update_incoming_flux()
      *
@@ -99,6 +113,39 @@ public:
      */
     void output(H5Node &file) const override final;
 
+    /**
+     * \copybrief TransportSweeper::write_checkpoint()
+     *
+     * The Sn and MoC sweepers store their state in their own groups, along
+     * with the Sn-MoC residual and the previous MoC flux, which are used by
+     * the flux projection.
+     */
+    void write_checkpoint(H5Node &node) const override final;
+
+    void read_checkpoint(H5Node &node) override final;
+
+    /**
+     * \copybrief TransportSweeper::output_performance()
+     *
+     * The Sn and MoC sweepers write their metrics to their own groups.
+     */
+    void output_performance(H5Node &node) const override final;
+
+    /**
+     * \copybrief TransportSweeper::memory()
+     *
+     * The Sn and MoC sweepers report to their own children. The correction
+     * factors are shared between the two, so they are reported once, here.
+     */
+    void memory(MemoryReport &report) const override final;
+
+    /**
+     * \copybrief TransportSweeper::compact()
+     *
+     * Compacts the Sn and MoC sweepers.
+     */
+    void compact() override final;
+
     /**
      * \brief \copybrief TransportSweeper::assign_source()
      *
@@ -200,13 +247,38 @@ public:
         }
     }
 
+    /**
+     * \brief \copybrief TransportSweeper::fission_update()
+     *
+     * The fission source is that of \ref calc_fission_source(), and the
+     * totals those of \ref total_fission().
+     */
+    FissionTotals fission_update(real_t k, ArrayB1 &fission_source) const
+        override final
+    {
+        assert((int)fission_source.size() ==
+               moc_sweeper_.n_reg() + sn_sweeper_->n_reg());
+
+        ArrayB1 sn_fission_source(
+            fission_source(blitz::Range(0, sn_sweeper_->n_reg() - 1)));
+        ArrayB1 moc_fission_source(
+            fission_source(blitz::Range(sn_sweeper_->n_reg(), blitz::toEnd)));
+        auto sn  = sn_sweeper_->fission_update(k, sn_fission_source);
+        auto moc = moc_sweeper_.fission_update(k, moc_fission_source);
+
+        return expose_sn_ ? sn : moc;
+    }
+
     /**
      * \brief \copybrief TransportSweeper::store_old_flux()
      *
-     * Defer to the MoC and Sn sweepers.
+     * Defer to the MoC and Sn sweepers. This is called once at the beginning
+     * of each outer iteration, so it is also where the outer iterations are
+     * counted.
      */
     void store_old_flux() override final
     {
+        i_outer_++;
         moc_sweeper_.store_old_flux();
         sn_sweeper_->store_old_flux();
         return;
@@ -235,6 +307,21 @@ private:
     // Calculate transverse leakage based on the state of the coarse_data_
     // and apply to the MoC sweeper's source.
     void add_tl(int group);
+    // Decide whether a group that is due for a MoC sweep actually needs one,
+    // based on how much it changed last time.
+    bool moc_needed(int group) const;
+    // Run the MoC and Sn sweeps of a group side by side, with the Sn sweep
+    // of each angle waiting on its correction factors from the MoC sweep
+    void sweep_pipelined(int group);
+    // Build the angle-coarse levels of the angular multigrid, one for each
+    // of the level-symmetric orders in angular_orders_
+    void setup_angular_levels(const pugi::xml_node &input);
+    // Correct the Sn flux of a group with the angular multigrid, given its
+    // flux from before the latest Sn sweep
+    void angular_correction(int group, const ArrayB1 &flux_old);
+    // Solve for the flux correction on an angular multigrid level, whose
+    // source holds the residual of the next finer level
+    void angular_cycle(int ilevel, int group);
 
     const CoreMesh &mesh_;
 
@@ -245,11 +332,40 @@ private:
     std::shared_ptr<CorrectionData> corrections_;
     MoCSweeper_2D3D moc_sweeper_;
     AngularQuadrature ang_quad_;
+
+    // One angle-coarse level of the angular multigrid. Each level has its
+    // own Sn sweeper, with correction factors restricted from the next finer
+    // level and a source holding the residual of that level.
+    struct AngularLevel {
+        UP_SnSweeper_t sweeper;
+        std::shared_ptr<CorrectionData> corrections;
+        std::unique_ptr<SourceIsotropic> source;
+        // The nearest 2-D angle of the next finer level to each 2-D angle of
+        // this one
+        VecI fine_angle;
+    };
+    // Angular multigrid levels, from the finest to the coarsest. Empty
+    // unless requested.
+    std::vector<AngularLevel> angular_levels_;
     // Pin-level transverse leakage. This is in coarse mesh ordering (at the
     // macroplane axial refinement) for easy output to HDF5, since it is
     // interacted with from the MoC side in expanded FSR space anyways
     ArrayB2 tl_;
 
+    // Each pin of the macroplanes, in the same order as the MoC flat source
+    // regions: its coarse cell in tl_, the coarse surfaces bounding its
+    // macroplane from below and above, the range of its flat source regions
+    // and the height of its macroplane
+    struct TLPin {
+        int cell;
+        int surf_down;
+        int surf_up;
+        int first_reg;
+        int n_reg;
+        real_t dz;
+    };
+    std::vector<TLPin> tl_pins_;
+
     // L-2 norm of the Sn-MoC residuals by group sweep
     std::vector<VecF> sn_resid_norm_;
 
@@ -260,6 +376,22 @@ private:
     // residual
     ArrayB2 prev_moc_flux_;
 
+    // Most recent MoC-Sn pin flux discrepancy of each group, relative to the
+    // Sn flux. Negative until the group has been swept.
+    VecF moc_sn_discrepancy_;
+
+    // Number of consecutive outer iterations that each group has skipped the
+    // MoC sweep, and the total number of skipped group sweeps
+    VecI moc_skipped_;
+    int n_moc_skipped_;
+
+    // Total number of sweeps on the angular multigrid levels
+    int n_angular_sweep_;
+
+    // Hands the 2-D angles of a pipelined sweep from the MoC sweeper to the
+    // Sn sweeper. See sweep_pipelined().
+    AnglePipeline pipeline_;
+
     // Outer iteration index. Starts at -1 and is incremented whenever group
     // 0 is swept. This is kind of brittle.
     int i_outer_;
@@ -282,6 +414,13 @@ private:
     // Number of outer iterations to skip MoC. Super experimental
     int n_inactive_moc_;
     int moc_modulo_;
+    // Tolerance on the MoC-Sn discrepancy and correction factor change,
+    // below which a group skips its MoC sweep. Zero disables the adaptive
+    // MoC sweeps.
+    real_t moc_tolerance_;
+    // Maximum number of consecutive outer iterations that a group may skip
+    // the MoC sweep
+    int moc_max_skip_;
     // Relaxation factor for the flux updates
     real_t relax_;
     // Whether to incorporate MoC/Sn error in CMFD flux update
@@ -290,6 +429,13 @@ private:
     bool dump_corrections_;
     // Whether to use a sawtooth or V cycle in the sweep
     bool v_cycle_;
+    // Number of threads given to the Sn sweep when it is pipelined behind
+    // the MoC sweep. Zero sweeps one after the other.
+    int sn_pipeline_threads_;
+    // Level-symmetric orders of the angular multigrid levels, from the
+    // finest to the coarsest, and the number of sweeps on each level
+    VecI angular_orders_;
+    int angular_smooth_;
 };
 }
 } // Namespace mocc::cmdo
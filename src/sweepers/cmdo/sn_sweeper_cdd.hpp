@@ -16,13 +16,13 @@
 
 #pragma once
 
+#include <atomic>
 #include <memory>
 #include "util/files.hpp"
 #include "util/force_inline.hpp"
 #include "util/pugifwd.hpp"
 #include "core/core_mesh.hpp"
 #include "core/exponential.hpp"
-#include "sn/cell_worker.hpp"
 #include "sn/sn_sweeper.hpp"
 #include "sn/sn_sweeper_variant.hpp"
 #include "correction_data.hpp"
@@ -78,27 +78,51 @@ public:
         real_t &flux_x, real_t &flux_y, real_t q, real_t xstr, int i,
         const typename SnSweeperVariant<Equation>::ThreadState &t_state) const
     {
-        int ix    = i % this->mesh_.nx();
-        real_t tx = t_state.ox / this->mesh_.dx(ix);
+        real_t tx = t_state.tx;
 
-        real_t ax = corrections_->alpha(i, t_state.iang_2d, this->group_,
-                                        Normal::X_NORM);
-        real_t ay = corrections_->alpha(i, t_state.iang_2d, this->group_,
-                                        Normal::Y_NORM);
-        real_t b = corrections_->beta(i, t_state.iang_2d, this->group_);
-
-        real_t gx = ax * b;
-        real_t gy = ay * b;
+        const real_t *f = this->cdd_factors(i, t_state.iang_2d);
+        real_t rgx      = f[0];
+        real_t rgy      = f[1];
 
         real_t psi = q + 2.0 * (tx * flux_x + t_state.ty * flux_y);
-        psi /= tx / gx + t_state.ty / gy + xstr;
+        psi /= tx * rgx + t_state.ty * rgy + xstr;
 
-        flux_x = (psi - gx * flux_x) / gx;
-        flux_y = (psi - gy * flux_y) / gy;
+        flux_x = psi * rgx - flux_x;
+        flux_y = psi * rgy - flux_y;
 
         return psi;
     }
 
+    void evaluate_batch_2d(real_t *flux_x, real_t *flux_y, const real_t *q,
+                           real_t xstr, int i,
+                           const typename SnSweeperVariant<Equation>::AngleBatch
+                               &batch,
+                           real_t *psi) const
+    {
+        const int n      = batch.size;
+        const real_t rdx = batch.rdx;
+        const real_t rdy = batch.rdy;
+        const real_t *factors = this->cdd_factors(i, 0);
+        const int stride      = 2 * ang_stride_;
+#pragma omp simd
+        for (int ia = 0; ia < n; ia++) {
+            real_t tx = batch.ox[ia] * rdx;
+            real_t ty = batch.oy[ia] * rdy;
+
+            const real_t *f = &factors[stride * batch.iang_2d[ia]];
+            real_t rgx      = f[0];
+            real_t rgy      = f[1];
+
+            real_t p = q[ia] + 2.0 * (tx * flux_x[ia] + ty * flux_y[ia]);
+            p /= tx * rgx + ty * rgy + xstr;
+
+            flux_x[ia] = p * rgx - flux_x[ia];
+            flux_y[ia] = p * rgy - flux_y[ia];
+            psi[ia]    = p;
+        }
+        return;
+    }
+
     /**
      * \brief Associate the internal reference to correction data.
      *
@@ -113,6 +137,93 @@ public:
         corrections_ = data;
     }
 
+    /**
+     * \brief Tabulate the corrected diamond difference factors for a group
+     *
+     * The cell updates use the reciprocals of alpha*beta for each normal.
+     * Rather than looking up and dividing by these for each cell and angle
+     * of each inner iteration, they are formed once per group sweep and
+     * stored in a dense table, ordered the way the sweep kernel visits them.
+     * The kernels that sweep one angle at a time see the table as
+     * [angle][region][normal], so that an angle's factors stream along with
+     * the cells. The octant kernel updates a batch of angles in each cell, so
+     * it gets [region][angle][normal], and the factors of a batch are
+     * adjacent.
+     *
+     * The corrections of a pipelined sweep come in one angle at a time, so
+     * the factors of each angle are left to \ref prepare_angle().
+     */
+    void prepare_group(int group)
+    {
+        assert(corrections_);
+        const CorrectionData &corr = *corrections_;
+        const int n_ang            = corr.n_ang();
+        const int n_reg            = corr.n_cell();
+        // The device sweep has its own kernel, which wants the angle-major
+        // table
+        bool region_major =
+            (this->sweep_mode_ == SnSweeper::SweepMode::OCTANT) &&
+            !this->device_;
+        ang_stride_ = region_major ? 1 : n_reg;
+        reg_stride_ = region_major ? n_ang : 1;
+        cdd_factors_.resize(2 * n_ang * n_reg);
+
+        if (this->pipeline_) {
+            angle_state_.reset(new std::atomic<int>[n_ang]);
+            for (int iang = 0; iang < n_ang; iang++) {
+                angle_state_[iang].store(0, std::memory_order_relaxed);
+            }
+            return;
+        }
+
+#pragma omp parallel for
+        for (int iang = 0; iang < n_ang; iang++) {
+            this->tabulate_angle(group, iang);
+        }
+        return;
+    }
+
+    /**
+     * \brief Tabulate the factors of a 2-D angle for a pipelined sweep
+     *
+     * Every thread that sweeps one of the 3-D angles of \p iang_2d calls
+     * this. The first one in tabulates the factors, and the others wait for
+     * it to finish.
+     */
+    void prepare_angle(int group, int iang_2d)
+    {
+        if (!this->pipeline_) {
+            return;
+        }
+        std::atomic<int> &state = angle_state_[iang_2d];
+        int expected            = 0;
+        if (state.compare_exchange_strong(expected, 1,
+                                          std::memory_order_acquire)) {
+            this->tabulate_angle(group, iang_2d);
+            state.store(2, std::memory_order_release);
+        } else {
+            while (state.load(std::memory_order_acquire) != 2) {
+            }
+        }
+        return;
+    }
+
+    /**
+     * \brief Return the reciprocal x- and y-normal correction factors of a
+     * region and 2-D angle, as tabulated by \ref prepare_group()
+     */
+    MOCC_FORCE_INLINE const real_t *cdd_factors(int reg, int iang_2d) const
+    {
+        return &cdd_factors_[2 * (iang_2d * ang_stride_ + reg * reg_stride_)];
+    }
+
+    void memory(MemoryReport &report) const override
+    {
+        SnSweeper::memory(report);
+        report.add("cdd_factors", bytes(cdd_factors_));
+        return;
+    }
+
     void output(H5Node &node) const
     {
         SnSweeper::output(node);
@@ -125,8 +236,34 @@ protected:
     std::shared_ptr<const CorrectionData> corrections_;
     VecI macroplanes_;
 
+    // Reciprocal correction factors for the group being swept, and the
+    // distances between the factors of adjacent angles and regions. See
+    // prepare_group().
+    VecF cdd_factors_;
+    int ang_stride_ = 0;
+    int reg_stride_ = 0;
+
+    // Whether the factors of each angle have been tabulated in a pipelined
+    // sweep: 0 if not, 1 while they are being, and 2 once they are. See
+    // prepare_angle().
+    std::unique_ptr<std::atomic<int>[]> angle_state_;
+
 private:
     bool dump_corrections_;
+
+    void tabulate_angle(int group, int iang)
+    {
+        const CorrectionData &corr = *corrections_;
+        const int n_reg            = corr.n_cell();
+        for (int reg = 0; reg < n_reg; reg++) {
+            real_t *f =
+                &cdd_factors_[2 * (iang * ang_stride_ + reg * reg_stride_)];
+            real_t b = corr.beta(reg, iang, group);
+            f[0] = 1.0 / (corr.alpha(reg, iang, group, Normal::X_NORM) * b);
+            f[1] = 1.0 / (corr.alpha(reg, iang, group, Normal::Y_NORM) * b);
+        }
+        return;
+    }
 };
 
 /**
@@ -135,6 +272,8 @@ private:
  */
 class SnSweeper_CDD_DD : public SnSweeper_CDD<SnSweeper_CDD_DD> {
 public:
+    static constexpr bool device_capable = true;
+
     SnSweeper_CDD_DD(const pugi::xml_node &input, const CoreMesh &mesh)
         : SnSweeper_CDD<SnSweeper_CDD_DD>(input, mesh)
     {
@@ -148,32 +287,64 @@ public:
                                                             xstr, i, t_state);
     }
 
+    const real_t *device_factors() const
+    {
+        return this->cdd_factors_.data();
+    }
+
     real_t evaluate(real_t &flux_x, real_t &flux_y, real_t &flux_z, real_t q,
                     real_t xstr, int i, const ThreadState &t_state) const
     {
-        int ix = i % mesh_.nx();
-        int ia = t_state.macroplane * this->plane_size_ + i % this->plane_size_;
-        real_t tx = t_state.ox / mesh_.dx(ix);
-
-        real_t ax =
-            corrections_->alpha(ia, t_state.iang_2d, group_, Normal::X_NORM);
-        real_t ay =
-            corrections_->alpha(ia, t_state.iang_2d, group_, Normal::Y_NORM);
-        real_t b = corrections_->beta(ia, t_state.iang_2d, group_);
+        int ia = t_state.macroplane * this->plane_size_ + t_state.ixy;
+        real_t tx = t_state.tx;
 
-        real_t gx = ax * b;
-        real_t gy = ay * b;
+        const real_t *f = this->cdd_factors(ia, t_state.iang_2d);
+        real_t rgx      = f[0];
+        real_t rgy      = f[1];
 
         real_t psi =
             q + 2.0 * (tx * flux_x + t_state.ty * flux_y + t_state.tz * flux_z);
-        psi /= tx / gx + t_state.ty / gy + 2.0 * t_state.tz + xstr;
+        psi /= tx * rgx + t_state.ty * rgy + 2.0 * t_state.tz + xstr;
 
-        flux_x = psi / gx - flux_x;
-        flux_y = psi / gy - flux_y;
+        flux_x = psi * rgx - flux_x;
+        flux_y = psi * rgy - flux_y;
         flux_z = 2.0 * psi - flux_z;
 
         return psi;
     }
+
+    void evaluate_batch(real_t *flux_x, real_t *flux_y, real_t *flux_z,
+                        const real_t *q, real_t xstr, int i,
+                        const AngleBatch &batch, real_t *psi) const
+    {
+        const int n      = batch.size;
+        const int ireg   = batch.macroplane * this->plane_size_ + batch.ixy;
+        const real_t rdx = batch.rdx;
+        const real_t rdy = batch.rdy;
+        const real_t rdz = batch.rdz;
+        const real_t *factors = this->cdd_factors(ireg, 0);
+        const int stride      = 2 * ang_stride_;
+#pragma omp simd
+        for (int ia = 0; ia < n; ia++) {
+            real_t tx = batch.ox[ia] * rdx;
+            real_t ty = batch.oy[ia] * rdy;
+            real_t tz = batch.oz[ia] * rdz;
+
+            const real_t *f = &factors[stride * batch.iang_2d[ia]];
+            real_t rgx = f[0];
+            real_t rgy = f[1];
+
+            real_t p = q[ia] + 2.0 * (tx * flux_x[ia] + ty * flux_y[ia] +
+                                      tz * flux_z[ia]);
+            p /= tx * rgx + ty * rgy + 2.0 * tz + xstr;
+
+            flux_x[ia] = p * rgx - flux_x[ia];
+            flux_y[ia] = p * rgy - flux_y[ia];
+            flux_z[ia] = 2.0 * p - flux_z[ia];
+            psi[ia]    = p;
+        }
+        return;
+    }
 };
 
 /**
@@ -198,22 +369,16 @@ public:
     real_t evaluate(real_t &flux_x, real_t &flux_y, real_t &flux_z, real_t q,
                     real_t xstr, int i, const ThreadState &t_state) const
     {
-        int ix = i % mesh_.nx();
-        int ia = t_state.macroplane * this->plane_size_ + i % this->plane_size_;
-        real_t tx = t_state.ox / mesh_.dx(ix);
+        int ia = t_state.macroplane * this->plane_size_ + t_state.ixy;
+        real_t tx = t_state.tx;
 
-        real_t ax =
-            corrections_->alpha(ia, t_state.iang_2d, group_, Normal::X_NORM);
-        real_t ay =
-            corrections_->alpha(ia, t_state.iang_2d, group_, Normal::Y_NORM);
-        real_t b = corrections_->beta(ia, t_state.iang_2d, group_);
-
-        real_t gx = ax * b;
-        real_t gy = ay * b;
+        const real_t *f = this->cdd_factors(ia, t_state.iang_2d);
+        real_t rgx      = f[0];
+        real_t rgy      = f[1];
 
         real_t psi =
             q + 2.0 * (tx * flux_x + t_state.ty * flux_y + t_state.tz * flux_z);
-        psi /= tx / gx + t_state.ty / gy + 2.0 * t_state.tz + xstr;
+        psi /= tx * rgx + t_state.ty * rgy + 2.0 * t_state.tz + xstr;
 
         // If the downwind axial flux is negative, re-evaluate psibar as though
         // it were actually zero, then compute the other downwind fluxes
@@ -221,14 +386,14 @@ public:
         if (flux_z_temp < 0.0) {
             psi = q + 2.0 * (tx * flux_x + t_state.ty * flux_y) +
                   t_state.tz * flux_z;
-            psi /= tx / gx + t_state.ty / gy + xstr;
+            psi /= tx * rgx + t_state.ty * rgy + xstr;
             flux_z = 0.0;
         } else {
             flux_z = flux_z_temp;
         }
 
-        flux_x = psi / gx - flux_x;
-        flux_y = psi / gy - flux_y;
+        flux_x = psi * rgx - flux_x;
+        flux_y = psi * rgy - flux_y;
 
         return psi;
     }
@@ -249,25 +414,19 @@ public:
     real_t evaluate(real_t &flux_x, real_t &flux_y, real_t &flux_z, real_t q,
                     real_t xstr, int i, const ThreadState &t_state) const
     {
-        int ix    = i % mesh_.nx();
-        int ia    = t_state.macroplane * plane_size_ + i % plane_size_;
-        real_t tx = t_state.ox / mesh_.dx(ix);
-
-        real_t ax =
-            corrections_->alpha(ia, t_state.iang_2d, group_, Normal::X_NORM);
-        real_t ay =
-            corrections_->alpha(ia, t_state.iang_2d, group_, Normal::Y_NORM);
-        real_t b = corrections_->beta(ia, t_state.iang_2d, group_);
+        int ia    = t_state.macroplane * plane_size_ + t_state.ixy;
+        real_t tx = t_state.tx;
 
-        real_t gx = ax * b;
-        real_t gy = ay * b;
+        const real_t *f = this->cdd_factors(ia, t_state.iang_2d);
+        real_t rgx      = f[0];
+        real_t rgy      = f[1];
 
         real_t psi =
             q + 2.0 * (tx * flux_x + t_state.ty * flux_y) + t_state.tz * flux_z;
-        psi /= tx / gx + t_state.ty / gy + t_state.tz + xstr;
+        psi /= tx * rgx + t_state.ty * rgy + t_state.tz + xstr;
 
-        flux_x = (psi - gx * flux_x) / gx;
-        flux_y = (psi - gy * flux_y) / gy;
+        flux_x = psi * rgx - flux_x;
+        flux_y = psi * rgy - flux_y;
         flux_z = psi;
 
         return psi;
@@ -289,18 +448,12 @@ public:
     real_t evaluate(real_t &flux_x, real_t &flux_y, real_t &flux_z, real_t q,
                     real_t xstr, int i, const ThreadState &t_state) const
     {
-        int ix    = i % mesh_.nx();
-        int ia    = t_state.macroplane * plane_size_ + i % plane_size_;
-        real_t tx = t_state.ox / mesh_.dx(ix);
-
-        real_t ax =
-            corrections_->alpha(ia, t_state.iang_2d, group_, Normal::X_NORM);
-        real_t ay =
-            corrections_->alpha(ia, t_state.iang_2d, group_, Normal::Y_NORM);
-        real_t b = corrections_->beta(ia, t_state.iang_2d, group_);
+        int ia    = t_state.macroplane * plane_size_ + t_state.ixy;
+        real_t tx = t_state.tx;
 
-        real_t gx = ax * b;
-        real_t gy = ay * b;
+        const real_t *f = this->cdd_factors(ia, t_state.iang_2d);
+        real_t rgx      = f[0];
+        real_t rgy      = f[1];
 
         real_t tau    = xstr / t_state.tz;
         real_t rho    = 1.0 / tau - 1.0 / (exponential_.exp(tau) - 1.0);
@@ -308,10 +461,10 @@ public:
 
         real_t psi = q + 2.0 * (tx * flux_x + t_state.ty * flux_y) +
                      t_state.tz * (rhofac + 1.0) * flux_z;
-        psi /= tx / gx + t_state.ty / gy + t_state.tz / (1.0 - rho) + xstr;
+        psi /= tx * rgx + t_state.ty * rgy + t_state.tz / (1.0 - rho) + xstr;
 
-        flux_x = (psi - gx * flux_x) / gx;
-        flux_y = (psi - gy * flux_y) / gy;
+        flux_x = psi * rgx - flux_x;
+        flux_y = psi * rgy - flux_y;
         flux_z = (psi - rho * flux_z) / (1.0 - rho);
 
         return psi;
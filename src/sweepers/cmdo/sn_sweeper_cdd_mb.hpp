@@ -38,33 +38,54 @@ public:
                                                              xstr, i, t_state);
     }
 
+    /**
+     * \brief PMB cell update, with the transverse closure fixed at diamond
+     * difference (gamma = 1/2), so no correction factors are needed
+     *
+     * The axial cell height enters as \f$ \Delta z \, \mu_z = \mu_z^2 / t_z
+     * \f$, since \f$ t_z = \mu_z / \Delta z \f$.
+     */
     real_t evaluate(real_t &flux_x, real_t &flux_y, real_t &flux_z, real_t q,
                     real_t xstr, int i, const ThreadState &t_state) const
     {
-        int ix    = i % mesh_.nx();
-        int iz    = i % mesh_.nx() * mesh_.ny();
-        real_t dz = mesh_.dz(iz);
-        int ia = t_state.macroplane * this->plane_size_ + i % this->plane_size_;
-        real_t tx = t_state.ox / mesh_.dx(ix);
+        return closure(flux_x, flux_y, flux_z, q, xstr, t_state.tx,
+                       t_state.ty, t_state.tz, t_state.oz);
+    }
 
-        real_t ax =
-            corrections_->alpha(ia, t_state.iang_2d, group_, Normal::X_NORM);
-        real_t ay =
-            corrections_->alpha(ia, t_state.iang_2d, group_, Normal::Y_NORM);
-        real_t b = corrections_->beta(ia, t_state.iang_2d, group_);
+    void evaluate_batch(real_t *flux_x, real_t *flux_y, real_t *flux_z,
+                        const real_t *q, real_t xstr, int i,
+                        const AngleBatch &batch, real_t *psi) const
+    {
+        const int n      = batch.size;
+        const real_t rdx = batch.rdx;
+        const real_t rdy = batch.rdy;
+        const real_t rdz = batch.rdz;
+#pragma omp simd
+        for (int ia = 0; ia < n; ia++) {
+            psi[ia] = closure(flux_x[ia], flux_y[ia], flux_z[ia], q[ia], xstr,
+                              batch.ox[ia] * rdx, batch.oy[ia] * rdy,
+                              batch.oz[ia] * rdz, batch.oz[ia]);
+        }
+        return;
+    }
 
-        real_t gx = 0.5;//ax * b;
-        real_t gy = 0.5;//ay * b;
+private:
+    MOCC_FORCE_INLINE static real_t closure(real_t &flux_x, real_t &flux_y,
+                                            real_t &flux_z, real_t q,
+                                            real_t xstr, real_t tx, real_t ty,
+                                            real_t tz, real_t oz)
+    {
+        const real_t rgx = 2.0;
+        const real_t rgy = 2.0;
+        real_t dz_oz     = oz * oz / tz;
 
-        real_t psi = q - (dz * t_state.oz * q) / (2.0 * t_state.tz + xstr) +
-                     2.0 * (tx * flux_x + t_state.ty * flux_y) +
-                     t_state.tz * flux_z;
-        psi /= tx / gx + t_state.ty / gy +
-               (t_state.oz * t_state.oz) / (t_state.tz + 0.5 * xstr) + xstr;
+        real_t psi = q - (dz_oz * q) / (2.0 * tz + xstr) +
+                     2.0 * (tx * flux_x + ty * flux_y) + tz * flux_z;
+        psi /= tx * rgx + ty * rgy + (oz * oz) / (tz + 0.5 * xstr) + xstr;
 
-        flux_x = psi / gx - flux_x;
-        flux_y = psi / gy - flux_y;
-        flux_z = (2.0 * psi * t_state.tz + q) / (2.0 * t_state.tz + xstr);
+        flux_x = psi * rgx - flux_x;
+        flux_y = psi * rgy - flux_y;
+        flux_z = (2.0 * psi * tz + q) / (2.0 * tz + xstr);
 
         return psi;
     }
@@ -29,7 +29,8 @@ CDDPair_t create_sweeper(const pugi::xml_node &input, const CoreMesh &mesh)
     std::unique_ptr<T> swp(std::make_unique<T>(input, mesh));
     std::shared_ptr<CorrectionData> corrections(
         std::make_shared<CorrectionData>(mesh, swp->ang_quad().ndir() / 2,
-                                         swp->n_group()));
+                                         swp->n_group(),
+                                         input.child("corrections")));
     if (!input.child("data").empty()) {
         corrections->from_data(input);
     }
@@ -63,7 +64,8 @@ CDDPair_t SnSweeperFactory_CDD(const pugi::xml_node &input,
         // one called below.
         sweeper     = SnSweeperFactory(input, mesh);
         corrections = std::make_shared<CorrectionData>(
-            mesh, sweeper->ang_quad().ndir() / 2, sweeper->n_group());
+            mesh, sweeper->ang_quad().ndir() / 2, sweeper->n_group(),
+            input.child("corrections"));
         corrections->from_data(input);
         return CDDPair_t(std::move(sweeper), corrections);
     }
@@ -42,6 +42,11 @@ namespace cmdo {
  * because the individual Sn and MoC sweepers should ultimately be assigned
  * their corresponding sub-sources, calling self_scatter() directly on those
  * instead.
+ *
+ * Both sub-sources are built in a single parallel region, with the threads
+ * splitting the Sn regions and then the MoC regions between them, so that
+ * the (much smaller) Sn source does not cost a parallel region and barrier
+ * of its own.
  */
 class Source_2D3D : public SourceIsotropic {
 public:
@@ -59,8 +64,17 @@ public:
      */
     void initialize_group(int group)
     {
-        Source::initialize_group(group);
-        sn_source_.initialize_group(group);
+        sn_source_.load_external(group);
+        this->load_external(group);
+
+#pragma omp parallel
+        {
+            sn_source_.initialize_group_loop(group, sn_source_.source_1g_);
+            this->initialize_group_loop(group, source_1g_);
+        }
+
+        state_.reset();
+        sn_source_.state_.reset();
         return;
     }
 
@@ -79,20 +93,57 @@ public:
     void fission(const ArrayB1 &fs, int ig)
     {
         assert((int)fs.size() == (n_reg_ + sn_source_.n_reg()));
+        assert(!state_.has_fission);
+        assert(!sn_source_.state_.has_fission);
 
         // Alias the appropriate regions of the passed fission source
         ArrayB1 sn_fission_source(fs(blitz::Range(0, sn_source_.n_reg() - 1)));
         ArrayB1 moc_fission_source(
             fs(blitz::Range(sn_source_.n_reg(), blitz::toEnd)));
 
-        sn_source_.fission(sn_fission_source, ig);
-        Source::fission(moc_fission_source, ig);
+#pragma omp parallel
+        {
+            sn_source_.fission_loop(sn_fission_source, ig,
+                                    sn_source_.source_1g_);
+            this->fission_loop(moc_fission_source, ig, source_1g_);
+        }
+
+        state_.has_fission            = true;
+        sn_source_.state_.has_fission = true;
+        return;
     }
 
     void in_scatter(size_t ig)
     {
-        Source::in_scatter(ig);
-        sn_source_.in_scatter(ig);
+        assert(!state_.has_inscatter);
+        assert(!sn_source_.state_.has_inscatter);
+
+#pragma omp parallel
+        {
+            sn_source_.in_scatter_loop(ig, sn_source_.flux_,
+                                       sn_source_.source_1g_);
+            this->in_scatter_loop(ig, flux_, source_1g_);
+        }
+        return;
+    }
+
+    /**
+     * The Sn source would need its own copy of the previous Sn flux, so
+     * in-scattering from an arbitrary flux is not supported.
+     */
+    void in_scatter(size_t ig, const ArrayB2 &flux)
+    {
+        throw EXCEPT("2D3D source does not support in-scatter from an "
+                     "external flux. Use Gauss-Seidel energy iterations.");
+    }
+
+    /**
+     * The Sn source is built along with the MoC source, so it can't be built
+     * ahead of time.
+     */
+    bool can_prepare_next() const override
+    {
+        return false;
     }
 
     Source *get_sn_source()
@@ -101,8 +152,15 @@ public:
     }
 
 private:
+    // The Sn source, whose protected loops are called directly so that they
+    // can share a parallel region with the MoC source
+    class SnSource : public SourceIsotropic {
+        friend class Source_2D3D;
+        using SourceIsotropic::SourceIsotropic;
+    };
+
     const CoreMesh &mesh_;
-    SourceIsotropic sn_source_;
+    SnSource sn_source_;
 };
 } // namespace cmdo
 } // namespace mocc
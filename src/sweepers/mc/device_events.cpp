@@ -0,0 +1,647 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include "device_events.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include "util/error.hpp"
+#include "util/fast_math.hpp"
+#include "util/files.hpp"
+#include "util/fp_utils.hpp"
+#include "util/rng_lcg.hpp"
+#include "util/sign.hpp"
+#include "core/constants.hpp"
+#include "core/pin_mesh_cyl.hpp"
+#include "core/pin_mesh_rect.hpp"
+#include "particle.hpp"
+
+namespace mocc {
+namespace mc {
+namespace {
+#pragma omp declare target
+const real_t NO_SURFACE = std::numeric_limits<real_t>::max();
+
+// Same as Line::distance_to_surface(), with the line given by its end points
+// in l
+inline real_t line_distance(const real_t *l, real_t x, real_t y, real_t ox,
+                            real_t oy, bool coincident)
+{
+    if (coincident) {
+        return NO_SURFACE;
+    }
+
+    real_t a = l[1] - l[3];
+    real_t b = l[2] - l[0];
+    real_t c = l[0] * l[3] - l[2] * l[1];
+
+    real_t f    = a * x + b * y + c;
+    real_t proj = ox * a + oy * b;
+
+    if (std::abs(proj) < REAL_FUZZ) {
+        return NO_SURFACE;
+    }
+
+    real_t d = -f / proj;
+    if ((d > 0.0) && std::abs(f) > REAL_FUZZ) {
+        return d;
+    }
+
+    return NO_SURFACE;
+}
+
+// Same as Circle::distance_to_surface(), with the center and radius of the
+// circle in c
+inline real_t circle_distance(const real_t *c, real_t x, real_t y, real_t ox,
+                              real_t oy, real_t oz, bool coincident)
+{
+    real_t a = 1.0 - oz * oz;
+
+    if (a == 0.0) {
+        return NO_SURFACE;
+    }
+
+    x -= c[0];
+    y -= c[1];
+
+    real_t k   = x * ox + y * oy;
+    real_t cc  = x * x + y * y - c[2] * c[2];
+    real_t det = k * k - a * cc;
+
+    if (det < 0.0) {
+        return NO_SURFACE;
+    }
+
+    if (coincident || (std::abs(cc) < REAL_FUZZ)) {
+        return (k >= 0.0) ? NO_SURFACE : (-k + std::sqrt(det)) / a;
+    }
+
+    if (cc < 0.0) {
+        return (-k + std::sqrt(det)) / a;
+    }
+
+    real_t d = (-k - std::sqrt(det)) / a;
+    return d >= 0.0 ? d : NO_SURFACE;
+}
+
+// Same as Particle::move()
+inline void move(real_t d, const real_t *dir, real_t *local, real_t *global)
+{
+    for (int i = 0; i < 2; i++) {
+        local[i] += (d + BUMP) * dir[i] + BUMP * sgn(dir[i]);
+    }
+    for (int i = 0; i < 3; i++) {
+        global[i] += (d + BUMP) * dir[i] + BUMP * sgn(dir[i]);
+    }
+    return;
+}
+
+// Same as PinMesh_Rect::find_reg(Point2, Direction)
+inline int find_reg_rect(const real_t *pitch, const int *n, const real_t *div,
+                         real_t x, real_t y, real_t ox, real_t oy)
+{
+    if (((x < -0.5 * pitch[0] + REAL_FUZZ) && (ox < 0.0)) ||
+        ((x > 0.5 * pitch[0] - REAL_FUZZ) && (ox > 0.0)) ||
+        ((y < -0.5 * pitch[1] + REAL_FUZZ) && (oy < 0.0)) ||
+        ((y > 0.5 * pitch[1] - REAL_FUZZ) && (oy > 0.0))) {
+        return -1;
+    }
+
+    int nx           = n[0];
+    int ny           = n[1];
+    const real_t *hx = div;
+    const real_t *hy = div + nx + 1;
+
+    int ix = 0;
+    while ((ix <= nx) && fuzzy_lt(hx[ix], x)) {
+        ix++;
+    }
+    if ((ix <= nx) && fp_equiv(x, hx[ix])) {
+        ix = (ox > 0.0) ? ix + 1 : ix;
+    }
+    ix = std::max(0, std::min(nx - 1, ix - 1));
+
+    int iy = 0;
+    while ((iy <= ny) && fuzzy_lt(hy[iy], y)) {
+        iy++;
+    }
+    if ((iy <= ny) && fp_equiv(y, hy[iy])) {
+        iy = (oy > 0.0) ? iy + 1 : iy;
+    }
+    iy = std::max(0, std::min(ny - 1, iy - 1));
+
+    return nx * iy + ix;
+}
+
+// Same as PinMesh_Cyl::find_reg(Point2, Direction)
+inline int find_reg_cyl(const real_t *pitch, const int *n, const real_t *radii,
+                        real_t x, real_t y, real_t ox, real_t oy,
+                        real_t alpha)
+{
+    if (((x < -0.5 * pitch[0]) && (ox < 0.0)) ||
+        ((x > 0.5 * pitch[0]) && (ox > 0.0)) ||
+        ((y < -0.5 * pitch[1]) && (oy < 0.0)) ||
+        ((y > 0.5 * pitch[1]) && (oy > 0.0))) {
+        return -1;
+    }
+
+    int n_rad = n[0];
+    int n_azi = n[1];
+
+    real_t r = std::sqrt(x * x + y * y);
+    int ir   = 0;
+    while ((ir < n_rad) && fuzzy_lt(radii[ir], r)) {
+        ir++;
+    }
+    if ((ir < n_rad) && fp_equiv_ulp(r, radii[ir])) {
+        if (x * ox + y * oy > 0.0) {
+            ir++;
+        }
+    }
+
+    real_t azi = Point2(x, y).alpha();
+    if (fp_equiv_ulp(azi, TWOPI)) {
+        azi = (alpha > PI) ? TWOPI : 0.0;
+    }
+    real_t azi_space = TWOPI / n_azi;
+    real_t azi_div   = azi / azi_space;
+    int closest_azi  = std::round(azi_div);
+
+    int ia = -1;
+    if (fp_equiv_abs(closest_azi * azi_space, azi)) {
+        ia = (azi < alpha) ? closest_azi : closest_azi - 1;
+    } else {
+        ia = (int)azi_div;
+    }
+    ia = ia % n_azi;
+
+    return ir * n_azi + ia;
+}
+
+// Same as AliasTableSet::sample()
+inline int sample_alias(const real_t *prob, const int *alias, int n,
+                        RNG_LCG &rng)
+{
+    real_t u = rng.random() * n;
+    int i    = std::min((int)u, n - 1);
+    return ((u - i) < prob[i]) ? i : alias[i];
+}
+#pragma omp end declare target
+} // namespace
+
+DeviceEvents::DeviceEvents(const CoreMesh &mesh, const XSMesh &xs_mesh,
+                           const VecI &xsmesh_regions,
+                           const AliasTableSet &reaction_tables,
+                           const AliasTableSet &scatter_tables)
+    : n_group_(xs_mesh.n_group()),
+      n_pm_(0),
+      n_reg_(xsmesh_regions.size()),
+      n_xs_(xs_mesh.size()),
+      xsmesh_regions_(xsmesh_regions.begin(), xsmesh_regions.end())
+{
+    // Flatten the pin meshes
+    pm_surf_.push_back(0);
+    pm_div_.push_back(0);
+    for (const auto &pm_pair : mesh.pin_meshes()) {
+        const PinMesh *pm = pm_pair.second.get();
+        pm_index_[pm]     = n_pm_++;
+        pm_pitch_.push_back(pm->pitch_x());
+        pm_pitch_.push_back(pm->pitch_y());
+
+        if (const auto *rect = dynamic_cast<const PinMesh_Rect *>(pm)) {
+            pm_type_.push_back(0);
+            for (const auto &l : rect->lines()) {
+                surf_type_.push_back(0);
+                surf_id_.push_back(l.surf_id);
+                surf_coeff_.insert(surf_coeff_.end(),
+                                   {l.p1.x, l.p1.y, l.p2.x, l.p2.y});
+            }
+            pm_n_.push_back(rect->hx().size() - 1);
+            pm_n_.push_back(rect->hy().size() - 1);
+            div_.insert(div_.end(), rect->hx().begin(), rect->hx().end());
+            div_.insert(div_.end(), rect->hy().begin(), rect->hy().end());
+        } else if (const auto *cyl = dynamic_cast<const PinMesh_Cyl *>(pm)) {
+            // Circles first, then lines, in the same order as
+            // PinMesh_Cyl::distance_to_surface()
+            pm_type_.push_back(1);
+            for (const auto &c : cyl->circles()) {
+                surf_type_.push_back(1);
+                surf_id_.push_back(c.surf_id);
+                surf_coeff_.insert(surf_coeff_.end(), {c.c.x, c.c.y, c.r, 0.0});
+            }
+            for (const auto &l : cyl->lines()) {
+                surf_type_.push_back(0);
+                surf_id_.push_back(l.surf_id);
+                surf_coeff_.insert(surf_coeff_.end(),
+                                   {l.p1.x, l.p1.y, l.p2.x, l.p2.y});
+            }
+            pm_n_.push_back(cyl->radii().size());
+            pm_n_.push_back(cyl->n_azi());
+            div_.insert(div_.end(), cyl->radii().begin(), cyl->radii().end());
+        } else {
+            throw EXCEPT("Unsupported pin mesh type for device events");
+        }
+
+        pm_surf_.push_back(surf_type_.size());
+        pm_div_.push_back(div_.size());
+    }
+
+    // Flatten the cross sections and alias tables
+    xstr_.reserve(n_xs_ * n_group_);
+    for (const auto &xsreg : xs_mesh) {
+        for (int ig = 0; ig < n_group_; ig++) {
+            xstr_.push_back(xsreg.xsmactr(ig));
+        }
+    }
+    assert(reaction_tables.width() == 3);
+    assert(scatter_tables.width() == n_group_);
+    rx_prob_  = reaction_tables.prob();
+    rx_alias_ = reaction_tables.alias();
+    sc_prob_  = scatter_tables.prob();
+    sc_alias_ = scatter_tables.alias();
+
+    LogFile << "Mapping " << n_pm_ << " pin meshes with " << surf_type_.size()
+            << " surfaces and " << n_xs_ << " XS regions to the device"
+            << std::endl;
+
+    const int *pm_type      = pm_type_.data();
+    const real_t *pm_pitch  = pm_pitch_.data();
+    const int *pm_surf      = pm_surf_.data();
+    const int *surf_type    = surf_type_.data();
+    const int *surf_id      = surf_id_.data();
+    const real_t *surf_coef = surf_coeff_.data();
+    const int *pm_div       = pm_div_.data();
+    const int *pm_n         = pm_n_.data();
+    const real_t *div       = div_.data();
+    const int *xsmesh_reg   = xsmesh_regions_.data();
+    const real_t *xstr      = xstr_.data();
+    const real_t *rx_prob   = rx_prob_.data();
+    const int *rx_alias     = rx_alias_.data();
+    const real_t *sc_prob   = sc_prob_.data();
+    const int *sc_alias     = sc_alias_.data();
+    int n_surf              = surf_type_.size();
+    int n_div               = div_.size();
+    int n_rx                = rx_prob_.size();
+    int n_sc                = sc_prob_.size();
+    int n_xsg               = xstr_.size();
+#pragma omp target enter data map(to: pm_type[0:n_pm_],                     \
+    pm_pitch[0:2 * n_pm_], pm_surf[0:n_pm_ + 1], surf_type[0:n_surf],       \
+    surf_id[0:n_surf], surf_coef[0:4 * n_surf], pm_div[0:n_pm_ + 1],        \
+    pm_n[0:2 * n_pm_], div[0:n_div], xsmesh_reg[0:n_reg_], xstr[0:n_xsg],   \
+    rx_prob[0:n_rx], rx_alias[0:n_rx], sc_prob[0:n_sc], sc_alias[0:n_sc])
+
+    return;
+}
+
+DeviceEvents::~DeviceEvents()
+{
+    const int *pm_type      = pm_type_.data();
+    const real_t *pm_pitch  = pm_pitch_.data();
+    const int *pm_surf      = pm_surf_.data();
+    const int *surf_type    = surf_type_.data();
+    const int *surf_id      = surf_id_.data();
+    const real_t *surf_coef = surf_coeff_.data();
+    const int *pm_div       = pm_div_.data();
+    const int *pm_n         = pm_n_.data();
+    const real_t *div       = div_.data();
+    const int *xsmesh_reg   = xsmesh_regions_.data();
+    const real_t *xstr      = xstr_.data();
+    const real_t *rx_prob   = rx_prob_.data();
+    const int *rx_alias     = rx_alias_.data();
+    const real_t *sc_prob   = sc_prob_.data();
+    const int *sc_alias     = sc_alias_.data();
+    int n_surf              = surf_type_.size();
+    int n_div               = div_.size();
+    int n_rx                = rx_prob_.size();
+    int n_sc                = sc_prob_.size();
+    int n_xsg               = xstr_.size();
+#pragma omp target exit data map(delete: pm_type[0:n_pm_],                  \
+    pm_pitch[0:2 * n_pm_], pm_surf[0:n_pm_ + 1], surf_type[0:n_surf],       \
+    surf_id[0:n_surf], surf_coef[0:4 * n_surf], pm_div[0:n_pm_ + 1],        \
+    pm_n[0:2 * n_pm_], div[0:n_div], xsmesh_reg[0:n_reg_], xstr[0:n_xsg],   \
+    rx_prob[0:n_rx], rx_alias[0:n_rx], sc_prob[0:n_sc], sc_alias[0:n_sc])
+
+    return;
+}
+
+void DeviceEvents::distance(const VecI &queue, EventBank &events)
+{
+    const int n  = queue.size();
+    const int ng = n_group_;
+
+    // Gather. Each particle has its pin-local position, direction, global
+    // position and pin bounds, in that order.
+    const int stride = 14;
+    std::vector<int> pm(n);
+    std::vector<int> ixsg(n);
+    std::vector<int> coincident(n);
+    std::vector<real_t> state(stride * n);
+    std::vector<uint64_t> rng(n);
+#pragma omp parallel for
+    for (int j = 0; j < n; j++) {
+        int i            = queue[j];
+        const auto &info = events.location_info[i];
+        const auto &dir  = events.direction[i];
+        const auto &pos  = events.location_global[i];
+        real_t *s        = &state[stride * j];
+
+        pm[j]         = pm_index_.at(info.pm);
+        ixsg[j]       = events.ixsreg[i] * ng + events.group[i];
+        coincident[j] = events.coincident[i];
+        rng[j]        = events.rng[i].state();
+
+        s[0]  = events.location[i].x;
+        s[1]  = events.location[i].y;
+        s[2]  = dir.ox;
+        s[3]  = dir.oy;
+        s[4]  = dir.oz;
+        s[5]  = pos.x;
+        s[6]  = pos.y;
+        s[7]  = pos.z;
+        s[8]  = info.pin_boundary[0].x;
+        s[9]  = info.pin_boundary[0].y;
+        s[10] = info.pin_boundary[0].z;
+        s[11] = info.pin_boundary[1].x;
+        s[12] = info.pin_boundary[1].y;
+        s[13] = info.pin_boundary[1].z;
+    }
+
+    std::vector<real_t> d_collision(n);
+    std::vector<real_t> d_surface(n);
+    std::vector<int> pin_crossing(n);
+
+    const real_t *pm_pitch  = pm_pitch_.data();
+    const int *pm_surf      = pm_surf_.data();
+    const int *surf_type    = surf_type_.data();
+    const int *surf_id      = surf_id_.data();
+    const real_t *surf_coef = surf_coeff_.data();
+    const real_t *xstr      = xstr_.data();
+    int *p_pm               = pm.data();
+    int *p_ixsg             = ixsg.data();
+    int *p_coinc            = coincident.data();
+    real_t *p_state         = state.data();
+    uint64_t *p_rng         = rng.data();
+    real_t *p_dcol          = d_collision.data();
+    real_t *p_dsurf         = d_surface.data();
+    int *p_pin              = pin_crossing.data();
+
+#pragma omp target teams distribute parallel for                            \
+    map(to: p_pm[0:n], p_ixsg[0:n], p_state[0:stride * n])                   \
+    map(tofrom: p_coinc[0:n], p_rng[0:n])                                    \
+    map(from: p_dcol[0:n], p_dsurf[0:n], p_pin[0:n])
+    for (int j = 0; j < n; j++) {
+        const real_t *s = &p_state[stride * j];
+        int ipm         = p_pm[j];
+
+        RNG_LCG r(p_rng[j]);
+        p_dcol[j] = -fast_log(r.random()) / xstr[p_ixsg[j]];
+        p_rng[j]  = r.state();
+
+        // Distance to the surfaces of the pin mesh
+        real_t d_surf  = NO_SURFACE;
+        bool pm_escape = false;
+        int coinc      = p_coinc[j];
+        if ((std::abs(s[0]) > 0.5 * pm_pitch[2 * ipm]) ||
+            (std::abs(s[1]) > 0.5 * pm_pitch[2 * ipm + 1])) {
+            d_surf    = 0.0;
+            pm_escape = true;
+        } else {
+            int coinc_new = coinc;
+            for (int is = pm_surf[ipm]; is < pm_surf[ipm + 1]; is++) {
+                bool on_surf    = coinc == surf_id[is];
+                const real_t *c = &surf_coef[4 * is];
+                real_t d        = (surf_type[is] == 1)
+                               ? circle_distance(c, s[0], s[1], s[2], s[3],
+                                                 s[4], on_surf)
+                               : line_distance(c, s[0], s[1], s[2], s[3],
+                                               on_surf);
+                if (d < d_surf) {
+                    coinc_new = surf_id[is];
+                    d_surf    = d;
+                }
+            }
+            coinc = coinc_new;
+        }
+        p_coinc[j] = coinc;
+
+        // Distance to the pin boundaries
+        real_t d_to_pin = NO_SURFACE;
+        for (int k = 0; k < 3; k++) {
+            real_t bound = (s[2 + k] > 0.0) ? s[11 + k] : s[8 + k];
+            real_t d     = (bound - s[5 + k]) / s[2 + k];
+            d_to_pin     = (d > 0.0) ? std::min(d_to_pin, d) : d_to_pin;
+        }
+
+        p_pin[j]   = pm_escape || (d_to_pin < d_surf);
+        p_dsurf[j] = std::min(d_to_pin, d_surf);
+    }
+
+    // Scatter
+#pragma omp parallel for
+    for (int j = 0; j < n; j++) {
+        int i                  = queue[j];
+        events.d_collision[i]  = d_collision[j];
+        events.d_surface[i]    = d_surface[j];
+        events.pin_crossing[i] = pin_crossing[j];
+        events.coincident[i]   = coincident[j];
+        events.rng[i].set_seed(rng[j]);
+    }
+
+    return;
+}
+
+void DeviceEvents::collide(const VecI &queue, EventBank &events,
+                           VecI &reaction, VecF &dir_random)
+{
+    const int n  = queue.size();
+    const int ng = n_group_;
+
+    // Gather. Each particle has its distance to collision, direction,
+    // pin-local position and global position, in that order.
+    const int stride = 9;
+    std::vector<int> ixsg(n);
+    std::vector<real_t> state(stride * n);
+    std::vector<uint64_t> rng(n);
+#pragma omp parallel for
+    for (int j = 0; j < n; j++) {
+        int i           = queue[j];
+        const auto &dir = events.direction[i];
+        const auto &pos = events.location_global[i];
+        real_t *s       = &state[stride * j];
+
+        ixsg[j] = events.ixsreg[i] * ng + events.group[i];
+        rng[j]  = events.rng[i].state();
+
+        s[0] = events.d_collision[i];
+        s[1] = dir.ox;
+        s[2] = dir.oy;
+        s[3] = dir.oz;
+        s[4] = events.location[i].x;
+        s[5] = events.location[i].y;
+        s[6] = pos.x;
+        s[7] = pos.y;
+        s[8] = pos.z;
+    }
+
+    reaction.resize(n);
+    dir_random.resize(2 * n);
+    std::vector<int> group(n);
+
+    const real_t *rx_prob = rx_prob_.data();
+    const int *rx_alias   = rx_alias_.data();
+    const real_t *sc_prob = sc_prob_.data();
+    const int *sc_alias   = sc_alias_.data();
+    int *p_ixsg           = ixsg.data();
+    real_t *p_state       = state.data();
+    uint64_t *p_rng       = rng.data();
+    int *p_reaction       = reaction.data();
+    real_t *p_dir_random  = dir_random.data();
+    int *p_group          = group.data();
+
+#pragma omp target teams distribute parallel for                            \
+    map(to: p_ixsg[0:n]) map(tofrom: p_state[0:stride * n], p_rng[0:n])      \
+    map(from: p_reaction[0:n], p_dir_random[0:2 * n], p_group[0:n])
+    for (int j = 0; j < n; j++) {
+        real_t *s = &p_state[stride * j];
+        int xsg   = p_ixsg[j];
+        move(s[0], &s[1], &s[4], &s[6]);
+
+        RNG_LCG r(p_rng[j]);
+        int rx = sample_alias(&rx_prob[3 * xsg], &rx_alias[3 * xsg], 3, r);
+        p_reaction[j] = rx;
+        p_group[j]    = xsg % ng;
+        if (rx == (int)Reaction::SCATTER) {
+            p_group[j] =
+                sample_alias(&sc_prob[ng * xsg], &sc_alias[ng * xsg], ng, r);
+            p_dir_random[2 * j]     = r.random();
+            p_dir_random[2 * j + 1] = r.random();
+        }
+        p_rng[j] = r.state();
+    }
+
+    // Scatter
+#pragma omp parallel for
+    for (int j = 0; j < n; j++) {
+        int i           = queue[j];
+        const real_t *s = &state[stride * j];
+
+        events.location[i].x        = s[4];
+        events.location[i].y        = s[5];
+        events.location_global[i].x = s[6];
+        events.location_global[i].y = s[7];
+        events.location_global[i].z = s[8];
+        events.coincident[i]        = -1;
+        events.group[i]             = group[j];
+        events.alive[i] = reaction[j] == (int)Reaction::SCATTER;
+        events.rng[i].set_seed(rng[j]);
+    }
+
+    return;
+}
+
+void DeviceEvents::cross_internal(const VecI &queue, EventBank &events)
+{
+    const int n = queue.size();
+
+    // Gather. Each particle has its distance to the surface, direction,
+    // pin-local position, global position and azimuthal angle, in that
+    // order.
+    const int stride = 10;
+    std::vector<int> pm(n);
+    std::vector<int> reg(n);
+    std::vector<real_t> state(stride * n);
+#pragma omp parallel for
+    for (int j = 0; j < n; j++) {
+        int i            = queue[j];
+        const auto &info = events.location_info[i];
+        const auto &dir  = events.direction[i];
+        const auto &pos  = events.location_global[i];
+        real_t *s        = &state[stride * j];
+        assert(!events.pin_crossing[i]);
+
+        pm[j]  = pm_index_.at(info.pm);
+        reg[j] = info.reg_offset;
+
+        s[0] = events.d_surface[i];
+        s[1] = dir.ox;
+        s[2] = dir.oy;
+        s[3] = dir.oz;
+        s[4] = events.location[i].x;
+        s[5] = events.location[i].y;
+        s[6] = pos.x;
+        s[7] = pos.y;
+        s[8] = pos.z;
+        s[9] = dir.alpha;
+    }
+
+    std::vector<int> ixsreg(n);
+
+    const int *pm_type     = pm_type_.data();
+    const real_t *pm_pitch = pm_pitch_.data();
+    const int *pm_div      = pm_div_.data();
+    const int *pm_n        = pm_n_.data();
+    const real_t *div      = div_.data();
+    const int *xsmesh_reg  = xsmesh_regions_.data();
+    int *p_pm              = pm.data();
+    int *p_reg             = reg.data();
+    real_t *p_state        = state.data();
+    int *p_ixsreg          = ixsreg.data();
+
+#pragma omp target teams distribute parallel for                            \
+    map(to: p_pm[0:n]) map(tofrom: p_reg[0:n], p_state[0:stride * n])        \
+    map(from: p_ixsreg[0:n])
+    for (int j = 0; j < n; j++) {
+        real_t *s = &p_state[stride * j];
+        int ipm   = p_pm[j];
+        move(s[0], &s[1], &s[4], &s[6]);
+
+        const real_t *pitch = &pm_pitch[2 * ipm];
+        const int *nd       = &pm_n[2 * ipm];
+        const real_t *d     = &div[pm_div[ipm]];
+        int ireg = (pm_type[ipm] == 1)
+                       ? find_reg_cyl(pitch, nd, d, s[4], s[5], s[1], s[2],
+                                      s[9])
+                       : find_reg_rect(pitch, nd, d, s[4], s[5], s[1], s[2]);
+        ireg += p_reg[j];
+
+        p_reg[j]    = ireg;
+        p_ixsreg[j] = xsmesh_reg[ireg];
+    }
+
+    // Scatter
+#pragma omp parallel for
+    for (int j = 0; j < n; j++) {
+        int i           = queue[j];
+        const real_t *s = &state[stride * j];
+        assert((reg[j] >= 0) && (reg[j] < n_reg_));
+
+        events.location[i].x        = s[4];
+        events.location[i].y        = s[5];
+        events.location_global[i].x = s[6];
+        events.location_global[i].y = s[7];
+        events.location_global[i].z = s[8];
+        events.ireg[i]              = reg[j];
+        events.ixsreg[i]            = ixsreg[j];
+    }
+
+    return;
+}
+} // namespace mc
+} // namespace mocc
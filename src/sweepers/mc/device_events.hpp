@@ -0,0 +1,154 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#pragma once
+
+#include <map>
+#include <vector>
+
+#include "util/alias_table.hpp"
+#include "util/global_config.hpp"
+#include "core/core_mesh.hpp"
+#include "core/xs_mesh.hpp"
+#include "event_bank.hpp"
+
+namespace mocc {
+namespace mc {
+/**
+ * \brief Device implementations of the distance, collision and internal
+ * surface crossing events of an event-based Monte Carlo simulation, using
+ * OpenMP target offload
+ *
+ * The surfaces of every \ref PinMesh_Cyl and \ref PinMesh_Rect in the \ref
+ * CoreMesh, the divisions needed to find regions within them, the transport
+ * cross sections and the reaction and scattering alias tables of every \ref
+ * XSMeshRegion are flattened into plain arrays. These are mapped to the
+ * device once, on construction, and stay there until the \ref DeviceEvents
+ * is destroyed.
+ *
+ * Each event gathers the fields it needs for a queue of particles from an
+ * \ref EventBank, runs on the device and scatters the results back. The
+ * events that need the rest of the geometry (crossing into another pin,
+ * boundary conditions) or that produce new particles (fission sites) are
+ * left to the host.
+ *
+ * Each particle draws from its own random number stream in the same order
+ * as on the host, so the particles follow the same histories, to within
+ * the roundoff of the device math library.
+ */
+class DeviceEvents {
+public:
+    /**
+     * \param mesh the \ref CoreMesh to track particles through
+     * \param xs_mesh the \ref XSMesh
+     * \param xsmesh_regions the \ref XSMeshRegion of each mesh region
+     * \param reaction_tables the reaction alias tables, indexed by [xs
+     * region * n_group + group]
+     * \param scatter_tables the outgoing group alias tables, indexed like
+     * \p reaction_tables
+     */
+    DeviceEvents(const CoreMesh &mesh, const XSMesh &xs_mesh,
+                 const VecI &xsmesh_regions,
+                 const AliasTableSet &reaction_tables,
+                 const AliasTableSet &scatter_tables);
+
+    ~DeviceEvents();
+
+    DeviceEvents(const DeviceEvents &) = delete;
+    DeviceEvents &operator=(const DeviceEvents &) = delete;
+
+    /**
+     * \brief Distance-to-collision and distance-to-surface event
+     *
+     * Fills the \c d_collision, \c d_surface and \c pin_crossing fields of
+     * the particles in \p queue, and updates their coincident surfaces and
+     * random number streams.
+     */
+    void distance(const VecI &queue, EventBank &events);
+
+    /**
+     * \brief Collision event
+     *
+     * Moves each particle in \p queue to its collision site and samples the
+     * reaction. Scattered particles get their new group; capture kills the
+     * particle.
+     *
+     * \param queue the particles to collide
+     * \param events the particle storage
+     * \param reaction the sampled \ref Reaction of each particle in \p queue
+     * \param dir_random the two random numbers drawn for the outgoing
+     * direction of each scattered particle. The \ref Direction itself is
+     * built on the host, so that it matches a history-based simulation
+     * exactly.
+     */
+    void collide(const VecI &queue, EventBank &events, VecI &reaction,
+                 VecF &dir_random);
+
+    /**
+     * \brief Surface crossing event for surfaces inside of a pin
+     *
+     * Moves each particle in \p queue across the surface and finds its new
+     * mesh and XS mesh regions. All particles in \p queue should have \c
+     * pin_crossing unset.
+     */
+    void cross_internal(const VecI &queue, EventBank &events);
+
+private:
+    int n_group_;
+    int n_pm_;
+    int n_reg_;
+    int n_xs_;
+
+    // Device index of each PinMesh
+    std::map<const PinMesh *, int> pm_index_;
+
+    // Type of each pin mesh (0 for rectangular, 1 for cylindrical) and its
+    // x and y pitch
+    std::vector<int> pm_type_;
+    std::vector<real_t> pm_pitch_;
+
+    // First surface of each pin mesh, with an extra entry at the end
+    std::vector<int> pm_surf_;
+
+    // Type (0 for a line, 1 for a circle), ID and four coefficients of each
+    // surface: (x1, y1, x2, y2) for lines and (x, y, r, 0) for circles
+    std::vector<int> surf_type_;
+    std::vector<int> surf_id_;
+    std::vector<real_t> surf_coeff_;
+
+    // First division of each pin mesh, with an extra entry at the end, and
+    // its number of divisions along each dimension. Rectangular meshes store
+    // their x then y divisions and (nx, ny); cylindrical meshes store their
+    // ring radii and (n_rad, n_azi).
+    std::vector<int> pm_div_;
+    std::vector<int> pm_n_;
+    std::vector<real_t> div_;
+
+    // XS mesh region of each mesh region
+    std::vector<int> xsmesh_regions_;
+
+    // Transport cross section, indexed [xs region * n_group + group]
+    std::vector<real_t> xstr_;
+
+    // Flattened alias tables
+    std::vector<real_t> rx_prob_;
+    std::vector<int> rx_alias_;
+    std::vector<real_t> sc_prob_;
+    std::vector<int> sc_alias_;
+};
+} // namespace mc
+} // namespace mocc
@@ -0,0 +1,141 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "util/global_config.hpp"
+#include "util/rng_lcg.hpp"
+#include "core/core_mesh.hpp"
+#include "particle.hpp"
+
+namespace mocc {
+namespace mc {
+/**
+ * \brief Structure-of-arrays storage for the particles of an event-based
+ * simulation
+ *
+ * Each field of \ref Particle is stored in its own array, along with the
+ * state that the history-based loop keeps on the stack (the pin location
+ * information, coarse pin index and the particle's random number stream),
+ * and the results of the most recent distance calculations. This allows the
+ * flight and tally events to stream through only the fields that they need
+ * for a whole queue of particles.
+ *
+ * The events that need the full state of a particle (collisions and surface
+ * crossings) can use \ref get() and \ref set() to gather it into a \ref
+ * Particle and scatter it back.
+ */
+struct EventBank {
+public:
+    void resize(int n)
+    {
+        weight.resize(n);
+        group.resize(n);
+        location.resize(n);
+        direction.resize(n);
+        ireg.resize(n);
+        ixsreg.resize(n);
+        location_global.resize(n);
+        pin_position.resize(n);
+        id.resize(n);
+        coincident.resize(n);
+        alive.resize(n);
+        ipin.resize(n);
+        location_info.resize(n);
+        rng.resize(n);
+        d_collision.resize(n);
+        d_surface.resize(n);
+        pin_crossing.resize(n);
+        return;
+    }
+
+    int size() const
+    {
+        return weight.size();
+    }
+
+    /**
+     * \brief Gather the state of particle \p i into a \ref Particle
+     */
+    Particle get(int i) const
+    {
+        Particle p;
+        p.weight          = weight[i];
+        p.group           = group[i];
+        p.location        = location[i];
+        p.direction       = direction[i];
+        p.ireg            = ireg[i];
+        p.ixsreg          = ixsreg[i];
+        p.location_global = location_global[i];
+        p.pin_position    = pin_position[i];
+        p.id              = id[i];
+        p.coincident      = coincident[i];
+        p.alive           = alive[i];
+        return p;
+    }
+
+    /**
+     * \brief Scatter the state of a \ref Particle into slot \p i
+     */
+    void set(int i, const Particle &p)
+    {
+        weight[i]          = p.weight;
+        group[i]           = p.group;
+        location[i]        = p.location;
+        direction[i]       = p.direction;
+        ireg[i]            = p.ireg;
+        ixsreg[i]          = p.ixsreg;
+        location_global[i] = p.location_global;
+        pin_position[i]    = p.pin_position;
+        id[i]              = p.id;
+        coincident[i]      = p.coincident;
+        alive[i]           = p.alive;
+        return;
+    }
+
+    // Particle state, mirroring Particle
+    VecF weight;
+    VecI group;
+    std::vector<Point2> location;
+    std::vector<Direction> direction;
+    VecI ireg;
+    VecI ixsreg;
+    std::vector<Point3> location_global;
+    std::vector<Position> pin_position;
+    std::vector<unsigned> id;
+    VecI coincident;
+    // Not std::vector<bool>, so that different threads can safely write to
+    // neighboring particles
+    std::vector<unsigned char> alive;
+
+    // Coarse pin index and pin mesh information for the pin that each
+    // particle is currently in
+    VecI ipin;
+    std::vector<CoreMesh::LocationInfo> location_info;
+
+    // Random number stream for each particle
+    std::vector<RNG_LCG> rng;
+
+    // Distances to the next collision and surface, and whether the surface
+    // is a pin boundary
+    VecF d_collision;
+    VecF d_surface;
+    std::vector<unsigned char> pin_crossing;
+};
+} // namespace mc
+} // namespace mocc
@@ -16,13 +16,35 @@
 
 #include "fission_bank.hpp"
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <numeric>
+#include <utility>
+#ifdef MOCC_USE_MPI
+#include <mpi.h>
+#endif
 #include "pugixml.hpp"
 #include "util/error.hpp"
+#include "core/parallel_environment.hpp"
+
+namespace {
+// First global index in the share of the sites that belongs to a rank, when
+// n sites are split evenly over n_rank processes
+long share_begin(long n, int rank, int n_rank)
+{
+    return n * rank / n_rank;
+}
+}
 
 namespace mocc {
 namespace mc {
-FissionBank::FissionBank(const CoreMesh &mesh) : mesh_(mesh)
+FissionBank::FissionBank(const CoreMesh &mesh)
+    : mesh_(mesh),
+      distributed_(false),
+      total_fission_(0.0),
+      thread_sites_(omp_get_max_threads()),
+      thread_fission_(omp_get_max_threads() * fission_stride, 0.0)
 {
     return;
 }
@@ -30,7 +52,11 @@ FissionBank::FissionBank(const CoreMesh &mesh) : mesh_(mesh)
 FissionBank::FissionBank(const pugi::xml_node &input, int n,
                          const CoreMesh &mesh, const XSMesh &xs_mesh,
                          RNG_LCG &rng)
-    : mesh_(mesh), total_fission_(0.0)
+    : mesh_(mesh),
+      distributed_(false),
+      total_fission_(0.0),
+      thread_sites_(omp_get_max_threads()),
+      thread_fission_(omp_get_max_threads() * fission_stride, 0.0)
 {
     if (input.empty()) {
         throw EXCEPT("Empty input provided to FissionBank");
@@ -61,14 +87,14 @@ FissionBank::FissionBank(const pugi::xml_node &input, int n,
     // sites in fissile regions).
     bool fissile_rejection = input.attribute("fissile_rejection").as_bool(true);
 
-    sites_.reserve(n);
+    this->reserve_sites(n);
     if (!fissile_rejection) {
         for (int i = 0; i < n; i++) {
             Point3 p(rng.random(x_min, x_max), rng.random(y_min, y_max),
                      rng.random(z_min, z_max));
             Direction dir = Direction::Isotropic(rng.random(), rng.random());
             int ig = rng.random_int(ng);
-            sites_.emplace_back(p, dir, ig, i);
+            this->push_site(FissionSite(p, dir, ig, i));
         }
     }
     else {
@@ -78,31 +104,130 @@ FissionBank::FissionBank(const pugi::xml_node &input, int n,
                      rng.random(z_min, z_max));
             Direction dir = Direction::Isotropic(rng.random(), rng.random());
             int ig = rng.random_int(ng);
-            sites_.emplace_back(p, dir, ig, i);
+            this->push_site(FissionSite(p, dir, ig, i));
         }
     }
 
     return;
 }
 
+FissionBank::FissionBank(const ArrayB3 &pin_source, int n,
+                         const CoreMesh &mesh, const XSMesh &xs_mesh,
+                         RNG_LCG &rng)
+    : mesh_(mesh),
+      distributed_(false),
+      total_fission_(0.0),
+      thread_sites_(omp_get_max_threads()),
+      thread_fission_(omp_get_max_threads() * fission_stride, 0.0)
+{
+    const int nx = mesh.nx();
+    const int ny = mesh.ny();
+    const int ng = xs_mesh.n_group();
+    const auto &macroplanes = mesh.macroplanes();
+    if ((pin_source.extent(0) != (int)macroplanes.size()) ||
+        (pin_source.extent(1) != ny) || (pin_source.extent(2) != nx)) {
+        throw EXCEPT("Pin fission source does not match the mesh");
+    }
+
+    // Map from mesh regions to the XS mesh, to find the fissile regions and
+    // their fission spectra
+    VecI xsmesh_regions(mesh.n_reg(MeshTreatment::TRUE), -1);
+    int ixs = 0;
+    for (const auto &xsreg : xs_mesh) {
+        for (const auto &ireg : xsreg.reg()) {
+            xsmesh_regions[ireg] = ixs;
+        }
+        ixs++;
+    }
+
+    // Cumulative source over the pins, in the order of the source array
+    VecF cumulative(1, 0.0);
+    cumulative.reserve(pin_source.size() + 1);
+    for (auto it = pin_source.begin(); it != pin_source.end(); ++it) {
+        cumulative.push_back(cumulative.back() + std::max(*it, 0.0));
+    }
+    if (!(cumulative.back() > 0.0)) {
+        throw EXCEPT("Pin fission source is not positive");
+    }
+
+    const auto &x = mesh.x_divisions();
+    const auto &y = mesh.y_divisions();
+    const auto &z = mesh.z_divisions();
+
+    // Fissile regions may only fill part of the pin, so reject sites outside
+    // of them. Give up after a while, in case the source was generated with
+    // different materials.
+    const int max_tries = 1000;
+
+    this->reserve_sites(n);
+    for (int i = 0; i < n; i++) {
+        real_t u = rng.random(cumulative.back());
+        int icell =
+            std::upper_bound(cumulative.begin() + 1, cumulative.end(), u) -
+            (cumulative.begin() + 1);
+        icell = std::min(icell, (int)pin_source.size() - 1);
+
+        int ix                  = icell % nx;
+        int iy                  = (icell / nx) % ny;
+        const auto &mplane      = macroplanes[icell / (nx * ny)];
+        const XSMeshRegion *xsr = nullptr;
+        Point3 p;
+        for (int itry = 0; itry < max_tries; itry++) {
+            p = Point3(rng.random(x[ix], x[ix + 1]),
+                       rng.random(y[iy], y[iy + 1]),
+                       rng.random(z[mplane.iz_min], z[mplane.iz_max + 1]));
+            xsr = &xs_mesh[xsmesh_regions[mesh.region_at_point(p)]];
+            real_t nf = 0.0;
+            for (int ig = 0; ig < ng; ig++) {
+                nf += xsr->xsmacnf(ig);
+            }
+            if (nf > 0.0) {
+                break;
+            }
+        }
+
+        // Sample the group from the fission spectrum
+        real_t r  = rng.random();
+        int group = ng - 1;
+        for (int ig = 0; ig < ng; ig++) {
+            r -= xsr->xsmacch(ig);
+            if (r < 0.0) {
+                group = ig;
+                break;
+            }
+        }
+
+        Direction dir = Direction::Isotropic(rng.random(), rng.random());
+        this->push_site(FissionSite(p, dir, group, i));
+    }
+
+    return;
+}
+
 real_t FissionBank::shannon_entropy() const
 {
     real_t h = 0.0;
 
     VecF populations(mesh_.n_pin(), 0.0);
 
-    for (const auto &p : sites_) {
-        int icell = mesh_.coarse_cell_point(p.location_global);
+    for (int i = 0; i < this->size(); i++) {
+        int icell = mesh_.coarse_cell_point(location_[i]);
         if (icell < 0 || icell > (int)mesh_.n_pin()) {
             std::stringstream msg;
-            msg << "Couldnt locate particle: " << p << std::endl;
+            msg << "Couldnt locate fission site: " << location_[i].x << " "
+                << location_[i].y << " " << location_[i].z << std::endl;
             throw EXCEPT(msg.str());
         }
-        populations[icell] += p.weight;
+        populations[icell] += weight_[i];
+    }
+
+    if (distributed_) {
+        ParEnv.sum(populations.data(), populations.size());
     }
+    const int n = this->global_size();
 
     for (const auto &p : populations) {
-        real_t pj = p / sites_.size();
+        real_t pj = p / n;
         if (pj > 0.0) {
             h -= pj * std::log2(pj);
         }
@@ -111,53 +236,604 @@ real_t FissionBank::shannon_entropy() const
     return h;
 }
 
+void FissionBank::commit()
+{
+    int n_thread = thread_sites_.size();
+
+    // Find where each thread's sites go with a prefix sum over the buffer
+    // sizes. The existing sites, if any, are already in order and form the
+    // first run.
+    const int n_old = this->size();
+    std::vector<size_t> bounds;
+    bounds.reserve(n_thread + 2);
+    bounds.push_back(0);
+    if (n_old > 0) {
+        bounds.push_back(n_old);
+    }
+    int first_run = bounds.size() - 1;
+    for (const auto &sites : thread_sites_) {
+        bounds.push_back(bounds.back() + sites.size());
+    }
+    int n_run = bounds.size() - 1;
+
+    for (int it = 0; it < n_thread; it++) {
+        total_fission_ += thread_fission_[it * fission_stride];
+        thread_fission_[it * fission_stride] = 0.0;
+    }
+
+    // The merge moves whole sites, so gather the bank into a temporary array
+    // of records, and scatter it back into the bank's arrays at the end
+    std::vector<FissionSite> merged(bounds.back());
+#pragma omp parallel for
+    for (int i = 0; i < n_old; i++) {
+        merged[i] = (*this)[i];
+    }
+
+    // Sort each thread's sites by parent and copy them into place
+#pragma omp parallel for
+    for (int it = 0; it < n_thread; it++) {
+        auto &sites = thread_sites_[it];
+        std::stable_sort(sites.begin(), sites.end());
+        std::copy(sites.begin(), sites.end(),
+                  merged.begin() + bounds[first_run + it]);
+        sites.clear();
+    }
+
+    // Merge the sorted runs pairwise. A parent's sites all come from the
+    // same thread, so there are no ties between runs, and the result does
+    // not depend on how the sites were split among threads.
+    for (int width = 1; width < n_run; width *= 2) {
+#pragma omp parallel for
+        for (int ir = 0; ir < n_run - width; ir += 2 * width) {
+            int ir_last = std::min(ir + 2 * width, n_run);
+            std::inplace_merge(merged.begin() + bounds[ir],
+                               merged.begin() + bounds[ir + width],
+                               merged.begin() + bounds[ir_last]);
+        }
+    }
+
+    const int n = merged.size();
+    this->resize_sites(n);
+#pragma omp parallel for
+    for (int i = 0; i < n; i++) {
+        this->set_site(i, merged[i]);
+    }
+
+    return;
+}
+
 void FissionBank::resize(unsigned int n, RNG_LCG &rng)
 {
-    assert(sites_.size() > 0);
+    if (distributed_) {
+        throw EXCEPT("Random resampling of a distributed fission bank is not "
+                     "supported.");
+    }
+    assert(this->size() > 0);
+    int n_orig = this->size();
 
-    if (n > sites_.size()) {
+    if ((int)n > n_orig) {
         // Fission bank is too small. Randomly sample fission sites to
         // expand.
         // Make sure to only sample for the original sites. Probably not
         // absolutely necessary, but keeps the original sites equally
         // probable for the whole process.
-        int n_orig = sites_.size();
-        while (sites_.size() < n) {
-            int i_rand = rng.random_int(n_orig);
-            sites_.push_back(sites_[i_rand]);
+        int n_add = n - n_orig;
+        VecI index(n);
+        for (int i = 0; i < n_orig; i++) {
+            index[i] = i;
+        }
+#pragma omp parallel for
+        for (int i = 0; i < n_add; i++) {
+            RNG_LCG rng_i = rng;
+            rng_i.jump_ahead(i);
+            index[n_orig + i] = rng_i.random_int(n_orig);
+        }
+        rng.jump_ahead(n_add);
+        this->select(index);
+    }
+
+    if ((int)n < n_orig) {
+        // Fission bank is too big. Keep a random subset of the sites, by
+        // giving each site a random key and keeping the n sites with the
+        // smallest keys. The survivors stay in their original order.
+        std::vector<std::pair<real_t, int>> keys(n_orig);
+#pragma omp parallel for
+        for (int i = 0; i < n_orig; i++) {
+            RNG_LCG rng_i = rng;
+            rng_i.jump_ahead(i);
+            keys[i] = {rng_i.random(), i};
+        }
+        rng.jump_ahead(n_orig);
+
+        auto threshold = keys;
+        std::nth_element(threshold.begin(), threshold.begin() + n,
+                         threshold.end());
+        auto cutoff = threshold[n];
+
+        VecI index;
+        index.reserve(n);
+        for (int i = 0; i < n_orig; i++) {
+            if (keys[i] < cutoff) {
+                index.push_back(i);
+            }
+        }
+        this->select(index);
+    }
+    assert(this->size() == (int)n);
+
+    return;
+}
+
+void FissionBank::comb(unsigned int n, RNG_LCG &rng)
+{
+    assert(distributed_ || (this->size() > 0));
+    const int n_orig  = this->size();
+    const int block   = 4096;
+    const int n_block = (n_orig + block - 1) / block;
+
+    // Running total of the site weights, cumulative[i] being the weight of
+    // all sites before site i. Each block is scanned on its own, then shifted
+    // by the total of the blocks before it.
+    VecF cumulative(n_orig + 1, 0.0);
+    VecF block_offset(n_block + 1, 0.0);
+#pragma omp parallel
+    {
+#pragma omp for
+        for (int ib = 0; ib < n_block; ib++) {
+            int last   = std::min(n_orig, (ib + 1) * block);
+            real_t sum = 0.0;
+            for (int i = ib * block; i < last; i++) {
+                sum += weight_[i];
+                cumulative[i + 1] = sum;
+            }
+            block_offset[ib + 1] = sum;
+        }
+
+#pragma omp single
+        for (int ib = 0; ib < n_block; ib++) {
+            block_offset[ib + 1] += block_offset[ib];
+        }
+
+#pragma omp for
+        for (int ib = 0; ib < n_block; ib++) {
+            int last = std::min(n_orig, (ib + 1) * block);
+            for (int i = ib * block; i < last; i++) {
+                cumulative[i + 1] += block_offset[ib];
+            }
         }
     }
 
-    if (n < sites_.size()) {
-        // Fission bank is too big. Randomly sample fission sites to remove.
-        // We do a swap, then pop_back because A) the order doesnt matter,
-        // and B) it avoids having to shuffle elements past the removed
-        // element. I could probaly just truncate the vector, but for some
-        // reason this feels more right
-        int n_remove = sites_.size() - n;
-        for (int i = 0; i < n_remove; i++) {
-            int i_rand     = rng.random_int(sites_.size());
-            sites_[i_rand] = sites_.back();
-            sites_.pop_back();
+    // Total weight of the sites on each process, and of the sites before
+    // ours in the global sequence
+    const int n_rank = distributed_ ? ParEnv.n_rank() : 1;
+    const int rank   = distributed_ ? ParEnv.rank() : 0;
+    VecF rank_total(n_rank, 0.0);
+    rank_total[rank] = cumulative.back();
+    if (n_rank > 1) {
+        ParEnv.sum(rank_total.data(), n_rank);
+    }
+    VecF before(n_rank + 1, 0.0);
+    std::partial_sum(rank_total.begin(), rank_total.end(), before.begin() + 1);
+
+    const real_t total  = before.back();
+    const real_t weight = total / n;
+    const real_t u      = rng.random();
+
+    // Teeth [tooth[r], tooth[r + 1]) land on the sites of rank r. Every
+    // process finds the same bounds from the same totals. The last rank that
+    // has any sites takes the remaining teeth, in case rounding drops the
+    // last one.
+    int last_rank = 0;
+    for (int r = 0; r < n_rank; r++) {
+        if (rank_total[r] > 0.0) {
+            last_rank = r;
         }
     }
-    assert(sites_.size() == n);
+    std::vector<long> tooth(n_rank + 1, n);
+    tooth[0] = 0;
+    for (int r = 1; r <= last_rank; r++) {
+        long j   = std::ceil(before[r] / weight - u);
+        tooth[r] = std::min(std::max(j, tooth[r - 1]), (long)n);
+    }
+
+    const int j_first = tooth[rank];
+    const int n_teeth = tooth[rank + 1] - j_first;
+    VecI index(n_teeth);
+#pragma omp parallel for
+    for (int j = 0; j < n_teeth; j++) {
+        real_t t = (u + j_first + j) * weight - before[rank];
+        auto it  = std::upper_bound(cumulative.begin() + 1, cumulative.end(),
+                                   t);
+        int i = it - (cumulative.begin() + 1);
+
+        index[j] = std::max(std::min(i, n_orig - 1), 0);
+    }
+    this->select(index);
+    std::fill(weight_.begin(), weight_.end(), weight);
+
+    return;
+}
+
+int FissionBank::global_size() const
+{
+    auto sizes = this->rank_sizes();
+    return std::accumulate(sizes.begin(), sizes.end(), 0l);
+}
+
+void FissionBank::renumber()
+{
+    // Sites on lower ranks come first in the global sequence
+    unsigned first = first_site(this->rank_sizes());
+    for (int i = 0; i < this->size(); i++) {
+        id_[i] = first + i;
+    }
+    return;
+}
+
+void FissionBank::distribute()
+{
+    const long n     = this->size();
+    const long first = share_begin(n, ParEnv.rank(), ParEnv.n_rank());
+    const long last  = share_begin(n, ParEnv.rank() + 1, ParEnv.n_rank());
+    VecI index(last - first);
+    std::iota(index.begin(), index.end(), first);
+    this->select(index);
+    distributed_ = true;
+    return;
+}
+
+void FissionBank::balance()
+{
+    if (!distributed_ || (ParEnv.n_rank() < 2)) {
+        return;
+    }
+#ifdef MOCC_USE_MPI
+    const int n_rank = ParEnv.n_rank();
+    const int rank   = ParEnv.rank();
+
+    // Global index of the first site on each rank, now and once balanced
+    auto sizes = this->rank_sizes();
+    std::vector<long> offset(n_rank + 1, 0);
+    std::partial_sum(sizes.begin(), sizes.end(), offset.begin() + 1);
+    const long n = offset.back();
+    std::vector<long> share(n_rank + 1);
+    for (int r = 0; r <= n_rank; r++) {
+        share[r] = share_begin(n, r, n_rank);
+    }
+
+    // Sites are sent as a record of doubles, which holds every field exactly
+    const int n_field = 8;
+    const int n_old   = this->size();
+    const int n_new   = share[rank + 1] - share[rank];
+    std::vector<double> send(n_old * n_field);
+    std::vector<double> recv(n_new * n_field);
+#pragma omp parallel for
+    for (int i = 0; i < n_old; i++) {
+        double *site = &send[i * n_field];
+        site[0]      = location_[i].x;
+        site[1]      = location_[i].y;
+        site[2]      = location_[i].z;
+        site[3]      = alpha_[i];
+        site[4]      = theta_[i];
+        site[5]      = weight_[i];
+        site[6]      = group_[i];
+        site[7]      = id_[i];
+    }
+
+    // Exchange the overlaps between our sites and the shares of the other
+    // ranks, keeping the sites that stay here
+    std::vector<MPI_Request> requests;
+    for (int r = 0; r < n_rank; r++) {
+        long first = std::max(offset[rank], share[r]);
+        long last  = std::min(offset[rank + 1], share[r + 1]);
+        if (last > first) {
+            double *data = &send[(first - offset[rank]) * n_field];
+            int count    = (last - first) * n_field;
+            if (r == rank) {
+                std::copy(data, data + count,
+                          &recv[(first - share[rank]) * n_field]);
+            } else {
+                requests.emplace_back();
+                MPI_Isend(data, count, MPI_DOUBLE, r, 0, MPI_COMM_WORLD,
+                          &requests.back());
+            }
+        }
+
+        first = std::max(offset[r], share[rank]);
+        last  = std::min(offset[r + 1], share[rank + 1]);
+        if ((last > first) && (r != rank)) {
+            requests.emplace_back();
+            MPI_Irecv(&recv[(first - share[rank]) * n_field],
+                      (last - first) * n_field, MPI_DOUBLE, r, 0,
+                      MPI_COMM_WORLD, &requests.back());
+        }
+    }
+    MPI_Waitall(requests.size(), requests.data(), MPI_STATUSES_IGNORE);
+
+    this->resize_sites(n_new);
+#pragma omp parallel for
+    for (int i = 0; i < n_new; i++) {
+        const double *site = &recv[i * n_field];
+        location_[i]       = Point3(site[0], site[1], site[2]);
+        alpha_[i]          = site[3];
+        theta_[i]          = site[4];
+        weight_[i]         = site[5];
+        group_[i]          = site[6];
+        id_[i]             = site[7];
+    }
+#endif
+
+    return;
+}
+
+void FissionBank::sort_sites()
+{
+    const int n = this->size();
+    if (n == 0) {
+        return;
+    }
+
+    VecI pin(n);
+#pragma omp parallel for
+    for (int i = 0; i < n; i++) {
+        pin[i] = mesh_.coarse_cell_point(location_[i]);
+    }
+
+    // Sort fixed-size runs of the site indices in parallel, then merge them
+    // pairwise, as in commit()
+    VecI order(n);
+    for (int i = 0; i < n; i++) {
+        order[i] = i;
+    }
+    auto by_pin = [&pin](int l, int r) {
+        return (pin[l] < pin[r]) || ((pin[l] == pin[r]) && (l < r));
+    };
+    const int run   = 4096;
+    const int n_run = (n + run - 1) / run;
+#pragma omp parallel for
+    for (int ir = 0; ir < n_run; ir++) {
+        std::sort(order.begin() + ir * run,
+                  order.begin() + std::min(n, (ir + 1) * run), by_pin);
+    }
+    for (int width = 1; width < n_run; width *= 2) {
+#pragma omp parallel for
+        for (int ir = 0; ir < n_run - width; ir += 2 * width) {
+            int last = std::min(n, (ir + 2 * width) * run);
+            std::inplace_merge(order.begin() + ir * run,
+                               order.begin() + (ir + width) * run,
+                               order.begin() + last, by_pin);
+        }
+    }
+
+    this->select(order);
 
     return;
 }
 
 void FissionBank::swap(FissionBank &other)
 {
-    sites_.swap(other.sites_);
+    location_.swap(other.location_);
+    alpha_.swap(other.alpha_);
+    theta_.swap(other.theta_);
+    weight_.swap(other.weight_);
+    group_.swap(other.group_);
+    id_.swap(other.id_);
     real_t tfis          = total_fission_;
     total_fission_       = other.total_fission_;
     other.total_fission_ = tfis;
 }
 
+void FissionBank::write_checkpoint(H5Node &node) const
+{
+    int n = this->size();
+    VecF x(n);
+    VecF y(n);
+    VecF z(n);
+    VecF ox(n);
+    VecF oy(n);
+    VecF oz(n);
+    VecF group(n);
+    VecF id(n);
+    VecF weight(n);
+    for (int i = 0; i < n; i++) {
+        Direction dir(alpha_[i], theta_[i]);
+        x[i]      = location_[i].x;
+        y[i]      = location_[i].y;
+        z[i]      = location_[i].z;
+        ox[i]     = dir.ox;
+        oy[i]     = dir.oy;
+        oz[i]     = dir.oz;
+        group[i]  = group_[i];
+        id[i]     = id_[i];
+        weight[i] = weight_[i];
+    }
+
+    node.write("x", x);
+    node.write("y", y);
+    node.write("z", z);
+    node.write("ox", ox);
+    node.write("oy", oy);
+    node.write("oz", oz);
+    node.write("group", group);
+    node.write("id", id);
+    node.write("weight", weight);
+    node.write("total_fission", VecF(1, total_fission_));
+
+    return;
+}
+
+void FissionBank::output(H5Node &node) const
+{
+    auto sizes = this->rank_sizes();
+    std::vector<hsize_t> dims(
+        1, std::accumulate(sizes.begin(), sizes.end(), 0l));
+    hsize_t first = first_site(sizes);
+
+    int n = this->size();
+    VecF x(n);
+    VecF y(n);
+    VecF z(n);
+    VecF group(n);
+    VecF weight(n);
+    for (int i = 0; i < n; i++) {
+        x[i]      = location_[i].x;
+        y[i]      = location_[i].y;
+        z[i]      = location_[i].z;
+        group[i]  = group_[i];
+        weight[i] = weight_[i];
+    }
+
+    node.write_slab("x", x.data(), dims, first, n);
+    node.write_slab("y", y.data(), dims, first, n);
+    node.write_slab("z", z.data(), dims, first, n);
+    node.write_slab("group", group.data(), dims, first, n);
+    node.write_slab("weight", weight.data(), dims, first, n);
+
+    return;
+}
+
+void FissionBank::read_checkpoint(H5Node &node)
+{
+    VecF x;
+    VecF y;
+    VecF z;
+    VecF ox;
+    VecF oy;
+    VecF oz;
+    VecF group;
+    VecF id;
+    VecF weight;
+    VecF total_fission;
+    node.read("x", x);
+    node.read("y", y);
+    node.read("z", z);
+    node.read("ox", ox);
+    node.read("oy", oy);
+    node.read("oz", oz);
+    node.read("group", group);
+    node.read("id", id);
+    node.read("weight", weight);
+    node.read("total_fission", total_fission);
+
+    unsigned n = x.size();
+    for (const auto *v : {&y, &z, &ox, &oy, &oz, &group, &id, &weight}) {
+        if (v->size() != n) {
+            throw EXCEPT("Malformed fission bank in checkpoint file.");
+        }
+    }
+    if (total_fission.size() != 1) {
+        throw EXCEPT("Malformed fission bank in checkpoint file.");
+    }
+
+    this->resize_sites(0);
+    this->reserve_sites(n);
+    for (unsigned i = 0; i < n; i++) {
+        this->push_site(FissionSite(Point3(x[i], y[i], z[i]),
+                                    Direction(ox[i], oy[i], oz[i]),
+                                    (int)group[i], (unsigned)id[i],
+                                    weight[i]));
+    }
+    total_fission_ = total_fission[0];
+
+    return;
+}
+
+void FissionBank::reserve_sites(int n)
+{
+    location_.reserve(n);
+    alpha_.reserve(n);
+    theta_.reserve(n);
+    weight_.reserve(n);
+    group_.reserve(n);
+    id_.reserve(n);
+    return;
+}
+
+void FissionBank::resize_sites(int n)
+{
+    location_.resize(n);
+    alpha_.resize(n);
+    theta_.resize(n);
+    weight_.resize(n);
+    group_.resize(n);
+    id_.resize(n);
+    return;
+}
+
+void FissionBank::push_site(const FissionSite &site)
+{
+    location_.push_back(site.location);
+    alpha_.push_back(site.alpha);
+    theta_.push_back(site.theta);
+    weight_.push_back(site.weight);
+    group_.push_back(site.group);
+    id_.push_back(site.id);
+    return;
+}
+
+void FissionBank::set_site(int i, const FissionSite &site)
+{
+    location_[i] = site.location;
+    alpha_[i]    = site.alpha;
+    theta_[i]    = site.theta;
+    weight_[i]   = site.weight;
+    group_[i]    = site.group;
+    id_[i]       = site.id;
+    return;
+}
+
+namespace {
+template <typename T>
+void select_field(std::vector<T> &field, const VecI &index)
+{
+    std::vector<T> selected(index.size());
+#pragma omp parallel for
+    for (int j = 0; j < (int)index.size(); j++) {
+        selected[j] = field[index[j]];
+    }
+    field.swap(selected);
+    return;
+}
+} // namespace
+
+void FissionBank::select(const VecI &index)
+{
+    select_field(location_, index);
+    select_field(alpha_, index);
+    select_field(theta_, index);
+    select_field(weight_, index);
+    select_field(group_, index);
+    select_field(id_, index);
+    return;
+}
+
+std::vector<long> FissionBank::rank_sizes() const
+{
+    long n = this->size();
+#ifdef MOCC_USE_MPI
+    if (distributed_ && (ParEnv.n_rank() > 1)) {
+        std::vector<long> sizes(ParEnv.n_rank());
+        MPI_Allgather(&n, 1, MPI_LONG, sizes.data(), 1, MPI_LONG,
+                      MPI_COMM_WORLD);
+        return sizes;
+    }
+#endif
+    return std::vector<long>(1, n);
+}
+
+long FissionBank::first_site(const std::vector<long> &sizes)
+{
+    // Sites on lower ranks come first in the global sequence
+    if (sizes.size() < 2) {
+        return 0;
+    }
+    return std::accumulate(sizes.begin(), sizes.begin() + ParEnv.rank(), 0l);
+}
+
 std::ostream &operator<<(std::ostream &os, const FissionBank &bank)
 {
-    for (const auto &p : bank.sites_) {
-        os << p.location_global.x << ", " << p.location_global.y << std::endl;
+    for (const auto &p : bank.location_) {
+        os << p.x << ", " << p.y << std::endl;
     }
     return os;
 }
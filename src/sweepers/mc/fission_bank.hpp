@@ -16,11 +16,17 @@
 
 #pragma once
 
+#include <algorithm>
 #include <array>
+#include <cassert>
 #include <iosfwd>
 #include <vector>
 
+#include "util/blitz_typedefs.hpp"
 #include "util/global_config.hpp"
+#include "util/h5file.hpp"
+#include "util/memory.hpp"
+#include "util/omp_guard.h"
 #include "util/pugifwd.hpp"
 #include "util/rng_lcg.hpp"
 #include "core/core_mesh.hpp"
@@ -31,7 +37,14 @@
 namespace mocc {
 namespace mc {
 /**
- * A FissionBank stores a sequence of fission sites. Nothing fancy
+ * A FissionBank stores a sequence of fission sites, as compact \ref
+ * FissionSite records rather than whole \ref Particle objects.
+ *
+ * When running on several processes, a bank may be distributed, with each
+ * process holding a contiguous piece of one global sequence of sites, in rank
+ * order. The methods that act on the whole sequence (\ref comb(), \ref
+ * balance(), \ref renumber(), \ref shannon_entropy() and \ref
+ * global_size()) are then collective, and must be called by every process.
  */
 class FissionBank {
 public:
@@ -54,50 +67,107 @@ public:
     FissionBank(const pugi::xml_node &input, int n, const CoreMesh &mesh,
                 const XSMesh &xs_mesh, RNG_LCG &rng);
 
-    auto begin()
-    {
-        return sites_.begin();
-    }
+    /**
+     * \brief Construct a FissionBank by sampling fission sites from a
+     * pin-wise fission source
+     *
+     * \param pin_source the fission source in each pin of each macroplane,
+     * indexed by [macroplane, y, x], as in \ref TransportSweeper::pin_powers()
+     * \param n the number of initial sites to sample
+     * \param mesh the \ref CoreMesh to use for initial sampling
+     * \param xs_mesh the \ref XSMesh to use for initial sampling
+     * \param rng a reference to the random number generator to be used for
+     * sampling initial fission sites.
+     *
+     * Pins are chosen in proportion to their source, and the sites are placed
+     * uniformly within the fissile regions of the pin, with their group
+     * sampled from the fission spectrum of the region.
+     */
+    FissionBank(const ArrayB3 &pin_source, int n, const CoreMesh &mesh,
+                const XSMesh &xs_mesh, RNG_LCG &rng);
 
-    const auto begin() const
+    int size() const
     {
-        return sites_.cbegin();
+        return id_.size();
     }
 
-    auto end()
-    {
-        return sites_.end();
-    }
+    /**
+     * \brief Return the number of sites on all processes
+     */
+    int global_size() const;
 
-    const auto end() const
+    /**
+     * \brief Return whether the bank is distributed over the processes
+     */
+    bool distributed() const
     {
-        return sites_.cend();
+        return distributed_;
     }
 
-    int size() const
+    /**
+     * \brief Mark the bank as distributed over the processes, or not
+     *
+     * This doesn't move any sites. It is meant for banks that are only ever
+     * filled with each process's own sites, such as the bank of new fission
+     * sites in the \ref ParticlePusher.
+     */
+    void set_distributed(bool distributed)
     {
-        return sites_.size();
+        distributed_ = distributed;
     }
 
+    /**
+     * \brief Distribute a bank that is the same on every process
+     *
+     * Each process keeps its own contiguous share of the sites, as in \ref
+     * balance(), and drops the rest.
+     */
+    void distribute();
+
+    /**
+     * \brief Even out the number of sites on each process
+     *
+     * The global sequence of sites is split into contiguous shares, as even
+     * as possible, and each process sends the sites that fall in the shares
+     * of other processes to them. The global order of the sites is
+     * unchanged, so the sites that each process simulates, and their IDs,
+     * depend only on the number of processes. Since \ref comb()
+     * leaves each process with close to its share already, the sites
+     * usually only move between neighbouring ranks.
+     */
+    void balance();
+
     /**
      * \brief Add a new fission site to the \ref FissionBank
      *
-     * \param p a \ref Point3 for the location of the fission site
+     * \param site the new \ref FissionSite
      *
-     * This method adds a new fission site to the fission bank, and makes a
-     * contribution to the total number of neutrons that were generated into
-     * the bank.
+     * This method adds a new fission site to the calling thread's buffer, and
+     * makes a contribution to the total number of neutrons that were
+     * generated into the bank. The new sites are not part of the bank until
+     * \ref commit() is called.
      */
-    void push_back(Particle &p)
+    void push_back(const FissionSite &site)
     {
-#pragma omp critical
-        {
-            sites_.push_back(p);
-            total_fission_ += p.weight;
-        }
+        int it = omp_get_thread_num();
+        assert(it < (int)thread_sites_.size());
+        thread_sites_[it].push_back(site);
+        thread_fission_[it * fission_stride] += site.weight;
         return;
     }
 
+    /**
+     * \brief Move the sites from the per-thread buffers into the bank
+     *
+     * This should be called outside of any parallel region, once all threads
+     * are done calling \ref push_back(). The new sites are ordered by the ID
+     * of their parent particle; sites with the same parent stay in the order
+     * that they were generated. Since each parent is only ever simulated on
+     * one thread, the resulting order is independent of the number of
+     * threads.
+     */
+    void commit();
+
     /**
      * \brief Return the Shannon entropy of the fission bank.
      *
@@ -116,11 +186,36 @@ public:
      */
     void swap(FissionBank &other);
 
-    const auto &operator[](unsigned i) const
+    /**
+     * \brief Return a copy of site \p i
+     */
+    FissionSite operator[](int i) const
+    {
+        return FissionSite(location_[i], Direction(alpha_[i], theta_[i]),
+                           group_[i], id_[i], weight_[i]);
+    }
+
+    const Point3 &location(int i) const
+    {
+        return location_[i];
+    }
+
+    real_t weight(int i) const
+    {
+        return weight_[i];
+    }
+
+    real_t &weight(int i)
     {
-        return sites_[i];
+        return weight_[i];
     }
 
+    /**
+     * \brief Set the ID of each site to its index in the bank, counting the
+     * sites on lower ranks for a distributed bank
+     */
+    void renumber();
+
     /**
      * \brief Clear the \ref FissionBank of all fission sites
      */
@@ -128,24 +223,151 @@ public:
     {
 #pragma omp single
         {
-            sites_.clear();
+            this->resize_sites(0);
+            for (auto &sites : thread_sites_) {
+                sites.clear();
+            }
+            std::fill(thread_fission_.begin(), thread_fission_.end(), 0.0);
             total_fission_ = 0.0;
         }
     }
 
+    /**
+     * \brief Resize the bank to \p n sites by randomly duplicating or
+     * removing sites
+     *
+     * Each random number used is drawn from its own position in the sequence
+     * of \p rng, found by jumping ahead, so that the sampling can be done in
+     * parallel with results that don't depend on the number of threads. \p
+     * rng is advanced past all of the numbers used.
+     *
+     * This is not supported for distributed banks.
+     */
     void resize(unsigned int n, RNG_LCG &rng);
 
+    /**
+     * \brief Resample the bank to \p n sites by systematic combing
+     *
+     * The sites are laid end-to-end along a line, each taking up a length
+     * equal to its weight, and \p n evenly-spaced teeth, offset by a single
+     * random number drawn from \p rng, pick out the new sites. Each site is
+     * therefore kept a number of times that differs from its expected share
+     * by less than one, which has lower variance than sampling the sites
+     * independently as in \ref resize(). The new sites keep their original
+     * order and share the total weight of the bank evenly.
+     *
+     * The running weight total is built with a blocked parallel prefix sum,
+     * whose blocking doesn't depend on the number of threads.
+     *
+     * For a distributed bank, the teeth span the global sequence of sites,
+     * and every process must pass an \p rng in the same state. Each process
+     * keeps the new sites from its own old sites, so the new bank is
+     * generally not balanced.
+     */
+    void comb(unsigned int n, RNG_LCG &rng);
+
+    /**
+     * \brief Sort the sites by the pin that they lie in
+     *
+     * Simulating the sites of the next cycle in this order keeps particles
+     * that are near each other in space on the same thread at about the same
+     * time, so the geometry and cross sections that they look up tend to
+     * already be in cache. Sites in the same pin keep their relative order,
+     * so the result is independent of the number of threads. Each process
+     * only sorts its own sites of a distributed bank.
+     */
+    void sort_sites();
+
     real_t total_fission() const
     {
         return total_fission_;
     }
 
+    /**
+     * \brief Return the number of bytes allocated for the fission sites,
+     * including the per-thread banks
+     */
+    size_t memory() const
+    {
+        size_t mem = location_.capacity() * sizeof(Point3) + bytes(alpha_) +
+                     bytes(theta_) + bytes(weight_) + bytes(group_) +
+                     id_.capacity() * sizeof(unsigned) + bytes(thread_fission_);
+        for (const auto &t : thread_sites_) {
+            mem += t.capacity() * sizeof(FissionSite);
+        }
+        return mem;
+    }
+
+    /**
+     * \brief Write the fission sites to an HDF5 node, for a checkpoint
+     */
+    void write_checkpoint(H5Node &node) const;
+
+    /**
+     * \brief Replace the fission sites with those stored by \ref
+     * write_checkpoint()
+     */
+    void read_checkpoint(H5Node &node);
+
+    /**
+     * \brief Write the location, group and weight of every site, as 1-D
+     * datasets over the global sequence of sites
+     *
+     * Each process writes its own sites with \ref H5Node::write_slab(), so a
+     * distributed bank must be written to a file shared by all of the
+     * processes (see \ref H5Access::PARALLEL). This is collective.
+     */
+    void output(H5Node &node) const;
+
     friend std::ostream &operator<<(std::ostream &os, const FissionBank &bank);
 
 private:
+    // Spacing between the per-thread fission totals, so that each lands on
+    // its own cache line
+    static const int fission_stride = 8;
+
     const CoreMesh &mesh_;
-    std::vector<Particle> sites_;
+
+    bool distributed_;
+
+    // The fields of each fission site, stored structure-of-arrays so that
+    // the passes over the bank between cycles (combing, sorting, entropy)
+    // only read the fields that they need
+    std::vector<Point3> location_;
+    VecF alpha_;
+    VecF theta_;
+    VecF weight_;
+    VecI group_;
+    std::vector<unsigned> id_;
+
     real_t total_fission_;
+
+    // Sites and fission totals generated by each thread, since the last
+    // commit()
+    std::vector<std::vector<FissionSite>> thread_sites_;
+    VecF thread_fission_;
+
+    /**
+     * \brief Return the number of sites on each process
+     */
+    std::vector<long> rank_sizes() const;
+
+    /**
+     * \brief Return the index in the global sequence of the first site on
+     * this process, given the result of \ref rank_sizes()
+     */
+    static long first_site(const std::vector<long> &sizes);
+
+    void reserve_sites(int n);
+    void resize_sites(int n);
+    void push_site(const FissionSite &site);
+    void set_site(int i, const FissionSite &site);
+
+    /**
+     * \brief Replace the sites with the sites at the passed indices, in their
+     * order. An index may appear any number of times.
+     */
+    void select(const VecI &index);
 };
 } // namespace mc
 } // namespace mocc
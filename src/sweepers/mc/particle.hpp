@@ -52,6 +52,8 @@ const real_t BUMP   = 1.0e-11;
  * underlying 2-D nature of the pin meshes. Again, to go more general would
  * require a change to the \ref Particle struct.
  */
+struct FissionSite;
+
 struct Particle {
 public:
     Particle()
@@ -69,6 +71,11 @@ public:
     {
         return;
     }
+
+    /**
+     * \brief Start a new \ref Particle from a \ref FissionSite
+     */
+    explicit Particle(const FissionSite &site);
     // Particle weight (for variance reduction and the like)
     real_t weight;
     // Particle's energy group
@@ -125,5 +132,54 @@ public:
     friend std::ostream &operator<<(std::ostream &os, const Particle &p);
 };
 
+/**
+ * \brief The state of a particle that is needed to start its history
+ *
+ * This is all that a \ref FissionBank keeps for each site; the rest of the
+ * \ref Particle state (the pin-local location, region indices, etc.) is
+ * found when the history starts. The direction is kept as its azimuthal and
+ * polar angles, from which the \ref Direction is rebuilt to within round-off
+ * of the one that \ref Direction::Isotropic() built.
+ */
+struct FissionSite {
+    FissionSite()
+    {
+    }
+
+    FissionSite(const Point3 &loc, const Direction &dir, int ig, unsigned id,
+                real_t weight = 1.0)
+        : location(loc),
+          alpha(dir.alpha),
+          theta(dir.theta),
+          weight(weight),
+          group(ig),
+          id(id)
+    {
+        return;
+    }
+
+    Point3 location;
+    real_t alpha;
+    real_t theta;
+    real_t weight;
+    int group;
+    // ID of the parent particle, or of the site itself once the bank is
+    // renumbered
+    unsigned id;
+
+    bool operator<(const FissionSite &other) const
+    {
+        return id < other.id;
+    }
+};
+
+inline Particle::Particle(const FissionSite &site)
+    : Particle(site.location, Direction(site.alpha, site.theta), site.group,
+               site.id)
+{
+    weight = site.weight;
+    return;
+}
+
 } // namespace mc
 } // namespace mocc
@@ -16,15 +16,25 @@
 
 #include "particle_pusher.hpp"
 
+#include <algorithm>
 #include <cmath>
 #include <iostream>
+#include <limits>
 #include "util/blitz_typedefs.hpp"
+#include "util/fast_math.hpp"
+#include "util/files.hpp"
 #include "util/omp_guard.h"
+#include "util/profile.hpp"
 #include "util/utils.hpp"
+#include "core/pin_mesh.hpp"
 #include "particle.hpp"
+#include "particle_queues.hpp"
 
 namespace {
 using namespace mocc;
+// Every combination of the Tally flags, for specializing the tracking loops
+using AllTallySets = std::make_integer_sequence<unsigned, mc::TALLY_ALL + 1>;
+
 // Given an array of two points and a Particle, determine the distance from the
 // particle to the box formed by the
 real_t inline distance_to_pin(std::array<Point3, 2> bounds,
@@ -65,22 +75,35 @@ extern RNG_LCG RNG;
 #pragma omp threadprivate(RNG)
 RNG_LCG RNG;
 
-ParticlePusher::ParticlePusher(const CoreMesh &mesh, const XSMesh &xs_mesh)
+ParticlePusher::ParticlePusher(const CoreMesh &mesh, const XSMesh &xs_mesh,
+                               bool sparse_tallies)
     : mesh_(mesh),
       xs_mesh_(xs_mesh),
       volumes_(mesh.volumes(MeshTreatment::TRUE)),
       n_group_(xs_mesh.n_group()),
       fission_bank_(mesh),
       do_implicit_capture_(false),
+      weight_cutoff_(0.25),
+      weight_survival_(0.5),
+      weight_split_(2.0),
       seed_(1),
+      streams_(seed_),
       scalar_flux_tally_(xs_mesh.n_group(),
                          TallySpatial(mesh_.coarse_volume())),
-      fine_flux_tally_(xs_mesh.n_group(), TallySpatial(volumes_)),
-      fine_flux_col_tally_(xs_mesh.n_group(), TallySpatial(volumes_)),
+      fine_flux_tally_(xs_mesh.n_group(),
+                       TallySpatial(volumes_, sparse_tallies)),
+      fine_flux_col_tally_(xs_mesh.n_group(),
+                           TallySpatial(volumes_, sparse_tallies)),
       pin_power_tally_(mesh_.coarse_volume()),
+      tallies_(TALLY_ALL),
+      sparse_tallies_(sparse_tallies),
+      active_(true),
       id_offset_(0),
       n_cycles_(0),
-      print_particles_(false)
+      print_particles_(false),
+      distributed_(false),
+      delta_tracking_(false),
+      event_based_(false)
 {
     // Build the map from mesh regions into the XS mesh
     xsmesh_regions_.resize(mesh.n_reg(MeshTreatment::TRUE), -1);
@@ -92,12 +115,153 @@ ParticlePusher::ParticlePusher(const CoreMesh &mesh, const XSMesh &xs_mesh)
         }
         ixs++;
     }
+
+    // Build the alias tables for sampling collisions
+    int n_xsreg      = xs_mesh_.size();
+    reaction_tables_ = AliasTableSet(3, n_xsreg * n_group_);
+    scatter_tables_  = AliasTableSet(n_group_, n_xsreg * n_group_);
+    chi_tables_      = AliasTableSet(n_group_, n_xsreg);
+    for (const auto &xsreg : xs_mesh_) {
+        for (int ig = 0; ig < n_group_; ig++) {
+            reaction_tables_.push_back(this->reaction_pdf(xsreg, ig));
+
+            VecF scatter_pdf(n_group_, 0.0);
+            const auto &row = xsreg.xsmacsc().from(ig);
+            for (int igg = row.min_g; igg <= row.max_g; igg++) {
+                scatter_pdf[igg] = row[igg];
+            }
+            scatter_tables_.push_back(scatter_pdf);
+        }
+
+        VecF chi(n_group_);
+        for (int ig = 0; ig < n_group_; ig++) {
+            chi[ig] = xsreg.xsmacch(ig);
+        }
+        chi_tables_.push_back(chi);
+    }
+
+    policy_ = tally_policy(tallies_, AllTallySets());
+
+    return;
+}
+
+template <unsigned... T>
+ParticlePusher::TallyPolicy
+ParticlePusher::tally_policy(unsigned tallies,
+                             std::integer_sequence<unsigned, T...>)
+{
+    static const TallyPolicy table[] = {
+        {&ParticlePusher::track<T>, &ParticlePusher::score_flight<T>,
+         &ParticlePusher::score_collision<T>}...};
+    assert(tallies < sizeof...(T));
+    return table[tallies];
+}
+
+void ParticlePusher::set_tallies(unsigned tallies)
+{
+    if (tallies > TALLY_ALL) {
+        throw EXCEPT("Invalid Monte Carlo tally set");
+    }
+
+    tallies_ = tallies;
+    policy_  = tally_policy(active_ ? tallies_ : 0, AllTallySets());
+
+    // Release the storage of the disabled tallies, and recreate the enabled
+    // ones, in case they had been disabled before
+    scalar_flux_tally_.clear();
+    fine_flux_tally_.clear();
+    fine_flux_col_tally_.clear();
+    if (tallies_ & TALLY_FLUX) {
+        scalar_flux_tally_ = std::vector<TallySpatial>(
+            n_group_, TallySpatial(mesh_.coarse_volume()));
+    }
+    if (tallies_ & TALLY_FINE_FLUX) {
+        fine_flux_tally_ = std::vector<TallySpatial>(
+            n_group_, TallySpatial(volumes_, sparse_tallies_));
+    }
+    if (tallies_ & TALLY_FINE_FLUX_COL) {
+        fine_flux_col_tally_ = std::vector<TallySpatial>(
+            n_group_, TallySpatial(volumes_, sparse_tallies_));
+    }
+
+    return;
+}
+
+void ParticlePusher::set_active(bool active)
+{
+    active_ = active;
+    policy_ = tally_policy(active_ ? tallies_ : 0, AllTallySets());
+    return;
+}
+
+void ParticlePusher::set_delta_tracking(bool delta)
+{
+    delta_tracking_ = delta;
+    if (!delta) {
+        majorant_.clear();
+        return;
+    }
+
+    // Find the largest transport cross section among the regions of each
+    // pin, locating the pins from their centers
+    const auto &x = mesh_.x_divisions();
+    const auto &y = mesh_.y_divisions();
+    const auto &z = mesh_.z_divisions();
+    majorant_.assign(mesh_.n_pin() * n_group_, 0.0);
+    for (int ipin = 0; ipin < (int)mesh_.n_pin(); ipin++) {
+        Position pos = mesh_.coarse_position(ipin);
+        Point3 center(0.5 * (x[pos.x] + x[pos.x + 1]),
+                      0.5 * (y[pos.y] + y[pos.y + 1]),
+                      0.5 * (z[pos.z] + z[pos.z + 1]));
+        auto info = mesh_.get_location_info(center, Direction());
+        assert(mesh_.coarse_cell(info.pos) == ipin);
+        for (int ir = 0; ir < info.pm->n_reg(); ir++) {
+            const auto &xsreg =
+                xs_mesh_[xsmesh_regions_[info.reg_offset + ir]];
+            for (int ig = 0; ig < n_group_; ig++) {
+                real_t &maj = majorant_[ipin * n_group_ + ig];
+                maj         = std::max(maj, xsreg.xsmactr(ig));
+            }
+        }
+    }
+
     return;
 }
 
+void ParticlePusher::set_current_tallies(bool current)
+{
+    current_tally_.clear();
+    if (!current) {
+        return;
+    }
+
+    // The tallies keep a reference to their normalization
+    areas_.resize(mesh_.n_surf());
+    for (int is = 0; is < (int)mesh_.n_surf(); is++) {
+        areas_[is] = mesh_.coarse_area(is);
+    }
+    current_tally_ = std::vector<TallySpatial>(n_group_, TallySpatial(areas_));
+
+    return;
+}
+
+VecF ParticlePusher::reaction_pdf(const XSMeshRegion &xsreg, int ig)
+{
+    VecF pdf(3, 0.0);
+
+    real_t scale = 1.0 / xsreg.xsmactr(ig);
+
+    pdf[(int)Reaction::SCATTER] = xsreg.xsmacsc().out(ig) * scale;
+    pdf[(int)Reaction::FISSION] = xsreg.xsmacf(ig) * scale;
+    pdf[(int)Reaction::CAPTURE] = std::max(
+        1.0 - pdf[(int)Reaction::SCATTER] - pdf[(int)Reaction::FISSION], 0.0);
+
+    return pdf;
+}
+
 void ParticlePusher::collide(Particle &p)
 {
-    bool print = print_particles_;
+    bool print = TraceEnabled && print_particles_;
     // print      = true;
     // Sample the type of interaction;
     const auto &xsreg = xs_mesh_[p.ixsreg];
@@ -106,16 +270,19 @@ void ParticlePusher::collide(Particle &p)
         std::cout << p << std::endl;
         std::cout << "xsregion: " << p.ixsreg << std::endl;
         std::cout << "reaction chance: ";
-        for (const auto &v : xsreg.reaction_cdf(p.group)) {
+        for (const auto &v : this->reaction_pdf(xsreg, p.group)) {
             std::cout << v << " ";
         }
         std::cout << std::endl;
     }
-    Reaction reaction = (Reaction)RNG.sample_cdf(xsreg.reaction_cdf(p.group));
-    real_t k_score = p.weight * xsreg.xsmacnf(p.group) / xsreg.xsmactr(p.group);
-    k_tally_col_.score(k_score);
-    fine_flux_col_tally_[p.group].score(p.ireg,
-                                        p.weight / xsreg.xsmactr(p.group));
+    if (do_implicit_capture_) {
+        this->collide_implicit(p);
+        return;
+    }
+
+    int ixs_group     = p.ixsreg * n_group_ + p.group;
+    Reaction reaction = (Reaction)reaction_tables_.sample(ixs_group, RNG);
+    (this->*policy_.score_collision)(p.ixsreg, p.ireg, p.group, p.weight);
 
     if (reaction == Reaction::SCATTER) {
         if (print) {
@@ -123,13 +290,16 @@ void ParticlePusher::collide(Particle &p)
         }
         // scatter. only isotropic for now
         // sample new energy
-        p.group = RNG.sample_cdf(xsreg.xsmacsc().out_cdf(p.group));
+        p.group = scatter_tables_.sample(ixs_group, RNG);
         if (print) {
             std::cout << "New group: " << p.group << std::endl;
         }
 
-        // sample new angle
-        p.direction = Direction::Isotropic(RNG.random(), RNG.random());
+        // sample new angle. Draw the random numbers in a fixed order, so
+        // that the device collision event can reproduce them.
+        real_t r1   = RNG.random();
+        real_t r2   = RNG.random();
+        p.direction = Direction::Isotropic(r1, r2);
         if (print) {
             std::cout << "New angle: " << p.direction << std::endl;
         }
@@ -138,20 +308,7 @@ void ParticlePusher::collide(Particle &p)
             std::cout << "fission at " << p.location_global.x << " "
                  << p.location_global.y << " " << p.location_global.z << std::endl;
         }
-        // fission
-        // sample number of new particles to generate
-        real_t nu = xsreg.xsmacnf(p.group) / xsreg.xsmacf(p.group);
-        int n_fis = (p.weight * nu) + RNG.random();
-
-        // Make new particles and push them onto the fission bank
-        for (int i = 0; i < n_fis; i++) {
-            int ig = RNG.sample_cdf(xsreg.chi_cdf());
-            Particle new_p(p.location_global,
-                           Direction::Isotropic(RNG.random(), RNG.random()), ig,
-                           p.id);
-            fission_bank_.push_back(new_p);
-        }
-        p.alive = false;
+        this->fission(p);
     } else {
         if (print) {
             std::cout << "capture" << std::endl;
@@ -163,39 +320,119 @@ void ParticlePusher::collide(Particle &p)
     return;
 }
 
-void ParticlePusher::simulate(Particle p, bool tally)
+void ParticlePusher::fission(Particle &p)
 {
-    bool print = print_particles_;
+    const auto &xsreg = xs_mesh_[p.ixsreg];
 
-    RNG.set_seed(seed_);
-    RNG.jump_ahead((p.id + id_offset_) * 10000);
+    // sample number of new particles to generate
+    real_t nu = xsreg.xsmacnf(p.group) / xsreg.xsmacf(p.group);
+    int n_fis = (p.weight * nu) + RNG.random();
 
-    // Register this particle with the tallies
-    k_tally_tl_.add_weight(p.weight);
-    k_tally_col_.add_weight(p.weight);
-    for (auto &tally : scalar_flux_tally_) {
-        tally.add_weight(p.weight);
+    this->bank_sites(p, n_fis);
+    p.alive = false;
+
+    return;
+}
+
+void ParticlePusher::bank_sites(const Particle &p, int n_fis)
+{
+    // Make new fission sites and push them onto the fission bank
+    for (int i = 0; i < n_fis; i++) {
+        int ig = chi_tables_.sample(p.ixsreg, RNG);
+        FissionSite site(p.location_global,
+                         Direction::Isotropic(RNG.random(), RNG.random()), ig,
+                         p.id);
+        fission_bank_.push_back(site);
     }
-    for (auto &tally : fine_flux_tally_) {
-        tally.add_weight(p.weight);
+
+    return;
+}
+
+void ParticlePusher::collide_implicit(Particle &p)
+{
+    const auto &xsreg = xs_mesh_[p.ixsreg];
+    int ixs_group     = p.ixsreg * n_group_ + p.group;
+    real_t xstr       = xsreg.xsmactr(p.group);
+    (this->*policy_.score_collision)(p.ixsreg, p.ireg, p.group, p.weight);
+
+    // Bank the expected number of fission sites for the collision, then
+    // carry on as a scatter with the weight of the scattered neutrons
+    int n_fis = (p.weight * xsreg.xsmacnf(p.group) / xstr) + RNG.random();
+    this->bank_sites(p, n_fis);
+    p.weight *= xsreg.xsmacsc().out(p.group) / xstr;
+
+    // Russian roulette
+    if (p.weight < weight_cutoff_) {
+        if (RNG.random() * weight_survival_ < p.weight) {
+            p.weight = weight_survival_;
+        } else {
+            p.alive = false;
+            return;
+        }
     }
-    for (auto &tally : fine_flux_col_tally_) {
-        tally.add_weight(p.weight);
+
+    p.group     = scatter_tables_.sample(ixs_group, RNG);
+    real_t r1   = RNG.random();
+    real_t r2   = RNG.random();
+    p.direction = Direction::Isotropic(r1, r2);
+
+    return;
+}
+
+void ParticlePusher::split_particle(Particle &p,
+                                    std::vector<Particle> &split) const
+{
+    if (!do_implicit_capture_ || !p.alive || (p.weight <= weight_split_)) {
+        return;
     }
-    pin_power_tally_.add_weight(p.weight);
 
-    // Figure out where we are
-    auto location_info =
-        mesh_.get_location_info(p.location_global, p.direction);
-    p.location = location_info.local_point;
-    p.ireg     = location_info.reg_offset +
-             location_info.pm->find_reg(p.location, p.direction);
-    p.pin_position  = location_info.pos;
-    int ipin_coarse = mesh_.coarse_cell(location_info.pos);
-    if (print) {
-        std::cout << std::endl << "NEW PARTICLE:" << std::endl;
-        std::cout << p << std::endl;
+    // Split into the fewest copies that are no heavier than weight_split_
+    int n    = std::ceil(p.weight / weight_split_);
+    p.weight = p.weight / n;
+    for (int i = 1; i < n; i++) {
+        split.push_back(p);
+    }
+
+    return;
+}
+
+void ParticlePusher::set_implicit_capture(bool implicit, real_t cutoff,
+                                          real_t survival, real_t split)
+{
+    if (implicit && !((cutoff > 0.0) && (cutoff < survival) &&
+                      (survival < split))) {
+        throw EXCEPT("Invalid weights for implicit capture. The roulette "
+                     "cutoff, survival and splitting weights must be "
+                     "increasing, and positive.");
     }
+
+    do_implicit_capture_ = implicit;
+    weight_cutoff_       = cutoff;
+    weight_survival_     = survival;
+    weight_split_        = split;
+    return;
+}
+
+void ParticlePusher::locate(Particle &p, CoreMesh::LocationInfo &info,
+                            int &ipin_coarse) const
+{
+    info = mesh_.get_location_info(p.location_global, p.direction);
+    this->apply_location(p, info, ipin_coarse);
+
+    return;
+}
+
+void ParticlePusher::apply_location(Particle &p,
+                                    const CoreMesh::LocationInfo &info,
+                                    int &ipin_coarse) const
+{
+    p.location = info.local_point;
+    int ireg   = visit(*info.pm, [&](const auto &pm) {
+        return pm.find_reg(p.location, p.direction);
+    });
+    p.ireg         = info.reg_offset + ireg;
+    p.pin_position = info.pos;
+    ipin_coarse    = mesh_.coarse_cell(info.pos);
     assert(ipin_coarse >= 0);
     assert(ipin_coarse < (int)mesh_.n_pin());
     assert(p.ireg >= 0);
@@ -204,16 +441,237 @@ void ParticlePusher::simulate(Particle p, bool tally)
     assert(p.ixsreg >= 0);
     assert(p.ixsreg < (int)xs_mesh_.size());
 
+    return;
+}
+
+void ParticlePusher::register_particle(real_t weight)
+{
+    k_tally_tl_.add_weight(weight);
+    k_tally_col_.add_weight(weight);
+    if (!active_) {
+        return;
+    }
+    for (auto &tally : scalar_flux_tally_) {
+        tally.add_weight(weight);
+    }
+    for (auto &tally : fine_flux_tally_) {
+        tally.add_weight(weight);
+    }
+    for (auto &tally : fine_flux_col_tally_) {
+        tally.add_weight(weight);
+    }
+    pin_power_tally_.add_weight(weight);
+    for (auto &tally : current_tally_) {
+        tally.add_weight(weight);
+    }
+
+    return;
+}
+
+template <unsigned Tallies>
+void ParticlePusher::score_flight(int ixsreg, int ireg, int ipin_coarse,
+                                  int group, real_t weight, real_t tl)
+{
+    const XSMeshRegion &xsreg = xs_mesh_[ixsreg];
+    k_tally_tl_.score(tl * weight * xsreg.xsmacnf(group));
+    if (Tallies & TALLY_PIN_POWER) {
+        pin_power_tally_.score(ipin_coarse,
+                               tl * weight * xsreg.xsmacf(group));
+    }
+    if (Tallies & TALLY_FLUX) {
+        scalar_flux_tally_[group].score(ipin_coarse, tl * weight);
+    }
+    if (Tallies & TALLY_FINE_FLUX) {
+        fine_flux_tally_[group].score(ireg, tl * weight);
+    }
+
+    return;
+}
+
+template <unsigned Tallies>
+void ParticlePusher::score_collision(int ixsreg, int ireg, int group,
+                                     real_t weight)
+{
+    const XSMeshRegion &xsreg = xs_mesh_[ixsreg];
+    k_tally_col_.score(weight * xsreg.xsmacnf(group) / xsreg.xsmactr(group));
+    if (Tallies & TALLY_FINE_FLUX_COL) {
+        fine_flux_col_tally_[group].score(ireg,
+                                          weight / xsreg.xsmactr(group));
+    }
+
+    return;
+}
+
+void ParticlePusher::score_current(const Particle &p,
+                                   const std::array<Point3, 2> &bounds,
+                                   int ipin_coarse)
+{
+    // The particle has been moved just past the faces that it crossed, and
+    // is still inside the bounds of the pin in the other dimensions
+    const Point3 &x = p.location_global;
+    auto &tally     = current_tally_[p.group];
+    if (x.x > bounds[1].x) {
+        tally.score(mesh_.coarse_surf(ipin_coarse, Surface::EAST), p.weight);
+    } else if (x.x < bounds[0].x) {
+        tally.score(mesh_.coarse_surf(ipin_coarse, Surface::WEST), -p.weight);
+    }
+    if (x.y > bounds[1].y) {
+        tally.score(mesh_.coarse_surf(ipin_coarse, Surface::NORTH), p.weight);
+    } else if (x.y < bounds[0].y) {
+        tally.score(mesh_.coarse_surf(ipin_coarse, Surface::SOUTH),
+                    -p.weight);
+    }
+    if (x.z > bounds[1].z) {
+        tally.score(mesh_.coarse_surf(ipin_coarse, Surface::TOP), p.weight);
+    } else if (x.z < bounds[0].z) {
+        tally.score(mesh_.coarse_surf(ipin_coarse, Surface::BOTTOM),
+                    -p.weight);
+    }
+
+    return;
+}
+
+void ParticlePusher::cross_surface(Particle &p, real_t d, bool pin_crossing,
+                                   CoreMesh::LocationInfo &info,
+                                   int &ipin_coarse)
+{
+    bool print = TraceEnabled && print_particles_;
+
+    if (!pin_crossing) {
+        // Particle crossed an internal boundary in the pin.
+        // Update its location and region index
+        p.move(d);
+        int ireg = visit(*info.pm, [&](const auto &pm) {
+            return pm.find_reg(p.location, p.direction);
+        });
+        p.ireg = ireg + info.reg_offset;
+        assert(p.ireg >= 0);
+        assert(p.ireg < (int)mesh_.n_reg(MeshTreatment::TRUE));
+        p.ixsreg = xsmesh_regions_[p.ireg];
+
+        assert(p.ixsreg >= 0);
+        assert(p.ixsreg < (int)xs_mesh_.size());
+        return;
+    }
+
+    // Particle crossed a pin boundary. Move to neighboring pin, handle
+    // boundary condition, etc. Regardless of what happens, move the particle
+    p.coincident = -1;
+    p.move(d);
+
+    if (print) {
+        std::cout << "particle after move to surf:" << std::endl;
+        std::cout << p << std::endl;
+    }
+
+    // Check for domain boundary crossing
+    auto bound_surf = mesh_.boundary_surface(p.location_global, p.direction);
+    bool reflected = false;
+    for (const auto &b : bound_surf) {
+        if (print) {
+            std::cout << b << std::endl;
+        }
+        if ((b != Surface::INTERNAL) && (p.alive)) {
+            // We are exiting a domain boundary. Handle the boundary
+            // condition.
+            auto bc = mesh_.boundary_condition(b);
+            switch (bc) {
+            case Boundary::REFLECT:
+                // Move the particle back into the domain so it's not floating
+                // in limbo
+                reflected = true;
+                p.direction.reflect(b);
+                break;
+            case Boundary::VACUUM:
+                // Just kill the thing
+                p.alive = false;
+                break;
+            default:
+                throw EXCEPT("Unsupported boundary condition");
+            }
+        }
+    }
+
+    if (active_ && !current_tally_.empty() && !reflected) {
+        this->score_current(p, info.pin_boundary, ipin_coarse);
+    }
+
+    if (reflected) {
+        p.move(BUMP);
+        if (print) {
+            std::cout << "Particle after reflection and move back:"
+                      << std::endl;
+            std::cout << p << std::endl;
+        }
+    }
+
+    // If the particle is still alive, relocate it. The particle has only
+    // just left the pin described by info, so the neighbor can be found
+    // without a full search of the geometry.
+    if (p.alive) {
+        info = mesh_.get_location_info(p.location_global, p.direction, info);
+        this->apply_location(p, info, ipin_coarse);
+    }
+
+    return;
+}
+
+void ParticlePusher::simulate(Particle p, bool tally)
+{
+    RNG = streams_.stream(p.id + id_offset_);
+
+    // Register this particle with the tallies
+    this->register_particle(p.weight);
+
+    // Follow the particle, then any copies split off of it or its copies.
+    // They all draw from the same random number stream.
+    std::vector<Particle> split;
+    (this->*policy_.track)(p, split);
+    while (!split.empty()) {
+        p = split.back();
+        split.pop_back();
+        (this->*policy_.track)(p, split);
+    }
+
+    if (tally) {
+        this->commit_tallies();
+    }
+
+    return;
+}
+
+template <unsigned Tallies>
+void ParticlePusher::track(Particle &p, std::vector<Particle> &split)
+{
+    bool print = TraceEnabled && print_particles_;
+
+    // Figure out where we are
+    CoreMesh::LocationInfo location_info;
+    int ipin_coarse = 0;
+    this->locate(p, location_info, ipin_coarse);
+    if (print) {
+        std::cout << std::endl << "NEW PARTICLE:" << std::endl;
+        std::cout << p << std::endl;
+    }
+
     p.alive = true;
 
+    // Delta tracking follows the particle to its death. Otherwise, track it
+    // from surface to surface.
+    if (delta_tracking_) {
+        this->track_delta<Tallies>(p, location_info, ipin_coarse, split);
+    }
+
     while (p.alive) {
         const XSMeshRegion &xsreg = xs_mesh_[p.ixsreg];
         real_t xstr               = xsreg.xsmactr(p.group);
-        real_t d_to_collision     = -std::log(RNG.random()) / xstr;
+        real_t d_to_collision     = -fast_log(RNG.random()) / xstr;
 
         // Determine distance to nearest surface
-        auto d_to_surf = location_info.pm->distance_to_surface(
-            p.location, p.direction, p.coincident);
+        auto d_to_surf = visit(*location_info.pm, [&](const auto &pm) {
+            return pm.distance_to_surface(p.location, p.direction,
+                                          p.coincident);
+        });
         if (print) {
             std::cout << "Where we are now:" << std::endl;
             std::cout << p << std::endl;
@@ -238,11 +696,8 @@ void ParticlePusher::simulate(Particle p, bool tally)
         real_t tl = std::min(d_to_collision, d_to_surf.first);
 
         // Contribute to track length-based tallies
-        k_tally_tl_.score(tl * p.weight * xsreg.xsmacnf(p.group));
-        pin_power_tally_.score(ipin_coarse,
-                               tl * p.weight * xsreg.xsmacf(p.group));
-        scalar_flux_tally_[p.group].score(ipin_coarse, tl * p.weight);
-        fine_flux_tally_[p.group].score(p.ireg, tl * p.weight);
+        this->score_flight<Tallies>(p.ixsreg, p.ireg, ipin_coarse, p.group,
+                                    p.weight, tl);
 
         if (d_to_collision < d_to_surf.first) {
             // Particle collided within the current region. Move particle to
@@ -254,99 +709,54 @@ void ParticlePusher::simulate(Particle p, bool tally)
                 std::cout << p << std::endl;
             }
             this->collide(p);
+            this->split_particle(p, split);
         } else {
             // Particle reached a surface before colliding. Move to the
             // surface and re-sample distance to collision.
-            if (!d_to_surf.second) {
-                // Particle crossed an internal boundary in the pin.
-                // Update its location and region index
-                p.move(d_to_surf.first);
-                p.ireg = location_info.pm->find_reg(p.location, p.direction) +
-                         location_info.reg_offset;
-                assert(p.ireg >= 0);
-                assert(p.ireg < (int)mesh_.n_reg(MeshTreatment::TRUE));
-                p.ixsreg = xsmesh_regions_[p.ireg];
-
-                assert(p.ixsreg >= 0);
-                assert(p.ixsreg < (int)xs_mesh_.size());
-            } else {
-                // Particle crossed a pin boundary. Move to neighboring pin,
-                // handle boundary condition, etc.
-                // Regardless of what happens, move the particle
-                p.coincident = -1;
-                p.move(d_to_surf.first);
-
-                if (print) {
-                    std::cout << "particle after move to surf:" << std::endl;
-                    std::cout << p << std::endl;
-                }
-
-                // Check for domain boundary crossing
-                auto bound_surf =
-                    mesh_.boundary_surface(p.location_global, p.direction);
-                bool reflected = false;
-                for (const auto &b : bound_surf) {
-                    if (print) {
-                        std::cout << b << std::endl;
-                    }
-                    if ((b != Surface::INTERNAL) && (p.alive)) {
-                        // We are exiting a domain boundary. Handle the boundary
-                        // condition.
-                        auto bc = mesh_.boundary_condition(b);
-                        switch (bc) {
-                        case Boundary::REFLECT:
-                            // Move the particle back into the domain so it's
-                            // not floating in limbo
-                            reflected = true;
-                            p.direction.reflect(b);
-                            break;
-                        case Boundary::VACUUM:
-                            // Just kill the thing
-                            p.alive = false;
-                            break;
-                        default:
-                            throw EXCEPT("Unsupported boundary condition");
-                        }
-                    }
-                }
-
-                if (reflected) {
-                    p.move(BUMP);
-                    if (print) {
-                        std::cout << "Particle after reflection and move back:"
-                             << std::endl;
-                        std::cout << p << std::endl;
-                    }
-                }
-
-                // If the particle is still alive, relocate it
-                if (p.alive) {
-                    location_info =
-                        mesh_.get_location_info(p.location_global, p.direction);
-                    p.location = location_info.local_point;
-                    p.ireg =
-                        location_info.reg_offset +
-                        location_info.pm->find_reg(p.location, p.direction);
-                    p.pin_position = location_info.pos;
-                    ipin_coarse    = mesh_.coarse_cell(location_info.pos);
-                    assert(ipin_coarse >= 0);
-                    assert(ipin_coarse < (int)mesh_.n_pin());
-                    assert(p.ireg >= 0);
-                    assert(p.ireg < (int)mesh_.n_reg(MeshTreatment::TRUE));
-                    p.ixsreg = xsmesh_regions_[p.ireg];
-                    if (p.ixsreg >= (int)xs_mesh_.size()) {
-                        std::cout << p;
-                        std::cout << std::endl;
-                    }
-                    assert(p.ixsreg >= 0);
-                    assert(p.ixsreg < (int)xs_mesh_.size());
-                }
-            }
+            this->cross_surface(p, d_to_surf.first, d_to_surf.second,
+                                location_info, ipin_coarse);
         } // collision or new region?
     }     // particle alive
 
-    if (tally) {
-        this->commit_tallies();
+    return;
+}
+
+template <unsigned Tallies>
+void ParticlePusher::track_delta(Particle &p, CoreMesh::LocationInfo &info,
+                                 int &ipin_coarse,
+                                 std::vector<Particle> &split)
+{
+    while (p.alive) {
+        real_t xs_maj         = majorant_[ipin_coarse * n_group_ + p.group];
+        real_t d_to_collision = -fast_log(RNG.random()) / xs_maj;
+        real_t d_to_pin       = distance_to_pin(info.pin_boundary, p);
+
+        if (d_to_collision >= d_to_pin) {
+            // Leave the pin, without sampling anything on the way
+            this->cross_surface(p, d_to_pin, true, info, ipin_coarse);
+            continue;
+        }
+
+        // Tentative collision. Find the region that it is in and score the
+        // collision estimate of the track length tallies, 1/majorant.
+        p.move(d_to_collision);
+        p.coincident = -1;
+        int ireg     = visit(*info.pm, [&](const auto &pm) {
+            return pm.find_reg(p.location, p.direction);
+        });
+        p.ireg   = info.reg_offset + ireg;
+        p.ixsreg = xsmesh_regions_[p.ireg];
+        assert(p.ixsreg >= 0);
+        assert(p.ixsreg < (int)xs_mesh_.size());
+        this->score_flight<Tallies>(p.ixsreg, p.ireg, ipin_coarse, p.group,
+                                    p.weight, 1.0 / xs_maj);
+
+        // Accept the collision as real with probability xstr/majorant
+        real_t xstr = xs_mesh_[p.ixsreg].xsmactr(p.group);
+        if (RNG.random() * xs_maj < xstr) {
+            this->collide(p);
+            this->split_particle(p, split);
+        }
     }
 
     return;
@@ -356,8 +766,17 @@ void ParticlePusher::simulate(Particle p, bool tally)
  * \brief Simulate all particles in a \ref FissionBank, stashing statistics at
  * the end.
  */
+void ParticlePusher::simulate(const FissionSite &site, bool tally)
+{
+    this->simulate(Particle(site), tally);
+    return;
+}
+
 void ParticlePusher::simulate(const FissionBank &bank, real_t k_eff)
 {
+    MOCC_PROFILE_ZONE("MC Cycle");
+    MOCC_PROFILE_COUNT(PARTICLES, bank.size());
+
     // Clear the internal FissionBank to store new fission sites for this
     // cycle
     fission_bank_.clear();
@@ -368,24 +787,327 @@ void ParticlePusher::simulate(const FissionBank &bank, real_t k_eff)
 
     print_particles_ = false;
 
+    if (event_based_ && delta_tracking_) {
+        throw EXCEPT("Delta tracking is only supported by the history-based "
+                     "simulation.");
+    }
+    if (event_based_ && do_implicit_capture_) {
+        throw EXCEPT("Implicit capture is only supported by the "
+                     "history-based simulation.");
+    }
+
+    if (event_based_) {
+        this->simulate_events(bank);
+    } else {
+        // Histories vary a lot in length, so hand the particles out
+        // dynamically. Each particle's random number stream comes from its
+        // ID, so the results don't depend on which thread simulates it.
+        ParticleQueues queues(bank.size(), particle_chunk);
 #pragma omp parallel
-    {
-        unsigned np = bank.size();
-#pragma omp for
-        for (unsigned ip = 0; ip < np; ip++) {
-            this->simulate(bank[ip]);
-        }
+        {
+            int first = 0;
+            int last  = 0;
+            while (queues.next(first, last)) {
+                for (int ip = first; ip < last; ip++) {
+                    this->simulate(bank[ip]);
+                }
+            }
 
-    } // OMP Parallel
+        } // OMP Parallel
+    }
 
-    k_tally_analog_.score((double)fission_bank_.size() / bank.size());
+    // Gather the new fission sites from all of the threads
+    fission_bank_.commit();
+
+    // Sizes of the banks over all processes. The per-particle eigenvalue
+    // tallies are summed over the processes as well, so that every process
+    // sees the same global estimates.
+    const int n_source  = bank.global_size();
+    const int n_fission = fission_bank_.global_size();
+    if (distributed_) {
+        k_tally_tl_.sum_processes();
+        k_tally_col_.sum_processes();
+    }
+
+    k_tally_analog_.score((double)n_fission / n_source);
     k_tally_analog_.add_weight(1.0);
 
     this->commit_tallies();
 
     n_cycles_++;
 
-    id_offset_ += bank.size();
+    id_offset_ += n_source;
+    return;
+}
+
+/**
+ * Each particle carries its own random number stream, seeded the same way as
+ * in the history-based simulate(Particle, bool), and draws from it in the
+ * same order. The particles therefore follow the same histories as they would
+ * in history-based mode; only the order in which tallies and fission sites
+ * are accumulated changes.
+ */
+void ParticlePusher::simulate_events(const FissionBank &bank)
+{
+    int np = bank.size();
+    events_.resize(np);
+
+    // Source event: register each particle with the tallies, find where it
+    // is and set up its random number stream
+#pragma omp parallel for
+    for (int i = 0; i < np; i++) {
+        Particle p(bank[i]);
+        this->register_particle(p.weight);
+        this->locate(p, events_.location_info[i], events_.ipin[i]);
+        p.alive = true;
+        events_.set(i, p);
+
+        events_.rng[i] = streams_.stream(p.id + id_offset_);
+    }
+
+    VecI active(np);
+    for (int i = 0; i < np; i++) {
+        active[i] = i;
+    }
+    VecI collision_queue;
+    VecI crossing_queue;
+    VecI internal_queue;
+    collision_queue.reserve(np);
+    crossing_queue.reserve(np);
+    internal_queue.reserve(np);
+
+    while (!active.empty()) {
+        int n = active.size();
+
+        // Sort the queue by cross-section region, which also groups particles
+        // by pin mesh. Consecutive particles then mostly share cross sections
+        // and take the same path through the pin mesh calls.
+        const auto &ixsreg = events_.ixsreg;
+        std::sort(active.begin(), active.end(), [&ixsreg](int a, int b) {
+            return (ixsreg[a] < ixsreg[b]) ||
+                   ((ixsreg[a] == ixsreg[b]) && (a < b));
+        });
+
+        // Distance-to-collision and distance-to-surface events
+        if (device_) {
+            device_->distance(active, events_);
+        } else {
+            // Draw the random numbers for the collision distances and take
+            // their logs in vectorized blocks
+            log_random_.resize(n);
+#pragma omp parallel for
+            for (int j0 = 0; j0 < n; j0 += event_block) {
+                int nb = std::min(event_block, n - j0);
+                for (int j = j0; j < j0 + nb; j++) {
+                    log_random_[j] = events_.rng[active[j]].random();
+                }
+                fast_log(nb, &log_random_[j0]);
+            }
+
+#pragma omp parallel for
+            for (int j = 0; j < n; j++) {
+                int i = active[j];
+                real_t xstr =
+                    xs_mesh_.xstr(events_.group[i])[events_.ixsreg[i]];
+                events_.d_collision[i] = -log_random_[j] / xstr;
+
+                const auto &info = events_.location_info[i];
+                auto d_to_surf   = visit(*info.pm, [&](const auto &pm) {
+                    return pm.distance_to_surface(events_.location[i],
+                                                  events_.direction[i],
+                                                  events_.coincident[i]);
+                });
+
+                const auto &bounds = info.pin_boundary;
+                const auto &pos    = events_.location_global[i];
+                const auto &dir    = events_.direction[i];
+                real_t d_to_pin    = std::numeric_limits<real_t>::max();
+                real_t dx =
+                    ((dir.ox > 0.0) ? bounds[1].x : bounds[0].x) - pos.x;
+                real_t dy =
+                    ((dir.oy > 0.0) ? bounds[1].y : bounds[0].y) - pos.y;
+                real_t dz =
+                    ((dir.oz > 0.0) ? bounds[1].z : bounds[0].z) - pos.z;
+                dx /= dir.ox;
+                dy /= dir.oy;
+                dz /= dir.oz;
+                d_to_pin = (dx > 0.0) ? std::min(d_to_pin, dx) : d_to_pin;
+                d_to_pin = (dy > 0.0) ? std::min(d_to_pin, dy) : d_to_pin;
+                d_to_pin = (dz > 0.0) ? std::min(d_to_pin, dz) : d_to_pin;
+
+                bool pin_crossing =
+                    d_to_surf.second || (d_to_pin < d_to_surf.first);
+                events_.d_surface[i]    = std::min(d_to_pin, d_to_surf.first);
+                events_.pin_crossing[i] = pin_crossing;
+            }
+        }
+
+        // Track length tally event
+#pragma omp parallel for
+        for (int j = 0; j < n; j++) {
+            int i     = active[j];
+            real_t tl = std::min(events_.d_collision[i], events_.d_surface[i]);
+            (this->*policy_.score_flight)(events_.ixsreg[i], events_.ireg[i],
+                                          events_.ipin[i], events_.group[i],
+                                          events_.weight[i], tl);
+        }
+
+        // Split the particles into collision and surface crossing queues.
+        // The device only handles crossings within a pin, so those are
+        // queued separately.
+        collision_queue.clear();
+        crossing_queue.clear();
+        internal_queue.clear();
+        for (const auto i : active) {
+            if (events_.d_collision[i] < events_.d_surface[i]) {
+                collision_queue.push_back(i);
+            } else if (device_ && !events_.pin_crossing[i]) {
+                internal_queue.push_back(i);
+            } else {
+                crossing_queue.push_back(i);
+            }
+        }
+
+        // Collision event. collide() draws from the thread's RNG, so swap
+        // the particle's stream in and out around it.
+        if (device_) {
+            this->collide_device(collision_queue);
+        } else {
+            int n_collision = collision_queue.size();
+#pragma omp parallel for
+            for (int j = 0; j < n_collision; j++) {
+                int i      = collision_queue[j];
+                Particle p = events_.get(i);
+                p.move(events_.d_collision[i]);
+                p.coincident = -1;
+
+                RNG = events_.rng[i];
+                this->collide(p);
+                events_.rng[i] = RNG;
+
+                events_.set(i, p);
+            }
+        }
+
+        // Surface crossing event
+        if (device_) {
+            device_->cross_internal(internal_queue, events_);
+        }
+        int n_crossing = crossing_queue.size();
+#pragma omp parallel for
+        for (int j = 0; j < n_crossing; j++) {
+            int i      = crossing_queue[j];
+            Particle p = events_.get(i);
+            this->cross_surface(p, events_.d_surface[i],
+                                events_.pin_crossing[i],
+                                events_.location_info[i], events_.ipin[i]);
+            events_.set(i, p);
+        }
+
+        // Drop the dead particles from the queue
+        active.erase(std::remove_if(active.begin(), active.end(),
+                                    [this](int i) { return !events_.alive[i]; }),
+                     active.end());
+    }
+
+    return;
+}
+
+/**
+ * The collision estimators are scored before the device event, since they use
+ * the group the particle collides in. The device samples the reaction and,
+ * for scattering, the outgoing group; fission sites are banked here, from the
+ * particle's stream, right where the device left it.
+ */
+void ParticlePusher::collide_device(const VecI &queue)
+{
+    int n = queue.size();
+
+#pragma omp parallel for
+    for (int j = 0; j < n; j++) {
+        int i = queue[j];
+        (this->*policy_.score_collision)(events_.ixsreg[i], events_.ireg[i],
+                                         events_.group[i], events_.weight[i]);
+    }
+
+    device_->collide(queue, events_, device_reaction_, device_dir_random_);
+
+    // Scattered directions get the sines and cosines of their azimuthal
+    // angles in vectorized blocks. Every reaction has its two random numbers,
+    // so blocks are taken over the whole queue.
+#pragma omp parallel for
+    for (int j0 = 0; j0 < n; j0 += event_block) {
+        int nb = std::min(event_block, n - j0);
+        real_t r1[event_block];
+        real_t sin_alpha[event_block];
+        real_t cos_alpha[event_block];
+        for (int k = 0; k < nb; k++) {
+            r1[k] = device_dir_random_[2 * (j0 + k)];
+        }
+        fast_sincos_2pi(nb, r1, sin_alpha, cos_alpha);
+
+        for (int k = 0; k < nb; k++) {
+            int j = j0 + k;
+            int i = queue[j];
+            switch ((Reaction)device_reaction_[j]) {
+            case Reaction::SCATTER:
+                events_.direction[i] = Direction::Isotropic(
+                    device_dir_random_[2 * j + 1], sin_alpha[k], cos_alpha[k],
+                    r1[k] * TWOPI);
+                break;
+            case Reaction::FISSION: {
+                Particle p = events_.get(i);
+                RNG        = events_.rng[i];
+                this->fission(p);
+                events_.rng[i] = RNG;
+                events_.set(i, p);
+            } break;
+            default:
+                break;
+            }
+        }
+    }
+
+    return;
+}
+
+void ParticlePusher::set_device_events(bool device)
+{
+    if (device) {
+        event_based_ = true;
+        device_.reset(new DeviceEvents(mesh_, xs_mesh_, xsmesh_regions_,
+                                       reaction_tables_, scatter_tables_));
+    } else {
+        device_.reset();
+    }
+    return;
+}
+
+void ParticlePusher::memory(MemoryReport &report) const
+{
+    size_t tallies = pin_power_tally_.memory();
+    for (const auto *tallies_g :
+         {&scalar_flux_tally_, &fine_flux_tally_, &fine_flux_col_tally_,
+          &current_tally_}) {
+        for (const auto &t : *tallies_g) {
+            tallies += t.memory();
+        }
+    }
+    report.add("tallies", tallies);
+
+    size_t tables = bytes(xsmesh_regions_) + bytes(majorant_);
+    for (const auto *t : {&reaction_tables_, &scatter_tables_, &chi_tables_}) {
+        tables += t->memory();
+    }
+    report.add("sampling_tables", tables);
+
+    report.add("fission_bank", fission_bank_.memory());
+
+    if (event_based_) {
+        // The event bank stores roughly one particle's worth of state in
+        // each slot
+        report.add("event_bank", events_.size() * sizeof(Particle));
+    }
     return;
 }
 
@@ -426,29 +1148,28 @@ void ParticlePusher::output(H5Node &node) const
         }
     }
 
-    // Fine flux tallies (TL)
+    // Fine flux tallies (TL). Like the collision tallies below, these are
+    // written a group at a time, since all of the groups of a full-core
+    // fine mesh may not fit in memory at once.
     {
-        ArrayB2 flux_mg(xs_mesh_.n_group(), mesh_.n_reg(MeshTreatment::TRUE));
-        ArrayB2 stdev_mg(xs_mesh_.n_group(), mesh_.n_reg(MeshTreatment::TRUE));
+        VecF flux_mg(mesh_.n_reg(MeshTreatment::TRUE));
+        VecF stdev_mg(mesh_.n_reg(MeshTreatment::TRUE));
 
         auto g = node.create_group("fsr_flux");
         for (int ig = 0; ig < (int)fine_flux_tally_.size(); ig++) {
+            std::stringstream path;
+            path << std::setfill('0') << std::setw(3) << ig + 1;
             auto flux_result = fine_flux_tally_[ig].get();
-            int ipin         = 0;
+            int ireg         = 0;
             for (const auto &v : flux_result) {
-                flux_mg(ig, ipin)  = v.first;
-                stdev_mg(ig, ipin) = v.second;
-                ipin++;
+                flux_mg[ireg]  = v.first;
+                stdev_mg[ireg] = v.second;
+                ireg++;
             }
-        }
 
-        for (int ig = 0; ig < (int)fine_flux_tally_.size(); ig++) {
-            std::stringstream path;
-            path << std::setfill('0') << std::setw(3) << ig + 1;
-
-            g.write(path.str(), flux_mg(ig, blitz::Range::all()));
+            g.write(path.str(), flux_mg);
             path << "_stdev";
-            g.write(path.str(), stdev_mg(ig, blitz::Range::all()));
+            g.write(path.str(), stdev_mg);
         }
     }
 
@@ -476,7 +1197,7 @@ void ParticlePusher::output(H5Node &node) const
     }
 
     // Pin powers
-    {
+    if (tallies_ & TALLY_PIN_POWER) {
         VecF pin_power;
         VecF stdev;
         pin_power.reserve(mesh_.n_pin());
@@ -16,12 +16,17 @@
 
 #pragma once
 
+#include <memory>
+#include <utility>
 #include <vector>
 
+#include "util/alias_table.hpp"
 #include "core/core_mesh.hpp"
 #include "core/output_interface.hpp"
 #include "core/xs_mesh.hpp"
 
+#include "device_events.hpp"
+#include "event_bank.hpp"
 #include "fission_bank.hpp"
 #include "particle.hpp"
 #include "tally_scalar.hpp"
@@ -29,6 +34,19 @@
 
 namespace mocc {
 namespace mc {
+/**
+ * \brief Flags for the optional tallies of a \ref ParticlePusher
+ *
+ * The eigenvalue tallies are always scored.
+ */
+enum Tally : unsigned {
+    TALLY_PIN_POWER     = 1 << 0,
+    TALLY_FLUX          = 1 << 1,
+    TALLY_FINE_FLUX     = 1 << 2,
+    TALLY_FINE_FLUX_COL = 1 << 3,
+    TALLY_ALL           = (1 << 4) - 1
+};
+
 /**
  * \brief Monte Carlo particle simulator
  *
@@ -64,10 +82,37 @@ namespace mc {
  * There is also support for use in fixed-source solvers through repeated calls
  * to simulate(Particle, bool) with \c tally=true, which will contribute to
  * tallies at the end of each particle.
+
+ *
+ * By default, simulate(FissionBank, real_t) is history-based, and follows
+ * each particle from birth to death on a single thread. The particles are
+ * handed out to the threads in chunks, with work stealing (see \ref
+ * ParticleQueues), to balance the load of histories of varying length. In
+ * event-based mode (see \ref set_event_based()), all particles in the bank
+ * are followed together. Each pass advances every live particle by one
+ * flight: distances to collision and to the next surface are computed for the
+ * whole queue, track-length tallies are scored, and then the particles are
+ * split into collision and surface crossing queues that are processed
+ * separately. The queue is sorted by cross-section region between passes.
+ *
+ * The set of spatial tallies to score may be chosen with \ref set_tallies().
+ * The history-based tracking loops and the scoring methods are templates on
+ * the tally set, with a specialization for every combination of \ref Tally
+ * flags, so the disabled tallies cost nothing in the flight loop. Inactive
+ * cycles (see \ref set_active()) use the specialization with no spatial
+ * tallies at all.
  */
 class ParticlePusher : public HasOutput {
 public:
-    ParticlePusher(const CoreMesh &mesh, const XSMesh &xs_mesh);
+    /**
+     * \brief Construct a pusher for the given mesh
+     *
+     * \param sparse_tallies whether to make the fine-mesh flux tallies
+     * sparse from the start (see \ref set_sparse_tallies()), so that their
+     * dense storage is never allocated
+     */
+    ParticlePusher(const CoreMesh &mesh, const XSMesh &xs_mesh,
+                   bool sparse_tallies = false);
 
     /**
      * \brief Simulate a particle history
@@ -79,6 +124,15 @@ public:
      */
     void simulate(Particle p, bool tally = false);
 
+    /**
+     * \brief Simulate the history of a particle starting from a \ref
+     * FissionSite
+     *
+     * \param site the \ref FissionSite to start the particle from
+     * \param tally as for simulate(Particle, bool)
+     */
+    void simulate(const FissionSite &site, bool tally = false);
+
     /**
      * \brief Simulate all particles in a \ref FissionBank
      *
@@ -159,6 +213,10 @@ public:
                 tally.reset();
             }
             pin_power_tally_.reset();
+
+            for (auto &tally : current_tally_) {
+                tally.reset();
+            }
         }
         return;
     }
@@ -168,31 +226,186 @@ public:
      * variables
      *
      * This calls \ref TallySpatial::commit_realization() for each of our
-     * internally-managed tallies.
+     * internally-managed tallies, summing them over the processes if the
+     * simulation is distributed.
      */
     void commit_tallies()
     {
+        if (!active_) {
+            return;
+        }
         for (auto &t : scalar_flux_tally_) {
-            t.commit_realization();
+            t.commit_realization(distributed_);
         }
         for (auto &t : fine_flux_tally_) {
-            t.commit_realization();
+            t.commit_realization(distributed_);
         }
         for (auto &t : fine_flux_col_tally_) {
-            t.commit_realization();
+            t.commit_realization(distributed_);
         }
 
-        pin_power_tally_.commit_realization();
+        pin_power_tally_.commit_realization(distributed_);
+
+        for (auto &t : current_tally_) {
+            t.commit_realization(distributed_);
+        }
 
         return;
     }
 
+    /**
+     * \brief Use sparse, rather than dense, storage for the fine-mesh flux
+     * tallies
+     *
+     * The dense tallies hold a value for every mesh region and group on
+     * every thread, plus the statistics of each, which can take tens of GB
+     * for full-core meshes. Sparse tallies buffer the scores of each thread
+     * in a hash table, and only store statistics for the (region, group)
+     * pairs that have been scored (see \ref TallySpatial). This discards
+     * anything that the fine-mesh tallies have scored.
+     */
+    void set_sparse_tallies(bool sparse)
+    {
+        sparse_tallies_ = sparse;
+        for (auto &tally : fine_flux_tally_) {
+            tally.set_sparse(sparse);
+        }
+        for (auto &tally : fine_flux_col_tally_) {
+            tally.set_sparse(sparse);
+        }
+        return;
+    }
+
+    /**
+     * \brief Select between history-based and event-based simulation of a
+     * \ref FissionBank
+     */
+    void set_event_based(bool event_based)
+    {
+        event_based_ = event_based;
+    }
+
+    /**
+     * \brief Run the distance, collision and internal surface crossing
+     * events of the event-based simulation on the device
+     *
+     * This implies \ref set_event_based(). See \ref DeviceEvents.
+     */
+    void set_device_events(bool device);
+
+    /**
+     * \brief Enable Woodcock delta tracking in the history-based simulation
+     *
+     * Rather than stopping at every surface of the pin meshes, particles fly
+     * with a per-pin majorant cross section, and are only located within the
+     * pin at tentative collision sites. A tentative collision is real with
+     * probability xstr / majorant. The track length tallies are replaced by
+     * their collision estimate at every tentative collision, which has the
+     * same expected value. Pin boundaries are still crossed explicitly.
+     */
+    void set_delta_tracking(bool delta);
+
+    /**
+     * \brief Enable survival biasing in the history-based simulation
+     *
+     * \param implicit whether to use implicit capture
+     * \param cutoff the weight below which particles play Russian roulette
+     * \param survival the weight of the particles that survive roulette
+     * \param split the weight above which particles are split
+     *
+     * With implicit capture, particles are never absorbed. Each collision
+     * banks the expected number of fission sites, and reduces the particle
+     * weight by the scattering probability. Light particles are then
+     * rouletted, and heavy particles split into copies of at most \p split
+     * weight, so that the weights stay within [\p cutoff, \p split].
+     */
+    void set_implicit_capture(bool implicit, real_t cutoff = 0.25,
+                              real_t survival = 0.5, real_t split = 2.0);
+
+    /**
+     * \brief Select the spatial tallies to score
+     *
+     * \param tallies a combination of \ref Tally flags
+     *
+     * The storage of the disabled tallies is released, and the enabled ones
+     * are recreated empty, keeping the storage chosen with \ref
+     * set_sparse_tallies().
+     */
+    void set_tallies(unsigned tallies);
+
+    /**
+     * \brief Choose whether the cycles being simulated are active
+     *
+     * Inactive cycles only converge the fission source. They track the
+     * particles, bank fission sites and score the eigenvalue estimators,
+     * using the tracking loop specialized for no spatial tallies; the spatial
+     * and current tallies are neither scored nor committed until the pusher
+     * is made active again. A new pusher is active.
+     */
+    void set_active(bool active);
+
+    bool active() const
+    {
+        return active_;
+    }
+
+    /**
+     * \brief Share the simulation of each cycle with the other processes
+     *
+     * Each process then simulates only its own piece of a distributed source
+     * bank, and its new fission sites form its piece of the distributed
+     * fission bank. The random number stream of each particle comes from its
+     * global ID, and all of the tallies are summed over the processes at the
+     * end of each cycle, so every process ends up with the same global
+     * estimates.
+     */
+    void set_distributed(bool distributed)
+    {
+        distributed_ = distributed;
+        fission_bank_.set_distributed(distributed);
+    }
+
+    /**
+     * \brief Return the spatial tallies being scored, as a combination of
+     * \ref Tally flags
+     */
+    unsigned tallies() const
+    {
+        return tallies_;
+    }
+
+    /**
+     * \brief Tally the net current through each coarse mesh surface
+     *
+     * Together with the coarse scalar flux tallies, these provide the data
+     * needed to accelerate the fission source with CMFD. Positive currents
+     * flow in the positive coordinate direction. Crossings of reflective
+     * domain boundaries are not scored, since their net current is zero.
+     */
+    void set_current_tallies(bool current);
+
     /**
      * \brief Assign a new seed to the RNG
      */
     void set_seed(uint64_t seed)
     {
         seed_ = seed;
+        streams_.set_seed(seed);
+    }
+
+    /**
+     * \brief Return the offset added to particle IDs to select their random
+     * number streams. This advances by the size of the bank every cycle, and
+     * is needed to resume a calculation from a checkpoint.
+     */
+    unsigned id_offset() const
+    {
+        return id_offset_;
+    }
+
+    void set_id_offset(unsigned id_offset)
+    {
+        id_offset_ = id_offset;
     }
 
     const auto &flux_tallies() const
@@ -205,8 +418,29 @@ public:
         return fine_flux_tally_;
     }
 
+    const TallySpatial &pin_power_tally() const
+    {
+        return pin_power_tally_;
+    }
+
+    /**
+     * \brief Return the coarse surface net current tallies, one per group
+     *
+     * These are empty unless enabled with \ref set_current_tallies().
+     */
+    const auto &current_tallies() const
+    {
+        return current_tally_;
+    }
+
     void output(H5Node &node) const override;
 
+    /**
+     * \brief Add the memory used by the tallies, sampling tables and fission
+     * bank to a \ref MemoryReport
+     */
+    void memory(MemoryReport &report) const;
+
 private:
     const CoreMesh &mesh_;
     const XSMesh &xs_mesh_;
@@ -214,6 +448,9 @@ private:
     // Explicit storage of mesh volumes. This is so the tallies can share
     VecF volumes_;
 
+    // Area of each coarse surface, for normalizing the current tallies
+    VecF areas_;
+
     int n_group_;
 
     // This fission bank stores new fission sites generated as the result of
@@ -227,11 +464,26 @@ private:
     // region, somewhat at random.
     std::vector<int> xsmesh_regions_;
 
-    // Do implicit capture?
+    // Alias tables for sampling the reaction type and outgoing scatter group,
+    // indexed by [xs region * n_group + group], and the fission spectrum,
+    // indexed by xs region
+    AliasTableSet reaction_tables_;
+    AliasTableSet scatter_tables_;
+    AliasTableSet chi_tables_;
+
+    // Do implicit capture? If so, particles lighter than weight_cutoff_ play
+    // Russian roulette, surviving with weight_survival_, and particles
+    // heavier than weight_split_ are split
     bool do_implicit_capture_;
+    real_t weight_cutoff_;
+    real_t weight_survival_;
+    real_t weight_split_;
 
     uint64_t seed_;
 
+    // Random number streams for each particle, spaced 10000 numbers apart
+    RNGStreams streams_;
+
     // Eigenvalue tally
     TallyScalar k_tally_tl_;
     TallyScalar k_tally_col_;
@@ -249,11 +501,177 @@ private:
     // Pin power tally
     TallySpatial pin_power_tally_;
 
+    // Coarse surface net current tallies, if enabled
+    std::vector<TallySpatial> current_tally_;
+
+    // Spatial tallies to score, as a combination of Tally flags
+    unsigned tallies_;
+
+    // Whether the fine-mesh flux tallies are sparse
+    bool sparse_tallies_;
+
+    // Whether the spatial and current tallies are scored. See set_active().
+    bool active_;
+
+    // Specializations of the tracking and scoring methods for a tally set
+    struct TallyPolicy {
+        void (ParticlePusher::*track)(Particle &, std::vector<Particle> &);
+        void (ParticlePusher::*score_flight)(int, int, int, int, real_t,
+                                             real_t);
+        void (ParticlePusher::*score_collision)(int, int, int, real_t);
+    };
+    TallyPolicy policy_;
+
+    /**
+     * \brief Return the \ref TallyPolicy for a tally set, from a table of
+     * the specializations for every tally set in \p T
+     */
+    template <unsigned... T>
+    static TallyPolicy tally_policy(unsigned tallies,
+                                    std::integer_sequence<unsigned, T...>);
+
+    // Number of consecutive particles handed to a thread at a time by the
+    // history-based simulation
+    static const int particle_chunk = 16;
+
+    // Number of consecutive particles whose sampling math is done together,
+    // in vectorized loops, by the event-based simulation
+    static const int event_block = 256;
+
     // Used to generate unique particle IDs
     unsigned id_offset_;
 
     unsigned n_cycles_;
     bool print_particles_;
+
+    // Whether the banks and tallies are shared with the other processes
+    bool distributed_;
+
+    // Whether to use delta tracking, and the majorant transport cross
+    // section of each coarse mesh pin, indexed by [pin * n_group + group].
+    // The majorants are only built when delta tracking is enabled.
+    bool delta_tracking_;
+    VecF majorant_;
+
+    // Whether to simulate fission banks event-by-event, and the particle
+    // storage for doing so
+    bool event_based_;
+    EventBank events_;
+
+    // Logs of the random numbers for the collision distances of the active
+    // particles
+    VecF log_random_;
+
+    // Device implementation of the events, if enabled, and the results of
+    // the device collision event
+    std::unique_ptr<DeviceEvents> device_;
+    VecI device_reaction_;
+    VecF device_dir_random_;
+
+    /**
+     * \brief Return the probabilities of each \ref Reaction for a collision
+     * in group \p ig of an \ref XSMeshRegion
+     */
+    static VecF reaction_pdf(const XSMeshRegion &xsreg, int ig);
+
+    /**
+     * \brief Find the pin, mesh region and XS mesh region of a particle from
+     * its global position
+     */
+    void locate(Particle &p, CoreMesh::LocationInfo &info,
+                int &ipin_coarse) const;
+
+    /**
+     * \brief Update the pin-local position, region indices and pin of a
+     * particle from an already-resolved \ref CoreMesh::LocationInfo
+     */
+    void apply_location(Particle &p, const CoreMesh::LocationInfo &info,
+                        int &ipin_coarse) const;
+
+    /**
+     * \brief Add a new particle's weight to all of the tallies
+     */
+    void register_particle(real_t weight);
+
+    /**
+     * \brief Score the track length-based tallies in \p Tallies for a flight
+     * of length \p tl
+     */
+    template <unsigned Tallies>
+    void score_flight(int ixsreg, int ireg, int ipin_coarse, int group,
+                      real_t weight, real_t tl);
+
+    /**
+     * \brief Score the collision estimators in \p Tallies for a collision in
+     * group \p group
+     */
+    template <unsigned Tallies>
+    void score_collision(int ixsreg, int ireg, int group, real_t weight);
+
+    /**
+     * \brief Score the current through the faces of a pin that a particle
+     * has just been moved across
+     */
+    void score_current(const Particle &p, const std::array<Point3, 2> &bounds,
+                       int ipin_coarse);
+
+    /**
+     * \brief Bank the fission sites of a fission and kill the particle
+     */
+    void fission(Particle &p);
+
+    /**
+     * \brief Push \p n_fis new fission sites at the location of a particle
+     * onto the fission bank
+     */
+    void bank_sites(const Particle &p, int n_fis);
+
+    /**
+     * \brief Perform a collision with implicit capture and Russian roulette
+     */
+    void collide_implicit(Particle &p);
+
+    /**
+     * \brief Split a particle that is heavier than \c weight_split_, adding
+     * the copies to \p split
+     */
+    void split_particle(Particle &p, std::vector<Particle> &split) const;
+
+    /**
+     * \brief Follow a particle from its birth until it dies, adding any
+     * particles split off of it to \p split
+     */
+    template <unsigned Tallies>
+    void track(Particle &p, std::vector<Particle> &split);
+
+    /**
+     * \brief Collision event, using the device kernel
+     */
+    void collide_device(const VecI &queue);
+
+    /**
+     * \brief Move a particle a distance \p d to a surface and handle the
+     * crossing
+     *
+     * If \p pin_crossing is true, the surface is a pin boundary, and the
+     * particle is either relocated into the neighboring pin, reflected or
+     * killed at the domain boundary. Otherwise, the particle just moves into
+     * the neighboring region of the same pin.
+     */
+    void cross_surface(Particle &p, real_t d, bool pin_crossing,
+                       CoreMesh::LocationInfo &info, int &ipin_coarse);
+
+    /**
+     * \brief Follow a particle with delta tracking until it dies
+     */
+    template <unsigned Tallies>
+    void track_delta(Particle &p, CoreMesh::LocationInfo &info,
+                     int &ipin_coarse, std::vector<Particle> &split);
+
+    /**
+     * \brief Event-based version of simulate(FissionBank, real_t)
+     */
+    void simulate_events(const FissionBank &bank);
 };
 } // namespace mc
 } // namespace mocc
@@ -0,0 +1,159 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include "util/omp_guard.h"
+
+namespace mocc {
+namespace mc {
+/**
+ * \brief Dynamic scheduling of a bank of particles over threads
+ *
+ * The particles are divided into chunks of \c chunk consecutive particles,
+ * and each thread starts out with its own queue, holding an even, contiguous
+ * run of the chunks. Threads take chunks from the front of their own queues,
+ * and once theirs is empty, steal the back half of the fullest-looking queue
+ * of another thread. Threads whose particles happen to have short histories
+ * therefore help out with the rest, instead of idling at the end of the
+ * cycle, while mostly staying on neighboring particles.
+ *
+ * The range of chunks left in each queue is packed into a single atomic
+ * word, so that taking and stealing chunks are each a single
+ * compare-and-swap.
+ *
+ * Which thread simulates which particle is not reproducible, so anything
+ * that should be must only depend on the particle, such as its random number
+ * stream.
+ */
+class ParticleQueues {
+public:
+    /**
+     * \brief Deal \p n particles out to the threads, in chunks of \p chunk
+     *
+     * This should be constructed outside of the parallel region that uses
+     * it, with the number of threads that will run it.
+     */
+    ParticleQueues(int n, int chunk, int n_thread = omp_get_max_threads())
+        : n_(n), chunk_(chunk), queues_(n_thread)
+    {
+        uint32_t n_chunk = (n + chunk - 1) / chunk;
+        for (int it = 0; it < n_thread; it++) {
+            uint32_t first = (uint64_t)n_chunk * it / n_thread;
+            uint32_t last  = (uint64_t)n_chunk * (it + 1) / n_thread;
+            queues_[it].range.store(pack(first, last));
+        }
+        return;
+    }
+
+    /**
+     * \brief Get the next chunk of particles for the calling thread
+     *
+     * \param first the index of the first particle in the chunk
+     * \param last one past the index of the last particle in the chunk
+     *
+     * \returns false once all of the particles have been handed out
+     */
+    bool next(int &first, int &last)
+    {
+        const int n_queue = queues_.size();
+        const int it      = omp_get_thread_num() % n_queue;
+        Queue &own        = queues_[it];
+
+        uint32_t chunk;
+        while (!pop(own, chunk)) {
+            // Look for the queue with the most left, starting with our
+            // neighbor, and steal the back half of it
+            int victim   = -1;
+            uint32_t max = 0;
+            for (int i = 1; i < n_queue; i++) {
+                int iq           = (it + i) % n_queue;
+                uint64_t range   = queues_[iq].range.load();
+                uint32_t n_chunk = end(range) - begin(range);
+                if (n_chunk > max) {
+                    max    = n_chunk;
+                    victim = iq;
+                }
+            }
+            if (victim < 0) {
+                return false;
+            }
+
+            uint64_t range = queues_[victim].range.load();
+            uint32_t b     = begin(range);
+            uint32_t e     = end(range);
+            if (b >= e) {
+                continue;
+            }
+            uint32_t mid = e - (e - b + 1) / 2;
+            if (queues_[victim].range.compare_exchange_strong(range,
+                                                              pack(b, mid))) {
+                // Nobody steals from an empty queue, so this can't race
+                own.range.store(pack(mid, e));
+            }
+        }
+
+        first = chunk * chunk_;
+        last  = std::min(first + chunk_, n_);
+        return true;
+    }
+
+private:
+    struct alignas(64) Queue {
+        std::atomic<uint64_t> range;
+    };
+
+    static uint64_t pack(uint32_t begin, uint32_t end)
+    {
+        return ((uint64_t)begin << 32) | end;
+    }
+
+    static uint32_t begin(uint64_t range)
+    {
+        return range >> 32;
+    }
+
+    static uint32_t end(uint64_t range)
+    {
+        return range & 0xFFFFFFFF;
+    }
+
+    /**
+     * \brief Take the chunk at the front of a queue, if there is one
+     */
+    static bool pop(Queue &queue, uint32_t &chunk)
+    {
+        uint64_t range = queue.range.load();
+        while (begin(range) < end(range)) {
+            if (queue.range.compare_exchange_weak(
+                    range, pack(begin(range) + 1, end(range)))) {
+                chunk = begin(range);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    int n_;
+    int chunk_;
+    std::vector<Queue> queues_;
+};
+} // namespace mc
+} // namespace mocc
@@ -16,9 +16,14 @@
 
 #pragma once
 
+#include <cassert>
+#include <cmath>
 #include <iostream>
 #include <utility>
+#include <vector>
 #include "util/global_config.hpp"
+#include "util/omp_guard.h"
+#include "core/parallel_environment.hpp"
 
 namespace mocc {
 namespace mc {
@@ -26,6 +31,11 @@ namespace mc {
 /**
  * \brief Monte Carlo tally for a scalar quantity
  *
+ * Scores and weights are accumulated separately by each thread, and only
+ * summed when the tally is queried with \ref get(). The tally must therefore
+ * be constructed with the number of threads that will be scoring to it
+ * already set.
+ *
  * See \ref tally_page for more discussion about tallies
  */
 class TallyScalar {
@@ -33,7 +43,7 @@ public:
     /**
      * \brief Make a new \ref TallyScalar
      */
-    TallyScalar() : sum_(0.0), sum_square_(0.0), weight_(0.0)
+    TallyScalar() : threads_(omp_get_max_threads())
     {
         return;
     }
@@ -43,10 +53,10 @@ public:
      */
     void score(real_t value)
     {
-#pragma omp atomic
-        sum_ += value;
-#pragma omp atomic
-        sum_square_ += value * value;
+        assert(omp_get_thread_num() < (int)threads_.size());
+        auto &t = threads_[omp_get_thread_num()];
+        t.sum += value;
+        t.sum_square += value * value;
 
         return;
     }
@@ -56,8 +66,8 @@ public:
      */
     void add_weight(real_t w)
     {
-#pragma omp atomic
-        weight_ += w;
+        assert(omp_get_thread_num() < (int)threads_.size());
+        threads_[omp_get_thread_num()].weight += w;
     }
 
     /**
@@ -67,10 +77,35 @@ public:
     {
 #pragma omp single
         {
-            sum_        = 0.0;
-            sum_square_ = 0.0;
-            weight_     = 0.0;
+            for (auto &t : threads_) {
+                t = Accumulator();
+            }
+        }
+
+        return;
+    }
+
+    /**
+     * \brief Sum the tally over all of the processes
+     *
+     * This gathers the scores and weights of all threads and processes, so
+     * that \ref get() returns the same global estimates everywhere. It is
+     * collective, and should only be called outside of a parallel region.
+     */
+    void sum_processes()
+    {
+        Accumulator total;
+        for (auto &t : threads_) {
+            total.sum += t.sum;
+            total.sum_square += t.sum_square;
+            total.weight += t.weight;
+            t = Accumulator();
         }
+        real_t data[3] = {total.sum, total.sum_square, total.weight};
+        ParEnv.sum(data, 3);
+        threads_[0].sum        = data[0];
+        threads_[0].sum_square = data[1];
+        threads_[0].weight     = data[2];
 
         return;
     }
@@ -81,21 +116,35 @@ public:
      */
     std::pair<real_t, real_t> get() const
     {
-        // Plenty of room for optimization in here
+        real_t sum        = 0.0;
+        real_t sum_square = 0.0;
+        real_t weight     = 0.0;
+        for (const auto &t : threads_) {
+            sum += t.sum;
+            sum_square += t.sum_square;
+            weight += t.weight;
+        }
+
         std::pair<real_t, real_t> val;
-        real_t mean           = sum_ / weight_;
+        real_t mean = sum / weight;
 
         val.first  = mean;
-        val.second = 1.0 / (weight_ - 1.0) *
-                     ((1.0 / weight_) * sum_square_ - mean * mean);
+        val.second = 1.0 / (weight - 1.0) *
+                     ((1.0 / weight) * sum_square - mean * mean);
         val.second = std::sqrt(val.second) / mean;
         return val;
     }
 
 private:
-    real_t sum_;
-    real_t sum_square_;
-    real_t weight_;
+    // Per-thread running sums. Each one is padded out to its own cache line,
+    // so that threads scoring at the same time don't contend for it.
+    struct alignas(64) Accumulator {
+        real_t sum        = 0.0;
+        real_t sum_square = 0.0;
+        real_t weight     = 0.0;
+    };
+
+    std::vector<Accumulator> threads_;
 };
 }
 } // namespaces
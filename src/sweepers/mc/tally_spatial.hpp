@@ -16,9 +16,18 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cassert>
+#include <cmath>
 #include <iostream>
+#include <limits>
+#include <unordered_map>
 #include <utility>
+#include <vector>
 #include "util/global_config.hpp"
+#include "util/memory.hpp"
+#include "util/omp_guard.h"
+#include "core/parallel_environment.hpp"
 
 namespace mocc {
 namespace mc {
@@ -26,12 +35,20 @@ namespace mc {
 /**
  * \brief Monte Carlo tally for a spatially-dependent quantity
  *
- * Calls to \ref score() contribute to a buffer, \ref realization_scores_, which
- * following the completion of a "sample" can then stored to the persistent
- * tally values, \ref data_, using the \ref commit_realization() method. \ref
- * data_ stores a sequence of \c std::pair, each containing a running sum and
- * sum of the square of the values from each realization for a region of phase
- * space.
+ * Calls to \ref score() contribute to a per-thread buffer, which following the
+ * completion of a "sample" are summed and stored to the persistent tally
+ * values, \ref data_, using the \ref commit_realization() method. \ref data_
+ * stores a sequence of \c std::pair, each containing a running sum and sum of
+ * the square of the values from each realization for a region of phase space.
+ *
+ * By default, each thread buffers its scores in a dense array spanning all of
+ * the regions, and the statistics are stored for every region. For tallies
+ * over many regions, of which only a fraction are scored, the tally may be
+ * made sparse (see \ref set_sparse()). Each thread then buffers its scores in
+ * a hash table, and statistics are only stored for the regions that have been
+ * scored, sorted by region, as 20 bytes each. Regions that have never been
+ * scored have a sum and sum of squares of zero, as they would in a dense
+ * tally.
  *
  * Calling \ref get() returns the mean and relative standard deviation for each
  * region of phase space.
@@ -43,44 +60,95 @@ public:
     /**
      * \brief Make a new \ref TallyScalar
      */
-    TallySpatial(const VecF &norm)
+    TallySpatial(const VecF &norm, bool sparse = false)
         : nreg_(norm.size()),
           norm_(norm),
-          data_(nreg_, {0.0, 0.0}),
-          realization_scores_(norm.size(), 0.0),
-          weight_(0.0),
+          n_thread_(omp_get_max_threads()),
+          sparse_(!sparse),
+          thread_weight_(n_thread_ * weight_stride, 0.0),
           n_(0)
     {
+        this->set_sparse(sparse);
         return;
     }
 
+    /**
+     * \brief Switch between dense and sparse storage
+     *
+     * This should only be called outside of a parallel region, and discards
+     * all of the scores and statistics.
+     */
+    void set_sparse(bool sparse)
+    {
+        if (sparse == sparse_) {
+            this->reset();
+            return;
+        }
+        sparse_ = sparse;
+        n_      = 0;
+        std::fill(thread_weight_.begin(), thread_weight_.end(), 0.0);
+        if (sparse_) {
+            std::vector<std::pair<real_t, real_t>>().swap(data_);
+            VecF().swap(realization_scores_);
+            std::vector<VecF>().swap(thread_scores_);
+            thread_sparse_scores_.assign(n_thread_,
+                                         std::unordered_map<int, real_t>());
+        } else {
+            VecI().swap(sparse_reg_);
+            VecF().swap(sparse_sum_);
+            VecF().swap(sparse_sum_sq_);
+            thread_sparse_scores_.clear();
+            data_.assign(nreg_, {0.0, 0.0});
+            realization_scores_.assign(nreg_, 0.0);
+            thread_scores_.assign(n_thread_, VecF(nreg_, 0.0));
+        }
+        return;
+    }
+
+    bool is_sparse() const
+    {
+        return sparse_;
+    }
+
     /**
      * \brief Score some quantity to the tally realization buffer
      */
     void score(int i, real_t value)
     {
-#pragma omp atomic
-        realization_scores_[i] += value;
+        int it = omp_get_thread_num();
+        assert(it < n_thread_);
+        if (sparse_) {
+            thread_sparse_scores_[it][i] += value;
+        } else {
+            thread_scores_[it][i] += value;
+        }
 
         return;
     }
 
     /**
      * \brief Commit tally contributions for a given realization to the tally
+     *
+     * \param global whether to sum the realization over all processes before
+     * committing it. This is collective, and should then only be called
+     * outside of a parallel region.
      */
-    void commit_realization()
+    void commit_realization(bool global = false)
     {
 #pragma omp single
         {
-            real_t r_weight = 1.0 / weight_;
-            for (unsigned i = 0; i < realization_scores_.size(); i++) {
-                real_t v = realization_scores_[i] * r_weight;
-                data_[i].first += v;
-                data_[i].second += v * v;
-                realization_scores_[i] = 0.0;
+            real_t weight = 0.0;
+            for (int it = 0; it < n_thread_; it++) {
+                weight += thread_weight_[it * weight_stride];
+                thread_weight_[it * weight_stride] = 0.0;
+            }
+
+            if (sparse_) {
+                this->commit_sparse(weight, global);
+            } else {
+                this->commit_dense(weight, global);
             }
             n_++;
-            weight_ = 0.0;
         }
     }
 
@@ -89,8 +157,9 @@ public:
      */
     void add_weight(real_t w)
     {
-#pragma omp atomic
-        weight_ += w;
+        int it = omp_get_thread_num();
+        assert(it < n_thread_);
+        thread_weight_[it * weight_stride] += w;
         return;
     }
 
@@ -107,8 +176,17 @@ public:
             for (auto &d : realization_scores_) {
                 d = 0.0;
             }
-            weight_ = 0.0;
-            n_      = 0;
+            for (auto &scores : thread_scores_) {
+                std::fill(scores.begin(), scores.end(), 0.0);
+            }
+            for (auto &scores : thread_sparse_scores_) {
+                scores.clear();
+            }
+            sparse_reg_.clear();
+            sparse_sum_.clear();
+            sparse_sum_sq_.clear();
+            std::fill(thread_weight_.begin(), thread_weight_.end(), 0.0);
+            n_ = 0;
         }
         return;
     }
@@ -121,14 +199,26 @@ public:
     {
         // Plenty of room for optimization in here
         assert(n_ > 0);
+
+        // Expand sparse statistics, for the same handling of the regions
+        // that haven't been scored
+        std::vector<std::pair<real_t, real_t>> expanded;
+        if (sparse_) {
+            expanded.assign(nreg_, {0.0, 0.0});
+            for (unsigned k = 0; k < sparse_reg_.size(); k++) {
+                expanded[sparse_reg_[k]] = {sparse_sum_[k], sparse_sum_sq_[k]};
+            }
+        }
+        const auto &data = sparse_ ? expanded : data_;
+
         std::vector<std::pair<real_t, real_t>> ret;
-        ret.reserve(data_.size());
-        for (unsigned i = 0; i < data_.size(); i++) {
+        ret.reserve(data.size());
+        for (unsigned i = 0; i < data.size(); i++) {
             real_t r_norm = 1.0 / norm_[i];
-            real_t mean   = data_[i].first / n_;
+            real_t mean   = data[i].first / n_;
             real_t square_of_mean =
-                data_[i].first * data_[i].first / (n_ * (n_ - 1.0));
-            real_t mean_of_square = data_[i].second / (n_ - 1.0);
+                data[i].first * data[i].first / (n_ * (n_ - 1.0));
+            real_t mean_of_square = data[i].second / (n_ - 1.0);
             real_t variance       = mean_of_square - square_of_mean;
 
             ret.push_back({mean * r_norm,
@@ -138,12 +228,220 @@ public:
         return ret;
     }
 
+    /**
+     * \brief Return the number of bytes used by the tally and its per-thread
+     * buffers
+     *
+     * The sparse buffers are estimated from their element counts, since the
+     * hash table overhead isn't exposed.
+     */
+    size_t memory() const
+    {
+        size_t mem = bytes(data_) + bytes(realization_scores_) +
+                     bytes(thread_weight_) + bytes(sparse_reg_) +
+                     bytes(sparse_sum_) + bytes(sparse_sum_sq_);
+        for (const auto &s : thread_scores_) {
+            mem += bytes(s);
+        }
+        for (const auto &s : thread_sparse_scores_) {
+            mem += s.size() * (sizeof(std::pair<int, real_t>) + sizeof(void *));
+        }
+        return mem;
+    }
+
+    /**
+     * \brief Return the largest relative standard error of the mean over all
+     * regions with a non-zero mean
+     *
+     * This needs at least two realizations, and returns the largest
+     * representable value otherwise.
+     */
+    real_t max_relative_error() const
+    {
+        if (n_ < 2) {
+            return std::numeric_limits<real_t>::max();
+        }
+        auto error = [this](real_t sum, real_t sum_sq) -> real_t {
+            if (sum <= 0.0) {
+                return 0.0;
+            }
+            real_t mean     = sum / n_;
+            real_t variance = (sum_sq - sum * mean) / (n_ - 1.0);
+            return std::sqrt(std::max(variance, 0.0) / n_) / mean;
+        };
+        real_t max_err = 0.0;
+        for (const auto &d : data_) {
+            max_err = std::max(max_err, error(d.first, d.second));
+        }
+        for (unsigned k = 0; k < sparse_reg_.size(); k++) {
+            max_err =
+                std::max(max_err, error(sparse_sum_[k], sparse_sum_sq_[k]));
+        }
+        return max_err;
+    }
+
 private:
+    // Number of regions summed over the processes at a time by a sparse
+    // tally, which bounds the size of the dense buffer that it needs
+    static const int global_chunk = 1 << 20;
+
+    /**
+     * \brief Gather the dense thread buffers into the realization, and
+     * commit it to the statistics
+     */
+    void commit_dense(real_t weight, bool global)
+    {
+        for (auto &scores : thread_scores_) {
+            for (unsigned i = 0; i < nreg_; i++) {
+                realization_scores_[i] += scores[i];
+                scores[i] = 0.0;
+            }
+        }
+
+        if (global) {
+            realization_scores_.push_back(weight);
+            ParEnv.sum(realization_scores_.data(), realization_scores_.size());
+            weight = realization_scores_.back();
+            realization_scores_.pop_back();
+        }
+
+        real_t r_weight = 1.0 / weight;
+        for (unsigned i = 0; i < realization_scores_.size(); i++) {
+            real_t v = realization_scores_[i] * r_weight;
+            data_[i].first += v;
+            data_[i].second += v * v;
+            realization_scores_[i] = 0.0;
+        }
+        return;
+    }
+
+    /**
+     * \brief Gather the hashed thread buffers into the realization, and merge
+     * it into the sparse statistics
+     */
+    void commit_sparse(real_t weight, bool global)
+    {
+        // The realization, sorted by region, with the scores of each region
+        // from the different threads combined
+        std::vector<std::pair<int, real_t>> scores;
+        for (auto &s : thread_sparse_scores_) {
+            scores.insert(scores.end(), s.begin(), s.end());
+            s.clear();
+        }
+        std::sort(scores.begin(), scores.end(),
+                  [](const std::pair<int, real_t> &a,
+                     const std::pair<int, real_t> &b) {
+                      return a.first < b.first;
+                  });
+        int n_score = 0;
+        for (const auto &v : scores) {
+            if ((n_score > 0) && (scores[n_score - 1].first == v.first)) {
+                scores[n_score - 1].second += v.second;
+            } else {
+                scores[n_score++] = v;
+            }
+        }
+        scores.resize(n_score);
+
+        if (global) {
+            ParEnv.sum(&weight, 1);
+            if (ParEnv.n_rank() > 1) {
+                // Sum a chunk of the regions at a time, keeping those that
+                // any process scored
+                std::vector<std::pair<int, real_t>> global_scores;
+                VecF chunk;
+                auto it = scores.begin();
+                for (int first = 0; first < (int)nreg_;
+                     first += global_chunk) {
+                    int n = std::min(global_chunk, (int)nreg_ - first);
+                    chunk.assign(n, 0.0);
+                    for (; (it != scores.end()) && (it->first < first + n);
+                         ++it) {
+                        chunk[it->first - first] = it->second;
+                    }
+                    ParEnv.sum(chunk.data(), n);
+                    for (int i = 0; i < n; i++) {
+                        if (chunk[i] != 0.0) {
+                            global_scores.push_back({first + i, chunk[i]});
+                        }
+                    }
+                }
+                scores.swap(global_scores);
+            }
+        }
+
+        // Count the regions scored for the first time, then merge in place
+        // from the back, so that the statistics are never copied
+        int n_old = sparse_reg_.size();
+        int n_new = 0;
+        {
+            int k = 0;
+            for (const auto &v : scores) {
+                while ((k < n_old) && (sparse_reg_[k] < v.first)) {
+                    k++;
+                }
+                if ((k == n_old) || (sparse_reg_[k] != v.first)) {
+                    n_new++;
+                }
+            }
+        }
+        sparse_reg_.resize(n_old + n_new);
+        sparse_sum_.resize(n_old + n_new);
+        sparse_sum_sq_.resize(n_old + n_new);
+
+        real_t r_weight = 1.0 / weight;
+        int k           = n_old - 1;
+        int out         = n_old + n_new - 1;
+        for (int i = (int)scores.size() - 1; i >= 0; i--) {
+            int reg  = scores[i].first;
+            real_t v = scores[i].second * r_weight;
+            while ((k >= 0) && (sparse_reg_[k] > reg)) {
+                sparse_reg_[out]    = sparse_reg_[k];
+                sparse_sum_[out]    = sparse_sum_[k];
+                sparse_sum_sq_[out] = sparse_sum_sq_[k];
+                k--;
+                out--;
+            }
+            if ((k >= 0) && (sparse_reg_[k] == reg)) {
+                sparse_reg_[out]    = reg;
+                sparse_sum_[out]    = sparse_sum_[k] + v;
+                sparse_sum_sq_[out] = sparse_sum_sq_[k] + v * v;
+                k--;
+            } else {
+                sparse_reg_[out]    = reg;
+                sparse_sum_[out]    = v;
+                sparse_sum_sq_[out] = v * v;
+            }
+            out--;
+        }
+        return;
+    }
+
+    // Spacing between the per-thread weights, so that each lands on its own
+    // cache line
+    static const int weight_stride = 8;
+
     unsigned nreg_;
     const VecF &norm_;
     std::vector<std::pair<real_t, real_t>> data_;
     VecF realization_scores_;
-    real_t weight_;
+
+    // Per-thread score buffers. Only one of these is in use, depending on
+    // sparse_.
+    int n_thread_;
+    bool sparse_;
+    std::vector<VecF> thread_scores_;
+    std::vector<std::unordered_map<int, real_t>> thread_sparse_scores_;
+
+    // Sparse statistics: the regions that have been scored, in order, and
+    // the sum and sum of squares of their realizations
+    VecI sparse_reg_;
+    VecF sparse_sum_;
+    VecF sparse_sum_sq_;
+
+    // Per-thread weight accumulated for the current realization
+    VecF thread_weight_;
+
     int n_;
 };
 }
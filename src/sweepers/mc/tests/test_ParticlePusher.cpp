@@ -18,8 +18,10 @@
 
 #include <iostream>
 #include "pugixml.hpp"
+#include "util/error.hpp"
 #include "util/h5file.hpp"
 #include "core/core_mesh.hpp"
+#include "sweepers/mc/fission_bank.hpp"
 #include "sweepers/mc/particle_pusher.hpp"
 #include "sweepers/mc/particle.hpp"
 #include "util/rng_lcg.hpp"
@@ -89,6 +91,477 @@ TEST(test_beam)
     return;
 }
 
+// The event-based mode should follow exactly the same histories as the
+// history-based mode, so the tallies should only differ by roundoff
+TEST(test_event_based)
+{
+    pugi::xml_document geom_xml;
+    geom_xml.load_file("square.xml");
+
+    CoreMesh mesh(geom_xml);
+
+    XSMesh xs_mesh(mesh, MeshTreatment::TRUE);
+
+    pugi::xml_document box_xml;
+    box_xml.load_string("<fission_box x_min=\"0.1\" x_max=\"1.4\" "
+                        "y_min=\"0.1\" y_max=\"1.4\" z_min=\"0.1\" "
+                        "z_max=\"0.4\" fissile_rejection=\"f\"/>");
+    RNG_LCG rng(11112854149);
+    FissionBank bank(box_xml.child("fission_box"), 1000, mesh, xs_mesh, rng);
+
+    ParticlePusher history(mesh, xs_mesh);
+    history.simulate(bank, 1.0);
+
+    ParticlePusher event(mesh, xs_mesh);
+    event.set_event_based(true);
+    event.simulate(bank, 1.0);
+
+    CHECK_EQUAL(history.fission_bank().size(), event.fission_bank().size());
+
+    // The fission banks come out ordered by parent, so they should match
+    // site for site
+    for (int i = 0; i < history.fission_bank().size(); i++) {
+        CHECK_EQUAL(history.fission_bank()[i].id, event.fission_bank()[i].id);
+        CHECK_EQUAL(history.fission_bank()[i].location.x,
+                    event.fission_bank()[i].location.x);
+    }
+    CHECK_CLOSE(history.k_tally_tl().get().first,
+                event.k_tally_tl().get().first, 1.0e-10);
+    CHECK_CLOSE(history.k_tally_col().get().first,
+                event.k_tally_col().get().first, 1.0e-10);
+}
+
+// The device events follow the same histories as the host events. On the
+// host (without offload) they should match exactly; on a device they may
+// differ by the roundoff of its math library, so only check the eigenvalue
+// estimates.
+TEST(test_device_events)
+{
+    pugi::xml_document geom_xml;
+    geom_xml.load_file("square.xml");
+
+    CoreMesh mesh(geom_xml);
+
+    XSMesh xs_mesh(mesh, MeshTreatment::TRUE);
+
+    pugi::xml_document box_xml;
+    box_xml.load_string("<fission_box x_min=\"0.1\" x_max=\"1.4\" "
+                        "y_min=\"0.1\" y_max=\"1.4\" z_min=\"0.1\" "
+                        "z_max=\"0.4\" fissile_rejection=\"f\"/>");
+    RNG_LCG rng(11112854149);
+    FissionBank bank(box_xml.child("fission_box"), 1000, mesh, xs_mesh, rng);
+
+    ParticlePusher event(mesh, xs_mesh);
+    event.set_event_based(true);
+    event.simulate(bank, 1.0);
+
+    ParticlePusher device(mesh, xs_mesh);
+    device.set_device_events(true);
+    device.simulate(bank, 1.0);
+
+    CHECK_CLOSE(event.k_tally_tl().get().first,
+                device.k_tally_tl().get().first, 1.0e-8);
+    CHECK_CLOSE(event.k_tally_col().get().first,
+                device.k_tally_col().get().first, 1.0e-8);
+}
+
+// Delta tracking follows different histories, but should agree with surface
+// tracking to within the statistics
+TEST(test_delta_tracking)
+{
+    pugi::xml_document geom_xml;
+    geom_xml.load_file("square.xml");
+
+    CoreMesh mesh(geom_xml);
+
+    XSMesh xs_mesh(mesh, MeshTreatment::TRUE);
+
+    pugi::xml_document box_xml;
+    box_xml.load_string("<fission_box x_min=\"0.1\" x_max=\"1.4\" "
+                        "y_min=\"0.1\" y_max=\"1.4\" z_min=\"0.1\" "
+                        "z_max=\"0.4\" fissile_rejection=\"f\"/>");
+    RNG_LCG rng(11112854149);
+    FissionBank bank(box_xml.child("fission_box"), 10000, mesh, xs_mesh, rng);
+
+    ParticlePusher surface(mesh, xs_mesh);
+    surface.simulate(bank, 1.0);
+
+    ParticlePusher delta(mesh, xs_mesh);
+    delta.set_delta_tracking(true);
+    delta.simulate(bank, 1.0);
+
+    real_t k_surface = surface.k_tally_tl().get().first;
+    CHECK_CLOSE(1.0, delta.k_tally_tl().get().first / k_surface, 0.05);
+    CHECK_CLOSE(1.0, delta.k_tally_col().get().first / k_surface, 0.05);
+
+    // Delta tracking is not available in event-based mode
+    delta.set_event_based(true);
+    CHECK_THROW(delta.simulate(bank, 1.0), Exception);
+}
+
+// Survival biasing changes the histories, but not the expected eigenvalue
+TEST(test_implicit_capture)
+{
+    pugi::xml_document geom_xml;
+    geom_xml.load_file("square.xml");
+
+    CoreMesh mesh(geom_xml);
+
+    XSMesh xs_mesh(mesh, MeshTreatment::TRUE);
+
+    pugi::xml_document box_xml;
+    box_xml.load_string("<fission_box x_min=\"0.1\" x_max=\"1.4\" "
+                        "y_min=\"0.1\" y_max=\"1.4\" z_min=\"0.1\" "
+                        "z_max=\"0.4\" fissile_rejection=\"f\"/>");
+    RNG_LCG rng(11112854149);
+    FissionBank bank(box_xml.child("fission_box"), 10000, mesh, xs_mesh, rng);
+
+    ParticlePusher analog(mesh, xs_mesh);
+    analog.simulate(bank, 1.0);
+
+    ParticlePusher implicit(mesh, xs_mesh);
+    implicit.set_implicit_capture(true);
+    implicit.simulate(bank, 1.0);
+
+    real_t k_analog = analog.k_tally_tl().get().first;
+    CHECK_CLOSE(1.0, implicit.k_tally_tl().get().first / k_analog, 0.05);
+    CHECK_CLOSE(1.0, implicit.k_tally_col().get().first / k_analog, 0.05);
+
+    // The weights must be increasing
+    CHECK_THROW(implicit.set_implicit_capture(true, 0.5, 0.25, 2.0),
+                Exception);
+}
+
+// Dropping tallies must not change the histories
+TEST(test_tally_set)
+{
+    pugi::xml_document geom_xml;
+    geom_xml.load_file("square.xml");
+
+    CoreMesh mesh(geom_xml);
+
+    XSMesh xs_mesh(mesh, MeshTreatment::TRUE);
+
+    pugi::xml_document box_xml;
+    box_xml.load_string("<fission_box x_min=\"0.1\" x_max=\"1.4\" "
+                        "y_min=\"0.1\" y_max=\"1.4\" z_min=\"0.1\" "
+                        "z_max=\"0.4\" fissile_rejection=\"f\"/>");
+    RNG_LCG rng(11112854149);
+    FissionBank bank(box_xml.child("fission_box"), 1000, mesh, xs_mesh, rng);
+
+    ParticlePusher all(mesh, xs_mesh);
+    all.simulate(bank, 1.0);
+
+    ParticlePusher pin(mesh, xs_mesh);
+    pin.set_tallies(TALLY_PIN_POWER);
+    pin.simulate(bank, 1.0);
+
+    CHECK_CLOSE(all.k_tally_tl().get().first, pin.k_tally_tl().get().first,
+                1.0e-12);
+    CHECK_CLOSE(all.k_tally_col().get().first, pin.k_tally_col().get().first,
+                1.0e-12);
+    CHECK(pin.flux_tallies().empty());
+    CHECK(pin.fine_flux_tallies().empty());
+
+    CHECK_THROW(pin.set_tallies(TALLY_ALL + 1), Exception);
+}
+
+// An inactive cycle scores the eigenvalue, but leaves nothing in the spatial
+// tallies for the active cycles that follow
+TEST(test_inactive)
+{
+    pugi::xml_document geom_xml;
+    geom_xml.load_file("square.xml");
+
+    CoreMesh mesh(geom_xml);
+
+    XSMesh xs_mesh(mesh, MeshTreatment::TRUE);
+
+    pugi::xml_document box_xml;
+    box_xml.load_string("<fission_box x_min=\"0.1\" x_max=\"1.4\" "
+                        "y_min=\"0.1\" y_max=\"1.4\" z_min=\"0.1\" "
+                        "z_max=\"0.4\" fissile_rejection=\"f\"/>");
+    RNG_LCG rng(11112854149);
+    FissionBank bank(box_xml.child("fission_box"), 1000, mesh, xs_mesh, rng);
+
+    ParticlePusher active(mesh, xs_mesh);
+    active.simulate(bank, 1.0);
+
+    ParticlePusher inactive(mesh, xs_mesh);
+    inactive.set_active(false);
+    CHECK(!inactive.active());
+    inactive.simulate(bank, 1.0);
+
+    CHECK_CLOSE(active.k_tally_tl().get().first,
+                inactive.k_tally_tl().get().first, 1.0e-12);
+    CHECK_CLOSE(active.k_tally_col().get().first,
+                inactive.k_tally_col().get().first, 1.0e-12);
+    CHECK_EQUAL(active.fission_bank().size(), inactive.fission_bank().size());
+
+    // A second, active cycle should match one that follows a reset
+    active.reset_tallies(true);
+    active.simulate(bank, 1.0);
+    inactive.set_active(true);
+    inactive.reset_tallies();
+    inactive.simulate(bank, 1.0);
+
+    auto a = active.pin_power_tally().get();
+    auto b = inactive.pin_power_tally().get();
+    REQUIRE CHECK_EQUAL(a.size(), b.size());
+    for (unsigned i = 0; i < a.size(); i++) {
+        CHECK_CLOSE(a[i].first, b[i].first, 1.0e-12);
+    }
+}
+
+// Sparse fine-mesh tallies should produce the same results as dense ones,
+// while only storing the regions that were scored
+TEST(test_sparse_tallies)
+{
+    pugi::xml_document geom_xml;
+    geom_xml.load_file("square.xml");
+
+    CoreMesh mesh(geom_xml);
+
+    XSMesh xs_mesh(mesh, MeshTreatment::TRUE);
+
+    pugi::xml_document box_xml;
+    box_xml.load_string("<fission_box x_min=\"0.1\" x_max=\"1.4\" "
+                        "y_min=\"0.1\" y_max=\"1.4\" z_min=\"0.1\" "
+                        "z_max=\"0.4\" fissile_rejection=\"f\"/>");
+    RNG_LCG rng(11112854149);
+    FissionBank bank(box_xml.child("fission_box"), 1000, mesh, xs_mesh, rng);
+
+    ParticlePusher dense(mesh, xs_mesh);
+    ParticlePusher sparse(mesh, xs_mesh, true);
+    for (int cycle = 0; cycle < 3; cycle++) {
+        dense.simulate(bank, 1.0);
+        sparse.simulate(bank, 1.0);
+    }
+
+    CHECK(sparse.fine_flux_tallies()[0].is_sparse());
+    for (int ig = 0; ig < (int)xs_mesh.n_group(); ig++) {
+        auto d = dense.fine_flux_tallies()[ig].get();
+        auto s = sparse.fine_flux_tallies()[ig].get();
+        REQUIRE CHECK_EQUAL(d.size(), s.size());
+        for (unsigned i = 0; i < d.size(); i++) {
+            CHECK_CLOSE(d[i].first, s[i].first, 1.0e-12);
+            if (d[i].first > 0.0) {
+                CHECK_CLOSE(d[i].second, s[i].second, 1.0e-8);
+            }
+        }
+        CHECK_CLOSE(dense.fine_flux_tallies()[ig].max_relative_error(),
+                    sparse.fine_flux_tallies()[ig].max_relative_error(),
+                    1.0e-8);
+    }
+}
+
+// The leakage from the surface current tallies and the absorption from the
+// flux tallies should balance the source
+TEST(test_current_tallies)
+{
+    pugi::xml_document geom_xml;
+    geom_xml.load_file("square.xml");
+
+    CoreMesh mesh(geom_xml);
+
+    XSMesh xs_mesh(mesh, MeshTreatment::TRUE);
+
+    pugi::xml_document box_xml;
+    box_xml.load_string("<fission_box x_min=\"0.1\" x_max=\"1.4\" "
+                        "y_min=\"0.1\" y_max=\"1.4\" z_min=\"0.1\" "
+                        "z_max=\"0.4\" fissile_rejection=\"f\"/>");
+    RNG_LCG rng(11112854149);
+    FissionBank bank(box_xml.child("fission_box"), 10000, mesh, xs_mesh, rng);
+
+    ParticlePusher pusher(mesh, xs_mesh);
+    pusher.set_current_tallies(true);
+    pusher.simulate(bank, 1.0);
+
+    auto current = pusher.current_tallies()[0].get();
+    real_t leakage = 0.0;
+    for (int is = 0; is < (int)mesh.n_surf(); is++) {
+        auto cells  = mesh.coarse_neigh_cells(is);
+        real_t j     = current[is].first * mesh.coarse_area(is);
+        if (cells.first < 0) {
+            leakage -= j;
+        }
+        if (cells.second < 0) {
+            leakage += j;
+        }
+        // Nothing is scored on the reflective top and bottom
+        if ((mesh.surface_normal(is) == Normal::Z_NORM) &&
+            ((cells.first < 0) || (cells.second < 0))) {
+            CHECK_EQUAL(0.0, current[is].first);
+        }
+    }
+
+    auto flux     = pusher.flux_tallies()[0].get();
+    real_t xsab   = xs_mesh[0].xsmactr(0) - xs_mesh[0].xsmacsc().out(0);
+    real_t absorb = 0.0;
+    for (int ipin = 0; ipin < (int)mesh.n_pin(); ipin++) {
+        absorb += flux[ipin].first * mesh.coarse_volume(ipin) * xsab;
+    }
+
+    CHECK(leakage > 0.0);
+    CHECK_CLOSE(1.0, leakage + absorb, 0.02);
+}
+
+TEST(test_bank_resize)
+{
+    pugi::xml_document geom_xml;
+    geom_xml.load_file("square.xml");
+
+    CoreMesh mesh(geom_xml);
+
+    XSMesh xs_mesh(mesh, MeshTreatment::TRUE);
+
+    pugi::xml_document box_xml;
+    box_xml.load_string("<fission_box x_min=\"0.1\" x_max=\"1.4\" "
+                        "y_min=\"0.1\" y_max=\"1.4\" z_min=\"0.1\" "
+                        "z_max=\"0.4\" fissile_rejection=\"f\"/>");
+    RNG_LCG rng(11112854149);
+    FissionBank bank(box_xml.child("fission_box"), 1000, mesh, xs_mesh, rng);
+
+    // Shrinking should keep a subset of the sites, in their original order
+    bank.resize(600, rng);
+    CHECK_EQUAL(600, bank.size());
+    for (int i = 1; i < bank.size(); i++) {
+        CHECK(bank[i - 1].id < bank[i].id);
+    }
+
+    // Growing should only add copies of existing sites
+    bank.resize(1500, rng);
+    CHECK_EQUAL(1500, bank.size());
+    for (int i = 600; i < bank.size(); i++) {
+        CHECK(bank[i].id < 1000);
+    }
+}
+
+// Sites sampled from a pin-wise source should only land in the source pins
+TEST(test_bank_pin_source)
+{
+    pugi::xml_document geom_xml;
+    geom_xml.load_file("square.xml");
+
+    CoreMesh mesh(geom_xml);
+
+    XSMesh xs_mesh(mesh, MeshTreatment::TRUE);
+
+    ArrayB3 pin_source(mesh.n_macroplanes(), mesh.ny(), mesh.nx());
+    pin_source          = 0.0;
+    pin_source(0, 2, 5) = 1.0;
+    pin_source(0, 7, 1) = 3.0;
+
+    RNG_LCG rng(11112854149);
+    FissionBank bank(pin_source, 1000, mesh, xs_mesh, rng);
+    CHECK_EQUAL(1000, bank.size());
+
+    int n_first = 0;
+    for (int i = 0; i < bank.size(); i++) {
+        Position pos =
+            mesh.coarse_position(mesh.coarse_cell_point(bank.location(i)));
+        bool first = (pos.x == 5) && (pos.y == 2);
+        CHECK(first || ((pos.x == 1) && (pos.y == 7)));
+        n_first += first;
+        CHECK_EQUAL(0, bank[i].group);
+    }
+    CHECK_CLOSE(250, n_first, 50);
+
+    // The source must match the mesh
+    ArrayB3 wrong(1, 2, 2);
+    wrong = 1.0;
+    CHECK_THROW(FissionBank(wrong, 10, mesh, xs_mesh, rng), Exception);
+}
+
+TEST(test_bank_comb)
+{
+    pugi::xml_document geom_xml;
+    geom_xml.load_file("square.xml");
+
+    CoreMesh mesh(geom_xml);
+
+    XSMesh xs_mesh(mesh, MeshTreatment::TRUE);
+
+    pugi::xml_document box_xml;
+    box_xml.load_string("<fission_box x_min=\"0.1\" x_max=\"1.4\" "
+                        "y_min=\"0.1\" y_max=\"1.4\" z_min=\"0.1\" "
+                        "z_max=\"0.4\" fissile_rejection=\"f\"/>");
+    RNG_LCG rng(11112854149);
+    FissionBank bank(box_xml.child("fission_box"), 1000, mesh, xs_mesh, rng);
+
+    // With equal weights, combing up to an integer multiple copies every
+    // site the same number of times, in order
+    bank.comb(3000, rng);
+    CHECK_EQUAL(3000, bank.size());
+    for (int i = 0; i < bank.size(); i++) {
+        CHECK_EQUAL(i / 3, (int)bank[i].id);
+        CHECK_CLOSE(1.0 / 3.0, bank[i].weight, 1.0e-12);
+    }
+
+    // Combing down keeps a subset, in order, and preserves the total weight
+    bank.comb(700, rng);
+    CHECK_EQUAL(700, bank.size());
+    real_t total = 0.0;
+    for (int i = 0; i < bank.size(); i++) {
+        total += bank[i].weight;
+        if (i > 0) {
+            CHECK(bank[i - 1].id <= bank[i].id);
+        }
+    }
+    CHECK_CLOSE(1000.0, total, 1.0e-8);
+
+    // Sorting should group the sites by pin
+    bank.sort_sites();
+    CHECK_EQUAL(700, bank.size());
+    for (int i = 1; i < bank.size(); i++) {
+        CHECK(mesh.coarse_cell_point(bank[i - 1].location) <=
+              mesh.coarse_cell_point(bank[i].location));
+    }
+}
+
+// On a single process, a distributed bank holds every site, and combing and
+// balancing it must give the same bank as combing an undistributed one
+TEST(test_bank_distribute)
+{
+    pugi::xml_document geom_xml;
+    geom_xml.load_file("square.xml");
+
+    CoreMesh mesh(geom_xml);
+
+    XSMesh xs_mesh(mesh, MeshTreatment::TRUE);
+
+    pugi::xml_document box_xml;
+    box_xml.load_string("<fission_box x_min=\"0.1\" x_max=\"1.4\" "
+                        "y_min=\"0.1\" y_max=\"1.4\" z_min=\"0.1\" "
+                        "z_max=\"0.4\" fissile_rejection=\"f\"/>");
+    RNG_LCG rng(11112854149);
+    FissionBank bank(box_xml.child("fission_box"), 1000, mesh, xs_mesh, rng);
+    RNG_LCG rng_ref(11112854149);
+    FissionBank ref(box_xml.child("fission_box"), 1000, mesh, xs_mesh,
+                    rng_ref);
+
+    bank.distribute();
+    CHECK(bank.distributed());
+    CHECK_EQUAL(1000, bank.size());
+    CHECK_EQUAL(1000, bank.global_size());
+    CHECK_EQUAL(ref.shannon_entropy(), bank.shannon_entropy());
+
+    bank.comb(700, rng);
+    bank.balance();
+    bank.renumber();
+    ref.comb(700, rng_ref);
+    ref.renumber();
+    CHECK_EQUAL(700, bank.global_size());
+    for (int i = 0; i < bank.size(); i++) {
+        CHECK_EQUAL(i, (int)bank[i].id);
+        CHECK_EQUAL(ref[i].location.x, bank[i].location.x);
+        CHECK_EQUAL(ref[i].weight, bank[i].weight);
+    }
+
+    // Random resampling is not supported on a distributed bank
+    CHECK_THROW(bank.resize(1000, rng), Exception);
+}
+
 int main()
 {
     return UnitTest::RunAllTests();
@@ -0,0 +1,343 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "axial_tracks.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "util/error.hpp"
+#include "util/memory.hpp"
+
+namespace {
+// Distances within this of each other are taken to be the same event (the
+// end of a segment coinciding with the end of a ray or plane, say)
+const mocc::real_t event_tol = 1.0e-9;
+}
+
+namespace mocc {
+namespace moc {
+AxialTracks::AxialTracks(const RayData &rays, const CyclicTracks &tracks,
+                         const std::array<Boundary, 6> &bc,
+                         const VecI &plane_ids, const VecF &heights,
+                         const VecI &first_reg, real_t spacing)
+    : rays_(&rays),
+      cyclic_(&tracks),
+      plane_ids_(plane_ids),
+      first_reg_(first_reg),
+      bc_(bc),
+      n_lines_(0)
+{
+    for (auto s : {Surface::TOP, Surface::BOTTOM}) {
+        if ((bc[s] != Boundary::VACUUM) && (bc[s] != Boundary::REFLECT)) {
+            throw EXCEPT("3-D MoC needs vacuum or reflective top and bottom "
+                         "boundaries.");
+        }
+    }
+    for (auto s : {Surface::EAST, Surface::NORTH, Surface::WEST,
+                   Surface::SOUTH}) {
+        if ((bc[s] != Boundary::VACUUM) && (bc[s] != Boundary::REFLECT) &&
+            (bc[s] != Boundary::ROTATE)) {
+            throw EXCEPT("3-D MoC needs vacuum, reflective or rotational "
+                         "radial boundaries.");
+        }
+    }
+    if (!(spacing > 0.0)) {
+        throw EXCEPT("Invalid axial ray spacing.");
+    }
+    if (rays.expanded() || rays.out_of_core()) {
+        throw EXCEPT("3-D MoC needs packed, in-core ray segments.");
+    }
+
+    z_.push_back(0.0);
+    for (auto h : heights) {
+        z_.push_back(z_.back() + h);
+    }
+    const real_t h = z_.back();
+
+    // Tabulate the end of each 2-D segment along its ray, for the plane
+    // geometries that are used
+    seg_end_.resize(std::distance(rays.begin(), rays.end()));
+    for (int plane_id : plane_ids_) {
+        auto &plane_end = seg_end_[plane_id];
+        if (!plane_end.empty()) {
+            continue;
+        }
+        for (int iang = 0; iang < (int)rays[plane_id].size(); iang++) {
+            const auto &packed = rays.packed(plane_id)[iang];
+            int n_ray          = rays[plane_id][iang].size();
+            int n_seg = packed.seg_offset(n_ray - 1) + packed.nseg(n_ray - 1);
+            std::vector<float> end(n_seg);
+            for (int iray = 0; iray < n_ray; iray++) {
+                const float *len = packed.seg_len(iray);
+                float *e         = &end[packed.seg_offset(iray)];
+                double pos       = 0.0;
+                for (int iseg = 0; iseg < packed.nseg(iray); iseg++) {
+                    pos += len[iseg];
+                    e[iseg] = pos;
+                }
+            }
+            plane_end.push_back(end);
+        }
+    }
+
+    // The lines follow the tracks of the first plane through all of the
+    // others, so the tracks have to be the same everywhere
+    const int plane_id = plane_ids_.front();
+    for (int other_id : plane_ids_) {
+        bool same = tracks.n_tracks(other_id) == tracks.n_tracks(plane_id);
+        for (int it = 0; same && (it < tracks.n_tracks(plane_id)); it++) {
+            int n_links = tracks.n_links(plane_id, it);
+            same        = n_links == tracks.n_links(other_id, it);
+            const TrackLink *l = tracks.links(plane_id, it);
+            const TrackLink *r = tracks.links(other_id, it);
+            for (int il = 0; same && (il < n_links); il++) {
+                same = (l[il].iang == r[il].iang) &&
+                       (l[il].iray == r[il].iray) &&
+                       (l[il].forward == r[il].forward);
+            }
+        }
+        if (!same) {
+            throw EXCEPT("3-D MoC needs the same ray layout in every plane.");
+        }
+    }
+
+    const AngularQuadrature &ang_quad = rays.ang_quad();
+    for (int it = 0; it < tracks.n_tracks(plane_id); it++) {
+        const TrackLink *links = tracks.links(plane_id, it);
+        Track track;
+        track.itrack     = it;
+        track.cyclic     = tracks.closed(plane_id, it);
+        track.first_link = link_pos_.size();
+        track.n_links    = tracks.n_links(plane_id, it);
+
+        real_t length = 0.0;
+        for (int il = 0; il < track.n_links; il++) {
+            const TrackLink &link = links[il];
+            const auto &packed    = rays.packed(plane_id)[link.iang];
+            int last = packed.seg_offset(link.iray) + packed.nseg(link.iray);
+            link_pos_.push_back(length);
+            link_wt_.push_back(ang_quad[link.iang].weight *
+                               rays.spacing(link.iang));
+            length += seg_end_[plane_id][link.iang][last - 1];
+        }
+        link_pos_.push_back(length);
+        link_wt_.push_back(0.0);
+
+        // Reflections and rotations keep the polar angle, so all of the rays
+        // of a track share it
+        const Angle &ang = ang_quad[links[0].iang];
+        real_t tan       = 1.0 / (std::abs(ang.oz) * ang.rsintheta);
+        track.length     = length;
+        track.n_b  = std::max(1, (int)std::round(length / (spacing * tan)));
+        track.ds   = length / track.n_b;
+        track.cot  = 1.0 / tan;
+        track.rsin = ang.rsintheta;
+        track.shift = h * tan / track.ds;
+        if (track.cyclic) {
+            track.j_min = 0;
+            track.j_far = track.n_b - 1;
+        } else {
+            track.j_min = (int)std::floor(-track.shift - 0.5) + 1;
+            track.j_far =
+                (int)std::floor((length - h * tan) / track.ds - 0.5);
+        }
+
+        real_t dz = track.ds * track.cot;
+        for (int il = 0; il < track.n_links; il++) {
+            link_wt_[track.first_link + il] *= HPI * dz / ang.rsintheta;
+        }
+
+        track.first_line = n_lines_;
+        n_lines_ += 2 * (track.n_b - track.j_min);
+        tracks_.push_back(track);
+    }
+
+    return;
+}
+
+bool AxialTracks::trace(int itrack, int iline, bool falling,
+                        std::vector<AxialSegment> &segments) const
+{
+    segments.clear();
+
+    const Track &track     = tracks_[itrack];
+    const TrackLink *links = cyclic_->links(plane_ids_.front(), track.itrack);
+    const real_t *pos      = &link_pos_[track.first_link];
+    const real_t *wt       = &link_wt_[track.first_link];
+    const int n_plane      = plane_ids_.size();
+    const real_t h         = z_.back();
+
+    // Entry position of the line, and where it ends
+    const real_t entry = (iline + track.j_min + 0.5) * track.ds;
+    real_t s           = track.cyclic ? entry : std::max(entry, 0.0);
+    real_t s_end       = entry + track.shift * track.ds;
+    bool on_surface    = true;
+    if (!track.cyclic && (s_end > track.length)) {
+        s_end      = track.length;
+        on_surface = false;
+    }
+
+    // Height above the entry surface, and the bounds of the planes in the
+    // same terms. Falling lines see the planes from the top down.
+    auto zeta  = [&](real_t s) { return (s - entry) * track.cot; };
+    auto bound = [&](int k) { return falling ? h - z_[n_plane - k] : z_[k]; };
+    int k      = 0;
+    while ((k < n_plane - 1) && (bound(k + 1) <= zeta(s))) {
+        k++;
+    }
+
+    int il = std::upper_bound(pos, pos + track.n_links + 1, s) - pos - 1;
+    il     = std::min(std::max(il, 0), track.n_links - 1);
+    real_t base = pos[il];
+
+    while (true) {
+        const TrackLink &link = links[il];
+        const int iplane      = falling ? n_plane - 1 - k : k;
+        const int plane_id    = plane_ids_[iplane];
+        const int first_reg   = first_reg_[iplane];
+        const auto &packed    = rays_->packed(plane_id)[link.iang];
+        const int nseg        = packed.nseg(link.iray);
+        const float *end =
+            &seg_end_[plane_id][link.iang][packed.seg_offset(link.iray)];
+        const real_t len_ray = pos[il + 1] - pos[il];
+        auto region          = [&](int iseg) -> int {
+            return packed.wide_index() ? packed.seg_index_32(link.iray)[iseg]
+                                       : packed.seg_index_16(link.iray)[iseg];
+        };
+
+        // Find the 2-D segment that we are in, in the order that the ray is
+        // swept
+        real_t x = link.forward ? s - base : len_ray - (s - base);
+        int iseg = link.forward ? std::upper_bound(end, end + nseg, x) - end
+                                : std::lower_bound(end, end + nseg, x) - end;
+        iseg     = std::min(iseg, nseg - 1);
+
+        bool done       = false;
+        bool next_link  = false;
+        bool next_plane = false;
+        while (true) {
+            x             = link.forward ? s - base : len_ray - (s - base);
+            real_t d_link = base + len_ray - s;
+            real_t d_end  = s_end - s;
+            real_t d_plane =
+                (k < n_plane - 1) ? (bound(k + 1) - zeta(s)) / track.cot
+                                  : std::numeric_limits<real_t>::max();
+            bool last = link.forward ? (iseg == nseg - 1) : (iseg == 0);
+            real_t d_seg = d_link;
+            if (!last) {
+                d_seg = link.forward ? end[iseg] - x : x - end[iseg - 1];
+            }
+
+            real_t d = std::min(std::min(d_seg, d_link),
+                                std::min(d_plane, d_end));
+            if (d > 0.0) {
+                segments.push_back({first_reg + region(iseg),
+                                    d * track.rsin, wt[il]});
+                s += d;
+            }
+
+            done       = d_end - d <= event_tol;
+            next_link  = d_link - d <= event_tol;
+            next_plane = d_plane - d <= event_tol;
+            if (done || next_link || next_plane) {
+                break;
+            }
+            iseg += link.forward ? 1 : -1;
+        }
+
+        if (done) {
+            break;
+        }
+        if (next_plane) {
+            k++;
+        }
+        if (next_link) {
+            base += len_ray;
+            il++;
+            if (il == track.n_links) {
+                if (!track.cyclic) {
+                    break;
+                }
+                il = 0;
+            }
+        }
+    }
+
+    return on_surface;
+}
+
+void AxialTracks::incoming(const real_t *out, real_t *in) const
+{
+#pragma omp parallel for schedule(dynamic)
+    for (int it = 0; it < (int)tracks_.size(); it++) {
+        const Track &track = tracks_[it];
+        for (bool falling : {false, true}) {
+            // Lines enter through the bottom when rising, and through the
+            // top when falling, where the lines of the other family leave
+            Surface surf   = falling ? Surface::TOP : Surface::BOTTOM;
+            bool reflect   = bc_[surf] == Boundary::REFLECT;
+            const real_t *o = out + this->first_line(it, !falling);
+            real_t *i       = in + this->first_line(it, falling);
+            for (int j = track.j_min; j < track.n_b; j++) {
+                i[j - track.j_min] =
+                    (reflect && (j >= 0))
+                        ? this->interpolate(track, o, j - track.shift)
+                        : 0.0;
+            }
+        }
+    }
+    return;
+}
+
+real_t AxialTracks::interpolate(const Track &track, const real_t *out,
+                                real_t x) const
+{
+    if (track.cyclic) {
+        x = std::fmod(x, (real_t)track.n_b);
+        if (x < 0.0) {
+            x += track.n_b;
+        }
+        int k0   = std::min((int)x, track.n_b - 1);
+        int k1   = (k0 + 1) % track.n_b;
+        real_t f = x - k0;
+        return (1.0 - f) * out[k0] + f * out[k1];
+    }
+
+    // Only the lines up to j_far reach the top or bottom
+    if (track.j_far < track.j_min) {
+        return 0.0;
+    }
+    x        = std::min(std::max(x, (real_t)track.j_min), (real_t)track.j_far);
+    int k0   = std::min((int)std::floor(x), track.j_far);
+    int k1   = std::min(k0 + 1, track.j_far);
+    real_t f = x - k0;
+    return (1.0 - f) * out[k0 - track.j_min] + f * out[k1 - track.j_min];
+}
+
+size_t AxialTracks::memory() const
+{
+    size_t n = bytes(plane_ids_) + bytes(first_reg_) + bytes(z_) +
+               bytes(tracks_) + bytes(link_pos_) + bytes(link_wt_);
+    for (const auto &plane_end : seg_end_) {
+        for (const auto &end : plane_end) {
+            n += bytes(end);
+        }
+    }
+    return n;
+}
+}
+}
@@ -0,0 +1,218 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <array>
+#include <vector>
+#include "util/global_config.hpp"
+#include "core/constants.hpp"
+#include "cyclic_tracks.hpp"
+#include "ray_data.hpp"
+
+namespace mocc {
+namespace moc {
+/**
+ * \brief A 3-D characteristic segment, as produced by \ref
+ * AxialTracks::trace()
+ */
+struct AxialSegment {
+    // Region index, including the offset of its macroplane
+    int reg;
+    // 3-D length of the segment
+    real_t len;
+    // Flux tally weight of the ray that the segment lies on
+    real_t wt;
+};
+
+/**
+ * \brief 3-D characteristics laid over the 2-D tracks of a \ref CyclicTracks,
+ * generated on the fly
+ *
+ * Every 3-D characteristic lies in the vertical plane of a 2-D track, and is
+ * a straight line in the (s, z) coordinates of that plane, where s is the
+ * distance along the track. For the polar angle \f$\theta\f$ of the track's
+ * rays, the lines rise (or fall) by \f$\cot\theta\f$ per unit of s. Sampling
+ * the lines evenly along the bottom (or top) of the domain, with a spacing of
+ * \f$\delta s\f$ in s, spaces them \f$\delta z = \delta s \cot\theta\f$ apart
+ * vertically, which is chosen to be as close as possible to the requested
+ * axial ray spacing while fitting a whole number of lines along the track.
+ *
+ * Only the 2-D rays and the heights of the macroplanes are stored. The
+ * segments of a line are found as it is swept, by following it along the
+ * track and looking up the 2-D segment of the current macroplane's ray at
+ * each position. The 3-D segments end wherever the 2-D segments, the rays of
+ * the track, or the macroplanes do. This costs a binary search into the 2-D
+ * segments when a line enters a new ray or macroplane, but avoids storing the
+ * explicit 3-D segments, of which there are many more than 2-D ones.
+ *
+ * The lines of each track come in two families, rising and falling. Each
+ * line is swept once, from its entry surface (bottom for rising lines, top
+ * for falling ones) to the other; the reverse directions come from the track
+ * that runs the other way. On closed tracks, the lines wrap around the track
+ * as often as needed to span the height of the domain. On open tracks, some
+ * lines start or end on the radial boundary, where they may only see vacuum.
+ * The rising and falling lines of a track hand their angular flux to each
+ * other through reflective top and bottom boundaries. Their ends do not
+ * generally line up, so the incoming flux is interpolated linearly, along
+ * the track, from the outgoing flux of the other family.
+ *
+ * Lines are numbered consecutively over all tracks, with the rising lines of
+ * each track followed by its falling ones.
+ */
+class AxialTracks {
+public:
+    AxialTracks()
+    {
+        return;
+    }
+
+    /**
+     * \brief Lay out the 3-D characteristics
+     *
+     * \param rays the 2-D rays
+     * \param tracks the tracks, made from \p rays
+     * \param bc the boundary conditions of the domain
+     * \param plane_ids the plane geometry ID of each macroplane, bottom to
+     * top
+     * \param heights the height of each macroplane
+     * \param first_reg the first region index of each macroplane
+     * \param spacing the desired axial ray spacing
+     */
+    AxialTracks(const RayData &rays, const CyclicTracks &tracks,
+                const std::array<Boundary, 6> &bc, const VecI &plane_ids,
+                const VecF &heights, const VecI &first_reg, real_t spacing);
+
+    /**
+     * \brief Return the number of tracks
+     */
+    int n_tracks() const
+    {
+        return tracks_.size();
+    }
+
+    /**
+     * \brief Return the number of lines of each family on a track
+     */
+    int n_lines(int itrack) const
+    {
+        return tracks_[itrack].n_b - tracks_[itrack].j_min;
+    }
+
+    /**
+     * \brief Return the total number of lines
+     */
+    int n_lines() const
+    {
+        return n_lines_;
+    }
+
+    /**
+     * \brief Return the index of the first line of a family on a track
+     */
+    int first_line(int itrack, bool falling) const
+    {
+        return tracks_[itrack].first_line +
+               (falling ? this->n_lines(itrack) : 0);
+    }
+
+    /**
+     * \brief Generate the segments of a line
+     *
+     * \param itrack the track
+     * \param iline the line within its family, from zero to \ref n_lines()
+     * \param falling the family of the line
+     * \param segments the segments of the line, in sweep order
+     *
+     * \returns whether the line ends on the top or bottom boundary, rather
+     * than on the radial boundary
+     */
+    bool trace(int itrack, int iline, bool falling,
+               std::vector<AxialSegment> &segments) const;
+
+    /**
+     * \brief Find the incoming angular flux of every line from the outgoing
+     * flux of the last sweep
+     *
+     * \param out the outgoing flux of each line, at its far end
+     * \param in the incoming flux of each line, at its entry end
+     */
+    void incoming(const real_t *out, real_t *in) const;
+
+    /**
+     * \brief Return the number of bytes used to store the axial data
+     */
+    size_t memory() const;
+
+private:
+    struct Track {
+        // Track of the CyclicTracks
+        int itrack;
+        bool cyclic;
+        // Length of the track
+        real_t length;
+        // Spacing of the lines along the track, in units of s
+        real_t ds;
+        // Shift in s from the entry end of a line to its far end, in units
+        // of ds
+        real_t shift;
+        real_t cot;
+        real_t rsin;
+        // Lines of each family are numbered from j_min to n_b - 1. Line j
+        // enters at s = (j + 1/2) ds, which is negative for lines that enter
+        // through the start of an open track. Lines up to j_far end on the
+        // top or bottom, and the rest on the end of an open track.
+        int j_min;
+        int j_far;
+        int n_b;
+        // Index of the first line of the track
+        int first_line;
+        // First entry of the track in link_pos_ and link_wt_
+        int first_link;
+        int n_links;
+    };
+
+    /**
+     * \brief Interpolate the outgoing flux of the lines of a family at a
+     * fractional line index
+     */
+    real_t interpolate(const Track &track, const real_t *out, real_t x) const;
+
+    const RayData *rays_;
+    const CyclicTracks *cyclic_;
+
+    VecI plane_ids_;
+    VecI first_reg_;
+
+    // Axial bounds of the macroplanes, bottom to top
+    VecF z_;
+
+    std::array<Boundary, 6> bc_;
+
+    std::vector<Track> tracks_;
+    int n_lines_;
+
+    // Start of each link (ray) along its track, and the flux tally weight
+    // of each. Each track has one extra entry, for the end of its last link.
+    VecF link_pos_;
+    VecF link_wt_;
+
+    // Position of the end of every 2-D segment along its ray, indexed by
+    // plane geometry ID, then angle, in the same layout as the PackedRays
+    std::vector<std::vector<std::vector<float>>> seg_end_;
+};
+}
+}
@@ -0,0 +1,203 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "cyclic_tracks.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include "util/memory.hpp"
+
+namespace mocc {
+namespace moc {
+CyclicTracks::CyclicTracks(const RayData &rays,
+                           const std::array<Boundary, 6> &bc)
+{
+    const AngularQuadrature &ang_quad = rays.ang_quad();
+    const int n_bc_ang                = 4 * ang_quad.ndir_oct();
+
+    // Index of the angle that the rays of each boundary angle are stored
+    // under, and the angles that each is rotated onto, if needed
+    auto sweep_angle = [&](int iang) {
+        return iang < n_bc_ang / 2 ? iang : (int)ang_quad.reverse(iang);
+    };
+    VecI rotate_cw(n_bc_ang, -1);
+    VecI rotate_ccw(n_bc_ang, -1);
+    if (bc[(int)Surface::WEST] == Boundary::ROTATE) {
+        for (int iang = 0; iang < n_bc_ang; iang++) {
+            rotate_cw[iang]  = ang_quad.rotate(iang, true);
+            rotate_ccw[iang] = ang_quad.rotate(iang, false);
+        }
+    }
+
+    // Offset of each boundary angle into a flat array of boundary values,
+    // laid out as in the BoundaryCondition
+    VecI bc_offset(n_bc_ang + 1, 0);
+    for (int iang = 0; iang < n_bc_ang; iang++) {
+        int is              = sweep_angle(iang);
+        bc_offset[iang + 1] = bc_offset[iang] + rays.nx(is) + rays.ny(is);
+    }
+
+    for (const auto &plane_rays : rays) {
+        const int n_ang = plane_rays.size();
+
+        // Directed rays are numbered 2 * ray + dir, where the rays are
+        // numbered consecutively over all angles and dir is 0 for forward
+        VecI ray_offset(n_ang + 1, 0);
+        for (int iang = 0; iang < n_ang; iang++) {
+            ray_offset[iang + 1] = ray_offset[iang] + plane_rays[iang].size();
+        }
+        const int n_dir = 2 * ray_offset.back();
+
+        std::vector<TrackLink> dir_links(n_dir);
+        VecI entry(bc_offset.back(), -1);
+        for (int iang = 0; iang < n_ang; iang++) {
+            int iang_rev = ang_quad.reverse(iang);
+            for (int iray = 0; iray < (int)plane_rays[iang].size(); iray++) {
+                const auto &ray   = plane_rays[iang][iray];
+                int id            = 2 * (ray_offset[iang] + iray);
+                dir_links[id]     = {iang, iray, true};
+                dir_links[id + 1] = {iang, iray, false};
+
+                entry[bc_offset[iang] + ray.bc(0)]     = id;
+                entry[bc_offset[iang_rev] + ray.bc(1)] = id + 1;
+            }
+        }
+
+        // Find the directed ray that picks up where each one leaves off, or
+        // -1 if it leaves the domain
+        auto follow = [&](int iang, int ibc) {
+            const Angle &ang = ang_quad[iang];
+            int ny           = rays.ny(sweep_angle(iang));
+            Normal norm      = (ibc < ny) ? Normal::X_NORM : Normal::Y_NORM;
+            int pos          = (ibc < ny) ? ibc : ibc - ny;
+            Surface exit;
+            if (norm == Normal::X_NORM) {
+                exit = (ang.ox > 0.0) ? Surface::EAST : Surface::WEST;
+            } else {
+                exit = (ang.oy > 0.0) ? Surface::NORTH : Surface::SOUTH;
+            }
+
+            int iang_in = -1;
+            int ibc_in  = -1;
+            switch (bc[(int)exit]) {
+            case Boundary::REFLECT:
+                iang_in = ang_quad.reflect(iang, norm);
+                ibc_in  = (norm == Normal::X_NORM)
+                             ? pos
+                             : rays.ny(sweep_angle(iang_in)) + pos;
+                break;
+            case Boundary::ROTATE:
+                if (exit == Surface::WEST) {
+                    iang_in = rotate_cw[iang];
+                    if (iang_in >= 0) {
+                        ibc_in = rays.ny(sweep_angle(iang_in)) + pos;
+                    }
+                } else {
+                    iang_in = rotate_ccw[iang];
+                    ibc_in  = pos;
+                }
+                break;
+            default:
+                break;
+            }
+            if (iang_in < 0) {
+                return -1;
+            }
+            return entry[bc_offset[iang_in] + ibc_in];
+        };
+
+        VecI next(n_dir, -1);
+        std::vector<bool> has_prev(n_dir, false);
+        for (int id = 0; id < n_dir; id++) {
+            const auto &link = dir_links[id];
+            const auto &ray  = plane_rays[link.iang][link.iray];
+
+            int iang = link.forward ? link.iang : ang_quad.reverse(link.iang);
+            next[id] = follow(iang, link.forward ? ray.bc(1) : ray.bc(0));
+            if (next[id] >= 0) {
+                has_prev[next[id]] = true;
+            }
+        }
+
+        // Walk the open tracks first, starting from the directed rays that
+        // nothing leads into. Whatever is left over lies on closed tracks.
+        std::vector<std::vector<TrackLink>> tracks;
+        VecI track_seg;
+        std::vector<bool> visited(n_dir, false);
+        auto walk = [&](int id) {
+            std::vector<TrackLink> track;
+            int n_seg = 0;
+            while ((id >= 0) && !visited[id]) {
+                const auto &link = dir_links[id];
+                track.push_back(link);
+                n_seg += plane_rays[link.iang][link.iray].nseg();
+                visited[id] = true;
+                id          = next[id];
+            }
+            tracks.push_back(track);
+            track_seg.push_back(n_seg);
+        };
+        for (int id = 0; id < n_dir; id++) {
+            if (!has_prev[id]) {
+                walk(id);
+            }
+        }
+        int n_open = tracks.size();
+        for (int id = 0; id < n_dir; id++) {
+            if (!visited[id]) {
+                walk(id);
+            }
+        }
+        n_cyclic_.push_back(tracks.size() - n_open);
+
+        // Order the tracks longest-first
+        VecI order(tracks.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](int l, int r) {
+            return track_seg[l] > track_seg[r];
+        });
+
+        std::vector<TrackLink> links;
+        links.reserve(n_dir);
+        VecI offset(1, 0);
+        VecI n_seg;
+        std::vector<bool> closed;
+        for (int it : order) {
+            links.insert(links.end(), tracks[it].begin(), tracks[it].end());
+            offset.push_back(links.size());
+            n_seg.push_back(track_seg[it]);
+            closed.push_back(it >= n_open);
+        }
+        links_.push_back(links);
+        closed_.push_back(closed);
+        offset_.push_back(offset);
+        n_seg_.push_back(n_seg);
+    }
+
+    return;
+}
+
+size_t CyclicTracks::memory() const
+{
+    size_t n = bytes(n_cyclic_);
+    for (unsigned iplane = 0; iplane < links_.size(); iplane++) {
+        n += bytes(links_[iplane]) + bytes(offset_[iplane]) +
+             bytes(n_seg_[iplane]) + closed_[iplane].size() / 8;
+    }
+    return n;
+}
+}
+}
@@ -0,0 +1,145 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <array>
+#include <vector>
+#include "util/global_config.hpp"
+#include "core/constants.hpp"
+#include "ray_data.hpp"
+
+namespace mocc {
+namespace moc {
+/**
+ * \brief A single ray, swept in one direction, as part of a track
+ */
+struct TrackLink {
+    // Angle index of the ray, in octants 1 and 2
+    int iang;
+    // Index of the ray within its angle
+    int iray;
+    // Whether the ray is swept forward (in the direction of iang) or
+    // backward (in the direction of its reverse)
+    bool forward;
+};
+
+/**
+ * \brief Rays of each plane, linked end-to-end into tracks across the
+ * boundaries of the domain
+ *
+ * With modular ray tracing, the end of every ray lies at the same point on
+ * the domain boundary as the start of one of the rays of the reflected angle
+ * (or the rotated angle, for \ref Boundary::ROTATE). Following those links
+ * strings the rays together into tracks, which close on themselves if all of
+ * the boundaries that they touch pass the flux along. Tracks that reach a
+ * boundary which does not (e.g. vacuum) are open, and run from one such
+ * boundary to another.
+ *
+ * Sweeping a whole track at a time carries the angular flux directly from
+ * the end of one ray into the start of the next, so only the first ray of
+ * each track has to start from a boundary value left over from the previous
+ * sweep.
+ *
+ * The tracks of each plane are ordered by decreasing number of segments, so
+ * that they may be handed out dynamically to threads with the long ones
+ * going first.
+ */
+class CyclicTracks {
+public:
+    CyclicTracks()
+    {
+        return;
+    }
+
+    /**
+     * \brief Link the rays of all planes of the passed \ref RayData into
+     * tracks, using the radial boundary conditions in \p bc
+     */
+    CyclicTracks(const RayData &rays, const std::array<Boundary, 6> &bc);
+
+    /**
+     * \brief Return the number of tracks in the plane with geometry \p
+     * plane_id
+     */
+    int n_tracks(int plane_id) const
+    {
+        return offset_[plane_id].size() - 1;
+    }
+
+    /**
+     * \brief Return a pointer to the first link of a track
+     */
+    const TrackLink *links(int plane_id, int itrack) const
+    {
+        return &links_[plane_id][offset_[plane_id][itrack]];
+    }
+
+    /**
+     * \brief Return the number of links (rays) in a track
+     */
+    int n_links(int plane_id, int itrack) const
+    {
+        return offset_[plane_id][itrack + 1] - offset_[plane_id][itrack];
+    }
+
+    /**
+     * \brief Return the number of segments in a track
+     */
+    int n_seg(int plane_id, int itrack) const
+    {
+        return n_seg_[plane_id][itrack];
+    }
+
+    /**
+     * \brief Return the number of tracks in the plane with geometry \p
+     * plane_id that close on themselves
+     */
+    int n_cyclic(int plane_id) const
+    {
+        return n_cyclic_[plane_id];
+    }
+
+    /**
+     * \brief Return whether a track closes on itself
+     */
+    bool closed(int plane_id, int itrack) const
+    {
+        return closed_[plane_id][itrack];
+    }
+
+    /**
+     * \brief Return the number of bytes used to store the tracks
+     */
+    size_t memory() const;
+
+private:
+    // Links of all tracks, indexed by plane, then link. The links of track
+    // i are in [offset_[plane][i], offset_[plane][i+1]).
+    std::vector<std::vector<TrackLink>> links_;
+    std::vector<VecI> offset_;
+
+    // Number of segments on each track, indexed by plane, then track
+    std::vector<VecI> n_seg_;
+
+    // Number of closed tracks in each plane
+    VecI n_cyclic_;
+
+    // Whether each track is closed, indexed by plane, then track
+    std::vector<std::vector<bool>> closed_;
+};
+}
+}
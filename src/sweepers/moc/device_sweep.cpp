@@ -0,0 +1,258 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include "device_sweep.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include "util/files.hpp"
+#include "core/constants.hpp"
+
+namespace mocc {
+namespace moc {
+DeviceSweep::DeviceSweep(const RayData &rays,
+                         const AngularQuadrature &ang_quad,
+                         const CoreMesh &mesh, const VecI &macroplane_ids,
+                         const VecI &first_reg, int n_reg,
+                         const BoundaryCondition &bc)
+    : n_reg_(n_reg),
+      n_ang_(0),
+      n_plane_(macroplane_ids.size()),
+      n_bc_plane_(bc.size_per_group()),
+      first_reg_(first_reg.begin(), first_reg.end()),
+      xstr_(n_reg, 0.0),
+      qbar_(n_reg, 0.0),
+      bc_in_(n_plane_ * n_bc_plane_, 0.0),
+      bc_out_(n_plane_ * n_bc_plane_, 0.0),
+      tally_(n_reg, 0.0)
+{
+    int n_unique = std::distance(rays.begin(), rays.end());
+    n_ang_       = rays[0].size();
+
+    // Flatten the rays of each unique plane, remembering where the rays of
+    // each angle start
+    std::vector<std::vector<int>> first_ray(n_unique, std::vector<int>(n_ang_));
+    ray_seg_.push_back(0);
+    for (int iplane = 0; iplane < n_unique; iplane++) {
+        for (int iang = 0; iang < n_ang_; iang++) {
+            first_ray[iplane][iang] = ray_bc_.size() / 2;
+            for (const auto &ray : rays[iplane][iang]) {
+                for (int iseg = 0; iseg < ray.nseg(); iseg++) {
+                    seg_len_.push_back(ray.seg_len(iseg));
+                    seg_reg_.push_back(ray.seg_index(iseg));
+                }
+                ray_seg_.push_back(seg_len_.size());
+                ray_bc_.push_back(ray.bc(0));
+                ray_bc_.push_back(ray.bc(1));
+            }
+        }
+    }
+    n_seg_ = seg_len_.size();
+
+    // Work items for every ray of every angle in every macroplane
+    for (int iplane = 0; iplane < n_plane_; iplane++) {
+        int plane_id = macroplane_ids[iplane];
+        for (int iang = 0; iang < n_ang_; iang++) {
+            int n_rays = rays[plane_id][iang].size();
+            for (int iray = 0; iray < n_rays; iray++) {
+                item_plane_.push_back(iplane);
+                item_ang_.push_back(iang);
+                item_ray_.push_back(first_ray[plane_id][iang] + iray);
+            }
+        }
+    }
+    n_item_ = item_plane_.size();
+
+    // Angle data and tally weights, as in MoCSweeper::sweep1g()
+    const real_t *bc_base = bc.get_boundary(0, 0).second;
+    for (int iang = 0; iang < n_ang_; iang++) {
+        const Angle &ang = ang_quad[iang];
+        int iang_rev     = ang_quad.reverse(iang);
+        rsintheta_.push_back(ang.rsintheta);
+        reverse_.push_back(iang_rev);
+        bc_offset_.push_back(bc.get_boundary(0, iang).second - bc_base);
+    }
+    // Offsets of the reverse angles go after the forward ones
+    for (int iang = 0; iang < n_ang_; iang++) {
+        bc_offset_.push_back(
+            bc.get_boundary(0, reverse_[iang]).second - bc_base);
+    }
+    weight_.resize(n_plane_ * n_ang_);
+    for (int iplane = 0; iplane < n_plane_; iplane++) {
+        for (int iang = 0; iang < n_ang_; iang++) {
+            const Angle &ang = ang_quad[iang];
+            weight_[iplane * n_ang_ + iang] =
+                ang.weight * rays.spacing(iang) *
+                mesh.macroplanes()[iplane].height * std::sin(ang.theta) * PI;
+        }
+    }
+
+    LogFile << "Mapping " << n_seg_ << " segments of " << ray_bc_.size() / 2
+            << " rays to the device" << std::endl;
+
+    // Map everything to the device. The ray data only ever go one way; the
+    // per-sweep buffers are just allocated, and updated by sweep().
+    const float *seg_len    = seg_len_.data();
+    const int *seg_reg      = seg_reg_.data();
+    const int64_t *ray_seg  = ray_seg_.data();
+    const int *ray_bc       = ray_bc_.data();
+    const int *item_plane   = item_plane_.data();
+    const int *item_ang     = item_ang_.data();
+    const int *item_ray     = item_ray_.data();
+    const int *first        = first_reg_.data();
+    const real_t *weight    = weight_.data();
+    const real_t *rsintheta = rsintheta_.data();
+    const int *bc_offset    = bc_offset_.data();
+    real_t *xstr            = xstr_.data();
+    real_t *qbar            = qbar_.data();
+    real_t *bc_in           = bc_in_.data();
+    real_t *bc_out          = bc_out_.data();
+    real_t *tally           = tally_.data();
+    int n_ray               = ray_bc_.size() / 2;
+    int n_bc                = bc_in_.size();
+    int n_w                 = weight_.size();
+#pragma omp target enter data map(to: seg_len[0:n_seg_], seg_reg[0:n_seg_], \
+    ray_seg[0:n_ray + 1], ray_bc[0:2 * n_ray], item_plane[0:n_item_],       \
+    item_ang[0:n_item_], item_ray[0:n_item_], first[0:n_plane_],            \
+    weight[0:n_w], rsintheta[0:n_ang_], bc_offset[0:2 * n_ang_])            \
+    map(alloc: xstr[0:n_reg_], qbar[0:n_reg_], bc_in[0:n_bc],              \
+        bc_out[0:n_bc], tally[0:n_reg_])
+
+    return;
+}
+
+DeviceSweep::~DeviceSweep()
+{
+    const float *seg_len    = seg_len_.data();
+    const int *seg_reg      = seg_reg_.data();
+    const int64_t *ray_seg  = ray_seg_.data();
+    const int *ray_bc       = ray_bc_.data();
+    const int *item_plane   = item_plane_.data();
+    const int *item_ang     = item_ang_.data();
+    const int *item_ray     = item_ray_.data();
+    const int *first        = first_reg_.data();
+    const real_t *weight    = weight_.data();
+    const real_t *rsintheta = rsintheta_.data();
+    const int *bc_offset    = bc_offset_.data();
+    real_t *xstr            = xstr_.data();
+    real_t *qbar            = qbar_.data();
+    real_t *bc_in           = bc_in_.data();
+    real_t *bc_out          = bc_out_.data();
+    real_t *tally           = tally_.data();
+    int n_ray               = ray_bc_.size() / 2;
+    int n_bc                = bc_in_.size();
+    int n_w                 = weight_.size();
+#pragma omp target exit data map(delete: seg_len[0:n_seg_],                  \
+    seg_reg[0:n_seg_], ray_seg[0:n_ray + 1], ray_bc[0:2 * n_ray],           \
+    item_plane[0:n_item_], item_ang[0:n_item_], item_ray[0:n_item_],        \
+    first[0:n_plane_], weight[0:n_w], rsintheta[0:n_ang_],                  \
+    bc_offset[0:2 * n_ang_], xstr[0:n_reg_], qbar[0:n_reg_], bc_in[0:n_bc], \
+    bc_out[0:n_bc], tally[0:n_reg_])
+
+    return;
+}
+
+void DeviceSweep::sweep(const real_t *xs_in, const real_t *q_in,
+                        const real_t *bc_in_host, real_t *bc_out_host,
+                        real_t *tally_host)
+{
+    const int n_reg  = n_reg_;
+    const int n_ang  = n_ang_;
+    const int n_item = n_item_;
+    const int n_bcp  = n_bc_plane_;
+    const int n_bc   = bc_in_.size();
+
+    std::copy(xs_in, xs_in + n_reg, xstr_.begin());
+    std::copy(q_in, q_in + n_reg, qbar_.begin());
+    std::copy(bc_in_host, bc_in_host + n_bc, bc_in_.begin());
+
+    const float *seg_len    = seg_len_.data();
+    const int *seg_reg      = seg_reg_.data();
+    const int64_t *ray_seg  = ray_seg_.data();
+    const int *ray_bc       = ray_bc_.data();
+    const int *item_plane   = item_plane_.data();
+    const int *item_ang     = item_ang_.data();
+    const int *item_ray     = item_ray_.data();
+    const int *first        = first_reg_.data();
+    const real_t *weight    = weight_.data();
+    const real_t *rsintheta = rsintheta_.data();
+    const int *bc_offset    = bc_offset_.data();
+    real_t *xstr            = xstr_.data();
+    real_t *qbar            = qbar_.data();
+    real_t *bc_in           = bc_in_.data();
+    real_t *bc_out          = bc_out_.data();
+    real_t *tally           = tally_.data();
+
+#pragma omp target update to(xstr[0:n_reg], qbar[0:n_reg], bc_in[0:n_bc])
+
+#pragma omp target teams distribute parallel for
+    for (int i = 0; i < n_reg; i++) {
+        tally[i] = 0.0;
+    }
+
+    // The exponentials are evaluated again for the backward direction, since
+    // there is no per-ray scratch storage on the device
+#pragma omp target teams distribute parallel for
+    for (int w = 0; w < n_item; w++) {
+        int iplane   = item_plane[w];
+        int iang     = item_ang[w];
+        int iray     = item_ray[w];
+        int reg0     = first[iplane];
+        real_t wt    = weight[iplane * n_ang + iang];
+        real_t rst   = rsintheta[iang];
+        int bc_plane = iplane * n_bcp;
+        int bc_fw    = bc_plane + bc_offset[iang];
+        int bc_bw    = bc_plane + bc_offset[n_ang + iang];
+        int bc1      = ray_bc[2 * iray];
+        int bc2      = ray_bc[2 * iray + 1];
+        int64_t s0   = ray_seg[iray];
+        int64_t s1   = ray_seg[iray + 1];
+
+        // Forward direction
+        real_t psi = bc_in[bc_fw + bc1];
+        for (int64_t is = s0; is < s1; is++) {
+            int ireg        = reg0 + seg_reg[is];
+            real_t e        = 1.0 - std::exp(-xstr[ireg] * seg_len[is] * rst);
+            real_t psi_diff = (psi - qbar[ireg]) * e;
+            psi -= psi_diff;
+#pragma omp atomic
+            tally[ireg] += psi_diff * wt;
+        }
+        bc_out[bc_fw + bc2] = psi;
+
+        // Backward direction
+        psi = bc_in[bc_bw + bc2];
+        for (int64_t is = s1 - 1; is >= s0; is--) {
+            int ireg        = reg0 + seg_reg[is];
+            real_t e        = 1.0 - std::exp(-xstr[ireg] * seg_len[is] * rst);
+            real_t psi_diff = (psi - qbar[ireg]) * e;
+            psi -= psi_diff;
+#pragma omp atomic
+            tally[ireg] += psi_diff * wt;
+        }
+        bc_out[bc_bw + bc1] = psi;
+    }
+
+#pragma omp target update from(tally[0:n_reg], bc_out[0:n_bc])
+
+    std::copy(tally_.begin(), tally_.end(), tally_host);
+    std::copy(bc_out_.begin(), bc_out_.end(), bc_out_host);
+
+    return;
+}
+}
+}
@@ -0,0 +1,138 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "util/global_config.hpp"
+#include "core/angular_quadrature.hpp"
+#include "core/boundary_condition.hpp"
+#include "core/core_mesh.hpp"
+#include "ray_data.hpp"
+
+namespace mocc {
+namespace moc {
+/**
+ * \brief Device-resident ray data and a one-group MoC sweep kernel, using
+ * OpenMP target offload
+ *
+ * The rays of every geometrically-unique plane are flattened into plain
+ * arrays of segment lengths and region indices, along with a list of work
+ * items, one for each ray of each angle in each macroplane. These are mapped
+ * to the device once, on construction, and stay there until the \ref
+ * DeviceSweep is destroyed, so that a sweep only moves the data that change
+ * between sweeps: the cross sections and source (one value per region), the
+ * boundary conditions of one group, and the scalar flux tallies.
+ *
+ * Each work item sweeps one ray in both directions. Since work items of all
+ * angles and planes run at once, the boundary conditions are updated in a
+ * Jacobi fashion, after the sweep. Currents are not computed on the device.
+ */
+class DeviceSweep {
+public:
+    /**
+     * \param rays the \ref RayData to flatten. Modular ray storage is
+     * expanded.
+     * \param ang_quad the angular quadrature of the sweeper
+     * \param mesh the \ref CoreMesh being swept
+     * \param macroplane_ids the unique plane ID of each macroplane
+     * \param first_reg the first region index of each macroplane
+     * \param n_reg the total number of regions
+     * \param bc a boundary condition of the same shape as those of each
+     * macroplane, used to find the layout of the boundary values
+     */
+    DeviceSweep(const RayData &rays, const AngularQuadrature &ang_quad,
+                const CoreMesh &mesh, const VecI &macroplane_ids,
+                const VecI &first_reg, int n_reg,
+                const BoundaryCondition &bc);
+
+    ~DeviceSweep();
+
+    DeviceSweep(const DeviceSweep &) = delete;
+    DeviceSweep &operator=(const DeviceSweep &) = delete;
+
+    /**
+     * \brief Return the number of boundary values for one group of one
+     * macroplane
+     */
+    int n_bc_plane() const
+    {
+        return n_bc_plane_;
+    }
+
+    /**
+     * \brief Sweep all rays once for a single group
+     *
+     * \param xstr the transport cross section of each region
+     * \param qbar the transport source of each region
+     * \param bc_in the incoming boundary values of the group, for all
+     * macroplanes, in order, each with \ref n_bc_plane() values
+     * \param bc_out the outgoing boundary values, in the same layout as \p
+     * bc_in
+     * \param tally the weighted sum of angular flux differences in each
+     * region, as accumulated into the thread flux by \ref
+     * MoCSweeper::sweep1g()
+     */
+    void sweep(const real_t *xstr, const real_t *qbar, const real_t *bc_in,
+               real_t *bc_out, real_t *tally);
+
+private:
+    int n_reg_;
+    int n_ang_;
+    int n_plane_;
+    int n_bc_plane_;
+    int n_item_;
+    size_t n_seg_;
+
+    // Segment data for the rays of all unique planes
+    std::vector<float> seg_len_;
+    std::vector<int> seg_reg_;
+
+    // First segment of each ray, with an extra entry at the end
+    std::vector<int64_t> ray_seg_;
+
+    // Boundary condition indices of each ray, in (forward, backward) pairs
+    std::vector<int> ray_bc_;
+
+    // Macroplane, angle and ray of each work item
+    std::vector<int> item_plane_;
+    std::vector<int> item_ang_;
+    std::vector<int> item_ray_;
+
+    // First region of each macroplane
+    std::vector<int> first_reg_;
+
+    // Tally weight for each macroplane and angle, indexed [plane * n_ang +
+    // iang]
+    std::vector<real_t> weight_;
+
+    // Reciprocal sine of the polar angle, reverse angle and boundary value
+    // offset of each angle
+    std::vector<real_t> rsintheta_;
+    std::vector<int> reverse_;
+    std::vector<int> bc_offset_;
+
+    // Per-sweep buffers, also kept on the device
+    std::vector<real_t> xstr_;
+    std::vector<real_t> qbar_;
+    std::vector<real_t> bc_in_;
+    std::vector<real_t> bc_out_;
+    std::vector<real_t> tally_;
+};
+}
+}
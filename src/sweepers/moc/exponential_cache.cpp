@@ -0,0 +1,74 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include "exponential_cache.hpp"
+
+#include <algorithm>
+#include "util/files.hpp"
+
+namespace mocc {
+namespace moc {
+void ExponentialCache::configure(size_t budget, const RayData &rays,
+                                 const VecI &macroplane_ids, int n_group,
+                                 bool single)
+{
+    data_.clear();
+    data_single_.clear();
+    offset_.clear();
+    state_    = VecI(n_group, -1);
+    n_cached_ = 0;
+
+    if (budget == 0) {
+        return;
+    }
+
+    size_t n_seg = 0;
+    offset_.reserve(macroplane_ids.size());
+    for (const auto plane_id : macroplane_ids) {
+        std::vector<size_t> plane_offset;
+        for (const auto &packed : rays.packed(plane_id)) {
+            plane_offset.push_back(n_seg);
+            // The offsets table has an extra entry at the end
+            n_seg += packed.seg_offset(packed.n_rays());
+        }
+        offset_.push_back(plane_offset);
+    }
+
+    size_t group_size = n_seg * (single ? sizeof(float) : sizeof(real_t));
+    n_cached_         = std::min<size_t>(n_group, budget / group_size);
+
+    if (single) {
+        data_single_.resize(n_group);
+        for (int ig = 0; ig < n_cached_; ig++) {
+            data_single_[ig].resize(n_seg);
+        }
+    } else {
+        data_.resize(n_group);
+        for (int ig = 0; ig < n_cached_; ig++) {
+            data_[ig].resize(n_seg);
+        }
+    }
+
+    LogFile << "Caching " << (single ? "single" : "double")
+            << "-precision segment exponentials for " << n_cached_ << " of "
+            << n_group << " groups (" << group_size * n_cached_ << " bytes)"
+            << std::endl;
+
+    return;
+}
+}
+}
@@ -0,0 +1,148 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#pragma once
+
+#include <vector>
+#include "util/global_config.hpp"
+#include "ray_data.hpp"
+
+namespace mocc {
+namespace moc {
+/**
+ * \brief Storage for the segment exponentials, 1 - exp(-tau), of an MoC sweep
+ *
+ * The exponentials along each ray only change when the cross sections do, so
+ * when several inner iterations are performed for each group, computing them
+ * again for every sweep is repeated work. The \ref ExponentialCache stores the
+ * exponentials for every segment of every macroplane and angle, for as many
+ * groups as fit in a memory budget. Groups that do not fit are left to be
+ * computed on the fly by the sweeper.
+ *
+ * Each cached group is tagged with the state of the \ref XSMesh that it was
+ * filled with, so that it is refilled when the cross sections are updated.
+ * The cache is laid out by macroplane, then angle, then ray, with each ray
+ * stored at the same offset as in the corresponding \ref PackedRays.
+ *
+ * The exponentials may be stored in single precision, for use by the
+ * mixed-precision sweep. This halves the memory traffic of reading them back,
+ * and lets twice as many groups fit in the same budget.
+ */
+class ExponentialCache {
+public:
+    ExponentialCache()
+    {
+        return;
+    }
+
+    /**
+     * \brief Size the cache and allocate as many groups as fit in the budget
+     *
+     * \param budget the memory budget, in bytes. Zero disables the cache.
+     * \param rays the \ref RayData which is being swept
+     * \param macroplane_ids the unique plane ID of each macroplane
+     * \param n_group the number of energy groups
+     * \param single whether to store the exponentials in single precision
+     */
+    void configure(size_t budget, const RayData &rays,
+                   const VecI &macroplane_ids, int n_group,
+                   bool single = false);
+
+    /**
+     * \brief Return a pointer to the storage for a group, or \c nullptr if
+     * the group is not cached.
+     *
+     * \c T must match the precision that the cache was configured with;
+     * asking for the other precision always returns \c nullptr.
+     */
+    template <typename T> T *group_data(int group);
+
+    /**
+     * \brief Return whether the exponentials are stored in single precision
+     */
+    bool single() const
+    {
+        return !data_single_.empty();
+    }
+
+    /**
+     * \brief Return whether the cached group was filled using the passed
+     * \ref XSMesh state.
+     */
+    bool is_valid(int group, int xs_state) const
+    {
+        return state_[group] == xs_state;
+    }
+
+    /**
+     * \brief Mark the cached group as having been filled using the passed
+     * \ref XSMesh state.
+     */
+    void set_valid(int group, int xs_state)
+    {
+        state_[group] = xs_state;
+    }
+
+    /**
+     * \brief Return the offset into the group storage of the first segment
+     * for the indexed macroplane and angle.
+     */
+    size_t offset(int iplane, int iang) const
+    {
+        return offset_[iplane][iang];
+    }
+
+    /**
+     * \brief Return the number of groups that are cached
+     */
+    int n_cached() const
+    {
+        return n_cached_;
+    }
+
+private:
+    // Segment exponentials for each group. Groups that are not cached are
+    // left empty.
+    std::vector<VecF> data_;
+    std::vector<std::vector<float>> data_single_;
+
+    // XSMesh state used to fill each group. -1 if never filled
+    VecI state_;
+
+    // Offset to the first segment of each macroplane/angle
+    std::vector<std::vector<size_t>> offset_;
+
+    int n_cached_ = 0;
+};
+
+template <> inline real_t *ExponentialCache::group_data<real_t>(int group)
+{
+    if (group >= (int)data_.size() || data_[group].empty()) {
+        return nullptr;
+    }
+    return data_[group].data();
+}
+
+template <> inline float *ExponentialCache::group_data<float>(int group)
+{
+    if (group >= (int)data_single_.size() || data_single_[group].empty()) {
+        return nullptr;
+    }
+    return data_single_[group].data();
+}
+}
+}
@@ -0,0 +1,158 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include "linear_source_geometry.hpp"
+
+#include "util/files.hpp"
+
+namespace mocc {
+namespace moc {
+LinearSourceGeometry::LinearSourceGeometry(const RayData &rays,
+                                           const CoreMesh &mesh)
+{
+    const auto &ang_quad = rays.ang_quad();
+    int n_plane          = std::distance(rays.begin(), rays.end());
+
+    offsets_.resize(n_plane);
+    ray_offset_.resize(n_plane);
+    inverse_moments_.resize(n_plane);
+
+    int n_singular = 0;
+    for (int iplane = 0; iplane < n_plane; iplane++) {
+        const auto &plane_rays = rays[iplane];
+        int n_reg              = mesh.unique_plane(iplane).n_reg();
+        int n_ang              = plane_rays.size();
+
+        // Segment midpoints, in absolute coordinates, and their weights
+        std::vector<VecF> mid(n_ang);
+        VecF wsum(n_reg, 0.0);
+        VecF cx(n_reg, 0.0);
+        VecF cy(n_reg, 0.0);
+
+        ray_offset_[iplane].resize(n_ang);
+        for (int iang = 0; iang < n_ang; iang++) {
+            real_t wt        = ang_quad[iang].weight * rays.spacing(iang);
+            auto &ray_offset = ray_offset_[iplane][iang];
+            size_t n_seg     = 0;
+            for (const auto &ray : plane_rays[iang]) {
+                ray_offset.push_back(n_seg);
+                n_seg += ray.nseg();
+            }
+            mid[iang].reserve(2 * n_seg);
+
+            for (const auto &ray : plane_rays[iang]) {
+                // The corrected segment lengths don't quite add up to the
+                // length of the ray, so locate the midpoints by the fraction
+                // of the ray that they are along
+                Point2 p1      = ray.p1();
+                Point2 p2      = ray.p2();
+                real_t ray_len = 0.0;
+                for (int iseg = 0; iseg < ray.nseg(); iseg++) {
+                    ray_len += ray.seg_len(iseg);
+                }
+                real_t scale = 1.0 / ray_len;
+
+                real_t s = 0.0;
+                for (int iseg = 0; iseg < ray.nseg(); iseg++) {
+                    real_t len = ray.seg_len(iseg);
+                    real_t f   = (s + 0.5 * len) * scale;
+                    real_t x   = p1.x + f * (p2.x - p1.x);
+                    real_t y   = p1.y + f * (p2.y - p1.y);
+                    mid[iang].push_back(x);
+                    mid[iang].push_back(y);
+
+                    int ireg = ray.seg_index(iseg);
+                    wsum[ireg] += wt * len;
+                    cx[ireg] += wt * len * x;
+                    cy[ireg] += wt * len * y;
+                    s += len;
+                }
+            }
+        }
+
+        for (int ireg = 0; ireg < n_reg; ireg++) {
+            if (wsum[ireg] > 0.0) {
+                cx[ireg] /= wsum[ireg];
+                cy[ireg] /= wsum[ireg];
+            }
+        }
+
+        // Second pass: offsets from the centroids and the moment matrices.
+        // Each segment contributes its midpoint offset, plus the spread of
+        // the segment itself along the ray direction.
+        VecF mxx(n_reg, 0.0);
+        VecF mxy(n_reg, 0.0);
+        VecF myy(n_reg, 0.0);
+        offsets_[iplane].resize(n_ang);
+        for (int iang = 0; iang < n_ang; iang++) {
+            real_t wt     = ang_quad[iang].weight * rays.spacing(iang);
+            auto &offsets = offsets_[iplane][iang];
+            offsets.reserve(mid[iang].size());
+            int imid = 0;
+            for (const auto &ray : plane_rays[iang]) {
+                Point2 p1 = ray.p1();
+                Point2 p2 = ray.p2();
+                real_t d  = p1.distance(p2);
+                real_t ux = (p2.x - p1.x) / d;
+                real_t uy = (p2.y - p1.y) / d;
+                for (int iseg = 0; iseg < ray.nseg(); iseg++) {
+                    int ireg   = ray.seg_index(iseg);
+                    real_t len = ray.seg_len(iseg);
+                    real_t dx  = mid[iang][imid++] - cx[ireg];
+                    real_t dy  = mid[iang][imid++] - cy[ireg];
+                    offsets.push_back(dx);
+                    offsets.push_back(dy);
+
+                    real_t w      = wt * len;
+                    real_t spread = len * len / 12.0;
+                    mxx[ireg] += w * (dx * dx + ux * ux * spread);
+                    mxy[ireg] += w * (dx * dy + ux * uy * spread);
+                    myy[ireg] += w * (dy * dy + uy * uy * spread);
+                }
+            }
+        }
+
+        auto &inverse = inverse_moments_[iplane];
+        inverse.resize(3 * n_reg, 0.0);
+        for (int ireg = 0; ireg < n_reg; ireg++) {
+            if (wsum[ireg] <= 0.0) {
+                n_singular++;
+                continue;
+            }
+            real_t xx  = mxx[ireg] / wsum[ireg];
+            real_t xy  = mxy[ireg] / wsum[ireg];
+            real_t yy  = myy[ireg] / wsum[ireg];
+            real_t det = xx * yy - xy * xy;
+            if (det <= 1.0e-10 * (xx + yy) * (xx + yy)) {
+                n_singular++;
+                continue;
+            }
+            inverse[3 * ireg + 0] = yy / det;
+            inverse[3 * ireg + 1] = -xy / det;
+            inverse[3 * ireg + 2] = xx / det;
+        }
+    }
+
+    if (n_singular > 0) {
+        LogFile << n_singular << " regions have a singular moment matrix, "
+                << "and will be treated with a flat source" << std::endl;
+    }
+
+    return;
+}
+}
+}
@@ -0,0 +1,91 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <vector>
+#include "util/global_config.hpp"
+#include "core/core_mesh.hpp"
+#include "ray_data.hpp"
+
+namespace mocc {
+namespace moc {
+/**
+ * \brief Geometric data needed to sweep with a linear source in each flat
+ * source region
+ *
+ * A linear source is expanded about the centroid of each region as
+ * \f$q(\vec{r}) = \bar{q} + \vec{q}\cdot(\vec{r} - \vec{r}_c)\f$. Sweeping it
+ * needs the offset of each segment midpoint from the centroid of the region
+ * that it crosses, and turning the spatial moments of the source into the
+ * coefficients \f$\vec{q}\f$ needs the inverse of the second spatial moment
+ * matrix of each region.
+ *
+ * Both are integrated numerically along the rays of each
+ * geometrically-unique plane, using the same angle weights and corrected
+ * segment lengths as the sweep, so that the midpoint offsets of each region
+ * sum to zero over the quadrature. The moment matrices are stored as their
+ * inverses, in [xx, xy, yy] order for each region. Regions whose moment
+ * matrix is singular (e.g. too few rays to resolve them) get a zero inverse,
+ * reducing them to a flat source.
+ */
+class LinearSourceGeometry {
+public:
+    LinearSourceGeometry()
+    {
+        return;
+    }
+
+    LinearSourceGeometry(const RayData &rays, const CoreMesh &mesh);
+
+    /**
+     * \brief Return the midpoint offsets, in (x, y) pairs, for the segments
+     * of a ray
+     *
+     * \param iplane the index of the geometrically-unique plane
+     * \param iang the angle index
+     * \param iray the ray index within the angle
+     */
+    const float *offsets(int iplane, int iang, int iray) const
+    {
+        return offsets_[iplane][iang].data() +
+               2 * ray_offset_[iplane][iang][iray];
+    }
+
+    /**
+     * \brief Return the inverse moment matrices of the regions in a
+     * geometrically-unique plane
+     */
+    const VecF &inverse_moments(int iplane) const
+    {
+        return inverse_moments_[iplane];
+    }
+
+private:
+    // Segment midpoint offsets from their region centroids, indexed by
+    // [plane][angle], with the (x, y) offsets of each segment stored
+    // consecutively
+    std::vector<std::vector<std::vector<float>>> offsets_;
+
+    // Index of the first segment of each ray within offsets_, by [plane]
+    // [angle][ray]
+    std::vector<std::vector<std::vector<size_t>>> ray_offset_;
+
+    // Inverse second moment matrix of each region, by [plane]
+    std::vector<VecF> inverse_moments_;
+};
+}
+}
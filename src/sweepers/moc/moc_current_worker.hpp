@@ -21,6 +21,7 @@
 #include "util/global_config.hpp"
 #include "core/constants.hpp"
 #include "core/geometry/angle.hpp"
+#include "core/thread_buffers.hpp"
 #include "ray.hpp"
 
 namespace mocc {
@@ -48,11 +49,15 @@ public:
      * which points to the same scalar every time, which should be elided by an
      * optimizing compiler.
      *
+     * The constructor accepts a pointer to external storage and a stride to
+     * match the interface of \ref moc::Current::FluxStore, but they are
+     * ignored.
+     *
      * \sa moc::Current::FluxStore
      */
     class FluxStore {
     public:
-        FluxStore(int size)
+        FluxStore(real_t *data, int stride = 1)
         {
             return;
         }
@@ -69,6 +74,21 @@ public:
         real_t psi_;
     };
 
+    /**
+     * Whether the worker needs all threads to synchronize before and after
+     * each angle (i.e. in \ref set_angle() and \ref post_angle()), and to
+     * work on the same plane. If not, the sweeper is free to work on several
+     * angles and planes at once.
+     */
+    static constexpr bool needs_angle_sync = false;
+
+    /**
+     * Whether the worker needs the angular flux along the whole length of
+     * each ray in \ref post_ray(). If not, the multi-group kernel only keeps
+     * the flux at the furthest-swept position.
+     */
+    static constexpr bool stores_ray_flux = false;
+
     NoCurrent()
     {
     }
@@ -137,26 +157,81 @@ public:
 class Current {
 public:
     /**
-     * \brief Typedef for a STL vector of real_t for storing angular flux along
-     * a ray.
+     * \brief Subscriptable view of externally-owned storage for the angular
+     * flux along a ray.
      *
      * This type is used to store the flux along the entire length of the ray
-     * when such information is needed from the MoC sweeper kernel.
+     * when such information is needed from the MoC sweeper kernel. The
+     * storage itself comes from the sweeper's \ref SweepWorkspace, and must
+     * be at least one longer than the number of segments on the longest ray.
+     *
+     * The multi-group kernel stores the flux of all groups in one block, with
+     * the group index running fastest, so the view of a single group strides
+     * over the others.
      *
      * \sa moc::NoCurrent::FluxStore
      */
-    typedef std::vector<real_t> FluxStore;
+    class FluxStore {
+    public:
+        FluxStore(real_t *data, int stride = 1) : psi_(data), stride_(stride)
+        {
+            return;
+        }
+        real_t &operator[](int i)
+        {
+            return psi_[i * stride_];
+        }
+        real_t operator[](int i) const
+        {
+            return psi_[i * stride_];
+        }
+
+    private:
+        real_t *psi_;
+        int stride_;
+    };
 
-    Current() : coarse_data_(nullptr), mesh_(nullptr)
+    // The angle weights are shared by all threads
+    static constexpr bool needs_angle_sync = true;
+
+    static constexpr bool stores_ray_flux = true;
+
+    Current() : coarse_data_(nullptr), mesh_(nullptr), n_surf_(0), plane_(-1)
     {
     }
 
+    /**
+     * The thread-private tallies are allocated here, so this must be called
+     * outside of any parallel region.
+     */
     Current(CoarseData *data, const Mesh *mesh)
-        : coarse_data_(data), mesh_(mesh)
+        : coarse_data_(data),
+          mesh_(mesh),
+          n_surf_(mesh->n_surf_plane()),
+          plane_(-1)
     {
+        tally_.resize(2 * n_surf_);
         return;
     }
 
+    /**
+     * \brief Copy the worker, with its own thread-private tallies
+     *
+     * Several workers may be in use at once (e.g. one for each group of a
+     * multi-group sweep), so they must never share tallies.
+     */
+    Current(const Current &other)
+        : coarse_data_(other.coarse_data_),
+          mesh_(other.mesh_),
+          n_surf_(other.n_surf_),
+          plane_(-1)
+    {
+        tally_.resize(2 * n_surf_);
+        return;
+    }
+
+    Current &operator=(const Current &other) = delete;
+
     MOCC_FORCE_INLINE void post_angle(int iang)
     {
         return;
@@ -172,11 +247,24 @@ public:
         group_ = group;
     }
 
+    /**
+     * \brief Set up the worker to treat the indexed macroplane
+     *
+     * This must be called by all threads, once the rays of the previous plane
+     * are done. The tallies of the previous plane are reduced into the \ref
+     * CoarseData first.
+     */
     MOCC_FORCE_INLINE void set_plane(int plane)
     {
-        plane_       = plane;
-        cell_offset_ = mesh_->coarse_cell_offset(plane);
-        surf_offset_ = mesh_->coarse_surf_offset(plane);
+        this->reduce_tallies();
+#pragma omp barrier
+#pragma omp single
+        {
+            plane_       = plane;
+            cell_offset_ = mesh_->coarse_cell_offset(plane);
+            surf_offset_ = mesh_->coarse_surf_offset(plane);
+        }
+        tally_.zero();
     }
 
     MOCC_FORCE_INLINE void set_angle(Angle ang, real_t spacing)
@@ -199,67 +287,30 @@ public:
 #pragma omp barrier
     }
 
+    /**
+     * \brief Tally the currents and surface fluxes at each coarse surface
+     * crossed by the ray
+     *
+     * The tallies are private to the calling thread, and indexed by surface
+     * within the plane. They are summed into the \ref CoarseData when moving
+     * on to the next plane, or at the end of the sweep.
+     */
     MOCC_FORCE_INLINE void post_ray(const FluxStore &psi1,
                                     const FluxStore &psi2, const ArrayB1 &e_tau,
                                     const Ray &ray, int first_reg)
     {
-#pragma omp critical
-        {
-            /**
-             * \todo this is going to perform poorly as implemented. this is a
-             * really large critical section, which we might be able to do as
-             * atomic updates, as is done in the Sn current worker. The Blitz
-             * array slicing is not thread safe, though, so we would need to be
-             * careful. It'd be nice to fiddle with this and profile once things
-             * settle down some.
-             */
-            auto all          = blitz::Range::all();
-            auto current      = coarse_data_->current(all, group_);
-            auto surface_flux = coarse_data_->surface_flux(all, group_);
-
-            int cell_fw = ray.cm_cell_fw() + cell_offset_;
-            int cell_bw = ray.cm_cell_bw() + cell_offset_;
-
-            int surf_fw = ray.cm_surf_fw() + surf_offset_;
-            int surf_bw = ray.cm_surf_bw() + surf_offset_;
-            int iseg_fw = 0;
-            int iseg_bw = ray.nseg();
-
-            int norm_fw = (int)mesh_->surface_normal(surf_fw);
-            int norm_bw = (int)mesh_->surface_normal(surf_bw);
-            current(surf_fw) += psi1[iseg_fw] * current_weights_[norm_fw];
-            current(surf_bw) -= psi2[iseg_bw] * current_weights_[norm_bw];
-            surface_flux(surf_fw) += psi1[iseg_fw] * flux_weights_[norm_fw];
-            surface_flux(surf_bw) += psi2[iseg_bw] * flux_weights_[norm_bw];
-
-            auto begin = ray.cm_data().cbegin();
-            auto end   = ray.cm_data().cend();
-            for (auto crd = begin; crd != end; ++crd) {
-                // Hopefully branch prediction saves me here.
-                if (crd->fw != Surface::INVALID) {
-                    iseg_fw += crd->nseg_fw;
-                    norm_fw = (int)surface_to_normal(crd->fw);
-                    surf_fw = mesh_->coarse_surf(cell_fw, crd->fw);
-                    current(surf_fw) +=
-                        psi1[iseg_fw] * current_weights_[norm_fw];
-                    surface_flux(surf_fw) +=
-                        psi1[iseg_fw] * flux_weights_[norm_fw];
-                }
+        real_t *current      = tally_.get();
+        real_t *surface_flux = current + n_surf_;
+        real_t w             = ray.weight();
 
-                if (crd->bw != Surface::INVALID) {
-                    iseg_bw -= crd->nseg_bw;
-                    norm_bw = (int)surface_to_normal(crd->bw);
-                    surf_bw = mesh_->coarse_surf(cell_bw, crd->bw);
-                    current(surf_bw) -=
-                        psi2[iseg_bw] * current_weights_[norm_bw];
-                    surface_flux(surf_bw) +=
-                        psi2[iseg_bw] * flux_weights_[norm_bw];
-                }
-
-                cell_fw = mesh_->coarse_neighbor(cell_fw, (crd)->fw);
-                cell_bw = mesh_->coarse_neighbor(cell_bw, (crd)->bw);
-            }
-        } // OMP critical
+        for (const auto &c : ray.crossings_fw()) {
+            current[c.surf] += psi1[c.iseg] * w * current_weights_[c.norm];
+            surface_flux[c.surf] += psi1[c.iseg] * w * flux_weights_[c.norm];
+        }
+        for (const auto &c : ray.crossings_bw()) {
+            current[c.surf] -= psi2[c.iseg] * w * current_weights_[c.norm];
+            surface_flux[c.surf] += psi2[c.iseg] * w * flux_weights_[c.norm];
+        }
         return;
     }
 
@@ -271,8 +322,11 @@ public:
      */
     MOCC_FORCE_INLINE void post_sweep()
     {
+        this->reduce_tallies();
 #pragma omp single
         {
+            plane_ = -1;
+
             // Check to see if we need to expand the currents across the mesh.
             if ((int)mesh_->nz() - 1 != (mesh_->macroplane_index().back())) {
                 // In the presence of subplaning, the currents coming from the
@@ -318,11 +372,45 @@ public:
     }
 
 protected:
+    /**
+     * \brief Sum the thread-private tallies of the current plane into the
+     * \ref CoarseData
+     *
+     * This must be called by all threads, after they are done with the rays
+     * of the plane. Nothing happens if no plane is being treated.
+     */
+    void reduce_tallies()
+    {
+        if (plane_ < 0) {
+            return;
+        }
+        const int n      = n_surf_;
+        const int offset = surf_offset_;
+        const int group  = group_;
+        auto &current    = coarse_data_->current;
+        auto &flux       = coarse_data_->surface_flux;
+        tally_.reduce([&](int i, real_t v) {
+            if (i < n) {
+                current(offset + i, group) += v;
+            } else {
+                flux(offset + i - n, group) += v;
+            }
+        });
+        return;
+    }
+
     CoarseData *coarse_data_;
     const Mesh *mesh_;
     std::array<real_t, 2> current_weights_;
     std::array<real_t, 2> flux_weights_;
 
+    // Thread-private current and surface flux tallies for the surfaces of
+    // the plane being swept. The currents come first, then the surface
+    // fluxes.
+    ThreadBuffers tally_;
+    int n_surf_;
+
+    // Index of the plane being swept, or -1 between sweeps
     int plane_;
     int group_;
     int cell_offset_;
@@ -17,14 +17,22 @@
 #include "moc_sweeper.hpp"
 
 #include <algorithm>
-#include <fstream>
+#include <cassert>
 #include <iomanip>
+#include <map>
+#include <sstream>
+#ifdef __linux__
+#include <unistd.h>
+#endif
 #include "pugixml.hpp"
 #include "util/error.hpp"
 #include "util/files.hpp"
+#include "util/first_touch.hpp"
+#include "util/fp_utils.hpp"
 #include "util/string_utils.hpp"
 #include "util/utils.hpp"
 #include "util/validate_input.hpp"
+#include "core/parallel_environment.hpp"
 #include "moc_current_worker.hpp"
 
 namespace {
@@ -51,10 +59,39 @@ std::vector<mocc::BC_Size_t> bc_size_helper(const mocc::moc::RayData &rays)
     return bc_dims;
 }
 
+/**
+ * \brief Return the ray input of a \ref mocc::moc::MoCSweeper, refusing to go
+ * any further on more than one rank.
+ *
+ * The distributed sweep would need domain-local rays and an exchange of the
+ * outgoing boundary flux between domains, neither of which is in place, so
+ * this rejects the run before any rays are traced rather than duplicate the
+ * work on every rank.
+ */
+pugi::xml_node serial_ray_input(const pugi::xml_node &input)
+{
+    using namespace mocc;
+    if (ParEnv.n_rank() > 1) {
+        throw EXCEPT("Distributed MoC sweeps are not supported yet.");
+    }
+    return input.child("rays");
+}
+
 const std::vector<std::string> recognized_attributes = {
-    "type",         "update_incoming", "n_inner",
-    "dump_rays",    "boundary_update", "tl_splitting",
-    "dump_fsr_flux"};
+    "type",               "update_incoming",    "n_inner",
+    "dump_rays",          "boundary_update",    "tl_splitting",
+    "dump_fsr_flux",      "kernel",             "group_block",
+    "exp_cache",          "exponential",        "schedule",
+    "plane_parallel",     "precision",          "source_shape",
+    "offload",            "plane_tolerance",    "plane_max_skip",
+    "polar_integration",  "inner_solver",       "gmres_tol",
+    "gmres_max_iter",     "gmres_restart",      "xs_cache",
+    "autotune",           "autotune_cache",     "autotune_tolerance",
+    "autotune_samples",   "axial_spacing",      "workload_stats",
+    "scattering_order",   "boundary_precision"};
+
+// Number of rays in each packet of the packet kernel
+constexpr int packet_width = 8;
 }
 
 namespace mocc {
@@ -65,164 +102,2468 @@ MoCSweeper::MoCSweeper(const pugi::xml_node &input, const CoreMesh &mesh)
       timer_init_(timer_.new_timer("Initialization", true)),
       timer_sweep_(timer_.new_timer("Sweep")),
       mesh_(mesh),
-      rays_(input.child("rays"), ang_quad_, mesh),
-      boundary_(mesh.nz(),
+      rays_(serial_ray_input(input), ang_quad_, mesh),
+      boundary_(mesh.subplane().size(),
                 BoundaryCondition(n_group_, ang_quad_, mesh_.boundary(),
                                   bc_size_helper(rays_))),
-      boundary_out_(mesh.nz(), BoundaryCondition(1, ang_quad_, mesh_.boundary(),
-                                                 bc_size_helper(rays_))),
+      boundary_out_(),
       xstr_(xs_mesh_.get()),
       flux_1g_(),
       subplane_(mesh.subplane()),
       subplane_bounds_(),
       bc_type_(mesh_.boundary()),
+      cyclic_(false),
       dump_rays_(false),
       dump_fsr_flux_(false),
       gauss_seidel_boundary_(true),
-      allow_splitting_(false)
+      allow_splitting_(false),
+      balanced_schedule_(true),
+      plane_parallel_(false),
+      mixed_precision_(false),
+      packed_boundary_(false),
+      linear_source_(false),
+      source_ls_(nullptr),
+      scat_order_(0),
+      source_pn_(nullptr),
+      multigroup_kernel_(false),
+      group_block_(1),
+      polar_kernel_(false),
+      packet_kernel_(false),
+      stack_kernel_(false),
+      max_stack_(0),
+      kernel_3d_(false),
+      n_seg_3d_(0.0),
+      bickley_(false),
+      n_rhs_(0),
+      plane_tol_(0.0),
+      plane_max_skip_(3),
+      all_planes_active_(true),
+      angle_pipeline_(nullptr),
+      n_plane_skipped_(0),
+      n_seg_skipped_(0.0),
+      n_seg_group_sets_(0.0)
 {
     LogFile << "Constructing a base MoC sweeper" << std::endl;
 
-    validate_input(input, recognized_attributes);
+    n_negative_.assign(n_group_, 0);
+    n_nan_.assign(n_group_, 0);
+
+    timer_sweep_.enable_counters();
+
+    validate_input(input, recognized_attributes);
+
+    // Make sure we have input from the XML
+    if (input.empty()) {
+        throw EXCEPT("No input specified to initialize MoC sweeper.");
+    }
+
+    // Parse the number of inner iterations
+    int int_in = input.attribute("n_inner").as_int(-1);
+    if (int_in < 0) {
+        throw EXCEPT("Invalid number of inner iterations specified "
+                     "(n_inner).");
+    }
+    n_inner_ = int_in;
+
+    // Parse the output options
+    dump_rays_     = input.attribute("dump_rays").as_bool(false);
+    dump_fsr_flux_ = input.attribute("dump_fsr_flux").as_bool(false);
+
+    // Determine boundary update technique
+    gauss_seidel_boundary_ = true;
+    if (!input.attribute("boundary_update").empty()) {
+        std::string in_string = input.attribute("boundary_update").value();
+        sanitize(in_string);
+        if (in_string == "jacobi" || in_string == "j") {
+            gauss_seidel_boundary_ = false;
+        } else if (in_string == "gs") {
+        } else if (in_string == "cyclic") {
+            // Sweeps that need currents still update the boundary
+            // conditions angle-by-angle
+            cyclic_ = true;
+        } else {
+            throw EXCEPT("Unrecognized boundary update option.");
+        }
+    }
+
+    // Determine how rays are distributed among threads
+    if (!input.attribute("schedule").empty()) {
+        std::string in_string = input.attribute("schedule").value();
+        sanitize(in_string);
+        if (in_string == "balanced") {
+            balanced_schedule_ = true;
+        } else if (in_string == "static") {
+            balanced_schedule_ = false;
+        } else {
+            throw EXCEPT("Unrecognized ray schedule option.");
+        }
+    }
+
+    plane_parallel_ = input.attribute("plane_parallel").as_bool(false);
+
+    // Select the exponential evaluator
+    std::string exponential = "linear";
+    if (!input.attribute("exponential").empty()) {
+        exponential = input.attribute("exponential").value();
+        sanitize(exponential);
+    }
+    exp_ = ExponentialFactory(exponential);
+    LogFile << "Using " << exponential << " exponential evaluation"
+            << std::endl;
+
+    // Autotuning tries out whichever of the exponential evaluator and the
+    // ray schedule weren't given in the input
+    bool autotune = input.attribute("autotune").as_bool(false);
+    bool tune_exponential =
+        autotune && input.attribute("exponential").empty();
+    bool tune_schedule = autotune && input.attribute("schedule").empty();
+
+    // Parse TL source splitting setting
+    allow_splitting_ = input.attribute("tl_splitting").as_bool(false);
+    if (allow_splitting_) {
+        split_.resize(n_reg_);
+    }
+
+    // Precision of the ray data in the sweep
+    if (!input.attribute("precision").empty()) {
+        std::string in_string = input.attribute("precision").value();
+        sanitize(in_string);
+        if (in_string == "mixed") {
+            mixed_precision_ = true;
+        } else if (in_string == "double") {
+            mixed_precision_ = false;
+        } else {
+            throw EXCEPT("Unrecognized sweep precision option.");
+        }
+    }
+    if (!input.attribute("boundary_precision").empty()) {
+        std::string in_string = input.attribute("boundary_precision").value();
+        sanitize(in_string);
+        if (in_string == "single") {
+            packed_boundary_ = true;
+        } else if (in_string != "double") {
+            throw EXCEPT("Unrecognized boundary precision option.");
+        }
+    }
+
+    // Spatial shape of the source within each region
+    if (!input.attribute("source_shape").empty()) {
+        std::string in_string = input.attribute("source_shape").value();
+        sanitize(in_string);
+        if (in_string == "linear") {
+            linear_source_ = true;
+        } else if (in_string == "flat") {
+            linear_source_ = false;
+        } else {
+            throw EXCEPT("Unrecognized source shape option.");
+        }
+    }
+
+    // Determine which sweep kernel to use
+    if (!input.attribute("kernel").empty()) {
+        std::string in_string = input.attribute("kernel").value();
+        sanitize(in_string);
+        if (in_string == "mg") {
+            multigroup_kernel_ = true;
+        } else if (in_string == "polar") {
+            polar_kernel_ = true;
+        } else if (in_string == "packet") {
+            packet_kernel_ = true;
+        } else if (in_string == "stacked") {
+            stack_kernel_ = true;
+        } else if (in_string == "3d") {
+            kernel_3d_ = true;
+        } else if (in_string == "1g") {
+            multigroup_kernel_ = false;
+        } else {
+            throw EXCEPT("Unrecognized sweep kernel option.");
+        }
+    }
+
+    if (multigroup_kernel_ && linear_source_) {
+        throw EXCEPT("The multi-group MoC kernel does not support a linear "
+                     "source.");
+    }
+    if (polar_kernel_ && linear_source_) {
+        throw EXCEPT("The polar MoC kernel does not support a linear "
+                     "source.");
+    }
+    if (packet_kernel_ && linear_source_) {
+        throw EXCEPT("The packet MoC kernel does not support a linear "
+                     "source.");
+    }
+    if (stack_kernel_ && linear_source_) {
+        throw EXCEPT("The stacked MoC kernel does not support a linear "
+                     "source.");
+    }
+    if (kernel_3d_ && linear_source_) {
+        throw EXCEPT("The 3-D MoC kernel does not support a linear source.");
+    }
+    if (gmres_inner_ && (multigroup_kernel_ || linear_source_ || kernel_3d_)) {
+        throw EXCEPT("GMRES inner iterations need the one-group MoC kernel "
+                     "and a flat source.");
+    }
+    // The linear source geometry and offloaded sweeps are set up from the
+    // segments of the rays themselves
+    if (!rays_.ray_segments() &&
+        (linear_source_ || input.attribute("offload").as_bool(false))) {
+        throw EXCEPT("Rays traced on the fly are not supported by the "
+                     "linear source or offloaded sweeps.");
+    }
+
+    if (multigroup_kernel_) {
+        group_block_ = input.attribute("group_block").as_int(n_group_);
+        if ((group_block_ < 1) || (group_block_ > n_group_)) {
+            throw EXCEPT("Invalid group block size (group_block).");
+        }
+        LogFile << "Using the multi-group MoC kernel with blocks of "
+                << group_block_ << " groups" << std::endl;
+
+        source_mg_.resize(n_reg_, n_group_);
+        qbar_mg_.resize(n_reg_, n_group_);
+        xstr_mg_.resize(n_reg_, n_group_);
+        source_mg_ = 0.0;
+        qbar_mg_   = 0.0;
+        xstr_mg_   = 0.0;
+
+        boundary_out_mg_ = std::vector<BoundaryCondition>(
+            boundary_.size(), BoundaryCondition(group_block_, ang_quad_,
+                                                mesh_.boundary(),
+                                                bc_size_helper(rays_)));
+        if (mixed_precision_) {
+            Warn("Mixed precision is only used by the one-group MoC kernel");
+        }
+    } else {
+        if (!input.attribute("group_block").empty()) {
+            Warn("group_block is only used by the multi-group MoC kernel");
+        }
+        boundary_out_ = std::vector<BoundaryCondition>(
+            boundary_.size(), BoundaryCondition(1, ang_quad_, mesh_.boundary(),
+                                                bc_size_helper(rays_)));
+    }
+
+    // Sanity-check the subplane parameters. We will operate on the assumption
+    // for now that all planes in a macroplane are not only geometrically
+    // identical, but completely so. For anyone interested in doing de-cusping,
+    // this will need to change. Lattices with different IDs are allowed, as
+    // long as they hold the same pins, or pins with the same mesh and
+    // materials, as the automatic plane merging produces.
+    auto same_pin = [](const Pin *p1, const Pin *p2) {
+        return (p1 == p2) ||
+               (p1->mesh().geometrically_equivalent(p2->mesh()) &&
+                (p1->mat_ids() == p2->mat_ids()));
+    };
+    for (const auto &assembly : mesh_.core()) {
+        int ip = 0;
+        for (const auto &mac_size : subplane_) {
+            const Lattice &lat = (*assembly)[ip];
+            for (int in_mac_plane = 1; in_mac_plane < mac_size;
+                 in_mac_plane++) {
+                const Lattice &other = (*assembly)[ip + in_mac_plane];
+                if ((other.id() != lat.id()) &&
+                    ((other.n_pin() != lat.n_pin()) ||
+                     !std::equal(lat.begin(), lat.end(), other.begin(),
+                                 same_pin))) {
+                    throw EXCEPT(
+                        "All lattices in a macroplane must be the same.");
+                }
+            }
+            ip += mac_size;
+        }
+    }
+
+    // Construct the entries in subplane_bounds_ these should be the the
+    // accumulation of the number of planes in each MoC plane, such that taking
+    // std::distance(..., std::lower_bound(..., iz)) for a given axial index iz
+    // should return the appropriate MoC plane index
+    subplane_bounds_.reserve(subplane_.size());
+    int prev = 0;
+    for (const auto np : subplane_) {
+        subplane_bounds_.push_back(prev + np);
+        prev += np;
+    }
+
+    // set up the array of unique plane ids and number of FSRs per moc plane. We
+    // have already checked that all of the planes are entirely the same, so we
+    // know they must be geometrically identical as well.
+    macroplane_unique_ids_.reserve(subplane_.size());
+    first_reg_macroplane_.reserve(subplane_.size());
+    first_reg_macroplane_.push_back(0);
+    nreg_plane_.reserve(subplane_.size());
+    int iz = 0;
+    for (const auto &sub_size : subplane_) {
+        macroplane_unique_ids_.push_back(mesh_.unique_plane_ids()[iz]);
+        nreg_plane_.push_back(
+            mesh_.unique_plane(macroplane_unique_ids_.back()).n_reg());
+        iz += sub_size;
+    }
+
+    for (const auto &plane_id : macroplane_unique_ids_) {
+        first_reg_macroplane_.push_back(first_reg_macroplane_.back() +
+                                        mesh_.unique_plane(plane_id).n_reg());
+    }
+    first_reg_macroplane_.pop_back();
+
+    if (dump_rays_) {
+        rays_.dump_xdmf("rays");
+    }
+
+    // Replace the angular quadrature with the modularized version
+    ang_quad_ = rays_.ang_quad();
+
+    // Gather the angles that share each azimuth, and therefore the same rays,
+    // to be swept together by the polar kernel
+    if (polar_kernel_) {
+        int n_ang = rays_.begin()->size();
+        for (int iang = 0; iang < n_ang; iang++) {
+            auto set = std::find_if(
+                polar_sets_.begin(), polar_sets_.end(), [&](const VecI &s) {
+                    return fp_equiv(ang_quad_[s.front()].alpha,
+                                    ang_quad_[iang].alpha);
+                });
+            if (set == polar_sets_.end()) {
+                polar_sets_.push_back(VecI(1, iang));
+                continue;
+            }
+            int iang0 = set->front();
+            bool same = fp_equiv(rays_.spacing(iang0), rays_.spacing(iang));
+            for (const auto &plane_rays : rays_) {
+                same = same &&
+                       (plane_rays[iang0].size() == plane_rays[iang].size());
+            }
+            if (!same) {
+                throw EXCEPT("Angles sharing an azimuth have different rays.");
+            }
+            set->push_back(iang);
+        }
+        if (mixed_precision_) {
+            Warn("Mixed precision is not used by the polar MoC kernel");
+        }
+        LogFile << "Using the polar MoC kernel, with "
+                << ang_quad_.ndir_oct() * 2 / polar_sets_.size()
+                << " polar angles per azimuth" << std::endl;
+    }
+
+    if (packet_kernel_) {
+        if (mixed_precision_) {
+            Warn("Mixed precision is not used by the packet MoC kernel");
+        }
+        LogFile << "Using the packet MoC kernel, with " << packet_width
+                << " rays per packet" << std::endl;
+    }
+
+    // Polar integration of the polar kernel
+    if (!input.attribute("polar_integration").empty()) {
+        std::string in_string = input.attribute("polar_integration").value();
+        sanitize(in_string);
+        if (in_string == "bickley") {
+            bickley_ = true;
+        } else if (in_string != "quadrature") {
+            throw EXCEPT("Unrecognized polar integration option.");
+        }
+    }
+    if (bickley_) {
+        if (!polar_kernel_) {
+            throw EXCEPT("Bickley-Naylor polar integration needs the polar "
+                         "MoC kernel.");
+        }
+        ki3_.reset(new BickleyNaylor_Ki3<4000>(-20.0));
+        LogFile << "Using Bickley-Naylor polar integration" << std::endl;
+    }
+
+    if (balanced_schedule_ || tune_schedule) {
+        this->setup_schedule();
+    }
+
+    if (stack_kernel_) {
+        if (gauss_seidel_boundary_) {
+            throw EXCEPT("The stacked MoC kernel needs Jacobi boundary "
+                         "updates.");
+        }
+        if (rays_.out_of_core()) {
+            throw EXCEPT("The stacked MoC kernel does not support "
+                         "out-of-core rays.");
+        }
+        if (mixed_precision_) {
+            Warn("Mixed precision is not used by the stacked MoC kernel");
+        }
+        this->setup_stacks();
+        LogFile << "Using the stacked MoC kernel, with " << plane_stacks_.size()
+                << " stacks of up to " << max_stack_ << " macroplanes"
+                << std::endl;
+    }
+
+    if (gauss_seidel_boundary_) {
+        this->setup_gs_order();
+    }
+
+    if (cyclic_) {
+        if (multigroup_kernel_ || polar_kernel_ || packet_kernel_ ||
+            stack_kernel_ || kernel_3d_ || linear_source_) {
+            throw EXCEPT("Cyclic ray tracing is only supported by the "
+                         "one-group, flat source kernel.");
+        }
+        if (mixed_precision_) {
+            Warn("Cyclic sweeps are always performed in double precision");
+        }
+        tracks_ = CyclicTracks(rays_, bc_type_);
+        for (int iplane = 0; iplane < (int)macroplane_unique_ids_.size();
+             iplane++) {
+            int plane_id = macroplane_unique_ids_[iplane];
+            for (int it = 0; it < tracks_.n_tracks(plane_id); it++) {
+                track_units_.emplace_back(iplane, it);
+            }
+        }
+        std::stable_sort(track_units_.begin(), track_units_.end(),
+                         [this](const std::pair<int, int> &l,
+                                const std::pair<int, int> &r) {
+                             int id_l = macroplane_unique_ids_[l.first];
+                             int id_r = macroplane_unique_ids_[r.first];
+                             return tracks_.n_seg(id_l, l.second) >
+                                    tracks_.n_seg(id_r, r.second);
+                         });
+
+        int plane_id = macroplane_unique_ids_.front();
+        LogFile << "Using cyclic ray tracing, with "
+                << tracks_.n_tracks(plane_id) << " tracks in the first "
+                << "macroplane, " << tracks_.n_cyclic(plane_id)
+                << " of them closed" << std::endl;
+    }
+
+    // Lay the 3-D characteristics over the tracks of the 2-D rays
+    if (kernel_3d_) {
+        if (mixed_precision_) {
+            Warn("Mixed precision is not used by the 3-D MoC kernel");
+        }
+        real_t spacing = input.attribute("axial_spacing").as_double(0.25);
+        tracks_        = CyclicTracks(rays_, bc_type_);
+        axial_tracks_  = AxialTracks(rays_, tracks_, bc_type_,
+                                    macroplane_unique_ids_,
+                                    mesh_.macroplane_heights(),
+                                    first_reg_macroplane_, spacing);
+        axial_bc_.resize((size_t)n_group_ * axial_tracks_.n_lines());
+        axial_bc_in_.resize(axial_tracks_.n_lines());
+        LogFile << "Using the 3-D MoC kernel, with "
+                << axial_tracks_.n_lines() << " characteristics on "
+                << axial_tracks_.n_tracks() << " tracks" << std::endl;
+    } else if (!input.attribute("axial_spacing").empty()) {
+        Warn("axial_spacing is only used by the 3-D MoC kernel");
+    }
+
+    // Keep the expanded cross sections of all groups
+    if (input.attribute("xs_cache").as_bool(false)) {
+        xstr_.cache_all_groups();
+    }
+
+    // Set up the exponential cache. The budget is given in MB
+    if (!input.attribute("exp_cache").empty()) {
+        real_t budget = input.attribute("exp_cache").as_float(-1.0);
+        if (budget < 0.0) {
+            throw EXCEPT("Invalid exponential cache size (exp_cache).");
+        }
+        if (allow_splitting_) {
+            Warn("The exponential cache is not used with TL source "
+                 "splitting.");
+        } else {
+            exp_cache_.configure(budget * 1024 * 1024, rays_,
+                                 macroplane_unique_ids_, n_group_,
+                                 mixed_precision_);
+        }
+    }
+
+    if (autotune) {
+        // Once cached, the exponentials aren't evaluated again, so the
+        // evaluator makes no difference to the timing of later sweeps
+        this->setup_autotune(input, exponential,
+                             tune_exponential && (exp_cache_.n_cached() == 0),
+                             tune_schedule);
+    }
+
+    // Set up the linear source
+    if (linear_source_) {
+        LogFile << "Using a linear source in each region" << std::endl;
+        if (mixed_precision_) {
+            Warn("Mixed precision is not used with a linear source");
+        }
+        if (!input.attribute("exp_cache").empty()) {
+            Warn("The exponential cache is not used with a linear source");
+        }
+
+        ls_geometry_ = LinearSourceGeometry(rays_, mesh_);
+
+        ls_inverse_.resize(3 * n_reg_, 0.0);
+        ls_coeff_.resize(2 * n_reg_, 0.0);
+        for (int iplane = 0; iplane < (int)macroplane_unique_ids_.size();
+             iplane++) {
+            const auto &inv =
+                ls_geometry_.inverse_moments(macroplane_unique_ids_[iplane]);
+            std::copy(inv.begin(), inv.end(),
+                      ls_inverse_.begin() + 3 * first_reg_macroplane_[iplane]);
+        }
+
+        flux_x_.resize(n_reg_, n_group_);
+        flux_y_.resize(n_reg_, n_group_);
+        flux_x_ = 0.0;
+        flux_y_ = 0.0;
+    }
+
+    // Set up offloading of the sweeps that don't need currents
+    if (input.attribute("offload").as_bool(false)) {
+        if (multigroup_kernel_ || polar_kernel_ || packet_kernel_ ||
+            stack_kernel_ || kernel_3d_ || linear_source_ || cyclic_) {
+            throw EXCEPT("Offloading is only supported by the one-group, "
+                         "flat source kernel, without cyclic ray tracing.");
+        }
+        if (gauss_seidel_boundary_) {
+            Warn("Offloaded sweeps always update the boundary conditions "
+                 "in a Jacobi fashion");
+        }
+        if (mixed_precision_ || !input.attribute("exp_cache").empty()) {
+            Warn("Mixed precision and the exponential cache are not used "
+                 "by offloaded sweeps");
+        }
+#ifndef MOCC_USE_OFFLOAD
+        Warn("Built without offload support. Offloaded sweeps will run on "
+             "the host.");
+#endif
+        LogFile << "Offloading MoC sweeps" << std::endl;
+
+        device_.reset(new DeviceSweep(rays_, ang_quad_, mesh_,
+                                      macroplane_unique_ids_,
+                                      first_reg_macroplane_, n_reg_,
+                                      boundary_out_[0]));
+        int n_bc = device_->n_bc_plane() * macroplane_unique_ids_.size();
+        device_bc_in_.resize(n_bc);
+        device_bc_out_.resize(n_bc);
+        device_tally_.resize(n_reg_);
+    }
+
+    // Out-of-core rays are streamed in a plane at a time, so the planes have
+    // to be swept one after another
+    if (rays_.out_of_core()) {
+        if (cyclic_ || polar_kernel_ || device_) {
+            throw EXCEPT("Out-of-core rays are not supported by the cyclic, "
+                         "polar or offloaded sweeps.");
+        }
+        if (plane_parallel_) {
+            Warn("Plane-parallel sweeps are not used with out-of-core rays");
+            plane_parallel_ = false;
+        }
+    }
+
+    // Map the renumbered regions of the packed rays back to the mesh
+    if (rays_.renumbered()) {
+        if (multigroup_kernel_ || linear_source_) {
+            throw EXCEPT("Renumbered rays are only supported by the "
+                         "one-group, flat source kernels.");
+        }
+        mesh_index_.resize(n_reg_);
+        for (int iplane = 0; iplane < (int)macroplane_unique_ids_.size();
+             iplane++) {
+            int first         = first_reg_macroplane_[iplane];
+            const VecI &index =
+                rays_.region_index(macroplane_unique_ids_[iplane]);
+            for (int ireg = 0; ireg < (int)index.size(); ireg++) {
+                mesh_index_[first + index[ireg]] = first + ireg;
+            }
+        }
+        xstr_sweep_.resize(n_reg_);
+        qbar_sweep_.resize(n_reg_);
+    }
+
+    // Only the 1g kernel honours the weights of adaptively-spaced rays
+    bool other_kernel = multigroup_kernel_ || polar_kernel_ || packet_kernel_ ||
+                        kernel_3d_ || linear_source_ || cyclic_ || device_ ||
+                        autotune;
+    if (rays_.adaptive() && other_kernel) {
+        throw EXCEPT("Adaptive ray spacing is only supported by the 1g "
+                     "kernel, with a flat source and without cyclic or "
+                     "offloaded sweeps or autotuning.");
+    }
+
+    // Set up the groups that have their own rays and angular quadrature
+    group_set_index_.assign(n_group_, -1);
+    for (auto set_input = input.child("group_set"); set_input;
+         set_input = set_input.next_sibling("group_set")) {
+        if (multigroup_kernel_ || polar_kernel_ || stack_kernel_ ||
+            kernel_3d_ || linear_source_ || cyclic_ || device_) {
+            throw EXCEPT("Group sets are only supported by the 1g and packet "
+                         "kernels, with a flat source and without cyclic or "
+                         "offloaded sweeps.");
+        }
+        if (autotune || exp_cache_.n_cached() > 0 || rays_.renumbered() ||
+            rays_.out_of_core()) {
+            throw EXCEPT("Group sets are not supported with autotuning, the "
+                         "exponential cache, or renumbered or out-of-core "
+                         "rays.");
+        }
+
+        int first = set_input.attribute("first_group").as_int(-1);
+        int last  = set_input.attribute("last_group").as_int(-1);
+        if ((first < 0) || (last < first) || (last >= n_group_)) {
+            throw EXCEPT("Invalid group range for a group set.");
+        }
+        for (int ig = first; ig <= last; ig++) {
+            if (group_set_index_[ig] >= 0) {
+                throw EXCEPT("Group sets overlap.");
+            }
+            group_set_index_[ig] = group_sets_.size();
+        }
+        if (set_input.child("rays").empty()) {
+            throw EXCEPT("No <rays> specified for a group set.");
+        }
+
+        // Use the nearest <ang_quad>, as for the sweeper itself
+        pugi::xml_node quad_input;
+        for (auto node = set_input; node && quad_input.empty();
+             node = node.parent()) {
+            quad_input = node.child("ang_quad");
+        }
+        if (quad_input.empty()) {
+            throw EXCEPT("No angular quadrature found for a group set.");
+        }
+        AngularQuadrature quad(quad_input);
+        group_sets_.emplace_back(first, last, set_input.child("rays"), quad,
+                                 mesh_);
+        GroupSet &set = group_sets_.back();
+        if (set.rays.adaptive() && other_kernel) {
+            throw EXCEPT("Adaptive ray spacing is only supported by the 1g "
+                         "kernel.");
+        }
+        if (set.rays.renumbered() || set.rays.out_of_core()) {
+            throw EXCEPT("Group sets are not supported with renumbered or "
+                         "out-of-core rays.");
+        }
+
+        // Build everything that depends on the rays with the set swapped in
+        this->swap_group_set(set);
+        boundary_ = std::vector<BoundaryCondition>(
+            subplane_.size(),
+            BoundaryCondition(n_group_, ang_quad_, mesh_.boundary(),
+                              bc_size_helper(rays_)));
+        boundary_out_ = std::vector<BoundaryCondition>(
+            subplane_.size(), BoundaryCondition(1, ang_quad_, mesh_.boundary(),
+                                                bc_size_helper(rays_)));
+        if (balanced_schedule_) {
+            this->setup_schedule();
+        }
+        if (gauss_seidel_boundary_) {
+            this->setup_gs_order();
+        }
+        this->swap_group_set(set);
+
+        LogFile << "Groups " << first << " to " << last << " use "
+                << set.ang_quad.ndir() << " angles and "
+                << this->n_seg_planes(set.rays) << " ray segments, against "
+                << ang_quad_.ndir() << " angles and "
+                << this->n_seg_planes(rays_) << " ray segments for the rest"
+                << std::endl;
+    }
+
+    // Keep only the groups being swept in full precision on the boundaries,
+    // which is a whole block for the multi-group kernel
+    if (packed_boundary_) {
+        int n_resident = multigroup_kernel_ ? group_block_ : 1;
+        for (auto &boundary : boundary_) {
+            boundary.enable_packed_storage(n_resident);
+        }
+        for (auto &set : group_sets_) {
+            for (auto &boundary : set.boundary) {
+                boundary.enable_packed_storage(n_resident);
+            }
+        }
+        LogFile << "Storing the boundary flux of groups that aren't being "
+                   "swept in single precision"
+                << std::endl;
+    }
+
+    // Tabulate the regions and coarse cell of each pin of each macroplane,
+    // for projecting between the flat source regions and the pin mesh
+    pin_reg_.push_back(0);
+    {
+        int implane = 0;
+        for (const auto &mplane : mesh_.macroplanes()) {
+            int ipin = 0;
+            for (const auto mpin : mplane) {
+                Position pos = mesh_.pin_position(ipin);
+                pos.z        = implane;
+                int first    = pin_reg_.back();
+                real_t v     = 0.0;
+                for (int ir = 0; ir < mpin->n_reg(); ir++) {
+                    v += vol_[first + ir];
+                }
+                pin_reg_.push_back(first + mpin->n_reg());
+                pin_cell_.push_back(mesh_.coarse_cell(pos));
+                pin_rvol_.push_back(1.0 / v);
+                ipin++;
+            }
+            implane++;
+        }
+    }
+
+    // Set up Pn scattering
+    scat_order_ = input.attribute("scattering_order").as_int(0);
+    if (scat_order_ < 0) {
+        throw EXCEPT("Invalid scattering order (scattering_order).");
+    }
+    if (scat_order_ > 0) {
+        if (multigroup_kernel_ || polar_kernel_ || packet_kernel_ ||
+            stack_kernel_ || kernel_3d_ || linear_source_ || gmres_inner_ ||
+            cyclic_ || device_ || autotune || !group_sets_.empty()) {
+            throw EXCEPT("Pn scattering is only supported by the one-group, "
+                         "flat source kernel on the host, without cyclic "
+                         "sweeps, group sets, GMRES or autotuning.");
+        }
+        if (!rays_.ray_segments() || rays_.renumbered() ||
+            rays_.out_of_core() || rays_.adaptive()) {
+            throw EXCEPT("Pn scattering needs in-memory rays, without "
+                         "renumbering or adaptive spacing.");
+        }
+        if (scat_order_ > xs_mesh_->scat_order()) {
+            Warn("The scattering order exceeds that of the cross sections; "
+                 "the higher moments will have no scattering.");
+        }
+        if (mixed_precision_) {
+            Warn("Mixed precision is not used with Pn scattering");
+        }
+        if (!input.attribute("exp_cache").empty()) {
+            Warn("The exponential cache is not used with Pn scattering");
+        }
+        LogFile << "Using P" << scat_order_ << " scattering" << std::endl;
+
+        // The sweeps are 2-D, so only the harmonics that are even in the
+        // polar cosine have moments
+        harmonics_ = SphericalHarmonics(scat_order_, true);
+        int n_mom  = harmonics_.size() - 1;
+        flux_pn_.assign(n_mom, ArrayB2());
+        for (auto &flux_k : flux_pn_) {
+            flux_k.resize(n_reg_, n_group_);
+            flux_k = 0.0;
+        }
+
+        // Harmonics of each angle of the quadrature, without R_00
+        VecF y(harmonics_.size());
+        pn_table_.resize(ang_quad_.ndir() * n_mom);
+        for (int iang = 0; iang < ang_quad_.ndir(); iang++) {
+            harmonics_.evaluate(ang_quad_[iang], y.data());
+            std::copy(y.begin() + 1, y.end(), &pn_table_[iang * n_mom]);
+        }
+    }
+
+    // Set up the sweeping of uniform pins as macro-segments. The rays tally
+    // each such pin to its first region, and the flux is spread over the
+    // rest of the pin as it is reduced.
+    for (const auto &set : group_sets_) {
+        if (set.rays.macro_segments() != rays_.macro_segments()) {
+            throw EXCEPT("Group sets must use macro-segments if, and only "
+                         "if, the rest of the groups do.");
+        }
+    }
+    if (rays_.macro_segments()) {
+        if (multigroup_kernel_ || linear_source_ || device_ ||
+            (scat_order_ > 0)) {
+            throw EXCEPT("Macro-segments are only supported by the "
+                         "one-group, flat source kernels on the host, with "
+                         "isotropic scattering.");
+        }
+        int n_plane = macroplane_unique_ids_.size();
+        for (int iplane = 0; iplane < n_plane; iplane++) {
+            int first = first_reg_macroplane_[iplane];
+            for (const auto &pin :
+                 rays_.macro_pins(macroplane_unique_ids_[iplane])) {
+                real_t v = 0.0;
+                for (int ir = 0; ir < pin.n_reg; ir++) {
+                    v += vol_[first + pin.first_reg + ir];
+                }
+                macro_reg_.push_back(first + pin.first_reg);
+                macro_nreg_.push_back(pin.n_reg);
+                macro_rvol_.push_back(1.0 / v);
+                macro_plane_.push_back(iplane);
+            }
+        }
+        LogFile << "Sweeping " << macro_reg_.size()
+                << " pins as macro-segments" << std::endl;
+    }
+
+    // Set up per-plane convergence masking
+    int n_plane = mesh_.macroplanes().size();
+    plane_active_.assign(n_plane, true);
+    plane_tol_ = input.attribute("plane_tolerance").as_double(0.0);
+    if (plane_tol_ < 0.0) {
+        throw EXCEPT("Invalid plane convergence tolerance "
+                     "(plane_tolerance).");
+    }
+    plane_max_skip_ = input.attribute("plane_max_skip").as_int(3);
+    if (plane_max_skip_ < 0) {
+        throw EXCEPT("Invalid maximum number of plane skips "
+                     "(plane_max_skip).");
+    }
+    if (plane_tol_ > 0.0) {
+        if (multigroup_kernel_ || linear_source_ || device_ || kernel_3d_ ||
+            (scat_order_ > 0)) {
+            throw EXCEPT("Plane masking is only supported by the 2-D, "
+                         "one-group, flat source kernels on the host, with "
+                         "isotropic scattering.");
+        }
+        plane_resid_.resize(n_group_, n_plane);
+        plane_resid_ = -1.0;
+        plane_skipped_.assign(n_group_, VecI(n_plane, 0));
+        plane_flux_prev_.resize(n_reg_);
+        LogFile << "Skipping MoC planes that have changed by less than "
+                << plane_tol_ << std::endl;
+    }
+
+    // Record the work of each thread in the one-group sweeps, by macroplane
+    // and swept angle of the largest quadrature in use
+    if (input.attribute("workload_stats").as_bool(false)) {
+        int n_ang = ang_quad_.ndir_oct() * 2;
+        for (const auto &set : group_sets_) {
+            n_ang = std::max(n_ang, set.ang_quad.ndir_oct() * 2);
+        }
+        workload_.enable({(int)macroplane_unique_ids_.size(), n_ang});
+    }
+
+    timer_init_.toc();
+    timer_.toc();
+
+    return;
+} // MoCSweeper( input, mesh )
+
+void MoCSweeper::sweep(int group)
+{
+    assert(source_);
+    MOCC_PROFILE_ZONE("MoC Sweep");
+
+    timer_.tic();
+    timer_sweep_.tic();
+
+    n_sweep_++;
+
+    // Expand the cross sections, and perform splitting if necessary
+    xstr_.expand(group, split_);
+
+    if (multigroup_kernel_) {
+        // Stash the source and cross sections for this group. Once the last
+        // group of a block has been handed to us, sweep the whole block. Since
+        // the flux for the block is not touched until then, the in-scatter
+        // source within a block is Jacobi-style.
+        const auto &src = source_->get();
+        for (int i = 0; i < (int)n_reg_; i++) {
+            source_mg_(i, group) = src[i];
+            xstr_mg_(i, group)   = xstr_[i];
+        }
+
+        int g_first = (group / group_block_) * group_block_;
+        int g_last  = std::min(g_first + group_block_, n_group_) - 1;
+        if (group == g_last) {
+            this->sweep_block(g_first, g_last);
+        }
+        n_sweep_inner_ += n_inner_;
+
+        timer_.toc();
+        timer_sweep_.toc();
+        return;
+    }
+
+    flux_1g_.reference(flux_(blitz::Range::all(), group));
+
+    // The merged segments of macro pins need a flat source over each pin
+    if (!macro_reg_.empty()) {
+        this->flatten_macro_pins();
+    }
+
+    // Groups of a group set are swept with its rays and quadrature swapped
+    // in. The source is isotropic, so it needs no mapping between them.
+    GroupSet *group_set = nullptr;
+    int n_inner_start   = n_sweep_inner_;
+    if (group_set_index_[group] >= 0) {
+        group_set = &group_sets_[group_set_index_[group]];
+        this->swap_group_set(*group_set);
+    }
+    this->load_boundary(group, group);
+
+    // While autotuning, each sweep tries out the next configuration
+    bool tune_sample = tuner_ && tuner_->tuning();
+    real_t tune_time = 0.0;
+    real_t tune_seg  = 0.0;
+    if (tune_sample) {
+        this->apply_tuning(tuner_->candidate());
+        tune_time = omp_get_wtime();
+        tune_seg  = this->n_seg_swept();
+    }
+
+    // The 3-D sweeps only tally the scalar flux
+    if (kernel_3d_ && coarse_data_) {
+        throw EXCEPT("The 3-D MoC kernel does not produce currents for "
+                     "CMFD.");
+    }
+
+    this->set_plane_mask(group);
+
+    // With GMRES, converge the within-group problem with the incoming
+    // boundary flux held fixed, then finish with a single regular sweep
+    unsigned int n_inner = n_inner_;
+    if (gmres_inner_) {
+        std::vector<VecF> bc(boundary_.size());
+        for (int i = 0; i < (int)boundary_.size(); i++) {
+            bc[i].resize(boundary_[i].size_per_group());
+            boundary_[i].copy_group(group, bc[i].data());
+        }
+        n_sweep_inner_ += this->gmres_inner(flux_1g_, [&]() {
+            for (int i = 0; i < (int)boundary_.size(); i++) {
+                boundary_[i].set_group(group, bc[i].data());
+            }
+            source_->self_scatter(group, xstr_.xs());
+            this->sweep1g_nocurrent(group);
+        });
+        for (int i = 0; i < (int)boundary_.size(); i++) {
+            boundary_[i].set_group(group, bc[i].data());
+        }
+        n_inner = 1;
+    }
+    n_sweep_inner_ += n_inner;
+
+    // Perform inner iterations
+    for (unsigned int inner = 0; inner < n_inner; inner++) {
+        // update the self-scattering source
+        {
+            MOCC_PROFILE_ZONE("Self Scatter");
+            source_->self_scatter(group, xstr_.xs());
+        }
+
+        // Perform the stock sweep unless we are on the last outer and have
+        // a CoarseData object.
+        if (inner == n_inner - 1 && coarse_data_) {
+            // Wipe out the existing currents (only on X- and Y-normal
+            // faces)
+            this->stash_plane_currents(group);
+            coarse_data_->zero_data_radial(group);
+
+            moc::Current cw(coarse_data_, &mesh_);
+            if (linear_source_) {
+                this->sweep1g_ls(group, cw);
+            } else if (scat_order_ > 0) {
+                this->sweep1g_pn(group, cw);
+            } else {
+                this->sweep1g(group, cw);
+            }
+            this->restore_plane_currents(group);
+            coarse_data_->set_has_radial_data(true);
+        } else {
+            this->sweep1g_nocurrent(group);
+        }
+    }
+
+    this->finish_plane_mask(group);
+
+    if (group_set) {
+        n_seg_group_sets_ +=
+            (this->n_seg_planes(rays_) - this->n_seg_planes(group_set->rays)) *
+            (n_sweep_inner_ - n_inner_start);
+        this->swap_group_set(*group_set);
+    }
+
+    if (tune_sample) {
+        // Judge the configurations by their time per segment, since masked
+        // sweeps skip some of the planes
+        real_t n_seg = this->n_seg_swept() - tune_seg;
+        if (n_seg > 0.0) {
+            tuner_->record((omp_get_wtime() - tune_time) / n_seg);
+        }
+        if (!tuner_->tuning()) {
+            LogFile << "Autotuned MoC sweep (time per segment):" << std::endl;
+            for (const auto &c : tuner_->costs()) {
+                LogFile << "    " << c.first << ": " << c.second << std::endl;
+            }
+            LogFile << "Using " << tuner_->candidate() << std::endl;
+            this->apply_tuning(tuner_->candidate());
+        }
+    }
+
+    timer_.toc();
+    timer_sweep_.toc();
+    return;
+} // sweep( group )
+
+void MoCSweeper::setup_autotune(const pugi::xml_node &input,
+                                const std::string &exponential,
+                                bool tune_exponential, bool tune_schedule)
+{
+    if (multigroup_kernel_) {
+        Warn("Autotuning is not supported by the multi-group MoC kernel");
+        return;
+    }
+
+    // Exponential evaluators that are accurate enough
+    real_t tolerance = input.attribute("autotune_tolerance").as_double(1.0e-6);
+    std::vector<std::string> exps(1, exponential);
+    if (tune_exponential) {
+        exps.clear();
+        for (const auto &e :
+             {"exact", "linear", "clamped", "quadratic", "polynomial"}) {
+            if (ExponentialFactory(e)->max_error() <= tolerance) {
+                exps.push_back(e);
+            }
+        }
+        if (exps.empty()) {
+            throw EXCEPT("No exponential evaluator meets the autotuning "
+                         "tolerance");
+        }
+    }
+
+    // The cyclic sweep hands out whole tracks, so it has no schedule to pick
+    std::vector<std::string> schedules(
+        1, balanced_schedule_ ? "balanced" : "static");
+    if (tune_schedule && !cyclic_) {
+        schedules = {"balanced", "static"};
+    }
+
+    std::vector<std::string> candidates;
+    for (const auto &e : exps) {
+        for (const auto &s : schedules) {
+            candidates.push_back(e + " " + s);
+        }
+    }
+
+    // The best choice depends on the machine, the thread count and the
+    // size of the problem
+    char host[256] = "unknown";
+#ifdef __linux__
+    gethostname(host, sizeof(host) - 1);
+#endif
+    real_t n_seg = 0.0;
+    for (const auto plane_id : macroplane_unique_ids_) {
+        n_seg += rays_.n_segments(plane_id);
+    }
+    std::stringstream key;
+    key << host << " threads=" << omp_get_max_threads() << " regions=" << n_reg_
+        << " segments=" << n_seg << " mixed=" << mixed_precision_
+        << " ls=" << linear_source_ << " polar=" << polar_kernel_
+        << " packet=" << packet_kernel_;
+
+    std::string cache = "mocc_autotune.txt";
+    if (!input.attribute("autotune_cache").empty()) {
+        cache = input.attribute("autotune_cache").value();
+    }
+    int n_sample = input.attribute("autotune_samples").as_int(2);
+
+    tuner_.reset(new Autotuner(candidates, n_sample, cache, key.str()));
+    if (!tuner_->tuning()) {
+        LogFile << "Using " << (tuner_->cached() ? "cached " : "")
+                << "MoC sweep configuration: " << tuner_->candidate()
+                << std::endl;
+        this->apply_tuning(tuner_->candidate());
+    }
+
+    return;
+}
+
+void MoCSweeper::apply_tuning(const std::string &config)
+{
+    std::stringstream ss(config);
+    std::string exponential;
+    std::string schedule;
+    ss >> exponential >> schedule;
+
+    exp_               = ExponentialFactory(exponential);
+    balanced_schedule_ = schedule == "balanced";
+    return;
+}
+
+real_t MoCSweeper::n_seg_swept() const
+{
+    if (kernel_3d_) {
+        return n_seg_3d_;
+    }
+    return this->n_seg_planes(rays_) * n_sweep_inner_ - n_seg_skipped_ +
+           n_seg_group_sets_;
+}
+
+real_t MoCSweeper::n_seg_planes(const RayData &rays) const
+{
+    real_t n_seg = 0.0;
+    for (const auto plane_id : macroplane_unique_ids_) {
+        n_seg += rays.n_segments(plane_id);
+    }
+    return n_seg;
+}
+
+void MoCSweeper::sweep1g_nocurrent(int group)
+{
+    if (kernel_3d_) {
+        this->sweep1g_3d(group);
+    } else if (linear_source_) {
+        moc::NoCurrent cw(coarse_data_, &mesh_);
+        this->sweep1g_ls(group, cw);
+    } else if (scat_order_ > 0) {
+        moc::NoCurrent cw(coarse_data_, &mesh_);
+        this->sweep1g_pn(group, cw);
+    } else if (cyclic_) {
+        this->sweep1g_cyclic(group);
+    } else if (device_) {
+        this->sweep1g_device(group);
+    } else if (polar_kernel_) {
+        this->sweep1g_polar(group);
+    } else if (packet_kernel_) {
+        this->sweep1g_packet(group);
+    } else if (stack_kernel_) {
+        this->sweep1g_stacked(group);
+    } else if (mixed_precision_) {
+        moc::NoCurrent cw(coarse_data_, &mesh_);
+        this->sweep1g<moc::NoCurrent, float>(group, cw);
+    } else {
+        moc::NoCurrent cw(coarse_data_, &mesh_);
+        this->sweep1g(group, cw);
+    }
+    return;
+}
+
+void MoCSweeper::set_plane_mask(int group)
+{
+    if (plane_tol_ <= 0.0) {
+        return;
+    }
+
+    // Same criteria as the adaptive group sweeps of the FixedSourceSolver:
+    // skip planes that have stopped changing, but not forever
+    int n_plane = plane_active_.size();
+    for (int iplane = 0; iplane < n_plane; iplane++) {
+        real_t resid = plane_resid_(group, iplane);
+        bool skip    = (resid >= 0.0) && (resid < plane_tol_) &&
+                       (plane_skipped_[group][iplane] < plane_max_skip_);
+        plane_active_[iplane] = !skip;
+        if (skip) {
+            all_planes_active_ = false;
+            plane_skipped_[group][iplane]++;
+            n_plane_skipped_++;
+            n_seg_skipped_ +=
+                rays_.n_segments(macroplane_unique_ids_[iplane]) * n_inner_;
+        } else {
+            plane_skipped_[group][iplane] = 0;
+        }
+    }
+
+    plane_flux_prev_ = flux_1g_;
+
+    return;
+}
+
+void MoCSweeper::finish_plane_mask(int group)
+{
+    if (plane_tol_ <= 0.0) {
+        return;
+    }
+
+    int n_plane = plane_active_.size();
+    for (int iplane = 0; iplane < n_plane; iplane++) {
+        if (plane_active_[iplane]) {
+            int first   = first_reg_macroplane_[iplane];
+            int last    = first + nreg_plane_[iplane];
+            real_t e    = 0.0;
+            real_t norm = 0.0;
+            for (int i = first; i < last; i++) {
+                real_t d = flux_1g_(i) - plane_flux_prev_(i);
+                e += d * d;
+                norm += flux_1g_(i) * flux_1g_(i);
+            }
+            plane_resid_(group, iplane) =
+                (norm > 0.0) ? std::sqrt(e / norm) : 0.0;
+        }
+    }
+
+    plane_active_.assign(n_plane, true);
+    all_planes_active_ = true;
+
+    return;
+}
+
+void MoCSweeper::stash_plane_currents(int group)
+{
+    plane_current_stash_.clear();
+    if (all_planes_active_) {
+        return;
+    }
+
+    int iplane = 0;
+    for (const auto &mplane : mesh_.macroplanes()) {
+        if (!plane_active_[iplane]) {
+            for (int iz = mplane.iz_min; iz <= mplane.iz_max; iz++) {
+                for (int surf = mesh_.plane_surf_xy_begin(iz);
+                     surf != mesh_.plane_surf_end(iz); ++surf) {
+                    plane_current_stash_.push_back(
+                        coarse_data_->current(surf, group));
+                    plane_current_stash_.push_back(
+                        coarse_data_->surface_flux(surf, group));
+                }
+            }
+        }
+        iplane++;
+    }
+
+    return;
+}
+
+void MoCSweeper::restore_plane_currents(int group)
+{
+    if (all_planes_active_) {
+        return;
+    }
+
+    int iplane = 0;
+    auto it    = plane_current_stash_.cbegin();
+    for (const auto &mplane : mesh_.macroplanes()) {
+        if (!plane_active_[iplane]) {
+            for (int iz = mplane.iz_min; iz <= mplane.iz_max; iz++) {
+                for (int surf = mesh_.plane_surf_xy_begin(iz);
+                     surf != mesh_.plane_surf_end(iz); ++surf) {
+                    coarse_data_->current(surf, group)      = *(it++);
+                    coarse_data_->surface_flux(surf, group) = *(it++);
+                }
+            }
+        }
+        iplane++;
+    }
+    assert(it == plane_current_stash_.cend());
+
+    return;
+}
+
+void MoCSweeper::sweep1g_device(int group)
+{
+    assert(device_);
+    const int n_bc    = device_->n_bc_plane();
+    const int n_plane = macroplane_unique_ids_.size();
+
+    // Gather the incoming boundary values of all macroplanes
+    for (int iplane = 0; iplane < n_plane; iplane++) {
+        const real_t *bc = boundary_[iplane].get_boundary(group, 0).second;
+        std::copy(bc, bc + n_bc, device_bc_in_.begin() + iplane * n_bc);
+    }
+
+    const auto &qbar = source_->get_transport(0);
+    device_->sweep(xstr_.xs().data(), qbar.data(), device_bc_in_.data(),
+                   device_bc_out_.data(), device_tally_.data());
+
+    // Scatter the outgoing boundary values and update the incoming ones
+    for (int iplane = 0; iplane < n_plane; iplane++) {
+        real_t *bc = boundary_out_[iplane].get_boundary(0, 0).second;
+        std::copy(device_bc_out_.begin() + iplane * n_bc,
+                  device_bc_out_.begin() + (iplane + 1) * n_bc, bc);
+        boundary_[iplane].update(group, boundary_out_[iplane]);
+    }
+
+    // Scale by the volume and add back the source
+    int n_neg = 0;
+    int n_nan = 0;
+    for (int i = 0; i < (int)n_reg_; i++) {
+        real_t f = device_tally_[i] / (xstr_[i] * vol_[i]) + qbar[i] * FPI;
+        flux_1g_(i) = f;
+        if (!(f >= 0.0)) {
+            if (f != f) {
+                n_nan++;
+            } else {
+                n_neg++;
+            }
+        }
+    }
+    n_negative_[group] = n_neg;
+    n_nan_[group]      = n_nan;
+
+    return;
+} // sweep1g_device( group )
+
+void MoCSweeper::sweep1g_cyclic(int group)
+{
+    thread_flux_.resize(n_reg_);
+    workspace_.resize(3, rays_.max_segments() + 1);
+
+    // Only read from the exponential cache. Each ray is swept in both
+    // directions, possibly by different threads, so the cache isn't filled
+    // from here.
+    const real_t *e_cache = (split_.size() == 0)
+                                ? exp_cache_.group_data<real_t>(group)
+                                : nullptr;
+    if (e_cache && !exp_cache_.is_valid(group, xs_mesh_->state())) {
+        e_cache = nullptr;
+    }
+
+    this->gather_regions();
+    const real_t *xstr = this->sweep_xstr();
+
+#pragma omp parallel default(shared)
+    {
+        ArrayB1 e_tau(workspace_.get(0), blitz::shape(rays_.max_segments()),
+                      blitz::neverDeleteData);
+        thread_flux_.zero();
+        real_t *t_flux = thread_flux_.get();
+        real_t *et     = e_tau.data();
+
+        AlignedVector<float> mod_len(
+            rays_.expanded() ? rays_.max_segments() : 0);
+        AlignedVector<uint32_t> mod_idx(mod_len.size());
+        RayData::TraceScratch trace_scratch;
+
+        MOCC_PROFILE_ZONE("MoC Tracks");
+#pragma omp for schedule(dynamic)
+        for (int iu = 0; iu < (int)track_units_.size(); iu++) {
+            int iplane = track_units_[iu].first;
+            int itrack = track_units_[iu].second;
+            if (!plane_active_[iplane]) {
+                continue;
+            }
+            int plane_ray_id        = macroplane_unique_ids_[iplane];
+            int first_reg           = first_reg_macroplane_[iplane];
+            const auto &boundary_in = boundary_[iplane];
+            auto &boundary_out      = boundary_out_[iplane];
+            const TrackLink *links  = tracks_.links(plane_ray_id, itrack);
+            int n_links             = tracks_.n_links(plane_ray_id, itrack);
+            MOCC_PROFILE_COUNT(SEGMENTS, tracks_.n_seg(plane_ray_id, itrack));
+
+            // Only the first ray of the track starts from the boundary
+            // condition. The rest pick up the flux where the last one left
+            // off.
+            real_t psi = 0.0;
+            for (int il = 0; il < n_links; il++) {
+                const TrackLink &link = links[il];
+                const auto &ray = rays_[plane_ray_id][link.iang][link.iray];
+                const auto &packed_rays =
+                    rays_.packed(plane_ray_id)[link.iang];
+
+                int iang_dir =
+                    link.forward ? link.iang : ang_quad_.reverse(link.iang);
+                if (il == 0) {
+                    psi = boundary_in.get_boundary(group, iang_dir)
+                              .second[ray.bc(link.forward ? 0 : 1)];
+                }
+
+                const real_t *qbar = this->sweep_source(link.iang);
+                const Angle &ang   = ang_quad_[link.iang];
+                real_t rstheta     = ang.rsintheta;
+                real_t wt_v_st     = ang.weight * rays_.spacing(link.iang) *
+                                     mesh_.macroplanes()[iplane].height *
+                                     std::sin(ang.theta) * PI;
+
+                int nseg             = packed_rays.nseg(link.iray);
+                const float *seg_len = rays_.expanded()
+                                           ? mod_len.data()
+                                           : packed_rays.seg_len(link.iray);
+
+                auto sweep_ray = [&](const auto *seg_index) {
+                    if (e_cache) {
+                        const real_t *ce =
+                            e_cache + exp_cache_.offset(iplane, link.iang) +
+                            packed_rays.seg_offset(link.iray);
+                        for (int iseg = 0; iseg < nseg; iseg++) {
+                            et[iseg] = ce[iseg];
+                        }
+                    } else {
+                        for (int iseg = 0; iseg < nseg; iseg++) {
+                            int ireg = seg_index[iseg] + first_reg;
+                            et[iseg] = -xstr[ireg] * seg_len[iseg] * rstheta;
+                        }
+                        exp_->exp_n(et, et, nseg);
+                        for (int iseg = 0; iseg < nseg; iseg++) {
+                            et[iseg] = 1.0 - et[iseg];
+                        }
+                    }
+
+                    if (link.forward) {
+                        for (int iseg = 0; iseg < nseg; iseg++) {
+                            int ireg        = seg_index[iseg] + first_reg;
+                            real_t psi_diff = (psi - qbar[ireg]) * et[iseg];
+                            psi -= psi_diff;
+                            t_flux[ireg] += psi_diff * wt_v_st;
+                        }
+                    } else {
+                        for (int iseg = nseg - 1; iseg >= 0; iseg--) {
+                            int ireg        = seg_index[iseg] + first_reg;
+                            real_t psi_diff = (psi - qbar[ireg]) * et[iseg];
+                            psi -= psi_diff;
+                            t_flux[ireg] += psi_diff * wt_v_st;
+                        }
+                    }
+                };
+
+                if (rays_.expanded()) {
+                    rays_.expand(plane_ray_id, link.iang, link.iray,
+                                 trace_scratch, mod_len.data(), mod_idx.data());
+                    sweep_ray(mod_idx.data());
+                } else if (packed_rays.wide_index()) {
+                    sweep_ray(packed_rays.seg_index_32(link.iray));
+                } else {
+                    sweep_ray(packed_rays.seg_index_16(link.iray));
+                }
+
+                boundary_out.get_boundary(0, iang_dir)
+                    .second[ray.bc(link.forward ? 1 : 0)] = psi;
+            } // links
+        }     // tracks
+
+        // Pass the outgoing flux at the end of each track back to its start
+#pragma omp for
+        for (int iplane = 0; iplane < (int)plane_active_.size(); iplane++) {
+            if (plane_active_[iplane]) {
+                MOCC_PROFILE_ZONE("Boundary Update");
+                boundary_[iplane].update(group, boundary_out_[iplane]);
+            }
+        }
+
+        this->reduce_flux_1g(group);
+    } // OMP Parallel
+
+    return;
+} // sweep1g_cyclic( group )
+
+void MoCSweeper::sweep1g_polar(int group)
+{
+    thread_flux_.resize(n_reg_);
+
+    int max_polar = 0;
+    for (const auto &set : polar_sets_) {
+        max_polar = std::max(max_polar, (int)set.size());
+    }
+
+    this->gather_regions();
+    const real_t *xstr = this->sweep_xstr();
+
+#pragma omp parallel default(shared)
+    {
+        thread_flux_.zero();
+        real_t *t_flux = thread_flux_.get();
+
+        // Segment exponentials, with the polar angles innermost
+        AlignedVecF e_tau(rays_.max_segments() * max_polar);
+        real_t *MOCC_RESTRICT et = MOCC_ASSUME_ALIGNED(e_tau.data());
+
+        // Data for each polar angle of the current azimuth
+        VecF rstheta(max_polar);
+        VecF wt_v_st(max_polar);
+        VecF psi(max_polar);
+        VecF bc_wt(max_polar);
+        std::vector<const real_t *> qbar(max_polar);
+        std::vector<const real_t *> bc_in_1(max_polar);
+        std::vector<const real_t *> bc_in_2(max_polar);
+        std::vector<real_t *> bc_out_1(max_polar);
+        std::vector<real_t *> bc_out_2(max_polar);
+
+        AlignedVector<float> mod_len(
+            rays_.expanded() ? rays_.max_segments() : 0);
+        AlignedVector<uint32_t> mod_idx(mod_len.size());
+        RayData::TraceScratch trace_scratch;
+
+        // Sweep rays [ray_first, ray_last) of the azimuth iset in a
+        // macroplane, for all of its polar angles
+        auto sweep_rays = [&](int iplane, int iset, int ray_first,
+                              int ray_last) {
+            const VecI &set         = polar_sets_[iset];
+            const int n_pol         = set.size();
+            int plane_ray_id        = macroplane_unique_ids_[iplane];
+            int first_reg           = first_reg_macroplane_[iplane];
+            const auto &boundary_in = boundary_[iplane];
+            auto &boundary_out      = boundary_out_[iplane];
+            real_t height           = mesh_.macroplanes()[iplane].height;
+
+            // Number of angular fluxes carried along the rays. With
+            // Bickley-Naylor integration a single, polar-integrated flux
+            // stands in for all of the polar angles.
+            const int n_lane        = bickley_ ? 1 : n_pol;
+            const Exponential &e_fn = bickley_ ? *ki3_ : *exp_;
+
+            // The polar angles all trace the rays of the first one
+            const auto &ang_rays    = rays_[plane_ray_id][set.front()];
+            const auto &packed_rays = rays_.packed(plane_ray_id)[set.front()];
+
+            for (int ip = 0; ip < n_pol; ip++) {
+                int iang1    = set[ip];
+                int iang2    = ang_quad_.reverse(iang1);
+                Angle ang    = ang_quad_[iang1];
+                rstheta[ip]  = ang.rsintheta;
+                wt_v_st[ip]  = ang.weight * rays_.spacing(iang1) * height *
+                              std::sin(ang.theta) * PI;
+                qbar[ip]     = this->sweep_source(iang1);
+                bc_in_1[ip]  = boundary_in.get_boundary(group, iang1).second;
+                bc_in_2[ip]  = boundary_in.get_boundary(group, iang2).second;
+                bc_out_1[ip] = boundary_out.get_boundary(0, iang1).second;
+                bc_out_2[ip] = boundary_out.get_boundary(0, iang2).second;
+            }
+            if (bickley_) {
+                // The incoming flux is averaged over the polar angles, with
+                // the same weights as the tallies. The source is isotropic,
+                // so that of the first angle serves for all of them.
+                real_t wt_sum = 0.0;
+                for (int ip = 0; ip < n_pol; ip++) {
+                    wt_sum += wt_v_st[ip];
+                }
+                for (int ip = 0; ip < n_pol; ip++) {
+                    bc_wt[ip] = wt_v_st[ip] / wt_sum;
+                }
+                rstheta[0] = 1.0;
+                wt_v_st[0] = wt_sum;
+            }
+
+            MOCC_PROFILE_COUNT(SEGMENTS,
+                               2 * n_lane *
+                                   (packed_rays.seg_offset(ray_last) -
+                                    packed_rays.seg_offset(ray_first)));
+            MOCC_PROFILE_COUNT(EXPONENTIALS,
+                               n_lane * (packed_rays.seg_offset(ray_last) -
+                                         packed_rays.seg_offset(ray_first)));
+
+            const real_t *rst      = rstheta.data();
+            const real_t *wt       = wt_v_st.data();
+            real_t *p              = psi.data();
+            const real_t *const *q = qbar.data();
+
+            // Move the angular flux between the rays and the boundary
+            // conditions of each polar angle
+            auto load_bc = [&](const std::vector<const real_t *> &bc,
+                               int ibc) {
+                if (bickley_) {
+                    p[0] = 0.0;
+                    for (int ip = 0; ip < n_pol; ip++) {
+                        p[0] += bc_wt[ip] * bc[ip][ibc];
+                    }
+                } else {
+                    for (int ip = 0; ip < n_pol; ip++) {
+                        p[ip] = bc[ip][ibc];
+                    }
+                }
+            };
+            auto store_bc = [&](const std::vector<real_t *> &bc, int ibc) {
+                for (int ip = 0; ip < n_pol; ip++) {
+                    bc[ip][ibc] = p[bickley_ ? 0 : ip];
+                }
+            };
+
+            for (int iray = ray_first; iray < ray_last; iray++) {
+                const auto &ray = ang_rays[iray];
+
+                int bc1              = ray.bc(0);
+                int bc2              = ray.bc(1);
+                int nseg             = packed_rays.nseg(iray);
+                const float *seg_len = rays_.expanded()
+                                           ? mod_len.data()
+                                           : packed_rays.seg_len(iray);
+
+                auto sweep_ray = [&](const auto *seg_index) {
+                    for (int iseg = 0; iseg < nseg; iseg++) {
+                        int ireg  = seg_index[iseg] + first_reg;
+                        real_t t  = -xstr[ireg] * seg_len[iseg];
+                        real_t *e = et + iseg * n_lane;
+                        for (int ip = 0; ip < n_lane; ip++) {
+                            e[ip] = t * rst[ip];
+                        }
+                    }
+                    e_fn.exp_n(et, et, nseg * n_lane);
+                    for (int i = 0; i < nseg * n_lane; i++) {
+                        et[i] = 1.0 - et[i];
+                    }
+
+                    // Forward direction
+                    load_bc(bc_in_1, bc1);
+                    for (int iseg = 0; iseg < nseg; iseg++) {
+                        int ireg        = seg_index[iseg] + first_reg;
+                        const real_t *e = et + iseg * n_lane;
+                        real_t tally    = 0.0;
+#pragma omp simd reduction(+ : tally)
+                        for (int ip = 0; ip < n_lane; ip++) {
+                            real_t psi_diff = (p[ip] - q[ip][ireg]) * e[ip];
+                            p[ip] -= psi_diff;
+                            tally += psi_diff * wt[ip];
+                        }
+                        t_flux[ireg] += tally;
+                    }
+                    store_bc(bc_out_1, bc2);
+
+                    // Backward direction
+                    load_bc(bc_in_2, bc2);
+                    for (int iseg = nseg - 1; iseg >= 0; iseg--) {
+                        int ireg        = seg_index[iseg] + first_reg;
+                        const real_t *e = et + iseg * n_lane;
+                        real_t tally    = 0.0;
+#pragma omp simd reduction(+ : tally)
+                        for (int ip = 0; ip < n_lane; ip++) {
+                            real_t psi_diff = (p[ip] - q[ip][ireg]) * e[ip];
+                            p[ip] -= psi_diff;
+                            tally += psi_diff * wt[ip];
+                        }
+                        t_flux[ireg] += tally;
+                    }
+                    store_bc(bc_out_2, bc1);
+                };
+
+                if (rays_.expanded()) {
+                    rays_.expand(plane_ray_id, set.front(), iray,
+                                 trace_scratch, mod_len.data(), mod_idx.data());
+                    sweep_ray(mod_idx.data());
+                } else if (packed_rays.wide_index()) {
+                    sweep_ray(packed_rays.seg_index_32(iray));
+                } else {
+                    sweep_ray(packed_rays.seg_index_16(iray));
+                }
+            } // Rays
+        };
+
+        {
+            MOCC_PROFILE_ZONE("MoC Rays");
+            const int n_plane = plane_active_.size();
+            const int n_set   = polar_sets_.size();
+            for (int iplane = 0; iplane < n_plane; iplane++) {
+                if (!plane_active_[iplane]) {
+                    continue;
+                }
+                int plane_ray_id = macroplane_unique_ids_[iplane];
+
+                for (int iset = 0; iset < n_set; iset++) {
+                    int iang = polar_sets_[iset].front();
+                    if (balanced_schedule_) {
+                        const auto &units =
+                            schedule_.angle_units(plane_ray_id, iang);
+#pragma omp for schedule(dynamic)
+                        for (int iu = 0; iu < (int)units.size(); iu++) {
+                            const auto &unit = units[iu];
+                            sweep_rays(iplane, iset, unit.first_ray,
+                                       unit.last_ray);
+                        }
+                    } else {
+                        int n_rays = rays_[plane_ray_id][iang].size();
+#pragma omp for schedule(static, 1)
+                        for (int iray = 0; iray < n_rays; iray++) {
+                            sweep_rays(iplane, iset, iray, iray + 1);
+                        }
+                    }
+
+                    if (gauss_seidel_boundary_)
+#pragma omp single
+                    {
+                        MOCC_PROFILE_ZONE("Boundary Update");
+                        for (int iang1 : polar_sets_[iset]) {
+                            boundary_[iplane].update(group, iang1,
+                                                     boundary_out_[iplane]);
+                            boundary_[iplane].update(group,
+                                                     ang_quad_.reverse(iang1),
+                                                     boundary_out_[iplane]);
+                        }
+                    }
+                } // azimuths
+
+                if (!gauss_seidel_boundary_)
+#pragma omp single
+                {
+                    MOCC_PROFILE_ZONE("Boundary Update");
+                    boundary_[iplane].update(group, boundary_out_[iplane]);
+                }
+            } // planes
+        }
+
+        this->reduce_flux_1g(group);
+    } // OMP Parallel
+
+    return;
+} // sweep1g_polar( group )
+
+void MoCSweeper::sweep1g_packet(int group)
+{
+    thread_flux_.resize(n_reg_);
+
+    this->gather_regions();
+    const real_t *xstr = this->sweep_xstr();
+
+    moc::NoCurrent cw(coarse_data_, &mesh_);
+    cw.set_group(group);
+
+#pragma omp parallel default(shared)
+    {
+        thread_flux_.zero();
+        real_t *t_flux = thread_flux_.get();
+
+        // Exponentials and regions of the segments of a packet, with the
+        // rays innermost
+        const int max_seg = rays_.max_segments();
+        AlignedVecF e_tau(max_seg * packet_width);
+        AlignedVector<int> reg(max_seg * packet_width);
+        real_t *MOCC_RESTRICT et = MOCC_ASSUME_ALIGNED(e_tau.data());
+        int *MOCC_RESTRICT ir    = reg.data();
+
+        // Per-lane state of a packet
+        alignas(64) real_t psi[packet_width];
+        alignas(64) real_t tally[packet_width];
+        int nseg[packet_width];
+        int bc1[packet_width];
+        int bc2[packet_width];
+
+        VecI order;
+        AlignedVector<float> mod_len(rays_.expanded() ? max_seg : 0);
+        AlignedVector<uint32_t> mod_idx(mod_len.size());
+        RayData::TraceScratch trace_scratch;
+
+        // Sweep rays [ray_first, ray_last) of a single angle in a macroplane
+        auto sweep_rays = [&](int iplane, int iang, int ray_first,
+                              int ray_last) {
+            int plane_ray_id        = macroplane_unique_ids_[iplane];
+            int first_reg           = first_reg_macroplane_[iplane];
+            const auto &boundary_in = boundary_[iplane];
+            auto &boundary_out      = boundary_out_[iplane];
+            const auto &ang_rays    = rays_[plane_ray_id][iang];
+            const auto &packed_rays = rays_.packed(plane_ray_id)[iang];
+
+            const real_t *qbar = this->sweep_source(iang);
+
+            int iang1 = iang;
+            int iang2 = ang_quad_.reverse(iang);
+            Angle ang = ang_quad_[iang];
+
+            const real_t *bc_in_1 =
+                boundary_in.get_boundary(group, iang1).second;
+            real_t *bc_out_1 = boundary_out.get_boundary(0, iang1).second;
+            const real_t *bc_in_2 =
+                boundary_in.get_boundary(group, iang2).second;
+            real_t *bc_out_2 = boundary_out.get_boundary(0, iang2).second;
+
+            real_t rstheta = ang.rsintheta;
+            real_t wt_v_st = ang.weight * rays_.spacing(iang) *
+                             mesh_.macroplanes()[iplane].height *
+                             std::sin(ang.theta) * PI;
+
+            MOCC_PROFILE_COUNT(SEGMENTS,
+                               2 * (packed_rays.seg_offset(ray_last) -
+                                    packed_rays.seg_offset(ray_first)));
+            MOCC_PROFILE_COUNT(EXPONENTIALS,
+                               packed_rays.seg_offset(ray_last) -
+                                   packed_rays.seg_offset(ray_first));
+
+            // Longest rays first, so that the rays of each packet are of
+            // similar length
+            order.resize(ray_last - ray_first);
+            for (int i = 0; i < (int)order.size(); i++) {
+                order[i] = ray_first + i;
+            }
+            std::stable_sort(order.begin(), order.end(), [&](int l, int r) {
+                return packed_rays.nseg(l) > packed_rays.nseg(r);
+            });
+
+            for (int first = 0; first < (int)order.size();
+                 first += packet_width) {
+                int n_ray = std::min(packet_width, (int)order.size() - first);
+                int n_step = packed_rays.nseg(order[first]);
+
+                // Gather the segments of each ray into its lane, padding
+                // the short rays (and the unused lanes) with empty
+                // segments
+                for (int l = 0; l < packet_width; l++) {
+                    nseg[l] = 0;
+                    bc1[l]  = 0;
+                    bc2[l]  = 0;
+                    if (l < n_ray) {
+                        int iray = order[first + l];
+                        nseg[l]  = packed_rays.nseg(iray);
+                        bc1[l]   = ang_rays[iray].bc(0);
+                        bc2[l]   = ang_rays[iray].bc(1);
+
+                        const float *seg_len = rays_.expanded()
+                                                   ? mod_len.data()
+                                                   : packed_rays.seg_len(iray);
+                        auto gather = [&](const auto *seg_index) {
+                            for (int iseg = 0; iseg < nseg[l]; iseg++) {
+                                int ireg = seg_index[iseg] + first_reg;
+                                ir[iseg * packet_width + l] = ireg;
+                                et[iseg * packet_width + l] =
+                                    -xstr[ireg] * seg_len[iseg] * rstheta;
+                            }
+                        };
+                        if (rays_.expanded()) {
+                            rays_.expand(plane_ray_id, iang, iray,
+                                         trace_scratch, mod_len.data(),
+                                         mod_idx.data());
+                            gather(mod_idx.data());
+                        } else if (packed_rays.wide_index()) {
+                            gather(packed_rays.seg_index_32(iray));
+                        } else {
+                            gather(packed_rays.seg_index_16(iray));
+                        }
+                    }
+                    for (int iseg = nseg[l]; iseg < n_step; iseg++) {
+                        ir[iseg * packet_width + l] = first_reg;
+                        et[iseg * packet_width + l] = 0.0;
+                    }
+                }
+
+                exp_->exp_n(et, et, n_step * packet_width);
+                for (int i = 0; i < n_step * packet_width; i++) {
+                    et[i] = 1.0 - et[i];
+                }
+                // The exponential tables need not be exact at zero
+                for (int l = 0; l < packet_width; l++) {
+                    for (int iseg = nseg[l]; iseg < n_step; iseg++) {
+                        et[iseg * packet_width + l] = 0.0;
+                    }
+                }
+
+                // Sweep one segment of every ray of the packet
+                auto step = [&](int iseg) {
+                    const int *r    = ir + iseg * packet_width;
+                    const real_t *e = et + iseg * packet_width;
+#pragma omp simd
+                    for (int l = 0; l < packet_width; l++) {
+                        real_t psi_diff = (psi[l] - qbar[r[l]]) * e[l];
+                        psi[l] -= psi_diff;
+                        tally[l] = psi_diff * wt_v_st;
+                    }
+                    // Several lanes may hit the same region
+                    for (int l = 0; l < packet_width; l++) {
+                        t_flux[r[l]] += tally[l];
+                    }
+                };
+
+                // Forward direction
+                for (int l = 0; l < packet_width; l++) {
+                    psi[l] = (l < n_ray) ? bc_in_1[bc1[l]] : 0.0;
+                }
+                for (int iseg = 0; iseg < n_step; iseg++) {
+                    step(iseg);
+                }
+                for (int l = 0; l < n_ray; l++) {
+                    bc_out_1[bc2[l]] = psi[l];
+                }
+
+                // Backward direction. The padding at the end of the short
+                // rays is swept first, leaving their incoming flux alone.
+                for (int l = 0; l < packet_width; l++) {
+                    psi[l] = (l < n_ray) ? bc_in_2[bc2[l]] : 0.0;
+                }
+                for (int iseg = n_step - 1; iseg >= 0; iseg--) {
+                    step(iseg);
+                }
+                for (int l = 0; l < n_ray; l++) {
+                    bc_out_2[bc1[l]] = psi[l];
+                }
+            } // Packets
+        };
+
+        {
+            MOCC_PROFILE_ZONE("MoC Rays");
+            this->sweep_planes(group, cw, sweep_rays);
+        }
+
+#pragma omp barrier
+        this->reduce_flux_1g(group);
+    } // OMP Parallel
+
+    return;
+} // sweep1g_packet( group )
+
+void MoCSweeper::sweep1g_stacked(int group)
+{
+    thread_flux_.resize(n_reg_);
+
+    this->gather_regions();
+    const real_t *xstr = this->sweep_xstr();
+
+#pragma omp parallel default(shared)
+    {
+        thread_flux_.zero();
+        real_t *t_flux = thread_flux_.get();
+
+        // Exponentials of the segments of a ray, with the planes of the
+        // stack innermost
+        const int max_seg = rays_.max_segments();
+        AlignedVecF e_tau(max_seg * max_stack_);
+        real_t *MOCC_RESTRICT et = MOCC_ASSUME_ALIGNED(e_tau.data());
+
+        // Per-plane state of the active planes of a stack
+        VecI first_reg(max_stack_);
+        VecF wt_v_st(max_stack_);
+        VecF psi(max_stack_);
+        std::vector<const real_t *> bc_in_1(max_stack_);
+        std::vector<const real_t *> bc_in_2(max_stack_);
+        std::vector<real_t *> bc_out_1(max_stack_);
+        std::vector<real_t *> bc_out_2(max_stack_);
+
+        AlignedVector<float> mod_len(rays_.expanded() ? max_seg : 0);
+        AlignedVector<uint32_t> mod_idx(mod_len.size());
+        RayData::TraceScratch trace_scratch;
+
+#pragma omp for schedule(dynamic)
+        for (int iu = 0; iu < (int)stack_units_.size(); iu++) {
+            MOCC_PROFILE_ZONE("MoC Rays");
+            const VecI &stack       = plane_stacks_[stack_units_[iu].first];
+            const WorkUnit &unit    = stack_units_[iu].second;
+            int plane_ray_id        = macroplane_unique_ids_[stack[0]];
+            int iang1               = unit.iang;
+            int iang2               = ang_quad_.reverse(iang1);
+            const auto &ang_rays    = rays_[plane_ray_id][iang1];
+            const auto &packed_rays = rays_.packed(plane_ray_id)[iang1];
+            Angle ang               = ang_quad_[iang1];
+            real_t rstheta          = ang.rsintheta;
+
+            const real_t *qbar = this->sweep_source(iang1);
+
+            int n_plane = 0;
+            for (int iplane : stack) {
+                if (!plane_active_[iplane]) {
+                    continue;
+                }
+                const auto &boundary_in = boundary_[iplane];
+                auto &boundary_out      = boundary_out_[iplane];
+                first_reg[n_plane]      = first_reg_macroplane_[iplane];
+                wt_v_st[n_plane] = ang.weight * rays_.spacing(iang1) *
+                                   mesh_.macroplanes()[iplane].height *
+                                   std::sin(ang.theta) * PI;
+                bc_in_1[n_plane] =
+                    boundary_in.get_boundary(group, iang1).second;
+                bc_in_2[n_plane] =
+                    boundary_in.get_boundary(group, iang2).second;
+                bc_out_1[n_plane] =
+                    boundary_out.get_boundary(0, iang1).second;
+                bc_out_2[n_plane] =
+                    boundary_out.get_boundary(0, iang2).second;
+                n_plane++;
+            }
+            if (n_plane == 0) {
+                continue;
+            }
+
+            int n_seg_unit = packed_rays.seg_offset(unit.last_ray) -
+                             packed_rays.seg_offset(unit.first_ray);
+            MOCC_PROFILE_COUNT(SEGMENTS, 2 * n_seg_unit * n_plane);
+            MOCC_PROFILE_COUNT(EXPONENTIALS, n_seg_unit * n_plane);
+
+            for (int iray = unit.first_ray; iray < unit.last_ray; iray++) {
+                const auto &ray = ang_rays[iray];
+                int bc1         = ray.bc(0);
+                int bc2         = ray.bc(1);
+                real_t wt       = ray.weight();
+                int nseg        = packed_rays.nseg(iray);
+                const float *seg_len = rays_.expanded()
+                                           ? mod_len.data()
+                                           : packed_rays.seg_len(iray);
+
+                auto sweep_ray = [&](const auto *seg_index) {
+                    // The segments are the same in every plane, but the
+                    // cross sections are not
+                    for (int iseg = 0; iseg < nseg; iseg++) {
+                        int ireg  = seg_index[iseg];
+                        real_t sl = -seg_len[iseg] * rstheta;
+                        for (int ip = 0; ip < n_plane; ip++) {
+                            et[iseg * n_plane + ip] =
+                                xstr[ireg + first_reg[ip]] * sl;
+                        }
+                    }
+                    exp_->exp_n(et, et, nseg * n_plane);
+                    for (int i = 0; i < nseg * n_plane; i++) {
+                        et[i] = 1.0 - et[i];
+                    }
+
+                    auto step = [&](int iseg) {
+                        int ireg        = seg_index[iseg];
+                        const real_t *e = et + iseg * n_plane;
+                        for (int ip = 0; ip < n_plane; ip++) {
+                            int r           = ireg + first_reg[ip];
+                            real_t psi_diff = (psi[ip] - qbar[r]) * e[ip];
+                            psi[ip] -= psi_diff;
+                            t_flux[r] += psi_diff * wt_v_st[ip] * wt;
+                        }
+                    };
+
+                    // Forward direction
+                    for (int ip = 0; ip < n_plane; ip++) {
+                        psi[ip] = bc_in_1[ip][bc1];
+                    }
+                    for (int iseg = 0; iseg < nseg; iseg++) {
+                        step(iseg);
+                    }
+                    for (int ip = 0; ip < n_plane; ip++) {
+                        bc_out_1[ip][bc2] = psi[ip];
+                        for (const auto &shadow : ray.shadow_bc()) {
+                            bc_out_1[ip][shadow[1]] = psi[ip];
+                        }
+                    }
+
+                    // Backward direction
+                    for (int ip = 0; ip < n_plane; ip++) {
+                        psi[ip] = bc_in_2[ip][bc2];
+                    }
+                    for (int iseg = nseg - 1; iseg >= 0; iseg--) {
+                        step(iseg);
+                    }
+                    for (int ip = 0; ip < n_plane; ip++) {
+                        bc_out_2[ip][bc1] = psi[ip];
+                        for (const auto &shadow : ray.shadow_bc()) {
+                            bc_out_2[ip][shadow[0]] = psi[ip];
+                        }
+                    }
+                };
+
+                if (rays_.expanded()) {
+                    rays_.expand(plane_ray_id, iang1, iray, trace_scratch,
+                                 mod_len.data(), mod_idx.data());
+                    sweep_ray(mod_idx.data());
+                } else if (packed_rays.wide_index()) {
+                    sweep_ray(packed_rays.seg_index_32(iray));
+                } else {
+                    sweep_ray(packed_rays.seg_index_16(iray));
+                }
+            } // Rays
+        }     // Units
+
+        const int n_plane = macroplane_unique_ids_.size();
+#pragma omp for
+        for (int iplane = 0; iplane < n_plane; iplane++) {
+            if (plane_active_[iplane]) {
+                MOCC_PROFILE_ZONE("Boundary Update");
+                boundary_[iplane].update(group, boundary_out_[iplane]);
+            }
+        }
+
+        this->reduce_flux_1g(group);
+    } // OMP Parallel
+
+    return;
+} // sweep1g_stacked( group )
+
+void MoCSweeper::sweep1g_3d(int group)
+{
+    thread_flux_.resize(n_reg_);
+
+    this->gather_regions();
+    const real_t *xstr = this->sweep_xstr();
+    const real_t *qbar = this->sweep_source(0);
+
+    // Start each line from the flux that left the top or bottom through the
+    // other family of lines on the last sweep
+    const int n_lines = axial_tracks_.n_lines();
+    real_t *bc_out    = &axial_bc_[(size_t)group * n_lines];
+    const real_t *bc_in = axial_bc_in_.data();
+    axial_tracks_.incoming(bc_out, axial_bc_in_.data());
+
+    real_t n_seg = 0.0;
+#pragma omp parallel default(shared) reduction(+ : n_seg)
+    {
+        thread_flux_.zero();
+        real_t *t_flux = thread_flux_.get();
+
+        std::vector<AxialSegment> segments;
+        AlignedVector<real_t> e_tau;
+
+        MOCC_PROFILE_ZONE("MoC 3-D Lines");
+        // The rising and falling lines of each track are handed out
+        // separately, longest tracks first
+#pragma omp for schedule(dynamic)
+        for (int iu = 0; iu < 2 * axial_tracks_.n_tracks(); iu++) {
+            int itrack   = iu / 2;
+            bool falling = iu % 2;
+            int first    = axial_tracks_.first_line(itrack, falling);
+            for (int iline = 0; iline < axial_tracks_.n_lines(itrack);
+                 iline++) {
+                bool on_surface =
+                    axial_tracks_.trace(itrack, iline, falling, segments);
+                int nseg = segments.size();
+                e_tau.resize(nseg);
+                real_t *et = e_tau.data();
+                for (int iseg = 0; iseg < nseg; iseg++) {
+                    et[iseg] = -xstr[segments[iseg].reg] * segments[iseg].len;
+                }
+                exp_->exp_n(et, et, nseg);
+
+                real_t psi = bc_in[first + iline];
+                for (int iseg = 0; iseg < nseg; iseg++) {
+                    const AxialSegment &seg = segments[iseg];
+                    real_t psi_diff = (psi - qbar[seg.reg]) * (1.0 - et[iseg]);
+                    psi -= psi_diff;
+                    t_flux[seg.reg] += psi_diff * seg.wt;
+                }
+
+                // Flux leaving through the radial boundary of an open track
+                // isn't needed again
+                bc_out[first + iline] = on_surface ? psi : 0.0;
+                n_seg += nseg;
+            }
+        }
+
+        this->reduce_flux_1g(group);
+    } // OMP Parallel
+
+    n_seg_3d_ += n_seg;
+    return;
+} // sweep1g_3d( group )
+
+void MoCSweeper::reduce_flux_1g(int group)
+{
+    MOCC_PROFILE_ZONE("Reduction");
+#pragma omp single
+    {
+        n_negative_[group] = 0;
+        n_nan_[group]      = 0;
+    }
+
+    // Count the bad values as we go, rather than sending the caller over
+    // the whole flux again
+    int n_neg = 0;
+    int n_nan = 0;
+
+    // \todo this is not correct for angle-dependent sources!
+    auto &qbar  = source_->get_transport(0);
+    auto update = [&](int i, real_t v) {
+        int ireg       = this->mesh_region(i);
+        real_t f       = v / (xstr_[ireg] * vol_[ireg]) + qbar[ireg] * FPI;
+        flux_1g_(ireg) = f;
+        if (!(f >= 0.0)) {
+            if (f != f) {
+                n_nan++;
+            } else {
+                n_neg++;
+            }
+        }
+    };
+    if (all_planes_active_) {
+        thread_flux_.reduce(update);
+    } else {
+        // Leave the flux of the skipped planes alone
+        const int n_plane = plane_active_.size();
+        for (int iplane = 0; iplane < n_plane; iplane++) {
+            if (plane_active_[iplane]) {
+                int first = first_reg_macroplane_[iplane];
+                thread_flux_.reduce(first, first + nreg_plane_[iplane],
+                                    update);
+            }
+        }
+    }
+
+#pragma omp atomic
+    n_negative_[group] += n_neg;
+#pragma omp atomic
+    n_nan_[group] += n_nan;
+
+    // The whole tally of each macro pin went to its first region, so rescale
+    // it by the volume of the pin and spread it over the pin
+    if (!macro_reg_.empty()) {
+#pragma omp barrier
+        const int n_macro = macro_reg_.size();
+#pragma omp for
+        for (int ip = 0; ip < n_macro; ip++) {
+            if (!plane_active_[macro_plane_[ip]]) {
+                continue;
+            }
+            int first = macro_reg_[ip];
+            real_t q  = qbar[first] * FPI;
+            real_t f =
+                (flux_1g_(first) - q) * vol_[first] * macro_rvol_[ip] + q;
+            for (int ir = first; ir < first + macro_nreg_[ip]; ir++) {
+                flux_1g_(ir) = f;
+            }
+        }
+    }
+
+    return;
+}
+
+void MoCSweeper::flatten_macro_pins()
+{
+    const int n_macro = macro_reg_.size();
+#pragma omp parallel for schedule(static)
+    for (int ip = 0; ip < n_macro; ip++) {
+        int first = macro_reg_[ip];
+        real_t f  = 0.0;
+        real_t q  = 0.0;
+        for (int ir = first; ir < first + macro_nreg_[ip]; ir++) {
+            f += flux_1g_(ir) * vol_[ir];
+            q += (*source_)[ir] * vol_[ir];
+        }
+        f *= macro_rvol_[ip];
+        q *= macro_rvol_[ip];
+        for (int ir = first; ir < first + macro_nreg_[ip]; ir++) {
+            flux_1g_(ir)   = f;
+            (*source_)[ir] = q;
+        }
+    }
+
+    return;
+}
+
+void MoCSweeper::gather_regions()
+{
+    if (mesh_index_.empty()) {
+        return;
+    }
+
+    const auto &qbar = source_->get_transport(0);
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < (int)n_reg_; i++) {
+        int ireg       = mesh_index_[i];
+        xstr_sweep_[i] = xstr_[ireg];
+        qbar_sweep_[i] = qbar[ireg];
+    }
+
+    return;
+} // gather_regions()
+
+void MoCSweeper::setup_gs_order()
+{
+    // Angles are swept together with their reverse, so find which of the
+    // swept angles each angle of the quadrature belongs to
+    const int n_ang = ang_quad_.ndir_oct() * 2;
+    VecI swept(ang_quad_.ndir(), -1);
+    for (int iang = 0; iang < n_ang; iang++) {
+        swept[iang]                    = iang;
+        swept[ang_quad_.reverse(iang)] = iang;
+    }
+
+    // All macroplanes have the same radial boundary conditions, so the
+    // first one stands for all of them
+    std::vector<VecI> writes(n_ang);
+    for (int iang = 0; iang < n_ang; iang++) {
+        for (int iang_out : {iang, (int)ang_quad_.reverse(iang)}) {
+            for (int target : boundary_.front().update_targets(iang_out)) {
+                assert(swept[target] >= 0);
+                writes[iang].push_back(swept[target]);
+            }
+        }
+        std::sort(writes[iang].begin(), writes[iang].end());
+        writes[iang].erase(
+            std::unique(writes[iang].begin(), writes[iang].end()),
+            writes[iang].end());
+    }
+
+    gs_sweep_after_.assign(n_ang, VecI());
+    gs_update_after_.assign(n_ang, VecI());
+    for (int iang = 0; iang < n_ang; iang++) {
+        for (int jang : writes[iang]) {
+            if (jang > iang) {
+                gs_sweep_after_[jang].push_back(iang);
+            } else if (jang < iang) {
+                gs_update_after_[iang].push_back(jang);
+            }
+        }
+    }
+
+    gs_first_unit_.assign(n_ang + 1, 0);
+    gs_next_unit_.reset(new std::atomic<int>(0));
+    gs_remaining_.reset(new std::atomic<int>[n_ang]);
+    gs_updated_.reset(new std::atomic<int>[n_ang]);
+    return;
+}
+
+void MoCSweeper::setup_schedule()
+{
+    // Balance the work for the threads that will actually sweep
+    ThreadTeam team(Phase::SWEEP);
+    schedule_ = SweepSchedule(rays_, omp_get_max_threads());
+    macroplane_units_.clear();
+    for (int iplane = 0; iplane < (int)macroplane_unique_ids_.size();
+         iplane++) {
+        for (const auto &unit :
+             schedule_.plane_units(macroplane_unique_ids_[iplane])) {
+            macroplane_units_.emplace_back(iplane, unit);
+        }
+    }
+    std::stable_sort(macroplane_units_.begin(), macroplane_units_.end(),
+                     [](const std::pair<int, WorkUnit> &l,
+                        const std::pair<int, WorkUnit> &r) {
+                         return l.second.n_seg > r.second.n_seg;
+                     });
+    return;
+}
+
+void MoCSweeper::setup_stacks()
+{
+    // The stacked kernel always hands out balanced work units
+    if (macroplane_units_.empty()) {
+        this->setup_schedule();
+    }
+
+    plane_stacks_.clear();
+    std::map<int, int> stack_index;
+    for (int iplane = 0; iplane < (int)macroplane_unique_ids_.size();
+         iplane++) {
+        int id = macroplane_unique_ids_[iplane];
+        if (stack_index.count(id) == 0) {
+            stack_index[id] = plane_stacks_.size();
+            plane_stacks_.emplace_back();
+        }
+        plane_stacks_[stack_index[id]].push_back(iplane);
+    }
+
+    // Weigh the units by the segments swept over the whole stack
+    stack_units_.clear();
+    max_stack_ = 0;
+    for (int istack = 0; istack < (int)plane_stacks_.size(); istack++) {
+        const VecI &stack = plane_stacks_[istack];
+        max_stack_        = std::max(max_stack_, (int)stack.size());
+        for (auto unit :
+             schedule_.plane_units(macroplane_unique_ids_[stack[0]])) {
+            unit.n_seg *= stack.size();
+            stack_units_.emplace_back(istack, unit);
+        }
+    }
+    std::stable_sort(stack_units_.begin(), stack_units_.end(),
+                     [](const std::pair<int, WorkUnit> &l,
+                        const std::pair<int, WorkUnit> &r) {
+                         return l.second.n_seg > r.second.n_seg;
+                     });
+    return;
+}
+
+void MoCSweeper::swap_group_set(GroupSet &set)
+{
+    std::swap(rays_, set.rays);
+    std::swap(ang_quad_, set.ang_quad);
+    boundary_.swap(set.boundary);
+    boundary_out_.swap(set.boundary_out);
+    std::swap(schedule_, set.schedule);
+    macroplane_units_.swap(set.macroplane_units);
+    gs_sweep_after_.swap(set.gs_sweep_after);
+    gs_update_after_.swap(set.gs_update_after);
+    gs_first_unit_.swap(set.gs_first_unit);
+    gs_remaining_.swap(set.gs_remaining);
+    gs_updated_.swap(set.gs_updated);
+    return;
+}
 
-    // Make sure we have input from the XML
-    if (input.empty()) {
-        throw EXCEPT("No input specified to initialize MoC sweeper.");
+void MoCSweeper::load_boundary(int g_first, int g_last)
+{
+    if (!packed_boundary_) {
+        return;
     }
-
-    // Parse the number of inner iterations
-    int int_in = input.attribute("n_inner").as_int(-1);
-    if (int_in < 0) {
-        throw EXCEPT("Invalid number of inner iterations specified "
-                     "(n_inner).");
+    for (auto &boundary : boundary_) {
+        for (int ig = g_first; ig <= g_last; ig++) {
+            boundary.load(ig);
+        }
     }
-    n_inner_ = int_in;
+    return;
+}
 
-    // Parse the output options
-    dump_rays_     = input.attribute("dump_rays").as_bool(false);
-    dump_fsr_flux_ = input.attribute("dump_fsr_flux").as_bool(false);
+void MoCSweeper::sweep_block(int g_first, int g_last)
+{
+    int ng = g_last - g_first + 1;
 
-    // Determine boundary update technique
-    gauss_seidel_boundary_ = true;
-    if (!input.attribute("boundary_update").empty()) {
-        std::string in_string = input.attribute("boundary_update").value();
-        sanitize(in_string);
-        if (in_string == "jacobi" || in_string == "j") {
-            gauss_seidel_boundary_ = false;
-        } else if (in_string == "gs") {
+    std::vector<moc::NoCurrent> ncw(ng, moc::NoCurrent(coarse_data_, &mesh_));
+    this->load_boundary(g_first, g_last);
+
+    for (unsigned int inner = 0; inner < n_inner_; inner++) {
+        this->self_scatter_mg(g_first, g_last);
+
+        // Same as the one-group sweep; only tally currents on the last inner
+        if (inner == n_inner_ - 1 && coarse_data_) {
+            for (int ig = g_first; ig <= g_last; ig++) {
+                coarse_data_->zero_data_radial(ig);
+            }
+
+            std::vector<moc::Current> cw(ng,
+                                         moc::Current(coarse_data_, &mesh_));
+            this->sweep_mg_dispatch(g_first, g_last, cw);
+            coarse_data_->set_has_radial_data(true);
         } else {
-            throw EXCEPT("Unrecognized boundary update option.");
+            this->sweep_mg_dispatch(g_first, g_last, ncw);
         }
     }
 
-    // Parse TL source splitting setting
-    allow_splitting_ = input.attribute("tl_splitting").as_bool(false);
-    if (allow_splitting_) {
-        split_.resize(n_reg_);
-    }
+    return;
+} // sweep_block( g_first, g_last )
 
-    // Sanity-check the subplane parameters. We will operate on the assumption
-    // for now that all planes in a macroplane are not only geometrically
-    // identical, but completely so. For anyone interested in doing de-cusping,
-    // this will need to change
-    for (const auto &assembly : mesh_.core()) {
-        int ip = 0;
-        for (const auto &mac_size : subplane_) {
-            int lat_id = (*assembly)[ip].id();
-            for (int in_mac_plane = 1; in_mac_plane < mac_size;
-                 in_mac_plane++) {
-                if ((*assembly)[ip + in_mac_plane].id() != lat_id) {
-                    throw EXCEPT(
-                        "All lattices in a macroplane must be the same.");
-                }
+void MoCSweeper::self_scatter_mg(int g_first, int g_last)
+{
+    for (const auto &xsr : *xs_mesh_) {
+        for (int ig = g_first; ig <= g_last; ig++) {
+            real_t xssc     = xsr.xsmacsc().to(ig)[ig];
+            real_t r_fpi_tr = 1.0 / (xsr.xsmactr(ig) * FPI);
+            for (const int ireg : xsr.reg()) {
+                qbar_mg_(ireg, ig) =
+                    (source_mg_(ireg, ig) + flux_(ireg, ig) * xssc) * r_fpi_tr;
             }
-            ip += mac_size;
         }
     }
 
-    // Construct the entries in subplane_bounds_ these should be the the
-    // accumulation of the number of planes in each MoC plane, such that taking
-    // std::distance(..., std::lower_bound(..., iz)) for a given axial index iz
-    // should return the appropriate MoC plane index
-    subplane_bounds_.reserve(subplane_.size());
-    int prev = 0;
-    for (const auto np : subplane_) {
-        subplane_bounds_.push_back(prev + np);
-        prev += np;
-    }
+    return;
+} // self_scatter_mg( g_first, g_last )
 
-    // set up the array of unique plane ids and number of FSRs per moc plane. We
-    // have already checked that all of the planes are entirely the same, so we
-    // know they must be geometrically identical as well.
-    macroplane_unique_ids_.reserve(subplane_.size());
-    first_reg_macroplane_.reserve(subplane_.size());
-    first_reg_macroplane_.push_back(0);
-    nreg_plane_.reserve(subplane_.size());
-    int iz = 0;
-    for (const auto &sub_size : subplane_) {
-        macroplane_unique_ids_.push_back(mesh_.unique_plane_ids()[iz]);
-        nreg_plane_.push_back(
-            mesh_.unique_plane(macroplane_unique_ids_.back()).n_reg());
-        iz += sub_size;
+void MoCSweeper::set_n_rhs(int n_rhs)
+{
+    if (n_rhs < 0) {
+        throw EXCEPT("Invalid number of right-hand sides");
     }
-
-    for (const auto &plane_id : macroplane_unique_ids_) {
-        first_reg_macroplane_.push_back(first_reg_macroplane_.back() +
-                                        mesh_.unique_plane(plane_id).n_reg());
+    if (n_rhs > 0) {
+        bool unsupported = !group_sets_.empty() || cyclic_ || kernel_3d_ ||
+                           linear_source_ || (scat_order_ > 0) ||
+                           rays_.renumbered() || rays_.adaptive() ||
+                           rays_.out_of_core() || !macro_reg_.empty();
+        if (unsupported) {
+            throw EXCEPT("Multiple right-hand sides are only supported by "
+                         "flat source, isotropic 2-D sweeps of in-memory "
+                         "rays, without group sets, cyclic tracks, "
+                         "renumbering, adaptive spacing or macro pins.");
+        }
     }
-    first_reg_macroplane_.pop_back();
 
-    if (dump_rays_) {
-        std::ofstream rayfile("rays.py");
-        rayfile << rays_ << std::endl;
+    n_rhs_ = n_rhs;
+    boundary_rhs_.clear();
+    boundary_rhs_out_.clear();
+    if (n_rhs_ == 0) {
+        qbar_rhs_.resize(0, 0);
+        return;
     }
 
-    // Replace the angular quadrature with the modularized version
-    ang_quad_ = rays_.ang_quad();
-
-    timer_init_.toc();
-    timer_.toc();
+    boundary_rhs_ = std::vector<BoundaryCondition>(
+        boundary_.size(),
+        BoundaryCondition(n_group_ * n_rhs_, ang_quad_, mesh_.boundary(),
+                          bc_size_helper(rays_)));
+    for (auto &boundary : boundary_rhs_) {
+        boundary.initialize_scalar(0.0);
+    }
+    boundary_rhs_out_ = std::vector<BoundaryCondition>(
+        boundary_.size(), BoundaryCondition(n_rhs_, ang_quad_,
+                                            mesh_.boundary(),
+                                            bc_size_helper(rays_)));
+    qbar_rhs_.resize(n_reg_, n_rhs_);
+
+    // The right-hand side kernel always hands out the work units of all
+    // macroplanes at once
+    if (macroplane_units_.empty()) {
+        this->setup_schedule();
+    }
 
     return;
-} // MoCSweeper( input, mesh )
+}
 
-void MoCSweeper::sweep(int group)
+void MoCSweeper::sweep_rhs(int group, const ArrayB2 &source, ArrayB2 &flux)
 {
-    assert(source_);
+    if (n_rhs_ == 0) {
+        throw EXCEPT("No right-hand sides have been set up to sweep");
+    }
+    assert((source.extent(0) == (int)n_reg_) && (source.extent(1) == n_rhs_));
+    assert((flux.extent(0) == (int)n_reg_) && (flux.extent(1) == n_rhs_));
+    MOCC_PROFILE_ZONE("MoC RHS Sweep");
 
     timer_.tic();
     timer_sweep_.tic();
 
-    // Expand the cross sections, and perform splitting if necessary
     xstr_.expand(group, split_);
 
-    flux_1g_.reference(flux_(blitz::Range::all(), group));
-
-    // Perform inner iterations
     for (unsigned int inner = 0; inner < n_inner_; inner++) {
-        // update the self-scattering source
-        source_->self_scatter(group, xstr_.xs());
+        this->self_scatter_rhs(group, source, flux);
+        this->sweep_rhs_dispatch(group, flux);
+    }
 
-        // Perform the stock sweep unless we are on the last outer and have
-        // a CoarseData object.
-        if (inner == n_inner_ - 1 && coarse_data_) {
-            // Wipe out the existing currents (only on X- and Y-normal
-            // faces)
-            coarse_data_->zero_data_radial(group);
+    timer_.toc();
+    timer_sweep_.toc();
+    return;
+} // sweep_rhs( group, source, flux )
 
-            moc::Current cw(coarse_data_, &mesh_);
-            this->sweep1g(group, cw);
-            coarse_data_->set_has_radial_data(true);
-        } else {
-            moc::NoCurrent cw(coarse_data_, &mesh_);
-            this->sweep1g(group, cw);
+void MoCSweeper::self_scatter_rhs(int group, const ArrayB2 &source,
+                                  const ArrayB2 &flux)
+{
+    for (const auto &xsr : *xs_mesh_) {
+        real_t xssc     = xsr.xsmacsc().to(group)[group];
+        real_t r_fpi_tr = 1.0 / (xsr.xsmactr(group) * FPI);
+        for (const int ireg : xsr.reg()) {
+            for (int ir = 0; ir < n_rhs_; ir++) {
+                qbar_rhs_(ireg, ir) =
+                    (source(ireg, ir) + flux(ireg, ir) * xssc) * r_fpi_tr;
+            }
         }
     }
 
-    timer_.toc();
-    timer_sweep_.toc();
     return;
-} // sweep( group )
+} // self_scatter_rhs( group, source, flux )
 
 /**
  * For now, this doesn't do anything remotely intelligent about the initial
@@ -239,19 +2580,133 @@ void MoCSweeper::initialize()
     if (coarse_data_) {
         coarse_data_->flux = val;
     }
-    // There are better ways to do this, but for now, just start with 1.0
-    flux_     = val;
-    flux_old_ = val;
+    // There are better ways to do this, but for now, just start with 1.0.
+    // Touch the flux in the same order that the thread-private flux is
+    // reduced into it, so that each thread's regions are in its local
+    // memory.
+    auto region = [this](int i) { return this->mesh_region(i); };
+    first_touch_rows(flux_.data(), n_reg_, n_group_, val, region);
+    first_touch_rows(flux_old_.data(), n_reg_, n_group_, val, region);
 
     // Walk through the boundary conditions and initialize them the 1/4pi
     real_t bound_val = val / FPI;
     for (auto &boundary : boundary_) {
         boundary.initialize_scalar(bound_val);
     }
+    for (auto &set : group_sets_) {
+        for (auto &boundary : set.boundary) {
+            boundary.initialize_scalar(bound_val);
+        }
+    }
+    std::fill(axial_bc_.begin(), axial_bc_.end(), bound_val);
+
+    // Size the per-thread scratch storage for the sweep kernels: one buffer
+    // for the exponentials and two for the angular flux along a ray, for
+    // each group in a block
+    int ng_block = multigroup_kernel_ ? group_block_ : 1;
+    int max_seg  = rays_.max_segments();
+    for (const auto &set : group_sets_) {
+        max_seg = std::max(max_seg, set.rays.max_segments());
+    }
+    workspace_.resize(3, (max_seg + 1) * ng_block);
+    int n_tally = linear_source_ ? 3 : ng_block;
+    if (scat_order_ > 0) {
+        n_tally = harmonics_.size();
+    }
+    thread_flux_.resize(n_reg_ * n_tally);
+
+    // Start from a flat flux in each region
+    if (linear_source_) {
+        flux_x_ = 0.0;
+        flux_y_ = 0.0;
+    }
+    for (auto &flux_k : flux_pn_) {
+        flux_k = 0.0;
+    }
 
     return;
 } // initialize()
 
+UP_Source_t MoCSweeper::create_source(const pugi::xml_node &input) const
+{
+    if (!linear_source_ && (scat_order_ == 0)) {
+        return TransportSweeper::create_source(input);
+    }
+
+    if (input.empty()) {
+        throw EXCEPT("No input specified for <source>.");
+    }
+    std::string scat = input.attribute("scattering").value();
+    sanitize(scat);
+
+    if (scat_order_ > 0) {
+        if (scat != "pn") {
+            throw EXCEPT("A sweeper with a scattering order needs a Pn "
+                         "source (scattering=\"pn\").");
+        }
+        UP_Source_t source(new SourcePn(n_reg_, xs_mesh_.get(), flux_,
+                                        harmonics_, flux_pn_));
+        source->add_external(input);
+        return source;
+    }
+
+    if (scat != "p0") {
+        throw EXCEPT("The linear source only supports P0 scattering.");
+    }
+
+    UP_Source_t source(
+        new SourceLinear(n_reg_, xs_mesh_.get(), flux_, flux_x_, flux_y_));
+    source->add_external(input);
+
+    return source;
+}
+
+void MoCSweeper::assign_source(Source *source)
+{
+    TransportSweeper::assign_source(source);
+
+    if (linear_source_) {
+        source_ls_ = dynamic_cast<const SourceLinear *>(source);
+        if (!source_ls_) {
+            throw EXCEPT("The linear source MoC sweeper needs a linear "
+                         "source.");
+        }
+    }
+    if (scat_order_ > 0) {
+        source_pn_ = dynamic_cast<const SourcePn *>(source);
+        if (!source_pn_) {
+            throw EXCEPT("The MoC sweeper with Pn scattering needs a Pn "
+                         "source.");
+        }
+    }
+
+    return;
+}
+
+void MoCSweeper::initialize_boundary(const ArrayB1 &spectrum)
+{
+    assert((int)spectrum.size() == n_group_);
+    ArrayB1 bound_val(n_group_);
+    bound_val = spectrum / FPI;
+    for (auto &boundary : boundary_) {
+        boundary.initialize_spectrum(bound_val);
+    }
+    for (auto &set : group_sets_) {
+        for (auto &boundary : set.boundary) {
+            boundary.initialize_spectrum(bound_val);
+        }
+    }
+    if (!axial_bc_.empty()) {
+        const int n_lines = axial_tracks_.n_lines();
+        for (int ig = 0; ig < n_group_; ig++) {
+            std::fill(axial_bc_.begin() + (size_t)ig * n_lines,
+                      axial_bc_.begin() + (size_t)(ig + 1) * n_lines,
+                      bound_val(ig));
+        }
+    }
+    return;
+}
+
 void MoCSweeper::update_incoming_flux()
 {
     assert(coarse_data_);
@@ -298,55 +2753,26 @@ void MoCSweeper::get_pin_flux_1g(int group, ArrayB1 &flux,
     /// assert(flux.isStorageContiguous());
     flux = 0.0;
 
+    const int n_plane_pin = pin_cell_.size();
+
     switch (treatment) {
     case MeshTreatment::PIN_PLANE: {
-        int ireg    = 0;
-        int implane = 0;
-        for (const auto &mplane : mesh_.macroplanes()) {
-            int ipin = 0;
-            for (const auto mpin : mplane) {
-                real_t v        = 0.0;
-                real_t pin_flux = 0.0;
-                for (int ir = 0; ir < mpin->n_reg(); ir++) {
-                    v += vol_[ireg];
-                    pin_flux += flux_(ireg, group) * vol_[ireg];
-                    ireg++;
-                }
-                pin_flux /= v;
-
-                Position pos = mesh_.pin_position(ipin);
-                pos.z        = implane;
-                int i        = mesh_.coarse_cell(pos);
-                flux(i) += pin_flux;
-
-                ipin++;
-            }
-            implane++;
+#pragma omp parallel for schedule(static)
+        for (int ip = 0; ip < n_plane_pin; ip++) {
+            flux(pin_cell_[ip]) = this->pin_average(ip, group);
         }
     } break;
 
     case MeshTreatment::PIN: {
-        int ireg = 0;
-        for (const auto &mplane : mesh_.macroplanes()) {
-            int ipin = 0;
-            for (const auto mpin : mplane) {
-                real_t v        = 0.0;
-                real_t pin_flux = 0.0;
-                for (int ir = 0; ir < mpin->n_reg(); ir++) {
-                    v += vol_[ireg];
-                    pin_flux += flux_(ireg, group) * vol_[ireg];
-                    ireg++;
-                }
-                pin_flux /= v;
-
-                Position pos = mesh_.pin_position(ipin);
-                for (int iz = mplane.iz_min; iz <= mplane.iz_max; iz++) {
-                    pos.z = iz;
-                    int i = mesh_.coarse_cell(pos);
-                    flux(i) += pin_flux;
-                }
-
-                ipin++;
+        const auto &mplanes = mesh_.macroplanes();
+        const int nxy       = mesh_.nx() * mesh_.ny();
+#pragma omp parallel for schedule(static)
+        for (int ip = 0; ip < n_plane_pin; ip++) {
+            real_t pin_flux   = this->pin_average(ip, group);
+            int ixy           = pin_cell_[ip] % nxy;
+            const auto &plane = mplanes[pin_cell_[ip] / nxy];
+            for (int iz = plane.iz_min; iz <= plane.iz_max; iz++) {
+                flux(ixy + nxy * iz) = pin_flux;
             }
         }
     } break;
@@ -394,34 +2820,27 @@ real_t MoCSweeper::set_pin_flux_1g(int group, const ArrayB1 &pin_flux,
             plane_pin_flux(i) /= mesh_.macroplane_heights()[iz];
         }
     case MeshTreatment::PIN_PLANE: {
-        plane_pin_flux = pin_flux;
-        int iz       = 0;
-        int ireg     = 0;
-        for (const auto &mplane : mesh_.macroplanes()) {
-            int ipin = 0;
-            for (const auto &pin : mplane) {
-                Position pos   = mesh_.pin_position(ipin);
-                pos.z          = iz;
-                int i_coarse   = mesh_.coarse_cell(pos);
-                real_t fm_flux = 0.0;
-                for (const auto area : pin->areas()) {
-                    fm_flux += flux_(ireg, group) * area;
-                    ireg++;
+        plane_pin_flux        = pin_flux;
+        const int n_plane_pin = pin_cell_.size();
+#pragma omp parallel for reduction(+ : resid) schedule(static)
+        for (int ip = 0; ip < n_plane_pin; ip++) {
+            int i_coarse   = pin_cell_[ip];
+            real_t fm_flux = this->pin_average(ip, group);
+            real_t e       = plane_pin_flux(i_coarse) - fm_flux;
+            real_t f       = plane_pin_flux(i_coarse) / fm_flux;
+
+            for (int ireg = pin_reg_[ip]; ireg < pin_reg_[ip + 1]; ireg++) {
+                flux_(ireg, group) *= f;
+                if (linear_source_) {
+                    flux_x_(ireg, group) *= f;
+                    flux_y_(ireg, group) *= f;
                 }
-                fm_flux /= pin->area();
-                real_t e = plane_pin_flux(i_coarse) - fm_flux;
-                real_t f = plane_pin_flux(i_coarse) / fm_flux;
-                ireg -= pin->n_reg();
-
-                for (int ir = 0; ir < pin->n_reg(); ir++) {
-                    flux_(ireg, group) *= f;
-                    ireg++;
+                for (auto &flux_k : flux_pn_) {
+                    flux_k(ireg, group) *= f;
                 }
-
-                resid += e * e;
-                ipin++;
             }
-            iz++;
+
+            resid += e * e;
         }
     } break;
     default:
@@ -531,6 +2950,179 @@ void MoCSweeper::check_balance(int group) const
     return;
 }
 
+void MoCSweeper::write_checkpoint(H5Node &node) const
+{
+    TransportSweeper::write_checkpoint(node);
+    for (unsigned i = 0; i < boundary_.size(); i++) {
+        boundary_[i].write(node, "boundary_" + std::to_string(i));
+    }
+    for (unsigned iset = 0; iset < group_sets_.size(); iset++) {
+        const auto &boundary = group_sets_[iset].boundary;
+        for (unsigned i = 0; i < boundary.size(); i++) {
+            boundary[i].write(node, "boundary_set" + std::to_string(iset) +
+                                        "_" + std::to_string(i));
+        }
+    }
+    return;
+}
+
+void MoCSweeper::read_checkpoint(H5Node &node)
+{
+    TransportSweeper::read_checkpoint(node);
+    for (unsigned i = 0; i < boundary_.size(); i++) {
+        boundary_[i].read(node, "boundary_" + std::to_string(i));
+    }
+    for (unsigned iset = 0; iset < group_sets_.size(); iset++) {
+        auto &boundary = group_sets_[iset].boundary;
+        for (unsigned i = 0; i < boundary.size(); i++) {
+            boundary[i].read(node, "boundary_set" + std::to_string(iset) +
+                                       "_" + std::to_string(i));
+        }
+    }
+    return;
+}
+
+void MoCSweeper::output_performance(H5Node &node) const
+{
+    TransportSweeper::output_performance(node);
+
+    real_t segments   = this->n_seg_swept();
+    real_t sweep_time = timer_sweep_.time();
+
+    node.write("segments", segments);
+    node.write("sweep_time", sweep_time);
+    node.write("segments_per_second",
+               sweep_time > 0.0 ? segments / sweep_time : 0.0);
+    size_t ray_memory = rays_.memory();
+    for (const auto &set : group_sets_) {
+        ray_memory += set.rays.memory();
+    }
+    node.write("ray_memory", (uint64_t)ray_memory);
+    if (plane_tol_ > 0.0) {
+        node.write("skipped_plane_sweeps", n_plane_skipped_);
+    }
+    if (rays_.out_of_core()) {
+        // Planes whose rays had to be read without being read ahead
+        node.write("ray_stream_stalls", rays_.n_stream_stall());
+    }
+    if (timer_sweep_.has_counts()) {
+        auto g = node.create_group("sweep_counters");
+        timer_sweep_.output_counters(g);
+    }
+    if (workload_.enabled()) {
+        auto g = node.create_group("workload");
+        workload_.output(g);
+
+        // Distribution of the number of segments per ray, over all planes
+        // and angles
+        std::vector<int> nseg;
+        for (const auto &plane_rays : rays_) {
+            for (const auto &ang_rays : plane_rays) {
+                for (const auto &ray : ang_rays) {
+                    nseg.push_back(ray.nseg());
+                }
+            }
+        }
+        auto hist = log2_histogram(nseg);
+        g.write("ray_length_histogram", VecF(hist.begin(), hist.end()));
+
+        LogFile << "MoC ";
+        workload_.print(LogFile);
+    }
+    return;
+}
+
+void MoCSweeper::compact()
+{
+    TransportSweeper::compact();
+    rays_.compact(true);
+    for (auto &set : group_sets_) {
+        set.rays.compact(true);
+    }
+    return;
+}
+
+void MoCSweeper::memory(MemoryReport &report) const
+{
+    TransportSweeper::memory(report);
+
+    report.add("rays", rays_.memory());
+
+    size_t bc = 0;
+    for (const auto &b : boundary_) {
+        bc += b.memory();
+    }
+    for (const auto &b : boundary_out_) {
+        bc += b.memory();
+    }
+    for (const auto &b : boundary_out_mg_) {
+        bc += b.memory();
+    }
+    for (const auto &b : boundary_rhs_) {
+        bc += b.memory();
+    }
+    for (const auto &b : boundary_rhs_out_) {
+        bc += b.memory();
+    }
+    report.add("boundary", bc);
+
+    if (!group_sets_.empty()) {
+        size_t set_rays = 0;
+        size_t set_bc   = 0;
+        for (const auto &set : group_sets_) {
+            set_rays += set.rays.memory();
+            for (const auto &b : set.boundary) {
+                set_bc += b.memory();
+            }
+            for (const auto &b : set.boundary_out) {
+                set_bc += b.memory();
+            }
+        }
+        report.add("group_set_rays", set_rays);
+        report.add("group_set_boundary", set_bc);
+    }
+
+    report.add("work_arrays", xstr_.memory() + bytes(flux_1g_) +
+                                  bytes(split_) + bytes(source_mg_) +
+                                  bytes(qbar_mg_) + bytes(xstr_mg_));
+    if (plane_tol_ > 0.0) {
+        report.add("plane_mask", bytes(plane_resid_) +
+                                     bytes(plane_flux_prev_) +
+                                     bytes(plane_current_stash_));
+    }
+    if (cyclic_) {
+        report.add("cyclic_tracks", tracks_.memory() + bytes(track_units_));
+    }
+    if (kernel_3d_) {
+        report.add("axial_tracks", tracks_.memory() + axial_tracks_.memory());
+        report.add("axial_boundary", bytes(axial_bc_) + bytes(axial_bc_in_));
+    }
+    if (linear_source_) {
+        report.add("linear_source", bytes(flux_x_) + bytes(flux_y_) +
+                                        bytes(ls_inverse_) +
+                                        bytes(ls_coeff_));
+    }
+    if (scat_order_ > 0) {
+        size_t mem = bytes(pn_table_);
+        for (const auto &flux_k : flux_pn_) {
+            mem += bytes(flux_k);
+        }
+        report.add("pn_moments", mem);
+    }
+    report.add("pin_projection",
+               bytes(pin_reg_) + bytes(pin_cell_) + bytes(pin_rvol_));
+    if (!mesh_index_.empty()) {
+        report.add("region_order", bytes(mesh_index_) + bytes(xstr_sweep_) +
+                                       bytes(qbar_sweep_));
+    }
+    if (device_) {
+        report.add("device_staging", bytes(device_bc_in_) +
+                                         bytes(device_bc_out_) +
+                                         bytes(device_tally_));
+    }
+    return;
+}
+
 void MoCSweeper::output(H5Node &node) const
 {
     // Get core dimensions from the mesh
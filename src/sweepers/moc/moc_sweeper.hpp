@@ -17,19 +17,37 @@
 #pragma once
 
 #include <array>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <type_traits>
+#include "util/aligned_allocator.hpp"
+#include "util/angle_pipeline.hpp"
+#include "util/autotuner.hpp"
 #include "util/omp_guard.h"
+#include "util/profile.hpp"
 #include "util/pugifwd.hpp"
 #include "util/timers.hpp"
+#include "util/workload.hpp"
 #include "core/angular_quadrature.hpp"
 #include "core/boundary_condition.hpp"
 #include "core/coarse_data.hpp"
 #include "core/core_mesh.hpp"
 #include "core/eigen_interface.hpp"
 #include "core/exponential.hpp"
+#include "core/source_linear.hpp"
+#include "core/source_pn.hpp"
+#include "core/spherical_harmonics.hpp"
 #include "core/transport_sweeper.hpp"
 #include "core/xs_mesh.hpp"
 #include "core/xs_mesh_homogenized.hpp"
+#include "moc/axial_tracks.hpp"
+#include "moc/cyclic_tracks.hpp"
+#include "moc/device_sweep.hpp"
+#include "moc/exponential_cache.hpp"
+#include "moc/linear_source_geometry.hpp"
 #include "moc/ray_data.hpp"
+#include "moc/sweep_schedule.hpp"
 
 namespace mocc {
 namespace moc {
@@ -43,8 +61,59 @@ public:
 
     virtual void sweep(int group) override;
 
+    int group_block() const override final
+    {
+        return multigroup_kernel_ ? group_block_ : 1;
+    }
+
     void initialize() override final;
 
+    /**
+     * \brief Allocate boundary conditions for \p n_rhs right-hand sides, to
+     * be swept together by \ref sweep_rhs()
+     *
+     * The boundary flux of every right-hand side in every group starts at
+     * zero. Zero right-hand sides releases the storage.
+     */
+    void set_n_rhs(int n_rhs);
+
+    int n_rhs() const
+    {
+        return n_rhs_;
+    }
+
+    /**
+     * \brief Sweep the right-hand sides of one group together, tracing the
+     * rays once for all of them
+     *
+     * Each right-hand side is a fixed-source problem of its own, with its
+     * own isotropic source, scalar flux and boundary conditions, sharing
+     * only the transport cross section of the group. The segment data and
+     * exponentials are therefore loaded and computed once, and applied to
+     * every right-hand side, e.g. the forward and adjoint flux, or several
+     * harmonics. Both directions of every ray are swept, so an adjoint
+     * problem is swept like any other, with a source that the caller builds
+     * from the adjoint operator. Its angular flux in direction \c iang is
+     * then the one swept in direction \c ang_quad_.reverse(iang).
+     *
+     * As with \ref sweep(), \c n_inner inner iterations are done, updating
+     * the self-scatter source of each right-hand side from its flux. The
+     * boundary conditions are updated at the end of each inner iteration.
+     *
+     * \param group the group to sweep
+     * \param source the source of each right-hand side, without
+     * self-scatter, indexed by [region, rhs]
+     * \param flux the scalar flux of each right-hand side, indexed by
+     * [region, rhs]. On entry, this is used for the self-scatter source of
+     * the first inner iteration.
+     */
+    void sweep_rhs(int group, const ArrayB2 &source, ArrayB2 &flux);
+
+    /**
+     * \copydoc TransportSweeper::initialize_boundary()
+     */
+    void initialize_boundary(const ArrayB1 &spectrum) override final;
+
     /**
      * \copydoc TransportSweeper::get_pin_flux_1g()
      *
@@ -70,6 +139,39 @@ public:
 
     void output(H5Node &node) const override;
 
+    /**
+     * \copydoc TransportSweeper::write_checkpoint()
+     *
+     * In addition to the flux, the boundary conditions for each macroplane
+     * are stored.
+     */
+    void write_checkpoint(H5Node &node) const override;
+
+    void read_checkpoint(H5Node &node) override;
+
+    /**
+     * \copybrief TransportSweeper::output_performance()
+     *
+     * Adds the number of ray segments swept, the sweep rate and the memory
+     * used to store the rays.
+     */
+    void output_performance(H5Node &node) const override;
+
+    /**
+     * \copybrief TransportSweeper::memory()
+     *
+     * Adds the ray data, boundary conditions and the per-group work arrays.
+     */
+    void memory(MemoryReport &report) const override;
+
+    /**
+     * \copybrief TransportSweeper::compact()
+     *
+     * The kernels only read the packed segments, so the segments of the rays
+     * themselves are released, along with their spare capacity.
+     */
+    void compact() override;
+
     void homogenize(CoarseData &data) const
     {
         throw EXCEPT("Not Implemented");
@@ -88,11 +190,16 @@ public:
      * for MoC.
      */
     virtual UP_Source_t
-    create_source(const pugi::xml_node &input) const override final
-    {
-        auto source = TransportSweeper::create_source(input);
-        return source;
-    }
+    create_source(const pugi::xml_node &input) const override final;
+
+    /**
+     * \copybrief TransportSweeper::assign_source()
+     *
+     * When sweeping with a linear source, the source must be a \ref
+     * SourceLinear, and with Pn scattering, a \ref SourcePn, as produced by
+     * \ref create_source().
+     */
+    void assign_source(Source *source) override;
 
     /**
      * Return a copy of the sweeper's angular quadrature.
@@ -121,6 +228,35 @@ public:
 
     void check_balance(int group) const;
 
+    /**
+     * \brief Return whether converged macroplanes may be skipped
+     */
+    bool plane_masking() const
+    {
+        return plane_tol_ > 0.0;
+    }
+
+    /**
+     * \brief Return the number of negative scalar flux values in a group, as
+     * of its last sweep
+     *
+     * These are counted while the flux is reduced, so they only cover the
+     * planes that were active in the sweep.
+     */
+    int n_negative_flux(int group) const
+    {
+        return n_negative_[group];
+    }
+
+    /**
+     * \brief Return the number of NaN scalar flux values in a group, as of
+     * its last sweep. See \ref n_negative_flux().
+     */
+    int n_nan_flux(int group) const
+    {
+        return n_nan_[group];
+    }
+
 protected:
     // Data
     Timer &timer_;
@@ -130,9 +266,11 @@ protected:
 
     RayData rays_;
 
-    // Multi-group, incoming boundary flux. One for each plane
+    // Multi-group, incoming boundary flux. One for each macroplane, since the
+    // planes within a macroplane are swept together
     std::vector<BoundaryCondition> boundary_;
-    // One-group, outgoing boundary flux
+    // One-group, outgoing boundary flux. Only allocated for the one-group
+    // kernels; the multi-group kernel uses boundary_out_mg_ instead.
     std::vector<BoundaryCondition> boundary_out_;
 
     // Array of one group transport cross sections, including transverse
@@ -143,6 +281,11 @@ protected:
     // default-constructed, so that it only references data in flux_
     ArrayB1 flux_1g_;
 
+    // Number of negative and NaN scalar flux values in each group, counted
+    // during the reduction of its last sweep
+    VecI n_negative_;
+    VecI n_nan_;
+
     // Subplane parameters. These come from the CoreMesh, ultimately through the
     // Assemblies. Each entry is the number of actual CoreMesh planes to bind
     // together into each macroplane
@@ -173,16 +316,542 @@ protected:
     // Boundary condition enumeration
     std::array<Boundary, 6> bc_type_;
 
-    // Exponential table
-    Exponential_Linear<10000> exp_;
-    //Exponential exp_;
+    // Exponential evaluator. Selected from the input, and evaluated a whole
+    // ray at a time through Exponential::exp_n()
+    UP_Exponential_t exp_;
+
+    // Cache of segment exponentials, reused between sweeps of the same group
+    // while the cross sections are unchanged
+    ExponentialCache exp_cache_;
+
+    // Whether to sweep with single-precision ray data (exponentials and
+    // angular flux) when no currents are needed
+    bool mixed_precision_;
+
+    // Whether to keep the incoming boundary flux of the groups that aren't
+    // being swept in single precision. See load_boundary().
+    bool packed_boundary_;
+
+    // Linear source treatment. When enabled, sweep1g_ls() is used in place of
+    // sweep1g(), and the first spatial moments of the flux are kept in
+    // flux_x_ and flux_y_, with the same layout as flux_.
+    bool linear_source_;
+    LinearSourceGeometry ls_geometry_;
+    ArrayB2 flux_x_;
+    ArrayB2 flux_y_;
+    const SourceLinear *source_ls_;
+
+    // Inverse moment matrix of every region, in [xx, xy, yy] triples, and the
+    // linear source coefficients of the current group, in (x, y) pairs
+    VecF ls_inverse_;
+    VecF ls_coeff_;
+
+    // Pn scattering. When the scattering order is above zero, sweep1g_pn() is
+    // used in place of sweep1g(), and the angular moments of the flux for
+    // each harmonic after R_00 are kept in flux_pn_, with the same layout as
+    // flux_. pn_table_ holds those harmonics for every angle of the
+    // quadrature, indexed [iang * n_moment + k].
+    int scat_order_;
+    SphericalHarmonics harmonics_;
+    std::vector<ArrayB2> flux_pn_;
+    VecF pn_table_;
+    const SourcePn *source_pn_;
+
+    // Device-resident ray data for offloaded sweeps, and host-side staging
+    // for the boundary values and flux tallies that it exchanges. Only
+    // allocated when offloading is enabled.
+    std::unique_ptr<DeviceSweep> device_;
+    VecF device_bc_in_;
+    VecF device_bc_out_;
+    VecF device_tally_;
+
+    // Load-balanced work units for the rays of each plane. Only built when
+    // balanced_schedule_ is set
+    SweepSchedule schedule_;
+
+    // Work units of all macroplanes, paired with their macroplane index and
+    // ordered longest-first
+    std::vector<std::pair<int, WorkUnit>> macroplane_units_;
+
+    // Ordering of the angles of a Gauss-Seidel boundary update, for
+    // sweep_plane_gs(). For each angle, gs_sweep_after_ holds the earlier
+    // angles whose boundary updates write its incoming flux, and
+    // gs_update_after_ the earlier angles whose incoming flux its own update
+    // overwrites.
+    std::vector<VecI> gs_sweep_after_;
+    std::vector<VecI> gs_update_after_;
+
+    // Progress through a plane in sweep_plane_gs(): the first flat work unit
+    // of each angle, the next unit to hand out, and the number of units left
+    // to sweep and whether the boundary has been updated for each angle
+    VecI gs_first_unit_;
+    std::unique_ptr<std::atomic<int>> gs_next_unit_;
+    std::unique_ptr<std::atomic<int>[]> gs_remaining_;
+    std::unique_ptr<std::atomic<int>[]> gs_updated_;
+
+    // Cyclic ray tracing. When enabled, the sweeps that don't need currents
+    // follow the rays of each plane end-to-end along the tracks_, rather
+    // than sweeping them angle-by-angle. The tracks of all macroplanes are
+    // handed out from track_units_, as (macroplane, track) pairs ordered
+    // longest-first.
+    bool cyclic_;
+    CyclicTracks tracks_;
+    std::vector<std::pair<int, int>> track_units_;
 
     bool dump_rays_;
     bool dump_fsr_flux_;
     bool gauss_seidel_boundary_;
     bool allow_splitting_;
+    bool balanced_schedule_;
+
+    // Whether to distribute whole macroplanes among threads when the sweep
+    // has to synchronize between angles
+    bool plane_parallel_;
+
+    // Multi-group sweep kernel options. When enabled, groups are swept in
+    // blocks of group_block_ using sweep_mg()
+    bool multigroup_kernel_;
+    int group_block_;
+
+    // Polar sweep kernel. When enabled, the sweeps that don't need currents
+    // use sweep1g_polar(), tracing the rays of each azimuth once for all of
+    // its polar angles. polar_sets_ holds the angles (of the first two
+    // octants) that share each azimuth.
+    bool polar_kernel_;
+    std::vector<VecI> polar_sets_;
+
+    // Ray packet kernel. When enabled, the sweeps that don't need currents
+    // use sweep1g_packet(), sweeping several rays of an angle at once
+    bool packet_kernel_;
+
+    // Stacked plane kernel. When enabled, the sweeps that don't need
+    // currents use sweep1g_stacked(), tracing each ray once for all of the
+    // macroplanes that share it. plane_stacks_ holds the macroplanes of each
+    // unique ray geometry, stack_units_ the work units of all stacks, paired
+    // with their stack index, and max_stack_ the size of the largest stack.
+    bool stack_kernel_;
+    std::vector<VecI> plane_stacks_;
+    std::vector<std::pair<int, WorkUnit>> stack_units_;
+    int max_stack_;
+
+    // Direct 3-D kernel. When enabled, the sweeps follow 3-D characteristics
+    // laid over the tracks_ of the 2-D rays, generated on the fly by
+    // axial_tracks_, and use sweep1g_3d(). axial_bc_ holds the outgoing
+    // angular flux of every line of every group, and axial_bc_in_ the
+    // incoming flux of the group being swept. n_seg_3d_ counts the 3-D
+    // segments swept.
+    bool kernel_3d_;
+    AxialTracks axial_tracks_;
+    VecF axial_bc_;
+    VecF axial_bc_in_;
+    real_t n_seg_3d_;
+
+    // Integrate over the polar angle analytically in the polar kernel,
+    // carrying one polar-integrated flux along the rays of each azimuth and
+    // attenuating it with the tabulated Ki3 function in ki3_
+    bool bickley_;
+    UP_Exponential_t ki3_;
+
+    // Multi-group storage for the sweep_mg() kernel, indexed by [region,
+    // group]. These are only allocated when the multi-group kernel is in use.
+    // source_mg_ is the source without self-scatter, as it is handed to
+    // sweep(), qbar_mg_ is the transport source, and xstr_mg_ is the expanded
+    // transport cross section.
+    ArrayB2 source_mg_;
+    ArrayB2 qbar_mg_;
+    ArrayB2 xstr_mg_;
+
+    // Outgoing boundary flux for a block of groups. One for each macroplane
+    std::vector<BoundaryCondition> boundary_out_mg_;
+
+    // Storage for sweep_rhs(), empty unless set_n_rhs() has been called.
+    // boundary_rhs_ is the incoming boundary flux of each macroplane, with
+    // the right-hand sides of a group stored as consecutive groups, and
+    // boundary_rhs_out_ the outgoing flux of the group being swept.
+    // qbar_rhs_ is the transport source, indexed by [region, rhs].
+    int n_rhs_;
+    std::vector<BoundaryCondition> boundary_rhs_;
+    std::vector<BoundaryCondition> boundary_rhs_out_;
+    ArrayB2 qbar_rhs_;
+
+    // Region renumbering of the packed rays. mesh_index_ is the mesh region
+    // of each region index used by the packed segments, and is empty unless
+    // the rays are renumbered. The flat source kernels then sweep with copies
+    // of the cross sections and source in the renumbered order, in
+    // xstr_sweep_ and qbar_sweep_, and map the flux tallies back to the mesh
+    // regions as they are reduced.
+    VecI mesh_index_;
+    VecF xstr_sweep_;
+    VecF qbar_sweep_;
+
+    // Projection between the flat source regions and the pin mesh, at the
+    // macroplane axial refinement. The regions of each pin are contiguous,
+    // so pin ip of the macroplanes holds regions [pin_reg_[ip],
+    // pin_reg_[ip+1]). pin_cell_ is the coarse cell of each pin, and
+    // pin_rvol_ the reciprocal of its volume.
+    VecI pin_reg_;
+    VecI pin_cell_;
+    VecF pin_rvol_;
+
+    // Pins swept as macro-segments, see RayData::macro_pins(). macro_reg_ is
+    // the first region of each, which its segments are tallied to,
+    // macro_nreg_ its number of regions, macro_rvol_ the reciprocal of its
+    // volume and macro_plane_ its macroplane. Empty unless the rays have
+    // macro-segments.
+    VecI macro_reg_;
+    VecI macro_nreg_;
+    VecF macro_rvol_;
+    VecI macro_plane_;
+
+    // Per-plane convergence masking. A macroplane whose flux changed by less
+    // than plane_tol_ over its last sweep of a group is skipped, reusing its
+    // previous flux and currents, for at most plane_max_skip_ sweeps in a
+    // row. A tolerance of zero disables the masking.
+    real_t plane_tol_;
+    int plane_max_skip_;
+
+    // Relative change in the flux of each macroplane over its last sweep,
+    // indexed by [group, plane]. Negative until the plane has been swept.
+    ArrayB2 plane_resid_;
+
+    // Number of consecutive sweeps that each macroplane has been skipped,
+    // indexed by [group][plane]
+    std::vector<VecI> plane_skipped_;
+
+    // Whether each macroplane is swept in the current group sweep. These
+    // are all true, unless we are inside of a masked sweep.
+    std::vector<bool> plane_active_;
+    bool all_planes_active_;
+
+    // Consumer of the angles of the sweep in progress, which is told as each
+    // angle is done in all of the active macroplanes. Null unless a derived
+    // sweeper is pipelining its sweep. See sweep_angles().
+    AnglePipeline *angle_pipeline_;
+
+    // The flux of the current group before a masked sweep, and the radial
+    // currents and surface fluxes of the skipped planes, which would
+    // otherwise be wiped out by the sweep
+    ArrayB1 plane_flux_prev_;
+    VecF plane_current_stash_;
+
+    // Total number of skipped plane sweeps, and the ray segments that they
+    // would have swept
+    int n_plane_skipped_;
+    real_t n_seg_skipped_;
+
+    // Per-thread work done in the one-group sweeps, by macroplane and angle.
+    // Only recorded if requested.
+    WorkloadStats workload_;
+
+    // Tuning of the exponential evaluator and the ray schedule over the
+    // first sweeps. Null unless autotuning was requested.
+    std::unique_ptr<Autotuner> tuner_;
+
+    /**
+     * \brief The rays, angular quadrature and everything derived from them,
+     * used in place of the sweeper's own for a range of groups
+     *
+     * The members mirror those of the sweeper, and are swapped into it by
+     * \ref swap_group_set() for as long as one of the groups is being swept,
+     * so that the kernels never need to know which set they are using. The
+     * boundary conditions refer to the sweeper's \c ang_quad_, which holds
+     * the quadrature of whichever set is swapped in.
+     */
+    struct GroupSet {
+        GroupSet(int first, int last, const pugi::xml_node &rays_input,
+                 const AngularQuadrature &quad, const CoreMesh &mesh)
+            : first_group(first),
+              last_group(last),
+              rays(rays_input, quad, mesh),
+              ang_quad(rays.ang_quad())
+        {
+            return;
+        }
+
+        int first_group;
+        int last_group;
+        RayData rays;
+        AngularQuadrature ang_quad;
+        std::vector<BoundaryCondition> boundary;
+        std::vector<BoundaryCondition> boundary_out;
+        SweepSchedule schedule;
+        std::vector<std::pair<int, WorkUnit>> macroplane_units;
+        std::vector<VecI> gs_sweep_after;
+        std::vector<VecI> gs_update_after;
+        VecI gs_first_unit;
+        std::unique_ptr<std::atomic<int>[]> gs_remaining;
+        std::unique_ptr<std::atomic<int>[]> gs_updated;
+    };
+
+    // Group sets with their own rays and quadrature, and the index of the set
+    // of each group, or -1 for the groups that use the sweeper's own
+    std::vector<GroupSet> group_sets_;
+    VecI group_set_index_;
+
+    // Difference between the segments swept by the group sets and what the
+    // sweeper's own rays would have swept in their place
+    real_t n_seg_group_sets_;
 
     // Methods
+    /**
+     * \brief Perform inner iterations on a block of groups using the
+     * multi-group kernel.
+     *
+     * \pre The source and cross sections for all groups in the block have
+     * been stored in \c source_mg_ and \c xstr_mg_.
+     */
+    void sweep_block(int g_first, int g_last);
+
+    /**
+     * \brief Perform a one-group sweep without currents, using whichever
+     * kernel is configured
+     */
+    void sweep1g_nocurrent(int group);
+
+    /**
+     * \brief Perform a one-group sweep on the device, without currents
+     *
+     * This is equivalent to \ref sweep1g() with a \ref NoCurrent worker and
+     * Jacobi boundary updates, but runs through the \ref DeviceSweep.
+     */
+    void sweep1g_device(int group);
+
+    /**
+     * \brief Perform a one-group sweep along the cyclic tracks, without
+     * currents
+     *
+     * Each track is swept from start to finish by a single thread, carrying
+     * the angular flux across the domain boundaries from one ray to the
+     * next. The outgoing flux at the end of each ray is still stored, and the
+     * boundary conditions are updated once all tracks have been swept, so
+     * that the next sweep may start each track from where this one left off.
+     */
+    void sweep1g_cyclic(int group);
+
+    /**
+     * \brief Perform a one-group sweep with all polar angles of an azimuth
+     * together, without currents
+     *
+     * The angles that share an azimuth trace identical 2-D rays, differing
+     * only in \f$1/\sin\theta\f$ and weight. Each ray is swept once, with
+     * the angular flux and exponentials of all of the polar angles carried
+     * along as the innermost dimension, so the segment data is only read
+     * once and the work on each segment vectorizes across polar angles.
+     */
+    void sweep1g_polar(int group);
+
+    /**
+     * \brief Perform a one-group sweep with packets of rays swept together,
+     * without currents
+     *
+     * The rays of each work unit are sorted by their number of segments, and
+     * each packet of eight of them is swept at once, one ray per SIMD lane.
+     * The recurrence along each ray is independent of the others, so the
+     * inner loop over the lanes vectorizes, with the cross sections
+     * and source gathered by region. Shorter rays are padded with empty
+     * segments, which leave their angular flux alone. Rays of a packet may
+     * cross the same region on the same step, so the flux tallies are
+     * scattered one lane at a time.
+     */
+    void sweep1g_packet(int group);
+
+    /**
+     * \brief Perform a one-group sweep with the macroplanes that share rays
+     * swept together, without currents
+     *
+     * Each ray of a stack (see \ref setup_stacks()) is traced once, carrying
+     * an angular flux for each of its active macroplanes. The segment
+     * lengths and regions are read once for the whole stack, and the
+     * exponentials of all of its planes are evaluated in one batch. Only
+     * Jacobi boundary updates are supported.
+     */
+    void sweep1g_stacked(int group);
+
+    /**
+     * \brief Perform a one-group sweep along 3-D characteristics, without
+     * currents
+     *
+     * Each line of the \ref AxialTracks is traced through the macroplanes as
+     * it is swept, so the 3-D segments are never stored. The lines start
+     * from the flux that the last sweep left at the top and bottom of the
+     * domain, which replaces the 2-D boundary conditions and the axial
+     * coupling between the macroplanes.
+     */
+    void sweep1g_3d(int group);
+
+    /**
+     * \brief Reduce the thread-private flux of a one-group sweep into \c
+     * flux_1g_, scaling by the volume and adding back the source, and count
+     * its negative and NaN values
+     *
+     * This must be called by all threads of the sweep's parallel region.
+     */
+    void reduce_flux_1g(int group);
+
+    /**
+     * \brief Make the one-group flux and source flat over each macro pin,
+     * preserving their volume integrals
+     *
+     * The self-scatter source is then flat over the pins as well, as the
+     * merged segments of \ref RayData::macro_pins() assume.
+     */
+    void flatten_macro_pins();
+
+    /**
+     * \brief Update the self-scatter contribution to \c qbar_mg_ for a block
+     * of groups, mirroring \ref SourceIsotropic::self_scatter().
+     */
+    void self_scatter_mg(int g_first, int g_last);
+
+    /**
+     * \brief Update \c qbar_rhs_ from the source and flux of each
+     * right-hand side, as \ref self_scatter_mg() does for a block of groups
+     */
+    void self_scatter_rhs(int group, const ArrayB2 &source,
+                          const ArrayB2 &flux);
+
+    /**
+     * \brief Copy the cross sections and source of the current group into
+     * the region order of the packed rays
+     *
+     * This is a no-op unless the rays are renumbered. The source is assumed
+     * to be isotropic.
+     */
+    void gather_regions();
+
+    /**
+     * \brief Work out the order in which the Gauss-Seidel boundary updates
+     * and the angles of a plane may be done by \ref sweep_plane_gs()
+     */
+    void setup_gs_order();
+
+    /**
+     * \brief Balance the rays of each plane over the threads, and gather the
+     * work units of all macroplanes, longest-first
+     */
+    void setup_schedule();
+
+    /**
+     * \brief Group the macroplanes by their ray geometry, and pair the
+     * balanced work units of each group with it, longest-first, for \ref
+     * sweep1g_stacked()
+     */
+    void setup_stacks();
+
+    /**
+     * \brief Exchange the rays, quadrature and derived data of a \ref
+     * GroupSet with those of the sweeper
+     *
+     * Calling it a second time with the same set restores the sweeper.
+     */
+    void swap_group_set(GroupSet &set);
+
+    /**
+     * \brief Make the incoming boundary flux of a range of groups resident
+     * in full precision, for the boundary conditions currently swapped in
+     *
+     * This does nothing unless the boundary conditions use packed storage.
+     */
+    void load_boundary(int g_first, int g_last);
+
+    /**
+     * \brief Return the number of ray segments in all of the macroplanes
+     */
+    real_t n_seg_planes(const RayData &rays) const;
+
+    /**
+     * \brief Return the transport cross sections, in the region order of the
+     * packed rays
+     */
+    const real_t *sweep_xstr() const
+    {
+        return mesh_index_.empty() ? xstr_.xs().data() : xstr_sweep_.data();
+    }
+
+    /**
+     * \brief Return the transport source for the passed angle, in the region
+     * order of the packed rays
+     */
+    const real_t *sweep_source(int iang) const
+    {
+        return mesh_index_.empty() ? source_->get_transport(iang).data()
+                                   : qbar_sweep_.data();
+    }
+
+    /**
+     * \brief Return the volume-averaged flux of a pin of the macroplanes
+     *
+     * \param ip the index of the pin, counting through the pins of each
+     * macroplane in turn, as in \c pin_cell_
+     * \param group the group of \c flux_ to average
+     */
+    real_t pin_average(int ip, int group) const
+    {
+        real_t f = 0.0;
+        for (int ireg = pin_reg_[ip]; ireg < pin_reg_[ip + 1]; ireg++) {
+            f += flux_(ireg, group) * vol_[ireg];
+        }
+        return f * pin_rvol_[ip];
+    }
+
+    /**
+     * \brief Return the mesh region for a region index of the packed rays
+     */
+    int mesh_region(int i) const
+    {
+        return mesh_index_.empty() ? i : mesh_index_[i];
+    }
+
+    /**
+     * \brief Decide which macroplanes to sweep for the passed group
+     *
+     * This is a no-op unless plane masking is enabled. Any call must be
+     * followed by a call to \ref finish_plane_mask() once the group sweep is
+     * done.
+     */
+    void set_plane_mask(int group);
+
+    /**
+     * \brief Update the residuals of the swept planes, and mark all of the
+     * planes active again
+     */
+    void finish_plane_mask(int group);
+
+    /**
+     * \brief Save the radial currents of the skipped planes, before they are
+     * zeroed for the current sweep
+     */
+    void stash_plane_currents(int group);
+
+    /**
+     * \brief Restore the radial currents stashed by \ref
+     * stash_plane_currents()
+     */
+    void restore_plane_currents(int group);
+
+    /**
+     * \brief Set up the autotuner with the candidate exponential evaluators
+     * and ray schedules
+     *
+     * \param input the sweeper input
+     * \param exponential the exponential evaluator selected from the input
+     * \param tune_exponential whether to try the other evaluators
+     * \param tune_schedule whether to try both ray schedules
+     */
+    void setup_autotune(const pugi::xml_node &input,
+                        const std::string &exponential,
+                        bool tune_exponential, bool tune_schedule);
+
+    /**
+     * \brief Switch to a configuration made by \ref setup_autotune()
+     */
+    void apply_tuning(const std::string &config);
+
+    /**
+     * \brief Return the total number of ray segments swept so far
+     */
+    real_t n_seg_swept() const;
+
     /**
      * \brief Return the MoC plane corresponding to the passed axial index
      */
@@ -197,36 +866,75 @@ protected:
 
     template <class Function> void update_incoming_generic(Function f)
     {
-        // There are probably more efficient ways to do this, but for now, just
-        // loop over all of the rays, look up the appropriate surface from the
-        // Mesh, and adjust the BC accordingly
-        for (auto g : groups_) {
+        // The groups of each group set are updated with its own rays
+        this->update_incoming_set(f, -1);
+        for (int iset = 0; iset < (int)group_sets_.size(); iset++) {
+            this->swap_group_set(group_sets_[iset]);
+            this->update_incoming_set(f, iset);
+            this->swap_group_set(group_sets_[iset]);
+        }
+        return;
+    }
+
+    template <class Function> void update_incoming_set(Function f, int iset)
+    {
+        // Loop over all of the rays, look up the appropriate surface from the
+        // Mesh, and adjust the BC accordingly. Each group and angle touches
+        // its own boundary values, so they are done in parallel.
+        const int n_group = groups_.size();
+        const int n_ang   = ang_quad_.ndir() / 2;
+        auto update_angle = [&](int g, int iang) {
+            int iang1 = iang;
+            int iang2 = ang_quad_.reverse(iang);
+
             int iplane = 0;
-            for (auto plane_geom_id : mesh_.unique_plane_ids()) {
-                auto &bc         = boundary_[iplane];
-                const auto &rays = rays_[plane_geom_id];
-                int iang         = 0;
-                for (const auto &ang_rays : rays) {
-                    int iang1 = iang;
-                    int iang2 = ang_quad_.reverse(iang);
-
-                    real_t *bc_fw = bc.get_boundary(g, iang1).second;
-                    real_t *bc_bw = bc.get_boundary(g, iang2).second;
-
-                    for (const auto &ray : ang_rays) {
-                        int is1 = ray.cm_cell_fw();
-                        int is2 = ray.cm_cell_bw();
-                        int bc1 = ray.bc(0);
-                        int bc2 = ray.bc(1);
-
-                        bc_fw[bc1] = f(bc_fw[bc1], is1, g);
-                        bc_bw[bc2] = f(bc_bw[bc2], is2, g);
-                    } // rays
-
-                    iang++;
-                } // angles
+            for (auto plane_geom_id : macroplane_unique_ids_) {
+                auto &bc             = boundary_[iplane];
+                const auto &ang_rays = rays_[plane_geom_id][iang];
+
+                real_t *bc_fw = bc.get_boundary(g, iang1).second;
+                real_t *bc_bw = bc.get_boundary(g, iang2).second;
+
+                for (const auto &ray : ang_rays) {
+                    int is1 = ray.cm_cell_fw();
+                    int is2 = ray.cm_cell_bw();
+                    int bc1 = ray.bc(0);
+                    int bc2 = ray.bc(1);
+
+                    bc_fw[bc1] = f(bc_fw[bc1], is1, g);
+                    bc_bw[bc2] = f(bc_bw[bc2], is2, g);
+                } // rays
+
                 iplane++;
             } // planes
+        };
+
+        // Packed boundary conditions only hold a few groups in full
+        // precision at a time, so the groups are loaded one after another
+        if (packed_boundary_) {
+            for (int ig = 0; ig < n_group; ig++) {
+                int g = groups_[ig];
+                if (group_set_index_[g] != iset) {
+                    continue;
+                }
+                this->load_boundary(g, g);
+#pragma omp parallel for schedule(dynamic)
+                for (int iang = 0; iang < n_ang; iang++) {
+                    update_angle(g, iang);
+                }
+            }
+            return;
+        }
+
+#pragma omp parallel for collapse(2) schedule(dynamic)
+        for (int ig = 0; ig < n_group; ig++) {
+            for (int iang = 0; iang < n_ang; iang++) {
+                int g = groups_[ig];
+                if (group_set_index_[g] != iset) {
+                    continue;
+                }
+                update_angle(g, iang);
+            } // angles
         }     // groups
 
         return;
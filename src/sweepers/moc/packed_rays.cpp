@@ -0,0 +1,332 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include "packed_rays.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <istream>
+#include <limits>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include "util/error.hpp"
+
+namespace {
+// Resolution used to match the segment lengths of pin crossings
+const mocc::real_t CHUNK_RESOLUTION = 1.0e-9;
+
+template <typename Vec> void put(std::ostream &os, const Vec &v)
+{
+    uint64_t n = v.size();
+    os.write(reinterpret_cast<const char *>(&n), sizeof(n));
+    os.write(reinterpret_cast<const char *>(v.data()),
+             v.size() * sizeof(*v.data()));
+    return;
+}
+
+// Read a vector written by put(), which must have n elements
+template <typename Vec> bool get(std::istream &is, Vec &v, size_t n)
+{
+    uint64_t n_file = 0;
+    is.read(reinterpret_cast<char *>(&n_file), sizeof(n_file));
+    if (!is || (n_file != n)) {
+        return false;
+    }
+    v.resize(n);
+    is.read(reinterpret_cast<char *>(v.data()), n * sizeof(*v.data()));
+    return (bool)is;
+}
+
+template <typename Vec> void release(Vec &v)
+{
+    Vec().swap(v);
+    return;
+}
+
+// Call f(first, last) for the segments [first, last) of each pin crossing of
+// a ray, using the coarse ray data
+template <typename F> void for_each_crossing(const mocc::moc::Ray &ray, F f)
+{
+    int iseg = 0;
+    for (const auto &rcd : ray.cm_data()) {
+        int n = rcd.nseg_fw;
+        if ((n == 0) || (iseg + n > ray.nseg())) {
+            continue;
+        }
+        f(iseg, iseg + n);
+        iseg += n;
+    }
+    // Anything left over is treated as its own crossing
+    if (iseg < ray.nseg()) {
+        f(iseg, ray.nseg());
+    }
+    return;
+}
+}
+
+namespace mocc {
+namespace moc {
+PackedRays::PackedRays(const std::vector<Ray> &rays, int n_reg)
+    : modular_(false),
+      compact_(false),
+      wide_index_(n_reg > std::numeric_limits<uint16_t>::max()),
+      len_step_(0.0)
+{
+    offset_.reserve(rays.size() + 1);
+    offset_.push_back(0);
+    for (const auto &ray : rays) {
+        offset_.push_back(offset_.back() + ray.nseg());
+    }
+
+    int n_seg = offset_.back();
+    seg_len_.reserve(n_seg);
+    if (wide_index_) {
+        seg_index_32_.reserve(n_seg);
+    } else {
+        seg_index_16_.reserve(n_seg);
+    }
+
+    for (const auto &ray : rays) {
+        for (int iseg = 0; iseg < ray.nseg(); iseg++) {
+            seg_len_.push_back(ray.seg_len(iseg));
+            if (wide_index_) {
+                seg_index_32_.push_back(ray.seg_index(iseg));
+            } else {
+                seg_index_16_.push_back(ray.seg_index(iseg));
+            }
+        }
+    }
+
+    return;
+}
+
+PackedRays::PackedRays(const std::vector<Ray> &rays, int n_reg,
+                       const VecF &correction)
+    : modular_(true),
+      compact_(false),
+      wide_index_(n_reg > std::numeric_limits<uint16_t>::max()),
+      correction_(correction.begin(), correction.end()),
+      len_step_(0.0)
+{
+    assert((int)correction.size() == n_reg);
+
+    offset_.reserve(rays.size() + 1);
+    offset_.push_back(0);
+    link_offset_.reserve(rays.size() + 1);
+    link_offset_.push_back(0);
+    chunk_offset_.push_back(0);
+
+    // Map from the local regions and quantized lengths of a pin crossing to
+    // its chunk index
+    std::unordered_map<std::string, int> chunk_ids;
+    std::vector<long long> key;
+
+    // Add the segments [first, last) of a ray as a link to a chunk
+    auto add_link = [&](const Ray &ray, int first, int last) {
+        int first_reg = ray.seg_index(first);
+        for (int iseg = first; iseg < last; iseg++) {
+            first_reg = std::min(first_reg, (int)ray.seg_index(iseg));
+        }
+
+        key.clear();
+        for (int iseg = first; iseg < last; iseg++) {
+            int ireg = ray.seg_index(iseg);
+            key.push_back(ireg - first_reg);
+            key.push_back(std::llround(ray.seg_len(iseg) / correction[ireg] /
+                                       CHUNK_RESOLUTION));
+        }
+        std::string key_str(reinterpret_cast<const char *>(key.data()),
+                            key.size() * sizeof(long long));
+
+        auto result = chunk_ids.emplace(key_str, n_chunks());
+        if (result.second) {
+            // New chunk
+            for (int iseg = first; iseg < last; iseg++) {
+                int ireg = ray.seg_index(iseg);
+                assert(ireg - first_reg <= std::numeric_limits<uint16_t>::max());
+                chunk_len_.push_back(ray.seg_len(iseg) / correction[ireg]);
+                chunk_reg_.push_back(ireg - first_reg);
+            }
+            chunk_offset_.push_back(chunk_len_.size());
+        }
+        links_.push_back({result.first->second, first_reg});
+    };
+
+    for (const auto &ray : rays) {
+        offset_.push_back(offset_.back() + ray.nseg());
+
+        for_each_crossing(
+            ray, [&](int first, int last) { add_link(ray, first, last); });
+
+        link_offset_.push_back(links_.size());
+    }
+
+    return;
+}
+
+PackedRays::PackedRays(const std::vector<Ray> &rays, int n_reg,
+                       real_t tolerance)
+    : modular_(false),
+      compact_(true),
+      wide_index_(n_reg > std::numeric_limits<uint16_t>::max()),
+      len_step_(0.0)
+{
+    const int max_delta = std::numeric_limits<uint8_t>::max();
+
+    offset_.reserve(rays.size() + 1);
+    offset_.push_back(0);
+    for (const auto &ray : rays) {
+        offset_.push_back(offset_.back() + ray.nseg());
+    }
+    int n_seg = offset_.back();
+    seg_delta_.reserve(n_seg);
+
+    // Use the finest quantization step that still reaches the longest
+    // segment
+    if (tolerance > 0.0) {
+        real_t max_len = 0.0;
+        for (const auto &ray : rays) {
+            for (auto l : ray.seg_len()) {
+                max_len = std::max(max_len, l);
+            }
+        }
+        len_step_ = max_len / std::numeric_limits<uint16_t>::max();
+        if (0.5 * len_step_ > tolerance) {
+            throw EXCEPT("Ray segments are too long to quantize to the "
+                         "requested tolerance.");
+        }
+        seg_len_q_.reserve(n_seg);
+    } else {
+        seg_len_.reserve(n_seg);
+    }
+
+    // Add the segments [first, last) of a ray as pin entries. A crossing is
+    // split into several entries if its regions don't fit in a byte.
+    auto add_entries = [&](const Ray &ray, int first, int last) {
+        int iseg = first;
+        while (iseg < last) {
+            int lo  = ray.seg_index(iseg);
+            int hi  = lo;
+            int end = iseg + 1;
+            while ((end < last) && (end - iseg < max_delta)) {
+                int ireg = ray.seg_index(end);
+                if (std::max(hi, ireg) - std::min(lo, ireg) > max_delta) {
+                    break;
+                }
+                lo = std::min(lo, ireg);
+                hi = std::max(hi, ireg);
+                end++;
+            }
+            entry_reg_.push_back(lo);
+            entry_nseg_.push_back(end - iseg);
+            for (; iseg < end; iseg++) {
+                seg_delta_.push_back(ray.seg_index(iseg) - lo);
+            }
+        }
+    };
+
+    entry_offset_.reserve(rays.size() + 1);
+    entry_offset_.push_back(0);
+    for (const auto &ray : rays) {
+        for_each_crossing(
+            ray, [&](int first, int last) { add_entries(ray, first, last); });
+        entry_offset_.push_back(entry_reg_.size());
+
+        for (auto l : ray.seg_len()) {
+            if (len_step_ > 0.0) {
+                long q = std::lround(l / len_step_);
+                seg_len_q_.push_back(std::min<long>(
+                    q, std::numeric_limits<uint16_t>::max()));
+            } else {
+                seg_len_.push_back(l);
+            }
+        }
+    }
+
+    return;
+}
+
+void PackedRays::renumber(const VecI &new_index)
+{
+    assert(!modular_ && !compact_);
+    for (auto &ireg : seg_index_16_) {
+        ireg = new_index[ireg];
+    }
+    for (auto &ireg : seg_index_32_) {
+        ireg = new_index[ireg];
+    }
+    return;
+}
+
+void PackedRays::write_segments(std::ostream &os) const
+{
+    assert(!modular_ && !compact_);
+    assert(this->resident());
+    put(os, seg_len_);
+    if (wide_index_) {
+        put(os, seg_index_32_);
+    } else {
+        put(os, seg_index_16_);
+    }
+    return;
+}
+
+void PackedRays::read_segments(std::istream &is)
+{
+    assert(!modular_ && !compact_);
+    size_t n_seg = offset_.back();
+    bool ok      = get(is, seg_len_, n_seg);
+    if (wide_index_) {
+        ok = ok && get(is, seg_index_32_, n_seg);
+    } else {
+        ok = ok && get(is, seg_index_16_, n_seg);
+    }
+    if (!ok) {
+        this->release_segments();
+        throw EXCEPT("Failed to read packed ray segments");
+    }
+    return;
+}
+
+void PackedRays::release_segments()
+{
+    assert(!modular_ && !compact_);
+    release(seg_len_);
+    release(seg_index_16_);
+    release(seg_index_32_);
+    return;
+}
+
+size_t PackedRays::memory() const
+{
+    return offset_.size() * sizeof(int) + seg_len_.size() * sizeof(float) +
+           seg_index_16_.size() * sizeof(uint16_t) +
+           seg_index_32_.size() * sizeof(uint32_t) +
+           link_offset_.size() * sizeof(int) + links_.size() * sizeof(Link) +
+           chunk_offset_.size() * sizeof(int) +
+           chunk_len_.size() * sizeof(float) +
+           chunk_reg_.size() * sizeof(uint16_t) +
+           correction_.size() * sizeof(float) +
+           entry_offset_.size() * sizeof(int) +
+           entry_reg_.size() * sizeof(uint32_t) +
+           entry_nseg_.size() * sizeof(uint8_t) +
+           seg_delta_.size() * sizeof(uint8_t) +
+           seg_len_q_.size() * sizeof(uint16_t);
+}
+}
+}
@@ -0,0 +1,390 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+#include "util/aligned_allocator.hpp"
+#include "util/global_config.hpp"
+#include "ray.hpp"
+
+namespace mocc {
+namespace moc {
+/**
+ * \brief Packed storage of the segment data for all of the rays in a single
+ * plane and angle.
+ *
+ * Each \ref Ray keeps its own segment lengths and region indices, each in its
+ * own heap allocation. This is convenient for ray tracing and for the coarse
+ * ray data, but it makes the MoC sweep chase pointers from ray to ray. The
+ * \ref PackedRays stores the segments of every ray in a plane/angle back to
+ * back in a single arena, with single-precision lengths and region indices
+ * that are only as wide as the number of regions in the plane requires. An
+ * offsets table marks the first segment of each ray.
+ *
+ * Alternatively, the segments can be stored modularly. Each ray is broken
+ * into its pin crossings, and each geometrically-unique crossing (same
+ * pin-local regions and uncorrected segment lengths) is stored only once.
+ * Each ray is then a list of links, each naming a unique crossing and the
+ * index of its first region. The volume-correction factors are applied per
+ * region when a ray is expanded for the sweep with \ref expand(). For
+ * lattices of repeated pins this reduces the segment storage considerably, at
+ * the cost of expanding each ray as it is swept.
+ *
+ * The segments can also be stored compactly. Each ray is broken into pin
+ * entries, each holding the plane index of its first region and its number
+ * of segments, and each segment stores only the one-byte offset of its region
+ * from that of its entry. The lengths are stored in single precision, or
+ * optionally quantized to 16 bits with a bounded absolute error. Compact
+ * segments are also decoded for the sweep with \ref expand().
+ *
+ * The packed (non-modular) segment data may also be written to a stream and
+ * released, and read back later, for out-of-core sweeps. The ray offsets are
+ * always kept, so the number of rays and segments can be queried while the
+ * segments are not resident.
+ */
+class PackedRays {
+public:
+    /**
+     * \brief Pack the segment data from a set of \ref Ray
+     *
+     * \param rays the rays to pack
+     * \param n_reg the number of regions in the plane. This determines the
+     * width of the region indices.
+     */
+    PackedRays(const std::vector<Ray> &rays, int n_reg);
+
+    /**
+     * \brief Pack the segment data from a set of \ref Ray into modular
+     * storage.
+     *
+     * \param rays the rays to pack
+     * \param n_reg the number of regions in the plane
+     * \param correction the volume-correction factor that was applied to
+     * the segments in each region of the plane
+     */
+    PackedRays(const std::vector<Ray> &rays, int n_reg,
+               const VecF &correction);
+
+    /**
+     * \brief Pack the segment data from a set of \ref Ray into compact
+     * storage.
+     *
+     * \param rays the rays to pack
+     * \param n_reg the number of regions in the plane
+     * \param tolerance the largest absolute error allowed in the segment
+     * lengths. If positive, the lengths are quantized to 16 bits, using the
+     * finest step that covers the longest segment, and this throws if that
+     * step is too coarse for the tolerance. Otherwise the lengths are stored
+     * in single precision.
+     */
+    PackedRays(const std::vector<Ray> &rays, int n_reg, real_t tolerance);
+
+    /**
+     * \brief Return whether the segments are stored modularly. If so, the
+     * segments must be accessed with \ref expand().
+     */
+    bool modular() const
+    {
+        return modular_;
+    }
+
+    /**
+     * \brief Return whether the segments are stored compactly. If so, the
+     * segments must be accessed with \ref expand().
+     */
+    bool compact() const
+    {
+        return compact_;
+    }
+
+    /**
+     * \brief Return the largest error in the segment lengths from
+     * quantization in compact storage. This is zero if the lengths are not
+     * quantized.
+     */
+    real_t length_error() const
+    {
+        return 0.5 * len_step_;
+    }
+
+    /**
+     * \brief Return the number of pin entries in compact storage
+     */
+    int n_entries() const
+    {
+        return entry_reg_.size();
+    }
+
+    /**
+     * \brief Return the number of unique pin crossings in modular storage
+     */
+    int n_chunks() const
+    {
+        return chunk_offset_.empty() ? 0 : chunk_offset_.size() - 1;
+    }
+
+    /**
+     * \brief Expand the segments of the indexed ray from modular or compact
+     * storage
+     *
+     * \param iray the ray to expand
+     * \param[out] len the corrected segment lengths, with room for \ref
+     * nseg() values
+     * \param[out] idx the region index of each segment
+     *
+     * \pre \ref modular() or \ref compact() is true
+     */
+    void expand(int iray, float *len, uint32_t *idx) const
+    {
+        assert(modular_ || compact_);
+        if (compact_) {
+            this->decode(iray, len, idx);
+            return;
+        }
+        int iseg = 0;
+        for (int il = link_offset_[iray]; il < link_offset_[iray + 1]; il++) {
+            const auto &link = links_[il];
+            for (int i = chunk_offset_[link.chunk];
+                 i < chunk_offset_[link.chunk + 1]; i++) {
+                uint32_t ireg = link.first_reg + chunk_reg_[i];
+                idx[iseg]     = ireg;
+                len[iseg]     = chunk_len_[i] * correction_[ireg];
+                iseg++;
+            }
+        }
+        assert(iseg == this->nseg(iray));
+        return;
+    }
+
+    /**
+     * \brief Return the number of rays
+     */
+    int n_rays() const
+    {
+        return offset_.size() - 1;
+    }
+
+    /**
+     * \brief Return the number of segments in the indexed ray
+     */
+    int nseg(int iray) const
+    {
+        return offset_[iray + 1] - offset_[iray];
+    }
+
+    /**
+     * \brief Return the index of the first segment of the indexed ray in the
+     * packed storage.
+     */
+    int seg_offset(int iray) const
+    {
+        return offset_[iray];
+    }
+
+    /**
+     * \brief Return a pointer to the segment lengths of the indexed ray
+     */
+    const float *seg_len(int iray) const
+    {
+        assert(!modular_ && !compact_);
+        assert(this->resident());
+        return seg_len_.data() + offset_[iray];
+    }
+
+    /**
+     * \brief Return whether the region indices are stored as 32-bit
+     * integers. If not, they are stored as 16-bit integers.
+     */
+    bool wide_index() const
+    {
+        return wide_index_;
+    }
+
+    /**
+     * \brief Return a pointer to the 16-bit region indices of the indexed
+     * ray.
+     *
+     * \pre \ref wide_index() is false
+     */
+    const uint16_t *seg_index_16(int iray) const
+    {
+        assert(!modular_ && !compact_);
+        assert(!wide_index_);
+        assert(this->resident());
+        return seg_index_16_.data() + offset_[iray];
+    }
+
+    /**
+     * \brief Return a pointer to the 32-bit region indices of the indexed
+     * ray.
+     *
+     * \pre \ref wide_index() is true
+     */
+    const uint32_t *seg_index_32(int iray) const
+    {
+        assert(!modular_ && !compact_);
+        assert(wide_index_);
+        assert(this->resident());
+        return seg_index_32_.data() + offset_[iray];
+    }
+
+    /**
+     * \brief Replace the region index of every segment
+     *
+     * \param new_index the new index of each region in the plane
+     *
+     * \pre \ref modular() and \ref compact() are false
+     */
+    void renumber(const VecI &new_index);
+
+    /**
+     * \brief Return whether the segment data is in memory
+     */
+    bool resident() const
+    {
+        return modular_ || compact_ ||
+               (seg_len_.size() == (size_t)offset_.back());
+    }
+
+    /**
+     * \brief Write the segment lengths and region indices to a binary
+     * stream
+     *
+     * \pre \ref modular() and \ref compact() are false
+     */
+    void write_segments(std::ostream &os) const;
+
+    /**
+     * \brief Read back the segment data written by \ref write_segments(),
+     * making it resident
+     *
+     * Throws if the stream doesn't hold the segments of these rays.
+     */
+    void read_segments(std::istream &is);
+
+    /**
+     * \brief Free the segment lengths and region indices, keeping the ray
+     * offsets
+     *
+     * \pre \ref modular() and \ref compact() are false
+     */
+    void release_segments();
+
+    /**
+     * \brief Return the number of bytes used to store the packed segments
+     */
+    size_t memory() const;
+
+private:
+    /**
+     * \brief Decode the segments of the indexed ray from compact storage
+     */
+    void decode(int iray, float *len, uint32_t *idx) const
+    {
+        assert(compact_);
+        const int first     = offset_[iray];
+        const int n         = this->nseg(iray);
+        const uint8_t *dreg = seg_delta_.data() + first;
+        int iseg            = 0;
+        for (int ie = entry_offset_[iray]; ie < entry_offset_[iray + 1];
+             ie++) {
+            const uint32_t base = entry_reg_[ie];
+            const int stop      = iseg + entry_nseg_[ie];
+            for (; iseg < stop; iseg++) {
+                idx[iseg] = base + dreg[iseg];
+            }
+        }
+        assert(iseg == n);
+
+        if (seg_len_q_.empty()) {
+            const float *l = seg_len_.data() + first;
+            for (int i = 0; i < n; i++) {
+                len[i] = l[i];
+            }
+        } else {
+            const uint16_t *q = seg_len_q_.data() + first;
+            const float step  = len_step_;
+#pragma omp simd
+            for (int i = 0; i < n; i++) {
+                len[i] = step * q[i];
+            }
+        }
+        return;
+    }
+
+    bool modular_;
+
+    bool compact_;
+
+    bool wide_index_;
+
+    // Index of the first segment of each ray, with one extra entry at the end
+    std::vector<int> offset_;
+
+    // The segment data is the bulk of the ray storage and is streamed
+    // through on every sweep, so it is cache-line aligned, and may be backed
+    // by huge pages to reduce TLB misses (see \ref set_huge_pages())
+    AlignedVector<float> seg_len_;
+
+    // Only one of these is used, depending on wide_index_
+    AlignedVector<uint16_t> seg_index_16_;
+    AlignedVector<uint32_t> seg_index_32_;
+
+    // Modular storage. Each link refers to a unique pin crossing (chunk),
+    // and gives the plane index of the region that the chunk's local region
+    // indices are relative to.
+    struct Link {
+        int chunk;
+        int first_reg;
+    };
+
+    // Index of the first link of each ray, with one extra entry at the end
+    std::vector<int> link_offset_;
+    std::vector<Link> links_;
+
+    // Index of the first segment of each chunk, with one extra entry at the
+    // end
+    std::vector<int> chunk_offset_;
+
+    // Uncorrected segment lengths and local region indices of the chunks
+    AlignedVector<float> chunk_len_;
+    AlignedVector<uint16_t> chunk_reg_;
+
+    // Volume-correction factor for each region
+    AlignedVector<float> correction_;
+
+    // Compact storage. Index of the first pin entry of each ray, with one
+    // extra entry at the end, and the first region and number of segments
+    // of each entry.
+    std::vector<int> entry_offset_;
+    AlignedVector<uint32_t> entry_reg_;
+    AlignedVector<uint8_t> entry_nseg_;
+
+    // Region of each segment, relative to the first region of its entry
+    AlignedVector<uint8_t> seg_delta_;
+
+    // Quantized segment lengths, in units of len_step_. If these are empty,
+    // the lengths are in seg_len_.
+    AlignedVector<uint16_t> seg_len_q_;
+    float len_step_;
+};
+}
+}
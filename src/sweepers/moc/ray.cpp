@@ -17,6 +17,11 @@
 #include "ray.hpp"
 
 #include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include "util/error.hpp"
 
 // Assuming that p1 is the "origin" return the quadrant of the angle formed by
 // p1. Since we assume that p1 is below p2 in y, only octants 1 or 2 can be
@@ -27,8 +32,140 @@ inline int get_octant(mocc::Point2 p1, mocc::Point2 p2)
     return (p2.x > p1.x) ? 1 : 2;
 }
 
+namespace {
+// Resolution used to match pin-local points in the PinTraceCache
+const mocc::real_t CACHE_RESOLUTION = 1.0e-10;
+
+// Helpers for the binary ray format. Values are stored in native layout,
+// since ray files are only meant to be reused on the same machine.
+template <typename T> void put(std::ostream &os, const T &v)
+{
+    os.write(reinterpret_cast<const char *>(&v), sizeof(T));
+}
+
+template <typename T> void put(std::ostream &os, const std::vector<T> &v)
+{
+    put(os, (uint64_t)v.size());
+    os.write(reinterpret_cast<const char *>(v.data()), v.size() * sizeof(T));
+}
+
+template <typename T> void get(const char *&data, T &v)
+{
+    std::memcpy(&v, data, sizeof(T));
+    data += sizeof(T);
+}
+
+template <typename T> void get(const char *&data, std::vector<T> &v)
+{
+    uint64_t n;
+    get(data, n);
+    v.resize(n);
+    std::memcpy(v.data(), data, n * sizeof(T));
+    data += n * sizeof(T);
+}
+}
+
 namespace mocc {
 namespace moc {
+int PinTraceCache::trace(const PinMesh &pm, Point2 p1, Point2 p2,
+                         int first_reg, VecF &s, VecI &reg)
+{
+    int nseg = this->queue(pm, p1, p2, first_reg);
+    this->flush(s, reg);
+    return nseg;
+}
+
+int PinTraceCache::queue(const PinMesh &pm, Point2 p1, Point2 p2,
+                         int first_reg)
+{
+    Key key = {&pm,
+               {{std::llround(p1.x / CACHE_RESOLUTION),
+                 std::llround(p1.y / CACHE_RESOLUTION),
+                 std::llround(p2.x / CACHE_RESOLUTION),
+                 std::llround(p2.y / CACHE_RESOLUTION)}}};
+
+    auto it = cache_.find(key);
+    if (it == cache_.end()) {
+        Segments segs;
+        visit(pm, [&](const auto &m) {
+            return m.trace(p1, p2, 0, segs.len, segs.reg);
+        });
+        it = cache_.emplace(key, std::move(segs)).first;
+    } else {
+        hits_++;
+    }
+
+    queue_.emplace_back(&it->second, first_reg);
+    return it->second.len.size();
+}
+
+void PinTraceCache::flush(VecF &s, VecI &reg)
+{
+    for (const auto &crossing : queue_) {
+        const Segments &segs = *crossing.first;
+        s.insert(s.end(), segs.len.begin(), segs.len.end());
+        for (auto r : segs.reg) {
+            reg.push_back(r + crossing.second);
+        }
+    }
+    queue_.clear();
+    return;
+}
+
+void Ray::trace(Point2 p1, Point2 p2, int iplane, const CoreMesh &mesh,
+                PinTraceCache *cache, std::vector<Point2> &ps, VecF &len,
+                VecI &reg, VecI *pin_nseg)
+{
+    ps.clear();
+    ps.push_back(p1);
+    ps.push_back(p2);
+
+    mesh.trace(ps);
+    if (pin_nseg) {
+        pin_nseg->reserve(pin_nseg->size() + ps.size() - 1);
+    }
+
+    size_t n_total = 0;
+    auto p_prev    = ps.front();
+    for (auto pi = ps.begin() + 1; pi != ps.end(); ++pi) {
+        // Use the midpoint of the pin entry and exit points to locate the
+        // pin.
+        auto pin_p = Midpoint(*pi, p_prev);
+
+        int first_reg          = 0;
+        // pin_p is overwritten as global coordinates of pin center.
+        const PinMeshTuple pmt = mesh.get_pinmesh(pin_p, iplane, first_reg);
+
+        int nseg = 0;
+        if (cache) {
+            nseg = cache->queue(*pmt.pm, p_prev - pin_p, *pi - pin_p,
+                                first_reg);
+            n_total += nseg;
+        } else {
+            nseg = visit(*pmt.pm, [&](const auto &pm) {
+                return pm.trace(p_prev - pin_p, *pi - pin_p, first_reg, len,
+                                reg);
+            });
+        }
+
+        if (pin_nseg) {
+            pin_nseg->push_back(nseg);
+        }
+
+        p_prev = *pi;
+    }
+
+    // With a cache, every crossing is resolved before any segments are
+    // stored, so the storage is sized exactly, once
+    if (cache) {
+        len.reserve(len.size() + n_total);
+        reg.reserve(reg.size() + n_total);
+        cache->flush(len, reg);
+    }
+
+    return;
+}
+
 /**
  * \param p1 the starting point of the \ref Ray.
  *
@@ -43,6 +180,8 @@ namespace moc {
  *
  * \param mesh a reference to the CoreMesh to trace.
  *
+ * \param cache an optional \ref PinTraceCache to use for the pin traces.
+ *
  * A Ray is defined by two \ref Point2 structs, specifying the beginning and
  * end of a ray, on the boundary of the problem. Given these two points, all
  * of the segments of the ray are determined by first finding intersections
@@ -50,37 +189,15 @@ namespace moc {
  * surface crossings for each pin (using \ref PinMesh::trace()).
  */
 Ray::Ray(Point2 p1, Point2 p2, std::array<int, 2> bc, int iplane,
-         const CoreMesh &mesh)
+         const CoreMesh &mesh, PinTraceCache *cache)
     : bc_(bc), p1_(p1), p2_(p2)
 {
-    std::vector<Point2> ps;
-
-    ps.push_back(p1);
-    ps.push_back(p2);
-
-    mesh.trace(ps);
-    std::vector<Point2> cps = ps;
-
     // Trace the fine ray. We need to keep track of the number of segments
     // in each pin crossing for the coarse ray data.
+    std::vector<Point2> cps;
     VecI cm_nseg;
-    auto p_prev = cps.front();
-    for (auto pi = ps.begin() + 1; pi != ps.end(); ++pi) {
-        // Use the midpoint of the pin entry and exit points to locate the
-        // pin.
-        auto pin_p = Midpoint(*pi, p_prev);
-
-        int first_reg          = 0;
-        // pin_p is overwritten as global coordinates of pin center.
-        const PinMeshTuple pmt = mesh.get_pinmesh(pin_p, iplane, first_reg);
-
-        int nseg = pmt.pm->trace(p_prev - pin_p, *pi - pin_p, first_reg,
-                                 seg_len_, seg_index_);
-
-        cm_nseg.push_back(nseg);
-
-        p_prev = *pi;
-    }
+    Ray::trace(p1, p2, iplane, mesh, cache, cps, seg_len_, seg_index_,
+               &cm_nseg);
 
     // Figure out the coarse mesh data for the ray. Start with the starting
     // cells and surfaces.
@@ -137,6 +254,14 @@ Ray::Ray(Point2 p1, Point2 p2, std::array<int, 2> bc, int iplane,
         }
     }
 
+    for (const auto *nsegs : {&nsegs_fw, &nsegs_bw}) {
+        for (int n : *nsegs) {
+            if (n > MAX_NSEG) {
+                throw EXCEPT("Too many ray segments in a single pin");
+            }
+        }
+    }
+
     size_t stp = std::min(nsegs_fw.size(), nsegs_bw.size());
     for (size_t i = 0; i < stp; i++) {
         RayCoarseData rcd;
@@ -172,6 +297,159 @@ Ray::Ray(Point2 p1, Point2 p2, std::array<int, 2> bc, int iplane,
 
     nseg_ = seg_len_.size();
 
+    // Resolve the coarse ray data into the crossed surfaces
+    int cell_fw = cm_cell_fw_;
+    int cell_bw = cm_cell_bw_;
+    int iseg_fw = 0;
+    int iseg_bw = nseg_;
+    crossings_fw_.reserve(cm_data_.size() + 1);
+    crossings_bw_.reserve(cm_data_.size() + 1);
+    crossings_fw_.push_back(
+        {iseg_fw, (unsigned)cm_surf_fw_,
+         (unsigned)mesh.surface_normal(cm_surf_fw_)});
+    crossings_bw_.push_back(
+        {iseg_bw, (unsigned)cm_surf_bw_,
+         (unsigned)mesh.surface_normal(cm_surf_bw_)});
+    for (const auto &rcd : cm_data_) {
+        if (rcd.fw != Surface::INVALID) {
+            iseg_fw += rcd.nseg_fw;
+            crossings_fw_.push_back(
+                {iseg_fw, (unsigned)mesh.coarse_surf(cell_fw, rcd.fw),
+                 (unsigned)surface_to_normal(rcd.fw)});
+        }
+        if (rcd.bw != Surface::INVALID) {
+            iseg_bw -= rcd.nseg_bw;
+            crossings_bw_.push_back(
+                {iseg_bw, (unsigned)mesh.coarse_surf(cell_bw, rcd.bw),
+                 (unsigned)surface_to_normal(rcd.bw)});
+        }
+        cell_fw = mesh.coarse_neighbor(cell_fw, rcd.fw);
+        cell_bw = mesh.coarse_neighbor(cell_bw, rcd.bw);
+    }
+
+    return;
+}
+
+void Ray::merge_segments(const VecI &merged)
+{
+    // Segments on either side of a coarse surface are never merged
+    std::vector<bool> split(nseg_ + 1, false);
+    for (const auto &c : crossings_fw_) {
+        split[c.iseg] = true;
+    }
+    for (const auto &c : crossings_bw_) {
+        split[c.iseg] = true;
+    }
+
+    // Merge in place, noting the new index of the angular flux at the start
+    // of each of the old segments
+    VecI new_iseg(nseg_ + 1, 0);
+    int n = 0;
+    for (int i = 0; i < (int)nseg_; i++) {
+        new_iseg[i] = n;
+        int ireg    = merged[seg_index_[i]];
+        if ((n > 0) && !split[i] && (seg_index_[n - 1] == ireg)) {
+            seg_len_[n - 1] += seg_len_[i];
+        } else {
+            seg_len_[n]   = seg_len_[i];
+            seg_index_[n] = ireg;
+            n++;
+        }
+    }
+    new_iseg[nseg_] = n;
+
+    // Every pin crossing starts and ends on a split, so its new number of
+    // segments follows from the new indices of its ends
+    int iseg_fw = 0;
+    int iseg_bw = nseg_;
+    for (auto &rcd : cm_data_) {
+        int n_fw    = rcd.nseg_fw;
+        rcd.nseg_fw = new_iseg[iseg_fw + n_fw] - new_iseg[iseg_fw];
+        iseg_fw += n_fw;
+        int n_bw    = rcd.nseg_bw;
+        rcd.nseg_bw = new_iseg[iseg_bw] - new_iseg[iseg_bw - n_bw];
+        iseg_bw -= n_bw;
+    }
+    for (auto *crossings : {&crossings_fw_, &crossings_bw_}) {
+        for (auto &c : *crossings) {
+            c.iseg = new_iseg[c.iseg];
+        }
+    }
+
+    seg_len_.resize(n);
+    seg_index_.resize(n);
+    nseg_ = n;
+
+    return;
+}
+
+Ray::Ray(const char *&data)
+{
+    get(data, cm_surf_fw_);
+    get(data, cm_surf_bw_);
+    get(data, cm_cell_fw_);
+    get(data, cm_cell_bw_);
+
+    uint64_t n_cm;
+    get(data, n_cm);
+    cm_data_.resize(n_cm);
+    for (auto &rcd : cm_data_) {
+        int fw, bw, nseg_fw, nseg_bw;
+        get(data, fw);
+        get(data, bw);
+        get(data, nseg_fw);
+        get(data, nseg_bw);
+        rcd.fw      = (Surface)fw;
+        rcd.bw      = (Surface)bw;
+        rcd.nseg_fw = nseg_fw;
+        rcd.nseg_bw = nseg_bw;
+    }
+
+    get(data, crossings_fw_);
+    get(data, crossings_bw_);
+
+    get(data, seg_len_);
+    get(data, seg_index_);
+    nseg_ = seg_len_.size();
+
+    get(data, bc_);
+    get(data, p1_);
+    get(data, p2_);
+
+    get(data, weight_);
+    get(data, shadow_bc_);
+
+    return;
+}
+
+void Ray::write(std::ostream &os) const
+{
+    put(os, cm_surf_fw_);
+    put(os, cm_surf_bw_);
+    put(os, cm_cell_fw_);
+    put(os, cm_cell_bw_);
+
+    put(os, (uint64_t)cm_data_.size());
+    for (const auto &rcd : cm_data_) {
+        put(os, (int)rcd.fw);
+        put(os, (int)rcd.bw);
+        put(os, (int)rcd.nseg_fw);
+        put(os, (int)rcd.nseg_bw);
+    }
+
+    put(os, crossings_fw_);
+    put(os, crossings_bw_);
+
+    put(os, seg_len_);
+    put(os, seg_index_);
+
+    put(os, bc_);
+    put(os, p1_);
+    put(os, p2_);
+
+    put(os, weight_);
+    put(os, shadow_bc_);
+
     return;
 }
 
@@ -16,14 +16,124 @@
 
 #pragma once
 
+#include <array>
+#include <cassert>
+#include <iosfwd>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 #include "util/global_config.hpp"
 #include "geometry/geom.hpp"
 #include "core_mesh.hpp"
 
-#define MAX_NSEG 255
+// Largest number of segments in a single pin crossing, as stored in the
+// coarse ray data
+#define MAX_NSEG 4095
 
 namespace mocc {
 namespace moc {
+/**
+ * \brief Cache of \ref PinMesh::trace() results.
+ *
+ * Rays of the same angle tend to cross many instances of the same \ref
+ * PinMesh at the same pin-local entry and exit points, especially for
+ * modular ray data on regular lattices. This stores the segments produced by
+ * each unique (\ref PinMesh, entry point, exit point) combination, so that
+ * repeated crossings are copied rather than re-traced. Points are matched
+ * after rounding to a small fraction of a typical pin dimension.
+ *
+ * A cache is not thread safe, and is intended to be used for the rays of a
+ * single angle, traced by a single thread.
+ */
+class PinTraceCache {
+public:
+    /**
+     * \brief Same as \ref PinMesh::trace(), but using cached segments if
+     * available.
+     */
+    int trace(const PinMesh &pm, Point2 p1, Point2 p2, int first_reg,
+              VecF &s, VecI &reg);
+
+    /**
+     * \brief Find the segments of a pin crossing, tracing them if they are
+     * not cached, and queue them to be appended by \ref flush()
+     *
+     * This lets a whole ray be resolved before any of its segments are
+     * stored, so that the storage can be sized exactly.
+     *
+     * \returns the number of segments in the crossing
+     */
+    int queue(const PinMesh &pm, Point2 p1, Point2 p2, int first_reg);
+
+    /**
+     * \brief Append the segments of the queued pin crossings, in order, and
+     * empty the queue
+     */
+    void flush(VecF &s, VecI &reg);
+
+    /**
+     * \brief Return the number of pin crossings that were served from the
+     * cache
+     */
+    size_t hits() const
+    {
+        return hits_;
+    }
+
+    /**
+     * \brief Return the number of unique pin crossings in the cache
+     */
+    size_t size() const
+    {
+        return cache_.size();
+    }
+
+    /**
+     * \brief Forget all of the cached pin crossings
+     */
+    void clear()
+    {
+        assert(queue_.empty());
+        cache_.clear();
+        return;
+    }
+
+private:
+    struct Key {
+        const PinMesh *pm;
+        std::array<long long, 4> p;
+
+        bool operator==(const Key &other) const
+        {
+            return (pm == other.pm) && (p == other.p);
+        }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key &key) const
+        {
+            size_t h = std::hash<const PinMesh *>()(key.pm);
+            for (auto v : key.p) {
+                h ^= std::hash<long long>()(v) + 0x9e3779b97f4a7c15 +
+                     (h << 6) + (h >> 2);
+            }
+            return h;
+        }
+    };
+
+    struct Segments {
+        VecF len;
+        VecI reg;
+    };
+
+    std::unordered_map<Key, Segments, KeyHash> cache_;
+    size_t hits_ = 0;
+
+    // Queued crossings, and the first region of the pin of each. Rehashing
+    // the cache leaves references to its elements valid.
+    std::vector<std::pair<const Segments *, int>> queue_;
+};
+
 /**
  * A \ref Ray stores vectors of segment length and the flat source region
  * index that each segment is crossing. The FSR indices are represented as
@@ -42,8 +152,8 @@ class Ray {
     struct RayCoarseData {
         Surface fw : 4;
         Surface bw : 4;
-        unsigned int nseg_fw : 8;
-        unsigned int nseg_bw : 8;
+        unsigned int nseg_fw : 12;
+        unsigned int nseg_bw : 12;
 
         friend std::ostream &operator<<(std::ostream &os,
                                         const RayCoarseData rcd)
@@ -56,15 +166,99 @@ class Ray {
     };
 
 public:
+    /**
+     * \brief A crossing of a coarse mesh surface, resolved from the coarse
+     * ray data
+     *
+     * \c iseg is the index of the angular flux along the ray at the
+     * crossing, \c surf the surface within the plane, and \c norm its
+     * \ref Normal.
+     */
+    struct CoarseCrossing {
+        int iseg;
+        unsigned int surf : 31;
+        unsigned int norm : 1;
+    };
+
     /** \brief Construct a ray from two starting points. */
     Ray(Point2 p1, Point2 p2, std::array<int, 2> bc, int iplane,
-        const CoreMesh &mesh);
+        const CoreMesh &mesh, PinTraceCache *cache = nullptr);
+
+    /**
+     * \brief Trace the segments of the ray from \p p1 to \p p2, without
+     * constructing a \ref Ray
+     *
+     * The segments are appended to \p len and \p reg, exactly as they would
+     * be stored by the constructor, before any volume correction. \p ps is
+     * used as scratch for the pin crossings, and holds them on return, and
+     * if \p pin_nseg is given, the number of segments in each pin crossing
+     * is appended to it.
+     */
+    static void trace(Point2 p1, Point2 p2, int iplane, const CoreMesh &mesh,
+                      PinTraceCache *cache, std::vector<Point2> &ps,
+                      VecF &len, VecI &reg, VecI *pin_nseg = nullptr);
+
+    /**
+     * \brief Construct a ray from the binary form produced by \ref write().
+     *
+     * \param[inout] data pointer to the start of the serialized ray. This is
+     * advanced past the end of the ray.
+     */
+    Ray(const char *&data);
+
+    /**
+     * \brief Write a binary form of the ray to a stream, which may later be
+     * read back with \ref Ray(const char *&)
+     */
+    void write(std::ostream &os) const;
+
+    /**
+     * \brief Return the number of bytes used to store the ray and its
+     * segments, including any spare capacity
+     */
+    size_t memory() const
+    {
+        return sizeof(Ray) + cm_data_.capacity() * sizeof(RayCoarseData) +
+               (crossings_fw_.capacity() + crossings_bw_.capacity()) *
+                   sizeof(CoarseCrossing) +
+               seg_len_.capacity() * sizeof(real_t) +
+               seg_index_.capacity() * sizeof(int) +
+               shadow_bc_.capacity() * sizeof(std::array<int, 2>);
+    }
+
+    /**
+     * \brief Release the spare capacity left over from tracing
+     */
+    void shrink_to_fit()
+    {
+        cm_data_.shrink_to_fit();
+        crossings_fw_.shrink_to_fit();
+        crossings_bw_.shrink_to_fit();
+        seg_len_.shrink_to_fit();
+        seg_index_.shrink_to_fit();
+        shadow_bc_.shrink_to_fit();
+        return;
+    }
 
     int nseg() const
     {
         return nseg_;
     }
 
+    /**
+     * \brief Free the segment lengths and indices, keeping everything else,
+     * including the number of segments
+     *
+     * This is for when the segments are re-traced as needed, using \ref
+     * trace(). \ref seg_len() and \ref seg_index() are empty afterwards.
+     */
+    void release_segments()
+    {
+        VecF().swap(seg_len_);
+        VecI().swap(seg_index_);
+        return;
+    }
+
     int ncseg() const
     {
         return cm_data_.size();
@@ -78,6 +272,28 @@ public:
         return cm_data_;
     }
 
+    /**
+     * \brief Return the coarse surfaces crossed by the ray in the forward
+     * direction, in order, starting with the surface it enters through
+     *
+     * These are the same crossings described by \ref cm_data(), resolved
+     * when the ray is made, so that tallying on the coarse surfaces needs no
+     * walk over the coarse cells.
+     */
+    const std::vector<CoarseCrossing> &crossings_fw() const
+    {
+        return crossings_fw_;
+    }
+
+    /**
+     * \brief Return the coarse surfaces crossed by the ray in the backward
+     * direction, in order, starting with the surface it enters through
+     */
+    const std::vector<CoarseCrossing> &crossings_bw() const
+    {
+        return crossings_bw_;
+    }
+
     /**
      * Return the index of the first coarse mesh cell encountered by this
      * ray in the forward direction
@@ -162,6 +378,22 @@ public:
         return seg_index_[iseg];
     }
 
+    /**
+     * \brief Return the point at which the ray enters the domain
+     */
+    Point2 p1() const
+    {
+        return p1_;
+    }
+
+    /**
+     * \brief Return the point at which the ray leaves the domain
+     */
+    Point2 p2() const
+    {
+        return p2_;
+    }
+
     /**
      * Return the bc index for the start/stop of the ray
      */
@@ -170,6 +402,59 @@ public:
         return bc_[dir];
     }
 
+    /**
+     * \brief Return the weight of the ray, in units of the ray spacing
+     *
+     * This is one, unless the ray also stands in for some of its neighbours,
+     * which were dropped from an optically thin part of the domain (see
+     * \ref absorb()).
+     */
+    real_t weight() const
+    {
+        return weight_;
+    }
+
+    /**
+     * \brief Return the boundary condition indices of the rays that this ray
+     * stands in for
+     *
+     * The angular flux leaving either end of the ray is also stored to the
+     * corresponding ends of these, so that the boundary conditions stay
+     * complete.
+     */
+    const std::vector<std::array<int, 2>> &shadow_bc() const
+    {
+        return shadow_bc_;
+    }
+
+    /**
+     * \brief Make this ray stand in for another, which is to be dropped
+     *
+     * The weight of \p other is added to that of this ray, and its boundary
+     * condition indices, along with those it already stood in for, are added
+     * to the \ref shadow_bc().
+     */
+    void absorb(const Ray &other)
+    {
+        weight_ += other.weight_;
+        shadow_bc_.push_back(other.bc_);
+        shadow_bc_.insert(shadow_bc_.end(), other.shadow_bc_.begin(),
+                          other.shadow_bc_.end());
+        return;
+    }
+
+    /**
+     * \brief Merge runs of neighbouring segments that are tallied to the
+     * same region into single segments
+     *
+     * \param merged the region to tally the segments of each region to,
+     * indexed by region. Neighbouring segments whose regions map to the
+     * same region become one segment in that region, with their total
+     * length, unless a coarse surface lies between them. The coarse ray
+     * data are updated to match.
+     */
+    void merge_segments(const VecI &merged);
+
     /**
      * \brief Ray magnitude for > and < operators is based on number of
      * segments.
@@ -197,6 +482,10 @@ private:
 
     std::vector<RayCoarseData> cm_data_;
 
+    // Coarse surface crossings in each direction
+    std::vector<CoarseCrossing> crossings_fw_;
+    std::vector<CoarseCrossing> crossings_bw_;
+
     // Length of ray segments
     VecF seg_len_;
 
@@ -209,6 +498,11 @@ private:
     // Boundary condition index for the forward and backward directions
     std::array<int, 2> bc_;
 
+    // Weight of the ray, and the boundary condition indices of the dropped
+    // rays that it stands in for
+    real_t weight_ = 1.0;
+    std::vector<std::array<int, 2>> shadow_bc_;
+
     // Store the points that were used to initialize the ray. You know...
     // for posterity
     Point2 p1_;
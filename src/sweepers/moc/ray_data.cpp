@@ -16,8 +16,17 @@
 
 #include "ray_data.hpp"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <sstream>
@@ -28,12 +37,27 @@
 #include "util/rational_approximation.hpp"
 #include "util/string_utils.hpp"
 #include "util/validate_input.hpp"
+#include "util/xdmf.hpp"
 #include "core/constants.hpp"
 #include "core/parallel_environment.hpp"
 
 namespace {
 const std::vector<std::string> recognized_attributes = {
-    "modularity", "spacing", "volume_correction", "modularization"};
+    "modularity", "spacing",  "volume_correction",
+    "modularization", "file", "storage", "out_of_core", "trace_cache",
+    "segment_tolerance", "adaptive_factor", "adaptive_tau",
+    "macro_segments"};
+
+// Ray file format. The header is the magic string, followed by the format
+// version, number of planes and number of angles as 64-bit integers. Then
+// comes a table with the key of each plane and the offset of its data from
+// the start of the file. The data for each angle of a plane follow, in
+// order: the number of rays, each ray in the form written by Ray::write(),
+// then the volume-correction factor of each region in the plane. Bump the
+// version whenever the format changes.
+const char RAY_FILE_MAGIC[] = "MOCCRAYS";
+const uint32_t RAY_FILE_VERSION = 5;
+const size_t RAY_FILE_HEADER    = 32;
 }
 
 namespace mocc {
@@ -60,13 +84,34 @@ namespace moc {
  * -# Parse input from the XML
  * -# Modularize the angular quadrature and determine ray spacing for each
  *  angle
- * -# Construct Ray objects for each geometrically-unique plane and angle
+ * -# Construct Ray objects for each geometrically-unique plane and angle.
+ *  The (plane, angle) pairs are traced in parallel, reusing the traces of
+ *  repeated pin crossings through a \ref PinTraceCache
  * -# Correct the ray segment lengths to preserve FSR volumes
  *
+ * The rays of each unique plane are keyed on its geometry, along with the
+ * quadrature and ray options. If the ray cache or a ray file has the rays of
+ * a plane with the same key, the tracing and volume correction steps are
+ * replaced by copying the corrected rays from there. Only the planes that
+ * are new, for instance because a control rod has moved into them, are
+ * traced.
+ *
+ * When tracing on the fly, the segments are released once the number of
+ * segments in each ray is known, keeping only the volume-correction factors
+ * needed to reproduce them in \ref expand().
+ *
 */
 RayData::RayData(const pugi::xml_node &input, const AngularQuadrature &ang_quad,
                  const CoreMesh &mesh)
-    : ang_quad_(ang_quad), modularization_method_(Modularization::RATIONAL)
+    : ang_quad_(ang_quad),
+      n_traced_(0),
+      compacted_(false),
+      storage_(SegmentStorage::PACKED),
+      mesh_(&mesh),
+      modularization_method_(Modularization::RATIONAL),
+      resident_(-1),
+      pending_id_(-1),
+      n_stall_(0)
 {
     LogScreen << "Generating ray data... " << std::endl;
     validate_input(input, recognized_attributes);
@@ -123,6 +168,83 @@ RayData::RayData(const pugi::xml_node &input, const AngularQuadrature &ang_quad,
         }
     }
 
+    // Get the segment storage setting
+    if (!input.attribute("storage").empty()) {
+        std::string in_str = input.attribute("storage").value();
+        sanitize(in_str);
+        if (in_str == "packed") {
+            storage_ = SegmentStorage::PACKED;
+        } else if (in_str == "modular") {
+            storage_ = SegmentStorage::MODULAR;
+        } else if (in_str == "compact") {
+            storage_ = SegmentStorage::COMPACT;
+        } else if (in_str == "on_the_fly") {
+            storage_ = SegmentStorage::ON_THE_FLY;
+        } else {
+            throw EXCEPT("Unrecognized ray storage option.");
+        }
+    }
+
+    // Get the error allowed in compact segment lengths. Zero keeps them at
+    // single precision.
+    real_t len_tol = input.attribute("segment_tolerance").as_float(0.0);
+    if (len_tol < 0.0) {
+        throw EXCEPT("Invalid segment_tolerance.");
+    }
+    if ((len_tol > 0.0) && (storage_ != SegmentStorage::COMPACT)) {
+        Warn("Segment lengths are only quantized with compact storage");
+    }
+
+    // Get the size of the per-thread pin crossing cache used when tracing
+    // on the fly
+    {
+        int n_cache = input.attribute("trace_cache").as_int(4096);
+        if (n_cache < 0) {
+            throw EXCEPT("Invalid trace_cache size.");
+        }
+        trace_cache_ = n_cache;
+    }
+
+    // Get the adaptive ray spacing. The ray spacing given above is used
+    // through optically thick regions, and adaptive_factor times it
+    // elsewhere.
+    adaptive_factor_ = input.attribute("adaptive_factor").as_int(1);
+    if (adaptive_factor_ < 1) {
+        throw EXCEPT("Invalid adaptive_factor.");
+    }
+    adaptive_tau_ = input.attribute("adaptive_tau").as_float(0.05);
+    if (adaptive_tau_ < 0.0) {
+        throw EXCEPT("Invalid adaptive_tau.");
+    }
+
+    // Merge the crossings of pins made of a single material into one segment
+    macro_segments_ = input.attribute("macro_segments").as_bool(false);
+    if (macro_segments_ && ((storage_ == SegmentStorage::MODULAR) ||
+                            (storage_ == SegmentStorage::ON_THE_FLY))) {
+        throw EXCEPT("Macro segments need packed or compact ray storage.");
+    }
+
+    // Get the region ordering of the packed segments
+    bool renumber = false;
+    if (!input.attribute("region_order").empty()) {
+        std::string in_str = input.attribute("region_order").value();
+        sanitize(in_str);
+        if (in_str == "visit") {
+            renumber = true;
+        } else if (in_str != "mesh") {
+            throw EXCEPT("Unrecognized region order option.");
+        }
+    }
+    if (renumber && (storage_ != SegmentStorage::PACKED)) {
+        throw EXCEPT("Only packed ray storage supports renumbering.");
+    }
+
+    // Get the out-of-core segment file
+    std::string stream_path = input.attribute("out_of_core").value();
+    if (!stream_path.empty() && (storage_ != SegmentStorage::PACKED)) {
+        throw EXCEPT("Only packed ray storage can be kept out of core.");
+    }
+
     if (core_modular) {
         LogFile << "Ray modularity: CORE" << std::endl;
     } else {
@@ -205,288 +327,1198 @@ RayData::RayData(const pugi::xml_node &input, const AngularQuadrature &ang_quad,
     LogFile << "Modularized Angular quadrature " << std::endl;
     LogFile << ang_quad_ << std::endl;
 
-    // Trace rays
-    Box core_box = Box(Point2(0.0, 0.0), Point2(hx, hy));
-    max_seg_     = 0;
-    // loop over the planes of unique geometry
+    this->predict_segments(mesh, hx_mod, hy_mod, opt_spacing, core_modular);
+
+    macro_pins_.assign(n_planes_, std::vector<MacroPin>());
+    if (macro_segments_) {
+        this->find_macro_pins(mesh);
+    }
+
+    // Take the rays of each plane from the ray cache, or from the ray file
+    // if one is given, where they match this problem. Trace the rest, and
+    // write the file for next time.
+    std::string ray_file = input.attribute("file").value();
+    std::vector<uint64_t> keys =
+        this->plane_keys(mesh, opt_spacing, core_modular);
+    rays_.assign(n_planes_, PlaneRays_t());
+    this->reset_correction(mesh);
+    std::vector<bool> found(n_planes_, false);
+    int n_found = 0;
+    if (cache_enabled_) {
+        for (unsigned iplane = 0; iplane < n_planes_; iplane++) {
+            auto cached = cache_.find(keys[iplane]);
+            if (cached != cache_.end()) {
+                rays_[iplane]       = cached->second->rays;
+                correction_[iplane] = cached->second->correction;
+                found[iplane]       = true;
+                n_found++;
+            }
+        }
+        if (n_found > 0) {
+            LogScreen << "Using cached rays for " << n_found << " of "
+                      << n_planes_ << " planes" << std::endl;
+        }
+    }
+    if (!ray_file.empty() && (n_found < (int)n_planes_)) {
+        n_found += this->read_rays(ray_file, keys, found);
+    }
+
+    VecI trace_planes;
     for (unsigned iplane = 0; iplane < n_planes_; iplane++) {
-        // generate rays for each angle in octants 1 and 2
+        if (!found[iplane]) {
+            trace_planes.push_back(iplane);
+        }
+    }
+    n_traced_ = trace_planes.size();
+    if (n_traced_ > 0) {
+        if (n_found > 0) {
+            LogScreen << "Tracing rays for " << n_traced_ << " of "
+                      << n_planes_ << " planes" << std::endl;
+        }
+        this->trace_rays(mesh, trace_planes);
+        if (!ray_file.empty()) {
+            this->write_rays(ray_file, keys);
+        }
+    }
+
+    if (cache_enabled_) {
+        for (unsigned iplane = 0; iplane < n_planes_; iplane++) {
+            if (cache_.count(keys[iplane]) == 0) {
+                cache_[keys[iplane]] = std::make_shared<const TracedPlane>(
+                    TracedPlane{rays_[iplane], correction_[iplane]});
+            }
+        }
+    }
+
+    max_seg_ = 0;
+    for (const auto &plane_rays : rays_) {
+        for (const auto &ang_rays : plane_rays) {
+            for (const auto &ray : ang_rays) {
+                max_seg_ = std::max(ray.nseg(), max_seg_);
+            }
+        }
+    }
+
+    // Pack the corrected segment data for the sweepers
+    size_t packed_memory = 0;
+    size_t n_chunks      = 0;
+    real_t len_err       = 0.0;
+    for (unsigned iplane = 0; iplane < n_planes_; iplane++) {
+        int nreg_plane = mesh.unique_plane(iplane).n_reg();
+        std::vector<PackedRays> packed_angles;
+        packed_angles.reserve(rays_[iplane].size());
         int iang = 0;
-        std::vector<std::vector<Ray>> angle_rays;
+        for (const auto &ang_rays : rays_[iplane]) {
+            if (storage_ == SegmentStorage::MODULAR) {
+                packed_angles.emplace_back(ang_rays, nreg_plane,
+                                           correction_[iplane][iang]);
+                n_chunks += packed_angles.back().n_chunks();
+            } else if (storage_ == SegmentStorage::COMPACT) {
+                packed_angles.emplace_back(ang_rays, nreg_plane, len_tol);
+                n_chunks += packed_angles.back().n_entries();
+                len_err = std::max(len_err,
+                                   packed_angles.back().length_error());
+            } else {
+                packed_angles.emplace_back(ang_rays, nreg_plane);
+            }
+            packed_memory += packed_angles.back().memory();
+            iang++;
+        }
+        packed_rays_.push_back(std::move(packed_angles));
+    }
+    LogFile << "Packed ray segment storage: " << packed_memory << " bytes"
+            << std::endl;
+    if (storage_ == SegmentStorage::MODULAR) {
+        LogFile << "Unique pin crossings in modular ray storage: " << n_chunks
+                << std::endl;
+    }
+    if (storage_ == SegmentStorage::COMPACT) {
+        LogFile << "Pin entries in compact ray storage: " << n_chunks
+                << std::endl;
+        LogFile << "Largest quantization error of compact segment lengths: "
+                << len_err << std::endl;
+    }
+
+    // Only keep the number of segments in each ray if they are to be traced
+    // on the fly. The correction factors are needed to reproduce them.
+    if (storage_ == SegmentStorage::ON_THE_FLY) {
+        for (unsigned iplane = 0; iplane < n_planes_; iplane++) {
+            this->release_segments(iplane);
+        }
+        this->release_ray_segments();
+        LogScreen << "Ray segments will be traced on the fly" << std::endl;
+    } else {
+        correction_.clear();
+    }
+
+    if (renumber) {
+        this->renumber_regions(mesh);
+    }
+
+    if (!stream_path.empty()) {
+        this->spill_segments(stream_path);
+    }
+
+    size_t n_seg = 0;
+    for (unsigned iplane = 0; iplane < n_planes_; iplane++) {
+        n_seg += this->n_segments(iplane);
+    }
+    LogScreen << "Traced ray segments: " << n_seg << std::endl;
+
+    LogScreen << "Done ray tracing" << std::endl;
+
+} // RayData::RayData()
+
+void RayData::renumber_regions(const CoreMesh &mesh)
+{
+    region_index_.resize(n_planes_);
+    for (unsigned iplane = 0; iplane < n_planes_; iplane++) {
         int nreg_plane = mesh.unique_plane(iplane).n_reg();
-        VecI nrayfsr(nreg_plane, 0);
-        for (auto ang = ang_quad_.octant(1); ang != ang_quad_.octant(3);
-             ++ang) {
-            int Nx  = Nx_[iang];
-            int Ny  = Ny_[iang];
-            std::array<int, 2> bc;
-            real_t space   = spacing_[iang];
-            real_t space_x = std::abs(space / std::sin(ang->alpha));
-            real_t space_y = std::abs(space / std::cos(ang->alpha));
-
-            LogFile << "Spacing: " << ang->alpha << " " << space << " "
-                    << space_x << " " << space_y << std::endl;
-
-            std::vector<Ray> rays;
-            // Handle rays entering on the x-normal faces ( along the
-            // y-axis)
-            for (int iray = 0; iray < Ny; iray++) {
-                Point2 p1;
-                bc[0] = iray;
-                if (ang->ox > 0.0) {
-                    // We are in octant 1, enter from the left/west
-                    p1.x = 0.0;
-                } else {
-                    // We are in octant 2, enter from the right/east
-                    p1.x = hx;
+        VecI &index    = region_index_[iplane];
+        index.assign(nreg_plane, -1);
+
+        int next = 0;
+        for (const auto &ang_rays : rays_[iplane]) {
+            for (const auto &ray : ang_rays) {
+                for (int iseg = 0; iseg < ray.nseg(); iseg++) {
+                    int ireg = ray.seg_index(iseg);
+                    if (index[ireg] < 0) {
+                        index[ireg] = next++;
+                    }
                 }
-                p1.y      = (0.5 + iray) * space_y;
-                Point2 p2 = core_box.intersect(p1, *ang);
-                // The below indexing based on point position / spacing is
-                // safer than it might appear at first. Since the rays are
-                // laid out starting a half-spacing into the domain, the
-                // i-th ray points lie between multiples of the ray spacing,
-                // and are therefore sufficiently far away from multiples
-                // of the spacing to permit a reliable division and cast to
-                // int. Ray i will start (i+0.5)*spacing into the domain, so
-                // dividing the ray position by the spacing and casting to
-                // an int gives i.
-                if (fp_equiv(p2.x, hx)) {
-                    // BC is on the right/east boundary of the domain
-                    bc[1] = p2.y / space_y;
-                } else if (fp_equiv(p2.y, hy)) {
-                    // BC is on the top/north boundary of the domain
-                    bc[1] = p2.x / space_x + Ny;
-                } else if (fp_equiv(p2.x, 0.0)) {
-                    // BC is on the left/west boundary of the domain
-                    bc[1] = p2.y / space_y;
-                } else {
-                    throw EXCEPT(
-                        "Something has gone horribly wrong in the "
-                        "ray trace.");
+            }
+        }
+
+        // Any regions missed by the rays go at the end
+        for (auto &i : index) {
+            if (i < 0) {
+                i = next++;
+            }
+        }
+
+        for (auto &packed : packed_rays_[iplane]) {
+            packed.renumber(index);
+        }
+    }
+
+    LogFile << "Renumbered the ray segment regions in order of first visit"
+            << std::endl;
+    return;
+}
+
+bool RayData::cache_enabled_ = false;
+std::map<uint64_t, std::shared_ptr<const RayData::TracedPlane>>
+    RayData::cache_;
+
+void RayData::enable_cache(bool enable)
+{
+    cache_enabled_ = enable;
+    if (!enable) {
+        cache_.clear();
+    }
+    return;
+}
+
+size_t RayData::memory() const
+{
+    size_t bytes = 0;
+    for (unsigned iplane = 0; iplane < rays_.size(); iplane++) {
+        for (const auto &ang_rays : rays_[iplane]) {
+            for (const auto &ray : ang_rays) {
+                bytes += ray.memory();
+            }
+        }
+        for (const auto &packed : packed_rays_[iplane]) {
+            bytes += packed.memory();
+        }
+    }
+    for (const auto &plane_cf : correction_) {
+        for (const auto &cf : plane_cf) {
+            bytes += cf.size() * sizeof(real_t);
+        }
+    }
+    return bytes;
+}
+
+void RayData::expand(int id, int iang, int iray, TraceScratch &scratch,
+                     float *len, uint32_t *idx) const
+{
+    assert(this->expanded());
+
+    if (storage_ != SegmentStorage::ON_THE_FLY) {
+        packed_rays_[id][iang].expand(iray, len, idx);
+        return;
+    }
+
+    if (scratch.cache.size() > trace_cache_) {
+        scratch.cache.clear();
+    }
+
+    const Ray &ray = rays_[id][iang][iray];
+    scratch.len.clear();
+    scratch.reg.clear();
+    Ray::trace(ray.p1(), ray.p2(), id, *mesh_,
+               trace_cache_ > 0 ? &scratch.cache : nullptr, scratch.ps,
+               scratch.len, scratch.reg);
+    assert((int)scratch.len.size() == ray.nseg());
+
+    const VecF &cf = correction_[id][iang];
+    for (int iseg = 0; iseg < ray.nseg(); iseg++) {
+        int ireg  = scratch.reg[iseg];
+        len[iseg] = scratch.len[iseg] * cf[ireg];
+        idx[iseg] = ireg;
+    }
+
+    return;
+}
+
+size_t RayData::n_segments(size_t id) const
+{
+    size_t n_seg = 0;
+    for (const auto &ang_rays : rays_[id]) {
+        for (const auto &ray : ang_rays) {
+            n_seg += ray.nseg();
+        }
+    }
+    return 2 * n_seg;
+}
+
+void RayData::trace_rays(const CoreMesh &mesh, const VecI &planes)
+{
+    // Lay out the end points and boundary condition indices of the rays for
+    // each angle. These are the same for every plane.
+    real_t hx    = mesh.hx_core();
+    real_t hy    = mesh.hy_core();
+    Box core_box = Box(Point2(0.0, 0.0), Point2(hx, hy));
+    struct RayEnds {
+        Point2 p1;
+        Point2 p2;
+        std::array<int, 2> bc;
+    };
+    std::vector<std::vector<RayEnds>> ray_ends;
+    int iang = 0;
+    for (auto ang = ang_quad_.octant(1); ang != ang_quad_.octant(3); ++ang) {
+        int Nx = Nx_[iang];
+        int Ny = Ny_[iang];
+        std::array<int, 2> bc;
+        real_t space   = spacing_[iang];
+        real_t space_x = std::abs(space / std::sin(ang->alpha));
+        real_t space_y = std::abs(space / std::cos(ang->alpha));
+
+        LogFile << "Spacing: " << ang->alpha << " " << space << " "
+                << space_x << " " << space_y << std::endl;
+
+        std::vector<RayEnds> ends;
+        ends.reserve(Nx + Ny);
+        // Handle rays entering on the x-normal faces ( along the
+        // y-axis)
+        for (int iray = 0; iray < Ny; iray++) {
+            Point2 p1;
+            bc[0] = iray;
+            if (ang->ox > 0.0) {
+                // We are in octant 1, enter from the left/west
+                p1.x = 0.0;
+            } else {
+                // We are in octant 2, enter from the right/east
+                p1.x = hx;
+            }
+            p1.y      = (0.5 + iray) * space_y;
+            Point2 p2 = core_box.intersect(p1, *ang);
+            // The below indexing based on point position / spacing is
+            // safer than it might appear at first. Since the rays are
+            // laid out starting a half-spacing into the domain, the
+            // i-th ray points lie between multiples of the ray spacing,
+            // and are therefore sufficiently far away from multiples
+            // of the spacing to permit a reliable division and cast to
+            // int. Ray i will start (i+0.5)*spacing into the domain, so
+            // dividing the ray position by the spacing and casting to
+            // an int gives i.
+            if (fp_equiv(p2.x, hx)) {
+                // BC is on the right/east boundary of the domain
+                bc[1] = p2.y / space_y;
+            } else if (fp_equiv(p2.y, hy)) {
+                // BC is on the top/north boundary of the domain
+                bc[1] = p2.x / space_x + Ny;
+            } else if (fp_equiv(p2.x, 0.0)) {
+                // BC is on the left/west boundary of the domain
+                bc[1] = p2.y / space_y;
+            } else {
+                throw EXCEPT(
+                    "Something has gone horribly wrong in the "
+                    "ray trace.");
+            }
+            assert(bc[0] >= 0);
+            assert(bc[1] >= 0);
+            assert(bc[0] < Nx + Ny);
+            assert(bc[1] < Nx + Ny);
+            ends.push_back({p1, p2, bc});
+        }
+
+        // Handle rays entering on the y-normal face
+        for (int iray = 0; iray < Nx; iray++) {
+            Point2 p1;
+            p1.x      = (0.5 + iray) * space_x;
+            p1.y      = 0.0;
+            Point2 p2 = core_box.intersect(p1, *ang);
+            bc[0]     = iray + Ny;
+            if (fp_equiv(p2.x, hx)) {
+                // BC is on the right/east boundary of the core
+                bc[1] = p2.y / space_y;
+            } else if (fp_equiv(p2.y, hy)) {
+                // BC is on the top/north boundary of the core
+                bc[1] = p2.x / space_x + Ny;
+            } else if (fp_equiv(p2.x, 0.0)) {
+                // BC is on the left/west boundary of the core
+                bc[1] = p2.y / space_y;
+            } else {
+                throw EXCEPT(
+                    "Something has gone horribly wrong in the "
+                    "ray trace.");
+            }
+            assert(bc[0] >= 0);
+            assert(bc[1] >= 0);
+            assert(bc[0] < Nx + Ny);
+            assert(bc[1] < Nx + Ny);
+            ends.push_back({p1, p2, bc});
+        }
+
+        ray_ends.push_back(std::move(ends));
+        ++iang;
+    } // Angle loop
+
+    // Trace rays. Each (plane, angle) pair is traced independently into its
+    // own slot of rays_, so the result does not depend on the number of
+    // threads. Each task gets its own pin trace cache.
+    int n_ang  = ray_ends.size();
+    int n_task = planes.size() * n_ang;
+    for (int iplane : planes) {
+        rays_[iplane].assign(n_ang, std::vector<Ray>());
+    }
+    // Everything that each task needs to finish its rays as soon as they are
+    // traced, while their segments are still in cache: the optical thickness
+    // for adaptive thinning, the true region volumes for the volume
+    // correction and the region that each region is merged into
+    std::vector<VecF> tau;
+    if (adaptive_factor_ > 1) {
+        tau = this->optical_thickness(mesh);
+    }
+    std::vector<VecF> true_vol(n_planes_);
+    std::vector<VecI> merged(n_planes_);
+    for (int iplane : planes) {
+        true_vol[iplane] = mesh.unique_plane(iplane).areas();
+        if (macro_segments_) {
+            merged[iplane].resize(true_vol[iplane].size());
+            for (int ireg = 0; ireg < (int)merged[iplane].size(); ireg++) {
+                merged[iplane][ireg] = ireg;
+            }
+            for (const auto &pin : macro_pins_[iplane]) {
+                for (int ir = 0; ir < pin.n_reg; ir++) {
+                    merged[iplane][pin.first_reg + ir] = pin.first_reg;
+                }
+            }
+        }
+    }
+
+    // Volume traced through each region by the rays of each task. The ANGLE
+    // correction needs all of the angles of a plane, so those rays are only
+    // corrected and merged once every task is done.
+    std::vector<VecF> ray_vol(n_task);
+    bool deferred = correction_type_ == VolumeCorrection::ANGLE;
+
+    size_t cache_hits = 0;
+    size_t n_traced   = 0;
+    size_t n_kept     = 0;
+    size_t n_seg      = 0;
+    size_t n_merged   = 0;
+    std::exception_ptr error;
+#pragma omp parallel for schedule(dynamic) \
+    reduction(+ : cache_hits, n_traced, n_kept, n_seg, n_merged)
+    for (int itask = 0; itask < n_task; itask++) {
+        int iplane = planes[itask / n_ang];
+        int ia     = itask % n_ang;
+        PinTraceCache cache;
+        auto &rays = rays_[iplane][ia];
+        rays.reserve(ray_ends[ia].size());
+        try {
+            for (const auto &ends : ray_ends[ia]) {
+                rays.emplace_back(ends.p1, ends.p2, ends.bc, iplane, mesh,
+                                  &cache);
+            }
+
+            if (!tau.empty()) {
+                n_traced += rays.size();
+                this->thin_rays(rays, ia, tau[iplane]);
+                n_kept += rays.size();
+            }
+
+            ray_vol[itask] =
+                this->ray_volume(rays, ia, true_vol[iplane].size());
+
+            if (correction_type_ == VolumeCorrection::FLAT) {
+                VecF &cf = correction_[iplane][ia];
+                for (int ireg = 0; ireg < (int)cf.size(); ireg++) {
+                    cf[ireg] = true_vol[iplane][ireg] / ray_vol[itask][ireg];
                 }
-                assert(bc[0] >= 0);
-                assert(bc[1] >= 0);
-                assert(bc[0] < Nx + Ny);
-                assert(bc[1] < Nx + Ny);
-                rays.emplace_back(Ray(p1, p2, bc, iplane, mesh));
-
-                max_seg_ = std::max(rays.back().nseg(), max_seg_);
-            }
-
-            // Handle rays entering on the y-normal face
-            for (int iray = 0; iray < Nx; iray++) {
-                Point2 p1;
-                p1.x      = (0.5 + iray) * space_x;
-                p1.y      = 0.0;
-                Point2 p2 = core_box.intersect(p1, *ang);
-                bc[0]     = iray + Ny;
-                if (fp_equiv(p2.x, hx)) {
-                    // BC is on the right/east boundary of the core
-                    bc[1] = p2.y / space_y;
-                } else if (fp_equiv(p2.y, hy)) {
-                    // BC is on the top/north boundary of the core
-                    bc[1] = p2.x / space_x + Ny;
-                } else if (fp_equiv(p2.x, 0.0)) {
-                    // BC is on the left/west boundary of the core
-                    bc[1] = p2.y / space_y;
-                } else {
-                    throw EXCEPT(
-                        "Something has gone horribly wrong in the "
-                        "ray trace.");
+                scale_segments(rays, cf);
+            }
+            if (!deferred) {
+                for (auto &ray : rays) {
+                    n_seg += ray.nseg();
+                    if (macro_segments_) {
+                        ray.merge_segments(merged[iplane]);
+                    }
+                    n_merged += ray.nseg();
                 }
-                assert(bc[0] >= 0);
-                assert(bc[1] >= 0);
-                assert(bc[0] < Nx + Ny);
-                assert(bc[1] < Nx + Ny);
-                rays.emplace_back(Ray(p1, p2, bc, iplane, mesh));
-                max_seg_ = std::max(rays.back().nseg(), max_seg_);
-            }
-
-            // Count number of ray crossings in each FSR
-            for (auto &r : rays) {
-                for (auto &i : r.seg_index()) {
-                    nrayfsr[i]++;
+            }
+        } catch (...) {
+#pragma omp critical
+            error = std::current_exception();
+        }
+        cache_hits += cache.hits();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    LogFile << "Pin traces reused from cache: " << cache_hits << std::endl;
+
+    if (deferred) {
+        // Angular integral of the traced volumes of each plane, which is
+        // shared by all of its angles. The angles are summed in order in
+        // each plane, so this is the same for any number of threads.
+#pragma omp parallel for schedule(dynamic)
+        for (int ip = 0; ip < (int)planes.size(); ip++) {
+            int iplane = planes[ip];
+            VecF cf(true_vol[iplane].size(), 0.0);
+            for (int ia = 0; ia < n_ang; ia++) {
+                real_t wgt        = ang_quad_[ia].weight * 0.5;
+                const VecF &vol_a = ray_vol[ip * n_ang + ia];
+                for (int ireg = 0; ireg < (int)cf.size(); ireg++) {
+                    cf[ireg] += vol_a[ireg] * wgt;
                 }
             }
+            for (int ireg = 0; ireg < (int)cf.size(); ireg++) {
+                cf[ireg] = true_vol[iplane][ireg] / cf[ireg];
+            }
+            for (int ia = 0; ia < n_ang; ia++) {
+                correction_[iplane][ia] = cf;
+            }
+        }
 
-            // Make sure that there is at least one ray in every FSR. Give a
-            // warning if not.
-            if (std::any_of(nrayfsr.begin(), nrayfsr.end(),
-                            [](int i) { return i == 0; })) {
-                Warn(
-                    "No rays passed through at least one FSR. Try finer "
-                    "ray spacing or larger regions.");
-                for (size_t ifsr = 0; ifsr < nrayfsr.size(); ifsr++) {
-                    std::cout << ifsr << " " << nrayfsr[ifsr] << std::endl;
+#pragma omp parallel for schedule(dynamic) reduction(+ : n_seg, n_merged)
+        for (int itask = 0; itask < n_task; itask++) {
+            int iplane = planes[itask / n_ang];
+            int ia     = itask % n_ang;
+            auto &rays = rays_[iplane][ia];
+            scale_segments(rays, correction_[iplane][ia]);
+            for (auto &ray : rays) {
+                n_seg += ray.nseg();
+                if (macro_segments_) {
+                    ray.merge_segments(merged[iplane]);
                 }
+                n_merged += ray.nseg();
             }
+        }
+    }
 
-            // Sort the rays by length. This might improve threading
-            // performance
-            // std::sort(rays.begin(), rays.end());
-            // std::reverse(rays.begin(), rays.end());
-            // Move the stack of rays into the vector of angular ray sets.
-            angle_rays.push_back(std::move(rays));
-            ++iang;
-        } // Angle loop
-        // Move the angular ray set to the vector of planar ray sets.
-        rays_.push_back(std::move(angle_rays));
-    } // Plane loop
+    if (!tau.empty()) {
+        LogScreen << "Adaptive ray spacing kept " << n_kept << " of "
+                  << n_traced << " rays" << std::endl;
+    }
 
-    // Adjust ray lengths to correct FSR volume. Use an angle integral to do
-    // so.
-    this->correct_volume(mesh);
+    // Make sure that there is at least one ray in every FSR. Give a warning
+    // if not. The planes are checked in parallel, and reported in order.
+    std::vector<VecI> missed_regions(planes.size());
+#pragma omp parallel for schedule(dynamic)
+    for (int ip = 0; ip < (int)planes.size(); ip++) {
+        VecI &missed = missed_regions[ip];
+        for (int ireg = 0; ireg < (int)true_vol[planes[ip]].size(); ireg++) {
+            bool hit = false;
+            for (int ia = 0; (ia < n_ang) && !hit; ia++) {
+                hit = ray_vol[ip * n_ang + ia][ireg] > 0.0;
+            }
+            if (!hit) {
+                missed.push_back(ireg);
+            }
+        }
+    }
+    for (int ip = 0; ip < (int)planes.size(); ip++) {
+        const VecI &missed = missed_regions[ip];
+        if (!missed.empty()) {
+            Warn(
+                "No rays passed through at least one FSR. Try finer "
+                "ray spacing or larger regions.");
+            std::cout << "Regions missed in plane " << planes[ip] << ":";
+            for (int ireg : missed) {
+                std::cout << " " << ireg;
+            }
+            std::cout << std::endl;
+        }
+    }
 
-    LogScreen << "Done ray tracing" << std::endl;
+    this->log_correction(planes);
 
-} // RayData::RayData()
+    if (macro_segments_) {
+        LogFile << "Macro-segments reduced the ray segments from " << n_seg
+                << " to " << n_merged << std::endl;
+    }
 
-void RayData::correct_volume(const CoreMesh &mesh)
+    return;
+}
+
+std::vector<uint64_t> RayData::plane_keys(const CoreMesh &mesh,
+                                          real_t opt_spacing,
+                                          bool core_modular) const
 {
-    switch (correction_type_) {
-    // Correct each angle independently, preserving volume integral of
-    // region for each angle
-    case VolumeCorrection::FLAT:
-        LogFile << std::endl << std::endl;
-        LogFile << "Using " << correction_type_ << " volume correction for "
-                << "rays." << std::endl;
-        for (size_t iplane = 0; iplane < n_planes_; iplane++) {
-            // flat_corr_max to store the maximum correction for all angles and
-            // regions
-            // flat_corr_rms to store the rms of the severity of correction
-            real_t flat_corr_max = 0.0;
-            int max_ireg         = 0;
-            int max_iang         = 0;
-            real_t flat_corr_rms = 0.0;
-            const VecF &true_vol = mesh.unique_plane(iplane).areas();
-            int iang             = 0;
-
-            for (auto ang = ang_quad_.octant(1); ang != ang_quad_.octant(3);
-                 ++ang) {
-                VecF fsr_vol(mesh.unique_plane(iplane).n_reg(), 0.0);
-                VecF flat_cf(mesh.unique_plane(iplane).n_reg(), 0.0);
-                auto &rays   = rays_[iplane][iang];
-                real_t space = spacing_[iang];
-                for (const auto &ray : rays) {
-                    for (int iseg = 0; iseg < ray.nseg(); iseg++) {
-                        size_t ireg = ray.seg_index(iseg);
-                        fsr_vol[ireg] += ray.seg_len(iseg) * space;
-                    }
+    // FNV-1a hash of everything that goes into the ray trace of a plane,
+    // starting with what all of the planes share
+    uint64_t key = 14695981039346656037ull;
+    auto hash    = [&key](const void *data, size_t size) {
+        const unsigned char *bytes = static_cast<const unsigned char *>(data);
+        for (size_t i = 0; i < size; i++) {
+            key ^= bytes[i];
+            key *= 1099511628211ull;
+        }
+    };
+    auto hash_vec = [&hash](const VecF &v) {
+        hash(v.data(), v.size() * sizeof(real_t));
+    };
+
+    hash(&RAY_FILE_VERSION, sizeof(RAY_FILE_VERSION));
+    hash(&opt_spacing, sizeof(opt_spacing));
+    hash(&core_modular, sizeof(core_modular));
+    hash(&modularization_method_, sizeof(modularization_method_));
+    hash(&correction_type_, sizeof(correction_type_));
+    for (auto ang = ang_quad_.octant(1); ang != ang_quad_.octant(3); ++ang) {
+        hash(&ang->alpha, sizeof(ang->alpha));
+        hash(&ang->theta, sizeof(ang->theta));
+    }
+
+    hash_vec(mesh.x_divisions());
+    hash_vec(mesh.y_divisions());
+
+    // The adaptive spacing also depends on the cross sections
+    hash(&adaptive_factor_, sizeof(adaptive_factor_));
+    std::vector<VecF> tau;
+    if (adaptive_factor_ > 1) {
+        hash(&adaptive_tau_, sizeof(adaptive_tau_));
+        tau = this->optical_thickness(mesh);
+    }
+
+    // Then the layout of the pin meshes in each plane
+    uint64_t shared_key = key;
+    std::vector<uint64_t> keys;
+    keys.reserve(n_planes_);
+    for (unsigned iplane = 0; iplane < n_planes_; iplane++) {
+        key = shared_key;
+        for (const Lattice *lat : mesh.unique_plane(iplane)) {
+            for (const Pin *pin : *lat) {
+                const PinMesh &pm = pin->mesh();
+                int n_reg         = pm.n_reg();
+                real_t pitch[2]   = {pm.pitch_x(), pm.pitch_y()};
+                hash(&n_reg, sizeof(n_reg));
+                hash(pitch, sizeof(pitch));
+                hash_vec(pin->areas());
+            }
+        }
+        if (adaptive_factor_ > 1) {
+            hash_vec(tau[iplane]);
+        }
+        // Which pins are merged depends on their materials
+        if (macro_segments_) {
+            int n_macro = macro_pins_[iplane].size();
+            hash(&n_macro, sizeof(n_macro));
+            hash(macro_pins_[iplane].data(), n_macro * sizeof(MacroPin));
+        }
+        keys.push_back(key);
+    }
+
+    return keys;
+}
+
+std::vector<VecF> RayData::optical_thickness(const CoreMesh &mesh) const
+{
+    const MaterialLib &mat_lib = mesh.mat_lib();
+    std::vector<VecF> tau;
+    for (unsigned iplane = 0; iplane < n_planes_; iplane++) {
+        tau.emplace_back(mesh.unique_plane(iplane).n_reg(), 0.0);
+    }
+
+    // The pins of each macroplane are in the region order of its plane
+    for (const auto &mplane : mesh.macroplanes()) {
+        VecF &tau_plane = tau[mesh.unique_plane_ids()[mplane.iz_min]];
+        int ireg        = 0;
+        for (const Pin *pin : mplane) {
+            const PinMesh &pm = pin->mesh();
+            int ireg_pin      = 0;
+            int ixsreg        = 0;
+            for (const int mat_id : pin->mat_ids()) {
+                const Material &mat = mat_lib[mat_id];
+                real_t xs           = 0.0;
+                for (int ig = 0; ig < mat_lib.n_group(); ig++) {
+                    xs = std::max(xs, (real_t)mat.xstr(ig));
+                }
+                for (size_t i = 0; i < pm.n_fsrs(ixsreg); i++) {
+                    real_t tau_reg = xs * std::sqrt(pm.areas()[ireg_pin]);
+                    tau_plane[ireg] = std::max(tau_plane[ireg], tau_reg);
+                    ireg++;
+                    ireg_pin++;
                 }
+                ixsreg++;
+            }
+        }
+    }
+
+    return tau;
+}
+
+void RayData::find_macro_pins(const CoreMesh &mesh)
+{
+    // Whether each pin of each plane is uniform in all of the planes seen so
+    // far. The pins of each plane are in region order.
+    std::vector<std::vector<bool>> uniform(n_planes_);
+    for (int iz = 0; iz < (int)mesh.nz(); iz++) {
+        auto &uniform_plane = uniform[mesh.unique_plane_id(iz)];
+        bool first          = uniform_plane.empty();
+        int ipin            = 0;
+        for (auto pin = mesh.begin(iz); pin != mesh.end(iz); ++pin) {
+            const VecI &mat_ids = (*pin)->mat_ids();
+            bool u = ((*pin)->n_reg() > 1) &&
+                     std::all_of(mat_ids.begin(), mat_ids.end(), [&](int id) {
+                         return id == mat_ids.front();
+                     });
+            if (first) {
+                uniform_plane.push_back(u);
+            } else {
+                uniform_plane[ipin] = uniform_plane[ipin] && u;
+            }
+            ipin++;
+        }
+    }
+
+    int n_macro = 0;
+    for (int iz = 0; iz < (int)mesh.nz(); iz++) {
+        int iplane = mesh.unique_plane_id(iz);
+        if (!macro_pins_[iplane].empty() || uniform[iplane].empty()) {
+            continue;
+        }
+        int ipin = 0;
+        int ireg = 0;
+        for (auto pin = mesh.begin(iz); pin != mesh.end(iz); ++pin) {
+            int n_reg = (*pin)->n_reg();
+            if (uniform[iplane][ipin]) {
+                macro_pins_[iplane].push_back({ireg, n_reg});
+                n_macro++;
+            }
+            ireg += n_reg;
+            ipin++;
+        }
+        // Only look at each plane once
+        uniform[iplane].clear();
+    }
+
+    LogScreen << "Pins swept as macro-segments: " << n_macro << std::endl;
+
+    return;
+}
 
-                for (size_t ireg = 0; ireg < mesh.unique_plane(iplane).n_reg();
-                     ireg++) {
-                    flat_cf[ireg] = true_vol[ireg] / fsr_vol[ireg];
-                    // jwg
-                    if (flat_corr_max < std::abs(flat_cf[ireg] - 1.0)) {
-                        flat_corr_max = std::abs(flat_cf[ireg] - 1.0);
-                        max_ireg      = ireg;
-                        max_iang      = iang;
+void RayData::thin_rays(std::vector<Ray> &rays, int iang,
+                        const VecF &tau) const
+{
+    std::vector<Ray> kept;
+    kept.reserve(rays.size());
+
+    // The rays entering through the x-normal faces come first
+    int face_begin[2] = {0, Ny_[iang]};
+    int face_end[2]   = {Ny_[iang], (int)rays.size()};
+    for (int iface = 0; iface < 2; iface++) {
+        for (int first = face_begin[iface]; first < face_end[iface];
+             first += adaptive_factor_) {
+            int last   = std::min(first + adaptive_factor_, face_end[iface]);
+            bool thick = false;
+            for (int iray = first; (iray < last) && !thick; iray++) {
+                for (const int ireg : rays[iray].seg_index()) {
+                    if (tau[ireg] > adaptive_tau_) {
+                        thick = true;
+                        break;
                     }
-                    flat_corr_rms +=
-                        (flat_cf[ireg] - 1.0) * (flat_cf[ireg] - 1.0);
                 }
+            }
 
-                // Correction
-                for (auto &ray : rays) {
-                    for (int iseg = 0; iseg < ray.nseg(); iseg++) {
-                        int ireg          = ray.seg_index(iseg);
-                        ray.seg_len(iseg) = ray.seg_len(iseg) * flat_cf[ireg];
+            if (thick) {
+                for (int iray = first; iray < last; iray++) {
+                    kept.push_back(std::move(rays[iray]));
+                }
+            } else {
+                int imid = (first + last) / 2;
+                for (int iray = first; iray < last; iray++) {
+                    if (iray != imid) {
+                        rays[imid].absorb(rays[iray]);
                     }
                 }
-                iang++;
-            } // angle loop
-            flat_corr_rms =
-                std::sqrt(flat_corr_rms / (mesh.unique_plane(iplane).n_reg() *
-                                           (ang_quad_.ndir() / 4)));
-
-            LogFile << "For plane " << iplane
-                    << ", the maximum correction occurs with "
-                    << "region index " << max_ireg << " and angle index "
-                    << max_iang << ", the magnitude of "
-                    << "the correction being " << flat_corr_max << "."
-                    << std::endl;
-            LogFile << "The RMS of the correction is " << flat_corr_rms << "."
-                    << std::endl;
-            LogFile << std::endl << std::endl;
-
-        } // plane loop
+                kept.push_back(std::move(rays[imid]));
+            }
+        }
+    }
 
-        break;
-    // Correct all angles at the same time, preserving the angular
-    // integral of the region volumes for all angles
-    case VolumeCorrection::ANGLE:
-        LogFile << std::endl << std::endl;
-        LogFile << "Using " << correction_type_ << " volume correction for "
-                << "rays." << std::endl;
-        for (size_t iplane = 0; iplane < n_planes_; iplane++) {
-            // flat_corr_max to store the maximum correction for all regions
-            // flat_corr_rms to store the rms of the severity of correction
-            real_t flat_corr_max = 0.0;
-            real_t flat_corr_rms = 0.0;
-            int max_ireg         = 0;
-
-            const VecF &true_vol = mesh.unique_plane(iplane).areas();
-            VecF fsr_vol(mesh.unique_plane(iplane).n_reg(), 0.0);
-            int iang = 0;
-            for (auto ang = ang_quad_.octant(1); ang != ang_quad_.octant(3);
-                 ++ang) {
-                std::vector<Ray> &rays = rays_[iplane][iang];
-                real_t space           = spacing_[iang];
-                real_t wgt             = ang->weight * 0.5;
+    rays = std::move(kept);
+    return;
+}
 
-                for (auto &ray : rays) {
-                    for (int iseg = 0; iseg < ray.nseg(); iseg++) {
-                        int ireg = ray.seg_index(iseg);
-                        fsr_vol[ireg] += ray.seg_len(iseg) * space * wgt;
-                    }
+VecF RayData::ray_volume(const std::vector<Ray> &rays, int iang,
+                         int n_reg) const
+{
+    VecF vol(n_reg, 0.0);
+    real_t space = spacing_[iang];
+    for (const auto &ray : rays) {
+        real_t w = space * ray.weight();
+        for (int iseg = 0; iseg < ray.nseg(); iseg++) {
+            vol[ray.seg_index(iseg)] += ray.seg_len(iseg) * w;
+        }
+    }
+    return vol;
+}
+
+void RayData::scale_segments(std::vector<Ray> &rays, const VecF &cf)
+{
+    for (auto &ray : rays) {
+        for (int iseg = 0; iseg < ray.nseg(); iseg++) {
+            ray.seg_len(iseg) *= cf[ray.seg_index(iseg)];
+        }
+    }
+    return;
+}
+
+int RayData::read_rays(const std::string &path,
+                       const std::vector<uint64_t> &keys,
+                       std::vector<bool> &found)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        LogScreen << "Ray file " << path << " not found. Tracing rays."
+                  << std::endl;
+        return 0;
+    }
+    struct stat st;
+    if ((fstat(fd, &st) != 0) || (st.st_size < (off_t)RAY_FILE_HEADER)) {
+        close(fd);
+        Warn("Unable to read ray file " + path + ". Tracing rays.");
+        return 0;
+    }
+
+    // Map the file read-only, so that concurrent runs on the same node share
+    // the page-cached data
+    void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        Warn("Unable to map ray file " + path + ". Tracing rays.");
+        return 0;
+    }
+
+    const char *data = static_cast<const char *>(map);
+    char magic[8];
+    uint64_t version;
+    uint64_t n_planes;
+    uint64_t n_ang;
+    std::memcpy(magic, data, sizeof(magic));
+    std::memcpy(&version, data + 8, sizeof(version));
+    std::memcpy(&n_planes, data + 16, sizeof(n_planes));
+    std::memcpy(&n_ang, data + 24, sizeof(n_ang));
+
+    bool match = (std::memcmp(magic, RAY_FILE_MAGIC, sizeof(magic)) == 0) &&
+                 (version == RAY_FILE_VERSION) &&
+                 (n_ang == (uint64_t)ang_quad_.ndir_oct() * 2) &&
+                 (RAY_FILE_HEADER + n_planes * 2 * sizeof(uint64_t) <=
+                  (uint64_t)st.st_size);
+    if (!match) {
+        munmap(map, st.st_size);
+        LogScreen << "Ray file " << path
+                  << " does not match this problem. Tracing rays."
+                  << std::endl;
+        return 0;
+    }
+
+    // Offset of the data of each plane in the file, by key
+    std::map<uint64_t, uint64_t> offsets;
+    for (unsigned ifile = 0; ifile < n_planes; ifile++) {
+        uint64_t entry[2];
+        std::memcpy(entry, data + RAY_FILE_HEADER + ifile * sizeof(entry),
+                    sizeof(entry));
+        offsets[entry[0]] = entry[1];
+    }
+
+    int n_read = 0;
+    for (unsigned iplane = 0; iplane < n_planes_; iplane++) {
+        auto offset = offsets.find(keys[iplane]);
+        if (found[iplane] || (offset == offsets.end()) ||
+            (offset->second >= (uint64_t)st.st_size)) {
+            continue;
+        }
+        const char *plane_data = data + offset->second;
+        rays_[iplane].resize(n_ang);
+        for (unsigned iang = 0; iang < n_ang; iang++) {
+            uint64_t n_rays;
+            std::memcpy(&n_rays, plane_data, sizeof(n_rays));
+            plane_data += sizeof(n_rays);
+            auto &rays = rays_[iplane][iang];
+            rays.clear();
+            rays.reserve(n_rays);
+            for (unsigned iray = 0; iray < n_rays; iray++) {
+                rays.emplace_back(plane_data);
+            }
+            VecF &cf = correction_[iplane][iang];
+            std::memcpy(cf.data(), plane_data, cf.size() * sizeof(real_t));
+            plane_data += cf.size() * sizeof(real_t);
+        }
+        found[iplane] = true;
+        n_read++;
+    }
+    munmap(map, st.st_size);
+
+    if (n_read == (int)n_planes_) {
+        LogScreen << "Read rays from " << path << std::endl;
+    } else {
+        LogScreen << "Read rays for " << n_read << " of " << n_planes_
+                  << " planes from " << path << std::endl;
+    }
+
+    return n_read;
+}
+
+void RayData::write_rays(const std::string &path,
+                         const std::vector<uint64_t> &keys) const
+{
+    // Only one process needs to write the file. Write to a temporary file
+    // and move it into place, so that concurrent runs never see a partial
+    // ray file.
+    if (!ParEnv.is_root()) {
+        return;
+    }
+
+    std::string tmp_path = path + ".tmp" + std::to_string(getpid());
+    {
+        std::ofstream out(tmp_path, std::ios::binary);
+        if (!out) {
+            Warn("Unable to write ray file " + path);
+            return;
+        }
+
+        uint64_t header[3] = {(uint64_t)RAY_FILE_VERSION, (uint64_t)n_planes_,
+                              (uint64_t)ang_quad_.ndir_oct() * 2};
+        out.write(RAY_FILE_MAGIC, 8);
+        out.write(reinterpret_cast<const char *>(header), sizeof(header));
+
+        // The plane table is filled in once the offsets are known
+        std::vector<uint64_t> table(2 * n_planes_, 0);
+        out.write(reinterpret_cast<const char *>(table.data()),
+                  table.size() * sizeof(uint64_t));
+
+        for (unsigned iplane = 0; iplane < n_planes_; iplane++) {
+            table[2 * iplane]     = keys[iplane];
+            table[2 * iplane + 1] = out.tellp();
+            for (unsigned iang = 0; iang < rays_[iplane].size(); iang++) {
+                uint64_t n_rays = rays_[iplane][iang].size();
+                out.write(reinterpret_cast<const char *>(&n_rays),
+                          sizeof(n_rays));
+                for (const auto &ray : rays_[iplane][iang]) {
+                    ray.write(out);
                 }
-                ++iang;
-            }
-            // Convert fsr_vol into a correction factor
-            for (int ireg = 0; ireg < (int)mesh.unique_plane(iplane).n_reg();
-                 ireg++) {
-                fsr_vol[ireg] = true_vol[ireg] / fsr_vol[ireg];
-                if (flat_corr_max < std::abs(fsr_vol[ireg] - 1.0)) {
-                    flat_corr_max = std::abs(fsr_vol[ireg] - 1.0);
+                const VecF &cf = correction_[iplane][iang];
+                out.write(reinterpret_cast<const char *>(cf.data()),
+                          cf.size() * sizeof(real_t));
+            }
+        }
+
+        out.seekp(RAY_FILE_HEADER);
+        out.write(reinterpret_cast<const char *>(table.data()),
+                  table.size() * sizeof(uint64_t));
+        if (!out) {
+            Warn("Failed writing ray file " + path);
+            std::remove(tmp_path.c_str());
+            return;
+        }
+    }
+
+    if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        Warn("Unable to move ray file into place: " + path);
+        std::remove(tmp_path.c_str());
+        return;
+    }
+
+    LogScreen << "Wrote rays to " << path << std::endl;
+
+    return;
+}
+
+void RayData::spill_segments(const std::string &path)
+{
+    // The segments are final by now, so every process could share a file,
+    // but they are likely to be on node-local storage anyway
+    std::string file = path;
+    if (ParEnv.n_rank() > 1) {
+        file += "." + std::to_string(ParEnv.rank());
+    }
+
+    {
+        std::ofstream out(file, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            throw EXCEPT("Unable to open out-of-core ray file " + file);
+        }
+        for (unsigned iplane = 0; iplane < n_planes_; iplane++) {
+            stream_offset_.push_back(out.tellp());
+            for (const auto &packed : packed_rays_[iplane]) {
+                packed.write_segments(out);
+            }
+        }
+        if (!out) {
+            std::remove(file.c_str());
+            throw EXCEPT("Failed writing out-of-core ray file " + file);
+        }
+    }
+
+    stream_file_ = std::shared_ptr<const std::string>(
+        new std::string(file), [](const std::string *f) {
+            std::remove(f->c_str());
+            delete f;
+        });
+
+    for (unsigned iplane = 0; iplane < n_planes_; iplane++) {
+        this->release_segments(iplane);
+    }
+
+    LogScreen << "Moved packed ray segments out of core to " << file
+              << std::endl;
+    return;
+}
+
+void RayData::release_ray_segments()
+{
+    for (auto &plane_rays : rays_) {
+        for (auto &ang_rays : plane_rays) {
+            for (auto &ray : ang_rays) {
+                ray.release_segments();
+            }
+        }
+    }
+    return;
+}
+
+void RayData::compact(bool release_segments)
+{
+    if (release_segments && this->ray_segments()) {
+        this->release_ray_segments();
+        compacted_ = true;
+    }
+    for (auto &plane_rays : rays_) {
+        for (auto &ang_rays : plane_rays) {
+            for (auto &ray : ang_rays) {
+                ray.shrink_to_fit();
+            }
+            ang_rays.shrink_to_fit();
+        }
+    }
+    return;
+}
+
+void RayData::load_segments(int id)
+{
+    std::ifstream in(*stream_file_, std::ios::binary);
+    in.seekg(stream_offset_[id]);
+    if (!in) {
+        throw EXCEPT("Unable to read out-of-core ray file " + *stream_file_);
+    }
+    for (auto &packed : packed_rays_[id]) {
+        packed.read_segments(in);
+    }
+    return;
+}
+
+void RayData::release_segments(int id)
+{
+    for (auto &packed : packed_rays_[id]) {
+        packed.release_segments();
+    }
+    return;
+}
+
+void RayData::stream(int id, int next)
+{
+    assert(this->out_of_core());
+
+    // Finish any read-ahead of a plane other than the one passed, and
+    // release it
+    auto drop_pending = [this]() {
+        if (pending_.valid()) {
+            pending_.get();
+            this->release_segments(pending_id_);
+        }
+        pending_id_ = -1;
+    };
+
+    if (id != resident_) {
+        if (resident_ >= 0) {
+            this->release_segments(resident_);
+            resident_ = -1;
+        }
+        if (pending_id_ == id) {
+            pending_id_ = -1;
+            pending_.get();
+        } else {
+            drop_pending();
+            n_stall_++;
+            this->load_segments(id);
+        }
+        resident_ = id;
+    }
+
+    if ((next >= 0) && (next != resident_) && (next != pending_id_)) {
+        drop_pending();
+        pending_id_ = next;
+        pending_    = std::async(std::launch::async,
+                                 [this, next]() { this->load_segments(next); });
+    }
+
+    return;
+}
+
+void RayData::reset_correction(const CoreMesh &mesh)
+{
+    correction_.clear();
+    for (unsigned iplane = 0; iplane < n_planes_; iplane++) {
+        correction_.emplace_back(ang_quad_.ndir_oct() * 2,
+                                 VecF(mesh.unique_plane(iplane).n_reg(), 1.0));
+    }
+    return;
+}
+
+void RayData::log_correction(const VecI &planes) const
+{
+    if (correction_type_ == VolumeCorrection::NONE) {
+        return;
+    }
+
+    LogFile << std::endl << std::endl;
+    LogFile << "Using " << correction_type_ << " volume correction for "
+            << "rays." << std::endl;
+    // The ANGLE correction is the same for every angle, so only look at the
+    // first
+    bool flat = correction_type_ == VolumeCorrection::FLAT;
+    int n_ang = flat ? correction_.front().size() : 1;
+    for (int iplane : planes) {
+        // flat_corr_max to store the maximum correction for all angles and
+        // regions
+        // flat_corr_rms to store the rms of the severity of correction
+        real_t flat_corr_max = 0.0;
+        int max_ireg         = 0;
+        int max_iang         = 0;
+        real_t flat_corr_rms = 0.0;
+        int n_reg            = correction_[iplane].front().size();
+        for (int iang = 0; iang < n_ang; iang++) {
+            const VecF &cf = correction_[iplane][iang];
+            for (int ireg = 0; ireg < n_reg; ireg++) {
+                real_t dev = std::abs(cf[ireg] - 1.0);
+                if (flat_corr_max < dev) {
+                    flat_corr_max = dev;
                     max_ireg      = ireg;
+                    max_iang      = iang;
                 }
-                flat_corr_rms += (fsr_vol[ireg] - 1.0) * (fsr_vol[ireg] - 1.0);
+                flat_corr_rms += dev * dev;
             }
+        }
+        flat_corr_rms = std::sqrt(flat_corr_rms / (n_reg * n_ang));
 
-            // Correct ray lengths to enforce proper FSR volumes
-            iang = 0;
-            for (auto ang = ang_quad_.octant(1); ang != ang_quad_.octant(3);
-                 ++ang) {
-                std::vector<Ray> &rays = rays_[iplane][iang];
-                for (auto &ray : rays) {
-                    for (int iseg = 0; iseg < ray.nseg(); iseg++) {
-                        int ireg          = ray.seg_index(iseg);
-                        ray.seg_len(iseg) = ray.seg_len(iseg) * fsr_vol[ireg];
-                    }
-                }
-                ++iang;
-            } // angle loop
-
-            flat_corr_rms =
-                sqrt(flat_corr_rms / (int)mesh.unique_plane(iplane).n_reg());
-
-            LogFile << "For plane " << iplane
-                    << ", the maximum correction occurs with "
-                    << "region index " << max_ireg << ", the magnitude of "
-                    << "the correction being " << flat_corr_max << "."
-                    << std::endl;
-            LogFile << "The RMS of the correction is " << flat_corr_rms << "."
-                    << std::endl;
-            LogFile << std::endl << std::endl;
-
-        } // plane loop
-        break;
-    case VolumeCorrection::NONE:
-        break;
+        LogFile << "For plane " << iplane
+                << ", the maximum correction occurs with "
+                << "region index " << max_ireg;
+        if (flat) {
+            LogFile << " and angle index " << max_iang;
+        }
+        LogFile << ", the magnitude of "
+                << "the correction being " << flat_corr_max << "."
+                << std::endl;
+        LogFile << "The RMS of the correction is " << flat_corr_rms << "."
+                << std::endl;
+        LogFile << std::endl << std::endl;
     }
-} // correct_volume
+    return;
+}
+
+void RayData::predict_segments(const CoreMesh &mesh, real_t hx_mod,
+                               real_t hy_mod, real_t opt_spacing,
+                               bool core_modular) const
+{
+    real_t hx    = mesh.hx_core();
+    real_t hy    = mesh.hy_core();
+    Box core_box = Box(Point2(0.0, 0.0), Point2(hx, hy));
+
+    // Sample the number of segments per unit length in each plane with a
+    // fan of probe rays entering from the south face
+    const int n_probe_ang = 4;
+    const int n_probe_ray = 8;
+    real_t density        = 0.0;
+    for (unsigned iplane = 0; iplane < n_planes_; iplane++) {
+        size_t n_seg  = 0;
+        real_t length = 0.0;
+        for (int ia = 0; ia < n_probe_ang; ia++) {
+            Angle ang((ia + 0.5) * HPI / n_probe_ang, HPI, 1.0);
+            for (int ir = 0; ir < n_probe_ray; ir++) {
+                Point2 p1((ir + 0.5) * hx / n_probe_ray, 0.0);
+                Point2 p2 = core_box.intersect(p1, ang);
+                Ray ray(p1, p2, {0, 0}, iplane, mesh);
+                n_seg += ray.nseg();
+                length += p1.distance(p2);
+            }
+        }
+        density += n_seg / length;
+    }
+
+    // Count the distinct azimuthal angles in the first octant, the rest of
+    // the octant being made up of polar angles
+    VecF alphas;
+    for (auto ang = ang_quad_.octant(1); ang != ang_quad_.octant(2); ++ang) {
+        bool found = false;
+        for (auto alpha : alphas) {
+            found = found || fp_equiv(alpha, ang->alpha);
+        }
+        if (!found) {
+            alphas.push_back(ang->alpha);
+        }
+    }
+    int n_az    = alphas.size();
+    int n_polar = ang_quad_.ndir_oct() / n_az;
+    real_t area = hx * hy;
+
+    LogScreen << "Predicted ray segments (" << n_polar
+              << " polar angles, per group sweep):" << std::endl;
+    for (int n : {n_az / 2, n_az, 2 * n_az}) {
+        if (n < 1) {
+            continue;
+        }
+        double n_seg = 0.0;
+        for (int i = 0; i < n; i++) {
+            // Chebyshev azimuthal angles, modularized the same way as the
+            // real ones
+            Angle ang((2 * i + 1) * PI / (4 * n), HPI, 1.0);
+            auto N = this->modularize_angle(ang, hx_mod, hy_mod, opt_spacing);
+            int Nx = N.first;
+            int Ny = N.second;
+            if (!core_modular) {
+                Nx *= mesh.nx();
+                Ny *= mesh.ny();
+            }
+            real_t alpha = std::atan(hy * Nx / (hx * Ny));
+            real_t space = std::cos(alpha) * hy / Ny;
+
+            // Octants 1 and 2, each swept forward and backward
+            n_seg += 4.0 * (n_planes_ * (Nx + Ny) + density * area / space);
+        }
+        LogScreen << "    " << 4 * n << " azimuthal angles: " << std::setw(12)
+                  << (size_t)n_seg << " segments, " << std::setw(12)
+                  << (size_t)(n_seg * n_polar) << " segment-angles"
+                  << std::endl;
+    }
+
+    return;
+}
 
 std::pair<int, int> RayData::modularize_angle(Angle ang, real_t hx, real_t hy,
                                               real_t nominal_spacing) const
@@ -526,50 +1558,32 @@ std::pair<int, int> RayData::modularize_angle(Angle ang, real_t hx, real_t hy,
     return std::pair<int, int>(Nx, Ny);
 }
 
-std::ostream &operator<<(std::ostream &os, const RayData &rays)
+void RayData::dump_xdmf(const std::string &stem) const
 {
     // For now, we are more interested in the rays in the macro sense. Where
     // they start and stop, more than what they do internally, so only do
     // output for one plane.
+    XDMFGrid grid("rays");
+    VecI angle;
+    VecI bc_start;
+    VecI bc_stop;
+    int iang = 0;
+    for (const auto &ang_rays : *this->begin()) {
+        for (const auto &r : ang_rays) {
+            grid.add_cell(std::vector<Point2>{r.p1(), r.p2()}, false);
+            angle.push_back(iang);
+            bc_start.push_back(r.bc(0));
+            bc_stop.push_back(r.bc(1));
+        }
+        iang++;
+    }
+    grid.attributes.emplace_back("angle", angle);
+    grid.attributes.emplace_back("bc_start", bc_start);
+    grid.attributes.emplace_back("bc_stop", bc_stop);
 
-    // spit out some boilerplate python to make these easy to draw
-    os << "import cairo" << std::endl;
-    os << "def draw_rays( ctx, angle):" << std::endl;
-    os << "    angle_rays = rays[angle]" << std::endl;
-
-    os << "    for r in angle_rays:" << std::endl;
-    os << "        p1 = r[0]" << std::endl;
-    os << "        p2 = r[1]" << std::endl;
-    os << "        ctx.move_to(p1[0], p1[1])" << std::endl;
-    os << "        ctx.line_to(p2[0], p2[1])" << std::endl;
-    os << "        ctx.close_path()" << std::endl;
-    os << "    ctx.stroke()" << std::endl;
-    os << "    return" << std::endl;
-
-    const auto &plane_rays = rays.begin();
-    os << "rays = [ ";
-    auto angle_pos = os.tellp();
-    for (auto &ang_rays : *plane_rays) {
-        auto ray_pos = os.tellp();
-        os << "[ " << std::endl;
-        for (auto &r : ang_rays) {
-            os << r;
-            ray_pos = os.tellp();
-            os << ",    # " << r.bc(0) << " " << r.bc(1) << std::endl;
-        }
-        // store the location before the comma
-        auto end_pos = os.tellp();
-        os.seekp(ray_pos);
-        os << " ]";
-        os.seekp(end_pos);
-        angle_pos = os.tellp();
-        os << "," << std::endl;
-    }
-    // go back to before the last comma and overwrite with close ]
-    os.seekp(angle_pos);
-    os << " ]" << std::endl;
+    write_xdmf(stem, {grid});
 
-    return os;
+    return;
 }
 
 std::ostream &operator<<(std::ostream &os, VolumeCorrection vc)
@@ -16,21 +16,39 @@
 
 #pragma once
 
+#include <cassert>
+#include <cstdint>
+#include <future>
 #include <iosfwd>
+#include <map>
 #include <memory>
+#include <string>
 #include <vector>
 #include "util/pugifwd.hpp"
 #include "core/angular_quadrature.hpp"
 #include "core/core_mesh.hpp"
 #include "core/geometry/angle.hpp"
 #include "core/geometry/geom.hpp"
+#include "packed_rays.hpp"
 #include "ray.hpp"
 
 namespace mocc {
 namespace moc {
 enum class VolumeCorrection { FLAT, ANGLE, NONE };
 enum class Modularization { TRIG, RATIONAL };
+enum class SegmentStorage { PACKED, MODULAR, COMPACT, ON_THE_FLY };
 std::ostream &operator<<(std::ostream &os, VolumeCorrection vc);
+
+/**
+ * \brief A pin whose regions are swept as one, see \ref RayData::macro_pins()
+ */
+struct MacroPin {
+    // First region of the pin, relative to its plane
+    int first_reg;
+    // Number of regions in the pin
+    int n_reg;
+};
+
 /**
  * \page coarseraypage Coarse Ray Tracing
  * Each ray crossing a mesh corner must deposit its information on one
@@ -153,6 +171,46 @@ public:
         return spacing_[iang];
     }
 
+    /**
+     * \brief Return whether the rays are spaced adaptively
+     *
+     * If so, some rays stand in for neighbours that were dropped from
+     * optically thin parts of the domain, and have a \ref Ray::weight()
+     * other than one. Only sweepers that honour the ray weights and \ref
+     * Ray::shadow_bc() may use them.
+     */
+    bool adaptive() const
+    {
+        return adaptive_factor_ > 1;
+    }
+
+    /**
+     * \brief Return the pins of the indexed plane whose crossings are swept
+     * as single macro-segments
+     *
+     * Where every region of a pin holds the same material, in all of the
+     * planes that share its geometry, and the source is taken to be flat
+     * over the pin, the pin can be swept as if it were a single region.
+     * With the \c macro_segments option, the segments of each crossing of
+     * such a pin are merged into one, once their lengths are corrected,
+     * which is tallied to the first region of the pin. The sweeper is then
+     * responsible for making the source flat over the pin, and for
+     * spreading the flux over its regions. Empty unless the option is set.
+     */
+    const std::vector<MacroPin> &macro_pins(size_t id) const
+    {
+        return macro_pins_[id];
+    }
+
+    /**
+     * \brief Return whether the crossings of uniform pins are merged into
+     * macro-segments. See \ref macro_pins().
+     */
+    bool macro_segments() const
+    {
+        return macro_segments_;
+    }
+
     /**
      * Return the maximum number of segments spanned by any \ref Ray in the
      * collection. This is useful for defining the size of the scratch
@@ -164,9 +222,25 @@ public:
     }
 
     /**
-     * Provide stream insertion support.
+     * \brief Return the number of bytes used to store the rays, including
+     * the packed segment data used by the sweepers.
      */
-    friend std::ostream &operator<<(std::ostream &os, const RayData &rays);
+    size_t memory() const;
+
+    /**
+     * \brief Return the number of segments swept by a single transport sweep
+     * of the plane with geometry \p id, counting both directions of each ray
+     */
+    size_t n_segments(size_t id) const;
+
+    /**
+     * \brief Write the rays of the first plane to \p stem.h5, with an XDMF
+     * descriptor in \p stem.xdmf
+     *
+     * Each ray is a line segment, tagged with its angle index and the
+     * boundary condition indices of its ends.
+     */
+    void dump_xdmf(const std::string &stem) const;
 
     /**
      * \brief Return a const reference to the indexed set of plane rays.
@@ -176,11 +250,270 @@ public:
         return rays_[id];
     }
 
+    /**
+     * \brief Return a const reference to the packed segment data for the
+     * indexed plane, one \ref PackedRays for each angle.
+     *
+     * The rays in each \ref PackedRays are in the same order as in the
+     * corresponding plane/angle of \ref operator[](). When \ref
+     * out_of_core(), the segments themselves are only resident for the plane
+     * most recently passed to \ref stream().
+     */
+    const std::vector<PackedRays> &packed(size_t id) const
+    {
+        return packed_rays_[id];
+    }
+
+    /**
+     * \brief Return whether the packed segments are stored modularly. See
+     * \ref PackedRays::expand().
+     */
+    bool modular_storage() const
+    {
+        return storage_ == SegmentStorage::MODULAR;
+    }
+
+    /**
+     * \brief Return whether the packed segments are stored compactly. See
+     * \ref PackedRays::expand().
+     */
+    bool compact_storage() const
+    {
+        return storage_ == SegmentStorage::COMPACT;
+    }
+
+    /**
+     * \brief Return whether the segments are re-traced for each sweep,
+     * rather than stored
+     *
+     * Only the number of segments in each ray is kept, along with the
+     * volume-correction factors, and \ref expand() traces the rays through
+     * the mesh again as they are swept.
+     */
+    bool on_the_fly() const
+    {
+        return storage_ == SegmentStorage::ON_THE_FLY;
+    }
+
+    /**
+     * \brief Return whether the segments of each ray have to be produced with
+     * \ref expand() before they are swept, rather than being read from the
+     * \ref PackedRays directly
+     */
+    bool expanded() const
+    {
+        return storage_ != SegmentStorage::PACKED;
+    }
+
+    /**
+     * \brief Return whether each \ref Ray keeps its own segments
+     *
+     * The segments of the \ref Ray objects are only used to set up some of
+     * the sweepers. They are released when traced on the fly, or by \ref
+     * compact(), leaving the packed segments as the only copy.
+     */
+    bool ray_segments() const
+    {
+        return !this->on_the_fly() && !compacted_;
+    }
+
+    /**
+     * \brief Release what is no longer needed once the sweeper is set up
+     *
+     * The spare capacity of the \ref Ray objects is released, along with
+     * their segments if \p release_segments is true. Sweepers that read the
+     * segments of the rays themselves while sweeping must keep them.
+     */
+    void compact(bool release_segments);
+
+    /**
+     * \brief Per-thread scratch space used by \ref expand()
+     */
+    struct TraceScratch {
+        PinTraceCache cache;
+        std::vector<Point2> ps;
+        VecF len;
+        VecI reg;
+    };
+
+    /**
+     * \brief Produce the segments of a single ray
+     *
+     * \param id the plane geometry of the ray
+     * \param iang the angle of the ray
+     * \param iray the ray within the plane and angle
+     * \param scratch scratch space, which should be kept by the calling
+     * thread from one ray to the next
+     * \param[out] len the volume-corrected length of each segment. There
+     * must be room for \ref max_segments() values
+     * \param[out] idx the region index of each segment
+     *
+     * Modular and compact segments are expanded with \ref
+     * PackedRays::expand(). Rays
+     * traced on the fly are traced through the mesh again, reusing the pin
+     * crossings of earlier rays in \p scratch where possible. The pin
+     * crossing cache is cleared whenever it grows past the \c trace_cache
+     * limit.
+     *
+     * \pre \ref expanded() is true
+     */
+    void expand(int id, int iang, int iray, TraceScratch &scratch,
+                float *len, uint32_t *idx) const;
+
+    /**
+     * \brief Return whether the packed segments are kept in a file, rather
+     * than in memory
+     */
+    bool out_of_core() const
+    {
+        return (bool)stream_file_;
+    }
+
+    /**
+     * \brief Make the packed segments of plane \p id resident, and start
+     * reading those of plane \p next in the background
+     *
+     * Only the packed segments of \p id, and of the plane being read ahead,
+     * are kept in memory. The segments of any other plane are released. If
+     * the segments of \p id were read ahead by the previous call, this only
+     * waits for the read to finish; otherwise they are read right away. Pass
+     * a negative \p next to skip the read-ahead.
+     *
+     * This must not be called while another thread may be using the packed
+     * segments of a plane other than \p id.
+     *
+     * \pre \ref out_of_core() is true
+     */
+    void stream(int id, int next);
+
+    /**
+     * \brief Return the number of times that \ref stream() had to wait to
+     * read a plane that hadn't been read ahead
+     */
+    int n_stream_stall() const
+    {
+        return n_stall_;
+    }
+
+    /**
+     * \brief Return the number of geometrically-unique planes whose rays were
+     * traced, rather than taken from the ray cache or a ray file
+     */
+    int n_traced_planes() const
+    {
+        return n_traced_;
+    }
+
+    /**
+     * \brief Return whether the regions of the packed segments have been
+     * renumbered for locality
+     *
+     * The \ref Ray objects themselves always keep the mesh region indices.
+     */
+    bool renumbered() const
+    {
+        return !region_index_.empty();
+    }
+
+    /**
+     * \brief Return the index used by the packed segments of the indexed
+     * plane for each of its regions.
+     *
+     * \pre \ref renumbered() is true
+     */
+    const VecI &region_index(size_t id) const
+    {
+        assert(renumbered());
+        return region_index_[id];
+    }
+
+    /**
+     * \brief Enable or disable the in-memory ray cache
+     *
+     * While enabled, the rays traced (or read from a ray file) for each
+     * geometrically-unique plane are kept in memory and copied into any
+     * later \ref RayData with the same plane geometry, quadrature and ray
+     * options, using the same plane keys as the ray files. This is meant for
+     * batch runs, where many cases share all or most of their geometry, as
+     * when moving control rods. Disabling the cache frees it.
+     */
+    static void enable_cache(bool enable);
+
 private:
     // Methods
     std::pair<int, int> modularize_angle(Angle ang, real_t hx, real_t hy,
                                          real_t nominal_spacing) const;
 
+    /**
+     * \brief Log an estimate of the number of ray segments that would be
+     * traced for a few different azimuthal angle counts, before the rays are
+     * actually traced.
+     *
+     * The estimate is the number of rays for each modularized angle, plus the
+     * total ray length times the segment density of each plane, which is
+     * sampled with a handful of probe rays.
+     */
+    void predict_segments(const CoreMesh &mesh, real_t hx_mod, real_t hy_mod,
+                          real_t opt_spacing, bool core_modular) const;
+
+    /**
+     * \brief Trace the rays for every angle of the indexed unique planes,
+     * and correct their volumes
+     *
+     * Each (plane, angle) pair is traced, thinned, volume-corrected and
+     * merged into macro-segments by a single task, while its segments are
+     * still in cache. Only the ANGLE correction, which needs every angle of
+     * a plane, is applied in a second pass.
+     */
+    void trace_rays(const CoreMesh &mesh, const VecI &planes);
+
+    /**
+     * \brief Return a hash for each unique plane of its geometry, along with
+     * the modularized quadrature and ray options, used to tell which planes
+     * of a ray file or of the ray cache belong to the current problem
+     */
+    std::vector<uint64_t> plane_keys(const CoreMesh &mesh, real_t opt_spacing,
+                                     bool core_modular) const;
+
+    /**
+     * \brief Read previously-traced rays from a ray file.
+     *
+     * The file is memory-mapped read-only. The rays and correction factors
+     * of each plane not yet \p found are read if the file has a plane with
+     * the same key, and the plane is then marked as found. Returns the
+     * number of planes read.
+     */
+    int read_rays(const std::string &path, const std::vector<uint64_t> &keys,
+                  std::vector<bool> &found);
+
+    /**
+     * \brief Write the rays of every plane to a ray file
+     */
+    void write_rays(const std::string &path,
+                    const std::vector<uint64_t> &keys) const;
+
+    /**
+     * \brief Move the packed segments of all planes to an out-of-core file
+     */
+    void spill_segments(const std::string &path);
+
+    /**
+     * \brief Release the segments of every \ref Ray, keeping the rest of
+     * the ray data
+     */
+    void release_ray_segments();
+
+    /**
+     * \brief Read the packed segments of plane \p id from the out-of-core
+     * file. This is safe to run on a background thread.
+     */
+    void load_segments(int id);
+
+    /**
+     * \brief Release the packed segments of plane \p id
+     */
+    void release_segments(int id);
+
     // Data
     // This starts as a copy of the angular quadrature that is passed in
     AngularQuadrature ang_quad_;
@@ -191,6 +524,10 @@ private:
     // treats all of the rays for the given plane and angle.
     RaySet_t rays_;
 
+    // Packed segment data, indexed by plane, then angle. This is built after
+    // volume correction, so the lengths are final.
+    std::vector<std::vector<PackedRays>> packed_rays_;
+
     // Ray spacings for each angle. These vary from those specified due to
     // modularization
     VecF spacing_;
@@ -213,17 +550,130 @@ private:
     // Maximum number of ray segments in a single ray
     int max_seg_;
 
+    // Number of unique planes that were traced
+    int n_traced_;
+
+    // Whether compact() has released the segments of the rays
+    bool compacted_;
+
+    // Volume-correction factor applied to each region, indexed by plane,
+    // angle, then region. Only kept until the rays are packed, unless the
+    // rays are traced on the fly.
+    std::vector<std::vector<VecF>> correction_;
+
+    // How the segments are stored for the sweep
+    SegmentStorage storage_;
+
+    // Mesh to re-trace the segments through, if they are traced on the fly
+    const CoreMesh *mesh_;
+
+    // Number of pin crossings to cache per thread when tracing on the fly
+    size_t trace_cache_;
+
+    // Number of neighbouring rays that may be merged into one where they
+    // only cross optically thin regions, and the largest optical thickness
+    // of a thin region
+    int adaptive_factor_;
+    real_t adaptive_tau_;
+
+    // Whether to merge the crossings of uniform pins, and the pins of each
+    // plane that are merged
+    bool macro_segments_;
+    std::vector<std::vector<MacroPin>> macro_pins_;
+
+    // Index used by the packed segments for each region, indexed by plane,
+    // then mesh region. Empty unless the regions are renumbered.
+    std::vector<VecI> region_index_;
+
+    /**
+     * \brief Renumber the regions of the packed segments in the order that
+     * the sweep first visits them
+     *
+     * The angles and rays of each plane are walked in sweep order, and each
+     * region is given the next index the first time a segment crosses it.
+     * Regions that are next to each other along the rays then tend to be
+     * next to each other in memory as well.
+     */
+    void renumber_regions(const CoreMesh &mesh);
+
+    /**
+     * \brief Return an estimate of the optical thickness of each region,
+     * indexed by plane, then region
+     *
+     * This is the largest transport cross section of the region's material,
+     * over all groups and all of the macroplanes that share the plane
+     * geometry, times the square root of the region's area.
+     */
+    std::vector<VecF> optical_thickness(const CoreMesh &mesh) const;
+
+    /**
+     * \brief Merge blocks of \c adaptive_factor_ neighbouring rays of angle
+     * \p iang that only cross regions thinner than \c adaptive_tau_, by
+     * their optical thickness \p tau, into a single ray
+     *
+     * The middle ray of each such block is kept, and stands in for the
+     * others (see \ref Ray::absorb()). Rays entering through the x- and
+     * y-normal faces of the domain are blocked separately.
+     */
+    void thin_rays(std::vector<Ray> &rays, int iang, const VecF &tau) const;
+
+    /**
+     * \brief Find the pins of each plane that are made of a single material
+     * in every plane sharing its geometry, filling \ref macro_pins_
+     */
+    void find_macro_pins(const CoreMesh &mesh);
+
+    /**
+     * \brief Return the volume of each of the \p n_reg regions of a plane
+     * traced by its \p rays of angle \p iang
+     */
+    VecF ray_volume(const std::vector<Ray> &rays, int iang, int n_reg) const;
+
+    /**
+     * \brief Scale the length of each segment of \p rays by the factor
+     * \p cf of its region
+     */
+    static void scale_segments(std::vector<Ray> &rays, const VecF &cf);
+
     /**
-     * Perform a volume-correction of the ray segment lengths. This can be
-     * done in two ways: using an angular integral of the ray volumes, or
-     * using an angle-wise correction, which ensures that for each angle,
-     * the ray segment volumes reproduce the region volumes. The first way
-     * is technically more correct, however the latter is useful for
-     * debugging purposes sometimes.
+     * \brief Log the largest and RMS volume corrections of the indexed planes
+     *
+     * The correction is applied as the rays are traced (see \ref
+     * trace_rays()). The FLAT correction preserves the region volumes for
+     * each angle; the ANGLE correction preserves the angular integral of
+     * the region volumes. The first way is technically more correct,
+     * however the latter is useful for debugging purposes sometimes.
      */
-    void correct_volume(const CoreMesh &mesh);
+    void log_correction(const VecI &planes) const;
+
+    /**
+     * \brief Size the volume-correction factors for the mesh, and set them
+     * all to unity
+     */
+    void reset_correction(const CoreMesh &mesh);
 
     Modularization modularization_method_;
+
+    // Out-of-core segment file, removed when the last copy of the RayData
+    // goes away. Null unless the segments are out of core.
+    std::shared_ptr<const std::string> stream_file_;
+    // Position of the segments of each plane in the file
+    std::vector<uint64_t> stream_offset_;
+    // Plane with resident segments, and plane being read ahead. -1 if none.
+    int resident_;
+    int pending_id_;
+    std::future<void> pending_;
+    int n_stall_;
+
+    // Traced rays of a plane, before packing, as stored in the in-memory
+    // cache
+    struct TracedPlane {
+        PlaneRays_t rays;
+        std::vector<VecF> correction;
+    };
+
+    static bool cache_enabled_;
+    static std::map<uint64_t, std::shared_ptr<const TracedPlane>> cache_;
 };
 
 typedef std::shared_ptr<RayData> SP_RayData_t;
@@ -0,0 +1,74 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include "sweep_schedule.hpp"
+
+#include <algorithm>
+
+namespace mocc {
+namespace moc {
+SweepSchedule::SweepSchedule(const RayData &rays, int n_thread)
+{
+    auto longest_first = [](const WorkUnit &l, const WorkUnit &r) {
+        return l.n_seg > r.n_seg;
+    };
+
+    n_thread = std::max(n_thread, 1);
+
+    for (const auto &plane_rays : rays) {
+        int plane_id = angle_units_.size();
+        const auto &plane_packed = rays.packed(plane_id);
+        std::vector<std::vector<WorkUnit>> plane_angle_units;
+        std::vector<WorkUnit> plane_units;
+
+        for (int iang = 0; iang < (int)plane_rays.size(); iang++) {
+            const auto &packed = plane_packed[iang];
+            int n_rays         = packed.n_rays();
+            int n_seg_total    = packed.seg_offset(n_rays);
+            int target         = std::max(1, n_seg_total / (4 * n_thread));
+
+            // Accumulate consecutive rays until the chunk reaches the target
+            // segment count
+            std::vector<WorkUnit> units;
+            WorkUnit unit = {iang, 0, 0, 0};
+            for (int iray = 0; iray < n_rays; iray++) {
+                unit.n_seg += packed.nseg(iray);
+                unit.last_ray = iray + 1;
+                if (unit.n_seg >= target) {
+                    units.push_back(unit);
+                    unit = {iang, iray + 1, iray + 1, 0};
+                }
+            }
+            if (unit.last_ray > unit.first_ray) {
+                units.push_back(unit);
+            }
+
+            std::stable_sort(units.begin(), units.end(), longest_first);
+            plane_units.insert(plane_units.end(), units.begin(), units.end());
+            plane_angle_units.push_back(units);
+        }
+
+        std::stable_sort(plane_units.begin(), plane_units.end(),
+                         longest_first);
+        angle_units_.push_back(plane_angle_units);
+        plane_units_.push_back(plane_units);
+    }
+
+    return;
+}
+}
+}
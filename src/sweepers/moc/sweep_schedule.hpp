@@ -0,0 +1,91 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#pragma once
+
+#include <vector>
+#include "util/global_config.hpp"
+#include "ray_data.hpp"
+
+namespace mocc {
+namespace moc {
+/**
+ * \brief A contiguous chunk of rays from a single angle, to be swept as one
+ * unit of work.
+ */
+struct WorkUnit {
+    // Angle index
+    int iang;
+    // First ray in the chunk
+    int first_ray;
+    // One past the last ray in the chunk
+    int last_ray;
+    // Total number of segments in the chunk
+    int n_seg;
+};
+
+/**
+ * \brief Division of the rays of each plane into load-balanced units of work
+ *
+ * The number of segments on a ray varies wildly, so handing out single rays
+ * in a static round-robin fashion leaves threads idle at the end of each
+ * angle. The \ref SweepSchedule groups consecutive rays of each angle into
+ * chunks of roughly equal segment count, and orders them longest-first, so
+ * that they can be handed out dynamically with the long chunks going first.
+ *
+ * The chunks are available both by angle, for sweeps that must synchronize
+ * between angles, and for a whole plane, for sweeps that may work on several
+ * angles at once.
+ */
+class SweepSchedule {
+public:
+    SweepSchedule()
+    {
+        return;
+    }
+
+    /**
+     * \brief Build a schedule for all planes of the passed \ref RayData
+     *
+     * \param rays the \ref RayData to schedule
+     * \param n_thread the number of threads that the schedule should be
+     * balanced for. About four chunks are made for each thread in each angle.
+     */
+    SweepSchedule(const RayData &rays, int n_thread);
+
+    /**
+     * \brief Return the work units for one angle of a plane, longest first
+     */
+    const std::vector<WorkUnit> &angle_units(int plane_id, int iang) const
+    {
+        return angle_units_[plane_id][iang];
+    }
+
+    /**
+     * \brief Return the work units for all angles of a plane, longest first
+     */
+    const std::vector<WorkUnit> &plane_units(int plane_id) const
+    {
+        return plane_units_[plane_id];
+    }
+
+private:
+    std::vector<std::vector<std::vector<WorkUnit>>> angle_units_;
+    std::vector<std::vector<WorkUnit>> plane_units_;
+};
+}
+}
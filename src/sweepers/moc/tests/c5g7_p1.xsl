@@ -0,0 +1,29 @@
+C5G7 UO2 cross sections with P1 scattering
+ 7 1
+ 2.0E+07 1.0E+06  5.0E+05 1.0E+03 1.0E+02 10. 0.0635 
+!
+!The UO2-3.3 data of c5g7.xsl, with a made-up P1 scattering table of
+!0.2 times the P0 table (an average scattering cosine of 0.2).
+!
+XSMACRO UO2-3.3 1
+  8.0248E-03 2.005998E-02 7.21206E-03 5.8791E-01
+  3.7174E-03 2.027303E-03 8.19301E-04 4.1176E-01
+  2.6769E-02 1.570599E-02 6.45320E-03 3.3906E-04
+  9.6236E-02 4.518301E-02 1.85648E-02 1.1761E-07
+  3.0020E-02 4.334208E-02 1.78084E-02 0.0000E+00
+  1.1126E-01 2.020901E-01 8.30348E-02 0.0000E+00
+  2.8278E-01 5.257105E-01 2.16004E-01 0.0000E+00
+  1.27537E-01 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00
+  4.23780E-02 3.24456E-01 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00
+  9.43740E-06 1.63140E-03 4.50940E-01 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00
+  5.51630E-09 3.14270E-09 2.67920E-03 4.52565E-01 1.25250E-04 0.00000E+00 0.00000E+00
+  0.00000E+00 0.00000E+00 0.00000E+00 5.56640E-03 2.71401E-01 1.29680E-03 0.00000E+00
+  0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00 1.02550E-02 2.65802E-01 8.54580E-03
+  0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00 1.00210E-08 1.68090E-02 2.73080E-01
+  2.55074E-02 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00
+  8.47560E-03 6.48912E-02 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00
+  1.88748E-06 3.26280E-04 9.01880E-02 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00
+  1.10326E-09 6.28540E-10 5.35840E-04 9.05130E-02 2.50500E-05 0.00000E+00 0.00000E+00
+  0.00000E+00 0.00000E+00 0.00000E+00 1.11328E-03 5.42802E-02 2.59360E-04 0.00000E+00
+  0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00 2.05100E-03 5.31604E-02 1.70916E-03
+  0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00 2.00420E-09 3.36180E-03 5.46160E-02
@@ -94,6 +94,57 @@ TEST(moc)
     }
 }
 
+// The right-hand sides are swept independently, and the sweep is linear in
+// the source
+TEST(moc_rhs)
+{
+    pugi::xml_document xml_doc;
+    {
+        auto result = xml_doc.load_string(complex_xml.c_str());
+        CHECK(result);
+    }
+
+    CoreMesh mesh(xml_doc);
+
+    pugi::xml_document moc_doc;
+    {
+        std::string moc_xml = "<sweeper type=\"moc\" n_inner=\"3\">"
+                              "    <ang_quad type=\"ls\" order=\"4\"/>"
+                              "    <rays spacing=\"0.05\"/>"
+                              "</sweeper>";
+        auto result = moc_doc.load_string(moc_xml.c_str());
+        CHECK(result);
+    }
+
+    MoCSweeper sweeper(moc_doc.child("sweeper"), mesh);
+    sweeper.initialize();
+
+    CHECK_THROW(sweeper.set_n_rhs(-1), Exception);
+    sweeper.set_n_rhs(3);
+    CHECK_EQUAL(3, sweeper.n_rhs());
+
+    int n_reg = sweeper.n_reg();
+    ArrayB2 source(n_reg, 3);
+    ArrayB2 flux(n_reg, 3);
+    source(blitz::Range::all(), 0) = 1.0;
+    source(blitz::Range::all(), 1) = 2.0;
+    source(blitz::Range::all(), 2) = 0.0;
+    flux = 0.0;
+
+    for (int i = 0; i < 2; i++) {
+        sweeper.sweep_rhs(0, source, flux);
+    }
+
+    for (int i = 0; i < n_reg; i++) {
+        CHECK(flux(i, 0) > 0.0);
+        CHECK_CLOSE(2.0 * flux(i, 0), flux(i, 1), 1.0e-10 * flux(i, 1));
+        CHECK_EQUAL(0.0, flux(i, 2));
+    }
+
+    sweeper.set_n_rhs(0);
+    CHECK_THROW(sweeper.sweep_rhs(0, source, flux), Exception);
+}
+
 int main()
 {
     return UnitTest::RunAllTests();
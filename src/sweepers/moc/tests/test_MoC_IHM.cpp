@@ -16,6 +16,7 @@
 
 #include "UnitTest++/UnitTest++.h"
 
+#include <functional>
 #include <iostream>
 #include <string>
 #include "pugixml.hpp"
@@ -91,19 +92,40 @@ public:
         }
         return;
     }
+
+    const ArrayB2 &flux_x() const
+    {
+        return flux_x_;
+    }
+
+    const ArrayB2 &flux_y() const
+    {
+        return flux_y_;
+    }
+
+    const std::vector<ArrayB2> &flux_pn() const
+    {
+        return flux_pn_;
+    }
 };
 
+// Extra checks to make on the sweeper once all of the groups are swept
+typedef std::function<void(const TestMoCSweeper &, const ArrayB1 &)>
+    IHMCheck;
+
 // This routine generates the reference solution
 void reference_solution(real_t &k_eff, ArrayB1 &flux, ArrayB1 &psi);
 
-TEST(moc_ihm)
+// Sweep each group once with the reference source, and check that the
+// sweeper reproduces the reference flux
+void check_ihm(const std::string &input, IHMCheck extra = nullptr)
 {
-    auto result = xml_doc.load_string(ihm_xml.c_str());
+    auto result = xml_doc.load_string(input.c_str());
     CHECK(result);
     if (!result) {
         std::cout << result.description() << std::endl;
         std::cout << result.offset << std::endl;
-        std::cout << "\"" << ihm_xml.substr(result.offset - 10, 20) << "\""
+        std::cout << "\"" << input.substr(result.offset - 10, 20) << "\""
                   << std::endl;
     }
 
@@ -147,6 +169,133 @@ TEST(moc_ihm)
         }
         std::cout << sweeper.flux()(blitz::Range::all(), ig) << std::endl;
     }
+
+    // The multi-group kernel only updates the flux of a block of groups once
+    // its last group is swept, so check them all again at the end
+    for (int ig = 0; ig < ng; ig++) {
+        for (int ireg = 0; ireg < sweeper.n_reg(); ireg++) {
+            CHECK_CLOSE(flux_ref(ig), sweeper.flux(ig, ireg),
+                        0.005 * flux_ref(ig));
+        }
+    }
+
+    if (extra) {
+        extra(sweeper, flux_ref);
+    }
+}
+
+// Check that a moment of the flux, with the same layout as the flux, is
+// small compared to the reference flux of each group
+void check_vanishes(const ArrayB2 &moment, const ArrayB1 &flux_ref,
+                    real_t tol)
+{
+    REQUIRE CHECK_EQUAL((int)flux_ref.size(), (int)moment.extent(1));
+    for (int ireg = 0; ireg < (int)moment.extent(0); ireg++) {
+        for (int ig = 0; ig < (int)moment.extent(1); ig++) {
+            CHECK_CLOSE(0.0, moment(ireg, ig), tol * flux_ref(ig));
+        }
+    }
+}
+
+// Return the IHM input with extra attributes on the sweeper tag
+std::string ihm_with(const std::string &attributes)
+{
+    std::string input = ihm_xml;
+    std::string from  = "type=\"moc\"";
+    size_t pos        = input.find(from);
+    input.insert(pos + from.size(), " " + attributes);
+    return input;
+}
+
+TEST(moc_ihm)
+{
+    check_ihm(ihm_xml);
+}
+
+// The same, with 3-D characteristics through a stack of planes. The
+// reflective top and bottom exercise the hand-off between the rising and
+// falling lines.
+TEST(moc_ihm_3d)
+{
+    std::string input = ihm_xml;
+    auto replace      = [&](const std::string &from, const std::string &to) {
+        size_t pos = input.find(from);
+        REQUIRE CHECK(pos != std::string::npos);
+        input.replace(pos, from.size(), to);
+    };
+    replace("np=\"1\" hz=\"0.5\"", "np=\"3\" hz=\"0.5\"");
+    replace("<lattices>"
+            "1"
+            "</lattices>",
+            "<lattices>1 1 1</lattices>");
+    replace("type=\"moc\"", "type=\"moc\" kernel=\"3d\" axial_spacing=\"0.1\"");
+
+    check_ihm(input);
+}
+
+// The fast groups with coarser rays and a different quadrature of their own
+TEST(moc_ihm_group_set)
+{
+    std::string input = ihm_xml;
+    std::string from  = "    <rays spacing=\"0.01\" />";
+    size_t pos        = input.find(from);
+    REQUIRE CHECK(pos != std::string::npos);
+    input.insert(pos + from.size(),
+                 "<group_set first_group=\"0\" last_group=\"2\">"
+                 "    <ang_quad type=\"ls\" order=\"4\" />"
+                 "    <rays spacing=\"0.05\" />"
+                 "</group_set>");
+
+    check_ihm(input);
+}
+
+// The multi-group kernel, with all 7 groups in one block. This runs the
+// kernel specialized for blocks of 7 groups.
+TEST(moc_ihm_mg)
+{
+    check_ihm(ihm_with("kernel=\"mg\""));
+}
+
+// Blocks of 3 groups, which don't divide the 7 groups evenly. The blocks of 3
+// and the last block of 1 run the generic kernel.
+TEST(moc_ihm_mg_block)
+{
+    check_ihm(ihm_with("kernel=\"mg\" group_block=\"3\""));
+}
+
+// The linear source on a flat problem. It should reproduce the flat
+// reference flux, and the spatial moments of the flux should vanish.
+TEST(moc_ihm_linear)
+{
+    check_ihm(ihm_with("source_shape=\"linear\""),
+              [](const TestMoCSweeper &sweeper, const ArrayB1 &flux_ref) {
+                  check_vanishes(sweeper.flux_x(), flux_ref, 1.0e-3);
+                  check_vanishes(sweeper.flux_y(), flux_ref, 1.0e-3);
+              });
+}
+
+// P1 scattering, with a library that adds a P1 table to the same P0 data.
+// The angular flux of an infinite medium is isotropic, so the scalar flux
+// should match the P0 reference, and the P1 moments of the flux should
+// vanish.
+TEST(moc_ihm_p1)
+{
+    std::string input = ihm_with("scattering_order=\"1\"");
+    auto replace      = [&](const std::string &from, const std::string &to) {
+        size_t pos = input.find(from);
+        REQUIRE CHECK(pos != std::string::npos);
+        input.replace(pos, from.size(), to);
+    };
+    replace("c5g7.xsl", "c5g7_p1.xsl");
+    replace("scattering=\"P0\"", "scattering=\"pn\"");
+
+    check_ihm(input,
+              [](const TestMoCSweeper &sweeper, const ArrayB1 &flux_ref) {
+                  REQUIRE CHECK(!sweeper.flux_pn().empty());
+                  for (const auto &moment : sweeper.flux_pn()) {
+                      check_vanishes(moment, flux_ref, 0.005);
+                  }
+              });
 }
 
 void reference_solution(real_t &k_eff, ArrayB1 &flux, ArrayB1 &psi)
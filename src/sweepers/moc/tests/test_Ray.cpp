@@ -89,6 +89,26 @@ TEST(simple_ray)
                 CHECK_EQUAL(rcd.nseg_fw, nseg[i]);
                 CHECK_EQUAL(rcd.nseg_bw, nseg[i]);
             }
+
+            // The crossing lists should start at the entry surfaces, and pick
+            // up one surface for each coarse ray datum
+            const auto &cross_fw = ray.crossings_fw();
+            const auto &cross_bw = ray.crossings_bw();
+            REQUIRE CHECK_EQUAL(9, cross_fw.size());
+            REQUIRE CHECK_EQUAL(9, cross_bw.size());
+            CHECK_EQUAL(37, cross_fw[0].surf);
+            CHECK_EQUAL(88, cross_bw[0].surf);
+            VecI iseg_fw = {0, 3, 3, 6, 6, 9, 9, 12, 12};
+            for (int i = 0; i < 9; i++) {
+                CHECK_EQUAL(iseg_fw[i], cross_fw[i].iseg);
+                CHECK_EQUAL(12 - iseg_fw[i], cross_bw[i].iseg);
+            }
+            for (int i = 0; i < ray.ncseg(); i++) {
+                CHECK_EQUAL((int)surface_to_normal(fw_surf[i]),
+                            (int)cross_fw[i + 1].norm);
+                CHECK_EQUAL((int)surface_to_normal(bw_surf[i]),
+                            (int)cross_bw[i + 1].norm);
+            }
         }
 
         {
@@ -117,6 +137,46 @@ TEST(simple_ray)
     }
 }
 
+// Merging the regions of each pin should leave one segment per pin crossing,
+// with the coarse ray data following along
+TEST(merge_segments)
+{
+    pugi::xml_document geom_xml;
+    pugi::xml_parse_result result = geom_xml.load_file("6x5.xml");
+
+    REQUIRE CHECK(result);
+
+    mocc::CoreMesh mesh(geom_xml);
+
+    // Every pin has 9 regions
+    VecI merged(mesh.unique_plane(0).n_reg());
+    for (int ireg = 0; ireg < (int)merged.size(); ireg++) {
+        merged[ireg] = ireg - ireg % 9;
+    }
+
+    Ray ray(Point2(0.0, 1.0), Point2(4.0, 5.0), {{0, 0}}, 0, mesh);
+    VecI seg_index = ray.seg_index();
+    ray.merge_segments(merged);
+
+    REQUIRE CHECK_EQUAL(4, ray.nseg());
+    for (int iseg = 0; iseg < 4; iseg++) {
+        CHECK_CLOSE(sqrt(2), ray.seg_len(iseg), 0.00001);
+        CHECK_EQUAL(merged[seg_index[iseg * 3]], (int)ray.seg_index(iseg));
+    }
+
+    VecI nseg = {1, 0, 1, 0, 1, 0, 1, 0};
+    for (int i = 0; i < ray.ncseg(); i++) {
+        CHECK_EQUAL(nseg[i], ray.cm_data()[i].nseg_fw);
+        CHECK_EQUAL(nseg[i], ray.cm_data()[i].nseg_bw);
+    }
+
+    VecI iseg_fw = {0, 1, 1, 2, 2, 3, 3, 4, 4};
+    for (int i = 0; i < 9; i++) {
+        CHECK_EQUAL(iseg_fw[i], ray.crossings_fw()[i].iseg);
+        CHECK_EQUAL(4 - iseg_fw[i], ray.crossings_bw()[i].iseg);
+    }
+}
+
 TEST(nasty_ray)
 {
 
@@ -16,15 +16,23 @@
 
 #include "UnitTest++/UnitTest++.h"
 
+#include <array>
 #include <cassert>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
 #include <string>
+#include <vector>
 #include "pugixml.hpp"
+#include "util/error.hpp"
 #include "util/global_config.hpp"
 #include "angular_quadrature.hpp"
 #include "constants.hpp"
 #include "core_mesh.hpp"
+#include "cyclic_tracks.hpp"
+#include "linear_source_geometry.hpp"
 #include "ray_data.hpp"
+#include "sweep_schedule.hpp"
 
 using namespace mocc;
 
@@ -73,6 +81,715 @@ TEST(raydata)
     }
 }
 
+// With a huge threshold every region is thin, so the rays are merged in
+// blocks. The weighted rays should still reproduce the region volumes, and
+// every boundary condition should be written by exactly one ray.
+TEST(raydata_adaptive)
+{
+    pugi::xml_document geom_xml;
+    pugi::xml_parse_result result = geom_xml.load_file("square.xml");
+
+    CoreMesh mesh(geom_xml);
+
+    pugi::xml_document angquad_xml;
+    result = angquad_xml.load_string("<ang_quad type=\"ls\" order=\"4\" />");
+
+    CHECK(result);
+
+    AngularQuadrature ang_quad(angquad_xml.child("ang_quad"));
+
+    pugi::xml_document ray_xml;
+    ray_xml.load_string("<rays spacing=\"0.01\" adaptive_factor=\"3\" "
+                        "adaptive_tau=\"1.0e10\" />");
+
+    moc::RayData ray_data(ray_xml.child("rays"), ang_quad, mesh);
+    CHECK(ray_data.adaptive());
+
+    for (auto &plane_rays : ray_data) {
+        int iang = 0;
+        VecF vol(mesh.n_reg(MeshTreatment::PLANE), 0.0);
+        for (auto &angle_rays : plane_rays) {
+            int n_rays = ray_data.n_rays(iang);
+            CHECK((int)angle_rays.size() < n_rays);
+
+            VecI n_in(n_rays, 0);
+            VecI n_out(n_rays, 0);
+            real_t wsum   = 0.0;
+            real_t wt_ang = ray_data.spacing(iang) * ang_quad[iang].weight *
+                            2.0 * PI;
+            for (auto &ray : angle_rays) {
+                n_in[ray.bc(0)]++;
+                n_out[ray.bc(1)]++;
+                for (const auto &shadow : ray.shadow_bc()) {
+                    n_in[shadow[0]]++;
+                    n_out[shadow[1]]++;
+                }
+                wsum += ray.weight();
+                for (int iseg = 0; iseg < ray.nseg(); iseg++) {
+                    int ireg = ray.seg_index(iseg);
+                    vol[ireg] += ray.seg_len(iseg) * wt_ang * ray.weight();
+                }
+            }
+            CHECK_CLOSE((real_t)n_rays, wsum, 1.0e-12);
+            for (int ibc = 0; ibc < n_rays; ibc++) {
+                CHECK_EQUAL(1, n_in[ibc]);
+                CHECK_EQUAL(1, n_out[ibc]);
+            }
+
+            iang++;
+        }
+        for (auto &v : vol) {
+            CHECK_CLOSE(0.1764 * 4.0 * PI, v, 1.0e-12);
+        }
+    }
+
+    // Invalid input
+    ray_xml.load_string("<rays spacing=\"0.01\" adaptive_factor=\"0\" />");
+    CHECK_THROW(moc::RayData(ray_xml.child("rays"), ang_quad, mesh),
+                Exception);
+}
+
+TEST(raydata_packed)
+{
+    pugi::xml_document geom_xml;
+    pugi::xml_parse_result result = geom_xml.load_file("square.xml");
+
+    CoreMesh mesh(geom_xml);
+
+    pugi::xml_document angquad_xml;
+    result = angquad_xml.load_string("<ang_quad type=\"ls\" order=\"4\" />");
+
+    CHECK(result);
+
+    AngularQuadrature ang_quad(angquad_xml.child("ang_quad"));
+
+    pugi::xml_document ray_xml;
+    ray_xml.load_string("<rays spacing=\"0.01\" />");
+
+    moc::RayData ray_data(ray_xml.child("rays"), ang_quad, mesh);
+
+    int iplane = 0;
+    for (auto &plane_rays : ray_data) {
+        const auto &plane_packed = ray_data.packed(iplane);
+        CHECK_EQUAL(plane_rays.size(), plane_packed.size());
+        int iang = 0;
+        for (auto &angle_rays : plane_rays) {
+            const auto &packed = plane_packed[iang];
+            CHECK(!packed.wide_index());
+            CHECK_EQUAL((int)angle_rays.size(), packed.n_rays());
+            for (int iray = 0; iray < packed.n_rays(); iray++) {
+                const auto &ray = angle_rays[iray];
+                CHECK_EQUAL(ray.nseg(), packed.nseg(iray));
+                for (int iseg = 0; iseg < ray.nseg(); iseg++) {
+                    CHECK_EQUAL((int)ray.seg_index(iseg),
+                                (int)packed.seg_index_16(iray)[iseg]);
+                    CHECK_CLOSE(ray.seg_len(iseg), packed.seg_len(iray)[iseg],
+                                1.0e-6);
+                }
+            }
+            iang++;
+        }
+        iplane++;
+    }
+}
+
+TEST(raydata_renumbered)
+{
+    pugi::xml_document geom_xml;
+    pugi::xml_parse_result result = geom_xml.load_file("square.xml");
+
+    CoreMesh mesh(geom_xml);
+
+    pugi::xml_document angquad_xml;
+    result = angquad_xml.load_string("<ang_quad type=\"ls\" order=\"4\" />");
+
+    CHECK(result);
+
+    AngularQuadrature ang_quad(angquad_xml.child("ang_quad"));
+
+    pugi::xml_document ray_xml;
+    ray_xml.load_string("<rays spacing=\"0.01\" region_order=\"visit\" />");
+
+    moc::RayData ray_data(ray_xml.child("rays"), ang_quad, mesh);
+    CHECK(ray_data.renumbered());
+
+    int iplane = 0;
+    for (auto &plane_rays : ray_data) {
+        // The new indices should be a permutation of the regions, starting
+        // with those crossed by the first ray
+        const VecI &index = ray_data.region_index(iplane);
+        int n_reg         = mesh.unique_plane(iplane).n_reg();
+        CHECK_EQUAL(n_reg, (int)index.size());
+        std::vector<int> count(n_reg, 0);
+        for (int i : index) {
+            CHECK((i >= 0) && (i < n_reg));
+            count[i]++;
+        }
+        for (int c : count) {
+            CHECK_EQUAL(1, c);
+        }
+        CHECK_EQUAL(0, index[plane_rays[0][0].seg_index(0)]);
+
+        // The packed segments use the new indices, while the rays keep the
+        // mesh indices
+        const auto &plane_packed = ray_data.packed(iplane);
+        int iang = 0;
+        for (auto &angle_rays : plane_rays) {
+            const auto &packed = plane_packed[iang];
+            for (int iray = 0; iray < packed.n_rays(); iray++) {
+                const auto &ray = angle_rays[iray];
+                for (int iseg = 0; iseg < ray.nseg(); iseg++) {
+                    CHECK_EQUAL(index[ray.seg_index(iseg)],
+                                (int)packed.seg_index_16(iray)[iseg]);
+                }
+            }
+            iang++;
+        }
+        iplane++;
+    }
+
+    // Modular storage relies on the mesh region order
+    ray_xml.load_string("<rays spacing=\"0.01\" region_order=\"visit\" "
+                        "storage=\"modular\" />");
+    CHECK_THROW(moc::RayData(ray_xml.child("rays"), ang_quad, mesh),
+                Exception);
+}
+
+TEST(raydata_modular)
+{
+    pugi::xml_document geom_xml;
+    pugi::xml_parse_result result = geom_xml.load_file("square.xml");
+
+    CoreMesh mesh(geom_xml);
+
+    pugi::xml_document angquad_xml;
+    result = angquad_xml.load_string("<ang_quad type=\"ls\" order=\"4\" />");
+
+    CHECK(result);
+
+    AngularQuadrature ang_quad(angquad_xml.child("ang_quad"));
+
+    pugi::xml_document ray_xml;
+    ray_xml.load_string(
+        "<rays spacing=\"0.01\" modularity=\"pin\" storage=\"modular\" />");
+
+    moc::RayData ray_data(ray_xml.child("rays"), ang_quad, mesh);
+    CHECK(ray_data.modular_storage());
+
+    std::vector<float> len(ray_data.max_segments());
+    std::vector<uint32_t> idx(ray_data.max_segments());
+    int iplane = 0;
+    for (auto &plane_rays : ray_data) {
+        int iang = 0;
+        for (auto &angle_rays : plane_rays) {
+            const auto &packed = ray_data.packed(iplane)[iang];
+            CHECK(packed.modular());
+            CHECK_EQUAL((int)angle_rays.size(), packed.n_rays());
+            int n_seg = 0;
+            for (int iray = 0; iray < packed.n_rays(); iray++) {
+                const auto &ray = angle_rays[iray];
+                REQUIRE CHECK_EQUAL(ray.nseg(), packed.nseg(iray));
+                packed.expand(iray, len.data(), idx.data());
+                for (int iseg = 0; iseg < ray.nseg(); iseg++) {
+                    CHECK_EQUAL((int)ray.seg_index(iseg), (int)idx[iseg]);
+                    CHECK_CLOSE(ray.seg_len(iseg), len[iseg], 1.0e-6);
+                }
+                n_seg += ray.nseg();
+            }
+            // Pin-modular rays cross each pin the same way, so there should
+            // be far fewer unique crossings than segments
+            CHECK(packed.n_chunks() < n_seg);
+            iang++;
+        }
+        iplane++;
+    }
+}
+
+TEST(raydata_compact)
+{
+    pugi::xml_document geom_xml;
+    pugi::xml_parse_result result = geom_xml.load_file("square.xml");
+
+    CoreMesh mesh(geom_xml);
+
+    pugi::xml_document angquad_xml;
+    result = angquad_xml.load_string("<ang_quad type=\"ls\" order=\"4\" />");
+
+    CHECK(result);
+
+    AngularQuadrature ang_quad(angquad_xml.child("ang_quad"));
+
+    pugi::xml_document ray_xml;
+    ray_xml.load_string("<rays spacing=\"0.01\" />");
+    moc::RayData packed_data(ray_xml.child("rays"), ang_quad, mesh);
+
+    ray_xml.load_string("<rays spacing=\"0.01\" storage=\"compact\" />");
+    moc::RayData exact(ray_xml.child("rays"), ang_quad, mesh);
+    CHECK(exact.compact_storage());
+    CHECK(exact.expanded());
+
+    // Quantize the lengths
+    const real_t tol = 1.0e-4;
+    ray_xml.load_string("<rays spacing=\"0.01\" storage=\"compact\" "
+                        "segment_tolerance=\"1.0e-4\" />");
+    moc::RayData quantized(ray_xml.child("rays"), ang_quad, mesh);
+
+    std::vector<float> len(exact.max_segments());
+    std::vector<uint32_t> idx(exact.max_segments());
+    size_t mem_packed = 0;
+    size_t mem_exact  = 0;
+    size_t mem_quant  = 0;
+    for (unsigned iplane = 0; iplane < mesh.n_unique_planes(); iplane++) {
+        for (unsigned iang = 0; iang < exact[iplane].size(); iang++) {
+            const auto &packed  = packed_data.packed(iplane)[iang];
+            const auto &p_exact = exact.packed(iplane)[iang];
+            const auto &p_quant = quantized.packed(iplane)[iang];
+            CHECK(p_exact.compact());
+            CHECK_EQUAL(0.0, p_exact.length_error());
+            CHECK(p_quant.length_error() <= tol);
+            mem_packed += packed.memory();
+            mem_exact += p_exact.memory();
+            mem_quant += p_quant.memory();
+            for (int iray = 0; iray < packed.n_rays(); iray++) {
+                REQUIRE CHECK_EQUAL(packed.nseg(iray), p_exact.nseg(iray));
+                p_exact.expand(iray, len.data(), idx.data());
+                for (int iseg = 0; iseg < packed.nseg(iray); iseg++) {
+                    CHECK_EQUAL((int)packed.seg_index_16(iray)[iseg],
+                                (int)idx[iseg]);
+                    CHECK_EQUAL(packed.seg_len(iray)[iseg], len[iseg]);
+                }
+                p_quant.expand(iray, len.data(), idx.data());
+                for (int iseg = 0; iseg < packed.nseg(iray); iseg++) {
+                    CHECK_EQUAL((int)packed.seg_index_16(iray)[iseg],
+                                (int)idx[iseg]);
+                    CHECK_CLOSE(packed.seg_len(iray)[iseg], len[iseg],
+                                tol + 1.0e-6);
+                }
+            }
+        }
+    }
+    CHECK(mem_exact < mem_packed);
+    CHECK(mem_quant < mem_exact);
+}
+
+TEST(raydata_on_the_fly)
+{
+    pugi::xml_document geom_xml;
+    pugi::xml_parse_result result = geom_xml.load_file("square.xml");
+
+    CoreMesh mesh(geom_xml);
+
+    pugi::xml_document angquad_xml;
+    result = angquad_xml.load_string("<ang_quad type=\"ls\" order=\"4\" />");
+
+    CHECK(result);
+
+    AngularQuadrature ang_quad(angquad_xml.child("ang_quad"));
+
+    pugi::xml_document ray_xml;
+    ray_xml.load_string("<rays spacing=\"0.01\" />");
+    moc::RayData stored(ray_xml.child("rays"), ang_quad, mesh);
+
+    // Use a tiny pin crossing cache, so that it gets cleared along the way
+    ray_xml.load_string(
+        "<rays spacing=\"0.01\" storage=\"on_the_fly\" trace_cache=\"8\" />");
+    moc::RayData traced(ray_xml.child("rays"), ang_quad, mesh);
+    CHECK(traced.on_the_fly());
+    CHECK(traced.expanded());
+    CHECK(traced.memory() < stored.memory());
+
+    moc::RayData::TraceScratch scratch;
+    std::vector<float> len(traced.max_segments());
+    std::vector<uint32_t> idx(traced.max_segments());
+    for (unsigned iplane = 0; iplane < mesh.n_unique_planes(); iplane++) {
+        for (unsigned iang = 0; iang < stored[iplane].size(); iang++) {
+            const auto &packed = stored.packed(iplane)[iang];
+            for (int iray = 0; iray < packed.n_rays(); iray++) {
+                const auto &ray = traced[iplane][iang][iray];
+                REQUIRE CHECK_EQUAL(packed.nseg(iray), ray.nseg());
+                CHECK(ray.seg_len().empty());
+                traced.expand(iplane, iang, iray, scratch, len.data(),
+                              idx.data());
+                for (int iseg = 0; iseg < ray.nseg(); iseg++) {
+                    CHECK_EQUAL((int)packed.seg_index_16(iray)[iseg],
+                                (int)idx[iseg]);
+                    CHECK_CLOSE(packed.seg_len(iray)[iseg], len[iseg],
+                                1.0e-6);
+                }
+            }
+        }
+    }
+}
+
+TEST(raydata_file)
+{
+    pugi::xml_document geom_xml;
+    pugi::xml_parse_result result = geom_xml.load_file("square.xml");
+
+    CoreMesh mesh(geom_xml);
+
+    pugi::xml_document angquad_xml;
+    result = angquad_xml.load_string("<ang_quad type=\"ls\" order=\"4\" />");
+
+    CHECK(result);
+
+    AngularQuadrature ang_quad(angquad_xml.child("ang_quad"));
+
+    std::remove("test_RayData.rays");
+    pugi::xml_document ray_xml;
+    ray_xml.load_string("<rays spacing=\"0.01\" file=\"test_RayData.rays\" />");
+
+    // The first one traces and writes the file, the second reads it
+    moc::RayData traced(ray_xml.child("rays"), ang_quad, mesh);
+    moc::RayData loaded(ray_xml.child("rays"), ang_quad, mesh);
+
+    CHECK_EQUAL(traced.max_segments(), loaded.max_segments());
+    for (size_t iplane = 0; iplane < mesh.n_unique_planes(); iplane++) {
+        for (size_t iang = 0; iang < traced[iplane].size(); iang++) {
+            const auto &rays_t = traced[iplane][iang];
+            const auto &rays_l = loaded[iplane][iang];
+            REQUIRE CHECK_EQUAL(rays_t.size(), rays_l.size());
+            for (size_t iray = 0; iray < rays_t.size(); iray++) {
+                CHECK_EQUAL(rays_t[iray].bc(0), rays_l[iray].bc(0));
+                CHECK_EQUAL(rays_t[iray].bc(1), rays_l[iray].bc(1));
+                CHECK_EQUAL(rays_t[iray].cm_cell_fw(),
+                            rays_l[iray].cm_cell_fw());
+                CHECK_EQUAL(rays_t[iray].ncseg(), rays_l[iray].ncseg());
+                CHECK(rays_t[iray].seg_len() == rays_l[iray].seg_len());
+                CHECK(rays_t[iray].seg_index() == rays_l[iray].seg_index());
+            }
+        }
+    }
+    std::remove("test_RayData.rays");
+}
+
+// Two-plane geometry, where the upper plane has one of a few lattices
+std::string two_plane_xml(int upper)
+{
+    return "<mesh id=\"1\" type=\"rect\" pitch=\"1.26\">"
+           "    <sub_x>3</sub_x> <sub_y>3</sub_y> </mesh>"
+           "<mesh id=\"2\" type=\"rect\" pitch=\"1.26\">"
+           "    <sub_x>2</sub_x> <sub_y>2</sub_y> </mesh>"
+           "<pin id=\"1\" mesh=\"1\"> 1 1 1 1 1 1 1 1 1 </pin>"
+           "<pin id=\"2\" mesh=\"2\"> 1 1 1 1 </pin>"
+           "<lattice id=\"1\" nx=\"3\" ny=\"3\"> 1 1 1 1 1 1 1 1 1 </lattice>"
+           "<lattice id=\"2\" nx=\"3\" ny=\"3\"> 2 1 1 1 1 1 1 1 1 </lattice>"
+           "<lattice id=\"3\" nx=\"3\" ny=\"3\"> 1 1 1 1 2 1 1 1 1 </lattice>"
+           "<assembly id=\"1\" np=\"2\" hz=\"0.5\">"
+           "    <lattices> 1 " +
+           std::to_string(upper) +
+           " </lattices> </assembly>"
+           "<core nx=\"1\" ny=\"1\" north=\"reflect\" south=\"reflect\""
+           "    east=\"reflect\" west=\"reflect\" top=\"vacuum\""
+           "    bottom=\"vacuum\"> 1 </core>"
+           "<material_lib path=\"c5g7.xsl\">"
+           "    <material id=\"1\" name=\"UO2-3.3\" /> </material_lib>";
+}
+
+void check_same_rays(const moc::RayData &a, const moc::RayData &b, int iplane)
+{
+    REQUIRE CHECK_EQUAL(a[iplane].size(), b[iplane].size());
+    for (size_t iang = 0; iang < a[iplane].size(); iang++) {
+        const auto &rays_a = a[iplane][iang];
+        const auto &rays_b = b[iplane][iang];
+        REQUIRE CHECK_EQUAL(rays_a.size(), rays_b.size());
+        for (size_t iray = 0; iray < rays_a.size(); iray++) {
+            CHECK(rays_a[iray].seg_len() == rays_b[iray].seg_len());
+            CHECK(rays_a[iray].seg_index() == rays_b[iray].seg_index());
+        }
+    }
+}
+
+// Changing the geometry of one plane should only re-trace that plane, from
+// either the ray file or the ray cache, and give the same rays as tracing
+// from scratch
+TEST(raydata_retrace)
+{
+    pugi::xml_document base_xml;
+    pugi::xml_document moved_xml;
+    REQUIRE CHECK(base_xml.load_string(two_plane_xml(2).c_str()));
+    REQUIRE CHECK(moved_xml.load_string(two_plane_xml(3).c_str()));
+    CoreMesh base_mesh(base_xml);
+    CoreMesh moved_mesh(moved_xml);
+    REQUIRE CHECK_EQUAL(2, moved_mesh.n_unique_planes());
+
+    pugi::xml_document angquad_xml;
+    angquad_xml.load_string("<ang_quad type=\"ls\" order=\"4\" />");
+    AngularQuadrature ang_quad(angquad_xml.child("ang_quad"));
+
+    pugi::xml_document ray_xml;
+    ray_xml.load_string("<rays spacing=\"0.05\" />");
+    moc::RayData reference(ray_xml.child("rays"), ang_quad, moved_mesh);
+    CHECK_EQUAL(2, reference.n_traced_planes());
+
+    std::remove("test_RayData_retrace.rays");
+    pugi::xml_document file_xml;
+    file_xml.load_string(
+        "<rays spacing=\"0.05\" file=\"test_RayData_retrace.rays\" />");
+    {
+        moc::RayData base(file_xml.child("rays"), ang_quad, base_mesh);
+        CHECK_EQUAL(2, base.n_traced_planes());
+        moc::RayData moved(file_xml.child("rays"), ang_quad, moved_mesh);
+        CHECK_EQUAL(1, moved.n_traced_planes());
+        CHECK_EQUAL(reference.max_segments(), moved.max_segments());
+        check_same_rays(reference, moved, 0);
+        check_same_rays(reference, moved, 1);
+    }
+    std::remove("test_RayData_retrace.rays");
+
+    moc::RayData::enable_cache(true);
+    {
+        moc::RayData base(ray_xml.child("rays"), ang_quad, base_mesh);
+        moc::RayData moved(ray_xml.child("rays"), ang_quad, moved_mesh);
+        CHECK_EQUAL(1, moved.n_traced_planes());
+        check_same_rays(reference, moved, 0);
+        check_same_rays(reference, moved, 1);
+        moc::RayData again(ray_xml.child("rays"), ang_quad, base_mesh);
+        CHECK_EQUAL(0, again.n_traced_planes());
+        check_same_rays(base, again, 1);
+    }
+    moc::RayData::enable_cache(false);
+}
+
+TEST(raydata_out_of_core)
+{
+    pugi::xml_document geom_xml;
+    pugi::xml_parse_result result = geom_xml.load_file("square.xml");
+
+    CoreMesh mesh(geom_xml);
+
+    pugi::xml_document angquad_xml;
+    result = angquad_xml.load_string("<ang_quad type=\"ls\" order=\"4\" />");
+
+    CHECK(result);
+
+    AngularQuadrature ang_quad(angquad_xml.child("ang_quad"));
+
+    pugi::xml_document ray_xml;
+    ray_xml.load_string(
+        "<rays spacing=\"0.01\" out_of_core=\"test_RayData.segments\" />");
+
+    {
+        moc::RayData ray_data(ray_xml.child("rays"), ang_quad, mesh);
+        CHECK(ray_data.out_of_core());
+        CHECK(std::ifstream("test_RayData.segments").good());
+
+        for (size_t iplane = 0; iplane < mesh.n_unique_planes(); iplane++) {
+            // The ray offsets stay in memory
+            CHECK(!ray_data.packed(iplane)[0].resident());
+            CHECK_EQUAL((int)ray_data[iplane][0].size(),
+                        ray_data.packed(iplane)[0].n_rays());
+
+            ray_data.stream(iplane, -1);
+            for (size_t iang = 0; iang < ray_data[iplane].size(); iang++) {
+                const auto &rays   = ray_data[iplane][iang];
+                const auto &packed = ray_data.packed(iplane)[iang];
+                REQUIRE CHECK(packed.resident());
+                for (int iray = 0; iray < packed.n_rays(); iray++) {
+                    const auto &ray = rays[iray];
+                    REQUIRE CHECK_EQUAL(ray.nseg(), packed.nseg(iray));
+                    for (int iseg = 0; iseg < ray.nseg(); iseg++) {
+                        int idx = packed.wide_index()
+                                      ? packed.seg_index_32(iray)[iseg]
+                                      : packed.seg_index_16(iray)[iseg];
+                        CHECK_EQUAL((int)ray.seg_index(iseg), idx);
+                        CHECK_EQUAL((float)ray.seg_len(iseg),
+                                    packed.seg_len(iray)[iseg]);
+                    }
+                }
+            }
+        }
+        CHECK_EQUAL((int)mesh.n_unique_planes(), ray_data.n_stream_stall());
+    }
+
+    // The segment file goes away with the rays
+    CHECK(!std::ifstream("test_RayData.segments").good());
+}
+
+TEST(sweep_schedule)
+{
+    pugi::xml_document geom_xml;
+    pugi::xml_parse_result result = geom_xml.load_file("square.xml");
+
+    CoreMesh mesh(geom_xml);
+
+    pugi::xml_document angquad_xml;
+    result = angquad_xml.load_string("<ang_quad type=\"ls\" order=\"4\" />");
+
+    CHECK(result);
+
+    AngularQuadrature ang_quad(angquad_xml.child("ang_quad"));
+
+    pugi::xml_document ray_xml;
+    ray_xml.load_string("<rays spacing=\"0.01\" />");
+
+    moc::RayData ray_data(ray_xml.child("rays"), ang_quad, mesh);
+
+    moc::SweepSchedule schedule(ray_data, 4);
+
+    // Every ray should show up in exactly one work unit, and the units should
+    // be ordered longest-first
+    int iplane = 0;
+    for (auto &plane_rays : ray_data) {
+        int n_rays_total = 0;
+        int n_prev       = schedule.plane_units(iplane).front().n_seg;
+        for (const auto &unit : schedule.plane_units(iplane)) {
+            CHECK(unit.n_seg <= n_prev);
+            n_prev = unit.n_seg;
+            n_rays_total += unit.last_ray - unit.first_ray;
+        }
+
+        int iang = 0;
+        for (auto &angle_rays : plane_rays) {
+            std::vector<int> count(angle_rays.size(), 0);
+            for (const auto &unit : schedule.angle_units(iplane, iang)) {
+                CHECK_EQUAL(iang, unit.iang);
+                int n_seg = 0;
+                for (int iray = unit.first_ray; iray < unit.last_ray; iray++) {
+                    count[iray]++;
+                    n_seg += angle_rays[iray].nseg();
+                }
+                CHECK_EQUAL(n_seg, unit.n_seg);
+            }
+            for (auto c : count) {
+                CHECK_EQUAL(1, c);
+            }
+            n_rays_total -= angle_rays.size();
+            iang++;
+        }
+        CHECK_EQUAL(0, n_rays_total);
+        iplane++;
+    }
+}
+
+TEST(cyclic_tracks)
+{
+    pugi::xml_document geom_xml;
+    pugi::xml_parse_result result = geom_xml.load_file("square.xml");
+
+    CoreMesh mesh(geom_xml);
+
+    pugi::xml_document angquad_xml;
+    result = angquad_xml.load_string("<ang_quad type=\"ls\" order=\"4\" />");
+
+    CHECK(result);
+
+    AngularQuadrature ang_quad(angquad_xml.child("ang_quad"));
+
+    pugi::xml_document ray_xml;
+    ray_xml.load_string("<rays spacing=\"0.01\" />");
+
+    moc::RayData ray_data(ray_xml.child("rays"), ang_quad, mesh);
+
+    // All of the radial boundaries are reflective, so every track should
+    // close on itself, and every ray should be swept once in each direction
+    {
+        moc::CyclicTracks tracks(ray_data, mesh.boundary());
+        int iplane = 0;
+        for (auto &plane_rays : ray_data) {
+            CHECK_EQUAL(tracks.n_tracks(iplane), tracks.n_cyclic(iplane));
+
+            std::vector<std::vector<int>> count;
+            for (auto &angle_rays : plane_rays) {
+                count.push_back(std::vector<int>(2 * angle_rays.size(), 0));
+            }
+            int n_prev = tracks.n_seg(iplane, 0);
+            for (int it = 0; it < tracks.n_tracks(iplane); it++) {
+                CHECK(tracks.n_seg(iplane, it) <= n_prev);
+                n_prev = tracks.n_seg(iplane, it);
+
+                const moc::TrackLink *links = tracks.links(iplane, it);
+                for (int il = 0; il < tracks.n_links(iplane, it); il++) {
+                    const auto &link = links[il];
+                    count[link.iang][2 * link.iray + (link.forward ? 0 : 1)]++;
+                }
+            }
+            for (const auto &ang_count : count) {
+                for (auto c : ang_count) {
+                    CHECK_EQUAL(1, c);
+                }
+            }
+            iplane++;
+        }
+    }
+
+    // With vacuum boundaries, no rays are linked
+    {
+        std::array<Boundary, 6> bc;
+        bc.fill(Boundary::VACUUM);
+        moc::CyclicTracks tracks(ray_data, bc);
+        int iplane = 0;
+        for (auto &plane_rays : ray_data) {
+            int n_rays = 0;
+            for (auto &angle_rays : plane_rays) {
+                n_rays += angle_rays.size();
+            }
+            CHECK_EQUAL(0, tracks.n_cyclic(iplane));
+            CHECK_EQUAL(2 * n_rays, tracks.n_tracks(iplane));
+            iplane++;
+        }
+    }
+}
+
+TEST(linear_source_geometry)
+{
+    pugi::xml_document geom_xml;
+    pugi::xml_parse_result result = geom_xml.load_file("square.xml");
+
+    CoreMesh mesh(geom_xml);
+
+    pugi::xml_document angquad_xml;
+    result = angquad_xml.load_string("<ang_quad type=\"ls\" order=\"4\" />");
+
+    CHECK(result);
+
+    AngularQuadrature ang_quad(angquad_xml.child("ang_quad"));
+
+    pugi::xml_document ray_xml;
+    ray_xml.load_string("<rays spacing=\"0.01\" />");
+
+    moc::RayData ray_data(ray_xml.child("rays"), ang_quad, mesh);
+
+    moc::LinearSourceGeometry geometry(ray_data, mesh);
+
+    int iplane = 0;
+    for (auto &plane_rays : ray_data) {
+        // Every region is a 0.42 cm square, so the moment matrix should be
+        // diagonal, with h^2/12 on the diagonal
+        const auto &inv = geometry.inverse_moments(iplane);
+        for (int ireg = 0; ireg < (int)inv.size() / 3; ireg++) {
+            CHECK_CLOSE(12.0 / 0.1764, inv[3 * ireg + 0], 0.5);
+            CHECK_CLOSE(0.0, inv[3 * ireg + 1], 0.5);
+            CHECK_CLOSE(12.0 / 0.1764, inv[3 * ireg + 2], 0.5);
+        }
+
+        // The segment offsets should average to zero in each region
+        VecF sum_x(inv.size() / 3, 0.0);
+        VecF sum_y(inv.size() / 3, 0.0);
+        int iang = 0;
+        for (auto &angle_rays : plane_rays) {
+            real_t wt = ang_quad[iang].weight * ray_data.spacing(iang);
+            int iray  = 0;
+            for (auto &ray : angle_rays) {
+                const float *offset = geometry.offsets(iplane, iang, iray);
+                for (int iseg = 0; iseg < ray.nseg(); iseg++) {
+                    int ireg = ray.seg_index(iseg);
+                    sum_x[ireg] += wt * ray.seg_len(iseg) * offset[2 * iseg];
+                    sum_y[ireg] +=
+                        wt * ray.seg_len(iseg) * offset[2 * iseg + 1];
+                }
+                iray++;
+            }
+            iang++;
+        }
+        for (int ireg = 0; ireg < (int)sum_x.size(); ireg++) {
+            CHECK_CLOSE(0.0, sum_x[ireg], 1.0e-6);
+            CHECK_CLOSE(0.0, sum_y[ireg], 1.0e-6);
+        }
+        iplane++;
+    }
+}
+
 TEST(raydata_performance) {
     pugi::xml_document geom_xml;
     pugi::xml_parse_result result = geom_xml.load_file("c5g7_2d.xml");
@@ -0,0 +1,297 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "device_sn_sweep.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include "util/memory.hpp"
+
+namespace mocc {
+namespace sn {
+DeviceSnSweep::DeviceSnSweep(int nx, int ny, int nz, bool is_2d,
+                             const AngularQuadrature &ang_quad,
+                             const VecF &rdx, const VecF &rdy, const VecF &rdz,
+                             const VecI &macroplanes)
+    : nx_(nx),
+      ny_(ny),
+      nz_(is_2d ? 1 : nz),
+      n_(nx_ * ny_ * nz_),
+      is_2d_(is_2d),
+      n_ang_(is_2d ? ang_quad.ndir() / 2 : ang_quad.ndir()),
+      n_ang_2d_(ang_quad.ndir() / 2),
+      nfx_(ny_ * nz_),
+      nfy_(nx_ * nz_),
+      nfz_(is_2d ? 0 : nx_ * ny_),
+      rdx_(rdx),
+      rdy_(rdy),
+      rdz_(rdz.begin(), rdz.begin() + nz_),
+      macroplane_(nz_, 0),
+      oct_start_(9, 0),
+      hp_start_(1, 0),
+      xstr_(n_, 0.0),
+      q_(n_ang_ * n_, 0.0),
+      fx_(n_ang_ * nfx_, 0.0),
+      fy_(n_ang_ * nfy_, 0.0),
+      fz_(n_ang_ * nfz_, 0.0),
+      flux_(n_, 0.0)
+{
+    if (!is_2d) {
+        std::copy(macroplanes.begin(), macroplanes.begin() + nz_,
+                  macroplane_.begin());
+    }
+    n_fac_ = (*std::max_element(macroplane_.begin(), macroplane_.end()) + 1) *
+             nx_ * ny_;
+
+    // Angles, sorted by octant
+    std::vector<VecI> octants(8);
+    for (int iang = 0; iang < n_ang_; iang++) {
+        const auto &angle = ang_quad[iang];
+        ox_.push_back(std::abs(angle.ox));
+        oy_.push_back(std::abs(angle.oy));
+        oz_.push_back(std::abs(angle.oz));
+        wgt_.push_back(angle.weight * (is_2d ? PI : HPI));
+        iang_2d_.push_back(iang % n_ang_2d_);
+        int oct = (angle.ox < 0.0 ? 1 : 0) + (angle.oy < 0.0 ? 2 : 0) +
+                  (angle.oz < 0.0 ? 4 : 0);
+        octants[oct].push_back(iang);
+    }
+    for (int oct = 0; oct < 8; oct++) {
+        oct_ang_.insert(oct_ang_.end(), octants[oct].begin(),
+                        octants[oct].end());
+        oct_start_[oct + 1] = oct_ang_.size();
+    }
+
+    // Hyperplanes, as for the host wavefront sweep
+    std::vector<VecI> hyperplanes(nx_ + ny_ + nz_ - 2);
+    for (int iz = 0; iz < nz_; iz++) {
+        for (int iy = 0; iy < ny_; iy++) {
+            for (int ix = 0; ix < nx_; ix++) {
+                hyperplanes[ix + iy + iz].push_back(ix + nx_ * (iy + ny_ * iz));
+            }
+        }
+    }
+    for (const auto &h : hyperplanes) {
+        hp_cell_.insert(hp_cell_.end(), h.begin(), h.end());
+        hp_start_.push_back(hp_cell_.size());
+    }
+
+    const real_t *p_rdx   = rdx_.data();
+    const real_t *p_rdy   = rdy_.data();
+    const real_t *p_rdz   = rdz_.data();
+    const int *p_mplane   = macroplane_.data();
+    const real_t *p_ox    = ox_.data();
+    const real_t *p_oy    = oy_.data();
+    const real_t *p_oz    = oz_.data();
+    const real_t *p_wgt   = wgt_.data();
+    const int *p_iang_2d  = iang_2d_.data();
+    const int *p_oct_ang  = oct_ang_.data();
+    const int *p_hp_cell  = hp_cell_.data();
+    real_t *p_xstr        = xstr_.data();
+    real_t *p_q           = q_.data();
+    real_t *p_fx          = fx_.data();
+    real_t *p_fy          = fy_.data();
+    real_t *p_fz          = fz_.data();
+    real_t *p_flux        = flux_.data();
+    const int n_ang       = n_ang_;
+    const int n           = n_;
+    const int n_q         = q_.size();
+    const int n_fx        = fx_.size();
+    const int n_fy        = fy_.size();
+    const int n_fz        = fz_.size();
+#pragma omp target enter data map(to: p_rdx[0:nx_], p_rdy[0:ny_],         \
+    p_rdz[0:nz_], p_mplane[0:nz_], p_ox[0:n_ang], p_oy[0:n_ang],           \
+    p_oz[0:n_ang], p_wgt[0:n_ang], p_iang_2d[0:n_ang], p_oct_ang[0:n_ang], \
+    p_hp_cell[0:n])                                                        \
+    map(alloc: p_xstr[0:n], p_q[0:n_q], p_fx[0:n_fx], p_fy[0:n_fy],        \
+        p_fz[0:n_fz], p_flux[0:n])
+
+    return;
+}
+
+DeviceSnSweep::~DeviceSnSweep()
+{
+    const real_t *p_rdx   = rdx_.data();
+    const real_t *p_rdy   = rdy_.data();
+    const real_t *p_rdz   = rdz_.data();
+    const int *p_mplane   = macroplane_.data();
+    const real_t *p_ox    = ox_.data();
+    const real_t *p_oy    = oy_.data();
+    const real_t *p_oz    = oz_.data();
+    const real_t *p_wgt   = wgt_.data();
+    const int *p_iang_2d  = iang_2d_.data();
+    const int *p_oct_ang  = oct_ang_.data();
+    const int *p_hp_cell  = hp_cell_.data();
+    real_t *p_xstr        = xstr_.data();
+    real_t *p_q           = q_.data();
+    real_t *p_fac         = fac_.data();
+    real_t *p_fx          = fx_.data();
+    real_t *p_fy          = fy_.data();
+    real_t *p_fz          = fz_.data();
+    real_t *p_flux        = flux_.data();
+    const int n_ang       = n_ang_;
+    const int n           = n_;
+    const int n_q         = q_.size();
+    const int n_f         = fac_.size();
+    const int n_fx        = fx_.size();
+    const int n_fy        = fy_.size();
+    const int n_fz        = fz_.size();
+#pragma omp target exit data map(delete: p_rdx[0:nx_], p_rdy[0:ny_],      \
+    p_rdz[0:nz_], p_mplane[0:nz_], p_ox[0:n_ang], p_oy[0:n_ang],           \
+    p_oz[0:n_ang], p_wgt[0:n_ang], p_iang_2d[0:n_ang], p_oct_ang[0:n_ang], \
+    p_hp_cell[0:n], p_xstr[0:n], p_q[0:n_q], p_fx[0:n_fx], p_fy[0:n_fy],   \
+    p_fz[0:n_fz], p_flux[0:n])
+    if (n_f > 0) {
+#pragma omp target exit data map(delete: p_fac[0:n_f])
+    }
+
+    return;
+}
+
+void DeviceSnSweep::sweep(const real_t *factors)
+{
+    const int nx     = nx_;
+    const int ny     = ny_;
+    const int nz     = nz_;
+    const int n      = n_;
+    const int n_fac  = n_fac_;
+    const int nfx    = nfx_;
+    const int nfy    = nfy_;
+    const int nfz    = nfz_;
+    const bool is_2d = is_2d_;
+    const bool corr  = factors != nullptr;
+    const int n_q    = q_.size();
+    const int n_fx   = fx_.size();
+    const int n_fy   = fy_.size();
+    const int n_fz   = fz_.size();
+
+    if (corr && fac_.empty()) {
+        fac_.resize(2 * n_ang_2d_ * n_fac_);
+        real_t *p_fac = fac_.data();
+        int n_f       = fac_.size();
+#pragma omp target enter data map(alloc: p_fac[0:n_f])
+    }
+    if (corr) {
+        std::copy(factors, factors + fac_.size(), fac_.begin());
+    }
+
+    const real_t *rdx     = rdx_.data();
+    const real_t *rdy     = rdy_.data();
+    const real_t *rdz     = rdz_.data();
+    const int *mplane     = macroplane_.data();
+    const real_t *ox      = ox_.data();
+    const real_t *oy      = oy_.data();
+    const real_t *oz      = oz_.data();
+    const real_t *wgt     = wgt_.data();
+    const int *iang_2d    = iang_2d_.data();
+    const int *oct_ang    = oct_ang_.data();
+    const int *hp_cell    = hp_cell_.data();
+    real_t *xstr          = xstr_.data();
+    real_t *q             = q_.data();
+    real_t *fac           = fac_.data();
+    real_t *fx            = fx_.data();
+    real_t *fy            = fy_.data();
+    real_t *fz            = fz_.data();
+    real_t *flux          = flux_.data();
+    const int n_f         = fac_.size();
+
+#pragma omp target update to(xstr[0:n], q[0:n_q], fx[0:n_fx], fy[0:n_fy], \
+    fz[0:n_fz])
+    if (corr) {
+#pragma omp target update to(fac[0:n_f])
+    }
+
+#pragma omp target teams distribute parallel for
+    for (int i = 0; i < n; i++) {
+        flux[i] = 0.0;
+    }
+
+    for (int oct = 0; oct < 8; oct++) {
+        const int a0    = oct_start_[oct];
+        const int n_oa  = oct_start_[oct + 1] - a0;
+        const bool x_rv = (oct & 1) != 0;
+        const bool y_rv = (oct & 2) != 0;
+        const bool z_rv = (oct & 4) != 0;
+        if (n_oa == 0) {
+            continue;
+        }
+
+        // March the hyperplanes from the upwind corner. Each launch sweeps
+        // one hyperplane for every angle in the octant.
+        for (int h = 0; h < (int)hp_start_.size() - 1; h++) {
+            const int c0     = hp_start_[h];
+            const int n_cell = hp_start_[h + 1] - c0;
+#pragma omp target teams distribute parallel for
+            for (int k = 0; k < n_oa * n_cell; k++) {
+                int iang  = oct_ang[a0 + k / n_cell];
+                int local = hp_cell[c0 + k % n_cell];
+                int jx    = local % nx;
+                int jy    = (local / nx) % ny;
+                int jz    = local / (nx * ny);
+                int ix    = x_rv ? nx - 1 - jx : jx;
+                int iy    = y_rv ? ny - 1 - jy : jy;
+                int iz    = z_rv ? nz - 1 - jz : jz;
+                int i     = ix + nx * (iy + ny * iz);
+                int ixy   = nx * iy + ix;
+
+                real_t tx  = ox[iang] * rdx[ix];
+                real_t ty  = oy[iang] * rdy[iy];
+                real_t rgx = 2.0;
+                real_t rgy = 2.0;
+                if (corr) {
+                    int ia          = mplane[iz] * nx * ny + ixy;
+                    const real_t *f = &fac[2 * (iang_2d[iang] * n_fac + ia)];
+                    rgx             = f[0];
+                    rgy             = f[1];
+                }
+
+                real_t &psi_x = fx[iang * nfx + ny * iz + iy];
+                real_t &psi_y = fy[iang * nfy + nx * iz + ix];
+                real_t num = q[iang * n + i] + 2.0 * (tx * psi_x + ty * psi_y);
+                real_t den = tx * rgx + ty * rgy + xstr[i];
+                real_t psi;
+                if (is_2d) {
+                    psi = num / den;
+                } else {
+                    real_t tz     = oz[iang] * rdz[iz];
+                    real_t &psi_z = fz[iang * nfz + ixy];
+                    psi   = (num + 2.0 * tz * psi_z) / (den + 2.0 * tz);
+                    psi_z = 2.0 * psi - psi_z;
+                }
+                psi_x = psi * rgx - psi_x;
+                psi_y = psi * rgy - psi_y;
+#pragma omp atomic
+                flux[i] += psi * wgt[iang];
+            }
+        }
+    }
+
+#pragma omp target update from(flux[0:n], fx[0:n_fx], fy[0:n_fy], \
+    fz[0:n_fz])
+
+    return;
+}
+
+size_t DeviceSnSweep::memory() const
+{
+    return bytes(rdx_) + bytes(rdy_) + bytes(rdz_) + bytes(macroplane_) +
+           bytes(ox_) + bytes(oy_) + bytes(oz_) + bytes(wgt_) +
+           bytes(iang_2d_) + bytes(oct_ang_) + bytes(hp_cell_) +
+           bytes(xstr_) + bytes(q_) + bytes(fac_) + bytes(fx_) + bytes(fy_) +
+           bytes(fz_) + bytes(flux_);
+}
+}
+}
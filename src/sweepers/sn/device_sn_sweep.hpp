@@ -0,0 +1,197 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <vector>
+#include "util/global_config.hpp"
+#include "core/angular_quadrature.hpp"
+#include "core/constants.hpp"
+
+namespace mocc {
+namespace sn {
+/**
+ * \brief Device-resident wavefront Sn sweep for diamond difference and
+ * corrected diamond difference, using OpenMP target offload
+ *
+ * The mesh, angles and hyperplanes of the wavefront sweep are mapped to the
+ * device once, on construction, and stay there until the \ref DeviceSnSweep
+ * is destroyed. A sweep moves the transport cross section and the transport
+ * source of each angle to the device, along with the incoming face fluxes of
+ * every angle and, for CDD, the reciprocal correction factors of the group,
+ * and brings back the scalar flux and the outgoing face fluxes.
+ *
+ * The octants are swept one after another, and within each, the cells of a
+ * hyperplane are swept for all angles of the octant at once, as in the host
+ * wavefront sweep. The boundary conditions are updated in a Jacobi fashion,
+ * after the sweep. Currents are not computed on the device.
+ *
+ * The cell update is the diamond difference update with the radial factors
+ * (2 for plain diamond difference) taken from the correction factors of the
+ * swept angle, if given. Axially, plain diamond difference is used, as in
+ * \ref cmdo::SnSweeper_CDD_DD.
+ */
+class DeviceSnSweep {
+public:
+    /**
+     * \param nx the number of cells along x
+     * \param ny the number of cells along y
+     * \param nz the number of cells along z
+     * \param is_2d whether the sweep is 2-D. If so, only the angles in the
+     * upper half-space are swept, and there are no z faces.
+     * \param ang_quad the angular quadrature
+     * \param rdx the reciprocal x pitch of each column of cells
+     * \param rdy the reciprocal y pitch of each row of cells
+     * \param rdz the reciprocal height of each plane of cells
+     * \param macroplanes the macroplane of each plane, which selects the
+     * correction factors of its cells
+     */
+    DeviceSnSweep(int nx, int ny, int nz, bool is_2d,
+                  const AngularQuadrature &ang_quad, const VecF &rdx,
+                  const VecF &rdy, const VecF &rdz, const VecI &macroplanes);
+
+    ~DeviceSnSweep();
+
+    DeviceSnSweep(const DeviceSnSweep &) = delete;
+    DeviceSnSweep &operator=(const DeviceSnSweep &) = delete;
+
+    /**
+     * \brief Return the number of angles swept
+     */
+    int n_ang() const
+    {
+        return n_ang_;
+    }
+
+    /**
+     * \brief Return the number of cells that the correction factors of each
+     * angle cover
+     */
+    int n_factor_cells() const
+    {
+        return n_fac_;
+    }
+
+    /**
+     * \brief Return the host buffer for the transport cross section of each
+     * cell, to be filled before \ref sweep()
+     */
+    real_t *xstr()
+    {
+        return xstr_.data();
+    }
+
+    /**
+     * \brief Return the host buffer for the transport source of an angle,
+     * to be filled before \ref sweep()
+     */
+    real_t *source(int iang)
+    {
+        return &q_[iang * n_];
+    }
+
+    /**
+     * \brief Return the host buffer for the face fluxes of an angle along a
+     * normal
+     *
+     * These hold the incoming face fluxes before \ref sweep(), and the
+     * outgoing ones after.
+     */
+    real_t *face(int iang, Normal norm)
+    {
+        switch (norm) {
+        case Normal::X_NORM:
+            return &fx_[iang * nfx_];
+        case Normal::Y_NORM:
+            return &fy_[iang * nfy_];
+        default:
+            return &fz_[iang * nfz_];
+        }
+    }
+
+    /**
+     * \brief Return the scalar flux of the last sweep
+     */
+    const real_t *flux() const
+    {
+        return flux_.data();
+    }
+
+    /**
+     * \brief Sweep all angles once for a single group
+     *
+     * \param factors the reciprocal x- and y-normal correction factors of
+     * each cell and 2-D angle, as tabulated by \ref
+     * cmdo::SnSweeper_CDD::prepare_group(), or null for plain diamond
+     * difference
+     */
+    void sweep(const real_t *factors);
+
+    /**
+     * \brief Return the number of bytes used on the device (and mirrored on
+     * the host)
+     */
+    size_t memory() const;
+
+private:
+    int nx_;
+    int ny_;
+    int nz_;
+    int n_;
+    bool is_2d_;
+    int n_ang_;
+    int n_ang_2d_;
+    int n_fac_;
+    int nfx_;
+    int nfy_;
+    int nfz_;
+
+    // Reciprocal pitches, and the macroplane of each plane
+    VecF rdx_;
+    VecF rdy_;
+    VecF rdz_;
+    VecI macroplane_;
+
+    // Absolute direction cosines, flux weight and 2-D angle index of each
+    // angle
+    VecF ox_;
+    VecF oy_;
+    VecF oz_;
+    VecF wgt_;
+    VecI iang_2d_;
+
+    // Angles, grouped by octant. Those of octant o are in [oct_start_[o],
+    // oct_start_[o+1]).
+    VecI oct_ang_;
+    VecI oct_start_;
+
+    // Cells of each hyperplane, in sweep-local coordinates. Those of
+    // hyperplane h are in [hp_start_[h], hp_start_[h+1]).
+    VecI hp_cell_;
+    VecI hp_start_;
+
+    // Per-sweep buffers, also kept on the device. The correction factors
+    // are only allocated by the first corrected sweep.
+    VecF xstr_;
+    VecF q_;
+    VecF fac_;
+    VecF fx_;
+    VecF fy_;
+    VecF fz_;
+    VecF flux_;
+};
+}
+}
@@ -0,0 +1,190 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "kba_domain.hpp"
+
+#include <cassert>
+#include <iostream>
+#ifdef MOCC_USE_MPI
+#include <mpi.h>
+#endif
+#include "util/error.hpp"
+#include "util/memory.hpp"
+
+namespace {
+#ifdef MOCC_USE_MPI
+MPI_Datatype mpi_real()
+{
+    return (sizeof(mocc::real_t) == sizeof(float)) ? MPI_FLOAT : MPI_DOUBLE;
+}
+#endif
+}
+
+namespace mocc {
+namespace sn {
+#ifdef MOCC_USE_MPI
+struct KBADomain::Requests {
+    std::vector<MPI_Request> send;
+};
+#else
+struct KBADomain::Requests {
+};
+#endif
+
+KBADomain::KBADomain(const Mesh &mesh, int n_domain, int domain, int planes)
+    : decomp_(VecI(mesh.nx() * mesh.ny(), 1), mesh.nx(), mesh.ny(),
+              n_domain),
+      domain_(domain),
+      planes_(planes),
+      requests_(new Requests)
+{
+#ifndef MOCC_USE_MPI
+    if (n_domain > 1) {
+        throw EXCEPT("Distributed KBA sweeps need MPI support");
+    }
+#endif
+    if ((domain < 0) || (domain >= n_domain)) {
+        throw EXCEPT("Invalid KBA domain");
+    }
+    if (planes < 1) {
+        throw EXCEPT("Invalid number of planes per KBA chunk");
+    }
+
+    int jx   = domain_ % decomp_.px();
+    int jy   = domain_ / decomp_.px();
+    x_begin_ = decomp_.x_bound(jx);
+    y_begin_ = decomp_.y_bound(jy);
+    nx_      = decomp_.x_bound(jx + 1) - x_begin_;
+    ny_      = decomp_.y_bound(jy + 1) - y_begin_;
+
+    return;
+}
+
+KBADomain::~KBADomain()
+{
+    return;
+}
+
+int KBADomain::upwind(Normal norm, bool positive) const
+{
+    switch (norm) {
+    case Normal::X_NORM:
+        return decomp_.neighbor(domain_,
+                                positive ? Surface::WEST : Surface::EAST);
+    case Normal::Y_NORM:
+        return decomp_.neighbor(domain_,
+                                positive ? Surface::SOUTH : Surface::NORTH);
+    default:
+        return -1;
+    }
+}
+
+void KBADomain::receive(int source, real_t *data, int n)
+{
+#ifdef MOCC_USE_MPI
+    MPI_Recv(data, n, mpi_real(), source, 0, MPI_COMM_WORLD,
+             MPI_STATUS_IGNORE);
+#else
+    assert(false);
+#endif
+    return;
+}
+
+void KBADomain::send(int dest, const real_t *data, int n)
+{
+#ifdef MOCC_USE_MPI
+    if (free_.empty()) {
+        free_.push_back(send_buf_.size());
+        send_buf_.emplace_back();
+        requests_->send.push_back(MPI_REQUEST_NULL);
+    }
+    int ibuf = free_.back();
+    free_.pop_back();
+    VecF &buf = send_buf_[ibuf];
+    buf.assign(data, data + n);
+    MPI_Isend(buf.data(), n, mpi_real(), dest, 0, MPI_COMM_WORLD,
+              &requests_->send[ibuf]);
+#else
+    assert(false);
+#endif
+    return;
+}
+
+void KBADomain::retire()
+{
+#ifdef MOCC_USE_MPI
+    if (requests_->send.empty()) {
+        return;
+    }
+    int n_done = 0;
+    done_.resize(requests_->send.size());
+    MPI_Testsome(requests_->send.size(), requests_->send.data(), &n_done,
+                 done_.data(), MPI_STATUSES_IGNORE);
+    // Requests that are already free are left out of the count, and with
+    // none in flight at all, n_done is MPI_UNDEFINED
+    if (n_done == MPI_UNDEFINED) {
+        return;
+    }
+    free_.insert(free_.end(), done_.begin(), done_.begin() + n_done);
+#endif
+    return;
+}
+
+void KBADomain::wait()
+{
+#ifdef MOCC_USE_MPI
+    MPI_Waitall(requests_->send.size(), requests_->send.data(),
+                MPI_STATUSES_IGNORE);
+#endif
+    free_.clear();
+    for (int ibuf = 0; ibuf < (int)send_buf_.size(); ibuf++) {
+        free_.push_back(ibuf);
+    }
+    return;
+}
+
+void KBADomain::reduce(real_t *data, int n) const
+{
+#ifdef MOCC_USE_MPI
+    if (decomp_.n_domain() > 1) {
+        MPI_Allreduce(MPI_IN_PLACE, data, n, mpi_real(), MPI_SUM,
+                      MPI_COMM_WORLD);
+    }
+#endif
+    return;
+}
+
+size_t KBADomain::memory() const
+{
+    size_t mem = 0;
+    for (const auto &buf : send_buf_) {
+        mem += bytes(buf);
+    }
+    return mem;
+}
+
+std::ostream &operator<<(std::ostream &os, const KBADomain &kba)
+{
+    os << "KBA Sn sweep: " << kba.decomp_.px() << " x " << kba.decomp_.py()
+       << " blocks of pins, " << kba.planes() << " planes per chunk"
+       << std::endl;
+    os << "    Block " << kba.domain() << ": pins x " << kba.x_begin()
+       << " - " << kba.x_begin() + kba.nx() - 1 << ", y " << kba.y_begin()
+       << " - " << kba.y_begin() + kba.ny() - 1 << std::endl;
+    return os;
+}
+}
+}
@@ -0,0 +1,206 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <iosfwd>
+#include <memory>
+#include <vector>
+#include "util/global_config.hpp"
+#include "core/constants.hpp"
+#include "core/mesh.hpp"
+#include "core/radial_decomposition.hpp"
+
+namespace mocc {
+namespace sn {
+/**
+ * \brief The block of the Sn mesh swept by one process in a distributed KBA
+ * sweep, and the exchange of face fluxes with the neighboring blocks
+ *
+ * The x-y extent of the mesh is cut into \c px by \c py rectangular blocks
+ * of pin columns with a \ref RadialDecomposition, one block per process. The
+ * blocks span the full height of the mesh. For each angle, a block may be
+ * swept once the face fluxes entering it through its upwind x- and y-normal
+ * faces are known. To get the downwind blocks started early, each block is
+ * swept in chunks of \ref planes() planes, sending the outgoing x- and
+ * y-normal face fluxes of a chunk to the downwind blocks as soon as it is
+ * done, and the angles follow each other without any synchronization. This
+ * pipelines the sweep in z and in angle, as in the Koch-Baker-Alcouffe
+ * algorithm.
+ *
+ * All processes sweep the angles in the same order, and messages between
+ * two processes are received in the order they were sent, so no tags are
+ * needed to tell the chunks and angles apart.
+ *
+ * Every process keeps the whole mesh; only the sweep itself is distributed.
+ * The scalar flux, currents and outgoing boundary fluxes that each process
+ * tallies for its block are summed over the processes with \ref reduce().
+ *
+ * Without MPI support (\c MOCC_USE_MPI), there may only be one block.
+ */
+class KBADomain {
+public:
+    /**
+     * \brief Cut the mesh into blocks
+     *
+     * \param mesh the Sn mesh
+     * \param n_domain the number of blocks, one per process
+     * \param domain the block swept by this process
+     * \param planes the number of planes in each chunk of the pipelined
+     * sweep
+     */
+    KBADomain(const Mesh &mesh, int n_domain, int domain, int planes);
+
+    ~KBADomain();
+
+    KBADomain(const KBADomain &) = delete;
+    KBADomain &operator=(const KBADomain &) = delete;
+
+    int domain() const
+    {
+        return domain_;
+    }
+
+    /**
+     * \brief Return the index of the first pin column of the block
+     */
+    int x_begin() const
+    {
+        return x_begin_;
+    }
+
+    /**
+     * \brief Return the index of the first pin row of the block
+     */
+    int y_begin() const
+    {
+        return y_begin_;
+    }
+
+    /**
+     * \brief Return the number of pin columns in the block
+     */
+    int nx() const
+    {
+        return nx_;
+    }
+
+    /**
+     * \brief Return the number of pin rows in the block
+     */
+    int ny() const
+    {
+        return ny_;
+    }
+
+    /**
+     * \brief Return the number of planes in each chunk of the sweep
+     */
+    int planes() const
+    {
+        return planes_;
+    }
+
+    /**
+     * \brief Return the block that sends face fluxes into this one through
+     * its upwind face along a normal, or -1 if that face is on the boundary
+     * of the mesh
+     *
+     * \param norm the normal, either \ref Normal::X_NORM or \ref
+     * Normal::Y_NORM
+     * \param positive whether the direction cosine along \p norm is positive
+     */
+    int upwind(Normal norm, bool positive) const;
+
+    /**
+     * \brief Return the block that receives face fluxes from this one
+     * through its downwind face along a normal, or -1 if that face is on the
+     * boundary of the mesh
+     */
+    int downwind(Normal norm, bool positive) const
+    {
+        return this->upwind(norm, !positive);
+    }
+
+    /**
+     * \brief Receive \p n face fluxes from another block, waiting for them
+     * to arrive
+     */
+    void receive(int source, real_t *data, int n);
+
+    /**
+     * \brief Start sending \p n face fluxes to another block
+     *
+     * The values are copied, so \p data may be reused right away. The copy
+     * goes into a buffer freed by \ref retire() or \ref wait() if there is
+     * one. The send is only guaranteed to finish after \ref wait().
+     */
+    void send(int dest, const real_t *data, int n);
+
+    /**
+     * \brief Free the buffers of the sends that have finished, without
+     * waiting for the others
+     *
+     * Calling this after each angle keeps the number of buffers down to the
+     * sends actually in flight, instead of all of the sends of a group.
+     */
+    void retire();
+
+    /**
+     * \brief Wait for all of the sends in flight to finish, and free their
+     * buffers
+     */
+    void wait();
+
+    /**
+     * \brief Sum an array over all of the blocks, leaving the result on all
+     * of them
+     */
+    void reduce(real_t *data, int n) const;
+
+    /**
+     * \brief Return the number of bytes used to store the face fluxes in
+     * flight
+     */
+    size_t memory() const;
+
+    friend std::ostream &operator<<(std::ostream &os, const KBADomain &kba);
+
+private:
+    struct Requests;
+
+    RadialDecomposition decomp_;
+    int domain_;
+    int x_begin_;
+    int y_begin_;
+    int nx_;
+    int ny_;
+    int planes_;
+
+    // Copies of the face fluxes being sent. These are kept between sweeps,
+    // so that they are only allocated once, and reused as the sends finish.
+    std::vector<VecF> send_buf_;
+
+    // Indices of the buffers in send_buf_ that are not in flight
+    VecI free_;
+
+    // Scratch space for the indices of the sends finished in retire()
+    VecI done_;
+
+    std::unique_ptr<Requests> requests_;
+};
+}
+}
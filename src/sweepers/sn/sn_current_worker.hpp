@@ -16,8 +16,10 @@
 
 #pragma once
 
+#include <vector>
 #include "util/force_inline.hpp"
 #include "util/global_config.hpp"
+#include "util/omp_guard.h"
 #include "core/coarse_data.hpp"
 #include "core/constants.hpp"
 #include "core/mesh.hpp"
@@ -31,17 +33,47 @@ namespace sn {
  * will perform current calculations for the upwind boundary condition
  * and after sweeping each cell.
  *
+ * Each thread in the sweep is expected to construct its own \ref Current.
+ * Contributions are accumulated into private buffers, which are added to the
+ * \ref CoarseData by \ref flush() once the thread is done sweeping. This
+ * avoids atomic updates for every cell and angle.
+ *
  * \note Unlike in the MoC sweepers, these routines to not calculate
  * area*current. Make sure to remember to multiply by the surface areas
  * at the end of the last Sn sweep.
  */
 class Current {
 public:
-    Current(CoarseData *data, const Mesh *mesh) : data_(data), mesh_(mesh)
+    Current(CoarseData *data, const Mesh *mesh)
+        : data_(data),
+          mesh_(mesh),
+          current_(mesh->n_surf(), 0.0),
+          surface_flux_(mesh->n_surf(), 0.0)
     {
         return;
     }
 
+    /**
+     * \brief Add the contributions accumulated by this thread to the \ref
+     * CoarseData.
+     *
+     * Each thread starts at a different surface, so that threads flushing at
+     * the same time seldom contend for the same entries.
+     */
+    void flush(int group)
+    {
+        int n_surf = current_.size();
+        int start  = (n_surf * omp_get_thread_num()) / omp_get_num_threads();
+        for (int k = 0; k < n_surf; k++) {
+            int surf = (start + k) % n_surf;
+#pragma omp atomic update
+            data_->current(surf, group) += current_[surf];
+#pragma omp atomic update
+            data_->surface_flux(surf, group) += surface_flux_[surf];
+        }
+        return;
+    }
+
     /**
      * Store the upwind boundary condition as a contribution to the
      * coarse mesh current.
@@ -86,10 +118,8 @@ public:
                 Position pos(ixx, iy, iz);
                 size_t i = mesh_->coarse_cell(pos);
                 int surf = mesh_->coarse_surf(i, upwind_x_);
-#pragma omp atomic update
-                data_->current(surf, group) += ox * x[ny * iz + iy];
-#pragma omp atomic update
-                data_->surface_flux(surf, group) += x[ny * iz + iy];
+                current_[surf] += ox * x[ny * iz + iy];
+                surface_flux_[surf] += x[ny * iz + iy];
             }
         }
 
@@ -99,10 +129,8 @@ public:
                 Position pos(ix, iyy, iz);
                 size_t i = mesh_->coarse_cell(pos);
                 int surf = mesh_->coarse_surf(i, upwind_y_);
-#pragma omp atomic update
-                data_->current(surf, group) += oy * y[nx * iz + ix];
-#pragma omp atomic update
-                data_->surface_flux(surf, group) += y[nx * iz + ix];
+                current_[surf] += oy * y[nx * iz + ix];
+                surface_flux_[surf] += y[nx * iz + ix];
             }
         }
 
@@ -112,10 +140,8 @@ public:
                 Position pos(ix, iy, izz);
                 size_t i = mesh_->coarse_cell(pos);
                 int surf = mesh_->coarse_surf(i, upwind_z_);
-#pragma omp atomic update
-                data_->current(surf, group) += oz * z[nx * iy + ix];
-#pragma omp atomic update
-                data_->surface_flux(surf, group) += z[nx * iy + ix];
+                current_[surf] += oz * z[nx * iy + ix];
+                surface_flux_[surf] += z[nx * iy + ix];
             }
         }
 
@@ -156,10 +182,8 @@ public:
             Position pos(ixx, iy, 0);
             size_t i = mesh_->coarse_cell(pos);
             int surf = mesh_->coarse_surf(i, upwind_x_);
-#pragma omp atomic update
-            data_->current(surf, group) += ox * x[iy];
-#pragma omp atomic update
-            data_->surface_flux(surf, group) += x[iy];
+            current_[surf] += ox * x[iy];
+            surface_flux_[surf] += x[iy];
         }
 
         // Y-normal
@@ -167,10 +191,8 @@ public:
             Position pos(ix, iyy, 0);
             size_t i = mesh_->coarse_cell(pos);
             int surf = mesh_->coarse_surf(i, upwind_y_);
-#pragma omp atomic update
-            data_->current(surf, group) += oy * y[ix];
-#pragma omp atomic update
-            data_->surface_flux(surf, group) += y[ix];
+            current_[surf] += oy * y[ix];
+            surface_flux_[surf] += y[ix];
         }
 
         return;
@@ -196,28 +218,22 @@ public:
         // X-normal
         {
             int surf = mesh_->coarse_surf(i, downwind_x_);
-#pragma omp atomic update
-            data_->current(surf, group) += psi_x * ox;
-#pragma omp atomic update
-            data_->surface_flux(surf, group) += psi_x;
+            current_[surf] += psi_x * ox;
+            surface_flux_[surf] += psi_x;
         }
 
         // Y-normal
         {
             int surf = mesh_->coarse_surf(i, downwind_y_);
-#pragma omp atomic update
-            data_->current(surf, group) += psi_y * oy;
-#pragma omp atomic update
-            data_->surface_flux(surf, group) += psi_y;
+            current_[surf] += psi_y * oy;
+            surface_flux_[surf] += psi_y;
         }
 
         // Z-normal
         {
             int surf = mesh_->coarse_surf(i, downwind_z_);
-#pragma omp atomic update
-            data_->current(surf, group) += psi_z * oz;
-#pragma omp atomic update
-            data_->surface_flux(surf, group) += psi_z;
+            current_[surf] += psi_z * oz;
+            surface_flux_[surf] += psi_z;
         }
 
         return;
@@ -241,19 +257,15 @@ public:
         // X-normal
         {
             int surf = mesh_->coarse_surf(i, downwind_x_);
-#pragma omp atomic update
-            data_->current(surf, group) += psi_x * ox;
-#pragma omp atomic update
-            data_->surface_flux(surf, group) += psi_x;
+            current_[surf] += psi_x * ox;
+            surface_flux_[surf] += psi_x;
         }
 
         // Y-normal
         {
             int surf = mesh_->coarse_surf(i, downwind_y_);
-#pragma omp atomic update
-            data_->current(surf, group) += psi_y * oy;
-#pragma omp atomic update
-            data_->surface_flux(surf, group) += psi_y;
+            current_[surf] += psi_y * oy;
+            surface_flux_[surf] += psi_y;
         }
 
         return;
@@ -286,6 +298,11 @@ public:
 private:
     CoarseData *data_;
     const Mesh *mesh_;
+
+    // Thread-private current and surface flux for the group being swept
+    std::vector<real_t> current_;
+    std::vector<real_t> surface_flux_;
+
     Surface upwind_x_;
     Surface upwind_y_;
     Surface upwind_z_;
@@ -343,6 +360,11 @@ public:
     {
         return;
     }
+
+    MOCC_FORCE_INLINE void flush(int group)
+    {
+        return;
+    }
 };
 }
 }
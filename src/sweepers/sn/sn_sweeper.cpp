@@ -20,9 +20,11 @@
 #include <string>
 #include "pugixml.hpp"
 #include "util/files.hpp"
+#include "util/fp_utils.hpp"
 #include "util/omp_guard.h"
 #include "util/string_utils.hpp"
 #include "util/validate_input.hpp"
+#include "core/parallel_environment.hpp"
 
 namespace {
 using namespace mocc;
@@ -35,8 +37,13 @@ BC_Size_t boundary_helper(const Mesh &mesh)
 }
 
 const std::vector<std::string> recognized_attributes = {
-    "type",  "n_inner",         "equation",
-    "axial", "boundary_update", "update_incoming"};
+    "type",   "n_inner",         "equation",
+    "axial",  "boundary_update", "update_incoming",
+    "sweep",  "tile",            "xs_update_tolerance",
+    "kernel", "group_block",     "inner_solver",
+    "gmres_tol", "gmres_max_iter", "gmres_restart",
+    "xs_cache", "workload_stats", "offload", "kba_planes",
+    "boundary_precision"};
 }
 
 namespace mocc {
@@ -54,7 +61,14 @@ SnSweeper::SnSweeper(const pugi::xml_node &input, const CoreMesh &mesh)
       bc_in_(mesh.mat_lib().n_group(), ang_quad_, bc_type_,
              boundary_helper(mesh)),
       bc_out_(1, ang_quad_, bc_type_, boundary_helper(mesh)),
-      gs_boundary_(true)
+      gs_boundary_(true),
+      negative_fixup_(true),
+      double_buffer_(false),
+      sweep_mode_(SweepMode::ANGLE),
+      tile_(0),
+      multigroup_kernel_(false),
+      group_block_(1),
+      pipeline_(nullptr)
 {
     LogFile << "Constructing a base Sn sweeper" << std::endl;
     validate_input(input, recognized_attributes);
@@ -86,6 +100,17 @@ SnSweeper::SnSweeper(const pugi::xml_node &input, const CoreMesh &mesh)
         }
     }
     xstr_ = ExpandedXS(xs_mesh_.get());
+    if (input.attribute("xs_cache").as_bool(false)) {
+        xstr_.cache_all_groups();
+    }
+
+    // Relative change in pin flux below which the homogenized cross sections
+    // of a pin are not updated
+    real_t xs_tol = input.attribute("xs_update_tolerance").as_double(0.0);
+    if (xs_tol < 0.0) {
+        throw EXCEPT("Invalid XS update tolerance (xs_update_tolerance).");
+    }
+    this->get_homogenized_xsmesh()->set_update_tolerance(xs_tol);
 
     // Parse the number of inner iterations
     int int_in = input.attribute("n_inner").as_int(-1);
@@ -95,6 +120,26 @@ SnSweeper::SnSweeper(const pugi::xml_node &input, const CoreMesh &mesh)
     }
     n_inner_ = int_in;
 
+    // Tabulate the reciprocal pin pitches
+    auto reciprocal = [](const VecF &h) {
+        VecF r;
+        r.reserve(h.size());
+        for (auto v : h) {
+            r.push_back(1.0 / v);
+        }
+        return r;
+    };
+    rdx_ = reciprocal(mesh_.pin_dx());
+    rdy_ = reciprocal(mesh_.pin_dy());
+    rdz_ = reciprocal(mesh_.pin_dz());
+
+    auto is_uniform = [](const VecF &h) {
+        return std::all_of(h.begin(), h.end(), [&h](real_t v) {
+            return fp_equiv_ulp(v, h.front());
+        });
+    };
+    uniform_pitch_ = is_uniform(mesh_.pin_dx()) && is_uniform(mesh_.pin_dy());
+
     // Try to read boundary update option
     if (!input.attribute("boundary_update").empty()) {
         std::string in_string = input.attribute("boundary_update").value();
@@ -108,15 +153,171 @@ SnSweeper::SnSweeper(const pugi::xml_node &input, const CoreMesh &mesh)
             throw EXCEPT("Unrecognized option for BC update!");
         }
     }
+    // Determine how to parallelize the sweep
+    if (!input.attribute("sweep").empty()) {
+        std::string in_string = input.attribute("sweep").value();
+        sanitize(in_string);
+
+        if (in_string == "angle") {
+            sweep_mode_ = SweepMode::ANGLE;
+        } else if (in_string == "wavefront") {
+            sweep_mode_ = SweepMode::WAVEFRONT;
+        } else if (in_string == "octant") {
+            sweep_mode_ = SweepMode::OCTANT;
+        } else if (in_string == "kba") {
+            sweep_mode_ = SweepMode::KBA;
+        } else {
+            throw EXCEPT("Unrecognized Sn sweep option.");
+        }
+    }
+
+    // Radial tile size for the cache-blocked sweeps
+    tile_ = input.attribute("tile").as_int(0);
+    if (tile_ < 0) {
+        throw EXCEPT("Invalid Sn sweep tile size (tile).");
+    }
+    if ((tile_ > 0) && ((sweep_mode_ == SweepMode::WAVEFRONT) ||
+                        (sweep_mode_ == SweepMode::KBA))) {
+        Warn("The wavefront and KBA Sn sweeps are not tiled.");
+    }
+
+    if (sweep_mode_ == SweepMode::WAVEFRONT) {
+        int nx = mesh_.nx();
+        int ny = mesh_.ny();
+        int nz = mesh_.nz();
+        hyperplanes_.resize(nx + ny + nz - 2);
+        for (int iz = 0; iz < nz; iz++) {
+            for (int iy = 0; iy < ny; iy++) {
+                for (int ix = 0; ix < nx; ix++) {
+                    hyperplanes_[ix + iy + iz].push_back(
+                        ix + nx * (iy + ny * iz));
+                }
+            }
+        }
+    }
+
+    // Cut the mesh into one block per process for the KBA sweep, which is
+    // pipelined over chunks of kba_planes planes
+    if (sweep_mode_ == SweepMode::KBA) {
+        int planes = input.attribute("kba_planes").as_int(1);
+        if (planes < 1) {
+            throw EXCEPT("Invalid number of planes per KBA chunk "
+                         "(kba_planes).");
+        }
+        kba_.reset(
+            new KBADomain(mesh_, ParEnv.n_rank(), ParEnv.rank(), planes));
+        LogFile << *kba_;
+    } else if (!input.attribute("kba_planes").empty()) {
+        Warn("kba_planes is only used by the KBA Sn sweep");
+    }
+
+    // Determine which sweep kernel to use
+    if (!input.attribute("kernel").empty()) {
+        std::string in_string = input.attribute("kernel").value();
+        sanitize(in_string);
+        if (in_string == "mg") {
+            multigroup_kernel_ = true;
+        } else if (in_string == "1g") {
+            multigroup_kernel_ = false;
+        } else {
+            throw EXCEPT("Unrecognized sweep kernel option.");
+        }
+    }
+
+    if (multigroup_kernel_ && gmres_inner_) {
+        throw EXCEPT("GMRES inner iterations need the one-group Sn kernel.");
+    }
+
+    if (multigroup_kernel_) {
+        if (sweep_mode_ != SweepMode::ANGLE) {
+            throw EXCEPT("The multi-group Sn kernel only supports the "
+                         "angle sweep.");
+        }
+        group_block_ = input.attribute("group_block").as_int(n_group_);
+        if ((group_block_ < 1) || (group_block_ > n_group_)) {
+            throw EXCEPT("Invalid group block size (group_block).");
+        }
+        LogFile << "Using the multi-group Sn kernel with blocks of "
+                << group_block_ << " groups" << std::endl;
+
+        source_mg_.resize(n_reg_, n_group_);
+        qbar_mg_.resize(n_reg_, n_group_);
+        xstr_mg_.resize(n_reg_, n_group_);
+        source_mg_ = 0.0;
+        qbar_mg_   = 0.0;
+        xstr_mg_   = 0.0;
+
+        bc_out_mg_.reset(new BoundaryCondition(group_block_, ang_quad_,
+                                               bc_type_,
+                                               boundary_helper(mesh)));
+    } else if (!input.attribute("group_block").empty()) {
+        Warn("group_block is only used by the multi-group Sn kernel");
+    }
+
+    // Record the work of each thread on each angle
+    if (input.attribute("workload_stats").as_bool(false)) {
+        if (multigroup_kernel_ || (sweep_mode_ != SweepMode::ANGLE)) {
+            Warn("Sn workload statistics are only recorded by the "
+                 "one-group angle sweep");
+        }
+        workload_.enable({ang_quad_.ndir()});
+    }
+
+    // Sweep the inner iterations that do not produce currents on the device
+    if (input.attribute("offload").as_bool(false)) {
+        if (multigroup_kernel_) {
+            throw EXCEPT("Offloaded Sn sweeps need the one-group kernel.");
+        }
+        if (kba_) {
+            throw EXCEPT("Offloaded Sn sweeps can not be distributed.");
+        }
+#ifndef MOCC_USE_OFFLOAD
+        Warn("Built without offload support. Offloaded Sn sweeps will run on "
+             "the host.");
+#endif
+        LogFile << "Offloading Sn sweeps" << std::endl;
+        device_.reset(new DeviceSnSweep(mesh_.nx(), mesh_.ny(), mesh_.nz(),
+                                        mesh.is_2d(), ang_quad_, rdx_, rdy_,
+                                        rdz_, macroplanes_));
+    }
+
     // For now, the BC doesnt support parallel boundary updates, so
     // disable Gauss-Seidel boundary update if we are using multiple
-    // threads.
+    // threads. The wavefront sweep only works on one octant at a time, so
+    // it can do Gauss-Seidel updates between octants safely.
     /// \todo Add support for multi-threaded G-S boundary update in Sn
-    if ((omp_get_max_threads() > 1) && gs_boundary_) {
+    if ((omp_get_max_threads() > 1) && gs_boundary_ &&
+        (sweep_mode_ != SweepMode::WAVEFRONT)) {
         gs_boundary_ = false;
         Warn("Disabling Gauss-Seidel boundary update "
              "in parallel Sn");
     }
+    // The KBA sweep only has the outgoing boundary fluxes once they have
+    // been summed over the processes, after the sweep
+    if (kba_ && gs_boundary_) {
+        gs_boundary_ = false;
+        Warn("Disabling Gauss-Seidel boundary update in the KBA Sn sweep");
+    }
+
+    // The Jacobi update of the angle sweeps can swap the outgoing face
+    // fluxes in, instead of copying them
+    if (!gs_boundary_ && !multigroup_kernel_ && !device_ &&
+        (sweep_mode_ == SweepMode::ANGLE)) {
+        double_buffer_ = true;
+        bc_in_.enable_double_buffer();
+    }
+
+    // Keep only the groups being swept in full precision on the boundaries
+    if (!input.attribute("boundary_precision").empty()) {
+        std::string in_string = input.attribute("boundary_precision").value();
+        sanitize(in_string);
+        if (in_string == "single") {
+            bc_in_.enable_packed_storage(multigroup_kernel_ ? group_block_
+                                                            : 1);
+        } else if (in_string != "double") {
+            throw EXCEPT("Unrecognized boundary precision option.");
+        }
+    }
 
     timer_.toc();
     timer_init_.toc();
@@ -210,6 +411,25 @@ ArrayB2 SnSweeper::pin_powers_2d() const {
     return powers;
 }
 
+void SnSweeper::set_pipeline(const AnglePipeline *pipeline)
+{
+    if (pipeline) {
+        if (sweep_mode_ != SweepMode::ANGLE || device_ || multigroup_kernel_ ||
+            gmres_inner_) {
+            throw EXCEPT("Pipelined Sn sweeps need the one-group angle "
+                         "sweep");
+        }
+        if (mesh_.is_2d()) {
+            throw EXCEPT("Pipelined Sn sweeps need a 3-D mesh");
+        }
+        if (pipeline->n_ang() != ang_quad_.ndir() / 2) {
+            throw EXCEPT("Pipeline does not match the angular quadrature");
+        }
+    }
+    pipeline_ = pipeline;
+    return;
+}
+
 void SnSweeper::check_balance(int group) const
 {
     if (!coarse_data_) {
@@ -242,14 +462,92 @@ void SnSweeper::check_balance(int group) const
         b += (*source_)[icell] * vol_[icell];
 
         // Internal removal
-        b -=
-            flux_1g_(icell) * (*xs_mesh_)[icell].xsmacrm()[group] * vol_[icell];
+        b -= flux_1g_(icell) * xs_mesh_->xsrm(group)[icell] * vol_[icell];
 
         std::cout << "Cell balance: " << b << std::endl;
     }
     std::cout << std::endl;
 }
 
+void SnSweeper::write_checkpoint(H5Node &node) const
+{
+    TransportSweeper::write_checkpoint(node);
+    bc_in_.write(node, "boundary");
+    return;
+}
+
+void SnSweeper::read_checkpoint(H5Node &node)
+{
+    TransportSweeper::read_checkpoint(node);
+    bc_in_.read(node, "boundary");
+    return;
+}
+
+void SnSweeper::self_scatter_mg(int g_first, int g_last)
+{
+    for (const auto &xsr : *xs_mesh_) {
+        for (int ig = g_first; ig <= g_last; ig++) {
+            real_t xssc = xsr.xsmacsc().to(ig)[ig];
+            for (const int i : xsr.reg()) {
+                qbar_mg_(i, ig) =
+                    (source_mg_(i, ig) + flux_(i, ig) * xssc) * RFPI;
+            }
+        }
+    }
+
+    return;
+} // self_scatter_mg( g_first, g_last )
+
+void SnSweeper::output_performance(H5Node &node) const
+{
+    TransportSweeper::output_performance(node);
+
+    real_t cell_angles = (real_t)n_reg_ * ang_quad_.ndir() * n_sweep_inner_;
+    real_t sweep_time  = timer_sweep_.time();
+
+    node.write("cell_angles", cell_angles);
+    node.write("sweep_time", sweep_time);
+    node.write("cell_angles_per_second",
+               sweep_time > 0.0 ? cell_angles / sweep_time : 0.0);
+    node.write("xs_homogenizations_skipped",
+               std::static_pointer_cast<XSMeshHomogenized>(xs_mesh_)
+                   ->n_skipped());
+    if (workload_.enabled()) {
+        auto g = node.create_group("workload");
+        workload_.output(g);
+        LogFile << "Sn ";
+        workload_.print(LogFile);
+    }
+    return;
+}
+
+void SnSweeper::memory(MemoryReport &report) const
+{
+    TransportSweeper::memory(report);
+
+    report.add("boundary",
+               bc_in_.memory() + bc_out_.memory() +
+                   (bc_out_mg_ ? bc_out_mg_->memory() : 0));
+
+    size_t hyperplanes = 0;
+    for (const auto &h : hyperplanes_) {
+        hyperplanes += bytes(h);
+    }
+    report.add("work_arrays", xstr_.memory() + bytes(rdx_) + bytes(rdy_) +
+                                  bytes(rdz_) + hyperplanes);
+    report.add("multigroup_arrays",
+               bytes(source_mg_) + bytes(qbar_mg_) + bytes(xstr_mg_));
+    if (kba_) {
+        report.add("kba", kba_->memory() + bytes(kba_flux_) + bytes(kba_x_) +
+                              bytes(kba_y_) + bytes(kba_z_) +
+                              bytes(kba_bc_));
+    }
+    if (device_) {
+        report.add("device", device_->memory());
+    }
+    return;
+}
+
 void SnSweeper::output(H5Node &node) const
 {
     auto dims = mesh_.dimensions();
@@ -15,13 +15,18 @@
 */
 #pragma once
 
+#include <memory>
+#include "util/angle_pipeline.hpp"
+#include "util/first_touch.hpp"
 #include "util/pugifwd.hpp"
 #include "util/timers.hpp"
 #include "util/utils.hpp"
+#include "util/workload.hpp"
 #include "core/angular_quadrature.hpp"
 #include "core/boundary_condition.hpp"
 #include "core/transport_sweeper.hpp"
-#include "cell_worker.hpp"
+#include "device_sn_sweep.hpp"
+#include "kba_domain.hpp"
 
 namespace mocc {
 namespace sn {
@@ -31,13 +36,34 @@ public:
 
     void initialize() override final
     {
-        flux_     = 1.0;
-        flux_old_ = 1.0;
+        // Touch the flux from the threads that reduce into it
+        first_touch(flux_.data(), flux_.size(), (real_t)1.0);
+        first_touch(flux_old_.data(), flux_old_.size(), (real_t)1.0);
         bc_in_.initialize_scalar(1.0 / FPI);
 
+        // Allocate the thread-private flux up front, rather than on the
+        // first sweep
+        thread_flux_.resize(n_reg_);
+
+        return;
+    }
+
+    /**
+     * \copydoc TransportSweeper::initialize_boundary()
+     */
+    void initialize_boundary(const ArrayB1 &spectrum) override final
+    {
+        ArrayB1 bound_val(n_group_);
+        bound_val = spectrum / FPI;
+        bc_in_.initialize_spectrum(bound_val);
         return;
     }
 
+    int group_block() const override final
+    {
+        return multigroup_kernel_ ? group_block_ : 1;
+    }
+
     /**
      * \copydoc TransportSweeper::get_pin_flux_1g()
      *
@@ -149,6 +175,43 @@ public:
         return std::sqrt(resid);
     }
 
+    /**
+     * \brief Set whether negative scalar fluxes are zeroed after each group
+     * sweep
+     *
+     * This is on by default. A sweeper that solves for a flux correction,
+     * which may rightly be negative, should turn it off.
+     */
+    void set_negative_fixup(bool fixup)
+    {
+        negative_fixup_ = fixup;
+        return;
+    }
+
+    /**
+     * \brief Zero the incoming boundary flux of a single group
+     */
+    void zero_boundary(int group)
+    {
+        VecF zero(bc_in_.size_per_group(), 0.0);
+        bc_in_.set_group(group, zero.data());
+        return;
+    }
+
+    /**
+     * \brief Sweep each 2-D angle only once \p pipeline has released it
+     *
+     * This lets the sweep run alongside whatever produces the data for its
+     * angles. The sweep waits for \ref AnglePipeline::begin() before it
+     * starts, and for \ref AnglePipeline::finish() before its last inner
+     * iteration, which tallies the currents. The cross sections are not
+     * updated by the sweep in the meantime, since the producer is expected
+     * to do so before it begins. Pass null to go back to regular sweeps.
+     *
+     * Only the one-group angle sweeps of 3-D meshes are supported.
+     */
+    void set_pipeline(const AnglePipeline *pipeline);
+
     /**
      * \brief Re-assign the angular quadrature.
      */
@@ -170,6 +233,29 @@ public:
 
     virtual void output(H5Node &node) const override;
 
+    /**
+     * \copydoc TransportSweeper::write_checkpoint()
+     *
+     * In addition to the flux, the incoming boundary condition is stored.
+     */
+    void write_checkpoint(H5Node &node) const override;
+
+    void read_checkpoint(H5Node &node) override;
+
+    /**
+     * \copybrief TransportSweeper::output_performance()
+     *
+     * Adds the number of cell-angles swept and the sweep rate.
+     */
+    void output_performance(H5Node &node) const override;
+
+    /**
+     * \copybrief TransportSweeper::memory()
+     *
+     * Adds the boundary conditions and per-group work arrays.
+     */
+    void memory(MemoryReport &report) const override;
+
 protected:
     Timer &timer_;
     Timer &timer_init_;
@@ -179,6 +265,16 @@ protected:
 
     VecI macroplanes_;
 
+    // Reciprocal pin pitches along each axis, so that the sweep kernels can
+    // form optical thicknesses without dividing
+    VecF rdx_;
+    VecF rdy_;
+    VecF rdz_;
+
+    // Whether all pins share the same x pitch and the same y pitch. If so,
+    // the radial optical thicknesses only depend on angle.
+    bool uniform_pitch_;
+
     unsigned int n_inner_;
 
     // Boundary condition enumeration
@@ -201,6 +297,77 @@ protected:
     // Gauss-Seidel BC update?
     bool gs_boundary_;
 
+    // Zero negative scalar fluxes at the end of each group sweep?
+    bool negative_fixup_;
+
+    // Sweep the face fluxes of the Jacobi boundary update directly in the
+    // spare storage of bc_in_, and swap it in, rather than copying them
+    // back from bc_out_. Only for the angle sweeps of the one-group kernel.
+    bool double_buffer_;
+
+    // How the angles and cells of a sweep are distributed among threads.
+    // ANGLE sweeps each angle on its own thread, WAVEFRONT sweeps the
+    // hyperplanes of each octant in parallel, and OCTANT sweeps batches of
+    // angles from the same octant together, vectorized over angles. KBA
+    // distributes blocks of the mesh among processes instead.
+    enum class SweepMode { ANGLE, WAVEFRONT, OCTANT, KBA };
+    SweepMode sweep_mode_;
+
+    // Cells on each diagonal hyperplane of the mesh, for the wavefront
+    // sweep. Cells are stored as indices into an nx * ny * nz block, in
+    // sweep-local coordinates (i.e. counting from the upwind corner). Only
+    // built for the WAVEFRONT sweep mode.
+    std::vector<VecI> hyperplanes_;
+
+    // Edge length, in pins, of the radial tiles that the 3-D sweeps traverse
+    // the mesh in. Each column of tiles is swept from the bottom to the top
+    // of the mesh before moving on to the next, so that the z-normal face
+    // fluxes of a tile stay in cache. Zero sweeps whole planes at a time.
+    int tile_;
+
+    // Block of the mesh swept by this process, for the KBA sweep mode
+    std::unique_ptr<KBADomain> kba_;
+
+    // Work arrays for the KBA sweep: the scalar flux tallied by this
+    // process, the face fluxes of its block, and the outgoing boundary
+    // fluxes of a group, to be summed over the processes
+    VecF kba_flux_;
+    VecF kba_x_;
+    VecF kba_y_;
+    VecF kba_z_;
+    VecF kba_bc_;
+
+    // Device copy of the mesh and angles, used for the sweeps that do not
+    // produce currents if present
+    std::unique_ptr<DeviceSnSweep> device_;
+
+    // Per-thread work done on each angle by the one-group angle sweeps. Only
+    // recorded if requested.
+    WorkloadStats workload_;
+
+    // Multi-group sweep kernel options. When enabled, groups are swept in
+    // blocks of group_block_, with the face fluxes stored group-innermost
+    bool multigroup_kernel_;
+    int group_block_;
+
+    // Multi-group storage for the multi-group kernel, indexed by [cell,
+    // group], so that the groups of a cell are contiguous. Only allocated
+    // when the multi-group kernel is in use. source_mg_ is the source
+    // without self-scatter, as it is handed to sweep(), qbar_mg_ is the
+    // transport source, and xstr_mg_ is the expanded transport cross
+    // section.
+    ArrayB2 source_mg_;
+    ArrayB2 qbar_mg_;
+    ArrayB2 xstr_mg_;
+
+    // Outgoing boundary condition for a block of groups. Null unless the
+    // multi-group kernel is in use.
+    std::unique_ptr<BoundaryCondition> bc_out_mg_;
+
+    // Source of the 2-D angles for a pipelined sweep. Null for a regular
+    // sweep. See set_pipeline().
+    const AnglePipeline *pipeline_;
+
     // Protected methods
     /**
      * \brief Grab data (XS, etc.) from one or more external files
@@ -213,6 +380,25 @@ protected:
      */
     void check_balance(int group) const;
 
+    /**
+     * \brief Update the self-scatter contribution to \c qbar_mg_ for a block
+     * of groups, mirroring \ref SourceIsotropic::self_scatter().
+     */
+    void self_scatter_mg(int g_first, int g_last);
+
+    /**
+     * \brief Return the storage to sweep a face flux of an angle in
+     *
+     * With double buffering, this is the next incoming face of \c bc_in_
+     * that the outgoing flux feeds, if any, so that the boundary update is
+     * a swap. Otherwise, it is the face of \c bc_out_.
+     */
+    real_t *sweep_face(int iang, Normal norm)
+    {
+        real_t *face = double_buffer_ ? bc_in_.next_face(iang, norm) : nullptr;
+        return face ? face : bc_out_.get_face(0, iang, norm).second;
+    }
+
     /**
      * This funtion template is used to permit flexibility in the
      * incoming
@@ -230,74 +416,94 @@ protected:
      */
     template <class Function> void update_incoming_generic(Function f)
     {
-        for (auto g : groups_) {
-            int iang = 0;
-            for (auto ang : ang_quad_) {
-                // X-normal
-                {
-                    real_t *face =
-                        bc_in_.get_face(g, iang, Normal::X_NORM).second;
-                    int ixx = (ang.ox > 0.0) ? 0 : mesh_.nx() - 1;
-                    Surface upwind =
-                        (ang.ox > 0.0) ? Surface::WEST : Surface::EAST;
-                    int sense = (upwind == Surface::WEST) ? 1 : 0;
-                    int i     = 0;
-                    for (unsigned iz = 0; iz < mesh_.nz(); iz++) {
-                        for (unsigned iy = 0; iy < mesh_.ny(); iy++) {
-                            int icell =
-                                mesh_.coarse_cell(Position(ixx, iy, iz));
-                            int is = mesh_.coarse_surf(icell, upwind);
-
-                            face[i] = f(face[i], is, g, sense);
-
-                            i++;
-                        }
-                    }
-                } // X-normal
-                // Y-normal
-                {
-                    real_t *face =
-                        bc_in_.get_face(g, iang, Normal::Y_NORM).second;
-                    int iyy = (ang.oy > 0.0) ? 0 : mesh_.ny() - 1;
-                    Surface upwind =
-                        (ang.oy > 0.0) ? Surface::SOUTH : Surface::NORTH;
-                    int sense = (upwind == Surface::SOUTH) ? 1 : 0;
-                    int i     = 0;
-                    for (unsigned iz = 0; iz < mesh_.nz(); iz++) {
-                        for (unsigned ix = 0; ix < mesh_.nx(); ix++) {
-                            int icell =
-                                mesh_.coarse_cell(Position(ix, iyy, iz));
-                            int is = mesh_.coarse_surf(icell, upwind);
-
-                            face[i] = f(face[i], is, g, sense);
-
-                            i++;
-                        }
-                    }
-                } // Y-normal
-                // Z-normal
-                {
-                    real_t *face =
-                        bc_in_.get_face(g, iang, Normal::Z_NORM).second;
-                    int izz = (ang.oz > 0.0) ? 0 : mesh_.nz() - 1;
-                    Surface upwind =
-                        (ang.oz > 0.0) ? Surface::BOTTOM : Surface::TOP;
-                    int sense = (upwind == Surface::BOTTOM) ? 1 : 0;
-                    int i     = 0;
+        // Each group and angle updates its own faces, so they are done in
+        // parallel
+        const int n_group = groups_.size();
+        const int n_ang   = ang_quad_.ndir();
+        auto update_angle = [&](int g, int iang) {
+            const auto &ang = ang_quad_[iang];
+            // X-normal
+            {
+                real_t *face =
+                    bc_in_.get_face(g, iang, Normal::X_NORM).second;
+                int ixx = (ang.ox > 0.0) ? 0 : mesh_.nx() - 1;
+                Surface upwind =
+                    (ang.ox > 0.0) ? Surface::WEST : Surface::EAST;
+                int sense = (upwind == Surface::WEST) ? 1 : 0;
+                int i     = 0;
+                for (unsigned iz = 0; iz < mesh_.nz(); iz++) {
                     for (unsigned iy = 0; iy < mesh_.ny(); iy++) {
-                        for (unsigned ix = 0; ix < mesh_.nx(); ix++) {
-                            int icell =
-                                mesh_.coarse_cell(Position(ix, iy, izz));
-                            int is = mesh_.coarse_surf(icell, upwind);
+                        int icell =
+                            mesh_.coarse_cell(Position(ixx, iy, iz));
+                        int is = mesh_.coarse_surf(icell, upwind);
 
-                            face[i] = f(face[i], is, g, sense);
+                        face[i] = f(face[i], is, g, sense);
 
-                            i++;
-                        }
+                        i++;
                     }
-                } // Z-normal
+                }
+            } // X-normal
+            // Y-normal
+            {
+                real_t *face =
+                    bc_in_.get_face(g, iang, Normal::Y_NORM).second;
+                int iyy = (ang.oy > 0.0) ? 0 : mesh_.ny() - 1;
+                Surface upwind =
+                    (ang.oy > 0.0) ? Surface::SOUTH : Surface::NORTH;
+                int sense = (upwind == Surface::SOUTH) ? 1 : 0;
+                int i     = 0;
+                for (unsigned iz = 0; iz < mesh_.nz(); iz++) {
+                    for (unsigned ix = 0; ix < mesh_.nx(); ix++) {
+                        int icell =
+                            mesh_.coarse_cell(Position(ix, iyy, iz));
+                        int is = mesh_.coarse_surf(icell, upwind);
+
+                        face[i] = f(face[i], is, g, sense);
+
+                        i++;
+                    }
+                }
+            } // Y-normal
+            // Z-normal
+            {
+                real_t *face =
+                    bc_in_.get_face(g, iang, Normal::Z_NORM).second;
+                int izz = (ang.oz > 0.0) ? 0 : mesh_.nz() - 1;
+                Surface upwind =
+                    (ang.oz > 0.0) ? Surface::BOTTOM : Surface::TOP;
+                int sense = (upwind == Surface::BOTTOM) ? 1 : 0;
+                int i     = 0;
+                for (unsigned iy = 0; iy < mesh_.ny(); iy++) {
+                    for (unsigned ix = 0; ix < mesh_.nx(); ix++) {
+                        int icell =
+                            mesh_.coarse_cell(Position(ix, iy, izz));
+                        int is = mesh_.coarse_surf(icell, upwind);
+
+                        face[i] = f(face[i], is, g, sense);
+
+                        i++;
+                    }
+                }
+            } // Z-normal
+        };
+
+        // Packed boundary conditions only hold a few groups in full
+        // precision at a time, so the groups are loaded one after another
+        if (bc_in_.packed()) {
+            for (int ig = 0; ig < n_group; ig++) {
+                bc_in_.load(groups_[ig]);
+#pragma omp parallel for schedule(static)
+                for (int iang = 0; iang < n_ang; iang++) {
+                    update_angle(groups_[ig], iang);
+                }
+            }
+            return;
+        }
 
-                iang++;
+#pragma omp parallel for collapse(2) schedule(static)
+        for (int ig = 0; ig < n_group; ig++) {
+            for (int iang = 0; iang < n_ang; iang++) {
+                update_angle(groups_[ig], iang);
             } // angles
         }     // groups
     }
@@ -16,11 +16,11 @@
 
 #pragma once
 
+#include <cmath>
 #include <iostream>
 
 #include "util/force_inline.hpp"
 #include "core/mesh.hpp"
-#include "sn/cell_worker.hpp"
 #include "sn/sn_sweeper.hpp"
 
 namespace mocc {
@@ -31,6 +31,9 @@ namespace sn {
  */
 class SnSweeper_DD : public SnSweeperVariant<SnSweeper_DD> {
 public:
+    static constexpr bool group_independent = true;
+    static constexpr bool device_capable    = true;
+
     SnSweeper_DD(const pugi::xml_node &input, const CoreMesh &mesh)
         : SnSweeperVariant<SnSweeper_DD>(input, mesh)
     {
@@ -41,8 +44,7 @@ public:
                                       real_t &flux_z, real_t q, real_t xstr,
                                       int i, const ThreadState &t_state) const
     {
-        size_t ix = i % mesh_.nx();
-        real_t tx = t_state.ox / mesh_.dx(ix);
+        real_t tx = t_state.tx;
         real_t psi =
             2.0 * (tx * flux_x + t_state.ty * flux_y + t_state.tz * flux_z) + q;
         psi /= 2.0 * (tx + t_state.ty + t_state.tz) + xstr;
@@ -58,8 +60,7 @@ public:
                                          real_t q, real_t xstr, int i,
                                          const ThreadState &t_state) const
     {
-        size_t ix  = i % mesh_.nx();
-        real_t tx  = t_state.ox / mesh_.dx(ix);
+        real_t tx  = t_state.tx;
         real_t psi = 2.0 * (tx * flux_x + t_state.ty * flux_y) + q;
         psi /= 2.0 * (tx + t_state.ty) + xstr;
 
@@ -68,6 +69,102 @@ public:
 
         return psi;
     }
+
+    void MOCC_FORCE_INLINE evaluate_batch(real_t *flux_x, real_t *flux_y,
+                                          real_t *flux_z, const real_t *q,
+                                          real_t xstr, int i,
+                                          const AngleBatch &batch,
+                                          real_t *psi) const
+    {
+        const int n      = batch.size;
+        const real_t rdx = batch.rdx;
+        const real_t rdy = batch.rdy;
+        const real_t rdz = batch.rdz;
+#pragma omp simd
+        for (int ia = 0; ia < n; ia++) {
+            real_t tx = batch.ox[ia] * rdx;
+            real_t ty = batch.oy[ia] * rdy;
+            real_t tz = batch.oz[ia] * rdz;
+            real_t p =
+                2.0 * (tx * flux_x[ia] + ty * flux_y[ia] + tz * flux_z[ia]) +
+                q[ia];
+            p /= 2.0 * (tx + ty + tz) + xstr;
+
+            flux_x[ia] = 2.0 * p - flux_x[ia];
+            flux_y[ia] = 2.0 * p - flux_y[ia];
+            flux_z[ia] = 2.0 * p - flux_z[ia];
+            psi[ia]    = p;
+        }
+        return;
+    }
+
+    void MOCC_FORCE_INLINE evaluate_batch_2d(real_t *flux_x, real_t *flux_y,
+                                             const real_t *q, real_t xstr,
+                                             int i, const AngleBatch &batch,
+                                             real_t *psi) const
+    {
+        const int n      = batch.size;
+        const real_t rdx = batch.rdx;
+        const real_t rdy = batch.rdy;
+#pragma omp simd
+        for (int ia = 0; ia < n; ia++) {
+            real_t tx = batch.ox[ia] * rdx;
+            real_t ty = batch.oy[ia] * rdy;
+            real_t p  = 2.0 * (tx * flux_x[ia] + ty * flux_y[ia]) + q[ia];
+            p /= 2.0 * (tx + ty) + xstr;
+
+            flux_x[ia] = 2.0 * p - flux_x[ia];
+            flux_y[ia] = 2.0 * p - flux_y[ia];
+            psi[ia]    = p;
+        }
+        return;
+    }
+
+    void MOCC_FORCE_INLINE evaluate_mg(real_t *flux_x, real_t *flux_y,
+                                       real_t *flux_z, const real_t *q,
+                                       const real_t *xstr, int ng, int i,
+                                       const ThreadState &t_state,
+                                       real_t *psi) const
+    {
+        const real_t tx = t_state.tx;
+        const real_t ty = t_state.ty;
+        const real_t tz = t_state.tz;
+        const real_t t2 = 2.0 * (tx + ty + tz);
+#pragma omp simd
+        for (int ig = 0; ig < ng; ig++) {
+            real_t p =
+                2.0 * (tx * flux_x[ig] + ty * flux_y[ig] + tz * flux_z[ig]) +
+                q[ig];
+            p /= t2 + xstr[ig];
+
+            flux_x[ig] = 2.0 * p - flux_x[ig];
+            flux_y[ig] = 2.0 * p - flux_y[ig];
+            flux_z[ig] = 2.0 * p - flux_z[ig];
+            psi[ig]    = p;
+        }
+        return;
+    }
+
+    void MOCC_FORCE_INLINE evaluate_mg_2d(real_t *flux_x, real_t *flux_y,
+                                          const real_t *q, const real_t *xstr,
+                                          int ng, int i,
+                                          const ThreadState &t_state,
+                                          real_t *psi) const
+    {
+        const real_t tx = t_state.tx;
+        const real_t ty = t_state.ty;
+        const real_t t2 = 2.0 * (tx + ty);
+#pragma omp simd
+        for (int ig = 0; ig < ng; ig++) {
+            real_t p = 2.0 * (tx * flux_x[ig] + ty * flux_y[ig]) + q[ig];
+            p /= t2 + xstr[ig];
+
+            flux_x[ig] = 2.0 * p - flux_x[ig];
+            flux_y[ig] = 2.0 * p - flux_y[ig];
+            psi[ig]    = p;
+        }
+        return;
+    }
 };
 
 /**
@@ -77,6 +174,8 @@ public:
  */
 class SnSweeper_DD_SC : public SnSweeperVariant<SnSweeper_DD_SC> {
 public:
+    static constexpr bool group_independent = true;
+
     SnSweeper_DD_SC(const pugi::xml_node &input, const CoreMesh &mesh)
         : SnSweeperVariant<SnSweeper_DD_SC>(input, mesh)
     {
@@ -86,8 +185,7 @@ public:
     real_t evaluate_2d(real_t &flux_x, real_t &flux_y, real_t q, real_t xstr,
                        int i, const ThreadState &t_state) const
     {
-        size_t ix  = i % mesh_.nx();
-        real_t tx  = t_state.ox / mesh_.dx(ix);
+        real_t tx  = t_state.tx;
         real_t psi = 2.0 * (tx * flux_x + t_state.ty * flux_y) + q;
         psi /= 2.0 * (tx + t_state.ty) + xstr;
 
@@ -100,8 +198,7 @@ public:
     real_t evaluate(real_t &flux_x, real_t &flux_y, real_t &flux_z, real_t q,
                     real_t xstr, int i, const ThreadState &t_state) const
     {
-        size_t ix = i % mesh_.nx();
-        real_t tx = t_state.ox / mesh_.dx(ix);
+        real_t tx = t_state.tx;
 
         real_t tau    = xstr / t_state.tz;
         real_t rho    = 1.0 / tau - 1.0 / (std::exp(tau) - 1.0);
@@ -16,11 +16,16 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
 #include "pugixml.hpp"
 #include "util/blitz_typedefs.hpp"
 #include "util/error.hpp"
 #include "util/files.hpp"
 #include "util/global_config.hpp"
+#include "util/omp_guard.h"
+#include "util/profile.hpp"
 #include "util/utils.hpp"
 #include "core/angular_quadrature.hpp"
 #include "core/coarse_data.hpp"
@@ -40,13 +45,17 @@ namespace sn {
  * that type for use elsewhere, so that the template parameter need not be
  * known to the client code. In uses where the differencing scheme is indeed
  * known, the client code may instantiate their own sweeper of this class
- * and have access to a fully-typed \ref CellWorker member. This is useful
- * in the \ref cmdo::PlaneSweeper_2D3D class, which knows what type of \ref
- * CellWorker it is using.
+ * and have access to the fully-typed sweeper. This is useful in the \ref
+ * cmdo::PlaneSweeper_2D3D class, which knows what differencing scheme it is
+ * using.
  *
  * Specialization is carried out using the Curiously-Recurring Template pattern.
  * See the specific implementations (e.g. \ref SnSweeper_DD or \ref
- * cmdo::SnSweeper_CDD).
+ * cmdo::SnSweeper_CDD). The \c evaluate() and \c evaluate_2d() methods of
+ * the \c Equation are resolved at compile time and should be inline; the
+ * sweep kernels supply the optical thicknesses (\ref ThreadState::tx, etc.)
+ * and the cell's index within its plane, so they need not divide or take
+ * a modulus.
  */
 template <class Equation> class SnSweeperVariant : public SnSweeper {
 public:
@@ -56,8 +65,10 @@ public:
      */
     struct ThreadState {
     public:
+        real_t tx;
         real_t ty;
         real_t tz;
+        int ixy;
         int iang;
         int iang_2d;
         int macroplane;
@@ -66,9 +77,69 @@ public:
         real_t oz;
         Angle angle;
     };
+
+    /**
+     * \brief State for a batch of angles from the same octant, as used by
+     * \ref sweep_1g_octant().
+     *
+     * Per-angle data are stored in arrays so that the batched cell updates
+     * can be vectorized over angles. The direction cosines are absolute
+     * values. The reciprocal cell dimensions, planar cell index and
+     * macroplane are set by the sweep for each cell before calling \ref evaluate_batch() or \ref
+     * evaluate_batch_2d().
+     */
+    struct AngleBatch {
+    public:
+        static constexpr int max_size = 8;
+        int size;
+        int iang[max_size];
+        int iang_2d[max_size];
+        real_t ox[max_size];
+        real_t oy[max_size];
+        real_t oz[max_size];
+        real_t wgt[max_size];
+        const VectorX *q[max_size];
+        Angle angle[max_size];
+
+        real_t rdx;
+        real_t rdy;
+        real_t rdz;
+        int ixy;
+        int macroplane;
+    };
+
+    /**
+     * \brief Whether the cell update depends on the group only through its
+     * arguments.
+     *
+     * The multi-group kernel sweeps several groups at once, so it can only be
+     * used with differencing schemes that don't look up group-dependent data
+     * of their own (e.g. the CDD correction factors). Such schemes should
+     * hide this with \c true.
+     */
+    static constexpr bool group_independent = false;
+
+    /**
+     * \brief Whether the cell update can be done by \ref DeviceSnSweep
+     *
+     * This is the case for diamond difference, and for corrected diamond
+     * difference with diamond difference in the axial dimension. Such
+     * schemes should hide this with \c true, and \ref device_factors() with
+     * their correction factors, if any.
+     */
+    static constexpr bool device_capable = false;
+
     SnSweeperVariant(const pugi::xml_node &input, const CoreMesh &mesh)
         : SnSweeper(input, mesh), plane_size_(mesh.nx() * mesh_.ny())
     {
+        if (multigroup_kernel_ && !Equation::group_independent) {
+            throw EXCEPT("The multi-group Sn kernel is not supported by this "
+                         "differencing scheme.");
+        }
+        if (device_ && !Equation::device_capable) {
+            throw EXCEPT("Offloaded Sn sweeps are not supported by this "
+                         "differencing scheme.");
+        }
         return;
     }
 
@@ -91,61 +162,232 @@ public:
             flux_x, flux_y, flux_z, q, xstr, i, t_state);
     }
 
+    /**
+     * \brief Evaluate a cell for each angle in a batch.
+     *
+     * The face fluxes, source and returned angular flux are stored angle-
+     * innermost. This default just calls \ref evaluate() for each angle;
+     * differencing schemes that can, should provide their own, vectorizable
+     * version.
+     */
+    inline void evaluate_batch(real_t *flux_x, real_t *flux_y, real_t *flux_z,
+                               const real_t *q, real_t xstr, int i,
+                               const AngleBatch &batch, real_t *psi) const
+    {
+        ThreadState t_state;
+        t_state.macroplane = batch.macroplane;
+        t_state.ixy        = batch.ixy;
+        for (int ia = 0; ia < batch.size; ia++) {
+            t_state.iang    = batch.iang[ia];
+            t_state.iang_2d = batch.iang_2d[ia];
+            t_state.angle   = batch.angle[ia];
+            t_state.ox      = batch.ox[ia];
+            t_state.oy      = batch.oy[ia];
+            t_state.oz      = batch.oz[ia];
+            t_state.tx      = batch.ox[ia] * batch.rdx;
+            t_state.ty      = batch.oy[ia] * batch.rdy;
+            t_state.tz      = batch.oz[ia] * batch.rdz;
+            psi[ia] = this->evaluate(flux_x[ia], flux_y[ia], flux_z[ia], q[ia],
+                                     xstr, i, t_state);
+        }
+        return;
+    }
+
+    /**
+     * \brief 2-D version of \ref evaluate_batch()
+     */
+    inline void evaluate_batch_2d(real_t *flux_x, real_t *flux_y,
+                                  const real_t *q, real_t xstr, int i,
+                                  const AngleBatch &batch, real_t *psi) const
+    {
+        ThreadState t_state;
+        t_state.macroplane = batch.macroplane;
+        t_state.ixy        = batch.ixy;
+        for (int ia = 0; ia < batch.size; ia++) {
+            t_state.iang    = batch.iang[ia];
+            t_state.iang_2d = batch.iang_2d[ia];
+            t_state.angle   = batch.angle[ia];
+            t_state.ox      = batch.ox[ia];
+            t_state.oy      = batch.oy[ia];
+            t_state.oz      = batch.oz[ia];
+            t_state.tx      = batch.ox[ia] * batch.rdx;
+            t_state.ty      = batch.oy[ia] * batch.rdy;
+            t_state.tz      = batch.oz[ia] * batch.rdz;
+            psi[ia]         = this->evaluate_2d(flux_x[ia], flux_y[ia], q[ia],
+                                        xstr, i, t_state);
+        }
+        return;
+    }
+
+    /**
+     * \brief Evaluate a cell for each group in a block.
+     *
+     * The face fluxes, source, cross section and returned angular flux are
+     * stored group-innermost. This default just calls \ref evaluate() for
+     * each group; differencing schemes that can, should provide their own,
+     * vectorizable version.
+     */
+    inline void evaluate_mg(real_t *flux_x, real_t *flux_y, real_t *flux_z,
+                            const real_t *q, const real_t *xstr, int ng,
+                            int i, const ThreadState &t_state,
+                            real_t *psi) const
+    {
+        for (int ig = 0; ig < ng; ig++) {
+            psi[ig] = this->evaluate(flux_x[ig], flux_y[ig], flux_z[ig], q[ig],
+                                     xstr[ig], i, t_state);
+        }
+        return;
+    }
+
+    /**
+     * \brief 2-D version of \ref evaluate_mg()
+     */
+    inline void evaluate_mg_2d(real_t *flux_x, real_t *flux_y,
+                               const real_t *q, const real_t *xstr, int ng,
+                               int i, const ThreadState &t_state,
+                               real_t *psi) const
+    {
+        for (int ig = 0; ig < ng; ig++) {
+            psi[ig] = this->evaluate_2d(flux_x[ig], flux_y[ig], q[ig],
+                                        xstr[ig], i, t_state);
+        }
+        return;
+    }
+
+    /**
+     * \brief Set up any group-dependent data used by the cell updates.
+     *
+     * This is called once by \ref sweep() for each group, before the inner
+     * iterations. Differencing schemes that need group-dependent
+     * coefficients should hide this, and tabulate the coefficients for the
+     * group, so that the cell updates need not look them up.
+     */
+    void prepare_group(int group)
+    {
+        return;
+    }
+
+    /**
+     * \brief Set up any angle-dependent data used by the cell updates.
+     *
+     * In a pipelined sweep (see \ref SnSweeper::set_pipeline()), this is
+     * called by each thread before it sweeps an angle, once the 2-D angle
+     * \p iang_2d has been released by the pipeline. Schemes that tabulate
+     * data for all angles in \ref prepare_group() should defer that of each
+     * angle to here when pipelined, since it may not be ready before.
+     */
+    void prepare_angle(int group, int iang_2d)
+    {
+        return;
+    }
+
     void sweep(int group) override
     {
         assert(source_);
+        MOCC_PROFILE_ZONE("Sn Sweep");
         timer_.tic();
 
-        timer_xsupdate_.tic();
-        xs_mesh_->update();
-        timer_xsupdate_.toc();
+        // The producer of a pipelined sweep updates the cross sections
+        // before it begins, and may still be using them
+        if (pipeline_) {
+            pipeline_->wait_begin();
+        } else {
+            timer_xsupdate_.tic();
+            xs_mesh_->update();
+            timer_xsupdate_.toc();
+        }
 
         timer_sweep_.tic();
 
         group_ = group;
+        n_sweep_++;
 
         /// \todo add an is_ready() method to the worker, and make sure that
         /// it's ready before continuing.
 
         // Store the transport cross section somewhere useful
         xstr_.expand(group);
+        if (!multigroup_kernel_) {
+            bc_in_.load(group);
+        }
+
+        static_cast<Equation &>(*this).prepare_group(group);
+
+        if (multigroup_kernel_) {
+            // Stash the source and cross sections for this group, and sweep
+            // the whole block once its last group has been handed to us. As
+            // with the multi-group MoC kernel, the in-scatter source within a
+            // block is Jacobi-style.
+            const auto &src = source_->get();
+            for (int i = 0; i < (int)n_reg_; i++) {
+                source_mg_(i, group) = src[i];
+                xstr_mg_(i, group)   = xstr_[i];
+            }
+
+            int g_first = (group / group_block_) * group_block_;
+            int g_last  = std::min(g_first + group_block_, n_group_) - 1;
+            if (group == g_last) {
+                this->sweep_block(g_first, g_last);
+            }
+
+            timer_.toc();
+            timer_sweep_.toc();
+            return;
+        }
 
         flux_1g_.reference(flux_(blitz::Range::all(), group));
 
+        // With GMRES, converge the within-group problem with the incoming
+        // boundary flux held fixed, then finish with a single regular sweep
+        unsigned n_inner = n_inner_;
+        if (gmres_inner_) {
+            VecF bc(bc_in_.size_per_group());
+            bc_in_.copy_group(group, bc.data());
+            n_sweep_inner_ += this->gmres_inner(flux_1g_, [&]() {
+                bc_in_.set_group(group, bc.data());
+                source_->self_scatter(group);
+                this->sweep_1g_dispatch<sn::NoCurrent>(group);
+            });
+            bc_in_.set_group(group, bc.data());
+            n_inner = 1;
+        }
+
         // Perform inner iterations
-        for (unsigned inner = 0; inner < n_inner_; inner++) {
+        for (unsigned inner = 0; inner < n_inner; inner++) {
+            n_sweep_inner_++;
             // Set the source (add upscatter and divide by 4PI)
             source_->self_scatter(group);
-            if (inner == n_inner_ - 1 && coarse_data_) {
+            if (inner == n_inner - 1 && coarse_data_) {
+                // The producer of a pipelined sweep may still be tallying
+                // its own currents
+                if (pipeline_) {
+                    pipeline_->wait_finish();
+                }
                 // Wipe out the existing currents
                 coarse_data_->zero_data(group);
                 coarse_data_->source() = "Sn Sweeper";
-                if (core_mesh_->is_2d()) {
-                    this->sweep_1g_2d<sn::Current>(group);
-                } else {
-                    this->sweep_1g<sn::Current>(group);
+                this->sweep_1g_dispatch<sn::Current>(group);
+                if (!core_mesh_->is_2d()) {
                     coarse_data_->set_has_axial_data(true);
                 }
                 coarse_data_->set_has_radial_data(true);
             } else {
-                if (core_mesh_->is_2d()) {
-                    this->sweep_1g_2d<sn::NoCurrent>(group);
-                } else {
-                    this->sweep_1g<sn::NoCurrent>(group);
-                }
+                this->sweep_1g_dispatch<sn::NoCurrent>(group);
             }
         }
 
         // Clean up zeros
+        if (negative_fixup_) {
             int n_neg = 0;
-        for(auto &v: flux_1g_){
-            if(v < 0) {
-                ++n_neg;
-                v = 0.0;
+            for (auto &v : flux_1g_) {
+                if (v < 0) {
+                    ++n_neg;
+                    v = 0.0;
+                }
+            }
+            if (n_neg > 0) {
+                LogFile << "Fixed " << n_neg << "negative Sn fluxes\n";
             }
-        }
-        if(n_neg > 0) {
-            LogFile << "Fixed " << n_neg << "negative Sn fluxes\n";
         }
 
         timer_.toc();
@@ -154,24 +396,412 @@ public:
     }
 
 protected:
+    /**
+     * \brief Perform inner iterations on a block of groups using the
+     * multi-group kernel.
+     *
+     * \pre The source and cross sections for all groups in the block have
+     * been stored in \c source_mg_ and \c xstr_mg_.
+     */
+    void sweep_block(int g_first, int g_last)
+    {
+        const int ng = g_last - g_first + 1;
+        for (int ig = g_first; ig <= g_last; ig++) {
+            bc_in_.load(ig);
+        }
+        for (unsigned inner = 0; inner < n_inner_; inner++) {
+            n_sweep_inner_ += ng;
+            this->self_scatter_mg(g_first, g_last);
+
+            // Same as the one-group sweep; only tally currents on the last
+            // inner
+            if (inner == n_inner_ - 1 && coarse_data_) {
+                for (int ig = g_first; ig <= g_last; ig++) {
+                    coarse_data_->zero_data(ig);
+                }
+                coarse_data_->source() = "Sn Sweeper";
+                this->sweep_mg_dispatch<sn::Current>(g_first, g_last);
+                if (!core_mesh_->is_2d()) {
+                    coarse_data_->set_has_axial_data(true);
+                }
+                coarse_data_->set_has_radial_data(true);
+            } else {
+                this->sweep_mg_dispatch<sn::NoCurrent>(g_first, g_last);
+            }
+        }
+
+        // Clean up zeros
+        int n_neg = 0;
+        for (int i = 0; i < (int)n_reg_; i++) {
+            for (int ig = g_first; ig <= g_last; ig++) {
+                if (flux_(i, ig) < 0.0) {
+                    ++n_neg;
+                    flux_(i, ig) = 0.0;
+                }
+            }
+        }
+        if (n_neg > 0) {
+            LogFile << "Fixed " << n_neg << " negative Sn fluxes\n";
+        }
+
+        return;
+    }
+
+    /**
+     * \brief Call the multi-group sweep kernel for the pitch uniformity
+     */
+    template <typename CurrentWorker>
+    void sweep_mg_dispatch(int g_first, int g_last)
+    {
+        if (uniform_pitch_) {
+            this->sweep_mg<CurrentWorker, true>(g_first, g_last);
+        } else {
+            this->sweep_mg<CurrentWorker, false>(g_first, g_last);
+        }
+        return;
+    }
+
+    /**
+     * \brief Call the sweep kernel for the selected \ref SweepMode, mesh
+     * dimensionality and pitch uniformity.
+     */
+    template <typename CurrentWorker> void sweep_1g_dispatch(int group)
+    {
+        if (device_ && std::is_same<CurrentWorker, sn::NoCurrent>::value) {
+            this->sweep_1g_device(group);
+        } else if (sweep_mode_ == SweepMode::KBA) {
+            this->sweep_1g_kba<CurrentWorker>(group);
+        } else if (sweep_mode_ == SweepMode::WAVEFRONT) {
+            this->sweep_1g_wavefront<CurrentWorker>(group);
+        } else if (sweep_mode_ == SweepMode::OCTANT) {
+            this->sweep_1g_octant<CurrentWorker>(group);
+        } else if (core_mesh_->is_2d()) {
+            if (uniform_pitch_) {
+                this->sweep_1g_2d<CurrentWorker, true>(group);
+            } else {
+                this->sweep_1g_2d<CurrentWorker, false>(group);
+            }
+        } else {
+            if (uniform_pitch_) {
+                this->sweep_1g<CurrentWorker, true>(group);
+            } else {
+                this->sweep_1g<CurrentWorker, false>(group);
+            }
+        }
+        return;
+    }
+
+    /**
+     * \brief Return the reciprocal correction factors of the current group
+     * for \ref DeviceSnSweep::sweep(), or null for plain diamond difference
+     */
+    const real_t *device_factors() const
+    {
+        return nullptr;
+    }
+
+    /**
+     * \brief One-group Sn sweep on the device, without currents
+     *
+     * The sources and incoming face fluxes of every angle are handed to the
+     * \ref DeviceSnSweep, and the outgoing face fluxes are applied to the
+     * incoming boundary conditions in a Jacobi fashion.
+     */
+    void sweep_1g_device(int group)
+    {
+        const bool is_2d = core_mesh_->is_2d();
+        const int n_ang  = device_->n_ang();
+
+        real_t *xstr = device_->xstr();
+        for (int i = 0; i < (int)n_reg_; i++) {
+            xstr[i] = xstr_[i];
+        }
+        for (int iang = 0; iang < n_ang; iang++) {
+            const VectorX &q = source_->get_transport(iang);
+            std::copy(q.data(), q.data() + n_reg_, device_->source(iang));
+            bc_in_.copy_face(group, iang, Normal::X_NORM,
+                             device_->face(iang, Normal::X_NORM));
+            bc_in_.copy_face(group, iang, Normal::Y_NORM,
+                             device_->face(iang, Normal::Y_NORM));
+            if (!is_2d) {
+                bc_in_.copy_face(group, iang, Normal::Z_NORM,
+                                 device_->face(iang, Normal::Z_NORM));
+            }
+        }
+
+        device_->sweep(static_cast<const Equation &>(*this).device_factors());
+
+        for (int iang = 0; iang < n_ang; iang++) {
+            for (auto norm : {Normal::X_NORM, Normal::Y_NORM, Normal::Z_NORM}) {
+                if (is_2d && (norm == Normal::Z_NORM)) {
+                    continue;
+                }
+                auto face        = bc_out_.get_face(0, iang, norm);
+                const real_t *in = device_->face(iang, norm);
+                std::copy(in, in + face.first, face.second);
+            }
+        }
+        bc_in_.update(group, bc_out_);
+
+        const real_t *flux = device_->flux();
+        for (int i = 0; i < (int)n_reg_; i++) {
+            flux_1g_(i) = flux[i];
+        }
+
+        return;
+    }
+
+    /**
+     * \brief Distributed (KBA) Sn sweep procedure for orthogonal mesh.
+     *
+     * Each process sweeps the block of the mesh given by its \ref KBADomain,
+     * one angle after another, in chunks of planes. The incoming x- and
+     * y-normal face fluxes of each chunk come from the upwind blocks, or
+     * from the boundary condition, and the outgoing ones are sent to the
+     * downwind blocks as soon as the chunk is done. The scalar flux, the
+     * outgoing boundary fluxes and, with \ref sn::Current, the currents
+     * tallied by each block are then summed over the processes, and the
+     * boundary conditions are updated in a Jacobi fashion.
+     *
+     * Every process has the whole incoming boundary condition, so only the
+     * first block adds its upwind contribution to the currents.
+     *
+     * This handles both 2-D and 3-D meshes. Each block is swept by a single
+     * thread.
+     */
+    template <typename CurrentWorker> void sweep_1g_kba(int group)
+    {
+        const bool is_2d  = core_mesh_->is_2d();
+        const int nx      = mesh_.nx();
+        const int ny      = mesh_.ny();
+        const int nz      = is_2d ? 1 : mesh_.nz();
+        const int x0      = kba_->x_begin();
+        const int y0      = kba_->y_begin();
+        const int lx      = kba_->nx();
+        const int ly      = kba_->ny();
+        const int n_ang   = is_2d ? ang_quad_.ndir() / 2 : ang_quad_.ndir();
+        const int n_plane = is_2d ? 1 : kba_->planes();
+
+        CurrentWorker cw(coarse_data_, &mesh_);
+
+        kba_flux_.assign(n_reg_, 0.0);
+        kba_x_.resize(ly * nz);
+        kba_y_.resize(lx * nz);
+        kba_z_.resize(lx * ly);
+
+        // Only the faces on the boundary of this block are written below
+        kba_bc_.assign(bc_out_.size_per_group(), 0.0);
+        bc_out_.set_group(0, kba_bc_.data());
+
+        ThreadState t_state;
+        for (int iang = 0; iang < n_ang; iang++) {
+            Angle angle     = ang_quad_[iang];
+            t_state.iang    = iang;
+            t_state.iang_2d = iang % (ang_quad_.ndir() / 2);
+            t_state.angle   = angle;
+            cw.set_octant(angle);
+
+            const auto &q = source_->get_transport(iang);
+
+            real_t wgt = angle.weight * (is_2d ? PI : HPI);
+            t_state.ox = std::abs(angle.ox);
+            t_state.oy = std::abs(angle.oy);
+            t_state.oz = std::abs(angle.oz);
+
+            const bool pos_x = angle.ox > 0.0;
+            const bool pos_y = angle.oy > 0.0;
+            const bool pos_z = angle.oz > 0.0;
+            const int sttx   = pos_x ? x0 : x0 + lx - 1;
+            const int stty   = pos_y ? y0 : y0 + ly - 1;
+            const int xdir   = pos_x ? 1 : -1;
+            const int ydir   = pos_y ? 1 : -1;
+
+            const int up_x   = kba_->upwind(Normal::X_NORM, pos_x);
+            const int up_y   = kba_->upwind(Normal::Y_NORM, pos_y);
+            const int down_x = kba_->downwind(Normal::X_NORM, pos_x);
+            const int down_y = kba_->downwind(Normal::Y_NORM, pos_y);
+
+            const real_t *x_in = bc_in_.get_face(group, iang, Normal::X_NORM)
+                                     .second;
+            const real_t *y_in = bc_in_.get_face(group, iang, Normal::Y_NORM)
+                                     .second;
+            const real_t *z_in = bc_in_.get_face(group, iang, Normal::Z_NORM)
+                                     .second;
+            real_t *x_out = bc_out_.get_face(0, iang, Normal::X_NORM).second;
+            real_t *y_out = bc_out_.get_face(0, iang, Normal::Y_NORM).second;
+            real_t *z_out = bc_out_.get_face(0, iang, Normal::Z_NORM).second;
+
+            if (kba_->domain() == 0) {
+                if (is_2d) {
+                    cw.upwind_work(x_in, y_in, angle, group);
+                } else {
+                    cw.upwind_work(x_in, y_in, z_in, angle, group);
+                }
+            }
+
+            // The z-normal face fluxes of the block stay here for the whole
+            // angle
+            if (!is_2d) {
+                for (int jy = 0; jy < ly; jy++) {
+                    for (int jx = 0; jx < lx; jx++) {
+                        kba_z_[lx * jy + jx] = z_in[nx * (y0 + jy) + x0 + jx];
+                    }
+                }
+            }
+
+            // Chunks of planes, in sweep order. The planes of a chunk are
+            // [z_lo, z_hi).
+            for (int c = 0; c < nz; c += n_plane) {
+                const int c_end = std::min(c + n_plane, nz);
+                const int z_lo  = pos_z ? c : nz - c_end;
+                const int z_hi  = pos_z ? c_end : nz - c;
+                const int n_pl  = z_hi - z_lo;
+
+                if (up_x < 0) {
+                    for (int iz = z_lo; iz < z_hi; iz++) {
+                        for (int jy = 0; jy < ly; jy++) {
+                            kba_x_[ly * iz + jy] = x_in[ny * iz + y0 + jy];
+                        }
+                    }
+                } else {
+                    kba_->receive(up_x, &kba_x_[ly * z_lo], ly * n_pl);
+                }
+                if (up_y < 0) {
+                    for (int iz = z_lo; iz < z_hi; iz++) {
+                        for (int jx = 0; jx < lx; jx++) {
+                            kba_y_[lx * iz + jx] = y_in[nx * iz + x0 + jx];
+                        }
+                    }
+                } else {
+                    kba_->receive(up_y, &kba_y_[lx * z_lo], lx * n_pl);
+                }
+
+                for (int kz = 0; kz < n_pl; kz++) {
+                    const int iz       = pos_z ? z_lo + kz : z_hi - 1 - kz;
+                    t_state.tz         = t_state.oz * rdz_[iz];
+                    t_state.macroplane = macroplanes_[iz];
+                    for (int ky = 0; ky < ly; ky++) {
+                        const int iy = stty + ydir * ky;
+                        const int jy = iy - y0;
+                        t_state.ty   = t_state.oy * rdy_[iy];
+                        for (int kx = 0; kx < lx; kx++) {
+                            const int ix = sttx + xdir * kx;
+                            const int jx = ix - x0;
+                            t_state.tx   = t_state.ox * rdx_[ix];
+                            t_state.ixy  = nx * iy + ix;
+
+                            real_t &psi_x = kba_x_[ly * iz + jy];
+                            real_t &psi_y = kba_y_[lx * iz + jx];
+
+                            int i = mesh_.coarse_cell(Position(ix, iy, iz));
+
+                            real_t psi;
+                            if (is_2d) {
+                                psi = this->evaluate_2d(psi_x, psi_y, q[i],
+                                                        xstr_[i], i, t_state);
+                                cw.current_work(psi_x, psi_y, i, angle,
+                                                group);
+                            } else {
+                                real_t &psi_z = kba_z_[lx * jy + jx];
+                                psi = this->evaluate(psi_x, psi_y, psi_z, q[i],
+                                                     xstr_[i], i, t_state);
+                                cw.current_work(psi_x, psi_y, psi_z, i, angle,
+                                                group);
+                            }
+
+                            kba_flux_[i] += psi * wgt;
+                        }
+                    }
+                }
+
+                if (down_x < 0) {
+                    for (int iz = z_lo; iz < z_hi; iz++) {
+                        for (int jy = 0; jy < ly; jy++) {
+                            x_out[ny * iz + y0 + jy] = kba_x_[ly * iz + jy];
+                        }
+                    }
+                } else {
+                    kba_->send(down_x, &kba_x_[ly * z_lo], ly * n_pl);
+                }
+                if (down_y < 0) {
+                    for (int iz = z_lo; iz < z_hi; iz++) {
+                        for (int jx = 0; jx < lx; jx++) {
+                            y_out[nx * iz + x0 + jx] = kba_y_[lx * iz + jx];
+                        }
+                    }
+                } else {
+                    kba_->send(down_y, &kba_y_[lx * z_lo], lx * n_pl);
+                }
+            } // Chunks
+
+            if (!is_2d) {
+                for (int jy = 0; jy < ly; jy++) {
+                    for (int jx = 0; jx < lx; jx++) {
+                        z_out[nx * (y0 + jy) + x0 + jx] = kba_z_[lx * jy + jx];
+                    }
+                }
+            }
+
+            // Free the buffers of the sends that the downwind blocks have
+            // already taken, so that the next angle can reuse them
+            kba_->retire();
+        } // Angles
+
+        cw.flush(group);
+        kba_->wait();
+
+        // Sum the contributions of the blocks
+        kba_->reduce(kba_flux_.data(), n_reg_);
+        for (int i = 0; i < (int)n_reg_; i++) {
+            flux_1g_(i) = kba_flux_[i];
+        }
+
+        bc_out_.copy_group(0, kba_bc_.data());
+        kba_->reduce(kba_bc_.data(), kba_bc_.size());
+        bc_out_.set_group(0, kba_bc_.data());
+
+        if (std::is_same<CurrentWorker, sn::Current>::value) {
+            const int n_surf = mesh_.n_surf();
+            VecF surf(2 * n_surf);
+            for (int is = 0; is < n_surf; is++) {
+                surf[is]          = coarse_data_->current(is, group);
+                surf[n_surf + is] = coarse_data_->surface_flux(is, group);
+            }
+            kba_->reduce(surf.data(), surf.size());
+            for (int is = 0; is < n_surf; is++) {
+                coarse_data_->current(is, group)      = surf[is];
+                coarse_data_->surface_flux(is, group) = surf[n_surf + is];
+            }
+        }
+
+        bc_in_.update(group, bc_out_);
+
+        return;
+    }
+
     /**
      * \brief Generic Sn sweep procedure for orthogonal mesh.
      *
      * This routine performs a single, one-group transport sweep with Sn. It
      * is templated on two parameters to tailor it to different differencing
      * schemes and current calculation requirements. To see examples of
-     * template parameters, look at \ref sn::CellWorker and \ref
-     * sn::Current.
+     * template parameters, look at \ref SnSweeper_DD and \ref
+     * sn::Current. When \p UniformPitch is set, all cells share the same x
+     * and y pitch, so the optical thicknesses in those directions are only
+     * computed once per angle.
      */
-    template <typename CurrentWorker> void sweep_1g(int group)
+    template <typename CurrentWorker, bool UniformPitch>
+    void sweep_1g(int group)
     {
-        flux_1g_ = 0.0;
+        thread_flux_.resize(n_reg_);
 #pragma omp parallel default(shared)
         {
+            double t_region = workload_.enabled() ? omp_get_wtime() : 0.0;
+
             CurrentWorker cw(coarse_data_, &mesh_);
 
-            ArrayB1 t_flux(n_reg_);
-            t_flux = 0.0;
+            thread_flux_.zero();
+            real_t *t_flux = thread_flux_.get();
 
             int nx = mesh_.nx();
             int ny = mesh_.ny();
@@ -181,11 +811,16 @@ protected:
             real_t *y_flux;
             real_t *z_flux;
 
+            const int tile_x = (tile_ > 0) ? tile_ : nx;
+            const int tile_y = (tile_ > 0) ? tile_ : ny;
+
             Angle angle;
             ThreadState t_state;
 
 #pragma omp for
             for (int iang = 0; iang < ang_quad_.ndir(); iang++) {
+                double t_start = workload_.enabled() ? omp_get_wtime() : 0.0;
+
                 angle           = ang_quad_[iang];
                 t_state.iang    = iang;
                 t_state.iang_2d = iang % (ang_quad_.ndir() / 2);
@@ -193,6 +828,12 @@ protected:
                 // Configure the current worker for this angle
                 cw.set_octant(angle);
 
+                if (pipeline_) {
+                    pipeline_->wait_angle(t_state.iang_2d);
+                    static_cast<Equation &>(*this).prepare_angle(
+                        group, t_state.iang_2d);
+                }
+
                 // Get the source for this angle
                 auto &q = source_->get_transport(iang);
 
@@ -204,22 +845,18 @@ protected:
                 // Configure the loop direction. Could template the below for
                 // speed at some point.
                 int sttx = 0;
-                int stpx = nx;
                 int xdir = 1;
                 if (t_state.ox < 0.0) {
                     t_state.ox = -t_state.ox;
                     sttx       = nx - 1;
-                    stpx       = -1;
                     xdir       = -1;
                 }
 
                 int stty = 0;
-                int stpy = ny;
                 int ydir = 1;
                 if (t_state.oy < 0.0) {
                     t_state.oy = -t_state.oy;
                     stty       = ny - 1;
-                    stpy       = -1;
                     ydir       = -1;
                 }
 
@@ -234,44 +871,64 @@ protected:
                 }
 
                 // initialize upwind condition
-                auto xf = bc_out_.get_face(0, iang, Normal::X_NORM);
-                x_flux  = xf.second;
-                auto yf = bc_out_.get_face(0, iang, Normal::Y_NORM);
-                y_flux  = yf.second;
-                auto zf = bc_out_.get_face(0, iang, Normal::Z_NORM);
-                z_flux  = zf.second;
+                x_flux = this->sweep_face(iang, Normal::X_NORM);
+                y_flux = this->sweep_face(iang, Normal::Y_NORM);
+                z_flux = this->sweep_face(iang, Normal::Z_NORM);
                 bc_in_.copy_face(group, iang, Normal::X_NORM, x_flux);
                 bc_in_.copy_face(group, iang, Normal::Y_NORM, y_flux);
                 bc_in_.copy_face(group, iang, Normal::Z_NORM, z_flux);
 
                 cw.upwind_work(x_flux, y_flux, z_flux, angle, group);
 
-                for (int iz = sttz; iz != stpz; iz += zdir) {
-                    t_state.tz         = t_state.oz / mesh_.dz(iz);
-                    t_state.macroplane = macroplanes_[iz];
-                    for (int iy = stty; iy != stpy; iy += ydir) {
-                        t_state.ty = t_state.oy / mesh_.dy(iy);
-                        for (int ix = sttx; ix != stpx; ix += xdir) {
-                            // Gross. really need an Sn mesh abstraction
-                            real_t psi_x = x_flux[ny * iz + iy];
-                            real_t psi_y = y_flux[nx * iz + ix];
-                            real_t psi_z = z_flux[nx * iy + ix];
+                if (UniformPitch) {
+                    t_state.tx = t_state.ox * rdx_[0];
+                    t_state.ty = t_state.oy * rdy_[0];
+                }
+                // Sweep each column of tiles bottom to top (or top to
+                // bottom). The tiles are visited in upwind order, so the
+                // face fluxes that a tile needs from its upwind neighbors are
+                // already in place. lx and ly count from the upwind corner.
+                for (int ty = 0; ty < ny; ty += tile_y) {
+                    const int ty_end = std::min(ty + tile_y, ny);
+                    for (int tx = 0; tx < nx; tx += tile_x) {
+                        const int tx_end = std::min(tx + tile_x, nx);
+                        for (int iz = sttz; iz != stpz; iz += zdir) {
+                            t_state.tz         = t_state.oz * rdz_[iz];
+                            t_state.macroplane = macroplanes_[iz];
+                            for (int ly = ty; ly < ty_end; ly++) {
+                                const int iy = stty + ydir * ly;
+                                if (!UniformPitch) {
+                                    t_state.ty = t_state.oy * rdy_[iy];
+                                }
+                                for (int lx = tx; lx < tx_end; lx++) {
+                                    const int ix = sttx + xdir * lx;
+                                    if (!UniformPitch) {
+                                        t_state.tx = t_state.ox * rdx_[ix];
+                                    }
+                                    t_state.ixy = nx * iy + ix;
+                                    // Gross. really need an Sn mesh
+                                    // abstraction
+                                    real_t psi_x = x_flux[ny * iz + iy];
+                                    real_t psi_y = y_flux[nx * iz + ix];
+                                    real_t psi_z = z_flux[nx * iy + ix];
 
-                            int i = mesh_.coarse_cell(Position(ix, iy, iz));
+                                    int i = mesh_.coarse_cell(
+                                        Position(ix, iy, iz));
 
-                            real_t psi =
-                                this->evaluate(psi_x, psi_y, psi_z, q[i],
-                                               xstr_[i], i, t_state);
+                                    real_t psi = this->evaluate(
+                                        psi_x, psi_y, psi_z, q[i], xstr_[i],
+                                        i, t_state);
 
-                            x_flux[ny * iz + iy] = psi_x;
-                            y_flux[nx * iz + ix] = psi_y;
-                            z_flux[nx * iy + ix] = psi_z;
+                                    x_flux[ny * iz + iy] = psi_x;
+                                    y_flux[nx * iz + ix] = psi_y;
+                                    z_flux[nx * iy + ix] = psi_z;
 
-                            t_flux(i) += psi * wgt;
+                                    t_flux[i] += psi * wgt;
 
-                            cw.current_work(
-                                x_flux[ny * iz + iy], y_flux[nx * iz + ix],
-                                z_flux[nx * iy + ix], i, angle, group);
+                                    cw.current_work(psi_x, psi_y, psi_z, i,
+                                                    angle, group);
+                                }
+                            }
                         }
                     }
                 }
@@ -279,18 +936,29 @@ protected:
                 if (gs_boundary_) {
                     bc_in_.update(group, iang, bc_out_);
                 }
+
+                if (workload_.enabled()) {
+                    workload_.record(iang, n_reg_, 1,
+                                     omp_get_wtime() - t_start);
+                }
             } // Angles
-              // Update the boundary condition
+
+            // Add this thread's currents to the coarse data
+            cw.flush(group);
+            // Update the boundary condition
 #pragma omp single
-            if (!gs_boundary_) {
+            if (double_buffer_) {
+                bc_in_.swap_next(group);
+            } else if (!gs_boundary_) {
                 bc_in_.update(group, bc_out_);
             }
 
-// Reduce scalar flux
-#pragma omp critical
-            {
-                flux_1g_ += t_flux;
+            if (workload_.enabled()) {
+                workload_.record_region(omp_get_wtime() - t_region);
             }
+
+            // Reduce scalar flux. The single above provides the barrier.
+            thread_flux_.reduce([&](int i, real_t v) { flux_1g_(i) = v; });
         } // OMP Parallel
 
         return;
@@ -302,18 +970,21 @@ protected:
      * This routine performs a single, one-group transport sweep with Sn. It
      * is templated on two parameters to tailor it to different differencing
      * schemes and current calculation requirements. To see examples of
-     * template parameters, look at \ref sn::CellWorker and \ref
-     * sn::Current.
+     * template parameters, look at \ref SnSweeper_DD and \ref
+     * sn::Current. See \ref sweep_1g() for \p UniformPitch.
      */
-    template <typename CurrentWorker> void sweep_1g_2d(int group)
+    template <typename CurrentWorker, bool UniformPitch>
+    void sweep_1g_2d(int group)
     {
-        flux_1g_ = 0.0;
+        thread_flux_.resize(n_reg_);
 #pragma omp parallel default(shared)
         {
+            double t_region = workload_.enabled() ? omp_get_wtime() : 0.0;
+
             CurrentWorker cw(coarse_data_, &mesh_);
 
-            ArrayB1 t_flux(n_reg_);
-            t_flux = 0.0;
+            thread_flux_.zero();
+            real_t *t_flux = thread_flux_.get();
 
             int nx = mesh_.nx();
             int ny = mesh_.ny();
@@ -328,6 +999,8 @@ protected:
 
 #pragma omp for
             for (int iang = 0; iang < ang_quad_.ndir() / 2; iang++) {
+                double t_start = workload_.enabled() ? omp_get_wtime() : 0.0;
+
                 angle           = ang_quad_[iang];
                 t_state.iang    = iang;
                 t_state.angle   = angle;
@@ -366,19 +1039,27 @@ protected:
                 }
 
                 // initialize upwind condition
-                auto xf = bc_out_.get_face(0, iang, Normal::X_NORM);
-                x_flux  = xf.second;
-                auto yf = bc_out_.get_face(0, iang, Normal::Y_NORM);
-                y_flux  = yf.second;
+                x_flux = this->sweep_face(iang, Normal::X_NORM);
+                y_flux = this->sweep_face(iang, Normal::Y_NORM);
                 bc_in_.copy_face(group, iang, Normal::X_NORM, x_flux);
                 bc_in_.copy_face(group, iang, Normal::Y_NORM, y_flux);
 
                 cw.upwind_work(x_flux, y_flux, angle, group);
 
-                t_state.tz = t_state.oz / mesh_.dz(0);
+                t_state.tz = t_state.oz * rdz_[0];
+                if (UniformPitch) {
+                    t_state.tx = t_state.ox * rdx_[0];
+                    t_state.ty = t_state.oy * rdy_[0];
+                }
                 for (int iy = stty; iy != stpy; iy += ydir) {
-                    t_state.ty = t_state.oy / mesh_.dy(iy);
+                    if (!UniformPitch) {
+                        t_state.ty = t_state.oy * rdy_[iy];
+                    }
                     for (int ix = sttx; ix != stpx; ix += xdir) {
+                        if (!UniformPitch) {
+                            t_state.tx = t_state.ox * rdx_[ix];
+                        }
+                        t_state.ixy = nx * iy + ix;
                         // Gross. really need an Sn mesh abstraction
                         real_t psi_x = x_flux[iy];
                         real_t psi_y = y_flux[ix];
@@ -391,7 +1072,7 @@ protected:
                         x_flux[iy] = psi_x;
                         y_flux[ix] = psi_y;
 
-                        t_flux(i) += psi * wgt;
+                        t_flux[i] += psi * wgt;
 
                         cw.current_work(x_flux[iy], y_flux[ix], i, angle,
                                         group);
@@ -401,23 +1082,669 @@ protected:
                 if (gs_boundary_) {
                     bc_in_.update(group, iang, bc_out_);
                 }
+
+                if (workload_.enabled()) {
+                    workload_.record(iang, nx * ny, 1,
+                                     omp_get_wtime() - t_start);
+                }
             } // Angles
-              // Update the boundary condition
+
+            // Add this thread's currents to the coarse data
+            cw.flush(group);
+            // Update the boundary condition
 #pragma omp single
-            if (!gs_boundary_) {
+            if (double_buffer_) {
+                bc_in_.swap_next(group);
+            } else if (!gs_boundary_) {
                 bc_in_.update(group, bc_out_);
             }
 
-// Reduce scalar flux
-#pragma omp critical
-            {
-                flux_1g_ += t_flux;
+            if (workload_.enabled()) {
+                workload_.record_region(omp_get_wtime() - t_region);
             }
+
+            // Reduce scalar flux. The single above provides the barrier.
+            thread_flux_.reduce([&](int i, real_t v) { flux_1g_(i) = v; });
         } // OMP Parallel
 
         return;
     }
 
+    /**
+     * \brief Wavefront (KBA-style) Sn sweep procedure for orthogonal mesh.
+     *
+     * Rather than sweeping each angle on its own thread, this sweeps all of
+     * the angles of an octant together. Cells on the same diagonal
+     * hyperplane (ix + iy + iz constant, counting from the upwind corner) do
+     * not depend on each other. All angles of an octant share the same
+     * hyperplane order, so each hyperplane of each angle in the octant is
+     * worked on in one parallel loop. This exposes parallelism even for low
+     * order quadratures, at the cost of a barrier per hyperplane.
+     *
+     * This handles both 2-D and 3-D meshes. Since octants are swept one at a
+     * time, Gauss-Seidel boundary updates are done between octants.
+     */
+    template <typename CurrentWorker> void sweep_1g_wavefront(int group)
+    {
+        const bool is_2d = core_mesh_->is_2d();
+        const int nx     = mesh_.nx();
+        const int ny     = mesh_.ny();
+        const int nz     = is_2d ? 1 : mesh_.nz();
+        const int n_ang  = is_2d ? ang_quad_.ndir() / 2 : ang_quad_.ndir();
+        // Tiling doesn't buy anything in 2-D, where there are no z faces
+        const int tile_x = ((tile_ > 0) && !is_2d) ? tile_ : nx;
+        const int tile_y = ((tile_ > 0) && !is_2d) ? tile_ : ny;
+
+        // Group the angles by octant, since all angles in an octant share a
+        // sweep order
+        std::vector<VecI> octants(8);
+        for (int iang = 0; iang < n_ang; iang++) {
+            const auto &angle = ang_quad_[iang];
+            int oct = (angle.ox < 0.0 ? 1 : 0) + (angle.oy < 0.0 ? 2 : 0) +
+                      (angle.oz < 0.0 ? 4 : 0);
+            octants[oct].push_back(iang);
+        }
+
+        // Per-angle state for the octant being swept
+        struct WaveAngle {
+            ThreadState t_state;
+            real_t wgt;
+            real_t *x_flux;
+            real_t *y_flux;
+            real_t *z_flux;
+            const VectorX *q;
+        };
+        std::vector<WaveAngle> wave_angles;
+        wave_angles.reserve(n_ang);
+
+        thread_flux_.resize(n_reg_);
+#pragma omp parallel default(shared)
+        {
+            CurrentWorker cw(coarse_data_, &mesh_);
+
+            thread_flux_.zero();
+            real_t *t_flux = thread_flux_.get();
+
+            for (const auto &oct_angles : octants) {
+                const int n_oct_ang = oct_angles.size();
+                if (n_oct_ang == 0) {
+                    continue;
+                }
+
+                const Angle &oct_angle = ang_quad_[oct_angles.front()];
+                const bool x_rev       = oct_angle.ox < 0.0;
+                const bool y_rev       = oct_angle.oy < 0.0;
+                const bool z_rev       = oct_angle.oz < 0.0;
+                cw.set_octant(oct_angle);
+
+#pragma omp single
+                wave_angles.resize(n_oct_ang);
+
+                // Initialize the upwind conditions for each angle
+#pragma omp for
+                for (int ia = 0; ia < n_oct_ang; ia++) {
+                    int iang   = oct_angles[ia];
+                    auto &wa   = wave_angles[ia];
+                    auto angle = ang_quad_[iang];
+
+                    wa.t_state.iang       = iang;
+                    wa.t_state.iang_2d    = iang % (ang_quad_.ndir() / 2);
+                    wa.t_state.angle      = angle;
+                    wa.t_state.macroplane = 0;
+                    wa.t_state.ox         = std::abs(angle.ox);
+                    wa.t_state.oy         = std::abs(angle.oy);
+                    wa.t_state.oz         = std::abs(angle.oz);
+                    wa.wgt = angle.weight * (is_2d ? PI : HPI);
+                    wa.q   = &source_->get_transport(iang);
+
+                    wa.x_flux =
+                        bc_out_.get_face(0, iang, Normal::X_NORM).second;
+                    wa.y_flux =
+                        bc_out_.get_face(0, iang, Normal::Y_NORM).second;
+                    bc_in_.copy_face(group, iang, Normal::X_NORM, wa.x_flux);
+                    bc_in_.copy_face(group, iang, Normal::Y_NORM, wa.y_flux);
+                    if (is_2d) {
+                        wa.z_flux = nullptr;
+                        cw.upwind_work(wa.x_flux, wa.y_flux, angle, group);
+                    } else {
+                        wa.z_flux =
+                            bc_out_.get_face(0, iang, Normal::Z_NORM).second;
+                        bc_in_.copy_face(group, iang, Normal::Z_NORM,
+                                         wa.z_flux);
+                        cw.upwind_work(wa.x_flux, wa.y_flux, wa.z_flux, angle,
+                                       group);
+                    }
+                }
+
+                // March the hyperplanes from the upwind corner
+                for (const auto &hplane : hyperplanes_) {
+                    const int n_cell = hplane.size();
+#pragma omp for schedule(static)
+                    for (int k = 0; k < n_oct_ang * n_cell; k++) {
+                        auto &wa    = wave_angles[k / n_cell];
+                        int local   = hplane[k % n_cell];
+                        int jx      = local % nx;
+                        int jy      = (local / nx) % ny;
+                        int jz      = local / (nx * ny);
+                        int ix      = x_rev ? nx - 1 - jx : jx;
+                        int iy      = y_rev ? ny - 1 - jy : jy;
+                        int iz      = z_rev ? nz - 1 - jz : jz;
+                        Angle angle = wa.t_state.angle;
+
+                        ThreadState t_state = wa.t_state;
+                        t_state.tx          = t_state.ox * rdx_[ix];
+                        t_state.ty          = t_state.oy * rdy_[iy];
+                        t_state.tz          = t_state.oz * rdz_[iz];
+                        t_state.ixy         = nx * iy + ix;
+                        t_state.macroplane  = is_2d ? 0 : macroplanes_[iz];
+
+                        int i = mesh_.coarse_cell(Position(ix, iy, iz));
+                        real_t q = (*wa.q)[i];
+
+                        real_t psi;
+                        if (is_2d) {
+                            real_t &psi_x = wa.x_flux[iy];
+                            real_t &psi_y = wa.y_flux[ix];
+                            psi = this->evaluate_2d(psi_x, psi_y, q, xstr_[i],
+                                                    i, t_state);
+                            cw.current_work(psi_x, psi_y, i, angle, group);
+                        } else {
+                            real_t &psi_x = wa.x_flux[ny * iz + iy];
+                            real_t &psi_y = wa.y_flux[nx * iz + ix];
+                            real_t &psi_z = wa.z_flux[nx * iy + ix];
+                            psi = this->evaluate(psi_x, psi_y, psi_z, q,
+                                                 xstr_[i], i, t_state);
+                            cw.current_work(psi_x, psi_y, psi_z, i, angle,
+                                            group);
+                        }
+
+                        t_flux[i] += psi * wa.wgt;
+                    }
+                }
+
+                // No angle in this octant is the reflection of another in
+                // the same octant, so the incoming conditions that these
+                // updates touch are not in use.
+                if (gs_boundary_) {
+#pragma omp for
+                    for (int ia = 0; ia < n_oct_ang; ia++) {
+                        bc_in_.update(group, oct_angles[ia], bc_out_);
+                    }
+                }
+            } // Octants
+
+            // Add this thread's currents to the coarse data
+            cw.flush(group);
+
+#pragma omp single
+            if (!gs_boundary_) {
+                bc_in_.update(group, bc_out_);
+            }
+
+            // Reduce scalar flux. The single above provides the barrier.
+            thread_flux_.reduce([&](int i, real_t v) { flux_1g_(i) = v; });
+        } // OMP Parallel
+
+        return;
+    } // sweep_1g_wavefront
+
+    /**
+     * \brief Octant-batched Sn sweep procedure for orthogonal mesh.
+     *
+     * The angles of each octant are split into batches of up to \ref
+     * AngleBatch::max_size angles, which are distributed among threads. All
+     * angles in a batch share the same traversal order, so each cell is
+     * visited once per batch, and the face fluxes for the batch are stored
+     * angle-innermost in thread-local scratch. This allows the cell update
+     * (\ref evaluate_batch()) to be vectorized over the angles of the batch.
+     *
+     * This handles both 2-D and 3-D meshes.
+     */
+    template <typename CurrentWorker> void sweep_1g_octant(int group)
+    {
+        typedef AngleBatch Batch;
+        const int nb     = Batch::max_size;
+        const bool is_2d = core_mesh_->is_2d();
+        const int nx     = mesh_.nx();
+        const int ny     = mesh_.ny();
+        const int nz     = is_2d ? 1 : mesh_.nz();
+        const int n_ang  = is_2d ? ang_quad_.ndir() / 2 : ang_quad_.ndir();
+        // Tiling doesn't buy anything in 2-D, where there are no z faces
+        const int tile_x = ((tile_ > 0) && !is_2d) ? tile_ : nx;
+        const int tile_y = ((tile_ > 0) && !is_2d) ? tile_ : ny;
+
+        // Group the angles by octant, then split each octant into batches
+        std::vector<VecI> octants(8);
+        for (int iang = 0; iang < n_ang; iang++) {
+            const auto &angle = ang_quad_[iang];
+            int oct = (angle.ox < 0.0 ? 1 : 0) + (angle.oy < 0.0 ? 2 : 0) +
+                      (angle.oz < 0.0 ? 4 : 0);
+            octants[oct].push_back(iang);
+        }
+
+        std::vector<Batch> batches;
+        for (const auto &oct_angles : octants) {
+            for (int first = 0; first < (int)oct_angles.size(); first += nb) {
+                Batch batch;
+                batch.size =
+                    std::min(nb, (int)oct_angles.size() - first);
+                for (int ia = 0; ia < batch.size; ia++) {
+                    int iang             = oct_angles[first + ia];
+                    const Angle &angle   = ang_quad_[iang];
+                    batch.iang[ia]       = iang;
+                    batch.iang_2d[ia]    = iang % (ang_quad_.ndir() / 2);
+                    batch.angle[ia]      = angle;
+                    batch.ox[ia]         = std::abs(angle.ox);
+                    batch.oy[ia]         = std::abs(angle.oy);
+                    batch.oz[ia]         = std::abs(angle.oz);
+                    batch.wgt[ia]        = angle.weight * (is_2d ? PI : HPI);
+                    batch.q[ia]          = &source_->get_transport(iang);
+                }
+                batch.macroplane = 0;
+                batches.push_back(batch);
+            }
+        }
+
+        // Three angle-innermost faces, plus the source and angular flux of
+        // the current cell
+        thread_flux_.resize(n_reg_);
+        workspace_.resize(
+            4, nb * std::max(std::max(ny * nz, nx * nz), std::max(nx * ny, 2)));
+
+#pragma omp parallel default(shared)
+        {
+            CurrentWorker cw(coarse_data_, &mesh_);
+
+            thread_flux_.zero();
+            real_t *t_flux = thread_flux_.get();
+
+            real_t *x_flux = workspace_.get(0);
+            real_t *y_flux = workspace_.get(1);
+            real_t *z_flux = workspace_.get(2);
+            real_t *q      = workspace_.get(3);
+            real_t *psi    = q + nb;
+
+#pragma omp for schedule(dynamic)
+            for (int ib = 0; ib < (int)batches.size(); ib++) {
+                Batch batch = batches[ib];
+                const int n = batch.size;
+
+                const Angle &oct_angle = batch.angle[0];
+                cw.set_octant(oct_angle);
+
+                int sttx = 0;
+                int xdir = 1;
+                if (oct_angle.ox < 0.0) {
+                    sttx = nx - 1;
+                    xdir = -1;
+                }
+
+                int stty = 0;
+                int ydir = 1;
+                if (oct_angle.oy < 0.0) {
+                    stty = ny - 1;
+                    ydir = -1;
+                }
+
+                int sttz = 0;
+                int stpz = nz;
+                int zdir = 1;
+                if (oct_angle.oz < 0.0) {
+                    sttz = nz - 1;
+                    stpz = -1;
+                    zdir = -1;
+                }
+
+                // Initialize the upwind conditions, transposing the incoming
+                // faces to angle-innermost
+                for (int ia = 0; ia < n; ia++) {
+                    int iang   = batch.iang[ia];
+                    auto x_in  = bc_in_.get_face(group, iang, Normal::X_NORM);
+                    auto y_in  = bc_in_.get_face(group, iang, Normal::Y_NORM);
+                    for (int k = 0; k < x_in.first; k++) {
+                        x_flux[k * nb + ia] = x_in.second[k];
+                    }
+                    for (int k = 0; k < y_in.first; k++) {
+                        y_flux[k * nb + ia] = y_in.second[k];
+                    }
+                    if (is_2d) {
+                        cw.upwind_work(x_in.second, y_in.second,
+                                       batch.angle[ia], group);
+                    } else {
+                        auto z_in =
+                            bc_in_.get_face(group, iang, Normal::Z_NORM);
+                        for (int k = 0; k < z_in.first; k++) {
+                            z_flux[k * nb + ia] = z_in.second[k];
+                        }
+                        cw.upwind_work(x_in.second, y_in.second, z_in.second,
+                                       batch.angle[ia], group);
+                    }
+                }
+
+                // See sweep_1g() for the order that the tiles are swept in
+                for (int ty = 0; ty < ny; ty += tile_y) {
+                    const int ty_end = std::min(ty + tile_y, ny);
+                    for (int tx = 0; tx < nx; tx += tile_x) {
+                        const int tx_end = std::min(tx + tile_x, nx);
+                        for (int iz = sttz; iz != stpz; iz += zdir) {
+                            batch.rdz        = rdz_[iz];
+                            batch.macroplane = is_2d ? 0 : macroplanes_[iz];
+                            for (int ly = ty; ly < ty_end; ly++) {
+                                const int iy = stty + ydir * ly;
+                                batch.rdy    = rdy_[iy];
+                                for (int lx = tx; lx < tx_end; lx++) {
+                                    const int ix = sttx + xdir * lx;
+                                    batch.rdx    = rdx_[ix];
+                                    batch.ixy    = nx * iy + ix;
+                                    int i        = mesh_.coarse_cell(
+                                        Position(ix, iy, iz));
+                                    for (int ia = 0; ia < n; ia++) {
+                                        q[ia] = (*batch.q[ia])[i];
+                                    }
+
+                                    real_t *fx = &x_flux[(ny * iz + iy) * nb];
+                                    real_t *fy = &y_flux[(nx * iz + ix) * nb];
+                                    real_t *fz = &z_flux[(nx * iy + ix) * nb];
+
+                                    const Equation &eq =
+                                        static_cast<const Equation &>(*this);
+                                    if (is_2d) {
+                                        eq.evaluate_batch_2d(fx, fy, q,
+                                                             xstr_[i], i,
+                                                             batch, psi);
+                                    } else {
+                                        eq.evaluate_batch(fx, fy, fz, q,
+                                                          xstr_[i], i, batch,
+                                                          psi);
+                                    }
+
+                                    real_t flux = 0.0;
+                                    for (int ia = 0; ia < n; ia++) {
+                                        flux += psi[ia] * batch.wgt[ia];
+                                    }
+                                    t_flux[i] += flux;
+
+                                    for (int ia = 0; ia < n; ia++) {
+                                        if (is_2d) {
+                                            cw.current_work(fx[ia], fy[ia], i,
+                                                            batch.angle[ia],
+                                                            group);
+                                        } else {
+                                            cw.current_work(
+                                                fx[ia], fy[ia], fz[ia], i,
+                                                batch.angle[ia], group);
+                                        }
+                                    }
+                                }
+                            }
+                        }
+                    }
+                }
+
+                // Store the outgoing faces for the boundary update
+                for (int ia = 0; ia < n; ia++) {
+                    int iang   = batch.iang[ia];
+                    auto x_out = bc_out_.get_face(0, iang, Normal::X_NORM);
+                    auto y_out = bc_out_.get_face(0, iang, Normal::Y_NORM);
+                    for (int k = 0; k < x_out.first; k++) {
+                        x_out.second[k] = x_flux[k * nb + ia];
+                    }
+                    for (int k = 0; k < y_out.first; k++) {
+                        y_out.second[k] = y_flux[k * nb + ia];
+                    }
+                    if (!is_2d) {
+                        auto z_out = bc_out_.get_face(0, iang, Normal::Z_NORM);
+                        for (int k = 0; k < z_out.first; k++) {
+                            z_out.second[k] = z_flux[k * nb + ia];
+                        }
+                    }
+                    if (gs_boundary_) {
+                        bc_in_.update(group, iang, bc_out_);
+                    }
+                }
+            } // Batches
+
+            // Add this thread's currents to the coarse data
+            cw.flush(group);
+
+#pragma omp single
+            if (!gs_boundary_) {
+                bc_in_.update(group, bc_out_);
+            }
+
+            // Reduce scalar flux. The single above provides the barrier.
+            thread_flux_.reduce([&](int i, real_t v) { flux_1g_(i) = v; });
+        } // OMP Parallel
+
+        return;
+    } // sweep_1g_octant
+
+    /**
+     * \brief Multi-group Sn sweep procedure for orthogonal mesh.
+     *
+     * This sweeps groups [\p g_first, \p g_last] together, with threads
+     * distributed over angles as in \ref sweep_1g(). Each cell is visited
+     * once per angle for the whole block, so the geometry and direction
+     * setup are shared by all groups. The face fluxes are stored
+     * group-innermost in thread-local scratch, and the source and cross
+     * sections are stored group-innermost in \c qbar_mg_ and \c xstr_mg_,
+     * so that the cell update (\ref evaluate_mg()) can be vectorized over
+     * groups.
+     *
+     * This handles both 2-D and 3-D meshes.
+     */
+    template <typename CurrentWorker, bool UniformPitch>
+    void sweep_mg(int g_first, int g_last)
+    {
+        const int ng     = g_last - g_first + 1;
+        const bool is_2d = core_mesh_->is_2d();
+        const int nx     = mesh_.nx();
+        const int ny     = mesh_.ny();
+        const int nz     = is_2d ? 1 : mesh_.nz();
+        const int n_ang  = is_2d ? ang_quad_.ndir() / 2 : ang_quad_.ndir();
+        // Tiling doesn't buy anything in 2-D, where there are no z faces
+        const int tile_x = ((tile_ > 0) && !is_2d) ? tile_ : nx;
+        const int tile_y = ((tile_ > 0) && !is_2d) ? tile_ : ny;
+
+        // Three group-innermost faces, plus the angular flux of the current
+        // cell
+        thread_flux_.resize(n_reg_ * ng);
+        workspace_.resize(
+            4, ng * std::max(std::max(ny * nz, nx * nz), std::max(nx * ny, 1)));
+
+#pragma omp parallel default(shared)
+        {
+            std::vector<CurrentWorker> cw(ng,
+                                          CurrentWorker(coarse_data_, &mesh_));
+
+            // Thread-private flux, indexed by [cell, group]
+            thread_flux_.zero();
+            real_t *t_flux = thread_flux_.get();
+
+            real_t *x_flux = workspace_.get(0);
+            real_t *y_flux = workspace_.get(1);
+            real_t *z_flux = workspace_.get(2);
+            real_t *psi    = workspace_.get(3);
+
+            const Equation &eq = static_cast<const Equation &>(*this);
+
+            ThreadState t_state;
+            t_state.macroplane = 0;
+
+#pragma omp for
+            for (int iang = 0; iang < n_ang; iang++) {
+                Angle angle     = ang_quad_[iang];
+                t_state.iang    = iang;
+                t_state.iang_2d = iang % (ang_quad_.ndir() / 2);
+                t_state.angle   = angle;
+                t_state.ox      = std::abs(angle.ox);
+                t_state.oy      = std::abs(angle.oy);
+                t_state.oz      = std::abs(angle.oz);
+                for (auto &c : cw) {
+                    c.set_octant(angle);
+                }
+
+                real_t wgt = angle.weight * (is_2d ? PI : HPI);
+
+                int sttx = 0;
+                int xdir = 1;
+                if (angle.ox < 0.0) {
+                    sttx = nx - 1;
+                    xdir = -1;
+                }
+
+                int stty = 0;
+                int ydir = 1;
+                if (angle.oy < 0.0) {
+                    stty = ny - 1;
+                    ydir = -1;
+                }
+
+                int sttz = 0;
+                int stpz = nz;
+                int zdir = 1;
+                if (angle.oz < 0.0) {
+                    sttz = nz - 1;
+                    stpz = -1;
+                    zdir = -1;
+                }
+
+                // Initialize the upwind conditions, transposing the incoming
+                // faces to group-innermost
+                for (int ig = 0; ig < ng; ig++) {
+                    int group = g_first + ig;
+                    auto x_in = bc_in_.get_face(group, iang, Normal::X_NORM);
+                    auto y_in = bc_in_.get_face(group, iang, Normal::Y_NORM);
+                    for (int k = 0; k < x_in.first; k++) {
+                        x_flux[k * ng + ig] = x_in.second[k];
+                    }
+                    for (int k = 0; k < y_in.first; k++) {
+                        y_flux[k * ng + ig] = y_in.second[k];
+                    }
+                    if (is_2d) {
+                        cw[ig].upwind_work(x_in.second, y_in.second, angle,
+                                           group);
+                    } else {
+                        auto z_in =
+                            bc_in_.get_face(group, iang, Normal::Z_NORM);
+                        for (int k = 0; k < z_in.first; k++) {
+                            z_flux[k * ng + ig] = z_in.second[k];
+                        }
+                        cw[ig].upwind_work(x_in.second, y_in.second,
+                                           z_in.second, angle, group);
+                    }
+                }
+
+                t_state.tz = t_state.oz * rdz_[0];
+                if (UniformPitch) {
+                    t_state.tx = t_state.ox * rdx_[0];
+                    t_state.ty = t_state.oy * rdy_[0];
+                }
+                // See sweep_1g() for the order that the tiles are swept in
+                for (int ty = 0; ty < ny; ty += tile_y) {
+                    const int ty_end = std::min(ty + tile_y, ny);
+                    for (int tx = 0; tx < nx; tx += tile_x) {
+                        const int tx_end = std::min(tx + tile_x, nx);
+                        for (int iz = sttz; iz != stpz; iz += zdir) {
+                            if (!is_2d) {
+                                t_state.tz         = t_state.oz * rdz_[iz];
+                                t_state.macroplane = macroplanes_[iz];
+                            }
+                            for (int ly = ty; ly < ty_end; ly++) {
+                                const int iy = stty + ydir * ly;
+                                if (!UniformPitch) {
+                                    t_state.ty = t_state.oy * rdy_[iy];
+                                }
+                                for (int lx = tx; lx < tx_end; lx++) {
+                                    const int ix = sttx + xdir * lx;
+                                    if (!UniformPitch) {
+                                        t_state.tx = t_state.ox * rdx_[ix];
+                                    }
+                                    t_state.ixy = nx * iy + ix;
+                                    int i       = mesh_.coarse_cell(
+                                        Position(ix, iy, iz));
+
+                                    real_t *fx = &x_flux[(ny * iz + iy) * ng];
+                                    real_t *fy = &y_flux[(nx * iz + ix) * ng];
+                                    real_t *fz = &z_flux[(nx * iy + ix) * ng];
+                                    const real_t *q  = &qbar_mg_(i, g_first);
+                                    const real_t *xs = &xstr_mg_(i, g_first);
+
+                                    if (is_2d) {
+                                        eq.evaluate_mg_2d(fx, fy, q, xs, ng, i,
+                                                          t_state, psi);
+                                    } else {
+                                        eq.evaluate_mg(fx, fy, fz, q, xs, ng,
+                                                       i, t_state, psi);
+                                    }
+
+                                    real_t *tf = &t_flux[i * ng];
+#pragma omp simd
+                                    for (int ig = 0; ig < ng; ig++) {
+                                        tf[ig] += psi[ig] * wgt;
+                                    }
+
+                                    for (int ig = 0; ig < ng; ig++) {
+                                        if (is_2d) {
+                                            cw[ig].current_work(
+                                                fx[ig], fy[ig], i, angle,
+                                                g_first + ig);
+                                        } else {
+                                            cw[ig].current_work(
+                                                fx[ig], fy[ig], fz[ig], i,
+                                                angle, g_first + ig);
+                                        }
+                                    }
+                                }
+                            }
+                        }
+                    }
+                }
+
+                // Store the outgoing faces for the boundary update
+                for (int ig = 0; ig < ng; ig++) {
+                    auto x_out = bc_out_mg_->get_face(ig, iang, Normal::X_NORM);
+                    auto y_out = bc_out_mg_->get_face(ig, iang, Normal::Y_NORM);
+                    for (int k = 0; k < x_out.first; k++) {
+                        x_out.second[k] = x_flux[k * ng + ig];
+                    }
+                    for (int k = 0; k < y_out.first; k++) {
+                        y_out.second[k] = y_flux[k * ng + ig];
+                    }
+                    if (!is_2d) {
+                        auto z_out =
+                            bc_out_mg_->get_face(ig, iang, Normal::Z_NORM);
+                        for (int k = 0; k < z_out.first; k++) {
+                            z_out.second[k] = z_flux[k * ng + ig];
+                        }
+                    }
+                    if (gs_boundary_) {
+                        bc_in_.update(g_first + ig, iang, *bc_out_mg_, ig);
+                    }
+                }
+            } // Angles
+
+            // Add this thread's currents to the coarse data
+            for (int ig = 0; ig < ng; ig++) {
+                cw[ig].flush(g_first + ig);
+            }
+
+#pragma omp single
+            if (!gs_boundary_) {
+                for (int ig = 0; ig < ng; ig++) {
+                    bc_in_.update(g_first + ig, *bc_out_mg_, ig);
+                }
+            }
+
+            // Reduce scalar flux. The single above provides the barrier.
+            thread_flux_.reduce([&](int k, real_t v) {
+                flux_(k / ng, g_first + k % ng) = v;
+            });
+        } // OMP Parallel
+
+        return;
+    } // sweep_mg
+
     int plane_size_;
     int group_;
 };
@@ -0,0 +1,160 @@
+C5G7 macroscopic cross section data
+ 7 8
+ 2.0E+07 1.0E+06  5.0E+05 1.0E+03 1.0E+02 10. 0.0635 
+!
+!Comments can appear after the first 3 lines and between macro/micro blocks
+!
+!In the second line, the first number is number of groups and the other is
+!number of cross section sets. 
+!
+!In the third line the energy group bounds are made up.
+! 
+!Data here is derived from NEA/NSC/DOC(2003)16 or ISBN 92-64-02139-6
+!Table 1 of Appendix A.
+!
+!The control rod cross sections come from NEA/NSC/DOC(2005)16 or 
+!ISBN 92-64-01069-6 Table 1 of Appendix A.
+!
+!  Abs       nu-fiss       fiss        chi
+! scat mat
+!UO2 fuel-clad  
+XSMACRO UO2-3.3 0
+  8.0248E-03 2.005998E-02 7.21206E-03 5.8791E-01
+  3.7174E-03 2.027303E-03 8.19301E-04 4.1176E-01
+  2.6769E-02 1.570599E-02 6.45320E-03 3.3906E-04
+  9.6236E-02 4.518301E-02 1.85648E-02 1.1761E-07
+  3.0020E-02 4.334208E-02 1.78084E-02 0.0000E+00
+  1.1126E-01 2.020901E-01 8.30348E-02 0.0000E+00
+  2.8278E-01 5.257105E-01 2.16004E-01 0.0000E+00
+  1.27537E-01 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00
+  4.23780E-02 3.24456E-01 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00
+  9.43740E-06 1.63140E-03 4.50940E-01 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00
+  5.51630E-09 3.14270E-09 2.67920E-03 4.52565E-01 1.25250E-04 0.00000E+00 0.00000E+00
+  0.00000E+00 0.00000E+00 0.00000E+00 5.56640E-03 2.71401E-01 1.29680E-03 0.00000E+00
+  0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00 1.02550E-02 2.65802E-01 8.54580E-03
+  0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00 1.00210E-08 1.68090E-02 2.73080E-01
+
+  
+!4.3% MOX fuel-clad
+XSMACRO MOX-4.3 0
+  8.4339E-03 2.175300E-02 7.62704E-03 5.8791E-01
+  3.7577E-03 2.535103E-03 8.76898E-04 4.1176E-01
+  2.7970E-02 1.626799E-02 5.69835E-03 3.3906E-04
+  1.0421E-01 6.547410E-02 2.28872E-02 1.1761E-07
+  1.3994E-01 3.072409E-02 1.07635E-02 0.0000E+00
+  4.0918E-01 6.666510E-01 2.32757E-01 0.0000E+00
+  4.0935E-01 7.139904E-01 2.48968E-01 0.0000E+00
+  1.28876E-01 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00
+  4.14130E-02 3.25452E-01 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00
+  8.22900E-06 1.63950E-03 4.53188E-01 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00
+  5.04050E-09 1.59820E-09 2.61420E-03 4.57173E-01 1.60460E-04 0.00000E+00 0.00000E+00
+  0.00000E+00 0.00000E+00 0.00000E+00 5.53940E-03 2.76814E-01 2.00510E-03 0.00000E+00
+  0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00 9.31270E-03 2.52962E-01 8.49480E-03
+  0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00 9.16560E-09 1.48500E-02 2.65007E-01
+
+  
+!7.0% MOX fuel-clad
+XSMACRO MOX-7.0 0
+  9.0657E-03 2.381395E-02 8.25446E-03 5.8791E-01
+  4.2967E-03 3.858689E-03 1.32565E-03 4.1176E-01
+  3.2881E-02 2.413400E-02 8.42156E-03 3.3906E-04
+  1.2203E-01 9.436622E-02 3.28730E-02 1.1761E-07
+  1.8298E-01 4.576988E-02 1.59636E-02 0.0000E+00
+  5.6846E-01 9.281814E-01 3.23794E-01 0.0000E+00
+  5.8521E-01 1.043200E+00 3.62803E-01 0.0000E+00
+  1.30457E-01 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00
+  4.17920E-02 3.28428E-01 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00
+  8.51050E-06 1.64360E-03 4.58371E-01 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00
+  5.13290E-09 2.20170E-09 2.53310E-03 4.63709E-01 1.76190E-04 0.00000E+00 0.00000E+00
+  0.00000E+00 0.00000E+00 0.00000E+00 5.47660E-03 2.82313E-01 2.27600E-03 0.00000E+00
+  0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00 8.72890E-03 2.49751E-01 8.86450E-03
+  0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00 9.00160E-09 1.31140E-02 2.59529E-01
+
+
+!8.7% MOX fuel-clad
+XSMACRO MOX-8.7 0
+  9.4862E-03 2.518600E-02 8.67209E-03 5.8791E-01
+  4.6556E-03 4.739509E-03 1.62426E-03 4.1176E-01
+  3.6240E-02 2.947805E-02 1.02716E-02 3.3906E-04
+  1.3272E-01 1.122500E-01 3.90447E-02 1.1761E-07
+  2.0840E-01 5.530301E-02 1.92576E-02 0.0000E+00
+  6.5870E-01 1.074999E+00 3.74888E-01 0.0000E+00
+  6.9017E-01 1.239298E+00 4.30599E-01 0.0000E+00
+  1.31504E-01 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00
+  4.20460E-02 3.30403E-01 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00
+  8.69720E-06 1.64630E-03 4.61792E-01 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00
+  5.19380E-09 2.60060E-09 2.47490E-03 4.68021E-01 1.85970E-04 0.00000E+00 0.00000E+00
+  0.00000E+00 0.00000E+00 0.00000E+00 5.43300E-03 2.85771E-01 2.39160E-03 0.00000E+00
+  0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00 8.39730E-03 2.47614E-01 8.96810E-03
+  0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00 8.92800E-09 1.23220E-02 2.56093E-01
+
+
+!Fission chamber
+XSMACRO FissCham 0
+  5.1132E-04 1.323401E-08 4.79002E-09 5.8791E-01
+  7.5813E-05 1.434500E-08 5.82564E-09 4.1176E-01
+  3.1643E-04 1.128599E-06 4.63719E-07 3.3906E-04
+  1.1675E-03 1.276299E-05 5.24406E-06 1.1761E-07
+  3.3977E-03 3.538502E-07 1.45390E-07 0.0000E+00
+  9.1886E-03 1.740099E-06 7.14972E-07 0.0000E+00
+  2.3244E-02 5.063302E-06 2.08041E-06 0.0000E+00
+  6.61659E-02 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00
+  5.90700E-02 2.40377E-01 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00
+  2.83340E-04 5.24350E-02 1.83425E-01 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00
+  1.46220E-06 2.49900E-04 9.22880E-02 7.90769E-02 3.73400E-05 0.00000E+00 0.00000E+00
+  2.06420E-08 1.92390E-05 6.93650E-03 1.69990E-01 9.97570E-02 9.17420E-04 0.00000E+00
+  0.00000E+00 2.98750E-06 1.07900E-03 2.58600E-02 2.06790E-01 3.16774E-01 4.97930E-02
+  0.00000E+00 4.21400E-07 2.05430E-04 4.92560E-03 2.44780E-02 2.38760E-01 1.09910E+00
+
+
+!Guide tube
+XSMACRO GuideTube 0
+  5.1132E-04 0.000000E+00 0.00000E+00 0.0000E+00
+  7.5801E-05 0.000000E+00 0.00000E+00 0.0000E+00
+  3.1572E-04 0.000000E+00 0.00000E+00 0.0000E+00
+  1.1582E-03 0.000000E+00 0.00000E+00 0.0000E+00
+  3.3975E-03 0.000000E+00 0.00000E+00 0.0000E+00
+  9.1878E-03 0.000000E+00 0.00000E+00 0.0000E+00
+  2.3242E-02 0.000000E+00 0.00000E+00 0.0000E+00
+  6.61659E-02 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00
+  5.90700E-02 2.40377E-01 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00
+  2.83340E-04 5.24350E-02 1.83297E-01 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00
+  1.46220E-06 2.49900E-04 9.23970E-02 7.88511E-02 3.73330E-05 0.00000E+00 0.00000E+00
+  2.06420E-08 1.92390E-05 6.94460E-03 1.70140E-01 9.97372E-02 9.17260E-04 0.00000E+00
+  0.00000E+00 2.98750E-06 1.08030E-03 2.58810E-02 2.06790E-01 3.16765E-01 4.97920E-02
+  0.00000E+00 4.21400E-07 2.05670E-04 4.92970E-03 2.44780E-02 2.38770E-01 1.09912E+00
+
+
+!Moderator
+XSMACRO Moderator 0
+  6.0105E-04 0.000000E+00 0.00000E+00 0.0000E+00
+  1.5793E-05 0.000000E+00 0.00000E+00 0.0000E+00
+  3.3716E-04 0.000000E+00 0.00000E+00 0.0000E+00
+  1.9406E-03 0.000000E+00 0.00000E+00 0.0000E+00
+  5.7416E-03 0.000000E+00 0.00000E+00 0.0000E+00
+  1.5001E-02 0.000000E+00 0.00000E+00 0.0000E+00
+  3.7239E-02 0.000000E+00 0.00000E+00 0.0000E+00
+  4.44777E-02 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00
+  1.13400E-01 2.82334E-01 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00
+  7.23470E-04 1.29940E-01 3.45256E-01 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00
+  3.74990E-06 6.23400E-04 2.24570E-01 9.10284E-02 7.14370E-05 0.00000E+00 0.00000E+00
+  5.31840E-08 4.80020E-05 1.69990E-02 4.15510E-01 1.39138E-01 2.21570E-03 0.00000E+00
+  0.00000E+00 7.44860E-06 2.64430E-03 6.37320E-02 5.11820E-01 6.99913E-01 1.32440E-01
+  0.00000E+00 1.04550E-06 5.03440E-04 1.21390E-02 6.12290E-02 5.37320E-01 2.48070E+00
+
+!Control Rod
+XSMACRO CRod 0
+  1.70490E-03 0.000000E+00 0.00000E+00 0.0000E+00
+  8.36224E-03 0.000000E+00 0.00000E+00 0.0000E+00
+  8.37901E-02 0.000000E+00 0.00000E+00 0.0000E+00
+  3.97797E-01 0.000000E+00 0.00000E+00 0.0000E+00
+  6.98763E-01 0.000000E+00 0.00000E+00 0.0000E+00
+  9.29508E-01 0.000000E+00 0.00000E+00 0.0000E+00
+  1.17836E+00 0.000000E+00 0.00000E+00 0.0000E+00
+  1.70563E-01 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00
+  4.44012E-02 4.71050E-01 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00
+  9.83670E-05 6.85480E-04 8.01859E-01 0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00
+  1.27786E-07 3.91395E-10 7.20132E-04 5.70752E-01 6.55562E-05 0.00000E+00 0.00000E+00
+  0.00000E+00 0.00000E+00 0.00000E+00 1.46015E-03 2.07838E-01 1.02427E-03 0.00000E+00
+  0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00 3.81486E-03 2.02465E-01 3.53043E-03
+  0.00000E+00 0.00000E+00 0.00000E+00 0.00000E+00 3.69760E-09 4.75290E-03 6.58597E-01
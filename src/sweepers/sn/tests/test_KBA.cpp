@@ -0,0 +1,141 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "UnitTest++/UnitTest++.h"
+
+#include <iostream>
+#include <string>
+#include "pugixml.hpp"
+#include "util/blitz_typedefs.hpp"
+#include "util/global_config.hpp"
+#include "core/core_mesh.hpp"
+#include "sweepers/sn/sn_sweeper_variant.hpp"
+#include "sweepers/sn/sn_sweeper_dd.hpp"
+
+using namespace mocc;
+using sn::SnSweeper_DD;
+
+// This test makes sure that the KBA Sn sweep, run on a single process,
+// reproduces the flux of the wavefront sweep. The problem is a 3x2 array of
+// fuel and moderator pins, four planes tall, with a vacuum boundary on two
+// sides so that the flux is not flat. Both sweeps use Jacobi boundary updates,
+// since the KBA sweep does not support Gauss-Seidel updates.
+
+std::string kba_mesh_xml = "<mesh id=\"1\" type=\"rect\" pitch=\"1.26\">"
+                           "<sub_x>1</sub_x>"
+                           "<sub_y>1</sub_y>"
+                           "</mesh>"
+                           "<pin id=\"1\" mesh=\"1\">"
+                           "1"
+                           "</pin>"
+                           "<pin id=\"2\" mesh=\"1\">"
+                           "2"
+                           "</pin>"
+                           "<lattice id=\"1\" nx=\"3\" ny=\"2\">"
+                           "1 2 1 2 1 1"
+                           "</lattice>"
+                           "<assembly id=\"1\" np=\"4\" hz=\"0.5\">"
+                           "<lattices>"
+                           "1 1 1 1"
+                           "</lattices>"
+                           "</assembly>"
+                           "<core nx=\"1\" ny=\"1\""
+                           " north=\"reflect\""
+                           " south=\"vacuum\""
+                           " east=\"reflect\""
+                           " west=\"vacuum\""
+                           " top=\"reflect\""
+                           " bottom=\"reflect\" >"
+                           "1"
+                           "</core>"
+                           ""
+                           "<material_lib path=\"c5g7.xsl\">"
+                           "<material id=\"1\" name=\"UO2-3.3\" />"
+                           "<material id=\"2\" name=\"Moderator\" />"
+                           "</material_lib>"
+                           ""
+                           "<source scattering=\"P0\" />";
+
+// Return the sweeper input with the passed sweep attributes
+std::string kba_sweeper_xml(const std::string &sweep)
+{
+    return "<sweeper type=\"sn\" n_inner=\"4\" boundary_update=\"jacobi\" " +
+           sweep + ">" + "<ang_quad type=\"ls\" order=\"4\" />" +
+           "</sweeper>";
+}
+
+// Sweep all of the groups a few times with a flat fission source, and return
+// the resulting flux
+ArrayB2 sweep_flux(const std::string &sweep)
+{
+    pugi::xml_document doc;
+    std::string input = kba_mesh_xml + kba_sweeper_xml(sweep);
+    REQUIRE CHECK(doc.load_string(input.c_str()));
+
+    CoreMesh mesh(doc);
+    SnSweeper_DD sweeper(doc.child("sweeper"), mesh);
+    auto source = sweeper.create_source(doc.child("source"));
+    sweeper.assign_source(source.get());
+
+    sweeper.flux() = 1.0;
+    ArrayB1 fission_source(sweeper.n_reg());
+    fission_source = 0.0;
+    sweeper.calc_fission_source(1.0, fission_source);
+
+    for (int iouter = 0; iouter < 3; iouter++) {
+        for (int ig = 0; ig < sweeper.n_group(); ig++) {
+            source->initialize_group(ig);
+            source->fission(fission_source, ig);
+            source->in_scatter(ig);
+            sweeper.sweep(ig);
+        }
+    }
+
+    ArrayB2 flux(sweeper.flux().shape());
+    flux = sweeper.flux();
+    return flux;
+}
+
+void compare_kba(const std::string &sweep)
+{
+    ArrayB2 flux_wavefront = sweep_flux("sweep=\"wavefront\"");
+    ArrayB2 flux_kba       = sweep_flux(sweep);
+
+    REQUIRE CHECK_EQUAL(flux_wavefront.size(), flux_kba.size());
+    for (int ireg = 0; ireg < (int)flux_wavefront.extent(0); ireg++) {
+        for (int ig = 0; ig < (int)flux_wavefront.extent(1); ig++) {
+            CHECK_CLOSE(flux_wavefront(ireg, ig), flux_kba(ireg, ig),
+                        1.0e-10 * flux_wavefront(ireg, ig));
+        }
+    }
+    return;
+}
+
+TEST(kba_one_plane)
+{
+    compare_kba("sweep=\"kba\"");
+}
+
+// With more than one chunk per block, but planes left over in the last one
+TEST(kba_three_planes)
+{
+    compare_kba("sweep=\"kba\" kba_planes=\"3\"");
+}
+
+int main()
+{
+    return UnitTest::RunAllTests();
+}
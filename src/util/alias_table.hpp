@@ -0,0 +1,250 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+#include "util/force_inline.hpp"
+#include "global_config.hpp"
+#include "rng_lcg.hpp"
+
+namespace mocc {
+/**
+ * \brief Walker alias table for sampling from a discrete distribution
+ *
+ * The table is built from a (not necessarily normalized) probability
+ * distribution using Vose's method. Sampling then takes constant time, no
+ * matter how many entries the distribution has: one random number picks a
+ * bin and, from its fractional part, either the bin itself or its alias.
+ * This uses the same single random number per sample as \ref
+ * RNG_LCG::sample_cdf(), though the two map random numbers to indices
+ * differently.
+ *
+ * If the distribution sums to zero, all entries are treated as equally
+ * probable.
+ */
+class AliasTable {
+public:
+    AliasTable()
+    {
+        return;
+    }
+
+    AliasTable(const VecF &pdf) : prob_(pdf.size(), 1.0), alias_(pdf.size())
+    {
+        int n = pdf.size();
+        assert(n > 0);
+
+        for (int i = 0; i < n; i++) {
+            alias_[i] = i;
+        }
+
+        real_t sum = 0.0;
+        for (const auto &p : pdf) {
+            assert(p >= 0.0);
+            sum += p;
+        }
+        if (sum <= 0.0) {
+            return;
+        }
+
+        // Scale the probabilities so that they average to one, and split
+        // them into those that under- and over-fill their bin
+        VecF scaled(n);
+        VecI small;
+        VecI large;
+        small.reserve(n);
+        large.reserve(n);
+        for (int i = 0; i < n; i++) {
+            scaled[i] = pdf[i] * n / sum;
+            if (scaled[i] < 1.0) {
+                small.push_back(i);
+            } else {
+                large.push_back(i);
+            }
+        }
+
+        // Fill each underfull bin with some of an overfull one
+        while (!small.empty() && !large.empty()) {
+            int is = small.back();
+            small.pop_back();
+            int il = large.back();
+            large.pop_back();
+
+            prob_[is]  = scaled[is];
+            alias_[is] = il;
+
+            scaled[il] = (scaled[il] + scaled[is]) - 1.0;
+            if (scaled[il] < 1.0) {
+                small.push_back(il);
+            } else {
+                large.push_back(il);
+            }
+        }
+
+        // Whatever is left over should be full, to within roundoff
+        for (const auto i : large) {
+            prob_[i] = 1.0;
+        }
+        for (const auto i : small) {
+            prob_[i] = 1.0;
+        }
+
+        return;
+    }
+
+    int size() const
+    {
+        return prob_.size();
+    }
+
+    /**
+     * \brief Sample an index from the distribution
+     */
+    MOCC_FORCE_INLINE int sample(RNG_LCG &rng) const
+    {
+        int n    = prob_.size();
+        real_t u = rng.random() * n;
+        int i    = std::min((int)u, n - 1);
+        return ((u - i) < prob_[i]) ? i : alias_[i];
+    }
+
+    /**
+     * \brief Return the probability of keeping each bin
+     */
+    const VecF &prob() const
+    {
+        return prob_;
+    }
+
+    /**
+     * \brief Return the alias of each bin
+     */
+    const VecI &alias() const
+    {
+        return alias_;
+    }
+
+private:
+    // Probability of keeping each bin, rather than taking its alias
+    VecF prob_;
+    VecI alias_;
+};
+
+/**
+ * \brief A collection of alias tables of the same size, stored end-to-end
+ *
+ * Sampling a collision needs a table for each cross-section region and
+ * group. Rather than giving each table its own pair of vectors, which would
+ * scatter them about the heap, the tables are stored in a single pair of
+ * flat arrays, with table \c i starting at <tt>i*width()</tt>. Sampling is
+ * the same as for \ref AliasTable::sample(), and never allocates.
+ */
+class AliasTableSet {
+public:
+    AliasTableSet() : width_(0)
+    {
+        return;
+    }
+
+    /**
+     * \brief Make an empty set for tables of \p width entries, with room
+     * for \p n_table of them
+     */
+    AliasTableSet(int width, int n_table = 0) : width_(width)
+    {
+        assert(width > 0);
+        prob_.reserve(width * n_table);
+        alias_.reserve(width * n_table);
+        return;
+    }
+
+    /**
+     * \brief Append a table for the passed distribution
+     */
+    void push_back(const VecF &pdf)
+    {
+        assert((int)pdf.size() == width_);
+        AliasTable table(pdf);
+        prob_.insert(prob_.end(), table.prob().begin(), table.prob().end());
+        alias_.insert(alias_.end(), table.alias().begin(),
+                      table.alias().end());
+        return;
+    }
+
+    /**
+     * \brief Return the number of tables
+     */
+    int size() const
+    {
+        return width_ > 0 ? prob_.size() / width_ : 0;
+    }
+
+    /**
+     * \brief Return the number of entries in each table
+     */
+    int width() const
+    {
+        return width_;
+    }
+
+    /**
+     * \brief Sample an index from table \p i
+     */
+    MOCC_FORCE_INLINE int sample(int i, RNG_LCG &rng) const
+    {
+        assert((i >= 0) && (i < this->size()));
+        const real_t *prob = &prob_[i * width_];
+        const int *alias   = &alias_[i * width_];
+        real_t u           = rng.random() * width_;
+        int j              = std::min((int)u, width_ - 1);
+        return ((u - j) < prob[j]) ? j : alias[j];
+    }
+
+    /**
+     * \brief Return the probabilities of all of the tables, end-to-end
+     */
+    const VecF &prob() const
+    {
+        return prob_;
+    }
+
+    /**
+     * \brief Return the aliases of all of the tables, end-to-end
+     */
+    const VecI &alias() const
+    {
+        return alias_;
+    }
+
+    /**
+     * \brief Return the number of bytes used by the tables
+     */
+    size_t memory() const
+    {
+        return prob_.capacity() * sizeof(real_t) +
+               alias_.capacity() * sizeof(int);
+    }
+
+private:
+    int width_;
+    VecF prob_;
+    VecI alias_;
+};
+} // namespace mocc
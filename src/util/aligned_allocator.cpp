@@ -0,0 +1,73 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "aligned_allocator.hpp"
+#include <atomic>
+#include <cstdlib>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+namespace {
+std::atomic<bool> use_huge_pages(false);
+}
+
+namespace mocc {
+void set_huge_pages(bool enable)
+{
+    use_huge_pages = enable;
+    return;
+}
+
+bool huge_pages()
+{
+    return use_huge_pages;
+}
+
+void *aligned_malloc(size_t n)
+{
+    if (n == 0) {
+        n = 1;
+    }
+
+    bool huge    = use_huge_pages && (n >= HUGE_PAGE);
+    size_t align = huge ? HUGE_PAGE : CACHE_LINE;
+    void *p      = nullptr;
+    if (posix_memalign(&p, align, n) != 0) {
+        throw std::bad_alloc();
+    }
+
+#ifdef __linux__
+#ifdef MADV_HUGEPAGE
+    if (huge) {
+        // Only the whole huge pages in the allocation can be promoted. This
+        // is only advice, so failure is not an error.
+        size_t len = (n / HUGE_PAGE) * HUGE_PAGE;
+        madvise(p, len, MADV_HUGEPAGE);
+    }
+#endif
+#endif
+
+    return p;
+}
+
+void aligned_free(void *p)
+{
+    free(p);
+    return;
+}
+}
@@ -0,0 +1,172 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+#include "global_config.hpp"
+
+/**
+ * \file aligned_allocator.hpp
+ * \brief Cache-line-aligned allocation for the large, hot arrays of the
+ * sweepers, and macros to tell the compiler about it.
+ */
+
+/**
+ * \brief Qualify a pointer as not aliasing any other pointer in scope
+ */
+#if defined(__GNUC__) || defined(__clang__) || defined(_MSC_VER)
+#define MOCC_RESTRICT __restrict
+#else
+#define MOCC_RESTRICT
+#endif
+
+/**
+ * \brief Return \p ptr, telling the compiler that it is aligned to \ref
+ * mocc::CACHE_LINE bytes.
+ *
+ * Only use this on pointers to the start of storage from an \ref
+ * AlignedAllocator, not on pointers into the middle of it.
+ */
+#if defined(__GNUC__) || defined(__clang__)
+#define MOCC_ASSUME_ALIGNED(ptr)                                              \
+    static_cast<decltype(ptr)>(__builtin_assume_aligned(ptr, 64))
+#else
+#define MOCC_ASSUME_ALIGNED(ptr) (ptr)
+#endif
+
+namespace mocc {
+/**
+ * \brief Alignment of all storage from \ref AlignedAllocator, in bytes
+ */
+constexpr size_t CACHE_LINE = 64;
+
+/**
+ * \brief Size of a transparent huge page, in bytes
+ */
+constexpr size_t HUGE_PAGE = 2 * 1024 * 1024;
+
+/**
+ * \brief Enable or disable the use of transparent huge pages for large
+ * allocations made through \ref AlignedAllocator
+ *
+ * This is set from the \c huge_pages attribute of the \c \<parallel\> tag,
+ * and only affects allocations made afterwards. It does nothing on platforms
+ * other than Linux.
+ */
+void set_huge_pages(bool enable);
+
+/**
+ * \brief Return whether large allocations are requested to be backed by
+ * transparent huge pages
+ */
+bool huge_pages();
+
+/**
+ * \brief Allocate \p n bytes aligned to \ref CACHE_LINE
+ *
+ * If huge pages are enabled and the allocation spans at least one huge
+ * page, it is aligned to \ref HUGE_PAGE instead and marked with \c
+ * madvise(MADV_HUGEPAGE), so that the kernel can back it with huge pages and
+ * cut down on TLB misses. The memory is not touched, so on first-touch NUMA
+ * systems it is placed near the thread that first writes to it.
+ *
+ * Throws \c std::bad_alloc on failure.
+ */
+void *aligned_malloc(size_t n);
+
+/**
+ * \brief Free memory from \ref aligned_malloc()
+ */
+void aligned_free(void *p);
+
+/**
+ * \brief Standard-conforming allocator for \ref aligned_malloc() storage
+ *
+ * Unlike \c std::allocator, default-constructing an element leaves it
+ * uninitialized (for trivial types), so \c resize() on a vector using this
+ * allocator does not touch the new storage. This keeps first-touch placement
+ * with whichever thread fills the storage, rather than the thread that
+ * allocates it. Pass an explicit value to \c resize() or the constructor to
+ * initialize.
+ */
+template <class T> class AlignedAllocator {
+public:
+    typedef T value_type;
+
+    template <class U> struct rebind {
+        typedef AlignedAllocator<U> other;
+    };
+
+    AlignedAllocator() noexcept
+    {
+        return;
+    }
+
+    template <class U> AlignedAllocator(const AlignedAllocator<U> &) noexcept
+    {
+        return;
+    }
+
+    T *allocate(size_t n)
+    {
+        return static_cast<T *>(aligned_malloc(n * sizeof(T)));
+    }
+
+    void deallocate(T *p, size_t)
+    {
+        aligned_free(p);
+        return;
+    }
+
+    /**
+     * \brief Default-initialize, rather than value-initialize, elements
+     */
+    template <class U> void construct(U *p)
+    {
+        ::new (static_cast<void *>(p)) U;
+        return;
+    }
+
+    template <class U, class... Args> void construct(U *p, Args &&... args)
+    {
+        ::new (static_cast<void *>(p)) U(std::forward<Args>(args)...);
+        return;
+    }
+};
+
+template <class T, class U>
+bool operator==(const AlignedAllocator<T> &, const AlignedAllocator<U> &)
+{
+    return true;
+}
+
+template <class T, class U>
+bool operator!=(const AlignedAllocator<T> &, const AlignedAllocator<U> &)
+{
+    return false;
+}
+
+/**
+ * \brief A \c std::vector with cache-line-aligned storage
+ */
+template <class T> using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+typedef AlignedVector<real_t> AlignedVecF;
+}
@@ -0,0 +1,113 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cassert>
+
+namespace mocc {
+/**
+ * \brief Hand the angles of a sweep from a producer to a consumer as they
+ * are finished
+ *
+ * The producer calls \ref begin() once the data that the consumer needs
+ * before any angle are in place, \ref angle_done() for each angle, in order,
+ * and \ref finish() once it is done altogether. The consumer waits on each
+ * of these in turn. \ref finish() also releases all of the angles, so a
+ * producer that fails part of the way through should still call it, to keep
+ * the consumer from waiting forever.
+ *
+ * The waits spin, like those of the Gauss-Seidel plane sweeps, since the
+ * producer is expected to keep up.
+ */
+class AnglePipeline {
+public:
+    AnglePipeline() : n_ang_(0), begun_(false), n_done_(0), finished_(false)
+    {
+        return;
+    }
+
+    /**
+     * \brief Start a new sweep of \p n_ang angles
+     *
+     * Neither side may be working on the previous sweep.
+     */
+    void reset(int n_ang)
+    {
+        n_ang_ = n_ang;
+        begun_.store(false, std::memory_order_relaxed);
+        n_done_.store(0, std::memory_order_relaxed);
+        finished_.store(false, std::memory_order_release);
+        return;
+    }
+
+    void begin()
+    {
+        begun_.store(true, std::memory_order_release);
+        return;
+    }
+
+    void angle_done(int iang)
+    {
+        assert(iang == n_done_.load(std::memory_order_relaxed));
+        n_done_.store(iang + 1, std::memory_order_release);
+        return;
+    }
+
+    void finish()
+    {
+        begun_.store(true, std::memory_order_release);
+        n_done_.store(n_ang_, std::memory_order_release);
+        finished_.store(true, std::memory_order_release);
+        return;
+    }
+
+    void wait_begin() const
+    {
+        while (!begun_.load(std::memory_order_acquire)) {
+        }
+        return;
+    }
+
+    void wait_angle(int iang) const
+    {
+        assert(iang < n_ang_);
+        while (n_done_.load(std::memory_order_acquire) <= iang) {
+        }
+        return;
+    }
+
+    void wait_finish() const
+    {
+        while (!finished_.load(std::memory_order_acquire)) {
+        }
+        return;
+    }
+
+    int n_ang() const
+    {
+        return n_ang_;
+    }
+
+private:
+    int n_ang_;
+    std::atomic<bool> begun_;
+    // Number of angles done so far. They are done in order.
+    std::atomic<int> n_done_;
+    std::atomic<bool> finished_;
+};
+}
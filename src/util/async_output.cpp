@@ -0,0 +1,112 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include "async_output.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include "error.hpp"
+
+namespace mocc {
+AsyncOutput OutputQueue;
+
+AsyncOutput::AsyncOutput() : busy_(false), done_(false)
+{
+    return;
+}
+
+AsyncOutput::~AsyncOutput()
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_ = true;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    return;
+}
+
+void AsyncOutput::submit(std::string filename, std::vector<char> data)
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        this->check_error();
+        queue_.emplace_back(std::move(filename), std::move(data));
+        if (!thread_.joinable()) {
+            thread_ = std::thread(&AsyncOutput::run, this);
+        }
+    }
+    cv_.notify_all();
+    return;
+}
+
+void AsyncOutput::flush()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this] { return queue_.empty() && !busy_; });
+    this->check_error();
+    return;
+}
+
+void AsyncOutput::run()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        cv_.wait(lock, [this] { return done_ || !queue_.empty(); });
+        if (queue_.empty()) {
+            // Only get here when done_ is set, and there's nothing left
+            break;
+        }
+
+        auto job = std::move(queue_.front());
+        queue_.pop_front();
+        busy_ = true;
+
+        // Write without holding the lock, so that the solver can keep
+        // submitting. Write to a temporary file first and move it into
+        // place, so that the file is never seen half-written (e.g. a
+        // checkpoint, if the run dies mid-write).
+        lock.unlock();
+        std::string tmp = job.first + ".tmp";
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        out.write(job.second.data(), job.second.size());
+        bool ok = out.good();
+        out.close();
+        ok = ok && (std::rename(tmp.c_str(), job.first.c_str()) == 0);
+        lock.lock();
+
+        if (!ok && error_.empty()) {
+            error_ = "Failed to write output file: " + job.first;
+        }
+        busy_ = false;
+        cv_.notify_all();
+    }
+    return;
+}
+
+void AsyncOutput::check_error()
+{
+    if (!error_.empty()) {
+        std::string msg = error_;
+        error_.clear();
+        throw EXCEPT(msg);
+    }
+    return;
+}
+} // namespace mocc
@@ -0,0 +1,88 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace mocc {
+/**
+ * \brief A queue of files to be written to disk by a background thread
+ *
+ * Solvers that want to dump their state in the middle of a run can write
+ * their output into an \ref H5Node opened with \ref H5Access::MEMORY, which
+ * leaves a snapshot of the data in memory, and hand its \ref H5Node::image()
+ * to \ref submit(). The solver can then carry on, while the background
+ * thread writes the file. Since the background thread only ever writes raw
+ * bytes, it does not need a thread-safe HDF5 library.
+ *
+ * The thread is started with the first submission. Errors on the background
+ * thread are reported by the next call to \ref submit() or \ref flush().
+ *
+ * There is a global \ref OutputQueue, which is flushed before the program
+ * exits.
+ */
+class AsyncOutput {
+public:
+    AsyncOutput();
+
+    ~AsyncOutput();
+
+    AsyncOutput(const AsyncOutput &) = delete;
+    AsyncOutput &operator=(const AsyncOutput &) = delete;
+
+    /**
+     * \brief Queue a file to be written
+     *
+     * \param filename the name of the file to write
+     * \param data the contents of the file
+     */
+    void submit(std::string filename, std::vector<char> data);
+
+    /**
+     * \brief Block until all of the queued files have been written
+     */
+    void flush();
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::pair<std::string, std::vector<char>>> queue_;
+
+    // Whether the background thread is writing a file, or should stop
+    bool busy_;
+    bool done_;
+
+    // Any error from the background thread, not yet reported
+    std::string error_;
+
+    std::thread thread_;
+
+    void run();
+
+    // Throw any pending error. Requires the lock.
+    void check_error();
+};
+
+extern AsyncOutput OutputQueue;
+} // namespace mocc
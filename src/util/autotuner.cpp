@@ -0,0 +1,99 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include "autotuner.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include "error.hpp"
+
+namespace mocc {
+Autotuner::Autotuner(std::vector<std::string> candidates, int n_sample,
+                     std::string cache, std::string key)
+    : candidates_(candidates),
+      n_sample_(n_sample),
+      cache_(cache),
+      key_(key),
+      next_(0),
+      n_recorded_(0),
+      best_(candidates.size(), std::numeric_limits<real_t>::max()),
+      choice_(-1),
+      cached_(false)
+{
+    if (candidates_.empty()) {
+        throw EXCEPT("No candidates to tune");
+    }
+    if (n_sample_ < 1) {
+        throw EXCEPT("Invalid number of tuning samples");
+    }
+
+    if (!cache_.empty()) {
+        std::ifstream in(cache_);
+        std::string line;
+        while (std::getline(in, line)) {
+            auto tab = line.find('\t');
+            if ((tab == std::string::npos) || (line.substr(0, tab) != key_)) {
+                continue;
+            }
+            auto it = std::find(candidates_.begin(), candidates_.end(),
+                                line.substr(tab + 1));
+            if (it != candidates_.end()) {
+                choice_ = it - candidates_.begin();
+                cached_ = true;
+            }
+        }
+    }
+
+    // Nothing to tune
+    if (candidates_.size() == 1) {
+        choice_ = 0;
+    }
+
+    return;
+}
+
+void Autotuner::record(real_t cost)
+{
+    if (!this->tuning()) {
+        return;
+    }
+
+    best_[next_] = std::min(best_[next_], cost);
+    n_recorded_++;
+    next_ = (next_ + 1) % candidates_.size();
+
+    if (n_recorded_ == n_sample_ * (int)candidates_.size()) {
+        choice_ = std::min_element(best_.begin(), best_.end()) - best_.begin();
+        if (!cache_.empty()) {
+            std::ofstream out(cache_, std::ios::app);
+            out << key_ << '\t' << candidates_[choice_] << std::endl;
+        }
+    }
+
+    return;
+}
+
+std::vector<std::pair<std::string, real_t>> Autotuner::costs() const
+{
+    std::vector<std::pair<std::string, real_t>> costs;
+    for (unsigned i = 0; i < candidates_.size(); i++) {
+        costs.emplace_back(candidates_[i], best_[i]);
+    }
+    return costs;
+}
+}
@@ -0,0 +1,117 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "global_config.hpp"
+
+namespace mocc {
+/**
+ * \brief Pick the fastest of several configurations of a kernel by timing
+ * samples of the real work
+ *
+ * The \ref Autotuner cycles through its candidate configurations, which are
+ * opaque strings to be interpreted by the client. For each sample the client
+ * applies \ref candidate(), does a representative piece of work (e.g. a
+ * sweep), and reports its cost with \ref record(). The candidates take turns,
+ * so that they all see a similar mix of work, and each is judged by its
+ * cheapest sample, which is the least affected by noise. Once every
+ * candidate has had \c n_sample samples, the cheapest is chosen, and stays
+ * the \ref candidate() from then on.
+ *
+ * The choice may be cached in a file, keyed by a string identifying the
+ * machine and problem, so that later runs with the same key skip the tuning.
+ * Each line of the cache holds a key and its choice, separated by a tab. The
+ * last line with a matching key wins, and cached choices that are not among
+ * the candidates are ignored.
+ */
+class Autotuner {
+public:
+    /**
+     * \brief Construct an \ref Autotuner
+     *
+     * \param candidates the configurations to choose from. There must be at
+     * least one.
+     * \param n_sample the number of samples to take of each candidate
+     * \param cache the name of the cache file. If empty, no cache is used.
+     * \param key the key for the choice in the cache
+     */
+    Autotuner(std::vector<std::string> candidates, int n_sample,
+              std::string cache, std::string key);
+
+    /**
+     * \brief Return whether samples are still being taken
+     */
+    bool tuning() const
+    {
+        return choice_ < 0;
+    }
+
+    /**
+     * \brief Return whether the choice came from the cache
+     */
+    bool cached() const
+    {
+        return cached_;
+    }
+
+    /**
+     * \brief Return the configuration to use for the next piece of work
+     */
+    const std::string &candidate() const
+    {
+        return candidates_[tuning() ? next_ : choice_];
+    }
+
+    /**
+     * \brief Record the cost of a sample with the current \ref candidate()
+     *
+     * Once the last sample has been recorded, the choice is made and
+     * written to the cache. This does nothing if the tuning is done.
+     */
+    void record(real_t cost);
+
+    /**
+     * \brief Return the candidates with the cost of their cheapest sample
+     * so far
+     */
+    std::vector<std::pair<std::string, real_t>> costs() const;
+
+private:
+    std::vector<std::string> candidates_;
+    int n_sample_;
+    std::string cache_;
+    std::string key_;
+
+    // Index of the candidate for the next sample
+    int next_;
+
+    // Number of samples recorded
+    int n_recorded_;
+
+    // Cheapest sample of each candidate
+    VecF best_;
+
+    // Index of the chosen candidate, or -1 while tuning
+    int choice_;
+    bool cached_;
+};
+}
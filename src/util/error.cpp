@@ -30,8 +30,14 @@ namespace mocc {
 
 std::unordered_map<std::string, Warning> Warnings;
 
+namespace {
+// Number of times each key of LogLimited() has been logged
+std::unordered_map<std::string, int> LimitedCounts;
+}
+
 void Error(const char *msg)
 {
+    FlushLogs();
     std::cerr << "ERROR: " << msg << std::endl;
     LogFile << "ERROR: " << msg << std::endl;
     exit(EXIT_FAILURE);
@@ -49,8 +55,29 @@ void Warn(const std::string &msg)
     }
 }
 
+void LogLimited(const std::string &key, const std::string &msg, int limit)
+{
+    int count = ++LimitedCounts[key];
+    if (count <= limit) {
+        LogScreen << msg << "\n";
+    } else {
+        LogFile << msg << "\n";
+    }
+    if (count == limit) {
+        Warn("Further \"" + key + "\" messages are only written to the log "
+             "file");
+    }
+}
+
+void ClearWarnings()
+{
+    Warnings.clear();
+    LimitedCounts.clear();
+}
+
 void Fail(Exception e)
 {
+    FlushLogs();
     std::cerr << e.what();
     LogFile << e.what();
     exit(EXIT_FAILURE);
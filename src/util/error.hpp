@@ -44,6 +44,21 @@ void Error(const char *msg);
 
 void Warn(const std::string &msg);
 
+/**
+ * \brief Print a message that may be repeated many times (e.g. once per group
+ * and iteration) to \c LogScreen, up to \p limit times for each \p key
+ *
+ * Once a key has been printed \p limit times, a warning says so, and the rest
+ * of its messages only go to the log file.
+ */
+void LogLimited(const std::string &key, const std::string &msg,
+                int limit = 10);
+
+/**
+ * \brief Forget all of the warnings, and the counts of \ref LogLimited()
+ */
+void ClearWarnings();
+
 class Exception : public std::exception {
 public:
     struct Info {
@@ -0,0 +1,163 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include "util/force_inline.hpp"
+#include "global_config.hpp"
+
+/**
+ * \file fast_math.hpp
+ * \brief Branch-free elementary functions for sampling batches of random
+ * numbers
+ *
+ * Calls into libm are opaque to the compiler, so a loop that takes the log or
+ * sine of each of its elements can't be vectorized without giving up strict
+ * floating point semantics everywhere. The functions here are plain
+ * polynomial evaluations (the fdlibm kernels) with no branches, so loops over
+ * them vectorize. They are accurate to a couple of ulp in double precision,
+ * which is plenty for turning random numbers into samples.
+ */
+
+namespace mocc {
+/**
+ * \brief Return the natural log of \p x
+ *
+ * \p x must be positive; values below the smallest normal double, including
+ * zero, are treated as that smallest normal, rather than returning -inf.
+ */
+MOCC_FORCE_INLINE double fast_log(double x)
+{
+    // Clamp to DBL_MIN on the bits, since a floating point comparison stops
+    // the loop from being vectorized
+    int64_t ibits;
+    std::memcpy(&ibits, &x, sizeof(ibits));
+    ibits         = std::max(ibits, INT64_C(0x0010000000000000));
+    uint64_t bits = ibits;
+
+    // Split x into 2^k * m, with m in [sqrt(2)/2, sqrt(2)). Adding the bits
+    // of 1 - sqrt(2)/2 to the mantissa carries into the exponent exactly
+    // when m >= sqrt(2).
+    bits += UINT64_C(0x00095f619980c433);
+    uint64_t k_bits = (bits >> 52) | UINT64_C(0x4330000000000000);
+    bits = (bits & UINT64_C(0x000fffffffffffff)) + UINT64_C(0x3fe6a09e667f3bcd);
+    double m;
+    std::memcpy(&m, &bits, sizeof(m));
+
+    // Convert the biased exponent to a double by placing it in the mantissa
+    // of 2^52, which avoids a 64-bit integer conversion
+    double dk;
+    std::memcpy(&dk, &k_bits, sizeof(dk));
+    dk -= 4503599627370496.0 + 1023.0;
+
+    const double ln2_hi = 6.93147180369123816490e-01;
+    const double ln2_lo = 1.90821492927058770002e-10;
+    const double lg1    = 6.666666666666735130e-01;
+    const double lg2    = 3.999999999940941908e-01;
+    const double lg3    = 2.857142874366239149e-01;
+    const double lg4    = 2.222219843214978396e-01;
+    const double lg5    = 1.818357216161805012e-01;
+    const double lg6    = 1.531383769920937332e-01;
+    const double lg7    = 1.479819860511658591e-01;
+
+    double f    = m - 1.0;
+    double hfsq = 0.5 * f * f;
+    double s    = f / (2.0 + f);
+    double z    = s * s;
+    double w    = z * z;
+    double t1   = w * (lg2 + w * (lg4 + w * lg6));
+    double t2   = z * (lg1 + w * (lg3 + w * (lg5 + w * lg7)));
+    double r    = t1 + t2;
+
+    return dk * ln2_hi - ((hfsq - (s * (hfsq + r) + dk * ln2_lo)) - f);
+}
+
+/**
+ * \brief Compute the sine and cosine of \f$ 2\pi u \f$
+ *
+ * Taking the angle in turns, rather than radians, makes the range reduction
+ * exact: \p u is reduced to its nearest quarter turn, leaving a remainder of
+ * at most an eighth of a turn for the polynomials.
+ */
+MOCC_FORCE_INLINE void fast_sincos_2pi(double u, double &s, double &c)
+{
+    // Nearest quarter turn, and the remainder in radians, in [-pi/4, pi/4]
+    double q  = u * 4.0;
+    // Rounding by adding and subtracting 1.5 * 2^52, rather than calling
+    // round(), which doesn't vectorize
+    double qn = (q + 6755399441055744.0) - 6755399441055744.0;
+    double x  = (q - qn) * 1.57079632679489661923;
+    int quad  = (int)qn & 3;
+
+    const double s1 = -1.66666666666666324348e-01;
+    const double s2 = 8.33333333332248946124e-03;
+    const double s3 = -1.98412698298579493134e-04;
+    const double s4 = 2.75573137070700676789e-06;
+    const double s5 = -2.50507602534068634195e-08;
+    const double s6 = 1.58969099521155010221e-10;
+    const double c1 = 4.16666666666666019037e-02;
+    const double c2 = -1.38888888888741095749e-03;
+    const double c3 = 2.48015872894767294178e-05;
+    const double c4 = -2.75573143513906633035e-07;
+    const double c5 = 2.08757232129817482790e-09;
+    const double c6 = -1.13596475577881948265e-11;
+
+    double z    = x * x;
+    double sinx = x + x * z * (s1 + z * (s2 + z * (s3 + z * (s4 + z * (s5 +
+                                                                  z * s6)))));
+    double cosx =
+        1.0 - 0.5 * z +
+        z * z * (c1 + z * (c2 + z * (c3 + z * (c4 + z * (c5 + z * c6)))));
+
+    // Rotate by the quarter turns
+    double sa = ((quad & 1) ? cosx : sinx);
+    double ca = ((quad & 1) ? sinx : cosx);
+    s         = ((quad == 2) || (quad == 3)) ? -sa : sa;
+    c         = ((quad == 1) || (quad == 2)) ? -ca : ca;
+    return;
+}
+
+/**
+ * \brief Overwrite each of the \p n values in \p x with its natural log
+ */
+inline void fast_log(int n, real_t *x)
+{
+#pragma omp simd
+    for (int i = 0; i < n; i++) {
+        x[i] = fast_log(x[i]);
+    }
+    return;
+}
+
+/**
+ * \brief Compute the sine and cosine of \f$ 2\pi u \f$ for each of the \p n
+ * values in \p u
+ */
+inline void fast_sincos_2pi(int n, const real_t *u, real_t *s, real_t *c)
+{
+#pragma omp simd
+    for (int i = 0; i < n; i++) {
+        double si, ci;
+        fast_sincos_2pi(u[i], si, ci);
+        s[i] = si;
+        c[i] = ci;
+    }
+    return;
+}
+} // namespace mocc
@@ -20,13 +20,43 @@
 #include <string.h>
 #include <string>
 
-std::fstream LogFile;
+mocc::LogStream LogFile;
 std::fstream OutFile;
 
 onullstream NullStream;
 
 TeeStream LogScreen(std::cout, NullStream);
 
+namespace {
+// Buffer standing in for that of std::cout while the log file is open. This
+// has to give std::cout its own buffer back before it goes away, since
+// std::cout is flushed after all of the static objects are destroyed.
+struct ScreenBuffer {
+    ~ScreenBuffer()
+    {
+        this->stop();
+    }
+
+    void start()
+    {
+        if (!buffer.is_open()) {
+            buffer.open(std::cout.rdbuf());
+            std::cout.rdbuf(&buffer);
+        }
+    }
+
+    void stop()
+    {
+        if (buffer.is_open()) {
+            std::cout.rdbuf(buffer.close());
+        }
+    }
+
+    mocc::LogBuffer buffer;
+};
+ScreenBuffer Screen;
+}
+
 // A utility function for stripping the extension from the end of the command
 // line argument and replacing with '.log'
 void StartLogFile(std::string arg)
@@ -35,8 +65,9 @@ void StartLogFile(std::string arg)
     logname.append(".log");
 
     std::cout << "Logging output to: " << logname << std::endl << std::endl;
-    LogFile.open(logname, std::fstream::out);
+    LogFile.open(logname);
 
+    Screen.start();
     LogScreen.reset(std::cout, LogFile);
 
     return;
@@ -45,4 +76,12 @@ void StartLogFile(std::string arg)
 void StopLogFile()
 {
     LogFile.close();
+    Screen.stop();
+    LogScreen.reset(std::cout, NullStream);
+}
+
+void FlushLogs()
+{
+    LogFile.flush();
+    Screen.buffer.flush();
 }
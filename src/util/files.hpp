@@ -19,14 +19,30 @@
 #pragma once
 
 #include <fstream>
+#include "util/log_buffer.hpp"
 #include "util/tee_stream.hpp"
 
-extern std::fstream LogFile;
+// The log file, and standard output once the log file has been started, are
+// buffered in memory and written by a background thread, so std::endl does
+// not wait on the file system. See mocc::LogBuffer.
+extern mocc::LogStream LogFile;
 extern std::fstream OutFile;
 
 // Print to both the log file and standard output
 extern TeeStream LogScreen;
 
+// Debug tracing output, such as the particle histories of the Monte Carlo
+// pusher, is only compiled in when MOCC is built with the TRACE option
+#ifdef MOCC_TRACE
+constexpr bool TraceEnabled = true;
+#else
+constexpr bool TraceEnabled = false;
+#endif
+
 void StartLogFile(std::string arg);
 
 void StopLogFile();
+
+// Write all of the buffered log and screen output now, e.g. before an error
+// message goes to std::cerr
+void FlushLogs();
@@ -0,0 +1,74 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include "omp_guard.h"
+
+/**
+ * \file first_touch.hpp
+ * \brief Parallel initialization of large arrays, for first-touch NUMA
+ * placement.
+ *
+ * On first-touch systems a page of memory is placed on the NUMA node of the
+ * thread that first writes to it. Filling a freshly-allocated array from the
+ * master thread therefore puts all of it on one socket, and every other
+ * socket then has to reach across the interconnect for its part of the
+ * array. These fill the array from a static-schedule parallel loop instead,
+ * so that each thread's slice lands in its local memory. For this to help,
+ * the loop should match how the solver divides the array between threads,
+ * and must be called before anything else writes to the array.
+ */
+
+namespace mocc {
+/**
+ * \brief Fill \p n elements, starting at \p data, with \p val
+ *
+ * The elements are split among the threads as by an <tt>omp for
+ * schedule(static)</tt> over [0, \p n).
+ */
+template <class T> void first_touch(T *data, size_t n, T val)
+{
+#pragma omp parallel for schedule(static)
+    for (long i = 0; i < (long)n; i++) {
+        data[i] = val;
+    }
+    return;
+}
+
+/**
+ * \brief Fill the rows of a row-major array, with \p row_len elements per
+ * row, with \p val
+ *
+ * Iteration \c i of an <tt>omp for schedule(static)</tt> over [0, \p n_row)
+ * fills row \c index(i). This matches, e.g., the reduction of thread-private
+ * flux over regions when the regions are stored in a different order than
+ * they are swept.
+ */
+template <class T, class Index>
+void first_touch_rows(T *data, int n_row, int row_len, T val, Index index)
+{
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < n_row; i++) {
+        T *row = data + (size_t)index(i) * row_len;
+        for (int j = 0; j < row_len; j++) {
+            row[j] = val;
+        }
+    }
+    return;
+}
+}
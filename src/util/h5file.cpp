@@ -16,15 +16,36 @@
 
 #include "h5file.hpp"
 
+#include <algorithm>
 #include <cassert>
 #include <sstream>
 
+#ifdef MOCC_USE_MPI
+#include <mpi.h>
+#endif
+#include "pugixml.hpp"
 #include "error.hpp"
 
+// Files are only shared through MPI-IO if HDF5 itself was built with
+// parallel support
+#if defined(MOCC_USE_MPI) && defined(H5_HAVE_PARALLEL)
+#define MOCC_H5_PARALLEL
+#endif
+
+// Parallel HDF5 only supports filters on collectively-written datasets
+// starting with 1.10.2
+#if defined(MOCC_H5_PARALLEL) && !H5_VERSION_GE(1, 10, 2)
+const bool COLLECTIVE_FILTERS = false;
+#else
+const bool COLLECTIVE_FILTERS = true;
+#endif
+
 unsigned int convert_access(mocc::H5Access access)
 {
     switch (access) {
     case mocc::H5Access::WRITE:
+    case mocc::H5Access::MEMORY:
+    case mocc::H5Access::PARALLEL:
         return H5F_ACC_TRUNC;
     case mocc::H5Access::APPEND:
         return H5F_ACC_RDWR;
@@ -33,21 +54,424 @@ unsigned int convert_access(mocc::H5Access access)
     }
 }
 
+// Index of this process in MPI_COMM_WORLD, and the number of processes.
+// Without MPI, or outside of MPI_Init()/MPI_Finalize(), this process is on
+// its own.
+int world_rank()
+{
+    int rank = 0;
+#ifdef MOCC_USE_MPI
+    int initialized = 0;
+    int finalized   = 0;
+    MPI_Initialized(&initialized);
+    MPI_Finalized(&finalized);
+    if (initialized && !finalized) {
+        MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    }
+#endif
+    return rank;
+}
+
+int world_size()
+{
+    int size = 1;
+#ifdef MOCC_USE_MPI
+    int initialized = 0;
+    int finalized   = 0;
+    MPI_Initialized(&initialized);
+    MPI_Finalized(&finalized);
+    if (initialized && !finalized) {
+        MPI_Comm_size(MPI_COMM_WORLD, &size);
+    }
+#endif
+    return size;
+}
+
+// File access properties. In-memory files use the core driver, without a
+// backing store. So do the files of the processes that don't write when a
+// file is shared without parallel HDF5, which lets them go through the same
+// motions as the root.
+H5::FileAccPropList file_access(mocc::H5Access access, bool shared,
+                                int process)
+{
+    H5::FileAccPropList fapl;
+#ifdef MOCC_H5_PARALLEL
+    if (shared) {
+        H5Pset_fapl_mpio(fapl.getId(), MPI_COMM_WORLD, MPI_INFO_NULL);
+    }
+    bool core = access == mocc::H5Access::MEMORY;
+#else
+    bool core = (access == mocc::H5Access::MEMORY) || (shared && process != 0);
+#endif
+    if (core) {
+        fapl.setCore(1 << 20, false);
+    }
+    return fapl;
+}
+
+// Upper limit on the number of elements in a chunk of a compressed dataset
+const hsize_t MAX_CHUNK = 1 << 16;
+
+// Registered identifier of the ZSTD filter plugin
+const H5Z_filter_t FILTER_ZSTD = 32015;
+
+// Whether a path relative to the root of a file is, or is inside of, another
+bool within(const std::string &path, const std::string &prefix)
+{
+    if (path.compare(0, prefix.size(), prefix) != 0) {
+        return false;
+    }
+    return (path.size() == prefix.size()) || prefix.empty() ||
+           (path[prefix.size()] == '/');
+}
+
+// Split a whitespace-separated list of paths
+std::vector<std::string> split_paths(const std::string &list)
+{
+    std::vector<std::string> paths;
+    std::stringstream ss(list);
+    std::string path;
+    while (ss >> path) {
+        paths.push_back(path);
+    }
+    return paths;
+}
+
 namespace mocc {
 H5Node::H5Node(const char *filename, H5Access access)
-    : file_(new H5::H5File(filename, convert_access(access))),
+    : process_(access == H5Access::PARALLEL ? world_rank() : 0),
+      n_process_(access == H5Access::PARALLEL ? world_size() : 1),
+#ifdef MOCC_H5_PARALLEL
+      sharing_(n_process_ > 1 ? Sharing::COLLECTIVE : Sharing::NONE),
+#else
+      sharing_(n_process_ > 1 ? Sharing::GATHER : Sharing::NONE),
+#endif
+      writer_(process_ == 0),
+      file_(new H5::H5File(filename, convert_access(access),
+                           H5::FileCreatPropList::DEFAULT,
+                           file_access(access, sharing_ != Sharing::NONE,
+                                       process_))),
       node_(file_),
-      access_(access)
+      access_(access),
+      filter_(H5Filter::NONE),
+      level_(0),
+      single_(false)
 {
     return;
 }
 
-H5Node::H5Node(std::shared_ptr<H5::CommonFG> node, H5Access access)
-    : file_(nullptr), node_(node), access_(access)
+H5Node::H5Node(const H5Node &parent, std::shared_ptr<H5::CommonFG> node,
+               std::string path)
+    : process_(parent.process_),
+      n_process_(parent.n_process_),
+      sharing_(parent.sharing_),
+      writer_(parent.writer_),
+      file_(nullptr),
+      node_(node),
+      access_(parent.access_),
+      path_(path),
+      filter_(parent.filter_),
+      level_(parent.level_),
+      single_(parent.single_),
+      include_(parent.include_),
+      exclude_(parent.exclude_)
 {
     return;
 }
 
+void H5Node::set_compression(H5Filter filter, int level)
+{
+    switch (filter) {
+    case H5Filter::NONE:
+        level = 0;
+        break;
+    case H5Filter::GZIP:
+        if ((level < 1) || (level > 9)) {
+            throw EXCEPT("Invalid HDF5 compression level");
+        }
+        break;
+    case H5Filter::SZIP:
+        if (H5Zfilter_avail(H5Z_FILTER_SZIP) <= 0) {
+            throw EXCEPT("The SZIP filter is not available");
+        }
+        break;
+    case H5Filter::ZSTD:
+        if ((level < 1) || (level > 22)) {
+            throw EXCEPT("Invalid HDF5 compression level");
+        }
+        if (H5Zfilter_avail(FILTER_ZSTD) <= 0) {
+            throw EXCEPT("The ZSTD filter plugin is not available");
+        }
+        break;
+    }
+
+    filter_ = filter;
+    level_  = level;
+    return;
+}
+
+void H5Node::set_selection(std::vector<std::string> include,
+                           std::vector<std::string> exclude)
+{
+    include_.clear();
+    for (const auto &p : include) {
+        include_.push_back(this->full_path("/" + p));
+    }
+    exclude_.clear();
+    for (const auto &p : exclude) {
+        exclude_.push_back(this->full_path("/" + p));
+    }
+    return;
+}
+
+void H5Node::configure(const pugi::xml_node &input)
+{
+    if (input.empty()) {
+        return;
+    }
+
+    std::string precision = input.attribute("precision").value();
+    if (precision == "single") {
+        single_ = true;
+    } else if (precision.empty() || (precision == "double")) {
+        single_ = false;
+    } else {
+        throw EXCEPT("Unrecognized output precision: " + precision);
+    }
+
+    std::string compression = input.attribute("compression").value();
+    H5Filter filter         = H5Filter::NONE;
+    int level               = input.attribute("level").as_int(4);
+    if (compression == "gzip") {
+        filter = H5Filter::GZIP;
+    } else if (compression == "szip") {
+        filter = H5Filter::SZIP;
+    } else if (compression == "zstd") {
+        filter = H5Filter::ZSTD;
+    } else if (!compression.empty() && (compression != "none")) {
+        throw EXCEPT("Unrecognized output compression: " + compression);
+    }
+    this->set_compression(filter, level);
+
+    this->set_selection(split_paths(input.attribute("include").value()),
+                        split_paths(input.attribute("exclude").value()));
+
+    return;
+}
+
+bool H5Node::selected(const std::string &path) const
+{
+    std::string full = this->full_path(path);
+    for (const auto &p : exclude_) {
+        if (within(full, p)) {
+            return false;
+        }
+    }
+    if (include_.empty()) {
+        return true;
+    }
+    for (const auto &p : include_) {
+        if (within(full, p)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string H5Node::full_path(const std::string &path) const
+{
+    std::string full = ((!path.empty()) && (path[0] == '/')) ? "" : path_;
+    std::stringstream ss(path);
+    std::string component;
+    while (std::getline(ss, component, '/')) {
+        if (component.empty() || (component == ".")) {
+            continue;
+        }
+        if (!full.empty()) {
+            full += "/";
+        }
+        full += component;
+    }
+    return full;
+}
+
+void H5Node::write_slab(std::string path, const real_t *data,
+                        const std::vector<hsize_t> &dims, hsize_t first,
+                        hsize_t count)
+{
+    if (dims.empty() || (first + count > dims[0])) {
+        std::stringstream msg;
+        msg << "Slab is outside of dataset: " << path;
+        throw EXCEPT(msg.str());
+    }
+    if ((sharing_ == Sharing::NONE) && ((first != 0) || (count != dims[0]))) {
+        std::stringstream msg;
+        msg << "Slab does not cover the unshared dataset: " << path;
+        throw EXCEPT(msg.str());
+    }
+
+    // Every process has to skip the dataset, or none of them
+    if (!this->selected(path)) {
+        return;
+    }
+
+    hsize_t stride = 1;
+    for (unsigned i = 1; i < dims.size(); i++) {
+        stride *= dims[i];
+    }
+    hsize_t size = dims[0] * stride;
+
+    // Gather the slabs onto the root, which writes the whole dataset
+    std::vector<real_t> gathered;
+#ifdef MOCC_USE_MPI
+    if (sharing_ == Sharing::GATHER) {
+        unsigned long long slab[2] = {first * stride, count * stride};
+        std::vector<unsigned long long> slabs(writer_ ? 2 * n_process_ : 0);
+        MPI_Gather(slab, 2, MPI_UNSIGNED_LONG_LONG, slabs.data(), 2,
+                   MPI_UNSIGNED_LONG_LONG, 0, MPI_COMM_WORLD);
+        std::vector<int> displs(slabs.size() / 2);
+        std::vector<int> counts(slabs.size() / 2);
+        for (unsigned ip = 0; ip < counts.size(); ip++) {
+            displs[ip] = slabs[2 * ip];
+            counts[ip] = slabs[2 * ip + 1];
+        }
+        if (writer_) {
+            gathered.resize(size);
+        }
+        MPI_Gatherv(data, count * stride, MPI_DOUBLE, gathered.data(),
+                    counts.data(), displs.data(), MPI_DOUBLE, 0,
+                    MPI_COMM_WORLD);
+        data = gathered.data();
+    }
+#endif
+
+    try {
+        H5::DSetCreatPropList plist;
+        // Chunk as many whole indices of the leading dimension as fit
+        std::vector<hsize_t> chunk(dims);
+        if (size > 0) {
+            hsize_t rows = std::max<hsize_t>(1, MAX_CHUNK / stride);
+            chunk[0]     = std::min(dims[0], rows);
+            plist.setChunk(chunk.size(), chunk.data());
+            if ((sharing_ != Sharing::COLLECTIVE) || COLLECTIVE_FILTERS) {
+                this->add_filter(plist);
+            }
+        }
+
+        H5::DataSpace space(dims.size(), dims.data());
+        H5::DataSet dataset =
+            node_->createDataSet(path, this->float_type(), space, plist);
+
+        if (sharing_ == Sharing::COLLECTIVE) {
+#ifdef MOCC_H5_PARALLEL
+            std::vector<hsize_t> offset(dims.size(), 0);
+            std::vector<hsize_t> extent(dims);
+            offset[0] = first;
+            extent[0] = count;
+            H5::DataSpace mem_space(extent.size(), extent.data());
+            if (count > 0) {
+                space.selectHyperslab(H5S_SELECT_SET, extent.data(),
+                                      offset.data());
+            } else {
+                space.selectNone();
+                mem_space.selectNone();
+            }
+            H5::DSetMemXferPropList xfer;
+            H5Pset_dxpl_mpio(xfer.getId(), H5FD_MPIO_COLLECTIVE);
+            dataset.write(data, H5::PredType::NATIVE_DOUBLE, mem_space,
+                          space, xfer);
+#endif
+        } else if (writer_ && (size > 0)) {
+            dataset.write(data, H5::PredType::NATIVE_DOUBLE);
+        }
+    } catch (...) {
+        std::stringstream msg;
+        msg << "Failed to write dataset slab: " << path;
+        throw EXCEPT(msg.str());
+    }
+
+    return;
+}
+
+std::vector<char> H5Node::image()
+{
+    if (!file_ || (access_ != H5Access::MEMORY)) {
+        throw EXCEPT("Only in-memory files have an image");
+    }
+
+    hid_t id = file_->getId();
+    H5Fflush(id, H5F_SCOPE_GLOBAL);
+    ssize_t size = H5Fget_file_image(id, nullptr, 0);
+    if (size < 0) {
+        throw EXCEPT("Failed to get HDF5 file image size");
+    }
+    std::vector<char> buf(size);
+    if (H5Fget_file_image(id, buf.data(), size) != size) {
+        throw EXCEPT("Failed to get HDF5 file image");
+    }
+
+    return buf;
+}
+
+H5::DSetCreatPropList
+H5Node::dataset_properties(const std::vector<hsize_t> &dims) const
+{
+    H5::DSetCreatPropList plist;
+    if ((filter_ == H5Filter::NONE) || dims.empty()) {
+        return plist;
+    }
+
+    // Whole datasets are only written by the root, which can't use filters
+    // on a file shared through MPI-IO
+    if (sharing_ == Sharing::COLLECTIVE) {
+        return plist;
+    }
+
+    // Chunk the full trailing dimensions, and as much of the leading ones
+    // as fits.
+    std::vector<hsize_t> chunk(dims);
+    hsize_t size = 1;
+    for (const auto d : dims) {
+        if (d == 0) {
+            return plist;
+        }
+        size *= d;
+    }
+    for (auto &c : chunk) {
+        if (size <= MAX_CHUNK) {
+            break;
+        }
+        hsize_t rest = size / c;
+        c            = std::max<hsize_t>(1, MAX_CHUNK / rest);
+        size         = rest * c;
+    }
+
+    plist.setChunk(chunk.size(), chunk.data());
+    this->add_filter(plist);
+
+    return plist;
+}
+
+void H5Node::add_filter(H5::DSetCreatPropList &plist) const
+{
+    switch (filter_) {
+    case H5Filter::NONE:
+        break;
+    case H5Filter::GZIP:
+        plist.setDeflate(level_);
+        break;
+    case H5Filter::SZIP:
+        plist.setSzip(H5_SZIP_NN_OPTION_MASK, 16);
+        break;
+    case H5Filter::ZSTD: {
+        unsigned int level = level_;
+        plist.setFilter(FILTER_ZSTD, H5Z_FLAG_MANDATORY, 1, &level);
+        break;
+    }
+    }
+    return;
+}
+
 H5Node H5Node::create_group(std::string path)
 {
     if (access_ != H5Access::READ) {
@@ -61,7 +485,7 @@ H5Node H5Node::create_group(std::string path)
             msg << "Failed to create group '" << path << "'";
             throw EXCEPT(msg.str())
         }
-        return H5Node(sp, access_);
+        return H5Node(*this, sp, this->full_path(path));
     } else {
         throw EXCEPT("No write permissions");
     }
@@ -85,6 +509,32 @@ void H5Node::create_link(std::string source, std::string destination,
     return;
 }
 
+bool H5Node::exists(std::string path) const
+{
+    // H5Lexists needs every intermediate link to exist, so check the path
+    // one component at a time
+    hid_t loc = node_->getLocId();
+    std::string partial;
+    std::stringstream ss(path);
+    std::string component;
+    while (std::getline(ss, component, '/')) {
+        if (component.empty()) {
+            if (partial.empty()) {
+                partial = "/";
+            }
+            continue;
+        }
+        if (!partial.empty() && (partial.back() != '/')) {
+            partial += "/";
+        }
+        partial += component;
+        if (H5Lexists(loc, partial.c_str(), H5P_DEFAULT) <= 0) {
+            return false;
+        }
+    }
+    return !partial.empty();
+}
+
 std::vector<hsize_t> H5Node::dimensions(std::string path)
 {
     try {
@@ -104,28 +554,36 @@ std::vector<hsize_t> H5Node::dimensions(std::string path)
 
 void H5Node::write(std::string path, const VecF &data)
 {
-    hsize_t *dims_a = new hsize_t;
-    *dims_a         = data.size();
+    if (!this->selected(path)) {
+        return;
+    }
+
+    std::vector<hsize_t> dims_a(1, data.size());
 
     try {
-        H5::DataSpace space(1, dims_a);
+        H5::DataSpace space(1, dims_a.data());
         H5::DataSet dataset =
-            node_->createDataSet(path, H5::PredType::NATIVE_DOUBLE, space);
-        dataset.write(data.data(), H5::PredType::NATIVE_DOUBLE);
+            node_->createDataSet(path, this->float_type(), space,
+                                 this->dataset_properties(dims_a));
+        if (writer_) {
+            dataset.write(data.data(), H5::PredType::NATIVE_DOUBLE);
+        }
     } catch (...) {
         std::stringstream msg;
         msg << "Failed to write dataset: " << path;
         throw EXCEPT(msg.str().c_str());
     }
 
-    delete dims_a;
-
     return;
 }
 
 void H5Node::write(std::string path, const VecF &data, VecI dims)
 {
-    hsize_t *dims_a = new hsize_t[dims.size()];
+    if (!this->selected(path)) {
+        return;
+    }
+
+    std::vector<hsize_t> dims_a(dims.size());
     int size = 1;
     for (unsigned i = 0; i < dims.size(); i++) {
         dims_a[i] = dims[i];
@@ -134,23 +592,59 @@ void H5Node::write(std::string path, const VecF &data, VecI dims)
     assert(size == data.size());
 
     try {
-        H5::DataSpace space(dims.size(), dims_a);
+        H5::DataSpace space(dims.size(), dims_a.data());
         H5::DataSet dataset =
-            node_->createDataSet(path, H5::PredType::NATIVE_DOUBLE, space);
-        dataset.write(data.data(), H5::PredType::NATIVE_DOUBLE);
+            node_->createDataSet(path, this->float_type(), space,
+                                 this->dataset_properties(dims_a));
+        if (writer_) {
+            dataset.write(data.data(), H5::PredType::NATIVE_DOUBLE);
+        }
     } catch (...) {
         std::stringstream msg;
         msg << "Failed to write dataset: " << path;
         throw EXCEPT(msg.str().c_str());
     }
 
-    delete[] dims_a;
+    return;
+}
+
+void H5Node::write(std::string path, const VecI &data, VecI dims)
+{
+    if (!this->selected(path)) {
+        return;
+    }
+
+    std::vector<hsize_t> dims_a(dims.size());
+    int size = 1;
+    for (unsigned i = 0; i < dims.size(); i++) {
+        dims_a[i] = dims[i];
+        size *= dims[i];
+    }
+    assert(size == (int)data.size());
+
+    try {
+        H5::DataSpace space(dims.size(), dims_a.data());
+        H5::DataSet dataset =
+            node_->createDataSet(path, H5::PredType::NATIVE_INT, space,
+                                 this->dataset_properties(dims_a));
+        if (writer_) {
+            dataset.write(data.data(), H5::PredType::NATIVE_INT);
+        }
+    } catch (...) {
+        std::stringstream msg;
+        msg << "Failed to write dataset: " << path;
+        throw EXCEPT(msg.str().c_str());
+    }
 
     return;
 }
 
 void H5Node::write(std::string path, const ArrayB1 &data, VecI dims)
 {
+    if (!this->selected(path)) {
+        return;
+    }
+
     if (!data.isStorageContiguous()) {
         throw EXCEPT("Data is not contiguous.");
     }
@@ -163,8 +657,11 @@ void H5Node::write(std::string path, const ArrayB1 &data, VecI dims)
     try {
         H5::DataSpace space(dims.size(), dims_a.data());
         H5::DataSet dataset =
-            node_->createDataSet(path, H5::PredType::NATIVE_DOUBLE, space);
-        dataset.write(data.data(), H5::PredType::NATIVE_DOUBLE);
+            node_->createDataSet(path, this->float_type(), space,
+                                 this->dataset_properties(dims_a));
+        if (writer_) {
+            dataset.write(data.data(), H5::PredType::NATIVE_DOUBLE);
+        }
     } catch (...) {
         std::stringstream msg;
         msg << "Failed to write dataset: " << path;
@@ -251,14 +748,106 @@ void H5Node::read(std::string path, std::vector<double> &data) const
     return;
 }
 
+void H5Node::read(std::string path, VecI &data) const
+{
+    H5::DataSet dataset;
+    int h5size = -1;
+    int ndim   = -1;
+
+    try {
+        dataset                 = node_->openDataSet(path);
+        H5::DataSpace dataspace = dataset.getSpace();
+        ndim                    = dataspace.getSimpleExtentNdims();
+        h5size                  = dataspace.getSimpleExtentNpoints();
+    } catch (...) {
+        std::stringstream msg;
+        msg << "Failed to access dataset: " << path;
+        throw EXCEPT(msg.str());
+    }
+
+    if (ndim != 1) {
+        throw EXCEPT("Vector input only supports single-dimensional data");
+    }
+
+    if (data.size() == 0) {
+        data.resize(h5size);
+    } else {
+        if ((int)data.size() != h5size) {
+            throw EXCEPT("Incompatible data sizes");
+        }
+    }
+
+    try {
+        dataset.read(data.data(), H5::PredType::NATIVE_INT);
+    } catch (...) {
+        std::stringstream msg;
+        msg << "Failed to read dataset: " << path;
+        throw EXCEPT(msg.str());
+    }
+
+    return;
+}
+
+void H5Node::read_slab(std::string path, real_t *data, hsize_t first,
+                       hsize_t count) const
+{
+    H5::DataSet dataset;
+    H5::DataSpace space;
+    std::vector<hsize_t> dims;
+    try {
+        dataset = node_->openDataSet(path);
+        space   = dataset.getSpace();
+        dims.resize(space.getSimpleExtentNdims());
+        space.getSimpleExtentDims(dims.data());
+    } catch (...) {
+        std::stringstream msg;
+        msg << "Failed to access dataset: " << path;
+        throw EXCEPT(msg.str());
+    }
+
+    if (dims.empty() || (first + count > dims[0])) {
+        std::stringstream msg;
+        msg << "Slab is outside of dataset: " << path;
+        throw EXCEPT(msg.str());
+    }
+
+    try {
+        std::vector<hsize_t> offset(dims.size(), 0);
+        std::vector<hsize_t> extent(dims);
+        offset[0] = first;
+        extent[0] = count;
+        H5::DataSpace mem_space(extent.size(), extent.data());
+        space.selectHyperslab(H5S_SELECT_SET, extent.data(), offset.data());
+        dataset.read(data, H5::PredType::NATIVE_DOUBLE, mem_space, space);
+    } catch (...) {
+        std::stringstream msg;
+        msg << "Failed to read dataset: " << path;
+        throw EXCEPT(msg.str());
+    }
+
+    return;
+}
+
 void H5Node::write(std::string path, const std::string &str)
 {
+    if (!this->selected(path)) {
+        return;
+    }
+
     try {
-        H5::StrType vlst(0, H5T_VARIABLE);
+        // Parallel HDF5 can't write variable-length data, so use a
+        // fixed-length string in a shared file
+        H5::StrType st(0, H5T_VARIABLE);
+        if (sharing_ == Sharing::COLLECTIVE) {
+            st = H5::StrType(H5::PredType::C_S1,
+                             std::max<size_t>(1, str.size()));
+        }
         H5::DataSpace space(H5S_SCALAR);
-        H5::DataSet dataset = node_->createDataSet(path, vlst, space);
+        H5::DataSet dataset = node_->createDataSet(path, st, space);
         H5std_string str_data(str);
-        dataset.write(str_data, vlst);
+        if (writer_) {
+            dataset.write(str_data, st);
+        }
     } catch (...) {
         std::stringstream msg;
         msg << "Failed to write string data: " << path;
@@ -21,10 +21,12 @@
 #include <memory>
 #include <sstream>
 #include <string>
+#include <vector>
 
 #include "blitz_typedefs.hpp"
 #include "error.hpp"
 #include "global_config.hpp"
+#include "pugifwd.hpp"
 
 namespace mocc {
 /**
@@ -44,10 +46,38 @@ enum class H5Access {
      * Open a file as-is, with read-write permissions.
      */
     APPEND,
+    /**
+     * Create a new file in memory, which is never written to disk by HDF5
+     * itself. Use \ref H5Node::image() to get its contents, e.g. to hand to
+     * \ref AsyncOutput.
+     */
+    MEMORY,
+    /**
+     * Delete any existing file, opening a new one shared by all of the
+     * processes in \c MPI_COMM_WORLD. Every process must then perform the
+     * same sequence of operations on the file. Whole datasets are written by
+     * the root process alone, while \ref H5Node::write_slab() lets each
+     * process write its own part of a dataset.
+     *
+     * With parallel HDF5, the processes share the file through MPI-IO, and
+     * slabs are written with collective hyperslab writes. Otherwise, the
+     * slabs are gathered to the root, and only the root writes the file.
+     * With a single process this is the same as \c WRITE.
+     */
+    PARALLEL
 };
 
 enum class H5Link { HARD, SOFT };
 
+/**
+ * \brief Compression filters that may be applied to floating-point datasets
+ *
+ * SZIP and ZSTD are only available if the HDF5 library was built with SZIP,
+ * or the ZSTD filter plugin (registered filter 32015) can be found at run
+ * time.
+ */
+enum class H5Filter { NONE, GZIP, SZIP, ZSTD };
+
 /**
  * \brief Wrapper class to selected HDF5 functionality.
  *
@@ -114,9 +144,132 @@ public:
     H5Node operator[](std::string path)
     {
         std::shared_ptr<H5::CommonFG> g(new H5::Group(node_->openGroup(path)));
-        return H5Node(g, access_);
+        return H5Node(*this, g, this->full_path(path));
+    }
+
+    /**
+     * \brief Compress the floating-point datasets subsequently written
+     * through this node, and the groups created from it.
+     *
+     * \param level the deflate level, from 0 (no compression, the default)
+     * to 9. Compressed datasets are chunked along their leading dimensions.
+     */
+    void set_compression(int level)
+    {
+        this->set_compression(level > 0 ? H5Filter::GZIP : H5Filter::NONE,
+                              level);
+    }
+
+    /**
+     * \brief Compress the floating-point datasets subsequently written
+     * through this node with the given filter
+     *
+     * \param filter the compression filter
+     * \param level the compression level: 1 to 9 for \c GZIP, 1 to 22 for
+     * \c ZSTD. This is ignored for \c SZIP and \c NONE.
+     *
+     * This throws if the filter is not available to the HDF5 library.
+     */
+    void set_compression(H5Filter filter, int level);
+
+    /**
+     * \brief Store the floating-point arrays subsequently written through
+     * this node (but not the scalars) in single precision
+     *
+     * The data are converted by the HDF5 library as they are written.
+     */
+    void set_single_precision(bool single)
+    {
+        single_ = single;
+    }
+
+    /**
+     * \brief Select which datasets subsequently written through this node
+     * actually make it into the file
+     *
+     * \param include the paths of the datasets or groups to write, relative
+     * to the root of the file. If empty, everything not excluded is written.
+     * \param exclude the paths of the datasets or groups not to write
+     *
+     * Writes to datasets that aren't selected are silently dropped. Groups
+     * are still created, so that the structure of the file does not change.
+     */
+    void set_selection(std::vector<std::string> include,
+                       std::vector<std::string> exclude);
+
+    /**
+     * \brief Apply the output options from an \c \<output\> tag
+     *
+     * This sets the precision (\c precision="single" or "double"), the
+     * compression filter (\c compression="none", "gzip", "szip" or "zstd")
+     * and its \c level, along with the whitespace-separated \c include and
+     * \c exclude lists of paths to pass to \ref set_selection(). An empty
+     * node leaves the defaults.
+     */
+    void configure(const pugi::xml_node &input);
+
+    /**
+     * \brief Return whether a dataset at the given path would be written
+     *
+     * This may be used to skip the preparation of data that the output
+     * selection would drop anyway.
+     */
+    bool selected(const std::string &path) const;
+
+    /**
+     * \brief Return the contents of the file, as it would be written to disk
+     *
+     * This is only valid for the root node of a file opened with \ref
+     * H5Access::MEMORY.
+     */
+    std::vector<char> image();
+
+    /**
+     * \brief Return the number of processes sharing the file, each of which
+     * should pass its own part to \ref write_slab()
+     *
+     * This is one unless the file was opened with \ref H5Access::PARALLEL.
+     */
+    int n_process() const
+    {
+        return n_process_;
     }
 
+    /**
+     * \brief Return the index of this process among those sharing the file
+     */
+    int process() const
+    {
+        return process_;
+    }
+
+    /**
+     * \brief Write this process's slab of a dataset distributed along its
+     * leading dimension
+     *
+     * \param path the path to the dataset
+     * \param data the values of this process's slab, in row-major order
+     * \param dims the dimensions of the whole dataset
+     * \param first the first index of this process's slab in the leading
+     * dimension
+     * \param count the extent of this process's slab in the leading
+     * dimension. This may be zero.
+     *
+     * This must be called by every process sharing the file (see \ref
+     * n_process()), with the same \p path and \p dims, and the slabs must
+     * not overlap. The dataset is chunked by whole indices of the leading
+     * dimension (e.g. whole planes of a 3-D pin array). If the file is not
+     * shared, the slab must cover the whole dataset.
+     */
+    void write_slab(std::string path, const real_t *data,
+                    const std::vector<hsize_t> &dims, hsize_t first,
+                    hsize_t count);
+
+    /**
+     * \brief Return whether a dataset or group exists at the path specified
+     */
+    bool exists(std::string path) const;
+
     /**
      * \brief Return the dimensions of the dataset specified by the path
      *
@@ -137,6 +290,12 @@ public:
      */
     void write(std::string path, const VecF &data, VecI dims);
 
+    /**
+     * \brief Write an std::vector<int> to the file, using specified
+     * dimensions.
+     */
+    void write(std::string path, const VecI &data, VecI dims);
+
     void write(std::string path, const std::string &str);
 
     /**
@@ -177,11 +336,18 @@ public:
                 "Something fishy is going on with array dimensions.");
         }
 
+        if (!this->selected(path)) {
+            return;
+        }
+
         try {
             H5::DataSpace space(dims.size(), dims.data());
             H5::DataSet dataset =
-                node_->createDataSet(path, H5::PredType::NATIVE_DOUBLE, space);
-            dataset.write(data.data(), H5::PredType::NATIVE_DOUBLE);
+                node_->createDataSet(path, this->float_type(), space,
+                                     this->dataset_properties(dims));
+            if (writer_) {
+                dataset.write(data.data(), H5::PredType::NATIVE_DOUBLE);
+            }
         } catch (...) {
             std::stringstream msg;
             msg << "Failed to write dataset: " << path;
@@ -196,6 +362,10 @@ public:
      */
     void write(std::string path, int data)
     {
+        if (!this->selected(path)) {
+            return;
+        }
+
         hsize_t dims_a[1];
 
         dims_a[0] = 1;
@@ -204,7 +374,37 @@ public:
             H5::DataSpace space(1, dims_a);
             H5::DataSet dataset =
                 node_->createDataSet(path, H5::PredType::NATIVE_INT, space);
-            dataset.write(&data, H5::PredType::NATIVE_INT);
+            if (writer_) {
+                dataset.write(&data, H5::PredType::NATIVE_INT);
+            }
+        } catch (...) {
+            std::stringstream msg;
+            msg << "Failed to write dataset: " << path;
+            throw EXCEPT(msg.str().c_str());
+        }
+        return;
+    }
+
+    /**
+     * \brief Write a scalar double.
+     */
+    void write(std::string path, double data)
+    {
+        if (!this->selected(path)) {
+            return;
+        }
+
+        hsize_t dims_a[1];
+
+        dims_a[0] = 1;
+
+        try {
+            H5::DataSpace space(1, dims_a);
+            H5::DataSet dataset =
+                node_->createDataSet(path, H5::PredType::NATIVE_DOUBLE, space);
+            if (writer_) {
+                dataset.write(&data, H5::PredType::NATIVE_DOUBLE);
+            }
         } catch (...) {
             std::stringstream msg;
             msg << "Failed to write dataset: " << path;
@@ -218,6 +418,10 @@ public:
      */
     void write(std::string path, uint64_t data)
     {
+        if (!this->selected(path)) {
+            return;
+        }
+
         hsize_t dims_a[1];
 
         dims_a[0] = 1;
@@ -226,7 +430,9 @@ public:
             H5::DataSpace space(1, dims_a);
             H5::DataSet dataset =
                 node_->createDataSet(path, H5::PredType::NATIVE_ULONG, space);
-            dataset.write(&data, H5::PredType::NATIVE_ULONG);
+            if (writer_) {
+                dataset.write(&data, H5::PredType::NATIVE_ULONG);
+            }
         } catch (...) {
             std::stringstream msg;
             msg << "Failed to write dataset: " << path;
@@ -240,6 +446,26 @@ public:
      */
     void read(std::string path, std::vector<double> &data) const;
 
+    /**
+     * \brief Read integer data from an \ref H5Node into an STL vector
+     */
+    void read(std::string path, VecI &data) const;
+
+    /**
+     * \brief Read a slab of a dataset along its leading dimension
+     *
+     * \param path the path to the dataset
+     * \param data the destination, with room for \p count times the number
+     * of values in one index of the leading dimension, in row-major order
+     * \param first the first index of the slab in the leading dimension
+     * \param count the extent of the slab in the leading dimension
+     *
+     * This lets a piece of a large dataset (e.g. one group of a multi-group
+     * array stored group-major) be read without reading the rest.
+     */
+    void read_slab(std::string path, real_t *data, hsize_t first,
+                   hsize_t count) const;
+
     /**
      * \brief Read data from an \ref H5Node into a 1-D Blitz array
      *
@@ -362,6 +588,30 @@ public:
         }
     }
 
+    /**
+     * \brief Read a scalar uint64_t integer
+     */
+    void read(std::string path, uint64_t &data) const
+    {
+        H5::DataSet dataset;
+
+        try {
+            dataset = node_->openDataSet(path);
+        } catch (...) {
+            std::stringstream msg;
+            msg << "Failed to access dataset: " << path;
+            throw EXCEPT(msg.str().c_str());
+        }
+
+        try {
+            dataset.read(&data, H5::PredType::NATIVE_ULONG);
+        } catch (...) {
+            std::stringstream msg;
+            msg << "Failed to read dataset: " << path;
+            throw EXCEPT(msg.str());
+        }
+    }
+
     /**
      * Write data to an HDF5 location using iterators.
      *
@@ -384,6 +634,10 @@ public:
             dims_a.push_back(di);
         }
 
+        if (!this->selected(path)) {
+            return last;
+        }
+
         VecF d(n);
         std::copy(first, last, d.begin());
         assert((int)d.size() == n);
@@ -391,8 +645,11 @@ public:
         try {
             H5::DataSpace space(dims.size(), dims_a.data());
             H5::DataSet dataset =
-                node_->createDataSet(path, H5::PredType::NATIVE_DOUBLE, space);
-            dataset.write(d.data(), H5::PredType::NATIVE_DOUBLE);
+                node_->createDataSet(path, this->float_type(), space,
+                                     this->dataset_properties(dims_a));
+            if (writer_) {
+                dataset.write(d.data(), H5::PredType::NATIVE_DOUBLE);
+            }
         } catch (...) {
             std::stringstream msg;
             msg << "Failed to write dataset: " << path;
@@ -402,11 +659,80 @@ public:
     }
 
 private:
-    H5Node(std::shared_ptr<H5::CommonFG> node_, H5Access access);
+    /**
+     * \brief How the processes share a file opened with \ref
+     * H5Access::PARALLEL
+     */
+    enum class Sharing {
+        // Not shared
+        NONE,
+        // Shared through MPI-IO
+        COLLECTIVE,
+        // Only the root writes the file, and the slabs are gathered to it
+        GATHER
+    };
+
+    /**
+     * \brief Construct a node for another location in the same file as \p
+     * parent
+     */
+    H5Node(const H5Node &parent, std::shared_ptr<H5::CommonFG> node,
+           std::string path);
+
+    /**
+     * \brief Return the path relative to the root of the file, without
+     * leading or trailing slashes, of a path relative to this node
+     */
+    std::string full_path(const std::string &path) const;
+
+    /**
+     * \brief Return the type to store floating-point arrays as
+     */
+    const H5::PredType &float_type() const
+    {
+        return single_ ? H5::PredType::NATIVE_FLOAT
+                       : H5::PredType::NATIVE_DOUBLE;
+    }
+
+    /**
+     * \brief Add the requested compression filter to the creation properties
+     * of a chunked dataset
+     */
+    void add_filter(H5::DSetCreatPropList &plist) const;
+
+    /**
+     * \brief Return the dataset creation properties for a floating-point
+     * dataset of the given dimensions, applying chunking and compression if
+     * requested.
+     */
+    H5::DSetCreatPropList
+    dataset_properties(const std::vector<hsize_t> &dims) const;
+
+    int process_;
+    int n_process_;
+    Sharing sharing_;
+
+    // Whether this process writes whole datasets. Only the root does if the
+    // file is shared.
+    bool writer_;
 
     // Pointer to the file object. Null if not the root node of the file.
     std::shared_ptr<H5::H5File> file_;
     std::shared_ptr<H5::CommonFG> node_;
     H5Access access_;
+
+    // Path of the node, relative to the root of the file
+    std::string path_;
+
+    // Compression filter and level for new datasets
+    H5Filter filter_;
+    int level_;
+
+    // Store floating-point arrays in single precision
+    bool single_;
+
+    // Paths of the datasets and groups to write, and not to write
+    std::vector<std::string> include_;
+    std::vector<std::string> exclude_;
 };
 }
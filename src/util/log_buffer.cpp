@@ -0,0 +1,165 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "log_buffer.hpp"
+
+namespace mocc {
+LogBuffer::LogBuffer()
+    : done_(false), target_(nullptr), interval_(std::chrono::seconds(1))
+{
+    return;
+}
+
+LogBuffer::~LogBuffer()
+{
+    this->close();
+    return;
+}
+
+void LogBuffer::open(std::streambuf *target,
+                     std::chrono::milliseconds interval)
+{
+    this->close();
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        target_   = target;
+        interval_ = interval;
+        done_     = false;
+    }
+    thread_ = std::thread(&LogBuffer::run, this);
+    return;
+}
+
+std::streambuf *LogBuffer::close()
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_ = true;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+
+    // The background thread writes everything before it stops, but output
+    // may still have arrived since
+    this->flush();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    std::streambuf *target = target_;
+    target_                = nullptr;
+    return target;
+}
+
+void LogBuffer::flush()
+{
+    this->write();
+    std::unique_lock<std::mutex> lock(write_mutex_);
+    if (target_) {
+        target_->pubsync();
+    }
+    return;
+}
+
+LogBuffer::int_type LogBuffer::overflow(int_type c)
+{
+    if (traits_type::eq_int_type(c, traits_type::eof())) {
+        return traits_type::not_eof(c);
+    }
+    char ch = traits_type::to_char_type(c);
+    this->xsputn(&ch, 1);
+    return c;
+}
+
+std::streamsize LogBuffer::xsputn(const char *s, std::streamsize n)
+{
+    bool wake = false;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (!target_) {
+            return n;
+        }
+        pending_.append(s, n);
+        wake = pending_.size() > threshold;
+    }
+    if (wake) {
+        cv_.notify_all();
+    }
+    return n;
+}
+
+int LogBuffer::sync()
+{
+    // Leave it to the background thread
+    return 0;
+}
+
+void LogBuffer::run()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!done_) {
+        cv_.wait_for(lock, interval_, [this] {
+            return done_ || (pending_.size() > threshold);
+        });
+        lock.unlock();
+        if (this->write()) {
+            std::unique_lock<std::mutex> write_lock(write_mutex_);
+            target_->pubsync();
+        }
+        lock.lock();
+    }
+    return;
+}
+
+bool LogBuffer::write()
+{
+    std::unique_lock<std::mutex> write_lock(write_mutex_);
+    std::string chunk;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (!target_) {
+            return false;
+        }
+        chunk.swap(pending_);
+    }
+    if (chunk.empty()) {
+        return false;
+    }
+    target_->sputn(chunk.data(), chunk.size());
+    return true;
+}
+
+void LogStream::open(const std::string &filename)
+{
+    this->close();
+    if (file_.open(filename, std::ios::out)) {
+        buffer_.open(&file_);
+        this->clear();
+    } else {
+        this->setstate(std::ios::failbit);
+    }
+    return;
+}
+
+void LogStream::close()
+{
+    buffer_.close();
+    if (file_.is_open()) {
+        file_.close();
+    }
+    return;
+}
+} // namespace mocc
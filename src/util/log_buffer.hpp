@@ -0,0 +1,150 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <thread>
+
+namespace mocc {
+/**
+ * \brief A stream buffer that collects output in memory, and writes it to
+ * another stream buffer from a background thread
+ *
+ * Syncing the buffer (e.g. with \c std::endl) does not write anything; the
+ * background thread writes whatever has been collected every \c interval,
+ * or as soon as more than \ref threshold bytes are waiting. Only \ref
+ * flush() and \ref close() write synchronously. This keeps the log output of
+ * the solvers, which is sprinkled with \c std::endl, from waiting on the
+ * file system.
+ *
+ * Output is collected under a lock, so several threads may write to the
+ * same buffer, though their output may be interleaved. Output written while
+ * the buffer is closed is discarded.
+ */
+class LogBuffer : public std::streambuf {
+public:
+    /**
+     * Collected output beyond which the background thread is woken early
+     */
+    static const size_t threshold = 1 << 16;
+
+    LogBuffer();
+
+    ~LogBuffer();
+
+    LogBuffer(const LogBuffer &) = delete;
+    LogBuffer &operator=(const LogBuffer &) = delete;
+
+    /**
+     * \brief Start collecting output for \p target, and start the
+     * background thread
+     *
+     * \param target the stream buffer to write to
+     * \param interval the longest that output is held before it is written
+     */
+    void open(std::streambuf *target,
+              std::chrono::milliseconds interval = std::chrono::seconds(1));
+
+    /**
+     * \brief Write all of the collected output, and stop the background
+     * thread. Returns the target stream buffer.
+     */
+    std::streambuf *close();
+
+    /**
+     * \brief Write all of the collected output now, and flush the target
+     */
+    void flush();
+
+    bool is_open() const
+    {
+        return target_ != nullptr;
+    }
+
+protected:
+    int_type overflow(int_type c) override;
+
+    std::streamsize xsputn(const char *s, std::streamsize n) override;
+
+    int sync() override;
+
+private:
+    // Guards pending_ and done_
+    std::mutex mutex_;
+    // Held while writing to the target, so that the chunks of output are
+    // written in order
+    std::mutex write_mutex_;
+    std::condition_variable cv_;
+    std::string pending_;
+    bool done_;
+
+    std::streambuf *target_;
+    std::chrono::milliseconds interval_;
+    std::thread thread_;
+
+    void run();
+
+    // Write the collected output to the target. Returns whether there was
+    // any.
+    bool write();
+};
+
+/**
+ * \brief An output file stream whose output goes through a \ref LogBuffer
+ */
+class LogStream : public std::ostream {
+public:
+    LogStream() : std::ostream(&buffer_)
+    {
+        return;
+    }
+
+    ~LogStream()
+    {
+        this->close();
+        return;
+    }
+
+    void open(const std::string &filename);
+
+    void close();
+
+    /**
+     * \brief Write all of the output so far to the file
+     */
+    void flush()
+    {
+        buffer_.flush();
+        return;
+    }
+
+    bool is_open() const
+    {
+        return file_.is_open();
+    }
+
+private:
+    std::filebuf file_;
+    LogBuffer buffer_;
+};
+} // namespace mocc
@@ -0,0 +1,113 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "memory.hpp"
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <sstream>
+#include "h5file.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+namespace mocc {
+size_t peak_rss()
+{
+#if defined(__unix__) || defined(__APPLE__)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#if defined(__APPLE__)
+    // Already in bytes
+    return usage.ru_maxrss;
+#else
+    // Linux reports kilobytes
+    return usage.ru_maxrss * 1024;
+#endif
+#else
+    return 0;
+#endif
+}
+
+void release_free_memory()
+{
+#if defined(__GLIBC__)
+    malloc_trim(0);
+#endif
+    return;
+}
+
+MemoryReport &MemoryReport::child(const std::string &name)
+{
+    auto it = children_.find(name);
+    if (it == children_.end()) {
+        it = children_.emplace(name, MemoryReport(name)).first;
+    }
+    return it->second;
+}
+
+size_t MemoryReport::total() const
+{
+    size_t sum = bytes_;
+    for (const auto &c : children_) {
+        sum += c.second.total();
+    }
+    return sum;
+}
+
+void MemoryReport::print(std::ostream &os, int level) const
+{
+    for (int i = 0; i < level; i++) {
+        os << "    ";
+    }
+    os << name_ << ": " << format_bytes(this->total()) << std::endl;
+    for (const auto &c : children_) {
+        c.second.print(os, level + 1);
+    }
+    return;
+}
+
+void MemoryReport::output(H5Node &node) const
+{
+    node.write("bytes", (uint64_t)this->total());
+    for (const auto &c : children_) {
+        auto g = node.create_group(c.first);
+        c.second.output(g);
+    }
+    return;
+}
+
+std::string format_bytes(size_t bytes)
+{
+    const char *prefixes[] = {"B", "KiB", "MiB", "GiB", "TiB"};
+    double value = bytes;
+    int i        = 0;
+    while ((value >= 1024.0) && (i < 4)) {
+        value /= 1024.0;
+        i++;
+    }
+    std::stringstream s;
+    s << std::fixed << std::setprecision(i == 0 ? 0 : 2) << value << " "
+      << prefixes[i];
+    return s.str();
+}
+}
@@ -0,0 +1,123 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <iosfwd>
+#include <map>
+#include <string>
+
+namespace mocc {
+class H5Node;
+
+/**
+ * \brief Return the peak resident set size of the process so far, in bytes
+ *
+ * Returns zero on platforms where this isn't available.
+ */
+size_t peak_rss();
+
+/**
+ * \brief Return the heap memory that has been freed to the operating system,
+ * where the C library supports it
+ *
+ * Freed memory is otherwise usually kept by the allocator for reuse, and
+ * still counts towards the resident set size.
+ */
+void release_free_memory();
+
+/**
+ * \brief Return the number of bytes held by the elements of a contiguous
+ * container
+ *
+ * This works for anything with \c size() and \c data() members, which
+ * covers \c std::vector, Blitz arrays and Eigen vectors. Only the element
+ * storage is counted, not the container overhead.
+ */
+template <class Container> size_t bytes(const Container &c)
+{
+    return c.size() * sizeof(*c.data());
+}
+
+/**
+ * \brief Tree of memory footprints, broken down by subsystem
+ *
+ * This is to memory what the \ref Timer tree is to run time. Each node has
+ * a name, a number of bytes directly attributed to it, and any number of
+ * named children, which are created on first access. The \ref total() of a
+ * node includes all of its children.
+ *
+ * The major data-holding classes add themselves to a report through their
+ * \c memory() methods, so that the footprint of a run can be logged and
+ * written to the output file.
+ */
+class MemoryReport {
+public:
+    MemoryReport(const std::string &name) : name_(name), bytes_(0)
+    {
+        return;
+    }
+
+    /**
+     * \brief Attribute some bytes to a child of this node, creating the
+     * child if needed
+     */
+    void add(const std::string &name, size_t bytes)
+    {
+        this->child(name).bytes_ += bytes;
+        return;
+    }
+
+    /**
+     * \brief Return a reference to the named child, creating it if needed
+     */
+    MemoryReport &child(const std::string &name);
+
+    /**
+     * \brief Return the number of bytes in this node and all of its
+     * children
+     */
+    size_t total() const;
+
+    const std::string &name() const
+    {
+        return name_;
+    }
+
+    /**
+     * \brief Print an indented breakdown of the tree
+     */
+    void print(std::ostream &os, int level = 0) const;
+
+    /**
+     * \brief Write the tree to an HDF5 node
+     *
+     * Each child becomes a group with a \c bytes dataset holding its total.
+     */
+    void output(H5Node &node) const;
+
+private:
+    std::string name_;
+    size_t bytes_;
+    std::map<std::string, MemoryReport> children_;
+};
+
+/**
+ * \brief Format a number of bytes with a binary prefix (e.g. "1.50 MiB")
+ */
+std::string format_bytes(size_t bytes);
+}
@@ -49,3 +49,13 @@ inline int omp_get_num_procs()
 {
     return 1;
 }
+
+inline int omp_get_max_active_levels()
+{
+    return 1;
+}
+
+inline void omp_set_max_active_levels( int i )
+{
+    return;
+}
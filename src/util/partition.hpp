@@ -0,0 +1,77 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <vector>
+#include "global_config.hpp"
+#include "omp_guard.h"
+
+namespace mocc {
+/**
+ * \brief Split the indices [0, key.size()) into \p n_bucket buckets by their
+ * key
+ *
+ * Index i goes into bucket \p key[i], which must be in [0, \p n_bucket). The
+ * indices in each bucket are in ascending order, exactly as if they were
+ * pushed back in a serial loop, whatever the number of threads. Each thread
+ * counts the keys of a contiguous chunk of indices, the counts are turned
+ * into offsets in chunk order, and each thread then places its own chunk.
+ *
+ * This should be called from outside of a parallel region.
+ */
+inline std::vector<VecI> parallel_buckets(const VecI &key, int n_bucket)
+{
+    const int n = key.size();
+    std::vector<VecI> buckets(n_bucket);
+    std::vector<VecI> offset(omp_get_max_threads());
+
+#pragma omp parallel default(shared)
+    {
+        const int n_thread = omp_get_num_threads();
+        const int it       = omp_get_thread_num();
+        const int first    = (long)n * it / n_thread;
+        const int last     = (long)n * (it + 1) / n_thread;
+
+        VecI &count = offset[it];
+        count.assign(n_bucket, 0);
+        for (int i = first; i < last; i++) {
+            count[key[i]]++;
+        }
+
+#pragma omp barrier
+#pragma omp single
+        {
+            for (int ib = 0; ib < n_bucket; ib++) {
+                int size = 0;
+                for (int jt = 0; jt < n_thread; jt++) {
+                    int n_key      = offset[jt][ib];
+                    offset[jt][ib] = size;
+                    size += n_key;
+                }
+                buckets[ib].resize(size);
+            }
+        }
+
+        for (int i = first; i < last; i++) {
+            buckets[key[i]][count[key[i]]++] = i;
+        }
+    }
+
+    return buckets;
+}
+}
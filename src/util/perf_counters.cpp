@@ -0,0 +1,158 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include "perf_counters.hpp"
+
+#include <vector>
+#ifdef __linux__
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#include "omp_guard.h"
+
+namespace {
+const int N_EVENT = (int)mocc::PerfEvent::N_EVENT;
+
+// The file descriptors of the events of each thread. The first is the
+// leader of the thread's group, through which they are all read at once.
+std::vector<std::array<int, N_EVENT>> groups;
+bool is_enabled = false;
+
+#ifdef __linux__
+const uint64_t EVENT_CONFIG[N_EVENT] = {PERF_COUNT_HW_CPU_CYCLES,
+                                        PERF_COUNT_HW_INSTRUCTIONS,
+                                        PERF_COUNT_HW_CACHE_MISSES};
+
+// Open a counter on the calling thread, as a member of group, or as a new
+// group leader if group is -1
+int open_event(uint64_t config, int group)
+{
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size           = sizeof(attr);
+    attr.type           = PERF_TYPE_HARDWARE;
+    attr.config         = config;
+    attr.disabled       = group == -1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+    attr.read_format    = PERF_FORMAT_GROUP;
+    return syscall(__NR_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+void close_all()
+{
+    for (auto &group : groups) {
+        for (auto fd : group) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+    groups.clear();
+}
+#endif
+}
+
+namespace mocc {
+namespace perf {
+bool enable()
+{
+    if (is_enabled) {
+        return true;
+    }
+
+#ifdef __linux__
+    int n_thread = omp_get_max_threads();
+    std::array<int, N_EVENT> closed;
+    closed.fill(-1);
+    groups.assign(n_thread, closed);
+
+    // Each thread opens its own counters, since they only count the thread
+    // that opened them
+    bool ok = true;
+#pragma omp parallel num_threads(n_thread) reduction(&& : ok)
+    {
+        auto &group = groups[omp_get_thread_num()];
+        for (int ie = 0; ie < N_EVENT; ie++) {
+            group[ie] = open_event(EVENT_CONFIG[ie], group[0]);
+            if (group[ie] < 0) {
+                ok = false;
+                break;
+            }
+        }
+    }
+
+    if (!ok) {
+        close_all();
+        return false;
+    }
+
+    for (const auto &group : groups) {
+        ioctl(group[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(group[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+    is_enabled = true;
+#endif
+
+    return is_enabled;
+}
+
+bool enabled()
+{
+    return is_enabled;
+}
+
+PerfCounts read()
+{
+    PerfCounts counts;
+    counts.fill(0);
+
+#ifdef __linux__
+    // With PERF_FORMAT_GROUP, a read gives the number of events, followed
+    // by their values
+    uint64_t buf[N_EVENT + 1];
+    for (const auto &group : groups) {
+        if (::read(group[0], buf, sizeof(buf)) != sizeof(buf)) {
+            continue;
+        }
+        for (int ie = 0; ie < N_EVENT; ie++) {
+            counts[ie] += buf[ie + 1];
+        }
+    }
+#endif
+
+    return counts;
+}
+
+const char *name(PerfEvent event)
+{
+    switch (event) {
+    case PerfEvent::CYCLES:
+        return "cycles";
+    case PerfEvent::INSTRUCTIONS:
+        return "instructions";
+    case PerfEvent::LLC_MISSES:
+        return "llc_misses";
+    default:
+        return "unknown";
+    }
+}
+}
+}
@@ -0,0 +1,77 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+namespace mocc {
+/**
+ * \brief Hardware events that may be counted alongside a \ref Timer
+ */
+enum class PerfEvent : int {
+    CYCLES,       // CPU cycles
+    INSTRUCTIONS, // Instructions retired
+    LLC_MISSES,   // Last-level cache misses
+    N_EVENT
+};
+
+typedef std::array<uint64_t, (int)PerfEvent::N_EVENT> PerfCounts;
+
+/**
+ * \brief Hardware performance counters, read through the Linux \c
+ * perf_event interface
+ *
+ * Once enabled, each OpenMP thread counts the \ref PerfEvent values of its
+ * own user-space work, and \ref read() sums them over the threads. This lets
+ * a \ref Timer that was started and stopped on the master thread account for
+ * the work done in the parallel regions in between. Only the threads of the
+ * OpenMP thread pool at the time of \ref enable() are counted.
+ *
+ * Floating-point operations and memory bandwidth do not have portable
+ * hardware events. Instead, the traffic from the last-level cache misses
+ * (one 64-byte line each) may be used as an estimate of the bandwidth.
+ */
+namespace perf {
+/**
+ * \brief Open the counters for every thread, returning whether they are
+ * available
+ *
+ * This may fail if the operating system isn't Linux, the CPU doesn't expose
+ * the events, or the \c perf_event_paranoid setting forbids them. Calling
+ * this again once the counters are open does nothing.
+ */
+bool enable();
+
+/**
+ * \brief Return whether the counters are open
+ */
+bool enabled();
+
+/**
+ * \brief Return the counts so far, summed over the threads. These are all
+ * zero if the counters are not enabled.
+ */
+PerfCounts read();
+
+/**
+ * \brief Return the name of an event, as written to the output
+ */
+const char *name(PerfEvent event);
+}
+}
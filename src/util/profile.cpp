@@ -0,0 +1,288 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "profile.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include "util/error.hpp"
+#include "util/h5file.hpp"
+#include "util/omp_guard.h"
+
+namespace {
+const char *counter_names[] = {"segments", "exponentials", "particles"};
+
+// Escape a zone name for a JSON string
+std::string json_escape(const std::string &s)
+{
+    std::string out;
+    for (const auto c : s) {
+        if ((c == '"') || (c == '\\')) {
+            out += '\\';
+        }
+        out += c;
+    }
+    return out;
+}
+}
+
+namespace mocc {
+namespace profile {
+Profiler Profile;
+
+Profiler::Profiler() : t0_(omp_get_wtime())
+{
+    return;
+}
+
+int Profiler::register_zone(const char *name)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    zones_.emplace_back(name);
+    return zones_.size() - 1;
+}
+
+Profiler::ThreadData &Profiler::thread_data()
+{
+    thread_local ThreadData *data = nullptr;
+    if (!data) {
+        std::unique_ptr<ThreadData> t(new ThreadData);
+        t->id       = omp_get_thread_num();
+        t->tree     = {{-1, -1, 0.0, 0, {}}};
+        t->stack    = {0};
+        t->start    = {0.0};
+        t->n_events = 0;
+        t->counters.fill(0);
+        t->ring.resize(RING_SIZE);
+        data = t.get();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        threads_.push_back(std::move(t));
+    }
+    return *data;
+}
+
+void Profiler::begin(int zone)
+{
+    ThreadData &t = this->thread_data();
+    int parent    = t.stack.back();
+
+    // Find or add the node for this zone under the current one
+    int node = -1;
+    for (const auto child : t.tree[parent].children) {
+        if (t.tree[child].zone == zone) {
+            node = child;
+            break;
+        }
+    }
+    if (node < 0) {
+        node = t.tree.size();
+        t.tree.push_back({zone, parent, 0.0, 0, {}});
+        t.tree[parent].children.push_back(node);
+    }
+
+    t.stack.push_back(node);
+    t.start.push_back(omp_get_wtime());
+    return;
+}
+
+void Profiler::end()
+{
+    double stop   = omp_get_wtime();
+    ThreadData &t = this->thread_data();
+    assert(t.stack.size() > 1);
+
+    int node     = t.stack.back();
+    double start = t.start.back();
+    t.stack.pop_back();
+    t.start.pop_back();
+
+    t.tree[node].time += stop - start;
+    t.tree[node].calls++;
+
+    t.ring[t.n_events % RING_SIZE] = {node, start, stop};
+    t.n_events++;
+    return;
+}
+
+void Profiler::count(Counter counter, uint64_t n)
+{
+    this->thread_data().counters[(int)counter] += n;
+    return;
+}
+
+bool Profiler::empty() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto &t : threads_) {
+        if (t->tree.size() > 1) {
+            return false;
+        }
+        for (const auto c : t->counters) {
+            if (c > 0) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+uint64_t Profiler::total(Counter counter) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t n = 0;
+    for (const auto &t : threads_) {
+        n += t->counters[(int)counter];
+    }
+    return n;
+}
+
+std::string Profiler::path(const ThreadData &t, int node) const
+{
+    std::string p;
+    while (node > 0) {
+        const auto &n = t.tree[node];
+        p = p.empty() ? zones_[n.zone] : zones_[n.zone] + "/" + p;
+        node = n.parent;
+    }
+    return p;
+}
+
+void Profiler::write_trace(std::ostream &os) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto flags = os.flags();
+    os << std::fixed << std::setprecision(3);
+
+    os << "{\"traceEvents\":[";
+    bool first = true;
+    for (const auto &t : threads_) {
+        uint64_t n_kept = std::min<uint64_t>(t->n_events, RING_SIZE);
+        for (uint64_t i = t->n_events - n_kept; i < t->n_events; i++) {
+            const auto &e = t->ring[i % RING_SIZE];
+            const auto &n = t->tree[e.node];
+            os << (first ? "\n" : ",\n");
+            first = false;
+            os << "{\"name\":\"" << json_escape(zones_[n.zone])
+               << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << t->id
+               << ",\"ts\":" << (e.start - t0_) * 1.0e6
+               << ",\"dur\":" << (e.stop - e.start) * 1.0e6 << "}";
+        }
+    }
+    os << "\n],\"otherData\":{";
+    for (int i = 0; i < (int)Counter::N_COUNTER; i++) {
+        uint64_t n = 0;
+        for (const auto &t : threads_) {
+            n += t->counters[i];
+        }
+        os << (i > 0 ? "," : "") << "\"" << counter_names[i] << "\":" << n;
+    }
+    os << "}}" << std::endl;
+
+    os.flags(flags);
+    return;
+}
+
+void Profiler::print(std::ostream &os) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // Sum over threads by path. The map keeps parents ahead of children.
+    std::map<std::string, std::pair<double, uint64_t>> totals;
+    for (const auto &t : threads_) {
+        for (int i = 1; i < (int)t->tree.size(); i++) {
+            auto &total = totals[this->path(*t, i)];
+            total.first += t->tree[i].time;
+            total.second += t->tree[i].calls;
+        }
+    }
+
+    os << "Profile zones (thread-seconds, calls):" << std::endl;
+    for (const auto &total : totals) {
+        int depth = std::count(total.first.begin(), total.first.end(), '/');
+        std::string name = total.first.substr(total.first.rfind('/') + 1);
+        for (int i = 0; i <= depth; i++) {
+            os << "    ";
+        }
+        os << name << ": " << total.second.first << " "
+           << total.second.second << std::endl;
+    }
+    for (int i = 0; i < (int)Counter::N_COUNTER; i++) {
+        uint64_t n = 0;
+        for (const auto &t : threads_) {
+            n += t->counters[i];
+        }
+        os << "    " << counter_names[i] << ": " << n << std::endl;
+    }
+    return;
+}
+
+void Profiler::output(H5Node &node) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    int n_thread = 0;
+    for (const auto &t : threads_) {
+        n_thread = std::max(n_thread, t->id + 1);
+    }
+
+    // Per-thread time and calls for each path
+    std::map<std::string, std::pair<VecF, VecF>> totals;
+    for (const auto &t : threads_) {
+        for (int i = 1; i < (int)t->tree.size(); i++) {
+            auto &total = totals[this->path(*t, i)];
+            if (total.first.empty()) {
+                total.first.resize(n_thread, 0.0);
+                total.second.resize(n_thread, 0.0);
+            }
+            total.first[t->id] += t->tree[i].time;
+            total.second[t->id] += t->tree[i].calls;
+        }
+    }
+
+    auto g = node.create_group("profile");
+    for (const auto &total : totals) {
+        auto zone = g.create_group(total.first);
+        zone.write("time", total.second.first);
+        zone.write("calls", total.second.second);
+    }
+
+    auto counters = g.create_group("counters");
+    for (int i = 0; i < (int)Counter::N_COUNTER; i++) {
+        uint64_t n = 0;
+        for (const auto &t : threads_) {
+            n += t->counters[i];
+        }
+        counters.write(counter_names[i], n);
+    }
+
+    return;
+}
+
+ScopedZone::ScopedZone(int zone)
+{
+    Profile.begin(zone);
+}
+
+ScopedZone::~ScopedZone()
+{
+    Profile.end();
+}
+} // namespace profile
+} // namespace mocc
@@ -0,0 +1,198 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace mocc {
+class H5Node;
+
+namespace profile {
+/**
+ * \brief Quantities that can be counted alongside the timed zones
+ */
+enum class Counter : int {
+    SEGMENTS,     // MoC ray segments swept
+    EXPONENTIALS, // MoC exponentials evaluated
+    PARTICLES,    // Monte Carlo particle histories tracked
+    N_COUNTER
+};
+
+/**
+ * \brief Low-overhead, per-thread instrumentation of code regions
+ *
+ * Where the \ref Timer tree gives a coarse breakdown of where the time goes,
+ * the \ref Profiler records nested "zones," which are opened and closed on
+ * each thread independently, and so may be used inside of parallel regions.
+ * Zones are usually marked with the \ref MOCC_PROFILE_ZONE macro, which opens
+ * a zone for the rest of the enclosing scope, and work is counted with \ref
+ * MOCC_PROFILE_COUNT. Both macros compile to nothing unless \c
+ * MOCC_PROFILE_ZONES is defined (the \c PROFILE_ZONES CMake option).
+ *
+ * Each thread keeps:
+ *  - A tree of total time and calls for each zone, keyed by its parent zone,
+ *  - A ring buffer of the most recent zone events, for timeline traces, and
+ *  - Totals for each \ref Counter.
+ *
+ * None of these are shared between threads, so recording an event never
+ * takes a lock. The hierarchy is per-thread; zones opened by the master
+ * thread outside of a parallel region do not appear as parents of the zones
+ * on the other threads. The data should only be exported outside of any
+ * parallel region.
+ *
+ * There is a global \ref Profile, which should be the only instance, since
+ * each thread finds its data through a \c thread_local pointer. If anything
+ * was recorded, its data is written to the HDF5 output and to a Chrome trace
+ * (<tt>\<case_name\>_trace.json</tt>, which may be loaded in \c
+ * chrome://tracing).
+ */
+class Profiler {
+public:
+    /**
+     * \brief Number of events kept by each thread for the timeline trace.
+     * Older events are dropped, but still contribute to the zone totals.
+     */
+    static const int RING_SIZE = 1 << 16;
+
+    Profiler();
+
+    /**
+     * \brief Register a zone name, returning its ID. This takes a lock, so
+     * it should be done once for each zone (the \ref MOCC_PROFILE_ZONE macro
+     * does this through a function-local static).
+     */
+    int register_zone(const char *name);
+
+    /**
+     * \brief Open a zone on the calling thread
+     */
+    void begin(int zone);
+
+    /**
+     * \brief Close the innermost open zone on the calling thread
+     */
+    void end();
+
+    /**
+     * \brief Add to a counter on the calling thread
+     */
+    void count(Counter counter, uint64_t n);
+
+    /**
+     * \brief Return whether any zones or counts have been recorded
+     */
+    bool empty() const;
+
+    /**
+     * \brief Return the total of a counter over all threads
+     */
+    uint64_t total(Counter counter) const;
+
+    /**
+     * \brief Write the retained events as a Chrome trace (JSON), along with
+     * the counter totals.
+     */
+    void write_trace(std::ostream &os) const;
+
+    /**
+     * \brief Print the zone tree, with times summed over threads
+     */
+    void print(std::ostream &os) const;
+
+    /**
+     * \brief Write the zone tree and counters to an HDF5 node. Each zone
+     * gets a group, nested like the zones, holding the time and number of
+     * calls on each thread.
+     */
+    void output(H5Node &node) const;
+
+private:
+    struct Node {
+        int zone;
+        int parent;
+        double time;
+        uint64_t calls;
+        std::vector<int> children;
+    };
+
+    struct Event {
+        int node;
+        double start;
+        double stop;
+    };
+
+    struct ThreadData {
+        int id;
+        // Zone tree. Node 0 is the root, which is never closed.
+        std::vector<Node> tree;
+        // Currently-open nodes, and the times that they were opened
+        std::vector<int> stack;
+        std::vector<double> start;
+        std::vector<Event> ring;
+        uint64_t n_events;
+        std::array<uint64_t, (int)Counter::N_COUNTER> counters;
+    };
+
+    mutable std::mutex mutex_;
+    std::vector<std::string> zones_;
+    std::deque<std::unique_ptr<ThreadData>> threads_;
+    double t0_;
+
+    ThreadData &thread_data();
+
+    // Return the path of a node in a thread's tree, with zone names
+    // separated by '/'
+    std::string path(const ThreadData &t, int node) const;
+};
+
+/**
+ * \brief Open a profiling zone for the lifetime of the object
+ */
+class ScopedZone {
+public:
+    ScopedZone(int zone);
+    ~ScopedZone();
+
+    ScopedZone(const ScopedZone &) = delete;
+    ScopedZone &operator=(const ScopedZone &) = delete;
+};
+
+extern Profiler Profile;
+} // namespace profile
+} // namespace mocc
+
+#ifdef MOCC_PROFILE_ZONES
+#define MOCC_PROFILE_CAT_(a, b) a##b
+#define MOCC_PROFILE_CAT(a, b) MOCC_PROFILE_CAT_(a, b)
+#define MOCC_PROFILE_ZONE(name)                                               \
+    static const int MOCC_PROFILE_CAT(mocc_zone_id_, __LINE__) =              \
+        mocc::profile::Profile.register_zone(name);                           \
+    mocc::profile::ScopedZone MOCC_PROFILE_CAT(mocc_zone_, __LINE__)(         \
+        MOCC_PROFILE_CAT(mocc_zone_id_, __LINE__))
+#define MOCC_PROFILE_COUNT(counter, n)                                        \
+    mocc::profile::Profile.count(mocc::profile::Counter::counter, (n))
+#else
+#define MOCC_PROFILE_ZONE(name)
+#define MOCC_PROFILE_COUNT(counter, n)
+#endif
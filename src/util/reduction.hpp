@@ -0,0 +1,140 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <vector>
+#include "global_config.hpp"
+
+namespace mocc {
+/**
+ * \brief Number of terms summed together by each block of \ref
+ * parallel_sum()
+ */
+constexpr int REDUCTION_BLOCK = 4096;
+
+/**
+ * \brief Return the sum of \p f(i) over i in [0, \p n)
+ *
+ * The range is split into blocks of \ref REDUCTION_BLOCK terms, which are
+ * summed in parallel and vectorized within each block. The block sums are
+ * then added up serially, in order. Since the blocking does not depend on the
+ * number of threads, neither does the result, so convergence histories stay
+ * reproducible from one run to the next.
+ *
+ * This should be called from outside of a parallel region.
+ */
+template <class Function> real_t parallel_sum(int n, Function f)
+{
+    const int n_block = (n + REDUCTION_BLOCK - 1) / REDUCTION_BLOCK;
+    std::vector<real_t> partial(n_block, 0.0);
+
+#pragma omp parallel for schedule(static) if (n_block > 1)
+    for (int ib = 0; ib < n_block; ib++) {
+        const int first = ib * REDUCTION_BLOCK;
+        const int last  = std::min(n, first + REDUCTION_BLOCK);
+        real_t s        = 0.0;
+#pragma omp simd reduction(+ : s)
+        for (int i = first; i < last; i++) {
+            s += f(i);
+        }
+        partial[ib] = s;
+    }
+
+    real_t sum = 0.0;
+    for (const auto p : partial) {
+        sum += p;
+    }
+    return sum;
+}
+
+/**
+ * \brief Return \p N sums over i in [0, \p n), from a single pass
+ *
+ * \p f(i, s) should add its \p N terms for index i to s[0] ... s[N-1]. The
+ * blocking is the same as that of \ref parallel_sum(), so the results are
+ * just as reproducible.
+ *
+ * This should be called from outside of a parallel region.
+ */
+template <int N, class Function>
+std::array<real_t, N> parallel_sums(int n, Function f)
+{
+    const int n_block = (n + REDUCTION_BLOCK - 1) / REDUCTION_BLOCK;
+    std::vector<std::array<real_t, N>> partial(n_block);
+
+#pragma omp parallel for schedule(static) if (n_block > 1)
+    for (int ib = 0; ib < n_block; ib++) {
+        const int first = ib * REDUCTION_BLOCK;
+        const int last  = std::min(n, first + REDUCTION_BLOCK);
+        std::array<real_t, N> s;
+        s.fill(0.0);
+        for (int i = first; i < last; i++) {
+            f(i, s.data());
+        }
+        partial[ib] = s;
+    }
+
+    std::array<real_t, N> sum;
+    sum.fill(0.0);
+    for (const auto &p : partial) {
+        for (int k = 0; k < N; k++) {
+            sum[k] += p[k];
+        }
+    }
+    return sum;
+}
+
+/**
+ * \brief Return the sum of the \p n values starting at \p a
+ */
+inline real_t parallel_sum(const real_t *a, int n)
+{
+    return parallel_sum(n, [a](int i) { return a[i]; });
+}
+
+/**
+ * \brief Return the squared L-2 norm of the \p n values starting at \p a
+ */
+inline real_t squared_norm(const real_t *a, int n)
+{
+    return parallel_sum(n, [a](int i) { return a[i] * a[i]; });
+}
+
+/**
+ * \brief Return the squared L-2 norm of the difference between the \p n
+ * values starting at \p a and those starting at \p b
+ */
+inline real_t squared_distance(const real_t *a, const real_t *b, int n)
+{
+    return parallel_sum(n, [a, b](int i) {
+        real_t e = a[i] - b[i];
+        return e * e;
+    });
+}
+
+/**
+ * \brief Return the dot product of the \p n values starting at \p a with
+ * those starting at \p b
+ */
+inline real_t dot(const real_t *a, const real_t *b, int n)
+{
+    return parallel_sum(n, [a, b](int i) { return a[i] * b[i]; });
+}
+}
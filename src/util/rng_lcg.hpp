@@ -20,8 +20,11 @@
 #include <cstdint>
 #include <iostream>
 #include <random>
+#include <utility>
+#include <vector>
 
 #include "util/force_inline.hpp"
+#include "util/omp_guard.h"
 #include "global_config.hpp"
 #include "fp_utils.hpp"
 
@@ -127,11 +130,27 @@ public:
      */
     void jump_ahead(uint64_t n)
     {
-        uint64_t nskip = n;
+        auto coeff    = jump_coefficients(n);
+        current_seed_ = (coeff.first * current_seed_ + coeff.second) & mask_;
+        return;
+    }
 
-        while (nskip < 0l) {
-            nskip += mod_;
-        }
+    /**
+     * \brief Return the current state of the generator
+     */
+    uint64_t state() const
+    {
+        return current_seed_;
+    }
+
+    /**
+     * \brief Return the coefficients \f$(g, c)\f$ which advance the state of
+     * the generator by \p n elements, as \f$ s' = g s + c \f$ (mod
+     * \f$2^{63}\f$).
+     */
+    static std::pair<uint64_t, uint64_t> jump_coefficients(uint64_t n)
+    {
+        uint64_t nskip = n;
 
         uint64_t g     = m_;
         uint64_t b     = b_;
@@ -150,8 +169,16 @@ public:
             nskip = nskip >> 1;
         }
 
-        current_seed_ = (g_new * current_seed_ + b_new) & mask_;
-        return;
+        return std::make_pair(g_new, b_new);
+    }
+
+    /**
+     * \brief Apply the coefficients from \ref jump_coefficients() to a state
+     */
+    static uint64_t advance(uint64_t state,
+                            const std::pair<uint64_t, uint64_t> &coeff)
+    {
+        return (coeff.first * state + coeff.second) & mask_;
     }
 
 private:
@@ -165,4 +192,80 @@ private:
     static constexpr real_t float_scale_ = 1.0 / (UINT64_C(1) << 63);
 };
 
+/**
+ * \brief Widely-spaced streams of an \ref RNG_LCG sequence
+ *
+ * Stream \c i starts \c i*stride elements into the sequence started from the
+ * seed, so \ref stream() gives the same generator as calling \c set_seed()
+ * and then \c jump_ahead(i*stride) on an \ref RNG_LCG. Rather than jumping
+ * from the seed every time, each thread remembers the last stream that it
+ * asked for. Asking for the next stream then costs a single multiply-add,
+ * and asking for a later stream only jumps the difference.
+ */
+class RNGStreams {
+public:
+    RNGStreams(uint64_t seed = UINT64_C(1), uint64_t stride = UINT64_C(10000))
+        : seed_(seed),
+          stride_(stride),
+          next_(RNG_LCG::jump_coefficients(stride)),
+          cache_(omp_get_max_threads())
+    {
+        return;
+    }
+
+    /**
+     * \brief Change the seed. This forgets all cached stream positions, so
+     * it should be called outside of any parallel region.
+     */
+    void set_seed(uint64_t seed)
+    {
+        seed_ = seed;
+        for (auto &c : cache_) {
+            c = Cache();
+        }
+        return;
+    }
+
+    /**
+     * \brief Return a generator positioned at the start of stream \p i
+     */
+    RNG_LCG stream(uint64_t i)
+    {
+        assert(omp_get_thread_num() < (int)cache_.size());
+        Cache &c = cache_[omp_get_thread_num()];
+
+        if (c.valid && (i >= c.stream)) {
+            uint64_t n = i - c.stream;
+            if (n == 1) {
+                c.state = RNG_LCG::advance(c.state, next_);
+            } else if (n > 1) {
+                c.state = RNG_LCG::advance(
+                    c.state, RNG_LCG::jump_coefficients(n * stride_));
+            }
+        } else {
+            RNG_LCG rng(seed_);
+            rng.jump_ahead(i * stride_);
+            c.state = rng.state();
+        }
+        c.stream = i;
+        c.valid  = true;
+
+        return RNG_LCG(c.state);
+    }
+
+private:
+    // Last stream handed out to each thread. Padded out to a cache line.
+    struct alignas(64) Cache {
+        uint64_t stream = 0;
+        uint64_t state  = 0;
+        bool valid      = false;
+    };
+
+    uint64_t seed_;
+    uint64_t stride_;
+    // Coefficients to advance by one stream
+    std::pair<uint64_t, uint64_t> next_;
+    std::vector<Cache> cache_;
+};
+
 } // namespace mocc
@@ -0,0 +1,93 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "UnitTest++/UnitTest++.h"
+
+#include "alias_table.hpp"
+#include "fp_utils.hpp"
+#include "rng_lcg.hpp"
+
+using namespace mocc;
+
+TEST(alias_sample)
+{
+    VecF pdf = {0.05, 0.075, 0.1, 0.125, 0.0, 0.225, 0.15, 0.075, 0.1, 0.1};
+
+    AliasTable table(pdf);
+    CHECK_EQUAL(10, table.size());
+
+    RNG_LCG rng;
+    VecF samples(pdf.size(), 0.0);
+
+    const int N = 1000000;
+    for (int i = 0; i < N; i++) {
+        samples[table.sample(rng)]++;
+    }
+
+    // Zero-probability entries should never come up
+    CHECK_EQUAL(0.0, samples[4]);
+    for (unsigned i = 0; i < pdf.size(); i++) {
+        CHECK_CLOSE(pdf[i], samples[i] / N, 0.002);
+    }
+}
+
+TEST(alias_unnormalized)
+{
+    // Only the relative sizes should matter
+    VecF pdf = {2.0, 0.0, 6.0};
+
+    AliasTable table(pdf);
+
+    RNG_LCG rng;
+    VecF samples(pdf.size(), 0.0);
+
+    const int N = 1000000;
+    for (int i = 0; i < N; i++) {
+        samples[table.sample(rng)]++;
+    }
+
+    CHECK_EQUAL(0.0, samples[1]);
+    CHECK_CLOSE(0.25, samples[0] / N, 0.002);
+    CHECK_CLOSE(0.75, samples[2] / N, 0.002);
+}
+
+TEST(alias_set)
+{
+    // Tables in a set should sample like the same tables on their own
+    std::vector<VecF> pdfs = {
+        {0.2, 0.0, 0.8}, {1.0, 1.0, 2.0}, {0.0, 0.0, 3.0}};
+
+    AliasTableSet set(3, pdfs.size());
+    for (const auto &pdf : pdfs) {
+        set.push_back(pdf);
+    }
+    CHECK_EQUAL(3, set.size());
+    CHECK_EQUAL(3, set.width());
+
+    for (int it = 0; it < (int)pdfs.size(); it++) {
+        AliasTable table(pdfs[it]);
+        RNG_LCG rng_set;
+        RNG_LCG rng_table;
+        for (int i = 0; i < 1000; i++) {
+            CHECK_EQUAL(table.sample(rng_table), set.sample(it, rng_set));
+        }
+    }
+}
+
+int main()
+{
+    return UnitTest::RunAllTests();
+}
@@ -0,0 +1,59 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "UnitTest++/UnitTest++.h"
+
+#include <cstdint>
+#include "aligned_allocator.hpp"
+
+using namespace mocc;
+
+TEST(aligned_vector)
+{
+    for (int n : {1, 3, 17, 1000}) {
+        AlignedVector<float> v(n, 1.0f);
+        CHECK_EQUAL(0, (int)((uintptr_t)v.data() % CACHE_LINE));
+        CHECK_EQUAL(1.0f, v[n - 1]);
+
+        AlignedVecF w;
+        for (int i = 0; i < n; i++) {
+            w.push_back(i);
+        }
+        CHECK_EQUAL(0, (int)((uintptr_t)w.data() % CACHE_LINE));
+        CHECK_EQUAL(n - 1, (int)w.back());
+    }
+}
+
+TEST(huge_pages)
+{
+    set_huge_pages(true);
+    CHECK(huge_pages());
+    {
+        AlignedVector<char> big(HUGE_PAGE + 1, 0);
+        CHECK_EQUAL(0, (int)((uintptr_t)big.data() % HUGE_PAGE));
+
+        // Small allocations are not padded out to a huge page
+        AlignedVector<char> small(100, 0);
+        CHECK_EQUAL(0, (int)((uintptr_t)small.data() % CACHE_LINE));
+    }
+    set_huge_pages(false);
+    CHECK(!huge_pages());
+}
+
+int main()
+{
+    return UnitTest::RunAllTests();
+}
@@ -0,0 +1,96 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "UnitTest++/UnitTest++.h"
+
+#include "omp_guard.h"
+#include <vector>
+#include "angle_pipeline.hpp"
+
+using namespace mocc;
+
+// The consumer should see everything that the producer wrote for an angle
+// before handing it over, and the start and end signals should come through
+TEST(producer_consumer)
+{
+    const int n_ang = 64;
+    const int n     = 1000;
+    AnglePipeline pipeline;
+
+    for (int pass = 0; pass < 3; pass++) {
+        pipeline.reset(n_ang);
+        CHECK_EQUAL(n_ang, pipeline.n_ang());
+
+        std::vector<int> setup(1, 0);
+        std::vector<int> data(n_ang * n, -1);
+        std::vector<int> seen(n_ang, 0);
+        int total = 0;
+
+#pragma omp parallel sections num_threads(2)
+        {
+#pragma omp section
+            {
+                setup[0] = pass + 1;
+                pipeline.begin();
+                for (int iang = 0; iang < n_ang; iang++) {
+                    for (int i = 0; i < n; i++) {
+                        data[iang * n + i] = iang + pass;
+                    }
+                    pipeline.angle_done(iang);
+                }
+                total = n_ang;
+                pipeline.finish();
+            }
+#pragma omp section
+            {
+                pipeline.wait_begin();
+                CHECK_EQUAL(pass + 1, setup[0]);
+                for (int iang = 0; iang < n_ang; iang++) {
+                    pipeline.wait_angle(iang);
+                    int good = 0;
+                    for (int i = 0; i < n; i++) {
+                        good += (data[iang * n + i] == iang + pass);
+                    }
+                    seen[iang] = good;
+                }
+                pipeline.wait_finish();
+                CHECK_EQUAL(n_ang, total);
+            }
+        }
+
+        for (int iang = 0; iang < n_ang; iang++) {
+            CHECK_EQUAL(n, seen[iang]);
+        }
+    }
+}
+
+// Finishing early releases all of the angles
+TEST(finish_early)
+{
+    AnglePipeline pipeline;
+    pipeline.reset(8);
+    pipeline.angle_done(0);
+    pipeline.finish();
+    pipeline.wait_begin();
+    pipeline.wait_angle(7);
+    pipeline.wait_finish();
+    CHECK(true);
+}
+
+int main()
+{
+    return UnitTest::RunAllTests();
+}
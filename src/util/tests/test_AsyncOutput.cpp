@@ -0,0 +1,79 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "UnitTest++/UnitTest++.h"
+
+#include <fstream>
+#include <iterator>
+#include "async_output.hpp"
+#include "blitz_typedefs.hpp"
+#include "h5file.hpp"
+
+using namespace mocc;
+
+TEST(async_raw)
+{
+    AsyncOutput queue;
+    for (int i = 0; i < 4; i++) {
+        std::string name = "async_" + std::to_string(i) + ".bin";
+        queue.submit(name, std::vector<char>(1000 * (i + 1), 'a' + i));
+    }
+    queue.flush();
+
+    for (int i = 0; i < 4; i++) {
+        std::string name = "async_" + std::to_string(i) + ".bin";
+        std::ifstream in(name, std::ios::binary);
+        std::vector<char> data((std::istreambuf_iterator<char>(in)),
+                               std::istreambuf_iterator<char>());
+        CHECK_EQUAL(1000 * (i + 1), (int)data.size());
+        CHECK_EQUAL('a' + i, data.back());
+    }
+}
+
+// An in-memory HDF5 file, written through the queue, should read back like
+// any other, compressed or not
+TEST(async_h5)
+{
+    ArrayB2 data(100, 700);
+    for (int i = 0; i < (int)data.size(); i++) {
+        data.data()[i] = 0.5 * i;
+    }
+
+    AsyncOutput queue;
+    for (int level : {0, 4}) {
+        std::string name = "async_" + std::to_string(level) + ".h5";
+        H5Node h5(name, H5Access::MEMORY);
+        h5.set_compression(level);
+        h5.write("data", data);
+        queue.submit(name, h5.image());
+    }
+    queue.flush();
+
+    for (int level : {0, 4}) {
+        std::string name = "async_" + std::to_string(level) + ".h5";
+        H5Node h5(name, H5Access::READ);
+        ArrayB2 read;
+        h5.read("data", read);
+        CHECK_EQUAL(100, read.extent(0));
+        CHECK_EQUAL(700, read.extent(1));
+        CHECK_EQUAL(data(99, 699), read(99, 699));
+    }
+}
+
+int main()
+{
+    return UnitTest::RunAllTests();
+}
@@ -0,0 +1,88 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include "UnitTest++/UnitTest++.h"
+
+#include <cstdio>
+#include <fstream>
+#include "autotuner.hpp"
+#include "error.hpp"
+
+using namespace mocc;
+
+// The candidates take turns, and the one with the cheapest sample wins
+TEST(autotuner_choice)
+{
+    Autotuner tuner({"a", "b", "c"}, 2, "", "key");
+    CHECK(tuner.tuning());
+
+    real_t costs[] = {3.0, 2.0, 4.0, 2.5, 1.5, 5.0};
+    const char *order[] = {"a", "b", "c", "a", "b", "c"};
+    for (int i = 0; i < 6; i++) {
+        CHECK(tuner.tuning());
+        CHECK_EQUAL(order[i], tuner.candidate());
+        tuner.record(costs[i]);
+    }
+    CHECK(!tuner.tuning());
+    CHECK(!tuner.cached());
+    CHECK_EQUAL("b", tuner.candidate());
+    CHECK_EQUAL(2.5, tuner.costs()[0].second);
+
+    // Later samples are ignored
+    tuner.record(0.0);
+    CHECK_EQUAL("b", tuner.candidate());
+
+    CHECK_THROW(Autotuner({}, 1, "", "key"), Exception);
+}
+
+// The choice is picked up from the cache by later tuners with the same key
+TEST(autotuner_cache)
+{
+    const char *cache = "test_autotune.txt";
+    std::remove(cache);
+
+    {
+        Autotuner tuner({"x", "y"}, 1, cache, "machine 1");
+        tuner.record(2.0);
+        tuner.record(1.0);
+        CHECK_EQUAL("y", tuner.candidate());
+    }
+
+    {
+        Autotuner tuner({"x", "y"}, 1, cache, "machine 1");
+        CHECK(!tuner.tuning());
+        CHECK(tuner.cached());
+        CHECK_EQUAL("y", tuner.candidate());
+    }
+
+    // Other keys, and choices that aren't candidates, are ignored
+    {
+        Autotuner tuner({"x", "y"}, 1, cache, "machine 2");
+        CHECK(tuner.tuning());
+    }
+    {
+        Autotuner tuner({"x", "z"}, 1, cache, "machine 1");
+        CHECK(tuner.tuning());
+    }
+
+    std::remove(cache);
+}
+
+int main()
+{
+    return UnitTest::RunAllTests();
+}
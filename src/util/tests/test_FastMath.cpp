@@ -0,0 +1,88 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "UnitTest++/UnitTest++.h"
+
+#include <cfloat>
+#include <cmath>
+#include "fast_math.hpp"
+#include "rng_lcg.hpp"
+
+using namespace mocc;
+
+const double twopi = 6.28318530717958647693;
+
+// The polynomial log should agree with the library's to a couple of ulp,
+// over the random numbers and far into the small values
+TEST(fast_log)
+{
+    RNG_LCG rng;
+    for (int i = 0; i < 100000; i++) {
+        double x   = std::ldexp(rng.random(), -(i % 1000));
+        double ref = std::log(x);
+        CHECK_CLOSE(ref, fast_log(x), 4.0e-16 * std::abs(ref));
+    }
+    CHECK_EQUAL(0.0, fast_log(1.0));
+    CHECK_CLOSE(std::log(DBL_MIN), fast_log(0.0), 1.0e-12);
+
+    VecF x(1000);
+    VecF ref(1000);
+    for (int i = 0; i < (int)x.size(); i++) {
+        x[i]   = rng.random();
+        ref[i] = fast_log(x[i]);
+    }
+    fast_log(x.size(), x.data());
+    CHECK_ARRAY_EQUAL(ref, x, x.size());
+}
+
+TEST(fast_sincos_2pi)
+{
+    RNG_LCG rng;
+    for (int i = 0; i < 100000; i++) {
+        double u = rng.random() * 3.0 - 1.0;
+        double s, c;
+        fast_sincos_2pi(u, s, c);
+        CHECK_CLOSE(std::sin(twopi * u), s, 2.0e-15);
+        CHECK_CLOSE(std::cos(twopi * u), c, 2.0e-15);
+    }
+
+    // Quarter turns are exact
+    double s, c;
+    fast_sincos_2pi(0.75, s, c);
+    CHECK_EQUAL(-1.0, s);
+    CHECK_EQUAL(0.0, c);
+
+    VecF u(1000);
+    VecF s_ref(1000);
+    VecF c_ref(1000);
+    for (int i = 0; i < (int)u.size(); i++) {
+        u[i] = rng.random();
+        double si, ci;
+        fast_sincos_2pi(u[i], si, ci);
+        s_ref[i] = si;
+        c_ref[i] = ci;
+    }
+    VecF s_batch(1000);
+    VecF c_batch(1000);
+    fast_sincos_2pi(u.size(), u.data(), s_batch.data(), c_batch.data());
+    CHECK_ARRAY_EQUAL(s_ref, s_batch, u.size());
+    CHECK_ARRAY_EQUAL(c_ref, c_batch, u.size());
+}
+
+int main()
+{
+    return UnitTest::RunAllTests();
+}
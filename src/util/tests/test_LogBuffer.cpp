@@ -0,0 +1,105 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "UnitTest++/UnitTest++.h"
+
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <thread>
+#include "log_buffer.hpp"
+
+using namespace mocc;
+
+// Syncing the stream shouldn't write anything; only flush() and close() do
+TEST(log_buffer_sync)
+{
+    std::stringbuf target;
+    LogBuffer buffer;
+    buffer.open(&target, std::chrono::hours(1));
+    std::ostream os(&buffer);
+
+    os << "something about foxes " << 42 << std::endl;
+    CHECK_EQUAL("", target.str());
+
+    buffer.flush();
+    CHECK_EQUAL("something about foxes 42\n", target.str());
+
+    os << "a lazy dog" << std::endl;
+    CHECK(buffer.close() == &target);
+    CHECK_EQUAL("something about foxes 42\na lazy dog\n", target.str());
+
+    // Output to a closed buffer goes nowhere
+    os << "such jump" << std::endl;
+    buffer.flush();
+    CHECK_EQUAL("something about foxes 42\na lazy dog\n", target.str());
+}
+
+// The background thread should pick up a large amount of output, and
+// anything left after the interval, without being asked
+TEST(log_buffer_background)
+{
+    std::stringbuf target;
+    LogBuffer buffer;
+    std::ostream os(&buffer);
+
+    buffer.open(&target, std::chrono::hours(1));
+    std::string big(LogBuffer::threshold + 1, 'x');
+    os << big;
+    for (int i = 0; i < 1000 && target.str().empty(); i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    CHECK_EQUAL(big, target.str());
+    buffer.close();
+
+    target.str("");
+    buffer.open(&target, std::chrono::milliseconds(10));
+    os << "small" << std::endl;
+    for (int i = 0; i < 1000 && target.str().empty(); i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    CHECK_EQUAL("small\n", target.str());
+}
+
+TEST(log_stream)
+{
+    {
+        LogStream log;
+        log.open("log_stream.log");
+        CHECK(log.is_open());
+        for (int i = 0; i < 100; i++) {
+            log << "line " << i << std::endl;
+        }
+        log.close();
+        CHECK(!log.is_open());
+    }
+
+    std::ifstream in("log_stream.log");
+    std::string text((std::istreambuf_iterator<char>(in)),
+                     std::istreambuf_iterator<char>());
+    std::stringstream truth;
+    for (int i = 0; i < 100; i++) {
+        truth << "line " << i << "\n";
+    }
+    CHECK_EQUAL(truth.str(), text);
+}
+
+int main()
+{
+    return UnitTest::RunAllTests();
+}
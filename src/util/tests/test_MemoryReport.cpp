@@ -0,0 +1,58 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "UnitTest++/UnitTest++.h"
+
+#include <sstream>
+#include <string>
+#include <vector>
+#include "memory.hpp"
+
+using namespace mocc;
+
+TEST(memory_report)
+{
+    MemoryReport report("Memory");
+    std::vector<double> v(100);
+
+    report.add("vector", bytes(v));
+    report.child("sweeper").add("flux", 2048);
+    report.child("sweeper").add("flux", 1024);
+    report.child("sweeper").add("rays", 512);
+
+    CHECK_EQUAL(800, (int)bytes(v));
+    CHECK_EQUAL(3584, (int)report.child("sweeper").total());
+    CHECK_EQUAL(3072, (int)report.child("sweeper").child("flux").total());
+    CHECK_EQUAL(4384, (int)report.total());
+
+    std::stringstream s;
+    report.print(s);
+    CHECK(s.str().find("Memory: 4.28 KiB") != std::string::npos);
+    CHECK(s.str().find("        flux: 3.00 KiB") != std::string::npos);
+    CHECK(s.str().find("    vector: 800 B") != std::string::npos);
+}
+
+TEST(format_bytes)
+{
+    CHECK_EQUAL("0 B", format_bytes(0));
+    CHECK_EQUAL("1.50 MiB", format_bytes(3 << 19));
+    CHECK_EQUAL("2.00 GiB", format_bytes(size_t(2) << 30));
+}
+
+int main()
+{
+    return UnitTest::RunAllTests();
+}
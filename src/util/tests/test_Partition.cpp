@@ -0,0 +1,59 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "UnitTest++/UnitTest++.h"
+
+#include "omp_guard.h"
+#include <vector>
+#include "partition.hpp"
+
+using namespace mocc;
+
+// The buckets should match those of a serial loop, for any number of threads
+TEST(buckets)
+{
+    int n        = 10007;
+    int n_bucket = 13;
+    VecI key(n);
+    for (int i = 0; i < n; i++) {
+        key[i] = (i * 7 + i / 5) % n_bucket;
+    }
+
+    std::vector<VecI> serial(n_bucket);
+    for (int i = 0; i < n; i++) {
+        serial[key[i]].push_back(i);
+    }
+
+    int n_thread = omp_get_max_threads();
+    for (int nt : {1, 3, 4}) {
+        omp_set_num_threads(nt);
+        auto buckets = parallel_buckets(key, n_bucket);
+        CHECK(buckets == serial);
+    }
+    omp_set_num_threads(n_thread);
+
+    // Empty buckets, and no keys at all
+    auto buckets = parallel_buckets(VecI(3, 1), 3);
+    CHECK(buckets[0].empty());
+    CHECK_EQUAL(3, (int)buckets[1].size());
+    CHECK(buckets[2].empty());
+    CHECK_EQUAL(2, (int)parallel_buckets(VecI(), 2).size());
+}
+
+int main()
+{
+    return UnitTest::RunAllTests();
+}
@@ -0,0 +1,63 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include "UnitTest++/UnitTest++.h"
+
+#include "omp_guard.h"
+#include "perf_counters.hpp"
+#include "timers.hpp"
+
+using namespace mocc;
+
+// The counters aren't available on every machine (or in every container),
+// so only check that they count something if they could be opened
+TEST(perf_counters)
+{
+    Timer timer("counted");
+    timer.enable_counters();
+
+    bool enabled = perf::enable();
+    CHECK_EQUAL(enabled, perf::enabled());
+    CHECK_EQUAL(enabled, timer.has_counts());
+
+    timer.tic();
+    double sum = 0.0;
+#pragma omp parallel for reduction(+ : sum)
+    for (int i = 0; i < 1000000; i++) {
+        sum += 1.0 / (i + 1);
+    }
+    timer.toc();
+    CHECK(sum > 0.0);
+
+    if (enabled) {
+        CHECK(timer.counts()[(int)PerfEvent::INSTRUCTIONS] > 1000000);
+        CHECK(timer.counts()[(int)PerfEvent::CYCLES] > 0);
+    } else {
+        for (auto c : perf::read()) {
+            CHECK_EQUAL(0u, c);
+        }
+    }
+
+    // Timers that weren't asked to count don't
+    Timer plain("plain");
+    CHECK(!plain.has_counts());
+}
+
+int main()
+{
+    return UnitTest::RunAllTests();
+}
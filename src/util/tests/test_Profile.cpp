@@ -0,0 +1,68 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "UnitTest++/UnitTest++.h"
+
+#include <sstream>
+#include <string>
+#include "omp_guard.h"
+#include "profile.hpp"
+
+using namespace mocc;
+using namespace mocc::profile;
+
+// Zones opened on every thread should nest per thread, and show up in the
+// trace and the counter totals
+TEST(profile_zones)
+{
+    int outer = Profile.register_zone("outer");
+    int inner = Profile.register_zone("inner");
+
+    int n_thread = 0;
+#pragma omp parallel
+    {
+#pragma omp single
+        n_thread = omp_get_num_threads();
+
+        Profile.begin(outer);
+        for (int i = 0; i < 3; i++) {
+            ScopedZone zone(inner);
+            Profile.count(Counter::SEGMENTS, 10);
+        }
+        Profile.end();
+    }
+
+    CHECK(!Profile.empty());
+    CHECK_EQUAL(30 * n_thread, (int)Profile.total(Counter::SEGMENTS));
+    CHECK_EQUAL(0, (int)Profile.total(Counter::PARTICLES));
+
+    std::stringstream summary;
+    Profile.print(summary);
+    CHECK(summary.str().find("    outer: ") != std::string::npos);
+    CHECK(summary.str().find("        inner: ") != std::string::npos);
+
+    std::stringstream trace;
+    Profile.write_trace(trace);
+    CHECK(trace.str().find("\"name\":\"inner\",\"ph\":\"X\"") !=
+          std::string::npos);
+    CHECK(trace.str().find("\"segments\":" + std::to_string(30 * n_thread)) !=
+          std::string::npos);
+}
+
+int main()
+{
+    return UnitTest::RunAllTests();
+}
@@ -159,6 +159,21 @@ TEST(sample_cdf)
     }
 }
 
+TEST(streams)
+{
+    mocc::RNGStreams streams(11, 10000);
+
+    // Walk forward one at a time, skip ahead, and go back to the beginning.
+    // All should match jumping from the seed.
+    std::vector<uint64_t> ids = {0, 1, 2, 3, 10, 11, 500, 4, 5, 123456};
+    for (auto id : ids) {
+        mocc::RNG_LCG ref(11);
+        ref.jump_ahead(id * 10000);
+        mocc::RNG_LCG rng = streams.stream(id);
+        CHECK_EQUAL(ref.random(), rng.random());
+    }
+}
+
 int main()
 {
     return UnitTest::RunAllTests();
@@ -0,0 +1,95 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "UnitTest++/UnitTest++.h"
+
+#include "omp_guard.h"
+#include <vector>
+#include "reduction.hpp"
+
+using namespace mocc;
+
+TEST(kernels)
+{
+    // Span several blocks, with a partial one at the end
+    int n = 3 * REDUCTION_BLOCK + 17;
+    std::vector<real_t> a(n);
+    std::vector<real_t> b(n);
+    for (int i = 0; i < n; i++) {
+        a[i] = 0.5 * i;
+        b[i] = 0.5 * i + 1.0;
+    }
+
+    real_t nn = n;
+    CHECK_CLOSE(0.25 * nn * (nn - 1.0), parallel_sum(a.data(), n), 1.0e-6);
+    CHECK_CLOSE(nn, squared_distance(a.data(), b.data(), n), 1.0e-10);
+    CHECK_CLOSE(0.25 * (nn - 1.0) * nn * (2.0 * nn - 1.0) / 6.0,
+                squared_norm(a.data(), n), 1.0e-6 * nn * nn * nn);
+    CHECK_CLOSE(squared_norm(a.data(), n) + parallel_sum(a.data(), n),
+                dot(a.data(), b.data(), n), 1.0e-6 * nn * nn * nn);
+
+    // Nothing to sum
+    CHECK_EQUAL(0.0, parallel_sum(a.data(), 0));
+}
+
+TEST(deterministic)
+{
+    int n = 10 * REDUCTION_BLOCK + 3;
+    std::vector<real_t> a(n);
+    for (int i = 0; i < n; i++) {
+        a[i] = 1.0 / (1.0 + i);
+    }
+
+    // Results should be bit-for-bit identical regardless of thread count
+    int n_thread = omp_get_max_threads();
+    omp_set_num_threads(1);
+    real_t serial = squared_norm(a.data(), n);
+    omp_set_num_threads(4);
+    real_t parallel = squared_norm(a.data(), n);
+    omp_set_num_threads(n_thread);
+
+    CHECK_EQUAL(serial, parallel);
+}
+
+// Several sums from one pass should match the single sums
+TEST(multiple_sums)
+{
+    int n = 3 * REDUCTION_BLOCK + 17;
+    std::vector<real_t> a(n);
+    std::vector<real_t> b(n);
+    for (int i = 0; i < n; i++) {
+        a[i] = 1.0 / (1.0 + i);
+        b[i] = (i % 3 == 0) ? 0.0 : 0.5 * i;
+    }
+
+    auto sums = parallel_sums<3>(n, [&](int i, real_t *s) {
+        s[0] += a[i];
+        s[1] += b[i];
+        s[2] += (b[i] > 0.0) ? 1.0 : 0.0;
+    });
+    CHECK_EQUAL(parallel_sum(a.data(), n), sums[0]);
+    CHECK_EQUAL(parallel_sum(b.data(), n), sums[1]);
+    CHECK_EQUAL(n - (n + 2) / 3, sums[2]);
+
+    auto none = parallel_sums<2>(0, [&](int i, real_t *s) { s[0] += 1.0; });
+    CHECK_EQUAL(0.0, none[0]);
+    CHECK_EQUAL(0.0, none[1]);
+}
+
+int main()
+{
+    return UnitTest::RunAllTests();
+}
@@ -0,0 +1,68 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "UnitTest++/UnitTest++.h"
+
+#include <sstream>
+#include <string>
+#include <vector>
+#include "omp_guard.h"
+#include "workload.hpp"
+
+using namespace mocc;
+
+// Thread 0 does twice the work of the others, and all threads spend twice
+// their busy time in the region
+TEST(workload_stats)
+{
+    WorkloadStats stats;
+    CHECK(!stats.enabled());
+    stats.enable({2, 3});
+    CHECK(stats.enabled());
+
+    int n_thread = 0;
+#pragma omp parallel
+    {
+#pragma omp single
+        n_thread = omp_get_num_threads();
+
+        int it      = omp_get_thread_num();
+        double time = (it == 0) ? 2.0 : 1.0;
+        stats.record(4, 10, 1, time);
+        stats.record_region(2.0 * time);
+    }
+
+    real_t mean = (n_thread + 1.0) / n_thread;
+    CHECK_CLOSE(2.0 / mean, stats.imbalance(), 1.0e-12);
+    CHECK_CLOSE(0.5, stats.idle_fraction(), 1.0e-12);
+
+    std::stringstream s;
+    stats.print(s);
+    CHECK(s.str().find("idle fraction: 0.5") != std::string::npos);
+}
+
+TEST(log2_histogram)
+{
+    std::vector<uint64_t> hist = log2_histogram({0, 1, 2, 3, 4, 7, 8, 100});
+    std::vector<uint64_t> ref  = {2, 2, 2, 1, 0, 0, 1};
+    CHECK(hist == ref);
+    CHECK(log2_histogram({}).empty());
+}
+
+int main()
+{
+    return UnitTest::RunAllTests();
+}
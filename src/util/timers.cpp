@@ -16,14 +16,21 @@
 
 #include "timers.hpp"
 
+#include <iomanip>
 #include <iostream>
+#include "util/h5file.hpp"
 #include "util/omp_guard.h"
 
 namespace mocc {
 Timer RootTimer("MOCC");
 
-Timer::Timer(std::string name) : name_(name), time_(0.0), running_(false)
+// Bytes moved by each last-level cache miss
+const real_t LINE_SIZE = 64.0;
+
+Timer::Timer(std::string name)
+    : name_(name), time_(0.0), running_(false), counting_(false)
 {
+    counts_.fill(0);
     return;
 }
 
@@ -40,6 +47,9 @@ void Timer::tic()
     assert(!running_);
     running_ = true;
     wtime_   = omp_get_wtime();
+    if (this->has_counts()) {
+        counts_tic_ = perf::read();
+    }
 }
 
 real_t Timer::toc()
@@ -48,6 +58,12 @@ real_t Timer::toc()
     running_ = false;
 
     time_ += omp_get_wtime() - wtime_;
+    if (this->has_counts()) {
+        PerfCounts counts = perf::read();
+        for (unsigned i = 0; i < counts.size(); i++) {
+            counts_[i] += counts[i] - counts_tic_[i];
+        }
+    }
     return time_;
 }
 
@@ -68,12 +84,56 @@ void Timer::print(std::ostream &os, int level) const
         os << "    ";
     }
     os << (*this) << std::endl;
+    if (this->has_counts()) {
+        real_t cycles       = counts_[(int)PerfEvent::CYCLES];
+        real_t instructions = counts_[(int)PerfEvent::INSTRUCTIONS];
+        real_t misses       = counts_[(int)PerfEvent::LLC_MISSES];
+        for (int i = 0; i <= level; i++) {
+            os << "    ";
+        }
+        os << "[" << std::setprecision(3)
+           << (cycles > 0.0 ? instructions / cycles : 0.0) << " IPC, "
+           << misses << " LLC misses, "
+           << (time_ > 0.0 ? misses * LINE_SIZE / time_ * 1.0e-9 : 0.0)
+           << " GB/s]" << std::setprecision(6) << std::endl;
+    }
     for (const auto &t : children_) {
         t.second.print(os, level + 1);
     }
     return;
 }
 
+void Timer::output_counters(H5Node &node) const
+{
+    if (!this->has_counts()) {
+        return;
+    }
+
+    for (int i = 0; i < (int)PerfEvent::N_EVENT; i++) {
+        node.write(perf::name((PerfEvent)i), (uint64_t)counts_[i]);
+    }
+    real_t cycles = counts_[(int)PerfEvent::CYCLES];
+    real_t misses = counts_[(int)PerfEvent::LLC_MISSES];
+    node.write("ipc",
+               cycles > 0.0
+                   ? counts_[(int)PerfEvent::INSTRUCTIONS] / cycles
+                   : 0.0);
+    node.write("llc_miss_bandwidth",
+               time_ > 0.0 ? misses * LINE_SIZE / time_ : 0.0);
+    return;
+}
+
+void Timer::output(H5Node &node) const
+{
+    node.write("time", this->time());
+    this->output_counters(node);
+    for (const auto &t : children_) {
+        auto g = node.create_group(t.first);
+        t.second.output(g);
+    }
+    return;
+}
+
 std::ostream &operator<<(std::ostream &os, const Timer &timer)
 {
     assert(!timer.running_);
@@ -18,10 +18,14 @@
 
 #include <cassert>
 #include <map>
+#include <string>
 
 #include "global_config.hpp"
+#include "perf_counters.hpp"
 
 namespace mocc {
+class H5Node;
+
 /**
  * The \ref Timer class provides functionality for measuring the amount of
  * runtime spent on various tasks. Each \ref Timer can have a number of
@@ -36,6 +40,10 @@ namespace mocc {
  *
  * There is a global \ref RootTimer, which is treated as the parent \ref
  * Timer for the entire executable.
+ *
+ * Timers around the hot spots of the calculation may also count hardware
+ * events (see \ref enable_counters()), so that it can be seen whether the
+ * time goes to computation or to waiting on memory.
  */
 class Timer {
 public:
@@ -85,6 +93,67 @@ public:
      */
     real_t time() const;
 
+    /**
+     * \brief Stop the \ref Timer, zero its time and discard its children
+     *
+     * This invalidates any references to the children.
+     */
+    void reset()
+    {
+        running_ = false;
+        time_    = 0.0;
+        counts_.fill(0);
+        children_.clear();
+    }
+
+    /**
+     * \brief Count the hardware events between each \ref tic() and \ref
+     * toc() of this timer
+     *
+     * The counts are only collected once the counters have been turned on
+     * with \ref perf::enable(). They cover the work of all of the threads,
+     * so they should only be used for timers that are started and stopped
+     * outside of parallel regions.
+     */
+    void enable_counters()
+    {
+        counting_ = true;
+    }
+
+    /**
+     * \brief Return whether the timer has hardware event counts
+     */
+    bool has_counts() const
+    {
+        return counting_ && perf::enabled();
+    }
+
+    /**
+     * \brief Return the hardware event counts accumulated so far
+     */
+    const PerfCounts &counts() const
+    {
+        return counts_;
+    }
+
+    /**
+     * \brief Write the hardware event counts of the timer to an HDF5 node,
+     * if it has any
+     *
+     * Besides the raw counts, this writes the instructions per cycle and
+     * the memory bandwidth estimated from the last-level cache misses.
+     */
+    void output_counters(H5Node &node) const;
+
+    /**
+     * \brief Write the entire \ref Timer tree to an HDF5 node
+     *
+     * Each timer writes its time (and hardware event counts, if it has
+     * any), and a group for each of its children, named after the child.
+     * Timers that are still running report the time up to now.
+     */
+    void output(H5Node &node) const;
+
     /**
      * \brief Return a reference the child Timer of the passed name
      */
@@ -109,6 +178,9 @@ public:
 
     /**
      * \brief Create a new child \ref Timer and return a reference to it.
+     *
+     * If a child of the same name already exists, it is returned instead,
+     * so that several objects of the same kind share a timer.
      */
     Timer &new_timer(const std::string &name)
     {
@@ -119,11 +191,17 @@ public:
     /**
      * \brief Create and return a new child \ref Timer, possibly starting it
      * automatically
+     *
+     * As with \ref new_timer(const std::string&), an existing child of the
+     * same name is returned instead; it is started if it isn't running.
      */
     Timer &new_timer(const std::string &name, bool start)
     {
-        children_.emplace(name, Timer(name, start));
-        return children_.at(name);
+        Timer &timer = children_.emplace(name, Timer(name)).first->second;
+        if (start && !timer.running_) {
+            timer.tic();
+        }
+        return timer;
     }
 
     friend std::ostream &operator<<(std::ostream &os, const Timer &timer);
@@ -133,6 +211,9 @@ private:
     real_t time_;
     bool running_;
     real_t wtime_;
+    bool counting_;
+    PerfCounts counts_;
+    PerfCounts counts_tic_;
     std::map<std::string, Timer> children_;
 };
 
@@ -0,0 +1,165 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "workload.hpp"
+#include <algorithm>
+#include <functional>
+#include <iomanip>
+#include <numeric>
+#include <ostream>
+#include "util/h5file.hpp"
+#include "util/omp_guard.h"
+
+namespace mocc {
+void WorkloadStats::enable(const VecI &dims)
+{
+    dims_   = dims;
+    n_unit_ = std::accumulate(dims.begin(), dims.end(), 1,
+                              std::multiplies<int>());
+
+    Tally tally;
+    tally.items.assign(n_unit_, 0);
+    tally.tasks.assign(n_unit_, 0);
+    tally.time.assign(n_unit_, 0.0);
+    tally.region = 0.0;
+    threads_.assign(omp_get_max_threads(), tally);
+    return;
+}
+
+void WorkloadStats::record(int unit, uint64_t items, uint64_t tasks,
+                           double time)
+{
+    Tally &t = threads_[omp_get_thread_num()];
+    t.items[unit] += items;
+    t.tasks[unit] += tasks;
+    t.time[unit] += time;
+    return;
+}
+
+void WorkloadStats::record_region(double time)
+{
+    threads_[omp_get_thread_num()].region += time;
+    return;
+}
+
+VecF WorkloadStats::busy_time() const
+{
+    VecF busy;
+    for (const auto &t : threads_) {
+        busy.push_back(std::accumulate(t.time.begin(), t.time.end(), 0.0));
+    }
+    return busy;
+}
+
+real_t WorkloadStats::imbalance() const
+{
+    VecF busy = this->busy_time();
+    if (busy.empty()) {
+        return 0.0;
+    }
+    real_t mean = std::accumulate(busy.begin(), busy.end(), 0.0) / busy.size();
+    return mean > 0.0 ? *std::max_element(busy.begin(), busy.end()) / mean
+                      : 0.0;
+}
+
+real_t WorkloadStats::idle_fraction() const
+{
+    VecF busy       = this->busy_time();
+    real_t busy_sum = std::accumulate(busy.begin(), busy.end(), 0.0);
+    real_t region   = 0.0;
+    for (const auto &t : threads_) {
+        region += t.region;
+    }
+    return region > 0.0 ? std::max(0.0, 1.0 - busy_sum / region) : 0.0;
+}
+
+void WorkloadStats::output(H5Node &node) const
+{
+    if (!this->enabled()) {
+        return;
+    }
+
+    int n_thread = threads_.size();
+    VecF thread_items(n_thread, 0.0);
+    VecF thread_tasks(n_thread, 0.0);
+    VecF thread_region(n_thread, 0.0);
+    VecF thread_idle(n_thread, 0.0);
+    VecF busy = this->busy_time();
+    for (int it = 0; it < n_thread; it++) {
+        const Tally &t = threads_[it];
+        for (int iu = 0; iu < n_unit_; iu++) {
+            thread_items[it] += t.items[iu];
+            thread_tasks[it] += t.tasks[iu];
+        }
+        thread_region[it] = t.region;
+        thread_idle[it]   = std::max(0.0, t.region - busy[it]);
+    }
+    node.write("thread_items", thread_items);
+    node.write("thread_tasks", thread_tasks);
+    node.write("thread_busy_time", busy);
+    node.write("thread_region_time", thread_region);
+    node.write("thread_idle_time", thread_idle);
+
+    VecF unit_items(n_unit_, 0.0);
+    VecF unit_tasks(n_unit_, 0.0);
+    VecF unit_time(n_unit_, 0.0);
+    VecF unit_imbalance(n_unit_, 0.0);
+    for (int iu = 0; iu < n_unit_; iu++) {
+        real_t max_time = 0.0;
+        for (const auto &t : threads_) {
+            unit_items[iu] += t.items[iu];
+            unit_tasks[iu] += t.tasks[iu];
+            unit_time[iu] += t.time[iu];
+            max_time = std::max(max_time, (real_t)t.time[iu]);
+        }
+        real_t mean        = unit_time[iu] / n_thread;
+        unit_imbalance[iu] = mean > 0.0 ? max_time / mean : 0.0;
+    }
+    node.write("unit_items", unit_items, dims_);
+    node.write("unit_tasks", unit_tasks, dims_);
+    node.write("unit_time", unit_time, dims_);
+    node.write("unit_imbalance", unit_imbalance, dims_);
+
+    node.write("imbalance", (double)this->imbalance());
+    node.write("idle_fraction", (double)this->idle_fraction());
+    return;
+}
+
+void WorkloadStats::print(std::ostream &os) const
+{
+    os << "Sweep load imbalance (max/mean thread busy time): "
+       << std::setprecision(4) << this->imbalance()
+       << ", idle fraction: " << this->idle_fraction() << std::endl;
+    return;
+}
+
+std::vector<uint64_t> log2_histogram(const std::vector<int> &values)
+{
+    std::vector<uint64_t> hist;
+    for (int v : values) {
+        unsigned bin = 0;
+        while ((v >> 1) > 0) {
+            v >>= 1;
+            bin++;
+        }
+        if (bin >= hist.size()) {
+            hist.resize(bin + 1, 0);
+        }
+        hist[bin]++;
+    }
+    return hist;
+}
+}
@@ -0,0 +1,128 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+#include "util/global_config.hpp"
+
+namespace mocc {
+class H5Node;
+
+/**
+ * \brief Per-thread tallies of the work done by a parallel sweep, for
+ * diagnosing load imbalance
+ *
+ * A sweep is broken into units of work (e.g. the rays of one angle in one
+ * plane), each of which may be shared by several threads. Each thread records
+ * the work it did on each unit as a number of items (e.g. ray segments or
+ * cells), a number of tasks (e.g. rays), and the time it took. It also
+ * records the wall time it spent in each parallel sweep region, so that the
+ * time spent waiting at barriers and in critical sections, or doing work
+ * that isn't counted against a unit, shows up as the difference.
+ *
+ * Threads only write to their own tallies, so recording never takes a lock.
+ * Nothing is recorded until \ref enable() is called.
+ */
+class WorkloadStats {
+public:
+    WorkloadStats() : n_unit_(0)
+    {
+        return;
+    }
+
+    /**
+     * \brief Start recording, for units laid out with the given dimensions,
+     * and as many threads as OpenMP may use
+     */
+    void enable(const VecI &dims);
+
+    bool enabled() const
+    {
+        return n_unit_ > 0;
+    }
+
+    /**
+     * \brief Return the dimensions of the units, as passed to \ref enable()
+     */
+    const VecI &dims() const
+    {
+        return dims_;
+    }
+
+    /**
+     * \brief Record work done on a unit by the calling thread
+     */
+    void record(int unit, uint64_t items, uint64_t tasks, double time);
+
+    /**
+     * \brief Record the wall time that the calling thread spent in a
+     * parallel sweep region
+     */
+    void record_region(double time);
+
+    /**
+     * \brief Return the largest time spent working on units by a thread,
+     * over the mean of all threads
+     */
+    real_t imbalance() const;
+
+    /**
+     * \brief Return the fraction of the time in the sweep regions, summed
+     * over threads, that was not spent working on units
+     */
+    real_t idle_fraction() const;
+
+    /**
+     * \brief Write the tallies of each thread and unit to an HDF5 node
+     *
+     * The per-unit data are shaped by the dimensions passed to \ref
+     * enable(), and hold the sum over threads, along with the imbalance
+     * (largest over mean thread time) of each unit.
+     */
+    void output(H5Node &node) const;
+
+    /**
+     * \brief Print a one-line summary of the imbalance and idle time
+     */
+    void print(std::ostream &os) const;
+
+private:
+    struct Tally {
+        std::vector<uint64_t> items;
+        std::vector<uint64_t> tasks;
+        std::vector<double> time;
+        double region;
+    };
+
+    // Return the total time spent working on units by each thread
+    VecF busy_time() const;
+
+    VecI dims_;
+    int n_unit_;
+    std::vector<Tally> threads_;
+};
+
+/**
+ * \brief Count values in power-of-two bins
+ *
+ * Bin i holds the values in [2^i, 2^(i+1)), with zero in the first bin.
+ * There are only as many bins as needed for the largest value.
+ */
+std::vector<uint64_t> log2_histogram(const std::vector<int> &values);
+}
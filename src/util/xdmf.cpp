@@ -0,0 +1,83 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "xdmf.hpp"
+#include <cassert>
+#include <fstream>
+#include <sstream>
+#include "util/error.hpp"
+#include "util/h5file.hpp"
+
+namespace mocc {
+void write_xdmf(const std::string &stem, const std::vector<XDMFGrid> &grids)
+{
+    std::string h5_file = stem + ".h5";
+    // The XDMF file refers to the HDF5 file relative to itself
+    std::string h5_ref = h5_file.substr(h5_file.find_last_of('/') + 1);
+
+    std::ofstream xdmf(stem + ".xdmf");
+    if (!xdmf.good()) {
+        std::stringstream msg;
+        msg << "Failed to open XDMF file: " << stem << ".xdmf";
+        throw EXCEPT(msg.str());
+    }
+
+    xdmf << "<?xml version=\"1.0\" ?>\n";
+    xdmf << "<Xdmf Version=\"3.0\">\n";
+    xdmf << "  <Domain>\n";
+
+    H5Node h5f(h5_file, H5Access::WRITE);
+    for (const auto &grid : grids) {
+        int n_points     = grid.points.size() / 2;
+        std::string path = h5_ref + ":/" + grid.name + "/";
+
+        auto g = h5f.create_group(grid.name);
+        g.write("points", grid.points, {n_points, 2});
+        g.write("topology", grid.topology, {(int)grid.topology.size()});
+
+        xdmf << "    <Grid Name=\"" << grid.name
+             << "\" GridType=\"Uniform\">\n";
+        xdmf << "      <Topology TopologyType=\"Mixed\" NumberOfElements=\""
+             << grid.n_cells << "\">\n";
+        xdmf << "        <DataItem Dimensions=\"" << grid.topology.size()
+             << "\" NumberType=\"Int\" Format=\"HDF\">" << path
+             << "topology</DataItem>\n";
+        xdmf << "      </Topology>\n";
+        xdmf << "      <Geometry GeometryType=\"XY\">\n";
+        xdmf << "        <DataItem Dimensions=\"" << n_points
+             << " 2\" NumberType=\"Float\" Precision=\"8\" Format=\"HDF\">"
+             << path << "points</DataItem>\n";
+        xdmf << "      </Geometry>\n";
+
+        for (const auto &attr : grid.attributes) {
+            assert((int)attr.second.size() == grid.n_cells);
+            g.write(attr.first, attr.second, {grid.n_cells});
+            xdmf << "      <Attribute Name=\"" << attr.first
+                 << "\" AttributeType=\"Scalar\" Center=\"Cell\">\n";
+            xdmf << "        <DataItem Dimensions=\"" << grid.n_cells
+                 << "\" NumberType=\"Int\" Format=\"HDF\">" << path
+                 << attr.first << "</DataItem>\n";
+            xdmf << "      </Attribute>\n";
+        }
+        xdmf << "    </Grid>\n";
+    }
+
+    xdmf << "  </Domain>\n";
+    xdmf << "</Xdmf>" << std::endl;
+
+    return;
+}
+}
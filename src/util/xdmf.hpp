@@ -0,0 +1,75 @@
+/*
+   Copyright 2016 Mitchell Young
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+#include "util/global_config.hpp"
+
+namespace mocc {
+/**
+ * \brief A 2-D unstructured grid of polylines and polygons, for visualization
+ *
+ * The grid is stored in HDF5 and described by an XDMF file, which ParaView
+ * and VisIt can open directly. See \ref write_xdmf().
+ */
+struct XDMFGrid {
+    XDMFGrid(std::string name) : name(name), n_cells(0)
+    {
+        return;
+    }
+
+    /**
+     * \brief Add a cell with the given vertices, which may be any type with
+     * \c x and \c y members
+     *
+     * \param vertices the vertices of the cell, in order
+     * \param closed whether the cell is a polygon, rather than a polyline
+     */
+    template <typename Points>
+    void add_cell(const Points &vertices, bool closed)
+    {
+        int first = points.size() / 2;
+        topology.push_back(closed ? 3 : 2);
+        topology.push_back(vertices.size());
+        for (const auto &p : vertices) {
+            topology.push_back(first++);
+            points.push_back(p.x);
+            points.push_back(p.y);
+        }
+        n_cells++;
+        return;
+    }
+
+    // Name of the grid, which is also its group in the HDF5 file
+    std::string name;
+    // Vertex coordinates, as (x, y) pairs
+    VecF points;
+    // Cells, in XDMF "Mixed" topology: the cell type, the number of
+    // vertices, then the index of each vertex
+    VecI topology;
+    int n_cells;
+    // Integer data on each cell, by name
+    std::vector<std::pair<std::string, VecI>> attributes;
+};
+
+/**
+ * \brief Write grids to \p stem.h5, described by \p stem.xdmf
+ */
+void write_xdmf(const std::string &stem, const std::vector<XDMFGrid> &grids);
+}
@@ -0,0 +1,351 @@
+#!/usr/bin/env python
+"""
+Generate a synthetic, C5G7-like core of any size, for performance testing.
+
+The core is an N x N checkerboard of the C5G7 UO2 and MOX assemblies (UO2 in
+the corners), optionally with a row of moderator assemblies on the south and
+east faces, with M axial planes. The pin meshes, ray options and group count
+are configurable, so that the same problem may be scaled up for weak scaling
+studies, or run at several sizes to extrapolate memory use (e.g. with
+"mocc --dry-run").
+
+Cross sections come from the C5G7 library. For any group count other than
+seven, a library with the requested number of groups is derived from it and
+written next to the input: each C5G7 group is split evenly into several
+groups (or several are merged, with a flat flux, for fewer than seven
+groups). The split library reproduces the C5G7 eigenvalue, so it is only
+useful for its cost, not its physics.
+
+Example:
+    python generate_core.py big.xml --assemblies 15 --planes 32 --groups 23
+"""
+
+from __future__ import print_function
+
+import argparse
+import math
+import os
+
+# C5G7 pin layouts of the UO2 and MOX assemblies. 'g' is a guide tube, 'f' the
+# fission chamber, and the digits the C5G7 fuel or MOX enrichments.
+UO2_LAYOUT = """
+u u u u u u u u u u u u u u u u u
+u u u u u u u u u u u u u u u u u
+u u u u u g u u g u u g u u u u u
+u u u g u u u u u u u u u g u u u
+u u u u u u u u u u u u u u u u u
+u u g u u g u u g u u g u u g u u
+u u u u u u u u u u u u u u u u u
+u u u u u u u u u u u u u u u u u
+u u g u u g u u f u u g u u g u u
+u u u u u u u u u u u u u u u u u
+u u u u u u u u u u u u u u u u u
+u u g u u g u u g u u g u u g u u
+u u u u u u u u u u u u u u u u u
+u u u g u u u u u u u u u g u u u
+u u u u u g u u g u u g u u u u u
+u u u u u u u u u u u u u u u u u
+u u u u u u u u u u u u u u u u u
+"""
+
+MOX_LAYOUT = """
+l l l l l l l l l l l l l l l l l
+l m m m m m m m m m m m m m m m l
+l m m m m g m m g m m g m m m m l
+l m m g m h h h h h h h m g m m l
+l m m m h h h h h h h h h m m m l
+l m g h h g h h g h h g h h g m l
+l m m h h h h h h h h h h h m m l
+l m m h h h h h h h h h h h m m l
+l m g h h g h h f h h g h h g m l
+l m m h h h h h h h h h h h m m l
+l m m h h h h h h h h h h h m m l
+l m g h h g h h g h h g h h g m l
+l m m m h h h h h h h h h m m m l
+l m m g m h h h h h h h m g m m l
+l m m m m g m m g m m g m m m m l
+l m m m m m m m m m m m m m m m l
+l l l l l l l l l l l l l l l l l
+"""
+
+# Pin symbol: (pin ID, material ID of the fuel region)
+PINS = {"u": (1, 1), "l": (2, 2), "m": (3, 3), "h": (4, 4), "f": (5, 5),
+        "g": (7, 7)}
+
+MATERIALS = ["UO2-3.3", "MOX-4.3", "MOX-7.0", "MOX-8.7", "FissCham",
+             "Moderator", "GuideTube"]
+MODERATOR = 6
+
+
+def read_library(path):
+    """
+    Read a text cross-section library, returning its group bounds and the
+    (name, [abs, nu-fiss, fiss, chi] per group, scattering rows) of each
+    material. Row g of the scattering matrix holds the scattering into group g
+    from each group.
+    """
+    with open(path) as f:
+        lines = [l.strip() for l in f]
+    data = [l for l in lines[3:] if l and not l.startswith("!")]
+    n_group, n_mat = [int(v) for v in lines[1].split()[0:2]]
+    bounds = [float(v) for v in lines[2].split()]
+
+    materials = []
+    pos = 0
+    for _ in range(n_mat):
+        name = data[pos].split()[1]
+        pos += 1
+        xs = [[float(v) for v in data[pos + g].split()]
+              for g in range(n_group)]
+        pos += n_group
+        scat = [[float(v) for v in data[pos + g].split()]
+                for g in range(n_group)]
+        pos += n_group
+        materials.append((name, xs, scat))
+    return bounds, materials
+
+
+def remap_library(bounds, materials, n_group):
+    """
+    Map a library onto n_group groups. Each coarse group is split into groups
+    with its cross sections and an even share of its fission spectrum and
+    in-scatter, or several coarse groups are merged with a flat flux.
+    """
+    n_coarse = len(bounds)
+    if n_group >= n_coarse:
+        # Fine groups of each coarse group
+        split = [[g for g in range(n_group) if g * n_coarse // n_group == c]
+                 for c in range(n_coarse)]
+        coarse = [g * n_coarse // n_group for g in range(n_group)]
+        new_materials = []
+        for name, xs, scat in materials:
+            new_xs = []
+            for g in range(n_group):
+                c = coarse[g]
+                a, nf, f, chi = xs[c]
+                new_xs.append([a, nf, f, chi / len(split[c])])
+            new_scat = [[scat[coarse[g]][coarse[gp]] / len(split[coarse[g]])
+                         for gp in range(n_group)] for g in range(n_group)]
+            new_materials.append((name, new_xs, new_scat))
+
+        # Split each group's energy range evenly in lethargy
+        lower = bounds[1:] + [min(1.0e-5, bounds[-1] * 0.1)]
+        new_bounds = []
+        for c in range(n_coarse):
+            n = len(split[c])
+            r = math.log(bounds[c] / lower[c])
+            new_bounds += [bounds[c] * math.exp(-r * i / n) for i in range(n)]
+        return new_bounds, new_materials
+
+    # Coarse groups of each new group
+    merge = [[c for c in range(n_coarse) if c * n_group // n_coarse == g]
+             for g in range(n_group)]
+    new_materials = []
+    for name, xs, scat in materials:
+        new_xs = []
+        for cs in merge:
+            n = float(len(cs))
+            new_xs.append([sum(xs[c][0] for c in cs) / n,
+                           sum(xs[c][1] for c in cs) / n,
+                           sum(xs[c][2] for c in cs) / n,
+                           sum(xs[c][3] for c in cs)])
+        new_scat = [[sum(scat[c][cp] for c in merge[g] for cp in merge[gp]) /
+                     len(merge[gp]) for gp in range(n_group)]
+                    for g in range(n_group)]
+        new_materials.append((name, new_xs, new_scat))
+    return [bounds[cs[0]] for cs in merge], new_materials
+
+
+def write_library(path, bounds, materials, title):
+    with open(path, "w") as f:
+        f.write(title + "\n")
+        f.write(" %d %d\n" % (len(bounds), len(materials)))
+        f.write(" " + " ".join("%.4E" % b for b in bounds) + "\n")
+        for name, xs, scat in materials:
+            f.write("XSMACRO %s 0\n" % name)
+            for row in xs:
+                f.write(" " + " ".join("%.6E" % v for v in row) + "\n")
+            for row in scat:
+                f.write(" " + " ".join("%.6E" % v for v in row) + "\n")
+
+
+def lattice(lid, layout):
+    pins = layout.split()
+    n = int(math.sqrt(len(pins)))
+    out = ['<lattice id="%d" nx="%d" ny="%d">' % (lid, n, n)]
+    for i in range(n):
+        out.append("    " + " ".join(str(PINS[p][0])
+                                     for p in pins[i * n:(i + 1) * n]))
+    out.append("</lattice>")
+    return "\n".join(out)
+
+
+def generate(args):
+    out_dir = os.path.dirname(os.path.abspath(args.output))
+    case = os.path.splitext(os.path.basename(args.output))[0]
+
+    # Cross-section library
+    xsl = os.path.abspath(args.xsl)
+    bounds, materials = read_library(xsl)
+    if args.groups != len(bounds):
+        bounds, materials = remap_library(bounds, materials, args.groups)
+        xsl = os.path.join(out_dir, "%s_%dg.xsl" % (case, args.groups))
+        write_library(xsl, bounds, materials,
+                      "C5G7-derived %d-group cross sections" % args.groups)
+    xsl = os.path.relpath(xsl, out_dir)
+
+    # The north and west boundaries are reflective, so as in C5G7 the
+    # reflector only goes on the south and east faces
+    n_asy = args.assemblies + (1 if args.reflector else 0)
+    core = []
+    for iy in range(n_asy):
+        row = []
+        for ix in range(n_asy):
+            if max(ix, iy) >= args.assemblies:
+                row.append("3")
+            else:
+                row.append("1" if (ix + iy) % 2 == 0 else "2")
+        core.append("    " + " ".join(row))
+
+    radii = " ".join(str(r) for r in args.radii)
+    sub_radii = " ".join(str(r) for r in args.sub_radii)
+    if len(args.radii) != len(args.sub_radii):
+        raise ValueError("Need a ring subdivision for each radius")
+
+    x = []
+    x.append("<case_name>%s</case_name>" % case)
+    x.append("")
+    x.append('<mesh id="1" type="cyl" pitch="1.26">')
+    x.append("    <radii>%s</radii>" % radii)
+    x.append("    <sub_radii>%s</sub_radii>" % sub_radii)
+    x.append("    <sub_azi>%d</sub_azi>" % args.sub_azi)
+    x.append("</mesh>")
+    x.append('<mesh id="2" type="rect" pitch="1.26">')
+    x.append("    <sub_x>%d</sub_x>" % args.sub_xy)
+    x.append("    <sub_y>%d</sub_y>" % args.sub_xy)
+    x.append("</mesh>")
+    x.append("")
+
+    quad = ('<ang_quad type="chebyshev-gauss" n_azimuthal="%d" '
+            'n_polar="%d" />' % (args.n_azimuthal, args.n_polar))
+    rays = '<rays spacing="%g" modularity="core" />' % args.spacing
+    sweeper = args.sweeper
+    if sweeper is None:
+        sweeper = "moc" if args.planes == 1 else "2d3d"
+    x.append('<solver type="eigenvalue" k_tol="1.e-6" psi_tol="1.e-5" '
+             'max_iter="%d" cmfd="t">' % args.max_iter)
+    x.append('    <cmfd enabled="t" />')
+    x.append('    <source scattering="P0" />')
+    if sweeper == "moc":
+        x.append("    " + quad)
+        x.append('    <sweeper type="moc" n_inner="%d">' % args.n_inner)
+        x.append("        " + rays)
+        x.append("    </sweeper>")
+    else:
+        x.append('    <sweeper type="2d3d">')
+        x.append("        " + quad)
+        x.append('        <moc_sweeper n_inner="%d">' % args.n_inner)
+        x.append("            " + rays)
+        x.append("        </moc_sweeper>")
+        x.append('        <sn_sweeper equation="cdd" axial="sc" />')
+        x.append("    </sweeper>")
+    x.append("</solver>")
+    x.append("")
+
+    x.append('<material_lib path="%s">' % xsl)
+    for i, name in enumerate(MATERIALS):
+        x.append('    <material id="%d" name="%s" />' % (i + 1, name))
+    x.append("</material_lib>")
+    x.append("")
+
+    # Fuel pins, with one ring of cladding/gap per extra radius
+    n_ring = len(args.radii)
+    for sym, (pid, mid) in sorted(PINS.items(), key=lambda p: p[1][0]):
+        mats = " ".join([str(mid)] + [str(MODERATOR)] * n_ring)
+        x.append('<pin id="%d" mesh="1">' % pid)
+        x.append("    " + mats)
+        x.append("</pin>")
+    x.append('<pin id="6" mesh="2">')
+    for _ in range(args.sub_xy):
+        x.append("    " + " ".join([str(MODERATOR)] * args.sub_xy))
+    x.append("</pin>")
+    x.append("")
+
+    x.append(lattice(1, UO2_LAYOUT))
+    x.append(lattice(2, MOX_LAYOUT))
+    mod = "\n".join(["    " + " ".join(["6"] * 17)] * 17)
+    x.append('<lattice id="3" nx="17" ny="17">\n%s\n</lattice>' % mod)
+    x.append("")
+
+    hz = args.height / args.planes
+    for aid in (1, 2, 3):
+        x.append('<assembly id="%d" np="%d" hz="%g">' % (aid, args.planes, hz))
+        x.append("    <lattices>")
+        x.append("        " + " ".join([str(aid)] * args.planes))
+        x.append("    </lattices>")
+        x.append("</assembly>")
+    x.append("")
+
+    x.append('<core nx="%d" ny="%d"' % (n_asy, n_asy))
+    x.append('    north  = "reflect"')
+    x.append('    south  = "vacuum"')
+    x.append('    east   = "vacuum"')
+    x.append('    west   = "reflect"')
+    top = "reflect" if args.planes == 1 else "vacuum"
+    x.append('    top    = "%s"' % top)
+    x.append('    bottom = "reflect" >')
+    x += core
+    x.append("</core>")
+
+    with open(args.output, "w") as f:
+        f.write("\n".join(x) + "\n")
+
+    n_pin = (n_asy * 17) ** 2
+    print("Wrote %s: %d x %d assemblies, %d planes, %d groups, %d pins per "
+          "plane" % (args.output, n_asy, n_asy, args.planes, args.groups,
+                     n_pin))
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    parser = argparse.ArgumentParser(
+        description="Generate a scalable C5G7-like MOCC input")
+    parser.add_argument("output", help="the input file to write")
+    parser.add_argument("--assemblies", type=int, default=3,
+                        help="number of fuel assemblies across the core")
+    parser.add_argument("--reflector", action="store_true",
+                        help="surround the core with moderator assemblies")
+    parser.add_argument("--planes", type=int, default=1,
+                        help="number of axial planes")
+    parser.add_argument("--height", type=float, default=1.0,
+                        help="total height of the core (cm)")
+    parser.add_argument("--radii", type=float, nargs="+",
+                        default=[0.54, 0.62], help="pin ring radii (cm)")
+    parser.add_argument("--sub-radii", type=int, nargs="+", default=[5, 2],
+                        help="subdivisions of each pin ring")
+    parser.add_argument("--sub-azi", type=int, default=8,
+                        help="azimuthal subdivisions of the pins")
+    parser.add_argument("--sub-xy", type=int, default=3,
+                        help="x and y subdivisions of the moderator pins")
+    parser.add_argument("--groups", type=int, default=7,
+                        help="number of energy groups")
+    parser.add_argument("--xsl", default=os.path.join(here, "..", "examples",
+                                                      "c5g7.xsl"),
+                        help="the C5G7 cross-section library")
+    parser.add_argument("--sweeper", choices=["moc", "2d3d"],
+                        help="defaults to moc for one plane, 2d3d otherwise")
+    parser.add_argument("--spacing", type=float, default=0.05,
+                        help="ray spacing (cm)")
+    parser.add_argument("--n-azimuthal", type=int, default=8)
+    parser.add_argument("--n-polar", type=int, default=2)
+    parser.add_argument("--n-inner", type=int, default=2)
+    parser.add_argument("--max-iter", type=int, default=100)
+    args = parser.parse_args()
+
+    if min(args.assemblies, args.planes, args.groups) < 1:
+        parser.error("Need at least one assembly, plane and group")
+    generate(args)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,300 @@
+#!/usr/bin/env python
+"""
+Run a MOCC case across thread (and MPI rank) counts, and report the parallel
+efficiency of each phase of the calculation.
+
+Each run writes its timer tree to /performance/timers of its HDF5 output, and,
+when MOCC is built with the PROFILE_ZONES option, the per-thread profile zones
+to /profile. From these the time of each phase is found:
+
+    sweep      the transport sweeps (MoC and/or Sn "Sweep" timers)
+    source     source construction
+    reduction  reduction of the thread-private flux tallies (profile zones)
+    cmfd       the CMFD solves
+    boundary   boundary condition updates (profile zones)
+    other      the rest of the wall time, not covered by the phases above
+
+Zone times are taken from the slowest thread, since that is what the others
+wait on. For every configuration the speedup and efficiency of each phase are
+given relative to the first (smallest) configuration, along with the
+Karp-Flatt estimate of its serial fraction. A phase whose serial fraction does
+not fall as the process count grows is the one to attack next.
+
+The reduction and boundary updates happen within the sweeps, so their time is
+also part of "sweep".
+
+Example:
+    python scaling_study.py c5g7_2d.xml --threads 1,2,4,8 --csv scaling.csv
+    python scaling_study.py big.xml --ranks 1,2,4 --threads 4 \\
+        --mpirun "mpirun -np {ranks}"
+"""
+
+from __future__ import print_function
+
+import argparse
+import json
+import os
+import re
+import shlex
+import subprocess
+import sys
+
+try:
+    import h5py
+except ImportError:
+    h5py = None
+
+PHASES = ["sweep", "source", "reduction", "cmfd", "boundary", "other"]
+
+# Timer tree paths (under the root timer) summed into each phase
+PHASE_TIMERS = {
+    "sweep": ["MoC Sweeper/Sweep", "Sn Sweeper/Sweep"],
+    "source": ["Source Construction"],
+    "cmfd": ["CMFD"],
+}
+
+# Profile zones summed into each phase
+PHASE_ZONES = {
+    "reduction": ["Reduction"],
+    "boundary": ["Boundary Update"],
+}
+
+
+def int_list(s):
+    values = [int(v) for v in s.split(",")]
+    if min(values) < 1:
+        raise argparse.ArgumentTypeError("counts must be positive")
+    return values
+
+
+def zone_times(group, name, times):
+    """
+    Sum the per-thread times of every zone called name under an HDF5 group,
+    at any depth, into times.
+    """
+    for key, item in group.items():
+        if not isinstance(item, h5py.Group):
+            continue
+        if key == name and "time" in item:
+            t = list(item["time"][()])
+            times.extend([0.0] * (len(t) - len(times)))
+            for i, v in enumerate(t):
+                times[i] += v
+        else:
+            zone_times(item, name, times)
+    return times
+
+
+def find_value(group, name):
+    """
+    Return the first scalar dataset called name under an HDF5 group
+    """
+    for key, item in group.items():
+        if isinstance(item, h5py.Group):
+            v = find_value(item, name)
+            if v is not None:
+                return v
+        elif key == name:
+            return float(item[()])
+    return None
+
+
+def read_run(fname):
+    """
+    Read the wall time, phase times and sweep throughput of a run
+    """
+    with h5py.File(fname, "r") as f:
+        perf = f["performance"]
+        result = {"wall": float(perf["wall_time"][()])}
+        timers = perf.get("timers")
+        if timers is None:
+            raise RuntimeError("%s has no timer tree; is its MOCC too old?"
+                               % fname)
+
+        for phase in PHASES:
+            result[phase] = 0.0
+        for phase, paths in PHASE_TIMERS.items():
+            for path in paths:
+                if path in timers:
+                    result[phase] += float(timers[path]["time"][()])
+
+        profile = f.get("profile")
+        for phase, zones in PHASE_ZONES.items():
+            if profile is None:
+                result[phase] = None
+                continue
+            for zone in zones:
+                times = zone_times(profile, zone, [])
+                result[phase] += max(times) if times else 0.0
+
+        covered = sum(result[p] for p in PHASE_TIMERS)
+        result["other"] = max(result["wall"] - covered, 0.0)
+
+        result["segments_per_second"] = find_value(perf,
+                                                   "segments_per_second")
+    return result
+
+
+def run_case(args, ranks, threads, rep):
+    case = "%s_r%d_t%d" % (args.prefix, ranks, threads)
+    if args.repeat > 1:
+        case += "_%d" % rep
+    cmd = shlex.split(args.mocc) + ["--case-name", case]
+    if args.set_threads:
+        cmd += ["-a", "parallel/num_threads=%d" % threads]
+    cmd.append(os.path.basename(args.input))
+    if args.mpirun:
+        cmd = shlex.split(args.mpirun.format(ranks=ranks)) + cmd
+    elif ranks > 1:
+        raise RuntimeError("Rank counts above one need --mpirun")
+
+    env = dict(os.environ)
+    env["OMP_NUM_THREADS"] = str(threads)
+    work_dir = os.path.dirname(os.path.abspath(args.input))
+    print("Running: " + " ".join(cmd))
+    sys.stdout.flush()
+    with open(os.path.join(work_dir, case + ".out"), "w") as log:
+        status = subprocess.call(cmd, cwd=work_dir, env=env, stdout=log,
+                                 stderr=subprocess.STDOUT)
+    if status != 0:
+        raise RuntimeError("%s failed; see %s.out" % (case, case))
+    return read_run(os.path.join(work_dir, case + ".h5"))
+
+
+def karp_flatt(speedup, p):
+    if p <= 1.0 or speedup <= 0.0:
+        return None
+    return (1.0 / speedup - 1.0 / p) / (1.0 - 1.0 / p)
+
+
+def analyze(runs):
+    """
+    Add the speedup, efficiency and serial fraction of each phase, relative
+    to the first run
+    """
+    base = runs[0]
+    p_base = base["ranks"] * base["threads"]
+    for r in runs:
+        p = float(r["ranks"] * r["threads"]) / p_base
+        for phase in ["wall"] + PHASES:
+            t0 = base[phase]
+            t = r[phase]
+            if not t0 or not t:
+                r[phase + "_speedup"] = None
+                r[phase + "_efficiency"] = None
+                r[phase + "_serial"] = None
+                continue
+            s = t0 / t
+            r[phase + "_speedup"] = s
+            r[phase + "_efficiency"] = s / p
+            r[phase + "_serial"] = karp_flatt(s, p)
+    return runs
+
+
+def fmt(v, spec):
+    return "-" if v is None else spec % v
+
+
+def report(runs):
+    print()
+    print("Phase times (s), and efficiency relative to %d rank(s) x %d "
+          "thread(s):" % (runs[0]["ranks"], runs[0]["threads"]))
+    header = "%6s %7s" % ("ranks", "threads")
+    for phase in ["wall"] + PHASES:
+        header += " %10s %6s" % (phase, "eff")
+    print(header)
+    for r in runs:
+        line = "%6d %7d" % (r["ranks"], r["threads"])
+        for phase in ["wall"] + PHASES:
+            line += " %10s %6s" % (fmt(r[phase], "%.4g"),
+                                   fmt(r[phase + "_efficiency"], "%.2f"))
+        print(line)
+
+    last = runs[-1]
+    if last["ranks"] * last["threads"] > runs[0]["ranks"] * runs[0]["threads"]:
+        print()
+        print("Estimated serial fraction at %d rank(s) x %d thread(s):"
+              % (last["ranks"], last["threads"]))
+        for phase in sorted(PHASES, key=lambda p: -(last[p] or 0.0)):
+            if last[phase + "_serial"] is None:
+                continue
+            print("    %-10s %6.1f%% of the wall time, serial fraction %.3f"
+                  % (phase, 100.0 * last[phase] / last["wall"],
+                     last[phase + "_serial"]))
+
+    rates = [r for r in runs if r["segments_per_second"]]
+    if rates:
+        print()
+        print("Sweep throughput (segments/s):")
+        for r in rates:
+            print("    %d x %d: %.4g" % (r["ranks"], r["threads"],
+                                         r["segments_per_second"]))
+
+
+def write_csv(fname, runs):
+    keys = ["ranks", "threads", "segments_per_second"]
+    for phase in ["wall"] + PHASES:
+        keys += [phase, phase + "_speedup", phase + "_efficiency",
+                 phase + "_serial"]
+    with open(fname, "w") as f:
+        f.write(",".join(keys) + "\n")
+        for r in runs:
+            f.write(",".join("" if r[k] is None else str(r[k]) for k in keys) +
+                    "\n")
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Measure the parallel scaling of each phase of a MOCC "
+                    "run")
+    parser.add_argument("input", help="MOCC input file")
+    parser.add_argument("--threads", type=int_list, default=[1, 2, 4],
+                        help="comma-separated thread counts [1,2,4]")
+    parser.add_argument("--ranks", type=int_list, default=[1],
+                        help="comma-separated MPI rank counts [1]")
+    parser.add_argument("--mpirun",
+                        help="MPI launcher, with {ranks} for the rank count, "
+                             "e.g. \"mpirun -np {ranks}\"")
+    parser.add_argument("--mocc", default="mocc",
+                        help="MOCC executable [mocc]")
+    parser.add_argument("--repeat", type=int, default=1,
+                        help="runs of each configuration; the fastest is "
+                             "kept [1]")
+    parser.add_argument("--prefix", default="scaling",
+                        help="case name prefix of the runs [scaling]")
+    parser.add_argument("--csv", help="write the results to a CSV file")
+    parser.add_argument("--json", help="write the results to a JSON file")
+    args = parser.parse_args()
+
+    if h5py is None:
+        parser.error("h5py is needed to read the MOCC output")
+
+    # An explicit thread count in the input would override OMP_NUM_THREADS
+    with open(args.input) as f:
+        args.set_threads = re.search(r"<parallel[^>]*num_threads",
+                                     f.read()) is not None
+
+    runs = []
+    for ranks in args.ranks:
+        for threads in args.threads:
+            best = None
+            for rep in range(args.repeat):
+                r = run_case(args, ranks, threads, rep)
+                if best is None or r["wall"] < best["wall"]:
+                    best = r
+            best["ranks"] = ranks
+            best["threads"] = threads
+            runs.append(best)
+    runs.sort(key=lambda r: (r["ranks"] * r["threads"], r["ranks"]))
+
+    analyze(runs)
+    report(runs)
+    if args.csv:
+        write_csv(args.csv, runs)
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump(runs, f, indent=2)
+
+
+if __name__ == "__main__":
+    main()